@@ -9,21 +9,33 @@
 
 /* .Call calls */
 extern SEXP XLearnCreate_R(SEXP);
+extern SEXP XLearnCreateDataFromCSC_R(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP XLearnCreateDataFromMat_R(SEXP, SEXP);
 extern SEXP XLearnFit_R(SEXP, SEXP);
 extern SEXP XLearnPredict_R(SEXP, SEXP, SEXP);
+extern SEXP XLearnPredictForMat_R(SEXP, SEXP);
+extern SEXP XLearnSetBool_R(SEXP, SEXP, SEXP);
+extern SEXP XLearnSetDMatrix_R(SEXP, SEXP, SEXP);
 extern SEXP XLearnSetFloat_R(SEXP, SEXP, SEXP);
 extern SEXP XLearnSetInt_R(SEXP, SEXP, SEXP);
 extern SEXP XLearnSetStr_R(SEXP, SEXP, SEXP);
+extern SEXP XLearnSetTest_R(SEXP, SEXP);
 extern SEXP XLearnSetTrain_R(SEXP, SEXP);
 extern SEXP XLearnSetValidate_R(SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
   {"XLearnCreate_R",      (DL_FUNC) &XLearnCreate_R,      1},
+  {"XLearnCreateDataFromCSC_R", (DL_FUNC) &XLearnCreateDataFromCSC_R, 5},
+  {"XLearnCreateDataFromMat_R", (DL_FUNC) &XLearnCreateDataFromMat_R, 2},
   {"XLearnFit_R",         (DL_FUNC) &XLearnFit_R,         2},
   {"XLearnPredict_R",     (DL_FUNC) &XLearnPredict_R,     3},
+  {"XLearnPredictForMat_R", (DL_FUNC) &XLearnPredictForMat_R, 2},
+  {"XLearnSetBool_R",     (DL_FUNC) &XLearnSetBool_R,     3},
+  {"XLearnSetDMatrix_R",  (DL_FUNC) &XLearnSetDMatrix_R,  3},
   {"XLearnSetFloat_R",    (DL_FUNC) &XLearnSetFloat_R,    3},
   {"XLearnSetInt_R",      (DL_FUNC) &XLearnSetInt_R,      3},
   {"XLearnSetStr_R",      (DL_FUNC) &XLearnSetStr_R,      3},
+  {"XLearnSetTest_R",     (DL_FUNC) &XLearnSetTest_R,     2},
   {"XLearnSetTrain_R",    (DL_FUNC) &XLearnSetTrain_R,    2},
   {"XLearnSetValidate_R", (DL_FUNC) &XLearnSetValidate_R, 2},
   {NULL, NULL, 0}
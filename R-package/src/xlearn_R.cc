@@ -53,6 +53,94 @@ SEXP XLearnCreate_R(SEXP model_type) {
     return ret;
 }
 
+void _XLearnDataFinalizer(SEXP ext) {
+    R_API_BEGIN();
+    if (R_ExternalPtrAddr(ext) == NULL) return;
+    void *r_exptr=R_ExternalPtrAddr(ext);
+    CHECK_CALL(XlearnDataFree(&r_exptr));
+    R_ClearExternalPtr(ext);
+    R_API_END();
+}
+
+// Create the data matrix from the slots of a dgCMatrix, which
+// is in the CSC format, and the label can be NULL
+SEXP XLearnCreateDataFromCSC_R(SEXP p, SEXP i, SEXP x,
+                               SEXP nrow, SEXP label) {
+    SEXP ret;
+    DataHandle out;
+    R_API_BEGIN();
+    index_t num_row = Rf_asInteger(nrow);
+    index_t num_col = Rf_length(p) - 1;
+    const int* col_ptr = INTEGER(p);
+    const int* row_ind = INTEGER(i);
+    const double* val = REAL(x);
+    // The index types of R and the values in double are converted
+    std::vector<uint64> indptr(col_ptr, col_ptr + num_col + 1);
+    std::vector<index_t> indices(row_ind, row_ind + Rf_length(i));
+    std::vector<real_t> data(val, val + Rf_length(x));
+    std::vector<real_t> y;
+    if (!Rf_isNull(label)) {
+        y.assign(REAL(label), REAL(label) + Rf_length(label));
+        if (y.size() != num_row) {
+            Rf_error("The label must have one value for each row");
+        }
+    }
+    CHECK_CALL(XlearnCreateDataFromCSC(indptr.data(), indices.data(),
+                                       data.data(), num_row, num_col,
+                                       y.empty() ? NULL : y.data(),
+                                       NULL, &out));
+    ret = PROTECT(R_MakeExternalPtr(out, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ret, _XLearnDataFinalizer, TRUE);
+    R_API_END();
+    UNPROTECT(1);
+    return ret;
+}
+
+// Create the data matrix from a dense numeric matrix, which is
+// in the column-major order of R, and the label can be NULL
+SEXP XLearnCreateDataFromMat_R(SEXP x, SEXP label) {
+    SEXP ret;
+    DataHandle out;
+    R_API_BEGIN();
+    index_t num_row = Rf_nrows(x);
+    index_t num_col = Rf_ncols(x);
+    const double* val = REAL(x);
+    // The rows of xLearn are in the row-major order of float
+    std::vector<real_t> data((size_t)num_row * num_col);
+    for (index_t j = 0; j < num_col; ++j) {
+        const double* col = val + (size_t)j * num_row;
+        for (index_t r = 0; r < num_row; ++r) {
+            data[(size_t)r * num_col + j] = col[r];
+        }
+    }
+    std::vector<real_t> y;
+    if (!Rf_isNull(label)) {
+        y.assign(REAL(label), REAL(label) + Rf_length(label));
+        if (y.size() != num_row) {
+            Rf_error("The label must have one value for each row");
+        }
+    }
+    CHECK_CALL(XlearnCreateDataFromMat(data.data(), num_row, num_col,
+                                       y.empty() ? NULL : y.data(),
+                                       NULL, &out));
+    ret = PROTECT(R_MakeExternalPtr(out, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ret, _XLearnDataFinalizer, TRUE);
+    R_API_END();
+    UNPROTECT(1);
+    return ret;
+}
+
+// Set the data matrix of train, test or validate
+SEXP XLearnSetDMatrix_R(SEXP out, SEXP key, SEXP data) {
+    R_API_BEGIN();
+    void *r_exptr=R_ExternalPtrAddr(out);
+    void *r_data=R_ExternalPtrAddr(data);
+    CHECK_CALL(XLearnSetDMatrix(&r_exptr,
+                                CHAR(Rf_asChar(key)),
+                                &r_data));
+    R_API_END();
+}
+
 // Show the model information
 SEXP XLearnShow_R(SEXP out) {
     R_API_BEGIN();
@@ -109,12 +197,33 @@ SEXP XLearnCV_R(SEXP out) {
 SEXP XLearnPredict_R(SEXP out, SEXP model_path, SEXP out_path) {
     R_API_BEGIN();
     void *r_exptr=R_ExternalPtrAddr(out);
-    CHECK_CALL(XLearnPredict(&r_exptr,
-                             CHAR(Rf_asChar(model_path)),
-                             CHAR(Rf_asChar(out_path))));
+    CHECK_CALL(XLearnPredictForFile(&r_exptr,
+                                    CHAR(Rf_asChar(model_path)),
+                                    CHAR(Rf_asChar(out_path))));
     R_API_END();
 }
 
+// Start to predict, and return the results as a numeric vector,
+// which is filled from the results kept by the handle
+SEXP XLearnPredictForMat_R(SEXP out, SEXP model_path) {
+    SEXP ret;
+    uint64 length = 0;
+    const float* preds = NULL;
+    R_API_BEGIN();
+    void *r_exptr=R_ExternalPtrAddr(out);
+    CHECK_CALL(XLearnPredictForMat(&r_exptr,
+                                   CHAR(Rf_asChar(model_path)),
+                                   &length, &preds));
+    ret = PROTECT(Rf_allocVector(REALSXP, length));
+    double* res = REAL(ret);
+    for (uint64 i = 0; i < length; ++i) {
+        res[i] = preds[i];
+    }
+    R_API_END();
+    UNPROTECT(1);
+    return ret;
+}
+
 // Set string param
 SEXP XLearnSetStr_R(SEXP out, SEXP key, SEXP value) {
     R_API_BEGIN();
@@ -3,6 +3,7 @@
 #define R_NO_REMAP
 
 #include <Rinternals.h>
+#include <vector>
 #include <stdlib.h> // for NULL
 #include <R_ext/Rdynload.h>
 #include <R_ext/Random.h>
@@ -16,6 +17,16 @@ XL_DLL SEXP XLearnCreate_R(SEXP model_type, SEXP out);
 // Free the xLearn handle
 XL_DLL SEXP XLearnHandleFree_R(SEXP out);
 
+// Create the data matrix from the slots of a dgCMatrix
+XL_DLL SEXP XLearnCreateDataFromCSC_R(SEXP p, SEXP i, SEXP x,
+                                      SEXP nrow, SEXP label);
+
+// Create the data matrix from a dense numeric matrix
+XL_DLL SEXP XLearnCreateDataFromMat_R(SEXP x, SEXP label);
+
+// Set the data matrix of train, test or validate
+XL_DLL SEXP XLearnSetDMatrix_R(SEXP out, SEXP key, SEXP data);
+
 // Show the model information
 XL_DLL SEXP XLearnShow_R(SEXP out);
 
@@ -37,6 +48,9 @@ XL_DLL SEXP XLearnCV_R(SEXP out);
 // Start to predict
 XL_DLL SEXP XLearnPredict_R(SEXP out, SEXP model_path, SEXP out_path);
 
+// Start to predict, and return the results as a numeric vector
+XL_DLL SEXP XLearnPredictForMat_R(SEXP out, SEXP model_path);
+
 // Set string param
 XL_DLL SEXP XLearnSetStr_R(SEXP out, SEXP key, SEXP value);
 
@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the generator of the synthetic CTR data for the
+benchmarks, which writes the libffm or the libsvm rows:
+
+  ./gen_data -o train.txt -rows 1000000 -fields 24 -features 1000000 \
+             -zipf 1.1 -nnz 20 -len poisson -format ffm -seed 1
+
+Each field has its own range of the feature ids, which are
+drawn by the Zipf distribution of the given exponent, so a few
+features are very frequent as in the CTR logs. A row has one
+feature in each of its fields, and the number of the fields of
+a row is fixed, uniform in [1, 2 * nnz] or Poisson of mean nnz
+(-len fixed|uniform|poisson). The label is drawn by a hidden
+logistic model of the features, so the data can be learned.
+The same seed gives the same file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+struct GenOption {
+  std::string output = "synthetic.txt";
+  std::string format = "ffm";
+  std::string len = "poisson";
+  uint64 rows = 100000;
+  index_t fields = 24;
+  index_t features = 1000000;
+  index_t nnz = 20;
+  double zipf = 1.1;
+  /* Bias of the hidden model, which sets the ratio of the clicks */
+  double bias = -1.5;
+  uint32 seed = 1;
+};
+
+static void usage() {
+  printf("Usage: gen_data [-o synthetic.txt] [-rows 100000] [-fields 24]\n"
+         "  [-features 1000000] [-nnz 20] [-len fixed|uniform|poisson]\n"
+         "  [-zipf 1.1] [-format ffm|libsvm] [-bias -1.5] [-seed 1]\n");
+  exit(0);
+}
+
+static void parse_option(int argc, char* argv[], GenOption* option) {
+  for (int i = 1; i < argc; i += 2) {
+    std::string name = argv[i];
+    if (i + 1 >= argc) { usage(); }
+    std::string value = argv[i + 1];
+    if (name == "-o") {
+      option->output = value;
+    } else if (name == "-format") {
+      option->format = value;
+    } else if (name == "-len") {
+      option->len = value;
+    } else if (name == "-rows") {
+      option->rows = strtoull(value.c_str(), nullptr, 10);
+    } else if (name == "-fields") {
+      option->fields = atoi(value.c_str());
+    } else if (name == "-features") {
+      option->features = atoi(value.c_str());
+    } else if (name == "-nnz") {
+      option->nnz = atoi(value.c_str());
+    } else if (name == "-zipf") {
+      option->zipf = atof(value.c_str());
+    } else if (name == "-bias") {
+      option->bias = atof(value.c_str());
+    } else if (name == "-seed") {
+      option->seed = atoi(value.c_str());
+    } else {
+      usage();
+    }
+  }
+  if ((option->format != "ffm" && option->format != "libsvm") ||
+      (option->len != "fixed" && option->len != "uniform" &&
+       option->len != "poisson") ||
+      option->rows == 0 || option->fields == 0 || option->nnz == 0 ||
+      option->features < option->fields || option->zipf <= 0) {
+    usage();
+  }
+}
+
+// The weight of the hidden model, which only depends on the id.
+static double hidden_weight(index_t id) {
+  uint64 h = (id + 1) * 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 31;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 29;
+  return (double)(h >> 11) / (1ULL << 53) * 2.0 - 1.0;
+}
+
+static uint64 gcd(uint64 a, uint64 b) {
+  while (b != 0) {
+    uint64 t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// The Zipf distribution over the ranks [0, n), which is the binary
+// search of the cumulative weights 1 / (rank + 1)^s.
+class ZipfSampler {
+ public:
+  ZipfSampler(index_t n, double s) : cdf_(n) {
+    double sum = 0;
+    for (index_t r = 0; r < n; ++r) {
+      sum += 1.0 / pow(r + 1.0, s);
+      cdf_[r] = sum;
+    }
+    for (index_t r = 0; r < n; ++r) {
+      cdf_[r] /= sum;
+    }
+  }
+
+  template <typename Gen>
+  index_t operator()(Gen& gen) {
+    double u = std::uniform_real_distribution<double>(0, 1)(gen);
+    size_t r = std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    return std::min(r, cdf_.size() - 1);
+  }
+
+ private:
+  std::vector<double> cdf_;
+};
+
+static void generate(const GenOption& option) {
+  FILE* file = fopen(option.output.c_str(), "w");
+  if (file == nullptr) {
+    printf("Cannot open the file %s\n", option.output.c_str());
+    exit(0);
+  }
+  index_t per_field = option.features / option.fields;
+  // The ranks of the popularity are scattered over the ids of the
+  // field, so the frequent features are not next to each other
+  uint64 stride = 2654435761ULL % per_field;
+  while (stride == 0 || gcd(stride, per_field) != 1) {
+    stride++;
+  }
+  ZipfSampler zipf(per_field, option.zipf);
+  std::mt19937_64 gen(option.seed);
+  std::poisson_distribution<int> poisson(option.nnz);
+  std::uniform_int_distribution<int> uniform(1, 2 * option.nnz);
+  std::uniform_real_distribution<double> coin(0, 1);
+  std::vector<index_t> fields(option.fields);
+  for (index_t f = 0; f < option.fields; ++f) { fields[f] = f; }
+  std::vector<index_t> ids;
+  std::string line;
+  char buf[64];
+  uint64 clicks = 0;
+  uint64 total_nnz = 0;
+  for (uint64 r = 0; r < option.rows; ++r) {
+    int len = option.nnz;
+    if (option.len == "poisson") {
+      len = poisson(gen);
+    } else if (option.len == "uniform") {
+      len = uniform(gen);
+    }
+    len = std::max(1, std::min(len, (int)option.fields));
+    // The first len of the shuffled fields
+    for (int i = 0; i < len; ++i) {
+      int j = i + gen() % (option.fields - i);
+      std::swap(fields[i], fields[j]);
+    }
+    std::sort(fields.begin(), fields.begin() + len);
+    ids.resize(len);
+    double score = option.bias;
+    for (int i = 0; i < len; ++i) {
+      index_t rank = zipf(gen);
+      ids[i] = fields[i] * per_field + rank * stride % per_field;
+      score += hidden_weight(ids[i]);
+    }
+    int label = coin(gen) < 1.0 / (1.0 + exp(-score)) ? 1 : 0;
+    clicks += label;
+    total_nnz += len;
+    line = label ? "1" : "0";
+    for (int i = 0; i < len; ++i) {
+      if (option.format == "ffm") {
+        snprintf(buf, sizeof(buf), " %u:%u:1", fields[i], ids[i]);
+      } else {
+        snprintf(buf, sizeof(buf), " %u:1", ids[i]);
+      }
+      line += buf;
+    }
+    line += "\n";
+    fwrite(line.data(), 1, line.size(), file);
+  }
+  fclose(file);
+  printf("%s: %llu rows, %.1f features per row, %.1f%% clicks\n",
+         option.output.c_str(), (unsigned long long)option.rows,
+         (double)total_nnz / option.rows, 100.0 * clicks / option.rows);
+}
+
+}  // namespace xLearn
+
+int main(int argc, char* argv[]) {
+  xLearn::GenOption option;
+  xLearn::parse_option(argc, argv, &option);
+  xLearn::generate(option);
+  return 0;
+}
@@ -0,0 +1,206 @@
+# Copyright (c) 2018 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# The comparison of xLearn with libffm and libFM on the same CTR data,
+# which is run in the bench directory of the build:
+#
+#   ROWS=1000000 THREADS="1 4 8" LIBFFM=~/libffm LIBFM=~/libfm/bin \
+#     ./run_compare.sh
+#
+# The data is the synthetic data of gen_data by default, or the libffm
+# files of TRAIN and TEST, e.g., the Criteo or the Avazu data of the
+# libffm format. The libsvm files of libFM are converted from them.
+#
+# For each number of the threads, it trains and predicts by xLearn
+# (linear, fm and ffm, in memory and on disk with --disk), by the
+# ffm-train and ffm-predict of libffm (in the LIBFFM directory), and
+# by libFM (in the LIBFM directory, which only has one thread), with
+# the same k, learning rate, lambda and epochs. The engines that are
+# not given are skipped. xLearn uses sgd for fm as libFM does, and
+# adagrad for ffm as libffm does. It prints the seconds of the training
+# (with the parsing of the data), the rows of all the epochs per second
+# of it, the peak RSS of the training, and the logloss and AUC of the test
+# data, which are computed from the predictions of each engine by the
+# same script.
+
+ROWS=${ROWS:-200000}
+FIELDS=${FIELDS:-24}
+FEATURES=${FEATURES:-1000000}
+NNZ=${NNZ:-20}
+EPOCH=${EPOCH:-5}
+K=${K:-4}
+LR=${LR:-0.2}
+LAMBDA=${LAMBDA:-0.00002}
+THREADS=${THREADS:-"1 2 4"}
+DATA=${DATA:-compare_data}
+LIBFFM=${LIBFFM:-}
+LIBFM=${LIBFM:-}
+
+cd "$(dirname "$0")"
+XLEARN=..
+mkdir -p $DATA
+
+# The synthetic data is generated again only if its options change
+if [ -z "$TRAIN" ]; then
+  TRAIN=$DATA/train.txt
+  TEST=$DATA/test.txt
+  OPTION="-rows $ROWS -fields $FIELDS -features $FEATURES -nnz $NNZ \
+-format ffm"
+  if [ ! -f $DATA/option ] || [ "$(cat $DATA/option)" != "$OPTION" ]; then
+    ./gen_data -o $TRAIN $OPTION -seed 1 || exit 1
+    ./gen_data -o $TEST $OPTION -rows $(( ROWS / 10 + 1 )) -seed 2 || exit 1
+    echo "$OPTION" > $DATA/option
+    rm -f $DATA/*.libfm
+  fi
+fi
+TRAIN_ROWS=$(wc -l < $TRAIN)
+LABEL=$DATA/label.txt
+OUT=$DATA/out.txt
+LOG=$DATA/log.txt
+cut -d ' ' -f 1 $TEST > $LABEL
+
+now() {
+  date +%s.%N
+}
+
+# The seconds between two times of now()
+elapsed() {
+  awk -v a=$1 -v b=$2 'BEGIN { printf "%.2f", b - a }'
+}
+
+rows_per_sec() {
+  awk -v n=$1 -v t=$2 'BEGIN { if (t > 0) printf "%.0f", n / t; else print "-" }'
+}
+
+# Run the command with its output in the log, and set WALL to its
+# seconds and RSS to its peak resident memory (MB), which is given by
+# GNU time, or polled from /proc while it runs without GNU time (so
+# the peak of a run shorter than the poll can be missed).
+run() {
+  START=$(now)
+  PEAK=0
+  if [ -x /usr/bin/time ]; then
+    /usr/bin/time -f "%M" -o $LOG.rss "$@" > $LOG 2>&1 ||
+      { cat $LOG; exit 1; }
+    PEAK=$(tail -1 $LOG.rss)
+  else
+    "$@" > $LOG 2>&1 &
+    PID=$!
+    while kill -0 $PID 2>/dev/null; do
+      HWM=$(awk '/^VmHWM/ { print $2 }' /proc/$PID/status 2>/dev/null)
+      if [ -n "$HWM" ]; then PEAK=$HWM; fi
+      sleep 0.05
+    done
+    wait $PID || { cat $LOG; exit 1; }
+  fi
+  WALL=$(elapsed $START $(now))
+  RSS=$(awk -v k=$PEAK 'BEGIN { printf "%.0f", k / 1024 }')
+}
+
+# The logloss and the AUC of the probabilities in the file, whose
+# lines are of the lines of the test data. The label is positive if
+# it is larger than 0, and the tied scores share their mean rank.
+evaluate() {
+  paste -d ' ' $LABEL $1 | sort -g -k 2 | awk '
+    function flush() {
+      rank = (seen + 1 + seen + group) / 2
+      rank_sum += rank * group_pos
+      seen += group
+      group = 0
+      group_pos = 0
+    }
+    {
+      y = $1 > 0 ? 1 : 0
+      p = $2 < 1e-15 ? 1e-15 : ($2 > 1 - 1e-15 ? 1 - 1e-15 : $2)
+      loss -= y ? log(p) : log(1 - p)
+      if (NR > 1 && $2 != last) { flush() }
+      last = $2
+      group++
+      group_pos += y
+      pos += y
+    }
+    END {
+      flush()
+      neg = NR - pos
+      auc = 0
+      if (pos > 0 && neg > 0) {
+        auc = (rank_sum - pos * (pos + 1) / 2) / (pos * neg)
+      }
+      printf "%.6f %.6f", loss / NR, auc
+    }'
+}
+
+report() {
+  printf "%-7s %-7s %-6s %7s %10s %12s %9s %9s %9s\n" $1 $2 $3 $4 \
+    $WALL $(rows_per_sec $(( TRAIN_ROWS * EPOCH )) $WALL) $RSS \
+    $(evaluate $OUT)
+}
+
+printf "%-7s %-7s %-6s %7s %10s %12s %9s %9s %9s\n" "engine" "model" \
+  "reader" "thread" "train(s)" "train(row/s)" "RSS(MB)" "logloss" "AUC"
+for t in $THREADS; do
+  # xLearn, where the binary cache is written by a first run
+  for reader in inmem disk; do
+    if [ $reader = "disk" ]; then
+      DISK="--disk"
+    else
+      DISK=""
+    fi
+    for score in 0 1 2; do
+      case $score in
+        0) MODEL=linear; OPT="-p sgd" ;;
+        1) MODEL=fm; OPT="-p sgd" ;;
+        2) MODEL=ffm; OPT="-p adagrad" ;;
+      esac
+      ARGS="-s $score -k $K -r $LR -b $LAMBDA -e $EPOCH -nthread $t \
+$OPT $DISK --dis-es -m $DATA/xlearn.model"
+      rm -f $TRAIN*.bin $TEST*.bin
+      $XLEARN/xlearn_train $TRAIN $ARGS > $LOG 2>&1 || { cat $LOG; exit 1; }
+      run $XLEARN/xlearn_train $TRAIN $ARGS
+      $XLEARN/xlearn_predict $TEST $DATA/xlearn.model -nthread $t \
+        $DISK --sigmoid -o $OUT > $LOG 2>&1 || { cat $LOG; exit 1; }
+      report xlearn $MODEL $reader $t
+    done
+  done
+  # libffm, which reads the text of the libffm format
+  if [ -n "$LIBFFM" ]; then
+    run $LIBFFM/ffm-train -k $K -t $EPOCH -r $LR -l $LAMBDA -s $t \
+      $TRAIN $DATA/libffm.model
+    $LIBFFM/ffm-predict $TEST $DATA/libffm.model $OUT > $LOG 2>&1 ||
+      { cat $LOG; exit 1; }
+    report libffm ffm inmem $t
+  fi
+done
+
+# libFM, which reads the libsvm format and only has one thread
+if [ -n "$LIBFM" ]; then
+  for f in $TRAIN $TEST; do
+    if [ ! -f $f.libfm ]; then
+      awk '{ printf "%s", $1
+             for (i = 2; i <= NF; ++i) {
+               split($i, a, ":")
+               printf " %s:%s", a[2], a[3]
+             }
+             printf "\n" }' $f > $f.libfm
+    fi
+  done
+  for dim in 0 $K; do
+    if [ $dim = 0 ]; then MODEL=linear; else MODEL=fm; fi
+    run $LIBFM/libFM -task c -train $TRAIN.libfm -test $TEST.libfm \
+      -dim "1,1,$dim" -iter $EPOCH -method sgd -learn_rate $LR \
+      -regular "0,0,$LAMBDA" -init_stdev 0.1 -out $OUT
+    report libfm $MODEL inmem 1
+  done
+fi
+rm -f $TRAIN*.bin $TEST*.bin $DATA/*.model $OUT $LABEL $LOG.rss
@@ -0,0 +1,109 @@
+# Copyright (c) 2018 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# The end-to-end benchmark of xLearn on the synthetic CTR data,
+# which is run in the bench directory of the build:
+#
+#   ROWS=1000000 THREADS="1 2 4 8" ./run_e2e.sh
+#
+# For the in-memory reader and the on-disk reader (--disk), and each
+# number of the threads, it trains the model twice: the first time
+# parses the text and writes the binary cache, and the second time
+# reads the cache. It prints the seconds of reading the problem, of
+# the epochs (with the validation) and of the prediction, and the
+# rows per second of the training and the prediction.
+
+ROWS=${ROWS:-200000}
+FIELDS=${FIELDS:-24}
+FEATURES=${FEATURES:-1000000}
+NNZ=${NNZ:-20}
+LEN=${LEN:-poisson}
+ZIPF=${ZIPF:-1.1}
+FORMAT=${FORMAT:-ffm}
+SCORE=${SCORE:-2}
+EPOCH=${EPOCH:-5}
+K=${K:-4}
+THREADS=${THREADS:-"1 2 4"}
+DATA=${DATA:-e2e_data}
+
+cd "$(dirname "$0")"
+XLEARN=..
+mkdir -p $DATA
+TRAIN=$DATA/train.txt
+TEST=$DATA/test.txt
+
+# The data is generated again only if its options change
+OPTION="-rows $ROWS -fields $FIELDS -features $FEATURES -nnz $NNZ \
+-len $LEN -zipf $ZIPF -format $FORMAT"
+if [ ! -f $DATA/option ] || [ "$(cat $DATA/option)" != "$OPTION" ]; then
+  ./gen_data -o $TRAIN $OPTION -seed 1 || exit 1
+  ./gen_data -o $TEST $OPTION -rows $(( ROWS / 10 + 1 )) -seed 2 || exit 1
+  echo "$OPTION" > $DATA/option
+fi
+
+now() {
+  date +%s.%N
+}
+
+# The seconds between two times of now()
+elapsed() {
+  awk -v a=$1 -v b=$2 'BEGIN { printf "%.2f", b - a }'
+}
+
+# The value of "Time cost for ...: x (sec)" in the log
+time_cost() {
+  grep "$1" $2 | tail -1 | awk '{ print $(NF-1) }'
+}
+
+# The sum of the time column of the epochs in the log
+epoch_time() {
+  grep "%" $1 | awk '{ sum += $NF } END { printf "%.2f", sum }'
+}
+
+rows_per_sec() {
+  awk -v n=$1 -v t=$2 'BEGIN { if (t > 0) printf "%.0f", n / t; else print "-" }'
+}
+
+TEST_ROWS=$(wc -l < $TEST)
+LOG=$DATA/log.txt
+printf "%-7s %7s %10s %10s %10s %12s %10s %12s\n" "reader" "thread" \
+  "parse(s)" "cached(s)" "epochs(s)" "train(row/s)" \
+  "predict(s)" "pred(row/s)"
+for reader in inmem disk; do
+  if [ $reader = "disk" ]; then
+    DISK="--disk"
+  else
+    DISK=""
+  fi
+  for t in $THREADS; do
+    rm -f $DATA/*.bin
+    ARGS="-s $SCORE -k $K -e $EPOCH -nthread $t -v $TEST $DISK --dis-es"
+    # The first run parses the text into the cache
+    $XLEARN/xlearn_train $TRAIN $ARGS > $LOG 2>&1 || { cat $LOG; exit 1; }
+    PARSE=$(time_cost "reading problem" $LOG)
+    # The second run reads the cache, and it is the timing of the epochs
+    $XLEARN/xlearn_train $TRAIN $ARGS > $LOG 2>&1 || { cat $LOG; exit 1; }
+    CACHED=$(time_cost "reading problem" $LOG)
+    EPOCHS=$(epoch_time $LOG)
+    TRAIN_SPEED=$(rows_per_sec $(( ROWS * EPOCH )) $EPOCHS)
+    START=$(now)
+    $XLEARN/xlearn_predict $TEST $TRAIN.model -nthread $t $DISK \
+      -o $DATA/out.txt > $LOG 2>&1 || { cat $LOG; exit 1; }
+    PREDICT=$(elapsed $START $(now))
+    PRED_SPEED=$(rows_per_sec $TEST_ROWS $PREDICT)
+    printf "%-7s %7s %10s %10s %10s %12s %10s %12s\n" $reader $t \
+      $PARSE $CACHED $EPOCHS $TRAIN_SPEED $PREDICT $PRED_SPEED
+  done
+done
+rm -f $DATA/*.bin $DATA/out.txt $TRAIN.model
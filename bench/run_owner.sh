@@ -0,0 +1,87 @@
+# Copyright (c) 2018 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# The benchmark of the training by the owners of the features (-owner)
+# against Hogwild on the synthetic CTR data of hot features, which is
+# run in the bench directory of the build:
+#
+#   ROWS=1000000 ZIPF=1.3 THREADS="4 8 16" NUMA=local ./run_owner.sh
+#
+# For each number of the threads, it trains the in-memory model by
+# Hogwild, by -grad_batch and by -owner on the same binary cache, and
+# prints the seconds of the epochs, the rows per second and the last
+# test loss. The larger ZIPF gives the hotter features.
+
+ROWS=${ROWS:-200000}
+FIELDS=${FIELDS:-24}
+FEATURES=${FEATURES:-1000000}
+NNZ=${NNZ:-20}
+ZIPF=${ZIPF:-1.3}
+SCORE=${SCORE:-2}
+EPOCH=${EPOCH:-5}
+K=${K:-4}
+OWNER=${OWNER:-256}
+NUMA=${NUMA:-none}
+THREADS=${THREADS:-"1 2 4"}
+DATA=${DATA:-owner_data}
+
+cd "$(dirname "$0")"
+XLEARN=..
+mkdir -p $DATA
+TRAIN=$DATA/train.txt
+TEST=$DATA/test.txt
+
+# The data is generated again only if its options change
+OPTION="-rows $ROWS -fields $FIELDS -features $FEATURES -nnz $NNZ \
+-len poisson -zipf $ZIPF -format ffm"
+if [ ! -f $DATA/option ] || [ "$(cat $DATA/option)" != "$OPTION" ]; then
+  rm -f $DATA/*.bin
+  ./gen_data -o $TRAIN $OPTION -seed 1 || exit 1
+  ./gen_data -o $TEST $OPTION -rows $(( ROWS / 10 + 1 )) -seed 2 || exit 1
+  echo "$OPTION" > $DATA/option
+fi
+
+# The sum of the time column of the epochs in the log
+epoch_time() {
+  grep "%" $1 | awk '{ sum += $NF } END { printf "%.2f", sum }'
+}
+
+# The test loss of the last epoch in the log
+test_loss() {
+  grep "%" $1 | tail -1 | awk '{ print $(NF-1) }'
+}
+
+rows_per_sec() {
+  awk -v n=$1 -v t=$2 'BEGIN { if (t > 0) printf "%.0f", n / t; else print "-" }'
+}
+
+LOG=$DATA/log.txt
+printf "%-10s %7s %10s %12s %10s\n" "update" "thread" \
+  "epochs(s)" "train(row/s)" "test loss"
+for t in $THREADS; do
+  for update in hogwild batch owner; do
+    case $update in
+      batch) MODE="-grad_batch $OWNER" ;;
+      owner) MODE="-owner $OWNER" ;;
+      *) MODE="" ;;
+    esac
+    ARGS="-s $SCORE -k $K -e $EPOCH -nthread $t -v $TEST -numa $NUMA \
+--dis-es $MODE"
+    $XLEARN/xlearn_train $TRAIN $ARGS > $LOG 2>&1 || { cat $LOG; exit 1; }
+    EPOCHS=$(epoch_time $LOG)
+    printf "%-10s %7s %10s %12s %10s\n" $update $t $EPOCHS \
+      $(rows_per_sec $(( ROWS * EPOCH )) $EPOCHS) $(test_loss $LOG)
+  done
+done
+rm -f $TRAIN.model
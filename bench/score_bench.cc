@@ -0,0 +1,398 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the micro-benchmark of the score functions, which
+times CalcScore() and CalcGrad() of linear, FM, FFM and FwFM over a
+sweep of the model shapes, the optimizers and the SIMD kernels.
+
+  ./score_bench -score ffm -k 4,16 -field 8,24 -nnz 16,40 \
+                -feature 10000,10000000 -opt sgd,adagrad -simd all
+
+Each option takes a comma-separated list, and every combination
+is timed. It prints the rows per second and the GB/s of the model
+parameters used by the kernels, where CalcGrad() reads and writes
+the parameters and their gradient caches. The models larger than
+-max_mem are skipped.
+
+The random rows draw the features uniformly, but the features of
+real data are skewed, so -data times the rows of a libffm file
+instead, whose features, fields and average nnz replace -feature,
+-field and -nnz. The -layout option compares the feature-major and
+the field-major latent factors of ffm (see Model::SetFieldMajor):
+
+  ./score_bench -score ffm -k 4 -opt adagrad -layout feature,field \
+                -data ./small_train.txt
+
+The -dense option makes the first nodes of each random row the dense
+columns 0, 1, 2, ... of a CSV file, which are followed by the random
+sparse features:
+
+  ./score_bench -score linear,fm -k 16 -nnz 230 -dense 200
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/cpu_info.h"
+#include "src/base/split_string.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/reader/parser.h"
+#include "src/score/score_function.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+// The sweep of the benchmark, where each list is one option.
+struct BenchOption {
+  std::vector<std::string> score = { "linear", "fm", "ffm" };
+  std::vector<std::string> opt = { "sgd", "adagrad" };
+  std::vector<std::string> simd = { "best" };
+  std::vector<index_t> k = { 4, 16 };
+  std::vector<index_t> field = { 8 };
+  std::vector<index_t> nnz = { 16, 40 };
+  std::vector<index_t> feature = { 10000, 1000000 };
+  /* Layouts of the latent factors of ffm: feature, field */
+  std::vector<std::string> layout = { "feature" };
+  /* The libffm file of the benchmark data, or the random rows */
+  std::string data;
+  /* Rows of the benchmark data, which are used round-robin */
+  index_t rows = 4096;
+  /* Dense columns in front of each random row */
+  index_t dense = 0;
+  /* Seconds of each timing */
+  double seconds = 0.3;
+  /* Most MB of a model */
+  double max_mem = 2048;
+};
+
+static void usage() {
+  printf("Usage: score_bench [-score linear,fm,ffm,fwfm] [-opt sgd,...]\n"
+         "  [-simd best|all|sse,avx2,avx512] [-k 4,16] [-field 8]\n"
+         "  [-nnz 16,40] [-feature 10000,1000000] [-rows 4096]\n"
+         "  [-layout feature,field] [-data file] [-dense 0]\n"
+         "  [-time 0.3] [-max_mem 2048]\n");
+  exit(0);
+}
+
+static std::vector<index_t> parse_ids(const std::string& str) {
+  std::vector<std::string> list;
+  SplitStringUsing(str, ",", &list);
+  std::vector<index_t> ids;
+  for (size_t i = 0; i < list.size(); ++i) {
+    int value = atoi(list[i].c_str());
+    if (value <= 0) { usage(); }
+    ids.push_back(value);
+  }
+  if (ids.empty()) { usage(); }
+  return ids;
+}
+
+static void parse_option(int argc, char* argv[], BenchOption* option) {
+  for (int i = 1; i < argc; i += 2) {
+    std::string name = argv[i];
+    if (i + 1 >= argc) { usage(); }
+    std::string value = argv[i + 1];
+    if (name == "-score") {
+      option->score.clear();
+      SplitStringUsing(value, ",", &option->score);
+    } else if (name == "-opt") {
+      option->opt.clear();
+      SplitStringUsing(value, ",", &option->opt);
+    } else if (name == "-simd") {
+      option->simd.clear();
+      SplitStringUsing(value, ",", &option->simd);
+    } else if (name == "-k") {
+      option->k = parse_ids(value);
+    } else if (name == "-field") {
+      option->field = parse_ids(value);
+    } else if (name == "-nnz") {
+      option->nnz = parse_ids(value);
+    } else if (name == "-feature") {
+      option->feature = parse_ids(value);
+    } else if (name == "-layout") {
+      option->layout.clear();
+      SplitStringUsing(value, ",", &option->layout);
+      for (size_t l = 0; l < option->layout.size(); ++l) {
+        if (option->layout[l] != "feature" &&
+            option->layout[l] != "field") { usage(); }
+      }
+    } else if (name == "-data") {
+      option->data = value;
+    } else if (name == "-dense") {
+      option->dense = atoi(value.c_str());
+    } else if (name == "-rows") {
+      option->rows = parse_ids(value)[0];
+    } else if (name == "-time") {
+      option->seconds = atof(value.c_str());
+    } else if (name == "-max_mem") {
+      option->max_mem = atof(value.c_str());
+    } else {
+      usage();
+    }
+  }
+}
+
+// The SIMD levels of -simd that current CPU supports.
+static std::vector<SimdLevel> get_levels(
+    const std::vector<std::string>& simd) {
+  std::vector<SimdLevel> levels;
+  SimdLevel all[] = { kSimdSSE, kSimdAVX2, kSimdAVX512 };
+  for (size_t i = 0; i < simd.size(); ++i) {
+    if (simd[i] == "best") {
+      levels.push_back(DetectSimdLevel());
+      continue;
+    }
+    for (SimdLevel level : all) {
+      if ((simd[i] == "all" || simd[i] == SimdLevelName(level)) &&
+          GetScoreKernels(level) != nullptr) {
+        levels.push_back(level);
+      }
+    }
+  }
+  return levels;
+}
+
+static index_t aux_size(const std::string& opt) {
+  if (opt == "sgd") { return 1; }
+  if (opt == "adagrad") { return 2; }
+  return 3;
+}
+
+// The random rows of nnz features, where the node i is of
+// the field i % num_field, as the fields of a CTR row. The
+// first dense nodes are the features 0, 1, 2, ... of random
+// values, and the others are random features of value 1.
+static void make_rows(index_t num_rows, index_t nnz, index_t dense,
+                      index_t num_feature, index_t num_field,
+                      std::vector<SparseRow>* rows) {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<index_t> feat(0, num_feature - 1);
+  std::uniform_real_distribution<real_t> value(0.0, 1.0);
+  dense = std::min(dense, std::min(nnz, num_feature));
+  rows->assign(num_rows, SparseRow());
+  for (index_t r = 0; r < num_rows; ++r) {
+    for (index_t i = 0; i < nnz; ++i) {
+      if (i < dense) {
+        (*rows)[r].push_back(Node(i % num_field, i, value(gen)));
+      } else {
+        (*rows)[r].push_back(Node(i % num_field, feat(gen), 1.0));
+      }
+    }
+  }
+}
+
+// Bytes of the parameters that CalcScore() reads for a row,
+// where each pair of FFM reads two latent vectors.
+static double score_bytes(const std::string& score, Model& model,
+                          index_t nnz) {
+  double k = model.get_aligned_k();
+  double bytes = nnz;
+  if (score == "fm" || score == "fwfm") {
+    bytes += nnz * k;
+  } else if (score == "ffm") {
+    bytes += nnz * (nnz - 1.0) * k;
+  }
+  return bytes * sizeof(real_t);
+}
+
+// Read the rows of the libffm file, and set the features, the
+// fields and the nnz of the sweep to the shape of the data.
+static void load_rows(BenchOption* option, std::vector<SparseRow>* rows) {
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(option->data, &buffer);
+  DMatrix matrix;
+  FFMParser parser;
+  parser.setLabel(true);
+  parser.Parse(buffer, size, matrix);
+  delete [] buffer;
+  if (matrix.row_length == 0) {
+    printf("No rows in -data %s\n", option->data.c_str());
+    exit(0);
+  }
+  uint64 nnz = 0;
+  rows->clear();
+  for (index_t i = 0; i < matrix.row_length; ++i) {
+    rows->push_back(*matrix.row[i]);
+    nnz += matrix.row[i]->size();
+  }
+  option->feature.assign(1, matrix.MaxFeat() + 1);
+  option->field.assign(1, matrix.MaxField() + 1);
+  option->nnz.assign(1, std::max((index_t)1,
+                     (index_t)(nnz / matrix.row_length)));
+}
+
+// Call fn(row) round-robin for at least the given seconds,
+// and return the rows per second. Timer::toc() adds up the
+// time since tic() on each call, so the clock is read here.
+template <typename Func>
+static double time_rows(const std::vector<SparseRow>& rows,
+                        double seconds, Func fn) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point begin = Clock::now();
+  uint64 count = 0;
+  double elapsed = 0;
+  do {
+    for (size_t r = 0; r < rows.size(); ++r) {
+      fn(&rows[r]);
+    }
+    count += rows.size();
+    elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+  } while (elapsed < seconds);
+  return count / elapsed;
+}
+
+// One combination of the sweep.
+struct BenchCase {
+  std::string score;
+  std::string opt;
+  index_t k;
+  index_t field;
+  index_t nnz;
+  index_t feature;
+  std::string layout;
+};
+
+// All the combinations, where the K is only used by FM, FFM and
+// FwFM, the fields only by FFM and FwFM, and the layouts only by FFM.
+static std::vector<BenchCase> get_cases(const BenchOption& option) {
+  std::vector<BenchCase> cases;
+  for (const std::string& score : option.score) {
+    for (const std::string& opt : option.opt) {
+      std::vector<index_t> ks = score == "linear" ?
+        std::vector<index_t>(1, 0) : option.k;
+      std::vector<index_t> fields = score == "ffm" || score == "fwfm" ?
+        option.field : std::vector<index_t>(1, 1);
+      std::vector<std::string> layouts = score == "ffm" ?
+        option.layout : std::vector<std::string>(1, "feature");
+      for (index_t k : ks) {
+        for (index_t field : fields) {
+          for (index_t nnz : option.nnz) {
+            for (index_t feature : option.feature) {
+              for (const std::string& layout : layouts) {
+                cases.push_back({ score, opt, k, field, nnz,
+                                  feature, layout });
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return cases;
+}
+
+// The rows of -data are used if given, or the random rows.
+static void run_case(const BenchCase& c,
+                     const std::vector<SimdLevel>& levels,
+                     const BenchOption& option,
+                     const std::vector<SparseRow>& data) {
+  index_t aux = aux_size(c.opt);
+  double mb = (double)c.feature * aux * sizeof(real_t) / 1e6;
+  index_t k_aligned = (c.k + kAlign - 1) / kAlign * kAlign;
+  if (c.score != "linear") {
+    mb *= 1.0 + (double)k_aligned * (c.score == "ffm" ? c.field : 1);
+  }
+  if (mb > option.max_mem) {
+    printf("Skip %s -k %u -field %u -feature %u: %.0f MB > -max_mem\n",
+           c.score.c_str(), c.k, c.field, c.feature, mb);
+    return;
+  }
+  std::string name = c.score + "_" + c.opt;
+  Score* score = CREATE_SCORE(name.c_str());
+  if (score == nullptr) {
+    printf("Unknown -score %s or -opt %s\n", c.score.c_str(), c.opt.c_str());
+    exit(0);
+  }
+  std::string opt_type = c.opt;
+  score->Initialize(0.01, 0.00002, 0.002, 0.8, 1, 1, opt_type);
+  Model model;
+  model.SetFieldMajor(c.layout == "field");
+  model.Initialize(c.score, "cross-entropy", c.feature, c.field,
+                   std::max(c.k, (index_t)1), aux, 1.0, false,
+                   c.opt.compare(0, 4, "adam") == 0 ? 0 : 1.0);
+  std::vector<SparseRow> rows;
+  if (data.empty()) {
+    make_rows(option.rows, c.nnz, option.dense, c.feature,
+              c.field, &rows);
+  }
+  const std::vector<SparseRow>& bench_rows = data.empty() ? rows : data;
+  real_t norm = 1.0 / c.nnz;
+  double bytes = score_bytes(c.score, model, c.nnz);
+  for (SimdLevel level : levels) {
+    // The same kernels as training, unrolled for the K if possible
+    score->SetKernels(GetScoreKernels(level, k_aligned));
+    real_t sum = 0;
+    double score_rate = time_rows(bench_rows, option.seconds,
+      [&](const SparseRow* row) {
+        sum += score->CalcScore(row, model, norm);
+      });
+    // The small gradient of both signs keeps the model stable
+    real_t pg = 0.01;
+    double grad_rate = time_rows(bench_rows, option.seconds,
+      [&](const SparseRow* row) {
+        pg = -pg;
+        score->CalcGrad(row, model, pg, norm);
+      });
+    printf("%-7s %-8s %-7s %-7s %4u %5u %5u %10u %10.1f "
+           "%12.0f %8.2f %12.0f %8.2f\n",
+           c.score.c_str(), c.opt.c_str(), SimdLevelName(level),
+           c.layout.c_str(), c.k, c.field, c.nnz, c.feature, mb,
+           score_rate, score_rate * bytes / 1e9,
+           grad_rate, grad_rate * bytes * aux * 2 / 1e9);
+    // Keep the scores from being optimized out
+    if (sum != sum) { printf("The scores are NaN\n"); }
+  }
+  delete score;
+}
+
+static void run_bench(BenchOption option) {
+  std::vector<SimdLevel> levels = get_levels(option.simd);
+  if (levels.empty()) {
+    printf("No SIMD level of -simd is supported by this CPU\n");
+    return;
+  }
+  std::vector<SparseRow> data;
+  if (!option.data.empty()) {
+    load_rows(&option, &data);
+  }
+  printf("%-7s %-8s %-7s %-7s %4s %5s %5s %10s %10s "
+         "%12s %8s %12s %8s\n",
+         "score", "opt", "simd", "layout", "k", "field", "nnz",
+         "feature", "model(MB)", "score(row/s)", "GB/s",
+         "grad(row/s)", "GB/s");
+  std::vector<BenchCase> cases = get_cases(option);
+  for (size_t i = 0; i < cases.size(); ++i) {
+    run_case(cases[i], levels, option, data);
+  }
+}
+
+}  // namespace xLearn
+
+int main(int argc, char* argv[]) {
+  xLearn::BenchOption option;
+  xLearn::parse_option(argc, argv, &option);
+  xLearn::run_bench(option);
+  return 0;
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package xlearn;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * The loaded model of the C API in the JVM. The model, its score
+ * function and the thread pool stay resident in the process until
+ * close(), so each call only scores the given rows:
+ *
+ * <pre>
+ *   try (Predictor predictor = new Predictor("ffm")) {
+ *     predictor.setBool("sigmoid", true);
+ *     predictor.loadModel("model.out");
+ *     predictor.scoreRows(indptr, nodes, numRows, out);
+ *   }
+ * </pre>
+ *
+ * The rows are given in the CSR layout by two direct ByteBuffers in
+ * the native byte order, which are read by the library in place:
+ * indptr has numRows + 1 longs, and the nodes of row i are the records
+ * [indptr[i], indptr[i+1]) of nodes. Each record has 12 bytes: the
+ * field id (int), the feature id (int) and the value (float), and
+ * putNode() writes one. The numRows scores are written to the direct
+ * buffer out as floats. The buffers are read from their start, not
+ * from their position.
+ *
+ * All the methods of scoring can be called by many threads at the
+ * same time, and reloadModel() swaps in a new version of the model
+ * while the old one is still serving.
+ */
+public final class Predictor implements AutoCloseable {
+  static {
+    System.loadLibrary("xlearn_jni");
+  }
+
+  /** Bytes of one node record. */
+  public static final int NODE_BYTES = 12;
+
+  private long handle;
+
+  /** Create the handle of the model type: linear, fm, fwfm or ffm. */
+  public Predictor(String modelType) {
+    handle = create(modelType);
+  }
+
+  /** Allocate a direct buffer of the native byte order. */
+  public static ByteBuffer allocate(int bytes) {
+    return ByteBuffer.allocateDirect(bytes).order(ByteOrder.nativeOrder());
+  }
+
+  /** Write the k-th node record of the buffer. */
+  public static void putNode(ByteBuffer nodes, int k, int field,
+                             int feature, float value) {
+    int pos = k * NODE_BYTES;
+    nodes.putInt(pos, field);
+    nodes.putInt(pos + 4, feature);
+    nodes.putFloat(pos + 8, value);
+  }
+
+  /** Set the options of the C API, e.g., sigmoid or batch_window. */
+  public void setStr(String key, String value) { setStr(handle(), key, value); }
+  public void setInt(String key, int value) { setInt(handle(), key, value); }
+  public void setFloat(String key, float value) { setFloat(handle(), key, value); }
+  public void setBool(String key, boolean value) { setBool(handle(), key, value); }
+
+  /** Load the model once for the following calls. */
+  public void loadModel(String path) { loadModel(handle(), path); }
+
+  /**
+   * Load a new version of the model, and swap it in when it is ready.
+   * If background is true, it is loaded by a background thread, and
+   * waitReload() waits for it.
+   */
+  public void reloadModel(String path, boolean background) {
+    reloadModel(handle(), path, background);
+  }
+
+  public void waitReload() { waitReload(handle()); }
+
+  /** The version of the loaded model, and 0 if it is not loaded. */
+  public long modelVersion() { return modelVersion(handle()); }
+
+  /**
+   * Predict the rows by the thread pool of the model, and the calls
+   * of many threads are predicted in one batch if batch_window is set.
+   */
+  public void predict(ByteBuffer indptr, ByteBuffer nodes,
+                      int numRows, ByteBuffer out) {
+    predict(handle(), indptr, nodes, numRows, out);
+  }
+
+  /**
+   * Score the rows in the calling thread, which is the path of the
+   * lowest latency for the small requests.
+   */
+  public void scoreRows(ByteBuffer indptr, ByteBuffer nodes,
+                        int numRows, ByteBuffer out) {
+    scoreRows(handle(), indptr, nodes, numRows, out);
+  }
+
+  /** Release the model and the handle, with no call running. */
+  @Override
+  public synchronized void close() {
+    if (handle != 0) {
+      unloadModel(handle);
+      free(handle);
+      handle = 0;
+    }
+  }
+
+  private long handle() {
+    if (handle == 0) {
+      throw new XLearnException("The predictor is closed");
+    }
+    return handle;
+  }
+
+  private static native long create(String modelType);
+  private static native void free(long handle);
+  private static native void setStr(long handle, String key, String value);
+  private static native void setInt(long handle, String key, int value);
+  private static native void setFloat(long handle, String key, float value);
+  private static native void setBool(long handle, String key, boolean value);
+  private static native void loadModel(long handle, String path);
+  private static native void reloadModel(long handle, String path,
+                                         boolean background);
+  private static native void waitReload(long handle);
+  private static native long modelVersion(long handle);
+  private static native void unloadModel(long handle);
+  private static native void predict(long handle, ByteBuffer indptr,
+                                     ByteBuffer nodes, int numRows,
+                                     ByteBuffer out);
+  private static native void scoreRows(long handle, ByteBuffer indptr,
+                                       ByteBuffer nodes, int numRows,
+                                       ByteBuffer out);
+}
@@ -0,0 +1,198 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the JNI binding of the loaded model of the C API,
+which is the native part of xlearn.Predictor.
+*/
+
+#include <jni.h>
+
+#include <string>
+
+#include "src/c_api/c_api.h"
+#include "src/c_api/c_api_error.h"
+
+namespace {
+
+// The size of one record of the nodes, which is xLearn::Node
+const jlong kNodeBytes = 12;
+
+// Throw an XLearnException of the message
+void throw_error(JNIEnv* env, const char* msg) {
+  jclass cls = env->FindClass("xlearn/XLearnException");
+  if (cls != nullptr) { env->ThrowNew(cls, msg); }
+}
+
+// Throw the last error of the C API if ret is not 0
+bool check_call(JNIEnv* env, int ret) {
+  if (ret == 0) { return true; }
+  throw_error(env, XLearnGetLastError());
+  return false;
+}
+
+// The address of the direct buffer, which has at least bytes
+void* direct_buffer(JNIEnv* env, jobject buffer, jlong bytes,
+                    const char* name) {
+  void* addr = buffer == nullptr ? nullptr :
+               env->GetDirectBufferAddress(buffer);
+  if (addr == nullptr) {
+    throw_error(env, (std::string(name) +
+                      " must be a direct ByteBuffer").c_str());
+    return nullptr;
+  }
+  if (env->GetDirectBufferCapacity(buffer) < bytes) {
+    throw_error(env, (std::string(name) + " is too small").c_str());
+    return nullptr;
+  }
+  return addr;
+}
+
+std::string to_string(JNIEnv* env, jstring str) {
+  const char* chars = env->GetStringUTFChars(str, nullptr);
+  std::string value(chars);
+  env->ReleaseStringUTFChars(str, chars);
+  return value;
+}
+
+// Score the num_rows rows of the buffers by the loaded model. The
+// matrix is a view of the nodes of the caller, so nothing is copied,
+// and the scores are written to the out buffer directly.
+void score(JNIEnv* env, jlong handle, jobject indptr, jobject nodes,
+           jint num_rows, jobject out, bool in_caller) {
+  if (num_rows < 0) {
+    throw_error(env, "numRows must not be negative");
+    return;
+  }
+  const uint64* ptr = static_cast<const uint64*>(
+      direct_buffer(env, indptr, ((jlong)num_rows + 1) * 8,
+                    "indptr"));
+  if (ptr == nullptr) { return; }
+  if (ptr[num_rows] < ptr[0]) {
+    throw_error(env, "The indptr must be non-decreasing");
+    return;
+  }
+  const void* node = direct_buffer(env, nodes,
+                                   (jlong)ptr[num_rows] * kNodeBytes,
+                                   "nodes");
+  if (node == nullptr) { return; }
+  float* out_arr = static_cast<float*>(
+      direct_buffer(env, out, (jlong)num_rows * 4, "out"));
+  if (out_arr == nullptr) { return; }
+  XL xl = reinterpret_cast<XL>(handle);
+  DataHandle matrix = nullptr;
+  if (!check_call(env, XlearnCreateDataView(ptr, node, num_rows,
+                                            nullptr, &matrix))) {
+    return;
+  }
+  int ret = in_caller ?
+            XLearnScoreRows(&xl, &matrix, out_arr, num_rows) :
+            XLearnPredict(&xl, &matrix, out_arr, num_rows);
+  XlearnDataFree(&matrix);
+  check_call(env, ret);
+}
+
+}  // namespace
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL Java_xlearn_Predictor_create(
+    JNIEnv* env, jclass, jstring model_type) {
+  XL xl = nullptr;
+  std::string type = to_string(env, model_type);
+  if (!check_call(env, XLearnCreate(type.c_str(), &xl))) { return 0; }
+  return reinterpret_cast<jlong>(xl);
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_free(
+    JNIEnv* env, jclass, jlong handle) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnHandleFree(&xl));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_setStr(
+    JNIEnv* env, jclass, jlong handle, jstring key, jstring value) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnSetStr(&xl, to_string(env, key).c_str(),
+                               to_string(env, value).c_str()));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_setInt(
+    JNIEnv* env, jclass, jlong handle, jstring key, jint value) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnSetInt(&xl, to_string(env, key).c_str(), value));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_setFloat(
+    JNIEnv* env, jclass, jlong handle, jstring key, jfloat value) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnSetFloat(&xl, to_string(env, key).c_str(), value));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_setBool(
+    JNIEnv* env, jclass, jlong handle, jstring key, jboolean value) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnSetBool(&xl, to_string(env, key).c_str(),
+                                value == JNI_TRUE));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_loadModel(
+    JNIEnv* env, jclass, jlong handle, jstring path) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnLoadModel(&xl, to_string(env, path).c_str()));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_reloadModel(
+    JNIEnv* env, jclass, jlong handle, jstring path, jboolean background) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnReloadModel(&xl, to_string(env, path).c_str(),
+                                    background == JNI_TRUE));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_waitReload(
+    JNIEnv* env, jclass, jlong handle) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnWaitReload(&xl));
+}
+
+JNIEXPORT jlong JNICALL Java_xlearn_Predictor_modelVersion(
+    JNIEnv* env, jclass, jlong handle) {
+  XL xl = reinterpret_cast<XL>(handle);
+  uint64 version = 0;
+  check_call(env, XLearnGetModelVersion(&xl, &version));
+  return (jlong)version;
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_unloadModel(
+    JNIEnv* env, jclass, jlong handle) {
+  XL xl = reinterpret_cast<XL>(handle);
+  check_call(env, XLearnUnloadModel(&xl));
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_predict(
+    JNIEnv* env, jclass, jlong handle, jobject indptr, jobject nodes,
+    jint num_rows, jobject out) {
+  score(env, handle, indptr, nodes, num_rows, out, false);
+}
+
+JNIEXPORT void JNICALL Java_xlearn_Predictor_scoreRows(
+    JNIEnv* env, jclass, jlong handle, jobject indptr, jobject nodes,
+    jint num_rows, jobject out) {
+  score(env, handle, indptr, nodes, num_rows, out, true);
+}
+
+}  // extern "C"
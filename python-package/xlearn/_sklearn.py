@@ -98,7 +98,7 @@ class BaseXLearnModel(BaseEstimator):
     :param fold: number of fold used in cross validation
     :param epoch: number of training epoch
     :param stop_window: window size for early stopping
-    :param opt: optimizer option, one of 'sgd', 'adagrad', 'ftrl'
+    :param opt: optimizer option, one of 'sgd', 'adagrad', 'ftrl', 'adam', 'adamw'
     :param nthread: number of threads (Deprecated, please use n_jobs)
     :param n_jobs: number of threads used to run xlearn.
     :param block_size: block size for on-disk training.
@@ -136,9 +136,9 @@ class BaseXLearnModel(BaseEstimator):
 
         # initialize internal structure
         self._XLearnModel = None
-        self._temp_model_file = tempfile.NamedTemporaryFile(delete=False)
-        self._temp_weight_file = tempfile.NamedTemporaryFile(delete=False)
-        self.weights = None
+        # The model file is only written for the prediction of a data file
+        self._temp_model_file = None
+        self._weights = None
         self.fields = None
 
     def get_model(self):
@@ -262,14 +262,53 @@ class BaseXLearnModel(BaseEstimator):
                 validate_set = DMatrix(X_val, y_val, self.fields)
                 self._XLearnModel.setValidate(validate_set)
 
-        # set up files for storing weights
-        self._XLearnModel.setTXTModel(self._temp_weight_file.name)
+        # fit model, which is kept in memory
+        self._remove_temp_file()
+        self._XLearnModel.fitInMemory(params)
 
-        # fit model
-        self._XLearnModel.fit(params, self._temp_model_file.name)
+        # weights are acquired on the first use
+        self._weights = None
 
-        # acquire weights
-        self._parse_weight(self._temp_weight_file.name)
+    def partial_fit(self, X, y, fields=None):
+        """ Update the XLearn model with one mini-batch of feature matrix X
+        and label y, which keeps the model and its optimizer state in memory
+        for the next call. The first call trains a new model if the model is
+        not fitted, and the new features of X grow the model.
+
+        :param X: array-like
+                  Feature matrix
+        :param y: array-like
+                  Label
+        :param fields: array-like
+                  Fields for FFMModel. Default as None
+        :return: the training loss of the mini-batch
+        """
+        X, y = check_X_y(X, y, accept_sparse=['csr'], y_numeric=True, multi_output=False)
+        if self.model_type == 'ffm' and fields is not None:
+            self.fields = fields
+
+        params = None
+        if self._XLearnModel is None:
+            if self.model_type == 'fm':
+                self._XLearnModel = create_fm()
+            elif self.model_type == 'lr':
+                self._XLearnModel = create_linear()
+            elif self.model_type == 'ffm':
+                assert self.fields is not None, 'Must specify fields in FFMModel'
+                self._XLearnModel = create_ffm()
+            else:
+                raise Exception('model_type must be fm, ffm or lr')
+            if self.task == 'binary':
+                self._XLearnModel.setSigmoid()
+            params = self.get_xlearn_params()
+
+        train_set = DMatrix(X, y, self.fields)
+        loss = self._XLearnModel.partialFit(train_set, params)
+
+        # the model file of the data file prediction is out of date
+        self._remove_temp_file()
+        self._weights = None
+        return loss
 
     def predict(self, X):
         """ Generate prediction using feature matrix X
@@ -279,17 +318,21 @@ class BaseXLearnModel(BaseEstimator):
         :return: prediction
         """
 
+        model = self.get_model()
         if isinstance(X, str):
-            self._XLearnModel.setTest(X)
-        else:
-            X = check_array(X, accept_sparse=['csr'])
-            test_set = DMatrix(X, None, self.fields)
-            self._XLearnModel.setTest(test_set)
+            # the data file is predicted by the model file
+            if self._temp_model_file is None:
+                fd, self._temp_model_file = tempfile.mkstemp()
+                os.close(fd)
+                model.saveModel(self._temp_model_file)
+            model.setTest(X)
+            return model.predict(self._temp_model_file)
 
-        # generate output
-        pred = self.get_model().predict(self._temp_model_file.name)
+        X = check_array(X, accept_sparse=['csr'])
+        test_set = DMatrix(X, None, self.fields)
 
-        return pred
+        # generate output by the model kept in memory
+        return model.predictLoaded(test_set)
 
     def feature_importance_(self):
         """TODO: analyze weight matrix to get feature importance"""
@@ -318,37 +361,31 @@ class BaseXLearnModel(BaseEstimator):
         except:
             raise Exception('Failed to convert feature matrix X and label y to xlearn data format')
 
-    def _parse_weight(self, file_name):
-        # estimate number of features from txt file
-        num_lines = sum(1 for line in open(file_name))
-        num_features = int((num_lines-1)/2)
-
-        if self.model_type in ['fm', 'ffm']:
-            weight_vec = np.genfromtxt(file_name, skip_footer=num_features)
-            weight_mtx = np.genfromtxt(file_name, skip_header=num_features+1)
-        else:
-            weight_vec = np.genfromtxt(file_name)
+    @property
+    def weights(self):
+        """ Weights of the fitted model as (weight_vec, weight_mtx) in the order
+        of the TXT model: the bias and the linear terms, and one row of latent
+        factors for each line of v, or None if the model is not fitted
+        """
+        if self._weights is None and self._XLearnModel is not None:
+            bias, linear, latent = self._XLearnModel.getWeights()
+            weight_vec = np.concatenate(([bias], linear))
             weight_mtx = None
+            if latent is not None:
+                weight_mtx = latent.reshape(-1, latent.shape[-1])
+            self._weights = (weight_vec, weight_mtx)
 
-        self.weights = (weight_vec, weight_mtx)
+        return self._weights
 
-    def _remove_temp_file(self, temp_file):
-        # The temp_file might be converted to binary file during training/inference.
-        # remove both original temp_file and derived binary file if exist
-        temp_bin_file = temp_file.name + '.bin'
-        if os.path.exists(temp_bin_file):
-            os.remove(temp_bin_file)
-        temp_file.close()
-        if os.path.exists(temp_file.name):
-            os.remove(temp_file.name)
+    def _remove_temp_file(self):
+        if self._temp_model_file is not None and os.path.exists(self._temp_model_file):
+            os.remove(self._temp_model_file)
+        self._temp_model_file = None
 
     def __del__(self):
-        self._remove_temp_file(self._temp_model_file)
-        self._remove_temp_file(self._temp_weight_file)
+        self._remove_temp_file()
 
     def __delete__(self, instance):
-        # self._temp_model_file.close()
-        # self._temp_weight_file.close()
         del instance
 
 class FMModel(BaseXLearnModel):
@@ -21,13 +21,67 @@ import numpy as np
 from .base import _LIB, XLearnHandle
 from .base import _check_call, c_str
 
+def _label_array(label, nrow):
+    """Return the float32 array of the label of nrow samples, or None"""
+    if label is not None:
+        if isinstance(label, DataFrame):
+            label = label.values
+        if isinstance(label, Series):
+            label = label.values
+        if isinstance(label, list):
+            label = np.array(label)
+        if isinstance(label, ndarray):
+            if (len(label.shape) > 2):
+                raise ValueError('Input numpy.ndarray of label must be 1 dimensional or 2 dimensional with one dimensional is 1')
+            if (len(label.shape) == 2) and (label.shape[0] != 1) and (label.shape[1] != 1):
+                print(len(label.shape))
+                raise ValueError('Input numpy.ndarray of label must be 1 dimensional or 2 dimensional with one dimensional is 1')
+            if (label.size != nrow):
+                raise ValueError('Input label must has same elements as the data lines')
+            labels = np.array(label.reshape(label.size), copy=False, dtype=np.float32)
+            return labels
+        else:
+            raise ValueError('Input label must be numpy.ndarray')
+    return None
+
+def _field_array(field_map, ncol):
+    """Return the uint32 array of the field of ncol features, or None"""
+    if field_map is not None:
+        if isinstance(field_map, DataFrame):
+            field_map = field_map.values
+        if isinstance(field_map, Series):
+            field_map = field_map.values
+        if isinstance(field_map, list):
+            field_map = np.array(field_map)
+        if isinstance(field_map, ndarray):
+            if (len(field_map.shape) > 2):
+                raise ValueError('Input numpy.ndarray of label must be 1 dimensional or 2 dimensional with one dimensional is 1')
+            if (len(field_map.shape) == 2) and (field_map.shape[0] != 1) and (field_map.shape[1] != 1):
+                raise ValueError('Input numpy.ndarray of field_map must be 1 dimensional or 2 dimensional with the one dimensional is 1')
+            if (field_map.size != ncol):
+                raise ValueError('Input field_map must has same elements as the data columns')
+            fields = np.array(field_map.reshape(field_map.size), copy=False, dtype=np.int32)
+            return fields
+        else:
+            raise ValueError('Input of field_map must numpy.ndarray')
+    return None
+
+def _is_sparse(data):
+    """If the data is a scipy.sparse matrix, and scipy is optional"""
+    try:
+        import scipy.sparse
+    except ImportError:
+        return False
+    return scipy.sparse.issparse(data)
+
 # This class is the xLearn core data
 class DMatrix(object):
     def __init__(self, data, label=None, field_map=None):
         """
         Initial function.
         Parameters:
-        data: NumPy 2D or pandas DataFrame of features data.
+        data: NumPy 2D, pandas DataFrame, or scipy.sparse matrix of features data. The CSR and CSC
+        matrices are read without densifying, and the other sparse formats are converted to CSR.
         label: one-dimensional array, it presents samples label.
         field_map: one-dimensional array, it presents the features'field respectively.
         This field_map like, [1, 2, 1, 3] means, the first and third features belong to field one, and the second belongs to field two, and so on.
@@ -38,8 +92,10 @@ class DMatrix(object):
         self.__handle = ctypes.c_void_p()
         if (isinstance(data, ndarray) or isinstance(data, DataFrame)):
             self._init_from_npy2d(data, label, field_map)
+        elif _is_sparse(data):
+            self._init_from_sparse(data, label, field_map)
         else:
-            raise ValueError('Input data must be numpy.ndarray or pandas.DataFrame')
+            raise ValueError('Input data must be numpy.ndarray, pandas.DataFrame or scipy.sparse matrix')
     
     # TODO(etveritas): support init DMatrix from other data type in memory, 
     # and unite init DMatrix from file.
@@ -58,47 +114,12 @@ class DMatrix(object):
 
         data = np.array(mat.reshape(mat.size), copy=False, dtype=np.float32)
         data_ptr = data.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
-        label_ptr = None
-        field_ptr = None
-        if label is not None:
-            if isinstance(label, DataFrame):
-                label = label.values
-            if isinstance(label, Series):
-                label = label.values
-            if isinstance(label, list):
-                label = np.array(label)
-            if isinstance(label, ndarray):
-                if (len(label.shape) > 2):
-                    raise ValueError('Input numpy.ndarray of label must be 1 dimensional or 2 dimensional with one dimensional is 1')
-                if (len(label.shape) == 2) and (label.shape[0] != 1) and (label.shape[1] != 1):
-                    print(len(label.shape))
-                    raise ValueError('Input numpy.ndarray of label must be 1 dimensional or 2 dimensional with one dimensional is 1')
-                if (label.size != mat.shape[0]):
-                    raise ValueError('Input label must has same elements as the data lines')
-                labels = np.array(label.reshape(label.size), copy=False, dtype=np.float32)
-                label_ptr = labels.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
-            else:
-                raise ValueError('Input label must be numpy.ndarray')
-
-        if field_map is not None:
-            if isinstance(field_map, DataFrame):
-                field_map = field_map.values
-            if isinstance(field_map, Series):
-                field_map = field_map.values
-            if isinstance(field_map, list):
-                field_map = np.array(field_map)
-            if isinstance(field_map, ndarray):
-                if (len(field_map.shape) > 2):
-                    raise ValueError('Input numpy.ndarray of label must be 1 dimensional or 2 dimensional with one dimensional is 1')
-                if (len(field_map.shape) == 2) and (field_map.shape[0] != 1) and (label.shape[1] != 1):
-                    raise ValueError('Input numpy.ndarray of field_map must be 1 dimensional or 2 dimensional with the one dimensional is 1')
-                if (field_map.size != mat.shape[1]):
-                    raise ValueError('Input field_map must has same elements as the data columns')
-                fields = np.array(field_map.reshape(field_map.size), copy=False, dtype=np.int32)
-                field_ptr = fields.ctypes.data_as(ctypes.POINTER(ctypes.c_uint))
-            else:
-                raise ValueError('Input of field_map must numpy.ndarray')
+        labels = _label_array(label, mat.shape[0])
+        fields = _field_array(field_map, mat.shape[1])
+        label_ptr = None if labels is None else labels.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        field_ptr = None if fields is None else fields.ctypes.data_as(ctypes.POINTER(ctypes.c_uint))
 
+        self.num_rows = mat.shape[0]
         _check_call(_LIB.XlearnCreateDataFromMat(data_ptr,
                                                  ctypes.c_uint64(mat.shape[0]),
                                                  ctypes.c_uint64(mat.shape[1]),
@@ -106,6 +127,67 @@ class DMatrix(object):
                                                  field_ptr,
                                                  ctypes.byref(self.__handle)))
 
+    def _init_from_sparse(self, mat, label, field_map):
+        """
+        This function do initialize DMatrix from scipy.sparse CSR or CSC matrix,
+        and only the non-zero values are read.
+        """
+        fmt = mat.getformat()
+        if fmt not in ('csr', 'csc'):
+            mat = mat.tocsr()
+            fmt = 'csr'
+        nrow, ncol = mat.shape
+        indptr = np.ascontiguousarray(mat.indptr, dtype=np.uint64)
+        indices = np.ascontiguousarray(mat.indices, dtype=np.uint32)
+        data = np.ascontiguousarray(mat.data, dtype=np.float32)
+        labels = _label_array(label, nrow)
+        fields = _field_array(field_map, ncol)
+        label_ptr = None if labels is None else labels.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        field_ptr = None if fields is None else fields.ctypes.data_as(ctypes.POINTER(ctypes.c_uint))
+        create = _LIB.XlearnCreateDataFromCSR if fmt == 'csr' else _LIB.XlearnCreateDataFromCSC
+        self.num_rows = nrow
+        _check_call(create(indptr.ctypes.data_as(ctypes.POINTER(ctypes.c_uint64)),
+                           indices.ctypes.data_as(ctypes.POINTER(ctypes.c_uint)),
+                           data.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                           ctypes.c_uint(nrow),
+                           ctypes.c_uint(ncol),
+                           label_ptr,
+                           field_ptr,
+                           ctypes.byref(self.__handle)))
+
+    # The packed nodes of DMatrix.view(), which is the same as xLearn::Node
+    NODE_DTYPE = np.dtype([('field', np.uint32), ('id', np.uint32), ('value', np.float32)])
+
+    @classmethod
+    def view(cls, indptr, nodes, label=None):
+        """
+        Create the DMatrix over the nodes without copying them.
+        Parameters:
+        indptr: one-dimensional array of nrow + 1 offsets, and the nodes of row i are nodes[indptr[i]:indptr[i+1]].
+        nodes: contiguous numpy structured array of DMatrix.NODE_DTYPE. It is referred to by the DMatrix,
+        so it must not be changed until the DMatrix is released.
+        label: one-dimensional array, it presents samples label.
+        """
+        if not isinstance(nodes, ndarray) or nodes.dtype != cls.NODE_DTYPE or not nodes.flags['C_CONTIGUOUS']:
+            raise ValueError('nodes must be a contiguous numpy array of DMatrix.NODE_DTYPE')
+        indptr = np.ascontiguousarray(indptr, dtype=np.uint64)
+        nrow = indptr.size - 1
+        if nrow < 0 or indptr[-1] > nodes.size:
+            raise ValueError('indptr must have nrow + 1 offsets within the nodes')
+        labels = _label_array(label, nrow)
+        label_ptr = None if labels is None else labels.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        self = cls.__new__(cls)
+        self._DMatrix__handle = ctypes.c_void_p()
+        # The nodes are kept alive by the DMatrix
+        self._nodes = nodes
+        self.num_rows = nrow
+        _check_call(_LIB.XlearnCreateDataView(indptr.ctypes.data_as(ctypes.POINTER(ctypes.c_uint64)),
+                                              nodes.ctypes.data_as(ctypes.c_void_p),
+                                              ctypes.c_uint(nrow),
+                                              label_ptr,
+                                              ctypes.byref(self._DMatrix__handle)))
+        return self
+
     @property
     def handle(self):
         return self.__handle
@@ -113,4 +195,106 @@ class DMatrix(object):
     # release the resource of DMatrix
     def __del__(self):
         _check_call(_LIB.XlearnDataFree(ctypes.byref(self.__handle)))
-        self.__handle = None
\ No newline at end of file
+        self.__handle = None
+def _batch_nodes(mat, field_map):
+    """Return the indptr and the nodes (DMatrix.NODE_DTYPE) of the non-zero
+    values of the numpy 2D, pandas DataFrame or scipy.sparse matrix"""
+    if isinstance(mat, DataFrame):
+        mat = mat.values
+    if _is_sparse(mat):
+        mat = mat.tocsr()
+        indptr = np.ascontiguousarray(mat.indptr, dtype=np.uint64)
+        cols, vals = mat.indices, mat.data
+    elif isinstance(mat, ndarray) and len(mat.shape) == 2:
+        rows, cols = np.nonzero(mat)
+        vals = mat[rows, cols]
+        indptr = np.zeros(mat.shape[0] + 1, dtype=np.uint64)
+        indptr[1:] = np.cumsum(np.bincount(rows, minlength=mat.shape[0]))
+    else:
+        raise ValueError('The batch must be numpy 2D, pandas DataFrame or scipy.sparse matrix')
+    nodes = np.empty(len(cols), dtype=DMatrix.NODE_DTYPE)
+    nodes['id'] = cols
+    nodes['value'] = vals
+    nodes['field'] = 0 if field_map is None else field_map[cols]
+    return indptr, nodes
+
+# The data given batch by batch, which is read again in each epoch
+class DataIter(object):
+    # The callbacks of XLearnSetDataIter()
+    NEXT_FUNC = ctypes.CFUNCTYPE(ctypes.c_uint64, ctypes.c_void_p,
+                                 ctypes.POINTER(ctypes.POINTER(ctypes.c_uint64)),
+                                 ctypes.POINTER(ctypes.c_void_p),
+                                 ctypes.POINTER(ctypes.POINTER(ctypes.c_float)))
+    RESET_FUNC = ctypes.CFUNCTYPE(None, ctypes.c_void_p)
+
+    def __init__(self, batches, field_map=None):
+        """
+        Initial function.
+        Parameters:
+        batches: a function that returns a new iterator of the batches for each pass over the data, e.g.,
+        the loader of the pandas or Arrow batches that do not fit in memory together. Each batch is
+        (data, label), where data is numpy 2D, pandas DataFrame or scipy.sparse matrix, or it is
+        (indptr, nodes, label) as DMatrix.view(), whose nodes are used without copying.
+        field_map: one-dimensional array of the field of each feature of data, only for ffm.
+        The arrays of a batch are kept until the next batch is read.
+        """
+        if not callable(batches):
+            raise ValueError('batches must be a function that returns an iterator of the batches')
+        self._batches = batches
+        self._field_map = None
+        if field_map is not None:
+            self._field_map = _field_array(field_map, np.asarray(field_map).size)
+        self._iter = None
+        self._batch = None
+        self._error = None
+        # The callbacks are kept alive with the DataIter
+        self._next_func = DataIter.NEXT_FUNC(self._next)
+        self._reset_func = DataIter.RESET_FUNC(self._reset)
+
+    def _convert(self, batch):
+        if len(batch) == 3:
+            indptr, nodes, label = batch
+            if not isinstance(nodes, ndarray) or nodes.dtype != DMatrix.NODE_DTYPE or \
+               not nodes.flags['C_CONTIGUOUS']:
+                raise ValueError('nodes must be a contiguous numpy array of DMatrix.NODE_DTYPE')
+            indptr = np.ascontiguousarray(indptr, dtype=np.uint64)
+        elif len(batch) == 2:
+            indptr, nodes = _batch_nodes(batch[0], self._field_map)
+            label = batch[1]
+        else:
+            raise ValueError('The batch must be (data, label) or (indptr, nodes, label)')
+        nrow = indptr.size - 1
+        if nrow < 0 or indptr[-1] > nodes.size:
+            raise ValueError('indptr must have nrow + 1 offsets within the nodes')
+        return indptr, nodes, _label_array(label, nrow)
+
+    def _next(self, handle, indptr, nodes, label):
+        # The error is raised by XLearn after the training
+        try:
+            if self._iter is None:
+                self._iter = iter(self._batches())
+            self._batch = None
+            for batch in self._iter:
+                self._batch = self._convert(batch)
+                if self._batch[0].size > 1:
+                    break
+            if self._batch is None or self._batch[0].size <= 1:
+                return 0
+            ptr, data, labels = self._batch
+            indptr[0] = ptr.ctypes.data_as(ctypes.POINTER(ctypes.c_uint64))
+            nodes[0] = data.ctypes.data
+            label[0] = ctypes.POINTER(ctypes.c_float)() if labels is None else \
+                       labels.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+            return ptr.size - 1
+        except Exception as e:
+            self._error = e
+            return 0
+
+    def _reset(self, handle):
+        self._iter = None
+
+    def check_error(self):
+        """Raise the error of the batches in the last training"""
+        error, self._error = self._error, None
+        if error is not None:
+            raise error
@@ -21,7 +21,7 @@ from .base import Series, DataFrame
 import numpy as np 
 from .base import _LIB, XLearnHandle
 from .base import _check_call, c_str
-from .data import DMatrix
+from .data import DMatrix, DataIter
 
 class XLearn(object):
     """XLearn is the core interface used by python API."""
@@ -36,6 +36,10 @@ class XLearn(object):
         """
         assert isinstance(handle, XLearnHandle)
         self.handle = handle
+        # Number of rows of the DMatrix of test data
+        self._test_rows = None
+        # The DataIter of train and validate, which is kept alive
+        self._data_iters = {}
 
     def __del__(self):
         _check_call(_LIB.XLearnHandleFree(ctypes.byref(self.handle)))
@@ -58,6 +62,51 @@ class XLearn(object):
             elif key == 'opt':
                 _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
                                               c_str(key), c_str(value)))
+            elif key == 'opt_state':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'stop_file':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'param_file':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'checkpoint':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'profile_file':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'trace':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'data_shm':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'feature_stats':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'sweep':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'cross':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'field_pairs':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'field_k':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'bag_field':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'bag_pool':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
+            elif key == 'task_loss':
+                _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                              c_str(key), c_str(value)))
             elif key == 'log':
                 _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
                                               c_str(key), c_str(value)))
@@ -91,18 +140,111 @@ class XLearn(object):
             elif key == 'lambda_2':
                 _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
                                                 c_str(key), ctypes.c_float(value)))
+            elif key == 'beta_1':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'beta_2':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'neg_rate':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'loss_sample':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'valid_sample':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'prune':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'checkpoint_minute':
+                _check_call(_LIB.XLearnSetFloat(ctypes.byref(self.handle),
+                                                c_str(key), ctypes.c_float(value)))
+            elif key == 'checkpoint_epoch':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'cv_jobs':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'read_jobs':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'sweep_jobs':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
             elif key == 'nthread':
                 _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
                                               c_str(key), ctypes.c_uint(value)))
             elif key == 'block_size':
                 _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
                                               c_str(key), ctypes.c_uint(value)))
+            elif key == 'mem_budget':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'block_cache':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'param_mem':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
             elif key == 'stop_window':
                 _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
                                               c_str(key), ctypes.c_uint(value)))
             elif key == 'seed':
                 _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
                                               c_str(key), ctypes.c_uint(value)))
+            elif key == 'shuffle_window':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'prefetch':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'merge_rows':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'hot_feature':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'grad_batch':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'owner_rows':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'long_row':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'sample_row':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'sample_pair':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'num_label':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'min_count':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'share_count':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'loss_sample_epoch':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'valid_every':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'valid_rows':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'hash_bits':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
+            elif key == 'auc_bucket':
+                _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                              c_str(key), ctypes.c_uint(value)))
             else:
                 raise Exception("Invalid key!", key)
 
@@ -126,8 +268,11 @@ class XLearn(object):
             key = "train"
             _check_call(_LIB.XLearnSetDMatrix(ctypes.byref(self.handle), c_str(key), ctypes.byref(train_path.handle)))
             _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle), c_str("from_file"), ctypes.c_bool(False)))
+        elif isinstance(train_path, DataIter):
+            self._set_data_iter("train", train_path)
+            _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle), c_str("from_file"), ctypes.c_bool(False)))
         else:
-            raise Exception("Invalid train.Can be test file path or xLearn DMatrix", type(train_path))
+            raise Exception("Invalid train.Can be test file path, xLearn DMatrix or DataIter", type(train_path))
 
     def setTest(self, test_path):
         """Set file path of test data.
@@ -140,10 +285,12 @@ class XLearn(object):
         if isinstance(test_path, str):
             _check_call(_LIB.XLearnSetTest(ctypes.byref(self.handle), c_str(test_path)))
             _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle), c_str("from_file"), ctypes.c_bool(True)))
+            self._test_rows = None
         elif isinstance(test_path, DMatrix):
             key = "test"
             _check_call(_LIB.XLearnSetDMatrix(ctypes.byref(self.handle), c_str(key), ctypes.byref(test_path.handle)))
             _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle), c_str("from_file"), ctypes.c_bool(False)))
+            self._test_rows = test_path.num_rows
         else:
             raise Exception("Invalid test.Can be test file path or xLearn DMatrix", type(test_path))
 
@@ -170,8 +317,24 @@ class XLearn(object):
         elif isinstance(val_path, DMatrix):
             key = "validate"
             _check_call(_LIB.XLearnSetDMatrix(ctypes.byref(self.handle), c_str(key), ctypes.byref(val_path.handle)))
+        elif isinstance(val_path, DataIter):
+            self._set_data_iter("validate", val_path)
         else:
-            raise Exception("Invalid validation.Can be test file path or xLearn DMatrix", type(val_path))
+            raise Exception("Invalid validation.Can be test file path, xLearn DMatrix or DataIter", type(val_path))
+
+    def _set_data_iter(self, key, data_iter):
+        """Stream the data of key (train or validate) from the batches of
+        the DataIter, which are read again in each epoch.
+        """
+        _check_call(_LIB.XLearnSetDataIter(ctypes.byref(self.handle), c_str(key),
+                                           data_iter._next_func, data_iter._reset_func,
+                                           None))
+        self._data_iters[key] = data_iter
+
+    def _check_data_iters(self):
+        """Raise the error of the batches of the DataIter"""
+        for data_iter in self._data_iters.values():
+            data_iter.check_error()
 
     def setTXTModel(self, model_path):
         """Set the path of TXT model file.
@@ -183,6 +346,17 @@ class XLearn(object):
         """
         _check_call(_LIB.XLearnSetTXTModel(ctypes.byref(self.handle), c_str(model_path)))
 
+    def setInferenceModel(self, model_path):
+        """Set the path of inference model file, which only keeps
+        the model without the gradient cache of the optimizer.
+
+        Parameters
+        ----------
+        model_path : str
+            the path of the inference model file.
+        """
+        _check_call(_LIB.XLearnSetInferenceModel(ctypes.byref(self.handle), c_str(model_path)))
+
     def setQuiet(self):
         """Set xlearn to quiet model"""
         key = 'quiet'
@@ -195,12 +369,52 @@ class XLearn(object):
         _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
                                        c_str(key), ctypes.c_bool(True)))
 
+    def setAutoBlock(self):
+        """Adjust the block size of on-disk training by its first epoch"""
+        key = 'auto_block'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setPackRows(self):
+        """Keep the rows of the in-memory training compressed, which
+        are decoded by the batches of each pass"""
+        key = 'pack_rows'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setAutotune(self):
+        """Time the threads, the prefetch and the kernels on a sample of
+        the training data, and train with the fastest ones"""
+        key = 'autotune'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setChecksum(self):
+        """Write the checksum of each section of the model file, which
+        is verified when the model is loaded"""
+        key = 'checksum'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
     def setNoBin(self):
         """Do not generate bin file"""
         key = 'bin_out'
         _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
                                        c_str(key), ctypes.c_bool(False)))
 
+    def setSkipZeros(self):
+        """Drop the features of value 0 when parsing the data"""
+        key = 'skip_zeros'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setMergeDup(self):
+        """Merge the features of the same id in a row
+        when parsing the data, whose values are summed"""
+        key = 'merge_dup'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
     def disableNorm(self):
         """Disable instance-wise normalization"""
         key = 'norm'
@@ -219,6 +433,139 @@ class XLearn(object):
         _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
                                        c_str(key), ctypes.c_bool(False)))
 
+    def setLazyInit(self):
+        """Initialize the model parameters of each feature on its first use"""
+        key = 'lazy_init'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setLazyL2(self):
+        """Apply the L2 regularization of each feature lazily on its next use,
+        so every step decays all the features (only for sgd and adagrad)"""
+        key = 'lazy_l2'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setTrainMetric(self):
+        """Also show the metric of the training data, which is
+        accumulated in the gradient pass"""
+        key = 'train_metric'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setExactAUC(self):
+        """Compute the exact AUC by sorting the scores of all the
+        examples, instead of the buckets (auc_bucket)"""
+        key = 'exact_auc'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setProfile(self):
+        """Print the time of the phases of each epoch, with the
+        rows/sec and the nnz/sec of the gradient pass"""
+        key = 'profile'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setPerfCounter(self):
+        """Count the hardware events of the gradient pass and of the
+        prediction (Linux only), which are printed with setProfile()"""
+        key = 'perf_counter'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setRemapFeatures(self):
+        """Renumber the features by their frequency in the training
+        data, so the frequent features are together in the model"""
+        key = 'remap_features'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setRemapFields(self):
+        """Renumber the fields of the training data to the used ones,
+        so ffm and fwfm only keep the parameters of these fields"""
+        key = 'remap_fields'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setAsyncValidate(self):
+        """Validate each epoch on a snapshot of the model while
+        the next epoch is trained"""
+        key = 'async_validate'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setSparseModel(self):
+        """Write the model file in the sparse format, which only
+        keeps the features that have been used"""
+        key = 'sparse_model'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setSparseFFM(self):
+        """Only keep the latent vectors of ffm for the pairs of
+        (feature, target field) in the training data"""
+        key = 'sparse_ffm'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setSplitFFM(self):
+        """Keep the latent weights of each feature of ffm
+        apart from their gradient cache"""
+        key = 'split_ffm'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setFieldMajor(self):
+        """Keep the latent vectors of ffm in the order
+        of target field and then feature"""
+        key = 'field_major'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setHugePage(self):
+        """Use transparent huge pages for the model parameters"""
+        key = 'huge_page'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setNumaPolicy(self, policy):
+        """Set NUMA placement of the model parameters, which can
+        be 'none', 'interleave', 'local' (only for training), or
+        'replicate' (a copy of the model on each NUMA node)"""
+        key = 'numa'
+        _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                      c_str(key), c_str(policy)))
+
+    def setNumaSync(self, rows):
+        """Set the number of rows trained by the NUMA copies of
+        'replicate' between two averages of the copies"""
+        key = 'numa_sync'
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str(key), ctypes.c_int(rows)))
+
+    def setFileIO(self, mode):
+        """Set how the data files are read, which can be 'cache',
+        'nocache' (drop the pages after they are read), 'direct'
+        (read by O_DIRECT), or 'uring' (read by io_uring)"""
+        key = 'io'
+        _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                      c_str(key), c_str(mode)))
+
+    def setPartition(self, partition):
+        """Set how the rows are split over the threads, which
+        can be 'row', 'nnz', or 'dynamic'"""
+        key = 'partition'
+        _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                      c_str(key), c_str(partition)))
+
+    def setAffinity(self, affinity):
+        """Set cpu affinity of the threads, which can be 'none',
+        'compact', 'scatter', or a cpu list such as '0-7,16-23'"""
+        key = 'affinity'
+        _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                      c_str(key), c_str(affinity)))
+
     def setSign(self):
         """Convert output to 0 and 1"""
         key = 'sign'
@@ -231,6 +578,33 @@ class XLearn(object):
         _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
                                        c_str(key), ctypes.c_bool(True)))
 
+    def setRawOut(self):
+        """Write the prediction file as raw float32 values instead of text"""
+        key = 'raw_out'
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str(key), ctypes.c_bool(True)))
+
+    def setGPU(self, device=0):
+        """Score the test set on the CUDA device, which falls back to
+        the CPU if xLearn is built without CUDA or the model is not supported"""
+        _check_call(_LIB.XLearnSetBool(ctypes.byref(self.handle),
+                                       c_str('use_gpu'), ctypes.c_bool(True)))
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str('gpu_device'), ctypes.c_int(device)))
+
+    def setPairTable(self, cells):
+        """Look up the pairs of fields of ffm whose features in the test
+        set are at most cells in product from the precomputed tables"""
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str('pair_table'), ctypes.c_int(cells)))
+
+    def setLatentType(self, latent_type):
+        """Set storage type of the latent factors for prediction and
+        the inference model, which can be 'fp32', 'fp16', 'bf16', or 'int8'"""
+        key = 'latent'
+        _check_call(_LIB.XLearnSetStr(ctypes.byref(self.handle),
+                                      c_str(key), c_str(latent_type)))
+
     def fit(self, param, model_path):
         """Check hyper-parameters, train model, and dump model.
 
@@ -243,6 +617,45 @@ class XLearn(object):
         """
         self._set_Param(param)
         _check_call(_LIB.XLearnFit(ctypes.byref(self.handle), c_str(model_path)))
+        self._check_data_iters()
+
+    def fitInMemory(self, param):
+        """Check hyper-parameters and train model, which is kept loaded in
+        the handle for predictLoaded() and getWeights() without writing the
+        model file.
+
+        Parameters
+        ----------
+        param : dict
+          hyper-parameter used by xlearn.
+        """
+        self._set_Param(param)
+        _check_call(_LIB.XLearnFitInMemory(ctypes.byref(self.handle)))
+        self._check_data_iters()
+
+    def partialFit(self, dmatrix, param=None):
+        """Train the model with one pass over a mini-batch, which keeps the
+        model and its optimizer state in the handle for the next call and
+        for predictLoaded(). The new feature ids grow the model, and the
+        first call creates the model if none is loaded.
+
+        Parameters
+        ----------
+        dmatrix : DMatrix. the mini-batch with labels.
+        param : dict, default None. hyper-parameters used by xlearn,
+        which are set before the call.
+
+        Returns
+        -------
+        the training loss of the mini-batch.
+        """
+        if param is not None:
+            self._set_Param(param)
+        loss = ctypes.c_float()
+        _check_call(_LIB.XLearnPartialFit(ctypes.byref(self.handle),
+                                          ctypes.byref(dmatrix.handle),
+                                          ctypes.byref(loss)))
+        return loss.value
 
     def cv(self, param):
         """ Do cross-validation
@@ -255,7 +668,7 @@ class XLearn(object):
         self._set_Param(param)
         _check_call(_LIB.XLearnCV(ctypes.byref(self.handle)))
 
-    def predict(self, model_path, out_path=None):
+    def predict(self, model_path, out_path=None, out=None):
         """Predict output
 
         Parameters
@@ -263,7 +676,21 @@ class XLearn(object):
         model_path : str. path of model checkpoint.
         out_path : str, default None. if a path of output result is set, then will save result to local file,
         and will not return numpy res.
+        out : numpy float32 array, default None. if it is set, the result is written to it directly,
+        which must have one value for each row of the test data. It is allocated for the test DMatrix.
         """
+        if out_path is None and out is None and self._test_rows is not None:
+            out = np.zeros(self._test_rows, dtype=np.float32)
+        if out_path is None and out is not None:
+            if out.dtype != np.float32 or not out.flags['C_CONTIGUOUS']:
+                raise ValueError('out must be a contiguous numpy.float32 array')
+            num_rows = ctypes.c_uint64()
+            _check_call(_LIB.XLearnPredictForBuffer(ctypes.byref(self.handle),
+                                                    c_str(model_path),
+                                                    out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                                    ctypes.c_uint64(out.size),
+                                                    ctypes.byref(num_rows)))
+            return out[:num_rows.value]
         if out_path is None:
             length = ctypes.c_uint64()
             preds = ctypes.POINTER(ctypes.c_float)()
@@ -279,6 +706,282 @@ class XLearn(object):
                                                  c_str(model_path),
                                                  c_str(out_path)))
 
+    def loadModel(self, model_path):
+        """Load the model once for the following predictLoaded() calls,
+        which keeps the model and the threads resident.
+
+        Parameters
+        ----------
+        model_path : str. path of model checkpoint.
+        """
+        _check_call(_LIB.XLearnLoadModel(ctypes.byref(self.handle),
+                                         c_str(model_path)))
+
+    def predictLoaded(self, dmatrix, out=None):
+        """Predict the DMatrix by the model of loadModel()
+
+        Parameters
+        ----------
+        dmatrix : DMatrix. the data to predict.
+        out : numpy float32 array, default None. if it is set, the
+        output is written to it, which must have one value for each row.
+        """
+        if out is None:
+            out = np.zeros(dmatrix.num_rows, dtype=np.float32)
+        if out.dtype != np.float32 or not out.flags['C_CONTIGUOUS']:
+            raise ValueError('out must be a contiguous numpy.float32 array')
+        _check_call(_LIB.XLearnPredict(ctypes.byref(self.handle),
+                                       ctypes.byref(dmatrix.handle),
+                                       out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                       ctypes.c_uint64(out.size)))
+        return out
+
+    def scoreRows(self, dmatrix, out=None):
+        """Same as predictLoaded(), but the rows are scored in the calling
+        thread without the thread pool, which has the lowest latency for
+        a few rows and can be called by many threads at the same time.
+
+        Parameters
+        ----------
+        dmatrix : DMatrix. the data to score.
+        out : numpy float32 array, default None. if it is set, the
+        output is written to it, which must have one value for each row.
+        """
+        if out is None:
+            out = np.zeros(dmatrix.num_rows, dtype=np.float32)
+        if out.dtype != np.float32 or not out.flags['C_CONTIGUOUS']:
+            raise ValueError('out must be a contiguous numpy.float32 array')
+        _check_call(_LIB.XLearnScoreRows(ctypes.byref(self.handle),
+                                         ctypes.byref(dmatrix.handle),
+                                         out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                         ctypes.c_uint64(out.size)))
+        return out
+
+    def predictIter(self, test_path, batch_size=65536):
+        """Predict the test file by the model of loadModel() batch by batch,
+        which yields a numpy float32 array of at most batch_size results for
+        each batch. Only a few blocks of the file are kept in memory, and the
+        next blocks are parsed while the caller handles the results.
+
+        Parameters
+        ----------
+        test_path : str. path of the test file.
+        batch_size : int, default 65536. the most results of a batch.
+        """
+        if batch_size <= 0:
+            raise ValueError('batch_size must be positive')
+        it = ctypes.c_void_p()
+        _check_call(_LIB.XLearnPredictOpen(ctypes.byref(self.handle),
+                                           c_str(test_path),
+                                           ctypes.byref(it)))
+        try:
+            while True:
+                out = np.empty(batch_size, dtype=np.float32)
+                num_rows = ctypes.c_uint64()
+                _check_call(_LIB.XLearnPredictNext(ctypes.byref(it),
+                                                   out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                                   ctypes.c_uint64(batch_size),
+                                                   ctypes.byref(num_rows)))
+                if num_rows.value == 0:
+                    break
+                yield out[:num_rows.value]
+        finally:
+            _check_call(_LIB.XLearnPredictClose(ctypes.byref(it)))
+
+    def rankCandidates(self, feat_id, value, candidates, field_id=None, out=None):
+        """Rank the candidates of one request, in which each row of the
+        candidates is scored as the context features plus its own features,
+        and the part of the context is computed only once.
+
+        Parameters
+        ----------
+        feat_id : list or numpy array of int. feature ids of the context.
+        value : list or numpy array of float. feature values of the context.
+        candidates : DMatrix. one row for each candidate.
+        field_id : list or numpy array of int, default None. field ids
+        of the context, which is only needed by ffm.
+        out : numpy float32 array, default None. if it is set, the
+        output is written to it, which must have one value for each row.
+        """
+        feat = np.ascontiguousarray(feat_id, dtype=np.uint32)
+        val = np.ascontiguousarray(value, dtype=np.float32)
+        if feat.size != val.size:
+            raise ValueError('feat_id and value must have the same length')
+        field_ptr = None
+        if field_id is not None:
+            field = np.ascontiguousarray(field_id, dtype=np.uint32)
+            if field.size != feat.size:
+                raise ValueError('field_id and feat_id must have the same length')
+            field_ptr = field.ctypes.data_as(ctypes.POINTER(ctypes.c_uint32))
+        if out is None:
+            out = np.zeros(candidates.num_rows, dtype=np.float32)
+        if out.dtype != np.float32 or not out.flags['C_CONTIGUOUS']:
+            raise ValueError('out must be a contiguous numpy.float32 array')
+        _check_call(_LIB.XLearnRankCandidates(ctypes.byref(self.handle),
+                                              feat.ctypes.data_as(ctypes.POINTER(ctypes.c_uint32)),
+                                              field_ptr,
+                                              val.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                              ctypes.c_uint32(feat.size),
+                                              ctypes.byref(candidates.handle),
+                                              out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                              ctypes.c_uint64(out.size)))
+        return out
+
+    def setBatching(self, window_us, max_rows=4096):
+        """Predict the predictLoaded() calls of many threads arriving within
+        window_us microseconds in one batch of at most max_rows rows, which
+        is set before loadModel()"""
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str('batch_window'), ctypes.c_int(window_us)))
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str('batch_rows'), ctypes.c_int(max_rows)))
+
+    def setResultCache(self, entries):
+        """Keep the scores of at most entries recent rows of the loaded
+        model, so the repeated rows of predictLoaded() and scoreRows() are
+        not scored again. The cache is emptied when the model is reloaded
+        or trained by partialFit(), and it is set before loadModel()"""
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str('result_cache'), ctypes.c_int(entries)))
+
+    def setMetricsPort(self, port):
+        """Serve the metrics of the loaded model (the rows, the latency of
+        the predictions, the memory and the threads) in the Prometheus text
+        format at http://<host>:port/metrics, which is set before
+        loadModel(). 0 disables it"""
+        _check_call(_LIB.XLearnSetInt(ctypes.byref(self.handle),
+                                      c_str('metrics_port'), ctypes.c_int(port)))
+
+    def reloadModel(self, model_path, background=False):
+        """Load a new version of the model of loadModel(), and swap it in
+        when it is ready. The running predictions keep the old version,
+        which is released after they are done.
+
+        Parameters
+        ----------
+        model_path : str. path of the new model checkpoint.
+        background : bool, default False. if it is True, the model is
+        loaded in a background thread, and waitReload() waits for it.
+        """
+        _check_call(_LIB.XLearnReloadModel(ctypes.byref(self.handle),
+                                           c_str(model_path),
+                                           ctypes.c_bool(background)))
+
+    def waitReload(self):
+        """Wait for the reloadModel() in the background"""
+        _check_call(_LIB.XLearnWaitReload(ctypes.byref(self.handle)))
+
+    def applyDelta(self, delta_path):
+        """Apply the delta file of xlearn_online -delta to the loaded
+        model in place, which only changes the updated features. Return
+        False if the model is not the base version of the delta, or it
+        cannot be changed in place, and then reloadModel() is needed.
+
+        Parameters
+        ----------
+        delta_path : str. path of the delta file.
+        """
+        applied = ctypes.c_bool()
+        _check_call(_LIB.XLearnApplyDelta(ctypes.byref(self.handle),
+                                          c_str(delta_path),
+                                          ctypes.byref(applied)))
+        return applied.value
+
+    def getModelVersion(self):
+        """Return the version of the loaded model"""
+        version = ctypes.c_uint64()
+        _check_call(_LIB.XLearnGetModelVersion(ctypes.byref(self.handle),
+                                               ctypes.byref(version)))
+        return version.value
+
+    def getWeights(self):
+        """Return the weights of the loaded model as (bias, linear, latent),
+        in which linear has one value for each feature, and latent has
+        the shape (num_feature, k) for fm, (num_feature, num_field, k)
+        for ffm, or is None for linear model"""
+        num_feature = ctypes.c_uint64()
+        num_field = ctypes.c_uint64()
+        num_K = ctypes.c_uint64()
+        _check_call(_LIB.XLearnGetModelShape(ctypes.byref(self.handle),
+                                             ctypes.byref(num_feature),
+                                             ctypes.byref(num_field),
+                                             ctypes.byref(num_K)))
+        linear = np.zeros(num_feature.value + 1, dtype=np.float32)
+        latent = None
+        if num_K.value > 0:
+            shape = (num_feature.value, num_K.value)
+            if num_field.value > 0:
+                shape = (num_feature.value, num_field.value, num_K.value)
+            latent = np.zeros(shape, dtype=np.float32)
+        latent_ptr = None if latent is None else \
+            latent.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        _check_call(_LIB.XLearnGetModelWeights(ctypes.byref(self.handle),
+                                               linear.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                                               ctypes.c_uint64(linear.size),
+                                               latent_ptr,
+                                               ctypes.c_uint64(0 if latent is None else latent.size)))
+        return linear[0], linear[1:], latent
+
+    def getThreadStats(self):
+        """Return the statistics of the thread pool of the last fit()
+        as a dict: the number of the tasks of each worker, the seconds
+        each worker was busy, idle and waiting for the lock of the
+        queue, and the seconds the training thread waited for them"""
+        num_worker = ctypes.c_uint64()
+        caller_wait = ctypes.c_double()
+        _check_call(_LIB.XLearnGetThreadStats(ctypes.byref(self.handle),
+                                              None, None, None, None,
+                                              ctypes.c_uint64(0),
+                                              ctypes.byref(num_worker),
+                                              ctypes.byref(caller_wait)))
+        num = num_worker.value
+        tasks = (ctypes.c_uint64 * num)()
+        busy = (ctypes.c_double * num)()
+        idle = (ctypes.c_double * num)()
+        lock_wait = (ctypes.c_double * num)()
+        _check_call(_LIB.XLearnGetThreadStats(ctypes.byref(self.handle),
+                                              tasks, busy, idle, lock_wait,
+                                              ctypes.c_uint64(num),
+                                              ctypes.byref(num_worker),
+                                              ctypes.byref(caller_wait)))
+        return {'tasks': list(tasks), 'busy': list(busy),
+                'idle': list(idle), 'lock_wait': list(lock_wait),
+                'caller_wait': caller_wait.value}
+
+    def getPredictLatency(self, phase='total',
+                          quantiles=(0.5, 0.9, 0.99, 0.999), reset=False):
+        """Return the latency (seconds) of a phase of predictLoaded() as a
+        dict of the quantiles, the count, the mean and the max. The phase
+        is 'queue' (the wait of setBatching()), 'build' (the DMatrix of
+        all the handles), 'score', 'copy' or 'total'. If reset is True,
+        the calls are removed, so each call reads one interval"""
+        q = (ctypes.c_double * len(quantiles))(*quantiles)
+        values = (ctypes.c_double * len(quantiles))()
+        count = ctypes.c_uint64()
+        mean = ctypes.c_double()
+        max_value = ctypes.c_double()
+        _check_call(_LIB.XLearnGetPredictLatency(ctypes.byref(self.handle),
+                                                 c_str(phase), q, values,
+                                                 ctypes.c_uint64(len(quantiles)),
+                                                 ctypes.byref(count),
+                                                 ctypes.byref(mean),
+                                                 ctypes.byref(max_value),
+                                                 ctypes.c_bool(reset)))
+        result = {'count': count.value, 'mean': mean.value,
+                  'max': max_value.value}
+        for i in range(len(quantiles)):
+            result['p%g' % (quantiles[i] * 100)] = values[i]
+        return result
+
+    def saveModel(self, model_path):
+        """Save the loaded model to a model checkpoint"""
+        _check_call(_LIB.XLearnSaveModel(ctypes.byref(self.handle),
+                                         c_str(model_path)))
+
+    def unloadModel(self):
+        """Release the model of loadModel()"""
+        _check_call(_LIB.XLearnUnloadModel(ctypes.byref(self.handle)))
+
 def create_linear():
     """
     Create a linear model.
@@ -309,6 +1012,17 @@ def create_ffm():
     return XLearn(handle)
 
 
+def create_fwfm():
+    """
+    Create a field-weighted factorization machine, which is an FM
+    with a learned weight for each pair of fields.
+    """
+    model_type = 'fwfm'
+    handle = XLearnHandle()
+    _check_call(_LIB.XLearnCreate(c_str(model_type), ctypes.byref(handle)))
+    return XLearn(handle)
+
+
 def hello():
     """
     Say hello to user
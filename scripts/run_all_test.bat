@@ -16,18 +16,54 @@ REM # limitations under the License.
 REM # This script runs all of the unit test for C++
 .\base\Release\file_util_test.exe
 .\base\Release\levenshtein_distance_test.exe
+.\base\Release\scratch_buffer_test.exe
+.\base\Release\half_test.exe
+.\base\Release\mem_alloc_test.exe
+.\base\Release\math_test.exe
+.\base\Release\parse_number_test.exe
+.\base\Release\mmap_file_test.exe
+.\base\Release\varint_test.exe
+.\base\Release\sha256_test.exe
+.\base\Release\phase_timer_test.exe
+.\base\Release\trace_test.exe
+.\base\Release\memory_info_test.exe
+.\base\Release\perf_counter_test.exe
+.\base\Release\uring_file_test.exe
+.\base\Release\stats_registry_test.exe
+.\base\Release\radix_sort_test.exe
+.\base\Release\stripe_lock_test.exe
 .\base\Release\thread_pool_test.exe
 .\c_api\Release\c_api_test.exe
 .\data\Release\data_structure_test.exe
 .\data\Release\model_parameters_test.exe
+.\data\Release\feature_stats_test.exe
+.\data\Release\field_index_test.exe
+.\data\Release\pair_table_test.exe
+.\distributed\Release\parameter_server_test.exe
+.\distributed\Release\ring_allreduce_test.exe
+.\distributed\Release\metrics_server_test.exe
+.\distributed\Release\shared_model_test.exe
 .\loss\Release\cross_entropy_loss_test.exe
 .\loss\Release\loss_test.exe
 .\loss\Release\metric_test.exe
 .\loss\Release\squared_loss_test.exe
 .\reader\Release\file_splitor_test.exe
+.\reader\Release\decompressor_test.exe
+.\reader\Release\remote_file_test.exe
+.\reader\Release\shared_dataset_test.exe
+.\reader\Release\columnar_test.exe
+.\reader\Release\block_cache_test.exe
+.\reader\Release\packed_rows_test.exe
 .\reader\Release\parser_test.exe
+.\reader\Release\tokenizer_test.exe
 .\reader\Release\reader_test.exe
 .\score\Release\ffm_score_test.exe
+.\score\Release\fwfm_score_test.exe
 .\score\Release\fm_score_test.exe
 .\score\Release\linear_score_test.exe
-.\score\Release\score_function_test.exe
\ No newline at end of file
+.\score\Release\score_function_test.exe
+.\score\Release\score_kernel_test.exe
+.\score\Release\gpu_score_test.exe
+.\solver\Release\solver_test.exe
+.\solver\Release\convert_test.exe
+.\solver\Release\result_cache_test.exe
\ No newline at end of file
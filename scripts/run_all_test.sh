@@ -16,18 +16,54 @@
 # This script runs all of the unit test for C++
 ./base/file_util_test
 ./base/levenshtein_distance_test
+./base/scratch_buffer_test
+./base/half_test
+./base/mem_alloc_test
+./base/math_test
+./base/parse_number_test
+./base/mmap_file_test
+./base/varint_test
+./base/sha256_test
+./base/phase_timer_test
+./base/trace_test
+./base/memory_info_test
+./base/perf_counter_test
+./base/uring_file_test
+./base/stats_registry_test
+./base/radix_sort_test
+./base/stripe_lock_test
 ./base/thread_pool_test
 ./c_api/c_api_test
 ./data/data_structure_test
 ./data/model_parameters_test
+./data/feature_stats_test
+./data/field_index_test
+./data/pair_table_test
+./distributed/parameter_server_test
+./distributed/ring_allreduce_test
+./distributed/metrics_server_test
+./distributed/shared_model_test
 ./loss/cross_entropy_loss_test
 ./loss/loss_test
 ./loss/metric_test
 ./loss/squared_loss_test
 ./reader/file_splitor_test
+./reader/decompressor_test
+./reader/remote_file_test
+./reader/shared_dataset_test
+./reader/columnar_test
+./reader/block_cache_test
+./reader/packed_rows_test
 ./reader/parser_test
+./reader/tokenizer_test
 ./reader/reader_test
 ./score/ffm_score_test
+./score/fwfm_score_test
 ./score/fm_score_test
 ./score/linear_score_test
-./score/score_function_test
\ No newline at end of file
+./score/score_function_test
+./score/score_kernel_test
+./score/gpu_score_test
+./solver/solver_test
+./solver/convert_test
+./solver/result_cache_test
\ No newline at end of file
@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file provides the runtime detection of the SIMD
+instruction set supported by current CPU.
+*/
+
+#ifndef XLEARN_BASE_CPU_INFO_H_
+#define XLEARN_BASE_CPU_INFO_H_
+
+//------------------------------------------------------------------------------
+// Target architecture. The score kernels are built with SSE/AVX2/AVX-512,
+// so only x86-64 is supported.
+//------------------------------------------------------------------------------
+#if defined(__x86_64__) || defined(_M_X64) || \
+    defined(__i386__) || defined(_M_IX86)
+#define XLEARN_X86 1
+#else
+#error "xLearn only supports x86-64."
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "src/base/common.h"
+
+// Prefetch the cache line of the address into all the cache
+// levels, which is the same as _mm_prefetch(p, _MM_HINT_T0).
+#if !defined(_MSC_VER)
+#define XLEARN_PREFETCH(p) __builtin_prefetch((const void*)(p), 0, 3)
+#else
+#define XLEARN_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#endif
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// SIMD level used by the score kernels. A higher level
+// always implies all the lower levels.
+//------------------------------------------------------------------------------
+enum SimdLevel {
+  kSimdSSE = 0,     /* 128-bit, the baseline of x86-64 */
+  kSimdAVX2 = 1,    /* 256-bit, AVX2 + FMA + F16C */
+  kSimdAVX512 = 2   /* 512-bit, AVX-512F */
+};
+
+// The baseline level, which is supported by every CPU.
+const SimdLevel kSimdBaseline = kSimdSSE;
+
+// Return the name of the SIMD level.
+inline const char* SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case kSimdAVX512: return "avx512";
+    case kSimdAVX2: return "avx2";
+    default: return "sse";
+  }
+}
+
+// Check CPUID (and the OS support of the wide registers)
+// to find the best SIMD level of current machine.
+inline SimdLevel DetectSimdLevel() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int max_id = info[0];
+  if (max_id < 7) { return kSimdSSE; }
+  __cpuid(info, 1);
+  bool has_fma = (info[2] & (1 << 12)) != 0;
+  bool has_osxsave = (info[2] & (1 << 27)) != 0;
+  bool has_avx = (info[2] & (1 << 28)) != 0;
+  bool has_f16c = (info[2] & (1 << 29)) != 0;
+  if (!has_osxsave || !has_avx) { return kSimdSSE; }
+  unsigned long long xcr0 = _xgetbv(0);
+  // XMM and YMM state
+  if ((xcr0 & 0x6) != 0x6) { return kSimdSSE; }
+  __cpuidex(info, 7, 0);
+  bool has_avx2 = (info[1] & (1 << 5)) != 0;
+  bool has_avx512f = (info[1] & (1 << 16)) != 0;
+  // opmask, ZMM_Hi256 and Hi16_ZMM state
+  if (has_avx512f && (xcr0 & 0xe0) == 0xe0) {
+    return kSimdAVX512;
+  }
+  if (has_avx2 && has_fma && has_f16c) {
+    return kSimdAVX2;
+  }
+  return kSimdSSE;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return kSimdAVX512;
+  }
+  if (__builtin_cpu_supports("avx2") &&
+      __builtin_cpu_supports("fma") &&
+      __builtin_cpu_supports("f16c")) {
+    return kSimdAVX2;
+  }
+  return kSimdSSE;
+#endif
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_CPU_INFO_H_
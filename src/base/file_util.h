@@ -22,12 +22,21 @@ This file contains facilitlies to control the file.
 #define XLEARN_BASE_FILE_UTIL_H_
 
 #ifndef _MSC_VER
+#include <dirent.h>
+#include <glob.h>
 #include <unistd.h>
 #else
 #include "src/base/unistd.h"
 #endif
+#include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 
 #include "src/base/common.h"
@@ -103,10 +112,41 @@ This file contains facilitlies to control the file.
 //    /* (14) Generate hash value for file  */
 //    uint64 hash_1 = HashFile(filename, true);   /* for one block */
 //    uint64 hash_2 = HashFile(filename, false);  /* for the whole file */
+//    uint64 stamp = HashFileStamp(filename);    /* size, mtime and inode */
+//    uint64 sample = HashFileSample(filename);  /* a few blocks */
 //
 //    /* (15) Read the whole file into in-memory buffer */
 //    char *buffer = nullptr;
 //    uint64 file_size = ReadFileToMemory(filename, &buffer);
+//
+//    /* (16) Get and set the position of a big file */
+//    uint64 pos = FileTell(file_r);
+//    FileSeek(file_r, pos);
+//
+//    /* (17) Read data from memory buffer (e.g., a mapped file) */
+//    const char* ptr = buf;
+//    int number = 0;
+//    ReadDataFromBuffer(&ptr, buf + size, (char*)&number, sizeof(number));
+//    std::vector<int> vec;
+//    ReadVectorFromBuffer(&ptr, buf + size, vec);
+//
+//    /* (18) Check if the input is a stream (stdin or a pipe) */
+//    if (IsStreamFile(filename)) { ... read it once ... }
+//
+//    /* (19) Check if the file is compressed, or in the object storage */
+//    if (GetCompression(filename) == "gzip") { ... }
+//    if (IsRemoteFile("s3://bucket/train.txt")) { ... }
+//
+//    /* (20) Expand the comma-separated list of files and globs */
+//    std::vector<std::string> files = ExpandFileList("a.txt,part-*");
+//    files = ExpandDataList("day-1/,@manifest.txt");
+//
+//    /* (21) Read a file without filling the page cache */
+//    AdviseFile(file_r, 0, 0, kAdviseSequential);
+//    size_t len = ReadDataFromDisk(file_r, buf, size);
+//    AdviseFile(file_r, 0, len, kAdviseDontNeed);
+//    DirectFile direct;
+//    if (direct.Open(filename)) { len = direct.Read(0, buf, size); }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
@@ -131,6 +171,149 @@ inline bool FileExist(const char *filename) {
   return false;
 }
 
+// The file name of the standard input.
+static const char* const kStdinFile = "-";
+
+// Check if the file is a stream that can only be read once, i.e.,
+// the standard input ("-"), a named pipe (FIFO), or a socket. The
+// readers cannot seek in a stream or read it again.
+inline bool IsStreamFile(const std::string& filename) {
+  if (filename == kStdinFile) { return true; }
+#ifndef _MSC_VER
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) { return false; }
+  return S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode) ||
+         S_ISCHR(st.st_mode);
+#else
+  return false;
+#endif
+}
+
+// Check if the file is an object of the object storage, i.e.,
+// s3://<bucket>/<key> or hdfs://<host>/<path>, which is read by
+// the RemoteFile of the readers (see remote_file.h).
+inline bool IsRemoteFile(const std::string& filename) {
+  return filename.compare(0, 5, "s3://") == 0 ||
+         filename.compare(0, 7, "hdfs://") == 0;
+}
+
+// Return the compression of the file by its magic number, which
+// is "gzip", "zstd", or "" (not compressed, or not a regular file).
+inline std::string GetCompression(const std::string& filename) {
+  if (IsStreamFile(filename) || IsRemoteFile(filename)) { return ""; }
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) { return ""; }
+  unsigned char magic[4] = { 0, 0, 0, 0 };
+  size_t len = fread(magic, 1, sizeof(magic), file);
+  fclose(file);
+  if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return "gzip";
+  }
+  if (len == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+      magic[2] == 0x2f && magic[3] == 0xfd) {
+    return "zstd";
+  }
+  return "";
+}
+
+// The prefix of the files made from the input (e.g., the model
+// and the cache), which is "stdin" for the standard input, and
+// the last part of the path (in current directory) for a remote file.
+inline std::string OutputPrefix(const std::string& filename) {
+  if (IsRemoteFile(filename)) {
+    return filename.substr(filename.rfind('/') + 1);
+  }
+  return filename == kStdinFile ? std::string("stdin") : filename;
+}
+
+// Check if the path is a directory.
+inline bool IsDirectory(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) { return false; }
+  return (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+// Expand the list of files separated by commas, in which each item
+// can be a glob pattern (e.g., "day-*.txt"), and its matches are
+// sorted. The item without any match is kept as it is, so a missing
+// file is reported by its caller. The glob is not expanded on Windows.
+inline std::vector<std::string> ExpandFileList(const std::string& list) {
+  std::vector<std::string> files;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) { end = list.size(); }
+    std::string item = list.substr(start, end - start);
+    start = end + 1;
+    if (item.empty()) { continue; }
+#ifndef _MSC_VER
+    if (item.find_first_of("*?[") != std::string::npos) {
+      glob_t matches;
+      if (glob(item.c_str(), 0, nullptr, &matches) == 0) {
+        std::vector<std::string> paths(matches.gl_pathv,
+                                       matches.gl_pathv + matches.gl_pathc);
+        globfree(&matches);
+        std::sort(paths.begin(), paths.end());
+        files.insert(files.end(), paths.begin(), paths.end());
+        continue;
+      }
+      globfree(&matches);
+    }
+#endif
+    files.push_back(item);
+  }
+  return files;
+}
+
+// Expand the list of data files as ExpandFileList(), where an item
+// can also be a directory, whose files are sorted (except the hidden
+// files and the binary files "*.bin"), or "@file", a manifest that has
+// a path or a glob in each line ('#' starts a comment). The directory
+// is not expanded on Windows.
+inline std::vector<std::string> ExpandDataList(const std::string& list) {
+  std::vector<std::string> files;
+  std::vector<std::string> items = ExpandFileList(list);
+  for (size_t i = 0; i < items.size(); ++i) {
+    const std::string& item = items[i];
+    FILE* manifest = nullptr;
+    if (item.size() > 1 && item[0] == '@' &&
+        (manifest = fopen(item.c_str() + 1, "r")) != nullptr) {
+      char line[4096];
+      while (fgets(line, sizeof(line), manifest) != nullptr) {
+        std::string path(line, strcspn(line, "#\r\n"));
+        size_t begin = path.find_first_not_of(" \t");
+        if (begin == std::string::npos) { continue; }
+        path = path.substr(begin, path.find_last_not_of(" \t") + 1 - begin);
+        std::vector<std::string> paths = ExpandFileList(path);
+        files.insert(files.end(), paths.begin(), paths.end());
+      }
+      fclose(manifest);
+      continue;
+    }
+#ifndef _MSC_VER
+    DIR* dir = IsDirectory(item) ? opendir(item.c_str()) : nullptr;
+    if (dir != nullptr) {
+      std::string prefix = item[item.size()-1] == '/' ? item : item + "/";
+      std::vector<std::string> paths;
+      for (struct dirent* entry; (entry = readdir(dir)) != nullptr; ) {
+        std::string name = entry->d_name;
+        if (name[0] == '.' || (name.size() > 4 &&
+            name.compare(name.size() - 4, 4, ".bin") == 0)) {
+          continue;
+        }
+        if (!IsDirectory(prefix + name)) { paths.push_back(prefix + name); }
+      }
+      closedir(dir);
+      std::sort(paths.begin(), paths.end());
+      files.insert(files.end(), paths.begin(), paths.end());
+      continue;
+    }
+#endif
+    files.push_back(item);
+  }
+  return files;
+}
+
 // Open file using fopen() and return the file pointer.
 // Args_mode : "w" for write and "r" for read
 inline FILE *OpenFileOrDie(const char *filename, const char *mode) {
@@ -168,6 +351,33 @@ inline uint64 GetFileSize(FILE *file) {
   return total_size;
 }
 
+// Return the position of the file, which can be larger than 2 GB.
+inline uint64 FileTell(FILE *file) {
+  CHECK_NOTNULL(file);
+#ifndef _MSC_VER
+  int64 pos = ftello(file);
+#else
+  int64 pos = _ftelli64(file);
+#endif
+  if (pos < 0) {
+    LOG(FATAL) << "Error: invoke ftell().";
+  }
+  return (uint64)pos;
+}
+
+// Move the file to the position given by FileTell().
+inline void FileSeek(FILE *file, uint64 pos) {
+  CHECK_NOTNULL(file);
+#ifndef _MSC_VER
+  int ret = fseeko(file, (off_t)pos, SEEK_SET);
+#else
+  int ret = _fseeki64(file, (int64)pos, SEEK_SET);
+#endif
+  if (ret != 0) {
+    LOG(FATAL) << "Error: invoke fseek().";
+  }
+}
+
 // Get one line of data from file by given a file pointer
 inline void GetLine(FILE *file, std::string &str_line) {
   CHECK_NOTNULL(file);
@@ -219,6 +429,196 @@ inline size_t ReadDataFromDisk(FILE *file, char *buf, size_t len) {
   return ret;
 }
 
+#ifndef _MSC_VER
+// Read len bytes at the offset of the file by pread(), which does
+// not move the position of the file, so the threads can read the
+// disjoint parts of one file at the same time.
+inline void ReadDataAt(FILE *file, char *buf, size_t len, uint64 offset) {
+  CHECK_NOTNULL(file);
+  int fd = fileno(file);
+  while (len > 0) {
+    ssize_t ret = pread(fd, buf, len, (off_t)offset);
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret <= 0) {
+      LOG(FATAL) << "Error: invoke pread().";
+    }
+    buf += ret;
+    len -= ret;
+    offset += ret;
+  }
+}
+
+// Write len bytes at the offset of the file by pwrite(), which is
+// the same as ReadDataAt() for the threads that write one file.
+inline void WriteDataAt(FILE *file, const char *buf,
+                        size_t len, uint64 offset) {
+  CHECK_NOTNULL(file);
+  int fd = fileno(file);
+  while (len > 0) {
+    ssize_t ret = pwrite(fd, buf, len, (off_t)offset);
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret <= 0) {
+      LOG(FATAL) << "Error: invoke pwrite().";
+    }
+    buf += ret;
+    len -= ret;
+    offset += ret;
+  }
+}
+#endif
+
+//------------------------------------------------------------------------------
+// The page cache of the files that are read once per pass. A large
+// scan of the training data fills the page cache, which evicts the
+// pages of the other jobs on the same host (e.g., the mapped model
+// of the prediction). kFileNoCache drops the pages of the text after
+// they are read, and kFileDirect reads the text by O_DIRECT, so it
+// does not go through the page cache at all. The hints are only
+// supported where posix_fadvise() is, and O_DIRECT on Linux.
+// kFileUring reads the text by io_uring, which keeps several reads
+// in flight for the fast disks (see UringFile in uring_file.h).
+//------------------------------------------------------------------------------
+enum FileIO {
+  kFileCached = 0,   /* Default buffered read */
+  kFileNoCache = 1,  /* Drop the pages after they are read */
+  kFileDirect = 2,   /* O_DIRECT read */
+  kFileUring = 3     /* Reads in flight by io_uring */
+};
+
+// Return the name of the FileIO.
+inline const char* FileIOName(FileIO io) {
+  switch (io) {
+    case kFileNoCache: return "nocache";
+    case kFileDirect: return "direct";
+    case kFileUring: return "uring";
+    default: return "cache";
+  }
+}
+
+// Parse the FileIO from its name.
+// Return false if the name is unknown.
+inline bool ParseFileIO(const std::string& name, FileIO* io) {
+  if (name == "cache") {
+    *io = kFileCached;
+  } else if (name == "nocache") {
+    *io = kFileNoCache;
+  } else if (name == "direct") {
+    *io = kFileDirect;
+  } else if (name == "uring") {
+    *io = kFileUring;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The access pattern of the bytes of a file (see AdviseFile).
+enum FileAdvice {
+  kAdviseNormal = 0,
+  kAdviseSequential = 1,  /* Read ahead more */
+  kAdviseRandom = 2,      /* No read ahead */
+  kAdviseDontNeed = 3     /* Drop the cached pages */
+};
+
+// Tell the kernel how the bytes [offset, offset + len) of the file
+// are read, where len = 0 is the rest of the file. It is only a
+// hint, which is ignored where posix_fadvise() is not supported.
+inline void AdviseFile(FILE *file, uint64 offset, uint64 len,
+                       FileAdvice advice) {
+  CHECK_NOTNULL(file);
+#if defined(POSIX_FADV_SEQUENTIAL) && !defined(_MSC_VER)
+  int flag = POSIX_FADV_NORMAL;
+  switch (advice) {
+    case kAdviseSequential: flag = POSIX_FADV_SEQUENTIAL; break;
+    case kAdviseRandom: flag = POSIX_FADV_RANDOM; break;
+    case kAdviseDontNeed: flag = POSIX_FADV_DONTNEED; break;
+    default: break;
+  }
+  posix_fadvise(fileno(file), (off_t)offset, (off_t)len, flag);
+#endif
+}
+
+// Read a file by O_DIRECT, which bypasses the page cache. The bytes
+// are read through an aligned buffer, so any offset and any length
+// can be read. Open() returns false if O_DIRECT is not supported by
+// the system or by the file system (e.g., tmpfs).
+class DirectFile {
+ public:
+  DirectFile() { }
+  ~DirectFile() { Close(); }
+
+  bool Open(const std::string& filename) {
+    Close();
+#if defined(O_DIRECT) && !defined(_MSC_VER)
+    fd_ = open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd_ < 0) { return false; }
+    if (posix_memalign((void**)&buffer_, kAlignment, kBufferSize) != 0) {
+      LOG(FATAL) << "Cannot allocate the buffer of O_DIRECT.";
+    }
+    // Some file systems only fail at the first read
+    if (pread(fd_, buffer_, kAlignment, 0) < 0) {
+      Close();
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void Close() {
+#if defined(O_DIRECT) && !defined(_MSC_VER)
+    if (fd_ >= 0) { close(fd_); }
+#endif
+    fd_ = -1;
+    free(buffer_);
+    buffer_ = nullptr;
+  }
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  // Read at most len bytes at the offset to buf, and return the
+  // size, which is less than len only at the end of the file.
+  size_t Read(uint64 offset, char *buf, size_t len) {
+    CHECK(IsOpen());
+    CHECK_NOTNULL(buf);
+    size_t done = 0;
+#if defined(O_DIRECT) && !defined(_MSC_VER)
+    while (done < len) {
+      // The aligned bytes that cover the next part of buf
+      uint64 pos = offset + done;
+      uint64 begin = pos / kAlignment * kAlignment;
+      size_t skip = pos - begin;
+      size_t want = (skip + len - done + kAlignment - 1) /
+                    kAlignment * kAlignment;
+      want = std::min(want, (size_t)kBufferSize);
+      ssize_t ret = pread(fd_, buffer_, want, (off_t)begin);
+      if (ret < 0 && errno == EINTR) { continue; }
+      if (ret < 0) {
+        LOG(FATAL) << "Error: invoke pread().";
+      }
+      // The end of the file
+      if ((size_t)ret <= skip) { break; }
+      size_t size = std::min(len - done, (size_t)ret - skip);
+      memcpy(buf + done, buffer_ + skip, size);
+      done += size;
+    }
+#endif
+    return done;
+  }
+
+  /* O_DIRECT needs the buffer, the offset and the
+  size aligned to the logical block of the disk */
+  static const size_t kAlignment = 4096;
+  static const size_t kBufferSize = 4 * 1024 * 1024;
+
+ private:
+  int fd_ = -1;
+  char* buffer_ = nullptr;
+
+  DISALLOW_COPY_AND_ASSIGN(DirectFile);
+};
+
 // Delete target file from disk.
 inline void RemoveFile(const char *filename) {
   CHECK_NOTNULL(filename);
@@ -292,6 +692,35 @@ void ReadVectorFromFile(FILE *file_ptr, std::vector<T> &vec) {
   ReadDataFromDisk(file_ptr, reinterpret_cast<char *>(vec.data()), sizeof(T)*len);
 }
 
+// Read binary data from the memory buffer [*ptr, end),
+// and then move *ptr to the end of the data.
+inline void ReadDataFromBuffer(const char **ptr, const char *end,
+                               char *buf, size_t len) {
+  CHECK_NOTNULL(buf);
+  if (len > (size_t)(end - *ptr)) {
+    LOG(FATAL) << "Error: read out of the buffer.";
+  }
+  memcpy(buf, *ptr, len);
+  *ptr += len;
+}
+
+// Read a std::vector written by WriteVectorToFile()
+// from the memory buffer [*ptr, end).
+template <typename T>
+void ReadVectorFromBuffer(const char **ptr, const char *end,
+                          std::vector<T> &vec) {
+  size_t len = 0;
+  ReadDataFromBuffer(ptr, end, reinterpret_cast<char *>(&len), sizeof(len));
+  CHECK_GT(len, 0);
+  if (len > (size_t)(end - *ptr) / sizeof(T)) {
+    LOG(FATAL) << "Error: read out of the buffer.";
+  }
+  vec.clear();
+  vec.resize(len);
+  ReadDataFromBuffer(ptr, end, reinterpret_cast<char *>(vec.data()),
+                     sizeof(T)*len);
+}
+
 // Write a std:string to disk file.
 inline void WriteStringToFile(FILE * file_ptr, const std::string &str) {
   CHECK_NOTNULL(file_ptr);
@@ -321,6 +750,22 @@ inline void ReadStringFromFile(FILE *file_ptr, std::string &str) {
 // Tool function used by Reader class of xLearn
 //------------------------------------------------------------------------------
 
+// Mix the data of buffer into the hash value magic.
+inline uint64_t HashBuffer(uint64_t magic, const char* buffer, long size) {
+  long i = 0;
+  while (i < size - 8) {
+    uint64_t x = 0;
+    memcpy(&x, buffer + i, sizeof(x));
+    magic = ((magic + x) * (magic + x + 1) >> 1) + x;
+    i += 8;
+  }
+  for ( ; i < size; i++) {
+    char x = buffer[i];
+    magic = ((magic + x) * (magic + x + 1) >> 1) + x;
+  }
+  return magic;
+}
+
 // Calculate the hash value of current txt file.
 // If one_block == true, we just read a small chunk of data.
 // If one_block == false, we read all the data from the file.
@@ -333,6 +778,7 @@ inline uint64_t HashFile(const std::string &filename, bool one_block=false) {
   CHECK_EQ(static_cast<int>(f.tellg()), 0);
 
   uint64_t magic = 90359;
+  std::vector<char> buffer(kChunkSize);
   for (long pos = 0; pos < end; ) {
 #ifndef _MSC_VER
     long next_pos = std::min(pos + kChunkSize, end);
@@ -340,19 +786,8 @@ inline uint64_t HashFile(const std::string &filename, bool one_block=false) {
     long next_pos = __min(pos + kChunkSize, end);
 #endif
     long size = next_pos - pos;
-    std::vector<char> buffer(kChunkSize);
     f.read(buffer.data(), size);
-
-    int i = 0;
-    while (i < size - 8) {
-      uint64_t x = *reinterpret_cast<uint64_t *>(buffer.data() + i);
-      magic = ((magic + x) * (magic + x + 1) >> 1) + x;
-      i += 8;
-    }
-    for ( ; i < size; i++) {
-      char x = buffer[i];
-      magic = ((magic + x) * (magic + x + 1) >> 1) + x;
-    }
+    magic = HashBuffer(magic, buffer.data(), size);
 
     pos = next_pos;
     if (one_block) { break; }
@@ -361,4 +796,55 @@ inline uint64_t HashFile(const std::string &filename, bool one_block=false) {
   return magic;
 }
 
+// Calculate the hash value of the file size, the modified time
+// and the inode (not on Windows), which change if the file is
+// rewritten, so nothing of the file is read. Return 0 if the
+// file cannot be found.
+inline uint64_t HashFileStamp(const std::string &filename) {
+#ifndef _MSC_VER
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) { return 0; }
+  uint64_t stamp[3] = { (uint64_t)st.st_size,
+                        (uint64_t)st.st_mtime,
+                        (uint64_t)st.st_ino };
+#else
+  struct _stat64 st;
+  if (_stat64(filename.c_str(), &st) != 0) { return 0; }
+  uint64_t stamp[3] = { (uint64_t)st.st_size,
+                        (uint64_t)st.st_mtime, 0 };
+#endif
+  return HashBuffer(90359, (const char*)stamp, sizeof(stamp));
+}
+
+// Number and size of the blocks read by HashFileSample().
+static const uint32 kSampleBlocks = 16;
+static const uint32 kSampleBlockSize = 64 * 1024;  // 64 KB
+
+// Calculate the hash value of kSampleBlocks blocks, which are spread
+// evenly from the head to the end of the file, so it takes 1 MB of
+// reads however big the file is. The small file is hashed all.
+inline uint64_t HashFileSample(const std::string &filename) {
+#ifndef _MSC_VER
+  FILE* file = fopen(filename.c_str(), "r");
+#else
+  FILE* file = fopen(filename.c_str(), "rb");
+#endif
+  if (file == nullptr) { return 0; }
+  uint64 size = GetFileSize(file);
+  uint64 total = (uint64)kSampleBlocks * kSampleBlockSize;
+  uint32 num_blocks = size <= total ? 1 : kSampleBlocks;
+  uint64 block_size = size <= total ? size : kSampleBlockSize;
+  std::vector<char> buffer(block_size);
+  uint64_t magic = 90359;
+  for (uint32 i = 0; i < num_blocks; ++i) {
+    uint64 pos = num_blocks == 1 ? 0 :
+        (size - block_size) * i / (num_blocks - 1);
+    FileSeek(file, pos);
+    size_t ret = fread(buffer.data(), 1, block_size, file);
+    magic = HashBuffer(magic, buffer.data(), (long)ret);
+  }
+  fclose(file);
+  return HashBuffer(magic, (const char*)&size, sizeof(size));
+}
+
 #endif // XLEARN_BASE_FILE_UTIL_H_
@@ -95,6 +95,75 @@ TEST(FileTest, Write_and_Read_Data) {
   RemoveFile(filename.c_str());
 }
 
+// The bytes read by O_DIRECT at any offset are the same as fread(),
+// and so are the bytes read with the hints of the page cache.
+TEST(FileTest, Direct_and_Advise) {
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test";
+#else
+  std::string filename = "../../test";
+#endif
+  // More than the buffer of DirectFile, and not aligned
+  const size_t kSize = DirectFile::kBufferSize * 2 + 12345;
+  std::vector<char> data(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    data[i] = (char)(i * 31 + i / 4096);
+  }
+  FILE* file_w = OpenFileOrDie(filename.c_str(), "wb");
+  WriteDataToDisk(file_w, data.data(), kSize);
+  Close(file_w);
+  FILE* file_r = OpenFileOrDie(filename.c_str(), "rb");
+  AdviseFile(file_r, 0, 0, kAdviseSequential);
+  std::vector<char> buf(kSize);
+  EXPECT_EQ(ReadDataFromDisk(file_r, buf.data(), kSize), kSize);
+  AdviseFile(file_r, 0, kSize, kAdviseDontNeed);
+  EXPECT_EQ(buf, data);
+  Close(file_r);
+  DirectFile direct;
+  if (direct.Open(filename)) {
+    uint64 offsets[4] = { 0, 1, 4095, DirectFile::kBufferSize + 7 };
+    for (uint64 offset : offsets) {
+      size_t len = DirectFile::kBufferSize + 100;
+      std::fill(buf.begin(), buf.end(), 0);
+      EXPECT_EQ(direct.Read(offset, buf.data(), len), len);
+      EXPECT_TRUE(std::equal(buf.begin(), buf.begin() + len,
+                             data.begin() + offset));
+    }
+    // The end of the file
+    EXPECT_EQ(direct.Read(kSize - 10, buf.data(), 100), 10);
+    EXPECT_TRUE(std::equal(buf.begin(), buf.begin() + 10,
+                           data.end() - 10));
+    EXPECT_EQ(direct.Read(kSize, buf.data(), 100), 0);
+    EXPECT_EQ(direct.Read(kSize + 5000, buf.data(), 100), 0);
+    direct.Close();
+    EXPECT_FALSE(direct.IsOpen());
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(FileTest, Tell_and_Seek) {
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test";
+#else
+  std::string filename = "../../test";
+#endif
+  FILE* file_w = OpenFileOrDie(filename.c_str(), "w");
+  EXPECT_EQ(FileTell(file_w), 0);
+  for (int i = 0; i < 10; ++i) {
+    WriteDataToDisk(file_w, (char*)&i, sizeof(i));
+  }
+  EXPECT_EQ(FileTell(file_w), 10 * sizeof(int));
+  Close(file_w);
+  FILE* file_r = OpenFileOrDie(filename.c_str(), "r");
+  FileSeek(file_r, 7 * sizeof(int));
+  int read = 0;
+  ReadDataFromDisk(file_r, (char*)&read, sizeof(read));
+  EXPECT_EQ(read, 7);
+  EXPECT_EQ(FileTell(file_r), 8 * sizeof(int));
+  Close(file_r);
+  RemoveFile(filename.c_str());
+}
+
 TEST(FileTest, Serialize_and_Deserialize_string) {
 #ifndef _MSC_VER
   std::string filename = "/tmp/test.bin";
@@ -184,6 +253,52 @@ TEST(FileTest, HashFile) {
   RemoveFile("./tmp_3");
 }
 
+TEST(FileTest, HashFileStamp_and_Sample) {
+  // A big file that has many sampled blocks
+  std::string str(kSampleBlocks * kSampleBlockSize * 2, 'a');
+  FILE* file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, const_cast<char*>(str.data()), str.size());
+  Close(file);
+  uint64 stamp = HashFileStamp("./tmp_1");
+  uint64 sample = HashFileSample("./tmp_1");
+  EXPECT_NE(stamp, 0);
+  EXPECT_EQ(HashFileStamp("./tmp_1"), stamp);
+  EXPECT_EQ(HashFileSample("./tmp_1"), sample);
+  // Change the first and the last byte
+  str[0] = 'b';
+  file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, const_cast<char*>(str.data()), str.size());
+  Close(file);
+  EXPECT_NE(HashFileSample("./tmp_1"), sample);
+  str[0] = 'a';
+  str[str.size()-1] = 'b';
+  file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, const_cast<char*>(str.data()), str.size());
+  Close(file);
+  EXPECT_NE(HashFileSample("./tmp_1"), sample);
+  // Change the size
+  str.push_back('a');
+  file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, const_cast<char*>(str.data()), str.size());
+  Close(file);
+  EXPECT_NE(HashFileStamp("./tmp_1"), stamp);
+  EXPECT_NE(HashFileSample("./tmp_1"), sample);
+  // A small file is hashed all
+  file = OpenFileOrDie("./tmp_2", "w");
+  WriteDataToDisk(file, const_cast<char*>(str.data()), 100);
+  Close(file);
+  file = OpenFileOrDie("./tmp_3", "w");
+  str[50] = 'c';
+  WriteDataToDisk(file, const_cast<char*>(str.data()), 100);
+  Close(file);
+  EXPECT_NE(HashFileSample("./tmp_2"), HashFileSample("./tmp_3"));
+  EXPECT_EQ(HashFileStamp("./tmp_4"), 0);
+  EXPECT_EQ(HashFileSample("./tmp_4"), 0);
+  RemoveFile("./tmp_1");
+  RemoveFile("./tmp_2");
+  RemoveFile("./tmp_3");
+}
+
 TEST(FileTest, ReadFile) {
   FILE* file = OpenFileOrDie("./tmp.bin", "w");
   int num = 999;
@@ -195,3 +310,60 @@ TEST(FileTest, ReadFile) {
   EXPECT_EQ((*(int*)ch_num), 999);
   RemoveFile("./tmp.bin");
 }
+
+TEST(FileTest, ExpandFileList) {
+  const char* names[] = { "./tmp_part_2", "./tmp_part_1", "./tmp_other" };
+  for (int i = 0; i < 3; ++i) {
+    FILE* file = OpenFileOrDie(names[i], "w");
+    Close(file);
+  }
+  std::vector<std::string> files =
+      ExpandFileList("./tmp_other,./tmp_part_*");
+  ASSERT_EQ(files.size(), 3);
+  EXPECT_EQ(files[0], "./tmp_other");
+  EXPECT_EQ(files[1], "./tmp_part_1");
+  EXPECT_EQ(files[2], "./tmp_part_2");
+  // The pattern without any match is kept
+  files = ExpandFileList("./tmp_none_*,");
+  ASSERT_EQ(files.size(), 1);
+  EXPECT_EQ(files[0], "./tmp_none_*");
+  EXPECT_TRUE(ExpandFileList("").empty());
+  EXPECT_TRUE(IsDirectory("."));
+  EXPECT_FALSE(IsDirectory("./tmp_other"));
+  for (int i = 0; i < 3; ++i) {
+    RemoveFile(names[i]);
+  }
+}
+
+TEST(FileTest, ExpandDataList) {
+  ASSERT_EQ(mkdir("./tmp_shards", 0755), 0);
+  const char* names[] = { "./tmp_shards/b", "./tmp_shards/a",
+                          "./tmp_shards/a.bin", "./tmp_shards/.c",
+                          "./tmp_manifest" };
+  for (int i = 0; i < 5; ++i) {
+    FILE* file = OpenFileOrDie(names[i], "w");
+    Close(file);
+  }
+  std::vector<std::string> files = ExpandDataList("./tmp_shards");
+  ASSERT_EQ(files.size(), 2);
+  EXPECT_EQ(files[0], "./tmp_shards/a");
+  EXPECT_EQ(files[1], "./tmp_shards/b");
+  // The manifest has a path or a glob in each line
+  FILE* file = OpenFileOrDie("./tmp_manifest", "w");
+  fputs("# shards\n./tmp_other  \n\n  ./tmp_shards/[ab]\n", file);
+  Close(file);
+  files = ExpandDataList("@./tmp_manifest,./tmp_shards/");
+  ASSERT_EQ(files.size(), 5);
+  EXPECT_EQ(files[0], "./tmp_other");
+  EXPECT_EQ(files[1], "./tmp_shards/a");
+  EXPECT_EQ(files[2], "./tmp_shards/b");
+  EXPECT_EQ(files[3], "./tmp_shards/a");
+  // The missing manifest is kept
+  files = ExpandDataList("@./tmp_none");
+  ASSERT_EQ(files.size(), 1);
+  EXPECT_EQ(files[0], "@./tmp_none");
+  for (int i = 0; i < 5; ++i) {
+    RemoveFile(names[i]);
+  }
+  rmdir("./tmp_shards");
+}
@@ -0,0 +1,191 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the storage types of the model parameters, and
+provides the scalar conversion between float and the 16-bit floating
+point formats (IEEE fp16 and bfloat16). Both of them are stored as
+uint16, and all the conversions use round-to-nearest-even.
+*/
+
+#ifndef XLEARN_BASE_HALF_H_
+#define XLEARN_BASE_HALF_H_
+
+#include <string.h>
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Storage type of the model parameters.
+//------------------------------------------------------------------------------
+enum StorageType {
+  kStoreFP32 = 0,   /* 32-bit float, used by training */
+  kStoreFP16 = 1,   /* IEEE half: 5-bit exponent, 10-bit mantissa */
+  kStoreBF16 = 2,   /* bfloat16: 8-bit exponent, 7-bit mantissa */
+  kStoreInt8 = 3    /* int8 with a float scale for each vector */
+};
+
+// Return the name of the storage type.
+inline const char* StorageTypeName(StorageType type) {
+  switch (type) {
+    case kStoreFP16: return "fp16";
+    case kStoreBF16: return "bf16";
+    case kStoreInt8: return "int8";
+    default: return "fp32";
+  }
+}
+
+// Parse the storage type from its name.
+// Return false if the name is unknown.
+inline bool ParseStorageType(const std::string& name,
+                             StorageType* type) {
+  if (name == "fp32") {
+    *type = kStoreFP32;
+  } else if (name == "fp16") {
+    *type = kStoreFP16;
+  } else if (name == "bf16") {
+    *type = kStoreBF16;
+  } else if (name == "int8") {
+    *type = kStoreInt8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+inline uint32 float_bits(float value) {
+  uint32 x;
+  memcpy(&x, &value, sizeof(x));
+  return x;
+}
+
+inline float bits_float(uint32 x) {
+  float value;
+  memcpy(&value, &x, sizeof(value));
+  return value;
+}
+
+// Convert float to IEEE half. The values out of the
+// range of fp16 (65504) become infinity.
+inline uint16 FloatToHalf(float value) {
+  uint32 x = float_bits(value);
+  uint32 sign = (x >> 16) & 0x8000;
+  uint32 abs = x & 0x7fffffff;
+  // Inf and NaN
+  if (abs >= 0x7f800000) {
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  // Overflow, which rounds to infinity
+  if (abs >= 0x477ff000) {
+    return sign | 0x7c00;
+  }
+  // Subnormal half: let the FPU round the value
+  // into the low mantissa bits of 0.5f.
+  if (abs < 0x38800000) {
+    float f = bits_float(abs) + 0.5f;
+    return sign | (float_bits(f) - 0x3f000000);
+  }
+  // Normal half: rebias the exponent and round
+  abs += 0xc8000fff + ((abs >> 13) & 1);
+  return sign | (abs >> 13);
+}
+
+// Convert IEEE half to float, which is exact.
+inline float HalfToFloat(uint16 h) {
+  uint32 sign = (uint32)(h & 0x8000) << 16;
+  uint32 exp = (h >> 10) & 0x1f;
+  uint32 mant = h & 0x3ff;
+  if (exp == 0x1f) {  // Inf and NaN
+    return bits_float(sign | 0x7f800000 | (mant << 13));
+  }
+  if (exp == 0) {  // Zero and subnormal
+    float f = mant * (1.0f / 16777216.0f);
+    return sign ? -f : f;
+  }
+  return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+// Convert float to bfloat16, which keeps the
+// high 16 bits of the float after rounding.
+inline uint16 FloatToBF16(float value) {
+  uint32 x = float_bits(value);
+  // Keep NaN as a quiet NaN
+  if ((x & 0x7fffffff) > 0x7f800000) {
+    return (x >> 16) | 0x40;
+  }
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+// Convert bfloat16 to float, which is exact.
+inline float BF16ToFloat(uint16 h) {
+  return bits_float((uint32)h << 16);
+}
+
+// Round the value to bfloat16 stochastically: it is rounded up with
+// the probability of the dropped low 16 bits, so the sum of many small
+// values is right on average, which round-to-nearest would lose. The
+// random bits are a hash of the value and the seed (the shifts and adds
+// of Jenkins' one-at-a-time hash, whose high bits are uniform), and the
+// result is a float whose low 16 bits are zero. The SIMD kernels have
+// the same rounding (see round_bf16 of score_kernel_impl.h).
+inline uint32 HashBits(uint32 x) {
+  x += x << 10;
+  x ^= x >> 6;
+  x += x << 3;
+  x ^= x >> 11;
+  x += x << 15;
+  return x;
+}
+
+inline float RoundBF16(float value, uint32 seed) {
+  uint32 x = float_bits(value);
+  x += HashBits(x ^ seed) >> 16;
+  return bits_float(x & 0xffff0000);
+}
+
+// Two bfloat16 in the bits of one float, where lo is kept in the low
+// half. It is the optimizer state of a parameter of -opt_state bf16
+// (see FTRLBF16Optimizer), which takes the place of one fp32 aux value.
+inline float PackBF16(float lo, float hi) {
+  return bits_float(((uint32)FloatToBF16(hi) << 16) | FloatToBF16(lo));
+}
+
+inline float LowBF16(float pair) {
+  return bits_float(float_bits(pair) << 16);
+}
+
+inline float HighBF16(float pair) {
+  return bits_float(float_bits(pair) & 0xffff0000);
+}
+
+// Convert float to the given 16-bit format.
+inline uint16 FloatTo16(float value, StorageType type) {
+  return type == kStoreBF16 ? FloatToBF16(value) : FloatToHalf(value);
+}
+
+// Convert the given 16-bit format to float.
+inline float Float16ToFloat(uint16 h, StorageType type) {
+  return type == kStoreBF16 ? BF16ToFloat(h) : HalfToFloat(h);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_HALF_H_
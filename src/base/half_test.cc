@@ -0,0 +1,135 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests half.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <limits>
+
+#include "src/base/half.h"
+
+namespace xLearn {
+
+TEST(HalfTest, Storage_type) {
+  StorageType type;
+  EXPECT_TRUE(ParseStorageType("fp32", &type));
+  EXPECT_EQ(type, kStoreFP32);
+  EXPECT_TRUE(ParseStorageType("fp16", &type));
+  EXPECT_EQ(type, kStoreFP16);
+  EXPECT_TRUE(ParseStorageType("bf16", &type));
+  EXPECT_EQ(type, kStoreBF16);
+  EXPECT_TRUE(ParseStorageType("int8", &type));
+  EXPECT_EQ(type, kStoreInt8);
+  EXPECT_FALSE(ParseStorageType("int4", &type));
+  EXPECT_STREQ(StorageTypeName(kStoreBF16), "bf16");
+}
+
+TEST(HalfTest, FP16_exact) {
+  EXPECT_EQ(FloatToHalf(0.0f), 0x0000);
+  EXPECT_EQ(FloatToHalf(-0.0f), 0x8000);
+  EXPECT_EQ(FloatToHalf(1.0f), 0x3c00);
+  EXPECT_EQ(FloatToHalf(-2.0f), 0xc000);
+  EXPECT_EQ(FloatToHalf(65504.0f), 0x7bff);
+  // The smallest normal and subnormal
+  EXPECT_EQ(FloatToHalf(std::ldexp(1.0f, -14)), 0x0400);
+  EXPECT_EQ(FloatToHalf(std::ldexp(1.0f, -24)), 0x0001);
+  // Every half can go back and forth
+  for (uint32 h = 0; h < 0x10000; ++h) {
+    if ((h & 0x7c00) == 0x7c00) continue;  // Inf and NaN
+    EXPECT_EQ(FloatToHalf(HalfToFloat(h)), h);
+  }
+}
+
+TEST(HalfTest, FP16_round) {
+  // 1 + 2^-11 is the middle of 1 and the next half,
+  // and it rounds to the even one.
+  EXPECT_EQ(FloatToHalf(1.0f + std::ldexp(1.0f, -11)), 0x3c00);
+  EXPECT_EQ(FloatToHalf(1.0f + 3 * std::ldexp(1.0f, -11)), 0x3c02);
+  EXPECT_EQ(FloatToHalf(1.0f + std::ldexp(1.0f, -10) * 0.75f), 0x3c01);
+  // Overflow and underflow
+  EXPECT_EQ(FloatToHalf(65520.0f), 0x7c00);
+  EXPECT_EQ(FloatToHalf(-1e10f), 0xfc00);
+  EXPECT_EQ(FloatToHalf(std::ldexp(1.0f, -26)), 0x0000);
+  // Inf and NaN
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(FloatToHalf(inf), 0x7c00);
+  EXPECT_TRUE(std::isinf(HalfToFloat(0x7c00)));
+  uint16 nan = FloatToHalf(std::numeric_limits<float>::quiet_NaN());
+  EXPECT_TRUE(std::isnan(HalfToFloat(nan)));
+}
+
+TEST(HalfTest, BF16) {
+  EXPECT_EQ(FloatToBF16(1.0f), 0x3f80);
+  EXPECT_EQ(BF16ToFloat(0x3f80), 1.0f);
+  EXPECT_EQ(FloatToBF16(-2.0f), 0xc000);
+  // Round to nearest even
+  EXPECT_EQ(FloatToBF16(1.0f + std::ldexp(1.0f, -8)), 0x3f80);
+  EXPECT_EQ(FloatToBF16(1.0f + 3 * std::ldexp(1.0f, -8)), 0x3f82);
+  // bf16 keeps the range of fp32
+  EXPECT_NEAR(BF16ToFloat(FloatToBF16(1e30f)), 1e30f, 1e28f);
+  uint16 nan = FloatToBF16(std::numeric_limits<float>::quiet_NaN());
+  EXPECT_TRUE(std::isnan(BF16ToFloat(nan)));
+  for (uint32 h = 0; h < 0x10000; ++h) {
+    if ((h & 0x7f80) == 0x7f80) continue;  // Inf and NaN
+    EXPECT_EQ(FloatToBF16(BF16ToFloat(h)), h);
+  }
+}
+
+TEST(HalfTest, BF16_stochastic_round) {
+  // The exact values are not changed
+  EXPECT_EQ(RoundBF16(1.0f, 123), 1.0f);
+  EXPECT_EQ(RoundBF16(-2.5f, 456), -2.5f);
+  float x = 1.0f + std::ldexp(1.0f, -10);
+  for (uint32 seed = 0; seed < 100; ++seed) {
+    float r = RoundBF16(x, seed);
+    EXPECT_TRUE(r == 1.0f || r == 1.0f + std::ldexp(1.0f, -7));
+  }
+  // The increments much less than the ulp of the sum are lost
+  // by round-to-nearest, but not by the stochastic rounding
+  float sum = 1.0f, sum_rne = 1.0f;
+  for (int i = 0; i < 10000; ++i) {
+    sum = RoundBF16(sum + 1e-4f, i * 2654435761U);
+    sum_rne = BF16ToFloat(FloatToBF16(sum_rne + 1e-4f));
+  }
+  EXPECT_EQ(sum_rne, 1.0f);
+  EXPECT_NEAR(sum, 2.0f, 0.3f);
+}
+
+TEST(HalfTest, BF16_pair) {
+  float pair = PackBF16(1.0f, -0.5f);
+  EXPECT_EQ(LowBF16(pair), 1.0f);
+  EXPECT_EQ(HighBF16(pair), -0.5f);
+  pair = PackBF16(3.0f, 0.0f);
+  EXPECT_EQ(LowBF16(pair), 3.0f);
+  EXPECT_EQ(HighBF16(pair), 0.0f);
+}
+
+TEST(HalfTest, Relative_error) {
+  for (float x = -10.0f; x < 10.0f; x += 0.0137f) {
+    EXPECT_NEAR(HalfToFloat(FloatToHalf(x)), x,
+                std::fabs(x) * std::ldexp(1.0f, -11) + 1e-7);
+    EXPECT_NEAR(BF16ToFloat(FloatToBF16(x)), x,
+                std::fabs(x) * std::ldexp(1.0f, -8) + 1e-7);
+    EXPECT_EQ(Float16ToFloat(FloatTo16(x, kStoreBF16), kStoreBF16),
+              BF16ToFloat(FloatToBF16(x)));
+  }
+}
+
+}  // namespace xLearn
@@ -24,7 +24,9 @@ mathematical methods.
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
 #include <cmath>
 #include <random>
 
@@ -163,14 +165,138 @@ static inline real_t fastersigmoid(real_t x) {
   return 1.0f / (1.0f + fasterexp (-x));
 }
 
+//------------------------------------------------------------------------------
+// Polynomial exp(), log(), log1p(), softplus() and sigmoid()
+//
+// They are much more accurate than the fast*() functions above, and
+// they have no branch and no table lookup, so a loop over an array
+// (see VecSigmoid() and SumSoftplus()) is vectorized by the compiler
+// (with -fno-trapping-math, which is set in CMakeLists.txt).
+// The coefficients are from Cephes. The max relative error (checked
+// by math_test.cc) is 2e-7 for polyexp() in [-87, 88], 3e-7 for
+// polylog() and polylog1p(), and 5e-7 for polysoftplus() and
+// polysigmoid(). The input of polyexp() is clamped to [-87.3, 88.3],
+// so it never returns 0 or inf.
+//------------------------------------------------------------------------------
+
+static inline uint32 float_as_bits(real_t x) {
+  uint32 i;
+  memcpy(&i, &x, sizeof(i));
+  return i;
+}
+
+static inline real_t bits_as_float(uint32 i) {
+  real_t x;
+  memcpy(&x, &i, sizeof(x));
+  return x;
+}
+
+static inline real_t polyexp(real_t x) {
+  x = std::min(std::max(x, -87.3f), 88.3f);
+  // x = n * ln2 + r, where |r| <= ln2 / 2. Adding 1.5 * 2^23 rounds
+  // x * log2(e) to the nearest integer n, which is then kept in the
+  // low bits of s. This has no branch (nor float-to-int conversion),
+  // so the compiler can vectorize the loops calling polyexp().
+  real_t s = x * 1.44269504088896341f + 12582912.0f;
+  real_t n = s - 12582912.0f;
+  real_t r = x - n * 0.693359375f;
+  r = r + n * 2.12194440e-4f;
+  real_t p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  // Multiply by 2^n
+  uint32 k = float_as_bits(s) - 0x4b400000u;
+  return p * bits_as_float((k + 127u) << 23);
+}
+
+// The input must be a positive normal number.
+static inline real_t polylog(real_t x) {
+  // x = m * 2^e, where m is in [sqrt(0.5), sqrt(2)). Shifting the
+  // bits by sqrt(0.5) first moves the exponent for the small m,
+  // so it needs no compare (see the log() of musl).
+  uint32 i = float_as_bits(x) - 0x3f3504f3u;
+  real_t e = (real_t)(static_cast<int32>(i) >> 23);
+  real_t f = bits_as_float((i & 0x007fffff) + 0x3f3504f3u) - 1.0f;
+  real_t z = f * f;
+  real_t y = 7.0376836292e-2f;
+  y = y * f - 1.1514610310e-1f;
+  y = y * f + 1.1676998740e-1f;
+  y = y * f - 1.2420140846e-1f;
+  y = y * f + 1.4249322787e-1f;
+  y = y * f - 1.6668057665e-1f;
+  y = y * f + 2.0000714765e-1f;
+  y = y * f - 2.4999993993e-1f;
+  y = y * f + 3.3333331174e-1f;
+  y = y * f * z;
+  y = y - 2.12194440e-4f * e;
+  y = y - 0.5f * z;
+  return f + y + 0.693359375f * e;
+}
+
+// log(1 + x) for x >= 0. The rounding error of (1 + x) is
+// cancelled by x / ((1 + x) - 1), so it is accurate for tiny x.
+static inline real_t polylog1p(real_t x) {
+  real_t u = 1.0f + x;
+  real_t d = u - 1.0f;
+  // Both sides are computed, so there is no branch
+  real_t y = polylog(u) * (x / (d == 0.0f ? 1.0f : d));
+  return d == 0.0f ? x : y;
+}
+
+// softplus(x) = log(1 + exp(x)) = max(x, 0) + log1p(exp(-|x|)),
+// and the cross-entropy loss log(1 + exp(-y*pred)) is softplus(-y*pred).
+static inline real_t polysoftplus(real_t x) {
+  return std::max(x, 0.0f) + polylog1p(polyexp(-std::abs(x)));
+}
+
+static inline real_t polysigmoid(real_t x) {
+  return 1.0f / (1.0f + polyexp(-x));
+}
+
+// out[i] = polysigmoid(in[i]), and out can be the same as in.
+static inline void VecSigmoid(const real_t* in, real_t* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = polysigmoid(in[i]);
+  }
+}
+
+// Return sum(polysoftplus(in[i])). The values are computed in
+// blocks into a buffer, so the loop over the block is vectorized.
+static inline real_t SumSoftplus(const real_t* in, size_t n) {
+  const size_t kBlock = 256;
+  real_t buf[kBlock];
+  real_t sum[4] = { 0, 0, 0, 0 };
+  for (size_t b = 0; b < n; b += kBlock) {
+    size_t len = std::min(kBlock, n - b);
+    for (size_t i = 0; i < len; ++i) {
+      buf[i] = polysoftplus(in[b + i]);
+    }
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+      sum[0] += buf[i];
+      sum[1] += buf[i + 1];
+      sum[2] += buf[i + 2];
+      sum[3] += buf[i + 3];
+    }
+    for (; i < len; ++i) {
+      sum[0] += buf[i];
+    }
+  }
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
 //------------------------------------------------------------------------------
 // 1 / sqrt() Magic function !!
 //------------------------------------------------------------------------------
 static inline real_t InvSqrt(real_t x) {
   real_t xhalf = 0.5f*x;
-  int i = *reinterpret_cast<int*>(&x);  // get bits for floating VALUE
+  uint32 i = float_as_bits(x);  // get bits for floating VALUE
   i = 0x5f375a86-(i>>1);  // gives initial guess y0
-  x = *reinterpret_cast<real_t*>(&i);  // convert bits BACK to float
+  x = bits_as_float(i);  // convert bits BACK to float
   x = x*(1.5f-xhalf*x*x);  // Newton step, repeating increases accuracy
   return x;
 }
@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests math.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <vector>
+
+#include "src/base/math.h"
+
+namespace xLearn {
+
+// Max relative error of f against the reference function.
+template<class F, class R>
+double max_error(F f, R ref, double min, double max, bool log_scale) {
+  const int kNum = 200000;
+  double err = 0;
+  for (int i = 0; i <= kNum; ++i) {
+    double t = min + (max - min) * i / kNum;
+    real_t x = log_scale ? std::pow(10.0, t) : t;
+    double y = ref(static_cast<double>(x));
+    if (y == 0) { continue; }
+    err = std::max(err, std::abs(f(x) - y) / std::abs(y));
+  }
+  return err;
+}
+
+TEST(MathTest, Poly_exp) {
+  double err = max_error([](real_t x) { return polyexp(x); },
+                         [](double x) { return std::exp(x); },
+                         -87, 88, false);
+  EXPECT_LT(err, 2e-7);
+  // Clamped, so never 0 or inf
+  EXPECT_GT(polyexp(-1000), 0);
+  EXPECT_TRUE(std::isfinite(polyexp(1000)));
+  EXPECT_EQ(polyexp(0), 1.0f);
+}
+
+TEST(MathTest, Poly_log) {
+  // |log(x)| is close to 0 near 1, so the error is
+  // checked away from 1, and then near 1 by log1p
+  double err = max_error([](real_t x) { return polylog(x); },
+                         [](double x) { return std::log(x); },
+                         -30, -0.01, true);
+  EXPECT_LT(err, 3e-7);
+  err = max_error([](real_t x) { return polylog(x); },
+                  [](double x) { return std::log(x); },
+                  0.01, 30, true);
+  EXPECT_LT(err, 3e-7);
+  EXPECT_EQ(polylog(1), 0.0f);
+  err = max_error([](real_t x) { return polylog1p(x); },
+                  [](double x) { return std::log1p(x); },
+                  -20, 10, true);
+  EXPECT_LT(err, 3e-7);
+  EXPECT_EQ(polylog1p(0), 0.0f);
+}
+
+TEST(MathTest, Poly_sigmoid) {
+  double err = max_error([](real_t x) { return polysoftplus(x); },
+                         [](double x) { return std::log1p(std::exp(x)); },
+                         -80, 80, false);
+  EXPECT_LT(err, 5e-7);
+  err = max_error([](real_t x) { return polysigmoid(x); },
+                  [](double x) { return 1.0 / (1.0 + std::exp(-x)); },
+                  -80, 80, false);
+  EXPECT_LT(err, 5e-7);
+  // Large input
+  EXPECT_FLOAT_EQ(polysoftplus(10000), 10000);
+  EXPECT_LT(polysoftplus(-10000), 1e-30);
+  EXPECT_FLOAT_EQ(polysigmoid(10000), 1);
+  EXPECT_LT(polysigmoid(-10000), 1e-30);
+}
+
+TEST(MathTest, Vector_function) {
+  // Larger than one block of SumSoftplus()
+  std::vector<real_t> in(1000), out(1000);
+  for (size_t i = 0; i < in.size(); ++i) {
+    in[i] = (static_cast<int>(i % 200) - 100) * 0.1;
+  }
+  VecSigmoid(in.data(), out.data(), in.size());
+  double sum = 0;
+  for (size_t i = 0; i < in.size(); ++i) {
+    EXPECT_FLOAT_EQ(out[i], polysigmoid(in[i]));
+    sum += std::log1p(std::exp(static_cast<double>(in[i])));
+  }
+  EXPECT_NEAR(SumSoftplus(in.data(), in.size()), sum, sum * 1e-6);
+  EXPECT_EQ(SumSoftplus(in.data(), 0), 0);
+  // In place
+  VecSigmoid(in.data(), in.data(), in.size());
+  for (size_t i = 0; i < in.size(); ++i) {
+    EXPECT_FLOAT_EQ(in[i], out[i]);
+  }
+}
+
+TEST(MathTest, Inv_sqrt) {
+  // One Newton step from the magic guess
+  double err = max_error([](real_t x) { return InvSqrt(x); },
+                         [](double x) { return 1.0 / std::sqrt(x); },
+                         -6, 6, true);
+  EXPECT_LT(err, 2e-3);
+  EXPECT_NEAR(InvSqrt(4.0f), 0.5f, 1e-3);
+}
+
+}  // namespace xLearn
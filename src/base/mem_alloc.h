@@ -0,0 +1,539 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file provides the allocation of the big arrays (such as the
+model parameters), which can use transparent huge pages and a NUMA
+placement policy, and the NUMA topology used to pin the threads
+(including the cpu affinity of the worker threads).
+They are only supported on Linux, and they are simply ignored on
+the other systems.
+*/
+
+#ifndef XLEARN_BASE_MEM_ALLOC_H_
+#define XLEARN_BASE_MEM_ALLOC_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// NUMA placement of the big arrays. Linux puts a page on the node of
+// the thread that first touches it, so an array written by the main
+// thread lands on one node. kNumaInterleave spreads the pages over all
+// the nodes, and kNumaLocal lets the worker threads initialize the
+// array, so the pages are spread over the nodes of the workers.
+// With kNumaReplicate every node keeps its own copy of the model, and
+// the worker threads pinned to the node read the local copy. The
+// training updates the local copy, and the copies are averaged after
+// some rows (see Model::SyncReplicas).
+//------------------------------------------------------------------------------
+enum NumaPolicy {
+  kNumaNone = 0,        /* Default policy of the OS */
+  kNumaInterleave = 1,  /* Interleave the pages over all the nodes */
+  kNumaLocal = 2,       /* First touch by the worker threads */
+  kNumaReplicate = 3    /* One copy of the model on each node */
+};
+
+// Return the name of the NUMA policy.
+inline const char* NumaPolicyName(NumaPolicy policy) {
+  switch (policy) {
+    case kNumaInterleave: return "interleave";
+    case kNumaLocal: return "local";
+    case kNumaReplicate: return "replicate";
+    default: return "none";
+  }
+}
+
+// Parse the NUMA policy from its name.
+// Return false if the name is unknown.
+inline bool ParseNumaPolicy(const std::string& name,
+                            NumaPolicy* policy) {
+  if (name == "none") {
+    *policy = kNumaNone;
+  } else if (name == "interleave") {
+    *policy = kNumaInterleave;
+  } else if (name == "local") {
+    *policy = kNumaLocal;
+  } else if (name == "replicate") {
+    *policy = kNumaReplicate;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Size of the huge page on x86-64 and AArch64 (with 4K pages).
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+// Allocate size bytes aligned to align, which is a power of two.
+// If huge_page is true, a buffer larger than kHugePageSize is aligned
+// to the huge page and the kernel is asked to back it with transparent
+// huge pages, which is only a hint. Use FreeAligned() to free it.
+inline void* AllocAligned(size_t size, size_t align, bool huge_page) {
+  void* ptr = nullptr;
+#ifdef _MSC_VER
+  ptr = _aligned_malloc(size, align);
+  CHECK(ptr != nullptr);
+#else
+  bool use_huge = huge_page && size >= kHugePageSize;
+  if (use_huge && align < kHugePageSize) {
+    align = kHugePageSize;
+  }
+  int ret = posix_memalign(&ptr, align, size);
+  CHECK_EQ(ret, 0);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (use_huge) {
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+#endif
+  return ptr;
+}
+
+inline void FreeAligned(void* ptr) {
+#ifdef _MSC_VER
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+// Set the memory policy of the whole pages in [ptr, ptr + size) by
+// calling mbind(2) directly, so xLearn does not depend on libnuma.
+// The nodes out of the cpuset of current process are masked by the
+// kernel. Only the first 64 nodes can be used.
+inline bool mbind_pages(void* ptr, size_t size, int mode,
+                        unsigned long nodemask, unsigned flags = 0) {
+#if defined(__linux__) && defined(SYS_mbind)
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+  uintptr_t end = ((uintptr_t)ptr + size) & ~(page - 1);
+  if (end <= begin) {
+    return true;
+  }
+  long ret = syscall(SYS_mbind, (void*)begin, end - begin,
+                     mode, &nodemask, sizeof(nodemask) * 8 + 1, flags);
+  return ret == 0;
+#else
+  return false;
+#endif
+}
+
+// Interleave the pages of [ptr, ptr + size) over all the memory nodes,
+// which must be called before the pages are touched. Return false if
+// the system does not support it.
+inline bool InterleaveMemory(void* ptr, size_t size) {
+  const int kMpolInterleave = 3;  /* MPOL_INTERLEAVE */
+  return mbind_pages(ptr, size, kMpolInterleave, ~0UL);
+}
+
+// Place the pages of [ptr, ptr + size) on the given node, which must
+// be called before the pages are touched. Return false if the system
+// does not support it.
+inline bool BindMemory(void* ptr, size_t size, int node) {
+  const int kMpolBind = 2;  /* MPOL_BIND */
+  if (node < 0 || node >= 64) {
+    return false;
+  }
+  return mbind_pages(ptr, size, kMpolBind, 1UL << node);
+}
+
+// Same as BindMemory(), but the pages that are already touched are
+// moved to the node too. Return false if the system does not support
+// it or some pages cannot be moved.
+inline bool MoveMemory(void* ptr, size_t size, int node) {
+  const int kMpolBind = 2;  /* MPOL_BIND */
+  const unsigned kMpolMfMove = 1 << 1;  /* MPOL_MF_MOVE */
+  if (node < 0 || node >= 64) {
+    return false;
+  }
+  return mbind_pages(ptr, size, kMpolBind, 1UL << node, kMpolMfMove);
+}
+
+//------------------------------------------------------------------------------
+// NUMA topology, which is read from /sys/devices/system/node/.
+//------------------------------------------------------------------------------
+
+// Parse the list format of sysfs, e.g., "0-3,8,10-11".
+// Return false if the string is malformed.
+inline bool ParseCpuList(const std::string& str, std::vector<int>* list) {
+  list->clear();
+  size_t pos = 0;
+  while (pos < str.size()) {
+    if (str[pos] == '\n' || str[pos] == ' ') { ++pos; continue; }
+    char* end = nullptr;
+    long first = strtol(str.c_str() + pos, &end, 10);
+    if (end == str.c_str() + pos || first < 0) { return false; }
+    long last = first;
+    pos = end - str.c_str();
+    if (pos < str.size() && str[pos] == '-') {
+      last = strtol(str.c_str() + pos + 1, &end, 10);
+      if (end == str.c_str() + pos + 1 || last < first) { return false; }
+      pos = end - str.c_str();
+    }
+    for (long i = first; i <= last; ++i) {
+      list->push_back((int)i);
+    }
+    if (pos < str.size() && str[pos] == ',') { ++pos; }
+  }
+  return true;
+}
+
+// Read the list in the given sysfs file.
+inline bool read_sysfs_list(const std::string& path, std::vector<int>* list) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char buf[4096];
+  size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  buf[len] = '\0';
+  return ParseCpuList(std::string(buf), list);
+}
+
+// Return the number of NUMA nodes, which is 1 on
+// the systems without NUMA support.
+inline int GetNumNodes() {
+  std::vector<int> nodes;
+  if (!read_sysfs_list("/sys/devices/system/node/online", &nodes) ||
+      nodes.empty()) {
+    return 1;
+  }
+  return nodes.back() + 1;
+}
+
+// The node that current thread is pinned to by PinThreadToNode(),
+// which is -1 if the thread is not pinned.
+inline int& current_numa_node() {
+  static thread_local int node = -1;
+  return node;
+}
+
+inline int CurrentNumaNode() { return current_numa_node(); }
+
+// Pin current thread to the cpus of the given node, and then the
+// memory it first touches also lands on the node. Return false if
+// the system does not support it.
+inline bool PinThreadToNode(int node) {
+#ifdef __linux__
+  std::vector<int> cpus;
+  std::string path = "/sys/devices/system/node/node" +
+                     std::to_string(node) + "/cpulist";
+  if (!read_sysfs_list(path, &cpus) || cpus.empty()) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    if (cpus[i] < CPU_SETSIZE) {
+      CPU_SET(cpus[i], &set);
+    }
+  }
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    return false;
+  }
+  current_numa_node() = node;
+  return true;
+#else
+  return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// CPU affinity of the worker threads. Without it, the OS can move a
+// thread to another socket in the middle of an epoch, away from the
+// memory it touched. kAffinityCompact fills the cpus of one node before
+// the next node, kAffinityScatter puts the threads on the nodes in
+// turn, and kAffinityList uses the cpus given by the user. Each thread
+// is pinned to one cpu, and the cpus are reused if there are more
+// threads than cpus.
+//------------------------------------------------------------------------------
+enum AffinityPolicy {
+  kAffinityNone = 0,     /* The OS places the threads */
+  kAffinityCompact = 1,  /* Fill the nodes one by one */
+  kAffinityScatter = 2,  /* Spread over the nodes */
+  kAffinityList = 3      /* The given list of cpus */
+};
+
+// Return the name of the affinity policy.
+inline const char* AffinityPolicyName(AffinityPolicy policy) {
+  switch (policy) {
+    case kAffinityCompact: return "compact";
+    case kAffinityScatter: return "scatter";
+    case kAffinityList: return "list";
+    default: return "none";
+  }
+}
+
+// Parse the affinity policy, which is 'none', 'compact', 'scatter',
+// or a cpu list in the format of ParseCpuList(), e.g., "0-7,16-23".
+// The cpus of the list are returned in cpus. Return false if the
+// name is unknown or the list is malformed.
+inline bool ParseAffinity(const std::string& name,
+                          AffinityPolicy* policy,
+                          std::vector<int>* cpus) {
+  cpus->clear();
+  if (name == "none") {
+    *policy = kAffinityNone;
+  } else if (name == "compact") {
+    *policy = kAffinityCompact;
+  } else if (name == "scatter") {
+    *policy = kAffinityScatter;
+  } else if (ParseCpuList(name, cpus) && !cpus->empty()) {
+    *policy = kAffinityList;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Return the cpus that current process can run on, which
+// can be fewer than the machine has, e.g., in a container.
+inline void GetAllowedCpus(std::vector<int>* cpus) {
+  cpus->clear();
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+      if (CPU_ISSET(i, &set)) { cpus->push_back(i); }
+    }
+  }
+#endif
+  if (cpus->empty()) {
+    int n = std::max<int>(std::thread::hardware_concurrency(), 1);
+    for (int i = 0; i < n; ++i) { cpus->push_back(i); }
+  }
+}
+
+//------------------------------------------------------------------------------
+// CPU quota of the cgroups, e.g., a container of Kubernetes limited to
+// 8 cpus can run on all the 96 cores of its host, but only gets the
+// time of 8 cpus, so the threads beyond the quota are throttled.
+//------------------------------------------------------------------------------
+
+// Read the whole (small) file of sysfs or procfs to str.
+inline bool read_sysfs_string(const std::string& path, std::string* str) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char buf[4096];
+  str->clear();
+  for (size_t len; (len = fread(buf, 1, sizeof(buf), file)) > 0; ) {
+    str->append(buf, len);
+  }
+  fclose(file);
+  return true;
+}
+
+// Parse the cpu limit of cgroup v2 in cpu.max, e.g., "800000 100000"
+// is 8 cpus, and "max 100000" has no limit. Return 0 for no limit.
+inline double ParseCpuMax(const std::string& str) {
+  long long quota = 0, period = 0;
+  if (sscanf(str.c_str(), "%lld %lld", &quota, &period) != 2 ||
+      quota <= 0 || period <= 0) {
+    return 0;
+  }
+  return (double)quota / period;
+}
+
+// The cpu limit of cgroup v1 in cpu.cfs_quota_us and cpu.cfs_period_us
+// of the directory, and the limit of v2 in cpu.max. Return 0 for none.
+inline double cgroup_dir_quota(const std::string& dir, bool v2) {
+  std::string quota, period;
+  if (v2) {
+    return read_sysfs_string(dir + "/cpu.max", &quota) ?
+           ParseCpuMax(quota) : 0;
+  }
+  if (!read_sysfs_string(dir + "/cpu.cfs_quota_us", &quota) ||
+      !read_sysfs_string(dir + "/cpu.cfs_period_us", &period)) {
+    return 0;
+  }
+  return ParseCpuMax(quota + " " + period);
+}
+
+// Return the cpu quota of current process in cpus, which is the
+// smallest quota of its cgroups (v1 or v2) and their parents, and 0 if
+// there is none. The cgroups are given by /proc/self/cgroup, whose
+// lines are 'id:controllers:path', and they are mounted at mount,
+// where v2 can also be mounted at mount/unified (the hybrid mode).
+// A container sees its own cgroup at the root of the mount, so
+// the path is walked up to the root.
+inline double GetCpuQuota(
+    const std::string& cgroup_file = "/proc/self/cgroup",
+    const std::string& mount = "/sys/fs/cgroup") {
+  std::string content;
+  if (!read_sysfs_string(cgroup_file, &content)) {
+    return 0;
+  }
+  double quota = 0;
+  size_t begin = 0;
+  while (begin < content.size()) {
+    size_t end = content.find('\n', begin);
+    if (end == std::string::npos) { end = content.size(); }
+    std::string line = content.substr(begin, end - begin);
+    begin = end + 1;
+    size_t colon_1 = line.find(':');
+    size_t colon_2 = colon_1 == std::string::npos ? colon_1 :
+                     line.find(':', colon_1 + 1);
+    if (colon_2 == std::string::npos) { continue; }
+    std::string controllers = line.substr(colon_1 + 1,
+                                          colon_2 - colon_1 - 1);
+    std::string path = line.substr(colon_2 + 1);
+    std::vector<std::string> roots;
+    bool v2 = controllers.empty();
+    if (v2) {
+      roots = { mount, mount + "/unified" };
+    } else if (("," + controllers + ",").find(",cpu,") !=
+               std::string::npos) {
+      roots = { mount + "/" + controllers, mount + "/cpu" };
+    } else {
+      continue;
+    }
+    for (;;) {
+      for (const std::string& root : roots) {
+        double q = cgroup_dir_quota(root + path, v2);
+        if (q > 0 && (quota == 0 || q < quota)) { quota = q; }
+      }
+      if (path.empty() || path == "/") { break; }
+      size_t pos = path.rfind('/');
+      path = pos == 0 || pos == std::string::npos ? std::string("/") :
+                                                    path.substr(0, pos);
+    }
+  }
+  return quota;
+}
+
+// The default number of threads, which is the number of the cpus that
+// current process can run on (see GetAllowedCpus), and no more than
+// its cpu quota (see GetCpuQuota) rounded up.
+inline size_t DefaultThreadNumber() {
+  std::vector<int> cpus;
+  GetAllowedCpus(&cpus);
+  size_t num = cpus.size();
+#ifdef __linux__
+  double quota = GetCpuQuota();
+  if (quota > 0) {
+    num = std::min(num, (size_t)std::max(1.0, std::ceil(quota)));
+  }
+#endif
+  return num;
+}
+
+// Return the NUMA node of the cpu, or -1 if it is unknown.
+inline int GetCpuNode(int cpu) {
+  int num_nodes = GetNumNodes();
+  for (int node = 0; node < num_nodes; ++node) {
+    std::vector<int> cpus;
+    std::string path = "/sys/devices/system/node/node" +
+                       std::to_string(node) + "/cpulist";
+    if (read_sysfs_list(path, &cpus) &&
+        std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+// Return the cpu of each of the first num_threads threads by the
+// policy, where list is only used by kAffinityList. The cpus list
+// is empty for kAffinityNone or an empty list.
+inline void GetThreadCpus(AffinityPolicy policy,
+                          const std::vector<int>& list,
+                          size_t num_threads,
+                          std::vector<int>* cpus) {
+  cpus->clear();
+  if (policy == kAffinityNone || num_threads == 0) {
+    return;
+  }
+  std::vector<int> order;
+  if (policy == kAffinityList) {
+    order = list;
+  } else {
+    // The allowed cpus of each node. If the topology is
+    // unknown, all of them are on node 0.
+    std::vector<int> allowed;
+    GetAllowedCpus(&allowed);
+    std::vector<std::vector<int> > nodes(GetNumNodes());
+    for (size_t i = 0; i < allowed.size(); ++i) {
+      int node = GetCpuNode(allowed[i]);
+      nodes[node < 0 ? 0 : node].push_back(allowed[i]);
+    }
+    if (policy == kAffinityCompact) {
+      for (size_t n = 0; n < nodes.size(); ++n) {
+        order.insert(order.end(), nodes[n].begin(), nodes[n].end());
+      }
+    } else {
+      // Take one cpu from each node in turn
+      for (size_t i = 0; order.size() < allowed.size(); ++i) {
+        for (size_t n = 0; n < nodes.size(); ++n) {
+          if (i < nodes[n].size()) { order.push_back(nodes[n][i]); }
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < num_threads && !order.empty(); ++i) {
+    cpus->push_back(order[i % order.size()]);
+  }
+}
+
+// Pin current thread to the cpu, and record its node for
+// CurrentNumaNode(). Return false if the system does not
+// support it or the cpu cannot be used.
+inline bool PinThreadToCpu(int cpu) {
+#ifdef __linux__
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    return false;
+  }
+  current_numa_node() = GetCpuNode(cpu);
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_MEM_ALLOC_H_
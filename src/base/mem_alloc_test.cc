@@ -0,0 +1,206 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests mem_alloc.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "src/base/mem_alloc.h"
+
+namespace xLearn {
+
+TEST(MemAllocTest, Numa_policy) {
+  NumaPolicy policy;
+  EXPECT_TRUE(ParseNumaPolicy("none", &policy));
+  EXPECT_EQ(policy, kNumaNone);
+  EXPECT_TRUE(ParseNumaPolicy("interleave", &policy));
+  EXPECT_EQ(policy, kNumaInterleave);
+  EXPECT_TRUE(ParseNumaPolicy("local", &policy));
+  EXPECT_EQ(policy, kNumaLocal);
+  EXPECT_TRUE(ParseNumaPolicy("replicate", &policy));
+  EXPECT_EQ(policy, kNumaReplicate);
+  EXPECT_FALSE(ParseNumaPolicy("remote", &policy));
+  EXPECT_EQ(std::string(NumaPolicyName(kNumaInterleave)), "interleave");
+}
+
+TEST(MemAllocTest, Alloc_aligned) {
+  size_t sizes[] = {100, kHugePageSize * 3 + 100};
+  for (size_t size : sizes) {
+    for (int huge = 0; huge < 2; ++huge) {
+      char* ptr = (char*)AllocAligned(size, 64, huge != 0);
+      EXPECT_EQ((uintptr_t)ptr % 64, (uintptr_t)0);
+#ifndef _MSC_VER
+      if (huge != 0 && size >= kHugePageSize) {
+        EXPECT_EQ((uintptr_t)ptr % kHugePageSize, (uintptr_t)0);
+      }
+#endif
+      memset(ptr, 1, size);
+      EXPECT_EQ(ptr[size-1], 1);
+      FreeAligned(ptr);
+    }
+  }
+}
+
+TEST(MemAllocTest, Interleave) {
+  size_t size = kHugePageSize + 100;
+  char* ptr = (char*)AllocAligned(size, 64, false);
+  // The result depends on the system, but the
+  // memory must still be usable after the call.
+  InterleaveMemory(ptr, size);
+  memset(ptr, 1, size);
+  EXPECT_EQ(ptr[0], 1);
+  EXPECT_EQ(ptr[size-1], 1);
+  FreeAligned(ptr);
+}
+
+TEST(MemAllocTest, Cpu_list) {
+  std::vector<int> list;
+  EXPECT_TRUE(ParseCpuList("0-3,8,10-11\n", &list));
+  int expected[] = {0, 1, 2, 3, 8, 10, 11};
+  ASSERT_EQ(list.size(), (size_t)7);
+  for (size_t i = 0; i < list.size(); ++i) {
+    EXPECT_EQ(list[i], expected[i]);
+  }
+  EXPECT_TRUE(ParseCpuList("", &list));
+  EXPECT_TRUE(list.empty());
+  EXPECT_FALSE(ParseCpuList("3-1", &list));
+  EXPECT_FALSE(ParseCpuList("a", &list));
+}
+
+TEST(MemAllocTest, Numa_node) {
+  EXPECT_GE(GetNumNodes(), 1);
+  EXPECT_EQ(CurrentNumaNode(), -1);
+  EXPECT_FALSE(BindMemory(nullptr, 100, -1));
+  size_t size = kHugePageSize + 100;
+  char* ptr = (char*)AllocAligned(size, 64, false);
+  BindMemory(ptr, size, 0);
+  memset(ptr, 1, size);
+  EXPECT_EQ(ptr[size-1], 1);
+  FreeAligned(ptr);
+}
+
+TEST(MemAllocTest, Affinity) {
+  AffinityPolicy policy;
+  std::vector<int> list;
+  EXPECT_TRUE(ParseAffinity("none", &policy, &list));
+  EXPECT_EQ(policy, kAffinityNone);
+  EXPECT_TRUE(ParseAffinity("scatter", &policy, &list));
+  EXPECT_EQ(policy, kAffinityScatter);
+  EXPECT_TRUE(list.empty());
+  EXPECT_TRUE(ParseAffinity("1,3-4", &policy, &list));
+  EXPECT_EQ(policy, kAffinityList);
+  EXPECT_EQ(list, std::vector<int>({1, 3, 4}));
+  EXPECT_STREQ(AffinityPolicyName(policy), "list");
+  // The list is reused by the threads
+  std::vector<int> cpus;
+  GetThreadCpus(kAffinityList, list, 5, &cpus);
+  EXPECT_EQ(cpus, std::vector<int>({1, 3, 4, 1, 3}));
+  GetThreadCpus(kAffinityNone, list, 5, &cpus);
+  EXPECT_TRUE(cpus.empty());
+  // Both use all the allowed cpus
+  std::vector<int> allowed;
+  GetAllowedCpus(&allowed);
+  ASSERT_FALSE(allowed.empty());
+  for (int p = kAffinityCompact; p <= kAffinityScatter; ++p) {
+    GetThreadCpus((AffinityPolicy)p, list, allowed.size(), &cpus);
+    std::sort(cpus.begin(), cpus.end());
+    EXPECT_EQ(cpus, allowed);
+  }
+  EXPECT_FALSE(ParseAffinity("all", &policy, &list));
+  EXPECT_FALSE(ParseAffinity("", &policy, &list));
+  GetThreadCpus(kAffinityList, list, 5, &cpus);
+  EXPECT_TRUE(cpus.empty());
+}
+
+void WriteFile(const std::string& path, const std::string& data) {
+  FILE* file = fopen(path.c_str(), "w");
+  ASSERT_TRUE(file != nullptr);
+  fwrite(data.data(), 1, data.size(), file);
+  fclose(file);
+}
+
+TEST(MemAllocTest, Cpu_quota) {
+  EXPECT_DOUBLE_EQ(ParseCpuMax("800000 100000\n"), 8);
+  EXPECT_DOUBLE_EQ(ParseCpuMax("150000 100000"), 1.5);
+  EXPECT_DOUBLE_EQ(ParseCpuMax("max 100000\n"), 0);
+  EXPECT_DOUBLE_EQ(ParseCpuMax("-1 100000"), 0);
+  EXPECT_DOUBLE_EQ(ParseCpuMax(""), 0);
+  // A fake mount of the cgroups, where the v1 cgroup of the
+  // process has no quota, but its parent has 3 cpus, and the
+  // v2 cgroup has 2.5 cpus
+  std::string root = "/tmp/xlearn_cgroup_" + std::to_string(getpid());
+  std::string v1 = root + "/cpu,cpuacct";
+  mkdir(root.c_str(), 0700);
+  mkdir(v1.c_str(), 0700);
+  mkdir((v1 + "/pod").c_str(), 0700);
+  mkdir((v1 + "/pod/app").c_str(), 0700);
+  mkdir((root + "/app").c_str(), 0700);
+  WriteFile(v1 + "/pod/cpu.cfs_quota_us", "300000\n");
+  WriteFile(v1 + "/pod/cpu.cfs_period_us", "100000\n");
+  WriteFile(v1 + "/pod/app/cpu.cfs_quota_us", "-1\n");
+  WriteFile(v1 + "/pod/app/cpu.cfs_period_us", "100000\n");
+  WriteFile(root + "/cgroup_1", "4:memory:/pod/app\n"
+                                "2:cpu,cpuacct:/pod/app\n");
+  EXPECT_DOUBLE_EQ(GetCpuQuota(root + "/cgroup_1", root), 3);
+  WriteFile(root + "/app/cpu.max", "250000 100000\n");
+  WriteFile(root + "/cgroup_2", "0::/app\n");
+  EXPECT_DOUBLE_EQ(GetCpuQuota(root + "/cgroup_2", root), 2.5);
+  WriteFile(root + "/cgroup_3", "0::/\n");
+  EXPECT_DOUBLE_EQ(GetCpuQuota(root + "/cgroup_3", root), 0);
+  EXPECT_DOUBLE_EQ(GetCpuQuota(root + "/none", root), 0);
+  const char* files[] = {
+    "/cpu,cpuacct/pod/app/cpu.cfs_quota_us",
+    "/cpu,cpuacct/pod/app/cpu.cfs_period_us",
+    "/cpu,cpuacct/pod/cpu.cfs_quota_us",
+    "/cpu,cpuacct/pod/cpu.cfs_period_us",
+    "/app/cpu.max", "/cgroup_1", "/cgroup_2", "/cgroup_3"
+  };
+  for (const char* file : files) { remove((root + file).c_str()); }
+  const char* dirs[] = {
+    "/cpu,cpuacct/pod/app", "/cpu,cpuacct/pod", "/cpu,cpuacct", "/app", ""
+  };
+  for (const char* dir : dirs) { rmdir((root + dir).c_str()); }
+  // The default is never more than the allowed cpus
+  std::vector<int> allowed;
+  GetAllowedCpus(&allowed);
+  EXPECT_GE(DefaultThreadNumber(), (size_t)1);
+  EXPECT_LE(DefaultThreadNumber(), allowed.size());
+}
+
+TEST(MemAllocTest, Pin_cpu) {
+  std::vector<int> allowed;
+  GetAllowedCpus(&allowed);
+  std::thread thread([&allowed]() {
+    EXPECT_FALSE(PinThreadToCpu(-1));
+#ifdef __linux__
+    EXPECT_TRUE(PinThreadToCpu(allowed.back()));
+    EXPECT_GE(CurrentNumaNode(), -1);
+#endif
+  });
+  thread.join();
+}
+
+}  // namespace xLearn
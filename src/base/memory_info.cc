@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of memory_info.h.
+*/
+
+#include "src/base/memory_info.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+
+namespace xLearn {
+
+uint64 GetCurrentRSS() {
+#ifdef _MSC_VER
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(),
+                            &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.WorkingSetSize;
+#elif defined(__linux__)
+  // The second number of statm is the resident pages
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == nullptr) { return 0; }
+  unsigned long long size = 0, resident = 0;
+  int ret = fscanf(file, "%llu %llu", &size, &resident);
+  fclose(file);
+  if (ret != 2) { return 0; }
+  return (uint64)resident * sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+uint64 GetPeakRSS() {
+#ifdef _MSC_VER
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(),
+                            &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+#ifdef __APPLE__
+  // The bytes on macOS, and the KB on Linux
+  return (uint64)usage.ru_maxrss;
+#else
+  return (uint64)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+uint64 GetPhysicalMemory() {
+#ifdef _MSC_VER
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status)) { return 0; }
+  return status.ullTotalPhys;
+#else
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (pages <= 0 || page_size <= 0) { return 0; }
+  return (uint64)pages * page_size;
+#endif
+}
+
+}  // namespace xLearn
@@ -0,0 +1,42 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the functions that read the memory used by
+current process and the physical memory of the host.
+*/
+
+#ifndef XLEARN_BASE_MEMORY_INFO_H_
+#define XLEARN_BASE_MEMORY_INFO_H_
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// Bytes of the resident memory of current process,
+// or 0 if it cannot be read.
+uint64 GetCurrentRSS();
+
+// The most bytes of the resident memory of current
+// process so far, or 0 if it cannot be read.
+uint64 GetPeakRSS();
+
+// Bytes of the physical memory of the host, or 0 if it cannot be read.
+uint64 GetPhysicalMemory();
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_MEMORY_INFO_H_
@@ -0,0 +1,46 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests memory_info.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "src/base/memory_info.h"
+
+namespace xLearn {
+
+TEST(MemoryInfoTest, RSS) {
+  uint64 before = GetCurrentRSS();
+  if (before == 0) { return; }  // Not supported
+  // The touched pages are resident
+  const size_t kSize = 64 * 1024 * 1024;
+  std::vector<char> buffer(kSize);
+  memset(buffer.data(), 1, kSize);
+  uint64 after = GetCurrentRSS();
+  EXPECT_GE(after, before + kSize / 2);
+  // The peak can be updated later than the current RSS
+  EXPECT_GE(GetPeakRSS(), before + kSize / 2);
+  EXPECT_GT(GetPhysicalMemory(), after);
+  EXPECT_EQ(buffer[kSize - 1], 1);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of MappedFile.
+*/
+
+#include "src/base/mmap_file.h"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace xLearn {
+
+#ifndef _MSC_VER
+
+bool MappedFile::Map(const std::string& filename) {
+  Unmap();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) { return false; }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* ptr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close(fd);
+      size_ = 0;
+      return false;
+    }
+    data_ = (const char*)ptr;
+  }
+  // The mapping is kept after close()
+  close(fd);
+  mapped_ = true;
+  return true;
+}
+
+bool MappedFile::Create(const std::string& filename, uint64 size) {
+  Unmap();
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) { return false; }
+  // The file is sparse, so its blocks are written by the first use
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return false;
+  }
+  if (size > 0) {
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    data_ = (const char*)ptr;
+  }
+  close(fd);
+  size_ = size;
+  mapped_ = true;
+  writable_ = true;
+  return true;
+}
+
+void MappedFile::Unmap() {
+  if (data_ != nullptr) {
+    munmap((void*)data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+  writable_ = false;
+}
+
+void MappedFile::Advise(Advice advice, uint64 offset, uint64 len) {
+  if (data_ == nullptr || offset >= size_) { return; }
+  if (len == 0 || len > size_ - offset) { len = size_ - offset; }
+  // madvise() needs the address aligned to the page
+  static const uint64 kPageSize = sysconf(_SC_PAGESIZE);
+  uint64 begin = offset / kPageSize * kPageSize;
+  len += offset - begin;
+  int flag = MADV_NORMAL;
+  switch (advice) {
+    case kSequential: flag = MADV_SEQUENTIAL; break;
+    case kRandom: flag = MADV_RANDOM; break;
+    case kWillNeed: flag = MADV_WILLNEED; break;
+    default: break;
+  }
+  madvise((void*)(data_ + begin), len, flag);
+}
+
+bool MappedFile::Lock(uint64 offset, uint64 len) {
+  if (data_ == nullptr || offset >= size_) { return true; }
+  if (len == 0 || len > size_ - offset) { len = size_ - offset; }
+  static const uint64 kPageSize = sysconf(_SC_PAGESIZE);
+  uint64 begin = offset / kPageSize * kPageSize;
+  len += offset - begin;
+  return mlock(data_ + begin, len) == 0;
+}
+
+#else  // _MSC_VER
+
+bool MappedFile::Map(const std::string& filename) {
+  Unmap();
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+                            FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) { return false; }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+  size_ = size.QuadPart;
+  if (size_ > 0) {
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY,
+                                       0, 0, NULL);
+    if (mapping == NULL) {
+      CloseHandle(file);
+      size_ = 0;
+      return false;
+    }
+    data_ = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // The view is kept after the handles are closed
+    CloseHandle(mapping);
+    if (data_ == nullptr) {
+      CloseHandle(file);
+      size_ = 0;
+      return false;
+    }
+  }
+  CloseHandle(file);
+  mapped_ = true;
+  return true;
+}
+
+bool MappedFile::Create(const std::string& filename, uint64 size) {
+  Unmap();
+  HANDLE file = CreateFileA(filename.c_str(),
+                            GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) { return false; }
+  if (size > 0) {
+    LARGE_INTEGER len;
+    len.QuadPart = size;
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READWRITE,
+                                       len.HighPart, len.LowPart, NULL);
+    if (mapping == NULL) {
+      CloseHandle(file);
+      return false;
+    }
+    data_ = (const char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data_ == nullptr) {
+      CloseHandle(file);
+      return false;
+    }
+  }
+  CloseHandle(file);
+  size_ = size;
+  mapped_ = true;
+  writable_ = true;
+  return true;
+}
+
+void MappedFile::Unmap() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+  writable_ = false;
+}
+
+void MappedFile::Advise(Advice advice, uint64 offset, uint64 len) { }
+
+bool MappedFile::Lock(uint64 offset, uint64 len) {
+  if (data_ == nullptr || offset >= size_) { return true; }
+  if (len == 0 || len > size_ - offset) { len = size_ - offset; }
+  return VirtualLock((LPVOID)(data_ + offset), len) != 0;
+}
+
+#endif  // _MSC_VER
+
+}  // namespace xLearn
@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the MappedFile class, which maps a whole
+file into memory for reading, or a new file for writing.
+*/
+
+#ifndef XLEARN_BASE_MMAP_FILE_H_
+#define XLEARN_BASE_MMAP_FILE_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// MappedFile maps a file read-only by mmap() (or MapViewOfFile() on
+// Windows), so the data is read from the page cache directly, without
+// the copy of fread() and the memory of a buffer. The pages are loaded
+// on demand, and we can tell the kernel how they are used:
+//
+//   MappedFile file;
+//   CHECK(file.Map(filename));
+//   file.Advise(MappedFile::kSequential);
+//   const char* data = file.data();
+//   for (uint64 i = 0; i < file.size(); ++i) { ... data[i] ... }
+//   file.Unmap();
+//
+// The advice is only a hint, which does nothing on Windows.
+//
+// Create() makes a new file of the given size and maps it for writing,
+// which keeps an array larger than the memory, e.g., the parameters of
+// the model (see Model::SetParamFile). The kernel loads the pages on
+// demand and writes the dirty pages back to the file, and Lock() keeps
+// a part of them in memory:
+//
+//   MappedFile file;
+//   CHECK(file.Create("/data/model.swap", size));
+//   file.Lock(0, hot_bytes);
+//   char* data = file.mutable_data();
+//------------------------------------------------------------------------------
+class MappedFile {
+ public:
+  enum Advice {
+    kNormal,      /* default */
+    kSequential,  /* read ahead, and free the pages behind */
+    kRandom,      /* no read ahead */
+    kWillNeed     /* load the pages now */
+  };
+
+  // Constructor and Destructor
+  MappedFile() : data_(nullptr), size_(0), mapped_(false),
+                 writable_(false) { }
+  ~MappedFile() { Unmap(); }
+
+  // Map the whole file. Return false if the file
+  // cannot be opened or mapped. An empty file is
+  // mapped to a nullptr data of size 0.
+  bool Map(const std::string& filename);
+
+  // Create the file of the given size (or truncate it) and map it
+  // for reading and writing, where the new file is all zeros. Return
+  // false if the file cannot be created, sized or mapped.
+  bool Create(const std::string& filename, uint64 size);
+
+  // Unmap the file.
+  void Unmap();
+
+  // Advise the pages in [offset, offset + len), and
+  // len = 0 means the pages from offset to the end.
+  void Advise(Advice advice, uint64 offset = 0, uint64 len = 0);
+
+  // Lock the pages in [offset, offset + len) in memory, and
+  // len = 0 means the pages from offset to the end. Return false if
+  // they cannot be locked, e.g., by the limit of locked memory.
+  bool Lock(uint64 offset = 0, uint64 len = 0);
+
+  const char* data() const { return data_; }
+  // The data of the file given by Create()
+  char* mutable_data() {
+    CHECK(writable_);
+    return const_cast<char*>(data_);
+  }
+  uint64 size() const { return size_; }
+  bool IsMapped() const { return mapped_; }
+  bool IsWritable() const { return writable_; }
+
+ protected:
+  const char* data_;
+  uint64 size_;
+  bool mapped_;
+  bool writable_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_MMAP_FILE_H_
@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests mmap_file.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "src/base/mmap_file.h"
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+const std::string kTestfilename = "./test_mmap_file.txt";
+
+TEST(MappedFileTest, Map_and_read) {
+  std::string str = "apple\nbanana\ncherry\n";
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, str.data(), str.size());
+  Close(file);
+  MappedFile mapped;
+  EXPECT_FALSE(mapped.IsMapped());
+  ASSERT_TRUE(mapped.Map(kTestfilename));
+  EXPECT_TRUE(mapped.IsMapped());
+  EXPECT_EQ(mapped.size(), str.size());
+  EXPECT_EQ(std::string(mapped.data(), mapped.size()), str);
+  // The hints do not change the data
+  mapped.Advise(MappedFile::kSequential);
+  mapped.Advise(MappedFile::kWillNeed, 7, 5);
+  mapped.Advise(MappedFile::kRandom, 100);
+  mapped.Advise(MappedFile::kNormal);
+  EXPECT_EQ(std::string(mapped.data(), mapped.size()), str);
+  mapped.Unmap();
+  EXPECT_FALSE(mapped.IsMapped());
+  EXPECT_EQ(mapped.size(), 0);
+  EXPECT_TRUE(mapped.data() == nullptr);
+  RemoveFile(kTestfilename.c_str());
+}
+
+TEST(MappedFileTest, Empty_and_missing) {
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  Close(file);
+  MappedFile mapped;
+  ASSERT_TRUE(mapped.Map(kTestfilename));
+  EXPECT_EQ(mapped.size(), 0);
+  EXPECT_TRUE(mapped.data() == nullptr);
+  mapped.Advise(MappedFile::kSequential);
+  RemoveFile(kTestfilename.c_str());
+  EXPECT_FALSE(mapped.Map(kTestfilename));
+  EXPECT_FALSE(mapped.IsMapped());
+}
+
+TEST(MappedFileTest, Read_from_buffer) {
+  // The data written by WriteVectorToFile()
+  std::vector<int> vec(1000);
+  for (int i = 0; i < 1000; ++i) { vec[i] = i; }
+  int number = 999;
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, (char*)&number, sizeof(number));
+  WriteVectorToFile(file, vec);
+  Close(file);
+  MappedFile mapped;
+  ASSERT_TRUE(mapped.Map(kTestfilename));
+  const char* ptr = mapped.data();
+  const char* end = ptr + mapped.size();
+  int number_r = 0;
+  ReadDataFromBuffer(&ptr, end, (char*)&number_r, sizeof(number_r));
+  EXPECT_EQ(number_r, number);
+  std::vector<int> vec_r;
+  ReadVectorFromBuffer(&ptr, end, vec_r);
+  EXPECT_EQ(vec_r, vec);
+  EXPECT_EQ(ptr, end);
+  mapped.Unmap();
+  RemoveFile(kTestfilename.c_str());
+}
+
+// The written pages go back to the file, which is read by Map().
+TEST(MappedFileTest, Create_and_write) {
+  uint64 size = 3 * 4096 + 100;
+  MappedFile mapped;
+  ASSERT_TRUE(mapped.Create(kTestfilename, size));
+  EXPECT_TRUE(mapped.IsMapped());
+  EXPECT_TRUE(mapped.IsWritable());
+  EXPECT_EQ(mapped.size(), size);
+  char* data = mapped.mutable_data();
+  // The new file is all zeros
+  for (uint64 i = 0; i < size; ++i) { EXPECT_EQ(data[i], 0); }
+  for (uint64 i = 0; i < size; ++i) { data[i] = (char)(i % 101); }
+  // A small lock is under the default limit of locked memory
+  EXPECT_TRUE(mapped.Lock(0, 100));
+  mapped.Unmap();
+  EXPECT_FALSE(mapped.IsWritable());
+  ASSERT_TRUE(mapped.Map(kTestfilename));
+  EXPECT_FALSE(mapped.IsWritable());
+  ASSERT_EQ(mapped.size(), size);
+  for (uint64 i = 0; i < size; ++i) {
+    EXPECT_EQ(mapped.data()[i], (char)(i % 101));
+  }
+  mapped.Unmap();
+  // The file is truncated by the next Create()
+  ASSERT_TRUE(mapped.Create(kTestfilename, 10));
+  EXPECT_EQ(mapped.data()[0], 0);
+  mapped.Unmap();
+  RemoveFile(kTestfilename.c_str());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,170 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file provides the fast conversion from the decimal
+string to the numbers, which is used by the parsers.
+*/
+
+#ifndef XLEARN_BASE_PARSE_NUMBER_H_
+#define XLEARN_BASE_PARSE_NUMBER_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The functions below parse the string [begin, end), which need not
+// be terminated by '\0', and they return false if the whole string is
+// not a valid number (e.g., empty, a non-digit character, or overflow),
+// instead of returning 0 like atoi() and atof(). They do not depend on
+// the locale. For example:
+//
+//   index_t feat_id;
+//   if (!ParseUint32(str, str + len, &feat_id)) { ... error ... }
+//------------------------------------------------------------------------------
+
+// Parse a decimal unsigned integer.
+inline bool ParseUint64(const char* begin, const char* end, uint64* value) {
+  if (begin >= end) { return false; }
+  uint64 v = 0;
+  // 19 digits cannot overflow
+  if (end - begin <= 19) {
+    for (const char* p = begin; p < end; ++p) {
+      uint32 d = (unsigned char)*p - '0';
+      if (d > 9) { return false; }
+      v = v * 10 + d;
+    }
+  } else {
+    const uint64 kMax = ~(uint64)0;
+    for (const char* p = begin; p < end; ++p) {
+      uint32 d = (unsigned char)*p - '0';
+      if (d > 9) { return false; }
+      if (v > (kMax - d) / 10) { return false; }
+      v = v * 10 + d;
+    }
+  }
+  *value = v;
+  return true;
+}
+
+inline bool ParseUint32(const char* begin, const char* end, uint32* value) {
+  uint64 v = 0;
+  if (!ParseUint64(begin, end, &v) || v > 0xffffffffULL) {
+    return false;
+  }
+  *value = (uint32)v;
+  return true;
+}
+
+// Parse a decimal floating-point number, such as "-1", "0.25",
+// ".5" and "1.5e-3". Here we collect (at most 19) significant digits
+// into an integer m and the exponent e, and if m < 2^53 and |e| <= 22,
+// both m and 10^e are exact doubles, so m*10^e (or m/10^-e) gives the
+// correctly rounded result, the same as strtod(). The other numbers,
+// which are rare in the data, are parsed by strtod().
+inline bool ParseDouble(const char* begin, const char* end, double* value) {
+  static const double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char* p = begin;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  uint64 m = 0;
+  int num_digits = 0;   /* significant digits in m */
+  int exponent = 0;
+  bool has_digit = false;
+  bool truncated = false;
+  // Integer part
+  for (; p < end; ++p) {
+    uint32 d = (unsigned char)*p - '0';
+    if (d > 9) { break; }
+    has_digit = true;
+    if (num_digits < 19) {
+      m = m * 10 + d;
+      if (m != 0) { num_digits++; }
+    } else {
+      exponent++;
+      truncated |= d != 0;
+    }
+  }
+  // Fraction part
+  if (p < end && *p == '.') {
+    for (++p; p < end; ++p) {
+      uint32 d = (unsigned char)*p - '0';
+      if (d > 9) { break; }
+      has_digit = true;
+      if (num_digits < 19) {
+        m = m * 10 + d;
+        if (m != 0) { num_digits++; }
+        exponent--;
+      } else {
+        truncated |= d != 0;
+      }
+    }
+  }
+  if (!has_digit) { return false; }
+  // Exponent part
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negative_exp = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative_exp = *p == '-';
+      ++p;
+    }
+    if (p == end) { return false; }
+    int e = 0;
+    for (; p < end; ++p) {
+      uint32 d = (unsigned char)*p - '0';
+      if (d > 9) { return false; }
+      if (e < 100000) { e = e * 10 + d; }
+    }
+    exponent += negative_exp ? -e : e;
+  }
+  if (p != end) { return false; }
+  if (!truncated && m <= (1ULL << 53) &&
+      exponent >= -22 && exponent <= 22) {
+    double v = (double)m;
+    v = exponent < 0 ? v / kPow10[-exponent] : v * kPow10[exponent];
+    *value = negative ? -v : v;
+    return true;
+  }
+  // The slow path
+  std::string str(begin, end);
+  *value = strtod(str.c_str(), nullptr);
+  return true;
+}
+
+inline bool ParseFloat(const char* begin, const char* end, float* value) {
+  double v = 0;
+  if (!ParseDouble(begin, end, &v)) { return false; }
+  *value = (float)v;
+  return true;
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_PARSE_NUMBER_H_
@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests parse_number.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "src/base/parse_number.h"
+
+namespace xLearn {
+
+bool parse_uint64(const std::string& str, uint64* value) {
+  return ParseUint64(str.data(), str.data() + str.size(), value);
+}
+
+bool parse_uint32(const std::string& str, uint32* value) {
+  return ParseUint32(str.data(), str.data() + str.size(), value);
+}
+
+bool parse_double(const std::string& str, double* value) {
+  return ParseDouble(str.data(), str.data() + str.size(), value);
+}
+
+TEST(ParseNumberTest, Integer) {
+  uint64 v = 0;
+  EXPECT_TRUE(parse_uint64("0", &v));
+  EXPECT_EQ(v, 0);
+  EXPECT_TRUE(parse_uint64("1234567", &v));
+  EXPECT_EQ(v, 1234567);
+  EXPECT_TRUE(parse_uint64("18446744073709551615", &v));
+  EXPECT_EQ(v, 18446744073709551615ULL);
+  EXPECT_TRUE(parse_uint64("000000000000000000000012", &v));
+  EXPECT_EQ(v, 12);
+  EXPECT_FALSE(parse_uint64("18446744073709551616", &v));
+  EXPECT_FALSE(parse_uint64("", &v));
+  EXPECT_FALSE(parse_uint64("-1", &v));
+  EXPECT_FALSE(parse_uint64("12a", &v));
+  EXPECT_FALSE(parse_uint64("1.0", &v));
+  uint32 u = 0;
+  EXPECT_TRUE(parse_uint32("4294967295", &u));
+  EXPECT_EQ(u, 4294967295U);
+  EXPECT_FALSE(parse_uint32("4294967296", &u));
+  // Only [begin, end) is parsed
+  const char* str = "123:456";
+  EXPECT_TRUE(ParseUint32(str, str + 3, &u));
+  EXPECT_EQ(u, 123);
+}
+
+TEST(ParseNumberTest, Float) {
+  const char* valid[] = {
+    "0", "-0", "1", "-1", "+1", "0.5", ".5", "5.", "0.12",
+    "3.14159265358979", "-2.5e-3", "1E10", "1e+5", "0.000001234",
+    "123456789012345678901234", "1e-30", "1e300", "4.9e-324",
+    "0.1234567890123456789012", "9007199254740993", "1e22", "1e23"
+  };
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+    double v = 0;
+    EXPECT_TRUE(parse_double(valid[i], &v)) << valid[i];
+    // The same as strtod()
+    EXPECT_EQ(v, strtod(valid[i], nullptr)) << valid[i];
+  }
+  const char* invalid[] = {
+    "", "-", ".", "e5", "1e", "1e+", "abc", "1.2.3", "12a", "0x10",
+    "1 ", " 1", "--1"
+  };
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    double v = 0;
+    EXPECT_FALSE(parse_double(invalid[i], &v)) << invalid[i];
+  }
+  // float
+  const char* str = "0.12 1";
+  float f = 0;
+  EXPECT_TRUE(ParseFloat(str, str + 4, &f));
+  EXPECT_EQ(f, 0.12f);
+}
+
+// Random numbers are the same as strtod().
+TEST(ParseNumberTest, Random_float) {
+  srand(1);
+  char str[64];
+  for (int i = 0; i < 100000; ++i) {
+    double x = (double)rand() / RAND_MAX;
+    int precision = rand() % 17 + 1;
+    int exp = rand() % 21 - 10;
+    snprintf(str, sizeof(str), "%.*fe%d", precision, x, exp);
+    double v = 0;
+    ASSERT_TRUE(ParseDouble(str, str + strlen(str), &v)) << str;
+    EXPECT_EQ(v, strtod(str, nullptr)) << str;
+  }
+}
+
+}  // namespace xLearn
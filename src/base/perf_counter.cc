@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of perf_counter.h.
+*/
+
+#include "src/base/perf_counter.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace xLearn {
+
+static const char* kPerfEventName[] = {
+  "cycles", "instructions", "llc_misses", "dtlb_misses"
+};
+
+const char* PerfEventName(int event) {
+  CHECK_GE(event, 0);
+  CHECK_LT(event, kNumPerfEvent);
+  return kPerfEventName[event];
+}
+
+PerfCounters::PerfCounters() {
+  for (int e = 0; e < kNumPerfEvent; ++e) { fd_[e] = -1; }
+}
+
+bool PerfCounters::IsOpen() const {
+  for (int e = 0; e < kNumPerfEvent; ++e) {
+    if (fd_[e] >= 0) { return true; }
+  }
+  return false;
+}
+
+#ifdef __linux__
+
+// The events are not in a group, because the inherited events
+// of the new threads cannot be read as a group.
+int PerfCounters::Open(std::string* error) {
+  Close();
+  static const uint32 kType[] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+  };
+  static const uint64 kConfig[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_CACHE_DTLB |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+  };
+  int num_open = 0;
+  int last_errno = 0;
+  for (int e = 0; e < kNumPerfEvent; ++e) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = kType[e];
+    attr.config = kConfig[e];
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // This process (and its new threads) on any cpu
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+      last_errno = errno;
+      continue;
+    }
+    fd_[e] = fd;
+    num_open++;
+  }
+  if (num_open == 0 && error != nullptr) {
+    *error = std::string("perf_event_open: ") + strerror(last_errno);
+  }
+  return num_open;
+}
+
+void PerfCounters::Close() {
+  for (int e = 0; e < kNumPerfEvent; ++e) {
+    if (fd_[e] >= 0) {
+      close(fd_[e]);
+      fd_[e] = -1;
+    }
+  }
+}
+
+void PerfCounters::Read(uint64* values) const {
+  for (int e = 0; e < kNumPerfEvent; ++e) {
+    values[e] = 0;
+    // The value, the time enabled and the time running
+    uint64 data[3];
+    if (fd_[e] < 0 ||
+        read(fd_[e], data, sizeof(data)) != sizeof(data)) {
+      continue;
+    }
+    if (data[2] > 0 && data[2] < data[1]) {
+      data[0] = (uint64)((double)data[0] * data[1] / data[2]);
+    }
+    values[e] = data[0];
+  }
+}
+
+#else
+
+int PerfCounters::Open(std::string* error) {
+  if (error != nullptr) {
+    *error = "The hardware counters are only supported on Linux";
+  }
+  return 0;
+}
+
+void PerfCounters::Close() { }
+
+void PerfCounters::Read(uint64* values) const {
+  for (int e = 0; e < kNumPerfEvent; ++e) { values[e] = 0; }
+}
+
+#endif
+
+}  // namespace xLearn
@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the PerfCounters class, which counts the hardware
+events of current process by perf_event_open() on Linux.
+*/
+
+#ifndef XLEARN_BASE_PERF_COUNTER_H_
+#define XLEARN_BASE_PERF_COUNTER_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// The hardware events of PerfCounters.
+enum PerfEvent {
+  kPerfCycles,
+  kPerfInstructions,
+  kPerfLLCMisses,
+  kPerfDTLBMisses,
+  kNumPerfEvent
+};
+
+// "cycles", "instructions", "llc_misses" or "dtlb_misses".
+const char* PerfEventName(int event);
+
+//------------------------------------------------------------------------------
+// PerfCounters counts the events of the thread that opens it and of the
+// threads created by that thread after it is opened, so it is opened
+// before the thread pool:
+//
+//   PerfCounters perf;
+//   perf.Open();
+//   ThreadPool pool(4);
+//   uint64 start[kNumPerfEvent], end[kNumPerfEvent];
+//   perf.Read(start);
+//   ...  /* the work of the pool */
+//   perf.Read(end);
+//
+// The counters need the permission of perf_event_paranoid, and the
+// events that cannot be opened (e.g., in a VM or on other OS) are
+// always 0. When there are more events than the hardware counters,
+// the kernel shares the counters by time, and the values are scaled
+// by the time that each event was counted.
+//------------------------------------------------------------------------------
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters() { Close(); }
+
+  // Open the counters, and return the number of the events
+  // opened. error gives the reason if none is opened.
+  int Open(std::string* error = nullptr);
+
+  void Close();
+
+  // If any event is counted.
+  bool IsOpen() const;
+
+  // If the event is counted.
+  bool IsOpen(int event) const { return fd_[event] >= 0; }
+
+  // Read the counts of all the events since Open().
+  void Read(uint64* values) const;
+
+ private:
+  int fd_[kNumPerfEvent];
+
+  DISALLOW_COPY_AND_ASSIGN(PerfCounters);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_PERF_COUNTER_H_
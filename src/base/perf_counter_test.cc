@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests perf_counter.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+
+#include "src/base/perf_counter.h"
+
+namespace xLearn {
+
+TEST(PerfCounterTest, Names) {
+  EXPECT_EQ(std::string(PerfEventName(kPerfCycles)), "cycles");
+  EXPECT_EQ(std::string(PerfEventName(kPerfDTLBMisses)), "dtlb_misses");
+}
+
+// The instructions of a new thread are also counted.
+TEST(PerfCounterTest, Count) {
+  PerfCounters perf;
+  uint64 values[kNumPerfEvent];
+  perf.Read(values);
+  for (int e = 0; e < kNumPerfEvent; ++e) {
+    EXPECT_EQ(values[e], 0);
+  }
+  std::string error;
+  if (perf.Open(&error) == 0) {
+    // Not supported by this host
+    EXPECT_FALSE(error.empty());
+    EXPECT_FALSE(perf.IsOpen());
+    return;
+  }
+  EXPECT_TRUE(perf.IsOpen());
+  uint64 start[kNumPerfEvent], end[kNumPerfEvent];
+  volatile uint64 sum = 0;
+  perf.Read(start);
+  std::thread thread([&sum]() {
+    for (uint64 i = 0; i < 10000000; ++i) { sum += i; }
+  });
+  thread.join();
+  perf.Read(end);
+  if (perf.IsOpen(kPerfInstructions)) {
+    EXPECT_GT(end[kPerfInstructions] - start[kPerfInstructions], 10000000);
+  }
+  for (int e = 0; e < kNumPerfEvent; ++e) {
+    EXPECT_GE(end[e], start[e]);
+  }
+  perf.Close();
+  EXPECT_FALSE(perf.IsOpen());
+}
+
+}  // namespace xLearn
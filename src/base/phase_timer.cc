@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the clocks of the PhaseTime.
+*/
+
+#include "src/base/phase_timer.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <chrono>
+
+namespace xLearn {
+
+double WallSeconds() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double ProcessCpuSeconds() {
+#ifdef _MSC_VER
+  FILETIME create, exit, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &create,
+                       &exit, &kernel, &user)) {
+    return 0;
+  }
+  // The times are in the units of 100 ns
+  auto seconds = [](const FILETIME& t) {
+    return ((uint64)t.dwHighDateTime << 32 | t.dwLowDateTime) * 1e-7;
+  };
+  return seconds(kernel) + seconds(user);
+#else
+  struct timespec ts;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+}  // namespace xLearn
@@ -0,0 +1,117 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the PhaseTime and ScopedPhase, which accumulate
+the wall time and the CPU time of the phases of the training.
+*/
+
+#ifndef XLEARN_BASE_PHASE_TIMER_H_
+#define XLEARN_BASE_PHASE_TIMER_H_
+
+#include "src/base/common.h"
+#include "src/base/perf_counter.h"
+
+namespace xLearn {
+
+// Seconds of a monotonic clock.
+double WallSeconds();
+
+// CPU seconds used by all the threads of current process, so the
+// CPU time of a phase over its wall time is the number of the busy
+// threads in the phase.
+double ProcessCpuSeconds();
+
+//------------------------------------------------------------------------------
+// PhaseTime is the total time of a phase, which is added by ScopedPhase
+// for each of its runs. The timers only read the clocks at the start and
+// the end of a scope, so they are used around the blocks of the data or
+// the passes, but not around each row:
+//
+//   PhaseTime read;
+//   {
+//     ScopedPhase phase(&read);
+//     reader->Samples(matrix);
+//   }
+//   printf("%.2f sec (%.2f cpu sec)\n", read.wall, read.cpu);
+//
+// A ScopedPhase of nullptr does nothing, so the timers can be turned
+// off without any cost. A PhaseTime is not thread-safe. If the perf
+// of a PhaseTime is set, its phases also add the hardware events.
+//------------------------------------------------------------------------------
+struct PhaseTime {
+  double wall = 0;
+  double cpu = 0;
+  /* Number of the runs */
+  uint64 count = 0;
+  /* The hardware events of the runs, which are
+  counted by perf if it is not nullptr */
+  const PerfCounters* perf = nullptr;
+  uint64 events[kNumPerfEvent] = { 0 };
+
+  // Reset the time and the events, but keep the perf.
+  void Reset() {
+    wall = 0;
+    cpu = 0;
+    count = 0;
+    for (int e = 0; e < kNumPerfEvent; ++e) { events[e] = 0; }
+  }
+};
+
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(PhaseTime* time)
+    : time_(time),
+      wall_(time == nullptr ? 0 : WallSeconds()),
+      cpu_(time == nullptr ? 0 : ProcessCpuSeconds()) {
+    if (time != nullptr && time->perf != nullptr) {
+      time->perf->Read(events_);
+    }
+  }
+  ~ScopedPhase() { Stop(); }
+
+  // Add the time since the construction, and
+  // the destructor does not add it again.
+  void Stop() {
+    if (time_ == nullptr) { return; }
+    time_->wall += WallSeconds() - wall_;
+    time_->cpu += ProcessCpuSeconds() - cpu_;
+    time_->count++;
+    if (time_->perf != nullptr) {
+      uint64 events[kNumPerfEvent];
+      time_->perf->Read(events);
+      // The scaled counts of the shared counters can go back
+      for (int e = 0; e < kNumPerfEvent; ++e) {
+        if (events[e] > events_[e]) {
+          time_->events[e] += events[e] - events_[e];
+        }
+      }
+    }
+    time_ = nullptr;
+  }
+
+ private:
+  PhaseTime* time_;
+  double wall_;
+  double cpu_;
+  uint64 events_[kNumPerfEvent];
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhase);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_PHASE_TIMER_H_
@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests phase_timer.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+
+#include "src/base/phase_timer.h"
+
+namespace xLearn {
+
+TEST(PhaseTimerTest, Wall_and_cpu) {
+  PhaseTime time;
+  {
+    ScopedPhase phase(&time);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_EQ(time.count, 1);
+  EXPECT_GE(time.wall, 0.015);
+  // Sleeping does not use the CPU
+  EXPECT_LT(time.cpu, time.wall);
+  // The busy loop uses the CPU
+  double wall = time.wall;
+  {
+    ScopedPhase phase(&time);
+    volatile double sum = 0;
+    double start = ProcessCpuSeconds();
+    while (ProcessCpuSeconds() - start < 0.02) { sum += 1; }
+  }
+  EXPECT_EQ(time.count, 2);
+  EXPECT_GT(time.wall, wall);
+  EXPECT_GE(time.cpu, 0.015);
+  time.Reset();
+  EXPECT_EQ(time.count, 0);
+  EXPECT_EQ(time.wall, 0);
+}
+
+TEST(PhaseTimerTest, Stop) {
+  PhaseTime time;
+  {
+    ScopedPhase phase(&time);
+    phase.Stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_EQ(time.count, 1);
+  EXPECT_LT(time.wall, 0.015);
+  // Nothing is timed
+  ScopedPhase phase(nullptr);
+  phase.Stop();
+}
+
+}  // namespace xLearn
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the parallel radix sort of the 64-bit keys,
+which is used by the exact AUC (see metric.h).
+*/
+
+#ifndef XLEARN_BASE_RADIX_SORT_H_
+#define XLEARN_BASE_RADIX_SORT_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+
+namespace xLearn {
+
+// Map the float to a key that has the same order as the
+// float when compared as an unsigned integer.
+inline uint32 FloatSortKey(float x) {
+  uint32 i;
+  memcpy(&i, &x, sizeof(i));
+  return (i & 0x80000000u) ? ~i : (i | 0x80000000u);
+}
+
+// The float of the key given by FloatSortKey().
+inline float FloatFromSortKey(uint32 key) {
+  uint32 i = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+  float x;
+  memcpy(&x, &i, sizeof(x));
+  return x;
+}
+
+//------------------------------------------------------------------------------
+// RadixSort() sorts the keys by their low num_bits bits, using the LSD
+// radix sort with 11-bit digits. Each pass splits the keys into one
+// range for each thread, which counts the digits of its range, and then
+// writes its keys to the offsets given by the prefix sum of all the
+// counts. The ranges are in order, so the sort is stable. The tmp
+// buffer is resized to keys->size(), and it can be reused by the next
+// call. The pool can be nullptr, and then it runs in current thread:
+//
+//   std::vector<uint64> keys, tmp;
+//   ... 
+//   RadixSort(&keys, &tmp, 33, pool);
+//------------------------------------------------------------------------------
+inline void RadixSort(std::vector<uint64>* keys,
+                      std::vector<uint64>* tmp,
+                      int num_bits,
+                      ThreadPool* pool) {
+  CHECK_NOTNULL(keys);
+  CHECK_NOTNULL(tmp);
+  CHECK_GT(num_bits, 0);
+  CHECK_LE(num_bits, 64);
+  static const int kDigitBits = 11;
+  static const size_t kNumDigits = 1 << kDigitBits;
+  // A thread sorts this number of keys at least
+  static const size_t kMinKeys = 1 << 16;
+  size_t n = keys->size();
+  if (n <= 1) { return; }
+  tmp->resize(n);
+  size_t num_ranges = 1;
+  if (pool != nullptr) {
+    num_ranges = std::min(pool->ThreadNumber(), n / kMinKeys);
+    num_ranges = std::max<size_t>(num_ranges, 1);
+  }
+  size_t range = (n + num_ranges - 1) / num_ranges;
+  // count[r * kNumDigits + d] is the count and then the offset
+  // of the digit d in the range r
+  std::vector<size_t> count(num_ranges * kNumDigits);
+  uint64* src = keys->data();
+  uint64* dst = tmp->data();
+  for (int shift = 0; shift < num_bits; shift += kDigitBits) {
+    std::fill(count.begin(), count.end(), 0);
+    // The last digit can be shorter
+    int bits = num_bits - shift < kDigitBits ? num_bits - shift : kDigitBits;
+    uint64 mask = (1ULL << bits) - 1;
+    auto run = [&](void (*fn)(const uint64*, uint64*, size_t*,
+                              size_t, size_t, int, uint64)) {
+      auto body = [&](size_t r) {
+        size_t begin = std::min(r * range, n);
+        size_t end = std::min(begin + range, n);
+        fn(src, dst, &count[r * kNumDigits], begin, end, shift, mask);
+      };
+      if (num_ranges == 1) {
+        body(0);
+      } else {
+        pool->ParallelFor(0, num_ranges, 1,
+          [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r) { body(r); }
+          });
+      }
+    };
+    // Count the digits
+    run([](const uint64* src, uint64*, size_t* cnt,
+           size_t begin, size_t end, int shift, uint64 mask) {
+      for (size_t i = begin; i < end; ++i) {
+        cnt[(src[i] >> shift) & mask]++;
+      }
+    });
+    // The offsets are ordered by digit first and then by range
+    size_t offset = 0;
+    for (size_t d = 0; d < kNumDigits; ++d) {
+      for (size_t r = 0; r < num_ranges; ++r) {
+        size_t c = count[r * kNumDigits + d];
+        count[r * kNumDigits + d] = offset;
+        offset += c;
+      }
+    }
+    // Scatter the keys
+    run([](const uint64* src, uint64* dst, size_t* off,
+           size_t begin, size_t end, int shift, uint64 mask) {
+      for (size_t i = begin; i < end; ++i) {
+        dst[off[(src[i] >> shift) & mask]++] = src[i];
+      }
+    });
+    std::swap(src, dst);
+  }
+  // The result is in tmp after an odd number of passes
+  if (src != keys->data()) { keys->swap(*tmp); }
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_RADIX_SORT_H_
@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests radix_sort.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "src/base/radix_sort.h"
+#include "src/base/thread_pool.h"
+
+namespace xLearn {
+
+// A simple random number generator
+uint64 next_key(uint64* state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return *state >> 11;
+}
+
+TEST(RadixSortTest, Float_key) {
+  std::vector<float> values = { -1e30, -2.5, -1e-30, -0.0, 0.0,
+                                 1e-30, 0.5, 2.5, 1e30 };
+  for (size_t i = 1; i < values.size(); ++i) {
+    EXPECT_LE(FloatSortKey(values[i-1]), FloatSortKey(values[i]));
+    if (values[i-1] < values[i]) {
+      EXPECT_LT(FloatSortKey(values[i-1]), FloatSortKey(values[i]));
+    }
+  }
+}
+
+TEST(RadixSortTest, Sort) {
+  ThreadPool pool(4);
+  std::vector<uint64> tmp;
+  uint64 state = 1;
+  // Even and odd numbers of passes, in one and many threads
+  for (int num_bits : {11, 22, 33, 53}) {
+    for (size_t n : {0, 1, 100, 300000}) {
+      std::vector<uint64> keys(n);
+      for (size_t i = 0; i < n; ++i) {
+        keys[i] = next_key(&state) & ((1ULL << num_bits) - 1);
+      }
+      std::vector<uint64> expect(keys);
+      std::sort(expect.begin(), expect.end());
+      std::vector<uint64> single(keys);
+      RadixSort(&keys, &tmp, num_bits, &pool);
+      EXPECT_EQ(keys, expect);
+      RadixSort(&single, &tmp, num_bits, nullptr);
+      EXPECT_EQ(single, expect);
+    }
+  }
+}
+
+TEST(RadixSortTest, Low_bits) {
+  // Only the low bits are sorted, and the sort is stable
+  std::vector<uint64> keys = { 0x301, 0x100, 0x201, 0x400 };
+  std::vector<uint64> tmp;
+  RadixSort(&keys, &tmp, 8, nullptr);
+  std::vector<uint64> expect = { 0x100, 0x400, 0x301, 0x201 };
+  EXPECT_EQ(keys, expect);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ScratchBuffer class, which is used to hold
+the per-row temporaries in the hot loops of training.
+*/
+
+#ifndef XLEARN_BASE_SCRATCH_BUFFER_H_
+#define XLEARN_BASE_SCRATCH_BUFFER_H_
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// ScratchBuffer is a growable buffer aligned to the cache line. It only
+// grows, and hence after the first few rows there is no more malloc and
+// free in the loop. It is not thread-safe, so the common usage is to give
+// each worker thread its own buffer:
+//
+//   static thread_local ScratchBuffer<real_t> buffer;
+//   real_t* sum = buffer.GetZero(aligned_k);
+//
+// T must be a POD type.
+//------------------------------------------------------------------------------
+template <typename T>
+class ScratchBuffer {
+ public:
+  // Constructor and Destructor
+  ScratchBuffer() : data_(nullptr), capacity_(0) { }
+  ~ScratchBuffer() { release(); }
+
+  // Return a buffer of at least n elements.
+  // Note that the content is not initialized.
+  T* Get(size_t n) {
+    if (n > capacity_) {
+      reserve(n > capacity_ * 2 ? n : capacity_ * 2);
+    }
+    return data_;
+  }
+
+  // Return a buffer of at least n elements, in which
+  // the first n elements are set to zero.
+  T* GetZero(size_t n) {
+    T* ptr = Get(n);
+    if (n > 0) {
+      memset(ptr, 0, n * sizeof(T));
+    }
+    return ptr;
+  }
+
+  // Number of elements can be used without growing.
+  size_t Capacity() const { return capacity_; }
+
+ protected:
+  static const size_t kAlignment = 64;
+
+  T* data_;
+  size_t capacity_;
+
+  void reserve(size_t n) {
+    release();
+    size_t bytes = n * sizeof(T);
+#ifdef _MSC_VER
+    data_ = static_cast<T*>(_aligned_malloc(bytes, kAlignment));
+    CHECK(data_ != nullptr);
+#else
+    int ret = posix_memalign(reinterpret_cast<void**>(&data_),
+                             kAlignment, bytes);
+    CHECK_EQ(ret, 0);
+#endif
+    capacity_ = n;
+  }
+
+  void release() {
+    if (data_ != nullptr) {
+#ifdef _MSC_VER
+      _aligned_free(data_);
+#else
+      free(data_);
+#endif
+    }
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScratchBuffer);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_SCRATCH_BUFFER_H_
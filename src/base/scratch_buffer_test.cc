@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests scratch_buffer.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdint.h>
+
+#include "src/base/scratch_buffer.h"
+
+namespace xLearn {
+
+TEST(ScratchBufferTest, Get_and_grow) {
+  ScratchBuffer<float> buffer;
+  EXPECT_EQ(buffer.Capacity(), 0);
+  float* ptr = buffer.Get(10);
+  EXPECT_EQ(buffer.Capacity(), 10);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 64, 0);
+  // Does not shrink or re-allocate for a smaller size
+  EXPECT_EQ(buffer.Get(5), ptr);
+  EXPECT_EQ(buffer.Capacity(), 10);
+  // Grow at least twice
+  ptr = buffer.Get(11);
+  EXPECT_EQ(buffer.Capacity(), 20);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 64, 0);
+  buffer.Get(100);
+  EXPECT_EQ(buffer.Capacity(), 100);
+}
+
+TEST(ScratchBufferTest, GetZero) {
+  ScratchBuffer<float> buffer;
+  float* ptr = buffer.Get(16);
+  for (int i = 0; i < 16; ++i) {
+    ptr[i] = i + 1;
+  }
+  ptr = buffer.GetZero(8);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_FLOAT_EQ(ptr[i], 0);
+  }
+  EXPECT_FLOAT_EQ(ptr[8], 9);
+}
+
+}  // namespace xLearn
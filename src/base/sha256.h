@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file provides SHA-256 and HMAC-SHA256, which sign the
+requests of the object storage (see remote_file.h).
+*/
+
+#ifndef XLEARN_BASE_SHA256_H_
+#define XLEARN_BASE_SHA256_H_
+
+#include <string.h>
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The digests are the 32 raw bytes, and HexString() gives the
+// lower-case hex of them:
+//
+//   std::string digest = Sha256("abc");
+//   std::string hex = HexString(Sha256("abc"));   /* "ba7816bf..." */
+//   std::string mac = HmacSha256("key", "message");
+//------------------------------------------------------------------------------
+
+static const size_t kSha256Bytes = 32;
+
+namespace sha256_internal {
+
+static const uint32 kRound[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32 rotr(uint32 x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// Add the 64-byte block to the state
+inline void transform(uint32* state, const uint8* block) {
+  uint32 w[64];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = ((uint32)block[i*4] << 24) | ((uint32)block[i*4+1] << 16) |
+           ((uint32)block[i*4+2] << 8) | block[i*4+3];
+  }
+  for (int i = 16; i < 64; ++i) {
+    uint32 s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+    uint32 s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+  uint32 a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32 e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 64; ++i) {
+    uint32 s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    uint32 ch = (e & f) ^ (~e & g);
+    uint32 t1 = h + s1 + ch + kRound[i] + w[i];
+    uint32 s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    uint32 maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32 t2 = s0 + maj;
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+}  // namespace sha256_internal
+
+// Return the SHA-256 digest of the data.
+inline std::string Sha256(const std::string& data) {
+  uint32 state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+  size_t size = data.size();
+  const uint8* p = (const uint8*)data.data();
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    sha256_internal::transform(state, p + i);
+  }
+  // The rest, 0x80, the zeros and the bit length
+  uint8 tail[128];
+  size_t rest = size - i;
+  memcpy(tail, p + i, rest);
+  tail[rest] = 0x80;
+  size_t len = rest + 1 + 8 <= 64 ? 64 : 128;
+  memset(tail + rest + 1, 0, len - rest - 1);
+  uint64 bits = (uint64)size * 8;
+  for (int j = 0; j < 8; ++j) {
+    tail[len-1-j] = (uint8)(bits >> (j * 8));
+  }
+  sha256_internal::transform(state, tail);
+  if (len == 128) { sha256_internal::transform(state, tail + 64); }
+  std::string digest(kSha256Bytes, '\0');
+  for (int j = 0; j < 8; ++j) {
+    digest[j*4] = (char)(state[j] >> 24);
+    digest[j*4+1] = (char)(state[j] >> 16);
+    digest[j*4+2] = (char)(state[j] >> 8);
+    digest[j*4+3] = (char)state[j];
+  }
+  return digest;
+}
+
+// Return the HMAC-SHA256 of the message with the key.
+inline std::string HmacSha256(const std::string& key,
+                              const std::string& message) {
+  std::string block = key.size() > 64 ? Sha256(key) : key;
+  block.resize(64, '\0');
+  std::string inner(64, '\0'), outer(64, '\0');
+  for (int i = 0; i < 64; ++i) {
+    inner[i] = block[i] ^ 0x36;
+    outer[i] = block[i] ^ 0x5c;
+  }
+  return Sha256(outer + Sha256(inner + message));
+}
+
+// Return the lower-case hex of the bytes.
+inline std::string HexString(const std::string& bytes) {
+  static const char* kHex = "0123456789abcdef";
+  std::string hex(bytes.size() * 2, '0');
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    hex[i*2] = kHex[(uint8)bytes[i] >> 4];
+    hex[i*2+1] = kHex[(uint8)bytes[i] & 15];
+  }
+  return hex;
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_SHA256_H_
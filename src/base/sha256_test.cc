@@ -0,0 +1,51 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests sha256.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "src/base/sha256.h"
+
+namespace xLearn {
+
+TEST(Sha256Test, Digest) {
+  EXPECT_EQ(HexString(Sha256("")),
+   "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(HexString(Sha256("abc")),
+   "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  // The padding takes another block
+  EXPECT_EQ(HexString(Sha256(
+   "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")),
+   "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+  EXPECT_EQ(HexString(Sha256(std::string(1000000, 'a'))),
+   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST(Sha256Test, Hmac) {
+  EXPECT_EQ(HexString(HmacSha256("Jefe", "what do ya want for nothing?")),
+   "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+  // The key longer than a block is hashed first
+  EXPECT_EQ(HexString(HmacSha256(std::string(131, '\xaa'),
+   "Test Using Larger Than Block-Size Key - Hash Key First")),
+   "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+}
+
+}  // namespace xLearn
@@ -0,0 +1,250 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of StatsRegistry.
+*/
+
+#include "src/base/stats_registry.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+const int StatHistogram::kNumBucket;
+
+double StatHistogram::Bound(int i) {
+  static const double kSteps[3] = { 1.0, 2.5, 5.0 };
+  double bound = kSteps[i % 3];
+  for (int p = i / 3; p > 0; --p) { bound *= 10; }
+  return bound * 1e-5;
+}
+
+void StatHistogram::Observe(double seconds) {
+  if (seconds < 0) { seconds = 0; }
+  int i = 0;
+  while (i < kNumBucket && seconds > Bound(i)) { ++i; }
+  count_[i].fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add((uint64)(seconds * 1e9), std::memory_order_relaxed);
+}
+
+uint64 StatHistogram::Count() const {
+  uint64 count = 0;
+  for (int i = 0; i <= kNumBucket; ++i) { count += BucketCount(i); }
+  return count;
+}
+
+const int LatencyHistogram::kNumBucket;
+
+int LatencyHistogram::Index(uint64 ns) {
+  if (ns < kSubBucket) { return (int)ns; }
+  if (ns >> kMaxBits) { return kNumBucket - 1; }
+  // The position of the highest bit
+  int bit = 0;
+  for (int step = 32; step > 0; step /= 2) {
+    if (ns >> (bit + step)) { bit += step; }
+  }
+  int group = bit - kSubBits + 1;
+  int sub = (int)(ns >> (bit - kSubBits)) - kSubBucket;
+  return group * kSubBucket + sub;
+}
+
+uint64 LatencyHistogram::Lower(int i) {
+  if (i < kSubBucket) { return i; }
+  int group = i / kSubBucket;
+  uint64 sub = i % kSubBucket;
+  return (kSubBucket + sub) << (group - 1);
+}
+
+void LatencyHistogram::Record(uint64 ns) {
+  count_[Index(ns)].fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+  uint64 max = max_ns_.load(std::memory_order_relaxed);
+  while (ns > max && !max_ns_.compare_exchange_weak(
+             max, ns, std::memory_order_relaxed)) { }
+}
+
+void LatencyHistogram::Merge(LatencyHistogram* other, bool take) {
+  CHECK_NOTNULL(other);
+  for (int i = 0; i < kNumBucket; ++i) {
+    uint64 n = take ?
+        other->count_[i].exchange(0, std::memory_order_relaxed) :
+        other->count_[i].load(std::memory_order_relaxed);
+    if (n > 0) { count_[i].fetch_add(n, std::memory_order_relaxed); }
+  }
+  uint64 sum = take ?
+      other->sum_ns_.exchange(0, std::memory_order_relaxed) :
+      other->sum_ns_.load(std::memory_order_relaxed);
+  sum_ns_.fetch_add(sum, std::memory_order_relaxed);
+  uint64 max = take ?
+      other->max_ns_.exchange(0, std::memory_order_relaxed) :
+      other->max_ns_.load(std::memory_order_relaxed);
+  uint64 cur = max_ns_.load(std::memory_order_relaxed);
+  while (max > cur && !max_ns_.compare_exchange_weak(
+             cur, max, std::memory_order_relaxed)) { }
+}
+
+void LatencyHistogram::Reset() {
+  for (int i = 0; i < kNumBucket; ++i) {
+    count_[i].store(0, std::memory_order_relaxed);
+  }
+  sum_ns_.store(0, std::memory_order_relaxed);
+  max_ns_.store(0, std::memory_order_relaxed);
+}
+
+uint64 LatencyHistogram::Count() const {
+  uint64 count = 0;
+  for (int i = 0; i < kNumBucket; ++i) { count += BucketCount(i); }
+  return count;
+}
+
+double LatencyHistogram::Mean() const {
+  uint64 count = Count();
+  if (count == 0) { return 0; }
+  return (double)sum_ns_.load(std::memory_order_relaxed) / count;
+}
+
+uint64 LatencyHistogram::Quantile(double q) const {
+  uint64 count = Count();
+  if (count == 0) { return 0; }
+  if (q < 0) { q = 0; }
+  if (q > 1) { q = 1; }
+  // The rank of the event of the quantile, from 1 to count
+  uint64 rank = (uint64)std::ceil(q * count);
+  if (rank == 0) { rank = 1; }
+  uint64 seen = 0;
+  int i = 0;
+  for (; i < kNumBucket - 1; ++i) {
+    seen += BucketCount(i);
+    if (seen >= rank) { break; }
+  }
+  return std::min(Upper(i), std::max(Max(), Lower(i)));
+}
+
+StatsRegistry::Series* StatsRegistry::get_series(const std::string& name,
+                                                 const std::string& help,
+                                                 const std::string& labels,
+                                                 Type type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family* family = nullptr;
+  for (size_t i = 0; i < families_.size(); ++i) {
+    if (families_[i]->name == name) {
+      family = families_[i].get();
+      break;
+    }
+  }
+  if (family == nullptr) {
+    families_.emplace_back(new Family);
+    family = families_.back().get();
+    family->name = name;
+    family->help = help;
+    family->type = type;
+  }
+  CHECK_EQ(family->type, type);
+  for (size_t i = 0; i < family->series.size(); ++i) {
+    if (family->series[i]->labels == labels) {
+      return family->series[i].get();
+    }
+  }
+  family->series.emplace_back(new Series);
+  Series* series = family->series.back().get();
+  series->labels = labels;
+  series->scale = 1.0;
+  switch (type) {
+    case kCounter: series->counter.reset(new StatCounter); break;
+    case kGauge: series->gauge.reset(new StatGauge); break;
+    case kHistogram: series->histogram.reset(new StatHistogram); break;
+  }
+  return series;
+}
+
+StatCounter* StatsRegistry::GetCounter(const std::string& name,
+                                       const std::string& help,
+                                       const std::string& labels,
+                                       double scale) {
+  Series* series = get_series(name, help, labels, kCounter);
+  series->scale = scale;
+  return series->counter.get();
+}
+
+StatGauge* StatsRegistry::GetGauge(const std::string& name,
+                                   const std::string& help,
+                                   const std::string& labels) {
+  return get_series(name, help, labels, kGauge)->gauge.get();
+}
+
+StatHistogram* StatsRegistry::GetHistogram(const std::string& name,
+                                           const std::string& help,
+                                           const std::string& labels) {
+  return get_series(name, help, labels, kHistogram)->histogram.get();
+}
+
+// The labels of a series in braces, with the extra label (e.g.,
+// the le of a bucket), or an empty string without any label.
+static std::string braces(const std::string& labels,
+                          const std::string& extra = "") {
+  if (labels.empty() && extra.empty()) { return ""; }
+  if (labels.empty()) { return "{" + extra + "}"; }
+  if (extra.empty()) { return "{" + labels + "}"; }
+  return "{" + labels + "," + extra + "}";
+}
+
+std::string StatsRegistry::Export() {
+  static const char* kTypes[3] = { "counter", "gauge", "histogram" };
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string text;
+  for (size_t f = 0; f < families_.size(); ++f) {
+    const Family& family = *families_[f];
+    text += StringPrintf("# HELP %s %s\n# TYPE %s %s\n",
+                         family.name.c_str(), family.help.c_str(),
+                         family.name.c_str(), kTypes[family.type]);
+    for (size_t s = 0; s < family.series.size(); ++s) {
+      const Series& series = *family.series[s];
+      const char* name = family.name.c_str();
+      std::string labels = braces(series.labels);
+      if (family.type == kCounter) {
+        text += StringPrintf("%s%s %.9g\n", name, labels.c_str(),
+                             series.counter->Value() * series.scale);
+      } else if (family.type == kGauge) {
+        text += StringPrintf("%s%s %.9g\n", name, labels.c_str(),
+                             series.gauge->Value());
+      } else {
+        // The buckets of Prometheus are cumulative
+        const StatHistogram& histogram = *series.histogram;
+        uint64 count = 0;
+        for (int i = 0; i <= StatHistogram::kNumBucket; ++i) {
+          count += histogram.BucketCount(i);
+          std::string le = i < StatHistogram::kNumBucket ?
+              StringPrintf("le=\"%g\"", StatHistogram::Bound(i)) :
+              std::string("le=\"+Inf\"");
+          text += StringPrintf("%s_bucket%s %llu\n", name,
+                               braces(series.labels, le).c_str(),
+                               (unsigned long long)count);
+        }
+        text += StringPrintf("%s_sum%s %.9g\n%s_count%s %llu\n",
+                             name, labels.c_str(), histogram.Sum(),
+                             name, labels.c_str(),
+                             (unsigned long long)count);
+      }
+    }
+  }
+  return text;
+}
+
+}  // namespace xLearn
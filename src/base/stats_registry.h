@@ -0,0 +1,241 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the StatsRegistry class, which keeps the counters,
+the gauges and the histograms of a long-running process and exports
+them in the Prometheus text format.
+*/
+
+#ifndef XLEARN_BASE_STATS_REGISTRY_H_
+#define XLEARN_BASE_STATS_REGISTRY_H_
+
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// A counter only goes up, e.g., the number of the trained rows. The
+// value is exported times the scale of the registry (see GetCounter),
+// so the nanoseconds can be added as integers and shown as seconds.
+class StatCounter {
+ public:
+  StatCounter() { }
+
+  void Add(uint64 n) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64 Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64> value_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(StatCounter);
+};
+
+// A gauge is a value that can go up and down, e.g., the bytes of
+// the model, which is set by the owner of the value.
+class StatGauge {
+ public:
+  StatGauge() { }
+
+  void Set(double value) {
+    uint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits_.store(bits, std::memory_order_relaxed);
+  }
+  double Value() const {
+    uint64 bits = bits_.load(std::memory_order_relaxed);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+ private:
+  std::atomic<uint64> bits_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(StatGauge);
+};
+
+// A histogram of the seconds of the events, e.g., the latency of the
+// predictions, whose buckets are fixed from 10us to 10s (1, 2.5, 5
+// of each power of ten). The count of each bucket and the sum are
+// atomic, so an event costs a few relaxed adds.
+class StatHistogram {
+ public:
+  StatHistogram() { }
+
+  static const int kNumBucket = 19;
+
+  // The upper bound (in seconds) of the i-th bucket.
+  static double Bound(int i);
+
+  // Add an event of the seconds.
+  void Observe(double seconds);
+
+  // The number of the events of the i-th bucket (not cumulative),
+  // where the last one (kNumBucket) is +Inf.
+  uint64 BucketCount(int i) const {
+    return count_[i].load(std::memory_order_relaxed);
+  }
+  uint64 Count() const;
+  double Sum() const {
+    return sum_ns_.load(std::memory_order_relaxed) * 1e-9;
+  }
+
+ private:
+  std::atomic<uint64> count_[kNumBucket + 1] = { };
+  std::atomic<uint64> sum_ns_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(StatHistogram);
+};
+
+// A histogram of the latency in nanoseconds with the buckets of
+// HdrHistogram: each power of two is split into kSubBucket linear
+// buckets, so a quantile is within 1/kSubBucket (6%) of the event
+// from 1ns to 2^kMaxBits ns (18 minutes), which is fine enough for
+// the p99 and p999 of the small requests. The longer events are in
+// the last bucket. As StatHistogram, an event costs a few relaxed
+// adds, and the histogram can be read and reset by another thread
+// while it is updated (see Merge).
+class LatencyHistogram {
+ public:
+  LatencyHistogram() { }
+
+  static const int kSubBits = 4;
+  static const int kSubBucket = 1 << kSubBits;
+  static const int kMaxBits = 40;
+  static const int kNumBucket = (kMaxBits - kSubBits + 1) * kSubBucket;
+
+  // The bucket of the nanoseconds, and the smallest and the largest
+  // nanoseconds of the i-th bucket.
+  static int Index(uint64 ns);
+  static uint64 Lower(int i);
+  static uint64 Upper(int i) { return Lower(i + 1) - 1; }
+
+  // Add an event of the nanoseconds or the seconds.
+  void Record(uint64 ns);
+  void RecordSeconds(double seconds) {
+    Record(seconds <= 0 ? 0 : (uint64)(seconds * 1e9));
+  }
+
+  // Add the events of the other histogram. If take is true, they are
+  // removed from it bucket by bucket, so an event recorded at the same
+  // time is either taken or left for the next interval, but not lost.
+  void Merge(LatencyHistogram* other, bool take);
+
+  // Remove all the events.
+  void Reset();
+
+  uint64 BucketCount(int i) const {
+    return count_[i].load(std::memory_order_relaxed);
+  }
+  uint64 Count() const;
+  uint64 Max() const { return max_ns_.load(std::memory_order_relaxed); }
+  // The mean nanoseconds, or 0 without any event.
+  double Mean() const;
+
+  // The nanoseconds of the quantile q in [0, 1], which is the largest
+  // value of its bucket (but not larger than Max()), or 0 without any
+  // event, e.g., Quantile(0.99) is the p99.
+  uint64 Quantile(double q) const;
+
+ private:
+  std::atomic<uint64> count_[kNumBucket] = { };
+  std::atomic<uint64> sum_ns_{0};
+  std::atomic<uint64> max_ns_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+//------------------------------------------------------------------------------
+// StatsRegistry owns the counters, the gauges and the histograms of a
+// process. Each one is named by a Prometheus name and the labels of the
+// series, and it is created by the first call of its name and labels.
+// The returned pointers are valid until the registry is deleted, so the
+// worker threads keep them and update the values without any lock, and
+// only the creation and Export() hold the mutex of the registry:
+//
+//   StatsRegistry stats;
+//   StatCounter* rows = stats.GetCounter("xlearn_train_rows_total",
+//                                        "Rows trained.");
+//   StatHistogram* latency = stats.GetHistogram(
+//       "xlearn_predict_seconds", "Latency of the predictions.");
+//   rows->Add(matrix->row_length);
+//   latency->Observe(seconds);
+//   std::string text = stats.Export();
+//
+// The labels are given as the text in the braces, e.g., phase="read".
+// The series of a name must have the same type.
+//------------------------------------------------------------------------------
+class StatsRegistry {
+ public:
+  // Constructor and Destructor
+  StatsRegistry() { }
+  ~StatsRegistry() { }
+
+  StatCounter* GetCounter(const std::string& name,
+                          const std::string& help,
+                          const std::string& labels = "",
+                          double scale = 1.0);
+  StatGauge* GetGauge(const std::string& name,
+                      const std::string& help,
+                      const std::string& labels = "");
+  StatHistogram* GetHistogram(const std::string& name,
+                              const std::string& help,
+                              const std::string& labels = "");
+
+  // Return all the series in the Prometheus text format (0.0.4),
+  // where the series of a name are in the order of their creation.
+  std::string Export();
+
+ protected:
+  enum Type { kCounter, kGauge, kHistogram };
+  struct Series {
+    std::string labels;
+    double scale;
+    std::unique_ptr<StatCounter> counter;
+    std::unique_ptr<StatGauge> gauge;
+    std::unique_ptr<StatHistogram> histogram;
+  };
+  struct Family {
+    std::string name;
+    std::string help;
+    Type type;
+    std::vector<std::unique_ptr<Series>> series;
+  };
+  std::vector<std::unique_ptr<Family>> families_;
+  std::mutex mutex_;
+
+  // Return the series of the name and the labels,
+  // which is added if it does not exist.
+  Series* get_series(const std::string& name,
+                     const std::string& help,
+                     const std::string& labels,
+                     Type type);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StatsRegistry);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_STATS_REGISTRY_H_
@@ -0,0 +1,135 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests stats_registry.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/stats_registry.h"
+
+namespace xLearn {
+
+TEST(StatsRegistryTest, Counter_from_threads) {
+  StatsRegistry stats;
+  StatCounter* rows = stats.GetCounter("rows_total", "Rows.");
+  EXPECT_EQ(stats.GetCounter("rows_total", "Rows."), rows);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::thread([rows]() {
+      for (int i = 0; i < 10000; ++i) { rows->Add(2); }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) { threads[t].join(); }
+  EXPECT_EQ(rows->Value(), 80000);
+}
+
+TEST(StatsRegistryTest, Export) {
+  StatsRegistry stats;
+  stats.GetCounter("phase_seconds_total", "Seconds of the phases.",
+                   "phase=\"read\"", 1e-9)->Add(1500000000ULL);
+  stats.GetCounter("phase_seconds_total", "Seconds of the phases.",
+                   "phase=\"grad\"", 1e-9)->Add(250000000ULL);
+  stats.GetGauge("model_bytes", "Bytes of the model.")->Set(4096);
+  std::string text = stats.Export();
+  EXPECT_EQ(text,
+            "# HELP phase_seconds_total Seconds of the phases.\n"
+            "# TYPE phase_seconds_total counter\n"
+            "phase_seconds_total{phase=\"read\"} 1.5\n"
+            "phase_seconds_total{phase=\"grad\"} 0.25\n"
+            "# HELP model_bytes Bytes of the model.\n"
+            "# TYPE model_bytes gauge\n"
+            "model_bytes 4096\n");
+}
+
+TEST(StatsRegistryTest, Histogram) {
+  EXPECT_DOUBLE_EQ(StatHistogram::Bound(0), 1e-5);
+  EXPECT_DOUBLE_EQ(StatHistogram::Bound(1), 2.5e-5);
+  EXPECT_DOUBLE_EQ(StatHistogram::Bound(5), 5e-4);
+  EXPECT_DOUBLE_EQ(StatHistogram::Bound(StatHistogram::kNumBucket - 1), 10);
+  StatsRegistry stats;
+  StatHistogram* latency = stats.GetHistogram("latency_seconds", "Latency.");
+  latency->Observe(1e-5);
+  latency->Observe(3e-5);
+  latency->Observe(100);
+  EXPECT_EQ(latency->BucketCount(0), 1);
+  EXPECT_EQ(latency->BucketCount(2), 1);
+  EXPECT_EQ(latency->BucketCount(StatHistogram::kNumBucket), 1);
+  EXPECT_EQ(latency->Count(), 3);
+  EXPECT_NEAR(latency->Sum(), 100.00004, 1e-6);
+  std::string text = stats.Export();
+  EXPECT_NE(text.find("# TYPE latency_seconds histogram\n"), std::string::npos);
+  // The buckets are cumulative
+  EXPECT_NE(text.find("latency_seconds_bucket{le=\"1e-05\"} 1\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("latency_seconds_bucket{le=\"2.5e-05\"} 1\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("latency_seconds_bucket{le=\"5e-05\"} 2\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("latency_seconds_bucket{le=\"10\"} 2\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("latency_seconds_bucket{le=\"+Inf\"} 3\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("latency_seconds_count 3\n"), std::string::npos);
+}
+
+TEST(StatsRegistryTest, LatencyHistogram) {
+  // Each bucket is in the range of its index
+  for (uint64 ns : { 0ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456789ULL,
+                     (1ULL << 40) - 1 }) {
+    int i = LatencyHistogram::Index(ns);
+    EXPECT_LE(LatencyHistogram::Lower(i), ns);
+    EXPECT_GE(LatencyHistogram::Upper(i), ns);
+    // Within 1/16 of the value
+    EXPECT_LE(LatencyHistogram::Upper(i) - LatencyHistogram::Lower(i),
+              ns / 16);
+  }
+  EXPECT_EQ(LatencyHistogram::Index(1ULL << 50),
+            LatencyHistogram::kNumBucket - 1);
+  LatencyHistogram latency;
+  EXPECT_EQ(latency.Quantile(0.99), 0);
+  // 1us to 1ms
+  for (uint64 us = 1; us <= 1000; ++us) { latency.Record(us * 1000); }
+  EXPECT_EQ(latency.Count(), 1000);
+  EXPECT_EQ(latency.Max(), 1000000);
+  EXPECT_DOUBLE_EQ(latency.Mean(), 500500);
+  EXPECT_NEAR(latency.Quantile(0.5), 500000, 500000 / 16);
+  EXPECT_NEAR(latency.Quantile(0.99), 990000, 990000 / 16);
+  EXPECT_EQ(latency.Quantile(1.0), 1000000);
+  EXPECT_NEAR(latency.Quantile(0), 1000, 1000 / 16);
+  // The events are taken by the snapshot of the interval
+  LatencyHistogram snapshot;
+  snapshot.Merge(&latency, false);
+  EXPECT_EQ(snapshot.Count(), 1000);
+  EXPECT_EQ(latency.Count(), 1000);
+  snapshot.Merge(&latency, true);
+  EXPECT_EQ(snapshot.Count(), 2000);
+  EXPECT_EQ(snapshot.Max(), 1000000);
+  EXPECT_EQ(latency.Count(), 0);
+  EXPECT_EQ(latency.Max(), 0);
+  latency.RecordSeconds(0.002);
+  EXPECT_EQ(latency.Max(), 2000000);
+  snapshot.Reset();
+  EXPECT_EQ(snapshot.Count(), 0);
+  EXPECT_EQ(snapshot.Mean(), 0);
+}
+
+}  // namespace xLearn
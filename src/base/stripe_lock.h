@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the StripedLock class, which is used by the
+synchronized (not lock-free) training to guard the model parameters.
+*/
+
+#ifndef XLEARN_BASE_STRIPE_LOCK_H_
+#define XLEARN_BASE_STRIPE_LOCK_H_
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// StripedLock is a fixed array of mutexes (stripes), and the key (e.g.,
+// the feature id) is hashed to one stripe by key % num_stripes. A thread
+// locks all the stripes it needs at once, which are sorted first, so two
+// threads never dead-lock however their keys overlap:
+//
+//   std::vector<size_t> stripes;
+//   for (...) { stripes.push_back(lock.Stripe(feat_id)); }
+//   lock.Lock(&stripes);
+//   ... update the model ...
+//   lock.Unlock(stripes);
+//
+// Two different keys can share a stripe, which is only slower.
+//------------------------------------------------------------------------------
+class StripedLock {
+ public:
+  // The number of stripes is rounded up to a power of two.
+  explicit StripedLock(size_t num_stripes = kDefaultStripes) {
+    CHECK_GT(num_stripes, 0);
+    size_t n = 1;
+    while (n < num_stripes) { n <<= 1; }
+    mask_ = n - 1;
+    stripes_.reset(new Slot[n]);
+  }
+  ~StripedLock() { }
+
+  // Number of the stripes.
+  size_t NumStripes() const { return mask_ + 1; }
+
+  // Return the stripe of the key.
+  size_t Stripe(uint64 key) const { return key & mask_; }
+
+  // Sort and unique the stripes, and then lock them in order.
+  void Lock(std::vector<size_t>* stripes) {
+    std::sort(stripes->begin(), stripes->end());
+    stripes->erase(std::unique(stripes->begin(), stripes->end()),
+                   stripes->end());
+    for (size_t i = 0; i < stripes->size(); ++i) {
+      stripes_[(*stripes)[i]].mutex.lock();
+    }
+  }
+
+  // Unlock the stripes given by Lock().
+  void Unlock(const std::vector<size_t>& stripes) {
+    for (size_t i = stripes.size(); i > 0; --i) {
+      stripes_[stripes[i-1]].mutex.unlock();
+    }
+  }
+
+  static const size_t kDefaultStripes = 4096;
+
+ protected:
+  // The padding keeps the mutexes of two stripes
+  // out of the same cache line.
+  struct Slot {
+    std::mutex mutex;
+    char padding[64];
+  };
+
+  std::unique_ptr<Slot[]> stripes_;
+  size_t mask_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StripedLock);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_STRIPE_LOCK_H_
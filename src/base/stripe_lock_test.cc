@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests stripe_lock.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include "src/base/stripe_lock.h"
+
+namespace xLearn {
+
+TEST(StripedLockTest, Num_stripes) {
+  StripedLock lock_default;
+  EXPECT_EQ(lock_default.NumStripes(), StripedLock::kDefaultStripes);
+  StripedLock lock(100);
+  EXPECT_EQ(lock.NumStripes(), 128);
+  EXPECT_EQ(lock.Stripe(3), 3);
+  EXPECT_EQ(lock.Stripe(128 + 3), 3);
+}
+
+TEST(StripedLockTest, Lock_sort_and_unique) {
+  StripedLock lock(8);
+  std::vector<size_t> stripes;
+  stripes.push_back(lock.Stripe(13));
+  stripes.push_back(lock.Stripe(2));
+  stripes.push_back(lock.Stripe(5));
+  lock.Lock(&stripes);
+  ASSERT_EQ(stripes.size(), 2);
+  EXPECT_EQ(stripes[0], 2);
+  EXPECT_EQ(stripes[1], 5);
+  lock.Unlock(stripes);
+  // All the stripes are released
+  lock.Lock(&stripes);
+  lock.Unlock(stripes);
+}
+
+// Every thread adds 1 to all the counters of its keys, which overlap
+// with the other threads in different order. The counters are exact
+// only if the updates are never mixed, and the sorted locking never
+// dead-locks.
+TEST(StripedLockTest, Concurrent_update) {
+  const int kThread = 4;
+  const int kLoop = 20000;
+  const int kKey = 10;
+  StripedLock lock(16);
+  std::vector<int> counter(kKey, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThread; ++t) {
+    threads.push_back(std::thread([&lock, &counter, t]() {
+      std::vector<size_t> stripes;
+      for (int n = 0; n < kLoop; ++n) {
+        stripes.clear();
+        for (int k = 0; k < kKey; ++k) {
+          stripes.push_back(lock.Stripe((k * (t + 1)) % kKey));
+        }
+        lock.Lock(&stripes);
+        for (int k = 0; k < kKey; ++k) {
+          counter[k]++;
+        }
+        lock.Unlock(stripes);
+      }
+    }));
+  }
+  for (int t = 0; t < kThread; ++t) {
+    threads[t].join();
+  }
+  for (int k = 0; k < kKey; ++k) {
+    EXPECT_EQ(counter[k], kThread * kLoop);
+  }
+}
+
+}  // namespace xLearn
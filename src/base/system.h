@@ -47,7 +47,9 @@ std::string get_host_name() {
 // Get user name
 std::string get_user_name() {
   const char* username = getenv("USER");
-  return username != NULL ? username : getenv("USERNAME");
+  if (username == NULL) { username = getenv("USERNAME"); }
+  // Neither is set in some containers
+  return username != NULL ? username : "unknown";
 }
 
 // Get current system time
@@ -22,6 +22,7 @@ thread pool that used by xLearn.
 #ifndef XLEARN_BASE_THREAD_POOL_H_
 #define XLEARN_BASE_THREAD_POOL_H_
 
+#include <algorithm>
 #include <vector>
 #include <queue>
 #include <memory>
@@ -32,8 +33,11 @@ thread pool that used by xLearn.
 #include <functional>
 #include <stdexcept>
 #include <atomic>
+#include <chrono>
 
 #include "src/base/common.h"
+#include "src/base/mem_alloc.h"
+#include "src/base/trace.h"
 
 //------------------------------------------------------------------------------
 // Simple ThreadPool that creates N threads upon its creation,
@@ -46,13 +50,61 @@ thread pool that used by xLearn.
 //   auto result = pool.enqueue([](int answer) { return answer; }, 42);
 //   /* Get result from future*/
 //   std::cout << result.get() << std::endl;
+//
+// For the data-parallel loops, ParallelFor() splits a range into
+// chunks, and runs them in current thread and the idle workers, which
+// steal the chunks from each other, so the uneven chunks are balanced.
+// It does not allocate memory for each chunk:
+//
+//   pool.ParallelFor(0, n, 0, [&](size_t begin, size_t end) {
+//     for (size_t i = begin; i < end; ++i) { ... }
+//   });
+//
+// Sync() waits for a number of enqueued tasks of the whole pool, so
+// two parallel regions cannot overlap. A TaskGroup only counts its own
+// tasks, and hence the regions of different groups can run at the same
+// time, e.g., the validation of a batch and the training of the next:
+//
+//   TaskGroup group(&pool);
+//   for (int i = 0; i < n; ++i) {
+//     group.Run([i]() { ... });
+//   }
+//   group.Wait();
+//
+// If pin_numa is true, the i-th thread is pinned to the NUMA node
+// (i % number of nodes), and the task can get the node of current
+// thread from CurrentNumaNode() (see mem_alloc.h). If cpus is not
+// empty, the i-th thread is pinned to cpus[i % cpus.size()] instead
+// (see GetThreadCpus), and CurrentNumaNode() is the node of the cpu.
+// The thread that calls ParallelFor() is not pinned by the pool.
+//
+// The tasks, the chunks of ParallelFor() and the waits of the callers
+// are the spans of the trace, if it is started (see trace.h).
 //  
 // This class requires a number of c++11 features be present in your compiler.
 //------------------------------------------------------------------------------
+class TaskGroup;
+
+// The statistics of a pool since its construction or ResetStats().
+struct ThreadPoolStats {
+  /* For each worker: the number of the tasks (each ParallelFor()
+  call that it joined is one task), the seconds of running them,
+  the seconds of waiting for the work on the condition, and the
+  seconds of waiting for the lock of the queue */
+  std::vector<uint64_t> tasks;
+  std::vector<double> busy;
+  std::vector<double> idle;
+  std::vector<double> lock_wait;
+  /* Seconds that the callers of ParallelFor() and Sync()
+  waited for the workers after their own work */
+  double caller_wait = 0;
+};
+
 class ThreadPool {
  public:
   // Constructor and Destructor
-  ThreadPool(size_t);
+  ThreadPool(size_t, bool pin_numa = false,
+             const std::vector<int>& cpus = std::vector<int>());
   ~ThreadPool();
 
   // Add task to current queue
@@ -60,17 +112,127 @@ class ThreadPool {
   auto enqueue(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type>;
 
-  // Sync threads
+  // Wait until wait_count tasks of enqueue() are done since the
+  // last call. The tasks of TaskGroup are not counted.
   void Sync(int wait_count);
 
   // Return the number of threads
   size_t ThreadNumber();
 
+  // Run fn(chunk_begin, chunk_end) for all the chunks of [begin, end),
+  // in which each chunk has grain items (the last one can be shorter),
+  // and return after all the chunks are done. Current thread and at most
+  // ThreadNumber()-1 workers run the chunks, so the number of running
+  // threads is the same as enqueue(), and one thread runs the chunks in
+  // order. grain = 0 gives kChunksPerThread chunks for each thread. The
+  // calls from different threads (or from fn) can run at the same time.
+  template <class F>
+  void ParallelFor(size_t begin, size_t end, size_t grain, F&& fn);
+
+  // Same as above, but the i-th chunk is [bounds[i], bounds[i+1]), so
+  // the chunks can have different sizes, e.g., the same amount of work.
+  // The bounds must be sorted, and they are not copied.
+  template <class F>
+  void ParallelFor(const std::vector<size_t>& bounds, F&& fn);
+
+  // Return the chunk size used by ParallelFor() for count items.
+  // With grain = 0, a chunk has min_grain items at least, so the
+  // small work gives fewer chunks, and it runs in current thread
+  // if there is only one chunk.
+  size_t Grain(size_t count, size_t grain, size_t min_grain = 1);
+
+  // Seconds that the callers of ParallelFor() and Sync() have waited
+  // for the workers after their own work, e.g., for the last chunk of
+  // an uneven split, since the last ResetWaitTime().
+  double WaitTime() const { return wait_ns.load() * 1e-9; }
+  void ResetWaitTime() { wait_ns.store(0); }
+
+  // Get the statistics of the workers, which are counted by each
+  // worker without any lock, so the numbers of the running tasks
+  // are added after they are done.
+  void GetStats(ThreadPoolStats* stats) const;
+  void ResetStats();
+
+  static const size_t kChunksPerThread = 4;
+
 private:
+    friend class TaskGroup;
+    // A queued task, which belongs to the group if it is not nullptr
+    struct Task {
+      std::function<void()> fn;
+      TaskGroup* group;
+    };
+    void submit(std::function<void()>&& fn, TaskGroup* group);
+    // Each thread of a ParallelFor() call owns a slot, which keeps
+    // the range [lo, hi) of its chunks in one word (lo << 32 | hi).
+    // The owner pops the chunk at lo, and a thread without chunks
+    // steals the upper half of another slot. Both are done by CAS.
+    struct Slot {
+      std::atomic<uint64_t> range;
+      char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    // A ParallelFor() call, which is on the stack of the caller.
+    struct Bulk {
+      void (*invoke)(void* fn, size_t begin, size_t end);
+      void* fn;
+      Slot* slots;
+      size_t begin;
+      size_t end;
+      size_t grain;
+      const size_t* bounds;  /* nullptr for the chunks of grain items */
+      size_t num_slots;
+      size_t next_slot;  /* guarded by queue_mutex */
+      size_t done;       /* guarded by mutex */
+      std::mutex mutex;
+      std::condition_variable cv;
+    };
+    static uint64_t pack_range(uint64_t lo, uint64_t hi) {
+      return (lo << 32) | hi;
+    }
+    bool pop_chunk(Bulk* bulk, size_t slot, size_t* chunk);
+    bool steal_chunk(Bulk* bulk, size_t slot, size_t* chunk);
+    void run_bulk(Bulk* bulk, size_t slot);
+    static void chunk_range(size_t begin, size_t end, size_t grain,
+                            const size_t* bounds, size_t chunk,
+                            size_t* chunk_begin, size_t* chunk_end) {
+      if (bounds != nullptr) {
+        *chunk_begin = bounds[chunk];
+        *chunk_end = bounds[chunk + 1];
+      } else {
+        *chunk_begin = begin + chunk * grain;
+        *chunk_end = std::min(*chunk_begin + grain, end);
+      }
+    }
+    template <class F>
+    void run_chunks(size_t begin, size_t end, size_t grain,
+                    const size_t* bounds, size_t num_chunks, F& fn);
+    static uint64_t nanoseconds(std::chrono::steady_clock::time_point a,
+                                std::chrono::steady_clock::time_point b) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        b - a).count();
+    }
+    void add_wait(std::chrono::steady_clock::time_point start) {
+      uint64_t ns = nanoseconds(start, std::chrono::steady_clock::now());
+      wait_ns += ns;
+      total_wait_ns += ns;
+    }
+    // The counters of a worker, which are only written by the worker
+    struct Counter {
+      std::atomic<uint64_t> tasks { 0 };
+      std::atomic<uint64_t> busy_ns { 0 };
+      std::atomic<uint64_t> idle_ns { 0 };
+      std::atomic<uint64_t> lock_ns { 0 };
+      char padding[64 - 4 * sizeof(std::atomic<uint64_t>)];
+    };
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+      counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+
     // need to keep track of threads so we can join them
     std::vector<std::thread> workers;
     // the task queue
-    std::queue<std::function<void()>> tasks;
+    std::queue<Task> tasks;
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable condition;
@@ -78,28 +240,139 @@ private:
     std::condition_variable sync_condition;
     bool stop;
     std::atomic_int sync { 0 };
+    std::atomic<uint64_t> wait_ns { 0 };
+    std::atomic<uint64_t> total_wait_ns { 0 };
+    std::unique_ptr<Counter[]> counters;
+    // ParallelFor() calls in progress, guarded by queue_mutex
+    std::vector<Bulk*> bulks;
+};
+
+//------------------------------------------------------------------------------
+// TaskGroup runs its tasks in the pool, and Wait() returns after all of
+// them are done. It waits in the destructor too. Wait() must not be
+// called in a task of the same pool, which could wait for itself.
+//------------------------------------------------------------------------------
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool* pool) : pool_(pool), pending_(0) { }
+  ~TaskGroup() { Wait(); }
+
+  // Add a task of this group to the pool.
+  template <class F>
+  void Run(F&& f) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pending_++;
+    }
+    pool_->submit(std::function<void()>(std::forward<F>(f)), this);
+  }
+
+  // Wait for all the tasks given by Run().
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+ private:
+  friend class ThreadPool;
+
+  // Called by the worker after each task. The notify is done under
+  // the lock, since the group can be destroyed once Wait() returns.
+  void finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (--pending_ == 0) {
+      cv_.notify_all();
+    }
+  }
+
+  ThreadPool* pool_;
+  size_t pending_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
 };
 
 // The constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false) {
-  for(size_t i = 0; i<threads; ++i)
+inline ThreadPool::ThreadPool(size_t threads, bool pin_numa,
+                              const std::vector<int>& cpus)
+    : stop(false), counters(new Counter[threads]) {
+  int num_nodes = pin_numa ? xLearn::GetNumNodes() : 1;
+  for(size_t i = 0; i<threads; ++i) {
+    int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
     workers.emplace_back(
-      [this]
+      [this, pin_numa, num_nodes, cpu, i]
       {
+        if (cpu >= 0) {
+          xLearn::PinThreadToCpu(cpu);
+        } else if (pin_numa) {
+          xLearn::PinThreadToNode(i % num_nodes);
+        }
+        if (xLearn::TraceOn()) {
+          xLearn::SetTraceThreadName("pool worker " + std::to_string(i));
+        }
+        typedef std::chrono::steady_clock Clock;
+        Counter& counter = this->counters[i];
         for(;;) {
-          std::function<void()> task;
+          Task task;
+          Bulk* bulk = nullptr;
+          size_t slot = 0;
           {
+            Clock::time_point lock_start = Clock::now();
             std::unique_lock<std::mutex> lock(this->queue_mutex);
+            Clock::time_point wait_start = Clock::now();
+            // The first ParallelFor() call that has a free slot
+            auto find_bulk = [this]() -> Bulk* {
+              for (size_t b = 0; b < this->bulks.size(); ++b) {
+                if (this->bulks[b]->next_slot < this->bulks[b]->num_slots) {
+                  return this->bulks[b];
+                }
+              }
+              return nullptr;
+            };
             this->condition.wait(lock,
-              [this]{ return this->stop || !this->tasks.empty(); });
-            if (this->stop && this->tasks.empty()) {
-              return;
+              [this, &find_bulk]{
+                return this->stop || !this->tasks.empty() ||
+                       find_bulk() != nullptr;
+              });
+            add(counter.lock_ns, nanoseconds(lock_start, wait_start));
+            add(counter.idle_ns, nanoseconds(wait_start, Clock::now()));
+            // The caller of ParallelFor() is waiting, so it goes first
+            bulk = find_bulk();
+            if (bulk != nullptr) {
+              slot = bulk->next_slot++;
+            } else {
+              if (this->stop && this->tasks.empty()) {
+                return;
+              }
+              task = std::move(this->tasks.front());
+              this->tasks.pop();
             }
-            task = std::move(this->tasks.front());
-            this->tasks.pop();
           }
-          task();
+          Clock::time_point busy_start = Clock::now();
+          if (bulk != nullptr) {
+            {
+              xLearn::TraceSpan span("parallel_for", "pool");
+              run_bulk(bulk, slot);
+            }
+            add(counter.tasks, 1);
+            add(counter.busy_ns, nanoseconds(busy_start, Clock::now()));
+            std::unique_lock<std::mutex> lock(bulk->mutex);
+            bulk->done++;
+            bulk->cv.notify_one();
+            continue;
+          }
+          {
+            xLearn::TraceSpan span("task", "pool");
+            task.fn();
+          }
+          add(counter.tasks, 1);
+          add(counter.busy_ns, nanoseconds(busy_start, Clock::now()));
+          if (task.group != nullptr) {
+            task.group->finish();
+            continue;
+          }
           {
             std::unique_lock<std::mutex> lock(this->sync_mutex);
             sync++;
@@ -108,6 +381,7 @@ inline ThreadPool::ThreadPool(size_t threads)
        }
      }
    );
+  }
 }
 
 // Add new work item to the pool
@@ -119,24 +393,38 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     std::bind(std::forward<F>(f), std::forward<Args>(args)...)
   );
   std::future<return_type> res = task->get_future();
+  submit([task](){ (*task)(); }, nullptr);
+  return res;
+}
+
+// Add a task to the queue
+inline void ThreadPool::submit(std::function<void()>&& fn,
+                               TaskGroup* group) {
   {
     std::unique_lock<std::mutex> lock(queue_mutex);
     // don't allow enqueueing after stopping the pool
     if (stop) {
       throw std::runtime_error("enqueue on stopped ThreadPool");
     }
-    tasks.emplace([task](){ (*task)(); });
+    Task task;
+    task.fn = std::move(fn);
+    task.group = group;
+    tasks.push(std::move(task));
   }
   condition.notify_one();
-  return res;
 }
 
 // Wait all thread to finish their jobs
 inline void ThreadPool::Sync(int wait_count) {
   std::unique_lock<std::mutex> lock(sync_mutex);
-  this->sync_condition.wait(lock, [&]() {
-    return sync == wait_count;
-  });
+  if (sync != wait_count) {
+    xLearn::TraceSpan span("sync", "pool");
+    auto start = std::chrono::steady_clock::now();
+    this->sync_condition.wait(lock, [&]() {
+      return sync == wait_count;
+    });
+    add_wait(start);
+  }
   sync = 0;
 }
 
@@ -145,6 +433,178 @@ inline size_t ThreadPool::ThreadNumber() {
   return workers.size();
 }
 
+inline void ThreadPool::GetStats(ThreadPoolStats* stats) const {
+  size_t n = workers.size();
+  stats->tasks.resize(n);
+  stats->busy.resize(n);
+  stats->idle.resize(n);
+  stats->lock_wait.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    stats->tasks[i] = counters[i].tasks.load();
+    stats->busy[i] = counters[i].busy_ns.load() * 1e-9;
+    stats->idle[i] = counters[i].idle_ns.load() * 1e-9;
+    stats->lock_wait[i] = counters[i].lock_ns.load() * 1e-9;
+  }
+  stats->caller_wait = total_wait_ns.load() * 1e-9;
+}
+
+inline void ThreadPool::ResetStats() {
+  for (size_t i = 0; i < workers.size(); ++i) {
+    counters[i].tasks.store(0);
+    counters[i].busy_ns.store(0);
+    counters[i].idle_ns.store(0);
+    counters[i].lock_ns.store(0);
+  }
+  total_wait_ns.store(0);
+}
+
+inline size_t ThreadPool::Grain(size_t count, size_t grain,
+                                size_t min_grain) {
+  if (grain > 0) {
+    return grain;
+  }
+  size_t parts = std::max<size_t>(workers.size(), 1) * kChunksPerThread;
+  return std::max<size_t>((count + parts - 1) / parts,
+                          std::max<size_t>(min_grain, 1));
+}
+
+// Pop the chunk at the lower end of the slot.
+inline bool ThreadPool::pop_chunk(Bulk* bulk, size_t slot, size_t* chunk) {
+  std::atomic<uint64_t>& range = bulk->slots[slot].range;
+  uint64_t r = range.load();
+  for (;;) {
+    uint64_t lo = r >> 32, hi = r & 0xffffffff;
+    if (lo >= hi) {
+      return false;
+    }
+    if (range.compare_exchange_weak(r, pack_range(lo + 1, hi))) {
+      *chunk = lo;
+      return true;
+    }
+  }
+}
+
+// Steal the upper half of the first slot that has chunks. The first
+// chunk of the half is returned, and the rest goes to the own slot,
+// which is empty (and hence nobody else can change it) at that time.
+inline bool ThreadPool::steal_chunk(Bulk* bulk, size_t slot, size_t* chunk) {
+  for (size_t k = 1; k < bulk->num_slots; ++k) {
+    std::atomic<uint64_t>& range =
+        bulk->slots[(slot + k) % bulk->num_slots].range;
+    uint64_t r = range.load();
+    for (;;) {
+      uint64_t lo = r >> 32, hi = r & 0xffffffff;
+      if (lo >= hi) {
+        break;
+      }
+      uint64_t mid = hi - (hi - lo + 1) / 2;
+      if (range.compare_exchange_weak(r, pack_range(lo, mid))) {
+        bulk->slots[slot].range.store(pack_range(mid + 1, hi));
+        *chunk = mid;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Run the chunks of the own slot, and then steal the others.
+inline void ThreadPool::run_bulk(Bulk* bulk, size_t slot) {
+  size_t chunk;
+  while (pop_chunk(bulk, slot, &chunk) || steal_chunk(bulk, slot, &chunk)) {
+    size_t begin = 0, end = 0;
+    chunk_range(bulk->begin, bulk->end, bulk->grain,
+                bulk->bounds, chunk, &begin, &end);
+    bulk->invoke(bulk->fn, begin, end);
+  }
+}
+
+template <class F>
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain, F&& fn) {
+  if (end <= begin) {
+    return;
+  }
+  grain = Grain(end - begin, grain);
+  size_t num_chunks = (end - begin + grain - 1) / grain;
+  run_chunks(begin, end, grain, nullptr, num_chunks, fn);
+}
+
+template <class F>
+void ThreadPool::ParallelFor(const std::vector<size_t>& bounds, F&& fn) {
+  if (bounds.size() < 2) {
+    return;
+  }
+  run_chunks(bounds.front(), bounds.back(), 0,
+             bounds.data(), bounds.size() - 1, fn);
+}
+
+template <class F>
+void ThreadPool::run_chunks(size_t begin, size_t end, size_t grain,
+                            const size_t* bounds, size_t num_chunks, F& fn) {
+  CHECK_LT(num_chunks, (size_t)1 << 32);
+  size_t num_slots = std::min(workers.size(), num_chunks);
+  // Nothing to share
+  if (num_slots <= 1) {
+    for (size_t c = 0; c < num_chunks; ++c) {
+      size_t b = 0, e = 0;
+      chunk_range(begin, end, grain, bounds, c, &b, &e);
+      fn(b, e);
+    }
+    return;
+  }
+  typedef typename std::remove_reference<F>::type Func;
+  // The slots are on the stack for the common number of threads
+  const size_t kStackSlots = 16;
+  Slot stack_slots[kStackSlots];
+  std::unique_ptr<Slot[]> heap_slots;
+  Bulk job;
+  job.slots = stack_slots;
+  if (num_slots > kStackSlots) {
+    heap_slots.reset(new Slot[num_slots]);
+    job.slots = heap_slots.get();
+  }
+  job.invoke = [](void* f, size_t b, size_t e) {
+    (*static_cast<Func*>(f))(b, e);
+  };
+  job.fn = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+  job.begin = begin;
+  job.end = end;
+  job.grain = grain;
+  job.bounds = bounds;
+  job.num_slots = num_slots;
+  job.next_slot = 1;  /* slot 0 is current thread */
+  job.done = 0;
+  for (size_t s = 0; s < num_slots; ++s) {
+    job.slots[s].range.store(pack_range(s * num_chunks / num_slots,
+                                    (s + 1) * num_chunks / num_slots));
+  }
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    bulks.push_back(&job);
+  }
+  for (size_t s = 1; s < num_slots; ++s) {
+    condition.notify_one();
+  }
+  {
+    xLearn::TraceSpan span("parallel_for", "pool");
+    run_bulk(&job, 0);
+  }
+  // No more workers can join, and wait for the joined ones
+  size_t joined = 0;
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    bulks.erase(std::find(bulks.begin(), bulks.end(), &job));
+    joined = job.next_slot - 1;
+  }
+  std::unique_lock<std::mutex> lock(job.mutex);
+  if (job.done != joined) {
+    xLearn::TraceSpan span("wait", "pool");
+    auto start = std::chrono::steady_clock::now();
+    job.cv.wait(lock, [&job, joined]() { return job.done == joined; });
+    add_wait(start);
+  }
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool() {
   {
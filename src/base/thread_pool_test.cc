@@ -20,6 +20,11 @@ This file tests thread_pool.h file.
 
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include "src/base/thread_pool.h"
 
 void func(int id) {
@@ -71,3 +76,223 @@ TEST(ThreadPoolTest, Sum_test) {
   int sum = a1 + a2 + a3 + a4 + a5;
   EXPECT_EQ(sum, 75);
 }
+
+TEST(ThreadPoolTest, Pin_numa) {
+  ThreadPool pool(4, true);
+  int nodes[4];
+  for (int i = 0; i < 4; ++i) {
+    pool.enqueue([&nodes, i]() { nodes[i] = xLearn::CurrentNumaNode(); });
+  }
+  pool.Sync(4);
+  // The node is -1 if the system cannot pin the thread
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_GE(nodes[i], -1);
+    EXPECT_LT(nodes[i], xLearn::GetNumNodes());
+  }
+}
+
+// Every item is visited exactly once, however the chunks are stolen.
+TEST(ThreadPoolTest, ParallelFor) {
+  ThreadPool pool(4);
+  size_t sizes[5] = { 0, 1, 7, 100, 10007 };
+  size_t grains[3] = { 0, 1, 64 };
+  for (int s = 0; s < 5; ++s) {
+    for (int g = 0; g < 3; ++g) {
+      std::vector<std::atomic_int> count(sizes[s] + 3);
+      for (size_t i = 0; i < count.size(); ++i) { count[i] = 0; }
+      pool.ParallelFor(3, sizes[s] + 3, grains[g],
+        [&count](size_t begin, size_t end) {
+          for (size_t i = begin; i < end; ++i) { count[i]++; }
+        });
+      for (size_t i = 0; i < count.size(); ++i) {
+        EXPECT_EQ(count[i], i < 3 ? 0 : 1);
+      }
+    }
+  }
+}
+
+// The chunks of the slow items are stolen by the other threads.
+TEST(ThreadPoolTest, ParallelFor_uneven) {
+  ThreadPool pool(4);
+  std::atomic_int sum { 0 };
+  for (int n = 0; n < 100; ++n) {
+    pool.ParallelFor(0, 64, 1, [&sum](size_t begin, size_t end) {
+      if (begin < 4) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+      sum += end - begin;
+    });
+  }
+  EXPECT_EQ(sum, 6400);
+}
+
+// The chunks are given by the bounds.
+TEST(ThreadPoolTest, ParallelFor_bounds) {
+  ThreadPool pool(4);
+  std::vector<size_t> bounds = {2, 3, 10, 11, 50, 100};
+  std::vector<std::atomic_int> count(100);
+  std::vector<std::atomic_int> chunks(100);
+  for (size_t i = 0; i < count.size(); ++i) {
+    count[i] = 0;
+    chunks[i] = 0;
+  }
+  pool.ParallelFor(bounds, [&](size_t begin, size_t end) {
+    chunks[begin]++;
+    for (size_t i = begin; i < end; ++i) { count[i]++; }
+  });
+  for (size_t i = 0; i < count.size(); ++i) {
+    EXPECT_EQ(count[i], i < 2 ? 0 : 1);
+  }
+  for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+    EXPECT_EQ(chunks[bounds[i]], 1);
+  }
+  // Nothing to do
+  pool.ParallelFor(std::vector<size_t>(1, 5), [&](size_t, size_t) {
+    count[0]++;
+  });
+  EXPECT_EQ(count[0], 0);
+}
+
+// One thread runs the chunks in order.
+TEST(ThreadPoolTest, ParallelFor_one_thread) {
+  ThreadPool pool(1);
+  std::vector<size_t> begins;
+  pool.ParallelFor(0, 10, 3, [&begins](size_t begin, size_t end) {
+    begins.push_back(begin);
+  });
+  ASSERT_EQ(begins.size(), 4);
+  for (size_t i = 0; i < begins.size(); ++i) {
+    EXPECT_EQ(begins[i], i * 3);
+  }
+  EXPECT_EQ(pool.Grain(10, 3), 3);
+  EXPECT_EQ(pool.Grain(10, 0), 3);
+  EXPECT_EQ(pool.Grain(0, 0), 1);
+}
+
+// The small work runs in current thread with min_grain.
+TEST(ThreadPoolTest, ParallelFor_min_grain) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.Grain(1000, 0), 63);
+  EXPECT_EQ(pool.Grain(1000, 0, 100), 100);
+  EXPECT_EQ(pool.Grain(1000, 0, 5000), 5000);
+  EXPECT_EQ(pool.Grain(1000, 7, 5000), 7);
+  EXPECT_EQ(pool.Grain(1000, 0, 0), 63);
+  std::thread::id caller = std::this_thread::get_id();
+  size_t grain = pool.Grain(1000, 0, 5000);
+  int chunks = 0;
+  pool.ParallelFor(0, 1000, grain, [&](size_t begin, size_t end) {
+    EXPECT_EQ(std::this_thread::get_id(), caller);
+    EXPECT_EQ(begin, 0);
+    EXPECT_EQ(end, 1000);
+    chunks++;
+  });
+  EXPECT_EQ(chunks, 1);
+}
+
+// ParallelFor() and enqueue() can be used together.
+TEST(ThreadPoolTest, ParallelFor_and_enqueue) {
+  ThreadPool pool(3);
+  std::atomic_int sum { 0 };
+  for (int n = 0; n < 10; ++n) {
+    for (int i = 0; i < 3; ++i) {
+      pool.enqueue([&sum]() { sum += 1; });
+    }
+    pool.ParallelFor(0, 100, 0, [&sum](size_t begin, size_t end) {
+      sum += end - begin;
+    });
+    pool.Sync(3);
+  }
+  EXPECT_EQ(sum, 1030);
+}
+
+// Each group only waits for its own tasks, and Sync() does
+// not count the tasks of the groups.
+TEST(ThreadPoolTest, TaskGroup) {
+  ThreadPool pool(4);
+  std::atomic_int slow { 0 };
+  std::atomic_int fast { 0 };
+  std::atomic_bool release { false };
+  TaskGroup slow_group(&pool);
+  slow_group.Run([&]() {
+    while (!release) { std::this_thread::yield(); }
+    slow++;
+  });
+  {
+    TaskGroup fast_group(&pool);
+    for (int i = 0; i < 10; ++i) {
+      fast_group.Run([&fast]() { fast++; });
+    }
+    fast_group.Wait();
+    EXPECT_EQ(fast, 10);
+    EXPECT_EQ(slow, 0);
+  }
+  pool.enqueue([&fast]() { fast++; });
+  pool.Sync(1);
+  EXPECT_EQ(fast, 11);
+  release = true;
+  slow_group.Wait();
+  EXPECT_EQ(slow, 1);
+}
+
+// Two ParallelFor() calls from different threads overlap,
+// and ParallelFor() can be called in its own chunks.
+TEST(ThreadPoolTest, ParallelFor_concurrent) {
+  ThreadPool pool(4);
+  std::atomic_int sum { 0 };
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 3; ++t) {
+    callers.push_back(std::thread([&pool, &sum]() {
+      for (int n = 0; n < 50; ++n) {
+        pool.ParallelFor(0, 10, 1, [&pool, &sum](size_t begin, size_t end) {
+          pool.ParallelFor(0, 8, 2, [&sum](size_t b, size_t e) {
+            sum += e - b;
+          });
+        });
+      }
+    }));
+  }
+  for (int t = 0; t < 3; ++t) {
+    callers[t].join();
+  }
+  EXPECT_EQ(sum, 3 * 50 * 10 * 8);
+}
+
+// The caller of Sync() waits for the slow task.
+TEST(ThreadPoolTest, WaitTime) {
+  ThreadPool pool(2);
+  EXPECT_EQ(pool.WaitTime(), 0);
+  pool.enqueue([]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  });
+  pool.Sync(1);
+  EXPECT_GE(pool.WaitTime(), 0.04);
+  EXPECT_LT(pool.WaitTime(), 10);
+  pool.ResetWaitTime();
+  EXPECT_EQ(pool.WaitTime(), 0);
+}
+
+TEST(ThreadPoolTest, Stats) {
+  ThreadPool pool(2);
+  for (int i = 0; i < 4; ++i) {
+    pool.enqueue([]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    });
+  }
+  pool.Sync(4);
+  ThreadPoolStats stats;
+  pool.GetStats(&stats);
+  ASSERT_EQ(stats.tasks.size(), 2);
+  EXPECT_EQ(stats.tasks[0] + stats.tasks[1], 4);
+  EXPECT_GE(stats.busy[0] + stats.busy[1], 0.035);
+  EXPECT_GE(stats.idle[0] + stats.idle[1], 0);
+  EXPECT_GE(stats.caller_wait, 0.015);
+  // The caller wait is not reset by ResetWaitTime()
+  pool.ResetWaitTime();
+  pool.GetStats(&stats);
+  EXPECT_GE(stats.caller_wait, 0.015);
+  pool.ResetStats();
+  pool.GetStats(&stats);
+  EXPECT_EQ(stats.tasks[0] + stats.tasks[1], 0);
+  EXPECT_EQ(stats.busy[0] + stats.busy[1], 0);
+  EXPECT_EQ(stats.caller_wait, 0);
+}
@@ -0,0 +1,179 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the trace of the spans.
+*/
+
+#include "src/base/trace.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace xLearn {
+
+std::atomic<bool> g_trace_on(false);
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  const char* category;
+  uint64 begin;
+  uint64 end;
+};
+
+// The spans of a thread, which are kept after the thread exits until
+// the next trace. The lock is only taken by the thread itself and by
+// StopTrace(), so it is not contended.
+struct TraceBuffer {
+  std::mutex mutex;
+  std::vector<TraceEvent> events;
+  std::string name;
+  uint64 dropped = 0;
+  size_t tid = 0;
+};
+
+struct TraceState {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  std::string filename;
+  size_t max_events = 0;
+  uint64 start = 0;
+  size_t next_tid = 0;
+};
+
+TraceState& state() {
+  static TraceState* s = new TraceState;
+  return *s;
+}
+
+TraceBuffer* local_buffer() {
+  static thread_local std::shared_ptr<TraceBuffer> local;
+  if (local == nullptr) {
+    local = std::make_shared<TraceBuffer>();
+    TraceState& s = state();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    local->tid = s.next_tid++;
+    s.buffers.push_back(local);
+  }
+  return local.get();
+}
+
+}  // namespace
+
+uint64 TraceNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void StartTrace(const std::string& filename, size_t max_events) {
+  CHECK(!filename.empty());
+  CHECK_GT(max_events, 0);
+  TraceState& s = state();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  // The buffers of the exited threads are removed
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  for (size_t i = 0; i < s.buffers.size(); ++i) {
+    if (s.buffers[i].use_count() > 1) {
+      std::unique_lock<std::mutex> buffer_lock(s.buffers[i]->mutex);
+      s.buffers[i]->events.clear();
+      s.buffers[i]->dropped = 0;
+      buffers.push_back(s.buffers[i]);
+    }
+  }
+  s.buffers.swap(buffers);
+  s.filename = filename;
+  s.max_events = max_events;
+  s.start = TraceNow();
+  g_trace_on.store(true);
+}
+
+void SetTraceThreadName(const std::string& name) {
+  TraceBuffer* buffer = local_buffer();
+  std::unique_lock<std::mutex> lock(buffer->mutex);
+  buffer->name = name;
+}
+
+void AddTraceSpan(const char* name, const char* category,
+                  uint64 begin, uint64 end) {
+  TraceState& s = state();
+  // The spans that started before this trace are not kept
+  if (!TraceOn() || begin < s.start) { return; }
+  TraceBuffer* buffer = local_buffer();
+  std::unique_lock<std::mutex> lock(buffer->mutex);
+  if (buffer->events.size() >= s.max_events) {
+    buffer->dropped++;
+    return;
+  }
+  buffer->events.push_back({ name, category, begin, end });
+}
+
+int64 StopTrace() {
+  if (!g_trace_on.exchange(false)) { return -1; }
+  TraceState& s = state();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  FILE* file = fopen(s.filename.c_str(), "w");
+  if (file == nullptr) {
+    LOG(ERR) << "Cannot open the trace file: " << s.filename;
+    return -1;
+  }
+  // The timestamps are the microseconds since the start
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+                "\"tid\": 0, \"args\": {\"name\": \"xLearn\"}}");
+  int64 count = 0;
+  uint64 dropped = 0;
+  for (size_t i = 0; i < s.buffers.size(); ++i) {
+    TraceBuffer* buffer = s.buffers[i].get();
+    std::unique_lock<std::mutex> buffer_lock(buffer->mutex);
+    if (buffer->events.empty() && buffer->name.empty()) { continue; }
+    std::string name = buffer->name.empty() ?
+      "thread " + std::to_string(buffer->tid) : buffer->name;
+    fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+                  "\"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+            buffer->tid, name.c_str());
+    for (size_t j = 0; j < buffer->events.size(); ++j) {
+      const TraceEvent& e = buffer->events[j];
+      fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %zu}",
+              e.name, e.category, (e.begin - s.start) * 1e-3,
+              (e.end - e.begin) * 1e-3, buffer->tid);
+    }
+    count += buffer->events.size();
+    dropped += buffer->dropped;
+    buffer->events.clear();
+    buffer->events.shrink_to_fit();
+  }
+  fprintf(file, "\n]}\n");
+  bool ok = ferror(file) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    LOG(ERR) << "Cannot write the trace file: " << s.filename;
+    return -1;
+  }
+  if (dropped > 0) {
+    LOG(WARNING) << "The trace dropped " << dropped << " spans "
+                 << "after the " << s.max_events << " spans of a thread";
+  }
+  return count;
+}
+
+}  // namespace xLearn
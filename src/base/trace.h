@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the TraceSpan class, which records the spans
+of the threads in the Chrome trace-event format.
+*/
+
+#ifndef XLEARN_BASE_TRACE_H_
+#define XLEARN_BASE_TRACE_H_
+
+#include <atomic>
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The trace records the spans (name, start and duration) of each thread
+// in its own buffer, and StopTrace() writes all of them to a JSON file,
+// which is opened by chrome://tracing or https://ui.perfetto.dev:
+//
+//   StartTrace("xlearn.trace");
+//   {
+//     TraceSpan span("parse", "reader");
+//     ... /* code we want to see in the trace */
+//   }
+//   StopTrace();
+//
+// A span only reads the clock twice and appends to the buffer of current
+// thread, and it does nothing if the trace is not started, so the spans
+// are used around the tasks, the blocks and the waits, but not around
+// each row. The name and the category must be string literals (or live
+// until StopTrace()), since only the pointers are kept. Each thread keeps
+// at most max_events spans of a trace, and the later ones are dropped.
+//------------------------------------------------------------------------------
+
+// Start a trace that is written to the file, where the
+// spans of the last trace are removed.
+void StartTrace(const std::string& filename,
+                size_t max_events = 1024 * 1024);
+
+// Stop the trace and write its file. Return the number of the written
+// spans, or -1 if the trace is not started or the file cannot be written.
+int64 StopTrace();
+
+// Name of current thread in the trace, e.g., the worker of a pool.
+void SetTraceThreadName(const std::string& name);
+
+// Is the trace started ?
+extern std::atomic<bool> g_trace_on;
+inline bool TraceOn() {
+  return g_trace_on.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds of the trace clock.
+uint64 TraceNow();
+
+// Add a span of current thread.
+void AddTraceSpan(const char* name, const char* category,
+                  uint64 begin, uint64 end);
+
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name, const char* category = "xlearn")
+    : name_(name), category_(category),
+      begin_(TraceOn() ? TraceNow() : kNoSpan) { }
+  ~TraceSpan() {
+    if (begin_ != kNoSpan) {
+      AddTraceSpan(name_, category_, begin_, TraceNow());
+    }
+  }
+
+ private:
+  static const uint64 kNoSpan = ~0ULL;
+  const char* name_;
+  const char* category_;
+  uint64 begin_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceSpan);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_TRACE_H_
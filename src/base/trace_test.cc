@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests trace.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "src/base/file_util.h"
+#include "src/base/thread_pool.h"
+#include "src/base/trace.h"
+
+namespace xLearn {
+
+const std::string kTraceFile = "./trace_test.json";
+
+std::string read_trace() {
+  std::ifstream file(kTraceFile);
+  std::stringstream str;
+  str << file.rdbuf();
+  return str.str();
+}
+
+size_t count_of(const std::string& str, const std::string& sub) {
+  size_t count = 0;
+  for (size_t pos = str.find(sub); pos != std::string::npos;
+       pos = str.find(sub, pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+TEST(TraceTest, Spans) {
+  {
+    // Not recorded
+    TraceSpan span("before");
+  }
+  EXPECT_EQ(StopTrace(), -1);
+  StartTrace(kTraceFile);
+  EXPECT_TRUE(TraceOn());
+  {
+    TraceSpan outer("outer", "test");
+    TraceSpan inner("inner", "test");
+  }
+  {
+    ThreadPool pool(2);
+    for (int i = 0; i < 4; ++i) {
+      pool.enqueue([]() { TraceSpan span("work", "test"); });
+    }
+    pool.Sync(4);
+  }
+  // 2 + 4 * (task + work), and the sync of the pool if it waited
+  int64 count = StopTrace();
+  EXPECT_FALSE(TraceOn());
+  EXPECT_GE(count, 10);
+  EXPECT_LE(count, 11);
+  std::string trace = read_trace();
+  EXPECT_EQ(trace.find("{\"displayTimeUnit\""), 0);
+  EXPECT_EQ(count_of(trace, "\"ph\": \"X\""), count);
+  EXPECT_EQ(count_of(trace, "\"name\": \"outer\", \"cat\": \"test\""), 1);
+  EXPECT_EQ(count_of(trace, "\"name\": \"inner\""), 1);
+  EXPECT_EQ(count_of(trace, "\"name\": \"work\""), 4);
+  EXPECT_EQ(count_of(trace, "\"name\": \"task\", \"cat\": \"pool\""), 4);
+  EXPECT_EQ(count_of(trace, "\"name\": \"before\""), 0);
+  EXPECT_EQ(count_of(trace, "pool worker 0"), 1);
+  EXPECT_EQ(count_of(trace, "pool worker 1"), 1);
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+  // A new trace does not keep the spans of the last one
+  StartTrace(kTraceFile);
+  {
+    TraceSpan span("again");
+  }
+  EXPECT_EQ(StopTrace(), 1);
+  trace = read_trace();
+  EXPECT_EQ(count_of(trace, "\"name\": \"outer\""), 0);
+  EXPECT_EQ(count_of(trace, "\"name\": \"again\""), 1);
+  RemoveFile(kTraceFile.c_str());
+}
+
+TEST(TraceTest, Max_events) {
+  StartTrace(kTraceFile, 3);
+  for (int i = 0; i < 10; ++i) {
+    TraceSpan span("span");
+  }
+  EXPECT_EQ(StopTrace(), 3);
+  RemoveFile(kTraceFile.c_str());
+}
+
+TEST(TraceTest, Bad_file) {
+  StartTrace("/not_a_dir/trace.json");
+  {
+    TraceSpan span("span");
+  }
+  EXPECT_EQ(StopTrace(), -1);
+}
+
+}  // namespace xLearn
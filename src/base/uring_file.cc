@@ -0,0 +1,207 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of uring_file.h.
+*/
+
+#include "src/base/uring_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define XLEARN_IO_URING
+#endif
+#endif
+#endif
+
+namespace xLearn {
+
+const uint32 UringFile::kDefaultDepth;
+const size_t UringFile::kChunkSize;
+
+#ifdef XLEARN_IO_URING
+
+bool UringFile::Open(const std::string& filename, uint32 depth) {
+  Close();
+  CHECK_GT(depth, 0);
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if (fd_ < 0) { return false; }
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, depth, &params);
+  if (ring_fd_ < 0) {
+    Close();
+    return false;
+  }
+  depth_ = params.sq_entries;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes +
+                  params.cq_entries * sizeof(struct io_uring_cqe);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+  sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+      sqes_ == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  char* sq = (char*)sq_ring_;
+  sq_head_ = (unsigned*)(sq + params.sq_off.head);
+  sq_tail_ = (unsigned*)(sq + params.sq_off.tail);
+  sq_mask_ = (unsigned*)(sq + params.sq_off.ring_mask);
+  sq_array_ = (unsigned*)(sq + params.sq_off.array);
+  char* cq = (char*)cq_ring_;
+  cq_head_ = (unsigned*)(cq + params.cq_off.head);
+  cq_tail_ = (unsigned*)(cq + params.cq_off.tail);
+  cq_mask_ = (unsigned*)(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  return true;
+}
+
+void UringFile::Close() {
+  if (sq_ring_ != nullptr && sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != MAP_FAILED) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sqes_ != nullptr && sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  sq_ring_ = cq_ring_ = sqes_ = nullptr;
+  if (ring_fd_ >= 0) { close(ring_fd_); }
+  if (fd_ >= 0) { close(fd_); }
+  ring_fd_ = fd_ = -1;
+}
+
+size_t UringFile::Read(uint64 offset, char* buf, size_t len) {
+  CHECK(IsOpen());
+  CHECK_NOTNULL(buf);
+  size_t num_chunk = (len + kChunkSize - 1) / kChunkSize;
+  std::vector<struct iovec> iov(num_chunk);
+  for (size_t i = 0; i < num_chunk; ++i) {
+    iov[i].iov_base = buf + i * kChunkSize;
+    iov[i].iov_len = std::min(kChunkSize, len - i * kChunkSize);
+  }
+  result_.assign(num_chunk, 0);
+  struct io_uring_sqe* sqes = (struct io_uring_sqe*)sqes_;
+  struct io_uring_cqe* cqes = (struct io_uring_cqe*)cqes_;
+  size_t submitted = 0, completed = 0;
+  while (completed < num_chunk) {
+    // Fill the ring up to depth_ chunks in flight
+    unsigned tail = *sq_tail_;
+    unsigned to_submit = 0;
+    while (submitted - completed < depth_ && submitted < num_chunk) {
+      unsigned index = tail & *sq_mask_;
+      struct io_uring_sqe* sqe = &sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = fd_;
+      sqe->off = offset + submitted * kChunkSize;
+      sqe->addr = (uint64)&iov[submitted];
+      sqe->len = 1;
+      sqe->user_data = submitted;
+      sq_array_[index] = index;
+      tail++;
+      to_submit++;
+      submitted++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    // The entries that are not taken by an interrupted call are
+    // submitted again
+    to_submit = tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1,
+                      IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0 && errno != EINTR) {
+      LOG(FATAL) << "Error: invoke io_uring_enter().";
+    }
+    // Reap all the completions
+    unsigned head = *cq_head_;
+    unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != cq_tail) {
+      struct io_uring_cqe* cqe = &cqes[head & *cq_mask_];
+      result_[cqe->user_data] = cqe->res;
+      head++;
+      completed++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+  // The chunks up to the first short one, which is the end of file
+  size_t done = 0;
+  for (size_t i = 0; i < num_chunk; ++i) {
+    size_t size = iov[i].iov_len;
+    size_t got = result_[i] > 0 ? (size_t)result_[i] : 0;
+    if (got < size) {
+      got = read_rest(offset + i * kChunkSize, (char*)iov[i].iov_base,
+                      size, got);
+    }
+    done += got;
+    if (got < size) { break; }
+  }
+  return done;
+}
+
+size_t UringFile::read_rest(uint64 offset, char* buf,
+                            size_t len, size_t done) {
+  while (done < len) {
+    ssize_t ret = pread(fd_, buf + done, len - done, (off_t)(offset + done));
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret < 0) {
+      LOG(FATAL) << "Error: invoke pread().";
+    }
+    if (ret == 0) { break; }
+    done += ret;
+  }
+  return done;
+}
+
+#else
+
+bool UringFile::Open(const std::string& filename, uint32 depth) {
+  return false;
+}
+
+void UringFile::Close() { }
+
+size_t UringFile::Read(uint64 offset, char* buf, size_t len) {
+  LOG(FATAL) << "io_uring is not supported.";
+  return 0;
+}
+
+size_t UringFile::read_rest(uint64 offset, char* buf,
+                            size_t len, size_t done) {
+  return done;
+}
+
+#endif
+
+}  // namespace xLearn
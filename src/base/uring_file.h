@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the UringFile class, which reads a file by
+several reads in flight with io_uring on Linux.
+*/
+
+#ifndef XLEARN_BASE_URING_FILE_H_
+#define XLEARN_BASE_URING_FILE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// UringFile reads a large range of a file as the chunks of kChunkSize,
+// and keeps up to depth chunks in flight in one io_uring, so a single
+// thread can keep the queue of a NVMe disk busy, while fread() only
+// has one request of the readahead in flight:
+//
+//   UringFile file;
+//   if (file.Open(filename)) {
+//     size_t size = file.Read(offset, buf, len);
+//   }
+//
+// The ring is set up by the raw system calls, so it does not need
+// liburing. Open() returns false if io_uring is not supported, e.g.,
+// on other OS, on Linux older than 5.1, or if it is disabled by the
+// seccomp policy of a container. A chunk that io_uring fails to read
+// (or reads in part) is read again by pread(), so a read only fails
+// on the errors of the file.
+//------------------------------------------------------------------------------
+class UringFile {
+ public:
+  UringFile() { }
+  ~UringFile() { Close(); }
+
+  // Open the file with the ring of depth reads in flight.
+  bool Open(const std::string& filename, uint32 depth = kDefaultDepth);
+
+  void Close();
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  // Read at most len bytes at the offset to buf, and return the
+  // size, which is less than len only at the end of the file.
+  size_t Read(uint64 offset, char* buf, size_t len);
+
+  static const uint32 kDefaultDepth = 8;
+  static const size_t kChunkSize = 1024 * 1024;
+
+ private:
+  int fd_ = -1;
+  int ring_fd_ = -1;
+  uint32 depth_ = 0;
+  /* The mapped rings and the entries of the submissions */
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  void* sqes_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  size_t sqes_size_ = 0;
+  /* The fields of the rings */
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  void* cqes_ = nullptr;
+  /* The bytes read of each chunk, or -errno */
+  std::vector<int64> result_;
+
+  // Read the rest of a chunk by pread(), and return its size.
+  size_t read_rest(uint64 offset, char* buf, size_t len, size_t done);
+
+  DISALLOW_COPY_AND_ASSIGN(UringFile);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_URING_FILE_H_
@@ -0,0 +1,77 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests uring_file.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/uring_file.h"
+
+namespace xLearn {
+
+// The chunks read in flight are the same as the file, at any offset
+// and with any depth, and the read stops at the end of the file.
+TEST(UringFileTest, Read) {
+  std::string filename = "./test_uring_file";
+  const size_t kSize = UringFile::kChunkSize * 5 + 4321;
+  std::vector<char> data(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    data[i] = (char)(i * 131 + i / 4096);
+  }
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  WriteDataToDisk(file, data.data(), kSize);
+  Close(file);
+  UringFile uring;
+  EXPECT_FALSE(uring.IsOpen());
+  EXPECT_FALSE(uring.Open("./non-exist-file"));
+  uint32 depth[3] = { 1, 2, UringFile::kDefaultDepth };
+  for (uint32 d : depth) {
+    if (!uring.Open(filename, d)) {
+      // Not supported by this host
+      EXPECT_FALSE(uring.IsOpen());
+      break;
+    }
+    EXPECT_TRUE(uring.IsOpen());
+    std::vector<char> buf(kSize + 100);
+    EXPECT_EQ(uring.Read(0, buf.data(), kSize), kSize);
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), buf.begin()));
+    uint64 offset = UringFile::kChunkSize / 2 + 7;
+    size_t len = UringFile::kChunkSize * 3 + 11;
+    std::fill(buf.begin(), buf.end(), 0);
+    EXPECT_EQ(uring.Read(offset, buf.data(), len), len);
+    EXPECT_TRUE(std::equal(buf.begin(), buf.begin() + len,
+                           data.begin() + offset));
+    // The end of the file
+    EXPECT_EQ(uring.Read(kSize - 10, buf.data(), kSize), 10);
+    EXPECT_TRUE(std::equal(buf.begin(), buf.begin() + 10,
+                           data.end() - 10));
+    EXPECT_EQ(uring.Read(kSize, buf.data(), 100), 0);
+    EXPECT_EQ(uring.Read(kSize + 5000, buf.data(), 100), 0);
+    EXPECT_EQ(uring.Read(0, buf.data(), 0), 0);
+    uring.Close();
+    EXPECT_FALSE(uring.IsOpen());
+  }
+  RemoveFile(filename.c_str());
+}
+
+}  // namespace xLearn
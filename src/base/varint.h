@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file provides the variable-length encoding (varint) of the
+integers, which is used by the compressed binary files.
+*/
+
+#ifndef XLEARN_BASE_VARINT_H_
+#define XLEARN_BASE_VARINT_H_
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// A varint keeps 7 bits in each byte, and the high bit of a byte is set
+// if more bytes follow, so the small numbers take fewer bytes, e.g.,
+// a number < 128 takes one byte, and a uint32 takes 5 bytes at most.
+// The signed numbers (e.g., the delta of two ids) are mapped to the
+// unsigned numbers by ZigZag (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...)
+// first, so a small negative number takes a few bytes as well:
+//
+//   char buf[kMaxVarint32Bytes];
+//   char* end = EncodeVarint32(buf, ZigZagEncode32(-5));
+//   uint32 value;
+//   if (DecodeVarint32(buf, end, &value) == nullptr) { ... error ... }
+//   CHECK_EQ(ZigZagDecode32(value), -5);
+//------------------------------------------------------------------------------
+
+static const int kMaxVarint32Bytes = 5;
+
+// Write v to dst, and return the position after it.
+inline char* EncodeVarint32(char* dst, uint32 v) {
+  uint8* p = (uint8*)dst;
+  while (v >= 128) {
+    *p++ = (uint8)(v | 128);
+    v >>= 7;
+  }
+  *p++ = (uint8)v;
+  return (char*)p;
+}
+
+// Read a varint of [p, end) to v, and return the position after it,
+// or nullptr if the varint is truncated or longer than 5 bytes.
+inline const char* DecodeVarint32(const char* p,
+                                  const char* end,
+                                  uint32* v) {
+  // The fast path of one byte
+  if (p < end && (*(const uint8*)p & 128) == 0) {
+    *v = *(const uint8*)p;
+    return p + 1;
+  }
+  uint32 result = 0;
+  for (int shift = 0; shift <= 28 && p < end; shift += 7) {
+    uint32 byte = *(const uint8*)p++;
+    result |= (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      *v = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+// Bytes of the varint of v.
+inline int Varint32Length(uint32 v) {
+  int len = 1;
+  while (v >= 128) {
+    v >>= 7;
+    len++;
+  }
+  return len;
+}
+
+inline uint32 ZigZagEncode32(int32 v) {
+  return ((uint32)v << 1) ^ (uint32)(v >> 31);
+}
+
+inline int32 ZigZagDecode32(uint32 v) {
+  return (int32)(v >> 1) ^ -(int32)(v & 1);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_VARINT_H_
@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests varint.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "src/base/varint.h"
+
+namespace xLearn {
+
+TEST(VarintTest, Encode_and_Decode) {
+  std::vector<uint32> values = {0, 1, 127, 128, 300, 16383, 16384,
+                                (1u << 21) - 1, 1u << 21, (1u << 28) - 1,
+                                1u << 28, 0xffffffffu};
+  std::vector<int> lengths = {1, 1, 1, 2, 2, 2, 3, 3, 4, 4, 5, 5};
+  std::vector<char> buf(values.size() * kMaxVarint32Bytes);
+  char* p = buf.data();
+  for (size_t i = 0; i < values.size(); ++i) {
+    char* next = EncodeVarint32(p, values[i]);
+    EXPECT_EQ(next - p, lengths[i]);
+    EXPECT_EQ(Varint32Length(values[i]), lengths[i]);
+    p = next;
+  }
+  const char* q = buf.data();
+  for (size_t i = 0; i < values.size(); ++i) {
+    uint32 v = 0;
+    q = DecodeVarint32(q, p, &v);
+    ASSERT_TRUE(q != nullptr);
+    EXPECT_EQ(v, values[i]);
+  }
+  EXPECT_EQ(q, p);
+}
+
+TEST(VarintTest, Bad_input) {
+  char buf[kMaxVarint32Bytes + 1];
+  char* end = EncodeVarint32(buf, 1u << 28);
+  uint32 v = 0;
+  // Truncated
+  EXPECT_TRUE(DecodeVarint32(buf, end - 1, &v) == nullptr);
+  EXPECT_TRUE(DecodeVarint32(buf, buf, &v) == nullptr);
+  // Longer than 5 bytes
+  for (int i = 0; i < kMaxVarint32Bytes + 1; ++i) { buf[i] = (char)0x80; }
+  EXPECT_TRUE(DecodeVarint32(buf, buf + sizeof(buf), &v) == nullptr);
+}
+
+TEST(VarintTest, ZigZag) {
+  EXPECT_EQ(ZigZagEncode32(0), 0);
+  EXPECT_EQ(ZigZagEncode32(-1), 1);
+  EXPECT_EQ(ZigZagEncode32(1), 2);
+  EXPECT_EQ(ZigZagEncode32(-2), 3);
+  int32 values[] = {0, 1, -1, 1000, -1000, 2147483647, -2147483647 - 1};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    EXPECT_EQ(ZigZagDecode32(ZigZagEncode32(values[i])), values[i]);
+  }
+}
+
+}  // namespace xLearn
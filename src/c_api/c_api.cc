@@ -18,15 +18,26 @@
 This file is the implementation of C API.
 */
 
+#include <algorithm>
 #include <string>
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include <string.h>
 
 #include "src/c_api/c_api.h"
 #include "src/c_api/c_api_error.h"
 #include "src/base/format_print.h"
+#include "src/base/phase_timer.h"
+#include "src/base/split_string.h"
+#include "src/base/thread_pool.h"
 #include "src/base/timer.h"
+#include "src/reader/parser.h"
+#include "src/data/field_index.h"
+#include "src/score/ffm_score.h"
+#include "src/solver/sweep.h"
 
 // Say hello to user
 XL_DLL int XLearnHello() {
@@ -59,6 +70,30 @@ XL_DLL int XLearnCreate(const char *model_type, XL *out) {
   API_END();
 }
 
+// Beyond this number of values, the rows of the matrix
+// are filled by all the cpus that xLearn can use.
+static const uint64 kParallelValues = 1 << 20;
+
+// Run fn(begin, end) for the rows [0, nrow). Each row has been
+// allocated, so the rows of a large matrix are filled in parallel.
+template <class F>
+static void fill_rows(index_t nrow, uint64 num_values, F&& fn) {
+  size_t threads = xLearn::DefaultThreadNumber();
+  if (num_values < kParallelValues || threads <= 1) {
+    fn(0, nrow);
+    return;
+  }
+  ThreadPool pool(threads);
+  pool.ParallelFor(0, nrow, 0, fn);
+}
+
+// The latency of the construction of the matrices by the functions
+// below, which is shared by all the handles of the process
+static xLearn::LatencyHistogram& build_latency() {
+  static xLearn::LatencyHistogram latency;
+  return latency;
+}
+
 // Handle data matrix for xLearn
 XL_DLL int XlearnCreateDataFromMat(const real_t* data,
                                    index_t nrow,
@@ -67,65 +102,166 @@ XL_DLL int XlearnCreateDataFromMat(const real_t* data,
                                    index_t* field_map,
                                    DataHandle* out) {
   API_BEGIN();
-  std::unique_ptr<xLearn::DMatrix> source(new xLearn::DMatrix());	
+  double start = xLearn::WallSeconds();
+  std::unique_ptr<xLearn::DMatrix> source(new xLearn::DMatrix());
   // if feature_map equal nullptr, we will not use field
-  if (label == nullptr) {
-    source->has_label = false;
-    if (field_map == nullptr) {
-      for (int i = 0; i < nrow; ++i) {	
-        source->AddRow();
-        real_t norm = 0.0;
-        for (int j = 0; j < ncol; ++j) {
-          real_t value = data[j+i*ncol];
-          source->AddNode(i, j, value);
-          norm += value*value;
-        }
-        norm = 1.0f / norm;
-        source->norm[i] = norm;
-      }
-    } else {
-      for (int i = 0; i < nrow; ++i) {	
-        source->AddRow();
-        real_t norm = 0.0;
-        for (int j = 0; j < ncol; ++j) {
-          real_t value = data[j+i*ncol];
-          source->AddNode(i, j, value, field_map[j]);
-          norm += value*value;
-        }
-        norm = 1.0f / norm;
-        source->norm[i] = norm;
+  source->ReAlloc(nrow, label != nullptr);
+  // The rows are allocated in order, and then filled by the threads
+  for (index_t i = 0; i < nrow; ++i) {
+    source->row[i] = source->arena.NewRow(ncol);
+  }
+  fill_rows(nrow, (uint64)nrow * ncol, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (label != nullptr) { source->Y[i] = label[i]; }
+      const real_t* values = data + i * ncol;
+      xLearn::Node* node = source->row[i]->data();
+      real_t norm = 0.0;
+      for (index_t j = 0; j < ncol; ++j) {
+        index_t field = field_map == nullptr ? 0 : field_map[j];
+        node[j] = xLearn::Node(field, j, values[j]);
+        norm += values[j]*values[j];
       }
+      source->norm[i] = 1.0f / norm;
     }
-  } else {
-    source->has_label = true;
-    if (field_map == nullptr) {
-      for (int i = 0; i < nrow; ++i) {
-        source->AddRow();
-        real_t norm = 0.0;
-        source->Y[i] = label[i];
-        for (int j = 0; j < ncol; ++j) {
-          real_t value = data[j+i*ncol];
-          source->AddNode(i, j, value);
-          norm += value*value;
+  });
+  build_latency().RecordSeconds(xLearn::WallSeconds() - start);
+  *out = source.release();
+  API_END();
+}
+
+// Handle the sparse matrix in the CSR format
+XL_DLL int XlearnCreateDataFromCSR(const uint64* indptr,
+                                   const index_t* indices,
+                                   const real_t* data,
+                                   index_t nrow,
+                                   index_t ncol,
+                                   const real_t* label,
+                                   const index_t* field_map,
+                                   DataHandle* out) {
+  API_BEGIN();
+  double start = xLearn::WallSeconds();
+  std::unique_ptr<xLearn::DMatrix> source(new xLearn::DMatrix());
+  source->ReAlloc(nrow, label != nullptr);
+  // The nodes of the rows are laid one after another in the arena
+  for (index_t i = 0; i < nrow; ++i) {
+    if (indptr[i+1] < indptr[i]) {
+      throw std::runtime_error("The indptr must be non-decreasing!");
+    }
+    source->row[i] = source->arena.NewRow(indptr[i+1] - indptr[i]);
+  }
+  std::atomic<bool> out_of_range(false);
+  fill_rows(nrow, indptr[nrow] - indptr[0], [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (label != nullptr) { source->Y[i] = label[i]; }
+      xLearn::Node* node = source->row[i]->data();
+      real_t norm = 0.0;
+      for (uint64 k = indptr[i]; k < indptr[i+1]; ++k) {
+        index_t j = indices[k];
+        if (j >= ncol) {
+          out_of_range = true;
+          j = 0;
         }
-        norm = 1.0f / norm;
-        source->norm[i] = norm;
+        index_t field = field_map == nullptr ? 0 : field_map[j];
+        *node++ = xLearn::Node(field, j, data[k]);
+        norm += data[k]*data[k];
       }
-    } else {
-      for (int i = 0; i < nrow; ++i) {	
-        source->AddRow();
-        real_t norm = 0.0;
-        source->Y[i] = label[i];
-        for (int j = 0; j < ncol; ++j) {
-          real_t value = data[j+i*ncol];
-          source->AddNode(i, j, value, field_map[j]);
-          norm += value*value;
-        }
-        norm = 1.0f / norm;
-        source->norm[i] = norm;
+      source->norm[i] = 1.0f / norm;
+    }
+  });
+  if (out_of_range) {
+    throw std::runtime_error("The column index is out of range!");
+  }
+  build_latency().RecordSeconds(xLearn::WallSeconds() - start);
+  *out = source.release();
+  API_END();
+}
+
+// Handle the sparse matrix in the CSC format
+XL_DLL int XlearnCreateDataFromCSC(const uint64* indptr,
+                                   const index_t* indices,
+                                   const real_t* data,
+                                   index_t nrow,
+                                   index_t ncol,
+                                   const real_t* label,
+                                   const index_t* field_map,
+                                   DataHandle* out) {
+  API_BEGIN();
+  double start = xLearn::WallSeconds();
+  // The number of nodes of each row
+  std::vector<uint64> count(nrow, 0);
+  for (index_t j = 0; j < ncol; ++j) {
+    if (indptr[j+1] < indptr[j]) {
+      throw std::runtime_error("The indptr must be non-decreasing!");
+    }
+    for (uint64 k = indptr[j]; k < indptr[j+1]; ++k) {
+      if (indices[k] >= nrow) {
+        throw std::runtime_error("The row index is out of range!");
       }
+      count[indices[k]]++;
+    }
+  }
+  std::unique_ptr<xLearn::DMatrix> source(new xLearn::DMatrix());
+  source->ReAlloc(nrow, label != nullptr);
+  // The next node of each row
+  std::vector<xLearn::Node*> next(nrow);
+  for (index_t i = 0; i < nrow; ++i) {
+    if (label != nullptr) { source->Y[i] = label[i]; }
+    source->row[i] = source->arena.NewRow(count[i]);
+    next[i] = source->row[i]->data();
+    source->norm[i] = 0.0;
+  }
+  // The nodes of each row are in the order of the columns
+  for (index_t j = 0; j < ncol; ++j) {
+    index_t field = field_map == nullptr ? 0 : field_map[j];
+    for (uint64 k = indptr[j]; k < indptr[j+1]; ++k) {
+      index_t i = indices[k];
+      *next[i]++ = xLearn::Node(field, j, data[k]);
+      source->norm[i] += data[k]*data[k];
     }
   }
+  for (index_t i = 0; i < nrow; ++i) {
+    source->norm[i] = 1.0f / source->norm[i];
+  }
+  build_latency().RecordSeconds(xLearn::WallSeconds() - start);
+  *out = source.release();
+  API_END();
+}
+
+// The nodes of the caller are used as they are
+static_assert(sizeof(xLearn::Node) == 3 * sizeof(uint32),
+              "The node must be packed as field, feature and value");
+
+// Handle the rows of the nodes owned by the caller without a copy
+XL_DLL int XlearnCreateDataView(const uint64* indptr,
+                                const void* nodes,
+                                index_t nrow,
+                                const real_t* label,
+                                DataHandle* out) {
+  API_BEGIN();
+  double start = xLearn::WallSeconds();
+  const xLearn::Node* begin = static_cast<const xLearn::Node*>(nodes);
+  std::unique_ptr<xLearn::DMatrix> source(new xLearn::DMatrix());
+  source->ReAlloc(nrow, label != nullptr);
+  for (index_t i = 0; i < nrow; ++i) {
+    if (indptr[i+1] < indptr[i]) {
+      throw std::runtime_error("The indptr must be non-decreasing!");
+    }
+    source->row[i] = source->arena.NewView(begin + indptr[i],
+                                           indptr[i+1] - indptr[i]);
+  }
+  // Only the label and the norm are kept by the matrix
+  fill_rows(nrow, indptr[nrow] - indptr[0], [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i) {
+      if (label != nullptr) { source->Y[i] = label[i]; }
+      real_t norm = 0.0;
+      const xLearn::SparseRow& row = *source->row[i];
+      for (size_t k = 0; k < row.size(); ++k) {
+        norm += row[k].feat_val * row[k].feat_val;
+      }
+      source->norm[i] = 1.0f / norm;
+    }
+  });
+  build_latency().RecordSeconds(xLearn::WallSeconds() - start);
   *out = source.release();
   API_END();
 }
@@ -141,7 +277,8 @@ XL_DLL int XlearnDataFree(DataHandle* out) {
 // Free the xLearn handle
 XL_DLL int XLearnHandleFree(XL *out) {
   API_BEGIN();
-  // For now, we do nothing here
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xl->GetPredictor().UnloadModel();
   API_END();
 }
 
@@ -237,6 +374,21 @@ XL_DLL int XLearnGetTXTModel(XL *out, std::string& model_path) {
   API_END();
 }
 
+// Set file path of the inference model data
+XL_DLL int XLearnSetInferenceModel(XL *out, const char *model_path) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xl->GetHyperParam().inference_model_file = std::string(model_path);
+  API_END();
+}
+
+XL_DLL int XLearnGetInferenceModel(XL *out, std::string& model_path) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  model_path = xl->GetHyperParam().inference_model_file;
+  API_END();
+}
+
 // Start to train
 XL_DLL int XLearnFit(XL *out, const char *model_path) {
   API_BEGIN();
@@ -254,6 +406,65 @@ XL_DLL int XLearnFit(XL *out, const char *model_path) {
   API_END();
 }
 
+// Train, and keep the model loaded in the handle
+XL_DLL int XLearnFitInMemory(XL *out) {
+  API_BEGIN();
+  Timer timer;
+  timer.tic();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xl->GetHyperParam().model_file = "none";
+  xl->GetHyperParam().is_train = true;
+  xl->GetSolver().Initialize(xl->GetHyperParam());
+  xl->GetSolver().StartWork();
+  xLearn::Model* model = xl->GetSolver().ReleaseModel();
+  xl->GetSolver().Clear();
+  xl->GetPredictor().LoadModel(xl->GetHyperParam(), model);
+  Color::print_info(
+    StringPrintf("Total time cost: %.2f (sec)", 
+    timer.toc()), true);
+  API_END();
+}
+
+// Train the loaded model on one mini-batch
+XL_DLL int XLearnPartialFit(XL *out, DataHandle *data, float *loss) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::DMatrix* matrix = reinterpret_cast<xLearn::DMatrix*>(*data);
+  xLearn::HyperParam& param = xl->GetHyperParam();
+  if (!matrix->has_label) {
+    throw std::runtime_error("The data of training must have labels!");
+  }
+  if (xl->GetPredictor().IsLoaded()) {
+    xLearn::Model* model = xl->GetPredictor().GetLoadedModel();
+    if (model->GetLatentType() != xLearn::kStoreFP32 ||
+        model->IsMapped() || model->GetReplica(0) != model) {
+      throw std::runtime_error("The loaded model is only kept for "
+                               "the prediction, which cannot be trained!");
+    }
+    xLearn::StorageType opt_state = param.opt_state.compare("bf16") == 0 ?
+        xLearn::kStoreBF16 : xLearn::kStoreFP32;
+    if ((index_t)model->GetAuxiliarySize() !=
+        xLearn::Solver::AuxiliarySize(param.opt_type, param.opt_state) ||
+        model->GetOptState() != opt_state) {
+      throw std::runtime_error("The loaded model is not trained by the "
+                               "optimizer of the handle (opt, opt_state)!");
+    }
+    if ((model->GetScoreFunction().compare("ffm") == 0 ||
+         model->GetScoreFunction().compare("fwfm") == 0) &&
+        matrix->row_length > 0 &&
+        matrix->MaxField() >= model->GetNumField()) {
+      throw std::runtime_error("The fields of ffm and fwfm cannot be more "
+                               "than the fields of the loaded model!");
+    }
+  } else if (xLearn::Solver::AuxiliarySize(param.opt_type) == 0) {
+    throw std::runtime_error("Unknown optimization method: " +
+                             param.opt_type);
+  }
+  real_t val = xl->GetPredictor().PartialFit(param, matrix);
+  if (loss != nullptr) { *loss = val; }
+  API_END();
+}
+
 // Cross-validation
 XL_DLL int XLearnCV(XL *out) {
   API_BEGIN();
@@ -286,10 +497,10 @@ XL_DLL int XLearnPredictForMat(XL *out, const char *model_path,
   xl->GetSolver().Initialize(xl->GetHyperParam());
   xl->GetSolver().SetPredict();
   xl->GetSolver().StartWork();
-  static std::vector<real_t> tmp_preds;
-  tmp_preds = xl->GetSolver().GetResult();
-  std::vector<real_t> &preds = tmp_preds;
-  *out_arr = &preds[0];
+  // The results are kept by the handle for the caller
+  std::vector<real_t>& preds = xl->GetResult();
+  preds.swap(xl->GetSolver().GetResult());
+  *out_arr = preds.data();
   *length = static_cast<uint64>(preds.size());
   xl->GetSolver().Clear();
   Color::print_info(
@@ -298,6 +509,42 @@ XL_DLL int XLearnPredictForMat(XL *out, const char *model_path,
   API_END();
 }
 
+// Start to predict, this function is for output to the buffer
+XL_DLL int XLearnPredictForBuffer(XL *out, const char *model_path,
+                                  float *out_arr, uint64 length,
+                                  uint64 *num_rows) {
+  API_BEGIN();
+  Timer timer;
+  timer.tic();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::DMatrix* test = xl->GetHyperParam().test_dataset;
+  if (!xl->GetHyperParam().from_file && test != nullptr &&
+      test->row_length > length) {
+    throw std::runtime_error("The length of the output buffer must "
+                             "be the number of rows!");
+  }
+  xl->GetHyperParam().model_file = std::string(model_path);
+  xl->GetHyperParam().res_out = false;
+  xl->GetHyperParam().is_train = false;
+  xl->GetSolver().Initialize(xl->GetHyperParam());
+  xl->GetSolver().SetPredict();
+  xl->GetSolver().SetOutputBuffer(out_arr, length);
+  xl->GetSolver().StartWork();
+  *num_rows = static_cast<uint64>(xl->GetSolver().GetNumResult());
+  xl->GetSolver().Clear();
+  if (*num_rows > length) {
+    throw std::runtime_error(
+      StringPrintf("The output buffer has %llu values, but there "
+                   "are %llu results!",
+                   (unsigned long long)length,
+                   (unsigned long long)*num_rows));
+  }
+  Color::print_info(
+    StringPrintf("Total time cost: %.2f (sec)", 
+    timer.toc()), true);
+  API_END();
+}
+
 // Start to predict, this function is for output file
 XL_DLL int XLearnPredictForFile(XL *out, const char *model_path, 
                          const char *out_path) {
@@ -319,6 +566,344 @@ XL_DLL int XLearnPredictForFile(XL *out, const char *model_path,
   API_END();
 }
 
+// Load the model once for the following XLearnPredict() calls
+XL_DLL int XLearnLoadModel(XL *out, const char *model_path) {
+  API_BEGIN();
+  Timer timer;
+  timer.tic();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xl->GetHyperParam().model_file = std::string(model_path);
+  xl->GetPredictor().LoadModel(xl->GetHyperParam());
+  Color::print_info(
+    StringPrintf("Total time cost: %.2f (sec)",
+    timer.toc()), true);
+  API_END();
+}
+
+// Predict the data by the loaded model into out_arr, which
+// can be called by many threads at the same time
+XL_DLL int XLearnPredict(XL *out, DataHandle *data,
+                         float *out_arr, uint64 length) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::DMatrix* matrix = reinterpret_cast<xLearn::DMatrix*>(*data);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  if (length != matrix->row_length) {
+    throw std::runtime_error("The length of the output buffer must "
+                             "be the number of rows!");
+  }
+  xl->GetPredictor().Predict(matrix, out_arr);
+  API_END();
+}
+
+// Score the data by the loaded model in the thread of the caller
+XL_DLL int XLearnScoreRows(XL *out, DataHandle *data,
+                           float *out_arr, uint64 length) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::DMatrix* matrix = reinterpret_cast<xLearn::DMatrix*>(*data);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  if (length != matrix->row_length) {
+    throw std::runtime_error("The length of the output buffer must "
+                             "be the number of rows!");
+  }
+  xl->GetPredictor().ScoreRows(matrix, out_arr);
+  API_END();
+}
+
+// Score one row in the thread of the caller
+XL_DLL int XLearnScoreRow(XL *out, const index_t *feat_id,
+                          const index_t *field_id,
+                          const real_t *value,
+                          index_t nnz, float *score) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  // The row of each thread keeps its memory for the next call
+  static thread_local xLearn::SparseRow row;
+  row.clear();
+  real_t norm = 0.0;
+  for (index_t i = 0; i < nnz; ++i) {
+    index_t field = field_id == nullptr ? 0 : field_id[i];
+    row.push_back(xLearn::Node(field, feat_id[i], value[i]));
+    norm += value[i] * value[i];
+  }
+  norm = 1.0f / norm;
+  *score = xl->GetPredictor().ScoreRow(&row, norm);
+  API_END();
+}
+
+// Rank the candidates of one request in the thread of the caller
+XL_DLL int XLearnRankCandidates(XL *out, const index_t *ctx_feat,
+                                const index_t *ctx_field,
+                                const real_t *ctx_value,
+                                index_t ctx_nnz,
+                                DataHandle *candidates,
+                                float *out_arr, uint64 length) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::DMatrix* matrix =
+    reinterpret_cast<xLearn::DMatrix*>(*candidates);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  if (length != matrix->row_length) {
+    throw std::runtime_error("The length of the output buffer must "
+                             "be the number of candidates!");
+  }
+  static thread_local xLearn::SparseRow context;
+  context.clear();
+  for (index_t i = 0; i < ctx_nnz; ++i) {
+    index_t field = ctx_field == nullptr ? 0 : ctx_field[i];
+    context.push_back(xLearn::Node(field, ctx_feat[i], ctx_value[i]));
+  }
+  xl->GetPredictor().RankCandidates(&context, matrix, out_arr);
+  API_END();
+}
+
+// Open a test file to be predicted by the loaded model batch by batch
+XL_DLL int XLearnPredictOpen(XL *out, const char *test_path,
+                             PredictHandle *iter) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  if (!FileExist(test_path)) {
+    throw std::runtime_error(
+      StringPrintf("Cannot open the file %s", test_path));
+  }
+  PredictIter* it = new PredictIter;
+  it->xl = xl;
+  it->reader.reset(
+    xl->GetPredictor().CreatePredictReader(std::string(test_path)));
+  it->next = 0;
+  *iter = it;
+  API_END();
+}
+
+// The results of a block are kept until they are all returned,
+// and then the next block is predicted into the same buffer
+XL_DLL int XLearnPredictNext(PredictHandle *iter, float *out_arr,
+                             uint64 length, uint64 *num_rows) {
+  API_BEGIN();
+  PredictIter* it = reinterpret_cast<PredictIter*>(*iter);
+  if (!it->xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  uint64 count = 0;
+  while (count < length) {
+    if (it->next == it->result.size()) {
+      xLearn::DMatrix* matrix = nullptr;
+      index_t rows = it->reader->Samples(matrix);
+      if (rows == 0) { break; }
+      it->result.resize(rows);
+      it->next = 0;
+      it->xl->GetPredictor().Predict(matrix, it->result.data());
+    }
+    uint64 n = std::min(length - count,
+                        (uint64)(it->result.size() - it->next));
+    std::copy(it->result.begin() + it->next,
+              it->result.begin() + it->next + n, out_arr + count);
+    it->next += n;
+    count += n;
+  }
+  *num_rows = count;
+  API_END();
+}
+
+// Close the file of XLearnPredictOpen()
+XL_DLL int XLearnPredictClose(PredictHandle *iter) {
+  API_BEGIN();
+  CHECK_NOTNULL(iter);
+  delete reinterpret_cast<PredictIter*>(*iter);
+  API_END();
+}
+
+// Load a new version of the loaded model
+XL_DLL int XLearnReloadModel(XL *out, const char *model_path,
+                             bool background) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  xl->GetPredictor().ReloadModel(std::string(model_path), background);
+  API_END();
+}
+
+// Wait for the reload in the background
+XL_DLL int XLearnWaitReload(XL *out) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xl->GetPredictor().WaitReload();
+  API_END();
+}
+
+// Apply a delta file to the loaded model
+XL_DLL int XLearnApplyDelta(XL *out, const char *delta_path,
+                            bool *applied) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  *applied = xl->GetPredictor().ApplyDelta(std::string(delta_path));
+  API_END();
+}
+
+// Get the version of the loaded model
+XL_DLL int XLearnGetModelVersion(XL *out, uint64 *version) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  *version = xl->GetPredictor().GetModelVersion();
+  API_END();
+}
+
+// Get the shape of the loaded model
+XL_DLL int XLearnGetModelShape(XL *out, uint64 *num_feature,
+                               uint64 *num_field, uint64 *num_K) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  xLearn::Model* model = xl->GetPredictor().GetLoadedModel();
+  const std::string& score = model->GetScoreFunction();
+  *num_feature = model->GetNumFeature();
+  *num_field = score.compare("ffm") == 0 ? model->GetNumField() : 0;
+  *num_K = score.compare("linear") == 0 ? 0 : model->GetNumK();
+  API_END();
+}
+
+// Copy the weights of the loaded model
+XL_DLL int XLearnGetModelWeights(XL *out, float *linear,
+                                 uint64 linear_length,
+                                 float *latent,
+                                 uint64 latent_length) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  xLearn::Model* model = xl->GetPredictor().GetLoadedModel();
+  if (model->GetLatentType() != xLearn::kStoreFP32) {
+    throw std::runtime_error("The weights can only be copied from "
+                             "the model of fp32 latent factors!");
+  }
+  const std::string& score = model->GetScoreFunction();
+  uint64 num_feature = model->GetNumFeature();
+  uint64 num_latent = 0;
+  if (score.compare("fm") == 0 || score.compare("fwfm") == 0) {
+    num_latent = num_feature * model->GetNumK();
+  } else if (score.compare("ffm") == 0) {
+    num_latent = num_feature * model->GetNumField() * model->GetNumK();
+  }
+  if (linear_length != num_feature + 1) {
+    throw std::runtime_error("The length of the linear weights must "
+                             "be the number of features plus one!");
+  }
+  if (latent != nullptr && latent_length != num_latent) {
+    throw std::runtime_error("The length of the latent weights does "
+                             "not match the shape of the model!");
+  }
+  model->GetWeights(linear, latent_length > 0 ? latent : nullptr);
+  API_END();
+}
+
+// Copy the statistics of the thread pool of the last training
+XL_DLL int XLearnGetThreadStats(XL *out, uint64 *tasks, double *busy,
+                                double *idle, double *lock_wait,
+                                uint64 length, uint64 *num_worker,
+                                double *caller_wait) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  const ThreadPoolStats& stats = xl->GetSolver().GetThreadStats();
+  uint64 num = stats.tasks.size();
+  *num_worker = num;
+  *caller_wait = stats.caller_wait;
+  if ((tasks != nullptr || busy != nullptr ||
+       idle != nullptr || lock_wait != nullptr) && length < num) {
+    throw std::runtime_error("The length of the arrays is less "
+                             "than the number of the workers!");
+  }
+  for (uint64 i = 0; i < num; ++i) {
+    if (tasks != nullptr) { tasks[i] = stats.tasks[i]; }
+    if (busy != nullptr) { busy[i] = stats.busy[i]; }
+    if (idle != nullptr) { idle[i] = stats.idle[i]; }
+    if (lock_wait != nullptr) { lock_wait[i] = stats.lock_wait[i]; }
+  }
+  API_END();
+}
+
+// Copy the latency of a phase of the predictions
+XL_DLL int XLearnGetPredictLatency(XL *out, const char *phase,
+                                   const double *quantiles,
+                                   double *values, uint64 length,
+                                   uint64 *count, double *mean,
+                                   double *max, bool reset) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::Solver& predictor = xl->GetPredictor();
+  xLearn::LatencyHistogram* latency = nullptr;
+  if (strcmp(phase, "queue") == 0) {
+    latency = predictor.GetPredictLatency(xLearn::Solver::kPhaseQueue);
+  } else if (strcmp(phase, "build") == 0) {
+    latency = &build_latency();
+  } else if (strcmp(phase, "score") == 0) {
+    latency = predictor.GetPredictLatency(xLearn::Solver::kPhaseScore);
+  } else if (strcmp(phase, "copy") == 0) {
+    latency = predictor.GetPredictLatency(xLearn::Solver::kPhaseCopy);
+  } else if (strcmp(phase, "total") == 0) {
+    latency = predictor.GetPredictLatency(xLearn::Solver::kPhaseTotal);
+  } else {
+    throw std::runtime_error(
+      StringPrintf("Unknown phase of the latency: %s", phase));
+  }
+  // The events are read from a snapshot, so the quantiles
+  // of the interval are not changed by the running calls
+  std::unique_ptr<xLearn::LatencyHistogram> snapshot(
+    new xLearn::LatencyHistogram);
+  snapshot->Merge(latency, reset);
+  for (uint64 i = 0; i < length; ++i) {
+    values[i] = snapshot->Quantile(quantiles[i]) * 1e-9;
+  }
+  if (count != nullptr) { *count = snapshot->Count(); }
+  if (mean != nullptr) { *mean = snapshot->Mean() * 1e-9; }
+  if (max != nullptr) { *max = snapshot->Max() * 1e-9; }
+  API_END();
+}
+
+// Save the loaded model
+XL_DLL int XLearnSaveModel(XL *out, const char *model_path) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  if (!xl->GetPredictor().IsLoaded()) {
+    throw std::runtime_error("The model is not loaded!");
+  }
+  xLearn::Model* model = xl->GetPredictor().GetLoadedModel();
+  if (model->GetLatentType() != xLearn::kStoreFP32) {
+    throw std::runtime_error("The model of compact latent factors "
+                             "cannot be saved as a checkpoint!");
+  }
+  model->Serialize(std::string(model_path));
+  API_END();
+}
+
+// Release the loaded model
+XL_DLL int XLearnUnloadModel(XL *out) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xl->GetPredictor().UnloadModel();
+  API_END();
+}
+
 XL_DLL int XLearnSetDMatrix(XL *out, const char *key, DataHandle *out_data){
   API_BEGIN()
   XLearn* xl = reinterpret_cast<XLearn*>(*out);
@@ -327,10 +912,35 @@ XL_DLL int XLearnSetDMatrix(XL *out, const char *key, DataHandle *out_data){
     if (!xl->GetHyperParam().train_dataset->has_label){
       throw std::runtime_error("Train set must have label!");
     }
+    xl->GetHyperParam().train_iter = xLearn::DataIter();
   } else if (strcmp(key, "test") == 0) {
     xl->GetHyperParam().test_dataset = reinterpret_cast<xLearn::DMatrix*>(*out_data);
   } else if (strcmp(key, "validate") == 0) {
     xl->GetHyperParam().valid_dataset = reinterpret_cast<xLearn::DMatrix*>(*out_data);
+    xl->GetHyperParam().valid_iter = xLearn::DataIter();
+  }
+  API_END();
+}
+
+// Set the data of the batches of the callbacks
+XL_DLL int XLearnSetDataIter(XL *out, const char *key,
+                             xLearn::DataIter::NextFunc next,
+                             xLearn::DataIter::ResetFunc reset,
+                             void *handle) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::DataIter iter;
+  iter.next = next;
+  iter.reset = reset;
+  iter.handle = handle;
+  if (strcmp(key, "train") == 0) {
+    xl->GetHyperParam().train_iter = iter;
+    xl->GetHyperParam().train_dataset = nullptr;
+  } else if (strcmp(key, "validate") == 0) {
+    xl->GetHyperParam().valid_iter = iter;
+    xl->GetHyperParam().valid_dataset = nullptr;
+  } else {
+    throw std::runtime_error("The data iterator is only for train and validate!");
   }
   API_END();
 }
@@ -355,6 +965,78 @@ XL_DLL int XLearnSetStr(XL *out, const char *key, const char *value) {
     xl->GetHyperParam().loss_func = std::string(value);
   } else if (strcmp(key, "opt") == 0) {
     xl->GetHyperParam().opt_type = std::string(value);
+  } else if (strcmp(key, "opt_state") == 0) {
+    xl->GetHyperParam().opt_state = std::string(value);
+  } else if (strcmp(key, "latent") == 0) {
+    xl->GetHyperParam().latent_type = std::string(value);
+  } else if (strcmp(key, "numa") == 0) {
+    xl->GetHyperParam().numa_policy = std::string(value);
+  } else if (strcmp(key, "io") == 0) {
+    xl->GetHyperParam().file_io = std::string(value);
+  } else if (strcmp(key, "partition") == 0) {
+    xl->GetHyperParam().partition = std::string(value);
+  } else if (strcmp(key, "affinity") == 0) {
+    xl->GetHyperParam().affinity = std::string(value);
+  } else if (strcmp(key, "stop_file") == 0) {
+    xl->GetHyperParam().stop_file = std::string(value);
+  } else if (strcmp(key, "param_file") == 0) {
+    xl->GetHyperParam().param_file = std::string(value);
+  } else if (strcmp(key, "checkpoint") == 0) {
+    xl->GetHyperParam().checkpoint_file = std::string(value);
+  } else if (strcmp(key, "profile_file") == 0) {
+    xl->GetHyperParam().profile_file = std::string(value);
+  } else if (strcmp(key, "trace") == 0) {
+    xl->GetHyperParam().trace_file = std::string(value);
+  } else if (strcmp(key, "data_shm") == 0) {
+    xl->GetHyperParam().data_shm = std::string(value);
+  } else if (strcmp(key, "feature_stats") == 0) {
+    xl->GetHyperParam().feature_stats_file = std::string(value);
+  } else if (strcmp(key, "sweep") == 0) {
+    std::vector<xLearn::SweepConfig> configs;
+    xLearn::SweepConfig base = { 1, 1, 0 };
+    if (strlen(value) > 0 && !xLearn::ParseSweep(value, base, &configs)) {
+      throw std::runtime_error("The grid of sweep is invalid!");
+    }
+    xl->GetHyperParam().sweep = std::string(value);
+  } else if (strcmp(key, "cross") == 0) {
+    std::vector<xLearn::FieldCross> crosses;
+    if (!xLearn::ParseCrosses(value, &crosses)) {
+      throw std::runtime_error("The crosses of the fields are invalid!");
+    }
+    xl->GetHyperParam().cross = std::string(value);
+  } else if (strcmp(key, "field_pairs") == 0) {
+    std::vector<xLearn::FieldCross> pairs;
+    if (strlen(value) > 0 && !xLearn::ParseCrosses(value, &pairs)) {
+      throw std::runtime_error("The pairs of the fields are invalid!");
+    }
+    xl->GetHyperParam().field_pairs = std::string(value);
+  } else if (strcmp(key, "field_k") == 0) {
+    std::vector<xLearn::FieldK> items;
+    if (strlen(value) > 0 && !xLearn::ParseFieldK(value, &items)) {
+      throw std::runtime_error("The K of the fields is invalid!");
+    }
+    xl->GetHyperParam().field_k = std::string(value);
+  } else if (strcmp(key, "bag_field") == 0) {
+    std::vector<xLearn::index_t> fields;
+    if (strlen(value) > 0 && !xLearn::ParseBagFields(value, &fields)) {
+      throw std::runtime_error("The bag fields are invalid!");
+    }
+    xl->GetHyperParam().bag_field = std::string(value);
+  } else if (strcmp(key, "bag_pool") == 0) {
+    if (strcmp(value, "sum") != 0 && strcmp(value, "mean") != 0) {
+      throw std::runtime_error("The pooling of the bags is invalid!");
+    }
+    xl->GetHyperParam().bag_pool = std::string(value);
+  } else if (strcmp(key, "task_loss") == 0) {
+    std::vector<std::string> loss;
+    SplitStringUsing(std::string(value), ",", &loss);
+    for (size_t i = 0; i < loss.size(); ++i) {
+      if (loss[i].compare("cross-entropy") != 0 &&
+          loss[i].compare("squared") != 0) {
+        throw std::runtime_error("The loss of a task is invalid!");
+      }
+    }
+    xl->GetHyperParam().task_loss = loss;
   }
   API_END();
 }
@@ -373,6 +1055,51 @@ XL_DLL int XLearnGetStr(XL *out, const char *key, std::string& value) {
     value = xl->GetHyperParam().loss_func;
   } else if (strcmp(key, "opt") == 0) {
     value = xl->GetHyperParam().opt_type;
+  } else if (strcmp(key, "opt_state") == 0) {
+    value = xl->GetHyperParam().opt_state;
+  } else if (strcmp(key, "latent") == 0) {
+    value = xl->GetHyperParam().latent_type;
+  } else if (strcmp(key, "numa") == 0) {
+    value = xl->GetHyperParam().numa_policy;
+  } else if (strcmp(key, "io") == 0) {
+    value = xl->GetHyperParam().file_io;
+  } else if (strcmp(key, "partition") == 0) {
+    value = xl->GetHyperParam().partition;
+  } else if (strcmp(key, "affinity") == 0) {
+    value = xl->GetHyperParam().affinity;
+  } else if (strcmp(key, "stop_file") == 0) {
+    value = xl->GetHyperParam().stop_file;
+  } else if (strcmp(key, "param_file") == 0) {
+    value = xl->GetHyperParam().param_file;
+  } else if (strcmp(key, "checkpoint") == 0) {
+    value = xl->GetHyperParam().checkpoint_file;
+  } else if (strcmp(key, "profile_file") == 0) {
+    value = xl->GetHyperParam().profile_file;
+  } else if (strcmp(key, "trace") == 0) {
+    value = xl->GetHyperParam().trace_file;
+  } else if (strcmp(key, "data_shm") == 0) {
+    value = xl->GetHyperParam().data_shm;
+  } else if (strcmp(key, "feature_stats") == 0) {
+    value = xl->GetHyperParam().feature_stats_file;
+  } else if (strcmp(key, "sweep") == 0) {
+    value = xl->GetHyperParam().sweep;
+  } else if (strcmp(key, "cross") == 0) {
+    value = xl->GetHyperParam().cross;
+  } else if (strcmp(key, "field_pairs") == 0) {
+    value = xl->GetHyperParam().field_pairs;
+  } else if (strcmp(key, "field_k") == 0) {
+    value = xl->GetHyperParam().field_k;
+  } else if (strcmp(key, "bag_field") == 0) {
+    value = xl->GetHyperParam().bag_field;
+  } else if (strcmp(key, "bag_pool") == 0) {
+    value = xl->GetHyperParam().bag_pool;
+  } else if (strcmp(key, "task_loss") == 0) {
+    const std::vector<std::string>& loss = xl->GetHyperParam().task_loss;
+    value.clear();
+    for (size_t i = 0; i < loss.size(); ++i) {
+      if (i > 0) { value += ","; }
+      value += loss[i];
+    }
   }
   API_END();
 }
@@ -387,14 +1114,76 @@ XL_DLL int XLearnSetInt(XL *out, const char *key, const int value) {
     xl->GetHyperParam().num_epoch = value;
   } else if (strcmp(key, "fold") == 0) {
     xl->GetHyperParam().num_folds = value;
+  } else if (strcmp(key, "cv_jobs") == 0) {
+    xl->GetHyperParam().cv_jobs = value;
+  } else if (strcmp(key, "read_jobs") == 0) {
+    xl->GetHyperParam().read_jobs = value;
+  } else if (strcmp(key, "sweep_jobs") == 0) {
+    xl->GetHyperParam().sweep_jobs = value;
   } else if (strcmp(key, "block_size") == 0) {
     xl->GetHyperParam().block_size = value;
+  } else if (strcmp(key, "mem_budget") == 0) {
+    xl->GetHyperParam().mem_budget = value;
+  } else if (strcmp(key, "block_cache") == 0) {
+    xl->GetHyperParam().block_cache = value;
+  } else if (strcmp(key, "param_mem") == 0) {
+    xl->GetHyperParam().param_mem = value;
   } else if (strcmp(key, "nthread") == 0) {
     xl->GetHyperParam().thread_number = value;
   } else if (strcmp(key, "stop_window") == 0) {
     xl->GetHyperParam().stop_window = value;
   } else if (strcmp(key, "seed") == 0) {
     xl->GetHyperParam().seed = value;
+  } else if (strcmp(key, "shuffle_window") == 0) {
+    xl->GetHyperParam().shuffle_window = value;
+  } else if (strcmp(key, "prefetch") == 0) {
+    xl->GetHyperParam().prefetch_distance = value;
+  } else if (strcmp(key, "merge_rows") == 0) {
+    xl->GetHyperParam().merge_rows = value;
+  } else if (strcmp(key, "hot_feature") == 0) {
+    xl->GetHyperParam().num_hot_feature = value;
+  } else if (strcmp(key, "grad_batch") == 0) {
+    xl->GetHyperParam().grad_batch = value;
+  } else if (strcmp(key, "owner_rows") == 0) {
+    xl->GetHyperParam().owner_rows = value;
+  } else if (strcmp(key, "long_row") == 0) {
+    xl->GetHyperParam().long_row = value;
+  } else if (strcmp(key, "sample_row") == 0) {
+    xl->GetHyperParam().sample_row = value;
+  } else if (strcmp(key, "sample_pair") == 0) {
+    xl->GetHyperParam().sample_pair = value;
+  } else if (strcmp(key, "num_label") == 0) {
+    xl->GetHyperParam().num_label = value;
+  } else if (strcmp(key, "min_count") == 0) {
+    xl->GetHyperParam().min_count = value;
+  } else if (strcmp(key, "share_count") == 0) {
+    xl->GetHyperParam().share_count = value;
+  } else if (strcmp(key, "loss_sample_epoch") == 0) {
+    xl->GetHyperParam().loss_sample_epoch = value;
+  } else if (strcmp(key, "valid_every") == 0) {
+    xl->GetHyperParam().valid_every = value;
+  } else if (strcmp(key, "valid_rows") == 0) {
+    xl->GetHyperParam().valid_rows = value;
+  } else if (strcmp(key, "hash_bits") == 0) {
+    xl->GetHyperParam().hash_bits = value;
+  } else if (strcmp(key, "auc_bucket") == 0) {
+    xl->GetHyperParam().auc_bucket = value;
+  } else if (strcmp(key, "numa_sync") == 0) {
+    xl->GetHyperParam().numa_sync = value;
+  } else if (strcmp(key, "checkpoint_epoch") == 0) {
+    xl->GetHyperParam().checkpoint_epoch = value;
+  } else if (strcmp(key, "batch_window") == 0) {
+    xl->GetHyperParam().batch_window = value;
+  } else if (strcmp(key, "batch_rows") == 0) {
+    xl->GetHyperParam().batch_rows = value;
+  } else if (strcmp(key, "result_cache") == 0) {
+    xl->GetHyperParam().result_cache = value;
+  } else if (strcmp(key, "metrics_port") == 0) {
+    xl->GetHyperParam().metrics_port = value;
+  } else if (strcmp(key, "gpu_device") == 0) {
+    xl->GetHyperParam().gpu_device = value;
+  } else if (strcmp(key, "pair_table") == 0) {
+    xl->GetHyperParam().pair_cells = value < 0 ? 0 : value;
   }
   API_END();
 }
@@ -409,12 +1198,74 @@ XL_DLL int XLearnGetInt(XL *out, const char *key, int *value) {
     *value = xl->GetHyperParam().num_epoch;
   } else if (strcmp(key, "fold") == 0) {
     *value = xl->GetHyperParam().num_folds;
+  } else if (strcmp(key, "cv_jobs") == 0) {
+    *value = xl->GetHyperParam().cv_jobs;
+  } else if (strcmp(key, "read_jobs") == 0) {
+    *value = xl->GetHyperParam().read_jobs;
+  } else if (strcmp(key, "sweep_jobs") == 0) {
+    *value = xl->GetHyperParam().sweep_jobs;
   } else if (strcmp(key, "block_size") == 0) {
     *value = xl->GetHyperParam().block_size;
+  } else if (strcmp(key, "mem_budget") == 0) {
+    *value = xl->GetHyperParam().mem_budget;
+  } else if (strcmp(key, "block_cache") == 0) {
+    *value = xl->GetHyperParam().block_cache;
+  } else if (strcmp(key, "param_mem") == 0) {
+    *value = xl->GetHyperParam().param_mem;
   } else if (strcmp(key, "nthread") == 0) {
     *value = xl->GetHyperParam().thread_number;
   } else if (strcmp(key, "stop_window") == 0) {
     *value = xl->GetHyperParam().stop_window;
+  } else if (strcmp(key, "shuffle_window") == 0) {
+    *value = xl->GetHyperParam().shuffle_window;
+  } else if (strcmp(key, "prefetch") == 0) {
+    *value = xl->GetHyperParam().prefetch_distance;
+  } else if (strcmp(key, "merge_rows") == 0) {
+    *value = xl->GetHyperParam().merge_rows;
+  } else if (strcmp(key, "hot_feature") == 0) {
+    *value = xl->GetHyperParam().num_hot_feature;
+  } else if (strcmp(key, "grad_batch") == 0) {
+    *value = xl->GetHyperParam().grad_batch;
+  } else if (strcmp(key, "owner_rows") == 0) {
+    *value = xl->GetHyperParam().owner_rows;
+  } else if (strcmp(key, "long_row") == 0) {
+    *value = xl->GetHyperParam().long_row;
+  } else if (strcmp(key, "sample_row") == 0) {
+    *value = xl->GetHyperParam().sample_row;
+  } else if (strcmp(key, "sample_pair") == 0) {
+    *value = xl->GetHyperParam().sample_pair;
+  } else if (strcmp(key, "num_label") == 0) {
+    *value = xl->GetHyperParam().num_label;
+  } else if (strcmp(key, "min_count") == 0) {
+    *value = xl->GetHyperParam().min_count;
+  } else if (strcmp(key, "share_count") == 0) {
+    *value = xl->GetHyperParam().share_count;
+  } else if (strcmp(key, "loss_sample_epoch") == 0) {
+    *value = xl->GetHyperParam().loss_sample_epoch;
+  } else if (strcmp(key, "valid_every") == 0) {
+    *value = xl->GetHyperParam().valid_every;
+  } else if (strcmp(key, "valid_rows") == 0) {
+    *value = xl->GetHyperParam().valid_rows;
+  } else if (strcmp(key, "hash_bits") == 0) {
+    *value = xl->GetHyperParam().hash_bits;
+  } else if (strcmp(key, "auc_bucket") == 0) {
+    *value = xl->GetHyperParam().auc_bucket;
+  } else if (strcmp(key, "numa_sync") == 0) {
+    *value = xl->GetHyperParam().numa_sync;
+  } else if (strcmp(key, "checkpoint_epoch") == 0) {
+    *value = xl->GetHyperParam().checkpoint_epoch;
+  } else if (strcmp(key, "batch_window") == 0) {
+    *value = xl->GetHyperParam().batch_window;
+  } else if (strcmp(key, "batch_rows") == 0) {
+    *value = xl->GetHyperParam().batch_rows;
+  } else if (strcmp(key, "result_cache") == 0) {
+    *value = xl->GetHyperParam().result_cache;
+  } else if (strcmp(key, "metrics_port") == 0) {
+    *value = xl->GetHyperParam().metrics_port;
+  } else if (strcmp(key, "gpu_device") == 0) {
+    *value = xl->GetHyperParam().gpu_device;
+  } else if (strcmp(key, "pair_table") == 0) {
+    *value = xl->GetHyperParam().pair_cells;
   }
   API_END();
 }
@@ -437,6 +1288,20 @@ XL_DLL int XLearnSetFloat(XL *out, const char *key, const float value) {
     xl->GetHyperParam().lambda_1 = value;
   } else if (strcmp(key, "lambda_2") == 0) {
     xl->GetHyperParam().lambda_2 = value;
+  } else if (strcmp(key, "beta_1") == 0) {
+    xl->GetHyperParam().beta_1 = value;
+  } else if (strcmp(key, "beta_2") == 0) {
+    xl->GetHyperParam().beta_2 = value;
+  } else if (strcmp(key, "neg_rate") == 0) {
+    xl->GetHyperParam().neg_rate = value;
+  } else if (strcmp(key, "loss_sample") == 0) {
+    xl->GetHyperParam().loss_sample = value;
+  } else if (strcmp(key, "valid_sample") == 0) {
+    xl->GetHyperParam().valid_sample = value;
+  } else if (strcmp(key, "checkpoint_minute") == 0) {
+    xl->GetHyperParam().checkpoint_minute = value;
+  } else if (strcmp(key, "prune") == 0) {
+    xl->GetHyperParam().prune = value;
   }
   API_END();
 }
@@ -459,6 +1324,20 @@ XL_DLL int XLearnGetFloat(XL *out, const char *key, float *value) {
     *value = xl->GetHyperParam().lambda_1;
   } else if (strcmp(key, "lambda_2") == 0) {
     *value = xl->GetHyperParam().lambda_2;
+  } else if (strcmp(key, "beta_1") == 0) {
+    *value = xl->GetHyperParam().beta_1;
+  } else if (strcmp(key, "beta_2") == 0) {
+    *value = xl->GetHyperParam().beta_2;
+  } else if (strcmp(key, "neg_rate") == 0) {
+    *value = xl->GetHyperParam().neg_rate;
+  } else if (strcmp(key, "loss_sample") == 0) {
+    *value = xl->GetHyperParam().loss_sample;
+  } else if (strcmp(key, "valid_sample") == 0) {
+    *value = xl->GetHyperParam().valid_sample;
+  } else if (strcmp(key, "checkpoint_minute") == 0) {
+    *value = xl->GetHyperParam().checkpoint_minute;
+  } else if (strcmp(key, "prune") == 0) {
+    *value = xl->GetHyperParam().prune;
   }
   API_END();
 }
@@ -469,6 +1348,14 @@ XL_DLL int XLearnSetBool(XL *out, const char *key, const bool value) {
   XLearn* xl = reinterpret_cast<XLearn*>(*out);
   if (strcmp(key, "on_disk") == 0) {
     xl->GetHyperParam().on_disk = value;
+  } else if (strcmp(key, "auto_block") == 0) {
+    xl->GetHyperParam().auto_block = value;
+  } else if (strcmp(key, "pack_rows") == 0) {
+    xl->GetHyperParam().pack_rows = value;
+  } else if (strcmp(key, "autotune") == 0) {
+    xl->GetHyperParam().autotune = value;
+  } else if (strcmp(key, "checksum") == 0) {
+    xl->GetHyperParam().model_checksum = value;
   } else if (strcmp(key, "quiet") == 0) {
     xl->GetHyperParam().quiet = value;
   } else if (strcmp(key, "norm") == 0) {
@@ -485,6 +1372,42 @@ XL_DLL int XLearnSetBool(XL *out, const char *key, const bool value) {
     xl->GetHyperParam().bin_out = value;
   } else if (strcmp(key, "from_file") == 0) {
     xl->GetHyperParam().from_file = value;
+  } else if (strcmp(key, "lazy_init") == 0) {
+    xl->GetHyperParam().lazy_init = value;
+  } else if (strcmp(key, "lazy_l2") == 0) {
+    xl->GetHyperParam().lazy_l2 = value;
+  } else if (strcmp(key, "huge_page") == 0) {
+    xl->GetHyperParam().huge_page = value;
+  } else if (strcmp(key, "train_metric") == 0) {
+    xl->GetHyperParam().train_metric = value;
+  } else if (strcmp(key, "exact_auc") == 0) {
+    xl->GetHyperParam().exact_auc = value;
+  } else if (strcmp(key, "profile") == 0) {
+    xl->GetHyperParam().profile = value;
+  } else if (strcmp(key, "perf_counter") == 0) {
+    xl->GetHyperParam().perf_counter = value;
+  } else if (strcmp(key, "remap_features") == 0) {
+    xl->GetHyperParam().remap_features = value;
+  } else if (strcmp(key, "remap_fields") == 0) {
+    xl->GetHyperParam().remap_fields = value;
+  } else if (strcmp(key, "async_validate") == 0) {
+    xl->GetHyperParam().async_validate = value;
+  } else if (strcmp(key, "skip_zeros") == 0) {
+    xl->GetHyperParam().skip_zeros = value;
+  } else if (strcmp(key, "merge_dup") == 0) {
+    xl->GetHyperParam().merge_dup = value;
+  } else if (strcmp(key, "sparse_model") == 0) {
+    xl->GetHyperParam().sparse_model = value;
+  } else if (strcmp(key, "sparse_ffm") == 0) {
+    xl->GetHyperParam().sparse_ffm = value;
+  } else if (strcmp(key, "split_ffm") == 0) {
+    xl->GetHyperParam().split_ffm = value;
+  } else if (strcmp(key, "field_major") == 0) {
+    xl->GetHyperParam().field_major = value;
+  } else if (strcmp(key, "raw_out") == 0) {
+    xl->GetHyperParam().raw_out = value;
+  } else if (strcmp(key, "use_gpu") == 0) {
+    xl->GetHyperParam().use_gpu = value;
   }
   API_END();
 }
@@ -495,6 +1418,14 @@ XL_DLL int XLearnGetBool(XL *out, const char *key, bool *value) {
   XLearn* xl = reinterpret_cast<XLearn*>(*out);
   if (strcmp(key, "on_disk") == 0) {
     *value = xl->GetHyperParam().on_disk;
+  } else if (strcmp(key, "auto_block") == 0) {
+    *value = xl->GetHyperParam().auto_block;
+  } else if (strcmp(key, "pack_rows") == 0) {
+    *value = xl->GetHyperParam().pack_rows;
+  } else if (strcmp(key, "autotune") == 0) {
+    *value = xl->GetHyperParam().autotune;
+  } else if (strcmp(key, "checksum") == 0) {
+    *value = xl->GetHyperParam().model_checksum;
   } else if (strcmp(key, "quiet") == 0) {
     *value = xl->GetHyperParam().quiet;
   } else if (strcmp(key, "norm") == 0) {
@@ -507,6 +1438,42 @@ XL_DLL int XLearnGetBool(XL *out, const char *key, bool *value) {
     *value = xl->GetHyperParam().sign = value;
   } else if (strcmp(key, "sigmoid") == 0) {
     *value = xl->GetHyperParam().sigmoid;
+  } else if (strcmp(key, "lazy_init") == 0) {
+    *value = xl->GetHyperParam().lazy_init;
+  } else if (strcmp(key, "lazy_l2") == 0) {
+    *value = xl->GetHyperParam().lazy_l2;
+  } else if (strcmp(key, "huge_page") == 0) {
+    *value = xl->GetHyperParam().huge_page;
+  } else if (strcmp(key, "train_metric") == 0) {
+    *value = xl->GetHyperParam().train_metric;
+  } else if (strcmp(key, "exact_auc") == 0) {
+    *value = xl->GetHyperParam().exact_auc;
+  } else if (strcmp(key, "profile") == 0) {
+    *value = xl->GetHyperParam().profile;
+  } else if (strcmp(key, "perf_counter") == 0) {
+    *value = xl->GetHyperParam().perf_counter;
+  } else if (strcmp(key, "remap_features") == 0) {
+    *value = xl->GetHyperParam().remap_features;
+  } else if (strcmp(key, "remap_fields") == 0) {
+    *value = xl->GetHyperParam().remap_fields;
+  } else if (strcmp(key, "async_validate") == 0) {
+    *value = xl->GetHyperParam().async_validate;
+  } else if (strcmp(key, "skip_zeros") == 0) {
+    *value = xl->GetHyperParam().skip_zeros;
+  } else if (strcmp(key, "merge_dup") == 0) {
+    *value = xl->GetHyperParam().merge_dup;
+  } else if (strcmp(key, "sparse_model") == 0) {
+    *value = xl->GetHyperParam().sparse_model;
+  } else if (strcmp(key, "sparse_ffm") == 0) {
+    *value = xl->GetHyperParam().sparse_ffm;
+  } else if (strcmp(key, "split_ffm") == 0) {
+    *value = xl->GetHyperParam().split_ffm;
+  } else if (strcmp(key, "field_major") == 0) {
+    *value = xl->GetHyperParam().field_major;
+  } else if (strcmp(key, "raw_out") == 0) {
+    *value = xl->GetHyperParam().raw_out;
+  } else if (strcmp(key, "use_gpu") == 0) {
+    *value = xl->GetHyperParam().use_gpu;
   }
   API_END();
 }
@@ -26,7 +26,9 @@ for interfacing to other languages.
 #include "src/data/hyper_parameters.h"
 #include "src/solver/solver.h"
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #ifdef __cplusplus
 #define XL_EXTERN_C extern "C"
@@ -46,6 +48,7 @@ for interfacing to other languages.
 /* Handle to xlearn */
 typedef void* XL;
 typedef void* DataHandle;
+typedef void* PredictHandle;
 
 // Say hello to user
 XL_DLL int XLearnHello();
@@ -61,6 +64,41 @@ XL_DLL int XlearnCreateDataFromMat(const real_t* data,
                                    index_t* field_map,
                                    DataHandle* out);
 
+// Handle the sparse matrix in the CSR format, in which the features
+// of row i are indices[k] and data[k] for k in [indptr[i], indptr[i+1]).
+// The field_map (ncol values) and the label (nrow values) can be NULL.
+XL_DLL int XlearnCreateDataFromCSR(const uint64* indptr,
+                                   const index_t* indices,
+                                   const real_t* data,
+                                   index_t nrow,
+                                   index_t ncol,
+                                   const real_t* label,
+                                   const index_t* field_map,
+                                   DataHandle* out);
+
+// The dense and CSR matrices above are converted by all the cores
+// if they are large. While this one does not copy the features: the
+// nodes (nnz records of uint32 field, uint32 feature and float value,
+// the same as xLearn::Node) of row i are [indptr[i], indptr[i+1]),
+// and the caller keeps them alive and unchanged until the matrix is
+// freed. Only the label (can be NULL) and the norm of rows are kept.
+XL_DLL int XlearnCreateDataView(const uint64* indptr,
+                                const void* nodes,
+                                index_t nrow,
+                                const real_t* label,
+                                DataHandle* out);
+
+// Same as above, but the sparse matrix is in the CSC format, in
+// which indptr has ncol + 1 values, and the indices are the rows.
+XL_DLL int XlearnCreateDataFromCSC(const uint64* indptr,
+                                   const index_t* indices,
+                                   const real_t* data,
+                                   index_t nrow,
+                                   index_t ncol,
+                                   const real_t* label,
+                                   const index_t* field_map,
+                                   DataHandle* out);
+
 // Handle data matrix for xLearn
 XL_DLL int XlearnDataFree(DataHandle* out);
 
@@ -100,23 +138,161 @@ XL_DLL int XLearnSetTXTModel(XL *out, const char *model_path);
 // Get file path of the txt model
 XL_DLL int XLearnGetTXTModel(XL *out, std::string& model_path);
 
+// Set file path of the inference model
+XL_DLL int XLearnSetInferenceModel(XL *out, const char *model_path);
+
+// Get file path of the inference model
+XL_DLL int XLearnGetInferenceModel(XL *out, std::string& model_path);
+
 // Start to train
 XL_DLL int XLearnFit(XL *out, const char *model_path);
 
+// Start to train, and keep the trained model loaded in the handle
+// as XLearnLoadModel() does, without writing the model file
+XL_DLL int XLearnFitInMemory(XL *out);
+
+// Train the loaded model with one pass over the data, which keeps
+// the model and its optimizer state in the handle for the next
+// mini-batch, and the new feature ids grow the model. A new model is
+// created by the first call if no model is loaded. The loss is the
+// training loss of the data, and it can be NULL. The model can be
+// used by XLearnPredict() between the calls, but not at the same time
+XL_DLL int XLearnPartialFit(XL *out, DataHandle *data, float *loss);
+
 // Cross-validation
 XL_DLL int XLearnCV(XL *out);
 
-// Start to predict, this function is for output numpy
+// Start to predict, this function is for output numpy. The
+// out_arr points to the results kept by the handle, which are
+// valid until the next prediction of the same handle.
 XL_DLL int XLearnPredictForMat(XL *out, const char *model_path, 
                                uint64 *length, const float** out_arr);
 
+// Start to predict, and the results are written to the buffer of
+// the caller (e.g., a numpy array), which has length values. The
+// num_rows is the number of the results, and it fails if it is
+// larger than the length.
+XL_DLL int XLearnPredictForBuffer(XL *out, const char *model_path,
+                                  float *out_arr, uint64 length,
+                                  uint64 *num_rows);
+
 // Start to predict, this function is for output file
 XL_DLL int XLearnPredictForFile(XL *out, const char *model_path, 
                                 const char *out_path);
 
+// Load the model once for the following XLearnPredict() calls,
+// which keeps the model and the thread pool resident
+XL_DLL int XLearnLoadModel(XL *out, const char *model_path);
+// Predict the data by the loaded model, and write the
+// length outputs to the buffer out_arr of the caller. It can be
+// called by many threads at the same time, and the calls are
+// predicted in micro-batches if batch_window is set.
+XL_DLL int XLearnPredict(XL *out, DataHandle *data,
+                         float *out_arr, uint64 length);
+// Score the data by the loaded model in the thread of the caller,
+// which can be called by many threads at the same time
+XL_DLL int XLearnScoreRows(XL *out, DataHandle *data,
+                           float *out_arr, uint64 length);
+// Score one row of nnz features in the thread of the caller,
+// and the field_id can be NULL if the model does not use fields
+XL_DLL int XLearnScoreRow(XL *out, const index_t *feat_id,
+                          const index_t *field_id,
+                          const real_t *value,
+                          index_t nnz, float *score);
+// Rank the candidates of one request in the thread of the caller,
+// in which each row of the candidates is scored as the ctx_nnz
+// context features plus its own features, and the context part is
+// computed only once. The ctx_field can be NULL like XLearnScoreRow.
+XL_DLL int XLearnRankCandidates(XL *out, const index_t *ctx_feat,
+                                const index_t *ctx_field,
+                                const real_t *ctx_value,
+                                index_t ctx_nnz,
+                                DataHandle *candidates,
+                                float *out_arr, uint64 length);
+// Open a test file to be predicted by the loaded model batch by batch,
+// which only keeps a few blocks (-block) of the file in memory, and
+// the next blocks are parsed while the caller handles the results.
+// The handle must be closed before the model is unloaded.
+XL_DLL int XLearnPredictOpen(XL *out, const char *test_path,
+                             PredictHandle *iter);
+// Write the results of the next rows of the file to the buffer out_arr
+// of the caller, which are at most length values. The num_rows is the
+// number of the results, and it is 0 at the end of the file
+XL_DLL int XLearnPredictNext(PredictHandle *iter, float *out_arr,
+                             uint64 length, uint64 *num_rows);
+// Close the file of XLearnPredictOpen()
+XL_DLL int XLearnPredictClose(PredictHandle *iter);
+// Load a new version of the loaded model, and swap it in when it
+// is ready, which is done in the background if background is true
+XL_DLL int XLearnReloadModel(XL *out, const char *model_path,
+                             bool background);
+// Wait for the reload in the background
+XL_DLL int XLearnWaitReload(XL *out);
+// Apply the delta file of xlearn_online -delta to the loaded model in
+// place. The applied is false if the model is not the base version of
+// the delta or cannot be written in place (e.g., a mapped inference
+// file), and then the model should be reloaded by XLearnReloadModel()
+XL_DLL int XLearnApplyDelta(XL *out, const char *delta_path,
+                            bool *applied);
+// Get the version of the loaded model, which is increased by each
+// XLearnLoadModel() or XLearnReloadModel(), and 0 if it is not loaded
+XL_DLL int XLearnGetModelVersion(XL *out, uint64 *version);
+// Get the shape of the loaded model. The num_K is 0 for linear
+// model, and the num_field is 0 if the model is not ffm
+XL_DLL int XLearnGetModelShape(XL *out, uint64 *num_feature,
+                               uint64 *num_field, uint64 *num_K);
+// Copy the weights of the loaded model to the buffers of the caller
+// in the order of the TXT model: the linear has the bias and the
+// num_feature linear terms, and the latent has the num_K factors of
+// each feature (fm) or of each feature and field (ffm). The latent
+// can be NULL, and the lengths must be the number of these values
+XL_DLL int XLearnGetModelWeights(XL *out, float *linear,
+                                 uint64 linear_length,
+                                 float *latent,
+                                 uint64 latent_length);
+// Copy the statistics of the thread pool of the last training: for
+// each worker, the number of its tasks and the seconds of running
+// them, of waiting for the work, and of waiting for the lock of the
+// queue. The arrays can be NULL, or have length values at least.
+// num_worker is the number of the workers, and caller_wait is the
+// seconds that the training thread waited for the workers.
+XL_DLL int XLearnGetThreadStats(XL *out, uint64 *tasks, double *busy,
+                                double *idle, double *lock_wait,
+                                uint64 length, uint64 *num_worker,
+                                double *caller_wait);
+// Read the latency of a phase of the XLearnPredict() calls of the
+// loaded model: "queue" (the wait of the micro-batching), "score",
+// "copy" (the results to out_arr), "total" (the whole call), or
+// "build" (the XlearnCreateDataFromMat/CSR/CSC/View calls of all the
+// handles of the process). values[i] is the seconds of the quantile
+// quantiles[i] in [0, 1] (e.g., 0.99), which is within 6% of the
+// true one. count is the number of the calls, and mean and max are
+// seconds (they can be NULL). If reset is true, the calls are removed,
+// so that each read gives the latency of one interval.
+XL_DLL int XLearnGetPredictLatency(XL *out, const char *phase,
+                                   const double *quantiles,
+                                   double *values, uint64 length,
+                                   uint64 *count, double *mean,
+                                   double *max, bool reset);
+// Save the loaded model to a model file
+XL_DLL int XLearnSaveModel(XL *out, const char *model_path);
+// Release the loaded model
+XL_DLL int XLearnUnloadModel(XL *out);
 // Set DMatrix
 XL_DLL int XLearnSetDMatrix(XL *out, const char *key, DataHandle *out_data);
 
+// Set the training ("train") or the validation ("validate") data to
+// the batches of the callbacks (see xLearn::DataIter), which are
+// replayed in each epoch, so the data is streamed from the loader of
+// the caller. next() returns the rows of the next batch (0 at the end
+// of a pass) and sets its indptr, nodes (as XlearnCreateDataView())
+// and label, which are kept until the next call. reset() (can be
+// NULL) starts the next pass. The NULL next() unsets the data.
+XL_DLL int XLearnSetDataIter(XL *out, const char *key,
+                             xLearn::DataIter::NextFunc next,
+                             xLearn::DataIter::ResetFunc reset,
+                             void *handle);
+
 // Set string param
 XL_DLL int XLearnSetStr(XL *out, const char *key, const char *value);
 
@@ -157,12 +333,33 @@ class XLearn {
     return solver; 
   }
 
+  inline xLearn::Solver& GetPredictor() {
+    return predictor;
+  }
+
+  inline std::vector<real_t>& GetResult() {
+    return result;
+  }
+
  protected:
    xLearn::HyperParam hyper_param;
    xLearn::Solver solver;
+   /* The model loaded by XLearnLoadModel() */
+   xLearn::Solver predictor;
+   /* The results of XLearnPredictForMat() */
+   std::vector<real_t> result;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(XLearn);
 };
 
+// The state of XLearnPredictOpen(): the reader of the test file,
+// and the results of its current block that are not returned yet.
+struct PredictIter {
+  XLearn* xl;
+  std::unique_ptr<xLearn::Reader> reader;
+  std::vector<real_t> result;
+  size_t next;
+};
+
 #endif  // XLEARN_C_API_C_API_H_
\ No newline at end of file
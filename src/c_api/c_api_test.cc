@@ -20,7 +20,18 @@ This file tests c_api.h file.
 
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/file_util.h"
 #include "src/c_api/c_api.h"
+#include "src/data/model_parameters.h"
+#include "src/solver/checkpoint.h"
 
 TEST(C_API_TEST, Initialize) {
   XL xlearn;
@@ -46,6 +57,7 @@ TEST(C_API_TEST, Initialize) {
   EXPECT_EQ(XLearnSetFloat(&xlearn, "init", 0.1), 0);
   EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 3), 0);
   EXPECT_EQ(XLearnSetInt(&xlearn, "fold", 10), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "cv_jobs", 2), 0);
   EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 3), 0);
   EXPECT_EQ(XLearnSetBool(&xlearn, "on_disk", true), 0);
   EXPECT_EQ(XLearnSetBool(&xlearn, "lock_free", false), 0);
@@ -55,6 +67,7 @@ TEST(C_API_TEST, Initialize) {
   EXPECT_EQ(XLearnSetBool(&xlearn, "sign", true), 0);
   EXPECT_EQ(XLearnSetBool(&xlearn, "sigmoid", true), 0);
   EXPECT_EQ(XLearnSetInt(&xlearn, "block_size", 256), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "mem_budget", 1024), 0);
   EXPECT_EQ(XLearnShow(&xlearn), 0);
   // Get
   XLearn* xl = reinterpret_cast<XLearn*>(xlearn);
@@ -78,6 +91,7 @@ TEST(C_API_TEST, Initialize) {
   EXPECT_FLOAT_EQ(xl->GetHyperParam().lambda_2, 0.1);
   EXPECT_EQ(xl->GetHyperParam().num_epoch, 3);
   EXPECT_EQ(xl->GetHyperParam().num_folds, 10);
+  EXPECT_EQ(xl->GetHyperParam().cv_jobs, 2);
   EXPECT_EQ(xl->GetHyperParam().thread_number, 3);
   EXPECT_EQ(xl->GetHyperParam().on_disk, true);
   EXPECT_EQ(xl->GetHyperParam().lock_free, false);
@@ -87,5 +101,1417 @@ TEST(C_API_TEST, Initialize) {
   EXPECT_EQ(xl->GetHyperParam().sign, true);
   EXPECT_EQ(xl->GetHyperParam().sigmoid, true);
   EXPECT_EQ(xl->GetHyperParam().block_size, 256);
+  EXPECT_EQ(xl->GetHyperParam().mem_budget, 1024);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+}
+// The matrix of 3 rows and 4 columns:
+//   [ 1 0 2 0 ]
+//   [ 0 0 0 0 ]
+//   [ 0 3 0 4 ]
+TEST(C_API_TEST, CreateDataFromCSR_CSC) {
+  const uint64 csr_indptr[4] = { 0, 2, 2, 4 };
+  const index_t csr_indices[4] = { 0, 2, 1, 3 };
+  const real_t csr_data[4] = { 1, 2, 3, 4 };
+  const uint64 csc_indptr[5] = { 0, 1, 2, 3, 4 };
+  const index_t csc_indices[4] = { 0, 2, 0, 2 };
+  const real_t csc_data[4] = { 1, 3, 2, 4 };
+  const real_t label[3] = { 1, 0, 1 };
+  const index_t field_map[4] = { 0, 1, 1, 2 };
+  DataHandle csr, csc;
+  EXPECT_EQ(XlearnCreateDataFromCSR(csr_indptr, csr_indices, csr_data,
+                                    3, 4, label, field_map, &csr), 0);
+  EXPECT_EQ(XlearnCreateDataFromCSC(csc_indptr, csc_indices, csc_data,
+                                    3, 4, label, field_map, &csc), 0);
+  DataHandle handles[2] = { csr, csc };
+  for (int t = 0; t < 2; ++t) {
+    xLearn::DMatrix* matrix =
+      reinterpret_cast<xLearn::DMatrix*>(handles[t]);
+    ASSERT_EQ(matrix->row_length, 3);
+    EXPECT_TRUE(matrix->has_label);
+    ASSERT_EQ(matrix->row[0]->size(), 2);
+    EXPECT_EQ((*matrix->row[0])[1].feat_id, 2);
+    EXPECT_EQ((*matrix->row[0])[1].field_id, 1);
+    EXPECT_FLOAT_EQ((*matrix->row[0])[1].feat_val, 2);
+    EXPECT_EQ(matrix->row[1]->size(), 0);
+    ASSERT_EQ(matrix->row[2]->size(), 2);
+    EXPECT_EQ((*matrix->row[2])[0].feat_id, 1);
+    EXPECT_EQ((*matrix->row[2])[1].field_id, 2);
+    EXPECT_FLOAT_EQ((*matrix->row[2])[1].feat_val, 4);
+    EXPECT_FLOAT_EQ(matrix->Y[2], 1);
+    EXPECT_FLOAT_EQ(matrix->norm[0], 1.0 / 5);
+    EXPECT_FLOAT_EQ(matrix->norm[2], 1.0 / 25);
+    EXPECT_EQ(XlearnDataFree(&handles[t]), 0);
+  }
+  // The index is out of range
+  const index_t bad_indices[4] = { 0, 4, 1, 3 };
+  DataHandle bad;
+  EXPECT_NE(XlearnCreateDataFromCSR(csr_indptr, bad_indices, csr_data,
+                                    3, 4, nullptr, nullptr, &bad), 0);
+  EXPECT_NE(XlearnCreateDataFromCSC(csc_indptr, bad_indices, csc_data,
+                                    3, 4, nullptr, nullptr, &bad), 0);
+}
+
+TEST(C_API_TEST, CreateDataView) {
+  // The rows of 2, 0 and 1 nodes owned by the test
+  const uint64 indptr[4] = { 0, 2, 2, 3 };
+  const xLearn::Node nodes[3] = { xLearn::Node(0, 1, 2.0),
+                                  xLearn::Node(1, 3, 1.0),
+                                  xLearn::Node(2, 5, 4.0) };
+  const real_t label[3] = { 1, 0, 1 };
+  DataHandle view;
+  EXPECT_EQ(XlearnCreateDataView(indptr, nodes, 3, label, &view), 0);
+  xLearn::DMatrix* matrix = reinterpret_cast<xLearn::DMatrix*>(view);
+  ASSERT_EQ(matrix->row_length, 3);
+  EXPECT_TRUE(matrix->has_label);
+  // The nodes are not copied
+  EXPECT_EQ(matrix->row[0]->data(), &nodes[0]);
+  EXPECT_EQ(matrix->row[0]->size(), 2);
+  EXPECT_EQ(matrix->row[1]->size(), 0);
+  EXPECT_EQ(matrix->row[2]->data(), &nodes[2]);
+  EXPECT_FLOAT_EQ(matrix->Y[2], 1);
+  EXPECT_FLOAT_EQ(matrix->norm[0], 1.0 / 5);
+  EXPECT_FLOAT_EQ(matrix->norm[2], 1.0 / 16);
+  // A change of the row copies it first
+  matrix->arena.PushBack(matrix->row[2], xLearn::Node(0, 7, 1.0));
+  EXPECT_NE(matrix->row[2]->data(), &nodes[2]);
+  EXPECT_EQ(matrix->row[2]->size(), 2);
+  EXPECT_EQ(nodes[2].feat_id, 5);
+  EXPECT_EQ(XlearnDataFree(&view), 0);
+}
+
+// The large matrix is filled by the threads
+TEST(C_API_TEST, CreateDataFromMat_large) {
+  const index_t nrow = 2048;
+  const index_t ncol = 600;
+  std::vector<real_t> data(nrow * ncol);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (i % 7) * 0.5;
+  }
+  DataHandle handle;
+  EXPECT_EQ(XlearnCreateDataFromMat(data.data(), nrow, ncol, nullptr,
+                                    nullptr, &handle), 0);
+  xLearn::DMatrix* matrix = reinterpret_cast<xLearn::DMatrix*>(handle);
+  ASSERT_EQ(matrix->row_length, nrow);
+  EXPECT_FALSE(matrix->has_label);
+  for (index_t i = 0; i < nrow; i += 97) {
+    ASSERT_EQ(matrix->row[i]->size(), ncol);
+    real_t norm = 0;
+    for (index_t j = 0; j < ncol; ++j) {
+      real_t value = data[i * ncol + j];
+      EXPECT_EQ((*matrix->row[i])[j].feat_id, j);
+      EXPECT_FLOAT_EQ((*matrix->row[i])[j].feat_val, value);
+      norm += value * value;
+    }
+    EXPECT_FLOAT_EQ(matrix->norm[i], 1.0f / norm);
+  }
+  EXPECT_EQ(XlearnDataFree(&handle), 0);
+}
+
+TEST(C_API_TEST, LoadModel) {
+  // A linear model: score = 0.5 + sum (j+1) * x_j
+  const std::string filename = "./c_api_test.model";
+  xLearn::Model model;
+  model.Initialize("linear", "squared", 3, 0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  for (index_t j = 0; j < 3; ++j) { w[j*2] = j + 1; }
+  model.GetParameter_b()[0] = 0.5;
+  model.Serialize(filename);
+  const real_t data[6] = { 1.0, 0.0, 2.0,
+                           0.5, 1.0, 0.0 };
+  const real_t expect[2] = { 7.5, 3.0 };
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data, 2, 3, nullptr,
+                                    nullptr, &matrix), 0);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  float out[2];
+  // The model is not loaded
+  EXPECT_NE(XLearnPredict(&xlearn, &matrix, out, 2), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename.c_str()), 0);
+  // The model stays loaded for each call
+  for (int k = 0; k < 3; ++k) {
+    EXPECT_EQ(XLearnPredict(&xlearn, &matrix, out, 2), 0);
+    EXPECT_FLOAT_EQ(out[0], expect[0]);
+    EXPECT_FLOAT_EQ(out[1], expect[1]);
+  }
+  // The buffer must have one value for each row
+  EXPECT_NE(XLearnPredict(&xlearn, &matrix, out, 1), 0);
+  // Reload with the sigmoid
+  EXPECT_EQ(XLearnSetBool(&xlearn, "sigmoid", true), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename.c_str()), 0);
+  EXPECT_EQ(XLearnPredict(&xlearn, &matrix, out, 2), 0);
+  EXPECT_FLOAT_EQ(out[1], 1.0 / (1.0 + exp(-expect[1])));
+  EXPECT_EQ(XLearnUnloadModel(&xlearn), 0);
+  EXPECT_NE(XLearnPredict(&xlearn, &matrix, out, 2), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, PredictForBuffer) {
+  // A linear model: score = 0.5 + sum (j+1) * x_j
+  const std::string filename = "./c_api_test.model";
+  xLearn::Model model;
+  model.Initialize("linear", "squared", 3, 0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  for (index_t j = 0; j < 3; ++j) { w[j*2] = j + 1; }
+  model.GetParameter_b()[0] = 0.5;
+  model.Serialize(filename);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  const real_t data[6] = { 1.0, 0.0, 2.0,
+                           0.5, 1.0, 0.0 };
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data, 2, 3, nullptr,
+                                    nullptr, &matrix), 0);
+  EXPECT_EQ(XLearnSetDMatrix(&xlearn, "test", &matrix), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "from_file", false), 0);
+  float out[3] = { -1, -1, -1 };
+  uint64 num_rows = 0;
+  EXPECT_EQ(XLearnPredictForBuffer(&xlearn, filename.c_str(),
+                                   out, 3, &num_rows), 0);
+  EXPECT_EQ(num_rows, 2);
+  EXPECT_FLOAT_EQ(out[0], 7.5);
+  EXPECT_FLOAT_EQ(out[1], 3.0);
+  // The buffer after the results is not written
+  EXPECT_FLOAT_EQ(out[2], -1);
+  // Same as the results kept by the handle
+  uint64 length = 0;
+  const float* preds = nullptr;
+  EXPECT_EQ(XLearnPredictForMat(&xlearn, filename.c_str(),
+                                &length, &preds), 0);
+  EXPECT_EQ(length, 2);
+  EXPECT_FLOAT_EQ(preds[0], out[0]);
+  EXPECT_FLOAT_EQ(preds[1], out[1]);
+  // The buffer is too small
+  EXPECT_NE(XLearnPredictForBuffer(&xlearn, filename.c_str(),
+                                   out, 1, &num_rows), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, FitInMemory) {
+  const std::string filename = "./c_api_test.model";
+  const index_t kRows = 8, kCols = 3;
+  std::vector<real_t> data(kRows * kCols);
+  std::vector<real_t> label(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    for (index_t j = 0; j < kCols; ++j) {
+      data[i*kCols+j] = (i + j) % 3 == 0 ? 0 : (i * j) % 5 + 1;
+    }
+    label[i] = i % 2;
+  }
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data.data(), kRows, kCols,
+                                    label.data(), nullptr, &matrix), 0);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "loss", "squared"), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 2), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+  EXPECT_EQ(XLearnSetDMatrix(&xlearn, "train", &matrix), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "from_file", false), 0);
+  uint64 num_feature = 0, num_field = 0, num_K = 0;
+  // The model is not loaded
+  EXPECT_NE(XLearnGetModelShape(&xlearn, &num_feature,
+                                &num_field, &num_K), 0);
+  EXPECT_EQ(XLearnFitInMemory(&xlearn), 0);
+  EXPECT_FALSE(FileExist(filename.c_str()));
+  EXPECT_EQ(XLearnGetModelShape(&xlearn, &num_feature,
+                                &num_field, &num_K), 0);
+  EXPECT_EQ(num_feature, kCols);
+  EXPECT_EQ(num_field, 0);
+  EXPECT_EQ(num_K, 2);
+  std::vector<float> linear(num_feature + 1);
+  std::vector<float> latent(num_feature * num_K);
+  EXPECT_NE(XLearnGetModelWeights(&xlearn, linear.data(), 2,
+                                  latent.data(), latent.size()), 0);
+  EXPECT_NE(XLearnGetModelWeights(&xlearn, linear.data(), linear.size(),
+                                  latent.data(), 1), 0);
+  EXPECT_EQ(XLearnGetModelWeights(&xlearn, linear.data(), linear.size(),
+                                  latent.data(), latent.size()), 0);
+  // The predictions of the kept model are given by the weights
+  std::vector<float> out(kRows);
+  EXPECT_EQ(XLearnPredict(&xlearn, &matrix, out.data(), kRows), 0);
+  for (index_t i = 0; i < kRows; ++i) {
+    const real_t* x = &data[i*kCols];
+    real_t score = linear[0];
+    for (index_t j = 0; j < kCols; ++j) {
+      score += linear[j+1] * x[j];
+      for (index_t k = j + 1; k < kCols; ++k) {
+        for (index_t d = 0; d < num_K; ++d) {
+          score += latent[j*num_K+d] * latent[k*num_K+d] * x[j] * x[k];
+        }
+      }
+    }
+    EXPECT_NEAR(out[i], score, 1e-5);
+  }
+  // Same as the model file of the same training
+  EXPECT_EQ(XLearnFit(&xlearn, filename.c_str()), 0);
+  XL loaded;
+  EXPECT_EQ(XLearnCreate("fm", &loaded), 0);
+  EXPECT_EQ(XLearnSetBool(&loaded, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&loaded, "norm", false), 0);
+  EXPECT_EQ(XLearnLoadModel(&loaded, filename.c_str()), 0);
+  std::vector<float> file_out(kRows);
+  EXPECT_EQ(XLearnPredict(&loaded, &matrix, file_out.data(), kRows), 0);
+  for (index_t i = 0; i < kRows; ++i) {
+    EXPECT_FLOAT_EQ(file_out[i], out[i]);
+  }
+  // The kept model is saved as a model file
+  RemoveFile(filename.c_str());
+  EXPECT_EQ(XLearnSaveModel(&xlearn, filename.c_str()), 0);
+  EXPECT_EQ(XLearnLoadModel(&loaded, filename.c_str()), 0);
+  EXPECT_EQ(XLearnPredict(&loaded, &matrix, file_out.data(), kRows), 0);
+  for (index_t i = 0; i < kRows; ++i) {
+    EXPECT_FLOAT_EQ(file_out[i], out[i]);
+  }
+  EXPECT_EQ(XLearnHandleFree(&loaded), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, PartialFit) {
+  // Two mini-batches, and the second one has the new features
+  const real_t data_1[8] = { 1.0, 0.0, 2.0, 0.0,
+                             0.0, 1.0, 0.0, 3.0 };
+  const real_t label_1[2] = { 1.0, 0.0 };
+  // The sparse rows of the second batch, which has no feature 3
+  const uint64 indptr_2[4] = { 0, 2, 4, 5 };
+  const index_t indices_2[5] = { 1, 5, 0, 4, 2 };
+  const real_t data_2[5] = { 1.0, 2.0, 1.0, 1.0, 1.0 };
+  const real_t label_2[3] = { 1.0, 0.0, 1.0 };
+  DataHandle batch_1, batch_2, test;
+  EXPECT_EQ(XlearnCreateDataFromMat(data_1, 2, 4, label_1,
+                                    nullptr, &batch_1), 0);
+  EXPECT_EQ(XlearnCreateDataFromCSR(indptr_2, indices_2, data_2, 3, 6,
+                                    label_2, nullptr, &batch_2), 0);
+  EXPECT_EQ(XlearnCreateDataFromCSR(indptr_2, indices_2, data_2, 3, 6,
+                                    nullptr, nullptr, &test), 0);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "opt", "adagrad"), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+  // The data of training must have labels
+  EXPECT_NE(XLearnPartialFit(&xlearn, &test, nullptr), 0);
+  float loss = 0;
+  EXPECT_EQ(XLearnPartialFit(&xlearn, &batch_1, &loss), 0);
+  EXPECT_GT(loss, 0);
+  uint64 num_feature = 0, num_field = 0, num_K = 0;
+  EXPECT_EQ(XLearnGetModelShape(&xlearn, &num_feature,
+                                &num_field, &num_K), 0);
+  EXPECT_EQ(num_feature, 4);
+  std::vector<float> linear_1(num_feature + 1);
+  EXPECT_EQ(XLearnGetModelWeights(&xlearn, linear_1.data(),
+                                  linear_1.size(), nullptr, 0), 0);
+  // The model grows for the new features of the next batch
+  float first = 0, last = 0;
+  for (int n = 0; n < 20; ++n) {
+    EXPECT_EQ(XLearnPartialFit(&xlearn, &batch_2, &loss), 0);
+    if (n == 0) { first = loss; }
+    last = loss;
+  }
+  EXPECT_LT(last, first);
+  EXPECT_EQ(XLearnGetModelShape(&xlearn, &num_feature,
+                                &num_field, &num_K), 0);
+  EXPECT_EQ(num_feature, 6);
+  std::vector<float> linear_2(num_feature + 1);
+  EXPECT_EQ(XLearnGetModelWeights(&xlearn, linear_2.data(),
+                                  linear_2.size(), nullptr, 0), 0);
+  // Feature 3 is not in the second batch
+  EXPECT_FLOAT_EQ(linear_2[4], linear_1[4]);
+  EXPECT_NE(linear_2[6], 0);
+  // The model is loaded for the prediction between the batches
+  float out[3];
+  EXPECT_EQ(XLearnPredict(&xlearn, &test, out, 3), 0);
+  EXPECT_GT(out[0], out[1]);
+  // The loaded model must be trained by the same optimizer
+  EXPECT_EQ(XLearnSetStr(&xlearn, "opt", "ftrl"), 0);
+  EXPECT_NE(XLearnPartialFit(&xlearn, &batch_1, &loss), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  EXPECT_EQ(XlearnDataFree(&batch_1), 0);
+  EXPECT_EQ(XlearnDataFree(&batch_2), 0);
+  EXPECT_EQ(XlearnDataFree(&test), 0);
+}
+
+TEST(C_API_TEST, ScoreRow) {
+  // A linear model: score = 0.5 + sum (j+1) * x_j
+  const std::string filename = "./c_api_test.model";
+  xLearn::Model model;
+  model.Initialize("linear", "squared", 3, 0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  for (index_t j = 0; j < 3; ++j) { w[j*2] = j + 1; }
+  model.GetParameter_b()[0] = 0.5;
+  model.Serialize(filename);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  const index_t feat_id[2] = { 0, 2 };
+  const real_t value[2] = { 1.0, 2.0 };
+  float score = 0;
+  // The model is not loaded
+  EXPECT_NE(XLearnScoreRow(&xlearn, feat_id, nullptr,
+                           value, 2, &score), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename.c_str()), 0);
+  // Many threads score the rows at the same time
+  std::vector<std::thread> threads;
+  std::vector<int> errors(4, 0);
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      for (int k = 0; k < 1000; ++k) {
+        float s = 0;
+        if (XLearnScoreRow(&xlearn, feat_id, nullptr,
+                           value, 2, &s) != 0 || s != 7.5) {
+          errors[t]++;
+        }
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  for (int t = 0; t < 4; ++t) {
+    EXPECT_EQ(errors[t], 0);
+  }
+  // The rows of the matrix are the same as XLearnPredict()
+  const real_t data[6] = { 1.0, 0.0, 2.0,
+                           0.5, 1.0, 0.0 };
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data, 2, 3, nullptr,
+                                    nullptr, &matrix), 0);
+  float out[2];
+  float pred[2];
+  EXPECT_EQ(XLearnScoreRows(&xlearn, &matrix, out, 2), 0);
+  EXPECT_EQ(XLearnPredict(&xlearn, &matrix, pred, 2), 0);
+  EXPECT_FLOAT_EQ(out[0], pred[0]);
+  EXPECT_FLOAT_EQ(out[1], pred[1]);
+  EXPECT_NE(XLearnScoreRows(&xlearn, &matrix, out, 3), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
   EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
-}
\ No newline at end of file
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, RankCandidates) {
+  const std::string filename = "./c_api_test.model";
+  xLearn::Model model;
+  model.Initialize("fm", "squared", 4, 1, 4, 2, 0.5);
+  model.GetParameter_b()[0] = 0.5;
+  model.Serialize(filename);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  // The context feature 0 and two candidates of features 1 to 3
+  const index_t ctx_feat[1] = { 0 };
+  const real_t ctx_value[1] = { 2.0 };
+  const real_t data[8] = { 0.0, 1.0, 0.0, 2.0,
+                           0.0, 0.0, 0.5, 1.5 };
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data, 2, 4, nullptr,
+                                    nullptr, &matrix), 0);
+  float out[2];
+  // The model is not loaded
+  EXPECT_NE(XLearnRankCandidates(&xlearn, ctx_feat, nullptr, ctx_value,
+                                 1, &matrix, out, 2), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename.c_str()), 0);
+  EXPECT_EQ(XLearnRankCandidates(&xlearn, ctx_feat, nullptr, ctx_value,
+                                 1, &matrix, out, 2), 0);
+  // Same as the score of the whole row
+  for (index_t i = 0; i < 2; ++i) {
+    std::vector<index_t> feat(1, ctx_feat[0]);
+    std::vector<real_t> value(1, ctx_value[0]);
+    for (index_t j = 0; j < 4; ++j) {
+      if (data[i*4+j] == 0) continue;
+      feat.push_back(j);
+      value.push_back(data[i*4+j]);
+    }
+    float score = 0;
+    EXPECT_EQ(XLearnScoreRow(&xlearn, feat.data(), nullptr, value.data(),
+                             feat.size(), &score), 0);
+    EXPECT_NEAR(out[i], score, 1e-5);
+  }
+  EXPECT_NE(XLearnRankCandidates(&xlearn, ctx_feat, nullptr, ctx_value,
+                                 1, &matrix, out, 3), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, Predict_batching) {
+  // A linear model: score = 0.5 + sum (j+1) * x_j
+  const std::string filename = "./c_api_test.model";
+  xLearn::Model model;
+  model.Initialize("linear", "squared", 3, 0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  for (index_t j = 0; j < 3; ++j) { w[j*2] = j + 1; }
+  model.GetParameter_b()[0] = 0.5;
+  model.Serialize(filename);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "batch_window", 500), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "batch_rows", 5), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename.c_str()), 0);
+  // Each thread predicts its own rows, which are
+  // batched with the rows of the other threads
+  const int kThreads = 4;
+  std::vector<std::thread> threads;
+  std::vector<int> errors(kThreads, 0);
+  for (int t = 0; t < kThreads; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      real_t data[6] = { 1.0, 0.0, 2.0,
+                         0.5, 1.0, 0.0 };
+      data[1] = static_cast<real_t>(t);
+      const real_t expect[2] = { 7.5f + 2 * t, 3.0 };
+      DataHandle matrix;
+      if (XlearnCreateDataFromMat(data, 2, 3, nullptr,
+                                  nullptr, &matrix) != 0) {
+        errors[t]++;
+        return;
+      }
+      for (int k = 0; k < 100; ++k) {
+        float out[2] = { 0, 0 };
+        if (XLearnPredict(&xlearn, &matrix, out, 2) != 0 ||
+            out[0] != expect[0] || out[1] != expect[1]) {
+          errors[t]++;
+        }
+      }
+      XlearnDataFree(&matrix);
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    EXPECT_EQ(errors[t], 0);
+  }
+  // The latency of each phase of the calls, and the
+  // calls are removed by the reset of the interval
+  const double quantiles[3] = { 0.5, 0.99, 1.0 };
+  double values[3];
+  uint64 count = 0;
+  double mean = 0, max = 0;
+  const char* phases[4] = { "queue", "score", "copy", "total" };
+  for (int p = 0; p < 4; ++p) {
+    EXPECT_EQ(XLearnGetPredictLatency(&xlearn, phases[p], quantiles,
+                                      values, 3, &count, &mean,
+                                      &max, false), 0);
+    EXPECT_EQ(count, kThreads * 100);
+    EXPECT_LE(values[0], values[1]);
+    EXPECT_LE(values[1], values[2]);
+    EXPECT_DOUBLE_EQ(values[2], max);
+    EXPECT_LE(mean, max);
+  }
+  EXPECT_EQ(XLearnGetPredictLatency(&xlearn, "build", quantiles, values,
+                                    3, &count, nullptr, nullptr, false), 0);
+  EXPECT_GE(count, kThreads);
+  EXPECT_EQ(XLearnGetPredictLatency(&xlearn, "total", quantiles, values,
+                                    3, &count, nullptr, nullptr, true), 0);
+  EXPECT_EQ(count, kThreads * 100);
+  EXPECT_EQ(XLearnGetPredictLatency(&xlearn, "total", quantiles, values,
+                                    3, &count, nullptr, &max, false), 0);
+  EXPECT_EQ(count, 0);
+  EXPECT_EQ(values[1], 0);
+  EXPECT_EQ(max, 0);
+  EXPECT_NE(XLearnGetPredictLatency(&xlearn, "wait", quantiles, values,
+                                    3, &count, nullptr, nullptr, false), 0);
+  EXPECT_EQ(XLearnUnloadModel(&xlearn), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, Result_cache) {
+  // Two versions of a linear model: score = bias + sum (j+1) * x_j
+  const std::string filename_1 = "./c_api_test_1.model";
+  const std::string filename_2 = "./c_api_test_2.model";
+  for (int k = 1; k <= 2; ++k) {
+    xLearn::Model model;
+    model.Initialize("linear", "squared", 3, 0, 0, 2);
+    real_t* w = model.GetParameter_w();
+    for (index_t j = 0; j < 3; ++j) { w[j*2] = j + 1; }
+    model.GetParameter_b()[0] = k * 10;
+    model.Serialize(k == 1 ? filename_1 : filename_2);
+  }
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "result_cache", 4), 0);
+  int entries = 0;
+  EXPECT_EQ(XLearnGetInt(&xlearn, "result_cache", &entries), 0);
+  EXPECT_EQ(entries, 4);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename_1.c_str()), 0);
+  // The same nodes in another order hit the cache
+  const index_t feat_id[2] = { 0, 2 };
+  const index_t feat_id_2[2] = { 2, 0 };
+  const real_t value[2] = { 1.0, 2.0 };
+  const real_t value_2[2] = { 2.0, 1.0 };
+  float score = 0;
+  for (int k = 0; k < 2; ++k) {
+    EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, nullptr,
+                             value, 2, &score), 0);
+    EXPECT_FLOAT_EQ(score, 17);
+    EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id_2, nullptr,
+                             value_2, 2, &score), 0);
+    EXPECT_FLOAT_EQ(score, 17);
+  }
+  // More rows than the cache, which are repeated
+  real_t data[12] = { 1.0, 0.0, 0.0,
+                      0.0, 1.0, 0.0,
+                      1.0, 0.0, 0.0,
+                      0.0, 0.0, 1.0 };
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data, 4, 3, nullptr,
+                                    nullptr, &matrix), 0);
+  for (int k = 0; k < 20; ++k) {
+    float out[4] = { 0, 0, 0, 0 };
+    EXPECT_EQ(XLearnPredict(&xlearn, &matrix, out, 4), 0);
+    EXPECT_FLOAT_EQ(out[0], 11);
+    EXPECT_FLOAT_EQ(out[1], 12);
+    EXPECT_FLOAT_EQ(out[2], 11);
+    EXPECT_FLOAT_EQ(out[3], 13);
+  }
+  // The new version does not use the cache of the old one
+  EXPECT_EQ(XLearnReloadModel(&xlearn, filename_2.c_str(), false), 0);
+  EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, nullptr, value, 2, &score), 0);
+  EXPECT_FLOAT_EQ(score, 27);
+  float out[4] = { 0, 0, 0, 0 };
+  EXPECT_EQ(XLearnScoreRows(&xlearn, &matrix, out, 4), 0);
+  EXPECT_FLOAT_EQ(out[0], 21);
+  EXPECT_FLOAT_EQ(out[3], 23);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+  EXPECT_EQ(XLearnUnloadModel(&xlearn), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(filename_1.c_str());
+  RemoveFile(filename_2.c_str());
+}
+
+TEST(C_API_TEST, ReloadModel) {
+  // Two versions of a linear model: score = bias + sum (j+1) * x_j
+  const std::string filename_1 = "./c_api_test_1.model";
+  const std::string filename_2 = "./c_api_test_2.model";
+  for (int k = 1; k <= 2; ++k) {
+    xLearn::Model model;
+    model.Initialize("linear", "squared", 3, 0, 0, 2);
+    real_t* w = model.GetParameter_w();
+    for (index_t j = 0; j < 3; ++j) { w[j*2] = j + 1; }
+    model.GetParameter_b()[0] = k * 10;
+    model.Serialize(k == 1 ? filename_1 : filename_2);
+  }
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  uint64 version = 1;
+  EXPECT_EQ(XLearnGetModelVersion(&xlearn, &version), 0);
+  EXPECT_EQ(version, 0);
+  EXPECT_NE(XLearnReloadModel(&xlearn, filename_2.c_str(), false), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename_1.c_str()), 0);
+  const index_t feat_id[1] = { 0 };
+  const real_t value[1] = { 1.0 };
+  float score = 0;
+  EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, nullptr, value, 1, &score), 0);
+  EXPECT_FLOAT_EQ(score, 11);
+  EXPECT_EQ(XLearnReloadModel(&xlearn, filename_2.c_str(), false), 0);
+  EXPECT_EQ(XLearnGetModelVersion(&xlearn, &version), 0);
+  EXPECT_EQ(version, 2);
+  EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, nullptr, value, 1, &score), 0);
+  EXPECT_FLOAT_EQ(score, 21);
+  // The threads score the rows while the models are swapped
+  // in the background, and each row gets one of the versions
+  std::atomic<bool> stop(false);
+  std::atomic<int> errors(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; ++t) {
+    threads.push_back(std::thread([&]() {
+      while (!stop) {
+        float s = 0;
+        if (XLearnScoreRow(&xlearn, feat_id, nullptr,
+                           value, 1, &s) != 0 ||
+            (s != 11 && s != 21)) {
+          errors++;
+        }
+      }
+    }));
+  }
+  for (int k = 0; k < 4; ++k) {
+    const std::string& filename = k % 2 == 0 ? filename_1 : filename_2;
+    EXPECT_EQ(XLearnReloadModel(&xlearn, filename.c_str(), true), 0);
+    EXPECT_EQ(XLearnWaitReload(&xlearn), 0);
+  }
+  stop = true;
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  EXPECT_EQ(errors, 0);
+  EXPECT_EQ(XLearnGetModelVersion(&xlearn, &version), 0);
+  EXPECT_EQ(version, 6);
+  EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, nullptr, value, 1, &score), 0);
+  EXPECT_FLOAT_EQ(score, 21);
+  EXPECT_EQ(XLearnUnloadModel(&xlearn), 0);
+  EXPECT_EQ(XLearnGetModelVersion(&xlearn, &version), 0);
+  EXPECT_EQ(version, 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(filename_1.c_str());
+  RemoveFile(filename_2.c_str());
+}
+
+TEST(C_API_TEST, ApplyDelta) {
+  const std::string filename = "./c_api_test_delta.model";
+  const std::string filename_1 = "./c_api_test_delta_1.model";
+  const std::string prefix = "./c_api_test_delta";
+  xLearn::Model model;
+  model.Initialize("ffm", "squared", 10, 3, 4, 2);
+  xLearn::Checkpoint checkpoint;
+  checkpoint.Initialize(filename, 1, 0);
+  checkpoint.SetDeltaFile(prefix);
+  EXPECT_TRUE(checkpoint.Step(&model, 1));
+  checkpoint.Wait();
+  EXPECT_FALSE(FileExist((prefix + ".1").c_str()));
+  std::rename(filename.c_str(), filename_1.c_str());
+  // Change two features of the model
+  std::vector<index_t> ids = { 2, 5 };
+  std::vector<real_t> row(ids.size() * model.GetFeatureSize());
+  model.GetFeatures(ids, row.data());
+  for (size_t i = 0; i < row.size(); ++i) { row[i] += 0.5; }
+  model.SetFeatures(ids, row.data());
+  EXPECT_TRUE(checkpoint.Step(&model, 2));
+  checkpoint.Wait();
+  const std::string delta = prefix + ".2";
+  ASSERT_TRUE(FileExist(delta.c_str()));
+  // The base model with the delta scores as the new model
+  XL xlearn, expected;
+  for (XL* xl : { &xlearn, &expected }) {
+    EXPECT_EQ(XLearnCreate("ffm", xl), 0);
+    EXPECT_EQ(XLearnSetBool(xl, "quiet", true), 0);
+    EXPECT_EQ(XLearnSetBool(xl, "norm", false), 0);
+  }
+  EXPECT_EQ(XLearnLoadModel(&xlearn, filename_1.c_str()), 0);
+  EXPECT_EQ(XLearnLoadModel(&expected, filename.c_str()), 0);
+  const index_t feat_id[3] = { 2, 5, 7 };
+  const index_t field_id[3] = { 0, 1, 2 };
+  const real_t value[3] = { 1.0, 0.5, 2.0 };
+  float score = 0, score_2 = 0;
+  EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, field_id, value, 3, &score), 0);
+  EXPECT_EQ(XLearnScoreRow(&expected, feat_id, field_id,
+                           value, 3, &score_2), 0);
+  EXPECT_NE(score, score_2);
+  bool applied = true;
+  EXPECT_EQ(XLearnApplyDelta(&xlearn, "./none.delta", &applied), 0);
+  EXPECT_FALSE(applied);
+  EXPECT_EQ(XLearnApplyDelta(&xlearn, delta.c_str(), &applied), 0);
+  EXPECT_TRUE(applied);
+  EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, field_id, value, 3, &score), 0);
+  EXPECT_FLOAT_EQ(score, score_2);
+  // The new model is not the base of the delta any more
+  EXPECT_EQ(XLearnApplyDelta(&xlearn, delta.c_str(), &applied), 0);
+  EXPECT_FALSE(applied);
+  EXPECT_EQ(XLearnApplyDelta(&expected, delta.c_str(), &applied), 0);
+  EXPECT_FALSE(applied);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  EXPECT_EQ(XLearnHandleFree(&expected), 0);
+  RemoveFile(filename.c_str());
+  RemoveFile(filename_1.c_str());
+  RemoveFile(delta.c_str());
+}
+
+// Each epoch writes one line of the time of its phases.
+TEST(C_API_TEST, Profile) {
+  const std::string filename = "./c_api_test.profile";
+  const index_t kRows = 8, kCols = 3;
+  std::vector<real_t> data(kRows * kCols);
+  std::vector<real_t> label(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    for (index_t j = 0; j < kCols; ++j) {
+      data[i*kCols+j] = (i + j) % 3 == 0 ? 0 : (i * j) % 5 + 1;
+    }
+    label[i] = i % 2;
+  }
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data.data(), kRows, kCols,
+                                    label.data(), nullptr, &matrix), 0);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 3), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "profile_file", filename.c_str()), 0);
+  std::string value;
+  EXPECT_EQ(XLearnGetStr(&xlearn, "profile_file", value), 0);
+  EXPECT_EQ(value, filename);
+  // The hardware events are written if this host can count them
+  EXPECT_EQ(XLearnSetBool(&xlearn, "perf_counter", true), 0);
+  bool perf = false;
+  EXPECT_EQ(XLearnGetBool(&xlearn, "perf_counter", &perf), 0);
+  EXPECT_TRUE(perf);
+  EXPECT_EQ(XLearnSetDMatrix(&xlearn, "train", &matrix), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "from_file", false), 0);
+  EXPECT_EQ(XLearnFitInMemory(&xlearn), 0);
+  std::ifstream file(filename);
+  std::string line;
+  int epoch = 0;
+  while (std::getline(file, line)) {
+    epoch++;
+    EXPECT_EQ(line.find("{\"epoch\": " + std::to_string(epoch) + ","), 0);
+    EXPECT_NE(line.find("\"rows\": 8,"), std::string::npos);
+    // The zeros of the matrix are also kept
+    EXPECT_NE(line.find("\"nnz\": 24,"), std::string::npos);
+    EXPECT_NE(line.find("\"read\": {"), std::string::npos);
+    EXPECT_NE(line.find("\"grad\": {"), std::string::npos);
+    EXPECT_EQ(line.back(), '}');
+  }
+  EXPECT_EQ(epoch, 3);
+  file.close();
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+  RemoveFile(filename.c_str());
+}
+
+TEST(C_API_TEST, ThreadStats) {
+  const index_t kRows = 64, kCols = 4;
+  std::vector<real_t> data(kRows * kCols);
+  std::vector<real_t> label(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    for (index_t j = 0; j < kCols; ++j) {
+      data[i*kCols+j] = (i * j) % 5 + 1;
+    }
+    label[i] = i % 2;
+  }
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data.data(), kRows, kCols,
+                                    label.data(), nullptr, &matrix), 0);
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 2), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  EXPECT_EQ(XLearnSetDMatrix(&xlearn, "train", &matrix), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "from_file", false), 0);
+  uint64 num_worker = 1;
+  double caller_wait = -1;
+  // No training yet
+  EXPECT_EQ(XLearnGetThreadStats(&xlearn, nullptr, nullptr, nullptr,
+                                 nullptr, 0, &num_worker, &caller_wait), 0);
+  EXPECT_EQ(num_worker, 0);
+  EXPECT_EQ(XLearnFitInMemory(&xlearn), 0);
+  EXPECT_EQ(XLearnGetThreadStats(&xlearn, nullptr, nullptr, nullptr,
+                                 nullptr, 0, &num_worker, &caller_wait), 0);
+  EXPECT_EQ(num_worker, 2);
+  EXPECT_GE(caller_wait, 0);
+  std::vector<uint64> tasks(2);
+  std::vector<double> busy(2), idle(2), lock_wait(2);
+  // The arrays are too short
+  EXPECT_EQ(XLearnGetThreadStats(&xlearn, tasks.data(), nullptr, nullptr,
+                                 nullptr, 1, &num_worker, &caller_wait), -1);
+  EXPECT_EQ(XLearnGetThreadStats(&xlearn, tasks.data(), busy.data(),
+                                 idle.data(), lock_wait.data(), 2,
+                                 &num_worker, &caller_wait), 0);
+  // The caller of ParallelFor() can run all the chunks of the small
+  // data by itself, so the workers may have no task at all
+  for (int i = 0; i < 2; ++i) {
+    if (tasks[i] == 0) { EXPECT_EQ(busy[i], 0); }
+    EXPECT_GE(busy[i], 0);
+    EXPECT_GE(idle[i], 0);
+    EXPECT_GE(lock_wait[i], 0);
+  }
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+}
+
+// The features are renumbered during the training only, so the
+// model is the same as the model trained on the original ids.
+TEST(C_API_TEST, RemapFeatures) {
+  const std::string data_file = "./c_api_test_remap.txt";
+  const std::string model_file = "./c_api_test_remap.model";
+  const std::string txt_file = "./c_api_test_remap.txt.model";
+  // The frequent features have the large ids
+  std::ofstream data(data_file);
+  for (int i = 0; i < 64; ++i) {
+    data << i % 2;
+    for (int f = 0; f < 3; ++f) {
+      data << " " << f << ":" << 40 - (i * (f + 1)) % (5 + f * 7) << ":1";
+    }
+    data << "\n";
+  }
+  data.close();
+  for (bool on_disk : { false, true }) {
+    std::string expect;
+    for (bool remap : { false, true }) {
+      XL xlearn;
+      EXPECT_EQ(XLearnCreate("ffm", &xlearn), 0);
+      EXPECT_EQ(XLearnSetTrain(&xlearn, data_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetValidate(&xlearn, data_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetTXTModel(&xlearn, txt_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "on_disk", on_disk), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "remap_features", remap), 0);
+      bool value = !remap;
+      EXPECT_EQ(XLearnGetBool(&xlearn, "remap_features", &value), 0);
+      EXPECT_EQ(value, remap);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 3), 0);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+      EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+      EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+      std::ifstream txt(txt_file);
+      std::stringstream model;
+      model << txt.rdbuf();
+      if (expect.empty()) { expect = model.str(); }
+      EXPECT_FALSE(expect.empty());
+      EXPECT_EQ(model.str(), expect);
+    }
+  }
+  RemoveFile(data_file.c_str());
+  RemoveFile(model_file.c_str());
+  RemoveFile(txt_file.c_str());
+}
+
+// The validation in the background gives the same results and the
+// same model as the validation between the epochs, including the
+// rollback of early-stopping.
+TEST(C_API_TEST, AsyncValidate) {
+  const std::string train_file = "./c_api_test_async_train.txt";
+  const std::string valid_file = "./c_api_test_async_valid.txt";
+  const std::string model_file = "./c_api_test_async.model";
+  const std::string txt_file = "./c_api_test_async.txt.model";
+  // The labels of the validation are noisy, so it stops early
+  std::ofstream train(train_file);
+  std::ofstream valid(valid_file);
+  for (int i = 0; i < 64; ++i) {
+    std::string features;
+    for (int f = 0; f < 3; ++f) {
+      features += " " + std::to_string(f) + ":" +
+                  std::to_string((i * (f + 3)) % 11) + ":1";
+    }
+    train << i % 2 << features << "\n";
+    valid << (i % 3 == 0 ? 1 : 0) << features << "\n";
+  }
+  train.close();
+  valid.close();
+  for (bool on_disk : { false, true }) {
+    std::string expect;
+    for (bool async : { false, true }) {
+      XL xlearn;
+      EXPECT_EQ(XLearnCreate("ffm", &xlearn), 0);
+      EXPECT_EQ(XLearnSetTrain(&xlearn, train_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetValidate(&xlearn, valid_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetTXTModel(&xlearn, txt_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetStr(&xlearn, "metric", "auc"), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "on_disk", on_disk), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "async_validate", async), 0);
+      bool value = !async;
+      EXPECT_EQ(XLearnGetBool(&xlearn, "async_validate", &value), 0);
+      EXPECT_EQ(value, async);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 8), 0);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+      EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+      EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+      std::ifstream txt(txt_file);
+      std::stringstream model;
+      model << txt.rdbuf();
+      if (expect.empty()) { expect = model.str(); }
+      EXPECT_FALSE(expect.empty());
+      EXPECT_EQ(model.str(), expect);
+    }
+  }
+  RemoveFile(train_file.c_str());
+  RemoveFile(valid_file.c_str());
+  RemoveFile(model_file.c_str());
+  RemoveFile(txt_file.c_str());
+}
+
+// The validation of every 64 rows (one epoch) and of the sample of
+// all the rows (the rate rounds to all of them) gives the same
+// early-stopping as the validation of each epoch, so the models are
+// the same, and the validation of every 2 epochs also works.
+TEST(C_API_TEST, ValidSchedule) {
+  const std::string train_file = "./c_api_test_schedule_train.txt";
+  const std::string valid_file = "./c_api_test_schedule_valid.txt";
+  const std::string model_file = "./c_api_test_schedule.model";
+  const std::string txt_file = "./c_api_test_schedule.txt.model";
+  // The labels of the validation are noisy, so it stops early
+  std::ofstream train(train_file);
+  std::ofstream valid(valid_file);
+  for (int i = 0; i < 64; ++i) {
+    std::string features;
+    for (int f = 0; f < 3; ++f) {
+      features += " " + std::to_string(f) + ":" +
+                  std::to_string((i * (f + 3)) % 11) + ":1";
+    }
+    train << i % 2 << features << "\n";
+    valid << (i % 3 == 0 ? 1 : 0) << features << "\n";
+  }
+  train.close();
+  valid.close();
+  for (bool on_disk : { false, true }) {
+    std::string expect;
+    for (int schedule = 0; schedule < 4; ++schedule) {
+      XL xlearn;
+      EXPECT_EQ(XLearnCreate("ffm", &xlearn), 0);
+      EXPECT_EQ(XLearnSetTrain(&xlearn, train_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetValidate(&xlearn, valid_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetTXTModel(&xlearn, txt_file.c_str()), 0);
+      EXPECT_EQ(XLearnSetStr(&xlearn, "metric", "auc"), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+      EXPECT_EQ(XLearnSetBool(&xlearn, "on_disk", on_disk), 0);
+      if (schedule == 1) {
+        EXPECT_EQ(XLearnSetInt(&xlearn, "valid_rows", 64), 0);
+        int value = 0;
+        EXPECT_EQ(XLearnGetInt(&xlearn, "valid_rows", &value), 0);
+        EXPECT_EQ(value, 64);
+      } else if (schedule == 2) {
+        EXPECT_EQ(XLearnSetFloat(&xlearn, "valid_sample", 0.999), 0);
+        float value = 0;
+        EXPECT_EQ(XLearnGetFloat(&xlearn, "valid_sample", &value), 0);
+        EXPECT_FLOAT_EQ(value, 0.999);
+      } else if (schedule == 3) {
+        EXPECT_EQ(XLearnSetInt(&xlearn, "valid_every", 2), 0);
+        int value = 0;
+        EXPECT_EQ(XLearnGetInt(&xlearn, "valid_every", &value), 0);
+        EXPECT_EQ(value, 2);
+      }
+      EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 8), 0);
+      EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+      EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+      EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+      std::ifstream txt(txt_file);
+      std::stringstream model;
+      model << txt.rdbuf();
+      EXPECT_FALSE(model.str().empty());
+      if (expect.empty()) { expect = model.str(); }
+      if (schedule < 3) {
+        EXPECT_EQ(model.str(), expect);
+      }
+    }
+  }
+  RemoveFile(train_file.c_str());
+  RemoveFile(valid_file.c_str());
+  RemoveFile(model_file.c_str());
+  RemoveFile(txt_file.c_str());
+}
+
+// The pre-trained model grows for the new feature ids of the data.
+TEST(C_API_TEST, WarmStartGrow) {
+  const std::string old_file = "./c_api_test_grow_old.txt";
+  const std::string new_file = "./c_api_test_grow_new.txt";
+  const std::string pre_file = "./c_api_test_grow_pre.model";
+  const std::string model_file = "./c_api_test_grow.model";
+  std::ofstream old_data(old_file);
+  std::ofstream new_data(new_file);
+  for (int i = 0; i < 16; ++i) {
+    old_data << i % 2 << " " << i % 4 << ":1\n";
+    new_data << i % 2 << " " << i % 4 << ":1 " << 4 + i % 6 << ":1\n";
+  }
+  old_data.close();
+  new_data.close();
+  for (int day = 0; day < 2; ++day) {
+    XL xlearn;
+    EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+    EXPECT_EQ(XLearnSetTrain(&xlearn,
+                             (day == 0 ? old_file : new_file).c_str()), 0);
+    if (day == 1) {
+      EXPECT_EQ(XLearnSetPreModel(&xlearn, pre_file.c_str()), 0);
+    }
+    EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+    EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+    EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 2), 0);
+    EXPECT_EQ(XLearnFit(&xlearn,
+                        (day == 0 ? pre_file : model_file).c_str()), 0);
+    EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  }
+  xLearn::Model pre(pre_file);
+  xLearn::Model model(model_file);
+  EXPECT_EQ(pre.GetNumFeature(), 4);
+  EXPECT_EQ(model.GetNumFeature(), 10);
+  // The new features are trained, and the gradient cache of
+  // the old features goes on from the pre-trained model
+  index_t aux = model.GetAuxiliarySize();
+  for (index_t j = 4; j < 10; ++j) {
+    EXPECT_NE(model.GetParameter_w()[j * aux], 0);
+  }
+  for (index_t j = 0; j < 4; ++j) {
+    EXPECT_GT(model.GetParameter_w()[j * aux + 1],
+              pre.GetParameter_w()[j * aux + 1]);
+  }
+  RemoveFile(old_file.c_str());
+  RemoveFile(new_file.c_str());
+  RemoveFile(pre_file.c_str());
+  RemoveFile(model_file.c_str());
+}
+
+// The configurations of the sweep are trained over the same data,
+// and the best of them is saved as the model.
+TEST(C_API_TEST, Sweep) {
+  const std::string train_file = "./c_api_test_sweep_train.txt";
+  const std::string valid_file = "./c_api_test_sweep_valid.txt";
+  const std::string model_file = "./c_api_test_sweep.model";
+  std::ofstream train(train_file);
+  std::ofstream valid(valid_file);
+  for (int i = 0; i < 64; ++i) {
+    std::string features;
+    for (int f = 0; f < 3; ++f) {
+      features += " " + std::to_string(f) + ":" +
+                  std::to_string((i * (f + 3)) % 11) + ":1";
+    }
+    train << i % 2 << features << "\n";
+    valid << (i % 3 == 0 ? 1 : 0) << features << "\n";
+  }
+  train.close();
+  valid.close();
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("ffm", &xlearn), 0);
+  // An invalid grid is rejected
+  EXPECT_EQ(XLearnSetStr(&xlearn, "sweep", "k=0"), -1);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "sweep", "k=2:k=4"), -1);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "sweep", "s=1"), -1);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "sweep", "k=2,4:r=0.1,0.2"), 0);
+  std::string grid;
+  EXPECT_EQ(XLearnGetStr(&xlearn, "sweep", grid), 0);
+  EXPECT_EQ(grid, "k=2,4:r=0.1,0.2");
+  EXPECT_EQ(XLearnSetInt(&xlearn, "sweep_jobs", 2), 0);
+  int jobs = 0;
+  EXPECT_EQ(XLearnGetInt(&xlearn, "sweep_jobs", &jobs), 0);
+  EXPECT_EQ(jobs, 2);
+  EXPECT_EQ(XLearnSetTrain(&xlearn, train_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetValidate(&xlearn, valid_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetStr(&xlearn, "metric", "auc"), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 4), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  xLearn::Model model(model_file);
+  EXPECT_EQ(model.GetScoreFunction(), "ffm");
+  EXPECT_TRUE(model.GetNumK() == 2 || model.GetNumK() == 4);
+  RemoveFile(train_file.c_str());
+  RemoveFile(valid_file.c_str());
+  RemoveFile(model_file.c_str());
+}
+
+// The rare features share one id of the model, and the data of
+// the predictions is renumbered by the map of the model file.
+TEST(C_API_TEST, MinCount) {
+  const std::string data_file = "./c_api_test_min_count.txt";
+  const std::string model_file = "./c_api_test_min_count.model";
+  const int kRows = 16;
+  // Features 0, 1 and 2 are frequent, and the others are used once
+  std::ofstream data(data_file);
+  for (int i = 0; i < kRows; ++i) {
+    data << i % 2 << " 0:1 " << (i % 4 == 0 ? 2 : 1) << ":1 "
+         << 20 + i << ":1\n";
+  }
+  data.close();
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("linear", &xlearn), 0);
+  EXPECT_EQ(XLearnSetTrain(&xlearn, data_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "min_count", 2), 0);
+  int value = 0;
+  EXPECT_EQ(XLearnGetInt(&xlearn, "min_count", &value), 0);
+  EXPECT_EQ(value, 2);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 3), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+  EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+  xLearn::Model model(model_file);
+  EXPECT_EQ(model.GetNumFeature(), 4);
+  const std::vector<index_t>& map = model.GetFeatureMap();
+  ASSERT_EQ(map.size(), 20 + kRows);
+  EXPECT_EQ(map[0], 0);
+  EXPECT_EQ(map[1], 1);
+  EXPECT_EQ(map[2], 2);
+  for (index_t j = 3; j < map.size(); ++j) { EXPECT_EQ(map[j], 3); }
+  // The test file is renumbered by the reader
+  EXPECT_EQ(XLearnSetTest(&xlearn, data_file.c_str()), 0);
+  uint64 length = 0;
+  const float* preds = nullptr;
+  EXPECT_EQ(XLearnPredictForMat(&xlearn, model_file.c_str(),
+                                &length, &preds), 0);
+  ASSERT_EQ(length, kRows);
+  std::vector<float> expect(preds, preds + length);
+  // And the rows of the loaded model are renumbered by the solver
+  EXPECT_EQ(XLearnLoadModel(&xlearn, model_file.c_str()), 0);
+  for (int i = 0; i < kRows; ++i) {
+    index_t feat_id[3] = { 0, (index_t)(i % 4 == 0 ? 2 : 1),
+                           (index_t)(20 + i) };
+    real_t feat_value[3] = { 1, 1, 1 };
+    float score = 0;
+    EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, nullptr,
+                             feat_value, 3, &score), 0);
+    EXPECT_FLOAT_EQ(score, expect[i]);
+  }
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(data_file.c_str());
+  RemoveFile(model_file.c_str());
+}
+
+// The sparse field ids of the data are renumbered to the used fields
+// of the model, and the test data is renumbered by the model file.
+TEST(C_API_TEST, RemapFields) {
+  const std::string data_file = "./c_api_test_remap_fields.txt";
+  const std::string model_file = "./c_api_test_remap_fields.model";
+  const int kRows = 16;
+  const index_t kFields[3] = { 0, 7, 1000 };
+  std::ofstream data(data_file);
+  for (int i = 0; i < kRows; ++i) {
+    data << i % 2 << " " << kFields[0] << ":" << i % 3 << ":1 "
+         << kFields[1] << ":" << 3 + i % 2 << ":1 "
+         << kFields[2] << ":5:1\n";
+  }
+  data.close();
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("ffm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetTrain(&xlearn, data_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "remap_fields", true), 0);
+  bool value = false;
+  EXPECT_EQ(XLearnGetBool(&xlearn, "remap_fields", &value), 0);
+  EXPECT_TRUE(value);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 3), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+  EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+  xLearn::Model model(model_file);
+  EXPECT_EQ(model.GetNumField(), 3);
+  const std::vector<index_t>& map = model.GetFieldMap();
+  ASSERT_EQ(map.size(), 1001);
+  EXPECT_EQ(map[0], 0);
+  EXPECT_EQ(map[7], 1);
+  EXPECT_EQ(map[1000], 2);
+  EXPECT_EQ(map[1], 3);
+  // The test file is renumbered by the reader
+  EXPECT_EQ(XLearnSetTest(&xlearn, data_file.c_str()), 0);
+  uint64 length = 0;
+  const float* preds = nullptr;
+  EXPECT_EQ(XLearnPredictForMat(&xlearn, model_file.c_str(),
+                                &length, &preds), 0);
+  ASSERT_EQ(length, kRows);
+  std::vector<float> expect(preds, preds + length);
+  // And the rows of the loaded model are renumbered by the solver
+  EXPECT_EQ(XLearnLoadModel(&xlearn, model_file.c_str()), 0);
+  for (int i = 0; i < kRows; ++i) {
+    index_t feat_id[3] = { (index_t)(i % 3), (index_t)(3 + i % 2), 5 };
+    index_t field_id[3] = { kFields[0], kFields[1], kFields[2] };
+    real_t feat_value[3] = { 1, 1, 1 };
+    float score = 0;
+    EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, field_id,
+                             feat_value, 3, &score), 0);
+    EXPECT_FLOAT_EQ(score, expect[i]);
+  }
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(data_file.c_str());
+  RemoveFile(model_file.c_str());
+}
+
+// The results of the test file are returned batch by batch,
+// which are the same as the prediction of the whole file.
+TEST(C_API_TEST, PredictIter) {
+  const std::string data_file = "./c_api_test_iter.txt";
+  const std::string model_file = "./c_api_test_iter.model";
+  const int kRows = 100;
+  std::ofstream data(data_file);
+  for (int i = 0; i < kRows; ++i) {
+    data << i % 2 << " " << i % 7 << ":1 " << 7 + i % 3 << ":0.5\n";
+  }
+  data.close();
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetTrain(&xlearn, data_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetTest(&xlearn, data_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "sigmoid", true), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+  uint64 length = 0;
+  const float* preds = nullptr;
+  EXPECT_EQ(XLearnPredictForMat(&xlearn, model_file.c_str(),
+                                &length, &preds), 0);
+  ASSERT_EQ(length, kRows);
+  std::vector<float> expect(preds, preds + length);
+  PredictHandle iter;
+  // The model is not loaded
+  EXPECT_NE(XLearnPredictOpen(&xlearn, data_file.c_str(), &iter), 0);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, model_file.c_str()), 0);
+  EXPECT_NE(XLearnPredictOpen(&xlearn, "./c_api_test_none.txt", &iter), 0);
+  EXPECT_EQ(XLearnPredictOpen(&xlearn, data_file.c_str(), &iter), 0);
+  std::vector<float> result;
+  float out[7];
+  uint64 num_rows = 0;
+  do {
+    EXPECT_EQ(XLearnPredictNext(&iter, out, 7, &num_rows), 0);
+    EXPECT_LE(num_rows, 7);
+    result.insert(result.end(), out, out + num_rows);
+  } while (num_rows > 0);
+  ASSERT_EQ(result.size(), expect.size());
+  for (int i = 0; i < kRows; ++i) {
+    EXPECT_FLOAT_EQ(result[i], expect[i]);
+  }
+  // It stays at the end of the file
+  EXPECT_EQ(XLearnPredictNext(&iter, out, 7, &num_rows), 0);
+  EXPECT_EQ(num_rows, 0);
+  EXPECT_EQ(XLearnPredictClose(&iter), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(data_file.c_str());
+  RemoveFile(model_file.c_str());
+}
+
+// The field weights of fwfm are trained, and the model
+// file gives the same scores for the rows.
+TEST(C_API_TEST, FieldWeighted) {
+  const std::string data_file = "./c_api_test_fwfm.txt";
+  const std::string model_file = "./c_api_test_fwfm.model";
+  const int kRows = 32;
+  std::ofstream data(data_file);
+  for (int i = 0; i < kRows; ++i) {
+    data << i % 2;
+    for (int f = 0; f < 3; ++f) {
+      data << " " << f << ":" << (i * (f + 2)) % 7 << ":1";
+    }
+    data << "\n";
+  }
+  data.close();
+  XL xlearn;
+  EXPECT_EQ(XLearnCreate("fwfm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetTrain(&xlearn, data_file.c_str()), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "bin_out", false), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "norm", false), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "k", 4), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 5), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+  EXPECT_EQ(XLearnFit(&xlearn, model_file.c_str()), 0);
+  xLearn::Model model(model_file);
+  EXPECT_EQ(model.GetScoreFunction(), "fwfm");
+  EXPECT_EQ(model.GetNumField(), 3);
+  EXPECT_EQ(model.GetNumParameter_r(), 3 * 3 * model.GetAuxiliarySize());
+  EXPECT_NE(model.GetFieldWeight(0, 1)[0], 1.0);
+  EXPECT_EQ(XLearnSetTest(&xlearn, data_file.c_str()), 0);
+  uint64 length = 0;
+  const float* preds = nullptr;
+  EXPECT_EQ(XLearnPredictForMat(&xlearn, model_file.c_str(),
+                                &length, &preds), 0);
+  ASSERT_EQ(length, kRows);
+  std::vector<float> expect(preds, preds + length);
+  EXPECT_EQ(XLearnLoadModel(&xlearn, model_file.c_str()), 0);
+  for (int i = 0; i < kRows; ++i) {
+    index_t field_id[3] = { 0, 1, 2 };
+    index_t feat_id[3];
+    real_t feat_value[3] = { 1, 1, 1 };
+    for (int f = 0; f < 3; ++f) { feat_id[f] = (i * (f + 2)) % 7; }
+    float score = 0;
+    EXPECT_EQ(XLearnScoreRow(&xlearn, feat_id, field_id,
+                             feat_value, 3, &score), 0);
+    EXPECT_FLOAT_EQ(score, expect[i]);
+  }
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile(data_file.c_str());
+  RemoveFile(model_file.c_str());
+}
+
+// The batches of DataIter, each of which is [begin, end) of the rows.
+struct BatchIter {
+  std::vector<uint64> indptr;
+  std::vector<xLearn::Node> nodes;
+  std::vector<real_t> label;
+  std::vector<index_t> bounds;
+  size_t next = 0;
+  int passes = 0;
+  std::vector<uint64> batch_ptr;
+};
+
+uint64 NextBatch(void* handle, const uint64** indptr,
+                 const void** nodes, const real_t** label) {
+  BatchIter* iter = static_cast<BatchIter*>(handle);
+  if (iter->next + 1 >= iter->bounds.size()) { return 0; }
+  index_t begin = iter->bounds[iter->next];
+  index_t end = iter->bounds[++iter->next];
+  // The offsets are into the nodes of the batch
+  iter->batch_ptr.assign(iter->indptr.begin() + begin,
+                         iter->indptr.begin() + end + 1);
+  *indptr = iter->batch_ptr.data();
+  *nodes = iter->nodes.data();
+  *label = iter->label.data() + begin;
+  return end - begin;
+}
+
+void ResetBatch(void* handle) {
+  BatchIter* iter = static_cast<BatchIter*>(handle);
+  iter->next = 0;
+  iter->passes++;
+}
+
+// The same rows of an iterator and of a DMatrix give the same model,
+// and the rows are all the same, so the order does not matter.
+TEST(C_API_TEST, DataIter) {
+  const index_t kRows = 6, kCols = 4;
+  BatchIter iter;
+  iter.indptr.push_back(0);
+  std::vector<real_t> data(kRows * kCols, 0);
+  for (index_t i = 0; i < kRows; ++i) {
+    for (index_t j = 0; j < kCols; ++j) {
+      iter.nodes.push_back(xLearn::Node(0, j, j + 1.0));
+      data[i*kCols+j] = j + 1.0;
+    }
+    iter.indptr.push_back(iter.nodes.size());
+    iter.label.push_back(1);
+  }
+  iter.bounds = { 0, 2, 5, 6 };
+  DataHandle matrix;
+  EXPECT_EQ(XlearnCreateDataFromMat(data.data(), kRows, kCols,
+                                    iter.label.data(), nullptr, &matrix), 0);
+  std::vector<float> expect(kCols + 1), linear(kCols + 1);
+  std::vector<float> expect_latent(kCols * 2), latent(kCols * 2);
+  for (int k = 0; k < 2; ++k) {
+    XL xlearn;
+    EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+    EXPECT_EQ(XLearnSetBool(&xlearn, "quiet", true), 0);
+    EXPECT_EQ(XLearnSetInt(&xlearn, "k", 2), 0);
+    EXPECT_EQ(XLearnSetInt(&xlearn, "epoch", 3), 0);
+    EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 1), 0);
+    EXPECT_EQ(XLearnSetBool(&xlearn, "from_file", false), 0);
+    if (k == 0) {
+      EXPECT_EQ(XLearnSetDMatrix(&xlearn, "train", &matrix), 0);
+    } else {
+      EXPECT_NE(XLearnSetDataIter(&xlearn, "test", NextBatch,
+                                  ResetBatch, &iter), 0);
+      EXPECT_EQ(XLearnSetDataIter(&xlearn, "train", NextBatch,
+                                  ResetBatch, &iter), 0);
+    }
+    EXPECT_EQ(XLearnFitInMemory(&xlearn), 0);
+    std::vector<float>& w = k == 0 ? expect : linear;
+    std::vector<float>& v = k == 0 ? expect_latent : latent;
+    EXPECT_EQ(XLearnGetModelWeights(&xlearn, w.data(), w.size(),
+                                    v.data(), v.size()), 0);
+    EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  }
+  // The data is read once for its shape, and once in each epoch
+  EXPECT_GE(iter.passes, 3);
+  EXPECT_NE(linear[1], 0);
+  for (index_t j = 0; j <= kCols; ++j) {
+    EXPECT_FLOAT_EQ(linear[j], expect[j]);
+  }
+  for (size_t j = 0; j < latent.size(); ++j) {
+    EXPECT_FLOAT_EQ(latent[j], expect_latent[j]);
+  }
+  EXPECT_EQ(XlearnDataFree(&matrix), 0);
+}
@@ -21,14 +21,23 @@ This file defines the basic data structures.
 #ifndef XLEARN_DATA_DATA_STRUCTURE_H_
 #define XLEARN_DATA_DATA_STRUCTURE_H_
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
 
 #include "src/base/common.h"
 #include "src/base/file_util.h"
+#include "src/base/radix_sort.h"
 #include "src/base/stl-util.h"
+#include "src/base/thread_pool.h"
+#include "src/base/varint.h"
 
 namespace xLearn {
 
@@ -44,17 +53,28 @@ typedef float real_t;
 //------------------------------------------------------------------------------
 typedef uint32 index_t;
 
+//------------------------------------------------------------------------------
+// The size and the offset of the model parameters need 64 bits, since
+// a big ffm model (num_feature * num_field * aligned_k * aux_size) can
+// be larger than 4G values, while the feature and field ids are still
+// stored in index_t.
+//------------------------------------------------------------------------------
+typedef uint64 offset_t;
+
 //------------------------------------------------------------------------------
 // Mapping sparse feature to dense feature. Used by distributed computation.
 //------------------------------------------------------------------------------
 typedef std::unordered_map<index_t, index_t> feature_map;
 
 //------------------------------------------------------------------------------
-// We use SSE to accelerate our training, and hence some 
-// parameters will be aligned.
+// We use SIMD to accelerate our training, and hence some
+// parameters will be aligned. kAlign is the block size of the
+// latent factors (and it decides the on-disk model layout), while
+// kAlignByte is the alignment of the allocated buffer, which is
+// wide enough for the AVX-512 kernels.
 //------------------------------------------------------------------------------
 const int kAlign = 4;
-const int kAlignByte = 16;
+const int kAlignByte = 64;
 
 //------------------------------------------------------------------------------
 // MetricInfo stores the evaluation metric information, which
@@ -63,6 +83,9 @@ const int kAlignByte = 16;
 struct MetricInfo {
   real_t loss_val;    /* Loss value */
   real_t metric_val;  /* Metric value */
+  /* The values of all the metrics of a list (-x auc,acc),
+  where the first one is metric_val */
+  std::vector<real_t> metric_list;
 };
 
 //------------------------------------------------------------------------------
@@ -86,10 +109,462 @@ struct Node {
 };
 
 //------------------------------------------------------------------------------
-// SparseRow is used to store one line of the data, which
-// is represented as a vector of the Node data structure.
+// SparseRow is used to store one line of the data, which is an array
+// of the Node data structure. It can be used like a std::vector<Node>:
+//
+//   SparseRow row;
+//   row.push_back(Node(field_id, feat_id, feat_val));
+//   for (SparseRow::const_iterator iter = row.begin();
+//        iter != row.end(); ++iter) { ... }
+//
+// The row created by users owns its nodes. While the row of a DMatrix
+// is allocated by the RowArena of the matrix, which is a view of the
+// nodes in the arena. Such a row is copied to its own memory when it is
+// changed by push_back() or resize() from outside of the arena.
+// SparseRow takes 16 bytes, and the iterator is just a Node pointer.
 //------------------------------------------------------------------------------
-typedef std::vector<Node> SparseRow;
+class SparseRow {
+ public:
+  typedef Node value_type;
+  typedef size_t size_type;
+  typedef Node* iterator;
+  typedef const Node* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  // Constructor and Destructor
+  SparseRow() : data_(nullptr), size_(0), capacity_(0), in_arena_(0) { }
+  explicit SparseRow(size_t n)
+   : data_(nullptr), size_(0), capacity_(0), in_arena_(0) {
+    resize(n);
+  }
+  template <typename Iter>
+  SparseRow(Iter first, Iter last)
+   : data_(nullptr), size_(0), capacity_(0), in_arena_(0) {
+    for (; first != last; ++first) { push_back(*first); }
+  }
+  SparseRow(const SparseRow& other)
+   : data_(nullptr), size_(0), capacity_(0), in_arena_(0) {
+    assign(other.begin(), other.end());
+  }
+  ~SparseRow() { release(); }
+
+  // The row keeps its own place (e.g., in the arena),
+  // and only the nodes are copied.
+  SparseRow& operator=(const SparseRow& other) {
+    if (this != &other) { assign(other.begin(), other.end()); }
+    return *this;
+  }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return capacity_; }
+  Node* data() { return data_; }
+  const Node* data() const { return data_; }
+  Node& operator[](size_t i) { return data_[i]; }
+  const Node& operator[](size_t i) const { return data_[i]; }
+  Node& front() { return data_[0]; }
+  const Node& front() const { return data_[0]; }
+  Node& back() { return data_[size_-1]; }
+  const Node& back() const { return data_[size_-1]; }
+
+  void push_back(const Node& node) {
+    if (size_ >= capacity_) { grow(size_ + 1); }
+    data_[size_++] = node;
+  }
+
+  // The new nodes are set to Node(), and a shrunk row keeps its
+  // nodes in place, which may be in the arena (capacity_ = 0).
+  void resize(size_t n) {
+    if (n > size_ && n > capacity_) { grow(n); }
+    for (size_t i = size_; i < n; ++i) { data_[i] = Node(); }
+    size_ = n;
+  }
+
+  void reserve(size_t n) {
+    if (n > capacity_) { grow(n); }
+  }
+
+  void clear() { size_ = 0; }
+
+  template <typename Iter>
+  void assign(Iter first, Iter last) {
+    clear();
+    for (; first != last; ++first) { push_back(*first); }
+  }
+
+  // If the row is allocated by a RowArena.
+  bool InArena() const { return in_arena_ != 0; }
+
+ protected:
+  friend class RowArena;
+
+  /* The nodes, which are owned by the row
+  if capacity_ > 0, or else by the arena */
+  Node* data_;
+  uint32 size_;
+  uint32 capacity_ : 31;
+  uint32 in_arena_ : 1;
+
+  // Move the nodes to the own memory of at least n nodes.
+  void grow(size_t n) {
+    size_t cap = std::max(n, std::max((size_t)4, (size_t)capacity_ * 2));
+    CHECK_LT(cap, (size_t)1 << 31);
+    Node* ptr = (Node*)malloc(cap * sizeof(Node));
+    CHECK_NOTNULL(ptr);
+    if (size_ > 0) { memcpy(ptr, data_, size_ * sizeof(Node)); }
+    release();
+    data_ = ptr;
+    capacity_ = cap;
+  }
+
+  // Free the own memory.
+  void release() {
+    if (capacity_ > 0) { free(data_); }
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+};
+
+//------------------------------------------------------------------------------
+// RowArena allocates the rows and their nodes in large chunks, so that
+// there is no malloc() for each row, and the nodes of the rows are laid
+// one after another in memory, which is the same as the CSR format:
+//
+//   RowArena arena;
+//   SparseRow* row = arena.NewRow();
+//   arena.PushBack(row, Node(field_id, feat_id, feat_val));
+//   ...
+//   arena.Rewind();  /* drop all the rows, but keep the memory */
+//   ...
+//   arena.Clear();  /* free all the rows */
+//
+// The nodes of the last row are added in place. Adding node to another
+// row moves the row to the end of the arena, so it is best to build the
+// rows one by one, which is what the parsers do. The rows never move to
+// another address, so they can be shared by the pointers, until the
+// arena is cleared. The chunks start small and grow to kMaxChunkNodes,
+// so a small matrix does not take much memory. After Rewind(), the
+// chunks are reused by the new rows, so a matrix that is filled again
+// and again (e.g., a block of the on-disk training) does not call
+// malloc() and free() for each block.
+//------------------------------------------------------------------------------
+class RowArena {
+ public:
+  // Constructor and Destructor
+  RowArena() { init(); }
+  ~RowArena() { }
+
+  // Allocate an empty row.
+  SparseRow* NewRow() {
+    SparseRow* row = new_header();
+    row->data_ = tail_;
+    last_row_ = row;
+    return row;
+  }
+
+  // Allocate a row of n nodes, which are not initialized.
+  SparseRow* NewRow(size_t n) {
+    SparseRow* row = new_header();
+    row->data_ = alloc_nodes(n, n);
+    row->size_ = n;
+    last_row_ = row;
+    return row;
+  }
+
+  // Allocate a copy of [begin, end).
+  SparseRow* NewRow(const Node* begin, const Node* end) {
+    size_t n = end - begin;
+    SparseRow* row = NewRow(n);
+    if (n > 0) { memcpy(row->data_, begin, n * sizeof(Node)); }
+    return row;
+  }
+
+  // Allocate a row over the n nodes of the caller, which are not
+  // copied, and the caller keeps them alive as long as the row. The
+  // arena never frees them, and PushBack() copies the row first.
+  SparseRow* NewView(const Node* begin, size_t n) {
+    CHECK_LT(n, (size_t)1 << 32);
+    SparseRow* row = new_header();
+    row->data_ = const_cast<Node*>(begin);
+    row->size_ = n;
+    return row;
+  }
+
+  // Add the node to the end of the row.
+  void PushBack(SparseRow* row, const Node& node) {
+    // The rows not in the arena (or copied to
+    // their own memory) are just like a vector
+    if (!row->InArena() || row->capacity_ > 0) {
+      row->push_back(node);
+      return;
+    }
+    if (row == last_row_ && tail_ < chunk_end_ &&
+        row->data_ + row->size_ == tail_) {
+      *tail_++ = node;
+      row->size_++;
+      return;
+    }
+    // Move the row to the end, with the room to double it
+    size_t n = row->size_;
+    Node* ptr = alloc_nodes(n + 1, 2 * (n + 1));
+    if (n > 0) { memcpy(ptr, row->data_, n * sizeof(Node)); }
+    ptr[n] = node;
+    row->data_ = ptr;
+    row->size_ = n + 1;
+    last_row_ = row;
+  }
+
+  // Take all the rows of another arena, which is empty after that.
+  void Absorb(RowArena* other) {
+    CHECK_NOTNULL(other);
+    CHECK_NE(other, this);
+    move_chunks(&other->node_chunks_, &node_chunks_);
+    move_chunks(&other->row_chunks_, &row_chunks_);
+    move_chunks(&other->spare_nodes_, &spare_nodes_);
+    move_chunks(&other->spare_rows_, &spare_rows_);
+    bytes_ += other->bytes_;
+    other->Clear();
+  }
+
+  // Drop all the rows, and keep the chunks for the new rows.
+  void Rewind() {
+    // The rows copied to their own memory are freed here
+    for (size_t c = 0; c < row_chunks_.size(); ++c) {
+      for (size_t i = 0; i < row_chunks_[c].len; ++i) {
+        row_chunks_[c].data[i].release();
+      }
+    }
+    move_chunks(&node_chunks_, &spare_nodes_);
+    move_chunks(&row_chunks_, &spare_rows_);
+    uint64 bytes = bytes_;
+    init();
+    bytes_ = bytes;
+  }
+
+  // Give one of every n spare chunks to another arena (e.g., the
+  // arena of a thread), which are taken back by Absorb(). So the
+  // spare chunks are split over m arenas by n = m, m-1, ..., 1.
+  void ShareSpare(RowArena* other, size_t n) {
+    CHECK_NOTNULL(other);
+    CHECK_GT(n, 0);
+    share_chunks(&spare_nodes_, &other->spare_nodes_, n);
+    share_chunks(&spare_rows_, &other->spare_rows_, n);
+    uint64 bytes = 0;
+    for (size_t i = 0; i < other->spare_nodes_.size(); ++i) {
+      bytes += other->spare_nodes_[i].len * sizeof(Node);
+    }
+    for (size_t i = 0; i < other->spare_rows_.size(); ++i) {
+      bytes += other->spare_rows_[i].len * sizeof(SparseRow);
+    }
+    other->bytes_ += bytes;
+    bytes_ -= bytes;
+  }
+
+  // Free all the rows.
+  void Clear() {
+    std::vector<Chunk<Node> >().swap(node_chunks_);
+    std::vector<Chunk<SparseRow> >().swap(row_chunks_);
+    std::vector<Chunk<Node> >().swap(spare_nodes_);
+    std::vector<Chunk<SparseRow> >().swap(spare_rows_);
+    init();
+  }
+
+  // Memory (bytes) of all the chunks, including the spare ones.
+  uint64 Bytes() const { return bytes_; }
+
+  static const size_t kMinChunkNodes = 256;
+  static const size_t kMaxChunkNodes = 64 * 1024;
+  static const size_t kMinChunkRows = 64;
+  static const size_t kMaxChunkRows = 4096;
+
+ protected:
+  template <typename T>
+  struct Chunk {
+    std::unique_ptr<T[]> data;
+    size_t len;
+  };
+
+  /* Chunks of the nodes */
+  std::vector<Chunk<Node> > node_chunks_;
+  /* Chunks of the rows */
+  std::vector<Chunk<SparseRow> > row_chunks_;
+  /* The chunks kept by Rewind() */
+  std::vector<Chunk<Node> > spare_nodes_;
+  std::vector<Chunk<SparseRow> > spare_rows_;
+  /* Free nodes of the last chunk: [tail_, chunk_end_) */
+  Node* tail_;
+  Node* chunk_end_;
+  /* The row before tail_, which can grow in place */
+  SparseRow* last_row_;
+  /* Free rows of the current chunk */
+  SparseRow* row_chunk_;
+  size_t rows_used_;
+  size_t rows_cap_;
+  /* Size of the next chunks */
+  size_t next_nodes_;
+  size_t next_rows_;
+  uint64 bytes_;
+
+  void init() {
+    tail_ = nullptr;
+    chunk_end_ = nullptr;
+    last_row_ = nullptr;
+    row_chunk_ = nullptr;
+    rows_used_ = 0;
+    rows_cap_ = 0;
+    next_nodes_ = kMinChunkNodes;
+    next_rows_ = kMinChunkRows;
+    bytes_ = 0;
+  }
+
+  // Move all the chunks to the end of another list.
+  template <typename T>
+  static void move_chunks(std::vector<Chunk<T> >* from,
+                          std::vector<Chunk<T> >* to) {
+    for (size_t i = 0; i < from->size(); ++i) {
+      to->push_back(std::move((*from)[i]));
+    }
+    from->clear();
+  }
+
+  // Move one of every n chunks to another list.
+  template <typename T>
+  static void share_chunks(std::vector<Chunk<T> >* from,
+                           std::vector<Chunk<T> >* to,
+                           size_t n) {
+    size_t kept = 0;
+    for (size_t i = 0; i < from->size(); ++i) {
+      if (i % n == 0) {
+        to->push_back(std::move((*from)[i]));
+      } else {
+        (*from)[kept++] = std::move((*from)[i]);
+      }
+    }
+    from->resize(kept);
+  }
+
+  // Take the last spare chunk of at least len items, or
+  // allocate a new one, which is added to the chunks.
+  template <typename T>
+  T* new_chunk(size_t len,
+               std::vector<Chunk<T> >* chunks,
+               std::vector<Chunk<T> >* spare) {
+    for (size_t i = spare->size(); i > 0; --i) {
+      if ((*spare)[i-1].len >= len) {
+        chunks->push_back(std::move((*spare)[i-1]));
+        spare->erase(spare->begin() + (i-1));
+        return chunks->back().data.get();
+      }
+    }
+    Chunk<T> chunk;
+    chunk.data.reset(new T[len]);
+    chunk.len = len;
+    chunks->push_back(std::move(chunk));
+    bytes_ += len * sizeof(T);
+    return chunks->back().data.get();
+  }
+
+  // Allocate n nodes at the tail, and make sure that
+  // there are at least room nodes from there.
+  Node* alloc_nodes(size_t n, size_t room) {
+    if ((size_t)(chunk_end_ - tail_) < room) {
+      size_t len = std::max(room, next_nodes_);
+      tail_ = new_chunk(len, &node_chunks_, &spare_nodes_);
+      chunk_end_ = tail_ + node_chunks_.back().len;
+      next_nodes_ = std::min(next_nodes_ * 2, kMaxChunkNodes);
+    }
+    Node* ptr = tail_;
+    tail_ += n;
+    return ptr;
+  }
+
+  SparseRow* new_header() {
+    if (rows_used_ == rows_cap_) {
+      row_chunk_ = new_chunk(next_rows_, &row_chunks_, &spare_rows_);
+      rows_cap_ = row_chunks_.back().len;
+      rows_used_ = 0;
+      next_rows_ = std::min(next_rows_ * 2, kMaxChunkRows);
+    }
+    SparseRow* row = &row_chunk_[rows_used_++];
+    // The header of a spare chunk is reset
+    row->data_ = nullptr;
+    row->size_ = 0;
+    row->capacity_ = 0;
+    row->in_arena_ = 1;
+    return row;
+  }
+};
+
+//------------------------------------------------------------------------------
+// DataStats is the shape of the data, which is counted by the parsers
+// while they parse the rows (see Parser::Parse), and it is kept in the
+// binary files, so the model can be sized without reading the data:
+//
+//    DataStats stats;
+//    parser->Parse(buffer, size, matrix, false, &stats);
+//    index_t num_feature = stats.max_feat + 1;
+//------------------------------------------------------------------------------
+struct DataStats {
+  /* The largest feature id and field id */
+  index_t max_feat = 0;
+  index_t max_field = 0;
+  /* Number of the nodes and of the rows */
+  uint64 nnz = 0;
+  uint64 rows = 0;
+
+  // Count a node of the feature and the field.
+  inline void AddNode(index_t feat_id, index_t field_id) {
+    if (feat_id > max_feat) { max_feat = feat_id; }
+    if (field_id > max_field) { max_field = field_id; }
+    nnz++;
+  }
+
+  // Add the stats of other rows.
+  void Merge(const DataStats& other) {
+    max_feat = std::max(max_feat, other.max_feat);
+    max_field = std::max(max_field, other.max_field);
+    nnz += other.nnz;
+    rows += other.rows;
+  }
+
+  // Write the stats to the current position of the file, which
+  // start with kMagic, so they are not misread from the old files.
+  void Serialize(FILE* file) const {
+    uint64 data[5] = { kMagic, max_feat, max_field, nnz, rows };
+    WriteDataToDisk(file, (char*)data, sizeof(data));
+  }
+
+  // Read the stats from [*ptr, end), which is moved to the end of
+  // them. Return false if they are not there, e.g., an old file.
+  bool Deserialize(const char** ptr, const char* end) {
+    uint64 data[5];
+    if (end - *ptr < (int64)sizeof(data)) { return false; }
+    memcpy(data, *ptr, sizeof(data));
+    if (data[0] != kMagic) { return false; }
+    max_feat = data[1];
+    max_field = data[2];
+    nnz = data[3];
+    rows = data[4];
+    *ptr += sizeof(data);
+    return true;
+  }
+
+  static const uint64 kMagic = 0x7374617473786c78ULL;
+};
 
 //------------------------------------------------------------------------------
 // DMatrix (data matrix) is used to store a batch of the dataset.
@@ -129,6 +604,13 @@ typedef std::vector<Node> SparseRow;
 //    /* We can also get the max index of feature or field */
 //    index_t max_feat = matrix.MaxFeat();
 //    index_t max_field = matrix.MaxField();
+//
+//    /* Or both of them (and the nonzeros) in one pass */
+//    DataStats stats = matrix.Stats();
+//
+// The rows are allocated by the arena of the matrix (see RowArena),
+// so the nodes of the rows are contiguous in memory,
+// and Reset() frees them at once instead of one row after another.
 //------------------------------------------------------------------------------
 // TODO(aksnzhy): Implement incremental adding
 struct DMatrix {
@@ -176,16 +658,46 @@ struct DMatrix {
     this->hash_value_2 = 0;
     // Delete Y
     std::vector<real_t>().swap(this->Y);
-    // Delete Node
-    for (int i = 0; i < this->row_length; ++i) {
-      if ((this->row)[i] != nullptr) {
-        STLDeleteElementsAndClear(&(this->row));
+    // Delete the rows which are not in the arena. The rows of
+    // any arena (e.g., shared from another matrix) are skipped
+    for (size_t i = 0; i < this->row.size(); ++i) {
+      if (row[i] != nullptr && !row[i]->InArena()) {
+        delete row[i];
       }
     }
     // Delete SparseRow
     std::vector<SparseRow*>().swap(this->row);
+    this->arena.Clear();
     // Delete norm
     std::vector<real_t>().swap(this->norm);
+    // Delete group
+    std::vector<uint64>().swap(this->group);
+    // Delete the labels of the tasks
+    std::vector<real_t>().swap(this->task_Y);
+    this->num_task = 1;
+    this->row_length = 0;
+    this->pos = 0;
+  }
+
+  // Drop all the rows like Reset(), but keep the memory of the
+  // vectors and the arena, which is reused when the matrix
+  // is filled again (e.g., by the next block of a file).
+  void Clear() {
+    this->has_label = true;
+    this->hash_value_1 = 0;
+    this->hash_value_2 = 0;
+    for (size_t i = 0; i < this->row.size(); ++i) {
+      if (row[i] != nullptr && !row[i]->InArena()) {
+        delete row[i];
+      }
+    }
+    this->row.clear();
+    this->arena.Rewind();
+    this->Y.clear();
+    this->norm.clear();
+    this->group.clear();
+    this->task_Y.clear();
+    this->num_task = 1;
     this->row_length = 0;
     this->pos = 0;
   }
@@ -195,9 +707,52 @@ struct DMatrix {
     this->Y.push_back(0);
     this->norm.push_back(1.0);
     this->row.push_back(nullptr);
+    if (!this->group.empty()) { this->group.push_back(0); }
+    if (num_task > 1) { task_Y.resize(task_Y.size() + num_task - 1, 0); }
     row_length++;
   }
 
+  // Set the number of the labels of each row for multi-task
+  // training, where Y is the label of task 0 and the others are
+  // in task_Y. If it changes, the labels of the other tasks of
+  // the rows are reset to 0.
+  void SetNumTask(index_t num) {
+    CHECK_GT(num, 0);
+    if (num == num_task) { return; }
+    num_task = num;
+    task_Y.assign((size_t)row_length * (num - 1), 0);
+  }
+
+  // The label of the task of the row, which is Y for task 0.
+  real_t& Label(index_t row_id, index_t task) {
+    return task == 0 ? Y[row_id] :
+           task_Y[(size_t)row_id * (num_task - 1) + task - 1];
+  }
+  real_t Label(index_t row_id, index_t task) const {
+    return task == 0 ? Y[row_id] :
+           task_Y[(size_t)row_id * (num_task - 1) + task - 1];
+  }
+
+  // Copy the labels of the other tasks of row j of the
+  // matrix to row i of this matrix, which can be the same.
+  void CopyTaskLabels(index_t i, const DMatrix& matrix, index_t j) {
+    CHECK_EQ(num_task, matrix.num_task);
+    for (index_t t = 1; t < num_task; ++t) {
+      Label(i, t) = matrix.Label(j, t);
+    }
+  }
+
+  // Set the group id of the row. The group vector is allocated on
+  // the first call, and then the rows without group id are in group 0.
+  void SetGroup(index_t row_id, uint64 group_id) {
+    CHECK_GT(row_length, row_id);
+    if (group.size() < row_length) { group.resize(row_length, 0); }
+    group[row_id] = group_id;
+  }
+
+  // If current matrix has the group ids.
+  bool HasGroup() const { return !group.empty(); }
+
   // Add node to current data matrix.
   // We don't use the 'field' by default because it
   // will only be used in the ffm tasks.
@@ -206,18 +761,18 @@ struct DMatrix {
                real_t feat_val, 
                index_t field_id = 0) {
     CHECK_GT(row_length, row_id);
-    // Allocate memory for the first adding
+    // Allocate the row for the first adding
     if (row[row_id] == nullptr) {
-      row[row_id] = new SparseRow;
+      row[row_id] = arena.NewRow();
     }
     Node node(field_id, feat_id, feat_val);
-    row[row_id]->push_back(node);
+    arena.PushBack(row[row_id], node);
   }
 
   // The hash value is used to identify the difference
-  // between two data matrix, and it can be generated by HashFile() 
-  // method (in file_util.h) and this value will be used when reading 
-  // txt data from disk file. We can cache the binary data in disk file 
+  // between two data matrix, and it can be generated by HashFileStamp()
+  // and HashFileSample() (in file_util.h), and this value will be used
+  // when reading txt data from disk file. We can cache the binary data in disk file 
   // to accelerate the reading of disk file.
   void SetHash(uint64 hash_1, uint64 hash_2) {
     hash_value_1 = hash_1;
@@ -238,25 +793,64 @@ struct DMatrix {
     this->row.resize(row_length, nullptr);
     // Copy row
     for (index_t i = 0; i < row_length; ++i) {
-      SparseRow* rowc = matrix->row[i];
-      for (SparseRow::iterator iter = rowc->begin();
-           iter != rowc->end(); ++iter) {
-        this->AddNode(i, 
-                iter->feat_id, 
-                iter->feat_val, 
-                iter->field_id);
+      const SparseRow* rowc = matrix->row[i];
+      if (rowc != nullptr) {
+        row[i] = arena.NewRow(rowc->begin(), rowc->end());
       }
     }
     // Copy y
     this->Y = matrix->Y;
     // Copy norm
     this->norm = matrix->norm;
+    // Copy group
+    this->group = matrix->group;
+    // Copy the labels of the tasks
+    this->num_task = matrix->num_task;
+    this->task_Y = matrix->task_Y;
     // Copy has label
     this->has_label = matrix->has_label;
     // Copy pos
     this->pos = matrix->pos;
   }
 
+  // Move the rows of another matrix to the end of this matrix,
+  // and the other matrix is empty after that. Here we only move
+  // the pointers of the rows, so nothing is copied.
+  void Append(DMatrix* matrix) {
+    CHECK_NOTNULL(matrix);
+    CHECK_NE(matrix, this);
+    // Group
+    if (this->HasGroup() || matrix->HasGroup()) {
+      this->group.resize(row_length, 0);
+      if (matrix->HasGroup()) {
+        this->group.insert(this->group.end(),
+                           matrix->group.begin(),
+                           matrix->group.end());
+      } else {
+        this->group.resize(row_length + matrix->row_length, 0);
+      }
+    }
+    this->row.insert(this->row.end(),
+                     matrix->row.begin(),
+                     matrix->row.end());
+    this->Y.insert(this->Y.end(),
+                   matrix->Y.begin(),
+                   matrix->Y.end());
+    this->norm.insert(this->norm.end(),
+                      matrix->norm.begin(),
+                      matrix->norm.end());
+    if (this->row_length == 0) { this->num_task = matrix->num_task; }
+    CHECK_EQ(this->num_task, matrix->num_task);
+    this->task_Y.insert(this->task_Y.end(),
+                        matrix->task_Y.begin(),
+                        matrix->task_Y.end());
+    this->row_length += matrix->row_length;
+    // The rows belong to this matrix now
+    this->arena.Absorb(&matrix->arena);
+    matrix->row.clear();
+    matrix->Clear();
+  }
+
   // Compress current sparse matrix to a dense matrix.
   // This method will be used in distributed computation.
   // For example, the sparse matrix is:
@@ -277,44 +871,77 @@ struct DMatrix {
   //  -------------------------------------------------
   //  | 1 | 2 | 3 | 4 | 5 | 7 | 8 | 10 | 11 | 12 | 20 |
   //  -------------------------------------------------
-  void Compress(std::vector<index_t>& feature_list) {
-    // Using a map to store the mapping relations
-    size_t node_num {0};
-    for (auto row : this->row) {
-      node_num += row->size();
-    }
-    std::unordered_set<index_t> feat_set;
-    feat_set.reserve(node_num);
+  //
+  // The ids are radix sorted (see RadixSort) with the index of their node
+  // in the high bits, so the nodes are renamed by one scan of the sorted
+  // ids without any hash table, and the sort runs on the pool, which can
+  // be nullptr for current thread.
+  void Compress(std::vector<index_t>& feature_list,
+                ThreadPool* pool = nullptr) {
+    std::vector<Node*> nodes;
+    std::vector<uint64> keys;
+    index_t max_id = 0;
     for (index_t i = 0; i < this->row_length; ++i) {
-      SparseRow* row = this->row[i];
-      for (SparseRow::iterator iter = row->begin();
-           iter != row->end(); ++iter) {
-        if (feat_set.count(iter->feat_id) == 0) {
-          feat_set.insert(iter->feat_id);
-        }
+      for (auto &iter : *this->row[i]) {
+        keys.push_back((uint64)nodes.size() << 32 | iter.feat_id);
+        nodes.push_back(&iter);
+        max_id = std::max(max_id, iter.feat_id);
       }
     }
-    feature_list.reserve(feat_set.size());
-    std::copy(feat_set.begin(), feat_set.end(), 
-              std::back_inserter(feature_list));
-    std::sort(begin(feature_list), end(feature_list));
-    feature_map mp;
-    mp.reserve(feature_list.size());
-    for (index_t i = 0; i < feature_list.size(); ++ i) {
-      mp[feature_list[i]] = i + 1;
-    }
-    for (index_t i = 0; i < this->row_length; ++ i) {
-      for (auto &iter: *this->row[i]) {
-        // using map is better than lower_bound
-        iter.feat_id = mp[iter.feat_id];
+    CHECK_LE(nodes.size(), (size_t)1 << 32);
+    std::vector<uint64> tmp;
+    RadixSort(&keys, &tmp, id_bits(max_id), pool);
+    feature_list.clear();
+    for (uint64 key : keys) {
+      index_t id = (index_t)key;
+      if (feature_list.empty() || feature_list.back() != id) {
+        feature_list.push_back(id);
       }
+      nodes[key >> 32]->feat_id = feature_list.size();
     }
   }
 
+  // Get the sorted ids of the features used by the rows, e.g.,
+  // the keys pulled from the parameter server. Unlike Compress(),
+  // the rows are not changed. The ids are radix sorted on the
+  // pool, which can be nullptr for current thread.
+  void GetFeatureList(std::vector<index_t>* feature_list,
+                      ThreadPool* pool = nullptr) const {
+    CHECK_NOTNULL(feature_list);
+    feature_list->clear();
+    std::vector<uint64> keys;
+    index_t max_id = 0;
+    for (index_t i = 0; i < this->row_length; ++i) {
+      const SparseRow* r = this->row[i];
+      if (r == nullptr) { continue; }
+      for (SparseRow::const_iterator iter = r->begin();
+           iter != r->end(); ++iter) {
+        keys.push_back(iter->feat_id);
+        max_id = std::max(max_id, iter->feat_id);
+      }
+    }
+    std::vector<uint64> tmp;
+    RadixSort(&keys, &tmp, id_bits(max_id), pool);
+    for (uint64 key : keys) {
+      index_t id = (index_t)key;
+      if (feature_list->empty() || feature_list->back() != id) {
+        feature_list->push_back(id);
+      }
+    }
+  }
+
+  // The number of the bits of the ids up to max_id.
+  static int id_bits(index_t max_id) {
+    int bits = 1;
+    while (bits < 32 && (max_id >> bits) != 0) { ++bits; }
+    return bits;
+  }
+
   // Get a mini-batch of data from current data matrix.
   // This method will be used for distributed computation. 
   // Return the count of sample for each function call.
   index_t GetMiniBatch(index_t batch_size, DMatrix& mini_batch) {
+    mini_batch.SetNumTask(num_task);
     // Copy mini-batch
     for (index_t i = 0; i < batch_size; ++i) {
       if (this->pos >= this->row_length) {
@@ -324,62 +951,116 @@ struct DMatrix {
       mini_batch.row[i] = this->row[pos];
       mini_batch.Y[i] = this->Y[pos];
       mini_batch.norm[i] = this->norm[pos];
+      if (HasGroup()) { mini_batch.SetGroup(i, this->group[pos]); }
+      mini_batch.CopyTaskLabels(i, *this, pos);
       this->pos++;
     }
     return batch_size;
   }
 
   // Serialize current DMatrix to disk file.
-  void Serialize(const std::string& filename) {
+  void Serialize(const std::string& filename, ThreadPool* pool = nullptr) {
     CHECK_NE(filename.empty(), true);
-    CHECK_EQ(row_length, row.size());
-    CHECK_EQ(row_length, Y.size());
-    CHECK_EQ(row_length, norm.size());
 #ifndef _MSC_VER
     FILE* file = OpenFileOrDie(filename.c_str(), "w");
 #else
     FILE* file = OpenFileOrDie(filename.c_str(), "wb");
 #endif
-    // Write hash_value
-    WriteDataToDisk(file, (char*)&hash_value_1, sizeof(hash_value_1));
-    WriteDataToDisk(file, (char*)&hash_value_2, sizeof(hash_value_2));
-    // Write row_length
-    WriteDataToDisk(file, (char*)&row_length, sizeof(row_length));
-    // Write row
-    for (size_t i = 0; i < row_length; ++i) {
-      WriteVectorToFile(file, *(row[i]));
-    }
-    // Write Y
-    WriteVectorToFile(file, Y);
-    // Write norm
-    WriteVectorToFile(file, norm);
-    // Write has_label
-    WriteDataToDisk(file, (char*)&has_label, sizeof(has_label));
-    // Write pos
-    WriteDataToDisk(file, (char*)&pos, sizeof(pos));
+    Serialize(file, pool);
     Close(file);
   }
 
+  // Serialize current DMatrix to the current position of
+  // an open file, so a file can keep many matrices.
+  //
+  // The rows are compressed (kFormatVersion), and they are written
+  // in the chunks of kRowsPerChunk rows after the index of their
+  // bytes, so the offset of each chunk is known before it is read,
+  // and the chunks are read and decoded in parallel:
+  //
+  //   | bytes of chunk_0 | bytes of chunk_1 | ... | chunk_0 | chunk_1 | ...
+  //
+  // Each row of a chunk is the varint of (len << 1 | unit), and then
+  // the varints of the len feature ids, which are the ZigZag deltas of
+  // the previous ids (e.g., the sorted ids give the small deltas), the
+  // varints of the len field ids, and the len values (4 bytes), which
+  // are omitted if they are all 1.0 (unit = 1), the common case of the
+  // one-hot categorical features. The chunks are encoded in
+  // parallel if pool is not nullptr.
+  void Serialize(FILE* file, ThreadPool* pool = nullptr) {
+    CHECK_NOTNULL(file);
+    serialize([file](const char* data, size_t len) {
+      WriteDataToDisk(file, data, len);
+    }, pool);
+  }
+
+  // Serialize current DMatrix to the end of a memory buffer in the
+  // format of Serialize(file), e.g., a block kept in memory by the
+  // on-disk reader, which is read by Deserialize(buf, size).
+  void Serialize(std::string* buf, ThreadPool* pool = nullptr) {
+    CHECK_NOTNULL(buf);
+    serialize([buf](const char* data, size_t len) {
+      buf->append(data, len);
+    }, pool);
+  }
+
   // Deserialize the DMatrix from disk file.
-  void Deserialize(const std::string& filename) {
+  void Deserialize(const std::string& filename, ThreadPool* pool = nullptr) {
     CHECK(!filename.empty());
-    this->Reset();
 #ifndef _MSC_VER
     FILE* file = OpenFileOrDie(filename.c_str(), "r");
 #else
     FILE* file = OpenFileOrDie(filename.c_str(), "rb");
 #endif
+    Deserialize(file, pool);
+    Close(file);
+  }
+
+  // Deserialize the DMatrix from the current position of
+  // an open file, which is written by Serialize(file).
+  // If pool is not nullptr, each thread reads its chunks at
+  // their offsets by pread() and decodes them.
+  void Deserialize(FILE* file, ThreadPool* pool = nullptr) {
+    CHECK_NOTNULL(file);
+    this->Reset();
     // Read hash_value
     ReadDataFromDisk(file, (char*)&hash_value_1, sizeof(hash_value_1));
     ReadDataFromDisk(file, (char*)&hash_value_2, sizeof(hash_value_2));
     // Read row_length
     ReadDataFromDisk(file, (char*)&row_length, sizeof(row_length));
     CHECK_GE(row_length, 0);
-    // Read row
-    row.resize(row_length, nullptr);
-    for (size_t i = 0; i < row_length; ++i) {
-      row[i] = new SparseRow;
-      ReadVectorFromFile(file, *(row[i]));
+    // Read row, which is the index of the bytes of the
+    // chunks, and then the chunks at their offsets
+    std::vector<uint64> sizes(num_chunks());
+    if (!sizes.empty()) {
+      uint64 len = sizes.size() * sizeof(uint64);
+      CHECK_EQ(ReadDataFromDisk(file, (char*)sizes.data(), len), len);
+    }
+    std::vector<uint64> offsets(sizes.size() + 1, 0);
+    for (size_t c = 0; c < sizes.size(); ++c) {
+      offsets[c+1] = offsets[c] + sizes[c];
+    }
+    std::vector<char> buffer(offsets.back());
+    std::vector<Chunk> chunks(sizes.size());
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      chunks[c] = Chunk(buffer.data() + offsets[c], sizes[c]);
+    }
+#ifndef _MSC_VER
+    if (pool != nullptr && chunks.size() > 1) {
+      uint64 base = FileTell(file);
+      decode_chunks(chunks, pool, [&](size_t c) {
+        ReadDataAt(file, buffer.data() + offsets[c], sizes[c],
+                   base + offsets[c]);
+      });
+      FileSeek(file, base + offsets.back());
+    } else
+#endif
+    {
+      if (!buffer.empty()) {
+        CHECK_EQ(ReadDataFromDisk(file, buffer.data(), buffer.size()),
+                 buffer.size());
+      }
+      decode_chunks(chunks, pool);
     }
     // Read Y
     ReadVectorFromFile(file, Y);
@@ -389,17 +1070,189 @@ struct DMatrix {
     ReadDataFromDisk(file, (char*)&has_label, sizeof(has_label));
     // Read pos
     ReadDataFromDisk(file, (char*)&pos, sizeof(pos));
-    Close(file);
+    // Read group
+    bool has_group = false;
+    ReadDataFromDisk(file, (char*)&has_group, sizeof(has_group));
+    if (has_group) { ReadVectorFromFile(file, group); }
+    // Read the labels of the tasks
+    ReadDataFromDisk(file, (char*)&num_task, sizeof(num_task));
+    if (num_task > 1) { ReadVectorFromFile(file, task_Y); }
+  }
+
+  // Deserialize the DMatrix from a memory buffer (e.g., a mapped
+  // file), which is written by Serialize(file). Return the number
+  // of bytes it takes, so the next matrix starts after that.
+  // The rows are decoded in parallel if pool is not nullptr.
+  uint64 Deserialize(const char* buf, uint64 size,
+                     ThreadPool* pool = nullptr) {
+    CHECK_NOTNULL(buf);
+    this->Clear();
+    const char* ptr = buf;
+    const char* end = buf + size;
+    // Read hash_value
+    ReadDataFromBuffer(&ptr, end, (char*)&hash_value_1, sizeof(hash_value_1));
+    ReadDataFromBuffer(&ptr, end, (char*)&hash_value_2, sizeof(hash_value_2));
+    // Read row_length
+    ReadDataFromBuffer(&ptr, end, (char*)&row_length, sizeof(row_length));
+    // Read row, which is the index of the bytes of the chunks
+    std::vector<uint64> sizes(num_chunks());
+    if (!sizes.empty()) {
+      ReadDataFromBuffer(&ptr, end, (char*)sizes.data(),
+                         sizes.size() * sizeof(uint64));
+    }
+    std::vector<Chunk> chunks(sizes.size());
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      if (sizes[c] > (uint64)(end - ptr)) {
+        LOG(FATAL) << "Error: read out of the buffer.";
+      }
+      chunks[c] = Chunk(ptr, sizes[c]);
+      ptr += sizes[c];
+    }
+    decode_chunks(chunks, pool);
+    // Read Y
+    ReadVectorFromBuffer(&ptr, end, Y);
+    // Read norm
+    ReadVectorFromBuffer(&ptr, end, norm);
+    // Read has label
+    ReadDataFromBuffer(&ptr, end, (char*)&has_label, sizeof(has_label));
+    // Read pos
+    ReadDataFromBuffer(&ptr, end, (char*)&pos, sizeof(pos));
+    // Read group, and the old file has nothing here
+    bool has_group = false;
+    if (ptr < end) {
+      ReadDataFromBuffer(&ptr, end, (char*)&has_group, sizeof(has_group));
+    }
+    if (has_group) { ReadVectorFromBuffer(&ptr, end, group); }
+    // Read the labels of the tasks
+    if (ptr < end) {
+      ReadDataFromBuffer(&ptr, end, (char*)&num_task, sizeof(num_task));
+    }
+    if (num_task > 1) { ReadVectorFromBuffer(&ptr, end, task_Y); }
+    return ptr - buf;
+  }
+
+  // Bytes of the memory of the matrix: the vectors, the arena, and
+  // the rows out of the arena, but not the rows that it shares with
+  // another matrix, e.g., the rows of the reader's buffer.
+  uint64 MemoryBytes() const {
+    uint64 bytes = arena.Bytes() +
+                   row.capacity() * sizeof(SparseRow*) +
+                   Y.capacity() * sizeof(real_t) +
+                   norm.capacity() * sizeof(real_t) +
+                   group.capacity() * sizeof(uint64) +
+                   task_Y.capacity() * sizeof(real_t);
+    for (size_t i = 0; i < row.size(); ++i) {
+      if (row[i] != nullptr && !row[i]->InArena()) {
+        bytes += sizeof(SparseRow) + row[i]->capacity() * sizeof(Node);
+      }
+    }
+    return bytes;
+  }
+
+  // The version of the format written by Serialize(), which
+  // is mixed into the hash of the binary files, so the files
+  // of an old format are rebuilt instead of being misread.
+  static const uint64 kFormatVersion = 4;
+
+  // Number of rows in a compressed chunk.
+  static const size_t kRowsPerChunk = 4096;
+
+  // Number of the compressed chunks of the rows.
+  size_t num_chunks() const {
+    return ((size_t)row_length + kRowsPerChunk - 1) / kRowsPerChunk;
+  }
+
+  // Append the compressed row (see Serialize(file)) to the end of
+  // buffer, where nullptr is an empty row.
+  static void EncodeRow(const SparseRow* r, std::vector<char>* buffer) {
+    size_t len = r == nullptr ? 0 : r->size();
+    CHECK_LT(len, (size_t)1 << 31);
+    bool unit = is_unit(r);
+    size_t offset = buffer->size();
+    buffer->resize(offset + (len * 2 + 1) * kMaxVarint32Bytes +
+                   (unit ? 0 : len * sizeof(real_t)));
+    char* p = buffer->data() + offset;
+    p = EncodeVarint32(p, (uint32)(len << 1) | (unit ? 1 : 0));
+    index_t last_id = 0;
+    for (size_t j = 0; j < len; ++j) {
+      index_t id = (*r)[j].feat_id;
+      p = EncodeVarint32(p, ZigZagEncode32((int32)(id - last_id)));
+      last_id = id;
+    }
+    for (size_t j = 0; j < len; ++j) {
+      p = EncodeVarint32(p, (*r)[j].field_id);
+    }
+    if (!unit) {
+      for (size_t j = 0; j < len; ++j, p += sizeof(real_t)) {
+        memcpy(p, &(*r)[j].feat_val, sizeof(real_t));
+      }
+    }
+    buffer->resize(p - buffer->data());
+  }
+
+  // Decode the compressed row at [ptr, end) to a new row of arena,
+  // and return the byte after it.
+  static const char* DecodeRow(const char* ptr,
+                               const char* end,
+                               RowArena* arena,
+                               SparseRow** row) {
+    uint32 header = 0;
+    ptr = next_varint(ptr, end, &header);
+    size_t len = header >> 1;
+    bool unit = header & 1;
+    // A node takes two bytes at least
+    if (len * 2 > (uint64)(end - ptr)) {
+      LOG(FATAL) << "Error: read out of the buffer.";
+    }
+    SparseRow* r = arena->NewRow(len);
+    Node* nodes = r->data();
+    index_t id = 0;
+    for (size_t j = 0; j < len; ++j) {
+      uint32 delta = 0;
+      ptr = next_varint(ptr, end, &delta);
+      id += (index_t)ZigZagDecode32(delta);
+      nodes[j].feat_id = id;
+    }
+    for (size_t j = 0; j < len; ++j) {
+      ptr = next_varint(ptr, end, &nodes[j].field_id);
+    }
+    if (unit) {
+      for (size_t j = 0; j < len; ++j) { nodes[j].feat_val = 1.0f; }
+    } else {
+      if (len * sizeof(real_t) > (uint64)(end - ptr)) {
+        LOG(FATAL) << "Error: read out of the buffer.";
+      }
+      for (size_t j = 0; j < len; ++j, ptr += sizeof(real_t)) {
+        memcpy(&nodes[j].feat_val, ptr, sizeof(real_t));
+      }
+    }
+    *row = r;
+    return ptr;
   }
 
   // We get find the max index of feature or field in current
   // data matrix. This is used for initialize our model parameter.  
   inline index_t MaxFeat() const { return max_feat_or_field(true); }
+  // The shape of the rows in one pass.
+  DataStats Stats() const {
+    DataStats stats;
+    stats.rows = row_length;
+    for (size_t i = 0; i < row_length; ++i) {
+      const SparseRow* sr = this->row[i];
+      if (sr == nullptr) { continue; }
+      for (SparseRow::const_iterator iter = sr->begin();
+           iter != sr->end(); ++iter) {
+        stats.AddNode(iter->feat_id, iter->field_id);
+      }
+    }
+    return stats;
+  }
   inline index_t MaxField() const { return max_feat_or_field(false); }
   inline index_t max_feat_or_field(bool is_feat) const {
     index_t max = 0;
     for (size_t i = 0; i < row_length; ++i) {
       SparseRow* sr = this->row[i];
+      if (sr == nullptr) { continue; }
       for (SparseRow::const_iterator iter = sr->begin();
            iter != sr->end(); ++iter) {
         if (is_feat) {  // feature
@@ -416,6 +1269,140 @@ struct DMatrix {
     return max;
   }
 
+  // A compressed chunk of rows, which is (begin, bytes).
+  typedef std::pair<const char*, uint64> Chunk;
+
+  // If all the values of the row are 1.0.
+  static bool is_unit(const SparseRow* r) {
+    if (r == nullptr) { return true; }
+    for (size_t i = 0; i < r->size(); ++i) {
+      if ((*r)[i].feat_val != 1.0f) { return false; }
+    }
+    return true;
+  }
+
+  // Write the matrix by write(data, len) (see Serialize(file)).
+  template <typename Write>
+  void serialize(Write write, ThreadPool* pool) {
+    CHECK_EQ(row_length, row.size());
+    CHECK_EQ(row_length, Y.size());
+    CHECK_EQ(row_length, norm.size());
+    CHECK_GT(row_length, 0);
+    // Write hash_value
+    write((char*)&hash_value_1, sizeof(hash_value_1));
+    write((char*)&hash_value_2, sizeof(hash_value_2));
+    // Write row_length
+    write((char*)&row_length, sizeof(row_length));
+    // Write row, where all the chunks are compressed
+    // in memory first for the index of their bytes
+    std::vector<std::vector<char>> chunks(num_chunks());
+    auto encode = [&](size_t begin, size_t end) {
+      for (size_t c = begin; c < end; ++c) {
+        encode_chunk(c * kRowsPerChunk,
+                     std::min((c + 1) * kRowsPerChunk, (size_t)row_length),
+                     &chunks[c]);
+      }
+    };
+    if (pool == nullptr || chunks.size() < 2) {
+      encode(0, chunks.size());
+    } else {
+      pool->ParallelFor(0, chunks.size(), 1, encode);
+    }
+    std::vector<uint64> sizes(chunks.size());
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      sizes[c] = chunks[c].size();
+    }
+    write((char*)sizes.data(), sizes.size() * sizeof(uint64));
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      write(chunks[c].data(), sizes[c]);
+    }
+    // The vectors are the length and then the data
+    auto write_vector = [&write](const std::vector<real_t>& vec) {
+      size_t len = vec.size();
+      write((char*)&len, sizeof(len));
+      write((char*)vec.data(), sizeof(real_t) * len);
+    };
+    // Write Y
+    write_vector(Y);
+    // Write norm
+    write_vector(norm);
+    // Write has_label
+    write((char*)&has_label, sizeof(has_label));
+    // Write pos
+    write((char*)&pos, sizeof(pos));
+    // Write group, which is at the end so that
+    // the file without it can still be read
+    bool has_group = HasGroup();
+    write((char*)&has_group, sizeof(has_group));
+    if (has_group) {
+      size_t len = group.size();
+      write((char*)&len, sizeof(len));
+      write((char*)group.data(), sizeof(group[0]) * len);
+    }
+    // Write the labels of the tasks
+    write((char*)&num_task, sizeof(num_task));
+    if (num_task > 1) { write_vector(task_Y); }
+  }
+
+  // Compress the rows [begin, end) to buffer.
+  void encode_chunk(size_t begin, size_t end, std::vector<char>* buffer) {
+    buffer->clear();
+    for (size_t i = begin; i < end; ++i) {
+      EncodeRow(row[i], buffer);
+    }
+  }
+
+  // Read a varint of the compressed rows.
+  static const char* next_varint(const char* p,
+                                 const char* end,
+                                 uint32* value) {
+    p = DecodeVarint32(p, end, value);
+    if (p == nullptr) {
+      LOG(FATAL) << "Error: bad varint in the binary data.";
+    }
+    return p;
+  }
+
+  // Decode the c-th chunk, whose rows are allocated from arena.
+  void decode_chunk(size_t c, const Chunk& chunk, RowArena* arena) {
+    const char* ptr = chunk.first;
+    const char* end = chunk.first + chunk.second;
+    size_t begin = c * kRowsPerChunk;
+    size_t last = std::min(begin + kRowsPerChunk, (size_t)row_length);
+    for (size_t i = begin; i < last; ++i) {
+      ptr = DecodeRow(ptr, end, arena, &row[i]);
+    }
+    CHECK_EQ(ptr, end);
+  }
+
+  // Decode all the chunks. In parallel, each chunk has its
+  // own arena, which is then moved to the arena of matrix.
+  // Each chunk is read by read(c) first if it is given.
+  void decode_chunks(const std::vector<Chunk>& chunks, ThreadPool* pool,
+                     const std::function<void(size_t)>& read = nullptr) {
+    row.resize(row_length, nullptr);
+    if (pool == nullptr || chunks.size() < 2) {
+      for (size_t c = 0; c < chunks.size(); ++c) {
+        if (read) { read(c); }
+        decode_chunk(c, chunks[c], &arena);
+      }
+      return;
+    }
+    std::unique_ptr<RowArena[]> arenas(new RowArena[chunks.size()]);
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      arena.ShareSpare(&arenas[c], chunks.size() - c);
+    }
+    pool->ParallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end) {
+      for (size_t c = begin; c < end; ++c) {
+        if (read) { read(c); }
+        decode_chunk(c, chunks[c], &arenas[c]);
+      }
+    });
+    for (size_t c = 0; c < chunks.size(); ++c) {
+      arena.Absorb(&arenas[c]);
+    }
+  }
+
   /* The DMatrix has a hash value that is generated
   from the TXT file. These two values are used to check 
   whether we can use binary file to speedup data reading */
@@ -425,17 +1412,79 @@ struct DMatrix {
   index_t row_length;
   /* Store many SparseRow. Using pointer for zero-copy */
   std::vector<SparseRow*> row;
+  /* The rows added by AddNode(), CopyFrom() and Deserialize()
+  are allocated here, and rows moved by Append() too */
+  RowArena arena;
   /* (0 or -1) for negative and (+1) for positive
   examples, and others value for regression */
   std::vector<real_t> Y;
   /* Used for instance-wise normalization */
   std::vector<real_t> norm;
+  /* Group (e.g., query or user) id of each row, given by
+  'qid:<id>' in the data, which is used by GAUC. It is
+  empty if the data has no group id */
+  std::vector<uint64> group;
+  /* Number of the labels of each row for multi-task training,
+  and the labels of task 1 to num_task - 1 of each row, which
+  are num_task - 1 values of each row (see SetNumTask) */
+  index_t num_task = 1;
+  std::vector<real_t> task_Y;
   /* If current dataset has label y */
   bool has_label;
   /* Current position for GetMiniBatch() */
   index_t pos;
 };
 
+//------------------------------------------------------------------------------
+// RowLoss keeps the loss of each row of an in-memory reader, so the rows
+// of the later passes are sampled by their loss (see Reader::TrackLoss).
+// The reader gives the ids (in its buffer) and the importance weights of
+// the rows of current batch, and the loss function weights the gradient
+// of each row and writes its loss after the update:
+//
+//   real_t pg = rows->weight[i] * partial_grad(pred, y);
+//   ...
+//   rows->loss[rows->ids[i]] = loss_of(pred, y);
+//
+// The weight of a row is 1/p for the probability p that it is sampled,
+// and 1 for all the rows of a pass that is not sampled.
+//------------------------------------------------------------------------------
+struct RowLoss {
+  /* Loss of each row of the reader at its last update */
+  std::vector<real_t> loss;
+  /* Ids and importance weights of the rows of current batch */
+  std::vector<index_t> ids;
+  std::vector<real_t> weight;
+  /* Sum of the weights of current batch */
+  real_t batch_weight = 0;
+};
+
+//------------------------------------------------------------------------------
+// DataIter gives the data batch by batch from the caller, e.g., the
+// loader of python whose data does not fit in memory together (see
+// FromIterReader). next() returns the number of rows of the next batch,
+// or 0 at the end of the pass, and sets the batch in the CSR layout of
+// XlearnCreateDataView(): the nodes (xLearn::Node) of row i are
+// nodes[indptr[i], indptr[i+1]), and label (can be NULL) has a value of
+// each row. The caller keeps the arrays alive and unchanged until the
+// next call, and reset() starts the next pass over the same data.
+//------------------------------------------------------------------------------
+struct DataIter {
+  typedef uint64 (*NextFunc)(void* handle,
+                             const uint64** indptr,
+                             const void** nodes,
+                             const real_t** label);
+  typedef void (*ResetFunc)(void* handle);
+
+  NextFunc next = nullptr;
+  ResetFunc reset = nullptr;
+  /* Given back to the callbacks */
+  void* handle = nullptr;
+
+  // No iterator is set.
+  bool Empty() const { return next == nullptr; }
+};
+
 }  // namespace xLearn
 
 #endif  // XLEARN_DATA_DATA_STRUCTURE_H_
@@ -26,6 +26,177 @@ namespace xLearn {
 
 const size_t kLength = 10;
 
+TEST(SPARSE_ROW_TEST, Vector) {
+  SparseRow row;
+  EXPECT_TRUE(row.empty());
+  EXPECT_FALSE(row.InArena());
+  for (index_t i = 0; i < 100; ++i) {
+    row.push_back(Node(i % 3, i, 0.5));
+  }
+  ASSERT_EQ(row.size(), 100);
+  EXPECT_GE(row.capacity(), 100);
+  EXPECT_EQ(row.front().feat_id, 0);
+  EXPECT_EQ(row.back().feat_id, 99);
+  EXPECT_EQ(row[50].field_id, 2);
+  // Copy
+  SparseRow copy(row);
+  EXPECT_NE(copy.data(), row.data());
+  ASSERT_EQ(copy.size(), row.size());
+  SparseRow reversed(row.rbegin(), row.rend());
+  ASSERT_EQ(reversed.size(), row.size());
+  for (index_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(copy[i].feat_id, i);
+    EXPECT_EQ(reversed[i].feat_id, 99 - i);
+  }
+  reversed = row;
+  EXPECT_EQ(reversed[0].feat_id, 0);
+  // Resize
+  SparseRow sized(3);
+  EXPECT_EQ(sized.size(), 3);
+  sized.resize(1);
+  EXPECT_EQ(sized.size(), 1);
+  sized.clear();
+  EXPECT_TRUE(sized.empty());
+  EXPECT_EQ(sizeof(SparseRow), 16);
+}
+
+TEST(SPARSE_ROW_TEST, Arena) {
+  RowArena arena;
+  EXPECT_EQ(arena.Bytes(), 0);
+  // The rows are built one by one, and they are contiguous
+  std::vector<SparseRow*> rows;
+  for (index_t i = 0; i < 2000; ++i) {
+    rows.push_back(arena.NewRow());
+    EXPECT_TRUE(rows.back()->InArena());
+    for (index_t j = 0; j <= i % 7; ++j) {
+      arena.PushBack(rows.back(), Node(0, i, j));
+    }
+  }
+  size_t contiguous = 0;
+  for (index_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(rows[i]->size(), i % 7 + 1);
+    EXPECT_EQ((*rows[i])[0].feat_id, i);
+    EXPECT_FLOAT_EQ(rows[i]->back().feat_val, i % 7);
+    EXPECT_EQ(rows[i]->capacity(), 0);
+    if (i > 0 && rows[i]->data() == rows[i-1]->data() + rows[i-1]->size()) {
+      contiguous++;
+    }
+  }
+  // Only the first row of a chunk starts elsewhere
+  EXPECT_GT(contiguous, 1900);
+  EXPECT_GT(arena.Bytes(), 0);
+  // Add to a row before the last one
+  arena.PushBack(rows[10], Node(1, 10, 7));
+  arena.PushBack(rows[1999], Node(1, 1999, 7));
+  ASSERT_EQ(rows[10]->size(), 5);
+  EXPECT_EQ((*rows[10])[0].feat_id, 10);
+  EXPECT_EQ(rows[10]->back().field_id, 1);
+  EXPECT_EQ(rows[1999]->back().field_id, 1);
+  EXPECT_EQ((*rows[11])[0].feat_id, 11);
+  // A long row
+  SparseRow* long_row = arena.NewRow();
+  for (index_t j = 0; j < 3 * RowArena::kMaxChunkNodes; ++j) {
+    arena.PushBack(long_row, Node(0, j, 1.0));
+  }
+  ASSERT_EQ(long_row->size(), 3 * RowArena::kMaxChunkNodes);
+  for (index_t j = 0; j < long_row->size(); ++j) {
+    ASSERT_EQ((*long_row)[j].feat_id, j);
+  }
+  // A copy
+  SparseRow* copy = arena.NewRow(long_row->begin(), long_row->begin() + 5);
+  ASSERT_EQ(copy->size(), 5);
+  EXPECT_EQ((*copy)[4].feat_id, 4);
+  // The row copied to its own memory by push_back()
+  copy->push_back(Node(0, 5, 1.0));
+  EXPECT_GT(copy->capacity(), 0);
+  arena.PushBack(copy, Node(0, 6, 1.0));
+  EXPECT_EQ((*copy)[6].feat_id, 6);
+  // Absorb
+  RowArena other;
+  SparseRow* row = other.NewRow(3);
+  (*row)[2].feat_id = 7;
+  uint64 bytes = arena.Bytes() + other.Bytes();
+  arena.Absorb(&other);
+  EXPECT_EQ(other.Bytes(), 0);
+  EXPECT_EQ(arena.Bytes(), bytes);
+  EXPECT_EQ((*row)[2].feat_id, 7);
+  // The arena still works
+  SparseRow* last = arena.NewRow();
+  arena.PushBack(last, Node(0, 8, 1.0));
+  EXPECT_EQ((*row)[2].feat_id, 7);
+  EXPECT_EQ((*last)[0].feat_id, 8);
+  arena.Clear();
+  EXPECT_EQ(arena.Bytes(), 0);
+}
+
+// The chunks are reused after Rewind()
+TEST(SPARSE_ROW_TEST, Arena_rewind) {
+  RowArena arena;
+  uint64 bytes = 0;
+  for (int t = 0; t < 3; ++t) {
+    for (index_t i = 0; i < 5000; ++i) {
+      SparseRow* row = arena.NewRow();
+      EXPECT_TRUE(row->empty());
+      EXPECT_EQ(row->capacity(), 0);
+      for (index_t j = 0; j < 10; ++j) {
+        arena.PushBack(row, Node(0, i, j));
+      }
+      // Some rows are copied to their own memory
+      if (i % 100 == 0) { row->push_back(Node(0, i, 10)); }
+      ASSERT_EQ((*row)[9].feat_id, i);
+    }
+    if (t == 0) { bytes = arena.Bytes(); }
+    EXPECT_EQ(arena.Bytes(), bytes);
+    arena.Rewind();
+    EXPECT_EQ(arena.Bytes(), bytes);
+  }
+  // The spare chunks are shared and taken back
+  RowArena threads[3];
+  for (int k = 0; k < 3; ++k) {
+    arena.ShareSpare(&threads[k], 3 - k);
+    EXPECT_GT(threads[k].Bytes(), 0);
+  }
+  EXPECT_EQ(arena.Bytes(), 0);
+  for (int k = 0; k < 3; ++k) {
+    SparseRow* row = threads[k].NewRow();
+    threads[k].PushBack(row, Node(0, k, 1.0));
+    arena.Absorb(&threads[k]);
+    EXPECT_EQ((*row)[0].feat_id, k);
+  }
+  EXPECT_EQ(arena.Bytes(), bytes);
+  arena.Clear();
+  EXPECT_EQ(arena.Bytes(), 0);
+}
+
+// The view rows use the nodes of the caller, which
+// are never written or freed by the arena.
+TEST(SPARSE_ROW_TEST, Arena_view) {
+  std::vector<Node> nodes;
+  for (index_t i = 0; i < 10; ++i) {
+    nodes.push_back(Node(i % 3, i, i * 0.5));
+  }
+  RowArena arena;
+  SparseRow* a = arena.NewView(nodes.data(), 4);
+  SparseRow* b = arena.NewView(nodes.data() + 4, 6);
+  EXPECT_TRUE(a->InArena());
+  EXPECT_EQ(a->data(), nodes.data());
+  EXPECT_EQ(b->size(), 6);
+  EXPECT_EQ((*b)[0].feat_id, 4);
+  // The row is copied before it is changed
+  arena.PushBack(a, Node(0, 100, 1.0));
+  EXPECT_NE(a->data(), nodes.data());
+  EXPECT_EQ(a->size(), 5);
+  EXPECT_EQ((*a)[3].feat_id, 3);
+  EXPECT_EQ((*a)[4].feat_id, 100);
+  EXPECT_EQ(nodes[4].feat_id, 4);
+  b->push_back(Node(0, 101, 1.0));
+  EXPECT_EQ(b->size(), 7);
+  EXPECT_EQ(nodes.size(), 10);
+  arena.Rewind();
+  arena.Clear();
+  EXPECT_EQ(nodes[9].feat_id, 9);
+}
+
 TEST(DMATRIX_TEST, ReAlloc) {
   DMatrix matrix;
   matrix.ReAlloc(kLength, false);
@@ -52,6 +223,38 @@ TEST(DMATRIX_TEST, Reset) {
   EXPECT_EQ(matrix.row.empty(),true);
 }
 
+// Clear() keeps the memory for the next rows
+TEST(DMATRIX_TEST, Clear) {
+  DMatrix matrix;
+  uint64 bytes = 0;
+  for (int t = 0; t < 3; ++t) {
+    matrix.Clear();
+    EXPECT_EQ(matrix.row_length, 0);
+    EXPECT_TRUE(matrix.row.empty());
+    EXPECT_TRUE(matrix.Y.empty());
+    EXPECT_FALSE(matrix.HasGroup());
+    for (index_t i = 0; i < kLength; ++i) {
+      matrix.AddRow();
+      matrix.Y[i] = t;
+      matrix.AddNode(i, i, 1.0);
+      matrix.AddNode(i, t, 2.0);
+    }
+    matrix.SetGroup(0, 5);
+    if (t == 0) { bytes = matrix.arena.Bytes(); }
+    EXPECT_EQ(matrix.arena.Bytes(), bytes);
+    EXPECT_GE(matrix.Y.capacity(), kLength);
+    for (index_t i = 0; i < kLength; ++i) {
+      ASSERT_EQ(matrix.row[i]->size(), 2);
+      EXPECT_EQ((*matrix.row[i])[0].feat_id, i);
+      EXPECT_EQ((*matrix.row[i])[1].feat_id, t);
+      EXPECT_FLOAT_EQ(matrix.Y[i], t);
+    }
+  }
+  EXPECT_GT(matrix.Y.capacity(), 0);
+  matrix.Reset();
+  EXPECT_EQ(matrix.arena.Bytes(), 0);
+}
+
 TEST(DMATRIX_TEST, AddData) {
   DMatrix matrix;
   matrix.Reset();
@@ -131,6 +334,368 @@ TEST(DMATRIX_TEST, Serialize_and_Deserialize) {
 #endif
 }
 
+TEST(DMATRIX_TEST, Group) {
+  DMatrix matrix;
+  matrix.AddRow();
+  matrix.AddNode(0, 1, 2.5);
+  EXPECT_FALSE(matrix.HasGroup());
+  matrix.AddRow();
+  matrix.AddNode(1, 1, 2.5);
+  matrix.SetGroup(1, 99);
+  matrix.AddRow();
+  matrix.AddNode(2, 1, 2.5);
+  ASSERT_TRUE(matrix.HasGroup());
+  std::vector<uint64> expect = { 0, 99, 0 };
+  EXPECT_EQ(matrix.group, expect);
+  // Copy and serialize
+  DMatrix copy;
+  copy.CopyFrom(&matrix);
+  EXPECT_EQ(copy.group, expect);
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_group.bin";
+#else
+  std::string filename = "../../test_group.bin";
+#endif
+  matrix.Serialize(filename);
+  matrix.Reset();
+  EXPECT_FALSE(matrix.HasGroup());
+  matrix.Deserialize(filename);
+  EXPECT_EQ(matrix.group, expect);
+  // No group
+  copy.Reset();
+  copy.AddRow();
+  copy.AddNode(0, 1, 2.5);
+  copy.Serialize(filename);
+  matrix.Deserialize(filename);
+  EXPECT_EQ(matrix.row_length, 1);
+  EXPECT_FALSE(matrix.HasGroup());
+  RemoveFile(filename.c_str());
+}
+
+TEST(DMATRIX_TEST, Task_labels) {
+  DMatrix matrix;
+  matrix.Reset();
+  matrix.SetNumTask(3);
+  for (size_t i = 0; i < kLength; ++i) {
+    matrix.AddRow();
+    matrix.AddNode(i, 1, 2.5);
+    matrix.Label(i, 0) = i;
+    matrix.Label(i, 1) = i + 0.5;
+    matrix.Label(i, 2) = -1.0 * i;
+  }
+  EXPECT_EQ(matrix.task_Y.size(), kLength * 2);
+  EXPECT_FLOAT_EQ(matrix.Y[3], 3);
+  // Copy and append
+  DMatrix copy;
+  copy.CopyFrom(&matrix);
+  DMatrix more;
+  more.CopyFrom(&matrix);
+  copy.Append(&more);
+  ASSERT_EQ(copy.num_task, 3);
+  for (size_t i = 0; i < kLength * 2; ++i) {
+    EXPECT_FLOAT_EQ(copy.Label(i, 1), i % kLength + 0.5);
+    EXPECT_FLOAT_EQ(copy.Label(i, 2), -1.0 * (i % kLength));
+  }
+  // The mini-batch keeps the labels
+  DMatrix mini_batch;
+  EXPECT_EQ(matrix.GetMiniBatch(4, mini_batch), 4);
+  ASSERT_EQ(mini_batch.num_task, 3);
+  EXPECT_FLOAT_EQ(mini_batch.Label(2, 1), 2.5);
+  // Serialize
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_task.bin";
+#else
+  std::string filename = "../../test_task.bin";
+#endif
+  matrix.Serialize(filename);
+  DMatrix read;
+  read.Deserialize(filename);
+  EXPECT_EQ(read.num_task, 3);
+  EXPECT_EQ(read.task_Y, matrix.task_Y);
+  RemoveFile(filename.c_str());
+  matrix.Reset();
+  EXPECT_EQ(matrix.num_task, 1);
+  EXPECT_TRUE(matrix.task_Y.empty());
+}
+
+TEST(DMATRIX_TEST, Deserialize_from_buffer) {
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_buffer.bin";
+#else
+  std::string filename = "../../test_buffer.bin";
+#endif
+  // Two matrices in a file, and the second one has group
+  DMatrix matrix[2];
+  for (int m = 0; m < 2; ++m) {
+    for (size_t i = 0; i < kLength; ++i) {
+      matrix[m].AddRow();
+      matrix[m].AddNode(i, i + m, 2.5, i);
+      matrix[m].AddNode(i, i + m + 1, 0.5, i);
+      matrix[m].Y[i] = i + m;
+    }
+    matrix[m].SetHash(1234 + m, 5678 + m);
+  }
+  matrix[1].SetGroup(3, 99);
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  matrix[0].Serialize(file);
+  matrix[1].Serialize(file);
+  Close(file);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  uint64 offset = 0;
+  for (int m = 0; m < 2; ++m) {
+    DMatrix read;
+    offset += read.Deserialize(buf + offset, size - offset);
+    EXPECT_EQ(read.row_length, kLength);
+    EXPECT_EQ(read.hash_value_1, 1234 + m);
+    EXPECT_EQ(read.hash_value_2, 5678 + m);
+    EXPECT_EQ(read.Y, matrix[m].Y);
+    EXPECT_EQ(read.norm, matrix[m].norm);
+    EXPECT_EQ(read.group, matrix[m].group);
+    for (size_t i = 0; i < kLength; ++i) {
+      ASSERT_EQ(read.row[i]->size(), 2);
+      EXPECT_EQ((*read.row[i])[1].feat_id, i + m + 1);
+      EXPECT_EQ((*read.row[i])[1].field_id, i);
+      EXPECT_FLOAT_EQ((*read.row[i])[1].feat_val, 0.5);
+    }
+  }
+  EXPECT_EQ(offset, size);
+  delete [] buf;
+  RemoveFile(filename.c_str());
+}
+
+TEST(DMATRIX_TEST, Compact_format) {
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_compact.bin";
+#else
+  std::string filename = "../../test_compact.bin";
+#endif
+  // The varints of field ids take 2 and 3 bytes
+  index_t max_field[3] = {200, 60000, 100000};
+  for (int k = 0; k < 3; ++k) {
+    DMatrix matrix;
+    for (size_t i = 0; i < kLength; ++i) {
+      matrix.AddRow();
+      // Odd rows are unit, and the last row is empty
+      if (i == kLength - 1) { continue; }
+      for (index_t j = 0; j < 8; ++j) {
+        real_t value = (i % 2 == 1 || j < 7) ? 1.0 : 0.25;
+        matrix.AddNode(i, i * 100 + j, value, max_field[k] - j);
+      }
+    }
+    matrix.SetHash(1234, 5678);
+    FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+    matrix.Serialize(file);
+    Close(file);
+    // Smaller than the raw Nodes
+    file = OpenFileOrDie(filename.c_str(), "rb");
+    EXPECT_LT(GetFileSize(file), kLength * 8 * sizeof(Node) + 128);
+    DMatrix read;
+    read.Deserialize(file);
+    Close(file);
+    char* buf = nullptr;
+    uint64 size = ReadFileToMemory(filename, &buf);
+    DMatrix read_buf;
+    EXPECT_EQ(read_buf.Deserialize(buf, size), size);
+    delete [] buf;
+    DMatrix* reads[2] = {&read, &read_buf};
+    for (int r = 0; r < 2; ++r) {
+      DMatrix& m = *reads[r];
+      EXPECT_EQ(m.row_length, kLength);
+      EXPECT_EQ(m.hash_value_1, 1234);
+      EXPECT_EQ(m.Y, matrix.Y);
+      EXPECT_EQ(m.norm, matrix.norm);
+      ASSERT_EQ(m.row[kLength-1]->size(), 0);
+      for (size_t i = 0; i < kLength - 1; ++i) {
+        ASSERT_EQ(m.row[i]->size(), matrix.row[i]->size());
+        for (size_t j = 0; j < m.row[i]->size(); ++j) {
+          EXPECT_EQ((*m.row[i])[j].feat_id, (*matrix.row[i])[j].feat_id);
+          EXPECT_EQ((*m.row[i])[j].field_id, (*matrix.row[i])[j].field_id);
+          EXPECT_FLOAT_EQ((*m.row[i])[j].feat_val,
+                          (*matrix.row[i])[j].feat_val);
+        }
+      }
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(DMATRIX_TEST, Compressed_chunks) {
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_chunks.bin";
+#else
+  std::string filename = "../../test_chunks.bin";
+#endif
+  // Three chunks, and the feature ids are not sorted
+  size_t length = DMatrix::kRowsPerChunk * 2 + 5;
+  DMatrix matrix;
+  for (size_t i = 0; i < length; ++i) {
+    matrix.AddRow();
+    matrix.AddNode(i, i * 7919, 1.0, 1);
+    matrix.AddNode(i, 0xffffffff - i, 1.0, 2);
+    matrix.AddNode(i, i % 13, i * 0.5, 3);
+    matrix.Y[i] = i % 2;
+  }
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  matrix.Serialize(file);
+  Close(file);
+  ThreadPool pool(3);
+  DMatrix read_file;
+  read_file.Deserialize(filename, &pool);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  DMatrix read_buf;
+  EXPECT_EQ(read_buf.Deserialize(buf, size, &pool), size);
+  delete [] buf;
+  DMatrix* reads[2] = {&read_file, &read_buf};
+  for (int r = 0; r < 2; ++r) {
+    DMatrix& m = *reads[r];
+    ASSERT_EQ(m.row_length, length);
+    EXPECT_EQ(m.Y, matrix.Y);
+    for (size_t i = 0; i < length; ++i) {
+      ASSERT_EQ(m.row[i]->size(), 3);
+      for (size_t j = 0; j < 3; ++j) {
+        EXPECT_EQ((*m.row[i])[j].feat_id, (*matrix.row[i])[j].feat_id);
+        EXPECT_EQ((*m.row[i])[j].field_id, (*matrix.row[i])[j].field_id);
+        EXPECT_FLOAT_EQ((*m.row[i])[j].feat_val,
+                        (*matrix.row[i])[j].feat_val);
+      }
+    }
+    EXPECT_GT(m.arena.Bytes(), 0);
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(DMATRIX_TEST, Parallel_chunks) {
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_parallel_chunks.bin";
+#else
+  std::string filename = "../../test_parallel_chunks.bin";
+#endif
+  // Two matrices in one file, where the second one
+  // is read after the chunks of the first one
+  size_t length[2] = { DMatrix::kRowsPerChunk * 5 + 7, 100 };
+  DMatrix matrix[2];
+  for (int k = 0; k < 2; ++k) {
+    for (size_t i = 0; i < length[k]; ++i) {
+      matrix[k].AddRow();
+      for (index_t j = 0; j <= i % 5; ++j) {
+        matrix[k].AddNode(i, i * 31 + j + k, (j + 1) * 0.5, j);
+      }
+      matrix[k].Y[i] = i % 2;
+    }
+  }
+  ThreadPool pool(3);
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  matrix[0].Serialize(file, &pool);
+  matrix[1].Serialize(file, &pool);
+  Close(file);
+  // The same bytes as the serial encoding
+  std::string serial;
+  matrix[0].Serialize(&serial);
+  matrix[1].Serialize(&serial);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  EXPECT_EQ(std::string(buf, size), serial);
+  delete [] buf;
+  file = OpenFileOrDie(filename.c_str(), "rb");
+  DMatrix read[2];
+  read[0].Deserialize(file, &pool);
+  read[1].Deserialize(file, &pool);
+  Close(file);
+  for (int k = 0; k < 2; ++k) {
+    ASSERT_EQ(read[k].row_length, length[k]);
+    EXPECT_EQ(read[k].Y, matrix[k].Y);
+    for (size_t i = 0; i < length[k]; ++i) {
+      ASSERT_EQ(read[k].row[i]->size(), matrix[k].row[i]->size());
+      for (size_t j = 0; j < read[k].row[i]->size(); ++j) {
+        EXPECT_EQ((*read[k].row[i])[j].feat_id,
+                  (*matrix[k].row[i])[j].feat_id);
+        EXPECT_EQ((*read[k].row[i])[j].field_id,
+                  (*matrix[k].row[i])[j].field_id);
+        EXPECT_FLOAT_EQ((*read[k].row[i])[j].feat_val,
+                        (*matrix[k].row[i])[j].feat_val);
+      }
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(DMATRIX_TEST, Append) {
+  DMatrix matrix;
+  matrix.AddRow();
+  matrix.AddNode(0, 1, 2.5);
+  matrix.Y[0] = 1;
+  DMatrix other;
+  for (index_t i = 0; i < 2; ++i) {
+    other.AddRow();
+    other.AddNode(i, i + 2, 0.5);
+    other.Y[i] = -1;
+    other.norm[i] = 0.25;
+  }
+  other.SetGroup(1, 7);
+  SparseRow* row = other.row[0];
+  matrix.Append(&other);
+  EXPECT_EQ(other.row_length, 0);
+  EXPECT_TRUE(other.row.empty());
+  EXPECT_FALSE(other.HasGroup());
+  ASSERT_EQ(matrix.row_length, 3);
+  // The rows are moved
+  EXPECT_EQ(matrix.row[1], row);
+  EXPECT_EQ((*matrix.row[2])[0].feat_id, 3);
+  std::vector<real_t> Y = { 1, -1, -1 };
+  std::vector<real_t> norm = { 1.0, 0.25, 0.25 };
+  std::vector<uint64> group = { 0, 0, 7 };
+  EXPECT_EQ(matrix.Y, Y);
+  EXPECT_EQ(matrix.norm, norm);
+  EXPECT_EQ(matrix.group, group);
+  // The matrix without group
+  other.AddRow();
+  other.AddNode(0, 5, 1.0);
+  matrix.Append(&other);
+  ASSERT_EQ(matrix.row_length, 4);
+  EXPECT_EQ(matrix.group.size(), 4);
+  EXPECT_EQ(matrix.group[3], 0);
+}
+
+TEST(DMATRIX_TEST, Arena_rows) {
+  DMatrix matrix;
+  for (size_t i = 0; i < kLength; ++i) {
+    matrix.AddRow();
+    matrix.AddNode(i, i, 1.0);
+    matrix.AddNode(i, i + 1, 1.0);
+  }
+  // The row added by users is deleted by Reset()
+  matrix.AddRow();
+  matrix.row[kLength] = new SparseRow;
+  matrix.AddNode(kLength, 1, 1.0);
+  EXPECT_FALSE(matrix.row[kLength]->InArena());
+  for (size_t i = 0; i < kLength; ++i) {
+    EXPECT_TRUE(matrix.row[i]->InArena());
+    ASSERT_EQ(matrix.row[i]->size(), 2);
+    EXPECT_EQ((*matrix.row[i])[1].feat_id, i + 1);
+    if (i > 0) {
+      EXPECT_EQ(matrix.row[i]->data(), matrix.row[i-1]->data() + 2);
+    }
+  }
+  // The rows shared with another matrix are not deleted
+  DMatrix shared;
+  shared.ReAlloc(kLength);
+  for (size_t i = 0; i < kLength; ++i) {
+    shared.row[i] = matrix.row[i];
+  }
+  shared.Reset();
+  EXPECT_EQ((*matrix.row[3])[1].feat_id, 4);
+  // Copy
+  DMatrix copy;
+  copy.CopyFrom(&matrix);
+  EXPECT_TRUE(copy.row[kLength]->InArena());
+  EXPECT_EQ((*copy.row[kLength])[0].feat_id, 1);
+  matrix.Reset();
+  EXPECT_EQ(matrix.arena.Bytes(), 0);
+  EXPECT_EQ((*copy.row[3])[1].feat_id, 4);
+}
+
 TEST(DMATRIX_TEST, Find_Max_Feat_and_Field) {
   DMatrix matrix;
   matrix.Reset();
@@ -143,6 +708,51 @@ TEST(DMATRIX_TEST, Find_Max_Feat_and_Field) {
   matrix.SetHash(1234, 5678);
   EXPECT_EQ(matrix.MaxFeat(), 9);
   EXPECT_EQ(matrix.MaxField(), 9);
+  DataStats stats = matrix.Stats();
+  EXPECT_EQ(stats.max_feat, 9);
+  EXPECT_EQ(stats.max_field, 9);
+  EXPECT_EQ(stats.nnz, kLength);
+  EXPECT_EQ(stats.rows, kLength);
+}
+
+TEST(DMATRIX_TEST, DataStats) {
+  DataStats stats, other;
+  stats.rows = 2;
+  stats.AddNode(5, 1);
+  stats.AddNode(3, 4);
+  other.rows = 1;
+  other.AddNode(8, 0);
+  stats.Merge(other);
+  EXPECT_EQ(stats.max_feat, 8);
+  EXPECT_EQ(stats.max_field, 4);
+  EXPECT_EQ(stats.nnz, 3);
+  EXPECT_EQ(stats.rows, 3);
+#ifndef _MSC_VER
+  std::string filename = "/tmp/test_stats.bin";
+#else
+  std::string filename = "../../test_stats.bin";
+#endif
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  stats.Serialize(file);
+  Close(file);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  const char* ptr = buf;
+  DataStats read;
+  ASSERT_TRUE(read.Deserialize(&ptr, buf + size));
+  EXPECT_EQ(ptr, buf + size);
+  EXPECT_EQ(read.max_feat, 8);
+  EXPECT_EQ(read.max_field, 4);
+  EXPECT_EQ(read.nnz, 3);
+  EXPECT_EQ(read.rows, 3);
+  // Nothing or other data is not the stats
+  ptr = buf;
+  EXPECT_FALSE(read.Deserialize(&ptr, buf + size - 1));
+  buf[0] ^= 1;
+  EXPECT_FALSE(read.Deserialize(&ptr, buf + size));
+  EXPECT_EQ(ptr, buf);
+  delete [] buf;
+  RemoveFile(filename.c_str());
 }
 
 TEST(DMATRIX_TEST, CopyFrom) {
@@ -240,6 +850,46 @@ TEST(DMATRIX_TEST, Compress) {
   EXPECT_EQ(feature_list[10], 20);
 }
 
+// The radix sort of the large matrix on the pool is the
+// same as renaming the ids by their order
+TEST(DMATRIX_TEST, Compress_large) {
+  const index_t kRows = 20000;
+  DMatrix matrix;
+  std::vector<index_t> ids;
+  uint64 seed = 1;
+  for (index_t i = 0; i < kRows; ++i) {
+    matrix.AddRow();
+    for (index_t j = 0; j < 10; ++j) {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      // Many of the ids are in many rows, and the others are sparse
+      index_t id = (seed >> 33) % 3 == 0 ? (seed >> 40) % 100 :
+                   (index_t)(seed >> 34);
+      matrix.AddNode(i, id, 0.1);
+      ids.push_back(id);
+    }
+  }
+  std::vector<index_t> expect = ids;
+  std::sort(expect.begin(), expect.end());
+  expect.erase(std::unique(expect.begin(), expect.end()), expect.end());
+  ThreadPool pool(3);
+  std::vector<index_t> feature_list;
+  matrix.GetFeatureList(&feature_list, &pool);
+  EXPECT_EQ(feature_list, expect);
+  matrix.GetFeatureList(&feature_list);
+  EXPECT_EQ(feature_list, expect);
+  feature_list.clear();
+  matrix.Compress(feature_list, &pool);
+  EXPECT_EQ(feature_list, expect);
+  size_t n = 0;
+  for (index_t i = 0; i < kRows; ++i) {
+    for (auto& node : *matrix.row[i]) {
+      index_t rank = std::lower_bound(expect.begin(), expect.end(),
+                                      ids[n++]) - expect.begin();
+      EXPECT_EQ(node.feat_id, rank + 1);
+    }
+  }
+}
+
 TEST(DMATRIX_TEST, GetMiniBatch) {
   // Init matrix
   DMatrix matrix;
@@ -0,0 +1,258 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the FeatureStats class.
+*/
+
+#include "src/data/feature_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+void FeatureStats::Add(const DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    const SparseRow* row = matrix->row[i];
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      if (iter->feat_id >= feat_count_.size()) {
+        // Grow by half at least, so it is resized a few times
+        feat_count_.resize(std::max((size_t)iter->feat_id + 1,
+                                    feat_count_.size() * 3 / 2), 0);
+      }
+      if (iter->field_id >= field_count_.size()) {
+        field_count_.resize(iter->field_id + 1, 0);
+      }
+      feat_count_[iter->feat_id]++;
+      field_count_[iter->field_id]++;
+    }
+    num_nodes_ += row->size();
+  }
+  num_rows_ += matrix->row_length;
+}
+
+void FeatureStats::Merge(const FeatureStats& other) {
+  if (other.feat_count_.size() > feat_count_.size()) {
+    feat_count_.resize(other.feat_count_.size(), 0);
+  }
+  for (size_t j = 0; j < other.feat_count_.size(); ++j) {
+    feat_count_[j] += other.feat_count_[j];
+  }
+  if (other.field_count_.size() > field_count_.size()) {
+    field_count_.resize(other.field_count_.size(), 0);
+  }
+  for (size_t f = 0; f < other.field_count_.size(); ++f) {
+    field_count_[f] += other.field_count_[f];
+  }
+  num_rows_ += other.num_rows_;
+  num_nodes_ += other.num_nodes_;
+}
+
+void FeatureStats::Clear() {
+  num_rows_ = 0;
+  num_nodes_ = 0;
+  std::vector<uint64>().swap(feat_count_);
+  std::vector<uint64>().swap(field_count_);
+}
+
+index_t FeatureStats::NumUsedFeatures() const {
+  index_t num = 0;
+  for (size_t j = 0; j < feat_count_.size(); ++j) {
+    if (feat_count_[j] > 0) { num++; }
+  }
+  return num;
+}
+
+// The larger count goes first, and then the smaller id.
+static bool more_frequent(const std::pair<index_t, uint64>& a,
+                          const std::pair<index_t, uint64>& b) {
+  return a.second != b.second ? a.second > b.second : a.first < b.first;
+}
+
+std::vector<std::pair<index_t, uint64> >
+FeatureStats::TopFeatures(size_t n) const {
+  std::vector<std::pair<index_t, uint64> > order;
+  for (size_t j = 0; j < feat_count_.size(); ++j) {
+    if (feat_count_[j] > 0) {
+      order.push_back(std::make_pair((index_t)j, feat_count_[j]));
+    }
+  }
+  n = std::min(n, order.size());
+  std::partial_sort(order.begin(), order.begin() + n,
+                    order.end(), more_frequent);
+  order.resize(n);
+  return order;
+}
+
+std::vector<index_t> FeatureStats::FrequencyOrder() const {
+  std::vector<std::pair<index_t, uint64> > top =
+    TopFeatures(feat_count_.size());
+  std::vector<index_t> order(top.size());
+  for (size_t i = 0; i < top.size(); ++i) {
+    order[i] = top[i].first;
+  }
+  return order;
+}
+
+std::vector<index_t> FeatureStats::FeatureMap(index_t num_feature) const {
+  std::vector<index_t> map(num_feature, num_feature);
+  index_t next = 0;
+  std::vector<index_t> order = FrequencyOrder();
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (order[i] < num_feature) { map[order[i]] = next++; }
+  }
+  for (index_t j = 0; j < num_feature; ++j) {
+    if (map[j] == num_feature) { map[j] = next++; }
+  }
+  return map;
+}
+
+// FrequencyOrder() is in the descending order of the counts,
+// so the kept features are its head.
+std::vector<index_t> FeatureStats::CompactMap(index_t num_feature,
+                                              uint64 min_count,
+                                              index_t* num_kept) const {
+  CHECK_NOTNULL(num_kept);
+  std::vector<index_t> order = FrequencyOrder();
+  index_t next = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (feat_count_[order[i]] < min_count) { break; }
+    if (order[i] < num_feature) { next++; }
+  }
+  std::vector<index_t> map(num_feature, next);
+  next = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (feat_count_[order[i]] < min_count) { break; }
+    if (order[i] < num_feature) { map[order[i]] = next++; }
+  }
+  *num_kept = next;
+  return map;
+}
+
+// The counts are sorted, so the top features are added
+// until their nodes reach the ratio.
+index_t FeatureStats::Coverage(double ratio) const {
+  std::vector<uint64> count;
+  for (size_t j = 0; j < feat_count_.size(); ++j) {
+    if (feat_count_[j] > 0) { count.push_back(feat_count_[j]); }
+  }
+  std::sort(count.begin(), count.end(), std::greater<uint64>());
+  double target = ratio * num_nodes_;
+  double sum = 0;
+  for (size_t i = 0; i < count.size(); ++i) {
+    if (sum >= target) { return i; }
+    sum += count[i];
+  }
+  return count.size();
+}
+
+std::vector<std::string> FeatureStats::Report(size_t top) const {
+  std::vector<std::string> lines;
+  index_t num_used = NumUsedFeatures();
+  lines.push_back(StringPrintf(
+    "Feature stats: %llu rows, %llu nodes (%.1f per row), %u features used",
+    (unsigned long long)num_rows_, (unsigned long long)num_nodes_,
+    num_rows_ > 0 ? (double)num_nodes_ / num_rows_ : 0.0, num_used));
+  if (num_nodes_ == 0) { return lines; }
+  std::string str = "The nodes are covered by the top features:";
+  double ratios[] = { 0.5, 0.9, 0.99 };
+  for (double ratio : ratios) {
+    index_t num = Coverage(ratio);
+    str += StringPrintf("%s %.0f%% by %u (%.2f%%)",
+                        ratio == ratios[0] ? "" : ",", ratio * 100,
+                        num, 100.0 * num / num_used);
+  }
+  lines.push_back(str);
+  std::vector<std::pair<index_t, uint64> > features = TopFeatures(top);
+  str = StringPrintf("Top %zu features (id: %% of the rows):",
+                     features.size());
+  for (size_t i = 0; i < features.size(); ++i) {
+    str += StringPrintf(" %u: %.2f%%", features[i].first,
+                        100.0 * features[i].second / num_rows_);
+  }
+  lines.push_back(str);
+  // The fields of the libsvm and csv files are all 0
+  if (field_count_.size() > 1) {
+    str = "Fields (id: nodes per row):";
+    for (size_t f = 0; f < field_count_.size(); ++f) {
+      if (field_count_[f] == 0) { continue; }
+      str += StringPrintf(" %zu: %.2f", f,
+                          (double)field_count_[f] / num_rows_);
+    }
+    lines.push_back(str);
+  }
+  return lines;
+}
+
+bool FeatureStats::Save(const std::string& filename) const {
+  FILE* file = fopen(filename.c_str(), "w");
+  if (file == nullptr) { return false; }
+  fprintf(file, "rows %llu\nnodes %llu\n",
+          (unsigned long long)num_rows_, (unsigned long long)num_nodes_);
+  for (size_t f = 0; f < field_count_.size(); ++f) {
+    if (field_count_[f] > 0) {
+      fprintf(file, "field %zu %llu\n", f,
+              (unsigned long long)field_count_[f]);
+    }
+  }
+  std::vector<index_t> order = FrequencyOrder();
+  for (size_t i = 0; i < order.size(); ++i) {
+    fprintf(file, "feature %u %llu\n", order[i],
+            (unsigned long long)feat_count_[order[i]]);
+  }
+  bool ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+  return ok;
+}
+
+bool FeatureStats::Load(const std::string& filename) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  Clear();
+  char name[16];
+  unsigned long long id = 0, count = 0;
+  bool ok = fscanf(file, "rows %llu\n", &count) == 1;
+  num_rows_ = count;
+  ok = ok && fscanf(file, "nodes %llu\n", &count) == 1;
+  num_nodes_ = count;
+  while (ok && fscanf(file, "%15s %llu %llu\n", name, &id, &count) == 3) {
+    std::vector<uint64>* counts = nullptr;
+    if (strcmp(name, "feature") == 0) {
+      counts = &feat_count_;
+    } else if (strcmp(name, "field") == 0) {
+      counts = &field_count_;
+    } else {
+      ok = false;
+      break;
+    }
+    if (id >= counts->size()) { counts->resize(id + 1, 0); }
+    (*counts)[id] = count;
+  }
+  ok = ok && feof(file);
+  fclose(file);
+  if (!ok) { Clear(); }
+  return ok;
+}
+
+}  // namespace xLearn
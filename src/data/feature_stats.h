@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the FeatureStats class, which counts how
+often each feature and each field is used by the data.
+*/
+
+#ifndef XLEARN_DATA_FEATURE_STATS_H_
+#define XLEARN_DATA_FEATURE_STATS_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// FeatureStats keeps the exact count of the nodes of each feature id and
+// of each field id, so the popular features can be found for the layout
+// of the model (e.g., the hot features of Model::SetHotFeatures, or the
+// ids ordered by the frequency). The counts are dense arrays of the ids,
+// which are never larger than the linear term of the model:
+//
+//   FeatureStats stats;
+//   while (reader->Samples(matrix)) { stats.Add(matrix); }
+//   stats.TopFeatures(10);  /* the 10 most frequent features */
+//   stats.Save("train.txt.stats");
+//
+// The file of Save() is a text file with one count per line:
+//
+//   rows 1000
+//   nodes 39000
+//   field 0 1000
+//   feature 12 875
+//
+// where the features are in the descending order of their counts.
+//------------------------------------------------------------------------------
+class FeatureStats {
+ public:
+  FeatureStats() : num_rows_(0), num_nodes_(0) { }
+
+  // Count the features and the fields of the rows.
+  void Add(const DMatrix* matrix);
+
+  // Add the counts of another FeatureStats, e.g.,
+  // of another thread or of another file.
+  void Merge(const FeatureStats& other);
+
+  void Clear();
+
+  uint64 NumRows() const { return num_rows_; }
+  uint64 NumNodes() const { return num_nodes_; }
+
+  // Number of the features that are used at least once.
+  index_t NumUsedFeatures() const;
+
+  uint64 FeatureCount(index_t feat) const {
+    return feat < feat_count_.size() ? feat_count_[feat] : 0;
+  }
+
+  uint64 FieldCount(index_t field) const {
+    return field < field_count_.size() ? field_count_[field] : 0;
+  }
+
+  // The (id, count) of the n most frequent features, and the
+  // ties of the counts are broken by the smaller id.
+  std::vector<std::pair<index_t, uint64> > TopFeatures(size_t n) const;
+
+  // The used features in the descending order of their counts,
+  // which maps a new id (the index) to an old id.
+  std::vector<index_t> FrequencyOrder() const;
+
+  // The new id of each id in [0, num_feature), which renumbers the
+  // used features by FrequencyOrder() from 0, and then the others in
+  // the order of their ids, so the map is a permutation. The ids of
+  // the used features that are not less than num_feature are kept.
+  std::vector<index_t> FeatureMap(index_t num_feature) const;
+
+  // The new id of each id in [0, num_feature) for -min_count, which
+  // renumbers the features of at least min_count nodes by their
+  // frequency from 0, and maps the others (the rare and the unused
+  // ids) to the next id, which they share. The number of the kept
+  // features, i.e., the shared id, is returned by num_kept.
+  std::vector<index_t> CompactMap(index_t num_feature,
+                                  uint64 min_count,
+                                  index_t* num_kept) const;
+
+  // The least number of the top features whose
+  // nodes are the given ratio of all the nodes.
+  index_t Coverage(double ratio) const;
+
+  // The summary of the counts with the top features,
+  // which has one line for each item.
+  std::vector<std::string> Report(size_t top) const;
+
+  // Write the counts to the file, or return false if the
+  // file cannot be written, and Load() reads them back.
+  bool Save(const std::string& filename) const;
+  bool Load(const std::string& filename);
+
+ private:
+  uint64 num_rows_;
+  uint64 num_nodes_;
+  /* Count of the nodes of each feature and field id */
+  std::vector<uint64> feat_count_;
+  std::vector<uint64> field_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(FeatureStats);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_FEATURE_STATS_H_
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the FeatureStats class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "src/data/feature_stats.h"
+
+namespace xLearn {
+
+// Row i has the features 0 .. i of the field i % 2.
+void init_matrix(DMatrix* matrix, index_t rows) {
+  matrix->ReAlloc(rows);
+  for (index_t i = 0; i < rows; ++i) {
+    matrix->row[i] = new SparseRow;
+    for (index_t j = 0; j <= i; ++j) {
+      matrix->AddNode(i, j, 1.0, i % 2);
+    }
+  }
+}
+
+TEST(FeatureStatsTest, Add) {
+  DMatrix matrix;
+  init_matrix(&matrix, 4);
+  FeatureStats stats;
+  stats.Add(&matrix);
+  EXPECT_EQ(stats.NumRows(), 4);
+  EXPECT_EQ(stats.NumNodes(), 10);
+  EXPECT_EQ(stats.NumUsedFeatures(), 4);
+  for (index_t j = 0; j < 4; ++j) {
+    EXPECT_EQ(stats.FeatureCount(j), 4 - j);
+  }
+  EXPECT_EQ(stats.FeatureCount(100), 0);
+  EXPECT_EQ(stats.FieldCount(0), 1 + 3);
+  EXPECT_EQ(stats.FieldCount(1), 2 + 4);
+  FeatureStats other;
+  other.Add(&matrix);
+  stats.Merge(other);
+  EXPECT_EQ(stats.NumRows(), 8);
+  EXPECT_EQ(stats.NumNodes(), 20);
+  EXPECT_EQ(stats.FeatureCount(0), 8);
+  stats.Clear();
+  EXPECT_EQ(stats.NumNodes(), 0);
+  EXPECT_EQ(stats.NumUsedFeatures(), 0);
+}
+
+TEST(FeatureStatsTest, TopFeatures) {
+  DMatrix matrix;
+  init_matrix(&matrix, 4);
+  // Feature 9 is as frequent as feature 1
+  for (index_t i = 1; i < 4; ++i) {
+    matrix.AddNode(i, 9, 1.0);
+  }
+  FeatureStats stats;
+  stats.Add(&matrix);
+  std::vector<std::pair<index_t, uint64> > top = stats.TopFeatures(3);
+  ASSERT_EQ(top.size(), 3);
+  EXPECT_EQ(top[0].first, 0);
+  EXPECT_EQ(top[0].second, 4);
+  EXPECT_EQ(top[1].first, 1);
+  EXPECT_EQ(top[2].first, 9);
+  EXPECT_EQ(top[2].second, 3);
+  EXPECT_EQ(stats.TopFeatures(100).size(), 5);
+  std::vector<index_t> order = stats.FrequencyOrder();
+  std::vector<index_t> expected = { 0, 1, 9, 2, 3 };
+  EXPECT_EQ(order, expected);
+  // The unused ids follow the used ones, and 9 is out of the map
+  std::vector<index_t> map = stats.FeatureMap(8);
+  expected = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  EXPECT_EQ(map, expected);
+  map = stats.FeatureMap(10);
+  expected = { 0, 1, 3, 4, 5, 6, 7, 8, 9, 2 };
+  EXPECT_EQ(map, expected);
+  // The features of less than 2 nodes share the last id
+  index_t num_kept = 0;
+  map = stats.CompactMap(10, 2, &num_kept);
+  EXPECT_EQ(num_kept, 4);
+  expected = { 0, 1, 3, 4, 4, 4, 4, 4, 4, 2 };
+  EXPECT_EQ(map, expected);
+  map = stats.CompactMap(8, 2, &num_kept);
+  EXPECT_EQ(num_kept, 3);
+  expected = { 0, 1, 2, 3, 3, 3, 3, 3 };
+  EXPECT_EQ(map, expected);
+  // 13 nodes: 4, 3, 3, 2, 1
+  EXPECT_EQ(stats.Coverage(0), 0);
+  EXPECT_EQ(stats.Coverage(0.3), 1);
+  EXPECT_EQ(stats.Coverage(0.5), 2);
+  EXPECT_EQ(stats.Coverage(1.0), 5);
+  std::vector<std::string> report = stats.Report(2);
+  ASSERT_EQ(report.size(), 4);
+  EXPECT_NE(report[0].find("4 rows, 13 nodes"), std::string::npos);
+  EXPECT_NE(report[2].find("0: 100.00% 1: 75.00%"), std::string::npos);
+}
+
+TEST(FeatureStatsTest, SaveAndLoad) {
+  DMatrix matrix;
+  init_matrix(&matrix, 5);
+  FeatureStats stats;
+  stats.Add(&matrix);
+  std::string filename = "feature_stats_test.txt";
+  ASSERT_TRUE(stats.Save(filename));
+  FeatureStats loaded;
+  ASSERT_TRUE(loaded.Load(filename));
+  EXPECT_EQ(loaded.NumRows(), stats.NumRows());
+  EXPECT_EQ(loaded.NumNodes(), stats.NumNodes());
+  for (index_t j = 0; j < 5; ++j) {
+    EXPECT_EQ(loaded.FeatureCount(j), stats.FeatureCount(j));
+  }
+  EXPECT_EQ(loaded.FieldCount(0), stats.FieldCount(0));
+  EXPECT_EQ(loaded.FieldCount(1), stats.FieldCount(1));
+  EXPECT_EQ(loaded.FrequencyOrder(), stats.FrequencyOrder());
+  // A broken file is not loaded
+  FILE* file = fopen(filename.c_str(), "a");
+  fprintf(file, "unknown 1 2\n");
+  fclose(file);
+  EXPECT_FALSE(loaded.Load(filename));
+  EXPECT_EQ(loaded.NumRows(), 0);
+  EXPECT_FALSE(loaded.Load("no_such_file.txt"));
+  remove(filename.c_str());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,415 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the FieldIndex class.
+*/
+
+#include "src/data/field_index.h"
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+#include "src/base/parse_number.h"
+#include "src/base/split_string.h"
+
+namespace xLearn {
+
+const offset_t FieldIndex::kNoBlock;
+const index_t FieldIndex::kNoField;
+
+bool ParseFieldK(const std::string& spec, std::vector<FieldK>* items) {
+  CHECK_NOTNULL(items);
+  items->clear();
+  std::vector<std::string> list;
+  SplitStringUsing(spec, ",", &list);
+  for (const std::string& item : list) {
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) { return false; }
+    size_t colon = item.find(':');
+    FieldK field_k;
+    field_k.pair = colon < eq;
+    const char* begin = item.data();
+    const char* end = item.data() + (field_k.pair ? colon : eq);
+    if (!ParseUint32(begin, end, &field_k.field_1)) { return false; }
+    field_k.field_2 = field_k.field_1;
+    if (field_k.pair &&
+        !ParseUint32(item.data() + colon + 1, item.data() + eq,
+                     &field_k.field_2)) {
+      return false;
+    }
+    if (!ParseUint32(item.data() + eq + 1, item.data() + item.size(),
+                     &field_k.k) || field_k.k == 0) {
+      return false;
+    }
+    for (const FieldK& other : *items) {
+      if (other.pair == field_k.pair &&
+          ((other.field_1 == field_k.field_1 &&
+            other.field_2 == field_k.field_2) ||
+           (other.field_1 == field_k.field_2 &&
+            other.field_2 == field_k.field_1))) {
+        return false;
+      }
+    }
+    items->push_back(field_k);
+  }
+  return true;
+}
+
+std::vector<index_t> FieldKTable(const std::vector<FieldK>& items,
+                                 index_t num_field,
+                                 index_t num_K) {
+  std::vector<index_t> k_field(num_field, num_K);
+  for (const FieldK& item : items) {
+    if (!item.pair && item.field_1 < num_field) {
+      k_field[item.field_1] = std::min(item.k, num_K);
+    }
+  }
+  std::vector<index_t> table((size_t)num_field * num_field);
+  for (index_t g = 0; g < num_field; ++g) {
+    for (index_t f = 0; f < num_field; ++f) {
+      table[(size_t)g * num_field + f] = std::min(k_field[g], k_field[f]);
+    }
+  }
+  for (const FieldK& item : items) {
+    if (item.pair && item.field_1 < num_field &&
+        item.field_2 < num_field) {
+      index_t k = std::min(item.k, num_K);
+      table[(size_t)item.field_1 * num_field + item.field_2] = k;
+      table[(size_t)item.field_2 * num_field + item.field_1] = k;
+    }
+  }
+  return table;
+}
+
+void FieldIndex::Add(const DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  CHECK(Empty());
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    const SparseRow* row = matrix->row[i];
+    // The fields of the row and their nodes
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t f = iter->field_id;
+      if (f / 64 >= words_) { set_words(f / 64 + 1); }
+      if (iter->feat_id >= num_feat_) {
+        // Grow by half at least, so it is resized a few times
+        num_feat_ = std::max(iter->feat_id + 1, num_feat_ / 2 * 3);
+        mask_.resize((offset_t)num_feat_ * words_, 0);
+      }
+      if (iter->feat_id >= feat_field_.size()) {
+        feat_field_.resize(num_feat_, kNoField);
+      }
+      if (feat_field_[iter->feat_id] == kNoField) {
+        feat_field_[iter->feat_id] = f;
+      }
+      if (f >= row_count_.size()) { row_count_.resize(f + 1, 0); }
+      row_count_[f]++;
+      row_mask_[f / 64] |= (uint64)1 << (f % 64);
+    }
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t f = iter->field_id;
+      uint64 bit = (uint64)1 << (f % 64);
+      uint64* mask = mask_.data() + (offset_t)iter->feat_id * words_;
+      bool seen = (mask[f / 64] & bit) != 0;
+      if (allow_.empty()) {
+        for (index_t w = 0; w < words_; ++w) {
+          mask[w] |= row_mask_[w];
+        }
+      } else if (f < allow_.size()) {
+        const std::vector<uint64>& allow = allow_[f];
+        index_t words = std::min(words_, (index_t)allow.size());
+        for (index_t w = 0; w < words; ++w) {
+          mask[w] |= row_mask_[w] & allow[w];
+        }
+      }
+      if (row_count_[f] == 1 && !seen) { mask[f / 64] &= ~bit; }
+    }
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      row_count_[iter->field_id] = 0;
+      row_mask_[iter->field_id / 64] = 0;
+    }
+  }
+}
+
+void FieldIndex::AllowPair(index_t f1, index_t f2) {
+  CHECK(Empty());
+  index_t f = std::max(f1, f2);
+  if (f >= allow_.size()) { allow_.resize(f + 1); }
+  for (int i = 0; i < 2; ++i) {
+    std::vector<uint64>& allow = allow_[f1];
+    if (f2 / 64 >= allow.size()) { allow.resize(f2 / 64 + 1, 0); }
+    allow[f2 / 64] |= (uint64)1 << (f2 % 64);
+    std::swap(f1, f2);
+  }
+}
+
+void FieldIndex::Set(index_t j, index_t f) {
+  CHECK(Empty());
+  if (f / 64 >= words_) { set_words(f / 64 + 1); }
+  if (j >= num_feat_) {
+    num_feat_ = std::max(j + 1, num_feat_ / 2 * 3);
+    mask_.resize((offset_t)num_feat_ * words_, 0);
+  }
+  mask_[(offset_t)j * words_ + f / 64] |= (uint64)1 << (f % 64);
+}
+
+void FieldIndex::Share(index_t j) {
+  CHECK(Empty());
+  if (j / 64 >= shared_.size()) { shared_.resize(j / 64 + 1, 0); }
+  shared_[j / 64] |= (uint64)1 << (j % 64);
+}
+
+void FieldIndex::SetFieldK(const std::vector<index_t>& field_k) {
+  CHECK(Empty());
+  field_k_ = field_k;
+  for (size_t i = 0; i < field_k_.size(); ++i) {
+    field_k_[i] = std::max(field_k_[i], (index_t)1);
+  }
+}
+
+void FieldIndex::Build(index_t num_feature, index_t num_field) {
+  CHECK(Empty());
+  CHECK_GT(num_field, 0);
+  if (HasWidths()) {
+    CHECK_EQ(field_k_.size(), (size_t)num_field * num_field);
+  }
+  index_t words = (num_field + 63) / 64;
+  std::vector<uint64> mask((offset_t)num_feature * words, 0);
+  index_t num_copy = std::min(num_feature, num_feat_);
+  index_t words_copy = std::min(words, words_);
+  for (index_t j = 0; j < num_copy; ++j) {
+    std::copy(mask_.begin() + (offset_t)j * words_,
+              mask_.begin() + (offset_t)j * words_ + words_copy,
+              mask.begin() + (offset_t)j * words);
+  }
+  // The fields out of the range
+  if (num_field % 64 != 0) {
+    uint64 last = ((uint64)1 << (num_field % 64)) - 1;
+    for (index_t j = 0; j < num_copy; ++j) {
+      mask[(offset_t)j * words + words - 1] &= last;
+    }
+  }
+  mask_.swap(mask);
+  num_feat_ = num_feature;
+  num_field_ = num_field;
+  words_ = words;
+  // The features without a field in the model have no width
+  if (HasWidths()) {
+    feat_field_.resize(num_feature, kNoField);
+    for (index_t j = 0; j < num_feature; ++j) {
+      if (feat_field_[j] >= num_field) {
+        feat_field_[j] = kNoField;
+        std::fill(mask_.begin() + (offset_t)j * words,
+                  mask_.begin() + (offset_t)(j + 1) * words, 0);
+      }
+    }
+  } else {
+    std::vector<index_t>().swap(feat_field_);
+  }
+  if (!shared_.empty()) {
+    shared_.resize((num_feature + 63) / 64, 0);
+    if (num_feature % 64 != 0 && !shared_.empty()) {
+      shared_.back() &= ((uint64)1 << (num_feature % 64)) - 1;
+    }
+    if (std::count(shared_.begin(), shared_.end(), 0) ==
+        (std::ptrdiff_t)shared_.size()) {
+      std::vector<uint64>().swap(shared_);
+    }
+  }
+  std::vector<index_t>().swap(row_count_);
+  std::vector<uint64>().swap(row_mask_);
+  set_planes();
+  set_begin();
+}
+
+void FieldIndex::Grow(index_t num_feature) {
+  CHECK(!Empty());
+  if (num_feature <= num_feat_) { return; }
+  mask_.resize((offset_t)num_feature * words_, 0);
+  begin_.resize((size_t)num_feature + 1, begin_.back());
+  if (!shared_.empty()) { shared_.resize((num_feature + 63) / 64, 0); }
+  if (HasWidths()) { feat_field_.resize(num_feature, kNoField); }
+  num_feat_ = num_feature;
+}
+
+void FieldIndex::Clear() {
+  num_feat_ = 0;
+  num_field_ = 0;
+  words_ = 0;
+  std::vector<uint64>().swap(mask_);
+  std::vector<offset_t>().swap(begin_);
+  std::vector<uint64>().swap(shared_);
+  std::vector<index_t>().swap(row_count_);
+  std::vector<uint64>().swap(row_mask_);
+  std::vector<std::vector<uint64> >().swap(allow_);
+  std::vector<index_t>().swap(feat_field_);
+  std::vector<index_t>().swap(field_k_);
+  num_plane_ = 0;
+  std::vector<uint64>().swap(planes_);
+}
+
+void FieldIndex::Serialize(FILE* file) const {
+  CHECK(!Empty());
+  WriteDataToDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  WriteDataToDisk(file, (char*)&num_field_, sizeof(num_field_));
+  if (!mask_.empty()) {
+    WriteDataToDisk(file, (char*)mask_.data(),
+                    mask_.size() * sizeof(uint64));
+  }
+  if (HasShared()) {
+    WriteDataToDisk(file, (char*)shared_.data(),
+                    shared_.size() * sizeof(uint64));
+  }
+  if (HasWidths()) {
+    WriteDataToDisk(file, (char*)feat_field_.data(),
+                    feat_field_.size() * sizeof(index_t));
+    WriteDataToDisk(file, (char*)field_k_.data(),
+                    field_k_.size() * sizeof(index_t));
+  }
+}
+
+bool FieldIndex::Deserialize(FILE* file, bool shared, bool widths) {
+  Clear();
+  index_t num_feat = 0, num_field = 0;
+  if (ReadDataFromDisk(file, (char*)&num_feat, sizeof(num_feat)) !=
+      sizeof(num_feat) ||
+      ReadDataFromDisk(file, (char*)&num_field, sizeof(num_field)) !=
+      sizeof(num_field) || num_field == 0) {
+    return false;
+  }
+  index_t words = (num_field + 63) / 64;
+  std::vector<uint64> mask((offset_t)num_feat * words);
+  size_t bytes = mask.size() * sizeof(uint64);
+  if (bytes > 0 &&
+      ReadDataFromDisk(file, (char*)mask.data(), bytes) != bytes) {
+    return false;
+  }
+  if (num_field % 64 != 0) {
+    uint64 last = ((uint64)1 << (num_field % 64)) - 1;
+    for (index_t j = 0; j < num_feat; ++j) {
+      if ((mask[(offset_t)j * words + words - 1] & ~last) != 0) {
+        return false;
+      }
+    }
+  }
+  if (shared) {
+    std::vector<uint64> bits((num_feat + 63) / 64);
+    bytes = bits.size() * sizeof(uint64);
+    if (bytes == 0 ||
+        ReadDataFromDisk(file, (char*)bits.data(), bytes) != bytes) {
+      return false;
+    }
+    if (num_feat % 64 != 0 &&
+        (bits.back() & ~(((uint64)1 << (num_feat % 64)) - 1)) != 0) {
+      return false;
+    }
+    shared_.swap(bits);
+  }
+  if (widths) {
+    std::vector<index_t> fields(num_feat);
+    std::vector<index_t> field_k((size_t)num_field * num_field);
+    bytes = fields.size() * sizeof(index_t);
+    if (bytes > 0 &&
+        ReadDataFromDisk(file, (char*)fields.data(), bytes) != bytes) {
+      return false;
+    }
+    bytes = field_k.size() * sizeof(index_t);
+    if (ReadDataFromDisk(file, (char*)field_k.data(), bytes) != bytes) {
+      return false;
+    }
+    for (index_t j = 0; j < num_feat; ++j) {
+      bool used = std::count(mask.begin() + (offset_t)j * words,
+                             mask.begin() + (offset_t)(j + 1) * words,
+                             0) != (std::ptrdiff_t)words;
+      if (used && fields[j] >= num_field) { return false; }
+    }
+    if (std::count(field_k.begin(), field_k.end(), 0) > 0) {
+      return false;
+    }
+    feat_field_.swap(fields);
+    field_k_.swap(field_k);
+  }
+  mask_.swap(mask);
+  num_feat_ = num_feat;
+  num_field_ = num_field;
+  words_ = words;
+  set_planes();
+  set_begin();
+  return true;
+}
+
+void FieldIndex::set_words(index_t words) {
+  std::vector<uint64> mask((offset_t)num_feat_ * words, 0);
+  for (index_t j = 0; j < num_feat_; ++j) {
+    std::copy(mask_.begin() + (offset_t)j * words_,
+              mask_.begin() + (offset_t)(j + 1) * words_,
+              mask.begin() + (offset_t)j * words);
+  }
+  mask_.swap(mask);
+  words_ = words;
+  row_mask_.resize(words, 0);
+}
+
+void FieldIndex::set_begin() {
+  begin_.assign((size_t)num_feat_ + 1, 0);
+  for (index_t j = 0; j < num_feat_; ++j) {
+    const uint64* mask = mask_.data() + (offset_t)j * words_;
+    offset_t blocks = 0;
+    if (HasWidths()) {
+      // The shared block is the widest one of its fields
+      bool shared = IsShared(j);
+      for (index_t f = 0; f < num_field_; ++f) {
+        if ((mask[f / 64] & ((uint64)1 << (f % 64))) == 0) { continue; }
+        offset_t width = Width(j, f);
+        blocks = shared ? std::max(blocks, width) : blocks + width;
+      }
+    } else {
+      for (index_t w = 0; w < words_; ++w) {
+        blocks += popcount(mask[w]);
+      }
+      if (blocks > 1 && IsShared(j)) { blocks = 1; }
+    }
+    begin_[j + 1] = begin_[j] + blocks;
+  }
+}
+
+void FieldIndex::set_planes() {
+  num_plane_ = 0;
+  std::vector<uint64>().swap(planes_);
+  if (!HasWidths()) { return; }
+  index_t max_k = *std::max_element(field_k_.begin(), field_k_.end());
+  index_t max_width = (max_k + kAlign - 1) / kAlign;
+  while ((max_width >> num_plane_) != 0) { ++num_plane_; }
+  planes_.assign((offset_t)num_field_ * num_plane_ * words_, 0);
+  for (index_t g = 0; g < num_field_; ++g) {
+    for (index_t f = 0; f < num_field_; ++f) {
+      index_t k = field_k_[(offset_t)g * num_field_ + f];
+      index_t width = (k + kAlign - 1) / kAlign;
+      for (index_t p = 0; p < num_plane_; ++p) {
+        if ((width >> p) & 1) {
+          planes_[((offset_t)g * num_plane_ + p) * words_ + f / 64] |=
+              (uint64)1 << (f % 64);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,265 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the FieldIndex class, which keeps the latent
+blocks (feature, target field) of a sparse ffm model.
+*/
+
+#ifndef XLEARN_DATA_FIELD_INDEX_H_
+#define XLEARN_DATA_FIELD_INDEX_H_
+
+#include <stdio.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// An item of the K of the fields (see FieldIndex::SetFieldK), which
+// is the K of the field field_1, or of the pair of field_1 and field_2
+// (in both directions) if pair is true.
+struct FieldK {
+  index_t field_1;
+  index_t field_2;
+  bool pair;
+  index_t k;
+};
+
+// Parse the K of the fields, e.g., "0=2,1=2,3:4=16", where each
+// item is field=K or field:field=K. Return false for an invalid
+// or repeated item, or K = 0.
+bool ParseFieldK(const std::string& spec, std::vector<FieldK>* items);
+
+// The K of the pairs of num_field fields for SetFieldK(), which is
+// the K of the pair, or else the smaller K of its two fields. The
+// fields without an item have num_K, which is also the largest K.
+std::vector<index_t> FieldKTable(const std::vector<FieldK>& items,
+                                 index_t num_field,
+                                 index_t num_K);
+
+//------------------------------------------------------------------------------
+// FieldIndex keeps the pairs of (feature j, target field f) that are seen
+// in the training data, so the ffm model only allocates the latent vectors
+// V_j_f of these pairs. The V_j_f is used by the pair of the node of j and
+// a node of field f in the same row, and most features only meet a part of
+// the fields, e.g., the fields that are sparse or only in some kinds of
+// rows. Each feature has a bitmask of its target fields, and its blocks
+// are contiguous in the order of the fields, so the block of V_j_f is the
+// first block of j plus the number of its fields before f:
+//
+//   FieldIndex index;
+//   while (reader->Samples(matrix)) { index.Add(matrix); }
+//   index.Build(num_feature, num_field);
+//   offset_t b = index.Block(j, f);  /* or kNoBlock */
+//
+// The blocks of j are [Begin(j), Begin(j+1)), and each block has the
+// aligned_k values of the latent vector and their gradient caches. The
+// pairs of fields can be limited by AllowPair() before Add(), and then
+// the features of a field only target the fields of its allowed pairs.
+//
+// The rare features have too few rows to learn a vector of each field,
+// so Share() gives a feature one block for all its target fields, like
+// the latent vector of fm, and Block() returns that block of each field
+// in the bitmask. The kernels need not know which features are shared.
+//
+// The vectors can have their own K by SetFieldK() before Build(), e.g.,
+// K = 2 for a small field and K = 16 for the ids. Then a block is kAlign
+// values, the vector V_j_f is Width(j, f) blocks by the field of j and
+// f (its K padded to kAlign), and Block() counts the widths of the fields
+// before f, which are kept as bit planes (the fields whose width has the
+// bit p), so it is still a few popcounts:
+//
+//   index.SetFieldK(field_k);  /* num_field * num_field */
+//   index.Build(num_feature, num_field);
+//   offset_t b = index.Block(j, f);  /* Width(j, f) blocks from b */
+//------------------------------------------------------------------------------
+class FieldIndex {
+ public:
+  /* The block of the pair that is not in the index */
+  static const offset_t kNoBlock = ~(offset_t)0;
+
+  /* The field of the feature that is not in the data */
+  static const index_t kNoField = ~(index_t)0;
+
+  FieldIndex() : num_feat_(0), num_field_(0), words_(0), num_plane_(0) { }
+
+  // Add the target fields of the nodes of the rows. The node of
+  // feature j in the row targets the fields of the other nodes, and
+  // its own field only if the row has another node of that field.
+  void Add(const DMatrix* matrix);
+
+  // Allow the pair of field f1 and f2 (both directions), and the
+  // other pairs are dropped by Add(). All the pairs are allowed
+  // if it is never called.
+  void AllowPair(index_t f1, index_t f2);
+
+  // Add the pair of (feature j, target field f), e.g., the pairs
+  // of a dense ffm model that are kept by Model::Prune().
+  void Set(index_t j, index_t f);
+
+  // Give the feature j one block for all its target fields,
+  // e.g., the features of less rows than -share_count.
+  void Share(index_t j);
+
+  // Give V_j_f of the features of field g the K of
+  // field_k[g * num_field + f] (at least 1), where the
+  // field of j is its first field in Add().
+  void SetFieldK(const std::vector<index_t>& field_k);
+
+  // Fix the index for the model of the given size, where the ids
+  // out of the range are dropped, and compute the first blocks.
+  void Build(index_t num_feature, index_t num_field);
+
+  // Add the new features [NumFeature(), num_feature), which
+  // have no blocks, e.g., for Model::Grow().
+  void Grow(index_t num_feature);
+
+  void Clear();
+
+  // The index has not been built.
+  bool Empty() const { return begin_.empty(); }
+
+  index_t NumFeature() const { return num_feat_; }
+  index_t NumField() const { return num_field_; }
+
+  // The feature j has one block for all its fields.
+  bool IsShared(index_t j) const {
+    return j / 64 < shared_.size() &&
+           (shared_[j / 64] & ((uint64)1 << (j % 64))) != 0;
+  }
+
+  // There is any shared feature.
+  bool HasShared() const { return !shared_.empty(); }
+
+  // The vectors have their own K (see SetFieldK).
+  bool HasWidths() const { return !field_k_.empty(); }
+
+  // The K of V_j_f, which is only given with the widths.
+  inline index_t FieldK(index_t j, index_t f) const {
+    return field_k_[(offset_t)feat_field_[j] * num_field_ + f];
+  }
+
+  // The blocks of V_j_f, which is 1 without the widths. The
+  // shared block of j is the widest of its fields, and so its
+  // pairs use the width of f, as the other features do.
+  inline index_t Width(index_t j, index_t f) const {
+    if (field_k_.empty()) { return 1; }
+    return (FieldK(j, f) + kAlign - 1) / kAlign;
+  }
+
+  // Number of the blocks of all the features.
+  offset_t NumBlocks() const { return Empty() ? 0 : begin_.back(); }
+
+  // The first block of the j-th feature, and Begin(NumFeature())
+  // is the number of the blocks.
+  offset_t Begin(index_t j) const { return begin_[j]; }
+
+  // The block of V_j_f, or kNoBlock if the pair is not in the index.
+  inline offset_t Block(index_t j, index_t f) const {
+    const uint64* mask = mask_.data() + (offset_t)j * words_;
+    index_t w = f / 64;
+    uint64 bit = (uint64)1 << (f % 64);
+    if ((mask[w] & bit) == 0) { return kNoBlock; }
+    if (!shared_.empty() && IsShared(j)) { return begin_[j]; }
+    if (!field_k_.empty()) { return width_block(j, mask, w, bit); }
+    offset_t block = begin_[j] + popcount(mask[w] & (bit - 1));
+    for (index_t i = 0; i < w; ++i) {
+      block += popcount(mask[i]);
+    }
+    return block;
+  }
+
+  // Write the index to the file, and Deserialize() reads it
+  // back, which returns false for a broken index. The shared
+  // features are written after the bitmasks if HasShared(),
+  // and then the widths if HasWidths(), and shared and widths
+  // tell Deserialize() to read them.
+  void Serialize(FILE* file) const;
+  bool Deserialize(FILE* file, bool shared = false, bool widths = false);
+
+ private:
+  /* Number of the features and the fields */
+  index_t num_feat_;
+  index_t num_field_;
+  /* Words of the bitmask of each feature */
+  index_t words_;
+  /* Bitmask of the target fields of each feature */
+  std::vector<uint64> mask_;
+  /* First block of each feature, and the number of blocks */
+  std::vector<offset_t> begin_;
+  /* Bitmask of the shared features, and it is empty if none */
+  std::vector<uint64> shared_;
+  /* Nodes of each field in current row, used by Add() */
+  std::vector<index_t> row_count_;
+  std::vector<uint64> row_mask_;
+  /* Bitmask of the allowed target fields of each field,
+  and it is empty if all the pairs are allowed */
+  std::vector<std::vector<uint64> > allow_;
+  /* Field of each feature (found by Add(), and kept by Build()
+  only with the widths), and the K of the pairs of fields */
+  std::vector<index_t> feat_field_;
+  std::vector<index_t> field_k_;
+  /* Bitmasks of the target fields of each field whose width
+  has the bit p, at ((g * num_plane_) + p) * words_ */
+  index_t num_plane_;
+  std::vector<uint64> planes_;
+
+  static inline index_t popcount(uint64 x) {
+#ifdef _MSC_VER
+    return (index_t)__popcnt64(x);
+#else
+    return (index_t)__builtin_popcountll(x);
+#endif
+  }
+
+  // Set the words of the bitmasks, and keep the fields.
+  void set_words(index_t words);
+
+  // Compute the first blocks by the bitmasks.
+  void set_begin();
+
+  // Compute the bit planes of the widths.
+  void set_planes();
+
+  // Block() of the widths, where the bit of f is in the word w.
+  inline offset_t width_block(index_t j, const uint64* mask,
+                              index_t w, uint64 bit) const {
+    const uint64* plane = planes_.data() +
+        (offset_t)feat_field_[j] * num_plane_ * words_;
+    offset_t block = begin_[j];
+    for (index_t p = 0; p < num_plane_; ++p) {
+      offset_t count = popcount(mask[w] & (bit - 1) & plane[w]);
+      for (index_t i = 0; i < w; ++i) {
+        count += popcount(mask[i] & plane[i]);
+      }
+      block += count << p;
+      plane += words_;
+    }
+    return block;
+  }
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_FIELD_INDEX_H_
@@ -0,0 +1,302 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the FieldIndex class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <string>
+
+#include "src/base/file_util.h"
+#include "src/data/field_index.h"
+
+namespace xLearn {
+
+// Row 0 is 0:0 1:1 1:2 and row 1 is 2:0 0:3 (field:feature), so
+// the targets are 0 -> { 0, 1 }, 1 -> { 0, 1 }, 2 -> { 0, 1 } and
+// 3 -> { 2 }. Feature 0 is alone in its field of each row.
+void init_matrix(DMatrix* matrix) {
+  matrix->ReAlloc(2);
+  matrix->row[0] = new SparseRow;
+  matrix->row[1] = new SparseRow;
+  matrix->AddNode(0, 0, 1.0, 0);
+  matrix->AddNode(0, 1, 1.0, 1);
+  matrix->AddNode(0, 2, 1.0, 1);
+  matrix->AddNode(1, 0, 1.0, 2);
+  matrix->AddNode(1, 3, 1.0, 0);
+}
+
+TEST(FieldIndexTest, Add_and_Build) {
+  DMatrix matrix;
+  init_matrix(&matrix);
+  FieldIndex index;
+  EXPECT_TRUE(index.Empty());
+  index.Add(&matrix);
+  index.Build(5, 3);
+  EXPECT_FALSE(index.Empty());
+  EXPECT_EQ(index.NumFeature(), 5);
+  EXPECT_EQ(index.NumField(), 3);
+  EXPECT_EQ(index.NumBlocks(), 7);
+  EXPECT_EQ(index.Block(0, 0), 0);
+  EXPECT_EQ(index.Block(0, 1), 1);
+  EXPECT_EQ(index.Block(0, 2), FieldIndex::kNoBlock);
+  EXPECT_EQ(index.Block(1, 0), 2);
+  EXPECT_EQ(index.Block(2, 1), 5);
+  EXPECT_EQ(index.Block(3, 0), FieldIndex::kNoBlock);
+  EXPECT_EQ(index.Block(3, 2), 6);
+  // The unseen feature has no blocks
+  EXPECT_EQ(index.Begin(4), 7);
+  EXPECT_EQ(index.Begin(5), 7);
+  EXPECT_EQ(index.Block(4, 0), FieldIndex::kNoBlock);
+  // The new features have no blocks either
+  index.Grow(8);
+  EXPECT_EQ(index.NumFeature(), 8);
+  EXPECT_EQ(index.NumBlocks(), 7);
+  EXPECT_EQ(index.Block(7, 1), FieldIndex::kNoBlock);
+  index.Clear();
+  EXPECT_TRUE(index.Empty());
+  EXPECT_EQ(index.NumBlocks(), 0);
+}
+
+// The ids out of the model are dropped.
+TEST(FieldIndexTest, Build_smaller) {
+  DMatrix matrix;
+  init_matrix(&matrix);
+  FieldIndex index;
+  index.Add(&matrix);
+  index.Build(2, 1);
+  EXPECT_EQ(index.NumBlocks(), 2);
+  EXPECT_EQ(index.Block(0, 0), 0);
+  EXPECT_EQ(index.Block(1, 0), 1);
+}
+
+// Only the pair of field 0 and 1 is kept.
+TEST(FieldIndexTest, Allow_pair) {
+  DMatrix matrix;
+  init_matrix(&matrix);
+  FieldIndex index;
+  index.AllowPair(1, 0);
+  index.Add(&matrix);
+  index.Build(5, 3);
+  EXPECT_EQ(index.NumBlocks(), 3);
+  EXPECT_EQ(index.Block(0, 1), 0);
+  EXPECT_EQ(index.Block(0, 0), FieldIndex::kNoBlock);
+  EXPECT_EQ(index.Block(1, 0), 1);
+  EXPECT_EQ(index.Block(1, 1), FieldIndex::kNoBlock);
+  EXPECT_EQ(index.Block(2, 0), 2);
+  EXPECT_EQ(index.Block(3, 2), FieldIndex::kNoBlock);
+  // The pairs are cleared with the index
+  index.Clear();
+  index.Add(&matrix);
+  index.Build(5, 3);
+  EXPECT_EQ(index.NumBlocks(), 7);
+}
+
+// The bitmask of more than 64 fields has several words.
+TEST(FieldIndexTest, Many_fields) {
+  DMatrix matrix;
+  matrix.ReAlloc(2);
+  matrix.row[0] = new SparseRow;
+  matrix.row[1] = new SparseRow;
+  matrix.AddNode(0, 0, 1.0, 3);
+  matrix.AddNode(0, 1, 1.0, 130);
+  matrix.AddNode(1, 0, 1.0, 70);
+  matrix.AddNode(1, 1, 1.0, 2);
+  FieldIndex index;
+  index.Add(&matrix);
+  index.Build(2, 131);
+  EXPECT_EQ(index.NumBlocks(), 4);
+  EXPECT_EQ(index.Block(0, 2), 0);
+  EXPECT_EQ(index.Block(0, 130), 1);
+  EXPECT_EQ(index.Block(1, 3), 2);
+  EXPECT_EQ(index.Block(1, 70), 3);
+  EXPECT_EQ(index.Block(1, 2), FieldIndex::kNoBlock);
+}
+
+// The fields of a shared feature have its one block.
+TEST(FieldIndexTest, Share_features) {
+  DMatrix matrix;
+  init_matrix(&matrix);
+  FieldIndex index;
+  index.Add(&matrix);
+  index.Share(1);
+  index.Share(3);
+  index.Share(9);
+  index.Build(5, 3);
+  EXPECT_TRUE(index.HasShared());
+  EXPECT_TRUE(index.IsShared(1));
+  EXPECT_FALSE(index.IsShared(2));
+  EXPECT_FALSE(index.IsShared(9));
+  EXPECT_EQ(index.NumBlocks(), 6);
+  EXPECT_EQ(index.Block(0, 1), 1);
+  EXPECT_EQ(index.Block(1, 0), 2);
+  EXPECT_EQ(index.Block(1, 1), 2);
+  EXPECT_EQ(index.Block(1, 2), FieldIndex::kNoBlock);
+  EXPECT_EQ(index.Block(2, 0), 3);
+  EXPECT_EQ(index.Block(2, 1), 4);
+  EXPECT_EQ(index.Block(3, 2), 5);
+  std::string filename = "field_index_test.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  index.Serialize(file);
+  Close(file);
+  FieldIndex loaded;
+  file = OpenFileOrDie(filename.c_str(), "rb");
+  ASSERT_TRUE(loaded.Deserialize(file, true));
+  Close(file);
+  EXPECT_EQ(loaded.NumBlocks(), 6);
+  for (index_t j = 0; j < 5; ++j) {
+    EXPECT_EQ(loaded.IsShared(j), index.IsShared(j));
+    for (index_t f = 0; f < 3; ++f) {
+      EXPECT_EQ(loaded.Block(j, f), index.Block(j, f));
+    }
+  }
+  RemoveFile(filename.c_str());
+  // No feature is shared in the model
+  FieldIndex none;
+  none.Add(&matrix);
+  none.Share(7);
+  none.Build(5, 3);
+  EXPECT_FALSE(none.HasShared());
+  EXPECT_EQ(none.NumBlocks(), 7);
+}
+
+TEST(FieldIndexTest, Parse_field_k) {
+  std::vector<FieldK> items;
+  EXPECT_TRUE(ParseFieldK("0=2,1=5,2:3=4", &items));
+  ASSERT_EQ(items.size(), 3);
+  EXPECT_FALSE(items[0].pair);
+  EXPECT_EQ(items[1].field_1, 1);
+  EXPECT_EQ(items[1].k, 5);
+  EXPECT_TRUE(items[2].pair);
+  EXPECT_EQ(items[2].field_2, 3);
+  EXPECT_FALSE(ParseFieldK("0", &items));
+  EXPECT_FALSE(ParseFieldK("0=0", &items));
+  EXPECT_FALSE(ParseFieldK("a=2", &items));
+  EXPECT_FALSE(ParseFieldK("1:2=4,2:1=8", &items));
+  EXPECT_TRUE(ParseFieldK("1=4,1:1=8", &items));
+  // A pair has the smaller K of its fields, and K is at most num_K
+  EXPECT_TRUE(ParseFieldK("0=2,1=5,2:3=4,3=40", &items));
+  std::vector<index_t> table = FieldKTable(items, 4, 11);
+  index_t expected[16] = { 2, 2, 2, 2,
+                           2, 5, 5, 5,
+                           2, 5, 11, 4,
+                           2, 5, 4, 11 };
+  for (int i = 0; i < 16; ++i) { EXPECT_EQ(table[i], expected[i]); }
+}
+
+// Feature j is of field j % 3 in the rows below, and its vector of
+// field f has Width() blocks of kAlign values, where the widths are
+// 1 for field 0 and 2 for the pairs of fields 1 and 2.
+TEST(FieldIndexTest, Field_k) {
+  DMatrix matrix;
+  matrix.ReAlloc(2);
+  for (index_t i = 0; i < 2; ++i) {
+    matrix.row[i] = new SparseRow;
+    for (index_t j = i; j < 6; j += 2) {
+      matrix.AddNode(i, j, 1.0, j % 3);
+    }
+  }
+  std::vector<FieldK> items;
+  ASSERT_TRUE(ParseFieldK("0=2", &items));
+  FieldIndex index;
+  index.Add(&matrix);
+  index.SetFieldK(FieldKTable(items, 3, 8));
+  index.Build(7, 3);
+  EXPECT_TRUE(index.HasWidths());
+  EXPECT_EQ(index.Width(0, 1), 1);
+  EXPECT_EQ(index.Width(1, 2), 2);
+  EXPECT_EQ(index.FieldK(0, 2), 2);
+  EXPECT_EQ(index.FieldK(4, 2), 8);
+  // Row 0 is 0:0 1:2 2:4 and row 1 is 1:1 0:3 2:5 (field:feature)
+  EXPECT_EQ(index.Block(0, 1), 0);
+  EXPECT_EQ(index.Block(0, 2), 1);
+  EXPECT_EQ(index.Begin(1), 2);
+  EXPECT_EQ(index.Block(1, 0), 2);
+  EXPECT_EQ(index.Block(1, 2), 3);
+  EXPECT_EQ(index.Begin(2), 5);
+  EXPECT_EQ(index.Block(2, 0), 5);
+  EXPECT_EQ(index.Block(2, 1), 6);
+  EXPECT_EQ(index.Block(2, 2), FieldIndex::kNoBlock);
+  EXPECT_EQ(index.NumBlocks(), 2 + 3 + 3 + 2 + 3 + 3);
+  // The shared feature has the widest of its blocks
+  FieldIndex shared;
+  shared.Add(&matrix);
+  shared.Share(4);
+  shared.SetFieldK(FieldKTable(items, 3, 8));
+  shared.Build(7, 3);
+  EXPECT_EQ(shared.Block(4, 0), shared.Block(4, 2));
+  EXPECT_EQ(shared.Begin(5) - shared.Begin(4), 2);
+  std::string filename = "field_index_test.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  shared.Serialize(file);
+  Close(file);
+  FieldIndex loaded;
+  file = OpenFileOrDie(filename.c_str(), "rb");
+  ASSERT_TRUE(loaded.Deserialize(file, true, true));
+  Close(file);
+  EXPECT_TRUE(loaded.HasWidths());
+  EXPECT_EQ(loaded.NumBlocks(), shared.NumBlocks());
+  for (index_t j = 0; j < 7; ++j) {
+    for (index_t f = 0; f < 3; ++f) {
+      EXPECT_EQ(loaded.Block(j, f), shared.Block(j, f));
+      if (loaded.Block(j, f) != FieldIndex::kNoBlock) {
+        EXPECT_EQ(loaded.Width(j, f), shared.Width(j, f));
+      }
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(FieldIndexTest, Serialize_and_Deserialize) {
+  DMatrix matrix;
+  init_matrix(&matrix);
+  FieldIndex index;
+  index.Add(&matrix);
+  index.Build(5, 3);
+  std::string filename = "field_index_test.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  index.Serialize(file);
+  Close(file);
+  FieldIndex loaded;
+  file = OpenFileOrDie(filename.c_str(), "rb");
+  ASSERT_TRUE(loaded.Deserialize(file));
+  Close(file);
+  EXPECT_EQ(loaded.NumFeature(), 5);
+  EXPECT_EQ(loaded.NumField(), 3);
+  EXPECT_EQ(loaded.NumBlocks(), 7);
+  for (index_t j = 0; j < 5; ++j) {
+    for (index_t f = 0; f < 3; ++f) {
+      EXPECT_EQ(loaded.Block(j, f), index.Block(j, f));
+    }
+  }
+  // A truncated index is not loaded
+  file = OpenFileOrDie(filename.c_str(), "wb");
+  index_t num_feat = 5;
+  WriteDataToDisk(file, (char*)&num_feat, sizeof(num_feat));
+  Close(file);
+  file = OpenFileOrDie(filename.c_str(), "rb");
+  EXPECT_FALSE(loaded.Deserialize(file));
+  Close(file);
+  EXPECT_TRUE(loaded.Empty());
+  RemoveFile(filename.c_str());
+}
+
+}  // namespace xLearn
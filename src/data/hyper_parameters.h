@@ -22,6 +22,7 @@ This file defines the basic hyper-parameters used by xLearn.
 #define XLEARN_DATA_HYPER_PARAMETER_H_
 
 #include <string>
+#include <vector>
 
 #include "src/data/data_structure.h"
 
@@ -45,6 +46,70 @@ struct HyperParam {
   during the training, and just train the model.
   Setting this option to true will accelerate the training. */
   bool quiet = false;
+  /* Also show the metric (-x) of the training data, which
+  is accumulated in the gradient pass, so the prediction
+  of each row is given by the model before its update */
+  bool train_metric = false;
+  /* Print the time of the phases of each epoch */
+  bool profile = false;
+  /* The file of the time of the phases of each epoch,
+  which has one JSON object per line (empty for no file) */
+  std::string profile_file;
+  /* Count the hardware events of the gradient pass
+  and of the prediction (Linux only) */
+  bool perf_counter = false;
+  /* The file of the Chrome trace of the spans of
+  the threads (empty for no trace) */
+  std::string trace_file;
+  /* The file of the counts of the features and the fields
+  of the training data (empty for no counting) */
+  std::string feature_stats_file;
+  /* Renumber the features of the training by their frequency,
+  and the model is saved with the ids of the data */
+  bool remap_features = false;
+  /* Renumber the fields of the training data to the dense ids
+  of the used fields, which the model file keeps */
+  bool remap_fields = false;
+  /* The features of less nodes than it in the training data
+  share one id of the model. 0 disables it. */
+  int min_count = 0;
+  /* The ffm model only keeps the latent vectors of the pairs of
+  (feature, target field) in the training data (see FieldIndex) */
+  bool sparse_ffm = false;
+  /* The pairs of fields whose interactions are kept by ffm,
+  e.g., "0:1,2:5" (see FieldIndex::AllowPair), and empty for
+  all the pairs. It implies sparse_ffm */
+  std::string field_pairs;
+  /* The features of less nodes than it in the training data have
+  one latent vector of ffm for all their target fields (see
+  FieldIndex::Share). It implies sparse_ffm, and 0 disables it. */
+  int share_count = 0;
+  /* The K of the fields and the pairs of fields of ffm, e.g.,
+  "0=2,1=2,3:4=16" (see ParseFieldK), where num_K is the K of
+  the other fields and the largest one. It implies sparse_ffm */
+  std::string field_k;
+  /* The bag fields of ffm, e.g., "3,7" (see ParseBagFields), whose
+  nodes of a row are summed, or averaged if bag_pool is "mean",
+  into one unit (see FFMScore). It is given to both the training
+  and the prediction. */
+  std::string bag_field;
+  std::string bag_pool = "sum";
+  /* The latent weights of each feature of ffm are kept apart
+  from their gradient cache (see Model::SetSplitLayout) */
+  bool split_ffm = false;
+  /* The latent vectors of ffm are in the order of target
+  field and then feature (see Model::SetFieldMajor) */
+  bool field_major = false;
+  /* Validate each epoch on a snapshot of the model
+  while the next epoch is trained */
+  bool async_validate = false;
+  /* Validate the model every valid_every epochs, or every
+  valid_rows training rows if it is not 0 */
+  int valid_every = 1;
+  int valid_rows = 0;
+  /* Rate of the sample of the validation data, which is used
+  by the validation during the training (1 uses all the rows) */
+  real_t valid_sample = 1.0;
   /* Score function. 
   For now, it can be 'linear', 'fm', or 'ffm' */
   std::string score_func = "linear";
@@ -55,13 +120,24 @@ struct HyperParam {
   For now, it can be 'acc', 'prec', 'recall', 
   'f1', 'mae', 'rmsd', 'mape', or 'none' */
   std::string metric = "none";
+  /* Number of the buckets used by the approximate AUC */
+  int auc_bucket = 1000000;
+  /* Compute the exact AUC by sorting all the scores */
+  bool exact_auc = false;
   /* Number of thread existing in the thread pool */
   int thread_number = 0;
+  /* CPU affinity of the threads, which can be 'none',
+  'compact', 'scatter', or a cpu list such as '0-7,16-23'
+  (see mem_alloc.h) */
+  std::string affinity = "none";
 //------------------------------------------------------------------------------
 // Parameters for optimization method
 //------------------------------------------------------------------------------
   /* Optimization method */
   std::string opt_type = "adagrad";
+  /* Storage type of the optimizer state, which is 'fp32', or
+  'bf16' for the two aux values of ftrl in one float */
+  std::string opt_state = "fp32";
   /* auxiliary size for gradient cache */
   index_t auxiliary_size = 2;
   /* Learning rate */
@@ -75,6 +151,9 @@ struct HyperParam {
   real_t beta = 1.0;
   real_t lambda_1 = 0.00001;
   real_t lambda_2 = 0.00002;
+  /* Used for adam and adamw */
+  real_t beta_1 = 0.9;
+  real_t beta_2 = 0.999;
   /* Number of epoch. 
   This value could be changed in early-stop */
   int num_epoch = 10;
@@ -83,13 +162,75 @@ struct HyperParam {
   bool norm = true;
   /* Using lock-free AdaGard to accelerate training */
   bool lock_free = true;
+  /* Number of rows to prefetch the model parameters
+  ahead in training and prediction. 0 disables it. */
+  int prefetch_distance = 4;
+  /* Number of rows between two merges of the per-thread
+  copy of the bias and the hot features. 0 disables it. */
+  int merge_rows = 0;
+  /* Number of the most frequent features that are
+  copied for each thread besides the bias */
+  int num_hot_feature = 0;
+  /* Number of rows of each thread whose gradients are
+  summed before one update of the model. 0 disables it. */
+  int grad_batch = 0;
+  /* Number of rows of each thread in a round of the training by
+  the owners of the features, where the gradients of each range of
+  the features are applied by its own thread. 0 (Hogwild) disables it. */
+  int owner_rows = 0;
+  /* The ffm rows of at least long_row nodes are split across
+  the threads, which take the blocks of its pair loop. 0 disables it. */
+  int long_row = 0;
+  /* The ffm rows of at least sample_row nodes are trained on a
+  sample of sample_pair * nnz of their pairs. 0 disables it. */
+  int sample_row = 0;
+  int sample_pair = 16;
+  /* Number of the labels of each training row, which are
+  the tasks of the multi-task training. The first one is the
+  task of -s, and each other one trains its own model. */
+  int num_label = 1;
+  /* The loss (cross-entropy or squared) of each other task,
+  which is the loss of -s if it is not given */
+  std::vector<std::string> task_loss;
+  /* Initialize the parameters of each feature on its first
+  use, so the memory of unseen features is not touched. */
+  bool lazy_init = false;
+  /* Apply the L2 regularization of the skipped steps on the
+  next use of each feature, so every step decays all the
+  features. Only used by sgd and adagrad. */
+  bool lazy_l2 = false;
+  /* Using transparent huge pages for the model parameters */
+  bool huge_page = false;
+  /* NUMA placement of the model parameters, which can be
+  'none', 'interleave', 'local', or 'replicate' (see mem_alloc.h) */
+  std::string numa_policy = "none";
+  /* Rows trained by the NUMA copies of -numa replicate
+  between two averages of the copies */
+  int numa_sync = 65536;
+  /* How the rows of a batch are split over the threads,
+  which can be 'row', 'nnz', or 'dynamic' (see loss.h) */
+  std::string partition = "row";
 //------------------------------------------------------------------------------
 // Parameters for dataset
 //------------------------------------------------------------------------------
   /* Number of feature */
   index_t num_feature = 0;
+  /* Number of bits of the hashing trick. If it is not 0,
+  the feature ids are hashed into 2^hash_bits buckets, and
+  num_feature is 2^hash_bits */
+  int hash_bits = 0;
+  /* Drop the features of value 0 in the txt data, e.g.,
+  the zero columns of a sparse CSV file */
+  bool skip_zeros = false;
+  /* Merge the nodes of the same feature (and field of ffm)
+  in a row of the txt data, whose values are summed */
+  bool merge_dup = false;
+  /* The pairs of fields whose features are crossed by the
+  parser of the txt data, e.g., "0:1,2:5" (see ParseCrosses
+  in parser.h), and empty for none */
+  std::string cross;
   /* Number of total model parameters */
-  index_t num_param = 0;
+  offset_t num_param = 0;
   /* Number of latent factor for fm and ffm */
   index_t num_K = 4;
   /* Number of field, used by ffm tasks */
@@ -97,9 +238,29 @@ struct HyperParam {
   /* Filename of training dataset
   We must set this value in training task. */
   std::string train_set_file;
+  /* All the training files given by a list, a glob, a directory
+  or a manifest (see ExpandDataList), which are read as one dataset
+  (see ShardReader), and read_jobs of them are parsed at the same
+  time. It is empty for a single file, and train_set_file is the
+  first file of the list. */
+  std::vector<std::string> train_set_files;
+  int read_jobs = 2;
   /* Filename of test dataset 
   We must set this value in predication task. */
   std::string test_set_file;
+  /* All the test files of a prediction task given by a list
+  or a glob, and their output files. These are empty for a
+  single test file, which uses test_set_file and output_file */
+  std::vector<std::string> test_set_files;
+  std::vector<std::string> output_files;
+  /* Number of test files predicted at the same time */
+  int test_jobs = 2;
+  /* The other models of an ensemble given by a list of model
+  files, which score the rows of model_file in the same pass, and
+  the weights of their blend (-blend), with the one of model_file
+  first. Both are empty for one model */
+  std::vector<std::string> ensemble_files;
+  std::vector<real_t> blend_weights;
   /* Filename for validation set
   This value can be empty. */
   std::string validate_set_file;
@@ -109,15 +270,32 @@ struct HyperParam {
   xLearn::DMatrix* test_dataset = nullptr;
   /* DMatrix pointer for validate*/
   xLearn::DMatrix* valid_dataset = nullptr;
+  /* The batches of the training and validation data
+  given by the caller, which replace the DMatrix above */
+  xLearn::DataIter train_iter;
+  xLearn::DataIter valid_iter;
 
   /* Filename of model checkpoint
   On default, model_file = train_set_file + ".model" */
   std::string model_file;
   /* Pre-trained model for online learning */
   std::string pre_model_file;
+  /* Write the model file in the sparse format, which only
+  keeps the features that have been used */
+  bool sparse_model = false;
+  /* Write the checksum of each section of the dense model
+  file, which is verified when it is loaded */
+  bool model_checksum = false;
+  /* Drop the latent vectors whose L2 norm is below
+  it before the model is saved (0 is off) */
+  real_t prune = 0;
   /* Filename of the txt model checkpoint 
   On default, txt_model_file = none */
   std::string txt_model_file = "none";
+  /* Filename of the inference model, which only keeps
+  the model without gradient cache.
+  On default, inference_model_file = none */
+  std::string inference_model_file = "none";
   /* Filename of output result for prediction
   output_file = test_set_file + ".out" */
   std::string output_file;
@@ -129,14 +307,68 @@ struct HyperParam {
 #endif
   /* Block size for on-disk training */
   int block_size = 500;  // 500 MB
+  /* Memory budget (MB) of the training, which chooses the
+  reader and the block size (0 for no budget) */
+  int mem_budget = 0;
+  /* Memory (MB) of the parsed blocks that the on-disk reader
+  keeps for the next epochs (0 for none, or the rest of -mem) */
+  int block_cache = 0;
+  /* The file that keeps w and v of the model, which can be larger
+  than the memory, and empty for keeping them in memory */
+  std::string param_file;
+  /* Memory (MB) of the head of -param_file that is locked
+  in memory, which keeps the most frequent features */
+  int param_mem = 0;
+  /* Adjust the block size of the on-disk reader by the parse
+  time and the train time of its first epoch (--auto-block) */
+  bool auto_block = false;
+  /* Keep the rows of the in-memory training compressed, which
+  are decoded by the batches of each pass (--pack-rows) */
+  bool pack_rows = false;
+  /* Time the threads, the prefetch, the partition, the lock-free
+  training and the ffm layout on a sample of the training data,
+  and train with the fastest ones (--autotune) */
+  bool autotune = false;
+  /* How the readers use the page cache of the data files,
+  which can be 'cache', 'nocache', 'direct', or 'uring'
+  (see file_util.h) */
+  std::string file_io = "cache";
   /* If generate bin file */
   bool bin_out = true;
   /* Random seed to shuffle data set */
   int seed = 1;
+  /* Rows of each window of the shuffled data, which are
+  ordered by the min-hash of their features (0 is off) */
+  index_t shuffle_window = 0;
   /* from file or not? */
   bool from_file = true;
   /* If generate prediction file */
   bool res_out = true;
+  /* Write the prediction file as raw float32
+  values instead of text (--raw-out) */
+  bool raw_out = false;
+  /* Score the test set on the CUDA device gpu_device (--gpu
+  and -gpu_device), which falls back to the CPU if xLearn is
+  built without CUDA or the model is not supported */
+  bool use_gpu = false;
+  int gpu_device = 0;
+  /* The pairs of the fields of ffm whose tables have at most
+  pair_cells cells are looked up from the tables precomputed from
+  the test set (-pair_table). 0 disables the tables. */
+  uint64 pair_cells = 0;
+  /* The requests of the loaded model of c_api arriving within
+  batch_window microseconds are predicted in one batch of at
+  most batch_rows rows. 0 disables the micro-batching. */
+  int batch_window = 0;
+  int batch_rows = 4096;
+  /* The loaded model of c_api keeps the scores of at most
+  result_cache recent rows, so the repeated rows are not
+  scored again. 0 disables the cache. */
+  int result_cache = 0;
+  /* The online training and the loaded model of c_api serve their
+  metrics in the Prometheus text format at http://<host>:metrics_port
+  /metrics (see MetricsServer). 0 disables it. */
+  int metrics_port = 0;
 //------------------------------------------------------------------------------
 // Parameters for validation
 //------------------------------------------------------------------------------
@@ -145,20 +377,102 @@ struct HyperParam {
   bool cross_validation = false;
   /* Number of folds in cross-validation */
   int num_folds = 3;
+  /* Number of folds trained at the same time, where
+  each of them uses its share of the threads */
+  int cv_jobs = 1;
+  /* The grid of -k, -r and -b trained over the same data,
+  e.g., "k=4,8:r=0.1,0.2" (see sweep.h), and empty for none */
+  std::string sweep;
+  /* Number of the configurations of the sweep trained at
+  the same time, where each of them uses its share of the threads */
+  int sweep_jobs = 1;
+  /* Rate of the negative sampling of the training data,
+  where 1 keeps all the negative rows */
+  real_t neg_rate = 1.0;
+  /* Expected share of the training rows that are sampled by their
+  loss from the epoch loss_sample_epoch (see Reader::SetLossRate),
+  where 1 trains all the rows of each epoch */
+  real_t loss_sample = 1.0;
+  int loss_sample_epoch = 3;
   /* True for using early-stop and
   False for not */
   bool early_stop = true;
   /* Early stop window size */
   int stop_window = 2;
+  /* The file that keeps the best model of early-stop,
+  and empty for keeping it in memory */
+  std::string stop_file;
+  /* The checkpoint file written during the training,
+  and empty for no checkpoint */
+  std::string checkpoint_file;
+  /* Epochs between two checkpoints (0 for no limit) */
+  int checkpoint_epoch = 0;
+  /* Minutes between two checkpoints (0 for no limit) */
+  real_t checkpoint_minute = 0;
+  /* Train on a stream of lines that never ends (see
+  xlearn_online), instead of the epochs over a file */
+  bool online = false;
+  /* Seconds between two publications of the model of
+  the online training */
+  real_t publish_seconds = 60;
+  /* Prefix of the delta files of each publication
+  of the online training, or empty */
+  std::string delta_file;
   /* Convert prediction output to 0 and 1 */
   bool sign = false;
   /* Convert prediction output using sigmoid */
   bool sigmoid = false;
+  /* Storage type of the latent factors in prediction
+  and in the inference model file.
+  It can be 'fp32', 'fp16', 'bf16', or 'int8' */
+  std::string latent_type = "fp32";
 //------------------------------------------------------------------------------
 // Parameters for distributed learning
 //------------------------------------------------------------------------------
-  /* Batch size for gradient descent */
-  int batch_size = 1000000;
+  /* Addresses (host:port) of the nodes of distributed training,
+  and each node is a worker and a server of a shard of the model.
+  Empty for training on one machine */
+  std::vector<std::string> ps_hosts;
+  /* Rank of this node in ps_hosts */
+  int ps_rank = 0;
+  /* Seconds to wait for the other nodes to start */
+  int ps_timeout = 300;
+  /* Pull the next mini-batch and push the last one while
+  a mini-batch is computed, or wait for each of them */
+  bool ps_pipeline = true;
+  /* The nodes read their own shards of the same training file */
+  bool ps_shard = false;
+  /* The number of mini-batches that a node can be ahead of the
+  slowest node, where the epochs are not synchronized. -1 for the
+  synchronized epochs */
+  int ps_staleness = -1;
+  /* Each node has the whole model, which is averaged by the
+  ring allreduce, instead of the parameter server */
+  bool ps_allreduce = false;
+  /* The encoding (fp32, fp16, bf16 or int8) of the pushes, and
+  the ratio of the values of each key in a push */
+  std::string ps_push = "fp32";
+  real_t ps_topk = 1.0;
+  /* The number of mini-batches that the pulled parameters are
+  cached by a worker, where 0 pulls them in each mini-batch */
+  int ps_cache = 0;
+  /* How the keys are split into the servers: mod (by the remainder),
+  range (contiguous ranges) or balanced (the ranges of the same load) */
+  std::string ps_partition = "mod";
+  /* Name of the shared memory of the processes that train one
+  model on the same host, where each process reads its own shard
+  of the training file. Empty for training in one process */
+  std::string shm_name;
+  /* Rank of this process and the number of the processes */
+  int shm_rank = 0;
+  int shm_procs = 1;
+  /* Name of the shared memory of the parsed data, which is
+  shared by the in-memory training processes of the host on
+  the same files. Empty for reading the data in each process */
+  std::string data_shm;
+  /* Batch size for gradient descent, which is the number
+  of rows of each pull and push of a worker */
+  int batch_size = 10000;
   /* Number of worker for compute gradient */
   int num_worker = 0;
   /* Number of parameter server for store model parameters */
@@ -21,13 +21,21 @@ This file is the implementation of the Model class.
 #include "src/data/model_parameters.h"
 
 #include <string.h>
-#include <pmmintrin.h>  // for SSE
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "src/base/file_util.h"
 #include "src/base/format_print.h"
 #include "src/base/math.h"
 #include "src/base/logging.h"
+#include "src/base/mem_alloc.h"
 #include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
 
 namespace xLearn {
 
@@ -35,6 +43,176 @@ namespace xLearn {
 // The Model class
 //------------------------------------------------------------------------------
 
+// The inference model starts with this tag instead of the
+// score function, so Deserialize() can tell them apart.
+static const char* kInferenceTag = "xlearn_inference";
+
+// The tag of the negative sampling rate at the end of the model file.
+static const char* kNegRateTag = "neg_rate";
+
+// The sparse model starts with this tag (see SerializeSparse).
+static const char* kSparseTag = "xlearn_sparse";
+
+// Features of a block of the sparse model file, which are
+// written or read by one call.
+static const size_t kSparseBlock = 4096;
+
+// The tag of the trained epochs of a checkpoint.
+static const char* kEpochTag = "epoch";
+
+// The tag of the map of the feature ids.
+static const char* kFeatureMapTag = "feature_map";
+
+// The tag of the map of the field ids.
+static const char* kFieldMapTag = "field_map";
+
+// The tag of the type of the optimizer state.
+static const char* kOptStateTag = "opt_state";
+
+// The tag of the field weights of fwfm.
+static const char* kFieldWeightTag = "field_weight";
+
+// The sparse ffm model starts with this tag and its field index,
+// which are followed by the checkpoint or the inference model, so
+// the sizes of the arrays are known before they are read.
+static const char* kFieldIndexTag = "xlearn_field_index";
+// The tag of the field index with the shared features.
+static const char* kSharedIndexTag = "xlearn_field_index_shared";
+// The tags of the field index with the widths (see FieldIndex::SetFieldK).
+static const char* kWidthIndexTag = "xlearn_field_index_width";
+static const char* kWidthSharedIndexTag = "xlearn_field_index_width_shared";
+
+// The tag of the field index by its shared features and widths.
+static const char* field_index_tag(const FieldIndex& index) {
+  if (index.HasWidths()) {
+    return index.HasShared() ? kWidthSharedIndexTag : kWidthIndexTag;
+  }
+  return index.HasShared() ? kSharedIndexTag : kFieldIndexTag;
+}
+
+// The delta file starts with this tag (see SerializeDelta).
+static const char* kDeltaTag = "xlearn_delta";
+
+// The tag of the id of the model version.
+static const char* kVersionTag = "version";
+
+// The tag of the checksum of the sections of w, b and v.
+static const char* kChecksumTag = "checksum";
+
+// The default bytes of a section of w, b and v (see file_sections).
+static const uint64 kFileSection = 16 << 20;
+
+// The checksum of the s-th section of the model file, which has
+// its index, so the sections in a wrong place do not match.
+static uint64 section_checksum(size_t s, const char* data, uint64 size) {
+  return HashBuffer(0x9E3779B97F4A7C15ULL + s, data, (long)size);
+}
+
+// The bit of the storage type in the inference file, which is set
+// if the arrays are aligned to kAlignByte (see map_inference).
+// An older version does not know the bit and stops at the file.
+static const index_t kAlignedLayout = 0x100;
+
+// Free the memory given by alloc_param().
+static void free_aligned(void* ptr) {
+  FreeAligned(ptr);
+}
+
+// The position rounded up to kAlignByte.
+static uint64 align_pos(uint64 pos) {
+  return (pos + kAlignByte - 1) / kAlignByte * kAlignByte;
+}
+
+// Write zeros up to the next aligned position of the file.
+static void write_padding(FILE* file) {
+  static const char kZeros[kAlignByte] = { 0 };
+  uint64 pos = FileTell(file);
+  size_t len = align_pos(pos) - pos;
+  if (len > 0) { WriteDataToDisk(file, kZeros, len); }
+}
+
+// Skip the zeros written by write_padding().
+static void skip_padding(FILE* file) {
+  FileSeek(file, align_pos(FileTell(file)));
+}
+
+// Set how the model parameters are allocated and initialized.
+void Model::SetMemoryPolicy(bool huge_page,
+                            NumaPolicy numa,
+                            ThreadPool* pool) {
+  huge_page_ = huge_page;
+  numa_ = numa;
+  pool_ = pool;
+}
+
+void Model::SetChecksum(bool checksum, uint64 section_bytes) {
+  checksum_ = checksum;
+  section_bytes_ = section_bytes;
+}
+
+// Allocate the big arrays of w and v with the memory policy.
+void* Model::alloc_param(size_t size) {
+  void* ptr = AllocAligned(size, kAlignByte, huge_page_);
+  if (numa_ == kNumaInterleave && !InterleaveMemory(ptr, size)) {
+    LOG(WARNING) << "Cannot interleave the model parameters "
+                    "over the NUMA nodes.";
+  }
+  return ptr;
+}
+
+void Model::SetParamFile(const std::string& filename) {
+  CHECK(param_w_ == nullptr);
+  CHECK(!filename.empty());
+  param_filename_ = filename;
+}
+
+// The file keeps w and then v at the next aligned position, so the
+// arrays are aligned as alloc_param() gives. The pages of the model
+// are used at random, so the kernel does not read ahead of them.
+void Model::map_param_file(bool has_v) {
+  uint64 pos_v = align_pos(param_num_w_ * sizeof(real_t));
+  uint64 size = pos_v + (has_v ? param_num_v_ * sizeof(real_t) : 0);
+  std::unique_ptr<MappedFile> file(new MappedFile());
+  if (!file->Create(param_filename_, size)) {
+    LOG(FATAL) << "Cannot create the model file " << param_filename_
+               << " of " << size << " bytes.";
+  }
+  file->Advise(MappedFile::kRandom);
+  param_w_ = (real_t*)file->mutable_data();
+  param_v_ = has_v ? (real_t*)(file->mutable_data() + pos_v) : nullptr;
+  param_file_ = std::move(file);
+}
+
+// Lock the head of w and the head of v, which are
+// the parameters of the first features.
+bool Model::LockFeatures(index_t num_feature) {
+  CHECK(IsFileBacked());
+  num_feature = std::min(num_feature, num_feat_);
+  if (num_feature == 0) { return true; }
+  const char* data = param_file_->data();
+  uint64 bytes_w = (offset_t)num_feature * aux_size_ * sizeof(real_t);
+  bool locked = param_file_->Lock(0, bytes_w);
+  uint64 base_v = param_v_ == nullptr ? 0 : (const char*)param_v_ - data;
+  if (locked && param_v_ != nullptr) {
+    latent_runs(0, num_feature, [&](offset_t pos, offset_t size) {
+      locked = locked && (size == 0 ||
+               param_file_->Lock(base_v + pos * sizeof(real_t),
+                                 size * sizeof(real_t)));
+    });
+  }
+  if (!locked) {
+    param_file_->Advise(MappedFile::kWillNeed, 0, bytes_w);
+    if (param_v_ != nullptr) {
+      latent_runs(0, num_feature, [&](offset_t pos, offset_t size) {
+        param_file_->Advise(MappedFile::kWillNeed,
+                            base_v + pos * sizeof(real_t),
+                            size * sizeof(real_t));
+      });
+    }
+  }
+  return locked;
+}
+
 // Basic contributor.
 void Model::Initialize(const std::string& score_func,
                   const std::string& loss_func,
@@ -42,7 +220,9 @@ void Model::Initialize(const std::string& score_func,
                   index_t num_field,
                   index_t num_K,
                   index_t aux_size,
-                  real_t scale) {
+                  real_t scale,
+                  bool lazy,
+                  real_t aux_value) {
   CHECK(!score_func.empty());
   CHECK(!loss_func.empty());
   CHECK_GT(num_feature, 0);
@@ -59,47 +239,69 @@ void Model::Initialize(const std::string& score_func,
   num_K_ = num_K;
   aux_size_ = aux_size;
   scale_ = scale;
-  // Calculate the number of model parameters
-  param_num_w_ = num_feature * aux_size_;
+  lazy_ = lazy;
+  aux_value_ = aux_value;
+  if (lazy_) {
+    touched_.assign(num_feature, 0);
+  }
+  if (!field_index_.Empty()) {
+    CHECK_EQ(score_func_.compare("ffm"), 0);
+    CHECK_EQ(field_index_.NumFeature(), num_feature);
+    CHECK_EQ(field_index_.NumField(), num_field);
+  }
+  this->set_num_param();
+  this->initial(true);
+}
+
+// Calculate the number of model parameters, which
+// is done in 64 bits to avoid overflow (see offset_t).
+void Model::set_num_param() {
+  param_num_w_ = (offset_t)num_feat_ * aux_size_;
   // latent vector
-  if (score_func == "linear") {
+  if (score_func_ == "linear") {
     param_num_v_ = 0;
-  } else if (score_func == "fm") {
-    // fm: feature * K
-    param_num_v_ = num_feature * get_aligned_k() * aux_size_;
-  } else if (score_func == "ffm") {
+  } else if (score_func_ == "fm" || score_func_ == "fwfm") {
+    // fm and fwfm: feature * K
+    param_num_v_ = (offset_t)num_feat_ * get_aligned_k() * aux_size_;
+  } else if (score_func_ == "ffm" && !field_index_.Empty()) {
+    // sparse ffm: block * K
+    CHECK_EQ(field_index_.NumField(), num_field_);
+    param_num_v_ = field_index_.NumBlocks() * get_row_k() * aux_size_;
+  } else if (score_func_ == "ffm") {
     // ffm: feature * K * field
-    param_num_v_ = num_feature * get_aligned_k() * num_field * aux_size_;
+    param_num_v_ = (offset_t)num_feat_ * get_aligned_k() *
+                   num_field_ * aux_size_;
   } else {
-    LOG(FATAL) << "Unknow score function: " << score_func;
+    LOG(FATAL) << "Unknow score function: " << score_func_;
   }
-  this->initial(true);
+  // The layouts are the same without aux
+  split_ = split_ && score_func_ == "ffm" &&
+           field_index_.Empty() && aux_size_ > 1;
+  field_major_ = field_major_ && score_func_ == "ffm" &&
+                 field_index_.Empty() && !split_;
 }
 
-// To get the best performance for SSE, we need to
+// To get the best performance for SIMD, we need to
 // allocate memory for the model parameters in aligned way.
-// For SSE, the align number should be 16 byte (kAlignByte).
+// The align number is 64 byte (kAlignByte), which covers
+// SSE, AVX2 and AVX-512 and also matches the cache line.
+// The linear term and latent factor follow the memory
+// policy (see SetMemoryPolicy).
 void Model::initial(bool set_val) {
+  cap_feat_ = num_feat_;
+  bool has_v = score_func_.compare("fm") == 0 ||
+               score_func_.compare("ffm") == 0 ||
+               score_func_.compare("fwfm") == 0;
   try {
-    // Conventional malloc for linear term and bias
-    param_w_ = (real_t*)malloc(param_num_w_ * sizeof(real_t));
+    // Conventional malloc for bias
     param_b_ = (real_t*)malloc(aux_size_ * sizeof(real_t));
-    if (score_func_.compare("fm") == 0 ||
-        score_func_.compare("ffm") == 0) {
-      // Aligned malloc for latent factor
-#ifdef _MSC_VER
-      param_v_ = (decltype(param_v_))_aligned_malloc(
-                 param_num_v_ * sizeof(real_t),
-                 kAlignByte);
-#else
-      int ret = posix_memalign(
-                (void**)&param_v_,
-                kAlignByte,
-                param_num_v_ * sizeof(real_t));
-      CHECK_EQ(ret, 0);
-#endif
+    if (!param_filename_.empty()) {
+      map_param_file(has_v);
     } else {
-      param_v_ = nullptr;
+      param_w_ = (real_t*)alloc_param(param_num_w_ * sizeof(real_t));
+      // Aligned malloc for latent factor
+      param_v_ = has_v ?
+          (real_t*)alloc_param(param_num_v_ * sizeof(real_t)) : nullptr;
     }
   } catch (std::bad_alloc&) {
     LOG(FATAL) << "Cannot allocate enough memory for current  \
@@ -114,76 +316,593 @@ void Model::initial(bool set_val) {
 
 // Set value for model
 void Model::set_value() {
+  /*********************************************************
+   *  Initialize bias term                                 *
+   *********************************************************/
+  param_b_[0] = 0.0;      /* model */
+  for (index_t j = 1; j < aux_size_; ++j) {
+    param_b_[j] = aux_value_;    /* gradient cache */
+  }
+  /*********************************************************
+   *  Initialize field weights of fwfm                     *
+   *********************************************************/
+  // All the weights start at 1, which is the fm model
+  if (score_func_.compare("fwfm") == 0) {
+    param_r_.assign((offset_t)num_field_ * num_field_ * aux_size_,
+                    aux_value_);
+    for (size_t i = 0; i < param_r_.size(); i += aux_size_) {
+      param_r_[i] = 1.0;
+    }
+  }
+  // Start the lazy L2 regularization over again
+  if (lazy_regu_) {
+    std::fill(regu_step_.begin(), regu_step_.end(), 0);
+    regu_clock_ = 1;
+  }
+  // The hot features are chosen again on the next batch
+  num_hot_ = 0;
+  hot_feat_.clear();
+  hot_bitmap_.clear();
+  // The features of the lazy model are set by Touch()
+  if (lazy_) {
+    std::fill(touched_.begin(), touched_.end(), 0);
+    return;
+  }
+  // Each feature uses its own random stream, which is seeded by
+  // its id. Then the model is the same as the lazy model, and it
+  // does not depend on the number of threads, so the worker threads
+  // initialize their own range of features, and the pages are first
+  // touched on their NUMA nodes.
+  if (pool_ != nullptr && pool_->ThreadNumber() > 1) {
+    size_t threads = pool_->ThreadNumber();
+    TaskGroup group(pool_);
+    for (size_t i = 0; i < threads; ++i) {
+      index_t start = getStart(num_feat_, threads, i);
+      index_t end = getEnd(num_feat_, threads, i);
+      group.Run([this, start, end]() {
+        for (index_t j = start; j < end; ++j) {
+          init_feature(j);
+        }
+      });
+    }
+    group.Wait();
+    return;
+  }
+  for (index_t j = 0; j < num_feat_; ++j) {
+    init_feature(j);
+  }
+}
+
+// Set the linear term and the latent factor of the j-th feature.
+void Model::set_feature_value(index_t j,
+                              std::default_random_engine& generator) {
   // Use distribution to transform the random unsigned
   // int generated by gen into a float in [(0.0, 1.0) * coef]
-  std::default_random_engine generator;
   std::uniform_real_distribution<real_t> dis(0.0, 1.0);
   /*********************************************************
-   *  Initialize linear and bias term                      *
+   *  Initialize linear term                               *
    *********************************************************/
-  for (index_t i = 0; i < param_num_w_; i += aux_size_) {
-    param_w_[i] = 0.0;        /* model */
-    for (index_t j = 1; j < aux_size_; ++j) {
-      param_w_[i+j] = 1.0;    /* gradient cache */
-    }
-  }
-  param_b_[0] = 0.0;      /* model */
-  for (index_t j = 1; j < aux_size_; ++j) {
-    param_b_[j] = 1.0;    /* gradient cache */
+  real_t* w = param_w_ + (offset_t)j * aux_size_;
+  w[0] = 0.0;          /* model */
+  for (index_t i = 1; i < aux_size_; ++i) {
+    w[i] = aux_value_;   /* gradient cache */
   }
   /*********************************************************
-   *  Initialize latent factor for fm                      *
+   *  Initialize latent factor for fm and fwfm             *
    *********************************************************/
-  if (score_func_.compare("fm") == 0) {
+  if (score_func_.compare("fm") == 0 ||
+      score_func_.compare("fwfm") == 0) {
     index_t k_aligned = get_aligned_k();
     real_t coef = 1.0f / sqrt(num_K_) * scale_;
-    real_t* w = param_v_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      for(index_t d = 0; d < num_K_; d++, w++) {
-        *w = coef * dis(generator);  /* model */
-      }
-      for(index_t d = num_K_; d < k_aligned; d++, w++) {
-        *w = 0;  /* Beyond aligned number */
-      }
-      for(index_t d = k_aligned; d < aux_size_*k_aligned; d++, w++) {
-        *w = 1.0;  /* gradient cache */
-      }
+    w = param_v_ + (offset_t)j * aux_size_ * k_aligned;
+    for(index_t d = 0; d < num_K_; d++, w++) {
+      *w = coef * dis(generator);  /* model */
+    }
+    for(index_t d = num_K_; d < k_aligned; d++, w++) {
+      *w = 0;  /* Beyond aligned number */
+    }
+    for(index_t d = k_aligned; d < aux_size_*k_aligned; d++, w++) {
+      *w = aux_value_;  /* gradient cache */
     }
   }
   /*********************************************************
    *  Initialize latent factor for ffm                     *
    *********************************************************/
+  // The sparse model draws the values of all the fields, and only
+  // keeps its blocks, so they are the same as the dense model. The
+  // vectors of their own K keep the first K values of the draws and
+  // are zero in the rest of their blocks.
   else if (score_func_.compare("ffm") == 0) {
     index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
     real_t coef = 1.0f / sqrt(num_K_) * scale_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      for (index_t f = 0; f < num_field_; ++f) {
-        for (index_t d = 0; d < k_aligned; ) {
-          for (index_t s = 0; s < kAlign; s++, w++, d++) {
-            w[0] = (d < num_K_) ? coef * dis(generator) : 0.0; /* model */
-            for (index_t j = 1; j < aux_size_; ++j) {
-              w[kAlign * j] = 1.0; /* gradient cache */
-            }
-          }
-          w += (aux_size_-1) * kAlign;
+    bool sparse = !field_index_.Empty();
+    bool widths = field_index_.HasWidths();
+    offset_t gap = ffm_gap();
+    for (index_t f = 0; f < num_field_; ++f) {
+      offset_t r = (offset_t)j * num_field_ + f;
+      if (sparse) {
+        r = field_index_.Block(j, f);
+        if (r == FieldIndex::kNoBlock) {
+          for (index_t d = 0; d < num_K_; ++d) { dis(generator); }
+          continue;
+        }
+      }
+      index_t num_K = num_K_;
+      index_t size = k_aligned;
+      if (widths) {
+        num_K = std::min(field_index_.FieldK(j, f), num_K_);
+        size = field_index_.Width(j, f) * kAlign;
+        coef = 1.0f / sqrt(num_K) * scale_;
+      }
+      for (index_t d = 0; d < k_aligned; ++d) {
+        real_t value = (d < num_K_) ? dis(generator) : 0.0;
+        if (d >= size) { continue; }
+        w = param_v_ + ffm_pos(r, d);
+        w[0] = (d < num_K) ? coef * value : 0.0; /* model */
+        for (index_t a = 1; a < aux_size_; ++a) {
+          w[gap * a] = aux_value_; /* gradient cache */
         }
       }
     }
   }
 }
 
+// The seed of each feature is mixed, since the seeds next
+// to each other give close random numbers in the LCG.
+static uint32 feature_seed(index_t j) {
+  uint64 x = j;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (uint32)x;
+}
+
+// Initialize the j-th feature with its own seed.
+void Model::init_feature(index_t j) {
+  std::default_random_engine generator(feature_seed(j));
+  set_feature_value(j, generator);
+}
+
+// Initialize the j-th feature on its first use.
+void Model::touch_feature(index_t j) {
+  init_feature(j);
+  touched_[j] = 1;
+  if (track_dirty_) { dirty_[j] = 1; }
+}
+
+void Model::touch_all() {
+  if (!lazy_) { return; }
+  for (index_t j = 0; j < num_feat_; ++j) {
+    if (touched_[j] == 0) {
+      touch_feature(j);
+    }
+  }
+}
+
+void Model::Densify() {
+  touch_all();
+  lazy_ = false;
+  std::vector<uint8>().swap(touched_);
+}
+
+index_t Model::GetNumTouched() {
+  if (!lazy_) { return num_feat_; }
+  return std::count(touched_.begin(), touched_.end(), 1);
+}
+
+// Grow the model for the new features. The layout of w and v is
+// feature first, so the old parameters are the head of the arrays.
+void Model::Grow(index_t num_feature) {
+  if (num_feature <= num_feat_) { return; }
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(!IsMapped());
+  CHECK(!IsShared());
+  CHECK(!IsFileBacked());
+  CHECK(replicas_.empty());
+  CHECK(!has_best_);
+  CHECK(!field_major_);
+  index_t old_feat = num_feat_;
+  // The new features have no latent blocks
+  if (!field_index_.Empty()) {
+    field_index_.Grow(num_feature);
+  }
+  if (num_feature > cap_feat_) {
+    real_t* old_w = param_w_;
+    real_t* old_v = param_v_;
+    offset_t old_num_w = param_num_w_;
+    offset_t old_num_v = param_num_v_;
+    // The headroom is not touched, so it has no pages until used
+    uint64 cap = std::max((uint64)num_feature,
+                          (uint64)num_feat_ + num_feat_ / 4);
+    num_feat_ = (index_t)std::min(cap, (uint64)kUInt32Max);
+    this->set_num_param();
+    try {
+      param_w_ = (real_t*)alloc_param(param_num_w_ * sizeof(real_t));
+      if (old_v != nullptr) {
+        param_v_ = (real_t*)alloc_param(param_num_v_ * sizeof(real_t));
+      }
+    } catch (std::bad_alloc&) {
+      LOG(FATAL) << "Cannot allocate enough memory for current  \
+                     model parameters. Parameter size: "
+                 << GetNumParameter();
+    }
+    cap_feat_ = num_feat_;
+    memcpy(param_w_, old_w, old_num_w * sizeof(real_t));
+    free_aligned(old_w);
+    if (old_v != nullptr) {
+      memcpy(param_v_, old_v, old_num_v * sizeof(real_t));
+      free_aligned(old_v);
+    }
+  }
+  num_feat_ = num_feature;
+  this->set_num_param();
+  if (lazy_) {
+    touched_.resize(num_feature, 0);
+  } else {
+    for (index_t j = old_feat; j < num_feature; ++j) {
+      init_feature(j);
+    }
+  }
+  if (track_dirty_) { dirty_.resize(num_feature, 1); }
+  // The new features have not missed any decay
+  if (lazy_regu_) {
+    regu_step_.resize(num_feature, regu_clock_.load() - 1);
+  }
+  if (!hot_bitmap_.empty()) {
+    hot_bitmap_.resize(num_feature / 8 + 1, 0);
+  }
+}
+
+// Move row j of the rows of the given width to row map[j] by
+// following the cycles of the permutation, where carry is the
+// row that is moved to the next position of the cycle.
+template <typename T>
+static void permute_rows(T* data, offset_t width,
+                         const std::vector<index_t>& map) {
+  if (data == nullptr || width == 0) { return; }
+  std::vector<bool> done(map.size(), false);
+  std::vector<T> carry(width), next(width);
+  for (index_t start = 0; start < map.size(); ++start) {
+    if (done[start] || map[start] == start) { continue; }
+    std::copy(data + start * width, data + (start + 1) * width,
+              carry.begin());
+    index_t j = map[start];
+    for (;;) {
+      T* row = data + j * width;
+      std::copy(row, row + width, next.begin());
+      std::copy(carry.begin(), carry.end(), row);
+      done[j] = true;
+      if (j == start) { break; }
+      carry.swap(next);
+      j = map[j];
+    }
+  }
+}
+
+template <typename T>
+static void permute_vector(std::vector<T>* data,
+                           const std::vector<index_t>& map) {
+  if (data->empty()) { return; }
+  CHECK_EQ(data->size(), map.size());
+  permute_rows(data->data(), 1, map);
+}
+
+void Model::RemapFeatures(const std::vector<index_t>& map) {
+  CHECK_EQ(map.size(), num_feat_);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(!IsMapped());
+  CHECK(!IsShared());
+  CHECK(replicas_.empty());
+  CHECK(best_file_ == nullptr);
+  CHECK(field_index_.Empty());
+  std::vector<bool> seen(num_feat_, false);
+  for (index_t j = 0; j < num_feat_; ++j) {
+    CHECK_LT(map[j], num_feat_);
+    // The map must be a permutation
+    CHECK(!seen[map[j]]);
+    seen[map[j]] = true;
+  }
+  // The field-major v is permuted in each field
+  offset_t size_v = param_num_v_ / num_feat_;
+  index_t num_slice = field_major_ ? num_field_ : 1;
+  size_v /= num_slice;
+  permute_rows(param_w_, aux_size_, map);
+  if (has_best_) {
+    permute_rows(param_best_w_, aux_size_, map);
+  }
+  for (index_t f = 0; f < num_slice && size_v > 0; ++f) {
+    offset_t pos = (offset_t)f * num_feat_ * size_v;
+    permute_rows(param_v_ + pos, size_v, map);
+    if (has_best_) {
+      permute_rows(param_best_v_ + pos, size_v, map);
+    }
+  }
+  permute_vector(&touched_, map);
+  permute_vector(&best_touched_, map);
+  permute_vector(&dirty_, map);
+  permute_vector(&regu_step_, map);
+  if (num_hot_ > 0) {
+    for (index_t h = 0; h < num_hot_; ++h) {
+      hot_feat_[h] = map[hot_feat_[h]];
+    }
+    set_hot_bitmap();
+  }
+}
+
+// The arrays of w and v are aligned as alloc_param() gives,
+// and b is the last one.
+uint64 Model::GetSharedSize() {
+  return align_pos(param_num_w_ * sizeof(real_t)) +
+         align_pos(param_num_v_ * sizeof(real_t)) +
+         aux_size_ * sizeof(real_t);
+}
+
+void Model::ShareParameters(char* buffer, bool copy) {
+  CHECK_NOTNULL(buffer);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(!IsMapped());
+  CHECK(!IsShared());
+  CHECK(!IsFileBacked());
+  CHECK(!lazy_);
+  // The field weights of fwfm and the field
+  // index of ffm are not in the buffer
+  CHECK(param_r_.empty());
+  CHECK(field_index_.Empty());
+  CHECK_EQ((uintptr_t)buffer % kAlignByte, 0);
+  real_t* w = (real_t*)buffer;
+  real_t* v = (real_t*)(buffer + align_pos(param_num_w_ * sizeof(real_t)));
+  real_t* b = (real_t*)((char*)v + align_pos(param_num_v_ * sizeof(real_t)));
+  if (copy) {
+    memcpy(w, param_w_, param_num_w_ * sizeof(real_t));
+    if (param_v_ != nullptr) {
+      memcpy(v, param_v_, param_num_v_ * sizeof(real_t));
+    }
+    memcpy(b, param_b_, aux_size_ * sizeof(real_t));
+  }
+  free_aligned(param_w_);
+  free(param_b_);
+  param_w_ = w;
+  param_b_ = b;
+  if (param_v_ != nullptr) {
+    free_aligned(param_v_);
+    param_v_ = v;
+  }
+  shared_ = buffer;
+  shared_size_ = GetSharedSize();
+}
+
+// Enable the lazy L2 regularization.
+void Model::SetLazyRegu(real_t learning_rate, real_t lambda) {
+  CHECK_GT(num_feat_, 0);
+  CHECK_LE(aux_size_, 2);
+  lazy_regu_ = true;
+  regu_rate_ = learning_rate * lambda;
+  regu_step_.assign(num_feat_, 0);
+  regu_clock_ = 1;
+}
+
+// Decay factor of the parameter over the given steps, where
+// rate is the decay of one step. It is exact for sgd, and the
+// skipped steps of adagrad are taken with the current rate.
+static inline real_t decay_factor(real_t rate, uint64 steps) {
+  if (rate >= 1.0) { return 0; }
+  return exp((double)steps * log1p(-(double)rate));
+}
+
+// Decay the linear term and the latent factor of the j-th
+// feature. For adagrad, each parameter is followed by its
+// gradient cache: w[1] for the linear term, ffm_gap() for
+// ffm, and the next aligned_k for fm.
+void Model::decay_feature(index_t j, uint64 steps) {
+  if (track_dirty_) { dirty_[j] = 1; }
+  real_t* w = param_w_ + (offset_t)j * aux_size_;
+  offset_t pos_v = latent_offset(j);
+  offset_t size_v = latent_offset(j + 1) - pos_v;
+  real_t* v = param_v_ + pos_v;
+  if (aux_size_ == 1) {
+    real_t factor = decay_factor(regu_rate_, steps);
+    w[0] *= factor;
+    latent_runs(j, j + 1, [&](offset_t pos, offset_t size) {
+      for (offset_t i = 0; i < size; ++i) {
+        param_v_[pos + i] *= factor;
+      }
+    });
+    return;
+  }
+  w[0] *= decay_factor(regu_rate_ / sqrt(w[1]), steps);
+  if (size_v == 0) { return; }
+  index_t k_aligned = get_row_k();
+  index_t num_K = std::min(num_K_, k_aligned);
+  bool is_ffm = score_func_.compare("ffm") == 0;
+  offset_t gap = is_ffm ? ffm_gap() : k_aligned;
+  offset_t first = pos_v / (k_aligned * aux_size_);
+  offset_t num_row = size_v / (k_aligned * aux_size_);
+  for (offset_t r = 0; r < num_row; ++r) {
+    real_t* row = v + r * k_aligned * aux_size_;
+    for (index_t d = 0; d < num_K; ++d) {
+      real_t* p = is_ffm ? param_v_ + ffm_pos(first + r, d) : row + d;
+      *p *= decay_factor(regu_rate_ / sqrt(p[gap]), steps);
+    }
+  }
+}
+
+// Bring all the features up to the last step. The features
+// of the lazy model that have not been used are skipped,
+// since they are initialized later.
+void Model::FlushLazyRegu() {
+  if (!lazy_regu_) { return; }
+  uint64 last = regu_clock_.load() - 1;
+  for (index_t j = 0; j < num_feat_; ++j) {
+    if (lazy_ && touched_[j] == 0) { continue; }
+    if (last > regu_step_[j]) {
+      decay_feature(j, last - regu_step_[j]);
+      regu_step_[j] = last;
+    }
+  }
+}
+
+// Enable the per-thread parameters.
+void Model::SetLocalParams(int merge_rows, index_t num_hot) {
+  CHECK_GE(merge_rows, 0);
+  merge_rows_ = merge_rows;
+  max_hot_ = merge_rows > 0 ? std::min(num_hot, num_feat_) : 0;
+  num_hot_ = 0;
+  hot_feat_.clear();
+  hot_bitmap_.clear();
+}
+
+// Count the features in the batch, and the ties of the
+// count are broken by the feature id, so the choice is
+// the same in every run.
+void Model::ChooseHotFeatures(const DMatrix* matrix) {
+  if (max_hot_ == 0 || num_hot_ > 0) { return; }
+  std::unordered_map<index_t, index_t> count;
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    SparseRow* row = matrix->row[i];
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      if (iter->feat_id < num_feat_) { count[iter->feat_id]++; }
+    }
+  }
+  std::vector<std::pair<index_t, index_t> > order;
+  order.reserve(count.size());
+  for (auto iter = count.begin(); iter != count.end(); ++iter) {
+    order.push_back(std::make_pair(iter->second, iter->first));
+  }
+  index_t num_hot = std::min((index_t)order.size(), max_hot_);
+  std::partial_sort(order.begin(), order.begin() + num_hot, order.end(),
+    [](const std::pair<index_t, index_t>& a,
+       const std::pair<index_t, index_t>& b) {
+      return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+  std::vector<index_t> ids(num_hot);
+  for (index_t h = 0; h < num_hot; ++h) {
+    ids[h] = order[h].second;
+  }
+  SetHotFeatures(ids);
+}
+
+void Model::SetHotFeatures(const std::vector<index_t>& ids) {
+  if (max_hot_ == 0 || num_hot_ > 0) { return; }
+  hot_feat_.clear();
+  for (size_t h = 0; h < ids.size() && hot_feat_.size() < max_hot_; ++h) {
+    if (ids[h] < num_feat_) { hot_feat_.push_back(ids[h]); }
+  }
+  index_t num_hot = hot_feat_.size();
+  for (index_t h = 0; h < num_hot; ++h) {
+    // The copy is taken from w, which must be initialized
+    if (lazy_ && touched_[hot_feat_[h]] == 0) {
+      touch_feature(hot_feat_[h]);
+    }
+  }
+  num_hot_ = num_hot;
+  set_hot_bitmap();
+}
+
+// Sort the hot features, and set their bits.
+void Model::set_hot_bitmap() {
+  std::sort(hot_feat_.begin(), hot_feat_.end());
+  hot_bitmap_.assign(num_feat_ / 8 + 1, 0);
+  for (index_t h = 0; h < num_hot_; ++h) {
+    hot_bitmap_[hot_feat_[h] >> 3] |= 1 << (hot_feat_[h] & 7);
+  }
+}
+
+// Take the copy of the bias and the hot features.
+void Model::BeginLocal() {
+  if (merge_rows_ == 0) { return; }
+  LocalParams& local = local_params();
+  size_t size = (num_hot_ + 1) * aux_size_;
+  local.value.resize(size);
+  local.base.resize(size);
+  {
+    std::lock_guard<std::mutex> lock(merge_mutex_);
+    for (index_t h = 0; h <= num_hot_; ++h) {
+      memcpy(local.base.data() + h * aux_size_, shared_local(h),
+             aux_size_ * sizeof(real_t));
+    }
+  }
+  local.value = local.base;
+  local.rows = 0;
+  local.owner = this;
+}
+
+// shared += value - base, and then value = base = shared. Both the
+// parameter and its aux (e.g., the gradient cache of adagrad) are
+// merged by the delta, which is the same as the lock-free update
+// with a delay of merge_rows_ rows.
+void Model::MergeLocal() {
+  LocalParams& local = local_params();
+  if (local.owner != this) { return; }
+  std::lock_guard<std::mutex> lock(merge_mutex_);
+  for (index_t h = 0; h <= num_hot_; ++h) {
+    real_t* shared = shared_local(h);
+    real_t* value = local.value.data() + h * aux_size_;
+    real_t* base = local.base.data() + h * aux_size_;
+    for (index_t d = 0; d < aux_size_; ++d) {
+      shared[d] += value[d] - base[d];
+      value[d] = shared[d];
+      base[d] = shared[d];
+    }
+  }
+  local.rows = 0;
+}
+
+// Merge and release the copy of current thread.
+void Model::EndLocal() {
+  if (merge_rows_ == 0) { return; }
+  MergeLocal();
+  local_params().owner = nullptr;
+}
+
 // Free the allocated memory
 void Model::free_model() {
-  free(param_w_);
-#ifndef _MSC_VER
-  free(param_v_);
-#else
-  _aligned_free(param_v_);
-#endif
+  // The arrays in the mapped file are unmapped at once
+  if (in_mapped(param_w_)) { param_w_ = nullptr; }
+  if (in_mapped(param_v_)) { param_v_ = nullptr; }
+  if (in_mapped(param_v_half_)) { param_v_half_ = nullptr; }
+  if (in_mapped(param_v_int8_)) { param_v_int8_ = nullptr; }
+  if (in_mapped(param_v_scale_)) { param_v_scale_ = nullptr; }
+  mapped_.reset();
+  // The file of w and v is removed with the model
+  if (in_param_file(param_w_)) { param_w_ = nullptr; }
+  if (in_param_file(param_v_)) { param_v_ = nullptr; }
+  if (param_file_ != nullptr) {
+    param_file_.reset();
+    RemoveFile(param_filename_.c_str());
+  }
+  // The shared buffer is kept by the caller
+  if (in_shared(param_w_)) { param_w_ = nullptr; }
+  if (in_shared(param_v_)) { param_v_ = nullptr; }
+  if (in_shared(param_b_)) { param_b_ = nullptr; }
+  shared_ = nullptr;
+  free_aligned(param_w_);
+  free_aligned(param_v_);
   free(param_b_);
+  if (param_v_half_ != nullptr) {
+    free_aligned(param_v_half_);
+  }
+  if (param_v_int8_ != nullptr) {
+    free_aligned(param_v_int8_);
+  }
+  if (param_v_scale_ != nullptr) {
+    free(param_v_scale_);
+  }
+  free_best();
+  ClearReplicas();
+}
+
+void Model::ClearReplicas() {
+  for (size_t n = 0; n < replicas_.size(); ++n) {
+    delete replicas_[n];
+  }
+  replicas_.clear();
+}
+
+void Model::free_best() {
   if (param_best_w_ != nullptr) {
     free(param_best_w_);
+    param_best_w_ = nullptr;
   }
   if (param_best_v_ != nullptr) {
 #ifndef _MSC_VER
@@ -191,10 +910,19 @@ void Model::free_model() {
 #else
     _aligned_free(param_best_v_);
 #endif
+    param_best_v_ = nullptr;
   }
   if (param_best_b_ != nullptr) {
     free(param_best_b_);
+    param_best_b_ = nullptr;
   }
+  if (best_file_ != nullptr) {
+    Close(best_file_);
+    RemoveFile(best_filename_.c_str());
+    best_file_ = nullptr;
+  }
+  std::vector<uint8>().swap(best_touched_);
+  has_best_ = false;
 }
 
 // Initialize model from a checkpoint file
@@ -212,11 +940,17 @@ Model::Model(const std::string& filename) {
 // Serialize current model to a disk file
 void Model::Serialize(const std::string& filename) {
   CHECK_NE(filename.empty(), true);
+  CHECK(latent_type_ == kStoreFP32);
+  touch_all();
 #ifndef _MSC_VER
   FILE* file = OpenFileOrDie(filename.c_str(), "w");
 #else
   FILE *file = OpenFileOrDie(filename.c_str(), "wb");
 #endif
+  if (!field_index_.Empty()) {
+    WriteStringToFile(file, std::string(field_index_tag(field_index_)));
+    field_index_.Serialize(file);
+  }
   // Write score function
   WriteStringToFile(file, score_func_);
   // Write loss function
@@ -231,184 +965,1673 @@ void Model::Serialize(const std::string& filename) {
   WriteDataToDisk(file, (char*)&aux_size_, sizeof(aux_size_));
   // Write w
   this->serialize_w_v_b(file);
+  this->serialize_extra(file);
+  section_hash_.clear();
   Close(file);
 }
 
-// Serialize current model to a TXT file.
-void Model::SerializeToTXT(const std::string& filename) {
-  CHECK_NE(filename.empty(), true);
-  std::ofstream o_file(filename);
-  /*********************************************************
-   *  Write linear and bias term                      *
-   *********************************************************/
-  // bias term
-  o_file << "bias: " << param_b_[0] << "\n";
-  // linear term
-  index_t idx = 0;
-  for (index_t i = 0; i < param_num_w_; i += aux_size_) {
-    o_file << "i_" << idx << ": " << param_w_[i] << "\n";
-    idx++;
+// The snapshot has the same layout as the model, so w, v and
+// b are copied as a whole. The lazy model also gives its touched_,
+// so the snapshot initializes the unseen features when it is
+// serialized, as this model would do.
+void Model::Snapshot(Model* snapshot) {
+  CHECK_NOTNULL(snapshot);
+  CHECK(latent_type_ == kStoreFP32);
+  if (snapshot->param_w_ == nullptr) {
+    snapshot->score_func_ = score_func_;
+    snapshot->loss_func_ = loss_func_;
+    snapshot->num_feat_ = num_feat_;
+    snapshot->num_field_ = num_field_;
+    snapshot->num_K_ = num_K_;
+    snapshot->aux_size_ = aux_size_;
+    snapshot->field_index_ = field_index_;
+    snapshot->split_ = split_;
+    snapshot->field_major_ = field_major_;
+    snapshot->set_num_param();
+    snapshot->initial(false);
   }
-  /*********************************************************
-   *  Write latent factor for fm                      *
-   *********************************************************/
-  if (score_func_.compare("fm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      o_file << "v_" << j << ": ";
-      for(index_t d = 0; d < num_K_; d++, w++) {
-        o_file << *w;
-        if (d != num_K_-1) {
-          o_file << " ";
-        }
-      }
-      o_file << "\n";
-      // skip the rest parameters
-      index_t skip = aux_size_*k_aligned-num_K_;
-      w += skip;
-    }
+  CHECK_EQ(snapshot->param_num_w_, param_num_w_);
+  CHECK_EQ(snapshot->param_num_v_, param_num_v_);
+  CHECK_EQ(snapshot->aux_size_, aux_size_);
+  CHECK_EQ(snapshot->split_, split_);
+  CHECK_EQ(snapshot->field_major_, field_major_);
+  memcpy(snapshot->param_w_, param_w_, param_num_w_ * sizeof(real_t));
+  memcpy(snapshot->param_b_, param_b_, aux_size_ * sizeof(real_t));
+  if (param_v_ != nullptr) {
+    memcpy(snapshot->param_v_, param_v_, param_num_v_ * sizeof(real_t));
   }
-  /*********************************************************
-   *  Write latent factor for ffm                     *
-   *********************************************************/
-  if (score_func_.compare("ffm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      for (index_t f = 0; f < num_field_; ++f) {
-        o_file << "v_" << j << "_" << f << ": ";
-        for (index_t d = 0; d < k_aligned; ) {
-          for (index_t s = 0; s < kAlign; s++, w++, d++) {
-            if (d < num_K_) {
-              o_file << w[0];
-              if (d != num_K_-1) {
-                o_file << " ";
-              }
-            }
-          }
-          w += (aux_size_-1) * kAlign;
-        }
-        o_file << "\n";
-      }
+  snapshot->param_r_ = param_r_;
+  snapshot->scale_ = scale_;
+  snapshot->aux_value_ = aux_value_;
+  snapshot->opt_state_ = opt_state_;
+  snapshot->neg_rate_ = neg_rate_;
+  snapshot->score_offset_ = score_offset_;
+  snapshot->epoch_ = epoch_;
+  snapshot->version_id_ = version_id_;
+  snapshot->feature_map_ = feature_map_;
+  snapshot->field_map_ = field_map_;
+  snapshot->lazy_ = lazy_;
+  snapshot->touched_ = touched_;
+}
+
+// The snapshot is compared before it is replaced by the next copy,
+// so the delta needs no tracking in the training. The unseen features
+// of the lazy model are initialized by their ids in the same way on
+// both sides, so they are never changed.
+bool Model::ChangedFeatures(Model* snapshot, std::vector<index_t>* ids) {
+  CHECK_NOTNULL(snapshot);
+  CHECK_NOTNULL(ids);
+  ids->clear();
+  if (snapshot->param_w_ == nullptr ||
+      latent_type_ != kStoreFP32 ||
+      !field_index_.Empty() ||
+      !snapshot->field_index_.Empty() ||
+      snapshot->param_num_w_ != param_num_w_ ||
+      snapshot->param_num_v_ != param_num_v_ ||
+      snapshot->aux_size_ != aux_size_ ||
+      snapshot->split_ != split_ ||
+      snapshot->field_major_ != field_major_) {
+    return false;
+  }
+  for (index_t j = 0; j < num_feat_; ++j) {
+    if (lazy_ && touched_[j] == 0) { continue; }
+    offset_t pos = (offset_t)j * aux_size_;
+    bool same = memcmp(param_w_ + pos, snapshot->param_w_ + pos,
+                       aux_size_ * sizeof(real_t)) == 0;
+    if (same && param_v_ != nullptr) {
+      latent_runs(j, j + 1, [&](offset_t p, offset_t size) {
+        same = same && memcmp(param_v_ + p, snapshot->param_v_ + p,
+                              size * sizeof(real_t)) == 0;
+      });
     }
+    if (!same) { ids->push_back(j); }
   }
+  return true;
 }
 
-// Deserialize model from a checkpoint file
-bool Model::Deserialize(const std::string& filename) {
+// The delta file is:
+//
+//   tag, score_func, num_feat, num_field, num_K, base_id, version_id,
+//   b, the size of the field weights and their values, the number of
+//   the features and their ids, and then the rows of the features
+//
+// where each row is the linear term and the num_K values of each
+// latent vector of the feature (one for fm, num_field for ffm), so
+// the file does not depend on the alignment of the build.
+void Model::SerializeDelta(const std::string& filename,
+                           const std::vector<index_t>& ids,
+                           uint64 base_id) {
   CHECK_NE(filename.empty(), true);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(field_index_.Empty());
 #ifndef _MSC_VER
-  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
 #else
-  FILE* file = OpenFileOrDie(filename.c_str(), "rb");
+  FILE *file = OpenFileOrDie(filename.c_str(), "wb");
 #endif
-  if (file == NULL) { return false; }
-  // Read score function
-  ReadStringFromFile(file, score_func_);
-  // Read loss function
-  ReadStringFromFile(file, loss_func_);
-  // Read feature num
-  ReadDataFromDisk(file, (char*)&num_feat_, sizeof(num_feat_));
-  // Read field num
-  ReadDataFromDisk(file, (char*)&num_field_, sizeof(num_field_));
-  // Read K
-  ReadDataFromDisk(file, (char*)&num_K_, sizeof(num_K_));
-  // Read aux_size
-  ReadDataFromDisk(file, (char*)&aux_size_, sizeof(aux_size_));
-  // Read w
-  this->deserialize_w_v_b(file);
+  WriteStringToFile(file, std::string(kDeltaTag));
+  WriteStringToFile(file, score_func_);
+  WriteDataToDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  WriteDataToDisk(file, (char*)&num_field_, sizeof(num_field_));
+  WriteDataToDisk(file, (char*)&num_K_, sizeof(num_K_));
+  WriteDataToDisk(file, (char*)&base_id, sizeof(base_id));
+  WriteDataToDisk(file, (char*)&version_id_, sizeof(version_id_));
+  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t));
+  std::vector<real_t> value;
+  for (size_t i = 0; i < param_r_.size(); i += aux_size_) {
+    value.push_back(param_r_[i]);
+  }
+  uint64 size = value.size();
+  WriteDataToDisk(file, (char*)&size, sizeof(size));
+  if (size > 0) {
+    WriteDataToDisk(file, (char*)value.data(), sizeof(real_t) * size);
+  }
+  size = ids.size();
+  WriteDataToDisk(file, (char*)&size, sizeof(size));
+  if (size > 0) {
+    WriteDataToDisk(file, (char*)ids.data(), sizeof(index_t) * size);
+  }
+  index_t num_vec = delta_vectors();
+  index_t k_aligned = get_aligned_k();
+  std::vector<real_t> latent(k_aligned);
+  for (size_t begin = 0; begin < ids.size(); begin += kSparseBlock) {
+    size_t end = std::min(begin + kSparseBlock, ids.size());
+    value.clear();
+    for (size_t i = begin; i < end; ++i) {
+      index_t j = ids[i];
+      CHECK_LT(j, num_feat_);
+      value.push_back(param_w_[(offset_t)j * aux_size_]);
+      for (index_t f = 0; f < num_vec; ++f) {
+        get_latent_row((offset_t)j * num_vec + f, latent.data());
+        value.insert(value.end(), latent.begin(),
+                     latent.begin() + num_K_);
+      }
+    }
+    WriteDataToDisk(file, (char*)value.data(),
+                    sizeof(real_t) * value.size());
+  }
   Close(file);
-  return true;
 }
 
-// Take a record of the best model during training
-void Model::SetBestModel() {
-  try {
-    if (param_best_w_ == nullptr) {
-        param_best_w_ = (real_t*)malloc(
-        param_num_w_*sizeof(real_t));
-    }
-    if (param_best_v_ == nullptr &&
-        score_func_.compare("linear") != 0) {
-  #ifdef _MSC_VER
-        param_best_v_ = (decltype(param_best_v_))_aligned_malloc(
-        param_num_v_ * sizeof(real_t),
-        kAlignByte);
-  #else
-      int ret = posix_memalign(
-                (void**)&param_best_v_,
-                kAlignByte,
-                param_num_v_ * sizeof(real_t));
-      CHECK_EQ(ret, 0);
-  #endif
-    }
-    if (param_best_b_ == nullptr) {
-        param_best_b_ = (real_t*)malloc(
-         aux_size_ * sizeof(real_t)
-        );
-    }
-  } catch (std::bad_alloc&) {
-    LOG(FATAL) << "Cannot allocate enough memory for current  \
-                   model parameters. Parameter size: "
-               << GetNumParameter();
+// Read the tag of a delta file, or the tag of an optional item.
+static bool read_tag(FILE* file, std::string* tag) {
+  size_t len = 0;
+  if (ReadDataFromDisk(file, (char*)&len, sizeof(len)) != sizeof(len) ||
+      len == 0 || len > 256) {
+    return false;
   }
-  // Copy current model parameters
-  memcpy(param_best_w_, param_w_, param_num_w_*sizeof(real_t));
-  memcpy(param_best_v_, param_v_, param_num_v_*sizeof(real_t));
+  tag->assign(len, '\0');
+  return ReadDataFromDisk(file, &(*tag)[0], len) == len;
+}
+
+// The whole file is checked before the first write, so a
+// wrong or truncated delta never changes the model. The serving
+// threads may read a feature while it is written, which mixes
+// its values of the two versions in that prediction, as the
+// lock-free training does.
+bool Model::ApplyDelta(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  if (latent_type_ != kStoreFP32 || IsMapped() || lazy_ ||
+      !field_index_.Empty() || param_w_ == nullptr) {
+    return false;
+  }
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) { return false; }
+  uint64 file_size = GetFileSize(file);
+  std::string tag, score_func;
+  index_t num_feat = 0, num_field = 0, num_K = 0;
+  uint64 base_id = 0, version_id = 0, num_r = 0, num_ids = 0;
+  real_t bias = 0;
+  bool ok = read_tag(file, &tag) && tag.compare(kDeltaTag) == 0 &&
+      read_tag(file, &score_func) &&
+      ReadDataFromDisk(file, (char*)&num_feat, sizeof(num_feat)) ==
+          sizeof(num_feat) &&
+      ReadDataFromDisk(file, (char*)&num_field, sizeof(num_field)) ==
+          sizeof(num_field) &&
+      ReadDataFromDisk(file, (char*)&num_K, sizeof(num_K)) ==
+          sizeof(num_K) &&
+      ReadDataFromDisk(file, (char*)&base_id, sizeof(base_id)) ==
+          sizeof(base_id) &&
+      ReadDataFromDisk(file, (char*)&version_id, sizeof(version_id)) ==
+          sizeof(version_id) &&
+      ReadDataFromDisk(file, (char*)&bias, sizeof(bias)) ==
+          sizeof(bias) &&
+      ReadDataFromDisk(file, (char*)&num_r, sizeof(num_r)) ==
+          sizeof(num_r);
+  if (!ok || score_func != score_func_ || num_feat != num_feat_ ||
+      num_field != num_field_ || num_K != num_K_ ||
+      base_id != version_id_ || base_id == 0 ||
+      num_r * aux_size_ != param_r_.size()) {
+    Close(file);
+    return false;
+  }
+  std::vector<real_t> field_weight(num_r);
+  ok = (num_r == 0 ||
+        ReadDataFromDisk(file, (char*)field_weight.data(),
+                         sizeof(real_t) * num_r) == sizeof(real_t) * num_r) &&
+       ReadDataFromDisk(file, (char*)&num_ids, sizeof(num_ids)) ==
+           sizeof(num_ids) && num_ids <= num_feat_;
+  std::vector<index_t> ids(ok ? num_ids : 0);
+  ok = ok && (num_ids == 0 ||
+              ReadDataFromDisk(file, (char*)ids.data(),
+                               sizeof(index_t) * num_ids) ==
+              sizeof(index_t) * num_ids);
+  index_t num_vec = delta_vectors();
+  uint64 row_size = 1 + (uint64)num_vec * num_K_;
+  for (size_t i = 0; ok && i < ids.size(); ++i) {
+    ok = ids[i] < num_feat_;
+  }
+  if (!ok || FileTell(file) + sizeof(real_t) * row_size * num_ids !=
+             file_size) {
+    Close(file);
+    return false;
+  }
+  std::vector<Model*> models(1, this);
+  models.insert(models.end(), replicas_.begin(), replicas_.end());
+  std::vector<real_t> value;
+  std::vector<real_t> latent(get_aligned_k(), 0);
+  for (size_t begin = 0; begin < ids.size(); begin += kSparseBlock) {
+    size_t end = std::min(begin + kSparseBlock, ids.size());
+    value.resize((end - begin) * row_size);
+    ReadDataFromDisk(file, (char*)value.data(),
+                     sizeof(real_t) * value.size());
+    const real_t* row = value.data();
+    for (size_t i = begin; i < end; ++i, row += row_size) {
+      index_t j = ids[i];
+      for (Model* model : models) {
+        model->param_w_[(offset_t)j * aux_size_] = row[0];
+        for (index_t f = 0; f < num_vec; ++f) {
+          model->set_latent_row((offset_t)j * num_vec + f,
+                                row + 1 + f * num_K_);
+        }
+      }
+    }
+  }
+  Close(file);
+  for (Model* model : models) {
+    model->param_b_[0] = bias;
+    for (uint64 i = 0; i < num_r; ++i) {
+      model->param_r_[i * aux_size_] = field_weight[i];
+    }
+    model->version_id_ = version_id;
+  }
+  return true;
+}
+
+// A used feature of the dense model has been updated by a row at
+// least once, so its linear term or gradient cache has changed.
+bool Model::is_used(index_t j) {
+  if (lazy_) { return touched_[j] != 0; }
+  const real_t* w = param_w_ + (offset_t)j * aux_size_;
+  if (w[0] != 0) { return true; }
+  for (index_t i = 1; i < aux_size_; ++i) {
+    if (w[i] != aux_value_) { return true; }
+  }
+  return false;
+}
+
+// In the file, the d-th block of kAlign weights of the field f is at
+// (f * aligned_k + d) * aux_size of the row, followed by its aux
+// blocks. ffm_pos() gives the block in memory, and its a-th aux
+// block is ffm_gap() after it.
+void Model::copy_latent(index_t j, real_t* row, bool to_file) {
+  offset_t k_aligned = get_aligned_k();
+  offset_t gap = ffm_gap();
+  offset_t first = (offset_t)j * num_field_;
+  for (index_t f = 0; f < num_field_; ++f) {
+    for (index_t d = 0; d < k_aligned; d += kAlign) {
+      real_t* v = param_v_ + ffm_pos(first + f, d);
+      real_t* q = row + (f * k_aligned + d) * aux_size_;
+      for (index_t a = 0; a < aux_size_; ++a) {
+        if (to_file) {
+          memcpy(q + a * kAlign, v + a * gap, kAlign * sizeof(real_t));
+        } else {
+          memcpy(v + a * gap, q + a * kAlign, kAlign * sizeof(real_t));
+        }
+      }
+    }
+  }
+}
+
+// The rows of each block are gathered into the buffer, so the
+// file is written (or read) by a few big calls. A block has w of
+// its features followed by their v.
+void Model::sparse_rows(FILE* file,
+                        const std::vector<index_t>& ids,
+                        bool save) {
+  offset_t size_v = param_num_v_ / num_feat_;
+  std::vector<real_t> buf;
+  for (size_t start = 0; start < ids.size(); start += kSparseBlock) {
+    size_t end = std::min(ids.size(), start + kSparseBlock);
+    for (int k = 0; k < (size_v > 0 ? 2 : 1); ++k) {
+      offset_t size = k == 0 ? aux_size_ : size_v;
+      real_t* param = k == 0 ? param_w_ : param_v_;
+      buf.resize((end - start) * size);
+      if (!save) {
+        ReadDataFromDisk(file, (char*)buf.data(),
+                         buf.size() * sizeof(real_t));
+      }
+      for (size_t i = start; i < end; ++i) {
+        real_t* row = param + ids[i] * size;
+        real_t* copy = buf.data() + (i - start) * size;
+        if (k == 1 && reorder_latent()) {
+          copy_latent(ids[i], copy, save);
+        } else if (save) {
+          memcpy(copy, row, size * sizeof(real_t));
+        } else {
+          memcpy(row, copy, size * sizeof(real_t));
+        }
+      }
+      if (save) {
+        WriteDataToDisk(file, (char*)buf.data(),
+                        buf.size() * sizeof(real_t));
+      }
+    }
+  }
+}
+
+// Serialize the used features to a sparse model file. The
+// header also keeps scale_ and aux_value_, which initialize
+// the other features after loading.
+void Model::SerializeSparse(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(field_index_.Empty());
+  std::vector<index_t> ids;
+  for (index_t j = 0; j < num_feat_; ++j) {
+    if (is_used(j)) { ids.push_back(j); }
+  }
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+#else
+  FILE *file = OpenFileOrDie(filename.c_str(), "wb");
+#endif
+  WriteStringToFile(file, std::string(kSparseTag));
+  WriteStringToFile(file, score_func_);
+  WriteStringToFile(file, loss_func_);
+  WriteDataToDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  WriteDataToDisk(file, (char*)&num_field_, sizeof(num_field_));
+  WriteDataToDisk(file, (char*)&num_K_, sizeof(num_K_));
+  WriteDataToDisk(file, (char*)&aux_size_, sizeof(aux_size_));
+  WriteDataToDisk(file, (char*)&scale_, sizeof(scale_));
+  WriteDataToDisk(file, (char*)&aux_value_, sizeof(aux_value_));
+  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t)*aux_size_);
+  // The ids of the used features, in ascending order
+  index_t num_ids = ids.size();
+  WriteDataToDisk(file, (char*)&num_ids, sizeof(num_ids));
+  if (num_ids > 0) {
+    WriteDataToDisk(file, (char*)ids.data(), sizeof(index_t)*num_ids);
+  }
+  this->sparse_rows(file, ids, true);
+  this->serialize_extra(file);
+  Close(file);
+}
+
+// Values of a block of the TXT model, which are formatted
+// by one thread (see SerializeToTXT).
+static const size_t kTxtBlockValues = 1 << 18;
+
+// Append the value in the format of std::ostream (%g), so the
+// file is the same as the one written by the stream.
+static inline void append_txt_value(std::string* buf, real_t value) {
+  char str[32];
+  int len = snprintf(str, sizeof(str), "%g", value);
+  buf->append(str, len);
+}
+
+// Append the lines of the features [begin, end) of the linear
+// term (latent = false) or the latent factor to buf.
+void Model::format_txt(bool latent, index_t begin, index_t end,
+                       std::string* buf) {
+  char str[64];
+  if (!latent) {
+    for (index_t j = begin; j < end; ++j) {
+      buf->append(str, snprintf(str, sizeof(str), "i_%u: ", j));
+      append_txt_value(buf, param_w_[(offset_t)j * aux_size_]);
+      buf->push_back('\n');
+    }
+    return;
+  }
+  index_t k_aligned = get_aligned_k();
+  if (score_func_.compare("ffm") != 0) {
+    for (index_t j = begin; j < end; ++j) {
+      const real_t* w = param_v_ + (offset_t)j * aux_size_ * k_aligned;
+      buf->append(str, snprintf(str, sizeof(str), "v_%u: ", j));
+      for (index_t d = 0; d < num_K_; ++d) {
+        append_txt_value(buf, w[d]);
+        if (d != num_K_-1) { buf->push_back(' '); }
+      }
+      buf->push_back('\n');
+    }
+  } else {
+    // The weights of ffm are found by ffm_pos(). The pairs
+    // out of the field index of the sparse model are zero, and
+    // so are the weights after the width of the vector.
+    for (index_t j = begin; j < end; ++j) {
+      for (index_t f = 0; f < num_field_; ++f) {
+        offset_t r = (offset_t)j * num_field_ + f;
+        index_t size = num_K_;
+        if (!field_index_.Empty()) { r = field_index_.Block(j, f); }
+        if (field_index_.HasWidths() && r != FieldIndex::kNoBlock) {
+          size = field_index_.Width(j, f) * kAlign;
+        }
+        buf->append(str, snprintf(str, sizeof(str), "v_%u_%u: ", j, f));
+        for (index_t d = 0; d < num_K_; ++d) {
+          append_txt_value(buf, r == FieldIndex::kNoBlock ||
+                                d >= size ? 0 :
+                                param_v_[ffm_pos(r, d)]);
+          if (d != num_K_-1) { buf->push_back(' '); }
+        }
+        buf->push_back('\n');
+      }
+    }
+  }
+}
+
+// Serialize current model to a TXT file. The features are split
+// into blocks, and the threads of pool_ format the blocks of each
+// round into their buffers, which are written in order, so the
+// file is the same for any number of threads.
+void Model::SerializeToTXT(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  CHECK(latent_type_ == kStoreFP32);
+  touch_all();
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  // bias term, which includes the offset of the negative
+  // sampling, so the TXT model gives the calibrated scores
+  std::string line("bias: ");
+  append_txt_value(&line, param_b_[0] + score_offset_);
+  line.push_back('\n');
+  WriteDataToDisk(file, line.data(), line.size());
+  size_t threads = pool_ == nullptr ? 1 : pool_->ThreadNumber();
+  std::vector<std::string> buf(threads);
+  bool has_latent = score_func_.compare("linear") != 0;
+  for (int section = 0; section < (has_latent ? 2 : 1); ++section) {
+    bool latent = section == 1;
+    size_t values = !latent ? 1 :
+        score_func_.compare("ffm") != 0 ? num_K_ : num_field_ * num_K_;
+    index_t block = std::max<size_t>(1, kTxtBlockValues / values);
+    for (index_t start = 0; start < num_feat_; ) {
+      index_t stop = (index_t)std::min<uint64>(num_feat_,
+                                 (uint64)start + (uint64)block * threads);
+      auto format = [&](size_t i) {
+        uint64 begin = std::min<uint64>(stop, (uint64)start + i * block);
+        uint64 end = std::min<uint64>(stop, begin + block);
+        buf[i].clear();
+        format_txt(latent, (index_t)begin, (index_t)end, &buf[i]);
+      };
+      if (threads > 1) {
+        pool_->ParallelFor(0, threads, 1, [&](size_t b, size_t e) {
+          for (size_t i = b; i < e; ++i) { format(i); }
+        });
+      } else {
+        format(0);
+      }
+      for (size_t i = 0; i < threads; ++i) {
+        if (!buf[i].empty()) {
+          WriteDataToDisk(file, buf[i].data(), buf[i].size());
+        }
+      }
+      start = stop;
+    }
+  }
+  // The field weights of fwfm, one line for each pair of fields
+  if (!param_r_.empty()) {
+    char str[64];
+    line.clear();
+    for (index_t f1 = 0; f1 < num_field_; ++f1) {
+      for (index_t f2 = f1; f2 < num_field_; ++f2) {
+        line.append(str, snprintf(str, sizeof(str), "r_%u_%u: ", f1, f2));
+        append_txt_value(&line, GetFieldWeight(f1, f2)[0]);
+        line.push_back('\n');
+      }
+    }
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+}
+
+// Copy the weights in the order of the TXT model
+void Model::GetWeights(real_t* linear, real_t* latent) {
+  CHECK_NOTNULL(linear);
+  CHECK(latent_type_ == kStoreFP32);
+  touch_all();
+  linear[0] = param_b_[0] + score_offset_;
+  for (index_t j = 0; j < num_feat_; ++j) {
+    linear[j+1] = param_w_[(offset_t)j * aux_size_];
+  }
+  if (latent == nullptr || param_v_ == nullptr) { return; }
+  std::vector<real_t> row(get_aligned_k());
+  // The sparse ffm model gives the zeros of the dense layout
+  // for the pairs out of its field index
+  if (!field_index_.Empty()) {
+    for (index_t j = 0; j < num_feat_; ++j) {
+      for (index_t f = 0; f < num_field_; ++f) {
+        real_t* dst = latent + ((offset_t)j * num_field_ + f) * num_K_;
+        offset_t b = field_index_.Block(j, f);
+        if (b == FieldIndex::kNoBlock) {
+          std::fill(dst, dst + num_K_, 0);
+          continue;
+        }
+        // The rows of kAlign values of the widths
+        index_t size = std::min(num_K_, field_index_.Width(j, f) *
+                                        get_row_k());
+        for (index_t d = 0; d < size; d += get_row_k()) {
+          get_latent_row(b++, row.data());
+          std::copy(row.begin(),
+                    row.begin() + std::min(get_row_k(), size - d),
+                    dst + d);
+        }
+        std::fill(dst + size, dst + num_K_, 0);
+      }
+    }
+    return;
+  }
+  offset_t num_row = get_num_row();
+  for (offset_t r = 0; r < num_row; ++r) {
+    get_latent_row(r, row.data());
+    std::copy(row.begin(), row.begin() + num_K_, latent + r * num_K_);
+  }
+}
+
+// Copy the linear term and the latent factors of each feature
+void Model::GetFeatures(const std::vector<index_t>& ids, real_t* value) {
+  CHECK_NOTNULL(value);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(!lazy_);
+  CHECK(field_index_.Empty());
+  offset_t size_v = param_num_v_ / num_feat_;
+  offset_t size = aux_size_ + size_v;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    index_t j = ids[i];
+    real_t* row = value + i * size;
+    if (j == num_feat_) {
+      memcpy(row, param_b_, aux_size_ * sizeof(real_t));
+      memset(row + aux_size_, 0, size_v * sizeof(real_t));
+      continue;
+    }
+    CHECK_LT(j, num_feat_);
+    memcpy(row, param_w_ + (offset_t)j * aux_size_,
+           aux_size_ * sizeof(real_t));
+    if (reorder_latent()) {
+      copy_latent(j, row + aux_size_, true);
+    } else if (size_v > 0) {
+      memcpy(row + aux_size_, param_v_ + j * size_v,
+             size_v * sizeof(real_t));
+    }
+  }
+}
+
+void Model::SetFeatures(const std::vector<index_t>& ids,
+                        const real_t* value) {
+  CHECK_NOTNULL(value);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(!lazy_);
+  CHECK(field_index_.Empty());
+  offset_t size_v = param_num_v_ / num_feat_;
+  offset_t size = aux_size_ + size_v;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    index_t j = ids[i];
+    const real_t* row = value + i * size;
+    if (j == num_feat_) {
+      memcpy(param_b_, row, aux_size_ * sizeof(real_t));
+      continue;
+    }
+    CHECK_LT(j, num_feat_);
+    memcpy(param_w_ + (offset_t)j * aux_size_, row,
+           aux_size_ * sizeof(real_t));
+    if (reorder_latent()) {
+      copy_latent(j, (real_t*)row + aux_size_, false);
+    } else if (size_v > 0) {
+      memcpy(param_v_ + j * size_v, row + aux_size_,
+             size_v * sizeof(real_t));
+    }
+  }
+}
+
+void Model::MapFeatures(SparseRow* row) const {
+  index_t none = field_map_.size();
+  for (SparseRow::iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    if (iter->feat_id < feature_map_.size()) {
+      iter->feat_id = feature_map_[iter->feat_id];
+    }
+    if (!field_map_.empty()) {
+      iter->field_id = iter->field_id < none ?
+                       field_map_[iter->field_id] : none;
+    }
+  }
+}
+
+void Model::MapFeatures(DMatrix* matrix) const {
+  if (feature_map_.empty() && field_map_.empty()) { return; }
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    if (matrix->row[i] != nullptr) { MapFeatures(matrix->row[i]); }
+  }
+}
+
+// Deserialize model from a checkpoint file
+bool Model::Deserialize(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+#else
+  FILE* file = OpenFileOrDie(filename.c_str(), "rb");
+#endif
+  if (file == NULL) { return false; }
+  // Read score function
+  ReadStringFromFile(file, score_func_);
+  // The field index of the sparse ffm model
+  field_index_.Clear();
+  bool shared = score_func_.compare(kSharedIndexTag) == 0 ||
+                score_func_.compare(kWidthSharedIndexTag) == 0;
+  bool widths = score_func_.compare(kWidthIndexTag) == 0 ||
+                score_func_.compare(kWidthSharedIndexTag) == 0;
+  if (shared || widths || score_func_.compare(kFieldIndexTag) == 0) {
+    if (!field_index_.Deserialize(file, shared, widths)) {
+      Close(file);
+      return false;
+    }
+    ReadStringFromFile(file, score_func_);
+  }
+  // The sparse model
+  if (score_func_.compare(kSparseTag) == 0) {
+    this->deserialize_sparse(file);
+    this->deserialize_extra(file);
+    Close(file);
+    return true;
+  }
+  // The inference model
+  if (score_func_.compare(kInferenceTag) == 0) {
+    this->deserialize_inference(file, filename);
+    this->deserialize_extra(file);
+    Close(file);
+    return true;
+  }
+  // Read loss function
+  ReadStringFromFile(file, loss_func_);
+  // Read feature num
+  ReadDataFromDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  // Read field num
+  ReadDataFromDisk(file, (char*)&num_field_, sizeof(num_field_));
+  // Read K
+  ReadDataFromDisk(file, (char*)&num_K_, sizeof(num_K_));
+  // Read aux_size
+  ReadDataFromDisk(file, (char*)&aux_size_, sizeof(aux_size_));
+  // Read w
+  this->deserialize_w_v_b(file);
+  this->deserialize_extra(file);
+  Close(file);
+  if (!this->verify_sections()) {
+    Color::print_error(
+      StringPrintf("The checksum of the model file does not match: %s",
+                   filename.c_str())
+    );
+    return false;
+  }
+  return true;
+}
+
+// The score offset is the log of the rate
+void Model::SetNegativeRate(real_t rate) {
+  CHECK_GT(rate, 0);
+  CHECK_LE(rate, 1);
+  neg_rate_ = rate;
+  score_offset_ = std::log(rate);
+}
+
+// Keep the best model in the file
+void Model::SetBestModelFile(const std::string& filename) {
+  CHECK(!has_best_);
+  CHECK(!filename.empty());
+  best_filename_ = filename;
+}
+
+// Take a record of the best model during training. The first record
+// copies the whole model (the features that have been used for the
+// lazy model), and the next records only copy the features changed
+// since the last one. The runs of these features are copied at once.
+void Model::SetBestModel() {
+  CHECK(latent_type_ == kStoreFP32);
+  if (!has_best_) {
+    try {
+      param_best_b_ = (real_t*)malloc(aux_size_ * sizeof(real_t));
+      if (!best_filename_.empty()) {
+        best_file_ = OpenFileOrDie(best_filename_.c_str(), "w+b");
+      } else {
+        param_best_w_ = (real_t*)malloc(param_num_w_*sizeof(real_t));
+        if (score_func_.compare("linear") != 0) {
+    #ifdef _MSC_VER
+          param_best_v_ = (decltype(param_best_v_))_aligned_malloc(
+          param_num_v_ * sizeof(real_t),
+          kAlignByte);
+    #else
+          int ret = posix_memalign(
+                    (void**)&param_best_v_,
+                    kAlignByte,
+                    param_num_v_ * sizeof(real_t));
+          CHECK_EQ(ret, 0);
+    #endif
+        }
+      }
+    } catch (std::bad_alloc&) {
+      LOG(FATAL) << "Cannot allocate enough memory for current  \
+                     model parameters. Parameter size: "
+                 << GetNumParameter();
+    }
+  }
+  bool full = !track_dirty_;
+  auto changed = [&](index_t j) {
+    return (full || dirty_[j] != 0) && (!lazy_ || touched_[j] != 0);
+  };
+  for (index_t j = 0; j < num_feat_; ) {
+    if (!changed(j)) { ++j; continue; }
+    index_t end = j + 1;
+    while (end < num_feat_ && changed(end)) { ++end; }
+    copy_best(j, end, true);
+    j = end;
+  }
+  if (lazy_) { best_touched_ = touched_; }
   memcpy(param_best_b_, param_b_, aux_size_*sizeof(real_t));
+  param_best_r_ = param_r_;
+  dirty_.assign(num_feat_, 0);
+  track_dirty_ = true;
+  has_best_ = true;
 }
 
 // Shrink back for getting the best model
 void Model::Shrink() {
-  // Copy best model parameters
-  if (param_best_w_ != nullptr) {
-    memcpy(param_w_, param_best_w_, param_num_w_*sizeof(real_t));
+  if (!has_best_) { return; }
+  // The features used after the best model go back to
+  // their initial value when they are touched again.
+  for (index_t j = 0; j < num_feat_; ) {
+    if (lazy_ && best_touched_[j] == 0) { ++j; continue; }
+    index_t end = j + 1;
+    while (end < num_feat_ && (!lazy_ || best_touched_[end] != 0)) {
+      ++end;
+    }
+    copy_best(j, end, false);
+    j = end;
   }
-  if (param_best_v_ != nullptr) {
-    memcpy(param_v_, param_best_v_, param_num_v_*sizeof(real_t));
+  if (lazy_) { touched_ = best_touched_; }
+  memcpy(param_b_, param_best_b_, aux_size_*sizeof(real_t));
+  param_r_ = param_best_r_;
+  // Nothing changed since the record
+  std::fill(dirty_.begin(), dirty_.end(), 0);
+}
+
+// The features [begin, end) are contiguous in w, and in v they are
+// the runs of latent_runs(). The best model has the same layout,
+// and its file keeps all of w and then all of v.
+void Model::copy_best(index_t begin, index_t end, bool save) {
+  offset_t size_w = aux_size_;
+  offset_t pos_w = (offset_t)begin * size_w;
+  size_t bytes_w = (end - begin) * size_w * sizeof(real_t);
+  if (best_file_ == nullptr) {
+    if (save) {
+      memcpy(param_best_w_ + pos_w, param_w_ + pos_w, bytes_w);
+    } else {
+      memcpy(param_w_ + pos_w, param_best_w_ + pos_w, bytes_w);
+    }
+    latent_runs(begin, end, [&](offset_t pos_v, offset_t size_v) {
+      if (size_v == 0) { return; }
+      size_t bytes_v = size_v * sizeof(real_t);
+      if (save) {
+        memcpy(param_best_v_ + pos_v, param_v_ + pos_v, bytes_v);
+      } else {
+        memcpy(param_v_ + pos_v, param_best_v_ + pos_v, bytes_v);
+      }
+    });
+    return;
   }
-  if (param_best_b_ != nullptr) {
-    memcpy(param_b_, param_best_b_, aux_size_*sizeof(real_t));
+  FileSeek(best_file_, pos_w * sizeof(real_t));
+  if (save) {
+    WriteDataToDisk(best_file_, (char*)(param_w_ + pos_w), bytes_w);
+  } else {
+    CHECK_EQ(ReadDataFromDisk(best_file_, (char*)(param_w_ + pos_w),
+                              bytes_w), bytes_w);
+  }
+  latent_runs(begin, end, [&](offset_t pos_v, offset_t size_v) {
+    if (size_v == 0) { return; }
+    size_t bytes_v = size_v * sizeof(real_t);
+    FileSeek(best_file_, (param_num_w_ + pos_v) * sizeof(real_t));
+    if (save) {
+      WriteDataToDisk(best_file_, (char*)(param_v_ + pos_v), bytes_v);
+    } else {
+      CHECK_EQ(ReadDataFromDisk(best_file_, (char*)(param_v_ + pos_v),
+                                bytes_v), bytes_v);
+    }
+  });
+}
+
+// Copy size bytes of src to the memory bound to the node, and
+// the memory is written after it is bound.
+static void* copy_to_node(const void* src, size_t size,
+                          int node, bool huge_page) {
+  void* dst = AllocAligned(size, kAlignByte, huge_page);
+  if (!BindMemory(dst, size, node)) {
+    LOG(WARNING) << "Cannot bind the model copy to NUMA node " << node;
+  }
+  memcpy(dst, src, size);
+  return dst;
+}
+
+void Model::Replicate(int num_nodes) {
+  CHECK(replicas_.empty());
+  CHECK_GT(num_nodes, 0);
+  offset_t num_row = score_func_.compare("linear") == 0 ?
+                     0 : get_num_row();
+  offset_t num_v = num_row * get_row_k();
+  for (int n = 0; n < num_nodes; ++n) {
+    Model* r = new Model();
+    r->score_func_ = score_func_;
+    r->loss_func_ = loss_func_;
+    r->param_num_w_ = param_num_w_;
+    r->param_num_v_ = param_num_v_;
+    r->num_feat_ = num_feat_;
+    r->num_field_ = num_field_;
+    r->num_K_ = num_K_;
+    r->aux_size_ = aux_size_;
+    r->field_index_ = field_index_;
+    r->split_ = split_;
+    r->field_major_ = field_major_;
+    r->scale_ = scale_;
+    r->neg_rate_ = neg_rate_;
+    r->score_offset_ = score_offset_;
+    r->feature_map_ = feature_map_;
+    r->field_map_ = field_map_;
+    r->latent_type_ = latent_type_;
+    r->opt_state_ = opt_state_;
+    r->huge_page_ = huge_page_;
+    r->param_w_ = (real_t*)copy_to_node(param_w_,
+                  param_num_w_ * sizeof(real_t), n, huge_page_);
+    r->param_b_ = (real_t*)malloc(aux_size_ * sizeof(real_t));
+    memcpy(r->param_b_, param_b_, aux_size_ * sizeof(real_t));
+    r->param_r_ = param_r_;
+    if (param_v_ != nullptr) {
+      r->param_v_ = (real_t*)copy_to_node(param_v_,
+                    param_num_v_ * sizeof(real_t), n, huge_page_);
+    }
+    if (param_v_half_ != nullptr) {
+      r->param_v_half_ = (uint16*)copy_to_node(param_v_half_,
+                         num_v * sizeof(uint16), n, huge_page_);
+    }
+    if (param_v_int8_ != nullptr) {
+      r->param_v_int8_ = (int8*)copy_to_node(param_v_int8_,
+                         num_v * sizeof(int8), n, huge_page_);
+      r->param_v_scale_ = (real_t*)malloc(num_row * sizeof(real_t));
+      memcpy(r->param_v_scale_, param_v_scale_,
+             num_row * sizeof(real_t));
+    }
+    replicas_.push_back(r);
+  }
+}
+
+// Parameters of each task of SyncReplicas()
+static const size_t kSyncGrain = 64 * 1024;
+
+void Model::SyncReplicas() {
+  if (replicas_.empty()) { return; }
+  CHECK(latent_type_ == kStoreFP32);
+  real_t scale = 1.0f / replicas_.size();
+  auto average = [&](real_t* (*get)(Model*), offset_t size) {
+    if (size == 0 || get(this) == nullptr) { return; }
+    auto run = [&](size_t begin, size_t end) {
+      real_t* dst = get(this);
+      for (size_t j = begin; j < end; ++j) {
+        real_t sum = 0;
+        for (size_t n = 0; n < replicas_.size(); ++n) {
+          sum += get(replicas_[n])[j];
+        }
+        dst[j] = sum * scale;
+        for (size_t n = 0; n < replicas_.size(); ++n) {
+          get(replicas_[n])[j] = dst[j];
+        }
+      }
+    };
+    if (pool_ == nullptr || size <= kSyncGrain) {
+      run(0, size);
+    } else {
+      pool_->ParallelFor(0, size, kSyncGrain, run);
+    }
+  };
+  average([](Model* m) { return m->param_w_; }, param_num_w_);
+  average([](Model* m) { return m->param_v_; }, param_num_v_);
+  average([](Model* m) { return m->param_b_; }, (offset_t)aux_size_);
+  average([](Model* m) { return m->param_r_.data(); },
+          param_r_.size());
+}
+
+// Each latent vector (feature for fm and feature-field for ffm)
+// becomes a row of aligned_k values in the compact layout: for ffm
+// the aux blocks between the blocks of w (or after the w of the
+// split layout) are squeezed out, and for fm the aux vectors after
+// w are dropped.
+offset_t Model::get_num_row() {
+  return param_num_v_ / (aux_size_ * get_row_k());
+}
+
+// Copy the w of the r-th latent vector to the row buffer.
+void Model::get_latent_row(offset_t r, real_t* row) {
+  index_t k_aligned = get_row_k();
+  const real_t* w = param_v_ + r * k_aligned * aux_size_;
+  bool is_ffm = score_func_.compare("ffm") == 0;
+  for (index_t d = 0; d < k_aligned; ++d) {
+    row[d] = is_ffm ? param_v_[ffm_pos(r, d)] : w[d];
+  }
+}
+
+void Model::set_latent_row(offset_t r, const real_t* row) {
+  index_t k_aligned = get_row_k();
+  real_t* w = param_v_ + r * k_aligned * aux_size_;
+  bool is_ffm = score_func_.compare("ffm") == 0;
+  for (index_t d = 0; d < std::min(num_K_, k_aligned); ++d) {
+    if (is_ffm) {
+      param_v_[ffm_pos(r, d)] = row[d];
+    } else {
+      w[d] = row[d];
+    }
+  }
+}
+
+// The kept pairs of ffm are copied to a new array in the order of
+// their blocks, which is the interleaved layout of the sparse model.
+offset_t Model::Prune(real_t threshold) {
+  CHECK_GT(threshold, 0);
+  CHECK(latent_type_ == kStoreFP32);
+  CHECK(!IsMapped());
+  CHECK(replicas_.empty());
+  // The kept pairs of the widths would need their own index
+  CHECK(!field_index_.HasWidths());
+  if (score_func_.compare("linear") == 0) { return 0; }
+  Densify();
+  index_t k_aligned = get_aligned_k();
+  real_t limit = threshold * threshold;
+  std::vector<real_t> row(k_aligned);
+  auto norm = [&](offset_t r) {
+    get_latent_row(r, row.data());
+    real_t sum = 0;
+    for (index_t d = 0; d < k_aligned; ++d) { sum += row[d] * row[d]; }
+    return sum;
+  };
+  auto is_small = [&](offset_t r) { return norm(r) < limit; };
+  offset_t pruned = 0;
+  if (score_func_.compare("ffm") != 0) {
+    for (index_t j = 0; j < num_feat_; ++j) {
+      if (!is_small(j)) { continue; }
+      memset(param_v_ + (offset_t)j * k_aligned * aux_size_, 0,
+             k_aligned * sizeof(real_t));
+      pruned++;
+    }
+    return pruned;
+  }
+  CHECK(!IsShared());
+  FieldIndex index;
+  std::vector<offset_t> kept;
+  // The largest pair is kept if all of them are small,
+  // since the files have no empty array of v
+  index_t max_j = 0, max_f = 0;
+  offset_t max_r = FieldIndex::kNoBlock;
+  real_t max_norm = -1;
+  for (index_t j = 0; j < num_feat_; ++j) {
+    // The fields of a shared feature are kept (or pruned) together
+    // and still share one block
+    bool shared = field_index_.IsShared(j);
+    if (shared) { index.Share(j); }
+    for (index_t f = 0; f < num_field_; ++f) {
+      offset_t r = field_index_.Empty() ? (offset_t)j * num_field_ + f :
+                   field_index_.Block(j, f);
+      if (r == FieldIndex::kNoBlock) { continue; }
+      real_t sum = norm(r);
+      if (sum < limit) {
+        if (sum > max_norm) {
+          max_j = j;
+          max_f = f;
+          max_r = r;
+          max_norm = sum;
+        }
+        pruned++;
+        continue;
+      }
+      index.Set(j, f);
+      if (!shared || kept.empty() || kept.back() != r) { kept.push_back(r); }
+    }
+  }
+  if (kept.empty() && max_r != FieldIndex::kNoBlock) {
+    index.Set(max_j, max_f);
+    kept.push_back(max_r);
+    pruned--;
+  }
+  index.Build(num_feat_, num_field_);
+  CHECK_EQ(index.NumBlocks(), kept.size());
+  offset_t size = (offset_t)k_aligned * aux_size_;
+  real_t* v = (real_t*)alloc_param(std::max(kept.size() * size,
+                                            (offset_t)kAlign) *
+                                   sizeof(real_t));
+  offset_t gap = ffm_gap();
+  for (offset_t b = 0; b < kept.size(); ++b) {
+    for (index_t d = 0; d < k_aligned; ++d) {
+      real_t* q = v + (b * k_aligned + d - d % kAlign) * aux_size_ +
+                  d % kAlign;
+      const real_t* p = param_v_ + ffm_pos(kept[b], d);
+      for (index_t a = 0; a < aux_size_; ++a) {
+        q[a * kAlign] = p[a * gap];
+      }
+    }
+  }
+  // The array in the file of SetParamFile() is removed with the model
+  if (!in_param_file(param_v_)) { free_aligned(param_v_); }
+  param_v_ = v;
+  field_index_ = index;
+  // The layouts of the dense ffm are off for the field index
+  this->set_num_param();
+  free_best();
+  return pruned;
+}
+
+// Quantize a row of k values to int8, and return the
+// scale, which is max(|w|) / 127, where w = q * scale.
+static real_t quantize_row(const real_t* row, index_t k, int8* q) {
+  real_t max_abs = 0;
+  for (index_t d = 0; d < k; ++d) {
+    max_abs = std::max(max_abs, std::abs(row[d]));
+  }
+  real_t scale = max_abs > 0 ? max_abs / 127 : 1.0;
+  for (index_t d = 0; d < k; ++d) {
+    q[d] = (int8)std::round(row[d] / scale);
+  }
+  return scale;
+}
+
+// Convert the latent factors to the compact storage type.
+void Model::ConvertLatent(StorageType type) {
+  CHECK(latent_type_ == kStoreFP32);
+  touch_all();
+  if (type == kStoreFP32 || param_v_ == nullptr) {
+    return;
+  }
+  // The compact kernels only read the dense layout of ffm
+  CHECK(field_index_.Empty());
+  index_t k_aligned = get_aligned_k();
+  offset_t num_row = get_num_row();
+  offset_t num_v = num_row * k_aligned;
+  if (type == kStoreInt8) {
+    param_v_int8_ = (int8*)alloc_param(num_v * sizeof(int8));
+    param_v_scale_ = (real_t*)malloc(num_row * sizeof(real_t));
+  } else {
+    param_v_half_ = (uint16*)alloc_param(num_v * sizeof(uint16));
+  }
+  std::vector<real_t> row(k_aligned);
+  for (offset_t r = 0; r < num_row; ++r) {
+    get_latent_row(r, row.data());
+    if (type == kStoreInt8) {
+      param_v_scale_[r] = quantize_row(row.data(), k_aligned,
+                                       param_v_int8_ + r * k_aligned);
+    } else {
+      uint16* h = param_v_half_ + r * k_aligned;
+      for (index_t d = 0; d < k_aligned; ++d) {
+        h[d] = FloatTo16(row[d], type);
+      }
+    }
+  }
+  if (!in_mapped(param_v_) && !in_shared(param_v_) &&
+      !in_param_file(param_v_)) {
+    free_aligned(param_v_);
+  }
+  param_v_ = nullptr;
+  latent_type_ = type;
+}
+
+// Serialize the model for prediction. Only the model is written,
+// so the size of linear term and bias always equals aux_size = 1.
+void Model::SerializeInference(const std::string& filename,
+                               StorageType type) {
+  CHECK_NE(filename.empty(), true);
+  // A compact model can only be written in its own type
+  if (latent_type_ != kStoreFP32) {
+    CHECK(type == latent_type_);
+  }
+  // The sparse ffm model is only written in fp32
+  CHECK(type == kStoreFP32 || field_index_.Empty());
+  touch_all();
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+#else
+  FILE *file = OpenFileOrDie(filename.c_str(), "wb");
+#endif
+  if (!field_index_.Empty()) {
+    WriteStringToFile(file, std::string(field_index_tag(field_index_)));
+    field_index_.Serialize(file);
   }
+  WriteStringToFile(file, std::string(kInferenceTag));
+  WriteStringToFile(file, score_func_);
+  WriteStringToFile(file, loss_func_);
+  WriteDataToDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  WriteDataToDisk(file, (char*)&num_field_, sizeof(num_field_));
+  WriteDataToDisk(file, (char*)&num_K_, sizeof(num_K_));
+  index_t store = type | kAlignedLayout;
+  WriteDataToDisk(file, (char*)&store, sizeof(store));
+  // Write w and b
+  write_padding(file);
+  for (offset_t i = 0; i < param_num_w_; i += aux_size_) {
+    WriteDataToDisk(file, (char*)(param_w_ + i), sizeof(real_t));
+  }
+  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t));
+  // Write v
+  if (score_func_.compare("linear") != 0) {
+    index_t k_aligned = get_row_k();
+    offset_t num_row = get_num_row();
+    offset_t num_v = num_row * k_aligned;
+    write_padding(file);
+    if (latent_type_ == kStoreFP16 || latent_type_ == kStoreBF16) {
+      WriteDataToDisk(file, (char*)param_v_half_,
+                      sizeof(uint16) * num_v);
+    } else if (latent_type_ == kStoreInt8) {
+      WriteDataToDisk(file, (char*)param_v_int8_, sizeof(int8) * num_v);
+      write_padding(file);
+      WriteDataToDisk(file, (char*)param_v_scale_,
+                      sizeof(real_t) * num_row);
+    } else {
+      // Compact the fp32 model row by row
+      std::vector<real_t> row(k_aligned);
+      std::vector<uint16> h(k_aligned);
+      std::vector<int8> q(k_aligned);
+      std::vector<real_t> scale;
+      for (offset_t r = 0; r < num_row; ++r) {
+        get_latent_row(r, row.data());
+        if (type == kStoreFP32) {
+          WriteDataToDisk(file, (char*)row.data(),
+                          sizeof(real_t) * k_aligned);
+        } else if (type == kStoreInt8) {
+          scale.push_back(quantize_row(row.data(), k_aligned, q.data()));
+          WriteDataToDisk(file, (char*)q.data(), sizeof(int8) * k_aligned);
+        } else {
+          for (index_t d = 0; d < k_aligned; ++d) {
+            h[d] = FloatTo16(row[d], type);
+          }
+          WriteDataToDisk(file, (char*)h.data(),
+                          sizeof(uint16) * k_aligned);
+        }
+      }
+      if (type == kStoreInt8) {
+        write_padding(file);
+        WriteDataToDisk(file, (char*)scale.data(),
+                        sizeof(real_t) * num_row);
+      }
+    }
+  }
+  this->serialize_extra(file, true);
+  Close(file);
 }
 
-// Serialize w,v,b to disk file
+// Deserialize the inference model, where the tag has been read.
+void Model::deserialize_inference(FILE* file, const std::string& filename) {
+  ReadStringFromFile(file, score_func_);
+  ReadStringFromFile(file, loss_func_);
+  ReadDataFromDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  ReadDataFromDisk(file, (char*)&num_field_, sizeof(num_field_));
+  ReadDataFromDisk(file, (char*)&num_K_, sizeof(num_K_));
+  index_t store = 0;
+  ReadDataFromDisk(file, (char*)&store, sizeof(store));
+  bool aligned = (store & kAlignedLayout) != 0;
+  store &= ~kAlignedLayout;
+  CHECK_LE(store, kStoreInt8);
+  aux_size_ = 1;
+  split_ = false;
+  field_major_ = false;
+  param_num_w_ = num_feat_;
+  offset_t num_row = 0;
+  if (score_func_.compare("fm") == 0 ||
+      score_func_.compare("fwfm") == 0) {
+    num_row = num_feat_;
+  } else if (score_func_.compare("ffm") == 0) {
+    num_row = field_index_.Empty() ? (offset_t)num_feat_ * num_field_ :
+              field_index_.NumBlocks();
+  }
+  if (!field_index_.Empty()) {
+    CHECK_EQ(score_func_.compare("ffm"), 0);
+    CHECK_EQ(field_index_.NumFeature(), num_feat_);
+    CHECK_EQ(field_index_.NumField(), num_field_);
+  }
+  param_num_v_ = num_row * get_row_k();
+  latent_type_ = (StorageType)store;
+  // The memory policy needs the model in its own memory
+  if (aligned && !huge_page_ && numa_ != kNumaInterleave &&
+      map_inference(file, filename, num_row)) {
+    return;
+  }
+  if (aligned) { skip_padding(file); }
+  if (latent_type_ == kStoreFP32) {
+    this->initial(false);
+  } else {
+    // The fp32 latent factor is not allocated
+    cap_feat_ = num_feat_;
+    param_w_ = (real_t*)alloc_param(param_num_w_ * sizeof(real_t));
+    param_b_ = (real_t*)malloc(sizeof(real_t));
+  }
+  ReadDataFromDisk(file, (char*)param_w_, sizeof(real_t) * param_num_w_);
+  ReadDataFromDisk(file, (char*)param_b_, sizeof(real_t));
+  if (score_func_.compare("linear") == 0) {
+    return;
+  }
+  if (aligned) { skip_padding(file); }
+  if (latent_type_ == kStoreFP32) {
+    ReadDataFromDisk(file, (char*)param_v_,
+                     sizeof(real_t) * param_num_v_);
+  } else if (latent_type_ == kStoreInt8) {
+    param_v_int8_ = (int8*)alloc_param(param_num_v_ * sizeof(int8));
+    param_v_scale_ = (real_t*)malloc(num_row * sizeof(real_t));
+    ReadDataFromDisk(file, (char*)param_v_int8_,
+                     sizeof(int8) * param_num_v_);
+    if (aligned) { skip_padding(file); }
+    ReadDataFromDisk(file, (char*)param_v_scale_,
+                     sizeof(real_t) * num_row);
+  } else {
+    param_v_half_ = (uint16*)alloc_param(
+                    param_num_v_ * sizeof(uint16));
+    ReadDataFromDisk(file, (char*)param_v_half_,
+                     sizeof(uint16) * param_num_v_);
+  }
+}
+
+// The arrays of the aligned inference file are:
+//
+//   [padding] w (num_feat floats) b (1 float)
+//   [padding] v (num_row * k_aligned of the storage type)
+//   [padding] scale (num_row floats, only for int8)
+//
+// where each padding goes to the next kAlignByte of the file, and
+// the mapping starts at a page, so the arrays are aligned in memory
+// just like alloc_param(). Only the bias is copied to its own
+// memory. The pages are loaded by their first use, so the mapping
+// takes no time, and the untouched parts never take memory.
+bool Model::map_inference(FILE* file,
+                          const std::string& filename,
+                          offset_t num_row) {
+  std::unique_ptr<MappedFile> mapped(new MappedFile());
+  if (!mapped->Map(filename)) { return false; }
+  uint64 pos_w = align_pos(FileTell(file));
+  uint64 pos_b = pos_w + param_num_w_ * sizeof(real_t);
+  uint64 end = pos_b + sizeof(real_t);
+  uint64 pos_v = 0, pos_scale = 0;
+  if (score_func_.compare("linear") != 0) {
+    pos_v = align_pos(end);
+    if (latent_type_ == kStoreFP32) {
+      end = pos_v + param_num_v_ * sizeof(real_t);
+    } else if (latent_type_ == kStoreInt8) {
+      pos_scale = align_pos(pos_v + param_num_v_ * sizeof(int8));
+      end = pos_scale + num_row * sizeof(real_t);
+    } else {
+      end = pos_v + param_num_v_ * sizeof(uint16);
+    }
+  }
+  if (end > mapped->size()) {
+    LOG(FATAL) << "The model file " << filename << " is truncated.";
+  }
+  char* data = const_cast<char*>(mapped->data());
+  param_w_ = (real_t*)(data + pos_w);
+  param_b_ = (real_t*)malloc(sizeof(real_t));
+  memcpy(param_b_, data + pos_b, sizeof(real_t));
+  if (score_func_.compare("linear") != 0) {
+    if (latent_type_ == kStoreFP32) {
+      param_v_ = (real_t*)(data + pos_v);
+    } else if (latent_type_ == kStoreInt8) {
+      param_v_int8_ = (int8*)(data + pos_v);
+      param_v_scale_ = (real_t*)(data + pos_scale);
+    } else {
+      param_v_half_ = (uint16*)(data + pos_v);
+    }
+  }
+  // The optional items are read from the file after the arrays
+  FileSeek(file, end);
+  mapped_ = std::move(mapped);
+  return true;
+}
+
+// The sparse model is loaded as a lazy model, whose used
+// features are touched, so only their memory is written.
+void Model::deserialize_sparse(FILE* file) {
+  ReadStringFromFile(file, score_func_);
+  ReadStringFromFile(file, loss_func_);
+  ReadDataFromDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  ReadDataFromDisk(file, (char*)&num_field_, sizeof(num_field_));
+  ReadDataFromDisk(file, (char*)&num_K_, sizeof(num_K_));
+  ReadDataFromDisk(file, (char*)&aux_size_, sizeof(aux_size_));
+  ReadDataFromDisk(file, (char*)&scale_, sizeof(scale_));
+  ReadDataFromDisk(file, (char*)&aux_value_, sizeof(aux_value_));
+  this->set_num_param();
+  this->initial(false);
+  ReadDataFromDisk(file, (char*)param_b_, sizeof(real_t)*aux_size_);
+  index_t num_ids = 0;
+  ReadDataFromDisk(file, (char*)&num_ids, sizeof(num_ids));
+  CHECK_LE(num_ids, num_feat_);
+  std::vector<index_t> ids(num_ids);
+  if (num_ids > 0) {
+    ReadDataFromDisk(file, (char*)ids.data(), sizeof(index_t)*num_ids);
+  }
+  lazy_ = true;
+  touched_.assign(num_feat_, 0);
+  for (index_t i = 0; i < num_ids; ++i) {
+    CHECK_LT(ids[i], num_feat_);
+    touched_[ids[i]] = 1;
+  }
+  this->sparse_rows(file, ids, false);
+}
+
+bool Model::in_mapped(const void* ptr) {
+  if (mapped_ == nullptr || ptr == nullptr) { return false; }
+  const char* p = (const char*)ptr;
+  return p >= mapped_->data() && p < mapped_->data() + mapped_->size();
+}
+
+bool Model::in_param_file(const void* ptr) {
+  if (param_file_ == nullptr || ptr == nullptr) { return false; }
+  const char* p = (const char*)ptr;
+  return p >= param_file_->data() &&
+         p < param_file_->data() + param_file_->size();
+}
+
+bool Model::in_shared(const void* ptr) {
+  if (shared_ == nullptr || ptr == nullptr) { return false; }
+  const char* p = (const char*)ptr;
+  return p >= shared_ && p < shared_ + shared_size_;
+}
+
+// Serialize w,v,b to disk file. The sizes of w and v are
+// still written in index_t to keep the checkpoint format, so
+// they only keep the low 32 bits of a big model, and the real
+// sizes are calculated from the header by set_num_param().
 void Model::serialize_w_v_b(FILE* file) {
   // Write size of w
-  WriteDataToDisk(file, (char*)&param_num_w_, sizeof(param_num_w_));
+  index_t num_w = (index_t)param_num_w_;
+  WriteDataToDisk(file, (char*)&num_w, sizeof(num_w));
   // Write size of v
   if (score_func_.compare("linear") != 0) {
-    WriteDataToDisk(file, (char*)&param_num_v_, sizeof(param_num_v_));
+    index_t num_v = (index_t)param_num_v_;
+    WriteDataToDisk(file, (char*)&num_v, sizeof(num_v));
   }
-  // Write w
-  WriteDataToDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
-  // Write b
-  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t)*aux_size_);
-  // Write v
-  if (score_func_.compare("linear") != 0) {
-    WriteDataToDisk(file, (char*)param_v_, sizeof(real_t)*param_num_v_);
+  // Write w, b and v, which is interleaved and feature-major in the file
+  section_hash_.clear();
+  hash_bytes_ = section_bytes_ == 0 ? kFileSection : section_bytes_;
+  this->io_sections(file, true, checksum_ ? &section_hash_ : nullptr);
+}
+
+// The sections are in the order of the file, and the sections of
+// w and b are the same for every layout, as those of v are.
+std::vector<Model::FileSection> Model::file_sections(uint64 bytes) {
+  std::vector<FileSection> sections;
+  uint64 pos = 0;
+  // Add the sections of an array of num values
+  auto add = [&](real_t* data, offset_t num) {
+    offset_t step = std::max((offset_t)1, (offset_t)(bytes / sizeof(real_t)));
+    for (offset_t i = 0; i < num; i += step) {
+      uint64 size = std::min(step, num - i) * sizeof(real_t);
+      sections.push_back({pos, size, data + i, 0, 0});
+      pos += size;
+    }
+  };
+  add(param_w_, param_num_w_);
+  add(param_b_, aux_size_);
+  if (score_func_.compare("linear") == 0 || param_num_v_ == 0) {
+    return sections;
+  }
+  if (num_feat_ == 0 || param_num_v_ % num_feat_ != 0) {
+    add(param_v_, param_num_v_);
+    return sections;
+  }
+  offset_t size_v = param_num_v_ / num_feat_;
+  uint64 feat_bytes = size_v * sizeof(real_t);
+  index_t step = (index_t)std::max((uint64)1, bytes / feat_bytes);
+  for (index_t j = 0; j < num_feat_; j += step) {
+    index_t end = j + std::min(step, num_feat_ - j);
+    real_t* data = reorder_latent() ? nullptr : param_v_ + j * size_v;
+    sections.push_back({pos, (end - j) * feat_bytes, data, j, end});
+    pos += (end - j) * feat_bytes;
+  }
+  return sections;
+}
+
+// Each thread of pool_ writes or reads its sections by pwrite() and
+// pread() at their offsets from the start of w, and the reordered
+// latent factors are moved through a buffer of the thread. Without
+// the pool (and on Windows), the sections are written or read in
+// order at the position of the file, so the file is the same.
+void Model::io_sections(FILE* file, bool save, std::vector<uint64>* hash) {
+  std::vector<FileSection> sections = file_sections(
+      section_bytes_ == 0 ? kFileSection : section_bytes_);
+  if (hash != nullptr) { hash->assign(sections.size(), 0); }
+  offset_t size_v = reorder_latent() ? param_num_v_ / num_feat_ : 0;
+  auto run = [&](size_t begin, size_t end, bool at, uint64 base) {
+    std::vector<real_t> buf;
+    for (size_t s = begin; s < end; ++s) {
+      const FileSection& section = sections[s];
+      real_t* data = section.data;
+      if (data == nullptr) {
+        buf.resize(section.size / sizeof(real_t));
+        data = buf.data();
+        for (index_t j = section.begin; save && j < section.end; ++j) {
+          copy_latent(j, data + (j - section.begin) * size_v, true);
+        }
+      }
+#ifndef _MSC_VER
+      if (at && save) {
+        WriteDataAt(file, (char*)data, section.size, base + section.pos);
+      } else if (at) {
+        ReadDataAt(file, (char*)data, section.size, base + section.pos);
+      } else
+#endif
+      if (save) {
+        WriteDataToDisk(file, (char*)data, section.size);
+      } else {
+        ReadDataFromDisk(file, (char*)data, section.size);
+      }
+      if (!save && section.data == nullptr) {
+        for (index_t j = section.begin; j < section.end; ++j) {
+          copy_latent(j, data + (j - section.begin) * size_v, false);
+        }
+      }
+      if (hash != nullptr) {
+        (*hash)[s] = section_checksum(s, (char*)data, section.size);
+      }
+    }
+  };
+#ifndef _MSC_VER
+  if (pool_ != nullptr && pool_->ThreadNumber() > 1 && sections.size() > 1) {
+    if (save) { fflush(file); }
+    uint64 base = FileTell(file);
+    pool_->ParallelFor(0, sections.size(), 1,
+      [&](size_t begin, size_t end) { run(begin, end, true, base); });
+    const FileSection& last = sections.back();
+    FileSeek(file, base + last.pos + last.size);
+    return;
+  }
+#endif
+  run(0, sections.size(), false, 0);
+}
+
+// The checksum is computed from the memory after the model is read,
+// which has the same bytes as the file, so the reading does not have
+// to know the bytes of the sections before the item at the end.
+bool Model::verify_sections() {
+  if (section_hash_.empty()) { return true; }
+  std::vector<FileSection> sections = file_sections(hash_bytes_);
+  std::vector<uint64> hash(sections.size(), 0);
+  offset_t size_v = reorder_latent() ? param_num_v_ / num_feat_ : 0;
+  auto run = [&](size_t begin, size_t end) {
+    std::vector<real_t> buf;
+    for (size_t s = begin; s < end; ++s) {
+      const FileSection& section = sections[s];
+      real_t* data = section.data;
+      if (data == nullptr) {
+        buf.resize(section.size / sizeof(real_t));
+        data = buf.data();
+        for (index_t j = section.begin; j < section.end; ++j) {
+          copy_latent(j, data + (j - section.begin) * size_v, true);
+        }
+      }
+      hash[s] = section_checksum(s, (char*)data, section.size);
+    }
+  };
+  if (pool_ != nullptr && sections.size() > 1) {
+    pool_->ParallelFor(0, sections.size(), 1, run);
+  } else {
+    run(0, sections.size());
+  }
+  bool match = hash == section_hash_;
+  section_hash_.clear();
+  return match;
+}
+
+// Each optional item is a tag followed by its value, and the
+// rate of the negative sampling is only written if it is not 1,
+// so the model file is the same as before without sampling. The
+// same goes for the epoch, which is only set in the checkpoints.
+// The field weights are the first item, which fwfm always has.
+void Model::serialize_extra(FILE* file, bool inference) {
+  if (!param_r_.empty()) {
+    WriteStringToFile(file, std::string(kFieldWeightTag));
+    index_t aux = inference ? 1 : aux_size_;
+    std::vector<real_t> value;
+    for (size_t i = 0; i < param_r_.size(); i += aux_size_) {
+      value.insert(value.end(), param_r_.begin() + i,
+                   param_r_.begin() + i + aux);
+    }
+    uint64 size = value.size();
+    WriteDataToDisk(file, (char*)&size, sizeof(size));
+    WriteDataToDisk(file, (char*)value.data(), sizeof(real_t) * size);
+  }
+  if (neg_rate_ != 1.0) {
+    WriteStringToFile(file, std::string(kNegRateTag));
+    WriteDataToDisk(file, (char*)&neg_rate_, sizeof(neg_rate_));
+  }
+  if (opt_state_ != kStoreFP32 && !inference) {
+    WriteStringToFile(file, std::string(kOptStateTag));
+    int32 type = opt_state_;
+    WriteDataToDisk(file, (char*)&type, sizeof(type));
+  }
+  if (epoch_ > 0) {
+    WriteStringToFile(file, std::string(kEpochTag));
+    WriteDataToDisk(file, (char*)&epoch_, sizeof(epoch_));
+  }
+  if (!feature_map_.empty()) {
+    WriteStringToFile(file, std::string(kFeatureMapTag));
+    uint64 size = feature_map_.size();
+    WriteDataToDisk(file, (char*)&size, sizeof(size));
+    WriteDataToDisk(file, (char*)feature_map_.data(),
+                    sizeof(index_t) * size);
+  }
+  if (!field_map_.empty()) {
+    WriteStringToFile(file, std::string(kFieldMapTag));
+    uint64 size = field_map_.size();
+    WriteDataToDisk(file, (char*)&size, sizeof(size));
+    WriteDataToDisk(file, (char*)field_map_.data(),
+                    sizeof(index_t) * size);
+  }
+  // The version is the last item, which the older versions skip
+  if (version_id_ != 0) {
+    WriteStringToFile(file, std::string(kVersionTag));
+    WriteDataToDisk(file, (char*)&version_id_, sizeof(version_id_));
+  }
+  // The checksum is after the version, so the versions that do not
+  // know it still read the version
+  if (!section_hash_.empty() && !inference) {
+    WriteStringToFile(file, std::string(kChecksumTag));
+    uint64 size = section_hash_.size();
+    WriteDataToDisk(file, (char*)&hash_bytes_, sizeof(hash_bytes_));
+    WriteDataToDisk(file, (char*)&size, sizeof(size));
+    WriteDataToDisk(file, (char*)section_hash_.data(),
+                    sizeof(uint64) * size);
+  }
+}
+
+// Read the optional items until the end of file,
+// and the unknown items stop the reading.
+void Model::deserialize_extra(FILE* file) {
+  SetNegativeRate(1.0);
+  epoch_ = 0;
+  version_id_ = 0;
+  opt_state_ = kStoreFP32;
+  feature_map_.clear();
+  field_map_.clear();
+  param_r_.clear();
+  section_hash_.clear();
+  for (;;) {
+    size_t len = 0;
+    if (ReadDataFromDisk(file, (char*)&len, sizeof(len)) != sizeof(len) ||
+        len == 0 || len > 256) {
+      return;
+    }
+    std::string tag(len, '\0');
+    if (ReadDataFromDisk(file, &tag[0], len) != len) { return; }
+    if (tag.compare(kNegRateTag) == 0) {
+      real_t rate = 0;
+      if (ReadDataFromDisk(file, (char*)&rate, sizeof(rate)) !=
+          sizeof(rate) || !(rate > 0 && rate <= 1)) {
+        return;
+      }
+      SetNegativeRate(rate);
+    } else if (tag.compare(kOptStateTag) == 0) {
+      int32 type = 0;
+      if (ReadDataFromDisk(file, (char*)&type, sizeof(type)) !=
+          sizeof(type) || type < kStoreFP32 || type > kStoreInt8) {
+        return;
+      }
+      opt_state_ = (StorageType)type;
+    } else if (tag.compare(kEpochTag) == 0) {
+      int epoch = 0;
+      if (ReadDataFromDisk(file, (char*)&epoch, sizeof(epoch)) !=
+          sizeof(epoch) || epoch < 0) {
+        return;
+      }
+      epoch_ = epoch;
+    } else if (tag.compare(kVersionTag) == 0) {
+      uint64 id = 0;
+      if (ReadDataFromDisk(file, (char*)&id, sizeof(id)) != sizeof(id)) {
+        return;
+      }
+      version_id_ = id;
+    } else if (tag.compare(kFeatureMapTag) == 0) {
+      uint64 size = 0;
+      if (ReadDataFromDisk(file, (char*)&size, sizeof(size)) !=
+          sizeof(size) ||
+          size > std::numeric_limits<index_t>::max()) {
+        return;
+      }
+      std::vector<index_t> map(size);
+      if (ReadDataFromDisk(file, (char*)map.data(),
+          sizeof(index_t) * size) != sizeof(index_t) * size) {
+        return;
+      }
+      feature_map_.swap(map);
+    } else if (tag.compare(kFieldMapTag) == 0) {
+      uint64 size = 0;
+      if (ReadDataFromDisk(file, (char*)&size, sizeof(size)) !=
+          sizeof(size) || size < num_field_ ||
+          size > std::numeric_limits<index_t>::max()) {
+        return;
+      }
+      std::vector<index_t> map(size);
+      if (ReadDataFromDisk(file, (char*)map.data(),
+          sizeof(index_t) * size) != sizeof(index_t) * size) {
+        return;
+      }
+      field_map_.swap(map);
+    } else if (tag.compare(kFieldWeightTag) == 0) {
+      uint64 size = 0;
+      if (ReadDataFromDisk(file, (char*)&size, sizeof(size)) !=
+          sizeof(size) ||
+          size != (uint64)num_field_ * num_field_ * aux_size_) {
+        return;
+      }
+      std::vector<real_t> value(size);
+      if (ReadDataFromDisk(file, (char*)value.data(),
+          sizeof(real_t) * size) != sizeof(real_t) * size) {
+        return;
+      }
+      param_r_.swap(value);
+    } else if (tag.compare(kChecksumTag) == 0) {
+      uint64 bytes = 0, size = 0;
+      if (ReadDataFromDisk(file, (char*)&bytes, sizeof(bytes)) !=
+          sizeof(bytes) || bytes == 0 ||
+          ReadDataFromDisk(file, (char*)&size, sizeof(size)) !=
+          sizeof(size) || size > std::numeric_limits<index_t>::max()) {
+        return;
+      }
+      std::vector<uint64> hash(size);
+      if (ReadDataFromDisk(file, (char*)hash.data(),
+          sizeof(uint64) * size) != sizeof(uint64) * size) {
+        return;
+      }
+      hash_bytes_ = bytes;
+      section_hash_.swap(hash);
+    } else {
+      LOG(WARNING) << "Unknown item in the model file: " << tag;
+      return;
+    }
   }
 }
 
 // Deserialize w,v,b from disk file
 void Model::deserialize_w_v_b(FILE* file) {
   // Read size of w
-  ReadDataFromDisk(file, (char*)&param_num_w_, sizeof(param_num_w_));
+  index_t num_w = 0;
+  ReadDataFromDisk(file, (char*)&num_w, sizeof(num_w));
   // Read size of v
+  index_t num_v = 0;
   if (score_func_.compare("linear") != 0) {
-    ReadDataFromDisk(file, (char*)&param_num_v_, sizeof(param_num_v_));
+    ReadDataFromDisk(file, (char*)&num_v, sizeof(num_v));
   }
+  this->set_num_param();
+  if (!field_index_.Empty()) {
+    CHECK_EQ(score_func_.compare("ffm"), 0);
+    CHECK_EQ(field_index_.NumFeature(), num_feat_);
+  }
+  CHECK_EQ(num_w, (index_t)param_num_w_);
+  CHECK_EQ(num_v, (index_t)param_num_v_);
   // Allocate memory. Don't set value here
   this->initial(false);
-  // Read w
-  ReadDataFromDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
-  // Read b
-  ReadDataFromDisk(file, (char*)param_b_, sizeof(real_t)*aux_size_);
-  // Read v
-  if (score_func_.compare("linear") != 0) {
-    ReadDataFromDisk(file, (char*)param_v_, sizeof(real_t)*param_num_v_);
-  }
+  // Read w, b and v, and move v to the layout of the memory
+  this->io_sections(file, false, nullptr);
 }
 
 }  // namespace xLearn
@@ -21,14 +21,27 @@ This file defines the class of model parameters.
 #ifndef XLEARN_DATA_MODEL_PARAMETERS_H_
 #define XLEARN_DATA_MODEL_PARAMETERS_H_
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <vector>
 
 #include <math.h>
 
 #include "src/base/common.h"
+#include "src/base/half.h"
+#include "src/base/mem_alloc.h"
+#include "src/base/mmap_file.h"
 #include "src/data/data_structure.h"
+#include "src/data/field_index.h"
+#include "src/data/pair_table.h"
 #include "src/base/logging.h"
 
+class ThreadPool;
+
 namespace xLearn {
 
 //------------------------------------------------------------------------------
@@ -59,15 +72,15 @@ namespace xLearn {
 //
 //    /* We can get the parameter of the linear term: */
 //    real_t* w = model.GetParameter_w();
-//    index_t w_len = model.GetNumParameter_w();
-//    for (index_t i = 0; i < w_len; ++i) {
+//    offset_t w_len = model.GetNumParameter_w();
+//    for (offset_t i = 0; i < w_len; ++i) {
 //      /* access w[i] ... */
 //    }
 //
 //    /* We can also get the parameter of the latent factor */
 //    real_t* v = model.GetParameter_v();
-//    index_t v_len = model.GetNumParameter_v();
-//    for (index_t i = 0; i < v_len; ++i) {
+//    offset_t v_len = model.GetNumParameter_v();
+//    for (offset_t i = 0; i < v_len; ++i) {
 //      /* access v[i] ... */
 //    }
 //
@@ -77,9 +90,142 @@ namespace xLearn {
 //    /* Also, we can load model from this file. */
 //    Model new_model("/tmp/model.txt");
 //
+// The fwfm model has the latent factors of fm, and also a weight of
+// each pair of fields with its gradient cache, which is kept in the
+// model files as an optional item (see serialize_extra):
+//
+//    real_t r = model.GetFieldWeight(field_1, field_2)[0];
+//
+// The ffm model can keep the latent vectors V_j_f of only the pairs of
+// (feature, target field) that are seen in the training data, which
+// are given by a FieldIndex before the model is initialized. Then the
+// V_j_f of the other pairs are zero, and the score kernels look up the
+// blocks of the pairs by the index (see FFMScore). The index is kept
+// in the model files, before the header (see Serialize):
+//
+//    model.SetFieldIndex(index);  /* index.Build() has been called */
+//    model.Initialize("ffm", ...);
+//    offset_t b = model.GetFieldIndex().Block(j, f);
+//
+// Each latent block of ffm is followed by its gradient cache, so the
+// forward pass, which only reads the weights, also pulls the cache
+// into the CPU cache. The split layout keeps the weights of all the
+// fields of a feature together, followed by the same number of values
+// of each aux, and the score kernels read aux_size times fewer bytes.
+// It only changes the memory, and the model files and the values of
+// the parameter server keep the interleaved layout:
+//
+//    model.SetSplitLayout(true);  /* before Initialize or Deserialize */
+//    model.Initialize("ffm", ...);  /* model.IsSplitLayout() */
+//
+// The latent vectors of ffm are in the order of feature and then
+// field, so a row of nnz features reads its vectors from nnz rows of
+// the model. The field-major layout puts the field first, so all the
+// V_j_f of one target field f are together, which groups the vectors
+// of a row into fewer pages when a few features of each field are
+// frequent. As the split layout, it only changes the memory, and the
+// field-major model cannot grow:
+//
+//    model.SetFieldMajor(true);  /* before Initialize or Deserialize */
+//
 // The Model class can support early-stopping technique. We can set
 // a record for the best model parameter by using SetBestModel() and
 // we can shrink back to find the best model by using Shrink() method.
+// After the first record, the model tracks the features changed by
+// the training rows (MarkDirty), so the next records only copy these
+// features. The record can also be kept in a file instead of memory:
+//
+//    model.SetBestModelFile("/tmp/best.bin");  /* before the record */
+//    model.SetBestModel();
+//    model.MarkDirty(row);  /* before updating the row */
+//    model.SetBestModel();  /* only copies the changed features */
+//    model.Shrink();
+//
+// For prediction, the latent factors can be converted to 16-bit floats
+// or int8 by using ConvertLatent(), which cuts the memory and the
+// bandwidth of the score kernels:
+//
+//    model.ConvertLatent(kStoreBF16);
+//    uint16* v = model.GetParameter_v_half();
+//
+// The arrays of the inference file are aligned to kAlignByte, so the
+// file is memory-mapped read-only by the constructor (or Deserialize),
+// and the score kernels use the pages of the file directly. Then the
+// model is ready without reading the file, and the processes on one
+// host that load the same model share its pages in the page cache:
+//
+//    model.SerializeInference("/tmp/model.inf", kStoreInt8);
+//    Model new_model("/tmp/model.inf");  /* new_model.IsMapped() */
+//
+// For a large feature space where most features never show up, the
+// model can be initialized lazily. Then the parameters of a feature
+// are set on its first use by Touch(), and the memory of the unseen
+// features is never touched, so the OS does not back it with pages:
+//
+//    model.Initialize(..., model_scale, true);
+//    model.Touch(row);  /* before using the row */
+//
+// The sparse model file only keeps the features that have been used
+// (see SerializeSparse), with the list of their ids. It is loaded as
+// a lazy model, so the memory of the unused features is not touched
+// either, and Densify() gives the dense model:
+//
+//    model.SerializeSparse("/tmp/model.sparse");
+//    Model new_model("/tmp/model.sparse");  /* new_model.IsLazy() */
+//    new_model.Densify();
+//
+// The L2 regularization of sgd only decays the features of current
+// row. With the lazy L2 regularization, the model records the last
+// update step of each feature, and the decay of the skipped steps is
+// applied on the next use of the feature, so every step decays the
+// whole model without a dense pass:
+//
+//    model.SetLazyRegu(learning_rate, regu_lambda);
+//    model.LazyRegu(row);  /* before using the row */
+//    model.FlushLazyRegu();  /* after each epoch */
+//
+// The big arrays of w and v can use huge pages and a NUMA policy,
+// which is set before the model is initialized or loaded:
+//
+//    model.SetMemoryPolicy(true, kNumaLocal, pool);
+//    model.Initialize(...);  /* initialized by the pool threads */
+//
+// With the pool, the threads also write and read w, b and v of the
+// model file at their offsets by pwrite() and pread(), in sections of
+// a fixed size, and the model file can keep a checksum of each section,
+// which is verified by Deserialize() (see file_sections):
+//
+//    model.SetChecksum(true);
+//    model.Serialize("/tmp/model.bin");  /* with the checksum item */
+//
+// The model larger than the memory keeps w and v in a file, which is
+// mapped in memory, so the kernel loads the pages on their use and
+// writes the dirty pages back. The head of the model, which has the
+// most frequent features after RemapFeatures(), can be locked in
+// memory, and the file is removed with the model:
+//
+//    model.SetParamFile("/data/model.swap");
+//    model.Initialize(...);  /* model.IsFileBacked() */
+//    model.LockFeatures(num_hot);
+//
+// The bias is updated by every row, and so are the most frequent
+// features, so the threads of lock-free training keep writing the same
+// cache lines. With the per-thread parameters, each thread updates its
+// own copy of the bias and of the linear term of the hot features, and
+// adds the delta of its copy to the shared model every merge_rows rows:
+//
+//    model.SetLocalParams(merge_rows, num_hot);
+//    model.ChooseHotFeatures(matrix);  /* on the first batch */
+//    model.BeginLocal();  /* in each thread */
+//    model.LocalStep();  /* after each row */
+//    model.EndLocal();
+//
+// The processes of one host can train the same model in the shared
+// memory (see SharedModel), where the first one copies its model to
+// the memory and the others use it as it is:
+//
+//    char* buffer = shared.Allocate(model.GetSharedSize());
+//    model.ShareParameters(buffer, rank == 0);
 //------------------------------------------------------------------------------
 class Model {
  public:
@@ -91,48 +237,437 @@ class Model {
   explicit Model(const std::string& filename);
 
   // Initialize model parameters to zero or using
-  // a random distribution.
+  // a random distribution. If lazy is true, the parameters
+  // of each feature are initialized by Touch() instead.
+  // The aux values (gradient cache) are set to aux_value,
+  // which is 1.0 for adagrad and ftrl, and 0 for adam.
   void Initialize(const std::string& score_func,
               const std::string& loss_func,
               index_t num_feature,
               index_t num_field,
               index_t num_K,
               index_t aux_size,
-              real_t scale = 1.0);
+              real_t scale = 1.0,
+              bool lazy = false,
+              real_t aux_value = 1.0);
+
+  // Set how the model parameters are allocated and initialized,
+  // which must be called before Initialize() or Deserialize().
+  // The initialization is split over the threads of the pool
+  // if it is not nullptr, which gives the same model as one thread.
+  void SetMemoryPolicy(bool huge_page,
+                       NumaPolicy numa,
+                       ThreadPool* pool = nullptr);
+
+  // Write the checksum of each section of w, b and v to the model
+  // file by Serialize(), where a section has section_bytes bytes
+  // (0 is the default 16 MB). The sections are also the units of the
+  // parallel I/O, with or without the checksum.
+  void SetChecksum(bool checksum, uint64 section_bytes = 0);
+
+  // Keep w and v in the given file instead of the memory, which
+  // must be called before Initialize() or Deserialize().
+  void SetParamFile(const std::string& filename);
+
+  // If w and v are in the file of SetParamFile().
+  inline bool IsFileBacked() { return param_file_ != nullptr; }
+
+  // Lock w and v of the first num_feature features of the file in
+  // memory. Return false if the pages cannot be locked, and then
+  // they are only loaded ahead.
+  bool LockFeatures(index_t num_feature);
+
+  // Set the index of the latent blocks of the sparse ffm model,
+  // which must be called before Initialize().
+  inline void SetFieldIndex(const FieldIndex& index) {
+    CHECK(param_w_ == nullptr);
+    field_index_ = index;
+  }
+
+  // Get the index of the latent blocks, which
+  // is empty for the dense layout of ffm.
+  inline const FieldIndex& GetFieldIndex() const { return field_index_; }
+
+  // The precomputed pairs of the small fields of ffm for the
+  // prediction (see FFMScore::FillPairTable), which are not in the
+  // model file, and must be rebuilt if the model is changed.
+  inline PairTable& GetPairTable() { return pair_table_; }
+
+  // Use the split layout of the latent factors of ffm, which must be
+  // called before Initialize() or Deserialize(). It is ignored by the
+  // other models, the sparse ffm model, and the model without aux.
+  inline void SetSplitLayout(bool split) {
+    CHECK(param_w_ == nullptr);
+    split_ = split;
+  }
+
+  // If the latent factors of ffm are in the split layout.
+  inline bool IsSplitLayout() const { return split_; }
+
+  // Use the field-major layout of the latent factors of ffm, which
+  // must be called before Initialize() or Deserialize(). It is
+  // ignored by the other models, the sparse ffm model, the split
+  // layout and the inference file.
+  inline void SetFieldMajor(bool field_major) {
+    CHECK(param_w_ == nullptr);
+    field_major_ = field_major;
+  }
+
+  // If the latent factors of ffm are in the field-major layout.
+  inline bool IsFieldMajor() const { return field_major_; }
+
+  // Initialize the parameters of the features in the row
+  // if they have not been used, which is only needed by the
+  // lazy model. The initial value of a feature only depends
+  // on its id, so two threads that touch the same feature
+  // at the same time write the same value.
+  inline void Touch(const SparseRow* row) {
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t j = iter->feat_id;
+      if (j < num_feat_ && touched_[j] == 0) {
+        touch_feature(j);
+      }
+    }
+  }
+
+  // Whether the model is initialized lazily.
+  inline bool IsLazy() { return lazy_; }
+
+  // Initialize the features of the lazy model that have not
+  // been used, and then the model is not lazy any more.
+  void Densify();
+
+  // Get the number of features that have been initialized.
+  index_t GetNumTouched();
+
+  // Grow the model to num_feature features for the new feature ids
+  // of the online training or the warm start (-pre), and nothing is
+  // done if it is not larger than current number. The parameters of
+  // the old features and the gradient cache are kept, and the new
+  // features are initialized as Initialize() does (or on the first
+  // use for the lazy model). The arrays are reallocated with the
+  // headroom of a quarter, so the next small grows are done in place.
+  void Grow(index_t num_feature);
+
+  // Number of the features that w and v are allocated for.
+  inline index_t GetCapacity() { return cap_feat_; }
+
+  // Move the parameters of each feature j to the feature map[j],
+  // where map is a permutation of the num_feat ids, e.g., to put
+  // the frequent features together (see FeatureStats::FeatureMap).
+  // The gradient cache, the state of the lazy model, the record of
+  // the best model in memory and the hot features move with them,
+  // so the model trained on the renumbered data is moved back by
+  // the inverse map. It is done in place with one row of buffer.
+  void RemapFeatures(const std::vector<index_t>& map);
+
+  // Bytes of the memory of w, v and b for ShareParameters().
+  uint64 GetSharedSize();
+
+  // Move w, v and b to the buffer of GetSharedSize() bytes, which
+  // is kept by the caller until the model is freed. The values are
+  // copied to the buffer if copy is true, or else the buffer is taken
+  // as the parameters, e.g., the copy of another process. The model
+  // cannot be lazy or grown after it, and so it must be kept fp32.
+  void ShareParameters(char* buffer, bool copy);
+
+  // If the parameters are in the buffer of ShareParameters().
+  inline bool IsShared() { return shared_ != nullptr; }
+
+  // Enable the lazy L2 regularization with the decay rate
+  // learning_rate * lambda of each step, which must be called
+  // after the model is initialized. Only sgd and adagrad
+  // (aux_size = 1 or 2) are supported. The adagrad rate of each
+  // parameter is taken as fixed over the skipped steps.
+  void SetLazyRegu(real_t learning_rate, real_t lambda);
+
+  // Whether the lazy L2 regularization is used.
+  inline bool IsLazyRegu() { return lazy_regu_; }
+
+  // Start a new update step, and apply the decay of the steps
+  // skipped by the features in the row since their last update.
+  // Then the update of the row regularizes the current step.
+  inline void LazyRegu(const SparseRow* row) {
+    uint64 step = regu_clock_.fetch_add(1, std::memory_order_relaxed);
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t j = iter->feat_id;
+      if (j < num_feat_ && regu_step_[j] != step) {
+        if (step - regu_step_[j] > 1) {
+          decay_feature(j, step - regu_step_[j] - 1);
+        }
+        regu_step_[j] = step;
+      }
+    }
+  }
+
+  // Apply the pending decay of all the features, so the whole
+  // model is up to date, e.g., at the end of each epoch.
+  void FlushLazyRegu();
+
+  // Enable the per-thread parameters, which are merged into the
+  // shared model every merge_rows rows (0 disables it). Besides the
+  // bias, the linear term of the num_hot most frequent features
+  // are also copied, which are chosen by ChooseHotFeatures().
+  void SetLocalParams(int merge_rows, index_t num_hot);
+
+  // Choose the hot features, which are the most frequent features in
+  // the given batch. It only works on the first call after the
+  // per-thread parameters are enabled, and does nothing after that.
+  void ChooseHotFeatures(const DMatrix* matrix);
+
+  // Set the hot features by their ids, e.g., the most frequent
+  // features of the whole data by FeatureStats, where the ids
+  // are unique, and the ids out of the model or after max_hot are
+  // ignored. As ChooseHotFeatures(), it does nothing after that.
+  void SetHotFeatures(const std::vector<index_t>& ids);
+
+  // Whether the per-thread parameters are used.
+  inline bool IsLocal() { return merge_rows_ > 0; }
+
+  // Start to update the copy of current thread, which is
+  // taken from the shared model.
+  void BeginLocal();
+
+  // Count a row updated by current thread, and merge the
+  // copy into the shared model every merge_rows_ rows.
+  inline void LocalStep() {
+    LocalParams& local = local_params();
+    if (++local.rows >= merge_rows_) {
+      MergeLocal();
+    }
+  }
+
+  // Add the delta of the copy of current thread to the shared
+  // model, and then take a new copy of the shared model.
+  void MergeLocal();
+
+  // Merge the copy of current thread, and stop using it.
+  void EndLocal();
 
   // Serialize model to a checkpoint file.
   void Serialize(const std::string& filename);
 
-  // Serialize model to a TXT file.
+  // Copy the model (with its gradient cache) to the snapshot, which
+  // can be serialized by another thread while this model is trained.
+  // The memory of the snapshot is allocated by the first copy, and
+  // the next copies reuse it.
+  void Snapshot(Model* snapshot);
+
+  // Get the features whose parameters (or gradient cache) are not
+  // the same as the snapshot any more, which are the rows of the
+  // delta from the snapshot to this model. Return false if there
+  // is no delta, e.g., the snapshot has not been taken yet, or it
+  // has another shape.
+  bool ChangedFeatures(Model* snapshot, std::vector<index_t>* ids);
+
+  // Serialize the bias, the field weights and the features in ids to
+  // a delta file, which only keeps the model without the gradient
+  // cache. It turns the model of the version base_id into this one
+  // (see SetVersionId), so it is much smaller than the model file
+  // when only a few features are changed, e.g., by online training.
+  void SerializeDelta(const std::string& filename,
+                      const std::vector<index_t>& ids,
+                      uint64 base_id);
+
+  // Apply the delta file to the model in place (and its replicas)
+  // while it is serving. Return false if the model is not the base
+  // version of the delta, or its memory cannot be written (mapped,
+  // converted, lazy or sparse ffm), and then the model is not
+  // changed, so the full model file should be loaded instead.
+  bool ApplyDelta(const std::string& filename);
+
+  // Serialize model to a sparse model file, which only keeps the
+  // used features: the touched features of the lazy model, or the
+  // features whose linear term or gradient cache is not at the
+  // initial value any more. The other features are initialized as
+  // the lazy model does when the file is loaded.
+  void SerializeSparse(const std::string& filename);
+
+  // Serialize model to a TXT file, which is formatted
+  // by the threads of the pool given by SetMemoryPolicy().
   void SerializeToTXT(const std::string& filename);
 
+  // Copy the weights to the arrays of the caller in the order of
+  // the TXT model: linear has num_feat + 1 values, which are the
+  // bias (with the score offset) and the linear terms, and latent
+  // has num_feat * num_K values for fm, or num_feat * num_field *
+  // num_K values for ffm. The latent can be nullptr.
+  void GetWeights(real_t* linear, real_t* latent);
+
+  // Get the number of the values of a feature, which are its linear
+  // term, its latent factors and their gradient cache. These are the
+  // values of a key of the parameter server.
+  inline index_t GetFeatureSize() {
+    return aux_size_ + (index_t)(param_num_v_ / num_feat_);
+  }
+
+  // Copy the values of the features to value (ids.size() *
+  // GetFeatureSize() values), or from value to the model. The id
+  // num_feat_ is the bias, which only uses its first aux_size_
+  // values, and the others are 0.
+  void GetFeatures(const std::vector<index_t>& ids, real_t* value);
+  void SetFeatures(const std::vector<index_t>& ids, const real_t* value);
+
+  // Serialize model to an inference model file, which only keeps
+  // the model (aux_size = 1) without the gradient cache, and stores
+  // the latent factors in the given type. The constructor and
+  // Deserialize() can load both of the checkpoint and this file.
+  void SerializeInference(const std::string& filename,
+                          StorageType type = kStoreFP32);
+
   // Deserialize model from a checkpoint file.
   bool Deserialize(const std::string& filename);
 
   // Take a record of the best model during training.
   void SetBestModel();
 
+  // Keep the record of the best model in the file instead of
+  // memory, which is removed when the model is freed.
+  void SetBestModelFile(const std::string& filename);
+
+  // Whether the changed features are tracked for SetBestModel().
+  inline bool IsTracked() { return track_dirty_; }
+
+  // Mark the features of the row as changed since the last
+  // record, which is needed before the row updates the model.
+  // Only the first mark of a feature writes the flag, so the
+  // threads do not keep writing the same cache line.
+  inline void MarkDirty(const SparseRow* row) {
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t j = iter->feat_id;
+      if (j < num_feat_ && dirty_[j] == 0) {
+        dirty_[j] = 1;
+      }
+    }
+  }
+
   // Shrink back for getting the best model.
   void Shrink();
 
+  // Drop the latent vectors whose L2 norm is below the threshold after
+  // the training, which are the most of a model trained with a strong
+  // L1 (e.g., lambda_1 of ftrl). The ffm model keeps the rest in the
+  // sparse layout of a field index (see FieldIndex), so the files are
+  // smaller and the kernels skip the dropped pairs, and it keeps its
+  // largest pair if all of them are small. The vectors of fm and fwfm
+  // are set to zero. The gradient cache of the kept vectors
+  // is kept, and the best model is dropped. Return the number of the
+  // dropped vectors.
+  offset_t Prune(real_t threshold);
+
+  // Convert the latent factors to the given compact type (fp16,
+  // bf16, or int8) for prediction. Only the model is kept and the
+  // gradient cache is dropped, so the model cannot be trained or
+  // saved after that. The compact latent factors have the layout
+  // of aux_size = 1.
+  void ConvertLatent(StorageType type);
+
+  // Make a copy of the model on each of the num_nodes NUMA nodes,
+  // after the model is loaded (and converted). The memory of each copy
+  // is bound to its node. The copies are read by the threads of their
+  // nodes for prediction, and for the training of -numa replicate each
+  // copy is trained by the threads of its node (see SyncReplicas).
+  void Replicate(int num_nodes);
+
+  // Average the parameters (with their gradient caches) of the copies,
+  // which replaces the parameters of the copies and of this model, so
+  // the copies trained apart are one model again. It is called between
+  // the mini-batches, when no thread updates the copies, and the
+  // parameters are split over the threads of the pool.
+  void SyncReplicas();
+
+  // Free the copies of the model.
+  void ClearReplicas();
+
+  // Get the copy of the model on the given node, which is this
+  // model itself if there is no copy on the node (e.g., node = -1).
+  inline Model* GetReplica(int node) {
+    if (node < 0 || node >= (int)replicas_.size()) {
+      return this;
+    }
+    return replicas_[node];
+  }
+
+  // Get the storage type of the latent factors.
+  inline StorageType GetLatentType() { return latent_type_; }
+
+  // If the parameters are in the mapped inference file,
+  // which are read-only and cannot be trained.
+  inline bool IsMapped() { return mapped_ != nullptr; }
+
   // Get the size of auxiliary cache size.
   inline real_t GetAuxiliarySize() { return aux_size_; }
 
   // Get the pointer of linear term.
   inline real_t* GetParameter_w() { return param_w_; }
 
+  // Get the linear term (and its aux) of the j-th feature, which is
+  // the copy of current thread for a hot feature between BeginLocal()
+  // and EndLocal(), and param_w_ + j * aux_size_ otherwise.
+  inline real_t* GetLinear(index_t j) {
+    if (num_hot_ > 0 && (hot_bitmap_[j >> 3] & (1 << (j & 7)))) {
+      LocalParams& local = local_params();
+      if (local.owner == this) {
+        index_t h = std::lower_bound(hot_feat_.begin(),
+                                     hot_feat_.end(), j) -
+                    hot_feat_.begin();
+        return local.value.data() + (h + 1) * aux_size_;
+      }
+    }
+    return param_w_ + (offset_t)j * aux_size_;
+  }
+
+  // Whether GetLinear() gives the copy of current thread for the hot
+  // features, and then w of the row cannot be read from param_w_.
+  inline bool HasLocalLinear() {
+    return num_hot_ > 0 && local_params().owner == this;
+  }
+
   // Get the pointer of latent factor.
   inline real_t* GetParameter_v() { return param_v_; }
 
-  // Get the pointer of bias.
-  inline real_t* GetParameter_b() { return param_b_; }
+  // Get the pointer of the 16-bit latent factor, which is
+  // nullptr until ConvertLatent() is called.
+  inline uint16* GetParameter_v_half() { return param_v_half_; }
+
+  // Get the pointer of the int8 latent factor and the scale of each
+  // latent vector, which are nullptr until ConvertLatent() is called.
+  inline int8* GetParameter_v_int8() { return param_v_int8_; }
+  inline real_t* GetParameter_v_scale() { return param_v_scale_; }
+
+  // Get the weight (and its aux) of the pair of fields f1 and f2
+  // of fwfm, which is the same for (f1, f2) and (f2, f1), and is
+  // also the weight of the pairs in one field for f1 = f2.
+  inline real_t* GetFieldWeight(index_t f1, index_t f2) {
+    if (f1 > f2) { std::swap(f1, f2); }
+    return param_r_.data() + ((offset_t)f1 * num_field_ + f2) * aux_size_;
+  }
+
+  // Get the size of the field weights, which is
+  // num_field^2 * aux_size for fwfm and 0 for others.
+  inline offset_t GetNumParameter_r() { return param_r_.size(); }
+
+  // Get the pointer of bias, which is the copy of current
+  // thread between BeginLocal() and EndLocal().
+  inline real_t* GetParameter_b() {
+    if (merge_rows_ > 0) {
+      LocalParams& local = local_params();
+      if (local.owner == this) {
+        return local.value.data();
+      }
+    }
+    return param_b_;
+  }
 
   // Get the size of the linear term.
-  inline index_t GetNumParameter_w() { return param_num_w_; }
+  inline offset_t GetNumParameter_w() { return param_num_w_; }
 
   // Get the size of the latent factor.
   // For linear score this value equals zero.
-  inline index_t GetNumParameter_v() { return param_num_v_; }
+  inline offset_t GetNumParameter_v() { return param_num_v_; }
 
   // Reset current model parameters.
   inline void Reset() { set_value(); }
@@ -152,20 +687,98 @@ class Model {
   // Get the number of k.
   inline index_t GetNumK() { return num_K_; }
 
+  // Set the rate of the negative sampling of the training data
+  // (see Reader::SetNegativeRate), which is kept in the model files.
+  // The model trained on the sampled data overestimates the odds by
+  // 1/rate, so the predictions (Loss::Predict) add the score offset
+  // log(rate) to the scores, and they are calibrated to the data
+  // before the sampling. 1 (by default) gives no offset.
+  void SetNegativeRate(real_t rate);
+
+  // Set the type of the optimizer state in the aux values, which
+  // is kStoreFP32 by default and kStoreBF16 for the two bf16 of
+  // -opt_state bf16 (see FTRLBF16Optimizer). It is kept in the
+  // model file, so the pre-trained model is trained by its state.
+  inline void SetOptState(StorageType type) { opt_state_ = type; }
+
+  // Get the type of the optimizer state.
+  inline StorageType GetOptState() { return opt_state_; }
+
+  // Get the rate of the negative sampling.
+  inline real_t GetNegativeRate() { return neg_rate_; }
+
+  // Get the offset of the predicted scores, which is log(rate).
+  inline real_t GetScoreOffset() { return score_offset_; }
+
+  // Set the number of the epochs trained by the model, which is
+  // kept in the checkpoint file for resuming the training. It is
+  // 0 by default, and then it is not written.
+  inline void SetEpoch(int epoch) { epoch_ = epoch; }
+
+  // Get the number of the trained epochs.
+  inline int GetEpoch() { return epoch_; }
+
+  // Set the id of the version of the model, which is kept in the
+  // model files and the delta files, so a delta is only applied to
+  // its base version. It is 0 (no version) by default.
+  inline void SetVersionId(uint64 id) { version_id_ = id; }
+
+  // Get the id of the version.
+  inline uint64 GetVersionId() { return version_id_; }
+
+  // Set the new id of each original feature id of the data, e.g., the
+  // compact ids of -min_count (see FeatureStats::CompactMap). The model
+  // is trained on the renumbered data, so the map is kept in the model
+  // files and the data of prediction is renumbered by it, where the ids
+  // out of the map are kept. It is empty (by default) for no map.
+  inline void SetFeatureMap(const std::vector<index_t>& map) {
+    feature_map_ = map;
+  }
+
+  // Get the feature map, which is empty if the features are not renumbered.
+  inline const std::vector<index_t>& GetFeatureMap() const {
+    return feature_map_;
+  }
+
+  // Set the new id of each original field id of the data, which makes
+  // the sparse field ids (e.g., of a global registry) dense, so ffm only
+  // has the latent vectors of the used fields (see --remap-fields). It
+  // is kept in the model files as the feature map, and the fields out
+  // of the map become map.size(), which the score functions skip.
+  inline void SetFieldMap(const std::vector<index_t>& map) {
+    field_map_ = map;
+  }
+
+  // Get the field map, which is empty if the fields are not renumbered.
+  inline const std::vector<index_t>& GetFieldMap() const {
+    return field_map_;
+  }
+
+  // Renumber the features and the fields of the rows by the maps.
+  void MapFeatures(SparseRow* row) const;
+  void MapFeatures(DMatrix* matrix) const;
+
   // Get the aligned size of K.
   inline index_t get_aligned_k() {
     return (index_t)ceil((real_t)num_K_/kAlign)*kAlign;
   }
 
+  // Get the size of a latent row, which is the aligned K, or one
+  // block of kAlign values when the field index has the widths, and
+  // then V_j_f is the Width(j, f) rows from its block.
+  inline index_t get_row_k() {
+    return field_index_.HasWidths() ? kAlign : get_aligned_k();
+  }
+
   // Get the total size of model parameters.
   // 2 = bias + bias_gradient
-  inline index_t GetNumParameter() {
-    return param_num_w_ + param_num_v_ + 2;
+  inline offset_t GetNumParameter() {
+    return param_num_w_ + param_num_v_ + param_r_.size() + 2;
   }
 
  protected:
   /* Score function
-  For now it can be 'linear', 'fm', or 'ffm' */
+  For now it can be 'linear', 'fm', 'ffm', or 'fwfm' */
   std::string  score_func_;
   /* Loss function
   For now it can be 'squared' and 'cross-entropy' */
@@ -174,17 +787,22 @@ class Model {
   Note that we store both of the model parameters
   and the gradient cache in param_w_, so
   param_num_w_ = num_feat_ * aux_size_  */
-  index_t param_num_w_;
+  offset_t param_num_w_;
   /* Size of the latent factor. 
   We store both the model parameters and the gradient 
   cache for adagrad in param_v_. 
   For linear function, param_num_v = 0
-  For fm function, param_num_v_ = num_feat * num_K * aux_size_
-  For ffm function, param_num_v_ = num_feat * num_field * num_K * aux_size_  */
-  index_t  param_num_v_;
+  For fm and fwfm function, param_num_v_ = num_feat * num_K * aux_size_
+  For ffm function, param_num_v_ = num_feat * num_field * num_K * aux_size_,
+  or num_blocks * num_K * aux_size_ for the blocks of field_index_
+  (num_blocks * kAlign * aux_size_ with the widths)  */
+  offset_t param_num_v_;
   /* Number of feature
   Feature id is start from 0 */
   index_t  num_feat_;
+  /* Number of the features that w and v are allocated
+  for, which is larger than num_feat_ after Grow() */
+  index_t  cap_feat_ = 0;
   /* Number of field (Used in ffm)
   Field id is start from 0 */
   index_t  num_field_;
@@ -193,7 +811,7 @@ class Model {
   User can get the aligned K by using get_aligned_k() */
   index_t  num_K_;
   /* Auxiliary memory size for different optimization method
-  For 'adagrad' it equals 2 and 'ftrl' it equals 3 */
+  For 'adagrad' it equals 2, and 'ftrl' and 'adam' it equals 3 */
   index_t aux_size_;
   /* Storing the parameter of linear term */
   real_t*  param_w_ = nullptr;
@@ -201,12 +819,137 @@ class Model {
   real_t*  param_v_ = nullptr;
   /* Storing the bias term */
   real_t*  param_b_ = nullptr;
+  /* Storing the field weights of fwfm, where the weight of the
+  fields f1 <= f2 is at (f1 * num_field_ + f2) * aux_size_ */
+  std::vector<real_t> param_r_;
+  /* The latent blocks of the sparse ffm model, or empty */
+  FieldIndex field_index_;
+  /* The precomputed pairs of ffm for the prediction, or empty */
+  PairTable pair_table_;
+  /* The aux of each feature of ffm follow all of its weights */
+  bool split_ = false;
+  /* The latent vectors of ffm are in the order of field and feature */
+  bool field_major_ = false;
+  /* Storage type of the latent factor */
+  StorageType latent_type_ = kStoreFP32;
+  /* Storing the 16-bit latent factor (without gradient cache) */
+  uint16*  param_v_half_ = nullptr;
+  /* Storing the int8 latent factor and the scale of each vector */
+  int8*    param_v_int8_ = nullptr;
+  real_t*  param_v_scale_ = nullptr;
   /* The following variables are used for early-stopping */
   real_t* param_best_w_ = nullptr;
   real_t* param_best_v_ = nullptr;
   real_t* param_best_b_ = nullptr;
+  std::vector<real_t> param_best_r_;
+  /* If there is a record of the best model */
+  bool has_best_ = false;
+  /* The file that keeps the best w and v, or nullptr */
+  FILE* best_file_ = nullptr;
+  std::string best_filename_;
+  /* Track the changed features after the first record */
+  bool track_dirty_ = false;
+  /* dirty_[j] is 1 if feature j changed since the last record */
+  std::vector<uint8> dirty_;
   /* Used to init model parameters */
   real_t scale_;
+  /* Initial value of the gradient cache */
+  real_t aux_value_ = 1.0;
+  /* Type of the optimizer state in the aux values */
+  StorageType opt_state_ = kStoreFP32;
+  /* Rate of the negative sampling, and its log */
+  real_t neg_rate_ = 1.0;
+  real_t score_offset_ = 0;
+  /* Number of the trained epochs of a checkpoint */
+  int epoch_ = 0;
+  /* Id of the version of the model, or 0 */
+  uint64 version_id_ = 0;
+  /* New id of each feature id of the data, or empty */
+  std::vector<index_t> feature_map_;
+  /* New id of each field id of the data, or empty */
+  std::vector<index_t> field_map_;
+  /* Initialize the parameters of each feature on its first use */
+  bool lazy_ = false;
+  /* touched_[j] is 1 if feature j has been initialized */
+  std::vector<uint8> touched_;
+  /* touched_ of the best model */
+  std::vector<uint8> best_touched_;
+  /* Using transparent huge pages for w and v */
+  bool huge_page_ = false;
+  /* NUMA placement of w and v */
+  NumaPolicy numa_ = kNumaNone;
+  /* Thread pool used by the initialization and the model files */
+  ThreadPool* pool_ = nullptr;
+  /* Write the checksum of the sections to the model file */
+  bool checksum_ = false;
+  /* Bytes of a section of the model file, or 0 for the default */
+  uint64 section_bytes_ = 0;
+  /* Checksum of each section, and the bytes of its sections, which
+  are given by the I/O of w, b and v to serialize_extra(), or read
+  by deserialize_extra() to be verified */
+  std::vector<uint64> section_hash_;
+  uint64 hash_bytes_ = 0;
+  /* Using the lazy L2 regularization */
+  bool lazy_regu_ = false;
+  /* Decay rate (learning_rate * lambda) of each step */
+  real_t regu_rate_ = 0;
+  /* regu_step_[j] is the last step that feature j is decayed to */
+  std::vector<uint64> regu_step_;
+  /* Current update step, which starts at 1 */
+  std::atomic<uint64> regu_clock_{1};
+  /* Read-only copy of the model on each NUMA node */
+  std::vector<Model*> replicas_;
+  /* The mapped inference file, where w and v are */
+  std::unique_ptr<MappedFile> mapped_;
+  /* The file of w and v (see SetParamFile), or empty */
+  std::string param_filename_;
+  std::unique_ptr<MappedFile> param_file_;
+  /* The buffer of ShareParameters(), which is not freed */
+  char* shared_ = nullptr;
+  uint64 shared_size_ = 0;
+  /* Rows between two merges of the per-thread parameters */
+  int merge_rows_ = 0;
+  /* Number of the hot features, which is 0 until they are chosen */
+  index_t num_hot_ = 0;
+  /* Number of the hot features to choose */
+  index_t max_hot_ = 0;
+  /* Sorted ids of the hot features */
+  std::vector<index_t> hot_feat_;
+  /* Bit j is set if feature j is hot */
+  std::vector<uint8> hot_bitmap_;
+  /* Guard the merge of the per-thread parameters */
+  std::mutex merge_mutex_;
+
+  // Per-thread parameters: value is the copy of the bias and the
+  // linear term of the hot features (in the order of hot_feat_),
+  // and base is the value of the shared model at the last merge.
+  struct LocalParams {
+    Model* owner = nullptr;
+    std::vector<real_t> value;
+    std::vector<real_t> base;
+    int rows = 0;
+  };
+
+  static LocalParams& local_params() {
+    static thread_local LocalParams local;
+    return local;
+  }
+
+  // Get the shared parameter of the h-th value of LocalParams,
+  // where h = 0 is the bias.
+  inline real_t* shared_local(index_t h) {
+    return h == 0 ? param_b_ :
+           param_w_ + (offset_t)hot_feat_[h-1] * aux_size_;
+  }
+
+  // Calculate param_num_w_ and param_num_v_.
+  void set_num_param();
+
+  // Sort hot_feat_ and set hot_bitmap_ by it.
+  void set_hot_bitmap();
+
+  // Allocate the memory of w and v with the memory policy.
+  void* alloc_param(size_t size);
 
   // Initialize the value of model parameters and gradient cache.
   void initial(bool set_value = false);
@@ -214,15 +957,175 @@ class Model {
   // Reset the value of current model parameters.
   void set_value();
 
+  // Set the value of w and v of the j-th feature.
+  void set_feature_value(index_t j, std::default_random_engine& gen);
+
+  // Initialize the j-th feature with the seed of its id.
+  void init_feature(index_t j);
+
+  // Initialize the j-th feature of the lazy model.
+  void touch_feature(index_t j);
+
+  // Initialize all the features that have not been used,
+  // before the whole model is read or written.
+  void touch_all();
+
+  // The offset of the latent factor of the j-th feature in param_v_,
+  // where the one of num_feat_ is the size of the latent factor.
+  inline offset_t latent_offset(index_t j) {
+    if (num_feat_ == 0) { return 0; }
+    if (!field_index_.Empty()) {
+      return field_index_.Begin(j) * get_row_k() * aux_size_;
+    }
+    return (offset_t)j * (param_num_v_ / num_feat_);
+  }
+
+  // The position in param_v_ of the d-th weight of the r-th latent
+  // vector of ffm, which is the r-th (feature, field) pair or the
+  // r-th block of the field index. The a-th aux of the weight is at
+  // the position + a * ffm_gap().
+  inline offset_t ffm_pos(offset_t r, index_t d) {
+    offset_t k_aligned = get_row_k();
+    if (split_) {
+      offset_t j = r / num_field_;
+      return (j * num_field_ * aux_size_ + r % num_field_) *
+             k_aligned + d;
+    }
+    if (field_major_) {
+      r = (r % num_field_) * num_feat_ + r / num_field_;
+    }
+    return (r * k_aligned + d - d % kAlign) * aux_size_ + d % kAlign;
+  }
+
+  inline offset_t ffm_gap() {
+    return split_ ? (offset_t)num_field_ * get_aligned_k() : kAlign;
+  }
+
+  // If the latent factors in memory are not in the layout of the
+  // model files, which is interleaved and feature-major.
+  inline bool reorder_latent() { return split_ || field_major_; }
+
+  // Copy the latent factor of the j-th feature of ffm to row in the
+  // layout of the model files (to_file = true), or from row to it.
+  void copy_latent(index_t j, real_t* row, bool to_file);
+
+  // Call fn(pos, size) for each run of param_v_ that holds the latent
+  // factors of the features [begin, end), which is one run, or one
+  // run of each field for the field-major layout.
+  template <typename Func>
+  void latent_runs(index_t begin, index_t end, Func fn) {
+    if (!field_major_) {
+      fn(latent_offset(begin), latent_offset(end) - latent_offset(begin));
+      return;
+    }
+    offset_t size = (offset_t)get_aligned_k() * aux_size_;
+    for (index_t f = 0; f < num_field_; ++f) {
+      fn(((offset_t)f * num_feat_ + begin) * size, (end - begin) * size);
+    }
+  }
+
+  // Decay w and v of the j-th feature by the given steps.
+  void decay_feature(index_t j, uint64 steps);
+
+  // Copy w and v of the features [begin, end) to the record of the
+  // best model (save = true), or from the record to the model.
+  void copy_best(index_t begin, index_t end, bool save);
+
   // Serialize w, v, b to disk file.
   void serialize_w_v_b(FILE* file);
 
   // Deserialize w, v, b from disk file.
   void deserialize_w_v_b(FILE* file);
 
+  // A section of w, b and v in the model file, which starts at pos
+  // bytes after the sizes of w and v. The data is the memory of the
+  // section, or nullptr if its latent factors are reordered in the
+  // memory, and then it has the features [begin, end).
+  struct FileSection {
+    uint64 pos;
+    uint64 size;
+    real_t* data;
+    index_t begin;
+    index_t end;
+  };
+
+  // Split w, b and v into the sections of at most bytes bytes (or
+  // one feature of v if it is bigger). The sections of v have whole
+  // features, so they are the same for every layout of the memory.
+  std::vector<FileSection> file_sections(uint64 bytes);
+
+  // Write (save = true) or read w, b and v in the sections, which are
+  // written at their offsets by the threads of pool_. The checksum of
+  // each section is added to hash if it is not nullptr.
+  void io_sections(FILE* file, bool save, std::vector<uint64>* hash);
+
+  // If the sections have the checksum of deserialize_extra().
+  bool verify_sections();
+
+  // If the j-th feature is kept by the sparse model file.
+  bool is_used(index_t j);
+
+  // Write (save = true) or read w and v of the features
+  // in ids, which are in the sparse model file.
+  void sparse_rows(FILE* file, const std::vector<index_t>& ids, bool save);
+
+  // Deserialize the sparse model from disk file.
+  void deserialize_sparse(FILE* file);
+
+  // Deserialize the inference model from disk file.
+  void deserialize_inference(FILE* file, const std::string& filename);
+
+  // Map the w, v (and the scale of int8) of the aligned inference
+  // file, whose header has been read. Return false if the file
+  // cannot be mapped, and then it is read as before.
+  bool map_inference(FILE* file,
+                     const std::string& filename,
+                     offset_t num_row);
+
+  // If the ptr is in the mapped file, which is not freed.
+  bool in_mapped(const void* ptr);
+
+  // Map w and v in the file of SetParamFile().
+  void map_param_file(bool has_v);
+
+  // If the ptr is in the file of SetParamFile().
+  bool in_param_file(const void* ptr);
+
+  // If the ptr is in the buffer of ShareParameters().
+  bool in_shared(const void* ptr);
+
+  // Write and read the optional items at the end of the model
+  // file, which are not needed by the older versions. The field
+  // weights of the inference file are written without the aux.
+  void serialize_extra(FILE* file, bool inference = false);
+  void deserialize_extra(FILE* file);
+
+  // Append the lines of the features [begin, end) of the TXT
+  // model, which are the linear term or the latent factor.
+  void format_txt(bool latent, index_t begin, index_t end,
+                  std::string* buf);
+
+  // Get the number of latent vectors.
+  offset_t get_num_row();
+
+  // Copy the model of the r-th latent vector to row.
+  void get_latent_row(offset_t r, real_t* row);
+
+  // The number of the latent vectors of a feature in the delta file.
+  inline index_t delta_vectors() {
+    if (score_func_.compare("linear") == 0) { return 0; }
+    return score_func_.compare("ffm") == 0 ? num_field_ : 1;
+  }
+
+  // Write the first num_K_ model values of the r-th latent vector.
+  void set_latent_row(offset_t r, const real_t* row);
+
   // Free the allocated memory.
   void free_model();
 
+  // Free the record of the best model.
+  void free_best();
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Model);
 };
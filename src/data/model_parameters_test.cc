@@ -20,9 +20,18 @@ This file tests model_parameters.h file.
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "src/base/mem_alloc.h"
+#include "src/base/thread_pool.h"
 #include "src/data/model_parameters.h"
 #include "src/data/hyper_parameters.h"
 
@@ -234,6 +243,57 @@ TEST(MODEL_TEST, SerializeToTXT) {
   model_ffm.SerializeToTXT("test_txt.ffm");
 }
 
+// The TXT model written by the stream, one value at a time
+std::string txt_by_stream(Model& model) {
+  std::ostringstream o_file;
+  o_file << "bias: " << model.GetParameter_b()[0] << "\n";
+  index_t aux_size = model.GetAuxiliarySize();
+  for (index_t j = 0; j < model.GetNumFeature(); ++j) {
+    o_file << "i_" << j << ": "
+           << model.GetParameter_w()[j * aux_size] << "\n";
+  }
+  index_t num_K = model.GetNumK();
+  index_t k_aligned = model.get_aligned_k();
+  real_t* v = model.GetParameter_v();
+  for (index_t j = 0; v != nullptr && j < model.GetNumFeature(); ++j) {
+    bool is_fm = model.GetScoreFunction().compare("fm") == 0;
+    index_t num_field = is_fm ? 1 : model.GetNumField();
+    for (index_t f = 0; f < num_field; ++f) {
+      real_t* w = v + (j * num_field + f) * aux_size * k_aligned;
+      o_file << "v_" << j;
+      if (!is_fm) { o_file << "_" << f; }
+      o_file << ": ";
+      for (index_t d = 0; d < num_K; ++d) {
+        o_file << (is_fm ? w[d] :
+                   w[(d / kAlign) * kAlign * aux_size + d % kAlign]);
+        if (d != num_K-1) { o_file << " "; }
+      }
+      o_file << "\n";
+    }
+  }
+  return o_file.str();
+}
+
+TEST(MODEL_TEST, SerializeToTXT_threads) {
+  ThreadPool pool(3);
+  std::string score_func[] = { "linear", "fm", "ffm" };
+  // Several blocks for each thread
+  index_t num_feature[] = { 800000, 300000, 40000 };
+  for (int i = 0; i < 3; ++i) {
+    Model model;
+    model.SetMemoryPolicy(false, kNumaNone, &pool);
+    model.Initialize(score_func[i], "squared",
+                     num_feature[i], 4, 4, 2, 0.5);
+    model.GetParameter_b()[0] = 0.25;
+    model.SerializeToTXT("test_txt.threads");
+    std::ifstream i_file("test_txt.threads");
+    std::string txt((std::istreambuf_iterator<char>(i_file)),
+                    std::istreambuf_iterator<char>());
+    EXPECT_TRUE(txt == txt_by_stream(model));
+    RemoveFile("test_txt.threads");
+  }
+}
+
 TEST(MODEL_TEST, BestModel) {
   // Init model
   HyperParam hyper_param = Init();
@@ -277,4 +337,1568 @@ TEST(MODEL_TEST, BestModel) {
   EXPECT_FLOAT_EQ(b[1], 3);
 }
 
+// The next records only copy the changed features, in memory
+// or in the file of the best model.
+TEST(MODEL_TEST, BestModel_incremental) {
+  HyperParam hyper_param = Init();
+  for (int t = 0; t < 2; ++t) {
+    Model model_ffm;
+    model_ffm.Initialize(hyper_param.score_func,
+                      hyper_param.loss_func,
+                      hyper_param.num_feature,
+                      hyper_param.num_field,
+                      hyper_param.num_K, 2);
+    std::string best_file = "./test_best_model.bin";
+    if (t == 1) { model_ffm.SetBestModelFile(best_file); }
+    real_t* w = model_ffm.GetParameter_w();
+    real_t* v = model_ffm.GetParameter_v();
+    index_t size_v = model_ffm.GetNumParameter_v() / hyper_param.num_feature;
+    EXPECT_FALSE(model_ffm.IsTracked());
+    model_ffm.SetBestModel();
+    EXPECT_TRUE(model_ffm.IsTracked());
+    EXPECT_EQ(FileExist(best_file.c_str()), t == 1);
+    // Feature 2 is marked, and feature 3 is not
+    real_t v_3 = v[3 * size_v];
+    SparseRow row;
+    row.push_back(Node(0, 2, 1.0));
+    model_ffm.MarkDirty(&row);
+    w[2 * 2] = 5.0;
+    w[3 * 2] = 5.0;
+    v[2 * size_v] = 5.0;
+    v[3 * size_v] = 5.0;
+    model_ffm.SetBestModel();
+    w[2 * 2] = 7.0;
+    w[3 * 2] = 7.0;
+    v[2 * size_v] = 7.0;
+    v[3 * size_v] = 7.0;
+    model_ffm.Shrink();
+    EXPECT_FLOAT_EQ(w[2 * 2], 5.0);
+    EXPECT_FLOAT_EQ(v[2 * size_v], 5.0);
+    EXPECT_FLOAT_EQ(w[3 * 2], 0.0);
+    EXPECT_FLOAT_EQ(v[3 * size_v], v_3);
+  }
+  EXPECT_FALSE(FileExist("./test_best_model.bin"));
+}
+
+TEST(MODEL_TEST, Sparse_model) {
+  HyperParam hyper_param = Init();
+  std::string filename = "./test_model.sparse";
+  // The lazy model keeps the touched features
+  Model model_lazy;
+  model_lazy.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2, 0.5, true);
+  SparseRow row;
+  row.push_back(Node(0, 1, 1.0));
+  row.push_back(Node(1, 3, 1.0));
+  model_lazy.Touch(&row);
+  index_t size_v = model_lazy.GetNumParameter_v() / hyper_param.num_feature;
+  model_lazy.GetParameter_w()[1 * 2] = 2.5;
+  model_lazy.GetParameter_v()[3 * size_v] = 3.5;
+  model_lazy.GetParameter_b()[0] = 1.5;
+  model_lazy.SerializeSparse(filename);
+  Model new_lazy(filename);
+  EXPECT_TRUE(new_lazy.IsLazy());
+  EXPECT_EQ(new_lazy.GetNumTouched(), 2);
+  EXPECT_EQ(new_lazy.GetNumParameter(), model_lazy.GetNumParameter());
+  EXPECT_FLOAT_EQ(new_lazy.GetParameter_b()[0], 1.5);
+  EXPECT_FLOAT_EQ(new_lazy.GetParameter_w()[1 * 2], 2.5);
+  EXPECT_FLOAT_EQ(new_lazy.GetParameter_v()[3 * size_v], 3.5);
+  // The other features are initialized as the lazy model does
+  new_lazy.Densify();
+  model_lazy.Densify();
+  EXPECT_FALSE(new_lazy.IsLazy());
+  for (index_t i = 0; i < model_lazy.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(new_lazy.GetParameter_w()[i],
+                    model_lazy.GetParameter_w()[i]);
+  }
+  for (index_t i = 0; i < model_lazy.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(new_lazy.GetParameter_v()[i],
+                    model_lazy.GetParameter_v()[i]);
+  }
+  // The dense model keeps the updated features
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  model_ffm.GetParameter_w()[2 * 2 + 1] = 4.0;
+  model_ffm.GetParameter_v()[2 * size_v] = 4.5;
+  model_ffm.SerializeSparse(filename);
+  Model new_ffm(filename);
+  EXPECT_EQ(new_ffm.GetNumTouched(), 1);
+  for (index_t i = 0; i < 2; ++i) {
+    EXPECT_FLOAT_EQ(new_ffm.GetParameter_w()[2 * 2 + i],
+                    model_ffm.GetParameter_w()[2 * 2 + i]);
+  }
+  for (index_t i = 0; i < size_v; ++i) {
+    EXPECT_FLOAT_EQ(new_ffm.GetParameter_v()[2 * size_v + i],
+                    model_ffm.GetParameter_v()[2 * size_v + i]);
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(MODEL_TEST, Snapshot) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  Model snapshot;
+  model_ffm.Snapshot(&snapshot);
+  real_t* w = snapshot.GetParameter_w();
+  real_t* v = snapshot.GetParameter_v();
+  // The memory of the snapshot is reused
+  model_ffm.GetParameter_w()[0] = 2.5;
+  model_ffm.GetParameter_v()[1] = 3.5;
+  model_ffm.GetParameter_b()[0] = 1.5;
+  model_ffm.Snapshot(&snapshot);
+  EXPECT_EQ(snapshot.GetParameter_w(), w);
+  EXPECT_EQ(snapshot.GetParameter_v(), v);
+  EXPECT_EQ(snapshot.GetNumParameter(), model_ffm.GetNumParameter());
+  for (index_t i = 0; i < model_ffm.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(w[i], model_ffm.GetParameter_w()[i]);
+  }
+  for (index_t i = 0; i < model_ffm.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(v[i], model_ffm.GetParameter_v()[i]);
+  }
+  EXPECT_FLOAT_EQ(snapshot.GetParameter_b()[0], 1.5);
+  // The snapshot is changed by the next copy only
+  model_ffm.GetParameter_w()[0] = 4.5;
+  EXPECT_FLOAT_EQ(w[0], 2.5);
+  // The epoch is kept in the checkpoint file
+  snapshot.SetEpoch(3);
+  snapshot.Serialize(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_EQ(new_model.GetEpoch(), 3);
+  EXPECT_FLOAT_EQ(new_model.GetParameter_w()[0], 2.5);
+  EXPECT_FLOAT_EQ(new_model.GetParameter_v()[1], 3.5);
+  model_ffm.Serialize(hyper_param.model_file);
+  Model model_file(hyper_param.model_file);
+  EXPECT_EQ(model_file.GetEpoch(), 0);
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, ConvertLatent_ffm) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    8, 3, 0.5);
+  index_t len = model_ffm.GetNumParameter_v();
+  std::vector<real_t> v(model_ffm.GetParameter_v(),
+                        model_ffm.GetParameter_v() + len);
+  model_ffm.ConvertLatent(kStoreFP16);
+  EXPECT_EQ(model_ffm.GetLatentType(), kStoreFP16);
+  EXPECT_TRUE(model_ffm.GetParameter_v() == nullptr);
+  uint16* h = model_ffm.GetParameter_v_half();
+  // Only the model is kept
+  for (index_t b = 0; b < len / (kAlign*3); ++b) {
+    for (index_t s = 0; s < kAlign; ++s) {
+      EXPECT_EQ(h[b*kAlign+s], FloatToHalf(v[b*kAlign*3+s]));
+    }
+  }
+}
+
+TEST(MODEL_TEST, ConvertLatent_fm) {
+  HyperParam hyper_param = Init();
+  Model model_fm;
+  model_fm.Initialize("fm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    5, 2, 0.5);
+  index_t k_aligned = model_fm.get_aligned_k();
+  index_t len = model_fm.GetNumParameter_v();
+  std::vector<real_t> v(model_fm.GetParameter_v(),
+                        model_fm.GetParameter_v() + len);
+  model_fm.ConvertLatent(kStoreBF16);
+  EXPECT_EQ(model_fm.GetLatentType(), kStoreBF16);
+  uint16* h = model_fm.GetParameter_v_half();
+  for (index_t j = 0; j < hyper_param.num_feature; ++j) {
+    for (index_t d = 0; d < k_aligned; ++d) {
+      EXPECT_EQ(h[j*k_aligned+d], FloatToBF16(v[j*k_aligned*2+d]));
+    }
+  }
+}
+
+TEST(MODEL_TEST, ConvertLatent_int8) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    6, 2, 0.5);
+  index_t k_aligned = model_ffm.get_aligned_k();
+  index_t len = model_ffm.GetNumParameter_v();
+  std::vector<real_t> v(model_ffm.GetParameter_v(),
+                        model_ffm.GetParameter_v() + len);
+  model_ffm.ConvertLatent(kStoreInt8);
+  EXPECT_EQ(model_ffm.GetLatentType(), kStoreInt8);
+  int8* q = model_ffm.GetParameter_v_int8();
+  real_t* scale = model_ffm.GetParameter_v_scale();
+  index_t num_row = len / (k_aligned*2);
+  for (index_t r = 0; r < num_row; ++r) {
+    int max_q = 0;
+    for (index_t d = 0; d < k_aligned; ++d) {
+      real_t w = v[r*k_aligned*2 + (d/kAlign)*kAlign*2 + d%kAlign];
+      EXPECT_NEAR(q[r*k_aligned+d] * scale[r], w, scale[r] * 0.5 + 1e-7);
+      max_q = std::max(max_q, std::abs((int)q[r*k_aligned+d]));
+    }
+    // The largest value of each row uses the full range
+    EXPECT_EQ(max_q, 127);
+  }
+}
+
+TEST(MODEL_TEST, Save_and_Load_inference) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    6, 3, 0.5);
+  real_t* w = model_ffm.GetParameter_w();
+  for (index_t i = 0; i < model_ffm.GetNumParameter_w(); ++i) {
+    w[i] = i * 0.5;
+  }
+  model_ffm.GetParameter_b()[0] = 1.5;
+  index_t k_aligned = model_ffm.get_aligned_k();
+  index_t num_row = hyper_param.num_feature * hyper_param.num_field;
+  std::vector<real_t> v(model_ffm.GetParameter_v(),
+                        model_ffm.GetParameter_v() +
+                        model_ffm.GetNumParameter_v());
+  // fp32: only the model is kept and aux_size = 1
+  model_ffm.SerializeInference(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_EQ(new_model.GetScoreFunction(), hyper_param.score_func);
+  EXPECT_EQ(new_model.GetLossFunction(), hyper_param.loss_func);
+  EXPECT_EQ(new_model.GetNumK(), 6);
+  EXPECT_EQ(new_model.GetNumField(), hyper_param.num_field);
+  EXPECT_EQ(new_model.GetAuxiliarySize(), 1);
+  EXPECT_EQ(new_model.GetLatentType(), kStoreFP32);
+  EXPECT_EQ(new_model.GetNumParameter_w(), hyper_param.num_feature);
+  EXPECT_EQ(new_model.GetNumParameter_v(), num_row * k_aligned);
+  EXPECT_FLOAT_EQ(new_model.GetParameter_b()[0], 1.5);
+  for (index_t i = 0; i < hyper_param.num_feature; ++i) {
+    EXPECT_FLOAT_EQ(new_model.GetParameter_w()[i], i * 3 * 0.5);
+  }
+  real_t* new_v = new_model.GetParameter_v();
+  for (index_t r = 0; r < num_row; ++r) {
+    for (index_t d = 0; d < k_aligned; ++d) {
+      EXPECT_FLOAT_EQ(new_v[r*k_aligned+d],
+        v[r*k_aligned*3 + (d/kAlign)*kAlign*3 + d%kAlign]);
+    }
+  }
+  // int8 is the same as ConvertLatent()
+  model_ffm.SerializeInference(hyper_param.model_file, kStoreInt8);
+  Model int8_model(hyper_param.model_file);
+  EXPECT_EQ(int8_model.GetLatentType(), kStoreInt8);
+  EXPECT_TRUE(int8_model.GetParameter_v() == nullptr);
+  model_ffm.ConvertLatent(kStoreInt8);
+  for (index_t i = 0; i < num_row * k_aligned; ++i) {
+    EXPECT_EQ(int8_model.GetParameter_v_int8()[i],
+              model_ffm.GetParameter_v_int8()[i]);
+  }
+  for (index_t r = 0; r < num_row; ++r) {
+    EXPECT_FLOAT_EQ(int8_model.GetParameter_v_scale()[r],
+                    model_ffm.GetParameter_v_scale()[r]);
+  }
+  // The converted model can be saved in its own type
+  model_ffm.SerializeInference(hyper_param.model_file, kStoreInt8);
+  Model int8_again(hyper_param.model_file);
+  for (index_t i = 0; i < num_row * k_aligned; ++i) {
+    EXPECT_EQ(int8_again.GetParameter_v_int8()[i],
+              model_ffm.GetParameter_v_int8()[i]);
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Save_and_Load_inference_half) {
+  HyperParam hyper_param = Init();
+  Model model_fm;
+  model_fm.Initialize("fm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    5, 2, 0.5);
+  model_fm.SerializeInference(hyper_param.model_file, kStoreBF16);
+  Model new_model(hyper_param.model_file);
+  EXPECT_EQ(new_model.GetLatentType(), kStoreBF16);
+  EXPECT_EQ(new_model.GetScoreFunction(), "fm");
+  model_fm.ConvertLatent(kStoreBF16);
+  index_t len = hyper_param.num_feature * model_fm.get_aligned_k();
+  for (index_t i = 0; i < len; ++i) {
+    EXPECT_EQ(new_model.GetParameter_v_half()[i],
+              model_fm.GetParameter_v_half()[i]);
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The inference model is used in the mapped file.
+TEST(MODEL_TEST, Load_inference_mapped) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    6, 1, 0.5);
+  model_ffm.GetParameter_b()[0] = 1.5;
+  model_ffm.Serialize(hyper_param.model_file);
+  Model checkpoint(hyper_param.model_file);
+  EXPECT_FALSE(checkpoint.IsMapped());
+  StorageType types[] = { kStoreFP32, kStoreBF16, kStoreInt8 };
+  for (int t = 0; t < 3; ++t) {
+    model_ffm.SerializeInference(hyper_param.model_file, types[t]);
+    Model mapped(hyper_param.model_file);
+    ASSERT_TRUE(mapped.IsMapped());
+    EXPECT_EQ(mapped.GetLatentType(), types[t]);
+    EXPECT_FLOAT_EQ(mapped.GetParameter_b()[0], 1.5);
+    EXPECT_EQ((size_t)mapped.GetParameter_w() % kAlignByte, 0);
+    for (index_t i = 0; i < hyper_param.num_feature; ++i) {
+      EXPECT_FLOAT_EQ(mapped.GetParameter_w()[i],
+                      model_ffm.GetParameter_w()[i]);
+    }
+    // The same as the model read to its own memory
+    Model loaded;
+    loaded.SetMemoryPolicy(true, kNumaNone, nullptr);
+    ASSERT_TRUE(loaded.Deserialize(hyper_param.model_file));
+    EXPECT_FALSE(loaded.IsMapped());
+    index_t len = loaded.GetNumParameter_v();
+    if (types[t] == kStoreFP32) {
+      EXPECT_EQ((size_t)mapped.GetParameter_v() % kAlignByte, 0);
+      for (index_t i = 0; i < len; ++i) {
+        EXPECT_FLOAT_EQ(mapped.GetParameter_v()[i],
+                        loaded.GetParameter_v()[i]);
+      }
+      // The mapped model can be converted
+      mapped.ConvertLatent(kStoreFP16);
+      EXPECT_TRUE(mapped.GetParameter_v_half() != nullptr);
+    } else if (types[t] == kStoreInt8) {
+      for (index_t i = 0; i < len; ++i) {
+        EXPECT_EQ(mapped.GetParameter_v_int8()[i],
+                  loaded.GetParameter_v_int8()[i]);
+      }
+      index_t num_row = hyper_param.num_feature * hyper_param.num_field;
+      for (index_t r = 0; r < num_row; ++r) {
+        EXPECT_FLOAT_EQ(mapped.GetParameter_v_scale()[r],
+                        loaded.GetParameter_v_scale()[r]);
+      }
+    } else {
+      for (index_t i = 0; i < len; ++i) {
+        EXPECT_EQ(mapped.GetParameter_v_half()[i],
+                  loaded.GetParameter_v_half()[i]);
+      }
+    }
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The inference file of the older version has no padding.
+TEST(MODEL_TEST, Load_inference_unaligned) {
+  std::string filename = "./test_model_old.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteStringToFile(file, std::string("xlearn_inference"));
+  WriteStringToFile(file, std::string("linear"));
+  WriteStringToFile(file, std::string("cross-entropy"));
+  index_t num_feat = 3, num_field = 0, num_K = 0, store = 0;
+  WriteDataToDisk(file, (char*)&num_feat, sizeof(num_feat));
+  WriteDataToDisk(file, (char*)&num_field, sizeof(num_field));
+  WriteDataToDisk(file, (char*)&num_K, sizeof(num_K));
+  WriteDataToDisk(file, (char*)&store, sizeof(store));
+  real_t w[4] = { 0.5, 1.5, 2.5, -1.0 };
+  WriteDataToDisk(file, (char*)w, sizeof(w));
+  Close(file);
+  Model model(filename);
+  EXPECT_FALSE(model.IsMapped());
+  EXPECT_EQ(model.GetNumFeature(), 3);
+  for (index_t i = 0; i < 3; ++i) {
+    EXPECT_FLOAT_EQ(model.GetParameter_w()[i], w[i]);
+  }
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0], -1.0);
+  RemoveFile(filename.c_str());
+}
+
+// The negative sampling rate is kept in both model files.
+TEST(MODEL_TEST, Save_and_Load_neg_rate) {
+  HyperParam hyper_param = Init();
+  Model model_lr;
+  model_lr.Initialize("linear",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    0, 1, 0.5);
+  EXPECT_FLOAT_EQ(model_lr.GetNegativeRate(), 1.0);
+  EXPECT_FLOAT_EQ(model_lr.GetScoreOffset(), 0.0);
+  // No rate is written for the rate 1
+  model_lr.Serialize(hyper_param.model_file);
+  Model full_model(hyper_param.model_file);
+  EXPECT_FLOAT_EQ(full_model.GetNegativeRate(), 1.0);
+  model_lr.SetNegativeRate(0.25);
+  EXPECT_FLOAT_EQ(model_lr.GetScoreOffset(), log(0.25));
+  model_lr.Serialize(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_FLOAT_EQ(new_model.GetNegativeRate(), 0.25);
+  EXPECT_FLOAT_EQ(new_model.GetScoreOffset(), log(0.25));
+  model_lr.SerializeInference(hyper_param.model_file);
+  Model inference_model(hyper_param.model_file);
+  EXPECT_FLOAT_EQ(inference_model.GetNegativeRate(), 0.25);
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Save_and_Load_feature_map) {
+  HyperParam hyper_param = Init();
+  Model model_lr;
+  model_lr.Initialize("linear",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    0, 1, 0.5);
+  model_lr.Serialize(hyper_param.model_file);
+  Model full_model(hyper_param.model_file);
+  EXPECT_TRUE(full_model.GetFeatureMap().empty());
+  std::vector<index_t> map = { 2, 0, 1, 3, 3, 3 };
+  model_lr.SetFeatureMap(map);
+  model_lr.SetNegativeRate(0.5);
+  model_lr.Serialize(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_EQ(new_model.GetFeatureMap(), map);
+  EXPECT_FLOAT_EQ(new_model.GetNegativeRate(), 0.5);
+  model_lr.SerializeInference(hyper_param.model_file);
+  Model inference_model(hyper_param.model_file);
+  EXPECT_EQ(inference_model.GetFeatureMap(), map);
+  RemoveFile(hyper_param.model_file.c_str());
+  // The ids out of the map are kept
+  SparseRow row;
+  row.push_back(Node(0, 0, 1.0));
+  row.push_back(Node(0, 4, 1.0));
+  row.push_back(Node(0, 9, 1.0));
+  new_model.MapFeatures(&row);
+  EXPECT_EQ(row[0].feat_id, 2);
+  EXPECT_EQ(row[1].feat_id, 3);
+  EXPECT_EQ(row[2].feat_id, 9);
+}
+
+TEST(MODEL_TEST, Save_and_Load_field_map) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize("ffm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    3,
+                    4, 1, 0.5);
+  // The fields 0, 2 and 5 of the data are the fields of the model
+  std::vector<index_t> map = { 0, 3, 1, 3, 3, 2 };
+  model_ffm.SetFieldMap(map);
+  model_ffm.Serialize(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_EQ(new_model.GetNumField(), 3);
+  EXPECT_EQ(new_model.GetFieldMap(), map);
+  EXPECT_TRUE(new_model.GetFeatureMap().empty());
+  model_ffm.SerializeInference(hyper_param.model_file);
+  Model inference_model(hyper_param.model_file);
+  EXPECT_EQ(inference_model.GetFieldMap(), map);
+  RemoveFile(hyper_param.model_file.c_str());
+  // The unused fields are out of the model, and the features are kept
+  SparseRow row;
+  row.push_back(Node(5, 1, 1.0));
+  row.push_back(Node(3, 2, 1.0));
+  row.push_back(Node(9, 3, 1.0));
+  new_model.MapFeatures(&row);
+  EXPECT_EQ(row[0].field_id, 2);
+  EXPECT_EQ(row[0].feat_id, 1);
+  EXPECT_EQ(row[1].field_id, 3);
+  EXPECT_EQ(row[2].field_id, 6);
+  EXPECT_EQ(row[2].feat_id, 3);
+}
+
+// The field weights of fwfm are kept in all the model files,
+// and in the best model.
+TEST(MODEL_TEST, Save_and_Load_field_weight) {
+  HyperParam hyper_param = Init();
+  Model model_fwfm;
+  model_fwfm.Initialize("fwfm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    4, 2, 0.5);
+  index_t num_field = hyper_param.num_field;
+  EXPECT_EQ(model_fwfm.GetNumParameter_r(), num_field * num_field * 2);
+  // The new weights are 1, which is the fm model
+  EXPECT_FLOAT_EQ(model_fwfm.GetFieldWeight(0, 1)[0], 1.0);
+  EXPECT_FLOAT_EQ(model_fwfm.GetFieldWeight(0, 1)[1], 1.0);
+  EXPECT_EQ(model_fwfm.GetFieldWeight(2, 1), model_fwfm.GetFieldWeight(1, 2));
+  for (index_t f1 = 0; f1 < num_field; ++f1) {
+    for (index_t f2 = f1; f2 < num_field; ++f2) {
+      model_fwfm.GetFieldWeight(f1, f2)[0] = f1 * 0.5 + f2;
+      model_fwfm.GetFieldWeight(f1, f2)[1] = f1 + f2 * 0.25;
+    }
+  }
+  model_fwfm.Serialize(hyper_param.model_file);
+  Model full_model(hyper_param.model_file);
+  model_fwfm.SerializeInference(hyper_param.model_file);
+  Model inference_model(hyper_param.model_file);
+  model_fwfm.SerializeSparse(hyper_param.model_file);
+  Model sparse_model(hyper_param.model_file);
+  for (index_t f1 = 0; f1 < num_field; ++f1) {
+    for (index_t f2 = f1; f2 < num_field; ++f2) {
+      EXPECT_FLOAT_EQ(full_model.GetFieldWeight(f1, f2)[0], f1 * 0.5 + f2);
+      EXPECT_FLOAT_EQ(full_model.GetFieldWeight(f1, f2)[1], f1 + f2 * 0.25);
+      EXPECT_FLOAT_EQ(sparse_model.GetFieldWeight(f1, f2)[1],
+                      f1 + f2 * 0.25);
+      EXPECT_FLOAT_EQ(inference_model.GetFieldWeight(f1, f2)[0],
+                      f1 * 0.5 + f2);
+    }
+  }
+  EXPECT_EQ(inference_model.GetNumParameter_r(), num_field * num_field);
+  // The txt model has one line for each pair of fields
+  model_fwfm.SerializeToTXT("test_txt.fwfm");
+  std::ifstream txt("test_txt.fwfm");
+  std::string text((std::istreambuf_iterator<char>(txt)),
+                   std::istreambuf_iterator<char>());
+  EXPECT_NE(text.find("r_0_1: 1\n"), std::string::npos);
+  EXPECT_NE(text.find("r_1_1: 1.5\n"), std::string::npos);
+  // The best model
+  model_fwfm.SetBestModel();
+  model_fwfm.GetFieldWeight(0, 1)[0] = 9.0;
+  model_fwfm.Shrink();
+  EXPECT_FLOAT_EQ(model_fwfm.GetFieldWeight(0, 1)[0], 1.0);
+  RemoveFile(hyper_param.model_file.c_str());
+  RemoveFile("test_txt.fwfm");
+}
+
+TEST(MODEL_TEST, Lazy_init) {
+  HyperParam hyper_param = Init();
+  Model model_1, model_2;
+  model_1.Initialize(hyper_param.score_func,
+                  hyper_param.loss_func,
+                  hyper_param.num_feature,
+                  hyper_param.num_field,
+                  hyper_param.num_K, 2, 1.0, true);
+  model_2.Initialize(hyper_param.score_func,
+                  hyper_param.loss_func,
+                  hyper_param.num_feature,
+                  hyper_param.num_field,
+                  hyper_param.num_K, 2, 1.0, true);
+  EXPECT_EQ(model_1.IsLazy(), true);
+  EXPECT_EQ(model_1.GetNumTouched(), (index_t)0);
+  SparseRow row_1, row_2;
+  row_1.push_back(Node(0, 1, 1.0));
+  row_1.push_back(Node(1, 3, 1.0));
+  row_2.push_back(Node(0, 3, 1.0));
+  row_2.push_back(Node(1, 1, 1.0));
+  row_2.push_back(Node(2, 2, 1.0));
+  model_1.Touch(&row_1);
+  EXPECT_EQ(model_1.GetNumTouched(), (index_t)2);
+  model_2.Touch(&row_2);
+  EXPECT_EQ(model_2.GetNumTouched(), (index_t)3);
+  // The initial value only depends on the feature id
+  index_t size_v = model_1.GetNumParameter_v() / hyper_param.num_feature;
+  real_t* w_1 = model_1.GetParameter_w();
+  real_t* w_2 = model_2.GetParameter_w();
+  real_t* v_1 = model_1.GetParameter_v();
+  real_t* v_2 = model_2.GetParameter_v();
+  for (index_t j = 1; j < hyper_param.num_feature; j += 2) {
+    EXPECT_FLOAT_EQ(w_1[j*2], w_2[j*2]);
+    EXPECT_FLOAT_EQ(w_1[j*2+1], 1.0);
+    for (index_t i = j*size_v; i < (j+1)*size_v; ++i) {
+      EXPECT_FLOAT_EQ(v_1[i], v_2[i]);
+    }
+  }
+  // Features are initialized before serialization
+  model_1.Serialize(hyper_param.model_file);
+  EXPECT_EQ(model_1.GetNumTouched(), hyper_param.num_feature);
+  Model new_model(hyper_param.model_file);
+  for (index_t i = 0; i < new_model.GetNumParameter_w(); i += 2) {
+    EXPECT_FLOAT_EQ(new_model.GetParameter_w()[i], 0.0);
+    EXPECT_FLOAT_EQ(new_model.GetParameter_w()[i+1], 1.0);
+  }
+  for (index_t i = 0; i < new_model.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(new_model.GetParameter_v()[i], v_1[i]);
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Lazy_BestModel) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2, 1.0, true);
+  SparseRow row_1, row_2;
+  row_1.push_back(Node(0, 1, 1.0));
+  row_2.push_back(Node(0, 2, 1.0));
+  model_ffm.Touch(&row_1);
+  real_t* w = model_ffm.GetParameter_w();
+  w[2] = 5.0;
+  model_ffm.SetBestModel();
+  w[2] = 6.0;
+  model_ffm.Touch(&row_2);
+  EXPECT_EQ(model_ffm.GetNumTouched(), (index_t)2);
+  model_ffm.Shrink();
+  EXPECT_FLOAT_EQ(w[2], 5.0);
+  EXPECT_EQ(model_ffm.GetNumTouched(), (index_t)1);
+}
+
+TEST(MODEL_TEST, Parallel_init) {
+  HyperParam hyper_param = Init();
+  hyper_param.num_feature = 13;
+  ThreadPool pool_1(1), pool_3(3);
+  Model model_1, model_3, model_none, model_seq, model_lazy;
+  model_1.SetMemoryPolicy(true, kNumaLocal, &pool_1);
+  model_3.SetMemoryPolicy(false, kNumaInterleave, &pool_3);
+  model_none.SetMemoryPolicy(false, kNumaNone, &pool_3);
+  Model* models[] = {&model_1, &model_3, &model_none,
+                     &model_seq, &model_lazy};
+  for (int m = 0; m < 5; ++m) {
+    models[m]->Initialize(hyper_param.score_func,
+                       hyper_param.loss_func,
+                       hyper_param.num_feature,
+                       hyper_param.num_field,
+                       hyper_param.num_K, 2, 1.0, m == 4);
+  }
+  // Reset gives the same model again
+  model_none.GetParameter_v()[0] = 9.0;
+  model_none.Reset();
+  // The same as the lazy model after every feature is touched
+  SparseRow row;
+  for (index_t j = 0; j < hyper_param.num_feature; ++j) {
+    row.push_back(Node(0, j, 1.0));
+  }
+  model_lazy.Touch(&row);
+  for (int m = 0; m < 4; ++m) {
+    for (offset_t i = 0; i < model_lazy.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(models[m]->GetParameter_w()[i],
+                      model_lazy.GetParameter_w()[i]);
+    }
+    for (offset_t i = 0; i < model_lazy.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(models[m]->GetParameter_v()[i],
+                      model_lazy.GetParameter_v()[i]);
+    }
+    EXPECT_FLOAT_EQ(models[m]->GetParameter_b()[0], 0.0);
+    EXPECT_FLOAT_EQ(models[m]->GetParameter_b()[1], 1.0);
+  }
+}
+
+TEST(MODEL_TEST, Grow) {
+  HyperParam hyper_param = Init();
+  const char* scores[] = { "ffm", "fm", "linear" };
+  for (int s = 0; s < 3; ++s) {
+    for (int lazy = 0; lazy < 2; ++lazy) {
+      Model model, model_big;
+      model.Initialize(scores[s], hyper_param.loss_func, 4,
+                       hyper_param.num_field, hyper_param.num_K,
+                       2, 1.0, lazy == 1);
+      model_big.Initialize(scores[s], hyper_param.loss_func, 9,
+                           hyper_param.num_field, hyper_param.num_K,
+                           2, 1.0, lazy == 1);
+      if (lazy == 1) {
+        SparseRow row;
+        row.push_back(Node(0, 1, 1.0));
+        model.Touch(&row);
+        model_big.Touch(&row);
+      }
+      // The trained parameter and its gradient cache are kept
+      model.GetParameter_w()[2] = 7.0;
+      model.GetParameter_w()[3] = 3.0;
+      model.Grow(2);
+      EXPECT_EQ(model.GetNumFeature(), (index_t)4);
+      EXPECT_EQ(model.GetCapacity(), (index_t)4);
+      model.Grow(8);
+      EXPECT_EQ(model.GetNumFeature(), (index_t)8);
+      EXPECT_EQ(model.GetCapacity(), (index_t)8);
+      model.Grow(9);
+      EXPECT_EQ(model.GetNumFeature(), (index_t)9);
+      EXPECT_EQ(model.GetCapacity(), (index_t)10);
+      EXPECT_EQ(model.GetNumParameter_w(), model_big.GetNumParameter_w());
+      EXPECT_EQ(model.GetNumParameter_v(), model_big.GetNumParameter_v());
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[2], 7.0);
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[3], 3.0);
+      model.GetParameter_w()[2] = model_big.GetParameter_w()[2];
+      model.GetParameter_w()[3] = model_big.GetParameter_w()[3];
+      // The new features are the same as the bigger model
+      model.Densify();
+      model_big.Densify();
+      for (offset_t i = 0; i < model.GetNumParameter_w(); ++i) {
+        EXPECT_FLOAT_EQ(model.GetParameter_w()[i],
+                        model_big.GetParameter_w()[i]);
+      }
+      for (offset_t i = 0; i < model.GetNumParameter_v(); ++i) {
+        EXPECT_FLOAT_EQ(model.GetParameter_v()[i],
+                        model_big.GetParameter_v()[i]);
+      }
+      // The small grow is done in place by the headroom
+      real_t* w = model.GetParameter_w();
+      model.Grow(10);
+      EXPECT_EQ(model.GetNumFeature(), (index_t)10);
+      EXPECT_EQ(model.GetParameter_w(), w);
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[2],
+                      model_big.GetParameter_w()[2]);
+    }
+  }
+}
+
+TEST(MODEL_TEST, Replicate) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  EXPECT_EQ(model_ffm.GetReplica(0), &model_ffm);
+  model_ffm.ConvertLatent(kStoreInt8);
+  model_ffm.Replicate(2);
+  EXPECT_EQ(model_ffm.GetReplica(-1), &model_ffm);
+  EXPECT_EQ(model_ffm.GetReplica(2), &model_ffm);
+  offset_t num_v = (offset_t)hyper_param.num_feature *
+                   hyper_param.num_field * model_ffm.get_aligned_k();
+  for (int n = 0; n < 2; ++n) {
+    Model* r = model_ffm.GetReplica(n);
+    EXPECT_NE(r, &model_ffm);
+    EXPECT_EQ(r->GetLatentType(), kStoreInt8);
+    EXPECT_EQ(r->GetNumFeature(), hyper_param.num_feature);
+    for (offset_t i = 0; i < model_ffm.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(r->GetParameter_w()[i],
+                      model_ffm.GetParameter_w()[i]);
+    }
+    for (offset_t i = 0; i < num_v; ++i) {
+      EXPECT_EQ(r->GetParameter_v_int8()[i],
+                model_ffm.GetParameter_v_int8()[i]);
+    }
+    offset_t num_row = num_v / model_ffm.get_aligned_k();
+    for (offset_t i = 0; i < num_row; ++i) {
+      EXPECT_FLOAT_EQ(r->GetParameter_v_scale()[i],
+                      model_ffm.GetParameter_v_scale()[i]);
+    }
+    EXPECT_FLOAT_EQ(r->GetParameter_b()[0],
+                    model_ffm.GetParameter_b()[0]);
+  }
+}
+
+// The copies trained apart are averaged to one model.
+TEST(MODEL_TEST, Sync_replicas) {
+  HyperParam hyper_param = Init();
+  ThreadPool pool(3);
+  Model model_ffm;
+  model_ffm.SetMemoryPolicy(false, kNumaNone, &pool);
+  // The latent factors are split over the threads
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    4000,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  model_ffm.Replicate(2);
+  Model* r_0 = model_ffm.GetReplica(0);
+  Model* r_1 = model_ffm.GetReplica(1);
+  offset_t num_w = model_ffm.GetNumParameter_w();
+  offset_t num_v = model_ffm.GetNumParameter_v();
+  for (offset_t i = 0; i < num_w; ++i) {
+    r_0->GetParameter_w()[i] = 1.0;
+    r_1->GetParameter_w()[i] = 3.0;
+  }
+  for (offset_t i = 0; i < num_v; ++i) {
+    r_0->GetParameter_v()[i] = i;
+    r_1->GetParameter_v()[i] = -2.0 * i;
+  }
+  r_0->GetParameter_b()[0] = 0.5;
+  r_1->GetParameter_b()[0] = 1.5;
+  model_ffm.SyncReplicas();
+  for (Model* m : { &model_ffm, r_0, r_1 }) {
+    for (offset_t i = 0; i < num_w; ++i) {
+      EXPECT_FLOAT_EQ(m->GetParameter_w()[i], 2.0);
+    }
+    for (offset_t i = 0; i < num_v; ++i) {
+      EXPECT_FLOAT_EQ(m->GetParameter_v()[i], -0.5 * i);
+    }
+    EXPECT_FLOAT_EQ(m->GetParameter_b()[0], 1.0);
+  }
+  model_ffm.ClearReplicas();
+  EXPECT_EQ(model_ffm.GetReplica(0), &model_ffm);
+}
+
+TEST(MODEL_TEST, Lazy_regu) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 1);
+  model_ffm.SetLazyRegu(0.1, 0.5);
+  EXPECT_TRUE(model_ffm.IsLazyRegu());
+  real_t* w = model_ffm.GetParameter_w();
+  real_t* v = model_ffm.GetParameter_v();
+  offset_t size_v = model_ffm.GetNumParameter_v() /
+                    hyper_param.num_feature;
+  for (index_t j = 0; j < 3; ++j) {
+    w[j] = 1.0;
+    v[j*size_v] = 2.0;
+  }
+  SparseRow row_0, row_1;
+  row_0.push_back(Node(0, 0, 1.0));
+  row_1.push_back(Node(0, 1, 1.0));
+  model_ffm.LazyRegu(&row_0);  // step 1
+  EXPECT_FLOAT_EQ(w[0], 1.0);
+  for (int i = 0; i < 3; ++i) {
+    model_ffm.LazyRegu(&row_1);  // step 2, 3, 4
+  }
+  EXPECT_FLOAT_EQ(w[1], pow(0.95, 1));
+  model_ffm.LazyRegu(&row_0);  // step 5
+  EXPECT_FLOAT_EQ(w[0], pow(0.95, 3));
+  EXPECT_FLOAT_EQ(v[0], 2.0 * pow(0.95, 3));
+  model_ffm.FlushLazyRegu();
+  EXPECT_FLOAT_EQ(w[0], pow(0.95, 3));
+  EXPECT_FLOAT_EQ(w[1], pow(0.95, 1) * 0.95);
+  EXPECT_FLOAT_EQ(w[2], pow(0.95, 5));
+  EXPECT_FLOAT_EQ(v[2*size_v], 2.0 * pow(0.95, 5));
+  // Reset() starts over again
+  model_ffm.Reset();
+  w[0] = 1.0;
+  model_ffm.FlushLazyRegu();
+  EXPECT_FLOAT_EQ(w[0], 1.0);
+}
+
+TEST(MODEL_TEST, Lazy_regu_adagrad) {
+  HyperParam hyper_param = Init();
+  Model model_fm;
+  model_fm.Initialize("fm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  model_fm.SetLazyRegu(0.1, 0.5);
+  real_t* w = model_fm.GetParameter_w();
+  real_t* v = model_fm.GetParameter_v();
+  index_t k = model_fm.get_aligned_k();
+  w[0] = 1.0;
+  w[1] = 4.0;
+  v[0] = 1.0;
+  v[k] = 0.25;
+  SparseRow row_1;
+  row_1.push_back(Node(0, 1, 1.0));
+  model_fm.LazyRegu(&row_1);
+  model_fm.LazyRegu(&row_1);
+  model_fm.FlushLazyRegu();
+  // rate = 0.05 / sqrt(cache)
+  EXPECT_FLOAT_EQ(w[0], pow(0.975, 2));
+  EXPECT_FLOAT_EQ(v[0], pow(0.9, 2));
+  EXPECT_FLOAT_EQ(w[1], 4.0);
+}
+
+TEST(MODEL_TEST, Local_params) {
+  HyperParam hyper_param = Init();
+  Model model_lr;
+  model_lr.Initialize("linear",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  model_lr.SetLocalParams(2, 1);
+  EXPECT_TRUE(model_lr.IsLocal());
+  // Feature 2 is the most frequent one
+  DMatrix matrix;
+  matrix.ReAlloc(3);
+  for (int i = 0; i < 3; ++i) {
+    matrix.row[i] = new SparseRow;
+    matrix.AddNode(i, 2, 1.0);
+    matrix.AddNode(i, i == 0 ? 1 : 3, 1.0);
+  }
+  model_lr.ChooseHotFeatures(&matrix);
+  real_t* b = model_lr.GetParameter_b();
+  real_t* w = model_lr.GetParameter_w();
+  model_lr.BeginLocal();
+  real_t* local_b = model_lr.GetParameter_b();
+  EXPECT_NE(local_b, b);
+  EXPECT_NE(model_lr.GetLinear(2), w + 2 * 2);
+  // The cold features are shared
+  EXPECT_EQ(model_lr.GetLinear(1), w + 1 * 2);
+  local_b[0] += 1.0;
+  local_b[1] += 2.0;
+  model_lr.GetLinear(2)[0] += 3.0;
+  model_lr.LocalStep();
+  EXPECT_FLOAT_EQ(b[0], 0);
+  EXPECT_FLOAT_EQ(w[2 * 2], 0);
+  // Merge on the second row
+  b[0] += 10.0;  /* update from the other thread */
+  model_lr.LocalStep();
+  EXPECT_FLOAT_EQ(b[0], 11.0);
+  EXPECT_FLOAT_EQ(b[1], 3.0);
+  EXPECT_FLOAT_EQ(w[2 * 2], 3.0);
+  EXPECT_FLOAT_EQ(model_lr.GetParameter_b()[0], 11.0);
+  model_lr.GetParameter_b()[0] += 1.0;
+  model_lr.EndLocal();
+  EXPECT_FLOAT_EQ(b[0], 12.0);
+  EXPECT_EQ(model_lr.GetParameter_b(), b);
+  EXPECT_EQ(model_lr.GetLinear(2), w + 2 * 2);
+}
+
+// The hot features are given by their ids, e.g., of FeatureStats.
+TEST(MODEL_TEST, Set_hot_features) {
+  HyperParam hyper_param = Init();
+  Model model_lr;
+  model_lr.Initialize("linear",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  model_lr.SetLocalParams(2, 2);
+  real_t* w = model_lr.GetParameter_w();
+  // The id out of the model and the third id are ignored
+  std::vector<index_t> ids = { 3, hyper_param.num_feature, 1, 2 };
+  model_lr.SetHotFeatures(ids);
+  // It is chosen only once
+  DMatrix matrix;
+  matrix.ReAlloc(1);
+  matrix.row[0] = new SparseRow;
+  matrix.AddNode(0, 2, 1.0);
+  model_lr.ChooseHotFeatures(&matrix);
+  model_lr.BeginLocal();
+  EXPECT_NE(model_lr.GetLinear(3), w + 3 * 2);
+  EXPECT_NE(model_lr.GetLinear(1), w + 1 * 2);
+  EXPECT_EQ(model_lr.GetLinear(2), w + 2 * 2);
+  model_lr.EndLocal();
+}
+
+// The deltas of all the threads are added to the shared model.
+TEST(MODEL_TEST, Local_params_threads) {
+  HyperParam hyper_param = Init();
+  Model model_lr;
+  model_lr.Initialize("linear",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 1);
+  model_lr.SetLocalParams(7, 0);
+  ThreadPool pool(4);
+  for (int t = 0; t < 4; ++t) {
+    pool.enqueue([&model_lr]() {
+      model_lr.BeginLocal();
+      for (int i = 0; i < 1000; ++i) {
+        model_lr.GetParameter_b()[0] += 1.0;
+        model_lr.LocalStep();
+      }
+      model_lr.EndLocal();
+    });
+  }
+  pool.Sync(4);
+  EXPECT_FLOAT_EQ(model_lr.GetParameter_b()[0], 4000.0);
+}
+
+// The features of distributed training are the linear and
+// latent values of a feature, and the bias after the features.
+TEST(MODEL_TEST, Get_set_features) {
+  HyperParam hyper_param = Init();
+  Model model_fm;
+  model_fm.Initialize("fm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  index_t size = model_fm.GetFeatureSize();
+  index_t size_v = model_fm.GetNumK() * 2;
+  EXPECT_EQ(size, 2 + size_v);
+  std::vector<index_t> ids = { 3, 4, 1 };
+  std::vector<real_t> value(ids.size() * size);
+  for (size_t i = 0; i < value.size(); ++i) {
+    value[i] = i;
+  }
+  model_fm.SetFeatures(ids, value.data());
+  real_t* w = model_fm.GetParameter_w();
+  real_t* v = model_fm.GetParameter_v();
+  real_t* b = model_fm.GetParameter_b();
+  EXPECT_FLOAT_EQ(w[3 * 2], 0);
+  EXPECT_FLOAT_EQ(w[3 * 2 + 1], 1);
+  EXPECT_FLOAT_EQ(v[3 * size_v], 2);
+  EXPECT_FLOAT_EQ(b[0], size);
+  EXPECT_FLOAT_EQ(b[1], size + 1);
+  EXPECT_FLOAT_EQ(w[1 * 2], 2 * size);
+  EXPECT_FLOAT_EQ(v[1 * size_v + size_v - 1], 3 * size - 1);
+  std::vector<real_t> result(ids.size() * size, -1);
+  model_fm.GetFeatures(ids, result.data());
+  for (size_t i = 0; i < result.size(); ++i) {
+    // The bias only has the aux values
+    if (i >= size + 2 && i < 2 * size) {
+      EXPECT_FLOAT_EQ(result[i], 0);
+    } else {
+      EXPECT_FLOAT_EQ(result[i], value[i]);
+    }
+  }
+}
+
+// Feature j moves to map[j], and the inverse map moves it back.
+TEST(MODEL_TEST, Remap_features) {
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize("ffm",
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  std::vector<index_t> ids = { 0, 1, 2, 3 };
+  index_t size = model_ffm.GetFeatureSize();
+  std::vector<real_t> value(ids.size() * size);
+  for (size_t i = 0; i < value.size(); ++i) {
+    value[i] = i;
+  }
+  model_ffm.SetFeatures(ids, value.data());
+  model_ffm.SetLocalParams(2, 1);
+  model_ffm.SetHotFeatures({ 3 });
+  std::vector<index_t> map = { 2, 0, 3, 1 };
+  model_ffm.RemapFeatures(map);
+  std::vector<real_t> result(value.size());
+  model_ffm.GetFeatures(map, result.data());
+  EXPECT_EQ(result, value);
+  // Feature 3 is the hot feature 1 now
+  real_t* w = model_ffm.GetParameter_w();
+  model_ffm.BeginLocal();
+  EXPECT_NE(model_ffm.GetLinear(1), w + 1 * 2);
+  EXPECT_EQ(model_ffm.GetLinear(3), w + 3 * 2);
+  model_ffm.EndLocal();
+  std::vector<index_t> inverse = { 1, 3, 0, 2 };
+  model_ffm.RemapFeatures(inverse);
+  model_ffm.GetFeatures(ids, result.data());
+  EXPECT_EQ(result, value);
+}
+
+// The first model copies its parameters to the buffer, and the
+// second one takes them, so both of them see the same update.
+TEST(MODEL_TEST, Share_parameters) {
+  HyperParam hyper_param = Init();
+  const char* scores[] = { "ffm", "fm", "linear" };
+  for (int s = 0; s < 3; ++s) {
+    std::unique_ptr<Model> model(new Model), other(new Model);
+    Model expect;
+    model->Initialize(scores[s], hyper_param.loss_func,
+                      hyper_param.num_feature, hyper_param.num_field,
+                      hyper_param.num_K, 2);
+    expect.Initialize(scores[s], hyper_param.loss_func,
+                      hyper_param.num_feature, hyper_param.num_field,
+                      hyper_param.num_K, 2);
+    other->Initialize(scores[s], hyper_param.loss_func,
+                      hyper_param.num_feature, hyper_param.num_field,
+                      hyper_param.num_K, 2);
+    uint64 size = model->GetSharedSize();
+    EXPECT_EQ(other->GetSharedSize(), size);
+    char* buffer = (char*)AllocAligned(size, kAlignByte, false);
+    model->GetParameter_b()[0] = 5.0;
+    expect.GetParameter_b()[0] = 5.0;
+    model->ShareParameters(buffer, true);
+    other->ShareParameters(buffer, false);
+    EXPECT_TRUE(model->IsShared());
+    EXPECT_EQ(model->GetParameter_w(), other->GetParameter_w());
+    EXPECT_EQ(model->GetParameter_v(), other->GetParameter_v());
+    EXPECT_EQ(model->GetParameter_b(), other->GetParameter_b());
+    for (offset_t i = 0; i < model->GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(other->GetParameter_w()[i],
+                      expect.GetParameter_w()[i]);
+    }
+    for (offset_t i = 0; i < model->GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(other->GetParameter_v()[i],
+                      expect.GetParameter_v()[i]);
+    }
+    EXPECT_FLOAT_EQ(other->GetParameter_b()[0], 5.0);
+    other->GetParameter_w()[4] = 3.0;
+    EXPECT_FLOAT_EQ(model->GetParameter_w()[4], 3.0);
+    // The models do not free the buffer
+    model.reset();
+    EXPECT_FLOAT_EQ(other->GetParameter_w()[4], 3.0);
+    other.reset();
+    FreeAligned(buffer);
+  }
+}
+
+// The model in the file has the same values as the one in memory,
+// it can be remapped and saved, and the file is removed with it.
+TEST(MODEL_TEST, Param_file) {
+  HyperParam hyper_param = Init();
+  std::string score_func[3] = { "linear", "fm", "ffm" };
+  std::string filename = "./test_model.swap";
+  for (int i = 0; i < 3; ++i) {
+    Model model;
+    model.Initialize(score_func[i], hyper_param.loss_func,
+                     hyper_param.num_feature, hyper_param.num_field,
+                     hyper_param.num_K, 2);
+    {
+      Model file_model;
+      file_model.SetParamFile(filename);
+      file_model.Initialize(score_func[i], hyper_param.loss_func,
+                            hyper_param.num_feature,
+                            hyper_param.num_field,
+                            hyper_param.num_K, 2);
+      EXPECT_TRUE(file_model.IsFileBacked());
+      EXPECT_FALSE(model.IsFileBacked());
+      EXPECT_TRUE(FileExist(filename.c_str()));
+      EXPECT_EQ((size_t)file_model.GetParameter_w() % kAlignByte, 0);
+      EXPECT_EQ((size_t)file_model.GetParameter_v() % kAlignByte, 0);
+      for (index_t j = 0; j < model.GetNumParameter_w(); ++j) {
+        EXPECT_FLOAT_EQ(file_model.GetParameter_w()[j],
+                        model.GetParameter_w()[j]);
+      }
+      for (index_t j = 0; j < model.GetNumParameter_v(); ++j) {
+        EXPECT_FLOAT_EQ(file_model.GetParameter_v()[j],
+                        model.GetParameter_v()[j]);
+      }
+      EXPECT_TRUE(file_model.LockFeatures(2));
+      std::vector<index_t> map = { 2, 0, 3, 1 };
+      std::vector<index_t> inverse = { 1, 3, 0, 2 };
+      file_model.RemapFeatures(map);
+      file_model.RemapFeatures(inverse);
+      file_model.Serialize(hyper_param.model_file);
+      Model loaded(hyper_param.model_file);
+      EXPECT_FALSE(loaded.IsFileBacked());
+      for (index_t j = 0; j < model.GetNumParameter_w(); ++j) {
+        EXPECT_FLOAT_EQ(loaded.GetParameter_w()[j],
+                        model.GetParameter_w()[j]);
+      }
+      for (index_t j = 0; j < model.GetNumParameter_v(); ++j) {
+        EXPECT_FLOAT_EQ(loaded.GetParameter_v()[j],
+                        model.GetParameter_v()[j]);
+      }
+      RemoveFile(hyper_param.model_file.c_str());
+    }
+    EXPECT_FALSE(FileExist(filename.c_str()));
+  }
+}
+
+// The split layout keeps the same values as the interleaved
+// layout, and the files of both layouts are the same.
+TEST(MODEL_TEST, Split_layout) {
+  HyperParam hyper_param = Init();
+  std::string split_file = "./test_model.split";
+  index_t k[2] = { 4, 6 };
+  for (index_t aux = 2; aux <= 3; ++aux) {
+    for (int i = 0; i < 2; ++i) {
+      Model model, split;
+      model.Initialize("ffm", hyper_param.loss_func,
+                       hyper_param.num_feature, hyper_param.num_field,
+                       k[i], aux);
+      split.SetSplitLayout(true);
+      split.Initialize("ffm", hyper_param.loss_func,
+                       hyper_param.num_feature, hyper_param.num_field,
+                       k[i], aux);
+      EXPECT_FALSE(model.IsSplitLayout());
+      EXPECT_TRUE(split.IsSplitLayout());
+      // The weights of feature 1 are together, and then the aux
+      index_t k_aligned = model.get_aligned_k();
+      offset_t size_v = split.GetNumParameter_v() / hyper_param.num_feature;
+      const real_t* v = model.GetParameter_v() + size_v;
+      const real_t* s = split.GetParameter_v() + size_v;
+      for (index_t d = 0; d < hyper_param.num_field * k_aligned; ++d) {
+        offset_t pos = (d - d % kAlign) * aux + d % kAlign;
+        EXPECT_FLOAT_EQ(s[d], v[pos]);
+        EXPECT_FLOAT_EQ(s[d + hyper_param.num_field * k_aligned],
+                        v[pos + kAlign]);
+      }
+      // The values of the parameter server and the files
+      std::vector<index_t> ids = { 0, 1, 2, 3 };
+      std::vector<real_t> value(ids.size() * model.GetFeatureSize());
+      std::vector<real_t> split_value(value.size());
+      model.GetFeatures(ids, value.data());
+      split.GetFeatures(ids, split_value.data());
+      EXPECT_TRUE(value == split_value);
+      for (size_t n = 0; n < value.size(); ++n) { value[n] = n; }
+      model.SetFeatures(ids, value.data());
+      split.SetFeatures(ids, value.data());
+      model.Serialize(hyper_param.model_file);
+      split.Serialize(split_file);
+      std::ifstream a(hyper_param.model_file.c_str(), std::ios::binary);
+      std::ifstream b(split_file.c_str(), std::ios::binary);
+      std::string bytes_a((std::istreambuf_iterator<char>(a)),
+                          std::istreambuf_iterator<char>());
+      std::string bytes_b((std::istreambuf_iterator<char>(b)),
+                          std::istreambuf_iterator<char>());
+      EXPECT_TRUE(bytes_a == bytes_b);
+      Model loaded;
+      loaded.SetSplitLayout(true);
+      ASSERT_TRUE(loaded.Deserialize(hyper_param.model_file));
+      EXPECT_TRUE(loaded.IsSplitLayout());
+      for (offset_t n = 0; n < split.GetNumParameter_v(); ++n) {
+        EXPECT_FLOAT_EQ(loaded.GetParameter_v()[n],
+                        split.GetParameter_v()[n]);
+      }
+      // The latent factors without aux are the same
+      std::vector<real_t> latent(model.GetNumParameter_v() / aux);
+      std::vector<real_t> split_latent(latent.size());
+      model.GetWeights(value.data(), latent.data());
+      split.GetWeights(value.data(), split_latent.data());
+      EXPECT_TRUE(latent == split_latent);
+      RemoveFile(hyper_param.model_file.c_str());
+      RemoveFile(split_file.c_str());
+    }
+  }
+  // It is ignored by fm and the model without aux
+  Model fm, sgd;
+  fm.SetSplitLayout(true);
+  fm.Initialize("fm", hyper_param.loss_func, hyper_param.num_feature,
+                hyper_param.num_field, hyper_param.num_K, 2);
+  EXPECT_FALSE(fm.IsSplitLayout());
+  sgd.SetSplitLayout(true);
+  sgd.Initialize("ffm", hyper_param.loss_func, hyper_param.num_feature,
+                 hyper_param.num_field, hyper_param.num_K, 1);
+  EXPECT_FALSE(sgd.IsSplitLayout());
+}
+
+TEST(MODEL_TEST, Field_major) {
+  HyperParam hyper_param = Init();
+  std::string field_file = "./test_model.field";
+  index_t num_feat = hyper_param.num_feature;
+  index_t num_field = hyper_param.num_field;
+  index_t k[2] = { 4, 6 };
+  for (index_t aux = 1; aux <= 2; ++aux) {
+    for (int i = 0; i < 2; ++i) {
+      Model model, field;
+      model.Initialize("ffm", hyper_param.loss_func,
+                       num_feat, num_field, k[i], aux);
+      field.SetFieldMajor(true);
+      field.Initialize("ffm", hyper_param.loss_func,
+                       num_feat, num_field, k[i], aux);
+      EXPECT_FALSE(model.IsFieldMajor());
+      EXPECT_TRUE(field.IsFieldMajor());
+      // V_j_f is the (f * num_feat + j)-th row
+      offset_t size = model.get_aligned_k() * aux;
+      for (index_t j = 0; j < num_feat; ++j) {
+        for (index_t f = 0; f < num_field; ++f) {
+          const real_t* v = model.GetParameter_v() +
+                            ((offset_t)j * num_field + f) * size;
+          const real_t* w = field.GetParameter_v() +
+                            ((offset_t)f * num_feat + j) * size;
+          for (offset_t d = 0; d < size; ++d) {
+            EXPECT_FLOAT_EQ(v[d], w[d]);
+          }
+        }
+      }
+      // The values of the parameter server and the files
+      std::vector<index_t> ids = { 0, 1, 2, 3 };
+      std::vector<real_t> value(ids.size() * model.GetFeatureSize());
+      std::vector<real_t> field_value(value.size());
+      model.GetFeatures(ids, value.data());
+      field.GetFeatures(ids, field_value.data());
+      EXPECT_TRUE(value == field_value);
+      for (size_t n = 0; n < value.size(); ++n) { value[n] = n; }
+      model.SetFeatures(ids, value.data());
+      field.SetFeatures(ids, value.data());
+      // The best model and the remap keep the same values
+      model.SetBestModel();
+      field.SetBestModel();
+      std::vector<index_t> map(num_feat);
+      for (index_t j = 0; j < num_feat; ++j) {
+        map[j] = (j + 3) % num_feat;
+      }
+      model.RemapFeatures(map);
+      field.RemapFeatures(map);
+      field.SetFeatures(ids, field_value.data());
+      field.Shrink();
+      model.Serialize(hyper_param.model_file);
+      field.Serialize(field_file);
+      std::ifstream a(hyper_param.model_file.c_str(), std::ios::binary);
+      std::ifstream b(field_file.c_str(), std::ios::binary);
+      std::string bytes_a((std::istreambuf_iterator<char>(a)),
+                          std::istreambuf_iterator<char>());
+      std::string bytes_b((std::istreambuf_iterator<char>(b)),
+                          std::istreambuf_iterator<char>());
+      EXPECT_TRUE(bytes_a == bytes_b);
+      Model loaded;
+      loaded.SetFieldMajor(true);
+      ASSERT_TRUE(loaded.Deserialize(hyper_param.model_file));
+      EXPECT_TRUE(loaded.IsFieldMajor());
+      for (offset_t n = 0; n < field.GetNumParameter_v(); ++n) {
+        EXPECT_FLOAT_EQ(loaded.GetParameter_v()[n],
+                        field.GetParameter_v()[n]);
+      }
+      // The latent factors without aux are the same
+      std::vector<real_t> linear(num_feat);
+      std::vector<real_t> latent(model.GetNumParameter_v() / aux);
+      std::vector<real_t> field_latent(latent.size());
+      model.GetWeights(linear.data(), latent.data());
+      field.GetWeights(linear.data(), field_latent.data());
+      EXPECT_TRUE(latent == field_latent);
+      RemoveFile(hyper_param.model_file.c_str());
+      RemoveFile(field_file.c_str());
+    }
+  }
+  // It is ignored by fm and the split layout
+  Model fm, split;
+  fm.SetFieldMajor(true);
+  fm.Initialize("fm", hyper_param.loss_func, num_feat,
+                num_field, hyper_param.num_K, 2);
+  EXPECT_FALSE(fm.IsFieldMajor());
+  split.SetSplitLayout(true);
+  split.SetFieldMajor(true);
+  split.Initialize("ffm", hyper_param.loss_func, num_feat,
+                   num_field, hyper_param.num_K, 2);
+  EXPECT_TRUE(split.IsSplitLayout());
+  EXPECT_FALSE(split.IsFieldMajor());
+}
+
+TEST(MODEL_TEST, Opt_state) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize("ffm", hyper_param.loss_func,
+                   hyper_param.num_feature, hyper_param.num_field,
+                   hyper_param.num_K, 2, 1.0, false, PackBF16(1.0, 1.0));
+  EXPECT_EQ(model.GetOptState(), kStoreFP32);
+  model.SetOptState(kStoreBF16);
+  model.Serialize(hyper_param.model_file);
+  Model loaded(hyper_param.model_file);
+  EXPECT_EQ(loaded.GetOptState(), kStoreBF16);
+  EXPECT_EQ(loaded.GetAuxiliarySize(), 2);
+  // The state is not kept by the model of inference
+  model.SerializeInference(hyper_param.model_file);
+  Model inference(hyper_param.model_file);
+  EXPECT_EQ(inference.GetOptState(), kStoreFP32);
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Prune) {
+  HyperParam hyper_param = Init();
+  std::string split_file = "./test_model.split";
+  index_t num_feat = hyper_param.num_feature;
+  index_t num_field = hyper_param.num_field;
+  index_t num_K = hyper_param.num_K;
+  Model model, split;
+  model.Initialize("ffm", hyper_param.loss_func,
+                   num_feat, num_field, num_K, 2, 0.5);
+  split.SetSplitLayout(true);
+  split.Initialize("ffm", hyper_param.loss_func,
+                   num_feat, num_field, num_K, 2, 0.5);
+  model.SetBestModel();
+  std::vector<real_t> linear(num_feat + 1);
+  std::vector<real_t> latent((offset_t)num_feat * num_field * num_K);
+  model.GetWeights(linear.data(), latent.data());
+  // The vectors below the median of the norms become zero
+  std::vector<real_t> norm((offset_t)num_feat * num_field, 0);
+  for (offset_t r = 0; r < norm.size(); ++r) {
+    for (index_t d = 0; d < num_K; ++d) {
+      norm[r] += latent[r * num_K + d] * latent[r * num_K + d];
+    }
+    norm[r] = std::sqrt(norm[r]);
+  }
+  std::vector<real_t> sorted = norm;
+  std::sort(sorted.begin(), sorted.end());
+  real_t threshold = (sorted[sorted.size() / 2 - 1] +
+                      sorted[sorted.size() / 2]) / 2;
+  offset_t small = 0;
+  for (offset_t r = 0; r < norm.size(); ++r) {
+    if (norm[r] < threshold) {
+      std::fill(latent.begin() + r * num_K,
+                latent.begin() + (r + 1) * num_K, 0);
+      small++;
+    }
+  }
+  ASSERT_GT(small, 0);
+  ASSERT_LT(small, (offset_t)num_feat * num_field);
+  EXPECT_EQ(model.Prune(threshold), small);
+  EXPECT_EQ(split.Prune(threshold), small);
+  EXPECT_FALSE(model.IsSplitLayout());
+  EXPECT_FALSE(split.IsSplitLayout());
+  EXPECT_EQ(model.GetFieldIndex().NumBlocks(),
+            (offset_t)num_feat * num_field - small);
+  std::vector<real_t> pruned(latent.size());
+  model.GetWeights(linear.data(), pruned.data());
+  EXPECT_TRUE(pruned == latent);
+  // The kept vectors keep their gradient cache
+  model.Serialize(hyper_param.model_file);
+  split.Serialize(split_file);
+  std::ifstream a(hyper_param.model_file.c_str(), std::ios::binary);
+  std::ifstream b(split_file.c_str(), std::ios::binary);
+  std::string bytes_a((std::istreambuf_iterator<char>(a)),
+                      std::istreambuf_iterator<char>());
+  std::string bytes_b((std::istreambuf_iterator<char>(b)),
+                      std::istreambuf_iterator<char>());
+  EXPECT_TRUE(bytes_a == bytes_b);
+  Model loaded(hyper_param.model_file);
+  loaded.GetWeights(linear.data(), pruned.data());
+  EXPECT_TRUE(pruned == latent);
+  // Pruning again drops nothing
+  EXPECT_EQ(loaded.Prune(threshold), 0);
+  // The largest pair is kept if all of them are small
+  offset_t kept = (offset_t)num_feat * num_field - small;
+  EXPECT_EQ(loaded.Prune(sorted.back() * 2), kept - 1);
+  EXPECT_EQ(loaded.GetFieldIndex().NumBlocks(), 1);
+  loaded.Serialize(hyper_param.model_file);
+  Model one(hyper_param.model_file);
+  EXPECT_EQ(one.GetFieldIndex().NumBlocks(), 1);
+  RemoveFile(hyper_param.model_file.c_str());
+  RemoveFile(split_file.c_str());
+  // The vectors of fm are set to zero
+  Model fm;
+  fm.Initialize("fm", hyper_param.loss_func, num_feat, 0, num_K, 2, 0.5);
+  offset_t fm_small = fm.Prune(threshold);
+  EXPECT_GT(fm_small, 0);
+  EXPECT_EQ(fm.Prune(threshold), fm_small);
+}
+
+// The shared features have one latent vector for all their fields.
+TEST(MODEL_TEST, Shared_field_index) {
+  HyperParam hyper_param = Init();
+  index_t num_feat = hyper_param.num_feature;
+  index_t num_field = hyper_param.num_field;
+  index_t num_K = hyper_param.num_K;
+  FieldIndex index;
+  for (index_t j = 0; j < num_feat; ++j) {
+    for (index_t f = 0; f < num_field; ++f) { index.Set(j, f); }
+  }
+  index.Share(0);
+  index.Share(2);
+  index.Build(num_feat, num_field);
+  Model model;
+  model.SetFieldIndex(index);
+  model.Initialize("ffm", hyper_param.loss_func,
+                   num_feat, num_field, num_K, 2, 0.5);
+  EXPECT_EQ(model.GetFieldIndex().NumBlocks(),
+            (offset_t)(num_feat - 2) * num_field + 2);
+  std::vector<real_t> linear(num_feat + 1);
+  std::vector<real_t> latent((offset_t)num_feat * num_field * num_K);
+  model.GetWeights(linear.data(), latent.data());
+  for (index_t f = 1; f < num_field; ++f) {
+    EXPECT_TRUE(std::equal(latent.begin(), latent.begin() + num_K,
+                           latent.begin() + f * num_K));
+  }
+  model.Serialize(hyper_param.model_file);
+  Model loaded(hyper_param.model_file);
+  EXPECT_TRUE(loaded.GetFieldIndex().IsShared(2));
+  EXPECT_FALSE(loaded.GetFieldIndex().IsShared(1));
+  std::vector<real_t> weights(latent.size());
+  loaded.GetWeights(linear.data(), weights.data());
+  EXPECT_TRUE(weights == latent);
+  // Pruning keeps the shared blocks
+  EXPECT_EQ(loaded.Prune(1e-10), 0);
+  EXPECT_EQ(loaded.GetFieldIndex().NumBlocks(),
+            model.GetFieldIndex().NumBlocks());
+  loaded.GetWeights(linear.data(), weights.data());
+  EXPECT_TRUE(weights == latent);
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The vectors of their own K are zero after the K, and the model
+// file and the inference file keep their widths.
+TEST(MODEL_TEST, Field_k_index) {
+  HyperParam hyper_param = Init();
+  index_t num_feat = 8;
+  index_t num_field = hyper_param.num_field;
+  index_t num_K = 6;
+  // Feature j is of field j % 4, and all of them are in one row
+  DMatrix matrix;
+  matrix.ReAlloc(1);
+  matrix.row[0] = new SparseRow;
+  for (index_t j = 0; j < num_feat; ++j) {
+    matrix.AddNode(0, j, 1.0, j % num_field);
+  }
+  std::vector<FieldK> items;
+  ASSERT_TRUE(ParseFieldK("0=1,2:3=3", &items));
+  FieldIndex index;
+  index.Add(&matrix);
+  index.SetFieldK(FieldKTable(items, num_field, num_K));
+  index.Build(num_feat, num_field);
+  Model model;
+  model.SetFieldIndex(index);
+  model.Initialize("ffm", hyper_param.loss_func,
+                   num_feat, num_field, num_K, 2, 0.5);
+  EXPECT_EQ(model.GetNumParameter_v(), index.NumBlocks() * kAlign * 2);
+  std::vector<real_t> linear(num_feat + 1);
+  std::vector<real_t> latent((offset_t)num_feat * num_field * num_K);
+  model.GetWeights(linear.data(), latent.data());
+  for (index_t j = 0; j < num_feat; ++j) {
+    for (index_t f = 0; f < num_field; ++f) {
+      const real_t* v = latent.data() + (j * num_field + f) * num_K;
+      index_t k = index.FieldK(j, f);
+      EXPECT_EQ(k, j % num_field == 0 || f == 0 ? 1 :
+                   (j % num_field) + f == 5 ? 3 : 6);
+      for (index_t d = 0; d < num_K; ++d) {
+        if (d < k) {
+          EXPECT_NE(v[d], 0);
+        } else {
+          EXPECT_EQ(v[d], 0);
+        }
+      }
+    }
+  }
+  model.Serialize(hyper_param.model_file);
+  Model loaded(hyper_param.model_file);
+  EXPECT_TRUE(loaded.GetFieldIndex().HasWidths());
+  EXPECT_EQ(loaded.GetNumParameter_v(), model.GetNumParameter_v());
+  std::vector<real_t> weights(latent.size());
+  loaded.GetWeights(linear.data(), weights.data());
+  EXPECT_TRUE(weights == latent);
+  model.SerializeInference(hyper_param.model_file);
+  Model inference(hyper_param.model_file);
+  EXPECT_TRUE(inference.GetFieldIndex().HasWidths());
+  EXPECT_EQ(inference.GetNumParameter_v(), index.NumBlocks() * kAlign);
+  inference.GetWeights(linear.data(), weights.data());
+  EXPECT_TRUE(weights == latent);
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Parallel_file) {
+  HyperParam hyper_param = Init();
+  std::string serial_file = "./test_model.serial";
+  index_t num_feat = 13;
+  index_t num_field = hyper_param.num_field;
+  ThreadPool pool(3);
+  Model model, serial;
+  model.SetMemoryPolicy(false, kNumaNone, &pool);
+  model.SetChecksum(true, 100);
+  model.Initialize("ffm", hyper_param.loss_func, num_feat,
+                   num_field, hyper_param.num_K, 2, 0.5);
+  serial.Initialize("ffm", hyper_param.loss_func, num_feat,
+                    num_field, hyper_param.num_K, 2, 0.5);
+  model.Serialize(hyper_param.model_file);
+  serial.Serialize(serial_file);
+  // The same file with the checksum at the end
+  std::ifstream a(hyper_param.model_file.c_str(), std::ios::binary);
+  std::ifstream b(serial_file.c_str(), std::ios::binary);
+  std::string bytes_a((std::istreambuf_iterator<char>(a)),
+                      std::istreambuf_iterator<char>());
+  std::string bytes_b((std::istreambuf_iterator<char>(b)),
+                      std::istreambuf_iterator<char>());
+  ASSERT_GT(bytes_a.size(), bytes_b.size());
+  EXPECT_TRUE(bytes_a.compare(0, bytes_b.size(), bytes_b) == 0);
+  // Each layout reads and verifies the sections by the threads
+  for (int layout = 0; layout < 3; ++layout) {
+    Model loaded;
+    loaded.SetMemoryPolicy(false, kNumaNone, layout == 0 ? nullptr : &pool);
+    loaded.SetSplitLayout(layout == 1);
+    loaded.SetFieldMajor(layout == 2);
+    ASSERT_TRUE(loaded.Deserialize(hyper_param.model_file));
+    std::vector<real_t> value(num_feat * model.GetFeatureSize());
+    std::vector<real_t> loaded_value(value.size());
+    std::vector<index_t> ids(num_feat);
+    for (index_t j = 0; j < num_feat; ++j) { ids[j] = j; }
+    model.GetFeatures(ids, value.data());
+    loaded.GetFeatures(ids, loaded_value.data());
+    EXPECT_TRUE(value == loaded_value);
+    // The reordered layout writes the same file
+    if (layout == 2) {
+      loaded.SetChecksum(true, 100);
+      loaded.Serialize(serial_file);
+      std::ifstream c(serial_file.c_str(), std::ios::binary);
+      std::string bytes_c((std::istreambuf_iterator<char>(c)),
+                          std::istreambuf_iterator<char>());
+      EXPECT_TRUE(bytes_a == bytes_c);
+    }
+  }
+  // A changed byte of v is found
+  bytes_a[bytes_b.size() - 10] ^= 1;
+  std::ofstream out(hyper_param.model_file.c_str(), std::ios::binary);
+  out << bytes_a;
+  out.close();
+  Model broken;
+  broken.SetMemoryPolicy(false, kNumaNone, &pool);
+  EXPECT_FALSE(broken.Deserialize(hyper_param.model_file));
+  RemoveFile(hyper_param.model_file.c_str());
+  RemoveFile(serial_file.c_str());
+}
+
 }   // namespace xLearn
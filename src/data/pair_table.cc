@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of PairTable.
+*/
+
+#include "src/data/pair_table.h"
+
+#include <algorithm>
+
+namespace xLearn {
+
+const index_t PairTable::kNoSlot;
+const uint64 PairTable::kNoTable;
+const index_t PairTable::kNoField;
+
+void PairTable::Init(index_t num_feature,
+                     index_t num_field,
+                     uint64 max_cells) {
+  Clear();
+  CHECK_GT(max_cells, 0);
+  num_feat_ = num_feature;
+  num_field_ = num_field;
+  max_cells_ = max_cells;
+  vocab_.resize(num_field);
+  too_many_.assign(num_field, false);
+}
+
+void PairTable::Add(const DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  CHECK(Empty());
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    const SparseRow* row = matrix->row[i];
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t j = iter->feat_id;
+      index_t f = iter->field_id;
+      if (j >= num_feat_ || f >= num_field_ || too_many_[f]) continue;
+      if (j >= field_.size()) {
+        // Grow by half at least, so it is resized a few times
+        size_t size = std::min((size_t)num_feat_,
+                               std::max((size_t)j + 1,
+                                        field_.size() / 2 * 3));
+        field_.resize(size, kNoField);
+        slot_.resize(size, kNoSlot);
+      }
+      // The feature of another field keeps the slot of its first
+      // field, and its pairs of this field are not looked up
+      if (field_[j] != kNoField) continue;
+      if (vocab_[f].size() == max_cells_) {
+        drop_field(f);
+        continue;
+      }
+      field_[j] = f;
+      slot_[j] = vocab_[f].size();
+      vocab_[f].push_back(j);
+    }
+  }
+}
+
+void PairTable::drop_field(index_t f) {
+  for (index_t j : vocab_[f]) {
+    field_[j] = kNoField;
+    slot_[j] = kNoSlot;
+  }
+  std::vector<index_t>().swap(vocab_[f]);
+  too_many_[f] = true;
+}
+
+void PairTable::Build() {
+  CHECK(Empty());
+  table_.assign((offset_t)num_field_ * num_field_, kNoTable);
+  uint64 num_cells = 0;
+  num_tables_ = 0;
+  for (index_t f1 = 0; f1 < num_field_; ++f1) {
+    uint64 n1 = vocab_[f1].size();
+    if (n1 == 0) continue;
+    for (index_t f2 = f1; f2 < num_field_; ++f2) {
+      uint64 n2 = vocab_[f2].size();
+      if (n2 == 0 || n1 * n2 > max_cells_) continue;
+      table_[(offset_t)f1 * num_field_ + f2] = num_cells;
+      num_cells += n1 * n2;
+      num_tables_++;
+    }
+  }
+  cells_.assign(num_cells, 0);
+}
+
+void PairTable::Clear() {
+  num_feat_ = 0;
+  num_field_ = 0;
+  max_cells_ = 0;
+  num_tables_ = 0;
+  std::vector<std::vector<index_t> >().swap(vocab_);
+  std::vector<bool>().swap(too_many_);
+  std::vector<index_t>().swap(field_);
+  std::vector<index_t>().swap(slot_);
+  std::vector<uint64>().swap(table_);
+  std::vector<real_t>().swap(cells_);
+}
+
+}  // namespace xLearn
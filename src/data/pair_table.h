@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the PairTable class, which keeps the precomputed
+interactions of the pairs of the small fields of ffm.
+*/
+
+#ifndef XLEARN_DATA_PAIR_TABLE_H_
+#define XLEARN_DATA_PAIR_TABLE_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// PairTable keeps the ffm interactions <V_i_fj, V_j_fi> of the pairs of
+// fields whose vocabularies are small, e.g., the device type and the
+// weekday, so the prediction looks the pair up instead of computing the
+// dot product of K values for each row. The features of each field are
+// found in the data, and they are numbered in their field (the slots):
+//
+//   PairTable table;
+//   table.Init(num_feature, num_field, max_cells);
+//   while (reader->Samples(matrix)) { table.Add(matrix); }
+//   table.Build();   /* the pairs of at most max_cells cells */
+//   ... fill the cells of Table(f1, f2) by the model ...
+//   real_t value;
+//   if (table.Lookup(f1, table.Slot(j1, f1), f2, table.Slot(j2, f2),
+//                    &value)) { ... }
+//
+// The table of the fields f1 <= f2 has VocabSize(f1) * VocabSize(f2)
+// cells, and the cell of the slots (s1, s2) is at s1 * VocabSize(f2)
+// + s2. A feature only has the slot of the first field it is seen in,
+// so its pairs in the other fields are not looked up.
+//------------------------------------------------------------------------------
+class PairTable {
+ public:
+  /* The feature that has no slot */
+  static const index_t kNoSlot = ~(index_t)0;
+
+  PairTable() : num_feat_(0), num_field_(0), max_cells_(0) { }
+
+  // Set the shape of the model, and the pairs of more than
+  // max_cells cells have no table.
+  void Init(index_t num_feature, index_t num_field, uint64 max_cells);
+
+  // Add the features of the nodes of the rows to the vocabularies
+  // of their fields. A field of more than max_cells features has no
+  // table, and its features are not kept.
+  void Add(const DMatrix* matrix);
+
+  // Allocate the tables of the pairs of fields whose product of the
+  // vocabularies is at most max_cells, whose cells are zero.
+  void Build();
+
+  void Clear();
+
+  // No table has been built.
+  bool Empty() const { return cells_.empty(); }
+
+  index_t NumField() const { return num_field_; }
+
+  // Number of the pairs of fields that have a table.
+  index_t NumTables() const { return num_tables_; }
+
+  // Number of the cells of all the tables.
+  uint64 NumCells() const { return cells_.size(); }
+
+  // Number of the features of the field, which is 0 if
+  // the field has too many features.
+  index_t VocabSize(index_t f) const {
+    return f < vocab_.size() ? (index_t)vocab_[f].size() : 0;
+  }
+
+  // The feature of the slot s of the field f.
+  index_t Feature(index_t f, index_t s) const { return vocab_[f][s]; }
+
+  // The slot of the feature j of the field f, or kNoSlot.
+  inline index_t Slot(index_t j, index_t f) const {
+    if (j >= slot_.size() || field_[j] != f) { return kNoSlot; }
+    return slot_[j];
+  }
+
+  // The table of the fields f1 <= f2, or nullptr.
+  real_t* Table(index_t f1, index_t f2) {
+    uint64 t = table_[(offset_t)f1 * num_field_ + f2];
+    return t == kNoTable ? nullptr : cells_.data() + t;
+  }
+
+  // Set the value of the pair of the slot s1 of f1 and the slot s2
+  // of f2, and return false if the pair has no table.
+  inline bool Lookup(index_t f1, index_t s1,
+                     index_t f2, index_t s2,
+                     real_t* value) const {
+    if (s1 == kNoSlot || s2 == kNoSlot) { return false; }
+    if (f1 > f2) {
+      std::swap(f1, f2);
+      std::swap(s1, s2);
+    }
+    uint64 t = table_[(offset_t)f1 * num_field_ + f2];
+    if (t == kNoTable) { return false; }
+    *value = cells_[t + (uint64)s1 * vocab_[f2].size() + s2];
+    return true;
+  }
+
+ private:
+  /* The pair of fields that has no table */
+  static const uint64 kNoTable = ~(uint64)0;
+  /* The feature that is not in the vocabularies */
+  static const index_t kNoField = ~(index_t)0;
+
+  /* The shape of the model */
+  index_t num_feat_;
+  index_t num_field_;
+  /* Max number of the cells of a table */
+  uint64 max_cells_;
+  /* The features of each field in the order of their slots,
+  and a field of too many features has none */
+  std::vector<std::vector<index_t> > vocab_;
+  std::vector<bool> too_many_;
+  /* The field and the slot of each feature */
+  std::vector<index_t> field_;
+  std::vector<index_t> slot_;
+  /* The first cell of the table of each pair of fields */
+  std::vector<uint64> table_;
+  index_t num_tables_ = 0;
+  /* The cells of all the tables */
+  std::vector<real_t> cells_;
+
+  // Drop the vocabulary of the field.
+  void drop_field(index_t f);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_PAIR_TABLE_H_
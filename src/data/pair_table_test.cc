@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the PairTable class.
+*/
+
+#include "gtest/gtest.h"
+
+#include "src/data/pair_table.h"
+
+namespace xLearn {
+
+// Field 0 has the features 0 and 1, field 1 has 2, 3 and 4, and
+// field 2 has 5, 6, 7 and 8. Feature 1 is also seen in field 1.
+void init_pair_matrix(DMatrix* matrix) {
+  matrix->ReAlloc(4);
+  for (index_t i = 0; i < 4; ++i) {
+    matrix->row[i] = new SparseRow;
+    matrix->AddNode(i, i % 2, 1.0, 0);
+    matrix->AddNode(i, 2 + i % 3, 1.0, 1);
+    matrix->AddNode(i, 5 + i, 1.0, 2);
+  }
+  matrix->AddNode(3, 1, 1.0, 1);
+}
+
+TEST(PairTableTest, Add_and_Build) {
+  DMatrix matrix;
+  init_pair_matrix(&matrix);
+  PairTable table;
+  EXPECT_TRUE(table.Empty());
+  table.Init(10, 3, 6);
+  table.Add(&matrix);
+  table.Build();
+  EXPECT_FALSE(table.Empty());
+  EXPECT_EQ(table.NumField(), 3);
+  EXPECT_EQ(table.VocabSize(0), 2);
+  EXPECT_EQ(table.VocabSize(1), 3);
+  EXPECT_EQ(table.VocabSize(2), 4);
+  // (0, 0), (0, 1), (1, 1) is 9 cells, which is too many
+  EXPECT_EQ(table.NumTables(), 2);
+  EXPECT_EQ(table.NumCells(), 4 + 6);
+  EXPECT_TRUE(table.Table(0, 0) != nullptr);
+  EXPECT_TRUE(table.Table(0, 1) != nullptr);
+  EXPECT_TRUE(table.Table(1, 1) == nullptr);
+  EXPECT_TRUE(table.Table(0, 2) == nullptr);
+  EXPECT_EQ(table.Slot(0, 0), 0);
+  EXPECT_EQ(table.Slot(1, 0), 1);
+  EXPECT_EQ(table.Slot(4, 1), 2);
+  EXPECT_EQ(table.Feature(1, 2), 4);
+  // The feature keeps the slot of its first field
+  EXPECT_EQ(table.Slot(1, 1), PairTable::kNoSlot);
+  EXPECT_EQ(table.Slot(9, 2), PairTable::kNoSlot);
+  // The cell of the slots (s1, s2) is at s1 * VocabSize(f2) + s2
+  real_t* cells = table.Table(0, 1);
+  for (index_t i = 0; i < 6; ++i) { cells[i] = i; }
+  real_t value = -1;
+  EXPECT_TRUE(table.Lookup(0, 1, 1, 2, &value));
+  EXPECT_FLOAT_EQ(value, 5);
+  EXPECT_TRUE(table.Lookup(1, 2, 0, 1, &value));
+  EXPECT_FLOAT_EQ(value, 5);
+  EXPECT_FALSE(table.Lookup(1, 0, 1, 1, &value));
+  EXPECT_FALSE(table.Lookup(0, PairTable::kNoSlot, 1, 0, &value));
+  table.Clear();
+  EXPECT_TRUE(table.Empty());
+  EXPECT_EQ(table.NumTables(), 0);
+}
+
+// The field of more than max_cells features is dropped.
+TEST(PairTableTest, Drop_field) {
+  DMatrix matrix;
+  init_pair_matrix(&matrix);
+  PairTable table;
+  table.Init(10, 3, 3);
+  table.Add(&matrix);
+  table.Build();
+  EXPECT_EQ(table.VocabSize(0), 2);
+  EXPECT_EQ(table.VocabSize(1), 3);
+  EXPECT_EQ(table.VocabSize(2), 0);
+  EXPECT_EQ(table.Slot(5, 2), PairTable::kNoSlot);
+  // Each pair of the others has more than 3 cells
+  EXPECT_EQ(table.NumTables(), 0);
+  EXPECT_TRUE(table.Empty());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of MetricsServer.
+*/
+
+#include "src/distributed/metrics_server.h"
+
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+// The listener is checked for Stop() this often
+static const int kPollMs = 100;
+// A client that sends nothing for this long is dropped
+static const int kRequestMs = 2000;
+// The head of a request is at most this long
+static const size_t kMaxRequest = 8192;
+
+int MetricsServer::Start(int port, StatsRegistry* stats) {
+  CHECK_NOTNULL(stats);
+  Stop();
+  int bound = listener_.Listen(port);
+  if (bound < 0) { return -1; }
+  stats_ = stats;
+  stop_.store(false);
+  thread_ = std::thread(&MetricsServer::serve, this);
+  return bound;
+}
+
+void MetricsServer::Stop() {
+  if (!thread_.joinable()) { return; }
+  stop_.store(true);
+  thread_.join();
+  listener_.Close();
+}
+
+void MetricsServer::serve() {
+  while (!stop_.load()) {
+    if (!listener_.Wait(kPollMs)) { continue; }
+    Socket conn;
+    if (listener_.Accept(&conn)) { answer(&conn); }
+  }
+}
+
+void MetricsServer::answer(Socket* conn) {
+  std::string request;
+  char buf[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < kMaxRequest && !stop_.load()) {
+    if (!conn->Wait(kRequestMs)) { return; }
+    int64 n = conn->RecvSome(buf, sizeof(buf));
+    if (n <= 0) { return; }
+    request.append(buf, n);
+  }
+  std::string reply = Reply(request);
+  conn->Send(reply.data(), reply.size());
+}
+
+std::string MetricsServer::Reply(const std::string& request) {
+  size_t begin = request.find(' ');
+  size_t end = begin == std::string::npos ?
+               std::string::npos : request.find(' ', begin + 1);
+  std::string method = request.substr(0, begin);
+  std::string path = end == std::string::npos ?
+                     "" : request.substr(begin + 1, end - begin - 1);
+  // The query (e.g., of the scraper) is ignored
+  path = path.substr(0, path.find('?'));
+  if ((method == "GET" || method == "HEAD") && path == "/metrics") {
+    std::string body = stats_->Export();
+    return StringPrintf("HTTP/1.1 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %llu\r\n"
+                        "Connection: close\r\n\r\n",
+                        (unsigned long long)body.size()) +
+           (method == "GET" ? body : std::string());
+  }
+  return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+         "Connection: close\r\n\r\n";
+}
+
+}  // namespace xLearn
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the MetricsServer class, which serves the
+StatsRegistry of a process over HTTP.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_METRICS_SERVER_H_
+#define XLEARN_DISTRIBUTED_METRICS_SERVER_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "src/base/common.h"
+#include "src/base/stats_registry.h"
+#include "src/distributed/transport.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// MetricsServer answers GET /metrics with the export of a StatsRegistry
+// in the Prometheus text format, so the online training and the served
+// model can be scraped (and autoscaled) without reading their logs:
+//
+//   MetricsServer server;
+//   int port = server.Start(9100, &stats);
+//   ... /* curl http://host:9100/metrics */
+//   server.Stop();
+//
+// One background thread accepts the connections and answers them in
+// turn, and each connection is closed after its reply. The other paths
+// are 404. The registry is only read by Export(), so serving it does
+// not slow down the threads that update it.
+//------------------------------------------------------------------------------
+class MetricsServer {
+ public:
+  // Constructor and Destructor
+  MetricsServer() { }
+  ~MetricsServer() { Stop(); }
+
+  // Listen on the port (0 picks a free one) and serve the registry,
+  // which must live until Stop(). Return the port, or -1 if it cannot
+  // listen on it.
+  int Start(int port, StatsRegistry* stats);
+
+  // Stop serving and close the port, which waits for the reply
+  // in progress.
+  void Stop();
+
+  // If the server is running.
+  bool IsRunning() const { return thread_.joinable(); }
+
+  // The reply of the request, e.g., "GET /metrics HTTP/1.1\r\n...".
+  std::string Reply(const std::string& request);
+
+ protected:
+  Socket listener_;
+  StatsRegistry* stats_ = nullptr;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+
+  // Accept the connections until Stop().
+  void serve();
+
+  // Read the request of the connection and send its reply.
+  void answer(Socket* conn);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MetricsServer);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_METRICS_SERVER_H_
@@ -0,0 +1,66 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the MetricsServer class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "src/distributed/metrics_server.h"
+
+namespace xLearn {
+
+// Send the request to the port, and return the whole reply.
+std::string Fetch(int port, const std::string& request) {
+  Socket client;
+  CHECK(client.Connect("127.0.0.1", port, 10));
+  CHECK(client.Send(request.data(), request.size()));
+  std::string reply;
+  char buf[1024];
+  for (int64 n; (n = client.RecvSome(buf, sizeof(buf))) > 0; ) {
+    reply.append(buf, n);
+  }
+  return reply;
+}
+
+TEST(MetricsServerTest, Serve_metrics) {
+  StatsRegistry stats;
+  StatCounter* rows = stats.GetCounter("xlearn_rows_total", "Rows.");
+  MetricsServer server;
+  int port = server.Start(0, &stats);
+  ASSERT_GT(port, 0);
+  EXPECT_TRUE(server.IsRunning());
+  rows->Add(3);
+  std::string reply = Fetch(port, "GET /metrics HTTP/1.1\r\n"
+                                   "Host: localhost\r\n\r\n");
+  EXPECT_EQ(reply.find("HTTP/1.1 200 OK\r\n"), 0);
+  EXPECT_NE(reply.find("\r\n\r\n# HELP xlearn_rows_total Rows.\n"),
+            std::string::npos);
+  EXPECT_NE(reply.find("\nxlearn_rows_total 3\n"), std::string::npos);
+  // The counter is read by each scrape
+  rows->Add(2);
+  reply = Fetch(port, "GET /metrics?x=1 HTTP/1.0\r\n\r\n");
+  EXPECT_NE(reply.find("\nxlearn_rows_total 5\n"), std::string::npos);
+  reply = Fetch(port, "GET / HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(reply.find("HTTP/1.1 404 Not Found\r\n"), 0);
+  server.Stop();
+  EXPECT_FALSE(server.IsRunning());
+}
+
+}  // namespace xLearn
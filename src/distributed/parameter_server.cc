@@ -15,13 +15,49 @@
 //------------------------------------------------------------------------------
 
 /*
-This file is the implementation of KVStore.
+This file is the implementation of KVStore and ParameterServer.
 */
 
 #include "src/distributed/parameter_server.h"
 
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "src/base/timer.h"
+
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// KVStore
+//------------------------------------------------------------------------------
+
+// Connect to all the servers
+bool KVStore::Connect(const std::vector<std::string>& servers,
+                      int timeout) {
+  Initialize(servers.size());
+  servers_.clear();
+  for (size_t i = 0; i < servers.size(); ++i) {
+    std::string host;
+    int port = 0;
+    if (!ParseAddress(servers[i], &host, &port)) {
+      LOG(ERR) << "Illegal address of server: " << servers[i];
+      return false;
+    }
+    servers_.emplace_back(new Socket);
+    if (!servers_[i]->Connect(host, port, timeout)) {
+      LOG(ERR) << "Cannot connect to server: " << servers[i];
+      return false;
+    }
+  }
+  local_key_.resize(server_num_);
+  local_value_.resize(server_num_);
+  encoded_.resize(server_num_);
+  return true;
+}
+
 // Push a list of (key, value) into store.
 // For example:
 //  ------------------------------------------------------
@@ -30,7 +66,7 @@ namespace xLearn {
 //  ------------------------------------------------------
 void KVStore::Push(const std::vector<index_t>& key,
    	               const std::vector<real_t>& value) {
- // TODO(chao)
+  Push(key, value, 1);
 }
 
 // Push a list of (key, value_list) into store.
@@ -47,7 +83,40 @@ void KVStore::Push(const std::vector<index_t>& key,
 void KVStore::Push(const std::vector<index_t>& key,
    	               const std::vector<real_t>& value_list,
    	               const size_t length) {
- // TODO(chao)
+  CHECK_EQ(value_list.size(), key.size() * length);
+  split_keys(key);
+  for (size_t s = 0; s < server_num_; ++s) {
+    local_value_[s].resize(local_key_[s].size() * length);
+  }
+  for (size_t i = 0; i < key.size(); ++i) {
+    size_t s = GetServerId(key[i]);
+    memcpy(local_value_[s].data() + position_[i] * length,
+           value_list.data() + i * length,
+           length * sizeof(real_t));
+  }
+  // Send all the requests before waiting for the replies
+  for (size_t s = 0; s < server_num_; ++s) {
+    if (local_key_[s].empty()) { continue; }
+    raw_push_bytes_ += local_value_[s].size() * sizeof(real_t);
+    if (compressed()) {
+      EncodeHead encode_head = encode(s, length);
+      send_keys(s, kPushEncoded, length, &encode_head);
+      send(s, encoded_[s].data(), encoded_[s].size());
+      push_bytes_ += encoded_[s].size();
+      continue;
+    }
+    send_keys(s, kPush, length);
+    send(s, local_value_[s].data(),
+         local_value_[s].size() * sizeof(real_t));
+    push_bytes_ += local_value_[s].size() * sizeof(real_t);
+  }
+  for (size_t s = 0; s < server_num_; ++s) {
+    if (local_key_[s].empty()) { continue; }
+    MessageHead head;
+    recv(s, &head, sizeof(head));
+    uint32 type = head.type & ~kKeyRuns;
+    CHECK(type == kPush || type == kPushEncoded);
+  }
 }
 
 // Pull the values for a list of keys from store.
@@ -58,7 +127,7 @@ void KVStore::Push(const std::vector<index_t>& key,
 //  ------------------------------------------------------
 void KVStore::Pull(const std::vector<index_t>& key,
    	               std::vector<real_t>* value) {
-  // TODO(chao)
+  Pull(key, value, 1);
 }
 
 // Pull the value list for a list of keys from store.
@@ -75,12 +144,204 @@ void KVStore::Pull(const std::vector<index_t>& key,
 void KVStore::Pull(const std::vector<index_t>& key,
    	               std::vector<real_t>* value_list,
    	               const size_t length) {
- // TODO(Chao)
+  CHECK_NOTNULL(value_list);
+  split_keys(key);
+  // Send all the requests before waiting for the replies
+  for (size_t s = 0; s < server_num_; ++s) {
+    if (local_key_[s].empty()) { continue; }
+    send_keys(s, kPull, length);
+  }
+  for (size_t s = 0; s < server_num_; ++s) {
+    local_value_[s].resize(local_key_[s].size() * length);
+    if (local_key_[s].empty()) { continue; }
+    recv(s, local_value_[s].data(),
+         local_value_[s].size() * sizeof(real_t));
+  }
+  value_list->resize(key.size() * length);
+  for (size_t i = 0; i < key.size(); ++i) {
+    size_t s = GetServerId(key[i]);
+    memcpy(value_list->data() + i * length,
+           local_value_[s].data() + position_[i] * length,
+           length * sizeof(real_t));
+  }
+}
+
+// The values are combined by the first server.
+void KVStore::AllReduce(std::vector<double>* value, ReduceOp op) {
+  CHECK_NOTNULL(value);
+  CHECK_NE(servers_.empty(), true);
+  MessageHead head = { kReduce, (uint32)op, value->size() };
+  send(0, &head, sizeof(head));
+  send(0, value->data(), value->size() * sizeof(double));
+  recv(0, value->data(), value->size() * sizeof(double));
+}
+
+// Tell the servers that this worker is done.
+void KVStore::Stop() {
+  for (size_t s = 0; s < servers_.size(); ++s) {
+    MessageHead head = { kStop, 0, 0 };
+    send(s, &head, sizeof(head));
+    servers_[s]->Close();
+  }
+  servers_.clear();
+}
+
+// For each key, the value plus its residual is encoded, and the
+// residual becomes the part that is not sent. The positions of the
+// topk values are sorted, so the server reads them in order.
+EncodeHead KVStore::encode(size_t server_id, size_t length) {
+  const std::vector<index_t>& key = local_key_[server_id];
+  std::vector<real_t>& value = local_value_[server_id];
+  EncodeHead head;
+  head.type = push_type_;
+  head.topk = topk_ratio_ < 1 ?
+    std::max((size_t)1, (size_t)std::ceil(topk_ratio_ * length)) : length;
+  // The positions are uint16
+  if (head.topk > length || length > 65535) { head.topk = length; }
+  bool sparse = head.topk < length;
+  size_t topk = head.topk;
+  size_t num = key.size();
+  std::vector<char>& buffer = encoded_[server_id];
+  size_t position_size = PositionSize(head, num, length);
+  buffer.resize(position_size + EncodedSize(head, num));
+  uint16* position = reinterpret_cast<uint16*>(buffer.data());
+  char* data = buffer.data() + position_size;
+  real_t* scale = reinterpret_cast<real_t*>(data);
+  int8* q8 = reinterpret_cast<int8*>(data + num * sizeof(real_t));
+  uint16* q16 = reinterpret_cast<uint16*>(data);
+  real_t* q32 = reinterpret_cast<real_t*>(data);
+  std::vector<uint32> order(length);
+  for (size_t i = 0; i < num; ++i) {
+    size_t global = GlobalKey(server_id, key[i]);
+    if (residual_.size() < (global + 1) * length) {
+      residual_.resize((global + 1) * length, 0);
+    }
+    real_t* r = residual_.data() + global * length;
+    real_t* v = value.data() + i * length;
+    for (size_t j = 0; j < length; ++j) {
+      r[j] += v[j];
+    }
+    for (size_t j = 0; j < length; ++j) { order[j] = j; }
+    if (sparse) {
+      std::nth_element(order.begin(), order.begin() + topk, order.end(),
+        [r](uint32 a, uint32 b) { return std::abs(r[a]) > std::abs(r[b]); });
+      std::sort(order.begin(), order.begin() + topk);
+      for (size_t j = 0; j < topk; ++j) {
+        position[i * topk + j] = (uint16)order[j];
+      }
+    }
+    real_t max_abs = 0;
+    for (size_t j = 0; j < topk; ++j) {
+      max_abs = std::max(max_abs, (real_t)std::abs(r[order[j]]));
+    }
+    real_t s = max_abs / 127;
+    if (head.type == kStoreInt8) { scale[i] = s; }
+    // The residual keeps the error of the sent values
+    for (size_t j = 0; j < topk; ++j) {
+      real_t x = r[order[j]];
+      real_t sent = x;
+      size_t k = i * topk + j;
+      if (head.type == kStoreFP16 || head.type == kStoreBF16) {
+        q16[k] = FloatTo16(x, (StorageType)head.type);
+        sent = Float16ToFloat(q16[k], (StorageType)head.type);
+      } else if (head.type == kStoreInt8) {
+        int q = s > 0 ? (int)std::lround(x / s) : 0;
+        q8[k] = (int8)std::max(-127, std::min(127, q));
+        sent = q8[k] * s;
+      } else {
+        q32[k] = x;
+      }
+      r[order[j]] = x - sent;
+    }
+  }
+  return head;
+}
+
+// The clocks are kept by the first server.
+void KVStore::Clock() {
+  if (!use_clock_) { return; }
+  CHECK_NE(servers_.empty(), true);
+  Timer timer;
+  timer.tic();
+  MessageHead head = { kClock, 0, clock_ };
+  send(0, &head, sizeof(head));
+  recv(0, &head, sizeof(head));
+  CHECK_EQ(head.type, kClock);
+  CHECK_LE(head.num, clock_);
+  uint64 staleness = clock_ - head.num;
+  clock_stat_.num_clock++;
+  clock_stat_.sum_staleness += staleness;
+  clock_stat_.max_staleness = std::max(clock_stat_.max_staleness, staleness);
+  clock_stat_.wait_time += timer.toc();
+  clock_++;
+}
+
+// Group the keys by their servers, and record the
+// position of each key in the message of its server.
+void KVStore::split_keys(const std::vector<index_t>& key) {
+  CHECK_EQ(servers_.size(), server_num_);
+  for (size_t s = 0; s < server_num_; ++s) {
+    local_key_[s].clear();
+  }
+  position_.resize(key.size());
+  for (size_t i = 0; i < key.size(); ++i) {
+    size_t s = GetServerId(key[i]);
+    position_[i] = local_key_[s].size();
+    local_key_[s].push_back(FeatMap(key[i]));
+  }
+}
+
+// The runs are only sent if they are smaller than the keys, e.g.,
+// the pulls of the whole model or the dense ranges of the keys.
+void KVStore::send_keys(size_t server_id, uint32 type, size_t length,
+                        const EncodeHead* encode_head) {
+  const std::vector<index_t>& key = local_key_[server_id];
+  runs_.clear();
+  for (size_t i = 0; i < key.size(); ++i) {
+    if (!runs_.empty() &&
+        runs_.back().start + runs_.back().count == key[i]) {
+      runs_.back().count++;
+      continue;
+    }
+    // Without the runs, the keys are smaller after this point
+    if ((runs_.size() + 1) * sizeof(KeyRun) + sizeof(uint64) >=
+        key.size() * sizeof(index_t)) {
+      runs_.clear();
+      break;
+    }
+    runs_.push_back({ key[i], 1 });
+  }
+  bool use_runs = !runs_.empty();
+  MessageHead head = { use_runs ? type | kKeyRuns : type,
+                       (uint32)length, key.size() };
+  send(server_id, &head, sizeof(head));
+  if (encode_head != nullptr) {
+    send(server_id, encode_head, sizeof(*encode_head));
+  }
+  if (use_runs) {
+    uint64 num_runs = runs_.size();
+    send(server_id, &num_runs, sizeof(num_runs));
+    send(server_id, runs_.data(), runs_.size() * sizeof(KeyRun));
+  } else {
+    send(server_id, key.data(), key.size() * sizeof(index_t));
+  }
+}
+
+void KVStore::send(size_t server_id, const void* data, size_t size) {
+  if (!servers_[server_id]->Send(data, size)) {
+    LOG(FATAL) << "Lost the connection to server " << server_id;
+  }
+}
+
+void KVStore::recv(size_t server_id, void* data, size_t size) {
+  if (!servers_[server_id]->Recv(data, size)) {
+    LOG(FATAL) << "Lost the connection to server " << server_id;
+  }
 }
 
 //------------------------------------------------------------------------------
 // In xLearn, we use a simple range strategy for model partition
-// on parameter server. For example, we have 10 features and 3 
+// on parameter server. For example, we have 10 features and 3
 // server nodes.
 //
 //  ---------------------------------------
@@ -102,13 +363,359 @@ void KVStore::Pull(const std::vector<index_t>& key,
 // Given a feature id, return the server id, which stores that feature.
 size_t KVStore::GetServerId(const index_t feat_id) const {
   CHECK_GE(feat_id, 0);
+  if (!bounds_.empty()) {
+    // The number of the bounds <= feat_id after the first one
+    return std::upper_bound(bounds_.begin() + 1, bounds_.end() - 1,
+                            feat_id) - (bounds_.begin() + 1);
+  }
   return feat_id % server_num_;
 }
 
 // Mapping the global feature id to the local server id.
 index_t KVStore::FeatMap(const index_t feat_id) const {
   CHECK_GE(feat_id, 0);
+  if (!bounds_.empty()) {
+    return feat_id - bounds_[GetServerId(feat_id)];
+  }
   return feat_id / server_num_;
 }
 
-}  // namespace xLearn
\ No newline at end of file
+index_t KVStore::GlobalKey(size_t server_id, index_t local_key) const {
+  CHECK_LT(server_id, server_num_);
+  if (!bounds_.empty()) {
+    return bounds_[server_id] + local_key;
+  }
+  return local_key * server_num_ + server_id;
+}
+
+index_t KVStore::NumLocalKey(index_t num_key, size_t server_id) const {
+  CHECK_LT(server_id, server_num_);
+  if (!bounds_.empty()) {
+    index_t begin = std::min(bounds_[server_id], num_key);
+    index_t end = server_id + 1 == server_num_ ?
+                  num_key : std::min(bounds_[server_id + 1], num_key);
+    return end - begin;
+  }
+  return ParameterServer::NumLocalKey(num_key, server_id, server_num_);
+}
+
+void KVStore::SetRangePartition(const std::vector<index_t>& bounds) {
+  CHECK_EQ(bounds.size(), server_num_ + 1);
+  CHECK_EQ(bounds[0], 0);
+  for (size_t s = 0; s < server_num_; ++s) {
+    CHECK_LE(bounds[s], bounds[s + 1]);
+  }
+  bounds_ = bounds;
+  // The residual of the encoding is ordered by the global keys
+  residual_.clear();
+}
+
+std::vector<index_t> KVStore::RangeBounds(index_t num_key,
+                                          size_t server_num) {
+  CHECK_GT(server_num, 0);
+  std::vector<index_t> bounds(server_num + 1);
+  for (size_t s = 0; s <= server_num; ++s) {
+    bounds[s] = (index_t)((uint64)num_key * s / server_num);
+  }
+  return bounds;
+}
+
+// A server gets the blocks until its load reaches its part of
+// the total load, so the bounds are the prefix sums of the loads.
+std::vector<index_t> KVStore::BalancedBounds(
+    const std::vector<double>& block_count,
+    index_t block_size,
+    index_t num_key,
+    size_t server_num) {
+  CHECK_GT(server_num, 0);
+  CHECK_GT(block_size, 0);
+  size_t num_block = ((uint64)num_key + block_size - 1) / block_size;
+  double total_count = 0;
+  for (size_t b = 0; b < num_block && b < block_count.size(); ++b) {
+    total_count += block_count[b];
+  }
+  if (total_count <= 0) { return RangeBounds(num_key, server_num); }
+  double key_load = num_key > 0 ? total_count / num_key : 0;
+  std::vector<double> load(num_block);
+  for (size_t b = 0; b < num_block; ++b) {
+    index_t begin = (index_t)(b * block_size);
+    index_t keys = std::min<uint64>(block_size, num_key - begin);
+    load[b] = (b < block_count.size() ? block_count[b] : 0) +
+              keys * key_load;
+  }
+  double total = 2 * total_count;
+  std::vector<index_t> bounds(server_num + 1, num_key);
+  bounds[0] = 0;
+  double sum = 0;
+  size_t s = 1;
+  for (size_t b = 0; b < num_block && s < server_num; ++b) {
+    sum += load[b];
+    while (s < server_num && sum >= total * s / server_num) {
+      bounds[s++] = (index_t)std::min<uint64>((b + 1) * (uint64)block_size,
+                                              num_key);
+    }
+  }
+  return bounds;
+}
+
+//------------------------------------------------------------------------------
+// ParameterServer
+//------------------------------------------------------------------------------
+
+// Listen on the port and accept the workers in the background.
+int ParameterServer::Start(int port, size_t server_id,
+                           size_t server_num, size_t num_worker,
+                           int staleness) {
+  CHECK_LT(server_id, server_num);
+  CHECK_GT(num_worker, 0);
+  server_id_ = server_id;
+  num_worker_ = num_worker;
+  staleness_ = staleness;
+  clock_.assign(num_worker, 0);
+  active_.assign(num_worker, true);
+  port = listener_.Listen(port);
+  if (port < 0) { return -1; }
+  accept_thread_ = std::thread(&ParameterServer::accept_workers, this);
+  return port;
+}
+
+// Each worker connects to each server once.
+void ParameterServer::accept_workers() {
+  for (size_t i = 0; i < num_worker_; ++i) {
+    Socket* worker = new Socket;
+    if (!listener_.Accept(worker)) {
+      LOG(ERR) << "Server " << server_id_
+                 << " cannot accept the workers.";
+      delete worker;
+      break;
+    }
+    workers_.emplace_back(worker);
+    threads_.emplace_back(&ParameterServer::serve, this, worker, i);
+  }
+  listener_.Close();
+}
+
+void ParameterServer::SetValue(size_t length, std::vector<real_t>* value) {
+  CHECK_NOTNULL(value);
+  CHECK_GT(length, 0);
+  CHECK_EQ(value->size() % length, 0);
+  std::lock_guard<std::mutex> lock(value_mutex_);
+  length_ = length;
+  value_.swap(*value);
+}
+
+// The keys k < num_key with k % server_num == server_id.
+index_t ParameterServer::NumLocalKey(index_t num_key,
+                                     size_t server_id,
+                                     size_t server_num) {
+  CHECK_LT(server_id, server_num);
+  return num_key / server_num +
+         (server_id < num_key % server_num ? 1 : 0);
+}
+
+// Decode the values of kPushEncoded (see KVStore::encode()), where
+// the values that are not sent are 0.
+static void decode(const EncodeHead& head, size_t length, size_t num,
+                   const char* buffer, real_t* value) {
+  size_t topk = head.topk;
+  bool sparse = topk < length;
+  const uint16* position = reinterpret_cast<const uint16*>(buffer);
+  const char* data = buffer + PositionSize(head, num, length);
+  const real_t* scale = reinterpret_cast<const real_t*>(data);
+  const int8* q8 = reinterpret_cast<const int8*>(data + num * sizeof(real_t));
+  const uint16* q16 = reinterpret_cast<const uint16*>(data);
+  const real_t* q32 = reinterpret_cast<const real_t*>(data);
+  if (sparse) {
+    memset(value, 0, num * length * sizeof(real_t));
+  }
+  for (size_t i = 0; i < num; ++i) {
+    real_t* v = value + i * length;
+    for (size_t j = 0; j < topk; ++j) {
+      size_t k = i * topk + j;
+      size_t pos = sparse ? position[k] : j;
+      CHECK_LT(pos, length);
+      if (head.type == kStoreFP16 || head.type == kStoreBF16) {
+        v[pos] = Float16ToFloat(q16[k], (StorageType)head.type);
+      } else if (head.type == kStoreInt8) {
+        v[pos] = q8[k] * scale[i];
+      } else {
+        v[pos] = q32[k];
+      }
+    }
+  }
+}
+
+// Receive the runs of the keys (see kKeyRuns), which have
+// the key->size() keys in total.
+static bool recv_runs(Socket* worker,
+                      std::vector<KeyRun>* runs,
+                      std::vector<index_t>* key) {
+  uint64 num_runs = 0;
+  if (!worker->Recv(&num_runs, sizeof(num_runs))) { return false; }
+  CHECK_LE(num_runs, key->size());
+  runs->resize(num_runs);
+  if (!worker->Recv(runs->data(), num_runs * sizeof(KeyRun))) {
+    return false;
+  }
+  size_t n = 0;
+  for (const KeyRun& run : *runs) {
+    CHECK_LE(n + run.count, key->size());
+    for (index_t j = 0; j < run.count; ++j) {
+      (*key)[n++] = run.start + j;
+    }
+  }
+  CHECK_EQ(n, key->size());
+  return true;
+}
+
+void ParameterServer::serve(Socket* worker, size_t worker_id) {
+  std::vector<KeyRun> runs;
+  std::vector<index_t> key;
+  std::vector<real_t> value;
+  std::vector<double> reduce_value;
+  std::vector<char> encoded;
+  for (;;) {
+    MessageHead head;
+    if (!worker->Recv(&head, sizeof(head))) { break; }
+    if (head.type == kStop) {
+      set_active(worker_id, false);
+      worker->Close();
+      return;
+    }
+    bool ok = true;
+    uint32 type = head.type & ~kKeyRuns;
+    if (type == kPull || type == kPush || type == kPushEncoded) {
+      size_t length = head.length;
+      bool push = type != kPull;
+      EncodeHead encode_head;
+      if (type == kPushEncoded) {
+        ok = worker->Recv(&encode_head, sizeof(encode_head));
+        CHECK_LE(encode_head.topk, length);
+      }
+      key.resize(head.num);
+      value.resize(head.num * length);
+      if (head.type & kKeyRuns) {
+        ok = ok && recv_runs(worker, &runs, &key);
+      } else {
+        ok = ok && worker->Recv(key.data(), key.size() * sizeof(index_t));
+      }
+      if (ok && type == kPush) {
+        ok = worker->Recv(value.data(), value.size() * sizeof(real_t));
+      } else if (ok && type == kPushEncoded) {
+        encoded.resize(PositionSize(encode_head, head.num, length) +
+                       EncodedSize(encode_head, head.num));
+        ok = worker->Recv(encoded.data(), encoded.size());
+        if (ok) {
+          decode(encode_head, length, head.num,
+                 encoded.data(), value.data());
+        }
+      }
+      if (!ok) { break; }
+      {
+        std::lock_guard<std::mutex> lock(value_mutex_);
+        CHECK_EQ(length, length_);
+        for (size_t i = 0; i < key.size(); ++i) {
+          CHECK_LT((size_t)key[i] * length, value_.size());
+          real_t* v = value_.data() + (size_t)key[i] * length;
+          real_t* w = value.data() + i * length;
+          if (push) {
+            for (size_t j = 0; j < length; ++j) { v[j] += w[j]; }
+          } else {
+            memcpy(w, v, length * sizeof(real_t));
+          }
+        }
+      }
+      if (push) {
+        ok = worker->Send(&head, sizeof(head));
+      } else {
+        ok = worker->Send(value.data(), value.size() * sizeof(real_t));
+      }
+    } else if (head.type == kReduce) {
+      reduce_value.resize(head.num);
+      ok = worker->Recv(reduce_value.data(),
+                        reduce_value.size() * sizeof(double));
+      if (ok) {
+        reduce(worker_id, &reduce_value, (ReduceOp)head.length);
+        ok = worker->Send(reduce_value.data(),
+                          reduce_value.size() * sizeof(double));
+      }
+    } else if (head.type == kClock) {
+      head.num = clock(worker_id, head.num);
+      ok = worker->Send(&head, sizeof(head));
+    } else {
+      LOG(FATAL) << "Unknow message type: " << head.type;
+    }
+    if (!ok) { break; }
+  }
+  LOG(ERR) << "Server " << server_id_ << " lost a worker.";
+  set_active(worker_id, false);
+  worker->Close();
+}
+
+// The last worker of a round gives the result to the others.
+// The workers in a round are not waited for by the clocks, so
+// the workers behind them can get there.
+void ParameterServer::reduce(size_t worker_id,
+                             std::vector<double>* value,
+                             ReduceOp op) {
+  std::unique_lock<std::mutex> lock(reduce_mutex_);
+  active_[worker_id] = false;
+  clock_cv_.notify_all();
+  uint64 generation = generation_;
+  if (num_arrived_ == 0) {
+    reduce_value_ = *value;
+  } else {
+    CHECK_EQ(reduce_value_.size(), value->size());
+    for (size_t i = 0; i < value->size(); ++i) {
+      if (op == kReduceSum) {
+        reduce_value_[i] += (*value)[i];
+      } else {
+        reduce_value_[i] = std::max(reduce_value_[i], (*value)[i]);
+      }
+    }
+  }
+  if (++num_arrived_ == num_worker_) {
+    reduce_result_.swap(reduce_value_);
+    num_arrived_ = 0;
+    ++generation_;
+    reduce_cv_.notify_all();
+  } else {
+    reduce_cv_.wait(lock, [&]() { return generation_ != generation; });
+  }
+  *value = reduce_result_;
+  active_[worker_id] = true;
+}
+
+uint64 ParameterServer::clock(size_t worker_id, uint64 clock) {
+  std::unique_lock<std::mutex> lock(reduce_mutex_);
+  clock_[worker_id] = clock;
+  clock_cv_.notify_all();
+  uint64 slowest = clock;
+  clock_cv_.wait(lock, [&]() {
+    slowest = clock;
+    for (size_t i = 0; i < clock_.size(); ++i) {
+      if (active_[i]) { slowest = std::min(slowest, clock_[i]); }
+    }
+    return staleness_ < 0 || clock - slowest <= (uint64)staleness_;
+  });
+  return slowest;
+}
+
+void ParameterServer::set_active(size_t worker_id, bool active) {
+  std::lock_guard<std::mutex> lock(reduce_mutex_);
+  active_[worker_id] = active;
+  clock_cv_.notify_all();
+}
+
+void ParameterServer::Wait() {
+  if (accept_thread_.joinable()) {
+    accept_thread_.join();
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+  threads_.clear();
+  workers_.clear();
+}
+
+}  // namespace xLearn
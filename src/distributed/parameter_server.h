@@ -16,22 +16,130 @@
 
 /*
 This file defines the KVStore class, which allows workers 
-to get and set the model parameters.
+to get and set the model parameters, and the ParameterServer
+class, which keeps a shard of the model parameters.
 */
 
 #ifndef XLEARN_DISTRIBUTED_KVSTORE_H_
 #define XLEARN_DISTRIBUTED_KVSTORE_H_
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "src/base/common.h"
+#include "src/base/half.h"
 #include "src/data/data_structure.h"
+#include "src/distributed/transport.h"
 
 namespace xLearn {
 
+// The messages between the KVStore and the ParameterServer. Each
+// request starts with a MessageHead, which is followed by num keys
+// (kPull), num keys and num * length values (kPush), or num values
+// of double (kReduce, where length is the ReduceOp). The reply of
+// kPull is num * length values, the reply of kPush is its head, and
+// the reply of kReduce is num values. kStop has no reply. The num of
+// kClock is the clock of the worker, and its reply is a head whose
+// num is the clock of the slowest worker. kPushEncoded is a kPush
+// of the encoded values (see KVStore::SetCompression()), whose keys
+// follow an EncodeHead, and then the topk positions (uint16) of each key and
+// the topk encoded values of each key (after a float scale of each
+// key for int8). Its reply is the same as kPush.
+//
+// If the type of kPull, kPush or kPushEncoded has the kKeyRuns bit, its
+// keys are sent as the runs of the consecutive keys, which are a uint64
+// number of runs and then a KeyRun of each run, instead of num keys.
+enum MessageType {
+  kPull = 1,
+  kPush = 2,
+  kReduce = 3,
+  kStop = 4,
+  kClock = 5,
+  kPushEncoded = 6,
+  kKeyRuns = 0x100
+};
+
+struct MessageHead {
+  uint32 type;
+  uint32 length;
+  uint64 num;
+};
+
+// The keys [start, start + count) of a message.
+struct KeyRun {
+  index_t start;
+  index_t count;
+};
+
+struct EncodeHead {
+  /* The StorageType of the values */
+  uint32 type;
+  /* Number of the values of each key, and there
+  are no positions if it is the length */
+  uint32 topk;
+};
+
+// Return the size of the positions (uint16) of kPushEncoded for num
+// keys, which is padded to 4 bytes, and 0 if all values are sent.
+inline size_t PositionSize(const EncodeHead& head,
+                           size_t num,
+                           size_t length) {
+  if (head.topk >= length) { return 0; }
+  return (num * head.topk * sizeof(uint16) + 3) / 4 * 4;
+}
+
+// Return the size of the values of kPushEncoded
+// for num keys, which has no the positions.
+inline size_t EncodedSize(const EncodeHead& head, size_t num) {
+  size_t count = num * head.topk;
+  switch (head.type) {
+    case kStoreFP16:
+    case kStoreBF16: return count * sizeof(uint16);
+    case kStoreInt8: return num * sizeof(real_t) + count * sizeof(int8);
+    default: return count * sizeof(real_t);
+  }
+}
+
+// How the values of the workers are combined by AllReduce()
+enum ReduceOp {
+  kReduceSum = 0,
+  kReduceMax = 1
+};
+
+// The statistics of the clocks of a worker (see KVStore::Clock()),
+// where the staleness of a clock is the number of the clocks that
+// the worker is ahead of the slowest worker.
+struct ClockStat {
+  uint64 num_clock = 0;
+  uint64 sum_staleness = 0;
+  uint64 max_staleness = 0;
+  /* Seconds of waiting for the slowest worker */
+  double wait_time = 0;
+};
+
 //------------------------------------------------------------------------------
 // KVStore are used for distributed training and it allows workers to get
 // and set the model parameters by using pull() and push() API.
+//
+// Each worker connects to all the servers by Connect(). The keys of a
+// Push() or a Pull() are split by GetServerId(), and one message with
+// the local keys (FeatMap()) is sent to each of the servers, which are
+// all sent before the replies are received, so the servers work at the
+// same time. A KVStore is used by one thread.
+//
+// A simple example:
+//
+//   KVStore store;
+//   if (!store.Connect(servers, 60)) { ... }
+//   store.Pull(keys, &values, length);
+//   ...  /* update values */
+//   store.Push(keys, delta, length);
+//   store.AllReduce(&loss, kReduceSum);  /* wait for all the workers */
+//   store.Stop();
 //------------------------------------------------------------------------------
 class KVStore {
  public:
@@ -46,7 +154,14 @@ class KVStore {
      server_num_ = server_num;
    }
 
-   // Push a list of (key, value) into store.
+   // Connect to the servers given by "host:port", which are
+   // waited for timeout seconds. It also calls Initialize().
+   // Return false if a server cannot be connected.
+   bool Connect(const std::vector<std::string>& servers, int timeout);
+
+   // Push a list of (key, value) into store, and the values
+   // are added to the values of the keys on the servers, e.g.,
+   // the change of the model parameters of a worker.
    // For example:
    //  ------------------------------------------------------
    // |  key:   |  0  |  2  |  4  |  5  |  6   |  7   |  9   |
@@ -94,6 +209,77 @@ class KVStore {
    	               std::vector<real_t>* value_list, 
    	               const size_t length);
 
+   // Wait for all the workers, and then replace the values with
+   // the sum (or the max) of the values of all the workers, which
+   // are combined by the first server. It is also the barrier of
+   // the workers, e.g., after all of their pushes of an epoch.
+   void AllReduce(std::vector<double>* value, ReduceOp op);
+
+   // Tell the servers that this worker is done.
+   void Stop();
+
+   // Use the clock of bounded staleness, and Clock() is
+   // a no-op if it is not used (by default).
+   void SetClock(bool use_clock) { use_clock_ = use_clock; }
+
+   // Advance the clock of this worker, which is called before each
+   // mini-batch. The first server blocks it while the worker is more
+   // than the staleness ahead of the slowest worker, where the workers
+   // in AllReduce() or after Stop() are not waited for.
+   void Clock();
+
+   // Return the statistics of the clocks.
+   const ClockStat& GetClockStat() const { return clock_stat_; }
+
+   // Encode the values of Push() by the type (fp32 by default), and
+   // only send the topk_ratio of the values of each key (at least one)
+   // that have the largest magnitude, where 1 sends all of them (and
+   // so do the keys of more than 65535 values). The
+   // error of the encoding is kept by this worker, and it is added to
+   // the next push of the key (error feedback), so no change is lost.
+   void SetCompression(StorageType type, real_t topk_ratio = 1.0) {
+     CHECK_GT(topk_ratio, 0);
+     CHECK_LE(topk_ratio, 1);
+     push_type_ = type;
+     topk_ratio_ = topk_ratio;
+   }
+
+   // Return the bytes of the values of the pushes, and the
+   // bytes of them without the compression.
+   uint64 GetPushBytes() const { return push_bytes_; }
+   uint64 GetRawPushBytes() const { return raw_push_bytes_; }
+
+   // Give each server a contiguous range of the keys, where the server
+   // s has the keys [bounds[s], bounds[s+1]), instead of the keys of
+   // the same remainder (by default). It is called after Connect(), and
+   // bounds has server_num + 1 values, where bounds[0] is 0. The keys
+   // after the last bound belong to the last server.
+   void SetRangePartition(const std::vector<index_t>& bounds);
+
+   // Return the bounds that split the keys [0, num_key) into the
+   // ranges of server_num servers with the same number of keys.
+   static std::vector<index_t> RangeBounds(index_t num_key,
+                                           size_t server_num);
+
+   // Return the bounds that split the keys [0, num_key) into the
+   // ranges of server_num servers with about the same load, where
+   // block_count[b] is the total count of the keys [b * block_size,
+   // (b + 1) * block_size) in the training data, e.g., the pulls and the
+   // pushes of the server. The load of a block is its count plus its
+   // number of keys times the average count of a key, so the memory of
+   // the servers is balanced as well, and the bounds are the multiples
+   // of the block_size.
+   static std::vector<index_t> BalancedBounds(
+       const std::vector<double>& block_count,
+       index_t block_size,
+       index_t num_key,
+       size_t server_num);
+
+   // Return the number of the local keys of a server for the global
+   // keys [0, num_key), and the global key of a local key.
+   index_t NumLocalKey(index_t num_key, size_t server_id) const;
+   index_t GlobalKey(size_t server_id, index_t local_key) const;
+
    //---------------------------------------------------------------------------
    // In xLearn, we use a simple range strategy for model partition
    // on parameter server. For example, we have 10 features and 3 
@@ -113,6 +299,14 @@ class KVStore {
    //  ---------------      -----------      -----------
    //   |   |   |   |        |   |   |        |   |   |
    //   0   3   6   9        1   4   7        2   5   8
+   //
+   // With SetRangePartition(), e.g., the bounds { 0, 4, 7, 10 }:
+   //
+   //  ---------------------------------------
+   // | 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9 |
+   //  ---------------------------------------
+   //   |   |   |   |   |   |   |   |   |   |
+   //  s0  s0  s0  s0  s1  s1  s1  s2  s2  s2
    //---------------------------------------------------------------------------
 
    // Given a feature id, return the server id
@@ -124,10 +318,149 @@ class KVStore {
  private:
   /* The number of server */
   size_t server_num_;  
+  /* The first key of each server for the range partition,
+  and empty for the partition by the remainder */
+  std::vector<index_t> bounds_;
+  /* The connection to each server */
+  std::vector<std::unique_ptr<Socket>> servers_;
+  /* The local keys and the values of each server */
+  std::vector<std::vector<index_t>> local_key_;
+  std::vector<std::vector<real_t>> local_value_;
+  /* The position of each key in its server's message */
+  std::vector<size_t> position_;
+  /* The runs of the local keys of a message */
+  std::vector<KeyRun> runs_;
+  /* The clock of this worker */
+  bool use_clock_ = false;
+  uint64 clock_ = 0;
+  ClockStat clock_stat_;
+  /* The compression of the pushes */
+  StorageType push_type_ = kStoreFP32;
+  real_t topk_ratio_ = 1.0;
+  /* The error of the encoding of each key */
+  std::vector<real_t> residual_;
+  /* The encoded message of each server */
+  std::vector<std::vector<char>> encoded_;
+  uint64 push_bytes_ = 0;
+  uint64 raw_push_bytes_ = 0;
+
+  // If the pushes are compressed.
+  inline bool compressed() const {
+    return push_type_ != kStoreFP32 || topk_ratio_ < 1;
+  }
+
+  // Encode the local values of the server to encoded_, and
+  // return the head.
+  EncodeHead encode(size_t server_id, size_t length);
+
+  // Split the keys into local_key_ by the servers.
+  void split_keys(const std::vector<index_t>& key);
+
+  // Send the head of the type and the local keys of the server,
+  // which are sent as runs (kKeyRuns) if they are smaller. The
+  // encode_head of kPushEncoded is sent between them.
+  void send_keys(size_t server_id, uint32 type, size_t length,
+                 const EncodeHead* encode_head = nullptr);
+
+  // Send a message to the server, or die.
+  void send(size_t server_id, const void* data, size_t size);
+
+  // Receive a message from the server, or die.
+  void recv(size_t server_id, void* data, size_t size);
 
   DISALLOW_COPY_AND_ASSIGN(KVStore);
 };
 
+//------------------------------------------------------------------------------
+// ParameterServer keeps the values of the local keys of one server, e.g.,
+// the keys server_id, server_id + server_num, server_id + 2 * server_num,
+// and so on (see KVStore::GetServerId()), with length values per key. It
+// listens on a port, and serves each of the num_worker workers by its own
+// thread. The pushed values are added to the keys under a lock, so the
+// workers can push the same keys at the same time. If the staleness is
+// not negative, the first server keeps the clocks of the workers, and
+// a worker cannot be more than staleness clocks ahead of the slowest
+// one, which is the stale synchronous parallel (SSP) training.
+//
+// A simple example:
+//
+//   ParameterServer server;
+//   server.Start(port, server_id, server_num, num_worker, staleness);
+//   server.SetValue(length, &value);  /* before the first pull */
+//   ...
+//   server.Wait();  /* until all the workers stop */
+//------------------------------------------------------------------------------
+class ParameterServer {
+ public:
+  // Constructor and Destructor
+  ParameterServer() { }
+  ~ParameterServer() { Wait(); }
+
+  // Listen on the port (0 for a free port), and serve the workers
+  // in the background. Return the port, or -1 if it cannot listen.
+  // A negative staleness does not bound the clocks.
+  int Start(int port, size_t server_id,
+            size_t server_num, size_t num_worker,
+            int staleness = -1);
+
+  // Set the values of the local keys, which has length values for
+  // each local key. The value is moved to this server.
+  void SetValue(size_t length, std::vector<real_t>* value);
+
+  // Get the number of the local keys of a server for the
+  // global keys [0, num_key).
+  static index_t NumLocalKey(index_t num_key,
+                             size_t server_id,
+                             size_t server_num);
+
+  // Wait until all the workers stop (KVStore::Stop()).
+  void Wait();
+
+ private:
+  size_t server_id_ = 0;
+  size_t num_worker_ = 0;
+  /* The values of the local keys */
+  std::vector<real_t> value_;
+  size_t length_ = 0;
+  std::mutex value_mutex_;
+  /* The workers waiting in AllReduce(), and the lock
+  of the clocks of the workers */
+  std::mutex reduce_mutex_;
+  std::condition_variable reduce_cv_;
+  size_t num_arrived_ = 0;
+  uint64 generation_ = 0;
+  std::vector<double> reduce_value_;
+  std::vector<double> reduce_result_;
+  /* The clocks, and if the workers are waited for */
+  int staleness_ = -1;
+  std::vector<uint64> clock_;
+  std::vector<bool> active_;
+  std::condition_variable clock_cv_;
+  /* The connections of the workers */
+  Socket listener_;
+  std::vector<std::unique_ptr<Socket>> workers_;
+  std::thread accept_thread_;
+  std::vector<std::thread> threads_;
+
+  // Accept the connections of the workers.
+  void accept_workers();
+
+  // Serve the requests of a worker until it stops.
+  void serve(Socket* worker, size_t worker_id);
+
+  // Combine the values of a worker, and wait for the others.
+  void reduce(size_t worker_id, std::vector<double>* value, ReduceOp op);
+
+  // Set the clock of a worker, and wait until it is in the
+  // staleness. Return the clock of the slowest worker.
+  uint64 clock(size_t worker_id, uint64 clock);
+
+  // Stop waiting for a worker.
+  void set_active(size_t worker_id, bool active);
+
+  DISALLOW_COPY_AND_ASSIGN(ParameterServer);
+};
+
 }  // namespace xLearn
 
 #endif  // XLEARN_DISTRIBUTED_KVSTORE_H_
\ No newline at end of file
@@ -20,6 +20,12 @@ This file tests the KVStore class file
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "src/distributed/parameter_server.h"
 
 namespace xLearn {
@@ -54,4 +60,287 @@ TEST(KVStoreTest, FeatMap) {
   EXPECT_EQ(store.FeatMap((index_t)9), (index_t)3);
 }
 
-}  // namespace xLearn
\ No newline at end of file
+TEST(KVStoreTest, RangePartition) {
+  KVStore store;
+  store.Initialize(3);
+  // The keys 0..3 / 4..6 / 7..9
+  store.SetRangePartition({ 0, 4, 7, 10 });
+  size_t server[] = { 0, 0, 0, 0, 1, 1, 1, 2, 2, 2, 2 };
+  index_t local[] = { 0, 1, 2, 3, 0, 1, 2, 0, 1, 2, 3 };
+  for (index_t k = 0; k <= 10; ++k) {
+    EXPECT_EQ(store.GetServerId(k), server[k]);
+    EXPECT_EQ(store.FeatMap(k), local[k]);
+    EXPECT_EQ(store.GlobalKey(server[k], local[k]), k);
+  }
+  EXPECT_EQ(store.NumLocalKey(10, 0), (index_t)4);
+  EXPECT_EQ(store.NumLocalKey(10, 1), (index_t)3);
+  EXPECT_EQ(store.NumLocalKey(10, 2), (index_t)3);
+  EXPECT_EQ(store.NumLocalKey(5, 2), (index_t)0);
+  // A server can be empty
+  store.SetRangePartition({ 0, 5, 5, 10 });
+  EXPECT_EQ(store.GetServerId(5), (size_t)2);
+  EXPECT_EQ(store.NumLocalKey(10, 1), (index_t)0);
+  EXPECT_EQ(KVStore::RangeBounds(10, 3),
+            std::vector<index_t>({ 0, 3, 6, 10 }));
+}
+
+TEST(KVStoreTest, BalancedBounds) {
+  // Without the counts, it is the same as RangeBounds()
+  EXPECT_EQ(KVStore::BalancedBounds({}, 10, 100, 4),
+            KVStore::RangeBounds(100, 4));
+  // The first block has most of the count, so it gets a server
+  std::vector<double> count(10, 1);
+  count[0] = 91;
+  std::vector<index_t> bounds = KVStore::BalancedBounds(count, 10, 100, 2);
+  EXPECT_EQ(bounds, std::vector<index_t>({ 0, 10, 100 }));
+  // The uniform counts split by the keys
+  count.assign(10, 5);
+  bounds = KVStore::BalancedBounds(count, 10, 100, 5);
+  EXPECT_EQ(bounds, std::vector<index_t>({ 0, 20, 40, 60, 80, 100 }));
+  // The bounds are in [0, num_key] for the last short block
+  bounds = KVStore::BalancedBounds(count, 10, 95, 3);
+  ASSERT_EQ(bounds.size(), (size_t)4);
+  EXPECT_EQ(bounds[3], (index_t)95);
+  for (size_t s = 0; s < 3; ++s) {
+    EXPECT_LE(bounds[s], bounds[s + 1]);
+  }
+}
+
+TEST(ParameterServerTest, NumLocalKey) {
+  // The keys 0, 3, 6, 9 / 1, 4, 7 / 2, 5, 8
+  EXPECT_EQ(ParameterServer::NumLocalKey(10, 0, 3), (index_t)4);
+  EXPECT_EQ(ParameterServer::NumLocalKey(10, 1, 3), (index_t)3);
+  EXPECT_EQ(ParameterServer::NumLocalKey(10, 2, 3), (index_t)3);
+  EXPECT_EQ(ParameterServer::NumLocalKey(1, 1, 2), (index_t)0);
+}
+
+const size_t kNumServer = 2;
+const size_t kNumWorker = 2;
+const index_t kNumKey = 7;
+const size_t kLength = 3;
+
+// The initial value of each key is (key, key + 0.5, key + 0.25)
+void init_servers(ParameterServer* server, std::vector<std::string>* hosts) {
+  for (size_t s = 0; s < kNumServer; ++s) {
+    int port = server[s].Start(0, s, kNumServer, kNumWorker);
+    ASSERT_GT(port, 0);
+    hosts->push_back("127.0.0.1:" + std::to_string(port));
+    index_t num_local = ParameterServer::NumLocalKey(kNumKey, s, kNumServer);
+    std::vector<real_t> value;
+    for (index_t i = 0; i < num_local; ++i) {
+      real_t key = i * kNumServer + s;
+      value.push_back(key);
+      value.push_back(key + 0.5);
+      value.push_back(key + 0.25);
+    }
+    server[s].SetValue(kLength, &value);
+  }
+}
+
+TEST(ParameterServerTest, PullAndPush) {
+  ParameterServer server[kNumServer];
+  std::vector<std::string> hosts;
+  init_servers(server, &hosts);
+  std::vector<real_t> result[kNumWorker];
+  std::vector<double> sum[kNumWorker];
+  std::vector<double> max[kNumWorker];
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < kNumWorker; ++w) {
+    threads.push_back(std::thread([&, w]() {
+      KVStore store;
+      CHECK(store.Connect(hosts, 10));
+      std::vector<index_t> key = { 6, 1, 4 };
+      std::vector<real_t> value;
+      store.Pull(key, &value, kLength);
+      CHECK_EQ(value.size(), key.size() * kLength);
+      for (size_t i = 0; i < key.size(); ++i) {
+        CHECK_EQ(value[i*kLength], (real_t)key[i]);
+        CHECK_EQ(value[i*kLength+1], (real_t)key[i] + 0.5);
+        CHECK_EQ(value[i*kLength+2], (real_t)key[i] + 0.25);
+      }
+      // Each worker adds 1 to the keys after the pulls of all
+      std::vector<double> barrier(1, 0);
+      store.AllReduce(&barrier, kReduceSum);
+      std::vector<real_t> delta(key.size() * kLength, 1.0);
+      store.Push(key, delta, kLength);
+      // Wait for the pushes of all the workers
+      sum[w] = { 1.0, (double)w };
+      store.AllReduce(&sum[w], kReduceSum);
+      max[w] = { (double)w, -1.0 };
+      store.AllReduce(&max[w], kReduceMax);
+      std::vector<index_t> all(kNumKey);
+      for (index_t i = 0; i < kNumKey; ++i) { all[i] = i; }
+      store.Pull(all, &result[w], kLength);
+      store.Stop();
+    }));
+  }
+  for (size_t w = 0; w < kNumWorker; ++w) {
+    threads[w].join();
+  }
+  for (size_t s = 0; s < kNumServer; ++s) {
+    server[s].Wait();
+  }
+  for (size_t w = 0; w < kNumWorker; ++w) {
+    ASSERT_EQ(sum[w].size(), (size_t)2);
+    EXPECT_EQ(sum[w][0], 2.0);
+    EXPECT_EQ(sum[w][1], 1.0);
+    ASSERT_EQ(max[w].size(), (size_t)2);
+    EXPECT_EQ(max[w][0], 1.0);
+    EXPECT_EQ(max[w][1], -1.0);
+    ASSERT_EQ(result[w].size(), kNumKey * kLength);
+    for (index_t k = 0; k < kNumKey; ++k) {
+      real_t add = (k == 1 || k == 4 || k == 6) ? kNumWorker : 0;
+      EXPECT_FLOAT_EQ(result[w][k*kLength], k + add);
+      EXPECT_FLOAT_EQ(result[w][k*kLength+1], k + 0.5 + add);
+      EXPECT_FLOAT_EQ(result[w][k*kLength+2], k + 0.25 + add);
+    }
+  }
+}
+
+// The ranges of the keys are pulled and pushed as runs.
+TEST(ParameterServerTest, RangePartition) {
+  const index_t kKey = 100;
+  const std::vector<index_t> kBounds = { 0, 30, kKey };
+  ParameterServer server[kNumServer];
+  std::vector<std::string> hosts;
+  for (size_t s = 0; s < kNumServer; ++s) {
+    int port = server[s].Start(0, s, kNumServer, 1);
+    ASSERT_GT(port, 0);
+    hosts.push_back("127.0.0.1:" + std::to_string(port));
+    std::vector<real_t> value;
+    for (index_t k = kBounds[s]; k < kBounds[s + 1]; ++k) {
+      value.push_back(k);
+      value.push_back(k + 0.5);
+    }
+    server[s].SetValue(2, &value);
+  }
+  KVStore store;
+  ASSERT_TRUE(store.Connect(hosts, 10));
+  store.SetRangePartition(kBounds);
+  std::vector<index_t> all(kKey);
+  for (index_t k = 0; k < kKey; ++k) { all[k] = k; }
+  std::vector<real_t> value;
+  store.Pull(all, &value, 2);
+  ASSERT_EQ(value.size(), kKey * 2);
+  for (index_t k = 0; k < kKey; ++k) {
+    EXPECT_EQ(value[k * 2], (real_t)k);
+    EXPECT_EQ(value[k * 2 + 1], (real_t)k + 0.5);
+  }
+  // The runs of the dense keys and the single keys
+  std::vector<index_t> key = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 29, 30, 99 };
+  std::vector<real_t> delta(key.size() * 2, 1.0);
+  store.Push(key, delta, 2);
+  store.Push(all, std::vector<real_t>(kKey * 2, 1.0), 2);
+  store.Pull(all, &value, 2);
+  store.Stop();
+  for (size_t s = 0; s < kNumServer; ++s) {
+    server[s].Wait();
+  }
+  for (index_t k = 0; k < kKey; ++k) {
+    real_t add = 1;
+    if (std::find(key.begin(), key.end(), k) != key.end()) { add = 2; }
+    EXPECT_EQ(value[k * 2], (real_t)k + add);
+    EXPECT_EQ(value[k * 2 + 1], (real_t)k + 0.5 + add);
+  }
+}
+
+// A worker waits while it is more than the staleness ahead of the
+// slowest worker, which is not waited for in AllReduce().
+TEST(ParameterServerTest, Clock) {
+  for (int staleness : { 0, 1 }) {
+    ParameterServer server;
+    int port = server.Start(0, 0, 1, kNumWorker, staleness);
+    ASSERT_GT(port, 0);
+    std::vector<real_t> value(1, 0);
+    server.SetValue(1, &value);
+    std::vector<std::string> hosts(1, "127.0.0.1:" + std::to_string(port));
+    ClockStat stat[kNumWorker];
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < kNumWorker; ++w) {
+      threads.push_back(std::thread([&, w]() {
+        KVStore store;
+        CHECK(store.Connect(hosts, 10));
+        store.SetClock(true);
+        // The second worker is slow, and it clocks once
+        if (w == 1) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          store.Clock();
+          std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        } else {
+          for (int i = 0; i < 4; ++i) { store.Clock(); }
+        }
+        std::vector<double> barrier(1, 0);
+        store.AllReduce(&barrier, kReduceSum);
+        stat[w] = store.GetClockStat();
+        store.Stop();
+      }));
+    }
+    for (size_t w = 0; w < kNumWorker; ++w) {
+      threads[w].join();
+    }
+    server.Wait();
+    EXPECT_EQ(stat[0].num_clock, (uint64)4);
+    EXPECT_EQ(stat[1].num_clock, (uint64)1);
+    // The clock 1 + staleness waits for the AllReduce()
+    // of the slow worker, which stops its clock at 0
+    EXPECT_EQ(stat[0].max_staleness, (uint64)staleness);
+    EXPECT_GT(stat[0].wait_time, 0.05);
+    EXPECT_EQ(stat[1].max_staleness, (uint64)0);
+  }
+}
+
+// The encoded push only sends a part of the change, and the error is
+// sent by the next pushes, so the pushes of 0 send the rest of it.
+TEST(ParameterServerTest, Compression) {
+  struct Option { StorageType type; real_t ratio; real_t error; };
+  std::vector<Option> options = {
+    { kStoreFP16, 1.0, 1e-3 }, { kStoreBF16, 1.0, 1e-2 },
+    { kStoreInt8, 1.0, 1e-2 }, { kStoreFP32, 0.5, 0 },
+    { kStoreInt8, 0.25, 1e-2 }
+  };
+  for (const Option& option : options) {
+    ParameterServer server;
+    int port = server.Start(0, 0, 1, 1);
+    ASSERT_GT(port, 0);
+    std::vector<real_t> init(kNumKey * 4, 0);
+    server.SetValue(4, &init);
+    KVStore store;
+    ASSERT_TRUE(store.Connect({ "127.0.0.1:" + std::to_string(port) }, 10));
+    store.SetCompression(option.type, option.ratio);
+    std::vector<index_t> key = { 5, 0, 3 };
+    std::vector<real_t> delta(key.size() * 4);
+    for (size_t i = 0; i < delta.size(); ++i) {
+      delta[i] = (i % 2 == 0 ? 1 : -1) * 0.1234 * (i + 1);
+    }
+    store.Push(key, delta, 4);
+    std::vector<real_t> value;
+    store.Pull(key, &value, 4);
+    // Only the largest values of each key are sent
+    for (size_t i = 0; i < key.size(); ++i) {
+      size_t num_sent = 0;
+      for (size_t j = 0; j < 4; ++j) {
+        real_t v = value[i * 4 + j];
+        real_t d = delta[i * 4 + j];
+        if (v != 0) {
+          num_sent++;
+          EXPECT_NEAR(v, d, option.error * std::abs(d));
+        }
+        if (option.ratio < 1 && j == 3) { EXPECT_NE(v, 0); }
+      }
+      EXPECT_EQ(num_sent, (size_t)(4 * option.ratio));
+    }
+    std::vector<real_t> zero(delta.size(), 0);
+    for (int n = 0; n < 4; ++n) {
+      store.Push(key, zero, 4);
+    }
+    store.Pull(key, &value, 4);
+    for (size_t i = 0; i < delta.size(); ++i) {
+      EXPECT_NEAR(value[i], delta[i], 5e-4);
+    }
+    EXPECT_GT(store.GetRawPushBytes(), store.GetPushBytes());
+    store.Stop();
+    server.Wait();
+  }
+}
+
+}  // namespace xLearn
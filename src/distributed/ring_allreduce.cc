@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of RingAllReduce.
+*/
+
+#include "src/distributed/ring_allreduce.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace xLearn {
+
+bool RingAllReduce::Connect(const std::vector<std::string>& hosts,
+                            size_t rank,
+                            int timeout) {
+  CHECK_LT(rank, hosts.size());
+  rank_ = rank;
+  num_node_ = hosts.size();
+  if (num_node_ == 1) { return true; }
+  std::string host;
+  int port = 0;
+  if (!ParseAddress(hosts[rank], &host, &port) ||
+      listener_.Listen(port) < 0) {
+    LOG(ERR) << "Cannot listen on: " << hosts[rank];
+    return false;
+  }
+  // The connection is queued by the listener of the next
+  // node before it is accepted, so all the nodes connect first
+  const std::string& next = hosts[(rank + 1) % num_node_];
+  if (!ParseAddress(next, &host, &port) ||
+      !next_.Connect(host, port, timeout)) {
+    LOG(ERR) << "Cannot connect to the next node: " << next;
+    return false;
+  }
+  if (!listener_.Accept(&prev_)) {
+    LOG(ERR) << "Cannot accept the previous node.";
+    return false;
+  }
+  listener_.Close();
+  return true;
+}
+
+void RingAllReduce::AllReduce(real_t* data, size_t size, ReduceOp op) {
+  all_reduce(data, size, op);
+}
+
+void RingAllReduce::AllReduce(double* data, size_t size, ReduceOp op) {
+  all_reduce(data, size, op);
+}
+
+// After the step s of the reduce-scatter, the segment (rank - s - 1)
+// has the values of s + 2 nodes, so the segment (rank + 1) has all the
+// values after n - 1 steps, which is passed around by the all-gather.
+template <typename T>
+void RingAllReduce::all_reduce(T* data, size_t size, ReduceOp op) {
+  if (num_node_ == 1 || size == 0) { return; }
+  CHECK_NOTNULL(data);
+  size_t n = num_node_;
+  auto begin = [&](size_t segment) { return segment % n * size / n; };
+  auto end = [&](size_t segment) { return (segment % n + 1) * size / n; };
+  // Add n to the segments, so they are not negative
+  for (size_t s = 0; s + 1 < n; ++s) {
+    size_t send = rank_ + n - s;
+    size_t recv = rank_ + 2 * n - s - 1;
+    exchange(data, begin(send), end(send),
+             begin(recv), end(recv), true, op);
+  }
+  for (size_t s = 0; s + 1 < n; ++s) {
+    size_t send = rank_ + n + 1 - s;
+    size_t recv = rank_ + n - s;
+    exchange(data, begin(send), end(send),
+             begin(recv), end(recv), false, op);
+  }
+}
+
+template <typename T>
+void RingAllReduce::exchange(T* data,
+                             size_t send_begin, size_t send_end,
+                             size_t recv_begin, size_t recv_end,
+                             bool reduce, ReduceOp op) {
+  bool sent = true;
+  std::thread sender([&]() {
+    sent = next_.Send(data + send_begin,
+                      (send_end - send_begin) * sizeof(T));
+  });
+  buffer_.resize(kPieceSize * sizeof(T));
+  T* piece = reinterpret_cast<T*>(buffer_.data());
+  bool received = true;
+  for (size_t i = recv_begin; i < recv_end && received; i += kPieceSize) {
+    size_t len = std::min(kPieceSize, recv_end - i);
+    received = prev_.Recv(piece, len * sizeof(T));
+    if (!received) { break; }
+    T* dst = data + i;
+    if (!reduce) {
+      memcpy(dst, piece, len * sizeof(T));
+    } else if (op == kReduceSum) {
+      for (size_t j = 0; j < len; ++j) { dst[j] += piece[j]; }
+    } else {
+      for (size_t j = 0; j < len; ++j) {
+        dst[j] = std::max(dst[j], piece[j]);
+      }
+    }
+  }
+  sender.join();
+  if (!sent || !received) {
+    LOG(FATAL) << "Lost the connection of the ring of node " << rank_;
+  }
+}
+
+}  // namespace xLearn
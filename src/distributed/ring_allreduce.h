@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the RingAllReduce class, which sums the arrays
+of all the nodes of data-parallel training without any server.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_RING_ALLREDUCE_H_
+#define XLEARN_DISTRIBUTED_RING_ALLREDUCE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/distributed/parameter_server.h"
+#include "src/distributed/transport.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// RingAllReduce connects the nodes in a ring, where each node sends to
+// the next node and receives from the previous one. AllReduce() splits
+// the array into one segment per node, and it is a reduce-scatter of
+// (n - 1) steps followed by an all-gather of (n - 1) steps, so each node
+// sends and receives 2 * (n - 1) / n of the array, which does not grow
+// with the number of nodes. In each step, the segment is sent by another
+// thread, while the segment from the previous node is received and
+// reduced piece by piece (kPieceSize values).
+//
+// All the nodes must call AllReduce() with the same size in the same
+// order, and it is used by one thread at a time.
+//
+// A simple example:
+//
+//   RingAllReduce ring;
+//   if (!ring.Connect(hosts, rank, 60)) { ... }
+//   ring.AllReduce(grad.data(), grad.size(), kReduceSum);
+//------------------------------------------------------------------------------
+class RingAllReduce {
+ public:
+  // Constructor and Destructor
+  RingAllReduce() { }
+  ~RingAllReduce() { }
+
+  // Listen on the port of hosts[rank] ("host:port"), connect to the
+  // next node, which is waited for timeout seconds, and accept the
+  // previous node. Return false if the ring cannot be connected.
+  bool Connect(const std::vector<std::string>& hosts,
+               size_t rank,
+               int timeout);
+
+  // Replace the size values of data with the sum (or the max)
+  // of the values of all the nodes.
+  void AllReduce(real_t* data, size_t size, ReduceOp op);
+  void AllReduce(double* data, size_t size, ReduceOp op);
+
+  // Rank of this node and the number of the nodes.
+  inline size_t Rank() const { return rank_; }
+  inline size_t NumNode() const { return num_node_; }
+
+  // Number of the values of each receive.
+  static const size_t kPieceSize = 64 * 1024;
+
+ private:
+  size_t rank_ = 0;
+  size_t num_node_ = 1;
+  Socket listener_;
+  /* The connections to the next and the previous node */
+  Socket next_;
+  Socket prev_;
+  /* The piece from the previous node */
+  std::vector<char> buffer_;
+
+  template <typename T>
+  void all_reduce(T* data, size_t size, ReduceOp op);
+
+  // Send the segment [send_begin, send_end) to the next node, and
+  // receive [recv_begin, recv_end) from the previous node at the same
+  // time, which is reduced to data (or copied if reduce is false).
+  template <typename T>
+  void exchange(T* data,
+                size_t send_begin, size_t send_end,
+                size_t recv_begin, size_t recv_end,
+                bool reduce, ReduceOp op);
+
+  DISALLOW_COPY_AND_ASSIGN(RingAllReduce);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_RING_ALLREDUCE_H_
@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the RingAllReduce class.
+*/
+
+#include "gtest/gtest.h"
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#endif
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/distributed/ring_allreduce.h"
+
+namespace xLearn {
+
+// The free ports of the nodes, which are closed before the ring
+// listens on them
+void get_hosts(size_t num_node, std::vector<std::string>* hosts) {
+  std::vector<Socket> socket(num_node);
+  for (size_t i = 0; i < num_node; ++i) {
+    int port = socket[i].Listen(0);
+    ASSERT_GT(port, 0);
+    hosts->push_back("127.0.0.1:" + std::to_string(port));
+  }
+}
+
+// Node i has value j * (i + 1) at j, where some segments are
+// empty for the small sizes, and the large size has many pieces.
+TEST(RingAllReduceTest, AllReduce) {
+  for (size_t num_node : { 1, 2, 3, 5 }) {
+    std::vector<std::string> hosts;
+    get_hosts(num_node, &hosts);
+    std::vector<size_t> sizes = { 1, 4, 7, 3 * RingAllReduce::kPieceSize + 5 };
+    std::vector<std::vector<std::vector<real_t>>> sum(num_node);
+    std::vector<std::vector<double>> max(num_node);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_node; ++i) {
+      threads.push_back(std::thread([&, i]() {
+        RingAllReduce ring;
+        CHECK(ring.Connect(hosts, i, 10));
+        CHECK_EQ(ring.Rank(), i);
+        CHECK_EQ(ring.NumNode(), num_node);
+        for (size_t size : sizes) {
+          std::vector<real_t> value(size);
+          for (size_t j = 0; j < size; ++j) {
+            value[j] = (j % 100) * (i + 1);
+          }
+          ring.AllReduce(value.data(), value.size(), kReduceSum);
+          sum[i].push_back(value);
+        }
+        max[i] = { (double)i, -(double)i, 0.5 };
+        ring.AllReduce(max[i].data(), max[i].size(), kReduceMax);
+      }));
+    }
+    for (size_t i = 0; i < num_node; ++i) {
+      threads[i].join();
+    }
+    real_t factor = num_node * (num_node + 1) / 2;
+    for (size_t i = 0; i < num_node; ++i) {
+      ASSERT_EQ(sum[i].size(), sizes.size());
+      for (size_t k = 0; k < sizes.size(); ++k) {
+        ASSERT_EQ(sum[i][k].size(), sizes[k]);
+        for (size_t j = 0; j < sizes[k]; ++j) {
+          ASSERT_FLOAT_EQ(sum[i][k][j], (j % 100) * factor);
+        }
+      }
+      EXPECT_EQ(max[i][0], num_node - 1.0);
+      EXPECT_EQ(max[i][1], 0.0);
+      EXPECT_EQ(max[i][2], 0.5);
+    }
+  }
+}
+
+#ifndef _MSC_VER
+static void ignore_signal(int) { }
+
+// A signal without SA_RESTART interrupts the blocked recv(), which
+// must not drop the connection, while a closed peer still fails.
+TEST(RingAllReduceTest, SocketInterrupted) {
+  struct sigaction action, old_action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = ignore_signal;
+  sigemptyset(&action.sa_mask);
+  ASSERT_EQ(sigaction(SIGUSR1, &action, &old_action), 0);
+  Socket server;
+  int port = server.Listen(0);
+  ASSERT_GT(port, 0);
+  Socket client, conn;
+  ASSERT_TRUE(client.Connect("127.0.0.1", port, 10));
+  ASSERT_TRUE(server.Accept(&conn));
+  int value = 0;
+  bool ok = false;
+  std::thread reader([&]() { ok = conn.Recv(&value, sizeof(value)); });
+  for (int i = 0; i < 5; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pthread_kill(reader.native_handle(), SIGUSR1);
+  }
+  int sent = 42;
+  ASSERT_TRUE(client.Send(&sent, sizeof(sent)));
+  reader.join();
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(value, 42);
+  client.Close();
+  EXPECT_FALSE(conn.Recv(&value, sizeof(value)));
+  sigaction(SIGUSR1, &old_action, nullptr);
+}
+#endif
+
+}  // namespace xLearn
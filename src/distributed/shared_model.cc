@@ -0,0 +1,261 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of SharedModel.
+*/
+
+#include "src/distributed/shared_model.h"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#include "src/base/timer.h"
+
+namespace xLearn {
+
+// The control region, whose magic is set after the others, so a
+// process does not use a region that is being created.
+struct SharedHead {
+  std::atomic<uint64> magic;
+  uint64 num_proc;
+  /* Number of the processes in current barrier, and the
+  number of the barriers that all the processes passed */
+  std::atomic<uint64> arrived;
+  std::atomic<uint64> generation;
+  /* Size of the parameters, or 0 if they are not created */
+  uint64 param_size;
+  double value[SharedModel::kMaxProcess][SharedModel::kMaxValue];
+};
+
+static const uint64 kSharedMagic = 0x78536861726564ULL;
+
+// A waiting process spins for this number of times,
+// and then it sleeps between two checks.
+static const int kSpinCount = 10000;
+
+#ifndef _MSC_VER
+
+// Create the region of size bytes, which is filled with zeros.
+// The old region of the same name is removed.
+static void* create_region(const std::string& name, uint64 size) {
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1) { return nullptr; }
+  // The memory of /dev/shm is reserved here, so the
+  // training does not crash when it is exhausted
+  bool ok = ftruncate(fd, size) == 0;
+#ifdef __linux__
+  ok = ok && posix_fallocate(fd, 0, size) == 0;
+#endif
+  void* ptr = ok ? mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+  return ptr;
+}
+
+// Open the region of at least size bytes. Return nullptr if it
+// does not exist or it is smaller, e.g., it is being created.
+static void* open_region(const std::string& name, uint64 size) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd == -1) { return nullptr; }
+  struct stat st;
+  void* ptr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (uint64)st.st_size >= size) {
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+static void unmap_region(void* ptr, uint64 size) {
+  if (ptr != nullptr) { munmap(ptr, size); }
+}
+
+static void unlink_region(const std::string& name) {
+  shm_unlink(name.c_str());
+}
+
+#else  // _MSC_VER
+
+// The shared memory is not supported on Windows yet.
+static void* create_region(const std::string& name, uint64 size) {
+  return nullptr;
+}
+
+static void* open_region(const std::string& name, uint64 size) {
+  return nullptr;
+}
+
+static void unmap_region(void* ptr, uint64 size) { }
+
+static void unlink_region(const std::string& name) { }
+
+#endif  // _MSC_VER
+
+bool SharedModel::Connect(const std::string& name,
+                          size_t rank,
+                          size_t num_proc,
+                          int timeout) {
+  CHECK(!name.empty());
+  CHECK_GT(num_proc, 0);
+  CHECK_LE(num_proc, kMaxProcess);
+  CHECK_LT(rank, num_proc);
+  Close();
+  rank_ = rank;
+  num_proc_ = num_proc;
+  // The name of POSIX shared memory starts with '/'
+  name_ = name[0] == '/' ? name : "/" + name;
+  param_name_ = name_ + ".param";
+  if (rank_ == 0) {
+    void* ptr = create_region(name_, sizeof(SharedHead));
+    if (ptr == nullptr) {
+      LOG(ERR) << "Cannot create the shared memory: " << name_;
+      return false;
+    }
+    head_ = new (ptr) SharedHead();
+    CHECK(head_->arrived.is_lock_free());
+    head_->num_proc = num_proc_;
+    head_->magic.store(kSharedMagic);
+  } else {
+    Timer timer;
+    timer.tic();
+    for (;;) {
+      void* ptr = open_region(name_, sizeof(SharedHead));
+      if (ptr != nullptr) {
+        head_ = (SharedHead*)ptr;
+        if (head_->magic.load() == kSharedMagic) { break; }
+        unmap_region(ptr, sizeof(SharedHead));
+        head_ = nullptr;
+      }
+      if (timer.toc() > timeout) {
+        LOG(ERR) << "Cannot open the shared memory: " << name_;
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (head_->num_proc != num_proc_) {
+      LOG(ERR) << "The shared memory " << name_ << " is for "
+               << head_->num_proc << " processes, not " << num_proc_;
+      Close();
+      return false;
+    }
+  }
+  Barrier();
+  return true;
+}
+
+char* SharedModel::Allocate(uint64 size) {
+  CHECK_NOTNULL(head_);
+  CHECK_GT(size, 0);
+  CHECK(param_ == nullptr);
+  if (rank_ == 0) {
+    param_ = (char*)create_region(param_name_, size);
+    head_->param_size = param_ == nullptr ? 0 : size;
+  }
+  Barrier();
+  if (rank_ != 0 && head_->param_size == size) {
+    param_ = (char*)open_region(param_name_, size);
+  }
+  // All the processes see the same result
+  double failed = param_ == nullptr ? 1 : 0;
+  AllReduce(&failed, 1, kReduceMax);
+  if (rank_ == 0) {
+    unlink_region(param_name_);
+    unlink_region(name_);
+  }
+  if (failed > 0) {
+    LOG(ERR) << "Cannot allocate " << size << " bytes of "
+             << "the shared memory: " << param_name_;
+    unmap_region(param_, size);
+    param_ = nullptr;
+    return nullptr;
+  }
+  param_size_ = size;
+  return param_;
+}
+
+// The last process of a barrier resets the counter before it
+// starts the next generation, so the processes of the next
+// barrier always see the counter from zero.
+void SharedModel::Barrier() {
+  CHECK_NOTNULL(head_);
+  uint64 generation = head_->generation.load();
+  if (head_->arrived.fetch_add(1) + 1 == num_proc_) {
+    head_->arrived.store(0);
+    head_->generation.fetch_add(1);
+    return;
+  }
+  int spin = 0;
+  while (head_->generation.load() == generation) {
+    if (spin < kSpinCount) {
+      ++spin;
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+}
+
+// The second barrier keeps the values until all the processes
+// have read them, before the next AllReduce() writes them.
+void SharedModel::AllReduce(double* data, size_t size, ReduceOp op) {
+  CHECK_NOTNULL(head_);
+  CHECK_LE(size, kMaxValue);
+  std::copy(data, data + size, head_->value[rank_]);
+  Barrier();
+  for (size_t i = 0; i < size; ++i) {
+    double value = head_->value[0][i];
+    for (size_t p = 1; p < num_proc_; ++p) {
+      if (op == kReduceSum) {
+        value += head_->value[p][i];
+      } else {
+        value = std::max(value, head_->value[p][i]);
+      }
+    }
+    data[i] = value;
+  }
+  Barrier();
+}
+
+void SharedModel::Close() {
+  // The names are kept if Allocate() is not called
+  if (rank_ == 0 && head_ != nullptr) {
+    unlink_region(param_name_);
+    unlink_region(name_);
+  }
+  unmap_region(param_, param_size_);
+  param_ = nullptr;
+  param_size_ = 0;
+  unmap_region(head_, sizeof(SharedHead));
+  head_ = nullptr;
+}
+
+}  // namespace xLearn
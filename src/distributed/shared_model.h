@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the SharedModel class, which keeps one model in
+the shared memory for the processes of a host.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_SHARED_MODEL_H_
+#define XLEARN_DISTRIBUTED_SHARED_MODEL_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/distributed/parameter_server.h"
+
+namespace xLearn {
+
+struct SharedHead;
+
+//------------------------------------------------------------------------------
+// SharedModel lets several processes of one host train the same model
+// without any copy of it. The processes are ranked from 0, and they all
+// update the parameters in the POSIX shared memory (shm_open() + mmap())
+// without any lock, as the threads of one process do. There are two
+// regions of the given name: the control region, which has the barrier
+// and the values of AllReduce(), and the parameters (name + ".param").
+// The process of rank 0 creates both of them, where an old region of the
+// same name is removed first, and the others open them. The names are
+// removed as soon as all the processes have mapped them, so the memory
+// is freed when the last process exits.
+//
+// All the processes must call Barrier(), AllReduce() and Allocate() in
+// the same order, and they are used by one thread at a time. A process
+// that exits in the middle leaves the others waiting for it.
+//
+// A simple example:
+//
+//   SharedModel shared;
+//   if (!shared.Connect("xlearn", rank, 4, 60)) { ... }
+//   shared.AllReduce(value.data(), value.size(), kReduceMax);
+//   char* param = shared.Allocate(size);
+//   if (param == nullptr) { ... }
+//   shared.Barrier();
+//------------------------------------------------------------------------------
+class SharedModel {
+ public:
+  // Constructor and Destructor
+  SharedModel() { }
+  ~SharedModel() { Close(); }
+
+  // Create (rank 0) or open the control region of num_proc
+  // processes, where the others wait for rank 0 at most timeout
+  // seconds, and then wait for all the processes. Return false if
+  // the region cannot be created or opened.
+  bool Connect(const std::string& name,
+               size_t rank,
+               size_t num_proc,
+               int timeout);
+
+  // Create (rank 0) or open the shared parameters of size bytes,
+  // which are zero when they are created. Return nullptr if the
+  // memory cannot be allocated, which is the same for all the
+  // processes. The names of both regions are removed after it.
+  char* Allocate(uint64 size);
+
+  // Wait for all the processes.
+  void Barrier();
+
+  // Replace the size (at most kMaxValue) values of data with the
+  // sum (or the max) of the values of all the processes.
+  void AllReduce(double* data, size_t size, ReduceOp op);
+
+  // Unmap the regions of this process.
+  void Close();
+
+  // Rank of this process and the number of the processes.
+  inline size_t Rank() const { return rank_; }
+  inline size_t NumProc() const { return num_proc_; }
+
+  // The most processes and the most values of each AllReduce().
+  static const size_t kMaxProcess = 64;
+  static const size_t kMaxValue = 8;
+
+ private:
+  size_t rank_ = 0;
+  size_t num_proc_ = 1;
+  /* Names of the control region and the parameters */
+  std::string name_;
+  std::string param_name_;
+  /* The mapped regions */
+  SharedHead* head_ = nullptr;
+  char* param_ = nullptr;
+  uint64 param_size_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedModel);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_SHARED_MODEL_H_
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the SharedModel class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/distributed/shared_model.h"
+
+namespace xLearn {
+
+// The names of the tests do not collide with the other runs
+std::string get_name(const std::string& test) {
+  return "xlearn_" + test + "_" + std::to_string(getpid());
+}
+
+// Each process maps the regions by itself as the processes do.
+// Process i writes its own part of the parameters, and then every
+// process reads the parts of the others after a barrier.
+TEST(SharedModelTest, Allocate) {
+  const uint64 kSize = 1024 * 1024 + 3;
+  for (size_t num_proc : { 1, 2, 4 }) {
+    std::string name = get_name("allocate");
+    std::vector<int> mismatch(num_proc, -1);
+    std::vector<std::vector<double>> sum(num_proc);
+    std::vector<std::vector<double>> max(num_proc);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_proc; ++i) {
+      threads.push_back(std::thread([&, i]() {
+        SharedModel shared;
+        CHECK(shared.Connect(name, i, num_proc, 10));
+        CHECK_EQ(shared.Rank(), i);
+        CHECK_EQ(shared.NumProc(), num_proc);
+        char* param = shared.Allocate(kSize);
+        CHECK_NOTNULL(param);
+        uint64 part = kSize / num_proc;
+        for (uint64 j = i * part; j < (i + 1) * part; ++j) {
+          param[j] = (char)(i + 1);
+        }
+        shared.Barrier();
+        mismatch[i] = 0;
+        for (uint64 j = 0; j < num_proc * part; ++j) {
+          if (param[j] != (char)(j / part + 1)) { mismatch[i]++; }
+        }
+        // The tail is the zeros of a new region
+        for (uint64 j = num_proc * part; j < kSize; ++j) {
+          if (param[j] != 0) { mismatch[i]++; }
+        }
+        sum[i] = { (double)i, 1.5 };
+        shared.AllReduce(sum[i].data(), sum[i].size(), kReduceSum);
+        max[i] = { (double)i, -(double)i };
+        shared.AllReduce(max[i].data(), max[i].size(), kReduceMax);
+      }));
+    }
+    for (size_t i = 0; i < num_proc; ++i) {
+      threads[i].join();
+    }
+    for (size_t i = 0; i < num_proc; ++i) {
+      EXPECT_EQ(mismatch[i], 0);
+      EXPECT_DOUBLE_EQ(sum[i][0], num_proc * (num_proc - 1) / 2.0);
+      EXPECT_DOUBLE_EQ(sum[i][1], 1.5 * num_proc);
+      EXPECT_DOUBLE_EQ(max[i][0], num_proc - 1);
+      EXPECT_DOUBLE_EQ(max[i][1], 0);
+    }
+    // The names are removed after the allocation
+    SharedModel late;
+    EXPECT_FALSE(late.Connect(name, 1, num_proc + 1, 0));
+  }
+}
+
+// A process does not wait for the first process forever.
+TEST(SharedModelTest, Timeout) {
+  SharedModel shared;
+  EXPECT_FALSE(shared.Connect(get_name("timeout"), 1, 2, 0));
+}
+
+}  // namespace xLearn
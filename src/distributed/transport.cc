@@ -0,0 +1,253 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of Socket.
+*/
+
+#include "src/distributed/transport.h"
+
+#ifndef _MSC_VER
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#else
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace xLearn {
+
+#ifndef _MSC_VER
+typedef int socket_t;
+static const socket_t kInvalidSocket = -1;
+static inline void close_socket(socket_t fd) { close(fd); }
+#else
+typedef SOCKET socket_t;
+static const socket_t kInvalidSocket = INVALID_SOCKET;
+static inline void close_socket(socket_t fd) { closesocket(fd); }
+#endif
+
+// Winsock is started once before the first socket
+static void init_socket() {
+#ifdef _MSC_VER
+  static std::once_flag flag;
+  std::call_once(flag, []() {
+    WSADATA data;
+    CHECK_EQ(WSAStartup(MAKEWORD(2, 2), &data), 0);
+  });
+#endif
+}
+
+// A call interrupted by a signal has not failed, and is retried
+static inline bool interrupted() {
+#ifndef _MSC_VER
+  return errno == EINTR;
+#else
+  return WSAGetLastError() == WSAEINTR;
+#endif
+}
+
+static inline socket_t to_socket(int64 fd) {
+  return fd == -1 ? kInvalidSocket : (socket_t)fd;
+}
+
+// The replies are small, so they are sent at once
+static void set_no_delay(socket_t fd) {
+  int flag = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+             (const char*)&flag, sizeof(flag));
+}
+
+int Socket::Listen(int port) {
+  init_socket();
+  Close();
+  socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == kInvalidSocket) { return -1; }
+  int flag = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+             (const char*)&flag, sizeof(flag));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons((uint16)port);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 128) != 0) {
+    close_socket(fd);
+    return -1;
+  }
+  socklen_t len = sizeof(addr);
+  if (getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+    close_socket(fd);
+    return -1;
+  }
+  fd_ = (int64)fd;
+  return ntohs(addr.sin_port);
+}
+
+bool Socket::Accept(Socket* conn) {
+  CHECK_NOTNULL(conn);
+  CHECK(IsOpen());
+  socket_t fd = kInvalidSocket;
+  do {
+    fd = accept(to_socket(fd_), nullptr, nullptr);
+  } while (fd == kInvalidSocket && interrupted());
+  if (fd == kInvalidSocket) { return false; }
+  set_no_delay(fd);
+  conn->Close();
+  conn->fd_ = (int64)fd;
+  return true;
+}
+
+bool Socket::Connect(const std::string& host, int port, int timeout) {
+  init_socket();
+  Close();
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* res = nullptr;
+  std::string service = std::to_string(port);
+  if (getaddrinfo(host.c_str(), service.c_str(), &hints, &res) != 0) {
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  socket_t fd = kInvalidSocket;
+  for (;;) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == kInvalidSocket) { break; }
+    if (connect(fd, res->ai_addr, (socklen_t)res->ai_addrlen) == 0) {
+      break;
+    }
+    close_socket(fd);
+    fd = kInvalidSocket;
+    // The server may not be listening yet
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed >= std::chrono::seconds(timeout)) { break; }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  freeaddrinfo(res);
+  if (fd == kInvalidSocket) { return false; }
+  set_no_delay(fd);
+  fd_ = (int64)fd;
+  return true;
+}
+
+bool Socket::Send(const void* data, size_t size) {
+  CHECK(IsOpen());
+  const char* p = (const char*)data;
+  while (size > 0) {
+    // Each call sends at most 1 GB, which fits in an int
+    int len = (int)std::min(size, (size_t)1 << 30);
+#ifdef MSG_NOSIGNAL
+    int n = send(to_socket(fd_), p, len, MSG_NOSIGNAL);
+#else
+    int n = send(to_socket(fd_), p, len, 0);
+#endif
+    if (n < 0 && interrupted()) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool Socket::Recv(void* data, size_t size) {
+  CHECK(IsOpen());
+  char* p = (char*)data;
+  while (size > 0) {
+    int len = (int)std::min(size, (size_t)1 << 30);
+    int n = recv(to_socket(fd_), p, len, 0);
+    if (n < 0 && interrupted()) { continue; }
+    // 0 means the peer has closed the connection
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+int64 Socket::RecvSome(void* data, size_t size) {
+  CHECK(IsOpen());
+  int len = (int)std::min(size, (size_t)1 << 30);
+  int n = 0;
+  do {
+    n = recv(to_socket(fd_), (char*)data, len, 0);
+  } while (n < 0 && interrupted());
+  return n < 0 ? -1 : n;
+}
+
+bool Socket::Wait(int timeout_ms) {
+  CHECK(IsOpen());
+  socket_t fd = to_socket(fd_);
+  int n = 0;
+  do {
+    // select() may change the set and the timeout, so they are
+    // reset before each call
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    // The first argument is ignored by Winsock
+    n = select((int)fd + 1, &set, nullptr, nullptr, &tv);
+  } while (n < 0 && interrupted());
+  return n > 0;
+}
+
+void Socket::Close() {
+  if (IsOpen()) {
+    close_socket(to_socket(fd_));
+    fd_ = -1;
+  }
+}
+
+bool ParseAddress(const std::string& address,
+                  std::string* host,
+                  int* port) {
+  CHECK_NOTNULL(host);
+  CHECK_NOTNULL(port);
+  size_t pos = address.rfind(':');
+  if (pos == std::string::npos || pos == 0 ||
+      pos + 1 == address.size()) {
+    return false;
+  }
+  char* end = nullptr;
+  long value = strtol(address.c_str() + pos + 1, &end, 10);
+  if (*end != '\0' || value <= 0 || value > 65535) {
+    return false;
+  }
+  *host = address.substr(0, pos);
+  *port = (int)value;
+  return true;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the Socket class, which is the TCP connection
+between the workers and the parameter servers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_TRANSPORT_H_
+#define XLEARN_DISTRIBUTED_TRANSPORT_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Socket is a blocking TCP connection (or a listening socket) used by
+// the KVStore and the ParameterServer. The messages are binary data in
+// the byte order of the machine, so all the machines of a training must
+// have the same byte order. Nagle's algorithm is disabled, since each
+// request waits for its reply.
+//
+// A simple example:
+//
+//   Socket listener;
+//   int port = listener.Listen(0);  /* on a free port */
+//
+//   Socket client;
+//   client.Connect("127.0.0.1", port, 10);
+//   Socket conn;
+//   listener.Accept(&conn);
+//   client.Send(data, size);
+//   conn.Recv(data, size);
+//------------------------------------------------------------------------------
+class Socket {
+ public:
+  // Constructor and Destructor
+  Socket() { }
+  ~Socket() { Close(); }
+
+  // Listen on the port of all the addresses, where 0 picks a
+  // free port. Return the port, or -1 if it cannot listen.
+  int Listen(int port);
+
+  // Accept a connection of the listening socket.
+  bool Accept(Socket* conn);
+
+  // Connect to host:port, which is retried for timeout
+  // seconds while the server is not listening yet.
+  bool Connect(const std::string& host, int port, int timeout);
+
+  // Send size bytes of the data.
+  bool Send(const void* data, size_t size);
+
+  // Receive size bytes to the data, which returns false
+  // if the connection is closed before that.
+  bool Recv(void* data, size_t size);
+
+  // Receive at most size bytes to the data, which are the bytes
+  // that have arrived. Return the number of the bytes, which is
+  // 0 if the connection is closed, or -1 for an error.
+  int64 RecvSome(void* data, size_t size);
+
+  // Wait for at most timeout_ms milliseconds until there is data
+  // to receive (or a connection to accept for the listening
+  // socket). Return false if the time is out.
+  bool Wait(int timeout_ms);
+
+  // Close the socket.
+  void Close();
+
+  // If the socket is open.
+  inline bool IsOpen() const { return fd_ != -1; }
+
+ private:
+  /* The socket, which is SOCKET on Windows */
+  int64 fd_ = -1;
+
+  DISALLOW_COPY_AND_ASSIGN(Socket);
+};
+
+// Split the address "host:port" into the host and the port.
+bool ParseAddress(const std::string& address,
+                  std::string* host,
+                  int* port);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_TRANSPORT_H_
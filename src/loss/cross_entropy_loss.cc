@@ -20,9 +20,12 @@ This file is the implementation of CrossEntropyLoss class.
 
 #include "src/loss/cross_entropy_loss.h"
 
+#include <algorithm>
 #include <thread>
 #include<atomic>
 
+#include "src/base/math.h"
+
 namespace xLearn {
 
 // Calculate loss in one thread.
@@ -32,10 +35,18 @@ static void ce_evaluate_thread(const std::vector<real_t>* pred,
                               size_t start_idx,
                               size_t end_idx) {
   CHECK_GE(end_idx, start_idx);
+  // The loss log(1 + exp(-y*pred)) is softplus(-y*pred), which
+  // is computed in blocks by the vectorized SumSoftplus()
+  const size_t kBlock = 256;
+  real_t z[kBlock];
   *tmp_sum = 0;
-  for (size_t i = start_idx; i < end_idx; ++i) {
-    real_t y = (*label)[i] > 0 ? 1.0 : -1.0;
-    (*tmp_sum) += log1p(exp(-y*(*pred)[i]));
+  for (size_t b = start_idx; b < end_idx; b += kBlock) {
+    size_t len = std::min(kBlock, end_idx - b);
+    for (size_t i = 0; i < len; ++i) {
+      real_t y = (*label)[b+i] > 0 ? 1.0 : -1.0;
+      z[i] = -y*(*pred)[b+i];
+    }
+    (*tmp_sum) += SumSoftplus(z, len);
   }
 }
 
@@ -58,19 +69,12 @@ void CrossEntropyLoss::Evaluate(const std::vector<real_t>& pred,
   CHECK_NE(label.empty(), true);
   total_example_ += pred.size();
   // multi-thread training
-  std::vector<real_t> sum(threadNumber_, 0);
-  for (int i = 0; i < threadNumber_; ++i) {
-    size_t start_idx = getStart(pred.size(), threadNumber_, i);
-    size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-    pool_->enqueue(std::bind(ce_evaluate_thread,
-                             &pred,
-                             &label,
-                             &(sum[i]),
-                             start_idx,
-                             end_idx));
-  }
-  // Wait all of the threads finish their job
-  pool_->Sync(threadNumber_);
+  size_t grain = pool_->Grain(pred.size(), 0, kMinEvalRows);
+  std::vector<real_t> sum((pred.size() + grain - 1) / grain, 0);
+  pool_->ParallelFor(0, pred.size(), grain,
+    [&](size_t begin, size_t end) {
+      ce_evaluate_thread(&pred, &label, &sum[begin / grain], begin, end);
+    });
   // Accumulate loss
   for (size_t i = 0; i < sum.size(); ++i) {
     loss_sum_ += sum[i];
@@ -78,27 +82,89 @@ void CrossEntropyLoss::Evaluate(const std::vector<real_t>& pred,
 }
 
 
-// Calculate gradient in one thread.
+// Calculate loss of [begin, end) in current thread.
+real_t CrossEntropyLoss::EvaluateRange(const std::vector<real_t>& pred,
+                                       const std::vector<real_t>& label,
+                                       size_t begin,
+                                       size_t end) {
+  real_t sum = 0;
+  ce_evaluate_thread(&pred, &label, &sum, begin, end);
+  return sum;
+}
+
+// partial gradient
+static real_t ce_partial_grad(real_t pred, real_t y) {
+  return -y * polysigmoid(-y*pred);
+}
+
+// Calculate gradient in one thread by the labels of the task.
+// With the buffer and grad_batch 0, the gradients are left in the
+// buffer for the owners of the features (see calc_grad_owner).
 static void ce_gradient_thread(const DMatrix* matrix,
+                               index_t task,
                                Model* model,
                                Score* score_func,
                                bool is_norm,
                                real_t* sum,
+                               size_t prefetch,
+                               StripedLock* lock,
+                               GradBuffer* buf,
+                               index_t grad_batch,
+                               RowLoss* rows,
+                               std::vector<real_t>* train_pred,
                                size_t start_idx,
                                size_t end_idx) {
   CHECK_GE(end_idx, start_idx);
-  *sum = 0;
+  // The copy of the model on the NUMA node of current thread,
+  // which is trained by the threads of the node
+  model = model->GetReplica(CurrentNumaNode());
+  // The sums of the chunks are next to each other, so
+  // the loss is accumulated in a local variable
+  real_t loss = 0;
+  bool is_local = model->IsLocal();
+  if (is_local) { model->BeginLocal(); }
   for (size_t i = start_idx; i < end_idx; ++i) {
+    if (prefetch > 0 && i + prefetch < end_idx) {
+      score_func->Prefetch(matrix->row[i+prefetch], *model);
+    }
     SparseRow* row = matrix->row[i];
+    RowLock row_lock(lock, row);
+    if (model->IsLazy()) { model->Touch(row); }
+    if (model->IsLazyRegu()) { model->LazyRegu(row); }
+    if (model->IsTracked()) { model->MarkDirty(row); }
     real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    real_t pred = score_func->CalcScore(row, *model, norm);
-    // partial gradient
-    real_t y = matrix->Y[i] > 0 ? 1.0 : -1.0;
-    *sum += log1p(exp(-y*pred));
-    real_t pg = -y/(1.0+(1.0/exp(-y*pred)));
-    // real gradient and update
-    score_func->CalcGrad(row, *model, pg, norm);
+    real_t y = matrix->Label(i, task) > 0 ? 1.0 : -1.0;
+    // score, real gradient and update
+    // The importance weight of a sampled row scales its gradient
+    real_t weight = rows == nullptr ? 1.0 : rows->weight[i];
+    real_t pred;
+    if (buf != nullptr) {
+      pred = score_func->CalcScoreAndBatchGrad(row, *model, y,
+                                               ce_partial_grad, norm,
+                                               buf, weight);
+    } else if (weight != 1.0) {
+      pred = score_func->CalcScore(row, *model, norm);
+      score_func->CalcGrad(row, *model,
+                           weight * ce_partial_grad(pred, y), norm);
+    } else {
+      pred = score_func->CalcScoreAndGrad(row, *model, y,
+                                          ce_partial_grad, norm);
+    }
+    real_t row_loss = polysoftplus(-y*pred);
+    if (rows != nullptr) { rows->loss[rows->ids[i]] = row_loss; }
+    loss += weight * row_loss;
+    if (train_pred != nullptr) { (*train_pred)[i] = pred; }
+    if (buf != nullptr && grad_batch > 0 && buf->rows >= grad_batch) {
+      score_func->ApplyGrad(*model, buf);
+    }
+    if (is_local) { model->LocalStep(); }
   }
+  // The rest of the chunk is updated before the merge
+  if (buf != nullptr && grad_batch > 0) {
+    score_func->ApplyGrad(*model, buf);
+  }
+  if (is_local) { model->EndLocal(); }
+  *sum = loss;
 }
 
 //------------------------------------------------------------------------------
@@ -120,27 +186,72 @@ void CrossEntropyLoss::CalcGrad(const DMatrix* matrix,
   CHECK_GT(matrix->row_length, 0);
   size_t row_len = matrix->row_length;
   total_example_ += row_len;
-  // multi-thread training
-  int count = lock_free_ ? threadNumber_ : 1;
-  std::vector<real_t> sum(count, 0);
-  for (int i = 0; i < count; ++i) {
-    index_t start_idx = getStart(row_len, count, i);
-    index_t end_idx = getEnd(row_len, count, i);
-    pool_->enqueue(std::bind(ce_gradient_thread,
-                             matrix,
-                             &model,
-                             score_func_,
-                             norm_,
-                             &(sum[i]),
-                             start_idx,
-                             end_idx));
+  model.ChooseHotFeatures(matrix);
+  // The predictions are kept for the training metric
+  std::vector<real_t>* train_pred = nullptr;
+  if (train_metric_ != nullptr) {
+    train_pred_.resize(row_len);
+    train_pred = &train_pred_;
+  }
+  // The weighted loss of a sampled batch is
+  // scaled to the mean of its weights
+  real_t scale = 1.0;
+  if (row_loss_ != nullptr && row_loss_->batch_weight > 0) {
+    scale = row_len / row_loss_->batch_weight;
+  }
+  // The gradients are applied by the owners of the features
+  if (owner_rows_ > 0) {
+    loss_sum_ += scale * calc_grad_owner(matrix, model,
+      [&](GradBuffer* buf, size_t begin, size_t end) {
+        real_t sum = 0;
+        ce_gradient_thread(matrix, 0, &model, score_func_, norm_, &sum,
+                           prefetch_distance_, nullptr, buf, 0,
+                           row_loss_, train_pred, begin, end);
+        if (train_pred != nullptr) {
+          Metric* local = train_metric_->AcquireLocal();
+          local->AccumulateRows(matrix, *train_pred, begin, end);
+          train_metric_->ReleaseLocal(local);
+        }
+        return sum;
+      });
+    return;
   }
-  // Wait all of the threads finish their job
-  pool_->Sync(count);
+  // multi-thread training, where the rows lock their
+  // features if lock_free_ is false (see RowLock)
+  std::vector<size_t> bounds;
+  SplitRows(matrix, model, &bounds);
+  std::vector<real_t> sum(bounds.size() - 1, 0);
+  pool_->ParallelFor(bounds,
+    [&](size_t begin, size_t end) {
+      ce_gradient_thread(matrix, 0, &model, score_func_, norm_,
+                         &sum[chunk_index(bounds, begin)],
+                         prefetch_distance_,
+                         row_lock_.get(), grad_buffer(), grad_batch_,
+                         row_loss_, train_pred, begin, end);
+      if (train_pred != nullptr) {
+        Metric* local = train_metric_->AcquireLocal();
+        local->AccumulateRows(matrix, *train_pred, begin, end);
+        train_metric_->ReleaseLocal(local);
+      }
+    });
   // Accumulate loss
   for (int i = 0; i < sum.size(); ++i) {
-    loss_sum_ += sum[i];
+    loss_sum_ += sum[i] * scale;
   }
 }
 
+// Train the rows of the task in current thread.
+real_t CrossEntropyLoss::calc_grad_range(const DMatrix* matrix,
+                                         index_t task,
+                                         Model& model,
+                                         std::vector<real_t>* train_pred,
+                                         size_t begin,
+                                         size_t end) {
+  real_t sum = 0;
+  ce_gradient_thread(matrix, task, &model, score_func_, norm_, &sum,
+                     prefetch_distance_, row_lock_.get(), grad_buffer(),
+                     grad_batch_, nullptr, train_pred, begin, end);
+  return sum;
+}
+
 } // namespace xLearn
@@ -20,10 +20,15 @@ This file tests the CrossEntropyLoss class.
 
 #include "gtest/gtest.h"
 
+#include <cmath>
+#include <string>
 #include <vector>
 
+#include "src/distributed/parameter_server.h"
 #include "src/loss/cross_entropy_loss.h"
+#include "src/loss/squared_loss.h"
 #include "src/score/fm_score.h"
+#include "src/score/linear_score.h"
 
 namespace xLearn {
 
@@ -61,4 +66,426 @@ TEST(CROSS_ENTROPY_LOSS, Evaluate) {
   EXPECT_LT(val, 0.000001);
 }
 
+// PredictAndEvaluate() is the same as Predict() + Evaluate().
+TEST(CROSS_ENTROPY_LOSS, Predict_and_evaluate) {
+  const index_t kRows = 500;
+  Model model;
+  model.Initialize("fm", "cross-entropy", 20, 1, 4, 1);
+  DMatrix matrix;
+  matrix.ReAlloc(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    matrix.Y[i] = i % 2 == 0 ? 1.0 : -1.0;
+    matrix.row[i] = new SparseRow;
+    for (index_t j = 0; j < i % 20 + 1; ++j) {
+      matrix.AddNode(i, j, 0.5);
+    }
+  }
+  size_t threadNumber = std::thread::hardware_concurrency();
+  ThreadPool pool(threadNumber);
+  FMScore score;
+  CrossEntropyLoss loss;
+  loss.Initialize(&score, &pool, false);
+  std::vector<real_t> expect(kRows);
+  loss.Predict(&matrix, model, expect);
+  loss.Evaluate(expect, matrix.Y);
+  real_t expect_loss = loss.GetLoss();
+  AccMetric expect_metric;
+  expect_metric.Initialize(&pool);
+  expect_metric.Accumulate(matrix.Y, expect);
+  loss.Reset();
+  AccMetric metric;
+  metric.Initialize(&pool);
+  std::vector<real_t> pred(kRows);
+  loss.SetPartition(kPartNnz);
+  loss.PredictAndEvaluate(&matrix, model, pred, &metric);
+  metric.MergeLocals();
+  for (index_t i = 0; i < kRows; ++i) {
+    EXPECT_FLOAT_EQ(pred[i], expect[i]);
+  }
+  EXPECT_NEAR(loss.GetLoss(), expect_loss, 1e-5);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), expect_metric.GetMetric());
+  loss.Reset();
+  loss.PredictAndEvaluate(&matrix, model, pred, nullptr);
+  EXPECT_NEAR(loss.GetLoss(), expect_loss, 1e-5);
+}
+
+// The training metric of CalcGrad() uses the scores before the
+// update, which are the same as Predict() if nothing is learned.
+TEST(CROSS_ENTROPY_LOSS, Train_metric) {
+  const index_t kRows = 300;
+  Model model;
+  model.Initialize("fm", "cross-entropy", 20, 1, 4, 1);
+  DMatrix matrix;
+  matrix.ReAlloc(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    matrix.Y[i] = i % 3 == 0 ? 1.0 : -1.0;
+    matrix.row[i] = new SparseRow;
+    for (index_t j = 0; j < i % 20 + 1; ++j) {
+      matrix.AddNode(i, j, 0.5);
+    }
+  }
+  ThreadPool pool(4);
+  FMScore score;
+  std::string opt = "sgd";
+  score.Initialize(0, 0, 0, 0, 0, 0, opt);
+  CrossEntropyLoss loss;
+  loss.Initialize(&score, &pool, false);
+  std::vector<real_t> pred(kRows);
+  loss.Predict(&matrix, model, pred);
+  AUCMetric expect;
+  expect.Initialize(&pool);
+  expect.Accumulate(matrix.Y, pred);
+  AUCMetric metric;
+  metric.Initialize(&pool);
+  loss.SetTrainMetric(&metric);
+  loss.CalcGrad(&matrix, model);
+  loss.CalcGrad(&matrix, model);
+  metric.MergeLocals();
+  EXPECT_FLOAT_EQ(metric.GetMetric(), expect.GetMetric());
+}
+
+const index_t kDistRows = 300;
+const index_t kDistFeat = 20;
+
+void init_dist_matrix(DMatrix* matrix) {
+  matrix->ReAlloc(kDistRows);
+  for (index_t i = 0; i < kDistRows; ++i) {
+    matrix->Y[i] = i % 3 == 0 ? 1.0 : -1.0;
+    matrix->row[i] = new SparseRow;
+    for (index_t j = 0; j < i % kDistFeat + 1; ++j) {
+      matrix->AddNode(i, (i + j) % kDistFeat, 0.5);
+    }
+  }
+}
+
+// Train one epoch by CalcGradDist() on a server of one worker, and
+// return the model of the server, where the bias is the last key.
+// The cache is the staleness of the parameter cache, and the ratio
+// of the keys read from the cache is returned by hit_ratio.
+real_t train_dist(index_t batch_size, bool pipeline,
+                  std::vector<real_t>* value,
+                  index_t cache = 0,
+                  double* hit_ratio = nullptr) {
+  Model model;
+  model.Initialize("fm", "cross-entropy", kDistFeat, 1, 4, 1);
+  index_t length = model.GetFeatureSize();
+  std::vector<index_t> key(kDistFeat + 1);
+  for (index_t i = 0; i <= kDistFeat; ++i) { key[i] = i; }
+  std::vector<real_t> init(key.size() * length);
+  model.GetFeatures(key, init.data());
+  ParameterServer server;
+  int port = server.Start(0, 0, 1, 1);
+  CHECK_GT(port, 0);
+  server.SetValue(length, &init);
+  KVStore store;
+  CHECK(store.Connect({ "127.0.0.1:" + std::to_string(port) }, 10));
+  DMatrix matrix;
+  init_dist_matrix(&matrix);
+  ThreadPool pool(2);
+  FMScore score;
+  std::string opt = "sgd";
+  score.Initialize(0.1, 0, 0, 0, 0, 0, opt);
+  CrossEntropyLoss loss;
+  loss.Initialize(&score, &pool, false, false, batch_size);
+  loss.SetPipeline(pipeline);
+  loss.SetParamCache(cache);
+  loss.CalcGradDist(&matrix, model, &store);
+  if (hit_ratio != nullptr) {
+    *hit_ratio = (double)loss.GetCacheHits() / loss.GetCacheKeys();
+  }
+  store.Pull(key, value, length);
+  store.Stop();
+  server.Wait();
+  return loss.GetLoss();
+}
+
+// One mini-batch of the whole matrix is the same as CalcGrad().
+TEST(CROSS_ENTROPY_LOSS, Calc_grad_dist) {
+  Model model;
+  model.Initialize("fm", "cross-entropy", kDistFeat, 1, 4, 1);
+  DMatrix matrix;
+  init_dist_matrix(&matrix);
+  ThreadPool pool(2);
+  FMScore score;
+  std::string opt = "sgd";
+  score.Initialize(0.1, 0, 0, 0, 0, 0, opt);
+  CrossEntropyLoss loss;
+  loss.Initialize(&score, &pool, false);
+  loss.CalcGrad(&matrix, model);
+  std::vector<index_t> key(kDistFeat + 1);
+  for (index_t i = 0; i <= kDistFeat; ++i) { key[i] = i; }
+  std::vector<real_t> expect(key.size() * model.GetFeatureSize());
+  model.GetFeatures(key, expect.data());
+  for (bool pipeline : { false, true }) {
+    std::vector<real_t> value;
+    real_t val = train_dist(kDistRows, pipeline, &value);
+    EXPECT_FLOAT_EQ(val, loss.GetLoss());
+    ASSERT_EQ(value.size(), expect.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+      EXPECT_NEAR(value[i], expect[i], 1e-6);
+    }
+  }
+}
+
+// The pipeline computes mini-batch t on the parameters pulled
+// before the push of t-1, which is the same as this simulation.
+TEST(CROSS_ENTROPY_LOSS, Calc_grad_dist_pipeline) {
+  const index_t kBatch = 30;
+  Model model;
+  model.Initialize("fm", "cross-entropy", kDistFeat, 1, 4, 1);
+  DMatrix matrix;
+  init_dist_matrix(&matrix);
+  ThreadPool pool(2);
+  FMScore score;
+  std::string opt = "sgd";
+  score.Initialize(0.1, 0, 0, 0, 0, 0, opt);
+  CrossEntropyLoss loss;
+  loss.Initialize(&score, &pool, false);
+  std::vector<index_t> key(kDistFeat + 1);
+  for (index_t i = 0; i <= kDistFeat; ++i) { key[i] = i; }
+  std::vector<real_t> server(key.size() * model.GetFeatureSize());
+  model.GetFeatures(key, server.data());
+  std::vector<real_t> pulled;
+  std::vector<real_t> delta(server.size());
+  std::vector<real_t> pending;  /* the push of t-1 */
+  matrix.pos = 0;
+  for (;;) {
+    DMatrix mini_batch;
+    if (matrix.GetMiniBatch(kBatch, mini_batch) == 0) { break; }
+    pulled = server;
+    for (size_t i = 0; i < pending.size(); ++i) {
+      server[i] += pending[i];
+    }
+    model.SetFeatures(key, pulled.data());
+    loss.CalcGrad(&mini_batch, model);
+    model.GetFeatures(key, delta.data());
+    for (size_t i = 0; i < delta.size(); ++i) {
+      delta[i] -= pulled[i];
+    }
+    pending = delta;
+  }
+  for (size_t i = 0; i < pending.size(); ++i) {
+    server[i] += pending[i];
+  }
+  std::vector<real_t> value;
+  real_t val = train_dist(kBatch, true, &value);
+  EXPECT_FLOAT_EQ(val, loss.GetLoss());
+  ASSERT_EQ(value.size(), server.size());
+  for (size_t i = 0; i < value.size(); ++i) {
+    EXPECT_NEAR(value[i], server[i], 1e-6);
+  }
+  // Without the pipeline, each mini-batch has the push of the last one
+  std::vector<real_t> sync_value;
+  train_dist(kBatch, false, &sync_value);
+  bool changed = false;
+  for (size_t i = 0; i < value.size(); ++i) {
+    changed |= value[i] != sync_value[i];
+  }
+  EXPECT_TRUE(changed);
+}
+
+// With one worker, the local model of the cache is the same as the
+// server, so it is the same as the training without the pipeline.
+TEST(CROSS_ENTROPY_LOSS, Calc_grad_dist_cache) {
+  const index_t kBatch = 30;
+  std::vector<real_t> expect;
+  real_t expect_loss = train_dist(kBatch, false, &expect);
+  for (bool pipeline : { false, true }) {
+    for (index_t cache : { 1, 3, 100 }) {
+      // The pipeline pulls t+1 before the change of t, which
+      // only the cache of all the mini-batches does not see
+      if (pipeline && cache != 100) { continue; }
+      std::vector<real_t> value;
+      double hit_ratio = 0;
+      real_t val = train_dist(kBatch, pipeline, &value,
+                              cache, &hit_ratio);
+      EXPECT_FLOAT_EQ(val, expect_loss);
+      ASSERT_EQ(value.size(), expect.size());
+      for (size_t i = 0; i < value.size(); ++i) {
+        EXPECT_NEAR(value[i], expect[i], 1e-5);
+      }
+      // The bias and most features are in all the mini-batches
+      EXPECT_GT(hit_ratio, 0.4);
+      EXPECT_LT(hit_ratio, 1.0);
+    }
+  }
+  // The stale keys of the pipeline miss the change
+  // of the last mini-batch, like Calc_grad_dist_pipeline
+  std::vector<real_t> value;
+  double hit_ratio = 0;
+  train_dist(kBatch, true, &value, 1, &hit_ratio);
+  bool changed = false;
+  for (size_t i = 0; i < value.size(); ++i) {
+    changed |= std::abs(value[i] - expect[i]) > 1e-5;
+  }
+  EXPECT_TRUE(changed);
+}
+
+// The models of the tasks trained by CalcGradTasks() in one thread are
+// the same as the ones of CalcGrad() on the labels of each task.
+TEST(CROSS_ENTROPY_LOSS, Calc_grad_tasks) {
+  DMatrix matrix;
+  init_dist_matrix(&matrix);
+  matrix.SetNumTask(2);
+  for (index_t i = 0; i < kDistRows; ++i) {
+    matrix.Label(i, 1) = i % 5 * 0.25;
+  }
+  ThreadPool pool(1);
+  std::string opt = "sgd";
+  FMScore score[2];
+  for (int t = 0; t < 2; ++t) {
+    score[t].Initialize(0.1, 0, 0, 0, 0, 0, opt);
+  }
+  Model model[2];
+  model[0].Initialize("fm", "cross-entropy", kDistFeat, 1, 4, 1);
+  model[1].Initialize("fm", "squared", kDistFeat, 1, 4, 1);
+  CrossEntropyLoss loss;
+  loss.Initialize(&score[0], &pool, false);
+  SquaredLoss task_loss;
+  task_loss.Initialize(&score[1], &pool, false);
+  std::vector<Loss::Task> tasks = { { &model[1], &task_loss } };
+  loss.CalcGradTasks(&matrix, model[0], tasks);
+  // Train each task alone
+  Model expect[2];
+  expect[0].Initialize("fm", "cross-entropy", kDistFeat, 1, 4, 1);
+  expect[1].Initialize("fm", "squared", kDistFeat, 1, 4, 1);
+  CrossEntropyLoss expect_loss;
+  expect_loss.Initialize(&score[0], &pool, false);
+  expect_loss.CalcGrad(&matrix, expect[0]);
+  DMatrix task_matrix;
+  task_matrix.CopyFrom(&matrix);
+  for (index_t i = 0; i < kDistRows; ++i) {
+    task_matrix.Y[i] = matrix.Label(i, 1);
+  }
+  SquaredLoss expect_task;
+  expect_task.Initialize(&score[1], &pool, false);
+  expect_task.CalcGrad(&task_matrix, expect[1]);
+  EXPECT_FLOAT_EQ(loss.GetLoss(), expect_loss.GetLoss());
+  EXPECT_FLOAT_EQ(task_loss.GetLoss(), expect_task.GetLoss());
+  std::vector<index_t> key(kDistFeat + 1);
+  for (index_t i = 0; i <= kDistFeat; ++i) { key[i] = i; }
+  for (int t = 0; t < 2; ++t) {
+    std::vector<real_t> value(key.size() * model[t].GetFeatureSize());
+    std::vector<real_t> expect_value(value.size());
+    model[t].GetFeatures(key, value.data());
+    expect[t].GetFeatures(key, expect_value.data());
+    for (size_t i = 0; i < value.size(); ++i) {
+      EXPECT_FLOAT_EQ(value[i], expect_value[i]);
+    }
+  }
+}
+
+// Train the model of score_func (fm or linear) and opt by two epochs
+// with num_thread threads, where the gradients are applied by the
+// owners of the features if owner_rows > 0, and return the features
+// and the bias of the model. The rows are weighted as a sampled pass
+// if weighted is true, and num_step is the adam steps taken if it is
+// not nullptr.
+std::vector<real_t> train_owner(size_t num_thread,
+                                index_t owner_rows,
+                                index_t grad_batch,
+                                real_t* loss_value,
+                                const std::string& opt = "adagrad",
+                                const std::string& score_func = "fm",
+                                bool weighted = false,
+                                uint64* num_step = nullptr) {
+  DMatrix matrix;
+  init_dist_matrix(&matrix);
+  ThreadPool pool(num_thread);
+  FMScore fm_score;
+  LinearScore linear_score;
+  Score* score = &fm_score;
+  if (score_func == "linear") { score = &linear_score; }
+  std::string opt_type = opt;
+  score->Initialize(0.1, 0.001, 0, 0, 0, 0, opt_type);
+  index_t aux_size = opt == "sgd" ? 1 : opt == "adagrad" ? 2 : 3;
+  Model model;
+  model.Initialize(score_func, "cross-entropy",
+                   kDistFeat, 1, 4, aux_size);
+  CrossEntropyLoss loss;
+  loss.Initialize(score, &pool, false, true);
+  loss.SetGradBatch(grad_batch);
+  loss.SetOwnerUpdate(owner_rows);
+  RowLoss rows;
+  if (weighted) {
+    rows.loss.resize(kDistRows);
+    for (index_t i = 0; i < kDistRows; ++i) {
+      rows.ids.push_back(i);
+      rows.weight.push_back(1.0 + (i % 4) * 0.5);
+      rows.batch_weight += rows.weight.back();
+    }
+    loss.SetRowLoss(&rows);
+  }
+  for (int n = 0; n < 2; ++n) {
+    loss.Reset();
+    loss.CalcGrad(&matrix, model);
+  }
+  *loss_value = loss.GetLoss();
+  if (num_step != nullptr) { *num_step = score->NextStep() - 1; }
+  std::vector<index_t> key(kDistFeat + 1);
+  for (index_t i = 0; i <= kDistFeat; ++i) { key[i] = i; }
+  std::vector<real_t> value(key.size() * model.GetFeatureSize());
+  model.GetFeatures(key, value.data());
+  return value;
+}
+
+TEST(CROSS_ENTROPY_LOSS, Owner_update) {
+  // One owner applies each round like the buffer of -grad_batch
+  real_t owner_loss = 0, batch_loss = 0;
+  std::vector<real_t> owner = train_owner(1, 32, 0, &owner_loss);
+  std::vector<real_t> batch = train_owner(1, 0, 32, &batch_loss);
+  EXPECT_FLOAT_EQ(owner_loss, batch_loss);
+  ASSERT_EQ(owner.size(), batch.size());
+  for (size_t i = 0; i < owner.size(); ++i) {
+    EXPECT_FLOAT_EQ(owner[i], batch[i]);
+  }
+  // The model of the owners does not depend on the threads
+  real_t loss_1 = 0, loss_2 = 0;
+  std::vector<real_t> model_1 = train_owner(4, 16, 0, &loss_1);
+  std::vector<real_t> model_2 = train_owner(4, 16, 0, &loss_2);
+  EXPECT_EQ(loss_1, loss_2);
+  EXPECT_EQ(model_1, model_2);
+  EXPECT_TRUE(std::isfinite(loss_1));
+  EXPECT_LT(loss_1, std::log(2.0));
+}
+
+// Rounds of one row on one thread are the updates of the default
+// training, for the plain and the weighted rows. The linear model is
+// the same to the last bit. The default updates of fm are fused in the
+// SIMD kernels, which round differently from the sums of the buffer.
+// Their adagrad takes the approximate rsqrt, so fm adagrad is left to
+// Owner_update, which checks it against -grad_batch.
+TEST(CROSS_ENTROPY_LOSS, Owner_update_default) {
+  for (std::string score_func : { "linear", "fm" }) {
+    for (std::string opt : { "sgd", "adagrad", "adam" }) {
+      if (score_func == "fm" && opt == "adagrad") { continue; }
+      for (bool weighted : { false, true }) {
+        real_t owner_loss = 0, default_loss = 0;
+        std::vector<real_t> owner = train_owner(1, 1, 0, &owner_loss,
+                                                opt, score_func,
+                                                weighted);
+        std::vector<real_t> base = train_owner(1, 0, 0, &default_loss,
+                                               opt, score_func,
+                                               weighted);
+        real_t tolerance = score_func == "linear" ? 0 : 1e-5;
+        EXPECT_NEAR(owner_loss, default_loss, tolerance);
+        ASSERT_EQ(owner.size(), base.size());
+        for (size_t i = 0; i < owner.size(); ++i) {
+          EXPECT_NEAR(owner[i], base[i], tolerance);
+        }
+      }
+    }
+  }
+}
+
+// The owners of a round take one adam step
+TEST(CROSS_ENTROPY_LOSS, Owner_update_adam_step) {
+  real_t loss_value = 0;
+  uint64 num_step = 0;
+  train_owner(4, 10, 0, &loss_value, "adam", "fm", false, &num_step);
+  // 300 rows in rounds of 4 * 10 rows, for two epochs
+  EXPECT_EQ(num_step, 8 * 2);
+  EXPECT_TRUE(std::isfinite(loss_value));
+}
+
 }  // namespace xLearn
@@ -31,19 +31,157 @@ CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_loss_registry, Loss);
 REGISTER_LOSS("squared", SquaredLoss);
 REGISTER_LOSS("cross-entropy", CrossEntropyLoss);
 
-// Predict in one thread
+const size_t Loss::kDynamicRows;
+const uint64 Loss::kMinChunkCost;
+const size_t Loss::kMinEvalRows;
+
+// Split the rows of the matrix by current partition
+void Loss::SplitRows(const DMatrix* matrix,
+                     Model& model,
+                     std::vector<size_t>* bounds) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(bounds);
+  size_t row_len = matrix->row_length;
+  bounds->clear();
+  bounds->push_back(0);
+  // The cost of a row: its nodes (or node pairs for ffm), which
+  // are multiplied by K for fm and ffm, and one for the row itself
+  const std::string& score = model.GetScoreFunction();
+  bool is_ffm = score == "ffm";
+  uint64 num_k = score == "linear" ? 1 :
+                 std::max<uint64>(model.GetNumK(), 1);
+  auto row_cost = [matrix, is_ffm, num_k](size_t i) -> uint64 {
+    uint64 nnz = matrix->row[i]->size();
+    uint64 cost = nnz + 1;
+    if (is_ffm) {
+      if (nnz > 1) { cost += nnz * (nnz - 1) / 2 * num_k; }
+    } else if (num_k > 1) {
+      cost += nnz * num_k;
+    }
+    return cost;
+  };
+  uint64 total = 0;
+  for (size_t i = 0; i < row_len; ++i) {
+    total += row_cost(i);
+  }
+  // Each chunk has min_chunk_cost_ at least, so a small batch
+  // gives a few chunks, or only one which runs in current thread
+  uint64 max_chunks = min_chunk_cost_ == 0 ? row_len :
+                      total / min_chunk_cost_;
+  max_chunks = std::max<uint64>(std::min<uint64>(max_chunks, row_len), 1);
+  if (partition_ == kPartNnz) {
+    size_t num_chunks = std::max<size_t>(threadNumber_, 1) *
+                        ThreadPool::kChunksPerThread;
+    num_chunks = std::min<uint64>(num_chunks, max_chunks);
+    // The k-th chunk ends once the cost reaches total*k/num_chunks
+    uint64 acc = 0;
+    size_t k = 1;
+    for (size_t i = 0; i < row_len && k < num_chunks; ++i) {
+      acc += row_cost(i);
+      if (acc * num_chunks >= total * k) {
+        if (i + 1 < row_len) { bounds->push_back(i + 1); }
+        while (k < num_chunks && acc * num_chunks >= total * k) { ++k; }
+      }
+    }
+  } else {
+    size_t min_rows = (row_len + max_chunks - 1) / max_chunks;
+    size_t grain = partition_ == kPartDynamic ?
+                   std::max(kDynamicRows, min_rows) :
+                   pool_->Grain(row_len, 0, min_rows);
+    for (size_t b = grain; b < row_len; b += grain) {
+      bounds->push_back(b);
+    }
+  }
+  if (row_len > 0) { bounds->push_back(row_len); }
+}
+
+// Return the prediction of the row by the given model, which is
+// the copy on the NUMA node of current thread
+static inline real_t predict_row(const SparseRow* row,
+                                 Model* model,
+                                 Score* score_func,
+                                 real_t norm) {
+  if (model->IsLazy()) { model->Touch(row); }
+  // The offset corrects the negative sampling of the training data
+  return score_func->CalcScore(row, *model, norm) +
+         model->GetScoreOffset();
+}
+
+// Rows of one Score::CalcScoreBatch() call of pred_thread, which
+// are a few, so the prefetch of the rows ahead of the batch is still
+// in the cache when they are scored
+static const size_t kScoreBatch = 8;
+
+// Predict in one thread, where the rows are scored by the
+// batches of kScoreBatch rows
 void pred_thread(const DMatrix* matrix,
                  Model* model,
-                 std::vector<real_t>* pred,
+                 real_t* pred,
                  Score* score_func_,
                  bool is_norm,
+                 size_t prefetch,
                  size_t start_idx,
                  size_t end_idx) {
   CHECK_GE(end_idx, start_idx);
-  for (size_t i = start_idx; i < end_idx; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    (*pred)[i] = score_func_->CalcScore(row, *model, norm);
+  // The copy of the model on the NUMA node of current thread
+  model = model->GetReplica(CurrentNumaNode());
+  real_t offset = model->GetScoreOffset();
+  for (size_t i = start_idx; i < end_idx; i += kScoreBatch) {
+    size_t n = std::min(kScoreBatch, end_idx - i);
+    for (size_t k = i; k < i + n; ++k) {
+      if (prefetch > 0 && k + prefetch < end_idx) {
+        score_func_->Prefetch(matrix->row[k+prefetch], *model);
+      }
+      if (model->IsLazy()) { model->Touch(matrix->row[k]); }
+    }
+    score_func_->CalcScoreBatch(&matrix->row[i], n, *model,
+                                is_norm ? &matrix->norm[i] : nullptr,
+                                pred + i);
+    // The offset corrects the negative sampling of the training data
+    for (size_t k = i; k < i + n; ++k) { pred[k] += offset; }
+  }
+}
+
+// Predict one row in current thread
+real_t Loss::PredictRow(const SparseRow* row,
+                        Model& model,
+                        real_t norm) {
+  return predict_row(row, model.GetReplica(CurrentNumaNode()),
+                     score_func_, norm_ ? norm : 1.0);
+}
+
+// Sum of the squared values of the row
+static inline real_t square_sum(const SparseRow* row) {
+  real_t sum = 0;
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    sum += iter->feat_val * iter->feat_val;
+  }
+  return sum;
+}
+
+// Rank the candidates of one request in current thread
+void Loss::PredictCandidates(const SparseRow* context,
+                             const DMatrix* candidates,
+                             Model& model,
+                             real_t* pred) {
+  CHECK_NOTNULL(context);
+  CHECK_NOTNULL(candidates);
+  CHECK_NOTNULL(pred);
+  Model* replica = model.GetReplica(CurrentNumaNode());
+  if (replica->IsLazy()) { replica->Touch(context); }
+  // The context of each thread keeps its memory for the next call
+  static thread_local ScoreContext ctx;
+  score_func_->CalcContext(context, *replica, &ctx);
+  real_t context_sq = norm_ ? square_sum(context) : 0;
+  real_t offset = replica->GetScoreOffset();
+  for (index_t i = 0; i < candidates->row_length; ++i) {
+    const SparseRow* row = candidates->row[i];
+    if (replica->IsLazy()) { replica->Touch(row); }
+    // The norm of the whole row of the context plus the candidate
+    real_t norm = norm_ ? 1.0f / (context_sq + square_sum(row)) : 1.0;
+    pred[i] = score_func_->CalcCandidate(ctx, row, *replica, norm) +
+              offset;
   }
 }
 
@@ -54,55 +192,523 @@ void Loss::Predict(const DMatrix* matrix,
   CHECK_NOTNULL(matrix);
   CHECK_NE(pred.empty(), true);
   CHECK_EQ(pred.size(), matrix->row_length);
-  index_t row_len = matrix->row_length;
-  // Predict in multi-thread
-  for (int i = 0; i < threadNumber_; ++i) {
-    size_t start_idx = getStart(row_len, threadNumber_, i);
-    size_t end_idx = getEnd(row_len, threadNumber_, i);
-    pool_->enqueue(std::bind(pred_thread,
-                             matrix,
-                             &model,
-                             &pred,
-                             score_func_,
-                             norm_,
-                             start_idx,
-                             end_idx));
-  }
-  // Wait all of the threads finish their job
-  pool_->Sync(threadNumber_);
-}
-
-// Given data sample and current model, calculate gradient.
-// Note that this method doesn't update local model, and the
-// gradient will be pushed to the parameter server, which is 
-// used for distributed computation.
+  Predict(matrix, model, pred.data());
+}
+
+// Predict in multi-thread into the buffer of row_length
+void Loss::Predict(const DMatrix* matrix,
+                   Model& model,
+                   real_t* pred) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(pred);
+  std::vector<size_t> bounds;
+  SplitRows(matrix, model, &bounds);
+  pool_->ParallelFor(bounds, [&](size_t begin, size_t end) {
+    pred_thread(matrix, &model, pred, score_func_,
+                norm_, prefetch_distance_, begin, end);
+  });
+}
+
+// Predict, and then evaluate the loss and the metric in one pass
+void Loss::PredictAndEvaluate(const DMatrix* matrix,
+                              Model& model,
+                              std::vector<real_t>& pred,
+                              Metric* metric) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NE(pred.empty(), true);
+  CHECK_EQ(pred.size(), matrix->row_length);
+  std::vector<size_t> bounds;
+  SplitRows(matrix, model, &bounds);
+  std::vector<real_t> sum(bounds.size() - 1, 0);
+  pool_->ParallelFor(bounds, [&](size_t begin, size_t end) {
+    pred_thread(matrix, &model, pred.data(), score_func_,
+                norm_, prefetch_distance_, begin, end);
+    sum[chunk_index(bounds, begin)] =
+        EvaluateRange(pred, matrix->Y, begin, end);
+    if (metric != nullptr) {
+      Metric* local = metric->AcquireLocal();
+      local->AccumulateRows(matrix, pred, begin, end);
+      metric->ReleaseLocal(local);
+    }
+  });
+  total_example_ += pred.size();
+  for (size_t i = 0; i < sum.size(); ++i) {
+    loss_sum_ += sum[i];
+  }
+}
+
+// The blocks of the rows of each chunk are trained by all the tasks
+void Loss::CalcGradTasks(const DMatrix* matrix,
+                         Model& model,
+                         const std::vector<Task>& tasks) {
+  CHECK_NOTNULL(matrix);
+  CHECK_GT(matrix->row_length, 0);
+  CHECK_EQ(matrix->num_task, tasks.size() + 1);
+  size_t row_len = matrix->row_length;
+  model.ChooseHotFeatures(matrix);
+  for (size_t t = 0; t < tasks.size(); ++t) {
+    tasks[t].model->ChooseHotFeatures(matrix);
+  }
+  std::vector<size_t> bounds;
+  SplitRows(matrix, model, &bounds);
+  size_t num_chunks = bounds.size() - 1;
+  // The sums of task t are [t * num_chunks, (t+1) * num_chunks)
+  std::vector<real_t> sum((tasks.size() + 1) * num_chunks, 0);
+  std::vector<real_t>* train_pred = nullptr;
+  if (train_metric_ != nullptr) {
+    train_pred_.resize(row_len);
+    train_pred = &train_pred_;
+  }
+  pool_->ParallelFor(bounds, [&](size_t begin, size_t end) {
+    size_t c = chunk_index(bounds, begin);
+    for (size_t b = begin; b < end; b += kTaskRows) {
+      size_t e = std::min(b + kTaskRows, end);
+      sum[c] += calc_grad_range(matrix, 0, model, train_pred, b, e);
+      for (size_t t = 0; t < tasks.size(); ++t) {
+        sum[(t+1) * num_chunks + c] += tasks[t].loss->calc_grad_range(
+            matrix, t + 1, *tasks[t].model, nullptr, b, e);
+      }
+    }
+    if (train_pred != nullptr) {
+      Metric* local = train_metric_->AcquireLocal();
+      local->AccumulateRows(matrix, *train_pred, begin, end);
+      train_metric_->ReleaseLocal(local);
+    }
+  });
+  total_example_ += row_len;
+  for (size_t c = 0; c < num_chunks; ++c) {
+    loss_sum_ += sum[c];
+  }
+  for (size_t t = 0; t < tasks.size(); ++t) {
+    Loss* loss = tasks[t].loss;
+    loss->total_example_ += row_len;
+    for (size_t c = 0; c < num_chunks; ++c) {
+      loss->loss_sum_ += sum[(t+1) * num_chunks + c];
+    }
+  }
+}
+
+GradBuffer* Loss::grad_buffer() {
+  if (grad_batch_ == 0) { return nullptr; }
+  // The buffer of each thread keeps its memory for the next batch
+  static thread_local GradBuffer buffer;
+  return &buffer;
+}
+
+// The first of the ids [0, n) of owner o of num_owner owners, where
+// the id i is of owner floor(i * num_owner / n).
+static uint64 owner_begin(size_t o, uint64 n, size_t num_owner) {
+  return ((uint64)o * n + num_owner - 1) / num_owner;
+}
+
+void OwnerRoute::Initialize(Model& model,
+                            size_t num_chunk,
+                            size_t num_owner,
+                            int num_node) {
+  CHECK_GT(num_chunk, 0);
+  CHECK_GT(num_owner, 0);
+  CHECK_GE(num_node, 1);
+  uint64 num_feat = std::max<uint64>(model.GetNumFeature(), 1);
+  uint64 num_v = std::max<uint64>(model.GetNumParameter_v(), 1);
+  if (model_ == &model && num_chunk_ == num_chunk &&
+      num_owner_ == num_owner && num_node_ == num_node &&
+      num_feat_ == num_feat && num_v_ == num_v) {
+    return;
+  }
+  model_ = &model;
+  num_chunk_ = num_chunk;
+  num_owner_ = num_owner;
+  num_node_ = num_node;
+  num_feat_ = num_feat;
+  num_v_ = num_v;
+  aligned_k_ = model.get_aligned_k();
+  outbox_.assign(num_chunk * num_owner, Outbox());
+  rows_.assign(num_chunk, 0);
+  bias_.assign(num_chunk, 0);
+  owned_.assign(num_owner, GradBuffer());
+  for (size_t o = 0; o < num_owner; ++o) {
+    owned_[o].has_bias = o == 0;
+  }
+  claimed_.reset(new std::atomic<bool>[num_owner]);
+  ResetClaims();
+}
+
+void OwnerRoute::Route(size_t c, GradBuffer* buf) {
+  CHECK_LT(c, num_chunk_);
+  Outbox* box = outbox_.data() + c * num_owner_;
+  for (size_t i = 0; i < buf->feat.size(); ++i) {
+    Outbox& out = box[FeatureOwner(buf->feat[i])];
+    out.feat.push_back(buf->feat[i]);
+    out.grad_w.push_back(buf->grad_w[i]);
+  }
+  for (size_t i = 0; i < buf->pos.size(); ++i) {
+    Outbox& out = box[OffsetOwner(buf->pos[i])];
+    const real_t* g = buf->grad_v.data() + i * aligned_k_;
+    out.pos.push_back(buf->pos[i]);
+    out.grad_v.insert(out.grad_v.end(), g, g + aligned_k_);
+  }
+  rows_[c] = buf->rows;
+  bias_[c] = buf->bias;
+  buf->Clear();
+}
+
+// The outboxes are summed in the order of the chunks,
+// so the update does not depend on the threads.
+void OwnerRoute::Apply(size_t o, Model& model, Score* score, uint64 step) {
+  CHECK_LT(o, num_owner_);
+  GradBuffer& buf = owned_[o];
+  for (size_t c = 0; c < num_chunk_; ++c) {
+    Outbox& out = outbox_[c * num_owner_ + o];
+    for (size_t i = 0; i < out.feat.size(); ++i) {
+      buf.Linear(out.feat[i]) += out.grad_w[i];
+    }
+    for (size_t i = 0; i < out.pos.size(); ++i) {
+      real_t* g = buf.Latent(out.pos[i], aligned_k_);
+      const real_t* src = out.grad_v.data() + i * aligned_k_;
+      for (index_t d = 0; d < aligned_k_; ++d) { g[d] += src[d]; }
+    }
+    out.feat.clear();
+    out.grad_w.clear();
+    out.pos.clear();
+    out.grad_v.clear();
+    buf.rows += rows_[c];
+    if (buf.has_bias) { buf.bias += bias_[c]; }
+  }
+  buf.step = step;
+  score->ApplyGrad(model, &buf);
+}
+
+size_t OwnerRoute::Claim() {
+  int node = CurrentNumaNode();
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t o = 0; o < num_owner_; ++o) {
+      if (pass == 0 && OwnerNode(o) != node) { continue; }
+      if (!claimed_[o].exchange(true)) { return o; }
+    }
+  }
+  LOG(FATAL) << "All the " << num_owner_ << " owners are claimed.";
+  return 0;
+}
+
+bool OwnerRoute::PlaceRanges(Model& model) {
+  if (num_node_ <= 1) { return true; }
+  bool placed = true;
+  offset_t aux_size = (offset_t)model.GetAuxiliarySize();
+  for (int n = 0; n < num_node_; ++n) {
+    // The owners [first, last) are of node n
+    size_t first = num_owner_, last = 0;
+    for (size_t o = 0; o < num_owner_; ++o) {
+      if (OwnerNode(o) != n) { continue; }
+      first = std::min(first, o);
+      last = o + 1;
+    }
+    if (first >= last) { continue; }
+    uint64 feat_begin = owner_begin(first, num_feat_, num_owner_);
+    uint64 feat_end = owner_begin(last, num_feat_, num_owner_);
+    placed = MoveMemory(model.GetParameter_w() + feat_begin * aux_size,
+                        (feat_end - feat_begin) * aux_size * sizeof(real_t),
+                        n) && placed;
+    if (model.GetParameter_v() != nullptr) {
+      uint64 v_begin = owner_begin(first, num_v_, num_owner_);
+      uint64 v_end = owner_begin(last, num_v_, num_owner_);
+      placed = MoveMemory(model.GetParameter_v() + v_begin,
+                          (v_end - v_begin) * sizeof(real_t),
+                          n) && placed;
+    }
+  }
+  return placed;
+}
+
+// The rows are trained in rounds of owner_rows_ rows of each thread.
+// In a round, the chunks of the rows are scored in parallel, and then
+// the owners apply the gradients of their ranges in parallel, so the
+// phases are split by the barriers of ParallelFor().
+real_t Loss::calc_grad_owner(
+    const DMatrix* matrix,
+    Model& model,
+    const std::function<real_t(GradBuffer*, size_t, size_t)>& train) {
+  size_t num_chunk = threadNumber_;
+  owner_route_.Initialize(model, num_chunk, threadNumber_, owner_node_);
+  if (owner_placed_ != &model) {
+    owner_placed_ = &model;
+    if (!owner_route_.PlaceRanges(model)) {
+      LOG(WARNING) << "Cannot move the ranges of the owners "
+                      "to their NUMA nodes.";
+    }
+  }
+  owner_buffer_.resize(num_chunk);
+  size_t row_len = matrix->row_length;
+  size_t round = (size_t)owner_rows_ * num_chunk;
+  std::vector<real_t> sum(num_chunk, 0);
+  real_t loss = 0;
+  for (size_t first = 0; first < row_len; first += round) {
+    size_t last = std::min(row_len, first + round);
+    size_t step = (last - first + num_chunk - 1) / num_chunk;
+    pool_->ParallelFor(0, num_chunk, 1, [&](size_t b, size_t e) {
+      for (size_t c = b; c < e; ++c) {
+        size_t begin = std::min(last, first + c * step);
+        size_t end = std::min(last, begin + step);
+        GradBuffer* buf = &owner_buffer_[c];
+        sum[c] = begin < end ? train(buf, begin, end) : 0;
+        owner_route_.Route(c, buf);
+      }
+    });
+    owner_route_.ResetClaims();
+    uint64 adam_step = score_func_->NextStep();
+    pool_->ParallelFor(0, owner_route_.NumOwner(), 1,
+      [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+          owner_route_.Apply(owner_route_.Claim(), model,
+                             score_func_, adam_step);
+        }
+      });
+    for (size_t c = 0; c < num_chunk; ++c) { loss += sum[c]; }
+  }
+  return loss;
+}
+
+// Get the features of the rows and the bias, which is the key
+// after the features. The features out of the model are skipped.
+static void get_batch_keys(const DMatrix* matrix,
+                           index_t bias,
+                           std::vector<index_t>* key,
+                           ThreadPool* pool) {
+  matrix->GetFeatureList(key, pool);
+  while (!key->empty() && key->back() >= bias) {
+    key->pop_back();
+  }
+  key->push_back(bias);
+}
+
+// One mini-batch of CalcGradDist(), whose parameters are pulled
+// before it is computed, and whose change is pushed after that.
+struct DistBatch {
+  /* The rows, which are shared with the data matrix */
+  std::unique_ptr<DMatrix> matrix;
+  /* The features of the rows and the bias */
+  std::vector<index_t> key;
+  /* The pulled values, and then the change of them */
+  std::vector<real_t> value;
+  std::future<void> pull;
+  std::future<void> push;
+};
+
+// Given data sample, train the model on the parameter server.
+// The local model keeps the parameters of the last pull, and each
+// mini-batch updates its own features, so the other workers see the
+// change of a mini-batch after its push.
+//
+// The clock of the store (see KVStore::Clock()) is advanced before
+// the pull of each mini-batch, which may wait for the slowest worker.
+//
+// With the pipeline, the pulls and the pushes are run in order by one
+// communication thread, so while mini-batch t is computed, the thread
+// pushes t-1 and then pulls t+1. Three batches are in flight, and the
+// batch of t+1 reuses the one of t-2, whose push is done before the
+// pull of t, which is waited for before t is computed.
 void Loss::CalcGradDist(DMatrix* matrix,
                         Model& model,
-                        std::vector<real_t>& grad) {
-  for(;;) {
-    // Get a mini-batch from current data matrix
-    DMatrix mini_batch;
-    mini_batch.ReAlloc(batch_size_);
-    index_t len = matrix->GetMiniBatch(batch_size_, mini_batch);
-    if (len == 0) {
-      break;
-    }
-    mini_batch.row_length = len;
-    // Compress the sparse data matrix and sparse model
-    // parameter to dense format
-    std::vector<index_t> feature_list;
-    mini_batch.Compress(feature_list);
-    /*
-    // Pull the model parameter from parameter server
-    store->pull(feature_list, model);
-
-    // Calculate gradient
-    this->CalcGrad(matrix, model, grad);
-
-    // Push gradient to the parameter server
-    ps->push(grad, feature_list);
-    */
+                        KVStore* store) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(store);
+  CHECK_GT(batch_size_, 0);
+  if (pipeline_ && comm_pool_ == nullptr) {
+    comm_pool_.reset(new ThreadPool(1));
+  }
+  if (cache_staleness_ > 0) {
+    calc_grad_cached(matrix, model, store);
+    return;
+  }
+  // The bias is the key after the features
+  index_t bias = model.GetNumFeature();
+  size_t length = model.GetFeatureSize();
+  // Get the next mini-batch from current data matrix and pull its
+  // parameters, which returns false at the end of the matrix
+  auto start_pull = [&](DistBatch* batch) -> bool {
+    if (batch->push.valid()) { batch->push.get(); }
+    batch->matrix.reset(new DMatrix);
+    if (matrix->GetMiniBatch(batch_size_, *batch->matrix) == 0) {
+      return false;
+    }
+    std::vector<index_t>& key = batch->key;
+    get_batch_keys(batch->matrix.get(), bias, &key, pool_);
+    if (pipeline_) {
+      batch->pull = comm_pool_->enqueue([store, batch, length]() {
+        store->Clock();
+        store->Pull(batch->key, &batch->value, length);
+      });
+    } else {
+      store->Clock();
+      store->Pull(key, &batch->value, length);
+    }
+    return true;
+  };
+  DistBatch batch[3];
+  std::vector<real_t> new_value;
+  matrix->pos = 0;
+  bool has_next = start_pull(&batch[0]);
+  for (size_t t = 0; has_next; ++t) {
+    DistBatch* current = &batch[t % 3];
+    if (current->pull.valid()) { current->pull.get(); }
+    model.SetFeatures(current->key, current->value.data());
+    if (pipeline_) {
+      has_next = start_pull(&batch[(t + 1) % 3]);
+    }
+    // Calculate gradient and update the local model
+    this->CalcGrad(current->matrix.get(), model);
+    // Push the change of the parameters to the parameter server
+    std::vector<real_t>& value = current->value;
+    new_value.resize(value.size());
+    model.GetFeatures(current->key, new_value.data());
+    for (size_t i = 0; i < value.size(); ++i) {
+      value[i] = new_value[i] - value[i];
+    }
+    if (pipeline_) {
+      current->push = comm_pool_->enqueue([store, current, length]() {
+        store->Push(current->key, current->value, length);
+      });
+    } else {
+      store->Push(current->key, value, length);
+      has_next = start_pull(&batch[(t + 1) % 3]);
+    }
+  }
+  // Wait for the last pushes
+  for (size_t i = 0; i < 3; ++i) {
+    if (batch[i].push.valid()) { batch[i].push.get(); }
+  }
+  matrix->pos = 0;
+}
+
+// One mini-batch of calc_grad_cached()
+struct CachedBatch {
+  /* The rows, which are shared with the data matrix */
+  std::unique_ptr<DMatrix> matrix;
+  /* The features of the rows and the bias */
+  std::vector<index_t> key;
+  /* The stale keys, which are pulled */
+  std::vector<index_t> pull_key;
+  std::vector<real_t> pull_value;
+  /* The local change of the stale keys, which is pushed first */
+  std::vector<index_t> push_key;
+  std::vector<real_t> push_value;
+  std::future<void> comm;
+};
+
+// Given data sample, train the model on the parameter server with
+// the parameter cache. The version of a key is the mini-batch of its
+// last pull, and the local model is used for the keys pulled in the
+// last cache_staleness_ mini-batches. The change of each mini-batch is
+// added to cache_delta_, and the change of a key is pushed right
+// before its next pull, so it is seen by the other workers after at
+// most cache_staleness_ + 1 mini-batches. The remaining changes are
+// pushed at the end, and the cache is cleared for the next call,
+// since the trainer may pull the whole model between them.
+//
+// The bookkeeping of the cache is done by current thread. With the
+// pipeline, the communication thread pushes and pulls the stale keys
+// of t+1 while t is computed, so the change of t is pushed with the
+// next pull of each key.
+void Loss::calc_grad_cached(DMatrix* matrix,
+                            Model& model,
+                            KVStore* store) {
+  index_t bias = model.GetNumFeature();
+  size_t length = model.GetFeatureSize();
+  cache_version_.assign(bias + 1, -1);
+  cache_delta_.assign((size_t)(bias + 1) * length, 0);
+  cache_dirty_.assign(bias + 1, 0);
+  int64 staleness = cache_staleness_;
+  // Get the mini-batch t, and push and pull its stale keys
+  auto start = [&](CachedBatch* batch, int64 t) -> bool {
+    batch->matrix.reset(new DMatrix);
+    if (matrix->GetMiniBatch(batch_size_, *batch->matrix) == 0) {
+      return false;
+    }
+    get_batch_keys(batch->matrix.get(), bias, &batch->key, pool_);
+    batch->pull_key.clear();
+    batch->push_key.clear();
+    batch->push_value.clear();
+    for (index_t k : batch->key) {
+      int64 version = cache_version_[k];
+      if (version >= 0 && t - version <= staleness) {
+        cache_hits_++;
+        continue;
+      }
+      batch->pull_key.push_back(k);
+      cache_version_[k] = t;
+      if (cache_dirty_[k]) {
+        real_t* delta = cache_delta_.data() + (size_t)k * length;
+        batch->push_key.push_back(k);
+        batch->push_value.insert(batch->push_value.end(),
+                                 delta, delta + length);
+        std::fill(delta, delta + length, 0);
+        cache_dirty_[k] = 0;
+      }
+    }
+    cache_keys_ += batch->key.size();
+    auto comm = [store, batch, length]() {
+      if (!batch->push_key.empty()) {
+        store->Push(batch->push_key, batch->push_value, length);
+      }
+      store->Clock();
+      store->Pull(batch->pull_key, &batch->pull_value, length);
+    };
+    if (pipeline_) {
+      batch->comm = comm_pool_->enqueue(comm);
+    } else {
+      comm();
+    }
+    return true;
+  };
+  // The batch of t+1 reuses the one of t-1, which is done
+  CachedBatch batch[2];
+  std::vector<real_t> old_value, new_value;
+  matrix->pos = 0;
+  bool has_next = start(&batch[0], 0);
+  for (int64 t = 0; has_next; ++t) {
+    CachedBatch* current = &batch[t % 2];
+    if (current->comm.valid()) { current->comm.get(); }
+    if (!current->pull_key.empty()) {
+      model.SetFeatures(current->pull_key, current->pull_value.data());
+    }
+    if (pipeline_) {
+      has_next = start(&batch[(t + 1) % 2], t + 1);
+    }
+    std::vector<index_t>& key = current->key;
+    old_value.resize(key.size() * length);
+    model.GetFeatures(key, old_value.data());
+    // Calculate gradient and update the local model
+    this->CalcGrad(current->matrix.get(), model);
+    new_value.resize(old_value.size());
+    model.GetFeatures(key, new_value.data());
+    for (size_t i = 0; i < key.size(); ++i) {
+      real_t* delta = cache_delta_.data() + (size_t)key[i] * length;
+      const real_t* v1 = new_value.data() + i * length;
+      const real_t* v0 = old_value.data() + i * length;
+      for (size_t j = 0; j < length; ++j) {
+        delta[j] += v1[j] - v0[j];
+      }
+      cache_dirty_[key[i]] = 1;
+    }
+    if (!pipeline_) {
+      has_next = start(&batch[(t + 1) % 2], t + 1);
+    }
+  }
+  for (size_t i = 0; i < 2; ++i) {
+    if (batch[i].comm.valid()) { batch[i].comm.get(); }
+  }
+  // Push the remaining changes
+  std::vector<index_t> push_key;
+  std::vector<real_t> push_value;
+  for (index_t k = 0; k <= bias; ++k) {
+    if (!cache_dirty_[k]) { continue; }
+    const real_t* delta = cache_delta_.data() + (size_t)k * length;
+    push_key.push_back(k);
+    push_value.insert(push_value.end(), delta, delta + length);
+  }
+  if (!push_key.empty()) {
+    store->Push(push_key, push_value, length);
   }
+  matrix->pos = 0;
 }
 
 }  // namespace xLearn
@@ -22,18 +22,215 @@ function or objective function.
 #ifndef XLEARN_LOSS_LOSS_H_
 #define XLEARN_LOSS_LOSS_H_
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
 #include "src/base/math.h"
+#include "src/base/stripe_lock.h"
 #include "src/base/thread_pool.h"
 #include "src/data/model_parameters.h"
+#include "src/distributed/parameter_server.h"
+#include "src/loss/metric.h"
 #include "src/score/score_function.h"
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// RowLock locks the stripes of all the features in a row during its
+// lifetime, which is used by the synchronized training (lock_free =
+// false), so the update of a row is never mixed with the other threads.
+// The bias is updated by every row and it is not locked. It does
+// nothing if the lock is nullptr.
+//------------------------------------------------------------------------------
+class RowLock {
+ public:
+  RowLock(StripedLock* lock, const SparseRow* row)
+    : lock_(lock), stripes_(stripe_buffer()) {
+    if (lock_ == nullptr) { return; }
+    stripes_.clear();
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      stripes_.push_back(lock_->Stripe(iter->feat_id));
+    }
+    lock_->Lock(&stripes_);
+  }
+
+  ~RowLock() {
+    if (lock_ != nullptr) { lock_->Unlock(stripes_); }
+  }
+
+ protected:
+  StripedLock* lock_;
+  std::vector<size_t>& stripes_;
+
+  // Each thread holds one row at a time, so the
+  // buffer of the stripes is shared by the thread.
+  static std::vector<size_t>& stripe_buffer() {
+    static thread_local std::vector<size_t> buffer;
+    return buffer;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RowLock);
+};
+
+//------------------------------------------------------------------------------
+// How the rows of a batch are split into the chunks of the threads
+// (see ThreadPool::ParallelFor). kPartRow gives each chunk the same
+// number of rows. kPartNnz gives each chunk the same cost, which is
+// estimated from the number of the features in each row (nnz for
+// linear, nnz*K for fm, and nnz*(nnz-1)/2*K for ffm), so a few long
+// rows do not keep one thread busy. kPartDynamic uses many small
+// chunks (kDynamicRows rows), which the idle threads take one by one.
+//------------------------------------------------------------------------------
+enum RowPartition {
+  kPartRow = 0,      /* The same number of rows */
+  kPartNnz = 1,      /* The same estimated cost */
+  kPartDynamic = 2   /* Small chunks taken on demand */
+};
+
+// Return the name of the row partition.
+inline const char* RowPartitionName(RowPartition partition) {
+  switch (partition) {
+    case kPartNnz: return "nnz";
+    case kPartDynamic: return "dynamic";
+    default: return "row";
+  }
+}
+
+// Parse the row partition from its name.
+// Return false if the name is unknown.
+inline bool ParseRowPartition(const std::string& name,
+                              RowPartition* partition) {
+  if (name == "row") {
+    *partition = kPartRow;
+  } else if (name == "nnz") {
+    *partition = kPartNnz;
+  } else if (name == "dynamic") {
+    *partition = kPartDynamic;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// OwnerRoute keeps the gradients of a round of the training by the owners
+// of the features (see Loss::SetOwnerUpdate). The linear terms and the
+// latent vectors are split into num_owner ranges of the features and of
+// the offsets of param_v_, and the range of owner o is only written by
+// the thread that applies o. Each chunk of rows sums its gradients in
+// its own GradBuffer, and Route() moves them to the outboxes of their
+// owners. Then Apply() sums the outboxes of an owner from all the chunks
+// and updates its range once, so a hot feature is written by one thread
+// instead of all of them. The chunks and the owners are the two phases
+// of a round, so the model does not depend on the order of the threads.
+// The owners of a round share one adam step, as one update of a batch.
+//
+// The phases are ParallelFor() loops split by their barriers instead of
+// lock-free queues to the owners, since the pool steals the tasks and
+// cannot send one to a given thread.
+//
+// The owners are grouped into num_node ranges of the NUMA nodes, whose
+// pages are moved to their nodes by PlaceRanges(), and Claim() gives the
+// thread pinned to a node the owners of its own node first, so the
+// updates write the local memory:
+//
+//   route.Initialize(model, num_chunk, num_owner, num_node);
+//   /* for each chunk c of rows, in parallel */
+//   route.Route(c, &buffer[c]);
+//   /* then num_owner tasks in parallel */
+//   route.Apply(route.Claim(), model, score, score->NextStep());
+//------------------------------------------------------------------------------
+class OwnerRoute {
+ public:
+  OwnerRoute() { }
+
+  // Split the model into the ranges of num_owner owners for the
+  // gradients of num_chunk chunks, and the owners into num_node
+  // groups of the nodes. It is kept if the shape is not changed.
+  void Initialize(Model& model,
+                  size_t num_chunk,
+                  size_t num_owner,
+                  int num_node);
+
+  // Move the gradients of the buffer of chunk c to the
+  // outboxes of their owners, and clear the buffer.
+  void Route(size_t c, GradBuffer* buf);
+
+  // Sum the gradients of owner o from all the chunks, and update
+  // its range of the model, where the first owner has the bias. The
+  // owners of a round share the adam step (see Score::NextStep).
+  void Apply(size_t o, Model& model, Score* score, uint64 step);
+
+  // Return an owner that is not claimed in this round, which is
+  // of the node of current thread if there is one left.
+  size_t Claim();
+
+  // Start a new round of Claim().
+  void ResetClaims() {
+    for (size_t o = 0; o < num_owner_; ++o) { claimed_[o].store(false); }
+  }
+
+  // Move the pages of the ranges of the owners of each node
+  // to the node. Return false if some pages are not moved.
+  bool PlaceRanges(Model& model);
+
+  // The owner of the linear term of feature j, and the
+  // owner of the latent vector at the offset of param_v_.
+  size_t FeatureOwner(index_t j) const {
+    return std::min((uint64)j * num_owner_ / num_feat_,
+                    (uint64)num_owner_ - 1);
+  }
+  size_t OffsetOwner(offset_t pos) const {
+    return std::min((uint64)pos * num_owner_ / num_v_,
+                    (uint64)num_owner_ - 1);
+  }
+
+  // The node of the range of owner o.
+  int OwnerNode(size_t o) const {
+    return (int)(o * num_node_ / num_owner_);
+  }
+
+  size_t NumChunk() const { return num_chunk_; }
+  size_t NumOwner() const { return num_owner_; }
+
+ protected:
+  // The gradients of a chunk for an owner
+  struct Outbox {
+    std::vector<index_t> feat;
+    std::vector<real_t> grad_w;
+    std::vector<offset_t> pos;
+    std::vector<real_t> grad_v;
+  };
+
+  const Model* model_ = nullptr;
+  size_t num_chunk_ = 0;
+  size_t num_owner_ = 0;
+  int num_node_ = 1;
+  uint64 num_feat_ = 1;
+  uint64 num_v_ = 1;
+  index_t aligned_k_ = 0;
+  /* Outbox (c, o) is at c * num_owner_ + o */
+  std::vector<Outbox> outbox_;
+  /* Rows and the gradient of the bias of each chunk */
+  std::vector<index_t> rows_;
+  std::vector<real_t> bias_;
+  /* The summed gradients of each owner */
+  std::vector<GradBuffer> owned_;
+  /* If each owner is claimed in this round */
+  std::unique_ptr<std::atomic<bool>[]> claimed_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(OwnerRoute);
+};
+
 //------------------------------------------------------------------------------
 // The Loss is an abstract class, which can be implemented by the real
 // loss functions such as cross-entropy loss (cross_entropy_loss.h),
@@ -73,45 +270,215 @@ class Loss {
   Loss() : loss_sum_(0), total_example_ (0) { };
   virtual ~Loss() { }
 
-  // This function needs to be invoked before using this class
+  // This function needs to be invoked before using this class.
+  // If lock_free is false, all the threads still work on the rows,
+  // but each row locks its features (see RowLock) before the update.
+  // When prefetch_distance > 0, each thread prefetches the model
+  // parameters of row (i + prefetch_distance) before it works on
+  // row i (see Score::Prefetch), and 0 disables the prefetch.
   void Initialize(Score* score, 
                   ThreadPool* pool, 
                   bool norm = true,
                   bool lock_free = false,
-                  index_t batch_size = 0) {
+                  index_t batch_size = 0,
+                  int prefetch_distance = 0) {
     CHECK_NOTNULL(score);
     CHECK_NOTNULL(pool);
     CHECK_GE(batch_size, 0);
+    CHECK_GE(prefetch_distance, 0);
     score_func_ = score;
     pool_ = pool;
     norm_ = norm;
     threadNumber_ = pool_->ThreadNumber();
     lock_free_ = lock_free;
+    row_lock_.reset(lock_free ? nullptr : new StripedLock());
     batch_size_ = batch_size;
+    prefetch_distance_ = prefetch_distance;
+  }
+
+  // Set how the rows are split into the chunks of the threads.
+  // The default is kPartRow.
+  void SetPartition(RowPartition partition) {
+    partition_ = partition;
   }
 
+  RowPartition GetPartition() const { return partition_; }
+
+  // Set the minimal estimated cost of a chunk (see RowPartition),
+  // so the small batch is split into fewer chunks, and it runs in
+  // current thread if there is only one. 0 disables the limit.
+  // The default is kMinChunkCost.
+  void SetMinChunkCost(uint64 cost) { min_chunk_cost_ = cost; }
+
+  uint64 GetMinChunkCost() const { return min_chunk_cost_; }
+
+  // Overlap the communication of CalcGradDist() with the compute,
+  // so the gradient of mini-batch t is computed on the parameters
+  // without the push of t-1. false waits for each pull and push.
+  // The default is true.
+  void SetPipeline(bool pipeline) { pipeline_ = pipeline; }
+
+  // Cache the pulled parameters of CalcGradDist() in the local model,
+  // so a feature is pulled again only if its last pull is more than
+  // staleness mini-batches ago, and the change of a cached feature is
+  // accumulated locally and pushed before its next pull. The hot
+  // features, like the bias, are pulled once every (staleness + 1)
+  // mini-batches. 0 (by default) pulls every feature of each batch.
+  void SetParamCache(index_t staleness) { cache_staleness_ = staleness; }
+
+  // Number of the keys of the mini-batches in CalcGradDist(), and
+  // the number of them that are read from the cache without a pull.
+  uint64 GetCacheKeys() const { return cache_keys_; }
+  uint64 GetCacheHits() const { return cache_hits_; }
+
+  // Sum the gradients of each rows rows of a thread in its own buffer
+  // (see GradBuffer), and update the model once by the sum, so a hot
+  // feature is written once for a mini-batch of each thread instead of
+  // once for each row. The rows of a batch are scored on the model
+  // before its update. It only works with the lock-free training, and
+  // 0 (by default) updates the model for each row.
+  void SetGradBatch(index_t rows) { grad_batch_ = rows; }
+
+  index_t GetGradBatch() const { return grad_batch_; }
+
+  // Train the rows in rounds of rows rows of each thread instead of
+  // Hogwild, where the features are split into the ranges of the owners
+  // (one for each thread), and the gradients of a round are routed to
+  // the owners of their features (see OwnerRoute), so each parameter is
+  // written by one thread only. The rows of a round are scored on the
+  // model before its update. If num_node > 1, the ranges are placed on
+  // the NUMA nodes of the threads that apply them, and the pool must be
+  // pinned to the nodes. It only works with the lock-free training,
+  // and -grad_batch is not used. 0 (by default) disables it.
+  void SetOwnerUpdate(index_t rows, int num_node = 1) {
+    CHECK_GE(num_node, 1);
+    owner_rows_ = rows;
+    owner_node_ = num_node;
+  }
+
+  index_t GetOwnerRows() const { return owner_rows_; }
+
+  // Accumulate the metric of the training rows in CalcGrad(), where
+  // the prediction of each row is the score computed before its own
+  // update. The counters are kept in the local metrics of the threads,
+  // so metric->MergeLocals() must be called before metric->GetMetric().
+  // nullptr (by default) disables it.
+  void SetTrainMetric(Metric* metric) { train_metric_ = metric; }
+
+  // Weight the gradient of each row of CalcGrad() by rows->weight and
+  // write its loss to rows->loss (see RowLoss), where rows belongs to
+  // the reader of the matrix. The training loss is the weighted mean,
+  // so it estimates the loss of all the rows of a sampled pass. Only
+  // the cross-entropy loss uses it, and nullptr (by default) disables it.
+  void SetRowLoss(RowLoss* rows) { row_loss_ = rows; }
+
+  // Split the rows of the matrix by current partition, where the
+  // i-th chunk is [bounds[i], bounds[i+1]) and no chunk is empty.
+  void SplitRows(const DMatrix* matrix,
+                 Model& model,
+                 std::vector<size_t>* bounds);
+
+  // Number of rows in a chunk of kPartDynamic.
+  static const size_t kDynamicRows = 64;
+
+  // Default minimal cost of a chunk, which is about the
+  // cost of waking up a thread and waiting for it.
+  static const uint64 kMinChunkCost = 16384;
+
+  // Minimal number of rows in a chunk of Evaluate().
+  static const size_t kMinEvalRows = 8192;
+
   // Given predictions and labels, accumulate loss value.
   virtual void Evaluate(const std::vector<real_t>& pred,
                        const std::vector<real_t>& label) = 0;
 
+  // Given predictions and labels, return the loss sum of
+  // [begin, end), which is computed in current thread.
+  virtual real_t EvaluateRange(const std::vector<real_t>& pred,
+                               const std::vector<real_t>& label,
+                               size_t begin,
+                               size_t end) = 0;
+
   // Given data sample and current model, return predictions.
   virtual void Predict(const DMatrix* data_matrix,
                        Model& model,
                        std::vector<real_t>& pred);
 
+  // Same as Predict(), but the predictions are written to the
+  // buffer of the caller, which has matrix->row_length values.
+  void Predict(const DMatrix* data_matrix,
+               Model& model,
+               real_t* pred);
+
+  // Return the prediction of one row, which is computed in the
+  // thread of the caller without the thread pool. The model is
+  // only read, so many threads can call it at the same time.
+  // The norm of the row is only used by instance-wise normalization.
+  real_t PredictRow(const SparseRow* row,
+                    Model& model,
+                    real_t norm = 1.0);
+
+  // Rank the candidates of one request, in which each row of the
+  // candidates matrix is scored as the context features plus its own
+  // features. The part of the context is computed once by the score
+  // function (see ScoreContext), and the row_length predictions are
+  // written to pred. Like PredictRow(), it runs in the thread of the
+  // caller, and many threads can call it at the same time.
+  void PredictCandidates(const SparseRow* context,
+                         const DMatrix* candidates,
+                         Model& model,
+                         real_t* pred);
+
+  // Same as Predict() + Evaluate() + metric->Accumulate(), but each
+  // thread evaluates the loss and the metric of its rows right after
+  // it scores them, so it is only one pass over the rows. The metric
+  // can be nullptr, and its counters are kept in the local metrics of
+  // the threads, so metric->MergeLocals() must be called before
+  // metric->GetMetric().
+  void PredictAndEvaluate(const DMatrix* data_matrix,
+                          Model& model,
+                          std::vector<real_t>& pred,
+                          Metric* metric);
+
   // Given data sample and current model, calculate gradient
   // and update current model parameters.
   // This function will also accumulate loss value.
   virtual void CalcGrad(const DMatrix* data_matrix, 
                         Model& model) = 0;
 
-  // Given data sample and current model, calculate gradient.
-  // Note that this method doesn't update local model, and the
-  // gradient will be pushed to the parameter server, which is 
-  // used for distributed computation.
+  // The model and the loss of one of the other tasks of multi-task
+  // training, which is trained by the labels of its task (see
+  // DMatrix::SetNumTask). The loss can be of another type.
+  struct Task {
+    Model* model;
+    Loss* loss;
+  };
+
+  // Same as CalcGrad(), but task t of the rows (t > 0) trains the
+  // model of tasks[t-1] at the same time. Each thread trains its rows
+  // in blocks of kTaskRows, and each block is trained by all the tasks
+  // one after another, so its nodes are still in cache for the next
+  // task. The loss of each task is accumulated in its own loss, and
+  // the training metric is only of task 0.
+  void CalcGradTasks(const DMatrix* data_matrix,
+                     Model& model,
+                     const std::vector<Task>& tasks);
+
+  // Number of rows of a block of CalcGradTasks().
+  static const size_t kTaskRows = 256;
+
+  // Given data sample, train the model on the parameter server,
+  // which is used for distributed computation. For each mini-batch
+  // of batch_size rows, the parameters of its features are pulled
+  // from the store to the local model, which is updated by CalcGrad(),
+  // and then the change of the parameters is pushed to the store.
+  // If the pipeline is on (see SetPipeline), the pull of mini-batch
+  // t+1 and the push of t-1 run on a communication thread while t is
+  // computed. With the cache (see SetParamCache), only the stale
+  // features are pulled. This function will also accumulate loss value.
   virtual void CalcGradDist(DMatrix* data_matrix,
                             Model& model,
-                            std::vector<real_t>& grad);
+                            KVStore* store);
 
   // Return the calculated loss value
   virtual real_t GetLoss() {
@@ -135,6 +502,8 @@ class Loss {
   bool norm_;
   /* Open lock-free training ? */
   bool lock_free_;
+  /* Locks of the features when lock_free_ is false */
+  std::unique_ptr<StripedLock> row_lock_;
   /* Thread pool for multi-thread training */
   ThreadPool* pool_;
   /* Number of thread in thread pool */
@@ -145,6 +514,83 @@ class Loss {
   index_t total_example_;
   /* Mini-batch size */
   index_t batch_size_;
+  /* Number of rows to prefetch ahead */
+  size_t prefetch_distance_ = 0;
+  /* How the rows are split into chunks */
+  RowPartition partition_ = kPartRow;
+  /* Minimal estimated cost of a chunk */
+  uint64 min_chunk_cost_ = kMinChunkCost;
+  /* Metric of the training rows, which can be nullptr */
+  Metric* train_metric_ = nullptr;
+  /* Predictions of the training rows for train_metric_ */
+  std::vector<real_t> train_pred_;
+  /* Loss and weights of the rows of the reader, which can be nullptr */
+  RowLoss* row_loss_ = nullptr;
+  /* Overlap the pull and the push of CalcGradDist() */
+  bool pipeline_ = true;
+  /* The communication thread of CalcGradDist() */
+  std::unique_ptr<ThreadPool> comm_pool_;
+  /* Rows of the gradient buffer of a thread, where 0 disables it */
+  index_t grad_batch_ = 0;
+  /* Rows of each thread in a round of the owners, where 0 disables it */
+  index_t owner_rows_ = 0;
+  /* Number of the NUMA nodes of the owners */
+  int owner_node_ = 1;
+  /* The route and the gradient buffers of the chunks of the owners */
+  OwnerRoute owner_route_;
+  std::vector<GradBuffer> owner_buffer_;
+  /* The model whose ranges are placed on the nodes */
+  const Model* owner_placed_ = nullptr;
+  /* Staleness of the parameter cache, where 0 disables it */
+  index_t cache_staleness_ = 0;
+  /* The mini-batch of the last pull of each key, or -1 */
+  std::vector<int64> cache_version_;
+  /* The local change of each key, which is not pushed yet */
+  std::vector<real_t> cache_delta_;
+  std::vector<char> cache_dirty_;
+  /* Counters of the cache */
+  uint64 cache_keys_ = 0;
+  uint64 cache_hits_ = 0;
+
+  // CalcGradDist() with the parameter cache.
+  void calc_grad_cached(DMatrix* data_matrix,
+                        Model& model,
+                        KVStore* store);
+
+  // Return the gradient buffer of current thread, or
+  // nullptr if the gradient batch is disabled.
+  GradBuffer* grad_buffer();
+
+  // Train the matrix by the owners (see SetOwnerUpdate), where
+  // train(buf, begin, end) scores the rows [begin, end), adds their
+  // gradients to buf without the update, and returns their loss.
+  // Return the sum of the loss of all the rows.
+  real_t calc_grad_owner(
+      const DMatrix* matrix,
+      Model& model,
+      const std::function<real_t(GradBuffer*, size_t, size_t)>& train);
+
+  // Train the rows [begin, end) of the matrix by the labels of the
+  // task in current thread, and return the sum of their loss, which
+  // is used by CalcGradTasks(). The predictions are written to
+  // train_pred if it is not nullptr.
+  virtual real_t calc_grad_range(const DMatrix* matrix,
+                                 index_t task,
+                                 Model& model,
+                                 std::vector<real_t>* train_pred,
+                                 size_t begin,
+                                 size_t end) {
+    LOG(FATAL) << "Multi-task training is not supported by "
+               << loss_type();
+    return 0;
+  }
+
+  // Return the index of the chunk that starts at begin.
+  static size_t chunk_index(const std::vector<size_t>& bounds,
+                            size_t begin) {
+    return std::lower_bound(bounds.begin(), bounds.end(), begin) -
+           bounds.begin();
+  }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Loss);
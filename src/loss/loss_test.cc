@@ -41,12 +41,17 @@ class TestLoss : public Loss {
   void Evaluate(const std::vector<real_t>& pred,
                const std::vector<real_t>& label) { return; }
 
+  real_t EvaluateRange(const std::vector<real_t>& pred,
+                       const std::vector<real_t>& label,
+                       size_t begin,
+                       size_t end) { return 0; }
+
   void CalcGrad(const DMatrix* data_matrix,
                 Model& model) { return; }
 
   void CalcGradDist(DMatrix* data_matrix,
                     Model& model,
-                    std::vector<real_t>& grad) { return; }
+                    KVStore* store) { return; }
 
   std::string loss_type() { return "test"; }
 
@@ -199,6 +204,58 @@ TEST_F(LossTest, Predict_FFM) {
   }
 }
 
+// The prefetch distance never changes the prediction, even for
+// the unseen features, the compact latent factors, and the
+// distance that is longer than the data.
+TEST_F(LossTest, Predict_Prefetch) {
+  std::string score_func[3] = { "linear", "fm", "ffm" };
+  StorageType types[2] = { kStoreFP32, kStoreInt8 };
+  for (int s = 0; s < 3; ++s) {
+    for (int t = 0; t < 2; ++t) {
+      Model model;
+      model.Initialize(score_func[s], param.loss_func,
+                       20, 4, param.num_K,
+                       param.auxiliary_size, 0.5);
+      if (s > 0) { model.ConvertLatent(types[t]); }
+      DMatrix matrix;
+      matrix.ReAlloc(kLine);
+      for (int i = 0; i < kLine; ++i) {
+        matrix.Y[i] = 0;
+        matrix.row[i] = new SparseRow;
+        for (int j = 0; j < 5 + i; ++j) {
+          // feat_id 20 and 21 are unseen
+          matrix.AddNode(i, (i * 7 + j * 3) % 22, 1.0, j % 4);
+        }
+      }
+      Score* score = nullptr;
+      if (s == 0) {
+        score = new LinearScore;
+      } else if (s == 1) {
+        score = new FMScore;
+      } else {
+        score = new FFMScore;
+      }
+      ThreadPool* pool = new ThreadPool(2);
+      std::vector<real_t> expect(kLine);
+      TestLoss loss;
+      loss.Initialize(score, pool);
+      loss.Predict(&matrix, model, expect);
+      int distance[3] = { 1, 3, 100 };
+      for (int d = 0; d < 3; ++d) {
+        TestLoss loss_pf;
+        loss_pf.Initialize(score, pool, true, false, 0, distance[d]);
+        std::vector<real_t> pred(kLine);
+        loss_pf.Predict(&matrix, model, pred);
+        for (int i = 0; i < kLine; ++i) {
+          EXPECT_FLOAT_EQ(pred[i], expect[i]);
+        }
+      }
+      delete pool;
+      delete score;
+    }
+  }
+}
+
 Loss* CreateLoss(const char* format_name) {
   return CREATE_LOSS(format_name);
 }
@@ -210,4 +267,124 @@ TEST_F(LossTest, Create_Loss) {
   EXPECT_TRUE(CreateLoss("unknow_name") == NULL);
 }
 
+// The first rows are much longer than the others.
+TEST_F(LossTest, Split_rows) {
+  const index_t kRows = 1000;
+  const index_t kFeat = 100;
+  Model model;
+  model.Initialize("linear", param.loss_func, kFeat, 1, 0, 1);
+  real_t* w = model.GetParameter_w();
+  for (size_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 0.5;
+  }
+  DMatrix matrix;
+  matrix.ReAlloc(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    matrix.row[i] = new SparseRow;
+    index_t nnz = i < 50 ? kFeat : 1;
+    for (index_t j = 0; j < nnz; ++j) {
+      matrix.AddNode(i, j, 1.0);
+    }
+  }
+  TestLoss loss;
+  Score* score = new LinearScore;
+  ThreadPool pool(4);
+  loss.Initialize(score, &pool, false);
+  // Split the small matrix too
+  loss.SetMinChunkCost(0);
+  std::vector<real_t> expect(kRows);
+  loss.Predict(&matrix, model, expect);
+  RowPartition parts[3] = { kPartRow, kPartNnz, kPartDynamic };
+  for (int p = 0; p < 3; ++p) {
+    loss.SetPartition(parts[p]);
+    std::vector<size_t> bounds;
+    loss.SplitRows(&matrix, model, &bounds);
+    ASSERT_GE(bounds.size(), 2);
+    EXPECT_EQ(bounds.front(), 0);
+    EXPECT_EQ(bounds.back(), kRows);
+    for (size_t i = 1; i < bounds.size(); ++i) {
+      EXPECT_LT(bounds[i-1], bounds[i]);
+    }
+    if (parts[p] == kPartNnz) {
+      // 16 chunks of (50*101 + 950*2) / 16 = 434 nodes,
+      // so each chunk has 5 long rows at most
+      EXPECT_EQ(bounds.size(), 17);
+      for (size_t i = 1; i < bounds.size(); ++i) {
+        size_t cost = 0;
+        for (size_t r = bounds[i-1]; r < bounds[i]; ++r) {
+          cost += matrix.row[r]->size() + 1;
+        }
+        EXPECT_LE(cost, 434 + 101);
+      }
+    } else if (parts[p] == kPartDynamic) {
+      EXPECT_EQ(bounds.size(), (kRows + Loss::kDynamicRows - 1) /
+                               Loss::kDynamicRows + 1);
+    } else {
+      EXPECT_EQ(bounds.size(), 17);
+    }
+    // The same predictions
+    std::vector<real_t> pred(kRows);
+    loss.Predict(&matrix, model, pred);
+    for (index_t i = 0; i < kRows; ++i) {
+      EXPECT_FLOAT_EQ(pred[i], expect[i]);
+    }
+  }
+  EXPECT_STREQ(RowPartitionName(kPartNnz), "nnz");
+  RowPartition partition;
+  EXPECT_TRUE(ParseRowPartition("dynamic", &partition));
+  EXPECT_EQ(partition, kPartDynamic);
+  EXPECT_FALSE(ParseRowPartition("col", &partition));
+}
+
+// The small batch runs in one chunk, and the number of chunks
+// of the bigger one depends on the model type.
+TEST_F(LossTest, Split_small_batch) {
+  const index_t kRows = 1000;
+  const index_t kFeat = 10;
+  DMatrix matrix;
+  matrix.ReAlloc(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    matrix.row[i] = new SparseRow;
+    for (index_t j = 0; j < kFeat; ++j) {
+      matrix.AddNode(i, j, 1.0, j);
+    }
+  }
+  ThreadPool pool(4);
+  RowPartition parts[3] = { kPartRow, kPartNnz, kPartDynamic };
+  // (10 + 1) * 1000 < kMinChunkCost
+  Model linear;
+  linear.Initialize("linear", param.loss_func, kFeat, 1, 0, 1);
+  {
+    TestLoss loss;
+    LinearScore score;
+    loss.Initialize(&score, &pool, false);
+    EXPECT_EQ(loss.GetMinChunkCost(), Loss::kMinChunkCost);
+    for (int p = 0; p < 3; ++p) {
+      loss.SetPartition(parts[p]);
+      std::vector<size_t> bounds;
+      loss.SplitRows(&matrix, linear, &bounds);
+      ASSERT_EQ(bounds.size(), 2);
+      EXPECT_EQ(bounds[0], 0);
+      EXPECT_EQ(bounds[1], kRows);
+    }
+  }
+  // (10 + 45 * 4 + 1) * 1000 / kMinChunkCost = 11 chunks at most
+  Model ffm;
+  ffm.Initialize("ffm", param.loss_func, kFeat, kFeat, 4, 1);
+  {
+    TestLoss loss;
+    FFMScore score;
+    loss.Initialize(&score, &pool, false);
+    for (int p = 0; p < 3; ++p) {
+      loss.SetPartition(parts[p]);
+      std::vector<size_t> bounds;
+      loss.SplitRows(&matrix, ffm, &bounds);
+      EXPECT_GT(bounds.size(), 2);
+      EXPECT_LE(bounds.size(), 12);
+      EXPECT_EQ(bounds.front(), 0);
+      EXPECT_EQ(bounds.back(), kRows);
+    }
+  }
+}
+
 } // namespace xLearn
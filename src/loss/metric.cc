@@ -31,5 +31,8 @@ REGISTER_METRIC("mae", MAEMetric);
 REGISTER_METRIC("mape", MAPEMetric);
 REGISTER_METRIC("rmsd", RMSDMetric);
 REGISTER_METRIC("auc", AUCMetric);
+REGISTER_METRIC("gauc", GAUCMetric);
+
+const size_t Metric::kMinRows;
 
 }  // namespace xLearn
@@ -23,8 +23,14 @@ This file defines the Metric class.
 
 #include <math.h>
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "src/base/common.h"
 #include "src/base/math.h"
+#include "src/base/radix_sort.h"
 #include "src/base/class_register.h"
 #include "src/base/thread_pool.h"
 #include "src/data/data_structure.h"
@@ -52,14 +58,41 @@ const index_t kMaxBucketSize = 1e6;
 //      metric->Accumulate(matrix->Y, pred);
 //    }
 //    real_t metric_val = metric.GetMetric();  
+//
+// The counters can also be accumulated by the threads themselves, e.g.,
+// in the same pass that computes the predictions. A local metric (given
+// by NewLocal()) is used by one thread at a time, and Merge() adds its
+// counters to the metric. AcquireLocal() and ReleaseLocal() keep a pool
+// of the local metrics, which are created once and reused by all the
+// batches, and MergeLocals() merges all of them:
+//
+//    pool->ParallelFor(0, n, 0, [&](size_t begin, size_t end) {
+//      Metric* local = metric->AcquireLocal();
+//      local->AccumulateRows(matrix, pred, begin, end);
+//      metric->ReleaseLocal(local);
+//    });
+//    metric->MergeLocals();
+//    real_t metric_val = metric->GetMetric();
+//
+// The counters of a metric are also its state, which is StateSize()
+// doubles, and the state of the whole data is the sum of the states of
+// its parts. So the metric of the data of all the nodes of distributed
+// training is given by one allreduce of the states, instead of sending
+// the predictions to one node:
+//
+//    std::vector<double> state(metric->StateSize());
+//    metric->GetState(state.data());
+//    ring->AllReduce(state.data(), state.size(), kReduceSum);
+//    metric->SetState(state.data());
+//    real_t global_val = metric->GetMetric();
 //------------------------------------------------------------------------------
 class Metric {
  public:
   // Constructor and Destructor
-  Metric() { }
+  Metric() : pool_(nullptr), threadNumber_(0) { }
   virtual ~Metric() { }
 
-  void Initialize(ThreadPool* pool) {
+  virtual void Initialize(ThreadPool* pool) {
     CHECK_NOTNULL(pool);
     pool_ = pool;
     threadNumber_ = pool_->ThreadNumber();
@@ -69,9 +102,69 @@ class Metric {
   virtual void Accumulate(const std::vector<real_t>& Y,
                           const std::vector<real_t>& pred) = 0;
 
+  // Accumulate counters of [begin, end) in current thread.
+  virtual void AccumulateRange(const std::vector<real_t>& Y,
+                               const std::vector<real_t>& pred,
+                               size_t begin,
+                               size_t end) = 0;
+
+  // Same as AccumulateRange(), but the rows of the matrix are given,
+  // so the metric can also use the other columns (e.g., the group ids
+  // used by GAUC). The labels are matrix->Y.
+  virtual void AccumulateRows(const DMatrix* matrix,
+                              const std::vector<real_t>& pred,
+                              size_t begin,
+                              size_t end) {
+    AccumulateRange(matrix->Y, pred, begin, end);
+  }
+
+  // Return a new and empty metric of the same type, which is
+  // used as the local metric of a thread.
+  virtual Metric* NewLocal() = 0;
+
+  // Add the counters of the local metric (given by NewLocal()),
+  // and then reset the local one.
+  virtual void Merge(Metric* local) = 0;
+
+  // Take a local metric from the pool, or create a new one.
+  Metric* AcquireLocal() {
+    std::unique_lock<std::mutex> lock(local_mutex_);
+    if (free_locals_.empty()) {
+      locals_.emplace_back(NewLocal());
+      return locals_.back().get();
+    }
+    Metric* local = free_locals_.back();
+    free_locals_.pop_back();
+    return local;
+  }
+
+  // Return the local metric to the pool.
+  void ReleaseLocal(Metric* local) {
+    std::unique_lock<std::mutex> lock(local_mutex_);
+    free_locals_.push_back(local);
+  }
+
+  // Merge all the local metrics, which must be called after the
+  // local metrics are used and before GetMetric().
+  void MergeLocals() {
+    std::unique_lock<std::mutex> lock(local_mutex_);
+    for (size_t i = 0; i < locals_.size(); ++i) {
+      Merge(locals_[i].get());
+    }
+  }
+
   // Reset counters
   virtual void Reset() = 0;
 
+  // The number of the doubles of the state, which only depends on the
+  // type and the options of the metric, so it is the same on all the
+  // nodes. GetState() writes the counters to the state, and SetState()
+  // replaces the counters with the state (e.g., the sum of the states
+  // of the nodes). They are called after MergeLocals().
+  virtual size_t StateSize() = 0;
+  virtual void GetState(double* state) = 0;
+  virtual void SetState(const double* state) = 0;
+
   // Return the final metric value.
   virtual real_t GetMetric() = 0;
 
@@ -81,11 +174,25 @@ class Metric {
   // Compare two metric value, which is used in early-stop.
   virtual bool cmp(const real_t a, const real_t b) = 0;
 
+  // The number of the metrics, and the type and the value of the
+  // i-th one, which are only more than one for MetricList.
+  virtual size_t NumMetrics() { return 1; }
+  virtual std::string MetricTypeAt(size_t i) { return metric_type(); }
+  virtual real_t MetricAt(size_t i) { return GetMetric(); }
+
+  // Minimal number of rows in a chunk of Accumulate(), so
+  // the small batch runs in fewer threads, or in current one.
+  static const size_t kMinRows = 4096;
+
  protected:
   /* Pointer of thread pool */
   ThreadPool* pool_;
   /* Thread number used by Metric */
   size_t threadNumber_;
+  /* Local metrics of the threads */
+  std::vector<std::unique_ptr<Metric> > locals_;
+  std::vector<Metric*> free_locals_;
+  std::mutex local_mutex_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Metric);
@@ -132,30 +239,56 @@ class AccMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<index_t> sum(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(acc_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<index_t> sum(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        acc_accum_thread(&Y, &pred, &sum[begin / grain], begin, end);
+      });
     for (size_t i = 0; i < sum.size(); ++i) {
       true_pred_ += sum[i];
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    index_t true_pred = 0;
+    acc_accum_thread(&Y, &pred, &true_pred, begin, end);
+    total_example_ += end - begin;
+    true_pred_ += true_pred;
+  }
+
+  Metric* NewLocal() { return new AccMetric(); }
+
+  void Merge(Metric* local) {
+    AccMetric* other = static_cast<AccMetric*>(local);
+    total_example_ += other->total_example_;
+    true_pred_ += other->true_pred_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     total_example_ = 0;
     true_pred_ = 0;
   }
 
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    state[0] = total_example_;
+    state[1] = true_pred_;
+  }
+
+  void SetState(const double* state) {
+    total_example_ = state[0];
+    true_pred_ = state[1];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return (true_pred_ * 1.0) / total_example_;
@@ -219,21 +352,18 @@ class PrecMetric : public Metric {
                   const std::vector<real_t>& pred) {
     CHECK_EQ(Y.size(), pred.size());
     // multi-thread training
-    std::vector<index_t> sum_1(threadNumber_, 0);
-    std::vector<index_t> sum_2(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(prec_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum_1[i]),
-                               &(sum_2[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<index_t> sum_1(num_chunks, 0);
+    std::vector<index_t> sum_2(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        prec_accum_thread(&Y,
+                          &pred,
+                          &sum_1[begin / grain],
+                          &sum_2[begin / grain],
+                          begin, end);
+      });
     for (size_t i = 0; i < sum_1.size(); ++i) {
       true_positive_ += sum_1[i];
     }
@@ -242,12 +372,44 @@ class PrecMetric : public Metric {
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    index_t true_pos = 0, false_pos = 0;
+    prec_accum_thread(&Y, &pred, &true_pos, &false_pos, begin, end);
+    true_positive_ += true_pos;
+    false_positive_ += false_pos;
+  }
+
+  Metric* NewLocal() { return new PrecMetric(); }
+
+  void Merge(Metric* local) {
+    PrecMetric* other = static_cast<PrecMetric*>(local);
+    true_positive_ += other->true_positive_;
+    false_positive_ += other->false_positive_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     true_positive_ = 0;
     false_positive_ = 0;
   }
 
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    state[0] = true_positive_;
+    state[1] = false_positive_;
+  }
+
+  void SetState(const double* state) {
+    true_positive_ = state[0];
+    false_positive_ = state[1];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return (true_positive_ * 1.0) / 
@@ -312,21 +474,18 @@ class RecallMetric : public Metric {
                   const std::vector<real_t>& pred) {
     CHECK_EQ(Y.size(), pred.size());
     // multi-thread training
-    std::vector<index_t> sum_1(threadNumber_, 0);
-    std::vector<index_t> sum_2(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(recall_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum_1[i]),
-                               &(sum_2[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<index_t> sum_1(num_chunks, 0);
+    std::vector<index_t> sum_2(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        recall_accum_thread(&Y,
+                            &pred,
+                            &sum_1[begin / grain],
+                            &sum_2[begin / grain],
+                            begin, end);
+      });
     for (size_t i = 0; i < sum_1.size(); ++i) {
       true_positive_ += sum_1[i];
     }
@@ -335,12 +494,44 @@ class RecallMetric : public Metric {
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    index_t true_pos = 0, false_neg = 0;
+    recall_accum_thread(&Y, &pred, &true_pos, &false_neg, begin, end);
+    true_positive_ += true_pos;
+    false_negative_ += false_neg;
+  }
+
+  Metric* NewLocal() { return new RecallMetric(); }
+
+  void Merge(Metric* local) {
+    RecallMetric* other = static_cast<RecallMetric*>(local);
+    true_positive_ += other->true_positive_;
+    false_negative_ += other->false_negative_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     true_positive_ = 0;
     false_negative_ = 0;
   }
 
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    state[0] = true_positive_;
+    state[1] = false_negative_;
+  }
+
+  void SetState(const double* state) {
+    true_positive_ = state[0];
+    false_negative_ = state[1];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return (true_positive_ * 1.0) / 
@@ -408,21 +599,18 @@ class F1Metric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<index_t> sum_1(threadNumber_, 0);
-    std::vector<index_t> sum_2(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(f1_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum_1[i]),
-                               &(sum_2[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<index_t> sum_1(num_chunks, 0);
+    std::vector<index_t> sum_2(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        f1_accum_thread(&Y,
+                        &pred,
+                        &sum_1[begin / grain],
+                        &sum_2[begin / grain],
+                        begin, end);
+      });
     for (size_t i = 0; i < sum_1.size(); ++i) {
       true_positive_ += sum_1[i];
     }
@@ -431,6 +619,28 @@ class F1Metric : public Metric {
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    index_t true_pos = 0, true_neg = 0;
+    f1_accum_thread(&Y, &pred, &true_pos, &true_neg, begin, end);
+    total_example_ += end - begin;
+    true_positive_ += true_pos;
+    true_negative_ += true_neg;
+  }
+
+  Metric* NewLocal() { return new F1Metric(); }
+
+  void Merge(Metric* local) {
+    F1Metric* other = static_cast<F1Metric*>(local);
+    total_example_ += other->total_example_;
+    true_positive_ += other->true_positive_;
+    true_negative_ += other->true_negative_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     true_positive_ = 0;
@@ -438,6 +648,20 @@ class F1Metric : public Metric {
     total_example_ = 0;
   }
 
+  size_t StateSize() { return 3; }
+
+  void GetState(double* state) {
+    state[0] = total_example_;
+    state[1] = true_positive_;
+    state[2] = true_negative_;
+  }
+
+  void SetState(const double* state) {
+    total_example_ = state[0];
+    true_positive_ = state[1];
+    true_negative_ = state[2];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return (true_positive_ * 2.0) / 
@@ -468,86 +692,207 @@ class F1Metric : public Metric {
 // equal to the probability that a classifier will rank a randomly chosen 
 // positive instance higher than a randomly chosen negative one 
 // (assuming 'positive' ranks higher than 'negative').
+//
+// AUCMetric has two modes. On default, it counts the positive and the
+// negative examples in the buckets of sigmoid(pred), so the AUC is an
+// approximation, and SetBucketSize() changes its resolution. The exact
+// mode (SetExact(true)) keeps the (score, label) pairs of all the
+// examples, which are sorted by the parallel radix sort in GetMetric(),
+// so it needs 8 bytes for each example. In both modes, the buckets or
+// the pairs of each thread are kept by the local metrics, and they are
+// reused by all the batches. The state of both modes is the buckets,
+// so the AUC of the merged states is the approximate AUC.
 //------------------------------------------------------------------------------
 class AUCMetric : public Metric {
- public:
-  struct Info {
-    Info() {
-      positive_vec_.resize(kMaxBucketSize, 0);
-      negative_vec_.resize(kMaxBucketSize, 0);
-    }
-    std::vector<index_t> positive_vec_;
-    std::vector<index_t> negative_vec_;
-  };
-
  public:
   // Constructor and Destructor
-  AUCMetric() {
-    all_positive_number_.clear();
-    all_negative_number_.clear();
-    all_positive_number_.resize(kMaxBucketSize, 0);
-    all_negative_number_.resize(kMaxBucketSize, 0);
-  }
+  AUCMetric()
+   : exact_(false),
+     bucket_size_(kMaxBucketSize),
+     num_example_(0) { }
   ~AUCMetric() { }
 
+  // Use the exact AUC instead of the buckets.
+  void SetExact(bool exact) {
+    exact_ = exact;
+    Reset();
+  }
+  bool IsExact() const { return exact_; }
+
+  // Number of the buckets of the approximate AUC.
+  void SetBucketSize(index_t bucket_size) {
+    CHECK_GT(bucket_size, 1);
+    bucket_size_ = bucket_size;
+    Reset();
+  }
+  index_t GetBucketSize() const { return bucket_size_; }
+
+  // The key of the exact AUC, which is ordered by the
+  // score first, and then the label (negative first).
+  static uint64 auc_key(real_t y, real_t pred) {
+    return (static_cast<uint64>(FloatSortKey(pred)) << 1) |
+           (y > 0 ? 1 : 0);
+  }
+
+  // The bucket of the score.
+  static index_t auc_bucket(real_t pred, index_t bucket_size) {
+    real_t sigmoid_score = polysigmoid(pred);
+    return std::min(index_t(sigmoid_score * bucket_size),
+                    bucket_size - 1);
+  }
+
   // Calculate AUC in one thread
   static void auc_accum_thread(const std::vector<real_t>* Y,
                                const std::vector<real_t>* pred,
-                               Info* info,
+                               std::vector<index_t>* positive_vec,
+                               std::vector<index_t>* negative_vec,
                                size_t start_idx,
                                size_t end_idx) {
     CHECK_GE(end_idx, start_idx);
+    index_t bucket_size = positive_vec->size();
     for (size_t i = start_idx; i < end_idx; ++i) {
-      real_t r_label = (*Y)[i] > 0 ? 1 : -1;
-      real_t sigmoid_score = fastsigmoid((*pred)[i]);
-      index_t bkt_id = index_t(sigmoid_score * kMaxBucketSize) 
-                       % kMaxBucketSize;
-      CHECK_LT(bkt_id, kMaxBucketSize);
-      if (r_label > 0) {
-        info->positive_vec_[bkt_id] += 1;
+      index_t bkt_id = auc_bucket((*pred)[i], bucket_size);
+      if ((*Y)[i] > 0) {
+        (*positive_vec)[bkt_id] += 1;
       } else {
-        info->negative_vec_[bkt_id] += 1;
+        (*negative_vec)[bkt_id] += 1;
       }
     }
   }
 
+  // Calculate the keys of exact AUC in one thread
+  static void auc_key_thread(const std::vector<real_t>* Y,
+                             const std::vector<real_t>* pred,
+                             std::vector<uint64>* keys,
+                             size_t start_idx,
+                             size_t end_idx) {
+    CHECK_GE(end_idx, start_idx);
+    for (size_t i = start_idx; i < end_idx; ++i) {
+      keys->push_back(auc_key((*Y)[i], (*pred)[i]));
+    }
+  }
+
   // Accumulate counters during the training.
   void Accumulate(const std::vector<real_t>& Y,
                   const std::vector<real_t>& pred) {
     CHECK_EQ(Y.size(), pred.size());
     // multi-thread
-    Info single_info;
-    std::vector<Info> info(threadNumber_, single_info);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(auc_accum_thread,
-                               &Y,
-                               &pred,
-                               &(info[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all thread finish their job
-    pool_->Sync(threadNumber_);
-    for (index_t i = 0; i < info.size(); ++i) {
-      for (index_t j = 0; j < kMaxBucketSize; ++j) {
-        all_positive_number_[j] += info[i].positive_vec_[j];
-        all_negative_number_[j] += info[i].negative_vec_[j];
+    // The buckets are big, so there is only one chunk for each
+    // thread, and the local buckets are reused by all the calls
+    size_t grain = std::max<size_t>(
+        (pred.size() + threadNumber_ - 1) / threadNumber_, kMinRows);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        Metric* local = AcquireLocal();
+        local->AccumulateRange(Y, pred, begin, end);
+        ReleaseLocal(local);
+      });
+    MergeLocals();
+  }
+
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    if (exact_) {
+      auc_key_thread(&Y, &pred, &keys_, begin, end);
+    } else {
+      // The buckets are allocated on the first use, so
+      // the empty local metrics do not take the memory
+      if (all_positive_number_.size() != bucket_size_) {
+        all_positive_number_.assign(bucket_size_, 0);
+        all_negative_number_.assign(bucket_size_, 0);
       }
-    } 
+      auc_accum_thread(&Y, &pred,
+                       &all_positive_number_,
+                       &all_negative_number_,
+                       begin, end);
+    }
+    num_example_ += end - begin;
+  }
+
+  Metric* NewLocal() {
+    AUCMetric* local = new AUCMetric();
+    local->exact_ = exact_;
+    local->bucket_size_ = bucket_size_;
+    return local;
+  }
+
+  // The empty local buckets are skipped.
+  void Merge(Metric* local) {
+    AUCMetric* other = static_cast<AUCMetric*>(local);
+    if (other->num_example_ == 0) { return; }
+    if (exact_) {
+      keys_.insert(keys_.end(), other->keys_.begin(), other->keys_.end());
+      other->keys_.clear();
+    } else {
+      if (all_positive_number_.size() != bucket_size_) {
+        all_positive_number_.assign(bucket_size_, 0);
+        all_negative_number_.assign(bucket_size_, 0);
+      }
+      for (index_t j = 0; j < bucket_size_; ++j) {
+        all_positive_number_[j] += other->all_positive_number_[j];
+        all_negative_number_[j] += other->all_negative_number_[j];
+        other->all_positive_number_[j] = 0;
+        other->all_negative_number_[j] = 0;
+      }
+    }
+    num_example_ += other->num_example_;
+    other->num_example_ = 0;
   }
   
   // Reset counters
   void Reset() {
-    all_positive_number_.clear();
-    all_negative_number_.clear();
-    all_positive_number_.resize(kMaxBucketSize, 0);
-    all_negative_number_.resize(kMaxBucketSize, 0);
+    if (exact_) {
+      keys_.clear();
+      all_positive_number_.clear();
+      all_negative_number_.clear();
+    } else {
+      all_positive_number_.assign(bucket_size_, 0);
+      all_negative_number_.assign(bucket_size_, 0);
+    }
+    num_example_ = 0;
+  }
+
+  // The positive buckets and then the negative buckets.
+  size_t StateSize() { return 2 * (size_t)bucket_size_; }
+
+  // The keys of the exact AUC are counted in the buckets.
+  void GetState(double* state) {
+    std::fill(state, state + StateSize(), 0);
+    if (exact_) {
+      for (size_t i = 0; i < keys_.size(); ++i) {
+        real_t pred = FloatFromSortKey(keys_[i] >> 1);
+        index_t bkt_id = auc_bucket(pred, bucket_size_);
+        state[(keys_[i] & 1) ? bkt_id : bucket_size_ + bkt_id] += 1;
+      }
+    } else if (all_positive_number_.size() == bucket_size_) {
+      for (index_t j = 0; j < bucket_size_; ++j) {
+        state[j] = all_positive_number_[j];
+        state[bucket_size_ + j] = all_negative_number_[j];
+      }
+    }
+  }
+
+  // The exact AUC is given by the buckets until Reset().
+  void SetState(const double* state) {
+    all_positive_number_.resize(bucket_size_);
+    all_negative_number_.resize(bucket_size_);
+    num_example_ = 0;
+    for (index_t j = 0; j < bucket_size_; ++j) {
+      all_positive_number_[j] = state[j];
+      all_negative_number_[j] = state[bucket_size_ + j];
+      num_example_ += all_positive_number_[j] + all_negative_number_[j];
+    }
+    keys_.clear();
   }
 
   // Return AUC
   real_t GetMetric() {
+    if (exact_ && all_positive_number_.empty()) {
+      return CalcExactAUC();
+    }
     return CalcAUC(all_positive_number_, 
                    all_negative_number_);
   }
@@ -563,11 +908,21 @@ class AUCMetric : public Metric {
   }
 
  protected:
+  /* Use the exact AUC */
+  bool exact_;
+  /* Number of the buckets */
+  index_t bucket_size_;
   std::vector<index_t> all_positive_number_;
   std::vector<index_t> all_negative_number_;
-
-  real_t CalcAUC(std::vector<index_t> positive_vec,
-                 std::vector<index_t> negative_vec) {
+  /* Keys of the exact AUC (see auc_key()) */
+  std::vector<uint64> keys_;
+  /* Buffer of the radix sort */
+  std::vector<uint64> sort_buffer_;
+  /* Number of the accumulated examples */
+  size_t num_example_;
+
+  real_t CalcAUC(const std::vector<index_t>& positive_vec,
+                 const std::vector<index_t>& negative_vec) {
     CHECK_EQ(positive_vec.size(), negative_vec.size());
     long long positive_sum = 0;
     long long negative_sum= 0;
@@ -575,22 +930,272 @@ class AUCMetric : public Metric {
     long long positivesum_dot_negativesum = 0;
     double auc = 0.0;
     double auc_res = 0.0;
-    for (index_t i = 0; i < kMaxBucketSize; ++i) {
+    for (size_t i = 0; i < positive_vec.size(); ++i) {
       pre_positive_sum = positive_sum;
-      positive_sum += all_positive_number_[i];
-      negative_sum += all_negative_number_[i];
+      positive_sum += positive_vec[i];
+      negative_sum += negative_vec[i];
       auc += (pre_positive_sum + positive_sum) * 
-             (double)(all_negative_number_[i]) * 1.0 / 2;
+             (double)(negative_vec[i]) * 1.0 / 2;
     }
     positivesum_dot_negativesum = positive_sum * negative_sum;
     auc_res = auc / (positivesum_dot_negativesum);
     return 1.0 - auc_res;
   }
 
+  // Sort the keys, and then each positive example counts the
+  // negative examples before it, where a tie counts as 0.5.
+  real_t CalcExactAUC() {
+    // 32 bits of the score and 1 bit of the label
+    RadixSort(&keys_, &sort_buffer_, 33, pool_);
+    long long negative_sum = 0;
+    long long positive_sum = 0;
+    double auc = 0.0;
+    size_t i = 0;
+    while (i < keys_.size()) {
+      uint64 score = keys_[i] >> 1;
+      long long neg = 0, pos = 0;
+      for (; i < keys_.size() && (keys_[i] >> 1) == score; ++i) {
+        if (keys_[i] & 1) { pos++; } else { neg++; }
+      }
+      auc += pos * (negative_sum + neg * 0.5);
+      negative_sum += neg;
+      positive_sum += pos;
+    }
+    return auc / (positive_sum * negative_sum);
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AUCMetric);
 };
 
+//------------------------------------------------------------------------------
+// GAUC (group AUC) is the average AUC of the groups (e.g., the users or
+// the queries), weighted by the number of examples of the group:
+//
+//   GAUC = sum(n_g * AUC_g) / sum(n_g)
+//
+// where the groups that have only positive or only negative examples
+// are skipped. The group ids are given by DMatrix::group (e.g., 'qid:3'
+// in the data), and all the rows are in group 0 if there is no group id,
+// so it is the same as the exact AUC. The (group, score, label) items
+// are kept in kNumShards shards by the hash of the group, so a group is
+// always in one shard, and GetMetric() sorts and scans the shards in
+// parallel without a global sort. It needs 16 bytes for each example.
+// The state is the sum of n_g * AUC_g and the sum of n_g, so the merged
+// GAUC is exact if each group is on one node (e.g., the data is split
+// by the users), and a group on several nodes counts as several groups.
+//------------------------------------------------------------------------------
+class GAUCMetric : public Metric {
+ public:
+  // Constructor and Destructor
+  GAUCMetric()
+   : shards_(kNumShards), num_example_(0), has_state_(false) { }
+  ~GAUCMetric() { }
+
+  // The key is given by AUCMetric::auc_key()
+  struct Item {
+    uint64 group;
+    uint64 key;
+    bool operator<(const Item& other) const {
+      return group != other.group ? group < other.group : key < other.key;
+    }
+  };
+
+  // Shard of the group, which is mixed by the
+  // finalizer of MurmurHash3.
+  static size_t shard_of(uint64 group) {
+    group ^= group >> 33;
+    group *= 0xff51afd7ed558ccdULL;
+    group ^= group >> 33;
+    return group & (kNumShards - 1);
+  }
+
+  // Add the items of [start_idx, end_idx) to the shards in one
+  // thread. All the rows are in group 0 if group is nullptr.
+  static void gauc_accum_thread(const std::vector<real_t>* Y,
+                                const std::vector<real_t>* pred,
+                                const std::vector<uint64>* group,
+                                std::vector<std::vector<Item> >* shards,
+                                size_t start_idx,
+                                size_t end_idx) {
+    CHECK_GE(end_idx, start_idx);
+    for (size_t i = start_idx; i < end_idx; ++i) {
+      Item item;
+      item.group = group == nullptr ? 0 : (*group)[i];
+      item.key = AUCMetric::auc_key((*Y)[i], (*pred)[i]);
+      (*shards)[shard_of(item.group)].push_back(item);
+    }
+  }
+
+  // Accumulate counters during the training.
+  void Accumulate(const std::vector<real_t>& Y,
+                  const std::vector<real_t>& pred) {
+    CHECK_EQ(Y.size(), pred.size());
+    size_t grain = std::max<size_t>(
+        (pred.size() + threadNumber_ - 1) / threadNumber_, kMinRows);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        Metric* local = AcquireLocal();
+        local->AccumulateRange(Y, pred, begin, end);
+        ReleaseLocal(local);
+      });
+    MergeLocals();
+  }
+
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    gauc_accum_thread(&Y, &pred, nullptr, &shards_, begin, end);
+    num_example_ += end - begin;
+  }
+
+  // The group ids are given by the matrix.
+  void AccumulateRows(const DMatrix* matrix,
+                      const std::vector<real_t>& pred,
+                      size_t begin,
+                      size_t end) {
+    const std::vector<uint64>* group =
+        matrix->HasGroup() ? &matrix->group : nullptr;
+    gauc_accum_thread(&matrix->Y, &pred, group, &shards_, begin, end);
+    num_example_ += end - begin;
+  }
+
+  Metric* NewLocal() { return new GAUCMetric(); }
+
+  // The local shards are cleared, which keep their capacity.
+  void Merge(Metric* local) {
+    GAUCMetric* other = static_cast<GAUCMetric*>(local);
+    if (other->num_example_ == 0) { return; }
+    for (size_t j = 0; j < kNumShards; ++j) {
+      std::vector<Item>& from = other->shards_[j];
+      shards_[j].insert(shards_[j].end(), from.begin(), from.end());
+      from.clear();
+    }
+    num_example_ += other->num_example_;
+    other->num_example_ = 0;
+  }
+
+  // Reset counters
+  void Reset() {
+    for (size_t j = 0; j < kNumShards; ++j) {
+      shards_[j].clear();
+    }
+    num_example_ = 0;
+    has_state_ = false;
+  }
+
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    if (has_state_) {
+      state[0] = state_[0];
+      state[1] = state_[1];
+    } else {
+      calc_groups(&state[0], &state[1]);
+    }
+  }
+
+  // The GAUC is given by the state until Reset().
+  void SetState(const double* state) {
+    for (size_t j = 0; j < kNumShards; ++j) {
+      shards_[j].clear();
+    }
+    state_[0] = state[0];
+    state_[1] = state[1];
+    has_state_ = true;
+  }
+
+  // Return GAUC
+  real_t GetMetric() {
+    double sum = 0, total = 0;
+    if (has_state_) {
+      sum = state_[0];
+      total = state_[1];
+    } else {
+      calc_groups(&sum, &total);
+    }
+    return total == 0 ? 0 : sum / total;
+  }
+
+  // Metric type
+  std::string metric_type() {
+    return "GAUC";
+  }
+
+  // Compare two metric value
+  bool cmp(const real_t a, const real_t b) {
+    return a >= b ? true : false;
+  }
+
+  static const size_t kNumShards = 256;
+
+ protected:
+  /* Items of the groups, split by shard_of() */
+  std::vector<std::vector<Item> > shards_;
+  /* Number of the accumulated examples */
+  size_t num_example_;
+  /* The state given by SetState() */
+  bool has_state_;
+  double state_[2];
+
+  // The sum of n_g * AUC_g and the sum of n_g of all the groups.
+  void calc_groups(double* auc_total, double* weight_total) {
+    std::vector<double> auc_sum(kNumShards, 0);
+    std::vector<double> weight(kNumShards, 0);
+    auto calc = [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; ++j) {
+        calc_shard(&shards_[j], &auc_sum[j], &weight[j]);
+      }
+    };
+    if (pool_ == nullptr) {
+      calc(0, kNumShards);
+    } else {
+      pool_->ParallelFor(0, kNumShards, 0, calc);
+    }
+    *auc_total = 0;
+    *weight_total = 0;
+    for (size_t j = 0; j < kNumShards; ++j) {
+      *auc_total += auc_sum[j];
+      *weight_total += weight[j];
+    }
+  }
+
+  // Sort the items of one shard by the group and then the score,
+  // and add n_g * AUC_g and n_g of each group to auc_sum and weight.
+  static void calc_shard(std::vector<Item>* shard,
+                         double* auc_sum,
+                         double* weight) {
+    std::sort(shard->begin(), shard->end());
+    size_t i = 0;
+    while (i < shard->size()) {
+      uint64 group = (*shard)[i].group;
+      long long negative_sum = 0;
+      long long positive_sum = 0;
+      double auc = 0.0;
+      while (i < shard->size() && (*shard)[i].group == group) {
+        uint64 score = (*shard)[i].key >> 1;
+        long long neg = 0, pos = 0;
+        for (; i < shard->size() && (*shard)[i].group == group &&
+               ((*shard)[i].key >> 1) == score; ++i) {
+          if ((*shard)[i].key & 1) { pos++; } else { neg++; }
+        }
+        auc += pos * (negative_sum + neg * 0.5);
+        negative_sum += neg;
+        positive_sum += pos;
+      }
+      if (positive_sum == 0 || negative_sum == 0) { continue; }
+      double n = positive_sum + negative_sum;
+      *auc_sum += n * auc / (positive_sum * negative_sum);
+      *weight += n;
+    }
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(GAUCMetric);
+};
+
  /*********************************************************
   *  For regression                                       *
   *********************************************************/
@@ -629,30 +1234,56 @@ class MAEMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<real_t> sum(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(mae_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<real_t> sum(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        mae_accum_thread(&Y, &pred, &sum[begin / grain], begin, end);
+      });
     for (size_t i = 0; i < sum.size(); ++i) {
       error_ += sum[i];
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    real_t error = 0;
+    mae_accum_thread(&Y, &pred, &error, begin, end);
+    total_example_ += end - begin;
+    error_ += error;
+  }
+
+  Metric* NewLocal() { return new MAEMetric(); }
+
+  void Merge(Metric* local) {
+    MAEMetric* other = static_cast<MAEMetric*>(local);
+    total_example_ += other->total_example_;
+    error_ += other->error_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     error_ = 0;
     total_example_ = 0;
   }
 
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    state[0] = error_;
+    state[1] = total_example_;
+  }
+
+  void SetState(const double* state) {
+    error_ = state[0];
+    total_example_ = state[1];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return error_ / total_example_;
@@ -708,30 +1339,56 @@ class MAPEMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<real_t> sum(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(mae_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<real_t> sum(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        mae_accum_thread(&Y, &pred, &sum[begin / grain], begin, end);
+      });
     for (size_t i = 0; i < sum.size(); ++i) {
       error_ += sum[i];
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    real_t error = 0;
+    mae_accum_thread(&Y, &pred, &error, begin, end);
+    total_example_ += end - begin;
+    error_ += error;
+  }
+
+  Metric* NewLocal() { return new MAPEMetric(); }
+
+  void Merge(Metric* local) {
+    MAPEMetric* other = static_cast<MAPEMetric*>(local);
+    total_example_ += other->total_example_;
+    error_ += other->error_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     error_ = 0;
     total_example_ = 0;
   }
 
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    state[0] = error_;
+    state[1] = total_example_;
+  }
+
+  void SetState(const double* state) {
+    error_ = state[0];
+    total_example_ = state[1];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return error_ / total_example_;
@@ -789,30 +1446,56 @@ class RMSDMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<real_t> sum(threadNumber_, 0);
-    for (int i = 0; i < threadNumber_; ++i) {
-      size_t start_idx = getStart(pred.size(), threadNumber_, i);
-      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-      pool_->enqueue(std::bind(rmsd_accum_thread,
-                               &Y,
-                               &pred,
-                               &(sum[i]),
-                               start_idx,
-                               end_idx));
-    }
-    // Wait all of the threads finish their job
-    pool_->Sync(threadNumber_);
+    size_t grain = pool_->Grain(pred.size(), 0, kMinRows);
+    size_t num_chunks = (pred.size() + grain - 1) / grain;
+    std::vector<real_t> sum(num_chunks, 0);
+    pool_->ParallelFor(0, pred.size(), grain,
+      [&](size_t begin, size_t end) {
+        rmsd_accum_thread(&Y, &pred, &sum[begin / grain], begin, end);
+      });
     for (size_t i = 0; i < sum.size(); ++i) {
       error_ += sum[i];
     }
   }
 
+  // Accumulate counters of [begin, end) in current thread.
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    real_t error = 0;
+    rmsd_accum_thread(&Y, &pred, &error, begin, end);
+    total_example_ += end - begin;
+    error_ += error;
+  }
+
+  Metric* NewLocal() { return new RMSDMetric(); }
+
+  void Merge(Metric* local) {
+    RMSDMetric* other = static_cast<RMSDMetric*>(local);
+    total_example_ += other->total_example_;
+    error_ += other->error_;
+    other->Reset();
+  }
+
   // Reset counters
   void Reset() {
     error_ = 0;
     total_example_ = 0;
   }
 
+  size_t StateSize() { return 2; }
+
+  void GetState(double* state) {
+    state[0] = error_;
+    state[1] = total_example_;
+  }
+
+  void SetState(const double* state) {
+    error_ = state[0];
+    total_example_ = state[1];
+  }
+
   // Return Accuracy
   real_t GetMetric() {
     return sqrt(error_ / total_example_);
@@ -836,6 +1519,130 @@ class RMSDMetric : public Metric {
   DISALLOW_COPY_AND_ASSIGN(RMSDMetric);
 };
 
+//------------------------------------------------------------------------------
+// MetricList evaluates several metrics (e.g., -x auc,acc,f1) by the same
+// predictions, so the validation data is predicted only once for all of
+// them. The rows are passed to each metric, and a local MetricList has
+// a local metric of each one. The first metric is the metric of the list
+// (GetMetric, metric_type and cmp), which is used by early-stopping,
+// and NumMetrics() and MetricAt() give all of them.
+//------------------------------------------------------------------------------
+class MetricList : public Metric {
+ public:
+  // Constructor and Destructor
+  MetricList() { }
+  ~MetricList() { }
+
+  // Add a metric, which is owned by the list.
+  void Add(Metric* metric) {
+    CHECK_NOTNULL(metric);
+    metrics_.emplace_back(metric);
+  }
+
+  void Initialize(ThreadPool* pool) {
+    Metric::Initialize(pool);
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->Initialize(pool);
+    }
+  }
+
+  void Accumulate(const std::vector<real_t>& Y,
+                  const std::vector<real_t>& pred) {
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->Accumulate(Y, pred);
+    }
+  }
+
+  void AccumulateRange(const std::vector<real_t>& Y,
+                       const std::vector<real_t>& pred,
+                       size_t begin,
+                       size_t end) {
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->AccumulateRange(Y, pred, begin, end);
+    }
+  }
+
+  void AccumulateRows(const DMatrix* matrix,
+                      const std::vector<real_t>& pred,
+                      size_t begin,
+                      size_t end) {
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->AccumulateRows(matrix, pred, begin, end);
+    }
+  }
+
+  Metric* NewLocal() {
+    MetricList* local = new MetricList;
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      local->Add(metrics_[i]->NewLocal());
+    }
+    return local;
+  }
+
+  void Merge(Metric* local) {
+    MetricList* other = static_cast<MetricList*>(local);
+    CHECK_EQ(other->metrics_.size(), metrics_.size());
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->Merge(other->metrics_[i].get());
+    }
+  }
+
+  void Reset() {
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->Reset();
+    }
+  }
+
+  // The states of the metrics one after another.
+  size_t StateSize() {
+    size_t size = 0;
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      size += metrics_[i]->StateSize();
+    }
+    return size;
+  }
+
+  void GetState(double* state) {
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->GetState(state);
+      state += metrics_[i]->StateSize();
+    }
+  }
+
+  void SetState(const double* state) {
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      metrics_[i]->SetState(state);
+      state += metrics_[i]->StateSize();
+    }
+  }
+
+  real_t GetMetric() { return metrics_[0]->GetMetric(); }
+
+  std::string metric_type() { return metrics_[0]->metric_type(); }
+
+  bool cmp(const real_t a, const real_t b) {
+    return metrics_[0]->cmp(a, b);
+  }
+
+  size_t NumMetrics() { return metrics_.size(); }
+
+  std::string MetricTypeAt(size_t i) {
+    CHECK_LT(i, metrics_.size());
+    return metrics_[i]->metric_type();
+  }
+
+  real_t MetricAt(size_t i) {
+    CHECK_LT(i, metrics_.size());
+    return metrics_[i]->GetMetric();
+  }
+
+ protected:
+  std::vector<std::unique_ptr<Metric>> metrics_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MetricList);
+};
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -179,6 +179,92 @@ TEST(AUCMetricTest, auc_test) {
   EXPECT_EQ(metric.metric_type(), "AUC");
 }
 
+TEST(AUCMetricTest, exact_auc_test) {
+  ThreadPool pool(4);
+  // Ties of the scores count as 0.5
+  std::vector<real_t> Y = {-1.0, 1.0, -1.0, 1.0, 1.0};
+  std::vector<real_t> pred = {-2.0, 0.5, 0.5, 3.0, -5.0};
+  AUCMetric metric;
+  metric.Initialize(&pool);
+  metric.SetExact(true);
+  EXPECT_TRUE(metric.IsExact());
+  metric.Accumulate(Y, pred);
+  // (1.5 + 2 + 0) / (3 * 2)
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 7.0 / 12);
+  // Many batches, compared with the pairs of all the examples
+  metric.Reset();
+  AUCMetric approx;
+  approx.Initialize(&pool);
+  approx.SetBucketSize(1 << 20);
+  EXPECT_EQ(approx.GetBucketSize(), 1 << 20);
+  std::vector<real_t> all_y, all_pred;
+  for (int b = 0; b < 5; ++b) {
+    Y.resize(1000);
+    pred.resize(1000);
+    for (size_t i = 0; i < Y.size(); ++i) {
+      int k = (b * 1000 + i) * 7919 % 10007;
+      pred[i] = (k % 4001) / 1000.0 - 2;
+      Y[i] = (k % 3 == 0 || pred[i] > 1) ? 1 : -1;
+    }
+    metric.Accumulate(Y, pred);
+    approx.Accumulate(Y, pred);
+    all_y.insert(all_y.end(), Y.begin(), Y.end());
+    all_pred.insert(all_pred.end(), pred.begin(), pred.end());
+  }
+  double auc = 0;
+  double num_pos = 0, num_neg = 0;
+  for (size_t i = 0; i < all_y.size(); ++i) {
+    if (all_y[i] <= 0) { num_neg++; continue; }
+    num_pos++;
+    for (size_t j = 0; j < all_y.size(); ++j) {
+      if (all_y[j] > 0) { continue; }
+      if (all_pred[i] > all_pred[j]) { auc += 1; }
+      if (all_pred[i] == all_pred[j]) { auc += 0.5; }
+    }
+  }
+  auc /= num_pos * num_neg;
+  EXPECT_NEAR(metric.GetMetric(), auc, 1e-6);
+  EXPECT_NEAR(approx.GetMetric(), auc, 1e-3);
+}
+
+TEST(GAUCMetricTest, gauc_test) {
+  ThreadPool pool(4);
+  GAUCMetric metric;
+  metric.Initialize(&pool);
+  // Group 1: AUC = 1, group 2: AUC = 0.5 (a tie),
+  // group 3 has no negative example
+  DMatrix matrix;
+  std::vector<real_t> pred;
+  real_t y[] = { 1, -1, -1, 1, -1, 1, 1 };
+  real_t p[] = { 0.9, 0.1, 0.3, 0.5, 0.5, 0.2, 0.7 };
+  uint64 g[] = { 1, 1, 1, 2, 2, 3, 3 };
+  for (int i = 0; i < 7; ++i) {
+    matrix.AddRow();
+    matrix.Y[i] = y[i];
+    matrix.SetGroup(i, g[i]);
+    pred.push_back(p[i]);
+  }
+  // Two chunks, which are merged
+  for (size_t begin = 0; begin < 7; begin += 4) {
+    Metric* local = metric.AcquireLocal();
+    local->AccumulateRows(&matrix, pred, begin, std::min<size_t>(begin + 4, 7));
+    metric.ReleaseLocal(local);
+  }
+  metric.MergeLocals();
+  // (3 * 1 + 2 * 0.5) / 5
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 0.8);
+  // Without the group ids, it is the AUC of all the rows
+  metric.Reset();
+  std::vector<real_t> Y(y, y + 7);
+  metric.Accumulate(Y, pred);
+  AUCMetric auc;
+  auc.Initialize(&pool);
+  auc.SetExact(true);
+  auc.Accumulate(Y, pred);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), auc.GetMetric());
+  EXPECT_EQ(metric.metric_type(), "GAUC");
+}
+
 TEST(MAEMetricTest, mae_test) {
   std::vector<real_t> Y;
   Y.push_back(12);
@@ -295,4 +381,173 @@ TEST(MetricTest, Create_Metric) {
   EXPECT_TRUE(CreateMetric("unknow_name") == NULL);
 }
 
+// The local metrics give the same value as Accumulate().
+TEST(MetricTest, Local_metric) {
+  std::vector<real_t> Y;
+  std::vector<real_t> pred;
+  for (int i = 0; i < 1000; ++i) {
+    Y.push_back(i % 3 == 0 ? -1.0 : 1.0);
+    pred.push_back((i % 7) * 0.1 - 0.3 + (Y[i] > 0 ? 0.1 : 0));
+  }
+  ThreadPool pool(4);
+  const char* names[8] = { "acc", "prec", "recall", "f1",
+                           "auc", "mae", "mape", "rmsd" };
+  for (int n = 0; n < 8; ++n) {
+    Metric* expect = CreateMetric(names[n]);
+    Metric* metric = CreateMetric(names[n]);
+    expect->Initialize(&pool);
+    metric->Initialize(&pool);
+    for (int batch = 0; batch < 2; ++batch) {
+      expect->Accumulate(Y, pred);
+      pool.ParallelFor(0, Y.size(), 7, [&](size_t begin, size_t end) {
+        Metric* local = metric->AcquireLocal();
+        local->AccumulateRange(Y, pred, begin, end);
+        metric->ReleaseLocal(local);
+      });
+    }
+    metric->MergeLocals();
+    EXPECT_NEAR(metric->GetMetric(), expect->GetMetric(), 1e-4);
+    // The local metrics are empty after the merge
+    metric->MergeLocals();
+    EXPECT_NEAR(metric->GetMetric(), expect->GetMetric(), 1e-4);
+    delete expect;
+    delete metric;
+  }
+}
+
+// The metrics of a list are the same as the ones of their own.
+TEST(MetricTest, Metric_list) {
+  std::vector<real_t> Y;
+  std::vector<real_t> pred;
+  for (int i = 0; i < 1000; ++i) {
+    Y.push_back(i % 3 == 0 ? -1.0 : 1.0);
+    pred.push_back((i % 7) * 0.1 - 0.3 + (Y[i] > 0 ? 0.1 : 0));
+  }
+  ThreadPool pool(4);
+  const char* names[3] = { "auc", "acc", "f1" };
+  MetricList list;
+  std::vector<Metric*> expect;
+  for (int n = 0; n < 3; ++n) {
+    list.Add(CreateMetric(names[n]));
+    expect.push_back(CreateMetric(names[n]));
+    expect[n]->Initialize(&pool);
+    expect[n]->Accumulate(Y, pred);
+  }
+  list.Initialize(&pool);
+  pool.ParallelFor(0, Y.size(), 7, [&](size_t begin, size_t end) {
+    Metric* local = list.AcquireLocal();
+    local->AccumulateRange(Y, pred, begin, end);
+    list.ReleaseLocal(local);
+  });
+  list.MergeLocals();
+  ASSERT_EQ(list.NumMetrics(), 3);
+  for (int n = 0; n < 3; ++n) {
+    EXPECT_EQ(list.MetricTypeAt(n), expect[n]->metric_type());
+    EXPECT_NEAR(list.MetricAt(n), expect[n]->GetMetric(), 1e-4);
+  }
+  // The first metric is the one of the list
+  EXPECT_EQ(list.metric_type(), "AUC");
+  EXPECT_NEAR(list.GetMetric(), expect[0]->GetMetric(), 1e-4);
+  EXPECT_TRUE(list.cmp(0.8, 0.7));
+  for (int n = 0; n < 3; ++n) { delete expect[n]; }
+}
+
+// The sum of the states of two halves of the data (e.g., of two
+// nodes) gives the metric of the whole data.
+TEST(MetricTest, Merge_state) {
+  std::vector<real_t> Y;
+  std::vector<real_t> pred;
+  for (int i = 0; i < 1000; ++i) {
+    Y.push_back(i % 3 == 0 ? -1.0 : 1.0);
+    pred.push_back((i % 7) * 0.1 - 0.3 + (Y[i] > 0 ? 0.1 : 0));
+  }
+  std::vector<real_t> Y_1(Y.begin(), Y.begin() + 400);
+  std::vector<real_t> Y_2(Y.begin() + 400, Y.end());
+  std::vector<real_t> pred_1(pred.begin(), pred.begin() + 400);
+  std::vector<real_t> pred_2(pred.begin() + 400, pred.end());
+  ThreadPool pool(4);
+  const char* names[8] = { "acc", "prec", "recall", "f1",
+                           "auc", "mae", "mape", "rmsd" };
+  for (int n = 0; n < 9; ++n) {
+    // The last one is the exact AUC, whose state is the buckets
+    const char* name = n < 8 ? names[n] : "auc";
+    Metric* expect = CreateMetric(name);
+    Metric* node_1 = CreateMetric(name);
+    Metric* node_2 = CreateMetric(name);
+    expect->Initialize(&pool);
+    node_1->Initialize(&pool);
+    node_2->Initialize(&pool);
+    if (n == 8) {
+      static_cast<AUCMetric*>(expect)->SetExact(true);
+      static_cast<AUCMetric*>(node_1)->SetExact(true);
+      static_cast<AUCMetric*>(node_2)->SetExact(true);
+    }
+    expect->Accumulate(Y, pred);
+    node_1->Accumulate(Y_1, pred_1);
+    node_2->Accumulate(Y_2, pred_2);
+    ASSERT_EQ(node_1->StateSize(), expect->StateSize());
+    std::vector<double> state(node_1->StateSize());
+    std::vector<double> other(node_2->StateSize());
+    node_1->GetState(state.data());
+    node_2->GetState(other.data());
+    for (size_t j = 0; j < state.size(); ++j) { state[j] += other[j]; }
+    node_1->SetState(state.data());
+    EXPECT_NEAR(node_1->GetMetric(), expect->GetMetric(), 1e-4);
+    delete expect;
+    delete node_1;
+    delete node_2;
+  }
+  // The states of a list are one after another
+  MetricList list;
+  list.Add(CreateMetric("acc"));
+  list.Add(CreateMetric("rmsd"));
+  list.Initialize(&pool);
+  list.Accumulate(Y, pred);
+  EXPECT_EQ(list.StateSize(), 4);
+  std::vector<double> state(list.StateSize());
+  list.GetState(state.data());
+  EXPECT_EQ(state[0], 1000);
+  EXPECT_EQ(state[3], 1000);
+  list.SetState(state.data());
+  real_t acc = list.MetricAt(0);
+  for (size_t j = 0; j < state.size(); ++j) { state[j] *= 2; }
+  list.SetState(state.data());
+  EXPECT_FLOAT_EQ(list.MetricAt(0), acc);
+}
+
+// The groups of GAUC on different nodes are merged exactly.
+TEST(GAUCMetricTest, merge_state) {
+  ThreadPool pool(4);
+  real_t y[] = { 1, -1, -1, 1, -1, 1, 1 };
+  real_t p[] = { 0.9, 0.1, 0.3, 0.5, 0.5, 0.2, 0.7 };
+  uint64 g[] = { 1, 1, 1, 2, 2, 3, 3 };
+  // Group 1 on the first node, and groups 2 and 3 on the second one
+  std::vector<double> state(2, 0);
+  for (int node = 0; node < 2; ++node) {
+    GAUCMetric metric;
+    metric.Initialize(&pool);
+    DMatrix matrix;
+    std::vector<real_t> pred;
+    for (int i = 0; i < 7; ++i) {
+      if ((g[i] == 1) != (node == 0)) { continue; }
+      matrix.AddRow();
+      matrix.Y[pred.size()] = y[i];
+      matrix.SetGroup(pred.size(), g[i]);
+      pred.push_back(p[i]);
+    }
+    metric.AccumulateRows(&matrix, pred, 0, pred.size());
+    std::vector<double> local(metric.StateSize());
+    metric.GetState(local.data());
+    state[0] += local[0];
+    state[1] += local[1];
+  }
+  GAUCMetric merged;
+  merged.Initialize(&pool);
+  merged.SetState(state.data());
+  // (3 * 1 + 2 * 0.5) / 5
+  EXPECT_FLOAT_EQ(merged.GetMetric(), 0.8);
+  merged.Reset();
+  EXPECT_FLOAT_EQ(merged.GetMetric(), 0);
+}
+
 }  // namespace xLearn
@@ -56,48 +56,90 @@ void SquaredLoss::Evaluate(const std::vector<real_t>& pred,
   CHECK_NE(label.empty(), true);
   total_example_ += pred.size();
   // multi-thread training
-  std::vector<real_t> sum(threadNumber_, 0);
-  for (int i = 0; i < threadNumber_; ++i) {
-    size_t start_idx = getStart(pred.size(), threadNumber_, i);
-    size_t end_idx = getEnd(pred.size(), threadNumber_, i);
-    pool_->enqueue(std::bind(sq_evaluate_thread,
-                             &pred,
-                             &label,
-                             &(sum[i]),
-                             start_idx,
-                             end_idx));
-  }
-  // Wait all of the threads finish their job
-  pool_->Sync(threadNumber_);
+  size_t grain = pool_->Grain(pred.size(), 0, kMinEvalRows);
+  std::vector<real_t> sum((pred.size() + grain - 1) / grain, 0);
+  pool_->ParallelFor(0, pred.size(), grain,
+    [&](size_t begin, size_t end) {
+      sq_evaluate_thread(&pred, &label, &sum[begin / grain], begin, end);
+    });
   // Accumulate loss
   for (size_t i = 0; i < sum.size(); ++i) {
     loss_sum_ += sum[i];
   }
 }
 
-// Calculate gradient in one thread
+// Calculate loss of [begin, end) in current thread.
+real_t SquaredLoss::EvaluateRange(const std::vector<real_t>& pred,
+                                  const std::vector<real_t>& label,
+                                  size_t begin,
+                                  size_t end) {
+  real_t sum = 0;
+  sq_evaluate_thread(&pred, &label, &sum, begin, end);
+  return sum;
+}
+
+// partial gradient: -error
+static real_t sq_partial_grad(real_t pred, real_t y) {
+  return pred - y;
+}
+
+// Calculate gradient in one thread by the labels of the task.
+// With the buffer and grad_batch 0, the gradients are left in the
+// buffer for the owners of the features (see calc_grad_owner).
 void sq_gradient_thread(const DMatrix* matrix,
+                        index_t task,
                         Model* model,
                         Score* score_func,
                         bool is_norm,
                         real_t* sum,
+                        size_t prefetch,
+                        StripedLock* lock,
+                        GradBuffer* buf,
+                        index_t grad_batch,
+                        std::vector<real_t>* train_pred,
                         index_t start,
                         index_t end) {
   CHECK_GE(end, start);
-  *sum = 0;
+  // The copy of the model on the NUMA node of current thread,
+  // which is trained by the threads of the node
+  model = model->GetReplica(CurrentNumaNode());
+  // The sums of the chunks are next to each other, so
+  // the loss is accumulated in a local variable
+  real_t loss = 0;
+  bool is_local = model->IsLocal();
+  if (is_local) { model->BeginLocal(); }
   for (size_t i = start; i < end; ++i) {
+    if (prefetch > 0 && i + prefetch < end) {
+      score_func->Prefetch(matrix->row[i+prefetch], *model);
+    }
     SparseRow* row = matrix->row[i];
+    RowLock row_lock(lock, row);
+    if (model->IsLazy()) { model->Touch(row); }
+    if (model->IsLazyRegu()) { model->LazyRegu(row); }
+    if (model->IsTracked()) { model->MarkDirty(row); }
     real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    real_t pred = score_func->CalcScore(row, *model, norm);
+    real_t y = matrix->Label(i, task);
+    // score, real gradient and update
+    real_t pred = buf == nullptr ?
+        score_func->CalcScoreAndGrad(row, *model, y,
+                                     sq_partial_grad, norm) :
+        score_func->CalcScoreAndBatchGrad(row, *model, y,
+                                          sq_partial_grad, norm, buf);
     // loss
-    real_t error = matrix->Y[i] - pred;
-    *sum += (error*error);
-    // partial gradient: -error
-    real_t pg = pred - matrix->Y[i];
-    // real gradient and update
-    score_func->CalcGrad(row, *model, pg, norm);
+    real_t error = y - pred;
+    loss += (error*error);
+    if (train_pred != nullptr) { (*train_pred)[i] = pred; }
+    if (buf != nullptr && grad_batch > 0 && buf->rows >= grad_batch) {
+      score_func->ApplyGrad(*model, buf);
+    }
+    if (is_local) { model->LocalStep(); }
   }
-  *sum *= 0.5;
+  // The rest of the chunk is updated before the merge
+  if (buf != nullptr && grad_batch > 0) {
+    score_func->ApplyGrad(*model, buf);
+  }
+  if (is_local) { model->EndLocal(); }
+  *sum = loss * 0.5;
 }
 
 //------------------------------------------------------------------------------
@@ -119,26 +161,64 @@ void SquaredLoss::CalcGrad(const DMatrix* matrix,
   CHECK_GT(matrix->row_length, 0);
   size_t row_len = matrix->row_length;
   total_example_ += row_len;
-  int count = lock_free_ ? threadNumber_ : 1;
-  std::vector<real_t> sum(count, 0);
-  for (int i = 0; i < count; ++i) {
-    size_t start = getStart(row_len, count, i);
-    size_t end = getEnd(row_len, count, i);
-    pool_->enqueue(std::bind(sq_gradient_thread,
-                             matrix,
-                             &model,
-                             score_func_,
-                             norm_,
-                             &(sum[i]),
-                             start,
-                             end));
+  model.ChooseHotFeatures(matrix);
+  // The predictions are kept for the training metric
+  std::vector<real_t>* train_pred = nullptr;
+  if (train_metric_ != nullptr) {
+    train_pred_.resize(row_len);
+    train_pred = &train_pred_;
+  }
+  // The gradients are applied by the owners of the features
+  if (owner_rows_ > 0) {
+    loss_sum_ += calc_grad_owner(matrix, model,
+      [&](GradBuffer* buf, size_t begin, size_t end) {
+        real_t sum = 0;
+        sq_gradient_thread(matrix, 0, &model, score_func_, norm_, &sum,
+                           prefetch_distance_, nullptr, buf, 0,
+                           train_pred, begin, end);
+        if (train_pred != nullptr) {
+          Metric* local = train_metric_->AcquireLocal();
+          local->AccumulateRows(matrix, *train_pred, begin, end);
+          train_metric_->ReleaseLocal(local);
+        }
+        return sum;
+      });
+    return;
   }
-  // Wait all of the threads finish their job
-  pool_->Sync(count);
+  std::vector<size_t> bounds;
+  SplitRows(matrix, model, &bounds);
+  std::vector<real_t> sum(bounds.size() - 1, 0);
+  pool_->ParallelFor(bounds,
+    [&](size_t begin, size_t end) {
+      sq_gradient_thread(matrix, 0, &model, score_func_, norm_,
+                         &sum[chunk_index(bounds, begin)],
+                         prefetch_distance_,
+                         row_lock_.get(), grad_buffer(), grad_batch_,
+                         train_pred, begin, end);
+      if (train_pred != nullptr) {
+        Metric* local = train_metric_->AcquireLocal();
+        local->AccumulateRows(matrix, *train_pred, begin, end);
+        train_metric_->ReleaseLocal(local);
+      }
+    });
   // Accumulate loss
   for (int i = 0; i < sum.size(); ++i) {
     loss_sum_ += sum[i];
   }
 }
 
+// Train the rows of the task in current thread
+real_t SquaredLoss::calc_grad_range(const DMatrix* matrix,
+                                    index_t task,
+                                    Model& model,
+                                    std::vector<real_t>* train_pred,
+                                    size_t begin,
+                                    size_t end) {
+  real_t sum = 0;
+  sq_gradient_thread(matrix, task, &model, score_func_, norm_, &sum,
+                     prefetch_distance_, row_lock_.get(), grad_buffer(),
+                     grad_batch_, train_pred, begin, end);
+  return sum;
+}
+
 } // namespace xLearn
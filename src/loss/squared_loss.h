@@ -41,6 +41,12 @@ class SquaredLoss : public Loss {
   void Evaluate(const std::vector<real_t>& pred,
                  const std::vector<real_t>& label);
 
+  // Return the loss sum of [begin, end).
+  real_t EvaluateRange(const std::vector<real_t>& pred,
+                       const std::vector<real_t>& label,
+                       size_t begin,
+                       size_t end);
+
   // Given data sample and current model, calculate gradient
   // and update current model parameters.
   // This function will also accumulate the loss value.
@@ -49,6 +55,15 @@ class SquaredLoss : public Loss {
   // Return current loss type
   std::string loss_type() { return "mse_loss"; }
 
+ protected:
+  // Train the rows [begin, end) of the task in current thread.
+  real_t calc_grad_range(const DMatrix* matrix,
+                         index_t task,
+                         Model& model,
+                         std::vector<real_t>* train_pred,
+                         size_t begin,
+                         size_t end);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SquaredLoss);
 };
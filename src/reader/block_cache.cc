@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the BlockCache class.
+*/
+
+#include "src/reader/block_cache.h"
+
+namespace xLearn {
+
+// The key of the blocks whose next use is not known, which
+// are used after all the blocks of the known order.
+static const uint64 kUnknownKey = kUInt64Max;
+
+void BlockCache::SetBudget(uint64 bytes) {
+  budget_ = bytes;
+  while (bytes_ > budget_) { drop_last(); }
+}
+
+// The kept blocks are not used in this pass yet
+void BlockCache::StartPass(const std::vector<size_t>& rank,
+                           const std::vector<size_t>& next_rank) {
+  rank_ = rank;
+  next_rank_ = next_rank;
+  keys_.clear();
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    it->second.key = it->first < rank_.size() ?
+                     rank_[it->first] : kUnknownKey;
+    keys_.insert(std::make_pair(it->second.key, it->first));
+  }
+}
+
+// The block is used again in the next pass, after
+// all the blocks of this pass
+uint64 BlockCache::used_key(size_t block_id) const {
+  if (block_id >= next_rank_.size()) { return kUnknownKey; }
+  return (uint64)rank_.size() + next_rank_[block_id];
+}
+
+const std::string* BlockCache::Get(size_t block_id) {
+  auto it = blocks_.find(block_id);
+  if (it == blocks_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  keys_.erase(std::make_pair(it->second.key, block_id));
+  it->second.key = used_key(block_id);
+  keys_.insert(std::make_pair(it->second.key, block_id));
+  return &it->second.data;
+}
+
+bool BlockCache::Wanted(size_t block_id) const {
+  if (budget_ == 0 || Has(block_id)) { return false; }
+  if (keys_.empty()) { return true; }
+  // Then it is still full without the blocks used later
+  return bytes_ < budget_ || used_key(block_id) < keys_.rbegin()->first;
+}
+
+bool BlockCache::Put(size_t block_id, const std::string& data) {
+  if (!Wanted(block_id) || data.size() > budget_) { return false; }
+  uint64 key = used_key(block_id);
+  // Drop the blocks used later, until the new block fits
+  while (bytes_ + data.size() > budget_) {
+    if (keys_.empty() || keys_.rbegin()->first <= key) { return false; }
+    drop_last();
+  }
+  Entry& entry = blocks_[block_id];
+  entry.data = data;
+  entry.key = key;
+  keys_.insert(std::make_pair(key, block_id));
+  bytes_ += data.size();
+  return true;
+}
+
+void BlockCache::drop_last() {
+  CHECK(!keys_.empty());
+  auto last = --keys_.end();
+  auto it = blocks_.find(last->second);
+  CHECK(it != blocks_.end());
+  bytes_ -= it->second.data.size();
+  blocks_.erase(it);
+  keys_.erase(last);
+}
+
+void BlockCache::Clear() {
+  blocks_.clear();
+  keys_.clear();
+  bytes_ = 0;
+}
+
+}  // namespace xLearn
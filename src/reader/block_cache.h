@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the BlockCache class, which keeps the parsed
+blocks of the on-disk reader in memory.
+*/
+
+#ifndef XLEARN_READER_BLOCK_CACHE_H_
+#define XLEARN_READER_BLOCK_CACHE_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// BlockCache keeps the serialized blocks (see DMatrix::Serialize) of the
+// on-disk reader up to a budget of bytes, so the blocks in the cache are
+// neither read nor parsed again by the next passes, and the other blocks
+// are read from the txt file or the binary cache:
+//
+//   BlockCache cache;
+//   cache.SetBudget(1024 * 1024 * 1024);
+//   cache.StartPass(rank, next_rank);  /* at the start of each pass */
+//   const std::string* data = cache.Get(block_id);
+//   if (data != nullptr) {
+//     matrix->Deserialize(data->data(), data->size());
+//   } else {
+//     ... read the block ...
+//     if (cache.Wanted(block_id)) { cache.Put(block_id, buffer); }
+//   }
+//
+// Each pass reads every block once, so the least recently used block is
+// the next one to read, and an LRU cache smaller than the data would miss
+// every block. As the order of the blocks is given by the shuffle of the
+// reader, the cache knows when each block is used again: the blocks not
+// used in current pass are used at their rank of this pass, and the used
+// blocks at their rank of the next pass. So the cache drops the block
+// used last (which can be the new block itself), which is the optimal
+// policy for the known order. The blocks in order of file (no shuffle)
+// are kept from the head of file. In the first pass, where the number of
+// the blocks is not known yet, the blocks are kept until it is full.
+//
+// It is not thread-safe, and the reader uses it in its loader thread.
+//------------------------------------------------------------------------------
+class BlockCache {
+ public:
+  BlockCache() { }
+  ~BlockCache() { }
+
+  // Set the budget of the cache in bytes, and 0 disables it.
+  // The blocks are dropped until they fit in the budget.
+  void SetBudget(uint64 bytes);
+
+  // If the blocks can be kept.
+  bool Enabled() const { return budget_ > 0; }
+
+  // Start a new pass, where rank[b] is the position of block b in the
+  // order of this pass, and next_rank[b] is that of the next pass.
+  // Both are empty if the number of the blocks is not known yet.
+  void StartPass(const std::vector<size_t>& rank,
+                 const std::vector<size_t>& next_rank);
+
+  // Get the block, which is used in current pass. Return nullptr
+  // if it is not kept. The data is valid until the next Put().
+  const std::string* Get(size_t block_id);
+
+  // If the cache can keep the block that is just used in current
+  // pass, maybe by dropping the blocks that are used later. Then
+  // the caller serializes the block for Put().
+  bool Wanted(size_t block_id) const;
+
+  // Keep the data of the block that is just used in current pass.
+  // Return false if it does not fit in the budget.
+  bool Put(size_t block_id, const std::string& data);
+
+  // If the block is kept.
+  bool Has(size_t block_id) const {
+    return blocks_.find(block_id) != blocks_.end();
+  }
+
+  // Drop all the blocks.
+  void Clear();
+
+  // Number of the blocks in the cache.
+  size_t Size() const { return blocks_.size(); }
+
+  // Bytes of the blocks in the cache.
+  uint64 Bytes() const { return bytes_; }
+
+  // Number of the blocks given by Get() and not given by it.
+  uint64 Hits() const { return hits_; }
+  uint64 Misses() const { return misses_; }
+
+ protected:
+  /* A block in the cache, which is used again at the key */
+  struct Entry {
+    std::string data;
+    uint64 key;
+  };
+
+  /* Budget of the cache in bytes */
+  uint64 budget_ = 0;
+  /* Bytes of the blocks in the cache */
+  uint64 bytes_ = 0;
+  /* The blocks in the cache */
+  std::map<size_t, Entry> blocks_;
+  /* The keys and the ids of the blocks, where the last
+  one is used again last */
+  std::set<std::pair<uint64, size_t> > keys_;
+  /* The ranks of StartPass() */
+  std::vector<size_t> rank_;
+  std::vector<size_t> next_rank_;
+  /* Statistics of Get() */
+  uint64 hits_ = 0;
+  uint64 misses_ = 0;
+
+  // The key of the block used in current pass.
+  uint64 used_key(size_t block_id) const;
+
+  // Drop the block that is used again last.
+  void drop_last();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockCache);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_BLOCK_CACHE_H_
@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the block_cache.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/reader/block_cache.h"
+
+namespace xLearn {
+
+// The ranks of the blocks in the given order.
+static std::vector<size_t> get_rank(const std::vector<size_t>& order) {
+  std::vector<size_t> rank(order.size());
+  for (size_t i = 0; i < order.size(); ++i) { rank[order[i]] = i; }
+  return rank;
+}
+
+// Read the blocks of a pass in the order, and put the missed ones.
+static size_t read_pass(BlockCache* cache,
+                        const std::vector<size_t>& order) {
+  size_t hits = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    const std::string* data = cache->Get(order[i]);
+    if (data != nullptr) {
+      EXPECT_EQ(*data, std::string(10, 'a' + order[i]));
+      hits++;
+    } else if (cache->Wanted(order[i])) {
+      cache->Put(order[i], std::string(10, 'a' + order[i]));
+    }
+  }
+  return hits;
+}
+
+TEST(BlockCacheTest, Disabled) {
+  BlockCache cache;
+  EXPECT_FALSE(cache.Enabled());
+  EXPECT_FALSE(cache.Wanted(0));
+  EXPECT_FALSE(cache.Put(0, "block"));
+  EXPECT_EQ(cache.Get(0), nullptr);
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+// The blocks in order of file are kept from the head of file,
+// where an LRU cache would miss every block.
+TEST(BlockCacheTest, InOrder) {
+  BlockCache cache;
+  cache.SetBudget(30);
+  std::vector<size_t> order = { 0, 1, 2, 3, 4, 5 };
+  // The first pass does not know the number of the blocks
+  cache.StartPass(std::vector<size_t>(), std::vector<size_t>());
+  EXPECT_EQ(read_pass(&cache, order), 0);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_EQ(cache.Bytes(), 30);
+  for (int pass = 0; pass < 3; ++pass) {
+    cache.StartPass(get_rank(order), get_rank(order));
+    EXPECT_EQ(read_pass(&cache, order), 3);
+    EXPECT_TRUE(cache.Has(0));
+    EXPECT_TRUE(cache.Has(1));
+    EXPECT_TRUE(cache.Has(2));
+  }
+  EXPECT_EQ(cache.Hits(), 9);
+  // A smaller budget drops the blocks used last
+  cache.SetBudget(15);
+  EXPECT_EQ(cache.Size(), 1);
+  EXPECT_TRUE(cache.Has(0));
+  EXPECT_FALSE(cache.Put(1, std::string(20, 'b')));
+}
+
+// The cache keeps the blocks that the next pass uses first.
+TEST(BlockCacheTest, Shuffle) {
+  BlockCache cache;
+  cache.SetBudget(20);
+  std::vector<size_t> first = { 0, 1, 2, 3 };
+  std::vector<size_t> second = { 3, 1, 0, 2 };
+  std::vector<size_t> third = { 2, 0, 3, 1 };
+  cache.StartPass(get_rank(first), get_rank(second));
+  EXPECT_EQ(read_pass(&cache, first), 0);
+  EXPECT_TRUE(cache.Has(3));
+  EXPECT_TRUE(cache.Has(1));
+  cache.StartPass(get_rank(second), get_rank(third));
+  EXPECT_EQ(read_pass(&cache, second), 2);
+  EXPECT_TRUE(cache.Has(2));
+  EXPECT_TRUE(cache.Has(0));
+  cache.StartPass(get_rank(third), get_rank(first));
+  EXPECT_EQ(read_pass(&cache, third), 2);
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+  EXPECT_EQ(cache.Bytes(), 0);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,340 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of columnar.h.
+*/
+
+#include "src/reader/columnar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/format_print.h"
+#include "src/base/stringprintf.h"
+#include "src/reader/parser.h"
+
+#ifdef XLEARN_USE_PARQUET
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <parquet/arrow/reader.h>
+#endif
+
+namespace xLearn {
+
+void AppendColumns(const ColumnBatch& batch,
+                   int hash_bits,
+                   DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(batch.offsets);
+  for (size_t r = 0; r < batch.num_rows; ++r) {
+    matrix->AddRow();
+    index_t i = matrix->row_length - 1;
+    // Add Y, which is -2 for predict task
+    matrix->Y[i] = batch.label != nullptr ? batch.label[r] : -2;
+    if (batch.group != nullptr) {
+      matrix->SetGroup(i, batch.group[r]);
+    }
+    // Add features
+    real_t norm = 0.0;
+    for (uint64 k = batch.offsets[r]; k < batch.offsets[r+1]; ++k) {
+      uint64 id = batch.id[k];
+      uint64 field = batch.field != nullptr ? batch.field[k] : 0;
+      if ((hash_bits == 0 && id > 0xffffffffULL) || field > 0xffffffffULL) {
+        LOG(FATAL) << "The feature id " << id << " (field " << field
+                   << ") is too large. Please check the data.";
+      }
+      index_t feat_id = hash_bits == 0 ? (index_t)id :
+                        HashFeature(id, hash_bits);
+      real_t value = batch.value != nullptr ? batch.value[k] : 1.0;
+      matrix->AddNode(i, feat_id, value, (index_t)field);
+      norm += value*value;
+    }
+    norm = 1.0f / norm;
+    matrix->norm[i] = norm;
+  }
+}
+
+bool IsParquetFile(const std::string& filename) {
+  if (IsStreamFile(filename)) { return false; }
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) { return false; }
+  char magic[4] = { 0, 0, 0, 0 };
+  size_t len = fread(magic, 1, sizeof(magic), file);
+  fclose(file);
+  return len == 4 && memcmp(magic, "PAR1", 4) == 0;
+}
+
+bool ParquetSupported() {
+#ifdef XLEARN_USE_PARQUET
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef XLEARN_USE_PARQUET
+
+// The columns of the file that are read by xLearn.
+static const char* const kColumns[] = {
+  "label", "id", "field", "value", "group"
+};
+
+// Exit with the error given by Arrow.
+static void arrow_error(const std::string& filename,
+                        const arrow::Status& status) {
+  Color::print_error(
+    StringPrintf("Cannot read the Parquet file %s: %s",
+                 filename.c_str(), status.ToString().c_str())
+  );
+  exit(0);
+}
+
+// Exit if the column has a wrong type.
+static void column_error(const std::string& filename,
+                         const char* column) {
+  Color::print_error(
+    StringPrintf("The column '%s' of the Parquet file %s has a wrong "
+                 "type or null values. Please check the data.",
+                 column, filename.c_str())
+  );
+  exit(0);
+}
+
+static std::unique_ptr<parquet::arrow::FileReader> open_parquet(
+    const std::string& filename) {
+  auto file = arrow::io::ReadableFile::Open(filename);
+  if (!file.ok()) { arrow_error(filename, file.status()); }
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  arrow::Status status = parquet::arrow::OpenFile(
+      *file, arrow::default_memory_pool(), &reader);
+  if (!status.ok()) { arrow_error(filename, status); }
+  return reader;
+}
+
+// The number of leaf columns of the type in the Parquet file,
+// which are used to choose the columns of a row group.
+static int count_leaves(const arrow::DataType& type) {
+  if (type.num_fields() == 0) { return 1; }
+  int num_leaves = 0;
+  for (int i = 0; i < type.num_fields(); ++i) {
+    num_leaves += count_leaves(*type.field(i)->type());
+  }
+  return num_leaves;
+}
+
+// Copy the numbers [begin, end) of the array, which can be any integer
+// or floating-point type. Return false for other types or null values.
+template <typename T>
+static bool copy_numbers(const arrow::Array& array,
+                         int64_t begin,
+                         int64_t end,
+                         std::vector<T>* out) {
+  if (array.null_count() > 0) { return false; }
+  out->resize(end - begin);
+  switch (array.type_id()) {
+#define XLEARN_COPY_NUMBERS(type_id, array_type)                      \
+    case arrow::Type::type_id: {                                      \
+      const auto& a = static_cast<const arrow::array_type&>(array);   \
+      for (int64_t i = begin; i < end; ++i) {                         \
+        (*out)[i - begin] = (T)a.Value(i);                            \
+      }                                                               \
+      return true;                                                    \
+    }
+    XLEARN_COPY_NUMBERS(INT8, Int8Array)
+    XLEARN_COPY_NUMBERS(INT16, Int16Array)
+    XLEARN_COPY_NUMBERS(INT32, Int32Array)
+    XLEARN_COPY_NUMBERS(INT64, Int64Array)
+    XLEARN_COPY_NUMBERS(UINT8, UInt8Array)
+    XLEARN_COPY_NUMBERS(UINT16, UInt16Array)
+    XLEARN_COPY_NUMBERS(UINT32, UInt32Array)
+    XLEARN_COPY_NUMBERS(UINT64, UInt64Array)
+    XLEARN_COPY_NUMBERS(FLOAT, FloatArray)
+    XLEARN_COPY_NUMBERS(DOUBLE, DoubleArray)
+#undef XLEARN_COPY_NUMBERS
+    default:
+      return false;
+  }
+}
+
+// Copy a list column, where offsets starts from 0.
+template <typename T, typename ListArray>
+static bool copy_list_array(const ListArray& list,
+                            std::vector<uint64>* offsets,
+                            std::vector<T>* values) {
+  int64_t base = list.value_offset(0);
+  offsets->resize(list.length() + 1);
+  for (int64_t i = 0; i <= list.length(); ++i) {
+    (*offsets)[i] = list.value_offset(i) - base;
+  }
+  return copy_numbers(*list.values(), base,
+                      list.value_offset(list.length()), values);
+}
+
+template <typename T>
+static bool copy_list(const arrow::Array& array,
+                      std::vector<uint64>* offsets,
+                      std::vector<T>* values) {
+  if (array.null_count() > 0) { return false; }
+  if (array.type_id() == arrow::Type::LIST) {
+    return copy_list_array(static_cast<const arrow::ListArray&>(array),
+                           offsets, values);
+  }
+  if (array.type_id() == arrow::Type::LARGE_LIST) {
+    return copy_list_array(
+        static_cast<const arrow::LargeListArray&>(array), offsets, values);
+  }
+  return false;
+}
+
+// Read a row group, which is appended to the matrix.
+static void read_row_group(parquet::arrow::FileReader* reader,
+                           const std::string& filename,
+                           int row_group,
+                           const std::vector<int>& leaves,
+                           int hash_bits,
+                           DMatrix* matrix) {
+  std::shared_ptr<arrow::Table> table;
+  arrow::Status status = reader->ReadRowGroup(row_group, leaves, &table);
+  if (!status.ok()) { arrow_error(filename, status); }
+  if (table->num_rows() == 0) { return; }
+  // One chunk for each column
+  auto combined = table->CombineChunks();
+  if (!combined.ok()) { arrow_error(filename, combined.status()); }
+  table = *combined;
+  auto column = [&](const char* name) -> const arrow::Array* {
+    std::shared_ptr<arrow::ChunkedArray> c = table->GetColumnByName(name);
+    return c == nullptr ? nullptr : c->chunk(0).get();
+  };
+  ColumnBatch batch;
+  batch.num_rows = table->num_rows();
+  std::vector<real_t> label, value;
+  std::vector<uint64> offsets, id, group, field, field_offsets,
+                      value_offsets;
+  if (!copy_list(*column("id"), &offsets, &id)) {
+    column_error(filename, "id");
+  }
+  batch.offsets = offsets.data();
+  batch.id = id.data();
+  if (column("label") != nullptr) {
+    if (!copy_numbers(*column("label"), 0, batch.num_rows, &label)) {
+      column_error(filename, "label");
+    }
+    batch.label = label.data();
+  }
+  // The field and value lists have the same size as the id list
+  if (column("field") != nullptr) {
+    if (!copy_list(*column("field"), &field_offsets, &field) ||
+        field_offsets != offsets) {
+      column_error(filename, "field");
+    }
+    batch.field = field.data();
+  }
+  if (column("value") != nullptr) {
+    if (!copy_list(*column("value"), &value_offsets, &value) ||
+        value_offsets != offsets) {
+      column_error(filename, "value");
+    }
+    batch.value = value.data();
+  }
+  if (column("group") != nullptr) {
+    if (!copy_numbers(*column("group"), 0, batch.num_rows, &group)) {
+      column_error(filename, "group");
+    }
+    batch.group = group.data();
+  }
+  AppendColumns(batch, hash_bits, matrix);
+}
+
+void ReadParquet(const std::string& filename,
+                 int hash_bits,
+                 ThreadPool* pool,
+                 DMatrix* matrix,
+                 bool* has_label) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(has_label);
+  std::unique_ptr<parquet::arrow::FileReader> reader =
+      open_parquet(filename);
+  std::shared_ptr<arrow::Schema> schema;
+  arrow::Status status = reader->GetSchema(&schema);
+  if (!status.ok()) { arrow_error(filename, status); }
+  if (schema->GetFieldByName("id") == nullptr) {
+    Color::print_error(
+      StringPrintf("The Parquet file %s has no 'id' column.",
+                   filename.c_str())
+    );
+    exit(0);
+  }
+  *has_label = schema->GetFieldByName("label") != nullptr;
+  // Only the leaf columns of xLearn are read
+  std::vector<int> leaves;
+  int leaf = 0;
+  for (int i = 0; i < schema->num_fields(); ++i) {
+    const std::string& name = schema->field(i)->name();
+    int num_leaves = count_leaves(*schema->field(i)->type());
+    for (size_t c = 0; c < sizeof(kColumns) / sizeof(kColumns[0]); ++c) {
+      if (name == kColumns[c]) {
+        for (int k = 0; k < num_leaves; ++k) {
+          leaves.push_back(leaf + k);
+        }
+      }
+    }
+    leaf += num_leaves;
+  }
+  // The row groups are read in parallel, and each thread opens
+  // its own file, because the FileReader is not thread-safe.
+  size_t num_groups = reader->num_row_groups();
+  std::vector<DMatrix> chunks(num_groups);
+  auto read_groups = [&](size_t begin, size_t end) {
+    std::unique_ptr<parquet::arrow::FileReader> group_reader =
+        open_parquet(filename);
+    for (size_t g = begin; g < end; ++g) {
+      read_row_group(group_reader.get(), filename, g,
+                     leaves, hash_bits, &chunks[g]);
+    }
+  };
+  if (pool != nullptr && num_groups > 1) {
+    pool->ParallelFor(0, num_groups, 1, read_groups);
+  } else if (num_groups > 0) {
+    read_groups(0, num_groups);
+  }
+  for (size_t g = 0; g < num_groups; ++g) {
+    matrix->Append(&chunks[g]);
+  }
+}
+
+#else
+
+void ReadParquet(const std::string& filename,
+                 int hash_bits,
+                 ThreadPool* pool,
+                 DMatrix* matrix,
+                 bool* has_label) {
+  Color::print_error(
+    StringPrintf("xLearn is built without Apache Arrow, and the "
+                 "Parquet file %s cannot be read.", filename.c_str())
+  );
+  exit(0);
+}
+
+#endif  // XLEARN_USE_PARQUET
+
+}  // namespace xLearn
@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the functions that read the columnar
+data (e.g., the Parquet files) into the DMatrix.
+*/
+
+#ifndef XLEARN_READER_COLUMNAR_H_
+#define XLEARN_READER_COLUMNAR_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// A Parquet file of xLearn has the following columns, where each row
+// is a sample, and the list columns give the features of the sample:
+//
+//   label: number                 (optional, not needed by prediction)
+//   id:    list<integer>          (the feature ids)
+//   field: list<integer>          (optional, the field ids of ffm)
+//   value: list<number>           (optional, the values are 1 by default)
+//   group: integer                (optional, the query id of ranking)
+//
+// Only these columns are read from the file, and then the other columns
+// of a feature store are skipped. The row groups of the file are read
+// and converted in parallel by the thread pool:
+//
+//   DMatrix matrix;
+//   bool has_label = false;
+//   ReadParquet("data.parquet", hash_bits, pool, &matrix, &has_label);
+//
+// The Parquet files need Apache Arrow, which is used if cmake finds
+// it (then XLEARN_USE_PARQUET is defined).
+//------------------------------------------------------------------------------
+
+// A batch of rows in the columns, which is the same as the layout
+// of the Arrow arrays, that is, the features of row i are
+// in [offsets[i], offsets[i+1]) of the id, field and value.
+struct ColumnBatch {
+  size_t num_rows = 0;
+  /* Label of each row, or nullptr */
+  const real_t* label = nullptr;
+  /* num_rows + 1 offsets of the features */
+  const uint64* offsets = nullptr;
+  /* The feature ids */
+  const uint64* id = nullptr;
+  /* The field ids, or nullptr */
+  const uint64* field = nullptr;
+  /* The feature values, or nullptr */
+  const real_t* value = nullptr;
+  /* Group id of each row, or nullptr */
+  const uint64* group = nullptr;
+};
+
+// Append the rows of the batch to the matrix. The feature ids
+// are hashed if hash_bits > 0 (see HashFeature in parser.h).
+void AppendColumns(const ColumnBatch& batch,
+                   int hash_bits,
+                   DMatrix* matrix);
+
+// If the file starts with the magic number of Parquet.
+bool IsParquetFile(const std::string& filename);
+
+// If xLearn can read the Parquet files.
+bool ParquetSupported();
+
+// Read all the rows of the Parquet file to the matrix. Exit
+// if the file or its columns cannot be read.
+void ReadParquet(const std::string& filename,
+                 int hash_bits,
+                 ThreadPool* pool,
+                 DMatrix* matrix,
+                 bool* has_label);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_COLUMNAR_H_
@@ -0,0 +1,138 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the columnar.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/reader/columnar.h"
+#include "src/reader/parser.h"
+
+using std::string;
+using std::vector;
+
+namespace xLearn {
+
+const string kTestfilename = "./test_columnar";
+
+// Three rows with 2, 0 and 3 features
+const vector<uint64> kOffsets = { 0, 2, 2, 5 };
+const vector<uint64> kId = { 1, 7, 3, 4, 5 };
+const vector<uint64> kField = { 0, 1, 2, 2, 0 };
+const vector<real_t> kValue = { 0.5, 2.0, 1.0, 3.0, 4.0 };
+const vector<real_t> kLabel = { 1, 0, 1 };
+
+void check_row(const DMatrix& matrix, index_t i,
+               const vector<Node>& expect) {
+  SparseRow* row = matrix.row[i];
+  if (expect.empty()) {
+    EXPECT_TRUE(row == nullptr || row->empty());
+    return;
+  }
+  ASSERT_TRUE(row != nullptr);
+  ASSERT_EQ(row->size(), expect.size());
+  for (size_t k = 0; k < expect.size(); ++k) {
+    EXPECT_EQ((*row)[k].feat_id, expect[k].feat_id);
+    EXPECT_EQ((*row)[k].field_id, expect[k].field_id);
+    EXPECT_FLOAT_EQ((*row)[k].feat_val, expect[k].feat_val);
+  }
+}
+
+TEST(ColumnarTest, AppendColumns) {
+  ColumnBatch batch;
+  batch.num_rows = 3;
+  batch.offsets = kOffsets.data();
+  batch.id = kId.data();
+  batch.field = kField.data();
+  batch.value = kValue.data();
+  batch.label = kLabel.data();
+  DMatrix matrix;
+  AppendColumns(batch, 0, &matrix);
+  ASSERT_EQ(matrix.row_length, 3);
+  EXPECT_FALSE(matrix.HasGroup());
+  for (index_t i = 0; i < 3; ++i) {
+    EXPECT_FLOAT_EQ(matrix.Y[i], kLabel[i]);
+  }
+  check_row(matrix, 0, { Node(0, 1, 0.5), Node(1, 7, 2.0) });
+  check_row(matrix, 1, { });
+  check_row(matrix, 2, { Node(2, 3, 1.0), Node(2, 4, 3.0),
+                         Node(0, 5, 4.0) });
+  EXPECT_FLOAT_EQ(matrix.norm[0], 1.0 / (0.25 + 4.0));
+  EXPECT_FLOAT_EQ(matrix.norm[2], 1.0 / (1.0 + 9.0 + 16.0));
+  // The batch is appended
+  AppendColumns(batch, 0, &matrix);
+  ASSERT_EQ(matrix.row_length, 6);
+  check_row(matrix, 5, { Node(2, 3, 1.0), Node(2, 4, 3.0),
+                         Node(0, 5, 4.0) });
+}
+
+// Only the id column is given
+TEST(ColumnarTest, AppendColumns_ids) {
+  vector<uint64> group = { 9, 9, 10 };
+  ColumnBatch batch;
+  batch.num_rows = 3;
+  batch.offsets = kOffsets.data();
+  batch.id = kId.data();
+  batch.group = group.data();
+  DMatrix matrix;
+  AppendColumns(batch, 0, &matrix);
+  ASSERT_EQ(matrix.row_length, 3);
+  for (index_t i = 0; i < 3; ++i) {
+    // No label for prediction
+    EXPECT_FLOAT_EQ(matrix.Y[i], -2);
+    EXPECT_EQ(matrix.group[i], group[i]);
+  }
+  check_row(matrix, 0, { Node(0, 1, 1.0), Node(0, 7, 1.0) });
+  check_row(matrix, 2, { Node(0, 3, 1.0), Node(0, 4, 1.0),
+                         Node(0, 5, 1.0) });
+}
+
+// The ids are hashed the same as the parser
+TEST(ColumnarTest, AppendColumns_hash) {
+  vector<uint64> offsets = { 0, 2 };
+  vector<uint64> id = { 1ULL << 40, 12 };
+  ColumnBatch batch;
+  batch.num_rows = 1;
+  batch.offsets = offsets.data();
+  batch.id = id.data();
+  DMatrix matrix;
+  AppendColumns(batch, 20, &matrix);
+  check_row(matrix, 0, { Node(0, HashFeature(id[0], 20), 1.0),
+                         Node(0, HashFeature(id[1], 20), 1.0) });
+}
+
+TEST(ColumnarTest, IsParquetFile) {
+  string filename = kTestfilename + ".parquet";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, "PAR1\x15\x04", 6);
+  Close(file);
+  EXPECT_TRUE(IsParquetFile(filename));
+  file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, "1 1:2\n", 6);
+  Close(file);
+  EXPECT_FALSE(IsParquetFile(filename));
+  RemoveFile(filename.c_str());
+  EXPECT_FALSE(IsParquetFile(filename));
+  EXPECT_FALSE(IsParquetFile(kStdinFile));
+}
+
+}  // namespace xLearn
@@ -0,0 +1,261 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of Decompressor.
+*/
+
+#include "src/reader/decompressor.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifndef _MSC_VER
+#include <signal.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/mmap_file.h"
+
+#ifdef XLEARN_USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace xLearn {
+
+const size_t Decompressor::kBatchMembers;
+
+bool Decompressor::Supported() {
+#ifdef XLEARN_USE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef XLEARN_USE_ZLIB
+
+// Return the size of the BGZF member at the head of [p, p + size),
+// which is given by the BSIZE of the 'BC' extra subfield, or 0 if it
+// is not a BGZF member.
+static size_t bgzf_member_size(const unsigned char* p, size_t size) {
+  // ID1, ID2, CM = deflate, FLG = FEXTRA, and XLEN
+  if (size < 12 || p[0] != 0x1f || p[1] != 0x8b ||
+      p[2] != 8 || (p[3] & 4) == 0) {
+    return 0;
+  }
+  size_t xlen = p[10] | (p[11] << 8);
+  if (12 + xlen > size) { return 0; }
+  const unsigned char* extra = p + 12;
+  for (size_t i = 0; i + 4 <= xlen; ) {
+    size_t slen = extra[i+2] | (extra[i+3] << 8);
+    if (extra[i] == 'B' && extra[i+1] == 'C' && slen == 2 &&
+        i + 6 <= xlen) {
+      size_t bsize = (extra[i+4] | (extra[i+5] << 8)) + 1;
+      return bsize <= size && bsize >= 12 + xlen + 8 ? bsize : 0;
+    }
+    i += 4 + slen;
+  }
+  return 0;
+}
+
+// Inflate a BGZF member to out, whose size is given by the ISIZE
+// at the end of member. Return false if the member is broken.
+static bool inflate_member(const char* data, size_t size,
+                           std::vector<char>* out) {
+  const unsigned char* tail = (const unsigned char*)data + size - 4;
+  uint32 isize = tail[0] | (tail[1] << 8) | (tail[2] << 16) |
+                 ((uint32)tail[3] << 24);
+  // One more byte to find the longer output
+  out->resize(isize + 1);
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  // 16 + MAX_WBITS for the gzip header and trailer
+  if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) { return false; }
+  strm.next_in = (Bytef*)data;
+  strm.avail_in = size;
+  strm.next_out = (Bytef*)out->data();
+  strm.avail_out = out->size();
+  int ret = inflate(&strm, Z_FINISH);
+  bool ok = ret == Z_STREAM_END && strm.total_out == isize &&
+            strm.avail_in == 0;
+  inflateEnd(&strm);
+  out->resize(isize);
+  return ok;
+}
+
+FILE* Decompressor::Open(const std::string& filename, ThreadPool* pool) {
+  Close();
+  if (GetCompression(filename) != "gzip") { return nullptr; }
+  filename_ = filename;
+  pool_ = pool;
+  // Check the first member of BGZF
+  MappedFile map;
+  if (!map.Map(filename)) { return nullptr; }
+  bgzf_ = bgzf_member_size((const unsigned char*)map.data(),
+                           map.size()) > 0;
+  map.Unmap();
+  int fds[2];
+#ifndef _MSC_VER
+  if (pipe(fds) != 0) {
+    LOG(FATAL) << "Cannot create the pipe: " << strerror(errno);
+  }
+  // The write() to a closed pipe returns EPIPE instead
+  signal(SIGPIPE, SIG_IGN);
+  file_ = fdopen(fds[0], "r");
+#else
+  if (_pipe(fds, 1 << 20, _O_BINARY) != 0) {
+    LOG(FATAL) << "Cannot create the pipe: " << strerror(errno);
+  }
+  file_ = _fdopen(fds[0], "rb");
+#endif
+  CHECK_NOTNULL(file_);
+  write_fd_ = fds[1];
+  if (bgzf_) {
+    thread_ = std::thread(&Decompressor::decompress_bgzf, this);
+  } else {
+    thread_ = std::thread(&Decompressor::decompress_gzip, this);
+  }
+  return file_;
+}
+
+void Decompressor::Close() {
+  if (file_ == nullptr) { return; }
+  // The thread stops at the next write
+  fclose(file_);
+  file_ = nullptr;
+  thread_.join();
+}
+
+bool Decompressor::write_pipe(const char* data, size_t size) {
+  while (size > 0) {
+#ifndef _MSC_VER
+    ssize_t ret = write(write_fd_, data, size);
+#else
+    int ret = _write(write_fd_, data, (unsigned int)size);
+#endif
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    data += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+void Decompressor::decompress_gzip() {
+  gzFile file = gzopen(filename_.c_str(), "rb");
+  if (file == nullptr) {
+    LOG(FATAL) << "Cannot open the gzip file " << filename_;
+  }
+  gzbuffer(file, 1 << 20);
+  std::vector<char> buffer(1 << 20);
+  for (;;) {
+    int ret = gzread(file, buffer.data(), buffer.size());
+    if (ret < 0) {
+      int err = 0;
+      LOG(FATAL) << "Fail to decompress " << filename_ << ": "
+                 << gzerror(file, &err);
+    }
+    if (ret == 0 || !write_pipe(buffer.data(), ret)) { break; }
+  }
+  gzclose(file);
+#ifndef _MSC_VER
+  close(write_fd_);
+#else
+  _close(write_fd_);
+#endif
+}
+
+void Decompressor::decompress_bgzf() {
+  MappedFile map;
+  if (!map.Map(filename_)) {
+    LOG(FATAL) << "Cannot map the gzip file " << filename_;
+  }
+  map.Advise(MappedFile::kSequential);
+  const char* data = map.data();
+  uint64 size = map.size();
+  uint64 pos = 0;
+  std::vector<std::pair<uint64, size_t> > members;
+  std::vector<std::vector<char> > outputs(kBatchMembers);
+  std::vector<char> failed(kBatchMembers);
+  bool closed = false;
+  while (pos < size && !closed) {
+    // The next batch of members
+    members.clear();
+    while (pos < size && members.size() < kBatchMembers) {
+      size_t len = bgzf_member_size((const unsigned char*)data + pos,
+                                    size - pos);
+      if (len == 0) {
+        LOG(FATAL) << "Broken BGZF member at " << pos
+                   << " of " << filename_;
+      }
+      members.push_back(std::make_pair(pos, len));
+      pos += len;
+    }
+    auto inflate_range = [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        failed[i] = !inflate_member(data + members[i].first,
+                                    members[i].second, &outputs[i]);
+      }
+    };
+    if (pool_ != nullptr) {
+      pool_->ParallelFor(0, members.size(), 1, inflate_range);
+    } else {
+      inflate_range(0, members.size());
+    }
+    for (size_t i = 0; i < members.size() && !closed; ++i) {
+      if (failed[i]) {
+        LOG(FATAL) << "Fail to decompress the BGZF member at "
+                   << members[i].first << " of " << filename_;
+      }
+      closed = !write_pipe(outputs[i].data(), outputs[i].size());
+    }
+  }
+  map.Unmap();
+#ifndef _MSC_VER
+  close(write_fd_);
+#else
+  _close(write_fd_);
+#endif
+}
+
+#else  // not XLEARN_USE_ZLIB
+
+FILE* Decompressor::Open(const std::string& filename, ThreadPool* pool) {
+  return nullptr;
+}
+
+void Decompressor::Close() { }
+
+bool Decompressor::write_pipe(const char* data, size_t size) {
+  return false;
+}
+
+void Decompressor::decompress_gzip() { }
+
+void Decompressor::decompress_bgzf() { }
+
+#endif  // XLEARN_USE_ZLIB
+
+}  // namespace xLearn
@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the Decompressor class, which reads the
+compressed input files (e.g., data.txt.gz) for the readers.
+*/
+
+#ifndef XLEARN_READER_DECOMPRESSOR_H_
+#define XLEARN_READER_DECOMPRESSOR_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <thread>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Decompressor decompresses a gzip file in its own thread, which writes
+// the text to a pipe, and the reader reads the text from the other end
+// of the pipe like a stream (it cannot seek), so the decompression runs
+// at the same time as the parsing of the blocks:
+//
+//   Decompressor decompressor;
+//   FILE* file = decompressor.Open("data.txt.gz", pool);
+//   if (file == nullptr) { ... not supported ... }
+//   ... ReadDataFromDisk(file, block, size) ...
+//   decompressor.Close();
+//
+// A BGZF file (e.g., given by bgzip) is a list of small gzip members,
+// and the size of each member is in its header. So the members are
+// decompressed in parallel by the thread pool, kBatchMembers at a time,
+// and they are written to the pipe in order. The other gzip files are
+// decompressed by one thread.
+//
+// The gzip files need zlib, which is used if cmake finds it (then
+// XLEARN_USE_ZLIB is defined). The zstd files are not supported.
+//------------------------------------------------------------------------------
+class Decompressor {
+ public:
+  // Constructor and Destructor
+  Decompressor() { }
+  ~Decompressor() { Close(); }
+
+  // Start to decompress the file. Return the file of the text, or
+  // nullptr if the file is not a gzip file or it is not supported.
+  FILE* Open(const std::string& filename, ThreadPool* pool = nullptr);
+
+  // Stop the decompression, and close the file given by Open().
+  void Close();
+
+  // If the file given by Open() is decompressed in parallel.
+  bool IsBgzf() const { return bgzf_; }
+
+  // If xLearn can decompress the gzip files.
+  static bool Supported();
+
+  static const size_t kBatchMembers = 64;
+
+ protected:
+  /* The gzip file */
+  std::string filename_;
+  /* Thread pool for the BGZF members */
+  ThreadPool* pool_ = nullptr;
+  /* The read end of the pipe */
+  FILE* file_ = nullptr;
+  /* The write end of the pipe */
+  int write_fd_ = -1;
+  /* The decompression thread */
+  std::thread thread_;
+  /* If the file is a BGZF file */
+  bool bgzf_ = false;
+
+  // Decompress the gzip file in current thread.
+  void decompress_gzip();
+
+  // Decompress the members of BGZF file in parallel.
+  void decompress_bgzf();
+
+  // Write the data to the pipe. Return false if
+  // the reader has closed the pipe.
+  bool write_pipe(const char* data, size_t size);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Decompressor);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_DECOMPRESSOR_H_
@@ -0,0 +1,191 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the decompressor.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef XLEARN_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
+#include "src/reader/decompressor.h"
+
+using std::string;
+
+namespace xLearn {
+
+const string kTestfilename = "./test_decompressor";
+
+// The text of about 2 MB
+string make_text() {
+  string text;
+  for (int i = 0; i < 100000; ++i) {
+    text += StringPrintf("%d 1:0.5 %d:0.25\n", i % 2, i);
+  }
+  return text;
+}
+
+// Read all the text of the file
+string read_all(FILE* file) {
+  string text;
+  char buf[4096];
+  size_t ret;
+  while ((ret = ReadDataFromDisk(file, buf, sizeof(buf))) > 0) {
+    text.append(buf, ret);
+  }
+  return text;
+}
+
+TEST(DecompressorTest, Compression) {
+  string filename = kTestfilename + ".magic";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, "\x1f\x8b\x08\x00", 4);
+  Close(file);
+  EXPECT_EQ(GetCompression(filename), string("gzip"));
+  file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, "\x28\xb5\x2f\xfd", 4);
+  Close(file);
+  EXPECT_EQ(GetCompression(filename), string("zstd"));
+  file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, "1 1:2\n", 6);
+  Close(file);
+  EXPECT_EQ(GetCompression(filename), string(""));
+  // The text file is not decompressed
+  Decompressor decompressor;
+  EXPECT_TRUE(decompressor.Open(filename) == nullptr);
+  RemoveFile(filename.c_str());
+}
+
+#ifdef XLEARN_USE_ZLIB
+
+// Write the text by gzwrite()
+void write_gzip(const string& filename, const string& text) {
+  gzFile gz = gzopen(filename.c_str(), "wb");
+  ASSERT_TRUE(gz != nullptr);
+  EXPECT_EQ(gzwrite(gz, text.data(), text.size()), (int)text.size());
+  gzclose(gz);
+}
+
+// Write the text as the BGZF members of 64 KB, and an empty
+// member at the end, which is the same as bgzip.
+void write_bgzf(const string& filename, const string& text) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+  const size_t kChunk = 60 * 1024;
+  size_t pos = 0;
+  do {
+    size_t size = std::min(kChunk, text.size() - pos);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    ASSERT_EQ(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           15 + 16, 8, Z_DEFAULT_STRATEGY), Z_OK);
+    // The 'BC' subfield keeps the size of the member - 1
+    unsigned char extra[6] = { 'B', 'C', 2, 0, 0, 0 };
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    header.extra = extra;
+    header.extra_len = sizeof(extra);
+    header.os = 255;
+    ASSERT_EQ(deflateSetHeader(&zs, &header), Z_OK);
+    std::vector<unsigned char> out(deflateBound(&zs, size) + 64);
+    zs.next_in = (Bytef*)text.data() + pos;
+    zs.avail_in = size;
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    ASSERT_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+    size_t member = zs.total_out;
+    deflateEnd(&zs);
+    ASSERT_LE(member, 65536);
+    out[16] = (member - 1) & 0xff;
+    out[17] = (member - 1) >> 8;
+    WriteDataToDisk(file, (char*)out.data(), member);
+    pos += size;
+  } while (pos < text.size());
+  // The end of the file
+  static const unsigned char kEof[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 0x42, 0x43,
+    0x02, 0, 0x1b, 0, 0x03, 0, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+  WriteDataToDisk(file, (char*)kEof, sizeof(kEof));
+  Close(file);
+}
+
+TEST(DecompressorTest, Gzip) {
+  EXPECT_TRUE(Decompressor::Supported());
+  string filename = kTestfilename + ".gz";
+  string text = make_text();
+  write_gzip(filename, text);
+  EXPECT_EQ(GetCompression(filename), string("gzip"));
+  Decompressor decompressor;
+  FILE* file = decompressor.Open(filename);
+  ASSERT_TRUE(file != nullptr);
+  EXPECT_FALSE(decompressor.IsBgzf());
+  EXPECT_EQ(read_all(file), text);
+  decompressor.Close();
+  // Open again
+  file = decompressor.Open(filename);
+  ASSERT_TRUE(file != nullptr);
+  EXPECT_EQ(read_all(file), text);
+  decompressor.Close();
+  RemoveFile(filename.c_str());
+}
+
+TEST(DecompressorTest, Bgzf) {
+  string filename = kTestfilename + ".bgz";
+  string text = make_text();
+  write_bgzf(filename, text);
+  ThreadPool pool(4);
+  for (int t = 0; t < 2; ++t) {
+    Decompressor decompressor;
+    FILE* file = decompressor.Open(filename, t == 0 ? &pool : nullptr);
+    ASSERT_TRUE(file != nullptr);
+    EXPECT_TRUE(decompressor.IsBgzf());
+    EXPECT_EQ(read_all(file), text);
+    decompressor.Close();
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The reader stops before the end of file
+TEST(DecompressorTest, CloseEarly) {
+  string filename = kTestfilename + ".bgz";
+  string text = make_text();
+  write_bgzf(filename, text);
+  ThreadPool pool(4);
+  Decompressor decompressor;
+  FILE* file = decompressor.Open(filename, &pool);
+  ASSERT_TRUE(file != nullptr);
+  char buf[100];
+  EXPECT_EQ(ReadDataFromDisk(file, buf, sizeof(buf)), sizeof(buf));
+  EXPECT_EQ(string(buf, sizeof(buf)), text.substr(0, sizeof(buf)));
+  decompressor.Close();
+  RemoveFile(filename.c_str());
+}
+
+#endif  // XLEARN_USE_ZLIB
+
+}  // namespace xLearn
@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the PackedRows class.
+*/
+
+#include "src/reader/packed_rows.h"
+
+#include <algorithm>
+
+namespace xLearn {
+
+// A slice of Unpack() has at least these rows, so
+// a small batch is not split over all the threads.
+static const size_t kMinSliceRows = 256;
+
+// The rows are encoded in the chunks of kRowsPerChunk rows, whose
+// offsets are given from the start of the chunk first, and then the
+// chunks are appended to bytes_ one after another.
+void PackedRows::Pack(const DMatrix& matrix, ThreadPool* pool) {
+  Clear();
+  const size_t kRowsPerChunk = DMatrix::kRowsPerChunk;
+  size_t num_row = matrix.row_length;
+  size_t num_chunk = (num_row + kRowsPerChunk - 1) / kRowsPerChunk;
+  std::vector<std::vector<char>> chunks(num_chunk);
+  offset_.assign(num_row + 1, 0);
+  auto encode = [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; ++c) {
+      size_t last = std::min((c + 1) * kRowsPerChunk, num_row);
+      for (size_t i = c * kRowsPerChunk; i < last; ++i) {
+        DMatrix::EncodeRow(matrix.row[i], &chunks[c]);
+        offset_[i + 1] = chunks[c].size();
+      }
+    }
+  };
+  if (pool == nullptr || num_chunk < 2) {
+    encode(0, num_chunk);
+  } else {
+    pool->ParallelFor(0, num_chunk, 1, encode);
+  }
+  uint64 total = 0;
+  for (size_t c = 0; c < num_chunk; ++c) { total += chunks[c].size(); }
+  bytes_.reserve(total);
+  for (size_t c = 0; c < num_chunk; ++c) {
+    uint64 base = bytes_.size();
+    size_t last = std::min((c + 1) * kRowsPerChunk, num_row);
+    for (size_t i = c * kRowsPerChunk; i < last; ++i) {
+      offset_[i + 1] += base;
+    }
+    bytes_.insert(bytes_.end(), chunks[c].begin(), chunks[c].end());
+    std::vector<char>().swap(chunks[c]);
+  }
+}
+
+void PackedRows::Unpack(const index_t* ids, size_t n,
+                        SparseRow** rows, ThreadPool* pool) {
+  size_t num_slice = pool == nullptr ? 1 : pool->ThreadNumber();
+  num_slice = std::max((size_t)1, std::min(num_slice, n / kMinSliceRows));
+  if (num_arena_ < num_slice) {
+    arenas_.reset(new RowArena[num_slice]);
+    num_arena_ = num_slice;
+  }
+  size_t num_row = Rows();
+  auto decode = [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; ++s) {
+      RowArena* arena = &arenas_[s];
+      arena->Rewind();
+      size_t last = n * (s + 1) / num_slice;
+      for (size_t i = n * s / num_slice; i < last; ++i) {
+        CHECK_LT(ids[i], num_row);
+        const char* row_begin = bytes_.data() + offset_[ids[i]];
+        const char* row_end = bytes_.data() + offset_[ids[i] + 1];
+        CHECK_EQ(DMatrix::DecodeRow(row_begin, row_end, arena, &rows[i]),
+                 row_end);
+      }
+    }
+  };
+  if (num_slice == 1) {
+    decode(0, 1);
+  } else {
+    pool->ParallelFor(0, num_slice, 1, decode);
+  }
+}
+
+void PackedRows::Clear() {
+  std::vector<char>().swap(bytes_);
+  std::vector<uint64>().swap(offset_);
+  arenas_.reset();
+  num_arena_ = 0;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the PackedRows class, which keeps the rows of the
+in-memory reader compressed.
+*/
+
+#ifndef XLEARN_READER_PACKED_ROWS_H_
+#define XLEARN_READER_PACKED_ROWS_H_
+
+#include <memory>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// PackedRows keeps the rows of a DMatrix compressed in memory in the
+// format of the binary file (see DMatrix::EncodeRow), i.e., the ZigZag
+// deltas of the feature ids and the field ids are varints, and the
+// values are dropped if they are all 1.0. So a node of the one-hot
+// features takes 2 ~ 4 bytes instead of sizeof(Node) = 12, and a row
+// has 8 bytes of its offset instead of its SparseRow and pointer. The
+// rows are decoded by a batch at a time, in any order (e.g., the
+// shuffled order of the pass), to the arenas of the packed rows:
+//
+//   PackedRows packed;
+//   packed.Pack(matrix, pool);
+//   matrix.Reset();  /* the rows are not needed any more */
+//   packed.Unpack(ids, n, rows, pool);  /* rows[i] is the row ids[i] */
+//
+// The threads of the pool decode a slice of the batch each to its own
+// arena, which keeps its memory for the next batch, so the decoded rows
+// are just a batch of memory. They are valid until the next Unpack().
+//------------------------------------------------------------------------------
+class PackedRows {
+ public:
+  PackedRows() { }
+  ~PackedRows() { }
+
+  // Compress the rows of the matrix, whose other parts (e.g., the
+  // labels) are not kept. The rows are encoded on the pool, which
+  // can be nullptr for current thread.
+  void Pack(const DMatrix& matrix, ThreadPool* pool);
+
+  // Decode the rows ids[0, n) to rows[0, n), on the pool or current
+  // thread if it is nullptr.
+  void Unpack(const index_t* ids, size_t n,
+              SparseRow** rows, ThreadPool* pool);
+
+  // Drop all the rows.
+  void Clear();
+
+  // Number of the rows.
+  size_t Rows() const {
+    return offset_.empty() ? 0 : offset_.size() - 1;
+  }
+
+  // Bytes of the packed rows and their offsets.
+  uint64 Bytes() const {
+    return bytes_.capacity() + offset_.capacity() * sizeof(uint64);
+  }
+
+ protected:
+  /* The compressed rows one after another, and the offset of each
+  row, where the last one is the end of the rows */
+  std::vector<char> bytes_;
+  std::vector<uint64> offset_;
+  /* The arena of each slice of Unpack() */
+  std::unique_ptr<RowArena[]> arenas_;
+  size_t num_arena_ = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PackedRows);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_PACKED_ROWS_H_
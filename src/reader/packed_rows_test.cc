@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the packed_rows.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "src/base/thread_pool.h"
+#include "src/reader/packed_rows.h"
+
+namespace xLearn {
+
+// The rows of one-hot features, the rows of other values,
+// and the empty rows, whose ids go up and down.
+static void make_matrix(DMatrix* matrix, index_t num_row) {
+  for (index_t i = 0; i < num_row; ++i) {
+    matrix->AddRow();
+    if (i % 7 == 0) { continue; }
+    for (index_t j = 0; j < i % 13 + 1; ++j) {
+      index_t feat = (i * 31 + j * 977) % 100000;
+      real_t value = i % 2 == 0 ? 1.0 : 0.5 + j;
+      matrix->AddNode(i, feat, value, j % 5);
+    }
+  }
+}
+
+static void check_rows(const DMatrix& matrix,
+                       const std::vector<index_t>& ids,
+                       SparseRow** rows) {
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const SparseRow* expect = matrix.row[ids[i]];
+    size_t len = expect == nullptr ? 0 : expect->size();
+    ASSERT_EQ(rows[i]->size(), len);
+    for (size_t j = 0; j < len; ++j) {
+      EXPECT_EQ((*rows[i])[j].feat_id, (*expect)[j].feat_id);
+      EXPECT_EQ((*rows[i])[j].field_id, (*expect)[j].field_id);
+      EXPECT_EQ((*rows[i])[j].feat_val, (*expect)[j].feat_val);
+    }
+  }
+}
+
+TEST(PackedRowsTest, Unpack) {
+  const index_t kRows = 10000;
+  DMatrix matrix;
+  make_matrix(&matrix, kRows);
+  ThreadPool pool(4);
+  for (ThreadPool* p : {(ThreadPool*)nullptr, &pool}) {
+    PackedRows packed;
+    packed.Pack(matrix, p);
+    EXPECT_EQ(packed.Rows(), kRows);
+    EXPECT_LT(packed.Bytes(), matrix.MemoryBytes());
+    // A batch of the rows in any order, which can be repeated
+    for (size_t n : {1, 100, 5000}) {
+      std::vector<index_t> ids(n);
+      for (size_t i = 0; i < n; ++i) { ids[i] = (i * 7919) % kRows; }
+      std::vector<SparseRow*> rows(n, nullptr);
+      packed.Unpack(ids.data(), n, rows.data(), p);
+      check_rows(matrix, ids, rows.data());
+    }
+    packed.Clear();
+    EXPECT_EQ(packed.Rows(), 0);
+  }
+}
+
+}  // namespace xLearn
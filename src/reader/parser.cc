@@ -20,16 +20,15 @@ This file is the implementation of Parser class.
 
 #include "src/reader/parser.h"
 
-#include "src/base/split_string.h"
-
 #include <stdlib.h>
 
-namespace xLearn {
+#include <algorithm>
 
-// Max size of one line TXT data
-static const uint32 kMaxLineSize = 10 * 1024 * 1024;  // 10 MB
+#include "src/base/trace.h"
+
+namespace xLearn {
 
-static char line_buf[kMaxLineSize];
+const uint64 Parser::kMinChunkSize;
 
 //------------------------------------------------------------------------------
 // Class register
@@ -39,90 +38,202 @@ REGISTER_PARSER("libsvm", LibsvmParser);
 REGISTER_PARSER("libffm", FFMParser);
 REGISTER_PARSER("csv", CSVParser);
 
-// Get one line from memory buffer
-uint64 Parser::get_line_from_buffer(char* line,
-                                    char* buf,
-                                    uint64 pos,
-                                    uint64 size) {
-  if (pos >= size) { return 0; }
-  uint64 end_pos = pos;
-  while (end_pos < size && buf[end_pos] != '\n') { end_pos++; }
-  uint64 read_size = end_pos - pos + 1;
-  if (read_size > kMaxLineSize) {
-    LOG(FATAL) << "Encountered a too-long line.    \
-                   Please check the data.";
+// Parse the buffer in current thread, or in multi-thread
+// if there are more than one chunk
+void Parser::Parse(const char* buf, 
+                   uint64 size, 
+                   DMatrix& matrix,
+                   bool reset,
+                   DataStats* stats) {
+  CHECK_NOTNULL(buf);
+  CHECK_GT(size, 0);
+  CHECK(crosses_.empty() || hash_bits_ > 0);
+  TraceSpan span("parse", "reader");
+  // Clear the data matrix, and keep its memory
+  if (reset) { 
+    matrix.Clear(); 
   }
-  memcpy(line, buf+pos, read_size);
-  line[read_size - 1] = '\0';
-  if (read_size > 1 && line[read_size - 2] == '\r') {
-    // Handle some txt format in windows or DOS.
-    line[read_size - 2] = '\0';
+  std::vector<uint64> bounds;
+  split_block(buf, size, &bounds);
+  size_t num_chunks = bounds.size() - 1;
+  DataStats local;
+  if (num_chunks == 1) {
+    parse_block(buf, size, &matrix, &local);
+    if (stats != nullptr) { stats->Merge(local); }
+    return;
+  }
+  while (chunks_.size() < num_chunks) {
+    chunks_.emplace_back(new DMatrix());
+  }
+  // The threads reuse the spare memory of the matrix
+  for (size_t c = 0; c < num_chunks; ++c) {
+    matrix.arena.ShareSpare(&chunks_[c]->arena, num_chunks - c);
+  }
+  // Each chunk has its own stats
+  std::vector<DataStats> chunk_stats(num_chunks);
+  pool_->ParallelFor(0, num_chunks, 1, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; ++c) {
+      parse_block(buf + bounds[c], bounds[c+1] - bounds[c],
+                  chunks_[c].get(), &chunk_stats[c]);
+    }
+  });
+  for (size_t c = 0; c < num_chunks; ++c) {
+    matrix.Append(chunks_[c].get());
+    if (stats != nullptr) { stats->Merge(chunk_stats[c]); }
   }
-  return read_size;
 }
 
+// The item of the data is not a valid number
+void Parser::number_error(const Token& token) {
+  LOG(FATAL) << "Invalid number '" << token.ToString()
+             << "' in the data. Please check the data.";
+}
 
+// The row is short, so it is sorted in place. The values that
+// sum to 0 are dropped with --skip-zeros as the parsed zeros.
+real_t Parser::merge_row(SparseRow* row, DataStats* stats) const {
+  if (row == nullptr || row->empty()) { return 0; }
+  std::sort(row->begin(), row->end(), [](const Node& a, const Node& b) {
+    return a.feat_id != b.feat_id ? a.feat_id < b.feat_id :
+                                    a.field_id < b.field_id;
+  });
+  size_t n = 0;
+  for (size_t i = 0; i < row->size(); ++i) {
+    const Node& node = (*row)[i];
+    if (n > 0 && (*row)[n-1].feat_id == node.feat_id &&
+        (*row)[n-1].field_id == node.field_id) {
+      (*row)[n-1].feat_val += node.feat_val;
+      continue;
+    }
+    if (n > 0 && skip_zeros_ && (*row)[n-1].feat_val == 0) { --n; }
+    (*row)[n++] = node;
+  }
+  if (n > 0 && skip_zeros_ && (*row)[n-1].feat_val == 0) { --n; }
+  stats->nnz -= row->size() - n;
+  row->resize(n);
+  real_t norm = 0;
+  for (size_t i = 0; i < n; ++i) {
+    norm += (*row)[i].feat_val * (*row)[i].feat_val;
+  }
+  return norm;
+}
+
+// The nodes of the row are copied before a new node is added,
+// which can move them. The rows are short, and each field has
+// only a few features, so the pairs are found by a linear scan.
+real_t Parser::add_crosses(DMatrix* matrix,
+                           index_t i,
+                           bool by_column,
+                           DataStats* stats) const {
+  if (crosses_.empty() || matrix->row[i] == nullptr) { return 0; }
+  size_t n = matrix->row[i]->size();
+  real_t norm = 0;
+  for (size_t k = 0; k < crosses_.size(); ++k) {
+    const FieldCross& cross = crosses_[k];
+    index_t field = by_column ? 0 : cross.field_1;
+    for (size_t a = 0; a < n; ++a) {
+      Node node_1 = (*matrix->row[i])[a];
+      if ((by_column ? node_1.feat_id : node_1.field_id) !=
+          cross.field_1) {
+        continue;
+      }
+      size_t b = cross.field_1 == cross.field_2 ? a + 1 : 0;
+      for (; b < n; ++b) {
+        Node node_2 = (*matrix->row[i])[b];
+        if ((by_column ? node_2.feat_id : node_2.field_id) !=
+            cross.field_2) {
+          continue;
+        }
+        real_t value = node_1.feat_val * node_2.feat_val;
+        if (skip_zeros_ && value == 0) { continue; }
+        index_t feat = CrossFeature(node_1.feat_id, node_2.feat_id,
+                                    k, hash_bits_);
+        matrix->AddNode(i, feat, value, field);
+        stats->AddNode(feat, field);
+        norm += value*value;
+      }
+    }
+  }
+  return norm;
+}
+
+// Split the buffer into chunks of whole lines
+void Parser::split_block(const char* buf,
+                         uint64 size,
+                         std::vector<uint64>* bounds) {
+  bounds->clear();
+  bounds->push_back(0);
+  uint64 num_chunks = 1;
+  if (pool_ != nullptr) {
+    num_chunks = std::min<uint64>(
+        pool_->ThreadNumber() * ThreadPool::kChunksPerThread,
+        size / kMinChunkSize);
+  }
+  for (uint64 c = 1; c < num_chunks; ++c) {
+    uint64 pos = std::max(size * c / num_chunks, bounds->back());
+    // The chunk ends after the '\n'
+    const char* end = (const char*)memchr(buf + pos, '\n', size - pos);
+    if (end == nullptr) { break; }
+    pos = end - buf + 1;
+    if (pos >= size) { break; }
+    if (pos > bounds->back()) { bounds->push_back(pos); }
+  }
+  bounds->push_back(size);
+}
 
 //------------------------------------------------------------------------------
 // LibsvmParser parses the following data format:
 // [y1 idx:value idx:value ...]
 // [y2 idx:value idx:value ...]
-// idx can start from 0
+// idx can start from 0, and the group id can be given by
+// [y1 qid:group idx:value idx:value ...]
 //------------------------------------------------------------------------------
-void LibsvmParser::Parse(char* buf, 
-                         uint64 size, 
-                         DMatrix& matrix, 
-                         bool reset) {
-  CHECK_NOTNULL(buf);
-  CHECK_GT(size, 0);
-  // Clear the data matrix
-  if (reset) { 
-    matrix.Reset(); 
-  }
+void LibsvmParser::parse_block(const char* buf,
+                               uint64 size,
+                               DMatrix* matrix,
+                               DataStats* stats) {
+  CHECK_NOTNULL(matrix);
+  if (has_label_) { matrix->SetNumTask(num_label_); }
   // Parse every line
   uint64 pos = 0;
-  for (;;) {
-    uint64 rd_size = get_line_from_buffer(line_buf, buf, pos, size);
-    if (rd_size == 0) break;
-    pos += rd_size;
-    matrix.AddRow();
-    int i = matrix.row_length - 1;
-    if (reset == false) {
-    }
+  Token line, item, idx;
+  while (Tokenizer::NextLine(buf, size, &pos, &line)) {
+    // Skip the empty line
+    if (!tokenizer_.NextItem(&line, &item)) { continue; }
+    matrix->AddRow();
+    stats->rows++;
+    index_t i = matrix->row_length - 1;
+    bool has_item = true;
     // Add Y
     if (has_label_) {  // for training task
-      char *y_char = strtok(line_buf, splitor_.c_str());
-      matrix.Y[i] = atof(y_char);
+      matrix->Y[i] = to_real(item);
+      has_item = tokenizer_.NextItem(&line, &item);
+      // The labels of the other tasks
+      for (index_t t = 1; t < num_label_ && has_item; ++t) {
+        matrix->Label(i, t) = to_real(item);
+        has_item = tokenizer_.NextItem(&line, &item);
+      }
     } else {  // for predict task
-      matrix.Y[i] = -2;
+      matrix->Y[i] = -2;
     }
     // Add features
     real_t norm = 0.0;
-    // The first element
-    if (!has_label_) {
-      char *idx_char = strtok(line_buf, ":");
-      char *value_char = strtok(nullptr, splitor_.c_str());
-      if (idx_char != nullptr && *idx_char != '\n') {
-        index_t idx = atoi(idx_char);
-        real_t value = atof(value_char);
-        matrix.AddNode(i, idx, value);
-        norm += value*value;
+    for (; has_item; has_item = tokenizer_.NextItem(&line, &item)) {
+      if (!Tokenizer::Split(&item, ':', &idx)) { continue; }
+      if (is_group(idx)) {
+        matrix->SetGroup(i, group_id(item));
+        continue;
       }
-    }
-    // The remain elements
-    for (;;) {
-      char *idx_char = strtok(nullptr, ":");
-      char *value_char = strtok(nullptr, splitor_.c_str());
-      if (idx_char == nullptr || *idx_char == '\n') {
-        break;
-      }
-      index_t idx = atoi(idx_char);
-      real_t value = atof(value_char);
-      matrix.AddNode(i, idx, value);
+      real_t value = to_real(item);
+      if (skip_zeros_ && value == 0) { continue; }
+      index_t feat = feature_id(idx);
+      matrix->AddNode(i, feat, value);
+      stats->AddNode(feat, 0);
       norm += value*value;
     }
+    if (merge_dup_) { norm = merge_row(matrix->row[i], stats); }
     norm = 1.0f / norm;
-    matrix.norm[i] = norm;
+    matrix->norm[i] = norm;
   }
 }
 
@@ -130,64 +241,58 @@ void LibsvmParser::Parse(char* buf,
 // FFMParser parses the following data format:
 // [y1 field:idx:value field:idx:value ...]
 // [y2 field:idx:value field:idx:value ...]
-// idx can start from 0
+// idx can start from 0, and the group id can be given by
+// [y1 qid:group field:idx:value field:idx:value ...]
 //------------------------------------------------------------------------------
-void FFMParser::Parse(char* buf, 
-                      uint64 size, 
-                      DMatrix& matrix,
-                      bool reset) {
-  CHECK_NOTNULL(buf);
-  CHECK_GT(size, 0);
-  // Clear the data matrix
-  if (reset) { 
-    matrix.Reset(); 
-  }
+void FFMParser::parse_block(const char* buf,
+                            uint64 size,
+                            DMatrix* matrix,
+                            DataStats* stats) {
+  CHECK_NOTNULL(matrix);
+  if (has_label_) { matrix->SetNumTask(num_label_); }
   // Parse every line
   uint64 pos = 0;
-  for (;;) {
-    uint64 rd_size = get_line_from_buffer(line_buf, buf, pos, size);
-    if (rd_size == 0) break;
-    pos += rd_size;
-    matrix.AddRow();
-    int i = matrix.row_length - 1;
+  Token line, item, field, idx;
+  while (Tokenizer::NextLine(buf, size, &pos, &line)) {
+    // Skip the empty line
+    if (!tokenizer_.NextItem(&line, &item)) { continue; }
+    matrix->AddRow();
+    stats->rows++;
+    index_t i = matrix->row_length - 1;
+    bool has_item = true;
     // Add Y
     if (has_label_) {  // for training task
-      char *y_char = strtok(line_buf, splitor_.c_str());
-      matrix.Y[i] = atof(y_char);
+      matrix->Y[i] = to_real(item);
+      has_item = tokenizer_.NextItem(&line, &item);
+      // The labels of the other tasks
+      for (index_t t = 1; t < num_label_ && has_item; ++t) {
+        matrix->Label(i, t) = to_real(item);
+        has_item = tokenizer_.NextItem(&line, &item);
+      }
     } else {  // for predict task
-      matrix.Y[i] = -2;
+      matrix->Y[i] = -2;
     }
     // Add features
     real_t norm = 0.0;
-    // The first element
-    if (!has_label_) {
-      char *field_char = strtok(line_buf, ":");
-      char *idx_char = strtok(nullptr, ":");
-      char *value_char = strtok(nullptr, splitor_.c_str());
-      if (idx_char != nullptr && *idx_char != '\n') {
-        index_t idx = atoi(idx_char);
-        real_t value = atof(value_char);
-        index_t field_id = atoi(field_char);
-        matrix.AddNode(i, idx, value, field_id);
-        norm += value*value;
-      }
-    }
-    // The remain elements
-    for (;;) {
-      char *field_char = strtok(nullptr, ":");
-      char *idx_char = strtok(nullptr, ":");
-      char *value_char = strtok(nullptr, splitor_.c_str());
-      if (field_char == nullptr || *field_char == '\n') {
-        break;
+    for (; has_item; has_item = tokenizer_.NextItem(&line, &item)) {
+      if (!Tokenizer::Split(&item, ':', &field)) { continue; }
+      if (is_group(field)) {
+        matrix->SetGroup(i, group_id(item));
+        continue;
       }
-      index_t idx = atoi(idx_char);
-      real_t value = atof(value_char);
-      index_t field_id = atoi(field_char);
-      matrix.AddNode(i, idx, value, field_id);
+      if (!Tokenizer::Split(&item, ':', &idx)) { continue; }
+      real_t value = to_real(item);
+      if (skip_zeros_ && value == 0) { continue; }
+      index_t feat = feature_id(idx);
+      index_t field_id = to_index(field);
+      matrix->AddNode(i, feat, value, field_id);
+      stats->AddNode(feat, field_id);
       norm += value*value;
     }
+    norm += add_crosses(matrix, i, false, stats);
+    if (merge_dup_) { norm = merge_row(matrix->row[i], stats); }
     norm = 1.0f / norm;
-    matrix.norm[i] = norm;
+    matrix->norm[i] = norm;
   }
 }
 
@@ -199,41 +304,44 @@ void FFMParser::Parse(char* buf,
 // label y, users should add a placeholder to the dataset
 // by themselves (Also in test data). Otherwise, the parser 
 // will treat the first element as the label y.
+// The feature id is the column, which is kept when the
+// zeros are dropped (see setSkipZeros), and the columns
+// are the fields of the crosses (see setCrosses).
 //------------------------------------------------------------------------------
-void CSVParser::Parse(char* buf, 
-                      uint64 size, 
-                      DMatrix& matrix, 
-                      bool reset) {
-  CHECK_NOTNULL(buf);
-  CHECK_GT(size, 0);
-  // Clear the data matrix
-  if (reset) { 
-    matrix.Reset(); 
-  }
+void CSVParser::parse_block(const char* buf,
+                            uint64 size,
+                            DMatrix* matrix,
+                            DataStats* stats) {
+  CHECK_NOTNULL(matrix);
+  if (has_label_) { matrix->SetNumTask(num_label_); }
   // Parse every line
   uint64 pos = 0;
-  std::vector<std::string> str_vec;
-  for (;;) {
-    uint64 rd_size = get_line_from_buffer(line_buf, buf, pos, size);
-    if (rd_size == 0) break;
-    pos += rd_size;
-    matrix.AddRow();
-    int i = matrix.row_length - 1;
-    str_vec.clear();
-    SplitStringUsing(line_buf, splitor_.c_str(), &str_vec);
-    int size = str_vec.size();
+  Token line, item;
+  while (Tokenizer::NextLine(buf, size, &pos, &line)) {
+    // Skip the empty line
+    if (!tokenizer_.NextItem(&line, &item)) { continue; }
+    matrix->AddRow();
+    stats->rows++;
+    index_t i = matrix->row_length - 1;
     // Add Y
-    matrix.Y[i] = atof(str_vec[0].c_str());
+    matrix->Y[i] = to_real(item);
+    // The labels of the other tasks, which are not features
+    for (index_t t = 1; has_label_ && t < num_label_ &&
+                        tokenizer_.NextItem(&line, &item); ++t) {
+      matrix->Label(i, t) = to_real(item);
+    }
     // Add features
     real_t norm = 0.0;
-    for (int j = 1; j < size; ++j) {
-      index_t idx = j-1;
-      real_t value = atof(str_vec[j].c_str());
-      matrix.AddNode(i, idx, value);
+    for (index_t idx = 0; tokenizer_.NextItem(&line, &item); ++idx) {
+      real_t value = to_real(item);
+      if (skip_zeros_ && value == 0) { continue; }
+      matrix->AddNode(i, idx, value);
+      stats->AddNode(idx, 0);
       norm += value*value;
     }
+    norm += add_crosses(matrix, i, true, stats);
     norm = 1.0f / norm;
-    matrix.norm[i] = norm;
+    matrix->norm[i] = norm;
   }
 }
 
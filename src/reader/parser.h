@@ -22,15 +22,112 @@ datasets to the DMatrix.
 #ifndef XLEARN_READER_PARSER_H_
 #define XLEARN_READER_PARSER_H_
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
 #include <vector>
 #include <string>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
+#include "src/base/parse_number.h"
+#include "src/base/split_string.h"
+#include "src/base/thread_pool.h"
 #include "src/data/data_structure.h"
+#include "src/reader/tokenizer.h"
 
 namespace xLearn {
 
+// Map a (64-bit) raw feature id to [0, 2^bits) for the hashing
+// trick, where bits is in [1, 31]. The ids are mixed by the
+// finalizer of MurmurHash3, so that nearby ids do not collide.
+inline index_t HashFeature(uint64 id, int bits) {
+  id ^= id >> 33;
+  id *= 0xff51afd7ed558ccdULL;
+  id ^= id >> 33;
+  id *= 0xc4ceb9fe1a85ec53ULL;
+  id ^= id >> 33;
+  return (index_t)(id >> (64 - bits));
+}
+
+// Map an id string (e.g., "user_country=DE") to a 64-bit raw id by the
+// MurmurHash64A, which is then hashed by HashFeature() like the integer
+// ids, so the string features need not be mapped to integers before.
+inline uint64 HashString(const char* begin, const char* end) {
+  const uint64 m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const uint64 kSeed = 0x9747b28cULL;
+  uint64 h = kSeed ^ ((uint64)(end - begin) * m);
+  const char* p = begin;
+  for (; end - p >= 8; p += 8) {
+    uint64 k;
+    memcpy(&k, p, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  // The last 0 ~ 7 bytes
+  if (p < end) {
+    for (int i = (int)(end - p) - 1; i >= 0; --i) {
+      h ^= (uint64)(unsigned char)p[i] << (8 * i);
+    }
+    h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+// A pair of fields whose features are crossed by the parser (see
+// Parser::setCrosses), which are the fields of the libffm data
+// and the columns of the csv data.
+struct FieldCross {
+  index_t field_1;
+  index_t field_2;
+};
+
+// Parse the crosses, e.g., "0:1,2:5", where each item is a pair of
+// fields, and the empty string gives no cross. Return false for an
+// invalid or repeated pair.
+inline bool ParseCrosses(const std::string& spec,
+                         std::vector<FieldCross>* crosses) {
+  CHECK_NOTNULL(crosses);
+  crosses->clear();
+  std::vector<std::string> items;
+  SplitStringUsing(spec, ",", &items);
+  for (const std::string& item : items) {
+    size_t pos = item.find(':');
+    if (pos == std::string::npos) { return false; }
+    FieldCross cross;
+    if (!ParseUint32(item.data(), item.data() + pos, &cross.field_1) ||
+        !ParseUint32(item.data() + pos + 1, item.data() + item.size(),
+                     &cross.field_2)) {
+      return false;
+    }
+    for (const FieldCross& other : *crosses) {
+      if (other.field_1 == cross.field_1 &&
+          other.field_2 == cross.field_2) {
+        return false;
+      }
+    }
+    crosses->push_back(cross);
+  }
+  return true;
+}
+
+// The id of the cross of two features by the k-th pair of fields,
+// which is hashed into 2^bits buckets like the raw ids, so the
+// same two ids of different pairs give different features.
+inline index_t CrossFeature(index_t feat_1, index_t feat_2,
+                            size_t k, int bits) {
+  uint64 id = ((uint64)feat_1 << 32) | feat_2;
+  return HashFeature(id + (k + 1) * 0x9e3779b97f4a7c15ULL, bits);
+}
+
 //------------------------------------------------------------------------------
 // Given a memory buffer, parse it to the DMatrix format.
 // Parser is an abstract class, which can be implemented by real
@@ -52,10 +149,22 @@ namespace xLearn {
 //   uint64 size = ReadFileToMemory(filename, buffer);
 //   DMatrix matrix;
 //   parser->Parse(buffer, size, matrix);
+//
+// If a thread pool is given by setThreadPool(), the buffer is split
+// into the chunks of whole lines, which are parsed by the threads into
+// their own matrices, and then the rows are moved to the matrix in
+// order (see DMatrix::Append), so the result is the same as before.
+// With reset == true, the memory of the matrix is kept and reused by
+// the new rows (see DMatrix::Clear), which is what the on-disk reader
+// does for each block of the file. The shape of the new rows is added
+// to the stats if they are given (see DataStats), which is counted in
+// the same pass as the parsing, so the rows need not be read again.
+// The crosses of the fields (see setCrosses) are added to each row
+// while it is parsed, so they are never stored in the text files.
 //------------------------------------------------------------------------------
 class Parser {
  public:
-  Parser() { }
+  Parser() : pool_(nullptr) { }
   virtual ~Parser() {  }
 
   // Wether this dataset contains label y ?
@@ -66,27 +175,168 @@ class Parser {
   // Set Splitor
   inline void setSplitor(const std::string& splitor) {
     splitor_ = splitor;
+    tokenizer_.SetDelimiter(splitor);
+  }
+
+  // Map the feature ids into 2^bits buckets by HashFeature().
+  // The ids can be any 64-bit integer in this mode, or any string
+  // (see HashString), and 0 (by default) keeps the ids as they are.
+  inline void setHashBits(int bits) {
+    CHECK_GE(bits, 0);
+    CHECK_LE(bits, 31);
+    hash_bits_ = bits;
+  }
+
+  // Drop the features of value 0, so a sparse CSV file
+  // keeps only the non-zero columns of each row.
+  inline void setSkipZeros(bool skip) {
+    skip_zeros_ = skip;
+  }
+
+  // Merge the nodes of the same feature (and field) in a row of
+  // the libsvm and libffm files, whose values are summed, so the
+  // rows are sorted by feature id without the duplicates.
+  inline void setMergeDuplicates(bool merge) {
+    merge_dup_ = merge;
+  }
+
+  // Read num labels at the head of each row of the training data,
+  // where the first one is Y (task 0) and the others are the labels
+  // of the other tasks (see DMatrix::SetNumTask). 1 by default.
+  inline void setNumLabels(index_t num) {
+    num_label_ = num;
+  }
+
+  // Add a node for each pair of features of the two fields of a
+  // cross in a row, whose id is given by CrossFeature() and whose
+  // value is the product of the two values. The node is in the
+  // first field of the cross, and field_1 == field_2 crosses each
+  // two features of the field. The crosses need the hashing trick
+  // (see setHashBits). The libsvm rows have no field, so they
+  // have no cross, and the fields of the csv rows are the columns.
+  inline void setCrosses(const std::vector<FieldCross>& crosses) {
+    crosses_ = crosses;
+  }
+
+  // Parse the buffer in multi-thread, and nullptr
+  // (by default) parses it in current thread.
+  inline void setThreadPool(ThreadPool* pool) {
+    pool_ = pool;
   }
 
   // The real parse function invoked by users.
-  // If reset == true, Parser will invoke matrix.Reset();
-  virtual void Parse(char* buf, 
-                     uint64 size, 
-                     DMatrix& matrix,
-                     bool reset = false) = 0;
+  // If reset == true, Parser will invoke matrix.Clear();
+  // and the stats of the new rows are added to stats.
+  void Parse(const char* buf, 
+             uint64 size, 
+             DMatrix& matrix,
+             bool reset = false,
+             DataStats* stats = nullptr);
+
+  // Minimal size of a chunk parsed by one thread.
+  static const uint64 kMinChunkSize = 1024 * 1024;  // 1 MB
 
  protected:
-   // Get one line from memory buffer.
-   uint64 get_line_from_buffer(char* line,
-                               char* buf,
-                               uint64 pos,
-                               uint64 size);
+   // Parse the lines of [buf, buf+size) and add them to the
+   // matrix, which is invoked by the threads at the same time,
+   // so it must not change the parser. The stats of the
+   // lines are added to stats.
+   virtual void parse_block(const char* buf,
+                            uint64 size,
+                            DMatrix* matrix,
+                            DataStats* stats) = 0;
+
+   // Sort the nodes of the row by feature and field, and merge the
+   // nodes of the same pair, whose values are summed. The merged
+   // nodes are taken from stats, and the new sum of the squares of
+   // the values is returned, which gives the norm of the row.
+   real_t merge_row(SparseRow* row, DataStats* stats) const;
+
+   // Add the crosses to the i-th row of the matrix, whose fields are
+   // its columns (feature ids) if by_column is true. The stats of the
+   // new nodes are added to stats, and the sum of the squares of
+   // their values is returned.
+   real_t add_crosses(DMatrix* matrix,
+                      index_t i,
+                      bool by_column,
+                      DataStats* stats) const;
+
+   // Split the buffer into chunks of whole lines, where the
+   // i-th chunk is [bounds[i], bounds[i+1]).
+   void split_block(const char* buf,
+                    uint64 size,
+                    std::vector<uint64>* bounds);
+
+   // Convert the token to a number (see parse_number.h),
+   // and the program crashes for an invalid number.
+   inline real_t to_real(const Token& token) {
+     real_t value = 0;
+     if (!ParseFloat(token.begin, token.end, &value)) {
+       number_error(token);
+     }
+     return value;
+   }
+   inline index_t to_index(const Token& token) {
+     index_t value = 0;
+     if (!ParseUint32(token.begin, token.end, &value)) {
+       number_error(token);
+     }
+     return value;
+   }
+   inline uint64 to_uint64(const Token& token) {
+     uint64 value = 0;
+     if (!ParseUint64(token.begin, token.end, &value)) {
+       number_error(token);
+     }
+     return value;
+   }
+   void number_error(const Token& token);
+
+   // Parse the feature id, which is hashed if the hashing
+   // trick is used. Then the id that is not an integer is
+   // a string, which is hashed by HashString().
+   inline index_t feature_id(const Token& token) {
+     if (hash_bits_ == 0) { return to_index(token); }
+     uint64 id = 0;
+     if (!ParseUint64(token.begin, token.end, &id)) {
+       if (token.empty()) { number_error(token); }
+       id = HashString(token.begin, token.end);
+     }
+     return HashFeature(id, hash_bits_);
+   }
+
+   // The group id of a row is given by 'qid:<id>', which is
+   // the first item after the label (see DMatrix::group).
+   inline bool is_group(const Token& token) {
+     return token.Equals("qid");
+   }
+   inline uint64 group_id(const Token& token) {
+     return to_uint64(token);
+   }
 
    /* True for training task and
    False for prediction task */
    bool has_label_;
    /* Split string for data items */
    std::string splitor_;
+   /* Split the lines and items in place */
+   Tokenizer tokenizer_;
+   /* Number of bits of the hashing trick,
+   and 0 means no hashing */
+   int hash_bits_ = 0;
+   /* Drop the features of value 0 */
+   bool skip_zeros_ = false;
+   /* Merge the duplicate features of a row */
+   bool merge_dup_ = false;
+   /* Number of the labels of each row */
+   index_t num_label_ = 1;
+   /* The pairs of the crossed fields */
+   std::vector<FieldCross> crosses_;
+   /* Thread pool, and nullptr for one thread */
+   ThreadPool* pool_;
+   /* The matrices of the threads, which are kept
+   for the next buffer, so as their memory */
+   std::vector<std::unique_ptr<DMatrix> > chunks_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Parser);
@@ -102,11 +352,12 @@ class LibsvmParser : public Parser {
   LibsvmParser() { }
   ~LibsvmParser() {  }
 
-  // Parse the libsvm file
-  void Parse(char* buf, 
-             uint64 size, 
-             DMatrix& matrix,
-             bool reset = false);
+ protected:
+  // Parse the lines of libsvm file
+  void parse_block(const char* buf,
+                   uint64 size,
+                   DMatrix* matrix,
+                   DataStats* stats);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(LibsvmParser);
@@ -122,11 +373,12 @@ class FFMParser : public Parser {
   FFMParser() { }
   ~FFMParser() {  }
 
-  // Parse the libffm file
-  void Parse(char* buf, 
-             uint64 size, 
-             DMatrix& matrix,
-             bool reset = false);
+ protected:
+  // Parse the lines of libffm file
+  void parse_block(const char* buf,
+                   uint64 size,
+                   DMatrix* matrix,
+                   DataStats* stats);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(FFMParser);
@@ -146,11 +398,12 @@ class CSVParser : public Parser {
   CSVParser() { }
   ~CSVParser() { }
 
-  // Parse the csv file
-  void Parse(char* buf, 
-             uint64 size, 
-             DMatrix& matrix,
-             bool reset = false);
+ protected:
+  // Parse the lines of csv file
+  void parse_block(const char* buf,
+                   uint64 size,
+                   DMatrix* matrix,
+                   DataStats* stats);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(CSVParser);
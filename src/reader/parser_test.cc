@@ -24,6 +24,7 @@ This file tests parser.h file.
 #include <vector>
 
 #include "src/reader/parser.h"
+#include "src/base/stringprintf.h"
 #include "src/data/data_structure.h"
 
 namespace xLearn {
@@ -280,6 +281,460 @@ TEST(PARSER_TEST, Parse_csv_comma) {
   RemoveFile(Kfilename.c_str());
 }
 
+// The hashed ids are in range and spread over the buckets.
+TEST(PARSER_TEST, HashFeature) {
+  for (int bits = 1; bits <= 31; ++bits) {
+    for (uint64 id = 0; id < 1000; ++id) {
+      EXPECT_LT(HashFeature(id, bits), 1ULL << bits);
+    }
+    EXPECT_LT(HashFeature(~0ULL, bits), 1ULL << bits);
+  }
+  std::vector<int> count(16, 0);
+  for (uint64 id = 0; id < 16000; ++id) {
+    count[HashFeature(id, 4)]++;
+  }
+  for (int b = 0; b < 16; ++b) {
+    EXPECT_GT(count[b], 800);
+    EXPECT_LT(count[b], 1200);
+  }
+}
+
+// The raw 64-bit ids are hashed by the libsvm and libffm
+// parsers, and the same id always goes to the same bucket.
+TEST(PARSER_TEST, Parse_hash) {
+  const std::string kStrHash = "1 18446744073709551615:0.5 "
+                               "4294967296:0.5 7:0.5\n";
+  const std::string kStrFFMHash = "1 0:18446744073709551615:0.5 "
+                                  "1:4294967296:0.5 2:7:0.5\n";
+  uint64 ids[3] = { 18446744073709551615ULL, 4294967296ULL, 7 };
+  const int kBits = 10;
+  for (int t = 0; t < 2; ++t) {
+    write_data(Kfilename, t == 0 ? kStrHash : kStrFFMHash);
+    char* buffer = nullptr;
+    uint64 size = ReadFileToMemory(Kfilename, &buffer);
+    DMatrix matrix;
+    Parser* parser = nullptr;
+    if (t == 0) {
+      parser = new LibsvmParser;
+    } else {
+      parser = new FFMParser;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    parser->setHashBits(kBits);
+    parser->Parse(buffer, size, matrix, true);
+    EXPECT_EQ(matrix.row_length, kNum_lines);
+    for (index_t i = 0; i < matrix.row_length; ++i) {
+      SparseRow* row = matrix.row[i];
+      ASSERT_EQ(row->size(), 3);
+      for (int n = 0; n < 3; ++n) {
+        EXPECT_EQ((*row)[n].feat_id, HashFeature(ids[n], kBits));
+        EXPECT_EQ((*row)[n].field_id, t == 0 ? 0 : n);
+        EXPECT_FLOAT_EQ((*row)[n].feat_val, 0.5);
+      }
+    }
+    EXPECT_LT(matrix.MaxFeat(), 1U << kBits);
+    delete parser;
+    delete [] buffer;
+    RemoveFile(Kfilename.c_str());
+  }
+}
+
+// The string ids are hashed by HashString(), and
+// the integer ids are the same as before.
+TEST(PARSER_TEST, Parse_hash_string) {
+  EXPECT_EQ(HashString("a", "a" + 1), HashString("a", "a" + 1));
+  const char* kStrs[4] = { "", "user_country=DE", "user_country=FR",
+                           "ad=123456789" };
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < i; ++j) {
+      EXPECT_NE(HashString(kStrs[i], kStrs[i] + strlen(kStrs[i])),
+                HashString(kStrs[j], kStrs[j] + strlen(kStrs[j])));
+    }
+  }
+  const std::string kData[2] = {
+    "1 user_country=DE:1 7:0.5 ad=123456789:2\n",
+    "1 0:user_country=DE:1 1:7:0.5 2:ad=123456789:2\n"
+  };
+  const int kBits = 20;
+  index_t ids[3] = {
+    HashFeature(HashString(kStrs[1], kStrs[1] + strlen(kStrs[1])), kBits),
+    HashFeature(7, kBits),
+    HashFeature(HashString(kStrs[3], kStrs[3] + strlen(kStrs[3])), kBits)
+  };
+  for (int t = 0; t < 2; ++t) {
+    Parser* parser = nullptr;
+    if (t == 0) {
+      parser = new LibsvmParser;
+    } else {
+      parser = new FFMParser;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    parser->setHashBits(kBits);
+    DMatrix matrix;
+    parser->Parse(kData[t].data(), kData[t].size(), matrix, true);
+    ASSERT_EQ(matrix.row_length, 1);
+    SparseRow* row = matrix.row[0];
+    ASSERT_EQ(row->size(), 3);
+    for (int n = 0; n < 3; ++n) {
+      EXPECT_EQ((*row)[n].feat_id, ids[n]);
+      EXPECT_EQ((*row)[n].field_id, t == 0 ? 0 : n);
+    }
+    delete parser;
+  }
+}
+
+// The zeros are dropped, and the feature id of a CSV
+// column is the same as before.
+TEST(PARSER_TEST, Parse_skip_zeros) {
+  const std::string kData[3] = {
+    "1 0 0.5 0 0.0 2\n",
+    "1 0:0 1:0.5 2:0 3:0.0 4:2\n",
+    "1 0:0:0 1:1:0.5 2:2:0 3:3:0.0 4:4:2\n"
+  };
+  for (int t = 0; t < 3; ++t) {
+    Parser* parser = nullptr;
+    if (t == 0) {
+      parser = new CSVParser;
+    } else if (t == 1) {
+      parser = new LibsvmParser;
+    } else {
+      parser = new FFMParser;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    for (int skip = 0; skip < 2; ++skip) {
+      parser->setSkipZeros(skip == 1);
+      DMatrix matrix;
+      parser->Parse(kData[t].data(), kData[t].size(), matrix, true);
+      ASSERT_EQ(matrix.row_length, 1);
+      SparseRow* row = matrix.row[0];
+      EXPECT_FLOAT_EQ(matrix.norm[0], 1.0 / (0.25 + 4.0));
+      if (skip == 0) {
+        ASSERT_EQ(row->size(), 5);
+        continue;
+      }
+      ASSERT_EQ(row->size(), 2);
+      EXPECT_EQ((*row)[0].feat_id, 1);
+      EXPECT_FLOAT_EQ((*row)[0].feat_val, 0.5);
+      EXPECT_EQ((*row)[1].feat_id, 4);
+      EXPECT_FLOAT_EQ((*row)[1].feat_val, 2);
+      EXPECT_EQ((*row)[1].field_id, t == 2 ? 4 : 0);
+    }
+    delete parser;
+  }
+}
+
+// The duplicate features are summed, and the ffm nodes of the same
+// feature are only merged in the same field. The rows are sorted.
+TEST(PARSER_TEST, Parse_merge_dup) {
+  const std::string kData[2] = {
+    "1 7:1 3:0.5 7:2 1:1 3:0.5\n",
+    "1 0:7:1 1:3:0.5 0:7:2 2:1:1 2:3:0.5\n"
+  };
+  for (int t = 0; t < 2; ++t) {
+    Parser* parser = nullptr;
+    if (t == 0) {
+      parser = new LibsvmParser;
+    } else {
+      parser = new FFMParser;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    parser->setMergeDuplicates(true);
+    DMatrix matrix;
+    DataStats stats;
+    parser->Parse(kData[t].data(), kData[t].size(), matrix, true, &stats);
+    ASSERT_EQ(matrix.row_length, 1);
+    SparseRow* row = matrix.row[0];
+    if (t == 0) {
+      ASSERT_EQ(row->size(), 3);
+      EXPECT_EQ(stats.nnz, 3);
+      index_t ids[3] = { 1, 3, 7 };
+      real_t values[3] = { 1, 1, 3 };
+      for (int n = 0; n < 3; ++n) {
+        EXPECT_EQ((*row)[n].feat_id, ids[n]);
+        EXPECT_FLOAT_EQ((*row)[n].feat_val, values[n]);
+      }
+      EXPECT_FLOAT_EQ(matrix.norm[0], 1.0 / (1 + 1 + 9));
+    } else {
+      ASSERT_EQ(row->size(), 4);
+      EXPECT_EQ(stats.nnz, 4);
+      index_t ids[4] = { 1, 3, 3, 7 };
+      index_t fields[4] = { 2, 1, 2, 0 };
+      real_t values[4] = { 1, 0.5, 0.5, 3 };
+      for (int n = 0; n < 4; ++n) {
+        EXPECT_EQ((*row)[n].feat_id, ids[n]);
+        EXPECT_EQ((*row)[n].field_id, fields[n]);
+        EXPECT_FLOAT_EQ((*row)[n].feat_val, values[n]);
+      }
+      EXPECT_FLOAT_EQ(matrix.norm[0], 1.0 / (1 + 0.25 + 0.25 + 9));
+    }
+    delete parser;
+  }
+}
+
+TEST(PARSER_TEST, Parse_crosses) {
+  std::vector<FieldCross> crosses;
+  EXPECT_TRUE(ParseCrosses("", &crosses));
+  EXPECT_TRUE(crosses.empty());
+  EXPECT_FALSE(ParseCrosses("0", &crosses));
+  EXPECT_FALSE(ParseCrosses("0:a", &crosses));
+  EXPECT_FALSE(ParseCrosses("0:1,0:1", &crosses));
+  ASSERT_TRUE(ParseCrosses("0:1,2:2", &crosses));
+  ASSERT_EQ(crosses.size(), 2);
+  EXPECT_EQ(crosses[1].field_1, 2);
+  const int kBits = 10;
+  EXPECT_NE(CrossFeature(3, 5, 0, kBits), CrossFeature(3, 5, 1, kBits));
+  // Field 2 has two features, which are crossed once
+  const std::string kFFM = "1 0:3:1 1:5:2 2:7:1 2:8:0.5\n";
+  FFMParser ffm;
+  ffm.setLabel(true);
+  ffm.setSplitor(" ");
+  ffm.setHashBits(kBits);
+  ffm.setCrosses(crosses);
+  DMatrix matrix;
+  DataStats stats;
+  ffm.Parse(kFFM.data(), kFFM.size(), matrix, true, &stats);
+  ASSERT_EQ(matrix.row_length, 1);
+  SparseRow* row = matrix.row[0];
+  ASSERT_EQ(row->size(), 6);
+  EXPECT_EQ(stats.nnz, 6);
+  index_t feat_3 = HashFeature(3, kBits);
+  index_t feat_5 = HashFeature(5, kBits);
+  EXPECT_EQ((*row)[4].feat_id, CrossFeature(feat_3, feat_5, 0, kBits));
+  EXPECT_EQ((*row)[4].field_id, 0);
+  EXPECT_FLOAT_EQ((*row)[4].feat_val, 2);
+  EXPECT_EQ((*row)[5].feat_id,
+            CrossFeature(HashFeature(7, kBits), HashFeature(8, kBits),
+                         1, kBits));
+  EXPECT_EQ((*row)[5].field_id, 2);
+  EXPECT_FLOAT_EQ((*row)[5].feat_val, 0.5);
+  EXPECT_FLOAT_EQ(matrix.norm[0],
+                  1.0 / (1 + 4 + 1 + 0.25 + 4 + 0.25));
+  // The fields of csv are the columns
+  ASSERT_TRUE(ParseCrosses("0:2", &crosses));
+  const std::string kCSV = "1 2 0 3\n";
+  CSVParser csv;
+  csv.setLabel(true);
+  csv.setSplitor(" ");
+  csv.setHashBits(kBits);
+  csv.setCrosses(crosses);
+  csv.Parse(kCSV.data(), kCSV.size(), matrix, true);
+  ASSERT_EQ(matrix.row_length, 1);
+  row = matrix.row[0];
+  ASSERT_EQ(row->size(), 4);
+  EXPECT_EQ((*row)[3].feat_id, CrossFeature(0, 2, 0, kBits));
+  EXPECT_EQ((*row)[3].field_id, 0);
+  EXPECT_FLOAT_EQ((*row)[3].feat_val, 6);
+}
+
+// The labels of the other tasks are before the features
+TEST(PARSER_TEST, Parse_multi_label) {
+  const std::string kData[3] = {
+    "1 0 2.5 3:1 7:2\n-1 1 0.5 4:1\n",
+    "1 0 2.5 0:3:1 1:7:2\n-1 1 0.5 2:4:1\n",
+    "1 0 2.5 0.5 2\n-1 1 0.5 1\n"
+  };
+  for (int t = 0; t < 3; ++t) {
+    Parser* parser = nullptr;
+    if (t == 0) {
+      parser = new LibsvmParser;
+    } else if (t == 1) {
+      parser = new FFMParser;
+    } else {
+      parser = new CSVParser;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    parser->setNumLabels(3);
+    DMatrix matrix;
+    DataStats stats;
+    parser->Parse(kData[t].data(), kData[t].size(), matrix, true, &stats);
+    ASSERT_EQ(matrix.row_length, 2);
+    ASSERT_EQ(matrix.num_task, 3);
+    EXPECT_FLOAT_EQ(matrix.Label(0, 0), 1);
+    EXPECT_FLOAT_EQ(matrix.Label(0, 1), 0);
+    EXPECT_FLOAT_EQ(matrix.Label(0, 2), 2.5);
+    EXPECT_FLOAT_EQ(matrix.Label(1, 0), -1);
+    EXPECT_FLOAT_EQ(matrix.Label(1, 1), 1);
+    EXPECT_FLOAT_EQ(matrix.Label(1, 2), 0.5);
+    EXPECT_EQ(matrix.row[0]->size(), 2);
+    EXPECT_EQ(matrix.row[1]->size(), 1);
+    if (t < 2) {
+      EXPECT_EQ((*matrix.row[0])[0].feat_id, 3);
+      EXPECT_EQ((*matrix.row[1])[0].feat_id, 4);
+    }
+    delete parser;
+  }
+}
+
+TEST(PARSER_TEST, Parse_group) {
+  // The group id is given by qid, and the row
+  // without qid is in group 0
+  std::string data = "1 qid:7 0:0:0.5 1:1:0.5\n"
+                     "0 1:1:0.5\n"
+                     "1 qid:12345678901 0:0:0.5\n";
+  std::string noy = "qid:7 0:0:0.5 1:1:0.5\n";
+  for (int t = 0; t < 2; ++t) {
+    std::string str = data;
+    std::string str_noy = noy;
+    if (t == 0) {
+      // libsvm format, which removes the fields
+      str = "1 qid:7 0:0.5 1:0.5\n0 1:0.5\n1 qid:12345678901 0:0.5\n";
+      str_noy = "qid:7 0:0.5 1:0.5\n";
+    }
+    Parser* parser = nullptr;
+    if (t == 0) {
+      parser = new LibsvmParser;
+    } else {
+      parser = new FFMParser;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    DMatrix matrix;
+    std::vector<char> buf(str.begin(), str.end());
+    parser->Parse(buf.data(), buf.size(), matrix, true);
+    ASSERT_EQ(matrix.row_length, 3);
+    ASSERT_TRUE(matrix.HasGroup());
+    ASSERT_EQ(matrix.group.size(), 3);
+    EXPECT_EQ(matrix.group[0], 7);
+    EXPECT_EQ(matrix.group[1], 0);
+    EXPECT_EQ(matrix.group[2], 12345678901ULL);
+    EXPECT_EQ(matrix.row[0]->size(), 2);
+    EXPECT_EQ(matrix.row[1]->size(), 1);
+    EXPECT_EQ(matrix.row[2]->size(), 1);
+    EXPECT_EQ((*matrix.row[0])[1].feat_id, 1);
+    EXPECT_EQ((*matrix.row[0])[1].field_id, t == 0 ? 0 : 1);
+    EXPECT_FLOAT_EQ(matrix.norm[0], 2.0);
+    // Without the label
+    parser->setLabel(false);
+    buf.assign(str_noy.begin(), str_noy.end());
+    parser->Parse(buf.data(), buf.size(), matrix, true);
+    ASSERT_EQ(matrix.row_length, 1);
+    ASSERT_TRUE(matrix.HasGroup());
+    EXPECT_EQ(matrix.group[0], 7);
+    EXPECT_EQ(matrix.row[0]->size(), 2);
+    EXPECT_EQ((*matrix.row[0])[0].feat_id, 0);
+    // No group id
+    parser->setLabel(true);
+    std::string plain = t == 0 ? "1 0:0.5\n" : "1 0:0:0.5\n";
+    buf.assign(plain.begin(), plain.end());
+    parser->Parse(buf.data(), buf.size(), matrix, true);
+    EXPECT_FALSE(matrix.HasGroup());
+    delete parser;
+  }
+}
+
+TEST(PARSER_TEST, Parse_numbers) {
+  std::string str = "-1 3:1.5e-1 4294967295:.25 7:2.\n"
+                    "+1.0e0 0:-3E1\n";
+  std::vector<char> buf(str.begin(), str.end());
+  LibsvmParser parser;
+  parser.setLabel(true);
+  parser.setSplitor(" ");
+  DMatrix matrix;
+  parser.Parse(buf.data(), buf.size(), matrix, true);
+  ASSERT_EQ(matrix.row_length, 2);
+  EXPECT_EQ(matrix.Y[0], -1);
+  EXPECT_EQ(matrix.Y[1], 1);
+  ASSERT_EQ(matrix.row[0]->size(), 3);
+  EXPECT_EQ((*matrix.row[0])[0].feat_id, 3);
+  EXPECT_FLOAT_EQ((*matrix.row[0])[0].feat_val, 0.15);
+  EXPECT_EQ((*matrix.row[0])[1].feat_id, 4294967295U);
+  EXPECT_FLOAT_EQ((*matrix.row[0])[1].feat_val, 0.25);
+  EXPECT_FLOAT_EQ((*matrix.row[0])[2].feat_val, 2.0);
+  EXPECT_FLOAT_EQ((*matrix.row[1])[0].feat_val, -30.0);
+}
+
+// Multi-thread parsing gives the same matrix as one thread.
+TEST(PARSER_TEST, Parse_multi_thread) {
+  // 3~6 MB of lines in different length, and
+  // the last line has no '\n'
+  std::string ffm, svm, csv;
+  const int kLines = 150000;
+  for (int i = 0; i < kLines; ++i) {
+    std::string y = i % 3 == 0 ? "1" : "0";
+    ffm += y;
+    svm += y;
+    csv += y;
+    if (i % 5 == 0) {
+      ffm += StringPrintf(" qid:%d", i / 5);
+      svm += StringPrintf(" qid:%d", i / 5);
+    }
+    for (int j = 0; j < i % 7 + 1; ++j) {
+      ffm += StringPrintf(" %d:%d:0.%d", j, i % 100 + j, j + 1);
+      svm += StringPrintf(" %d:0.%d", i % 100 + j, j + 1);
+      csv += StringPrintf(" 0.%d", j + 1);
+    }
+    if (i + 1 < kLines) {
+      ffm += "\n";
+      svm += "\n";
+      csv += "\n";
+    }
+  }
+  ThreadPool pool(4);
+  for (int t = 0; t < 3; ++t) {
+    Parser* parser = nullptr;
+    std::string* str = nullptr;
+    if (t == 0) {
+      parser = new LibsvmParser;
+      str = &svm;
+    } else if (t == 1) {
+      parser = new FFMParser;
+      str = &ffm;
+    } else {
+      parser = new CSVParser;
+      str = &csv;
+    }
+    parser->setLabel(true);
+    parser->setSplitor(" ");
+    std::vector<char> buf(str->begin(), str->end());
+    ASSERT_GT(buf.size(), 2 * Parser::kMinChunkSize);
+    DMatrix expect;
+    DataStats expect_stats;
+    parser->Parse(buf.data(), buf.size(), expect, true, &expect_stats);
+    ASSERT_EQ(expect.row_length, kLines);
+    EXPECT_EQ(expect.HasGroup(), t != 2);
+    parser->setThreadPool(&pool);
+    DMatrix matrix;
+    // Append to the existing row
+    matrix.AddRow();
+    DataStats stats;
+    parser->Parse(buf.data(), buf.size(), matrix, false, &stats);
+    ASSERT_EQ(matrix.row_length, kLines + 1);
+    // The stats are the same as the scan of the rows
+    DataStats scan = expect.Stats();
+    EXPECT_EQ(scan.max_feat, t == 2 ? 6 : 105);
+    EXPECT_EQ(scan.max_field, t == 1 ? 6 : 0);
+    EXPECT_EQ(scan.rows, kLines);
+    for (const DataStats& s : { expect_stats, stats }) {
+      EXPECT_EQ(s.max_feat, scan.max_feat);
+      EXPECT_EQ(s.max_field, scan.max_field);
+      EXPECT_EQ(s.nnz, scan.nnz);
+      EXPECT_EQ(s.rows, scan.rows);
+    }
+    EXPECT_EQ(matrix.HasGroup(), t != 2);
+    for (index_t i = 0; i < expect.row_length; ++i) {
+      EXPECT_EQ(matrix.Y[i+1], expect.Y[i]);
+      EXPECT_EQ(matrix.norm[i+1], expect.norm[i]);
+      if (expect.HasGroup()) {
+        EXPECT_EQ(matrix.group[i+1], expect.group[i]);
+      }
+      ASSERT_EQ(matrix.row[i+1]->size(), expect.row[i]->size());
+      for (size_t j = 0; j < expect.row[i]->size(); ++j) {
+        const Node& a = (*matrix.row[i+1])[j];
+        const Node& b = (*expect.row[i])[j];
+        EXPECT_EQ(a.feat_id, b.feat_id);
+        EXPECT_EQ(a.field_id, b.field_id);
+        EXPECT_EQ(a.feat_val, b.feat_val);
+      }
+    }
+    delete parser;
+  }
+}
+
 Parser* CreateParser(const char* format_name) {
   return CREATE_PARSER(format_name);
 }
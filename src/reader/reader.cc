@@ -22,10 +22,16 @@ This file is the implementation of Reader class.
 
 #include <string.h>
 #include <algorithm> // for random_shuffle
+#include <atomic>
+#include <cstdio>
+#include <limits>
 
 #include "src/base/file_util.h"
+#include "src/base/parse_number.h"
 #include "src/base/split_string.h"
 #include "src/base/format_print.h"
+#include "src/base/trace.h"
+#include "src/reader/columnar.h"
 
 namespace xLearn {
 
@@ -37,6 +43,12 @@ REGISTER_READER("memory", InmemReader);
 REGISTER_READER("disk", OndiskReader);
 REGISTER_READER("dmatrix", FromDMReader);
 
+const uint64 OndiskReader::kCacheMagic;
+const uint64 OndiskReader::kAutoBlockStart;
+const uint64 OndiskReader::kMinAutoBlock;
+constexpr double OndiskReader::kAutoBlockSeconds;
+const index_t InmemReader::kPackedBatch;
+
 // Check current file format and
 // return 'libsvm', 'libffm', or 'csv'.
 // This function will also check if current
@@ -51,6 +63,11 @@ std::string Reader::check_file_format() {
   std::string data_line;
   GetLine(file, data_line);
   Close(file);
+  return check_line_format(data_line);
+}
+
+// Check the format by the first line of data.
+std::string Reader::check_line_format(const std::string& data_line) {
   // Find the split string
   int space_count = 0;
   int table_count = 0;
@@ -86,22 +103,66 @@ std::string Reader::check_file_format() {
   } else {
     has_label_ = true;
   }
-  // check file format
+  // check file format, where the other labels of -num_label
+  // and the group id (qid:<id>) are skipped
+  size_t item = has_label_ ? num_label_ : 1;
+  if (item >= str_list.size()) {
+    Color::print_error("Unknow file format");
+    exit(0);
+  }
+  while (item + 1 < str_list.size() &&
+         str_list[item].compare(0, 4, "qid:") == 0) {
+    item++;
+  }
   int count = 0;
-  for (int i = 0; i < str_list[1].size(); ++i) {
-    if (str_list[1][i] == ':') {
+  for (int i = 0; i < str_list[item].size(); ++i) {
+    if (str_list[item][i] == ':') {
       count++;
     }
   }
+  if (count > 2) {
+    Color::print_error("Unknow file format");
+    exit(0);
+  }
+  // The numbers of the label and the item must be
+  // valid, which are id:value or field:id:value
+  double value = 0;
+  bool valid = true;
+  if (has_label_) {
+    const std::string& y = str_list[0];
+    valid = ParseDouble(y.data(), y.data() + y.size(), &value);
+  }
+  std::vector<std::string> numbers;
+  if (str_list[item].compare(0, 4, "qid:") != 0) {
+    SplitStringUsing(str_list[item], ":", &numbers);
+    valid = valid && numbers.size() == count + 1;
+  }
+  for (size_t i = 0; valid && i < numbers.size(); ++i) {
+    const char* begin = numbers[i].data();
+    const char* end = begin + numbers[i].size();
+    uint32 id = 0;
+    if (i + 1 == numbers.size()) {
+      valid = ParseDouble(begin, end, &value);
+    } else if (i + 2 == numbers.size() && hash_bits_ > 0) {
+      // The hashed feature id can be a string
+      valid = begin < end;
+    } else {
+      valid = ParseUint32(begin, end, &id);
+    }
+  }
+  if (!valid) {
+    Color::print_error(
+      StringPrintf("Invalid number in the first line of %s: %s",
+                   filename_.c_str(), data_line.c_str())
+    );
+    exit(0);
+  }
   if (count == 1) {
     return "libsvm";
   } else if (count == 2) {
     return "libffm";
-  } else if (count == 0){
-    return "csv";
   }
-  Color::print_error("Unknow file format");
-  exit(0);
+  return "csv";
 }
 
 // Find the last '\n' in block, and shrink back file pointer
@@ -115,10 +176,389 @@ void Reader::shrink_block(char* block, size_t* ret, FILE* file) {
   *ret = index + 1;
 }
 
+// The rows of the first block take the same memory per byte of the
+// text as the rest of the file, so the estimate is only rough for
+// the files whose rows change a lot, e.g., the sorted files.
+bool Reader::EstimateMatrix(const std::string& filename,
+                            size_t sample_mb,
+                            MatrixEstimate* estimate) {
+  CHECK_NOTNULL(estimate);
+  CHECK_GT(sample_mb, 0);
+  if (IsStreamFile(filename) || IsRemoteFile(filename) ||
+      !GetCompression(filename).empty() ||
+      IsParquetFile(filename) || !FileExist(filename.c_str())) {
+    return false;
+  }
+  filename_ = filename;
+  std::string format = check_file_format();
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(filename_.c_str(), "r");
+#else
+  FILE* file = OpenFileOrDie(filename_.c_str(), "rb");
+#endif
+  uint64 file_size = GetFileSize(file);
+  size_t size = std::min((uint64)sample_mb * 1024 * 1024, file_size);
+  std::vector<char> block(size);
+  size = ReadDataFromDisk(file, block.data(), size);
+  Close(file);
+  // Only the complete lines are parsed
+  while (size > 0 && block[size-1] != '\n') { size--; }
+  if (size == 0) { return false; }
+  Parser* parser = CreateParser(format.c_str());
+  CHECK_NOTNULL(parser);
+  parser->setLabel(has_label_);
+  parser->setSplitor(splitor_);
+  parser->setHashBits(hash_bits_);
+  parser->setSkipZeros(skip_zeros_);
+  parser->setMergeDuplicates(merge_dup_);
+  parser->setCrosses(crosses_);
+  parser->setNumLabels(num_label_);
+  parser->setThreadPool(pool_);
+  DMatrix matrix;
+  parser->Parse(block.data(), size, matrix, true);
+  delete parser;
+  estimate->text_bytes = file_size / num_shard_;
+  estimate->sample_bytes = size;
+  estimate->sample_rows = matrix.row_length;
+  // The nodes and the rows without the spare capacity of the
+  // vectors and of the arena, which do not grow with the file
+  uint64 nnz = 0;
+  uint64 packed = 0;
+  std::vector<char> buffer;
+  for (index_t i = 0; i < matrix.row_length; ++i) {
+    nnz += matrix.row[i]->size();
+    buffer.clear();
+    DMatrix::EncodeRow(matrix.row[i], &buffer);
+    packed += buffer.size();
+  }
+  estimate->sample_matrix_bytes = nnz * sizeof(Node) +
+      (uint64)matrix.row_length * (sizeof(SparseRow) +
+      sizeof(SparseRow*) + 2 * sizeof(real_t));
+  // The packed rows have their offsets instead of the rows
+  estimate->sample_packed_bytes = packed +
+      (uint64)matrix.row_length * (sizeof(uint64) + 2 * sizeof(real_t));
+  estimate->max_feat = matrix.MaxFeat();
+  estimate->max_field = matrix.MaxField();
+  return true;
+}
+
+// Return the head of the line after the byte offset - 1, which is
+// the offset if the byte before it is '\n', or the size of file.
+static uint64 line_head(FILE* file, uint64 offset, uint64 size) {
+  if (offset == 0 || offset >= size) { return std::min(offset, size); }
+  FileSeek(file, offset - 1);
+  char buffer[4096];
+  uint64 pos = offset - 1;
+  for (;;) {
+    size_t ret = fread(buffer, 1, sizeof(buffer), file);
+    if (ret == 0) { return size; }
+    const char* end = (const char*)memchr(buffer, '\n', ret);
+    if (end != nullptr) { return pos + (end - buffer) + 1; }
+    pos += ret;
+  }
+}
+
+// The shard is the lines that start in its bytes
+void Reader::init_shard() {
+  if (!sharded()) { return; }
+  if (compressed_ || IsStreamFile(filename_) || IsParquetFile(filename_)) {
+    Color::print_error(
+      StringPrintf("The file %s cannot be split into shards, since it is "
+                   "not a plain text file.", filename_.c_str())
+    );
+    exit(0);
+  }
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(filename_.c_str(), "r");
+#else
+  FILE* file = OpenFileOrDie(filename_.c_str(), "rb");
+#endif
+  uint64 size = GetFileSize(file);
+  shard_begin_ = line_head(file, size / num_shard_ * shard_ +
+                           size % num_shard_ * shard_ / num_shard_, size);
+  uint64 end = size / num_shard_ * (shard_ + 1) +
+               size % num_shard_ * (shard_ + 1) / num_shard_;
+  shard_end_ = line_head(file, end, size);
+  Close(file);
+  Color::print_info(
+    StringPrintf("Read the shard %lu of %lu of %s: bytes [%llu, %llu).",
+                 shard_, num_shard_, filename_.c_str(),
+                 (unsigned long long)shard_begin_,
+                 (unsigned long long)shard_end_)
+  );
+}
+
+std::string Reader::shard_suffix() const {
+  if (!sharded()) { return ""; }
+  return StringPrintf(".%lu-of-%lu", shard_, num_shard_);
+}
+
+// The block is shrunk to its last '\n' only if it is full, since
+// the shard ends at the head of a line.
+size_t Reader::read_shard_block(FILE* file, uint64 read_byte) {
+  uint64 pos = FileTell(file);
+  if (pos >= shard_end_) { return 0; }
+  uint64 limit = std::min(read_byte, shard_end_ - pos);
+  size_t ret = read_text(file, limit);
+  if (ret == read_byte && pos + ret < shard_end_) {
+    shrink_block(block_, &ret, file);
+  }
+  return ret;
+}
+
+void Reader::init_file_io(FILE* file) {
+  AdviseFile(file, 0, 0, kAdviseSequential);
+  if (file_io_ == kFileUring && !uring_.IsOpen() &&
+      !uring_.Open(filename_)) {
+    Color::print_warning(
+      StringPrintf("The file %s cannot be read by io_uring, so it is "
+                   "read by fread() (-io cache).", filename_.c_str())
+    );
+    file_io_ = kFileCached;
+  }
+  if (file_io_ != kFileDirect || direct_.IsOpen()) { return; }
+  if (!direct_.Open(filename_)) {
+    Color::print_warning(
+      StringPrintf("The file %s cannot be read by O_DIRECT, so its "
+                   "pages are dropped after they are read (-io nocache).",
+                   filename_.c_str())
+    );
+    file_io_ = kFileNoCache;
+  }
+}
+
+size_t Reader::read_text(FILE* file, uint64 read_byte) {
+  uint64 pos = FileTell(file);
+  size_t ret = 0;
+  if (direct_.IsOpen() || uring_.IsOpen()) {
+    ret = direct_.IsOpen() ? direct_.Read(pos, block_, read_byte) :
+                             uring_.Read(pos, block_, read_byte);
+    FileSeek(file, pos + ret);
+  } else {
+    ret = ReadDataFromDisk(file, block_, read_byte);
+    if (file_io_ == kFileNoCache && ret > 0) {
+      AdviseFile(file, pos, ret, kAdviseDontNeed);
+    }
+  }
+  return ret;
+}
+
+// Start to decompress the input
+FILE* Reader::open_compressed() {
+  if (remote_) {
+    FILE* file = remote_file_.Open(filename_);
+    if (file == nullptr) {
+      Color::print_error(
+        StringPrintf("The remote file %s cannot be read.",
+                     filename_.c_str())
+      );
+      exit(0);
+    }
+    LOG(INFO) << "Download " << filename_ << " by "
+              << RemoteFile::kConnections << " connections";
+    return file;
+  }
+  FILE* file = decompressor_.Open(filename_, pool_);
+  if (file == nullptr) {
+    if (GetCompression(filename_) == "zstd") {
+      Color::print_error(
+        StringPrintf("The zstd file %s is not supported. Please "
+                     "decompress it first.", filename_.c_str())
+      );
+    } else {
+      Color::print_error(
+        StringPrintf("xLearn is built without zlib, and the gzip "
+                     "file %s cannot be read.", filename_.c_str())
+      );
+    }
+    exit(0);
+  }
+  LOG(INFO) << "Decompress " << filename_
+            << (decompressor_.IsBgzf() ? " in parallel" : "");
+  return file;
+}
+
+void Reader::close_compressed() {
+  if (remote_) {
+    remote_file_.Close();
+  } else {
+    decompressor_.Close();
+  }
+}
+
+// The format is given by the first line of the first block,
+// which is kept in block_ for read_stream()
+std::string Reader::check_stream_format(FILE* file) {
+  carry_ = ReadDataFromDisk(file, block_, block_size_*1024*1024);
+  const char* end = (const char*)memchr(block_, '\n', carry_);
+  std::string data_line((const char*)block_,
+                        end == nullptr ? block_ + carry_ : end);
+  if (!data_line.empty() && data_line.back() == '\r') {
+    data_line.pop_back();
+  }
+  if (data_line.empty()) {
+    Color::print_error(
+      StringPrintf("The file %s has no data.", filename_.c_str())
+    );
+    exit(0);
+  }
+  return check_line_format(data_line);
+}
+
+// Fill the block after the carry_ bytes that are not parsed, and
+// return the size of the complete lines at the head of the block
+size_t Reader::read_stream(FILE* file) {
+  uint64 read_byte = block_size_ * 1024 * 1024;
+  if (carry_ < read_byte) {
+    carry_ += ReadDataFromDisk(file, block_ + carry_,
+                               read_byte - carry_);
+  }
+  // The stream ends, and the last line can have no '\n'
+  if (carry_ < read_byte) { return carry_; }
+  size_t index = carry_;
+  while (index > 0 && block_[index-1] != '\n') { index--; }
+  if (index == 0) {
+    LOG(FATAL) << "A line of " << filename_ << " is longer than the "
+               << "block size (" << block_size_ << " MB).";
+  }
+  return index;
+}
+
+// The rest of the block is parsed next time
+void Reader::drop_stream(size_t size) {
+  CHECK_LE(size, carry_);
+  carry_ -= size;
+  memmove(block_, block_ + size, carry_);
+}
+
 //------------------------------------------------------------------------------
 // Implementation of InmemReader
 //------------------------------------------------------------------------------
 
+index_t Reader::HashRow(const SparseRow* row, int seed, int bits) {
+  uint64 h = row == nullptr ? 0 :
+             HashString((const char*)row->begin(),
+                        (const char*)row->end());
+  return HashFeature(h ^ ((uint64)seed * 0x9e3779b97f4a7c15ULL), bits);
+}
+
+index_t Reader::MinHashRow(const SparseRow* row) {
+  index_t key = std::numeric_limits<index_t>::max();
+  if (row == nullptr) { return key; }
+  for (SparseRow::const_iterator it = row->begin();
+       it != row->end(); ++it) {
+    key = std::min(key, HashFeature(it->feat_id, 31));
+  }
+  return key;
+}
+
+// The windows are sorted by the keys of their rows, which are
+// hashed again in each pass, since the rows can be renumbered.
+void Reader::sort_windows(const DMatrix& matrix,
+                          std::vector<index_t>* order) {
+  if (shuffle_window_ <= 1) { return; }
+  std::vector<std::pair<index_t, index_t>> keys;
+  for (size_t begin = 0; begin < order->size(); begin += shuffle_window_) {
+    size_t end = std::min(order->size(), begin + shuffle_window_);
+    keys.clear();
+    for (size_t i = begin; i < end; ++i) {
+      index_t row = (*order)[i];
+      keys.emplace_back(MinHashRow(matrix.row[row]), row);
+    }
+    std::stable_sort(keys.begin(), keys.end(),
+        [](const std::pair<index_t, index_t>& a,
+           const std::pair<index_t, index_t>& b) {
+          return a.first < b.first;
+        });
+    for (size_t i = begin; i < end; ++i) {
+      (*order)[i] = keys[i - begin].second;
+    }
+  }
+}
+
+// Hash the nodes of the row with the seed, which gives a
+// number in [0, 2^24) that is compared with the rate.
+bool Reader::keep_row(const DMatrix& matrix, index_t i) {
+  if (neg_rate_ >= 1.0 || matrix.Y[i] > 0) { return true; }
+  return HashRow(matrix.row[i], seed_, 24) < neg_rate_ * (1 << 24);
+}
+
+// The dropped rows are deleted if they are not in the arena.
+void Reader::sample_rows(DMatrix* matrix) {
+  if (neg_rate_ >= 1.0) { return; }
+  bool has_group = matrix->HasGroup();
+  index_t k = 0;
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    if (!keep_row(*matrix, i)) {
+      if (matrix->row[i] != nullptr && !matrix->row[i]->InArena()) {
+        delete matrix->row[i];
+      }
+      continue;
+    }
+    matrix->row[k] = matrix->row[i];
+    matrix->Y[k] = matrix->Y[i];
+    matrix->norm[k] = matrix->norm[i];
+    if (has_group) { matrix->group[k] = matrix->group[i]; }
+    matrix->CopyTaskLabels(k, *matrix, i);
+    k++;
+  }
+  matrix->row.resize(k);
+  matrix->Y.resize(k);
+  matrix->norm.resize(k);
+  if (has_group) { matrix->group.resize(k); }
+  matrix->task_Y.resize((size_t)k * (matrix->num_task - 1));
+  matrix->row_length = k;
+}
+
+void Reader::remap_features(DMatrix* matrix) {
+  if (feature_map_ == nullptr) { return; }
+  const std::vector<index_t>& map = *feature_map_;
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    SparseRow* row = matrix->row[i];
+    if (row == nullptr) { continue; }
+    for (SparseRow::iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      if (iter->feat_id < map.size()) {
+        iter->feat_id = map[iter->feat_id];
+      }
+    }
+  }
+}
+
+void Reader::remap_fields(DMatrix* matrix) {
+  if (field_map_ == nullptr) { return; }
+  const std::vector<index_t>& map = *field_map_;
+  index_t none = map.size();
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    SparseRow* row = matrix->row[i];
+    if (row == nullptr) { continue; }
+    for (SparseRow::iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      iter->field_id = iter->field_id < map.size() ?
+                       map[iter->field_id] : none;
+    }
+  }
+}
+
+void Reader::copy_options(Reader* reader) const {
+  CHECK_NOTNULL(reader);
+  reader->block_size_ = block_size_;
+  reader->bin_out_ = bin_out_;
+  reader->seed_ = seed_;
+  reader->hash_bits_ = hash_bits_;
+  reader->skip_zeros_ = skip_zeros_;
+  reader->merge_dup_ = merge_dup_;
+  reader->num_label_ = num_label_;
+  reader->crosses_ = crosses_;
+  reader->cross_hash_ = cross_hash_;
+  reader->neg_rate_ = neg_rate_;
+  reader->shuffle_window_ = shuffle_window_;
+  reader->pack_rows_ = pack_rows_;
+  reader->file_io_ = file_io_;
+  reader->pool_ = pool_;
+  reader->show_info_ = show_info_;
+}
+
 // Pre-load all the data into memory buffer (data_buf_).
 // Note that this function will first check whether we
 // can use the existing binary file. If not, reader will 
@@ -126,25 +566,37 @@ void Reader::shrink_block(char* block, size_t* ret, FILE* file) {
 void InmemReader::Initialize(const std::string& filename) {
   CHECK_NE(filename.empty(), true)
   filename_ = filename;
-  Color::print_info("First check if the text file has been already "
-                    "converted to binary format.");
+  remote_ = IsRemoteFile(filename_);
+  compressed_ = remote_ || !GetCompression(filename_).empty();
+  init_shard();
+  if (show_info_) {
+    Color::print_info("First check if the text file has been already "
+                      "converted to binary format.");
+  }
   // HashBinary() will read the first two hash value
   // and then check it whether equal to the hash value generated
-  // by HashFile() function from current txt file.
-  if (hash_binary(filename_)) {
-    Color::print_info(
-      StringPrintf("Binary file (%s.bin) found. "
-                   "Skip converting text to binary.",
-                   filename_.c_str())
-    );
-    filename_ += ".bin";
+  // by HashFileStamp() and HashFileSample() from current txt file.
+  // The remote file has no stamp, so it is parsed each time.
+  if (init_from_shared()) {
+    return;
+  } else if (!remote_ && hash_binary(filename_)) {
+    if (show_info_) {
+      Color::print_info(
+        StringPrintf("Binary file (%s%s.bin) found. "
+                     "Skip converting text to binary.",
+                     filename_.c_str(), shard_suffix().c_str())
+      );
+    }
+    filename_ += shard_suffix() + ".bin";
     init_from_binary();
   } else {
-    Color::print_info(
-      StringPrintf("Binary file (%s.bin) NOT found. Convert text "
-                   "file to binary file.",
-                   filename_.c_str())
-    );
+    if (show_info_) {
+      Color::print_info(
+        StringPrintf("Binary file (%s%s.bin) NOT found. Convert text "
+                     "file to binary file.",
+                     filename_.c_str(), shard_suffix().c_str())
+      );
+    }
     // Allocate memory for block
     try {
       this->block_ = (char*)malloc(block_size_*1024*1024);
@@ -159,10 +611,11 @@ void InmemReader::Initialize(const std::string& filename) {
 }
 
 // Check whether current path has a binary file.
-// We use double check here, that is, we first check 
-// the hash value of a small data block, then check the whole file.
+// We use double check here, that is, we first check the hash
+// value of the file stamp (size, mtime and inode), then check
+// the sampled blocks, so the text file is not read all.
 bool InmemReader::hash_binary(const std::string& filename) {
-  std::string bin_file = filename + ".bin";
+  std::string bin_file = filename + shard_suffix() + ".bin";
   // If the ".bin" file does not exists, return false.
   if (!FileExist(bin_file.c_str())) { return false; }
 #ifndef _MSC_VER
@@ -173,14 +626,14 @@ bool InmemReader::hash_binary(const std::string& filename) {
   // Check the first hash value
   uint64 hash_1 = 0;
   ReadDataFromDisk(file, (char*)&hash_1, sizeof(hash_1));
-  if (hash_1 != HashFile(filename, true)) {
+  if (hash_1 != bin_hash(HashFileStamp(filename))) {
     Close(file);
     return false;
   }
   // Check the second hash value
   uint64 hash_2 = 0;
   ReadDataFromDisk(file, (char*)&hash_2, sizeof(hash_2));
-  if (hash_2 != HashFile(filename, false)) {
+  if (hash_2 != bin_hash(HashFileSample(filename))) {
     Close(file);
     return false;
   }
@@ -190,94 +643,421 @@ bool InmemReader::hash_binary(const std::string& filename) {
 
 // In-memory Reader can be initialized from binary file.
 void InmemReader::init_from_binary() {
-  // Init data_buf_                               
-  data_buf_.Deserialize(filename_);
+  TraceSpan span("deserialize", "reader");
+  // Init data_buf_ from the mapped file, which is read
+  // from the page cache without the fread() for each row.
+  MappedFile bin;
+  if (bin.Map(filename_) && bin.size() > 0) {
+    bin.Advise(MappedFile::kSequential);
+    bin.Advise(MappedFile::kWillNeed);
+    uint64 bytes = data_buf_.Deserialize(bin.data(), bin.size(), pool_);
+    // The old file has no stats after the matrix
+    const char* ptr = bin.data() + bytes;
+    has_stats_ = stats_.Deserialize(&ptr, bin.data() + bin.size());
+    bin.Unmap();
+  } else {
+    data_buf_.Deserialize(filename_, pool_);
+  }
   has_label_ = data_buf_.has_label;
+  share_buffer();
+  sample_buffer();
   // Init data_samples_
   num_samples_ = data_buf_.row_length;
   data_samples_.ReAlloc(num_samples_);
+  data_samples_.SetNumTask(data_buf_.num_task);
   // for shuffle
   order_.resize(num_samples_);
   for (int i = 0; i < order_.size(); ++i) {
     order_[i] = i;
   }
+  pack_buffer();
 }
 
-// Pre-load all the data to memory buffer from txt file.
-void InmemReader::init_from_txt() {
+// The name of the shared data of the file is given by its
+// hash value, so it is not used after the file is changed.
+bool InmemReader::init_from_shared() {
+  if (shared_data_.empty() || remote_) { return false; }
+  uint64 hash_1 = bin_hash(HashFileStamp(filename_));
+  uint64 hash_2 = bin_hash(HashFileSample(filename_));
+  std::string name = StringPrintf("/%s.%016llx", shared_data_.c_str(),
+                                  (unsigned long long)hash_1);
+  if (!shared_.Attach(name, hash_1, hash_2, &data_buf_)) { return false; }
+  Color::print_info(
+    StringPrintf("Shared data (%s, %.1f MB) found. Skip reading %s.",
+                 name.c_str(), shared_.Size() / 1024.0 / 1024.0,
+                 filename_.c_str())
+  );
+  has_label_ = data_buf_.has_label;
+  sample_buffer();
+  // Init data_samples_
+  num_samples_ = data_buf_.row_length;
+  data_samples_.ReAlloc(num_samples_, has_label_);
+  data_samples_.SetNumTask(data_buf_.num_task);
+  // for shuffle
+  order_.resize(num_samples_);
+  for (int i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  return true;
+}
+
+// The rows of data_buf_ are moved to the shared memory, and
+// the writer of the bin file reads them, so it is waited for.
+void InmemReader::share_buffer() {
+  if (shared_data_.empty() || remote_) { return; }
+  WaitBinary();
+  std::string name = StringPrintf("/%s.%016llx", shared_data_.c_str(),
+                                  (unsigned long long)data_buf_.hash_value_1);
+  if (!shared_.Create(name, &data_buf_) &&
+      shared_.Attach(name, data_buf_.hash_value_1,
+                     data_buf_.hash_value_2, &data_buf_)) {
+    // Another process has created it in the meantime
+    Color::print_info(
+      StringPrintf("Shared data (%s) found. Use it instead of the "
+                   "data of %s.", name.c_str(), filename_.c_str())
+    );
+  } else if (shared_.IsOpen() || shared_.Create(name, &data_buf_)) {
+    // Attach() removes the region of a crashed process
+    Color::print_info(
+      StringPrintf("Shared data (%s, %.1f MB) created for the other "
+                   "processes.", name.c_str(),
+                   shared_.Size() / 1024.0 / 1024.0)
+    );
+  } else {
+    Color::print_warning(
+      StringPrintf("Cannot create the shared data (%s), and the data "
+                   "of %s is not shared.", name.c_str(), filename_.c_str())
+    );
+  }
+}
+
+// Parse the txt file to the data buffer.
+void InmemReader::parse_txt() {
+  TraceSpan span("parse_txt", "reader");
   // Init parser_                       
-  parser_ = CreateParser(check_file_format().c_str());
+  FILE* text_file = nullptr;
+  if (compressed_) {
+    text_file = open_compressed();
+    parser_ = CreateParser(check_stream_format(text_file).c_str());
+  } else {
+    parser_ = CreateParser(check_file_format().c_str());
+  }
   if (has_label_) parser_->setLabel(true);
   else parser_->setLabel(false);
   // Set splitor
   parser_->setSplitor(this->splitor_);
-  // Convert MB to Byte
-  uint64 read_byte = block_size_ * 1024 * 1024;
-  // Open file
+  parser_->setHashBits(this->hash_bits_);
+  parser_->setSkipZeros(this->skip_zeros_);
+  parser_->setMergeDuplicates(this->merge_dup_);
+  parser_->setCrosses(this->crosses_);
+  parser_->setNumLabels(this->num_label_);
+  parser_->setThreadPool(this->pool_);
+  MappedFile text;
+  if (compressed_) {
+    // Parse the decompressed text block by block
+    for (size_t size; (size = read_stream(text_file)) > 0; ) {
+      parser_->Parse(block_, size, data_buf_, false, &stats_);
+      drop_stream(size);
+    }
+    close_compressed();
+  } else if ((file_io_ == kFileCached || file_io_ == kFileNoCache) &&
+             text.Map(filename_)) {
+    // Parse the mapped file in one pass, so the parser splits
+    // the whole file for the threads, and nothing is copied.
+    text.Advise(MappedFile::kSequential);
+    uint64 begin = 0, end = text.size();
+    if (sharded()) {
+      begin = shard_begin_;
+      end = shard_end_;
+    }
+    if (end > begin) {
+      parser_->Parse(text.data() + begin, end - begin,
+                     data_buf_, false, &stats_);
+    }
+    text.Unmap();
+    // The pages are not used once the file is parsed
+    if (file_io_ == kFileNoCache) {
+      FILE* file = OpenFileOrDie(filename_.c_str(), "rb");
+      AdviseFile(file, 0, 0, kAdviseDontNeed);
+      Close(file);
+    }
+  } else {
+    // Convert MB to Byte
+    uint64 read_byte = block_size_ * 1024 * 1024;
+    // Open file
 #ifndef _MSC_VER
-  FILE* file = OpenFileOrDie(filename_.c_str(), "r");
+    FILE* file = OpenFileOrDie(filename_.c_str(), "r");
 #else
-  FILE* file = OpenFileOrDie(filename_.c_str(), "rb");
+    FILE* file = OpenFileOrDie(filename_.c_str(), "rb");
 #endif
-  // Read until the end of file
-  for (;;) {
-    // Read a block of data from disk file
-    size_t ret = ReadDataFromDisk(file, block_, read_byte);
-    if (ret == 0) {
-      break;
-    } else if (ret == read_byte) {
-      // Find the last '\n', and shrink back file pointer
-      this->shrink_block(block_, &ret, file);
-    } // else ret < read_byte: we don't need shrink_block()
-    parser_->Parse(block_, ret, data_buf_, false);
+    init_file_io(file);
+    if (sharded()) {
+      FileSeek(file, shard_begin_);
+      for (size_t ret; (ret = read_shard_block(file, read_byte)) > 0; ) {
+        parser_->Parse(block_, ret, data_buf_, false, &stats_);
+      }
+    }
+    // Read until the end of file
+    while (!sharded()) {
+      // Read a block of data from disk file
+      size_t ret = read_text(file, read_byte);
+      if (ret == 0) {
+        break;
+      } else if (ret == read_byte) {
+        // Find the last '\n', and shrink back file pointer
+        this->shrink_block(block_, &ret, file);
+      } // else ret < read_byte: we don't need shrink_block()
+      parser_->Parse(block_, ret, data_buf_, false, &stats_);
+    }
+    Close(file);
   }
-  data_buf_.SetHash(HashFile(filename_, true),
-                    HashFile(filename_, false));
+  has_stats_ = true;
+}
+
+// Pre-load all the data to memory buffer from txt file.
+void InmemReader::init_from_txt() {
+  if (IsParquetFile(filename_)) {
+    // The columns are read to the rows directly
+    ReadParquet(filename_, hash_bits_, pool_, &data_buf_, &has_label_);
+  } else {
+    parse_txt();
+  }
+  data_buf_.SetHash(bin_hash(HashFileStamp(filename_)),
+                    bin_hash(HashFileSample(filename_)));
   data_buf_.has_label = has_label_;
+  // Deserialize in-memory buffer to disk file, which
+  // goes on while the first epoch trains
+  if (bin_out_ && !remote_) {
+    bin_writer_ = std::thread(&InmemReader::write_binary, this,
+                              filename_ + shard_suffix() + ".bin");
+  }
+  // The bin file keeps all the rows
+  if (neg_rate_ < 1.0) { WaitBinary(); }
+  share_buffer();
+  sample_buffer();
   // Init data_samples_ 
   num_samples_ = data_buf_.row_length;
   data_samples_.ReAlloc(num_samples_, has_label_);
+  data_samples_.SetNumTask(data_buf_.num_task);
   // for shuffle
   order_.resize(num_samples_);
   for (int i = 0; i < order_.size(); ++i) {
     order_[i] = i;
   }
-  // Deserialize in-memory buffer to disk file.
-  if (bin_out_) {
-    std::string bin_file = filename_ + ".bin";
-    data_buf_.Serialize(bin_file);
-  }
   delete [] block_;
+  block_ = nullptr;
+  pack_buffer();
+}
+
+void InmemReader::write_binary(const std::string& bin_file) {
+  TraceSpan span("serialize", "reader");
+  std::string tmp = bin_file + ".tmp";
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(tmp.c_str(), "w");
+#else
+  FILE* file = OpenFileOrDie(tmp.c_str(), "wb");
+#endif
+  data_buf_.Serialize(file, pool_);
+  // The stats are after the matrix
+  if (has_stats_) { stats_.Serialize(file); }
   Close(file);
+#ifdef _MSC_VER
+  // rename() does not replace the file on Windows
+  if (FileExist(bin_file.c_str())) {
+    RemoveFile(bin_file.c_str());
+  }
+#endif
+  if (std::rename(tmp.c_str(), bin_file.c_str()) != 0) {
+    LOG(ERR) << "Cannot rename " << tmp << " to " << bin_file;
+  }
+}
+
+// Apply the negative sampling to the data buffer.
+void InmemReader::sample_buffer() {
+  if (neg_rate_ >= 1.0) { return; }
+  index_t num_rows = data_buf_.row_length;
+  sample_rows(&data_buf_);
+  Color::print_info(
+    StringPrintf("Negative sampling (rate %g) keeps %u of %u rows.",
+                 neg_rate_, data_buf_.row_length, num_rows)
+  );
+}
+
+// The writer of the bin file and the shared data read the rows, so
+// the rows are packed after the bin file, and the shared rows are not.
+void InmemReader::pack_buffer() {
+  if (!pack_rows_ || shared_.IsOpen() || data_buf_.row_length == 0) {
+    return;
+  }
+  WaitBinary();
+  uint64 bytes = data_buf_.arena.Bytes() +
+                 data_buf_.row.capacity() * sizeof(SparseRow*);
+  packed_.Pack(data_buf_, pool_);
+  for (size_t i = 0; i < data_buf_.row.size(); ++i) {
+    if (data_buf_.row[i] != nullptr && !data_buf_.row[i]->InArena()) {
+      delete data_buf_.row[i];
+    }
+  }
+  std::vector<SparseRow*>().swap(data_buf_.row);
+  data_buf_.arena.Clear();
+  num_samples_ = std::min(data_buf_.row_length, kPackedBatch);
+  resize_samples(num_samples_);
+  if (show_info_) {
+    Color::print_info(
+      StringPrintf("Pack %u rows of %s into %s.", data_buf_.row_length,
+                   PrintSize(bytes).c_str(),
+                   PrintSize(packed_.Bytes()).c_str())
+    );
+  }
+}
+
+// The rows of data_samples_ belong to the arenas of packed_.
+void InmemReader::resize_samples(index_t rows) {
+  data_samples_.row.assign(data_samples_.row.size(), nullptr);
+  data_samples_.ReAlloc(rows, has_label_);
+  data_samples_.SetNumTask(data_buf_.num_task);
+  batch_ids_.resize(rows);
+}
+
+void InmemReader::own_buffer() {
+  if (!shared_.IsOpen()) { return; }
+  for (index_t i = 0; i < data_buf_.row_length; ++i) {
+    const SparseRow* row = data_buf_.row[i];
+    data_buf_.row[i] = data_buf_.arena.NewRow(row->begin(), row->end());
+  }
+  shared_.Close();
+}
+
+// The packed rows are renumbered by Samples() after they are decoded.
+void InmemReader::SetFeatureMap(const std::vector<index_t>* map) {
+  WaitBinary();
+  CHECK(feature_map_ == nullptr);
+  own_buffer();
+  feature_map_ = map;
+  if (!Packed()) { remap_features(&data_buf_); }
+}
+
+void InmemReader::SetFieldMap(const std::vector<index_t>* map) {
+  WaitBinary();
+  CHECK(field_map_ == nullptr);
+  own_buffer();
+  field_map_ = map;
+  if (!Packed()) { remap_fields(&data_buf_); }
 }
 
 // Sample data from memory buffer.
 index_t InmemReader::Samples(DMatrix* &matrix) {
-  for (int i = 0; i < num_samples_; ++i) {
-    if (pos_ >= data_buf_.row_length) {
+  const std::vector<index_t>& order = loss_sampled_ ? loss_order_ : order_;
+  if (track_loss_) {
+    row_loss_.ids.resize(num_samples_);
+    row_loss_.weight.resize(num_samples_);
+    row_loss_.batch_weight = 0;
+  }
+  // The last batch of the packed rows can be shorter
+  bool packed = Packed();
+  if (packed && pos_ < order.size()) {
+    index_t rows = std::min((size_t)num_samples_, order.size() - pos_);
+    if (data_samples_.row_length != rows) { resize_samples(rows); }
+  }
+  for (int i = 0; i < data_samples_.row_length; ++i) {
+    if (pos_ >= order.size()) {
       // End of the data buffer
       if (i == 0) {
-        if (shuffle_) {
-          srand(this->seed_+1);
-          random_shuffle(order_.begin(), order_.end());
-        }
+        EndPass();
         matrix = nullptr;
         return 0;
       }
       break;
     }
     // Copy data between different DMatrix.
-    data_samples_.row[i] = data_buf_.row[order_[pos_]];
-    data_samples_.Y[i] = data_buf_.Y[order_[pos_]];
-    data_samples_.norm[i] = data_buf_.norm[order_[pos_]];
+    index_t id = order[pos_];
+    if (packed) {
+      batch_ids_[i] = id;
+    } else {
+      data_samples_.row[i] = data_buf_.row[id];
+    }
+    data_samples_.Y[i] = data_buf_.Y[id];
+    data_samples_.norm[i] = data_buf_.norm[id];
+    if (data_buf_.HasGroup()) {
+      data_samples_.SetGroup(i, data_buf_.group[id]);
+    }
+    data_samples_.CopyTaskLabels(i, data_buf_, id);
+    if (track_loss_) {
+      real_t weight = loss_sampled_ ? loss_weight_[pos_] : 1.0;
+      row_loss_.ids[i] = id;
+      row_loss_.weight[i] = weight;
+      row_loss_.batch_weight += weight;
+    }
     pos_++;
   }
+  if (packed) {
+    packed_.Unpack(batch_ids_.data(), data_samples_.row_length,
+                   data_samples_.row.data(), pool_);
+    remap_features(&data_samples_);
+    remap_fields(&data_samples_);
+  }
   matrix = &data_samples_;
-  return num_samples_;
+  return data_samples_.row_length;
+}
+
+// The new order of the rows for the next pass.
+void InmemReader::EndPass() {
+  pos_ = data_buf_.row_length;
+  if (shuffle_) {
+    srand(this->seed_+1);
+    random_shuffle(order_.begin(), order_.end());
+    sort_windows(data_buf_, &order_);
+  }
 }
 
-// Return to the beginning of the data buffer.
-void InmemReader::Reset() { pos_ = 0; }
+// Return to the beginning of the data buffer, and the rows of
+// the new pass are sampled by their loss if SetLossRate() < 1.
+void InmemReader::Reset() {
+  pos_ = 0;
+  if (!track_loss_) { return; }
+  loss_sampled_ = false;
+  if (loss_rate_ < 1) { sample_by_loss(); }
+  if (Packed()) { return; }
+  // The pass is read in one batch of all its rows
+  index_t rows = loss_sampled_ ? loss_order_.size() : order_.size();
+  if (data_samples_.row_length != rows) {
+    // The rows of data_samples_ belong to data_buf_
+    data_samples_.row.assign(data_samples_.row.size(), nullptr);
+    data_samples_.ReAlloc(rows, has_label_);
+    data_samples_.SetNumTask(data_buf_.num_task);
+    num_samples_ = rows;
+  }
+}
+
+RowLoss* InmemReader::TrackLoss() {
+  if (!track_loss_) {
+    row_loss_.loss.assign(data_buf_.row_length, 0);
+    loss_generator_.seed(seed_);
+    track_loss_ = true;
+  }
+  return &row_loss_;
+}
+
+// The rows are kept in the shuffled order, so the sampled pass is
+// still random, and the rows that are never trained have no loss.
+void InmemReader::sample_by_loss() {
+  const std::vector<real_t>& loss = row_loss_.loss;
+  double sum = 0;
+  for (size_t i = 0; i < order_.size(); ++i) { sum += loss[order_[i]]; }
+  if (sum <= 0) { return; }
+  double scale = loss_rate_ * order_.size() / sum;
+  double least = loss_rate_ * kMinLossShare;
+  std::uniform_real_distribution<double> dis(0.0, 1.0);
+  loss_order_.clear();
+  loss_weight_.clear();
+  for (size_t i = 0; i < order_.size(); ++i) {
+    double p = std::min(std::max(loss[order_[i]] * scale, least), 1.0);
+    if (p < 1 && dis(loss_generator_) >= p) { continue; }
+    loss_order_.push_back(order_[i]);
+    loss_weight_.push_back(1.0 / p);
+  }
+  loss_sampled_ = !loss_order_.empty();
+}
 
 //------------------------------------------------------------------------------
 // Implementation of OndiskReader.
@@ -287,15 +1067,28 @@ void InmemReader::Reset() { pos_ = 0; }
 void OndiskReader::Initialize(const std::string& filename) {
   CHECK_NE(filename.empty(), true);
   this->filename_ = filename;
-  // Init parser_                                 
-  parser_ = CreateParser(check_file_format().c_str());
-  if (has_label_) parser_->setLabel(true);
-  else parser_->setLabel(false);
-  // Set splitor
-  parser_->setSplitor(this->splitor_);
+  stream_ = IsStreamFile(filename_);
+  remote_ = IsRemoteFile(filename_);
+  compressed_ = remote_ ||
+                (!stream_ && !GetCompression(filename_).empty());
+  init_shard();
+  if (IsParquetFile(filename_)) {
+    Color::print_error(
+      StringPrintf("The Parquet file %s can only be read by "
+                   "in-memory training.", filename_.c_str())
+    );
+    exit(0);
+  }
+  // The blocks of a file can be sized in the first pass
+  if (auto_block_ && !seekable()) { auto_block_ = false; }
+  block_bytes_ = (uint64)block_size_ * 1024 * 1024;
+  if (auto_block_) {
+    block_bytes_ = std::min(block_bytes_, kAutoBlockStart);
+  }
+  block_capacity_ = block_bytes_;
   // Allocate memory for block
   try {
-    this->block_ = (char*)malloc(block_size_*1024*1024);
+    this->block_ = (char*)malloc(block_capacity_);
   } catch (std::bad_alloc&) {
     LOG(FATAL) << "Cannot allocate enough memory for data  \
                    block. Block size: " 
@@ -303,61 +1096,571 @@ void OndiskReader::Initialize(const std::string& filename) {
                << "You set change the block size via configuration.";
   }
   // Open file
+  std::string format;
+  if (stream_) {
+    if (filename_ == kStdinFile) {
+      file_ptr_ = stdin;
+    } else {
 #ifndef _MSC_VER
-  file_ptr_ = OpenFileOrDie(filename_.c_str(), "r");
+      file_ptr_ = OpenFileOrDie(filename_.c_str(), "r");
 #else
-  file_ptr_ = OpenFileOrDie(filename_.c_str(), "rb");
+      file_ptr_ = OpenFileOrDie(filename_.c_str(), "rb");
 #endif
+    }
+    // The stream cannot be opened again
+    format = check_stream_format(file_ptr_);
+  } else if (compressed_) {
+    file_ptr_ = open_compressed();
+    format = check_stream_format(file_ptr_);
+  } else {
+    format = check_file_format();
+#ifndef _MSC_VER
+    file_ptr_ = OpenFileOrDie(filename_.c_str(), "r");
+#else
+    file_ptr_ = OpenFileOrDie(filename_.c_str(), "rb");
+#endif
+    init_file_io(file_ptr_);
+    if (sharded()) { FileSeek(file_ptr_, shard_begin_); }
+  }
+  // Init parser_                                 
+  parser_ = CreateParser(format.c_str());
+  if (has_label_) parser_->setLabel(true);
+  else parser_->setLabel(false);
+  // Set splitor
+  parser_->setSplitor(this->splitor_);
+  parser_->setHashBits(this->hash_bits_);
+  parser_->setSkipZeros(this->skip_zeros_);
+  parser_->setMergeDuplicates(this->merge_dup_);
+  parser_->setCrosses(this->crosses_);
+  parser_->setNumLabels(this->num_label_);
+  parser_->setThreadPool(this->pool_);
+  if (stream_ || remote_) {
+    // The cache of a stream is only used by current run
+    cache_file_ = OutputPrefix(filename_) + ".disk.bin";
+    if (bin_out_) { create_cache(); }
+    return;
+  }
+  // Use the binary cache if it is made from current txt file
+  cache_file_ = filename_ + shard_suffix() + ".disk.bin";
+  cache_hash_1_ = bin_hash(HashFileStamp(filename_));
+  cache_hash_2_ = bin_hash(HashFileSample(filename_));
+  if (open_cache()) {
+    if (show_info_) {
+      Color::print_info(
+        StringPrintf("Binary cache (%s) found. Skip parsing "
+                     "the text file.", cache_file_.c_str())
+      );
+    }
+    // Nothing is decompressed
+    if (compressed_) {
+      close_compressed();
+      file_ptr_ = nullptr;
+    }
+  } else if (bin_out_) {
+    create_cache();
+  }
 }
 
 // Return to the beginning of the file
 void OndiskReader::Reset() {
-  int ret = fseek(file_ptr_, 0, SEEK_SET);
-  if (ret != 0) {
-    LOG(FATAL) << "Fail to return to the head of file.";
+  stop_loader();
+  // The stream goes on from current position, and
+  // the later passes read the cache (if any)
+  if (!cache_.IsMapped() && !stream_) {
+    if (compressed_) {
+      // Decompress the file again
+      close_compressed();
+      file_ptr_ = open_compressed();
+      carry_ = 0;
+    } else if (sharded()) {
+      FileSeek(file_ptr_, shard_begin_);
+    } else if (fseek(file_ptr_, 0, SEEK_SET) != 0) {
+      LOG(FATAL) << "Fail to return to the head of file.";
+    }
+    // The offsets and the stats of an unfinished pass are found
+    // again, and so are the blocks of the adjusted size
+    if (!text_done_) {
+      text_offsets_.clear();
+      stats_ = DataStats();
+      if (auto_block_) { block_cache_.Clear(); }
+    }
+    // The cache of an unfinished pass is written again
+    if (cache_out_ != nullptr) {
+      abort_cache();
+      create_cache();
+    }
+  }
+  next_block_ = 0;
+  epoch_++;
+  // Random order of the blocks
+  block_order_.clear();
+  size_t num_blocks = 0;
+  if (cache_.IsMapped()) {
+    num_blocks = block_offsets_.size();
+  } else if (text_done_ && seekable()) {
+    num_blocks = text_offsets_.size();
+  }
+  if (shuffle_ && num_blocks > 0) {
+    block_order_ = shuffle_blocks(num_blocks, epoch_);
+  }
+  // The kept blocks know when they are used again
+  if (block_cache_.Enabled()) {
+    std::vector<size_t> rank(num_blocks), next_rank(num_blocks);
+    std::vector<size_t> next_order;
+    if (shuffle_ && num_blocks > 0) {
+      next_order = shuffle_blocks(num_blocks, epoch_ + 1);
+    }
+    for (size_t i = 0; i < num_blocks; ++i) {
+      rank[block_order_.empty() ? i : block_order_[i]] = i;
+      next_rank[next_order.empty() ? i : next_order[i]] = i;
+    }
+    block_cache_.StartPass(rank, next_rank);
+  }
+  skipped_ = false;
+  // No read ahead for the blocks in random order
+  cache_.Advise(block_order_.empty() ? MappedFile::kSequential
+                                     : MappedFile::kRandom);
+  if (!cache_.IsMapped() && seekable()) {
+    AdviseFile(file_ptr_, 0, 0, block_order_.empty() ? kAdviseSequential
+                                                     : kAdviseRandom);
+  }
+  eof_ = false;
+}
+
+// The order is given by the seed and the epoch, so the
+// order of the next pass is known before it starts
+std::vector<size_t> OndiskReader::shuffle_blocks(size_t num_blocks,
+                                                 uint32 epoch) {
+  std::vector<size_t> order(num_blocks);
+  for (size_t i = 0; i < num_blocks; ++i) {
+    order[i] = i;
+  }
+  std::default_random_engine generator(seed_ + epoch);
+  std::shuffle(order.begin(), order.end(), generator);
+  return order;
+}
+
+// Map the cache and read the offsets of the blocks
+bool OndiskReader::open_cache() {
+  if (!FileExist(cache_file_.c_str())) { return false; }
+  if (!cache_.Map(cache_file_)) { return false; }
+  const char* data = cache_.data();
+  uint64 size = cache_.size();
+  uint64 head[2] = { 0, 0 };
+  uint64 tail[2] = { 0, 0 };
+  if (size >= sizeof(head) + sizeof(tail)) {
+    memcpy(head, data, sizeof(head));
+    memcpy(tail, data + size - sizeof(tail), sizeof(tail));
+  }
+  if (head[0] != cache_hash_1_ || head[1] != cache_hash_2_ ||
+      tail[1] != kCacheMagic || tail[0] >= size) {
+    cache_.Unmap();
+    return false;
+  }
+  const char* ptr = data + tail[0];
+  ReadVectorFromBuffer(&ptr, data + size, block_offsets_);
+  // The old cache has no stats after the offsets
+  has_stats_ = stats_.Deserialize(&ptr, data + size - sizeof(tail));
+  cache_.Advise(MappedFile::kSequential);
+  next_block_ = 0;
+  return true;
+}
+
+// Start to write the cache from the head of txt file
+void OndiskReader::create_cache() {
+#ifndef _MSC_VER
+  cache_out_ = OpenFileOrDie(cache_file_.c_str(), "w");
+#else
+  cache_out_ = OpenFileOrDie(cache_file_.c_str(), "wb");
+#endif
+  WriteDataToDisk(cache_out_, (char*)&cache_hash_1_, sizeof(cache_hash_1_));
+  WriteDataToDisk(cache_out_, (char*)&cache_hash_2_, sizeof(cache_hash_2_));
+  block_offsets_.clear();
+}
+
+// Write the offsets, and then read the blocks from the cache
+void OndiskReader::finish_cache() {
+  if (block_offsets_.empty()) {
+    abort_cache();
+    return;
+  }
+  uint64 tail[2] = { FileTell(cache_out_), kCacheMagic };
+  WriteVectorToFile(cache_out_, block_offsets_);
+  stats_.Serialize(cache_out_);
+  WriteDataToDisk(cache_out_, (char*)tail, sizeof(tail));
+  Close(cache_out_);
+  cache_out_ = nullptr;
+  if (!open_cache()) {
+    LOG(FATAL) << "Fail to open the binary cache " << cache_file_;
+  }
+  // We are at the end of the data
+  next_block_ = block_offsets_.size();
+}
+
+// Remove the cache that has not been finished
+void OndiskReader::abort_cache() {
+  if (cache_out_ == nullptr) { return; }
+  Close(cache_out_);
+  cache_out_ = nullptr;
+  RemoveFile(cache_file_.c_str());
+  block_offsets_.clear();
+}
+
+// Read and parse the next block of file, or read it from the cache
+bool OndiskReader::read_block(DMatrix* matrix) {
+  TraceSpan span("read_block", "reader");
+  size_t block_id = next_block_;
+  if (!block_order_.empty()) {
+    if (next_block_ >= block_order_.size()) { return false; }
+    block_id = block_order_[next_block_];
+  }
+  // The blocks kept in memory are not read again
+  const std::string* kept = nullptr;
+  if (block_cache_.Enabled() && addressable()) {
+    if (cache_.IsMapped() && block_id >= block_offsets_.size()) {
+      return false;
+    }
+    if (!cache_.IsMapped() && block_id >= text_offsets_.size()) {
+      return false;
+    }
+    kept = block_cache_.Get(block_id);
+  }
+  if (kept != nullptr) {
+    TraceSpan deserialize_span("deserialize", "reader");
+    matrix->Deserialize(kept->data(), kept->size());
+    skipped_ = !cache_.IsMapped();
+  } else if (cache_.IsMapped()) {
+    if (block_id >= block_offsets_.size()) { return false; }
+    uint64 offset = block_offsets_[block_id];
+    // Load the next block in random order while we read this
+    // one, unless it is kept in memory
+    if (next_block_ + 1 < block_order_.size() &&
+        !block_cache_.Has(block_order_[next_block_ + 1])) {
+      size_t next = block_order_[next_block_ + 1];
+      uint64 end = next + 1 < block_offsets_.size() ?
+                   block_offsets_[next + 1] : cache_.size();
+      cache_.Advise(MappedFile::kWillNeed, block_offsets_[next],
+                    end - block_offsets_[next]);
+    }
+    TraceSpan deserialize_span("deserialize", "reader");
+    uint64 bytes = matrix->Deserialize(cache_.data() + offset,
+                                       cache_.size() - offset);
+    if (block_cache_.Wanted(block_id)) {
+      block_cache_.Put(block_id,
+                       std::string(cache_.data() + offset, bytes));
+    }
+  } else {
+    if (!block_order_.empty() || skipped_) {
+      skipped_ = false;
+      FileSeek(file_ptr_, text_offsets_[block_id]);
+    } else if (!text_done_ && seekable()) {
+      text_offsets_.push_back(FileTell(file_ptr_));
+    }
+    Timer parse_timer;
+    parse_timer.tic();
+    uint64 read_byte = block_bytes_;
+    // The later passes read the same blocks as the first one, whose
+    // sizes are adjusted by --auto-block, and the last block is at
+    // most the largest one
+    if (text_done_ && seekable()) {
+      read_byte = block_id + 1 < text_offsets_.size() ?
+                  text_offsets_[block_id + 1] - text_offsets_[block_id] :
+                  block_capacity_;
+    }
+    if (read_byte > block_capacity_) {
+      char* block = (char*)realloc(block_, read_byte);
+      CHECK_NOTNULL(block);
+      block_ = block;
+      block_capacity_ = read_byte;
+    }
+    // Read a block of data from disk file
+    size_t ret = 0;
+    if (sharded()) {
+      ret = read_shard_block(file_ptr_, read_byte);
+    } else {
+      ret = seekable() ? read_text(file_ptr_, read_byte) :
+                         read_stream(file_ptr_);
+    }
+    if (ret == 0) {
+      if (!text_done_) {
+        // The first pass is done
+        if (seekable()) { text_offsets_.pop_back(); }
+        text_done_ = true;
+        has_stats_ = true;
+        if (cache_out_ != nullptr) { finish_cache(); }
+      }
+      return false;
+    }
+    // Only a full block tells the time of its size
+    bool full = ret == read_byte;
+    if (full && seekable() && !sharded()) {
+      // Find the last '\n', and shrink back file pointer
+      shrink_block(block_, &ret, file_ptr_);
+    } // else ret < read_byte: we don't need shrink_block()
+    // Parse block to the matrix
+    // The stats are counted in the first pass
+    parser_->Parse(block_, ret, *matrix, true,
+                   text_done_ ? nullptr : &stats_);
+    if (auto_block_ && !text_done_ && full) {
+      adjust_block(ret, matrix->row_length, parse_timer.toc(),
+                   matrix->MemoryBytes());
+    }
+    if (!seekable()) { drop_stream(ret); }
+    if (cache_out_ != nullptr) {
+      TraceSpan serialize_span("serialize", "reader");
+      block_offsets_.push_back(FileTell(cache_out_));
+      matrix->Serialize(cache_out_);
+    }
+    // The block can be found again if the file can seek
+    // to it, or it is in the binary cache
+    if ((seekable() || cache_out_ != nullptr) &&
+        block_cache_.Wanted(block_id)) {
+      std::string data;
+      matrix->Serialize(&data);
+      block_cache_.Put(block_id, data);
+    }
+  }
+  next_block_++;
+  // The cache keeps all the rows of the block
+  sample_rows(matrix);
+  remap_features(matrix);
+  remap_fields(matrix);
+  // The order is only given by the shuffle
+  if (!block_order_.empty()) {
+    shuffle_rows(matrix, block_id);
+  }
+  return true;
+}
+
+// The block takes about kAutoBlockSeconds by the slower one of the
+// loader and the trainer, and its memory fits in auto_memory_
+void OndiskReader::adjust_block(uint64 bytes, index_t rows,
+                                double parse_sec, uint64 matrix_bytes) {
+  if (rows == 0 || bytes == 0) { return; }
+  double per_row = parse_sec / rows;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    per_row = std::max(per_row, train_per_row_);
+  }
+  double target = per_row > 0 ?
+                  kAutoBlockSeconds / per_row * bytes / rows :
+                  2.0 * block_bytes_;
+  target = std::min(target, 2.0 * block_bytes_);
+  target = std::max(target, 0.5 * block_bytes_);
+  if (auto_memory_ > 0) {
+    // The txt block, the blocks parsed ahead and the current one
+    double ratio = (double)matrix_bytes / bytes;
+    target = std::min(target, auto_memory_ / (1.0 + (prefetch_ + 1) * ratio));
+  }
+  target = std::min(target, (double)block_size_ * 1024 * 1024);
+  target = std::max(target, (double)kMinAutoBlock);
+  block_bytes_ = (uint64)target;
+}
+
+// The time between two calls of Samples() is the time of
+// the trainer on the block returned by the first one
+void OndiskReader::time_train() {
+  if (train_rows_ == 0) { return; }
+  double per_row = train_timer_.toc() / train_rows_;
+  train_rows_ = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  train_per_row_ = per_row;
+}
+
+// Fisher-Yates shuffle of the rows, labels, norms and groups
+void OndiskReader::shuffle_rows(DMatrix* matrix, size_t block_id) {
+  std::seed_seq seq{ (uint32)seed_, epoch_, (uint32)block_id };
+  std::default_random_engine generator(seq);
+  bool has_group = matrix->HasGroup();
+  for (index_t i = matrix->row_length; i > 1; --i) {
+    std::uniform_int_distribution<index_t> dist(0, i - 1);
+    index_t j = dist(generator);
+    std::swap(matrix->row[i-1], matrix->row[j]);
+    std::swap(matrix->Y[i-1], matrix->Y[j]);
+    std::swap(matrix->norm[i-1], matrix->norm[j]);
+    if (has_group) {
+      std::swap(matrix->group[i-1], matrix->group[j]);
+    }
+    for (index_t t = 1; t < matrix->num_task; ++t) {
+      std::swap(matrix->Label(i-1, t), matrix->Label(j, t));
+    }
+  }
+}
+
+// The loader thread fills the free blocks in the order of file,
+// and it stops at the end of file, or when stop_ is set
+void OndiskReader::load_blocks() {
+  if (TraceOn()) { SetTraceThreadName("block loader"); }
+  for (;;) {
+    DMatrix* matrix = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || !free_blocks_.empty(); });
+      if (stop_) { return; }
+      matrix = free_blocks_.back();
+      free_blocks_.pop_back();
+    }
+    bool has_data = read_block(matrix);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (has_data) {
+        ready_blocks_.push_back(matrix);
+      } else {
+        free_blocks_.push_back(matrix);
+        eof_ = true;
+      }
+    }
+    cv_.notify_all();
+    if (!has_data) { return; }
+  }
+}
+
+// Start the loader thread at current position of file
+void OndiskReader::start_loader() {
+  if (blocks_.empty()) {
+    for (size_t i = 0; i < prefetch_ + 1; ++i) {
+      blocks_.emplace_back(new DMatrix);
+      free_blocks_.push_back(blocks_.back().get());
+    }
+  }
+  stop_ = false;
+  loading_ = true;
+  loader_ = std::thread(&OndiskReader::load_blocks, this);
+}
+
+// Stop the loader thread, and then all the blocks are free
+void OndiskReader::stop_loader() {
+  if (!loading_) { return; }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  loader_.join();
+  loading_ = false;
+  // The blocks parsed ahead are dropped
+  for (size_t i = 0; i < ready_blocks_.size(); ++i) {
+    free_blocks_.push_back(ready_blocks_[i]);
+  }
+  ready_blocks_.clear();
+  if (current_ != nullptr) {
+    free_blocks_.push_back(current_);
+    current_ = nullptr;
   }
 }
 
 // Sample data from disk file.
 index_t OndiskReader::Samples(DMatrix* &matrix) {
-  // Convert MB to Byte
-  uint64 read_byte = block_size_ * 1024 * 1024;
-  // Read a block of data from disk file
-  size_t ret = ReadDataFromDisk(file_ptr_, block_, read_byte);
-  if (ret == 0) {
+  if (auto_block_) { time_train(); }
+  if (prefetch_ == 0) {
+    if (eof_ || !read_block(&data_samples_)) {
+      eof_ = true;
+      matrix = nullptr;
+      return 0;
+    }
+    matrix = &data_samples_;
+    start_train(data_samples_.row_length);
+    return data_samples_.row_length;
+  }
+  if (!loading_ && !eof_) { start_loader(); }
+  std::unique_lock<std::mutex> lock(mutex_);
+  // The block of last call can be reused
+  if (current_ != nullptr) {
+    free_blocks_.push_back(current_);
+    current_ = nullptr;
+    cv_.notify_all();
+  }
+  if (ready_blocks_.empty() && !eof_) {
+    TraceSpan span("wait_block", "reader");
+    cv_.wait(lock, [this]() { return !ready_blocks_.empty() || eof_; });
+  }
+  if (ready_blocks_.empty()) {
     matrix = nullptr;
     return 0;
-  } else if (ret == read_byte) {
-    // Find the last '\n', and shrink back file pointer
-    shrink_block(block_, &ret, file_ptr_);
-  } // else ret < read_byte: we don't need shrink_block()
-  // Parse block to data_sample_
-  parser_->Parse(block_, ret, data_samples_, true);
-  matrix = &data_samples_;
-  return data_samples_.row_length;
+  }
+  current_ = ready_blocks_.front();
+  ready_blocks_.pop_front();
+  matrix = current_;
+  start_train(current_->row_length);
+  return current_->row_length;
 }
 
 void FromDMReader::Initialize(xLearn::DMatrix* &dmatrix) { 
+  Initialize(dmatrix, 0, dmatrix->row_length);
+}
+
+void FromDMReader::Initialize(xLearn::DMatrix* dmatrix,
+                              index_t begin,
+                              index_t end) {
+  CHECK_NOTNULL(dmatrix);
+  CHECK_LE(begin, end);
+  CHECK_LE(end, dmatrix->row_length);
   this->data_ptr_ = dmatrix;
   has_label_ = this->data_ptr_->has_label;
-  num_samples_ = this->data_ptr_->row_length;
+  begin_ = begin;
+  end_ = end;
+  init_order();
+}
+
+// The order starts from the rows in the matrix order, and
+// it is shuffled again if the shuffle has been set.
+void FromDMReader::init_order() {
+  order_.clear();
+  for (index_t i = begin_; i < end_; ++i) {
+    if (keep_row(*data_ptr_, i)) { order_.push_back(i); }
+  }
+  num_samples_ = order_.size();
+  // The rows are borrowed from the matrix
+  std::fill(data_samples_.row.begin(), data_samples_.row.end(), nullptr);
   data_samples_.ReAlloc(num_samples_, has_label_);
-  // for shuffle
-  order_.resize(num_samples_);
-  for (int i = 0; i < order_.size(); ++i) {
-    order_[i] = i;
+  data_samples_.SetNumTask(data_ptr_->num_task);
+  if (shuffle_) {
+    std::shuffle(order_.begin(), order_.end(), generator_);
+    sort_windows(*data_ptr_, &order_);
   }
+  pos_ = 0;
+}
+
+// The order and the sampled rows point to the copy
+void FromDMReader::copy_matrix() {
+  CHECK_NOTNULL(data_ptr_);
+  if (data_ptr_ == &mapped_) { return; }
+  mapped_.CopyFrom(data_ptr_);
+  data_ptr_ = &mapped_;
+  pos_ = 0;
+}
+
+void FromDMReader::SetFeatureMap(const std::vector<index_t>* map) {
+  CHECK(feature_map_ == nullptr);
+  copy_matrix();
+  feature_map_ = map;
+  remap_features(&mapped_);
+}
+
+void FromDMReader::SetFieldMap(const std::vector<index_t>* map) {
+  CHECK(field_map_ == nullptr);
+  copy_matrix();
+  field_map_ = map;
+  remap_fields(&mapped_);
+}
+
+void FromDMReader::SetNegativeRate(real_t rate) {
+  CHECK_GT(rate, 0);
+  CHECK_LE(rate, 1);
+  if (rate == neg_rate_) { return; }
+  neg_rate_ = rate;
+  if (data_ptr_ != nullptr) { init_order(); }
 }
 
 // Sample data from memory buffer.
 index_t FromDMReader::Samples(DMatrix* &matrix) {
   for (int i = 0; i < num_samples_; ++i) {
-    if (pos_ >= this->data_ptr_->row_length) {
+    if (pos_ >= order_.size()) {
       // End of the data buffer
       if (i == 0) {
         if (shuffle_) {
-          srand(this->seed_+1);
-          random_shuffle(order_.begin(), order_.end());
+          std::shuffle(order_.begin(), order_.end(), generator_);
+          sort_windows(*data_ptr_, &order_);
         }
         matrix = nullptr;
         return 0;
@@ -368,10 +1671,258 @@ index_t FromDMReader::Samples(DMatrix* &matrix) {
     data_samples_.row[i] = this->data_ptr_->row[order_[pos_]];
     data_samples_.Y[i] = this->data_ptr_->Y[order_[pos_]];
     data_samples_.norm[i] = this->data_ptr_->norm[order_[pos_]];
+    if (this->data_ptr_->HasGroup()) {
+      data_samples_.SetGroup(i, this->data_ptr_->group[order_[pos_]]);
+    }
+    data_samples_.CopyTaskLabels(i, *this->data_ptr_, order_[pos_]);
     pos_++;
   }
   matrix = &data_samples_;
   return num_samples_;
 }
 
+void FromIterReader::Initialize(const DataIter& iter) {
+  CHECK(!iter.Empty());
+  iter_ = iter;
+}
+
+void FromIterReader::Reset() {
+  if (iter_.reset != nullptr) { iter_.reset(iter_.handle); }
+}
+
+// Pull the batches until one of them has a row
+// that is kept by the negative sampling.
+index_t FromIterReader::Samples(DMatrix* &matrix) {
+  CHECK(!iter_.Empty());
+  for (;;) {
+    const uint64* indptr = nullptr;
+    const void* nodes = nullptr;
+    const real_t* label = nullptr;
+    uint64 n = iter_.next(iter_.handle, &indptr, &nodes, &label);
+    if (n == 0) {
+      matrix = nullptr;
+      return 0;
+    }
+    CHECK_NOTNULL(indptr);
+    CHECK_LT(n, (uint64)1 << 32);
+    const Node* begin = static_cast<const Node*>(nodes);
+    data_samples_.ReAlloc(n, label != nullptr);
+    for (uint64 i = 0; i < n; ++i) {
+      CHECK_LE(indptr[i], indptr[i+1]);
+      CHECK(indptr[i] == indptr[i+1] || begin != nullptr);
+      // The renumbered rows are copied, so the nodes
+      // of the caller are not changed
+      size_t len = indptr[i+1] - indptr[i];
+      SparseRow* row = feature_map_ == nullptr && field_map_ == nullptr ?
+          data_samples_.arena.NewView(begin + indptr[i], len) :
+          data_samples_.arena.NewRow(begin + indptr[i],
+                                     begin + indptr[i] + len);
+      data_samples_.row[i] = row;
+      if (label != nullptr) { data_samples_.Y[i] = label[i]; }
+      real_t norm = 0.0;
+      for (SparseRow::const_iterator iter = row->begin();
+           iter != row->end(); ++iter) {
+        norm += iter->feat_val * iter->feat_val;
+      }
+      data_samples_.norm[i] = 1.0f / norm;
+    }
+    sample_rows(&data_samples_);
+    remap_features(&data_samples_);
+    remap_fields(&data_samples_);
+    if (data_samples_.row_length > 0) {
+      matrix = &data_samples_;
+      return data_samples_.row_length;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Implementation of ShardReader.
+//------------------------------------------------------------------------------
+
+void ShardReader::Initialize(const std::vector<std::string>& files) {
+  CHECK(!files.empty());
+  Clear();
+  // Each worker reads its files of the list if there are enough
+  split_list_ = sharded() && files.size() >= num_shard_;
+  for (size_t i = 0; i < files.size(); ++i) {
+    CHECK(!IsStreamFile(files[i]));
+    if (!split_list_ || i % num_shard_ == shard_) {
+      files_.push_back(files[i]);
+    }
+  }
+  this->filename_ = files_[0];
+  shards_.resize(files_.size());
+  order_.resize(files_.size());
+  for (size_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  pos_ = 0;
+  epoch_ = 0;
+  pass_stats_ = DataStats();
+  pass_has_stats_ = true;
+  if (on_disk()) {
+    // The stats are found by the first pass
+    open_window();
+    has_label_ = shards_[order_[0]]->has_label();
+    return;
+  }
+  // The jobs take the next shard when they are done
+  std::atomic<size_t> next_shard(0);
+  auto run_job = [&]() {
+    for (size_t i = next_shard++; i < files_.size(); i = next_shard++) {
+      open_shard(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  size_t num_jobs = std::min(num_jobs_, files_.size());
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads.emplace_back(run_job);
+  }
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads[j].join();
+  }
+  has_label_ = shards_[0]->has_label();
+  has_stats_ = true;
+  stats_ = DataStats();
+  for (size_t i = 0; i < shards_.size() && has_stats_; ++i) {
+    DataStats stats;
+    has_stats_ = shards_[i]->GetStats(&stats);
+    stats_.Merge(stats);
+  }
+}
+
+Reader* ShardReader::open_shard(size_t i) {
+  Reader* reader = CREATE_READER(shard_type_.c_str());
+  CHECK_NOTNULL(reader);
+  copy_options(reader);
+  reader->SetShowInfo(false);
+  if (sharded() && !split_list_) {
+    reader->SetShard(shard_, num_shard_);
+  }
+  // The open shards share the budgets
+  uint64 num_open = std::min(num_jobs_, files_.size());
+  reader->SetBlockCache(block_cache_ / num_open);
+  if (auto_block_) {
+    reader->SetAutoBlock(auto_memory_ / num_open);
+  }
+  reader->Initialize(files_[i]);
+  reader->SetShuffle(shuffle_);
+  if (feature_map_ != nullptr) {
+    reader->SetFeatureMap(feature_map_);
+  }
+  if (field_map_ != nullptr) {
+    reader->SetFieldMap(field_map_);
+  }
+  shards_[i].reset(reader);
+  return reader;
+}
+
+void ShardReader::open_window() {
+  size_t end = std::min(order_.size(), pos_ + num_jobs_);
+  for (size_t p = pos_; p < end; ++p) {
+    size_t i = order_[p];
+    if (shards_[i] == nullptr) {
+      open_shard(i)->Prefetch();
+    }
+  }
+}
+
+void ShardReader::end_shard(size_t i) {
+  DataStats stats;
+  if (shards_[i]->GetStats(&stats)) {
+    pass_stats_.Merge(stats);
+  } else {
+    pass_has_stats_ = false;
+  }
+  if (on_disk()) {
+    shards_[i].reset();
+  } else {
+    shards_[i]->Reset();
+  }
+}
+
+index_t ShardReader::Samples(DMatrix* &matrix) {
+  while (pos_ < order_.size()) {
+    size_t i = order_[pos_];
+    if (shards_[i] == nullptr) { open_window(); }
+    index_t num = shards_[i]->Samples(matrix);
+    if (num > 0) { return num; }
+    end_shard(i);
+    pos_++;
+    if (on_disk()) { open_window(); }
+    // The stats of the whole pass
+    if (pos_ == order_.size()) {
+      has_stats_ = pass_has_stats_;
+      stats_ = pass_stats_;
+    }
+  }
+  matrix = nullptr;
+  return 0;
+}
+
+void ShardReader::Reset() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (on_disk()) {
+      shards_[i].reset();
+    } else {
+      shards_[i]->Reset();
+    }
+  }
+  pos_ = 0;
+  epoch_++;
+  pass_stats_ = DataStats();
+  pass_has_stats_ = true;
+  if (shuffle_) {
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = i;
+    }
+    std::default_random_engine generator(seed_ + epoch_);
+    std::shuffle(order_.begin(), order_.end(), generator);
+  }
+  if (on_disk()) { open_window(); }
+}
+
+void ShardReader::EndPass() {
+  for (; pos_ < order_.size(); ++pos_) {
+    size_t i = order_[pos_];
+    if (shards_[i] == nullptr) { continue; }
+    shards_[i]->EndPass();
+    if (on_disk()) { shards_[i].reset(); }
+  }
+}
+
+void ShardReader::Clear() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i] != nullptr) { shards_[i]->Clear(); }
+  }
+  shards_.clear();
+  files_.clear();
+  order_.clear();
+  pos_ = 0;
+}
+
+void ShardReader::SetShuffle(bool shuffle) {
+  this->shuffle_ = shuffle;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i] == nullptr) { continue; }
+    shards_[i]->SetShuffleWindow(shuffle_window_);
+    shards_[i]->SetShuffle(shuffle);
+  }
+}
+
+void ShardReader::SetFeatureMap(const std::vector<index_t>* map) {
+  feature_map_ = map;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i] != nullptr) { shards_[i]->SetFeatureMap(map); }
+  }
+}
+
+void ShardReader::SetFieldMap(const std::vector<index_t>* map) {
+  field_map_ = map;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i] != nullptr) { shards_[i]->SetFieldMap(map); }
+  }
+}
+
 }  // namespace xLearn
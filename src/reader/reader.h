@@ -26,13 +26,27 @@ reading data from data source.
 #include <vector>
 #include <thread>
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
+#include "src/base/file_util.h"
+#include "src/base/mmap_file.h"
 #include "src/base/scoped_ptr.h"
 #include "src/base/thread_pool.h"
+#include "src/base/timer.h"
+#include "src/base/uring_file.h"
 #include "src/data/data_structure.h"
+#include "src/reader/block_cache.h"
+#include "src/reader/decompressor.h"
+#include "src/reader/remote_file.h"
+#include "src/reader/packed_rows.h"
 #include "src/reader/parser.h"
+#include "src/reader/shared_dataset.h"
 
 namespace xLearn {
 
@@ -73,12 +87,48 @@ const size_t kDefautBlockSize = 500;  // 500 MB
 // For now, the Reader can parse three kinds of file format, including
 // the libsvm format, the libffm format, and the CSV format.
 //------------------------------------------------------------------------------
+// The estimate of the DMatrix of a text file, which is
+// given by the DMatrix of its first block (Reader::EstimateMatrix).
+struct MatrixEstimate {
+  /* Bytes of the text file */
+  uint64 text_bytes = 0;
+  /* Bytes and rows of the block */
+  uint64 sample_bytes = 0;
+  index_t sample_rows = 0;
+  /* Bytes of the rows and the nodes of the block */
+  uint64 sample_matrix_bytes = 0;
+  /* Bytes of the packed rows of the block (see PackedRows) */
+  uint64 sample_packed_bytes = 0;
+  /* The largest feature and field of the block */
+  index_t max_feat = 0;
+  index_t max_field = 0;
+
+  // Bytes of the DMatrix of the given bytes of the text.
+  uint64 MatrixBytes(uint64 bytes) const {
+    if (sample_bytes == 0) { return 0; }
+    return (uint64)((double)sample_matrix_bytes / sample_bytes * bytes);
+  }
+
+  // Bytes of the packed rows of the given bytes of the text.
+  uint64 PackedBytes(uint64 bytes) const {
+    if (sample_bytes == 0) { return 0; }
+    return (uint64)((double)sample_packed_bytes / sample_bytes * bytes);
+  }
+
+  // Rows of the text file.
+  uint64 Rows() const {
+    if (sample_bytes == 0) { return 0; }
+    return (uint64)((double)sample_rows / sample_bytes * text_bytes);
+  }
+};
+
 class Reader {
  public:
   // Constructor and Destructor
   Reader() : 
     shuffle_(false), 
     bin_out_(true),
+    block_(nullptr),
     block_size_(kDefautBlockSize) {  }
   virtual ~Reader() {  }
 
@@ -122,11 +172,223 @@ class Reader {
     seed_ = seed;
   }
 
+  // Use the hashing trick with 2^bits buckets
+  // for the feature ids (see Parser::setHashBits).
+  void SetHashBits(int bits) {
+    CHECK_GE(bits, 0);
+    CHECK_LE(bits, 31);
+    hash_bits_ = bits;
+  }
+
+  // Drop the features of value 0 (see Parser::setSkipZeros).
+  void SetSkipZeros(bool skip) {
+    skip_zeros_ = skip;
+  }
+
+  // Merge the duplicate features of each row
+  // (see Parser::setMergeDuplicates).
+  void SetMergeDuplicates(bool merge) {
+    merge_dup_ = merge;
+  }
+
+  // Add the crosses of the fields to the rows, e.g., "0:1,2:5"
+  // (see ParseCrosses and Parser::setCrosses), which need the
+  // hashing trick. The spec must be valid.
+  void SetCrosses(const std::string& spec) {
+    CHECK(ParseCrosses(spec, &crosses_));
+    cross_hash_ = crosses_.empty() ? 0 :
+        HashString((const char*)crosses_.data(),
+                   (const char*)(crosses_.data() + crosses_.size()));
+  }
+
+  // Read num labels at the head of each row for multi-task
+  // training (see Parser::setNumLabels). 1 by default.
+  void SetNumLabels(index_t num) {
+    CHECK_GT(num, 0);
+    num_label_ = num;
+  }
+
+  // How the text file is read (see FileIO in file_util.h), which
+  // must be called before Initialize(). kFileDirect falls back to
+  // kFileNoCache if the file system does not support O_DIRECT, and
+  // kFileUring falls back to kFileCached without io_uring.
+  void SetFileIO(FileIO io) {
+    file_io_ = io;
+  }
+
+  // Parse the text file in multi-thread
+  // (see Parser::setThreadPool).
+  void SetThreadPool(ThreadPool* pool) {
+    pool_ = pool;
+  }
+
+  // Keep all the positive rows (y > 0) and each negative row with
+  // the probability rate, which is the negative sampling of the
+  // training data (see Model::SetNegativeRate for the calibration).
+  // A row is kept or dropped by the hash of its features and the
+  // seed, so the choice is the same in every pass and it does not
+  // depend on the reader or on the order of the rows. The readers of
+  // file sample the rows after they are parsed (and cached), so it
+  // must be called before Initialize(), and the bin file keeps all
+  // the rows. 1 (by default) keeps all the rows.
+  virtual void SetNegativeRate(real_t rate) {
+    CHECK_GT(rate, 0);
+    CHECK_LE(rate, 1);
+    neg_rate_ = rate;
+  }
+
+  // Hash the features of the row with the seed into [0, 2^bits),
+  // which does not depend on the reader or on the order of the rows.
+  static index_t HashRow(const SparseRow* row, int seed, int bits);
+
+  // The minimum of the hashed feature ids of the row, so the rows
+  // of the same key share at least one feature. The empty row has
+  // the largest key.
+  static index_t MinHashRow(const SparseRow* row);
+
   // If shuffle data ?
   virtual void SetShuffle(bool shuffle) {
     shuffle_ = shuffle;
   }
 
+  // Split each shuffled pass into the windows of rows, and order the
+  // rows of each window by MinHashRow(), so the rows that share the
+  // features are trained one after another and their parameters are
+  // still in the cache. Each window is a random set of the rows, so
+  // the order of the pass is still random across the windows. It is
+  // set before SetShuffle(), and 0 (by default) keeps the shuffled
+  // order. The readers in memory use it, and the on-disk reader
+  // ignores it, since it only shuffles the rows within a block.
+  void SetShuffleWindow(index_t rows) {
+    shuffle_window_ = rows;
+  }
+
+  // Keep the rows compressed in memory (see PackedRows), which are
+  // decoded by the batches of the pass. It is set before Initialize(),
+  // and only the in-memory reader uses it.
+  void SetPackRows(bool pack) {
+    pack_rows_ = pack;
+  }
+
+  // Renumber the feature ids of the data, where the id j becomes
+  // (*map)[j], and the ids out of the map are kept, e.g., to put
+  // the frequent features together (see FeatureStats::FeatureMap).
+  // The map is kept by the caller. The in-memory reader renumbers
+  // its buffer at once, so the map is set only once, and the
+  // on-disk reader renumbers each block after it is read. The bin
+  // files keep the ids of the text file.
+  virtual void SetFeatureMap(const std::vector<index_t>* map) {
+    feature_map_ = map;
+  }
+
+  // Renumber the field ids of the data in the same way, where the
+  // field f becomes (*map)[f], and the fields out of the map become
+  // map->size(), which is not a field of the model, so the sparse
+  // field ids of a big registry are dense in the model of ffm (see
+  // --remap-fields). The map is kept by the caller.
+  virtual void SetFieldMap(const std::vector<index_t>* map) {
+    field_map_ = map;
+  }
+
+  // Get the shape of all the rows (see DataStats), which is counted
+  // by the parser as it parses the text file, and it is kept in the
+  // binary file, so the data need not be scanned to size the model.
+  // The on-disk reader has the stats after its first pass, or from
+  // the cache. It returns false if the stats are not known, e.g.,
+  // the Parquet files, the old binary files, or the rows that are
+  // changed after the parsing by the negative sampling or by the
+  // feature map. It is called between the passes.
+  virtual bool GetStats(DataStats* stats) const {
+    CHECK_NOTNULL(stats);
+    if (!has_stats_ || neg_rate_ < 1.0 || feature_map_ != nullptr ||
+        field_map_ != nullptr) {
+      return false;
+    }
+    *stats = stats_;
+    return true;
+  }
+
+  // Keep at most bytes of the parsed blocks in memory for the next
+  // passes (see OndiskReader), and 0 disables it. The readers that
+  // keep all the data in memory ignore it.
+  virtual void SetBlockCache(uint64 bytes) { }
+
+  // Adjust the block size in the first pass within the size of
+  // SetBlockSize() and the memory of the blocks (see OndiskReader),
+  // where 0 is no limit of memory. The other readers ignore it.
+  virtual void SetAutoBlock(uint64 memory) { }
+
+  // Share the parsed rows with the other processes of the host by
+  // the shared memory of the name (see SharedDataset), so the file is
+  // parsed once and kept in memory once for the concurrent jobs on it
+  // (e.g., a sweep). The in-memory reader shares its buffer, and the
+  // other readers ignore it. The rows of the file (of the shard) are
+  // found by the stamp of the file and the options of the parser, as
+  // the binary file. It must be called before Initialize().
+  virtual void SetSharedData(const std::string& name) { }
+
+  // Skip the rest of current pass, as Samples() returns 0 at the
+  // end of the data, e.g., the pass that only reads the stats.
+  // Then Reset() starts the next pass.
+  virtual void EndPass() { }
+
+  // Keep the loss of each row (see RowLoss), which the loss function
+  // writes as the rows are trained, and return it, or nullptr if the
+  // reader does not keep its rows in memory. The ids and the weights
+  // of RowLoss are of the batch of the last Samples().
+  virtual RowLoss* TrackLoss() { return nullptr; }
+
+  // Sample the rows of each pass after the next Reset() by their loss
+  // of TrackLoss(), where row i is kept with the probability
+  //
+  //   p_i = max(rate * loss_i / mean(loss), rate * kMinLossShare),
+  //
+  // (at most 1) and its weight is 1/p_i, so the weighted gradient of a
+  // pass is unbiased on about rate of the rows. 1 (by default) keeps
+  // all the rows. It is ignored without TrackLoss().
+  virtual void SetLossRate(real_t rate) { }
+
+  // The least probability of a row of SetLossRate() is this share of
+  // the rate, so the confident rows are still trained now and then,
+  // and their weights are at most 1 / (rate * kMinLossShare).
+  static constexpr real_t kMinLossShare = 0.1;
+
+  // Start to read the next blocks in background before the first
+  // Samples() of the pass (see OndiskReader), e.g., the next shard
+  // of ShardReader. The readers in memory ignore it.
+  virtual void Prefetch() { }
+
+  // Print the binary files found by Initialize(), which is
+  // turned off for the many files of ShardReader.
+  void SetShowInfo(bool show) {
+    show_info_ = show;
+  }
+
+  // Only read the shard of the text file, e.g., the part of a worker
+  // of distributed training in a shared file. The file of size bytes
+  // is split by the bytes size * shard / num_shard, and each split is
+  // moved to the head of its line, so each line is read by one shard.
+  // The binary file of a shard has its own name. It must be called
+  // before Initialize(), and the compressed files, the streams and the
+  // Parquet files cannot be sharded. The readers of DMatrix ignore it.
+  void SetShard(size_t shard, size_t num_shard) {
+    CHECK_GT(num_shard, 0);
+    CHECK_LT(shard, num_shard);
+    shard_ = shard;
+    num_shard_ = num_shard;
+  }
+
+  // Estimate the DMatrix of the text file by parsing its first block
+  // of at most sample_mb MB, so the memory of the data is known before
+  // the file is read. The file of a shard is its share of the file.
+  // It uses the hashing bits, the zeros and the pool of the reader,
+  // and it does not initialize the reader. It returns false for the
+  // files that cannot be sampled: the streams, the compressed files
+  // and the Parquet files.
+  bool EstimateMatrix(const std::string& filename,
+                      size_t sample_mb,
+                      MatrixEstimate* estimate);
+
  protected:
   /* Input file name */
   std::string filename_;
@@ -140,6 +402,10 @@ class Reader {
   bool has_label_;
   /* If shuffle data ? */
   bool shuffle_;
+  /* Rows of the window ordered by MinHashRow(), or 0 */
+  index_t shuffle_window_ = 0;
+  /* Keep the rows of the in-memory reader packed (see SetPackRows) */
+  bool pack_rows_ = false;
   /* Generate bin file ? */
   bool bin_out_;
   /* Split string for data items */
@@ -150,6 +416,56 @@ class Reader {
   size_t block_size_;
   /* Random seed */
   int seed_ = 1;
+  /* Number of bits of the hashing trick */
+  int hash_bits_ = 0;
+  /* Drop the features of value 0 */
+  bool skip_zeros_ = false;
+  /* Merge the duplicate features of a row */
+  bool merge_dup_ = false;
+  /* Number of the labels of each row */
+  index_t num_label_ = 1;
+  /* The pairs of the crossed fields, and their
+  hash value, which is 0 for no cross */
+  std::vector<FieldCross> crosses_;
+  uint64 cross_hash_ = 0;
+  /* Rate of the negative sampling */
+  real_t neg_rate_ = 1.0;
+  /* The new ids of the features and of the fields, or nullptr */
+  const std::vector<index_t>* feature_map_ = nullptr;
+  const std::vector<index_t>* field_map_ = nullptr;
+  /* The stats of the rows given by the parser */
+  DataStats stats_;
+  bool has_stats_ = false;
+  /* Thread pool of the parser */
+  ThreadPool* pool_ = nullptr;
+  /* The input is compressed, which is read by decompressor_,
+  or it is remote, which is read by remote_file_ in the same way */
+  bool compressed_ = false;
+  Decompressor decompressor_;
+  bool remote_ = false;
+  RemoteFile remote_file_;
+  /* Bytes at the head of block_ that are read from a
+  stream (see read_stream) but not parsed yet */
+  size_t carry_ = 0;
+  /* The shard of the text file (see SetShard), which is the
+  bytes [shard_begin_, shard_end_) */
+  size_t shard_ = 0;
+  size_t num_shard_ = 1;
+  uint64 shard_begin_ = 0;
+  uint64 shard_end_ = 0;
+  /* How the text file is read, and the file of kFileDirect
+  or of kFileUring */
+  FileIO file_io_ = kFileCached;
+  DirectFile direct_;
+  UringFile uring_;
+  /* Print the binary files found by Initialize() */
+  bool show_info_ = true;
+
+  // Set the options of the parser and of the rows of this reader
+  // to the reader, e.g., the readers of the shards of ShardReader,
+  // which is called before its Initialize(). The shard of the
+  // file and the feature map are not copied.
+  void copy_options(Reader* reader) const;
 
   // Check current file format and return
   // "libsvm", "ffm", or "csv".
@@ -158,10 +474,101 @@ class Reader {
   // data has the label y.
   std::string check_file_format();
 
+  // Same as check_file_format(), but the first line
+  // is given, e.g., by the first block of a stream.
+  std::string check_line_format(const std::string& data_line);
+
   // Find the last '\n' in block and 
   // shrink back file pointer.
   void shrink_block(char* block, size_t* ret, FILE* file);
 
+  // If only a shard of the file is read.
+  inline bool sharded() const { return num_shard_ > 1; }
+
+  // Find the bytes of the shard in the text file, or exit if the
+  // file cannot be sharded, and print the range.
+  void init_shard();
+
+  // The suffix of the binary files of the shard, e.g., ".2-of-4"
+  // for the shard 2 of 4 shards, which is empty without shards.
+  std::string shard_suffix() const;
+
+  // Read a block of at most read_byte bytes of the shard to block_,
+  // which ends with a complete line, and return its size.
+  size_t read_shard_block(FILE* file, uint64 read_byte);
+
+  // Hint the sequential read of the text file, and open direct_
+  // for kFileDirect (or uring_ for kFileUring), which is called
+  // once the file is opened.
+  void init_file_io(FILE* file);
+
+  // Read at most read_byte bytes of the text file to block_ from
+  // the position of the file (see ReadDataFromDisk), and move the
+  // position after them. The bytes are read by direct_ or uring_ if
+  // it is open, and their pages are dropped for kFileNoCache.
+  size_t read_text(FILE* file, uint64 read_byte);
+
+  // Order the rows of each window of the shuffled order (of the
+  // rows of the matrix) by MinHashRow(), where the rows of the same
+  // key keep their shuffled order (see SetShuffleWindow).
+  void sort_windows(const DMatrix& matrix, std::vector<index_t>* order);
+
+  // If the i-th row of the matrix is kept by the negative sampling.
+  bool keep_row(const DMatrix& matrix, index_t i);
+
+  // Remove the rows of the matrix that are dropped by the negative
+  // sampling, and the rows left keep their order.
+  void sample_rows(DMatrix* matrix);
+
+  // Renumber the features of the matrix by feature_map_.
+  void remap_features(DMatrix* matrix);
+
+  // Renumber the fields of the matrix by field_map_.
+  void remap_fields(DMatrix* matrix);
+
+  // Start to decompress the input (or download the remote file),
+  // and return the file of the text. Exit if the compression is
+  // not supported, or the remote file cannot be read.
+  FILE* open_compressed();
+
+  // Close the file given by open_compressed().
+  void close_compressed();
+
+  // The functions below read the text from a file that cannot seek,
+  // e.g., the standard input or the decompressor. The next block is
+  // filled after the carry_ bytes of the last block, and the partial
+  // line at its end is kept for the next block:
+  //
+  //   std::string format = check_stream_format(file);
+  //   for (size_t size; (size = read_stream(file)) > 0; ) {
+  //     parser_->Parse(block_, size, matrix, false);
+  //     drop_stream(size);
+  //   }
+
+  // Read the first block, and return the format
+  // given by its first line (see check_line_format).
+  std::string check_stream_format(FILE* file);
+
+  // Read the next block, and return the size
+  // of the complete lines at the head of block_.
+  size_t read_stream(FILE* file);
+
+  // Drop the size bytes at the head of block_.
+  void drop_stream(size_t size);
+
+  // The bin file keeps the hashed feature ids, so the hash
+  // value of the txt file is mixed with the hashing bits, the
+  // skip_zeros_, the merge_dup_, the num_label_ and the crosses. Then
+  // the bin file is rebuilt if they have changed, and so is it if the
+  // format of DMatrix has changed.
+  uint64 bin_hash(uint64 file_hash) {
+    return file_hash ^ cross_hash_ ^ (uint64)hash_bits_ ^
+           ((uint64)skip_zeros_ << 8) ^ ((uint64)merge_dup_ << 9) ^
+           ((uint64)(num_label_ - 1) << 10) ^
+           ((uint64)shard_ << 16) ^ ((uint64)num_shard_ << 36) ^
+           (DMatrix::kFormatVersion << 56);
+  }
+
   // Create parser for different file format
   Parser* CreateParser(const char* format_name) {
     return CREATE_PARSER(format_name);
@@ -175,12 +582,39 @@ class Reader {
 // Sampling data from memory buffer.
 // For in-memory sampling, the Reader will automatically convert
 // txt data to binary data, and uses this binary data in the next time.
+// The binary file has the DMatrix and then the stats of the rows.
+//
+// The binary file is written by a background thread while the first
+// epoch trains, since the training only reads data_buf_. It is written
+// to filename.bin.tmp and renamed at the end, so an interrupted run
+// leaves no partial binary file. The negative sampling, SetFeatureMap()
+// and Clear() change data_buf_, so they wait for the writer first.
+//
+// With SetSharedData(), the reader first looks for the shared data of
+// the file (see SharedDataset), and data_buf_ is a view of it if it is
+// found. Otherwise the file is read as above, and then data_buf_ is
+// copied to the shared memory for the later processes. The negative
+// sampling only drops the rows of the view, and the shared data keeps
+// all of them, as the bin file does.
+//
+// With SetPackRows(true), the rows of data_buf_ are compressed to
+// packed_ once they are read (and the bin file is written), and
+// data_buf_ only keeps the labels and the norms. Then Samples() gives
+// the pass in the batches of kPackedBatch rows, which are decoded by
+// the threads of the pool just before they are trained, and the maps
+// of the features and the fields are applied to each batch. The data
+// takes 2 ~ 4 times less memory, at the cost of the decoding.
 //------------------------------------------------------------------------------
 class InmemReader : public Reader {
  public:
   // Constructor and Destructor
   InmemReader() : pos_(0) { }
-  ~InmemReader() { }
+  ~InmemReader() { WaitBinary(); }
+
+  // Wait until the binary file is written (if it is).
+  void WaitBinary() {
+    if (bin_writer_.joinable()) { bin_writer_.join(); }
+  }
 
   // Pre-load all the data into memory buffer.
   virtual void Initialize(const std::string& filename);
@@ -194,8 +628,13 @@ class InmemReader : public Reader {
 
   // Free the memory of data matrix.
   virtual void Clear() {
+    WaitBinary();
+    // The rows of data_samples_ belong to data_buf_
+    data_samples_.row.assign(data_samples_.row.size(), nullptr);
     data_buf_.Reset();
     data_samples_.Reset();
+    packed_.Clear();
+    shared_.Close();
     if (block_ != nullptr) {
       delete [] block_;
     }
@@ -212,14 +651,45 @@ class InmemReader : public Reader {
     if (shuffle_ && !order_.empty()) {
       srand(this->seed_);
       random_shuffle(order_.begin(), order_.end());
+      sort_windows(data_buf_, &order_);
     }
   }
 
-  // Get data buffer
+  // Renumber the features of data_buf_.
+  virtual void SetFeatureMap(const std::vector<index_t>* map);
+
+  // Renumber the fields of data_buf_.
+  virtual void SetFieldMap(const std::vector<index_t>* map);
+
+  // Share data_buf_ by the shared memory of the name.
+  virtual void SetSharedData(const std::string& name) {
+    shared_data_ = name;
+  }
+
+  // Shuffle the rows for the next pass as Samples() does.
+  virtual void EndPass();
+
+  // Keep the loss of the rows of data_buf_.
+  virtual RowLoss* TrackLoss();
+
+  // Sample the rows of the next passes by their loss.
+  virtual void SetLossRate(real_t rate) {
+    CHECK_GT(rate, 0);
+    CHECK_LE(rate, 1);
+    loss_rate_ = rate;
+  }
+
+  // Get data buffer, which has no rows if they are packed.
   virtual inline DMatrix* GetMatrix() {
     return &data_buf_;
   }
 
+  // If the rows are packed (see SetPackRows).
+  bool Packed() const { return packed_.Rows() > 0; }
+
+  // Rows of each batch of the packed rows.
+  static const index_t kPackedBatch = 16384;
+
  protected:
   /* Reader will load all the data 
   into this buffer */
@@ -230,6 +700,27 @@ class InmemReader : public Reader {
   index_t pos_;
   /* For random shuffle */
   std::vector<index_t> order_;
+  /* The loss of the rows (see TrackLoss), and the rate of the
+  sampling by the loss, where 1 keeps all the rows */
+  RowLoss row_loss_;
+  bool track_loss_ = false;
+  real_t loss_rate_ = 1.0;
+  /* The rows of current pass sampled by their loss, which are
+  read instead of order_ if loss_sampled_, and their weights */
+  bool loss_sampled_ = false;
+  std::vector<index_t> loss_order_;
+  std::vector<real_t> loss_weight_;
+  std::mt19937 loss_generator_;
+  /* The thread that writes the binary file */
+  std::thread bin_writer_;
+  /* The name of the shared data, and the shared memory
+  of the rows of data_buf_ if they are shared */
+  std::string shared_data_;
+  SharedDataset shared_;
+  /* The packed rows of data_buf_, and the ids of the rows of
+  current batch */
+  PackedRows packed_;
+  std::vector<index_t> batch_ids_;
 
   // Check whehter current path has a binary file.
   bool hash_binary(const std::string& filename);
@@ -237,9 +728,39 @@ class InmemReader : public Reader {
   // Initialize Reader from existing binary file.
   void init_from_binary();
 
-  // Initialize Reader from a new txt file.
+  // Initialize Reader from the shared data of the file, which
+  // is created by another process. Return false if it is not found.
+  bool init_from_shared();
+
+  // Copy data_buf_ to the shared data if it is not shared.
+  void share_buffer();
+
+  // Copy the shared rows of data_buf_, which are read-only,
+  // so this reader can renumber its own copy of them.
+  void own_buffer();
+
+  // Drop the rows of data_buf_ by the negative sampling.
+  void sample_buffer();
+
+  // Move the rows of data_buf_ to packed_ if SetPackRows(true).
+  void pack_buffer();
+
+  // Resize data_samples_ for a batch of the packed rows.
+  void resize_samples(index_t rows);
+
+  // Sample the rows of order_ for current pass by their loss.
+  void sample_by_loss();
+
+  // Initialize Reader from a new txt file,
+  // or a Parquet file (see columnar.h).
   void init_from_txt();
 
+  // Parse the txt file to data_buf_.
+  void parse_txt();
+
+  // Write data_buf_ and the stats to the binary file.
+  void write_binary(const std::string& bin_file);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(InmemReader);
 };
@@ -248,15 +769,62 @@ class InmemReader : public Reader {
 // Sampling data from disk file.
 // OndiskReader is used to train very big data, which cannot be
 // loaded into main memory of current single machine.
+//
+// A loader thread reads and parses the next blocks in background, so
+// the I/O and the parsing overlap the training of current block. It
+// keeps prefetch (kDefaultPrefetch by default) parsed blocks ahead of
+// Samples() at most, and the block returned by Samples() is reused
+// after the next call, so the memory is bounded by (prefetch + 1)
+// blocks. SetPrefetch(0) reads the blocks in Samples() instead.
+//
+// The first pass over the txt file also writes the parsed blocks to
+// a binary cache (filename.disk.bin, see SetNoBin), which has the
+// offsets of all the blocks and the stats of the rows at the end:
+//
+//   | hash_1 | hash_2 | block_0 | ... | block_n-1 | offsets |
+//   | stats | offset of the offsets | kCacheMagic |
+//
+// The later passes (and the later runs) read the blocks from the
+// cache instead of parsing the txt file again. The cache is mapped
+// into memory, so the blocks are read from the page cache, which is
+// shared by all the jobs on the same data.
+//
+// SetShuffle(true) shuffles the data of each pass (except the first
+// one, which reads the txt file in order) in two levels: the blocks
+// are read in a random order, and the rows of each block are shuffled
+// in memory. So the shuffle buffer is just the block itself, and the
+// memory is the same as before. Without the cache (--no-bin), the
+// blocks are found by the offsets of the txt file given by the first
+// pass. The order only depends on the seed (see SetSeed), the pass,
+// and the block, so it is not changed by the prefetch.
+//
+// The input can also be a stream, i.e., the standard input ("-") or a
+// named pipe (see IsStreamFile), which is read only once. The format
+// is found by the first block, and the partial line at the end of a
+// block is moved to the next block instead of seeking back. The first
+// pass writes the cache as usual (stdin.disk.bin for "-"), and the
+// later passes read the cache, which is removed by Clear() since the
+// next stream has other data. Without the cache (--no-bin) the stream
+// is read in a single pass, and the later passes have no data.
+//
+// A compressed file (e.g., data.txt.gz) is read by the Decompressor
+// in the same way, instead of seeking in the file. It is decompressed
+// again for each pass without the cache, and its cache is checked and
+// kept like the cache of a txt file. A remote file (e.g., s3://) is
+// read by the RemoteFile like a compressed file, but its cache is
+// only used by current run, like the one of a stream.
 //------------------------------------------------------------------------------
-// TODO(chao): binary-cache
 class OndiskReader : public Reader {
  public:
   // Constructor and Destructor
-  OndiskReader() { }
+  OndiskReader() : file_ptr_(nullptr) { }
   ~OndiskReader() { 
     Clear();
-    Close(file_ptr_); 
+    // The file of compressed input is closed by decompressor_
+    // (or remote_file_)
+    if (file_ptr_ != nullptr && file_ptr_ != stdin && !compressed_) {
+      Close(file_ptr_); 
+    }
   }
 
   // Create parser and open file
@@ -271,9 +839,19 @@ class OndiskReader : public Reader {
 
   // Free the memory of data matrix.
   virtual void Clear() {
+    stop_loader();
+    abort_cache();
+    if (stream_ && cache_.IsMapped()) {
+      cache_.Unmap();
+      RemoveFile(cache_file_.c_str());
+    }
+    blocks_.clear();
+    free_blocks_.clear();
+    block_cache_.Clear();
     data_samples_.Reset();
     if (block_ != nullptr) {
       delete [] block_;
+      block_ = nullptr;
     }
   }
 
@@ -282,17 +860,197 @@ class OndiskReader : public Reader {
     return "on-disk";
   }
 
-  // We cannot set shuffle for OndiskReader
+  // Shuffle the blocks and the rows from the next pass,
+  // which starts at the next Reset().
   void inline SetShuffle(bool shuffle) {
-    if (shuffle == true) {
-      LOG(ERR) << "Cannot set shuffle for OndiskReader.";
-    }
-    this->shuffle_ = false;
+    this->shuffle_ = shuffle;
+  }
+
+  // Start the loader thread, which parses the
+  // blocks ahead of the first Samples().
+  virtual void Prefetch() {
+    if (prefetch_ > 0 && !loading_ && !eof_) { start_loader(); }
+  }
+
+  // Set the number of the blocks parsed ahead
+  // of Samples(), and 0 disables the loader thread.
+  void SetPrefetch(size_t num_blocks) {
+    stop_loader();
+    prefetch_ = num_blocks;
+  }
+
+  // Keep the parsed blocks in memory up to bytes, and then the
+  // next passes only read the other blocks from the txt file or
+  // the binary cache (see BlockCache). The blocks of the streams
+  // and compressed files without the binary cache are not kept,
+  // since they cannot skip a block.
+  virtual void SetBlockCache(uint64 bytes) {
+    stop_loader();
+    block_cache_.SetBudget(bytes);
   }
 
+  // The blocks kept in memory.
+  const BlockCache& GetBlockCache() const { return block_cache_; }
+
+  // Adjust the size of the next blocks of txt file in the first pass
+  // instead of the fixed SetBlockSize(), which is the largest size.
+  // It starts from kAutoBlockStart, and each block is sized by the
+  // measured seconds per row of the parsing and of the training
+  // (the time between the calls of Samples), whichever is slower,
+  // so the block takes about kAutoBlockSeconds: the smaller blocks
+  // spend more time to hand out the threads, and the larger blocks
+  // take more memory and a longer wait for the first one. The size
+  // changes by a factor of 2 at most each block. If memory is not 0,
+  // the txt block and the (prefetch + 1) parsed blocks fit in it, by
+  // the measured ratio of the parsed bytes to the txt bytes. The
+  // later passes keep the blocks of the first pass. The streams and
+  // the compressed files keep the fixed size. It must be called
+  // before Initialize().
+  virtual void SetAutoBlock(uint64 memory) {
+    auto_block_ = true;
+    auto_memory_ = memory;
+  }
+
+  // Bytes of the next block of txt file.
+  uint64 GetBlockBytes() const { return block_bytes_; }
+
+  static const uint64 kAutoBlockStart = 16 * 1024 * 1024;
+  static const uint64 kMinAutoBlock = 1024 * 1024;
+  static constexpr double kAutoBlockSeconds = 0.2;
+
+  // If the blocks are read from the binary cache.
+  bool FromCache() const { return cache_.IsMapped(); }
+
+  // If the input is a stream that is read only once.
+  bool IsStream() const { return stream_; }
+
+  static const size_t kDefaultPrefetch = 2;
+  static const uint64 kCacheMagic = 0x6b636f6c62786c78ULL;
+
  protected:
   /* Maintain the file pointer */
   FILE* file_ptr_; 
+  /* File name of the binary cache */
+  std::string cache_file_;
+  /* The blocks are read from the mapped cache */
+  MappedFile cache_;
+  /* Write the blocks to the cache in first pass, or nullptr */
+  FILE* cache_out_ = nullptr;
+  /* Offsets of the blocks in the cache */
+  std::vector<uint64> block_offsets_;
+  /* Next block to read in current pass */
+  size_t next_block_ = 0;
+  /* Offsets of the blocks in the txt file */
+  std::vector<uint64> text_offsets_;
+  /* If text_offsets_ has all the blocks */
+  bool text_done_ = false;
+  /* The input is a stream, which cannot be read again */
+  bool stream_ = false;
+  /* Random order of the blocks in current pass,
+  which is empty if the blocks are read in order */
+  std::vector<size_t> block_order_;
+  /* Number of the passes, which is used by the shuffle */
+  uint32 epoch_ = 0;
+  /* The cache is made from the txt file with these hash values,
+  which are given by the first chunk and the size of txt file */
+  uint64 cache_hash_1_ = 0;
+  uint64 cache_hash_2_ = 0;
+  /* Number of the blocks parsed ahead */
+  size_t prefetch_ = kDefaultPrefetch;
+  /* The parsed blocks kept in memory */
+  BlockCache block_cache_;
+  /* A block of the txt file is skipped by the
+  block_cache_, so the next one needs a seek */
+  bool skipped_ = false;
+  /* Bytes of the next block of txt file, and of block_ */
+  uint64 block_bytes_ = 0;
+  uint64 block_capacity_ = 0;
+  /* Adjust block_bytes_ in the first pass (see SetAutoBlock) */
+  bool auto_block_ = false;
+  uint64 auto_memory_ = 0;
+  /* Seconds per row that the trainer spent on the last block,
+  which is guarded by mutex_ */
+  double train_per_row_ = 0;
+  /* Measure the time of the block returned by last Samples() */
+  Timer train_timer_;
+  index_t train_rows_ = 0;
+  /* All the (prefetch_ + 1) blocks */
+  std::vector<std::unique_ptr<DMatrix> > blocks_;
+  /* The blocks can be filled by the loader */
+  std::vector<DMatrix*> free_blocks_;
+  /* The parsed blocks in the order of file */
+  std::deque<DMatrix*> ready_blocks_;
+  /* The block returned by last Samples() */
+  DMatrix* current_ = nullptr;
+  /* Loader thread */
+  std::thread loader_;
+  /* Guard the blocks and the flags below */
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool loading_ = false;
+  bool stop_ = false;
+  bool eof_ = false;
+
+  // Read and parse the next block of file into the matrix.
+  // Return false at the end of file.
+  bool read_block(DMatrix* matrix);
+
+  // If the txt file can seek to a block.
+  bool seekable() const { return !stream_ && !compressed_; }
+
+  // The loop of loader thread.
+  void load_blocks();
+
+  // Start the loader thread at current position of file.
+  void start_loader();
+
+  // Stop the loader thread, and then all
+  // the blocks can be reused.
+  void stop_loader();
+
+  // Open the cache and read the offsets of the blocks.
+  // Return false if the cache does not exist, or it is
+  // not made from current txt file.
+  bool open_cache();
+
+  // Start to write the cache from the head of txt file.
+  void create_cache();
+
+  // Write the offsets at the end of file, and then the
+  // blocks are read from the cache.
+  void finish_cache();
+
+  // Remove the cache that has not been finished.
+  void abort_cache();
+
+  // Set the size of the next block by the last full block of txt
+  // file, which has rows and is parsed in parse_sec seconds, and
+  // the parsed bytes of it (see SetAutoBlock).
+  void adjust_block(uint64 bytes, index_t rows, double parse_sec,
+                    uint64 matrix_bytes);
+
+  // Measure the time of the trainer on the last block.
+  void time_train();
+
+  // Start to time the trainer on the block of rows.
+  void start_train(index_t rows) {
+    if (!auto_block_) { return; }
+    train_rows_ = rows;
+    train_timer_.reset();
+  }
+
+  // The random order of the blocks in the pass of epoch.
+  std::vector<size_t> shuffle_blocks(size_t num_blocks, uint32 epoch);
+
+  // If the blocks can be found by the id in current pass,
+  // so the blocks of block_cache_ are used.
+  bool addressable() const {
+    return cache_.IsMapped() || (text_done_ && seekable());
+  }
+
+  // Shuffle the rows of the block, where the random
+  // seed is given by the seed_, epoch_ and block id.
+  void shuffle_rows(DMatrix* matrix, size_t block_id);
  
  private:
   DISALLOW_COPY_AND_ASSIGN(OndiskReader);
@@ -301,12 +1059,22 @@ class OndiskReader : public Reader {
 class FromDMReader : public Reader {
  public:
   // Constructor and Destructor
-  FromDMReader() : pos_(0) { }
+  FromDMReader() : data_ptr_(nullptr), pos_(0) { }
   ~FromDMReader() { }
 
   virtual void Initialize(const std::string& filename) { };
   virtual void Initialize(xLearn::DMatrix* &dmatrix);
 
+  // Sample the rows [begin, end) of the matrix only, e.g., a fold
+  // of cross-validation, so the folds can share one matrix.
+  void Initialize(xLearn::DMatrix* dmatrix, index_t begin, index_t end);
+
+  // The matrix is not changed, and the rows are only dropped from
+  // the order of sampling, so the rate can also be changed after
+  // Initialize(), e.g., a fold of cross-validation is sampled for
+  // training and it is not for validation.
+  virtual void SetNegativeRate(real_t rate);
+
   virtual index_t Samples(DMatrix* &matrix);
 
   // Return to the beginning of the data.
@@ -325,15 +1093,24 @@ class FromDMReader : public Reader {
     return "from-dmatrix";
   }
 
-  // If shuffle data ?
+  // If shuffle data ? The rows are shuffled by the own random
+  // engine of the reader, so the readers used by different threads
+  // (e.g., the folds trained at the same time) do not share rand().
   virtual inline void SetShuffle(bool shuffle) {
     this->shuffle_ = shuffle;
     if (shuffle_ && !order_.empty()) {
-      srand(this->seed_);
-      random_shuffle(order_.begin(), order_.end());
+      generator_.seed(this->seed_);
+      std::shuffle(order_.begin(), order_.end(), generator_);
+      sort_windows(*data_ptr_, &order_);
     }
   }
 
+  // The rows belong to the caller, so the reader renumbers its
+  // own copy of the matrix, which costs the memory of the data.
+  // Both maps renumber the same copy.
+  virtual void SetFeatureMap(const std::vector<index_t>* map);
+  virtual void SetFieldMap(const std::vector<index_t>* map);
+
  protected:
   DMatrix* data_ptr_;
   /* Number of record at each sampling */
@@ -342,12 +1119,207 @@ class FromDMReader : public Reader {
   index_t pos_;
   /* For random shuffle */
   std::vector<index_t> order_;
+  /* Random engine of the shuffle */
+  std::default_random_engine generator_;
+  /* The rows [begin_, end_) of the matrix */
+  index_t begin_ = 0;
+  index_t end_ = 0;
+  /* The renumbered copy of the matrix of SetFeatureMap() */
+  DMatrix mapped_;
+
+  // Point data_ptr_ to the copy of the matrix, which is renumbered.
+  void copy_matrix();
+
+  // Set order_ to the rows kept by the negative sampling.
+  void init_order();
 
 
  private:
   DISALLOW_COPY_AND_ASSIGN(FromDMReader);
 };
 
+//------------------------------------------------------------------------------
+// FromIterReader streams the batches of a DataIter, e.g., the loader of
+// python, so the training needs neither a data file nor all the data in
+// memory. Each Samples() pulls the next batch of the iterator, and its
+// rows are the views of the nodes of the caller (see RowArena::NewView),
+// which are copied only if the features are renumbered. Reset() starts
+// the next pass of the iterator, so the data is replayed in each epoch.
+// The rows keep the order of the caller, who shuffles them if needed,
+// and the negative sampling drops the rows of each batch.
+//------------------------------------------------------------------------------
+class FromIterReader : public Reader {
+ public:
+  // Constructor and Destructor
+  FromIterReader() { }
+  ~FromIterReader() { }
+
+  virtual void Initialize(const std::string& filename) { }
+  virtual void Initialize(xLearn::DMatrix* &dmatrix) { }
+
+  // Read the batches of the iterator.
+  void Initialize(const DataIter& iter);
+
+  virtual index_t Samples(DMatrix* &matrix);
+
+  // Start the next pass of the iterator.
+  virtual void Reset();
+
+  // Free the memory of data matrix.
+  virtual void Clear() { data_samples_.Reset(); }
+
+  // Return the Reader type
+  virtual std::string Type() {
+    return "from-iter";
+  }
+
+ protected:
+  /* The callbacks of the caller */
+  DataIter iter_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FromIterReader);
+};
+
+//------------------------------------------------------------------------------
+// ShardReader reads a list of files (the shards), e.g., the libffm or
+// Parquet files of a day, as one dataset, so they need not be put
+// together in one file first. Each shard is read by its own reader of
+// SetShardType(), which takes the options of the ShardReader (see
+// copy_options) and has its own binary file:
+//
+//   ShardReader* reader = new ShardReader;
+//   reader->SetShardType("disk");   /* or "memory" */
+//   reader->SetNumJobs(4);
+//   ... the options of Reader ...
+//   reader->Initialize(files);
+//
+// The in-memory shards are parsed by the jobs threads at the same time
+// in Initialize(), which share the pool of the parser. The on-disk
+// shards are opened in the order of the pass, and the jobs shards from
+// current one are open at a time, whose loader threads parse their first
+// blocks ahead (see Prefetch), so the next shard is ready when current
+// one ends. A shard is closed at its end, so the open files and the
+// parsed blocks are bounded by the jobs, and the later passes open it
+// again from its binary cache.
+//
+// SetShuffle(true) shuffles the order of the shards in each pass except
+// the first one, and each shard shuffles its own rows as its reader does.
+// SetShard() splits the list instead of the files, where the shard of
+// the worker has the files i of i % num_shard == shard, and each file is
+// split as usual if the list has fewer files than the workers.
+//------------------------------------------------------------------------------
+class ShardReader : public Reader {
+ public:
+  // Constructor and Destructor
+  ShardReader() { }
+  ~ShardReader() { Clear(); }
+
+  // The reader of each shard, which is "memory" or "disk".
+  void SetShardType(const std::string& type) {
+    CHECK(type == "memory" || type == "disk");
+    shard_type_ = type;
+  }
+
+  // Number of the shards parsed at the same time. 2 by default.
+  void SetNumJobs(size_t jobs) {
+    CHECK_GT(jobs, 0);
+    num_jobs_ = jobs;
+  }
+
+  // Read the files of the list (see ExpandFileList).
+  virtual void Initialize(const std::string& filename) {
+    Initialize(ExpandFileList(filename));
+  }
+  virtual void Initialize(xLearn::DMatrix* &dmatrix) { }
+
+  // Read the files, which must not be the streams.
+  void Initialize(const std::vector<std::string>& files);
+
+  // Sample the rows of current shard, and go on
+  // to the next shard at the end of it.
+  virtual index_t Samples(DMatrix* &matrix);
+
+  // Start the next pass, whose shards are shuffled.
+  virtual void Reset();
+
+  // Close all the shards.
+  virtual void Clear();
+
+  // Return the Reader type
+  virtual std::string Type() {
+    return "shard";
+  }
+
+  // Shuffle the shards from the next pass, and the rows of each one.
+  virtual void SetShuffle(bool shuffle);
+
+  // Renumber the features and the fields of the shards,
+  // including the on-disk shards that are opened later.
+  virtual void SetFeatureMap(const std::vector<index_t>* map);
+  virtual void SetFieldMap(const std::vector<index_t>* map);
+
+  // The budgets of the on-disk shards, which are split evenly
+  // over the jobs shards open at a time.
+  virtual void SetBlockCache(uint64 bytes) {
+    block_cache_ = bytes;
+  }
+  virtual void SetAutoBlock(uint64 memory) {
+    auto_block_ = true;
+    auto_memory_ = memory;
+  }
+
+  // Skip the rest of current pass.
+  virtual void EndPass();
+
+  // Number of the shards of the reader.
+  size_t NumShards() const { return files_.size(); }
+
+ protected:
+  /* The type of the readers of the shards */
+  std::string shard_type_ = "memory";
+  /* Number of the shards parsed at the same time */
+  size_t num_jobs_ = 2;
+  /* The files of the shards, and their readers,
+  which are nullptr for the closed on-disk shards */
+  std::vector<std::string> files_;
+  std::vector<std::unique_ptr<Reader> > shards_;
+  /* The shards of current pass, and the position in it */
+  std::vector<size_t> order_;
+  size_t pos_ = 0;
+  /* Number of the passes, which is used by the shuffle */
+  uint32 epoch_ = 0;
+  /* The budgets of the on-disk shards */
+  uint64 block_cache_ = 0;
+  bool auto_block_ = false;
+  uint64 auto_memory_ = 0;
+  /* The list is split over the workers of SetShard(),
+  and otherwise each file is split */
+  bool split_list_ = false;
+  /* The stats merged from the shards of current pass, and
+  if all of them have the stats, which are the stats of the
+  reader (see GetStats) after the whole pass */
+  DataStats pass_stats_;
+  bool pass_has_stats_ = true;
+
+  // If the shards are read from disk.
+  bool on_disk() const { return shard_type_ == "disk"; }
+
+  // Create the reader of the shard i and initialize it.
+  Reader* open_shard(size_t i);
+
+  // Open the on-disk shards of current pass from pos_ to
+  // pos_ + num_jobs_, which start to parse their blocks.
+  void open_window();
+
+  // Current shard ends, whose stats are merged and which
+  // is closed (on disk) or rewound (in memory).
+  void end_shard(size_t i);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ShardReader);
+};
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -20,11 +20,23 @@ This file tests the Reader class.
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifndef _MSC_VER
+#include <sys/stat.h>
+#endif
+
+#ifdef XLEARN_USE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "src/reader/reader.h"
 #include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
 
 using std::vector;
 using std::string;
@@ -133,6 +145,15 @@ void delete_file() {
   RemoveFile(csv_file_comma.c_str());
   RemoveFile(lr_no_file_comma.c_str());
   RemoveFile(ffm_no_file_comma.c_str());
+  // cache of the on-disk reader
+  const char* names[] = { "_LR", "_ffm", "_csv", "_LR_no", "_ffm_no" };
+  for (int i = 0; i < 5; ++i) {
+    string prefix = kTestfilename + names[i];
+    string cache = prefix + ".txt.disk.bin";
+    if (FileExist(cache.c_str())) { RemoveFile(cache.c_str()); }
+    cache = prefix + "_comma.txt.disk.bin";
+    if (FileExist(cache.c_str())) { RemoveFile(cache.c_str()); }
+  }
 }
 
 void CheckLR(const DMatrix* matrix, bool has_label, bool disk) {
@@ -367,6 +388,1029 @@ TEST(ReaderTest, SampleFromDisk) {
   delete_file();
 }
 
+// Read all the labels of the file in order.
+std::vector<real_t> read_labels(Reader* reader, index_t max_rows) {
+  std::vector<real_t> labels;
+  DMatrix* matrix = nullptr;
+  while (labels.size() < max_rows && reader->Samples(matrix) > 0) {
+    labels.insert(labels.end(), matrix->Y.begin(), matrix->Y.end());
+  }
+  return labels;
+}
+
+// The blocks parsed in background are the same as before.
+TEST(ReaderTest, SampleFromDisk_prefetch) {
+  // About 3 MB, so there are 3 blocks of 1 MB
+  string filename = kTestfilename + "_prefetch.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 150000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  size_t prefetch[3] = { 0, 1, OndiskReader::kDefaultPrefetch };
+  for (int p = 0; p < 3; ++p) {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    reader.SetPrefetch(prefetch[p]);
+    reader.Initialize(filename);
+    // Two epochs
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader.Reset();
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+      DMatrix* matrix = nullptr;
+      EXPECT_EQ(reader.Samples(matrix), 0);
+      EXPECT_TRUE(matrix == nullptr);
+    }
+    // Reset in the middle of the file
+    reader.Reset();
+    std::vector<real_t> head = read_labels(&reader, 1);
+    ASSERT_GT(head.size(), 0);
+    ASSERT_LT(head.size(), kRows);
+    reader.Reset();
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    reader.Clear();
+    string cache = filename + ".disk.bin";
+    if (FileExist(cache.c_str())) { RemoveFile(cache.c_str()); }
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The shards of the file have all the lines in order, and each line
+// is in one shard, for the readers of the text and the binary files.
+TEST(ReaderTest, Shard) {
+  string filename = kTestfilename + "_shard.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 150000;
+  for (index_t i = 0; i < kRows; ++i) {
+    // The lines have different lengths
+    string line = StringPrintf("%u 1:0.5 2:0.25%s\n", i,
+                               i % 7 == 0 ? " 3:0.125" : "");
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  const size_t kShard = 3;
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<real_t> disk_labels, mem_labels;
+    for (size_t shard = 0; shard < kShard; ++shard) {
+      OndiskReader disk;
+      disk.SetBlockSize(1);
+      disk.SetShard(shard, kShard);
+      disk.Initialize(filename);
+      std::vector<real_t> labels = read_labels(&disk, kRows + 1);
+      // The shards have about the same number of rows
+      EXPECT_GT(labels.size(), kRows / kShard - 3000);
+      EXPECT_LT(labels.size(), kRows / kShard + 3000);
+      disk_labels.insert(disk_labels.end(), labels.begin(), labels.end());
+      disk.Clear();
+      InmemReader mem;
+      mem.SetShard(shard, kShard);
+      mem.Initialize(filename);
+      DMatrix* matrix = nullptr;
+      while (mem.Samples(matrix) > 0) {
+        mem_labels.insert(mem_labels.end(),
+                          matrix->Y.begin(), matrix->Y.end());
+      }
+      mem.Clear();
+    }
+    ASSERT_EQ(disk_labels.size(), kRows);
+    ASSERT_EQ(mem_labels.size(), kRows);
+    for (index_t i = 0; i < kRows; ++i) {
+      EXPECT_EQ(disk_labels[i], (real_t)i);
+      EXPECT_EQ(mem_labels[i], (real_t)i);
+    }
+  }
+  // The second pass reads the binary files of the shards
+  for (size_t shard = 0; shard < kShard; ++shard) {
+    string suffix = StringPrintf(".%lu-of-%lu", shard, kShard);
+    string bin = filename + suffix + ".bin";
+    string cache = filename + suffix + ".disk.bin";
+    EXPECT_TRUE(FileExist(bin.c_str()));
+    EXPECT_TRUE(FileExist(cache.c_str()));
+    RemoveFile(bin.c_str());
+    RemoveFile(cache.c_str());
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The files of a list are read as one dataset in memory and on
+// disk, and the later passes read them in a shuffled order.
+TEST(ReaderTest, ShardReader) {
+  const size_t kFiles = 5;
+  const index_t kRows = 20000;
+  std::vector<string> files;
+  for (size_t f = 0; f < kFiles; ++f) {
+    string filename = kTestfilename + StringPrintf("_list_%lu.txt", f);
+    FILE* file = OpenFileOrDie(filename.c_str(), "w");
+    for (index_t i = 0; i < kRows; ++i) {
+      string line = StringPrintf("%lu 1:0.5 %u:0.25\n",
+                                 f * kRows + i, i + 2);
+      WriteDataToDisk(file, line.data(), line.size());
+    }
+    Close(file);
+    files.push_back(filename);
+  }
+  std::vector<real_t> expect(kFiles * kRows);
+  for (size_t i = 0; i < expect.size(); ++i) {
+    expect[i] = i;
+  }
+  const char* types[] = { "memory", "disk" };
+  for (int t = 0; t < 2; ++t) {
+    ShardReader reader;
+    reader.SetShardType(types[t]);
+    reader.SetNumJobs(3);
+    reader.SetBlockSize(1);
+    reader.Initialize(files);
+    EXPECT_EQ(reader.NumShards(), kFiles);
+    EXPECT_TRUE(reader.has_label());
+    EXPECT_EQ(read_labels(&reader, expect.size() + 1), expect);
+    DataStats stats;
+    ASSERT_TRUE(reader.GetStats(&stats));
+    EXPECT_EQ(stats.rows, kFiles * kRows);
+    EXPECT_EQ(stats.max_feat, kRows + 1);
+    // The files are shuffled, and then the rows of each one
+    reader.SetShuffle(true);
+    for (int pass = 0; pass < 2; ++pass) {
+      reader.Reset();
+      std::vector<real_t> labels = read_labels(&reader, expect.size() + 1);
+      ASSERT_EQ(labels.size(), expect.size());
+      EXPECT_NE(labels, expect);
+      std::sort(labels.begin(), labels.end());
+      EXPECT_EQ(labels, expect);
+    }
+    reader.Clear();
+  }
+  // Each worker reads its files of the list
+  {
+    ShardReader reader;
+    reader.SetShard(1, 2);
+    reader.Initialize(files);
+    EXPECT_EQ(reader.NumShards(), 2);
+    std::vector<real_t> labels = read_labels(&reader, expect.size());
+    ASSERT_EQ(labels.size(), 2 * kRows);
+    EXPECT_EQ(labels[0], kRows);
+    EXPECT_EQ(labels[kRows], 3 * kRows);
+  }
+  for (size_t f = 0; f < kFiles; ++f) {
+    RemoveFile((files[f] + ".bin").c_str());
+    RemoveFile((files[f] + ".disk.bin").c_str());
+    RemoveFile(files[f].c_str());
+  }
+}
+
+// The first pass writes the binary cache, and the later
+// passes (and readers) read the same blocks from the cache.
+TEST(ReaderTest, SampleFromDisk_cache) {
+  string filename = kTestfilename + "_cache.txt";
+  string cache = filename + ".disk.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 150000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  size_t prefetch[2] = { 0, OndiskReader::kDefaultPrefetch };
+  for (int p = 0; p < 2; ++p) {
+    {
+      OndiskReader reader;
+      reader.SetBlockSize(1);
+      reader.SetPrefetch(prefetch[p]);
+      reader.Initialize(filename);
+      EXPECT_FALSE(reader.FromCache());
+      // An unfinished pass does not leave the cache
+      reader.Reset();
+      ASSERT_LT(read_labels(&reader, 1).size(), kRows);
+      reader.Reset();
+      EXPECT_FALSE(reader.FromCache());
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+      EXPECT_TRUE(reader.FromCache());
+      EXPECT_TRUE(FileExist(cache.c_str()));
+      for (int epoch = 0; epoch < 2; ++epoch) {
+        reader.Reset();
+        EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+      }
+      reader.Reset();
+      read_labels(&reader, 1);
+      reader.Reset();
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    }
+    // A new reader uses the cache
+    {
+      OndiskReader reader;
+      reader.SetBlockSize(1);
+      reader.SetPrefetch(prefetch[p]);
+      reader.Initialize(filename);
+      EXPECT_TRUE(reader.FromCache());
+      reader.Reset();
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    }
+    RemoveFile(cache.c_str());
+  }
+  // No cache
+  {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    reader.SetNoBin();
+    reader.Initialize(filename);
+    reader.Reset();
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    EXPECT_FALSE(reader.FromCache());
+    EXPECT_FALSE(FileExist(cache.c_str()));
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The stats of the parser are kept in the bin file and in the cache.
+TEST(ReaderTest, GetStats) {
+  string filename = kTestfilename + "_stats.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 150000;
+  DataStats expect;
+  expect.rows = kRows;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u", i % 2);
+    for (index_t j = 0; j < i % 3 + 1; ++j) {
+      line += StringPrintf(" %u:%u:0.5", j + 1, i % 1000 + j);
+      expect.AddNode(i % 1000 + j, j + 1);
+    }
+    line += "\n";
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  ASSERT_EQ(expect.max_feat, 1001);
+  ASSERT_EQ(expect.max_field, 3);
+  auto check = [&](const Reader& reader) {
+    DataStats stats;
+    ASSERT_TRUE(reader.GetStats(&stats));
+    EXPECT_EQ(stats.max_feat, expect.max_feat);
+    EXPECT_EQ(stats.max_field, expect.max_field);
+    EXPECT_EQ(stats.nnz, expect.nnz);
+    EXPECT_EQ(stats.rows, expect.rows);
+  };
+  DataStats stats;
+  // The txt file and then the bin file
+  for (int t = 0; t < 2; ++t) {
+    InmemReader reader;
+    reader.Initialize(filename);
+    check(reader);
+  }
+  {
+    InmemReader reader;
+    reader.SetNegativeRate(0.5);
+    reader.Initialize(filename);
+    EXPECT_FALSE(reader.GetStats(&stats));
+  }
+  RemoveFile((filename + ".bin").c_str());
+  // The stats are known after the first pass, without
+  // the cache and then with it
+  for (int p = 0; p < 2; ++p) {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    if (p == 0) { reader.SetNoBin(); }
+    reader.Initialize(filename);
+    reader.Reset();
+    read_labels(&reader, 1);
+    reader.Reset();
+    EXPECT_FALSE(reader.GetStats(&stats));
+    EXPECT_EQ(read_labels(&reader, kRows + 1).size(), kRows);
+    reader.Reset();
+    check(reader);
+  }
+  // A new reader has the stats of the cache
+  {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    reader.Initialize(filename);
+    EXPECT_TRUE(reader.FromCache());
+    check(reader);
+  }
+  RemoveFile((filename + ".disk.bin").c_str());
+  RemoveFile(filename.c_str());
+}
+
+// The later passes are shuffled by the seed, and the order is the
+// same with or without the cache and the prefetch.
+TEST(ReaderTest, SampleFromDisk_shuffle) {
+  string filename = kTestfilename + "_shuffle.txt";
+  string cache = filename + ".disk.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 150000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  // Passes 2 and 3 of the first reader
+  std::vector<real_t> shuffled[2];
+  for (int t = 0; t < 4; ++t) {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    reader.SetSeed(3);
+    reader.SetPrefetch(t % 2 == 0 ? 0 : OndiskReader::kDefaultPrefetch);
+    if (t >= 2) { reader.SetNoBin(); }
+    reader.Initialize(filename);
+    reader.SetShuffle(true);
+    // The first pass is in order
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader.Reset();
+      std::vector<real_t> labels = read_labels(&reader, kRows + 1);
+      if (t == 0) {
+        shuffled[epoch] = labels;
+        EXPECT_NE(labels, expect);
+        // The rows are shuffled in the block
+        EXPECT_FALSE(std::is_sorted(labels.begin(), labels.begin() + 100));
+        std::sort(labels.begin(), labels.end());
+        EXPECT_EQ(labels, expect);
+      } else {
+        EXPECT_EQ(labels, shuffled[epoch]);
+      }
+    }
+    EXPECT_EQ(reader.FromCache(), t < 2);
+    EXPECT_NE(shuffled[0], shuffled[1]);
+    // No shuffle
+    reader.SetShuffle(false);
+    reader.Reset();
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    if (t == 1) { RemoveFile(cache.c_str()); }
+  }
+  // Another seed
+  OndiskReader reader;
+  reader.SetBlockSize(1);
+  reader.SetSeed(4);
+  reader.SetNoBin();
+  reader.Initialize(filename);
+  reader.SetShuffle(true);
+  read_labels(&reader, kRows + 1);
+  reader.Reset();
+  EXPECT_NE(read_labels(&reader, kRows + 1), shuffled[0]);
+  RemoveFile(filename.c_str());
+}
+
+// The blocks kept in memory give the same rows as the txt file
+// and the binary cache, in order and shuffled.
+TEST(ReaderTest, SampleFromDisk_block_cache) {
+  string filename = kTestfilename + "_block_cache.txt";
+  string cache = filename + ".disk.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 200000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  // The bytes of all the blocks
+  uint64 total = 0;
+  {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    reader.SetNoBin();
+    reader.SetBlockCache(1ULL << 30);
+    reader.Initialize(filename);
+    read_labels(&reader, kRows + 1);
+    total = reader.GetBlockCache().Bytes();
+    EXPECT_GT(reader.GetBlockCache().Size(), 2);
+  }
+  for (int t = 0; t < 8; ++t) {
+    bool bin = t % 2 == 0, shuffle = t / 2 % 2 == 0;
+    size_t prefetch = t < 4 ? 0 : OndiskReader::kDefaultPrefetch;
+    OndiskReader reader, expect;
+    OndiskReader* readers[2] = { &reader, &expect };
+    for (OndiskReader* r : readers) {
+      r->SetBlockSize(1);
+      r->SetSeed(3);
+      r->SetPrefetch(prefetch);
+      if (!bin) { r->SetNoBin(); }
+    }
+    // Half of the blocks are kept
+    reader.SetBlockCache(total / 2);
+    reader.Initialize(filename);
+    read_labels(&reader, kRows + 1);
+    if (bin) { EXPECT_TRUE(reader.FromCache()); }
+    // The other reader uses the cache of the first one
+    expect.Initialize(filename);
+    read_labels(&expect, kRows + 1);
+    reader.SetShuffle(shuffle);
+    expect.SetShuffle(shuffle);
+    for (int epoch = 0; epoch < 3; ++epoch) {
+      uint64 hits = reader.GetBlockCache().Hits();
+      reader.Reset();
+      expect.Reset();
+      EXPECT_EQ(read_labels(&reader, kRows + 1),
+                read_labels(&expect, kRows + 1));
+      EXPECT_GT(reader.GetBlockCache().Hits(), hits);
+      EXPECT_LE(reader.GetBlockCache().Bytes(), total / 2);
+    }
+    EXPECT_GT(reader.GetBlockCache().Misses(), 0);
+    if (bin) { RemoveFile(cache.c_str()); }
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The binary file is written while the rows are sampled, and the
+// next reader reads the same rows from it.
+TEST(ReaderTest, SampleFromMemory_write_binary) {
+  string filename = kTestfilename + "_write_binary.txt";
+  string bin_file = filename + ".bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 200000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  auto read_all = [](InmemReader* reader) {
+    std::vector<real_t> labels;
+    DMatrix* matrix = nullptr;
+    while (reader->Samples(matrix) > 0) {
+      labels.insert(labels.end(), matrix->Y.begin(), matrix->Y.end());
+    }
+    return labels;
+  };
+  {
+    InmemReader reader;
+    reader.Initialize(filename);
+    // The first pass does not wait for the writer
+    EXPECT_EQ(read_all(&reader), expect);
+    reader.WaitBinary();
+    EXPECT_TRUE(FileExist(bin_file.c_str()));
+    EXPECT_FALSE(FileExist((bin_file + ".tmp").c_str()));
+    reader.Reset();
+    EXPECT_EQ(read_all(&reader), expect);
+  }
+  {
+    InmemReader reader;
+    reader.Initialize(filename);
+    EXPECT_EQ(read_all(&reader), expect);
+  }
+  // The negative sampling waits for the writer, and
+  // the binary file has all the rows
+  RemoveFile(bin_file.c_str());
+  {
+    InmemReader reader;
+    reader.SetNegativeRate(0.5);
+    reader.Initialize(filename);
+    EXPECT_LT(read_all(&reader).size(), kRows);
+  }
+  {
+    InmemReader reader;
+    reader.Initialize(filename);
+    EXPECT_EQ(read_all(&reader), expect);
+  }
+  RemoveFile(bin_file.c_str());
+  RemoveFile(filename.c_str());
+}
+
+// The text read by -io nocache, direct and uring is the same, which
+// fall back to nocache and cache if they are not supported.
+// The rows are sampled by their loss, and each of them is
+// weighted by 1/p for its probability p.
+TEST(ReaderTest, SampleFromMemory_loss_rate) {
+  string filename = kTestfilename + "_loss_rate.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 20000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  InmemReader reader;
+  reader.SetNoBin();
+  reader.SetSeed(1);
+  reader.SetShuffle(true);
+  reader.Initialize(filename);
+  // It has no effect before the loss is kept
+  reader.SetLossRate(0.5);
+  reader.Reset();
+  RowLoss* rows = reader.TrackLoss();
+  ASSERT_TRUE(rows != nullptr);
+  EXPECT_EQ(rows->loss.size(), kRows);
+  DMatrix* matrix = nullptr;
+  ASSERT_EQ(reader.Samples(matrix), kRows);
+  EXPECT_EQ(rows->batch_weight, kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    EXPECT_EQ(matrix->Y[i], rows->ids[i]);
+    EXPECT_EQ(rows->weight[i], 1.0);
+    // The even rows have the loss
+    rows->loss[rows->ids[i]] = rows->ids[i] % 2 == 0 ? 1.0 : 0.0;
+  }
+  EXPECT_EQ(reader.Samples(matrix), 0);
+  // The even rows are kept with p = 1 and the odd ones with
+  // p = 0.5 * kMinLossShare
+  reader.Reset();
+  index_t num = reader.Samples(matrix);
+  real_t least = 0.5 * Reader::kMinLossShare;
+  index_t num_odd = 0;
+  std::vector<bool> seen(kRows, false);
+  for (index_t i = 0; i < num; ++i) {
+    index_t id = rows->ids[i];
+    EXPECT_EQ(matrix->Y[i], id);
+    EXPECT_FALSE(seen[id]);
+    seen[id] = true;
+    if (id % 2 == 0) {
+      EXPECT_EQ(rows->weight[i], 1.0);
+    } else {
+      EXPECT_FLOAT_EQ(rows->weight[i], 1.0 / least);
+      num_odd++;
+    }
+  }
+  EXPECT_EQ(num - num_odd, kRows / 2);
+  EXPECT_GT(num_odd, kRows / 2 * least * 0.7);
+  EXPECT_LT(num_odd, kRows / 2 * least * 1.3);
+  EXPECT_EQ(reader.Samples(matrix), 0);
+  // All the rows are read again with the rate 1
+  reader.SetLossRate(1.0);
+  reader.Reset();
+  EXPECT_EQ(reader.Samples(matrix), kRows);
+  EXPECT_EQ(rows->batch_weight, kRows);
+  RemoveFile(filename.c_str());
+}
+
+TEST(ReaderTest, SampleFromDisk_file_io) {
+  // About 3 MB, so there are 3 blocks of 1 MB
+  string filename = kTestfilename + "_file_io.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 150000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  FileIO modes[3] = { kFileNoCache, kFileDirect, kFileUring };
+  for (FileIO io : modes) {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    reader.SetNoBin();
+    reader.SetFileIO(io);
+    reader.Initialize(filename);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader.Reset();
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    }
+    reader.SetShuffle(true);
+    reader.Reset();
+    std::vector<real_t> labels = read_labels(&reader, kRows + 1);
+    std::sort(labels.begin(), labels.end());
+    EXPECT_EQ(labels, expect);
+    // The in-memory reader
+    InmemReader inmem;
+    inmem.SetBlockSize(1);
+    inmem.SetNoBin();
+    inmem.SetFileIO(io);
+    inmem.Initialize(filename);
+    labels.clear();
+    DMatrix* matrix = nullptr;
+    while (inmem.Samples(matrix) > 0) {
+      labels.insert(labels.end(), matrix->Y.begin(), matrix->Y.end());
+    }
+    EXPECT_EQ(labels, expect);
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The block size of --auto-block changes in the first pass, and
+// the later passes read the same blocks, in order or shuffled.
+TEST(ReaderTest, SampleFromDisk_auto_block) {
+  // About 8 MB
+  string filename = kTestfilename + "_auto_block.txt";
+  string cache = filename + ".disk.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 500000;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  // Without and with the memory of -mem
+  uint64 memory[2] = { 0, 3 * OndiskReader::kMinAutoBlock };
+  for (int t = 0; t < 4; ++t) {
+    bool bin = t % 2 == 0;
+    OndiskReader reader;
+    reader.SetBlockSize(4);
+    reader.SetSeed(5);
+    reader.SetAutoBlock(memory[t / 2]);
+    if (!bin) { reader.SetNoBin(); }
+    reader.Initialize(filename);
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    EXPECT_GE(reader.GetBlockBytes(), OndiskReader::kMinAutoBlock);
+    EXPECT_LE(reader.GetBlockBytes(), 4 * OndiskReader::kMinAutoBlock);
+    if (bin) { EXPECT_TRUE(reader.FromCache()); }
+    reader.Reset();
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    reader.SetShuffle(true);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader.Reset();
+      std::vector<real_t> labels = read_labels(&reader, kRows + 1);
+      std::sort(labels.begin(), labels.end());
+      EXPECT_EQ(labels, expect);
+    }
+    if (bin) { RemoveFile(cache.c_str()); }
+  }
+  RemoveFile(filename.c_str());
+}
+
+#ifndef _MSC_VER
+// A named pipe is read once, and the line at the end of a block
+// is carried to the next block.
+TEST(ReaderTest, SampleFromDisk_stream) {
+  string fifo = kTestfilename + "_stream.fifo";
+  string cache = fifo + ".disk.bin";
+  const index_t kRows = 150000;
+  string data;
+  for (index_t i = 0; i < kRows; ++i) {
+    data += StringPrintf("%u 1:0.5 2:0.25\n", i);
+  }
+  // The last line has no '\n'
+  data.pop_back();
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  for (int t = 0; t < 2; ++t) {
+    remove(fifo.c_str());
+    ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+    std::thread writer([&]() {
+      FILE* file = OpenFileOrDie(fifo.c_str(), "w");
+      WriteDataToDisk(file, data.data(), data.size());
+      Close(file);
+    });
+    {
+      OndiskReader reader;
+      reader.SetBlockSize(1);
+      if (t == 1) { reader.SetNoBin(); }
+      reader.Initialize(fifo);
+      EXPECT_TRUE(reader.IsStream());
+      EXPECT_TRUE(reader.has_label());
+      reader.SetShuffle(true);
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+      reader.Reset();
+      std::vector<real_t> labels = read_labels(&reader, kRows + 1);
+      if (t == 0) {
+        // The later passes read the cache
+        EXPECT_TRUE(reader.FromCache());
+        EXPECT_TRUE(FileExist(cache.c_str()));
+        EXPECT_NE(labels, expect);
+        std::sort(labels.begin(), labels.end());
+        EXPECT_EQ(labels, expect);
+      } else {
+        // Single pass
+        EXPECT_FALSE(reader.FromCache());
+        EXPECT_TRUE(labels.empty());
+      }
+      writer.join();
+    }
+    // The cache of a stream is removed
+    EXPECT_FALSE(FileExist(cache.c_str()));
+  }
+  RemoveFile(fifo.c_str());
+}
+#endif
+
+#ifdef XLEARN_USE_ZLIB
+// The gzip file is decompressed in each pass, and the later
+// passes of the on-disk reader read the cache.
+TEST(ReaderTest, SampleFromGzip) {
+  string filename = kTestfilename + "_gzip.txt.gz";
+  string cache = filename + ".disk.bin";
+  const index_t kRows = 150000;
+  gzFile gz = gzopen(filename.c_str(), "wb");
+  ASSERT_TRUE(gz != nullptr);
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 2:0.25\n", i);
+    gzwrite(gz, line.data(), line.size());
+  }
+  gzclose(gz);
+  std::vector<real_t> expect(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    expect[i] = (real_t)i;
+  }
+  for (int t = 0; t < 2; ++t) {
+    OndiskReader reader;
+    reader.SetBlockSize(1);
+    if (t == 1) { reader.SetNoBin(); }
+    reader.Initialize(filename);
+    EXPECT_TRUE(reader.has_label());
+    EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader.Reset();
+      EXPECT_EQ(read_labels(&reader, kRows + 1), expect);
+      EXPECT_EQ(reader.FromCache(), t == 0);
+    }
+    EXPECT_EQ(FileExist(cache.c_str()), t == 0);
+    remove(cache.c_str());
+  }
+  // In-memory
+  {
+    InmemReader reader;
+    reader.SetNoBin();
+    reader.Initialize(filename);
+    std::vector<real_t> labels;
+    DMatrix* matrix = nullptr;
+    while (reader.Samples(matrix) > 0) {
+      labels.insert(labels.end(), matrix->Y.begin(), matrix->Y.end());
+    }
+    EXPECT_EQ(labels, expect);
+  }
+  RemoveFile(filename.c_str());
+}
+#endif
+
+// A fold of the matrix samples its own rows only.
+TEST(ReaderTest, FromDMReader_range) {
+  DMatrix matrix;
+  matrix.has_label = true;
+  for (index_t i = 0; i < 10; ++i) {
+    matrix.AddRow();
+    matrix.Y[i] = i;
+    matrix.AddNode(i, i, 1.0);
+  }
+  FromDMReader reader;
+  reader.Initialize(&matrix, 3, 7);
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    reader.SetShuffle(epoch == 1);
+    reader.Reset();
+    DMatrix* samples = nullptr;
+    ASSERT_EQ(reader.Samples(samples), 4);
+    std::vector<real_t> labels(samples->Y.begin(), samples->Y.end());
+    std::sort(labels.begin(), labels.end());
+    EXPECT_EQ(labels, std::vector<real_t>({ 3, 4, 5, 6 }));
+    for (index_t i = 0; i < 4; ++i) {
+      EXPECT_EQ((*samples->row[i])[0].feat_id, (index_t)samples->Y[i]);
+    }
+    EXPECT_EQ(reader.Samples(samples), 0);
+  }
+}
+
+// Each window of the shuffled rows is sorted by the min-hash, and
+// every row is read once in each pass.
+TEST(ReaderTest, FromDMReader_shuffle_window) {
+  DMatrix matrix;
+  matrix.has_label = true;
+  for (index_t i = 0; i < 1000; ++i) {
+    matrix.AddRow();
+    matrix.Y[i] = i;
+    matrix.AddNode(i, i % 37, 1.0);
+    matrix.AddNode(i, 100 + i % 11, 1.0);
+  }
+  DMatrix* data = &matrix;
+  FromDMReader reader;
+  reader.Initialize(data);
+  reader.SetShuffleWindow(64);
+  reader.SetShuffle(true);
+  std::vector<real_t> passes[2];
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    reader.Reset();
+    DMatrix* samples = nullptr;
+    ASSERT_EQ(reader.Samples(samples), 1000);
+    for (index_t i = 0; i < 1000; ++i) {
+      passes[epoch].push_back(samples->Y[i]);
+      if (i % 64 != 0) {
+        EXPECT_LE(Reader::MinHashRow(samples->row[i-1]),
+                  Reader::MinHashRow(samples->row[i]));
+      }
+    }
+    EXPECT_EQ(reader.Samples(samples), 0);
+    std::vector<real_t> labels = passes[epoch];
+    std::sort(labels.begin(), labels.end());
+    for (index_t i = 0; i < 1000; ++i) { EXPECT_EQ(labels[i], i); }
+  }
+  EXPECT_NE(passes[0], passes[1]);
+}
+
+// The negative sampling keeps all the positive rows and the
+// same negative rows for the same seed.
+TEST(ReaderTest, FromDMReader_neg_rate) {
+  DMatrix matrix;
+  matrix.has_label = true;
+  for (index_t i = 0; i < 2000; ++i) {
+    matrix.AddRow();
+    matrix.Y[i] = i % 10 == 0 ? 1 : -1;
+    matrix.AddNode(i, i, 1.0);
+  }
+  DMatrix* data = &matrix;
+  std::vector<real_t> kept[2];
+  for (int t = 0; t < 2; ++t) {
+    FromDMReader reader;
+    reader.Initialize(data);
+    reader.SetShuffle(t == 1);
+    reader.SetNegativeRate(0.5);
+    DMatrix* samples = nullptr;
+    index_t num_rows = 0;
+    while (index_t n = reader.Samples(samples)) {
+      for (index_t i = 0; i < n; ++i) {
+        kept[t].push_back((*samples->row[i])[0].feat_id);
+      }
+      num_rows += n;
+    }
+    index_t num_pos = 0;
+    for (real_t id : kept[t]) {
+      if ((index_t)id % 10 == 0) { num_pos++; }
+    }
+    EXPECT_EQ(num_pos, 200);
+    EXPECT_GT(num_rows, 200 + 1800 * 0.4);
+    EXPECT_LT(num_rows, 200 + 1800 * 0.6);
+    std::sort(kept[t].begin(), kept[t].end());
+    // All the rows are read again for the rate 1
+    reader.SetNegativeRate(1.0);
+    reader.Reset();
+    num_rows = 0;
+    while (index_t n = reader.Samples(samples)) { num_rows += n; }
+    EXPECT_EQ(num_rows, 2000);
+  }
+  EXPECT_EQ(kept[0], kept[1]);
+}
+
+// The first block of 1 MB estimates the DMatrix of the whole file.
+TEST(ReaderTest, EstimateMatrix) {
+  string filename = kTestfilename + "_estimate.txt";
+  const index_t kRows = 200000;
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 1:0.5 %u:0.25 %u:1\n",
+                               i % 2, i % 1000 + 2, i % 7 + 3000);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  InmemReader reader;
+  reader.SetNoBin();
+  MatrixEstimate estimate;
+  EXPECT_TRUE(reader.EstimateMatrix(filename, 1, &estimate));
+  EXPECT_LE(estimate.sample_bytes, 1024 * 1024);
+  EXPECT_GT(estimate.sample_rows, 0);
+  EXPECT_EQ(estimate.max_feat, 3006);
+  EXPECT_NEAR((double)estimate.Rows(), kRows, kRows * 0.05);
+  reader.Initialize(filename);
+  double bytes = reader.GetMatrix()->MemoryBytes();
+  double estimated = estimate.MatrixBytes(estimate.text_bytes);
+  EXPECT_NEAR(estimated, bytes, bytes * 0.2);
+  EXPECT_GT(estimate.PackedBytes(estimate.text_bytes), 0);
+  EXPECT_LT(estimate.PackedBytes(estimate.text_bytes), estimated);
+  // The streams cannot be sampled
+  EXPECT_FALSE(reader.EstimateMatrix("-", 1, &estimate));
+  EXPECT_FALSE(reader.EstimateMatrix(filename + ".none", 1, &estimate));
+  RemoveFile(filename.c_str());
+}
+
+// The feature ids are renumbered by the map after they are read,
+// where the ids out of the map are kept, and the bin files keep
+// the ids of the text file.
+TEST(ReaderTest, SetFeatureMap) {
+  string filename = kTestfilename + "_map.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = 100;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 0:1 %u:1 9:1\n", i % 2, i % 3 + 1);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<index_t> map = { 3, 2, 1, 0 };
+  for (int r = 0; r < 4; ++r) {
+    std::unique_ptr<Reader> reader;
+    if (r % 2 == 0) {
+      reader.reset(new InmemReader);
+    } else {
+      reader.reset(new OndiskReader);
+    }
+    // The second round reads the bin files of the first round
+    reader->Initialize(filename);
+    reader->SetFeatureMap(&map);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader->Reset();
+      DMatrix* matrix = nullptr;
+      index_t rows = 0;
+      while (reader->Samples(matrix) > 0) {
+        for (index_t i = 0; i < matrix->row_length; ++i) {
+          SparseRow* row = matrix->row[i];
+          ASSERT_EQ(row->size(), 3);
+          EXPECT_EQ((*row)[0].feat_id, 3);
+          EXPECT_LE((*row)[1].feat_id, 2);
+          EXPECT_EQ((*row)[2].feat_id, 9);
+        }
+        rows += matrix->row_length;
+      }
+      EXPECT_EQ(rows, kRows);
+    }
+    reader->Clear();
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".disk.bin").c_str());
+}
+
+// The packed rows give the same batches as the rows of data_buf_ in
+// the same shuffled order, which are renumbered after they are decoded.
+TEST(ReaderTest, SampleFromMemory_packed) {
+  string filename = kTestfilename + "_packed.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kRows = InmemReader::kPackedBatch * 2 + 100;
+  for (index_t i = 0; i < kRows; ++i) {
+    string line = StringPrintf("%u 0:%u:1 1:%u:%.2f 2:9:1\n", i % 2,
+                               i % 3 + 1, i % 1000 + 10, i % 5 * 0.5);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  std::vector<index_t> map = { 3, 2, 1, 0 };
+  std::vector<std::vector<Node>> rows[2];
+  std::vector<real_t> labels[2];
+  for (int r = 0; r < 2; ++r) {
+    InmemReader reader;
+    reader.SetNoBin();
+    reader.SetPackRows(r == 1);
+    reader.Initialize(filename);
+    EXPECT_EQ(reader.Packed(), r == 1);
+    reader.SetShuffle(true);
+    reader.SetFeatureMap(&map);
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      reader.Reset();
+      DMatrix* matrix = nullptr;
+      index_t num = 0;
+      while ((num = reader.Samples(matrix)) > 0) {
+        EXPECT_EQ(num, matrix->row_length);
+        if (r == 1) { EXPECT_LE(num, InmemReader::kPackedBatch); }
+        for (index_t i = 0; i < num; ++i) {
+          SparseRow* row = matrix->row[i];
+          rows[r].emplace_back(row->begin(), row->end());
+          labels[r].push_back(matrix->Y[i]);
+        }
+      }
+    }
+    reader.Clear();
+  }
+  ASSERT_EQ(rows[0].size(), 2 * kRows);
+  ASSERT_EQ(rows[1].size(), rows[0].size());
+  EXPECT_EQ(labels[0], labels[1]);
+  for (size_t i = 0; i < rows[0].size(); ++i) {
+    ASSERT_EQ(rows[0][i].size(), 3);
+    ASSERT_EQ(rows[1][i].size(), 3);
+    EXPECT_LE(rows[1][i][0].feat_id, 2);
+    for (size_t j = 0; j < 3; ++j) {
+      EXPECT_EQ(rows[0][i][j].feat_id, rows[1][i][j].feat_id);
+      EXPECT_EQ(rows[0][i][j].field_id, rows[1][i][j].field_id);
+      EXPECT_EQ(rows[0][i][j].feat_val, rows[1][i][j].feat_val);
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+// The DMatrix of the caller is not renumbered.
+TEST(ReaderTest, SetFeatureMap_DMatrix) {
+  DMatrix data;
+  const index_t kRows = 10;
+  for (index_t i = 0; i < kRows; ++i) {
+    data.AddRow();
+    data.AddNode(i, 0, 1.0);
+    data.AddNode(i, i % 3 + 1, 1.0);
+    data.AddNode(i, 9, 1.0);
+  }
+  std::vector<index_t> map = { 3, 2, 1, 0 };
+  FromDMReader reader;
+  DMatrix* ptr = &data;
+  reader.Initialize(ptr);
+  reader.SetFeatureMap(&map);
+  DMatrix* matrix = nullptr;
+  index_t rows = 0;
+  while (reader.Samples(matrix) > 0) {
+    for (index_t i = 0; i < matrix->row_length; ++i) {
+      SparseRow* row = matrix->row[i];
+      ASSERT_EQ(row->size(), 3);
+      EXPECT_EQ((*row)[0].feat_id, 3);
+      EXPECT_LE((*row)[1].feat_id, 2);
+      EXPECT_EQ((*row)[2].feat_id, 9);
+    }
+    rows += matrix->row_length;
+  }
+  EXPECT_EQ(rows, kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    EXPECT_EQ((*data.row[i])[0].feat_id, 0);
+  }
+}
+
 Reader* CreateReader(const char* format_name) {
   return CREATE_READER(format_name);
 }
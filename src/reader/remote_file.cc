@@ -0,0 +1,511 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of RemoteFile.
+*/
+
+#include "src/reader/remote_file.h"
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef _MSC_VER
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "src/base/sha256.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+const int RemoteFile::kConnections;
+const uint64 RemoteFile::kRangeBytes;
+const int RemoteFile::kRetries;
+
+#ifndef _MSC_VER
+
+// Seconds to wait for the server before a request fails
+static const int kTimeoutSec = 60;
+// Redirects followed at most, e.g., from the namenode to a datanode
+static const int kMaxRedirects = 5;
+
+// The parts of http://<host>[:<port>]<path>
+struct HttpUrl {
+  std::string host;
+  int port = 80;
+  /* The path and the query */
+  std::string path = "/";
+};
+
+// One request, whose headers are in order
+struct HttpRequest {
+  std::string method;
+  HttpUrl url;
+  std::vector<std::pair<std::string, std::string>> headers;
+};
+
+struct HttpResponse {
+  int status = 0;
+  /* The names are in lower case */
+  std::map<std::string, std::string> headers;
+  std::string body;
+};
+
+static std::string getenv_or(const char* name, const std::string& value) {
+  const char* env = getenv(name);
+  return env != nullptr && env[0] != '\0' ? std::string(env) : value;
+}
+
+static std::string to_lower(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+  return str;
+}
+
+// Parse http://<host>[:<port>][<path>]
+static bool parse_http_url(const std::string& url, HttpUrl* out) {
+  const std::string prefix = "http://";
+  if (url.compare(0, prefix.size(), prefix) != 0) { return false; }
+  size_t begin = prefix.size();
+  size_t slash = url.find('/', begin);
+  std::string host = url.substr(begin, slash == std::string::npos ?
+                                       std::string::npos : slash - begin);
+  out->path = slash == std::string::npos ? "/" : url.substr(slash);
+  out->port = 80;
+  size_t colon = host.rfind(':');
+  if (colon != std::string::npos) {
+    out->port = atoi(host.c_str() + colon + 1);
+    host.resize(colon);
+  }
+  out->host = host;
+  return !host.empty() && out->port > 0 && out->port < 65536;
+}
+
+static std::string host_header(const HttpUrl& url) {
+  return url.port == 80 ? url.host :
+         url.host + ":" + std::to_string(url.port);
+}
+
+// The URI encoding of AWS, where '/' is kept in the path
+static std::string uri_encode(const std::string& str, bool keep_slash) {
+  std::string out;
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = str[i];
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ||
+        (c == '/' && keep_slash)) {
+      out += c;
+    } else {
+      out += StringPrintf("%%%02X", c);
+    }
+  }
+  return out;
+}
+
+// Sign the request of S3 by AWS Signature V4, whose
+// payload is empty (GET and HEAD)
+static void sign_s3(HttpRequest* req, const std::string& region) {
+  std::string key_id = getenv_or("AWS_ACCESS_KEY_ID", "");
+  std::string secret = getenv_or("AWS_SECRET_ACCESS_KEY", "");
+  if (key_id.empty() || secret.empty()) { return; }
+  std::string token = getenv_or("AWS_SESSION_TOKEN", "");
+  time_t now = time(nullptr);
+  struct tm t;
+  gmtime_r(&now, &t);
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &t);
+  std::string amz_date = stamp;
+  std::string date = amz_date.substr(0, 8);
+  std::string payload = HexString(Sha256(""));
+  // The signed headers, in the order of their names
+  std::vector<std::pair<std::string, std::string>> signed_headers = {
+    { "host", host_header(req->url) },
+    { "x-amz-content-sha256", payload },
+    { "x-amz-date", amz_date }
+  };
+  if (!token.empty()) {
+    signed_headers.push_back({ "x-amz-security-token", token });
+  }
+  std::string canonical_headers, names;
+  for (size_t i = 0; i < signed_headers.size(); ++i) {
+    canonical_headers += signed_headers[i].first + ":" +
+                         signed_headers[i].second + "\n";
+    names += (i == 0 ? "" : ";") + signed_headers[i].first;
+  }
+  std::string canonical = req->method + "\n" + req->url.path + "\n" +
+                          "\n" + canonical_headers + "\n" + names +
+                          "\n" + payload;
+  std::string scope = date + "/" + region + "/s3/aws4_request";
+  std::string to_sign = "AWS4-HMAC-SHA256\n" + amz_date + "\n" + scope +
+                        "\n" + HexString(Sha256(canonical));
+  std::string key = HmacSha256("AWS4" + secret, date);
+  key = HmacSha256(key, region);
+  key = HmacSha256(key, "s3");
+  key = HmacSha256(key, "aws4_request");
+  std::string signature = HexString(HmacSha256(key, to_sign));
+  for (size_t i = 1; i < signed_headers.size(); ++i) {
+    req->headers.push_back(signed_headers[i]);
+  }
+  req->headers.push_back({ "Authorization",
+    "AWS4-HMAC-SHA256 Credential=" + key_id + "/" + scope +
+    ", SignedHeaders=" + names + ", Signature=" + signature });
+}
+
+// Make the request of the object, which reads [begin, end) of
+// it if end > begin, or its size for the HEAD.
+static bool make_request(const std::string& url,
+                         const std::string& method,
+                         uint64 begin,
+                         uint64 end,
+                         HttpRequest* req) {
+  req->method = method;
+  req->headers.clear();
+  if (url.compare(0, 5, "s3://") == 0) {
+    std::string object = url.substr(5);
+    size_t slash = object.find('/');
+    if (slash == std::string::npos || slash == 0 ||
+        slash + 1 == object.size()) {
+      return false;
+    }
+    std::string region = getenv_or("AWS_REGION", "us-east-1");
+    std::string endpoint = getenv_or("XLEARN_S3_ENDPOINT",
+        "http://s3." + region + ".amazonaws.com");
+    if (!endpoint.empty() && endpoint.back() == '/') { endpoint.pop_back(); }
+    if (!parse_http_url(endpoint, &req->url)) { return false; }
+    // The path-style URL of the bucket
+    std::string base = req->url.path == "/" ? "" : req->url.path;
+    req->url.path = base + "/" + uri_encode(object.substr(0, slash), false) +
+                    "/" + uri_encode(object.substr(slash + 1), true);
+    req->headers.push_back({ "Host", host_header(req->url) });
+    sign_s3(req, region);
+    if (end > begin) {
+      req->headers.push_back({ "Range",
+        StringPrintf("bytes=%llu-%llu", (unsigned long long)begin,
+                     (unsigned long long)(end - 1)) });
+    }
+    return true;
+  }
+  if (url.compare(0, 7, "hdfs://") == 0) {
+    std::string address = url.substr(7);
+    size_t slash = address.find('/');
+    if (slash == std::string::npos || slash == 0) { return false; }
+    std::string host = address.substr(0, slash);
+    if (host.find(':') == std::string::npos) { host += ":9870"; }
+    if (!parse_http_url("http://" + host, &req->url)) { return false; }
+    std::string path = "/webhdfs/v1" +
+                       uri_encode(address.substr(slash), true);
+    if (end > begin) {
+      path += StringPrintf("?op=OPEN&offset=%llu&length=%llu",
+                           (unsigned long long)begin,
+                           (unsigned long long)(end - begin));
+    } else {
+      path += "?op=GETFILESTATUS";
+    }
+    std::string user = getenv_or("HADOOP_USER_NAME", "");
+    if (!user.empty()) { path += "&user.name=" + uri_encode(user, false); }
+    req->method = "GET";
+    req->url.path = path;
+    req->headers.push_back({ "Host", host_header(req->url) });
+    return true;
+  }
+  return false;
+}
+
+// Decode the body of "Transfer-Encoding: chunked"
+static bool decode_chunked(const std::string& body, std::string* out) {
+  out->clear();
+  size_t pos = 0;
+  for (;;) {
+    size_t eol = body.find("\r\n", pos);
+    if (eol == std::string::npos) { return false; }
+    uint64 size = strtoull(body.c_str() + pos, nullptr, 16);
+    pos = eol + 2;
+    if (size == 0) { return true; }
+    if (pos + size + 2 > body.size()) { return false; }
+    out->append(body, pos, size);
+    pos += size + 2;
+  }
+}
+
+// Send the request on a new connection, and read the whole
+// response, which ends when the server closes the connection.
+static bool http_send(const HttpRequest& req, HttpResponse* resp) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* res = nullptr;
+  std::string service = std::to_string(req.url.port);
+  if (getaddrinfo(req.url.host.c_str(), service.c_str(),
+                  &hints, &res) != 0) {
+    return false;
+  }
+  int fd = -1;
+  for (struct addrinfo* p = res; p != nullptr && fd < 0; p = p->ai_next) {
+    fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+    if (fd < 0) { continue; }
+    struct timeval tv = { kTimeoutSec, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(fd, p->ai_addr, p->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0) { return false; }
+  std::string text = req.method + " " + req.url.path + " HTTP/1.1\r\n";
+  for (size_t i = 0; i < req.headers.size(); ++i) {
+    text += req.headers[i].first + ": " + req.headers[i].second + "\r\n";
+  }
+  text += "Connection: close\r\n\r\n";
+  bool ok = true;
+  for (size_t sent = 0; ok && sent < text.size(); ) {
+#ifdef MSG_NOSIGNAL
+    ssize_t n = send(fd, text.data() + sent, text.size() - sent,
+                     MSG_NOSIGNAL);
+#else
+    ssize_t n = send(fd, text.data() + sent, text.size() - sent, 0);
+#endif
+    if (n < 0 && errno == EINTR) { continue; }
+    ok = n > 0;
+    sent += ok ? n : 0;
+  }
+  std::string data;
+  std::vector<char> buf(256 * 1024);
+  while (ok) {
+    ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n < 0) { ok = false; }
+    if (n <= 0) { break; }
+    data.append(buf.data(), n);
+  }
+  close(fd);
+  if (!ok) { return false; }
+  // The status line and the headers
+  size_t head_end = data.find("\r\n\r\n");
+  if (head_end == std::string::npos ||
+      data.compare(0, 5, "HTTP/") != 0) {
+    return false;
+  }
+  size_t space = data.find(' ');
+  resp->status = atoi(data.c_str() + space + 1);
+  resp->headers.clear();
+  size_t pos = data.find("\r\n") + 2;
+  while (pos < head_end) {
+    size_t eol = data.find("\r\n", pos);
+    size_t colon = data.find(':', pos);
+    if (colon != std::string::npos && colon < eol) {
+      size_t value = data.find_first_not_of(' ', colon + 1);
+      resp->headers[to_lower(data.substr(pos, colon - pos))] =
+          data.substr(value, eol - value);
+    }
+    pos = eol + 2;
+  }
+  if (req.method == "HEAD") {
+    resp->body.clear();
+    return true;
+  }
+  resp->body = data.substr(head_end + 4);
+  auto it = resp->headers.find("transfer-encoding");
+  if (it != resp->headers.end() && to_lower(it->second) == "chunked") {
+    std::string body;
+    if (!decode_chunked(resp->body, &body)) { return false; }
+    resp->body.swap(body);
+  }
+  it = resp->headers.find("content-length");
+  if (it != resp->headers.end() &&
+      strtoull(it->second.c_str(), nullptr, 10) != resp->body.size()) {
+    return false;
+  }
+  return true;
+}
+
+// Send the request of the object, and follow the redirects
+static bool fetch(const std::string& url,
+                  const std::string& method,
+                  uint64 begin,
+                  uint64 end,
+                  HttpResponse* resp) {
+  HttpRequest req;
+  if (!make_request(url, method, begin, end, &req)) { return false; }
+  for (int i = 0; i <= kMaxRedirects; ++i) {
+    if (!http_send(req, resp)) { return false; }
+    if (resp->status < 300 || resp->status >= 400) { return true; }
+    auto it = resp->headers.find("location");
+    if (it == resp->headers.end()) { return true; }
+    // The new location has the full query, so only the range is kept
+    HttpRequest next;
+    next.method = req.method;
+    if (!parse_http_url(it->second, &next.url)) { return false; }
+    next.headers.push_back({ "Host", host_header(next.url) });
+    for (size_t j = 0; j < req.headers.size(); ++j) {
+      if (req.headers[j].first == "Range") {
+        next.headers.push_back(req.headers[j]);
+      }
+    }
+    req = next;
+  }
+  return false;
+}
+
+// Download [begin, end) of the object, which
+// is requested again if it fails
+static bool fetch_range(const std::string& url,
+                        uint64 begin,
+                        uint64 end,
+                        std::string* data) {
+  for (int i = 0; i < RemoteFile::kRetries; ++i) {
+    HttpResponse resp;
+    if (fetch(url, "GET", begin, end, &resp) &&
+        (resp.status == 200 || resp.status == 206) &&
+        resp.body.size() == end - begin) {
+      data->swap(resp.body);
+      return true;
+    }
+    LOG(WARNING) << "Fail to read the bytes [" << begin << ", " << end
+                 << ") of " << url << " (status " << resp.status
+                 << "), retry " << i + 1;
+  }
+  return false;
+}
+
+bool RemoteFile::GetSize(const std::string& url, uint64* size) {
+  CHECK_NOTNULL(size);
+  HttpResponse resp;
+  if (!fetch(url, "HEAD", 0, 0, &resp) || resp.status != 200) {
+    return false;
+  }
+  if (url.compare(0, 7, "hdfs://") == 0) {
+    // {"FileStatus":{..., "length":24930, ..., "type":"FILE"}}
+    size_t pos = resp.body.find("\"length\"");
+    if (pos == std::string::npos ||
+        resp.body.find("\"DIRECTORY\"") != std::string::npos) {
+      return false;
+    }
+    pos = resp.body.find(':', pos);
+    *size = strtoull(resp.body.c_str() + pos + 1, nullptr, 10);
+    return true;
+  }
+  auto it = resp.headers.find("content-length");
+  if (it == resp.headers.end()) { return false; }
+  *size = strtoull(it->second.c_str(), nullptr, 10);
+  return true;
+}
+
+FILE* RemoteFile::Open(const std::string& url) {
+  Close();
+  if (!GetSize(url, &size_)) { return nullptr; }
+  url_ = url;
+  stop_.store(false);
+  int fds[2];
+  if (pipe(fds) != 0) {
+    LOG(FATAL) << "Cannot create the pipe: " << strerror(errno);
+  }
+  // The write() to a closed pipe returns EPIPE instead
+  signal(SIGPIPE, SIG_IGN);
+  file_ = fdopen(fds[0], "r");
+  CHECK_NOTNULL(file_);
+  write_fd_ = fds[1];
+  thread_ = std::thread(&RemoteFile::download, this);
+  return file_;
+}
+
+void RemoteFile::Close() {
+  if (file_ == nullptr) { return; }
+  // The thread stops at the next range
+  stop_.store(true);
+  fclose(file_);
+  file_ = nullptr;
+  thread_.join();
+}
+
+bool RemoteFile::write_pipe(const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t ret = write(write_fd_, data, size);
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    data += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+// The next ranges are requested while the first one is written
+void RemoteFile::download() {
+  uint64 num_ranges = (size_ + kRangeBytes - 1) / kRangeBytes;
+  std::deque<std::future<std::pair<bool, std::string>>> pending;
+  uint64 next = 0;
+  auto request = [this](uint64 index) {
+    uint64 begin = index * kRangeBytes;
+    uint64 end = std::min(begin + kRangeBytes, size_);
+    std::pair<bool, std::string> range;
+    range.first = stop_.load() ||
+                  fetch_range(url_, begin, end, &range.second);
+    return range;
+  };
+  for (uint64 i = 0; i < num_ranges; ++i) {
+    while (next < num_ranges && pending.size() < kConnections) {
+      pending.push_back(std::async(std::launch::async, request, next++));
+    }
+    std::pair<bool, std::string> range = pending.front().get();
+    pending.pop_front();
+    if (stop_.load()) { break; }
+    if (!range.first) {
+      LOG(FATAL) << "Cannot read the object " << url_;
+    }
+    if (!write_pipe(range.second.data(), range.second.size())) { break; }
+  }
+  // The rest of the requests return at once
+  stop_.store(true);
+  pending.clear();
+  close(write_fd_);
+  write_fd_ = -1;
+}
+
+#else
+
+bool RemoteFile::GetSize(const std::string& url, uint64* size) {
+  return false;
+}
+
+FILE* RemoteFile::Open(const std::string& url) { return nullptr; }
+
+void RemoteFile::Close() { }
+
+bool RemoteFile::write_pipe(const char* data, size_t size) {
+  return false;
+}
+
+void RemoteFile::download() { }
+
+#endif  // _MSC_VER
+
+}  // namespace xLearn
@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the RemoteFile class, which reads the objects
+of the object storage (s3:// and hdfs://) for the readers.
+*/
+
+#ifndef XLEARN_READER_REMOTE_FILE_H_
+#define XLEARN_READER_REMOTE_FILE_H_
+
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// RemoteFile streams an object of the object storage in its own thread,
+// which writes the object to a pipe in order, and the reader reads it
+// from the other end of the pipe like a compressed file, so nothing is
+// copied to the local disk first:
+//
+//   RemoteFile remote;
+//   FILE* file = remote.Open("s3://bucket/data/train.txt");
+//   if (file == nullptr) { ... cannot read it ... }
+//   ... ReadDataFromDisk(file, block, size) ...
+//   remote.Close();
+//
+// The object is split into the ranges of kRangeBytes, and kConnections
+// ranged GETs are in flight at the same time, so the download is not
+// bound by the latency of one request. At most kConnections ranges are
+// kept in memory, and a failed range is requested again kRetries times.
+//
+// The requests are plain HTTP (there is no TLS), and the URLs are:
+//
+//   s3://<bucket>/<key>     The endpoint is $XLEARN_S3_ENDPOINT (e.g.,
+//                           http://minio:9000), or the one of AWS for
+//                           $AWS_REGION (us-east-1 by default). The
+//                           requests are signed (AWS Signature V4) if
+//                           $AWS_ACCESS_KEY_ID and $AWS_SECRET_ACCESS_KEY
+//                           are set, with $AWS_SESSION_TOKEN if any.
+//   hdfs://<host>:<port>/<path>
+//                           The WebHDFS of the namenode (9870 by default),
+//                           which redirects to the datanodes, and the user
+//                           is $HADOOP_USER_NAME if it is set.
+//
+// The remote files are not supported on Windows.
+//------------------------------------------------------------------------------
+class RemoteFile {
+ public:
+  // Constructor and Destructor
+  RemoteFile() { }
+  ~RemoteFile() { Close(); }
+
+  // Start to stream the object of the URL. Return the file of the
+  // object, or nullptr if the object cannot be found or read.
+  FILE* Open(const std::string& url);
+
+  // Stop the download, and close the file given by Open().
+  void Close();
+
+  // Get the size of the object. Return false if it cannot be found.
+  static bool GetSize(const std::string& url, uint64* size);
+
+  static const int kConnections = 4;
+  static const uint64 kRangeBytes = 8 * 1024 * 1024;  // 8 MB
+  static const int kRetries = 3;
+
+ protected:
+  /* The URL and the size of the object */
+  std::string url_;
+  uint64 size_ = 0;
+  /* The read end of the pipe */
+  FILE* file_ = nullptr;
+  /* The write end of the pipe */
+  int write_fd_ = -1;
+  /* The download thread */
+  std::thread thread_;
+  /* Set by Close() to stop the download */
+  std::atomic<bool> stop_{false};
+
+  // Download the ranges and write them to the pipe in order.
+  void download();
+
+  // Write the data to the pipe. Return false if
+  // the reader has closed the pipe.
+  bool write_pipe(const char* data, size_t size);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RemoteFile);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_REMOTE_FILE_H_
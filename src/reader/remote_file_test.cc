@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the RemoteFile class by a local HTTP server.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/reader/remote_file.h"
+
+namespace xLearn {
+
+// Serve the object of /bucket/key (S3) and /webhdfs/v1/dir/key (WebHDFS),
+// and the WebHDFS redirects OPEN to /data, which is sent in chunks.
+class HttpServer {
+ public:
+  explicit HttpServer(const std::string& object) : object_(object) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(fd_, (struct sockaddr*)&addr, sizeof(addr));
+    listen(fd_, 16);
+    socklen_t len = sizeof(addr);
+    getsockname(fd_, (struct sockaddr*)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread(&HttpServer::serve, this);
+  }
+
+  ~HttpServer() {
+    shutdown(fd_, SHUT_RDWR);
+    close(fd_);
+    thread_.join();
+  }
+
+  int Port() const { return port_; }
+  int NumRanges() const { return num_ranges_.load(); }
+  bool Signed() const { return signed_.load(); }
+
+ protected:
+  std::string object_;
+  int fd_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+  std::atomic<int> num_ranges_{0};
+  std::atomic<bool> signed_{false};
+
+  void serve() {
+    for (;;) {
+      int conn = accept(fd_, nullptr, nullptr);
+      if (conn < 0) { return; }
+      std::thread(&HttpServer::reply, this, conn).detach();
+    }
+  }
+
+  static uint64 query(const std::string& path, const std::string& name) {
+    size_t pos = path.find(name + "=");
+    return pos == std::string::npos ? 0 :
+           strtoull(path.c_str() + pos + name.size() + 1, nullptr, 10);
+  }
+
+  void reply(int conn) {
+    std::string request;
+    char buf[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t n = recv(conn, buf, sizeof(buf), 0);
+      if (n <= 0) { break; }
+      request.append(buf, n);
+    }
+    std::string method = request.substr(0, request.find(' '));
+    size_t begin = method.size() + 1;
+    std::string path = request.substr(begin, request.find(' ', begin) - begin);
+    if (request.find("Authorization: AWS4-HMAC-SHA256") !=
+        std::string::npos) {
+      signed_.store(true);
+    }
+    std::string response;
+    if (path == "/bucket/dir/key%20a.txt") {
+      uint64 first = 0, last = object_.size() - 1;
+      size_t range = request.find("Range: bytes=");
+      if (range != std::string::npos) {
+        sscanf(request.c_str() + range, "Range: bytes=%llu-%llu",
+               (unsigned long long*)&first, (unsigned long long*)&last);
+        num_ranges_++;
+      }
+      std::string body = object_.substr(first, last - first + 1);
+      response = StringPrintf("HTTP/1.1 %s\r\nContent-Length: %llu\r\n\r\n",
+                              range == std::string::npos ? "200 OK" :
+                              "206 Partial Content",
+                              (unsigned long long)body.size());
+      if (method != "HEAD") { response += body; }
+    } else if (path.find("/webhdfs/v1/dir/key?op=GETFILESTATUS") == 0) {
+      std::string body = StringPrintf(
+          "{\"FileStatus\":{\"length\":%llu,\"type\":\"FILE\"}}",
+          (unsigned long long)object_.size());
+      response = StringPrintf("HTTP/1.1 200 OK\r\nContent-Length: %llu"
+                              "\r\n\r\n%s", (unsigned long long)body.size(),
+                              body.c_str());
+    } else if (path.find("/webhdfs/v1/dir/key?op=OPEN") == 0) {
+      response = StringPrintf("HTTP/1.1 307 Temporary Redirect\r\n"
+                              "Location: http://127.0.0.1:%d/data?"
+                              "offset=%llu&length=%llu\r\n"
+                              "Content-Length: 0\r\n\r\n", port_,
+                              (unsigned long long)query(path, "offset"),
+                              (unsigned long long)query(path, "length"));
+    } else if (path.find("/data?") == 0) {
+      num_ranges_++;
+      std::string body = object_.substr(query(path, "offset"),
+                                        query(path, "length"));
+      response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+      for (size_t i = 0; i < body.size(); i += 100000) {
+        std::string chunk = body.substr(i, 100000);
+        response += StringPrintf("%zx\r\n", chunk.size()) + chunk + "\r\n";
+      }
+      response += "0\r\n\r\n";
+    } else {
+      response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+    for (size_t sent = 0; sent < response.size(); ) {
+      ssize_t n = send(conn, response.data() + sent,
+                       response.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) { break; }
+      sent += n;
+    }
+    close(conn);
+  }
+};
+
+// An object of 2.5 ranges, whose lines are numbered
+std::string MakeObject() {
+  std::string object;
+  for (int i = 0; object.size() < RemoteFile::kRangeBytes * 5 / 2; ++i) {
+    object += StringPrintf("%d 1:%d 2:0.5\n", i % 2, i);
+  }
+  return object;
+}
+
+std::string ReadAll(FILE* file) {
+  std::string data;
+  char buf[65536];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), file)) > 0; ) {
+    data.append(buf, n);
+  }
+  return data;
+}
+
+TEST(RemoteFileTest, Is_remote_file) {
+  EXPECT_TRUE(IsRemoteFile("s3://bucket/train.txt"));
+  EXPECT_TRUE(IsRemoteFile("hdfs://namenode:9870/data/train.txt"));
+  EXPECT_FALSE(IsRemoteFile("train.txt"));
+  EXPECT_FALSE(IsRemoteFile("-"));
+  EXPECT_EQ(OutputPrefix("s3://bucket/data/train.txt"), "train.txt");
+  EXPECT_EQ(OutputPrefix("train.txt"), "train.txt");
+}
+
+TEST(RemoteFileTest, Read_s3) {
+  std::string object = MakeObject();
+  HttpServer server(object);
+  setenv("XLEARN_S3_ENDPOINT",
+         StringPrintf("http://127.0.0.1:%d", server.Port()).c_str(), 1);
+  setenv("AWS_ACCESS_KEY_ID", "AKIDEXAMPLE", 1);
+  setenv("AWS_SECRET_ACCESS_KEY", "secret", 1);
+  uint64 size = 0;
+  ASSERT_TRUE(RemoteFile::GetSize("s3://bucket/dir/key a.txt", &size));
+  EXPECT_EQ(size, object.size());
+  EXPECT_FALSE(RemoteFile::GetSize("s3://bucket/none", &size));
+  RemoteFile remote;
+  EXPECT_EQ(remote.Open("s3://bucket/none"), nullptr);
+  FILE* file = remote.Open("s3://bucket/dir/key a.txt");
+  ASSERT_TRUE(file != nullptr);
+  EXPECT_TRUE(ReadAll(file) == object);
+  remote.Close();
+  EXPECT_EQ(server.NumRanges(), 3);
+  EXPECT_TRUE(server.Signed());
+  // Close before the end
+  file = remote.Open("s3://bucket/dir/key a.txt");
+  ASSERT_TRUE(file != nullptr);
+  char buf[100];
+  ASSERT_EQ(fread(buf, 1, sizeof(buf), file), sizeof(buf));
+  EXPECT_EQ(memcmp(buf, object.data(), sizeof(buf)), 0);
+  remote.Close();
+  unsetenv("AWS_ACCESS_KEY_ID");
+  unsetenv("AWS_SECRET_ACCESS_KEY");
+}
+
+TEST(RemoteFileTest, Read_hdfs) {
+  std::string object = MakeObject();
+  HttpServer server(object);
+  std::string url = StringPrintf("hdfs://127.0.0.1:%d/dir/key",
+                                 server.Port());
+  uint64 size = 0;
+  ASSERT_TRUE(RemoteFile::GetSize(url, &size));
+  EXPECT_EQ(size, object.size());
+  RemoteFile remote;
+  FILE* file = remote.Open(url);
+  ASSERT_TRUE(file != nullptr);
+  EXPECT_TRUE(ReadAll(file) == object);
+  remote.Close();
+  EXPECT_EQ(server.NumRanges(), 3);
+}
+
+}  // namespace xLearn
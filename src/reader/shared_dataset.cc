@@ -0,0 +1,293 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of SharedDataset.
+*/
+
+#include "src/reader/shared_dataset.h"
+
+#ifndef _MSC_VER
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace xLearn {
+
+// The head of the region, whose magic is set after the data, so
+// the region of a crashed creator is never used. The head is
+// followed by the offsets of the rows (row_length + 1), the
+// nodes, Y, norm, group and the labels of the other tasks.
+struct DatasetHead {
+  std::atomic<uint64> magic;
+  uint64 hash_1;
+  uint64 hash_2;
+  uint64 row_length;
+  uint64 num_nodes;
+  uint64 has_label;
+  uint64 has_group;
+  uint64 num_task;
+};
+
+static const uint64 kDatasetMagic = 0x78446174617365ULL;
+
+// The offsets of the parts of the region.
+struct DatasetLayout {
+  uint64 offset, node, Y, norm, group, task_Y, size;
+};
+
+static uint64 align8(uint64 size) { return (size + 7) & ~(uint64)7; }
+
+static DatasetLayout get_layout(uint64 row_length, uint64 num_nodes,
+                                bool has_group, uint64 num_task) {
+  DatasetLayout layout;
+  layout.offset = align8(sizeof(DatasetHead));
+  layout.node = layout.offset + (row_length + 1) * sizeof(uint64);
+  layout.Y = align8(layout.node + num_nodes * sizeof(Node));
+  layout.norm = layout.Y + row_length * sizeof(real_t);
+  layout.group = align8(layout.norm + row_length * sizeof(real_t));
+  layout.task_Y = layout.group +
+                  (has_group ? row_length * sizeof(uint64) : 0);
+  layout.size = layout.task_Y +
+                row_length * (num_task - 1) * sizeof(real_t);
+  return layout;
+}
+
+#ifndef _MSC_VER
+
+static const int kEmptyChecks = 50;
+
+// Wait a moment between two checks of the region.
+static void nap() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+// Remove the name if it is still the region of the fd,
+// which is not the case if it has been removed and
+// created again by another process.
+static void unlink_same(const std::string& name, int fd) {
+  int cur = shm_open(name.c_str(), O_RDONLY, 0600);
+  if (cur == -1) { return; }
+  struct stat st_1, st_2;
+  if (fstat(fd, &st_1) == 0 && fstat(cur, &st_2) == 0 &&
+      st_1.st_dev == st_2.st_dev && st_1.st_ino == st_2.st_ino) {
+    shm_unlink(name.c_str());
+  }
+  close(cur);
+}
+
+bool SharedDataset::Attach(const std::string& name,
+                           uint64 hash_1,
+                           uint64 hash_2,
+                           DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  Close();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0600);
+  if (fd == -1) { return false; }
+  // The creator holds the exclusive lock until the region is
+  // filled, and the region is empty before it takes the lock,
+  // which is given up after kEmptyChecks (a crashed creator)
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  for (int empty = 0; ; ) {
+    if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+      if (fstat(fd, &st) == 0 && st.st_size > 0) { break; }
+      if (++empty == kEmptyChecks) { break; }
+      flock(fd, LOCK_UN);
+    } else if (errno != EWOULDBLOCK) {
+      close(fd);
+      return false;
+    }
+    nap();
+  }
+  uint64 size = st.st_size;
+  void* ptr = size >= sizeof(DatasetHead) ?
+              mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  const DatasetHead* head = (const DatasetHead*)ptr;
+  if (ptr == MAP_FAILED ||
+      head->magic.load(std::memory_order_acquire) != kDatasetMagic) {
+    // The creator crashed before the region was filled,
+    // so it is removed if no other process holds it
+    if (ptr != MAP_FAILED) { munmap(ptr, size); }
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0) { unlink_same(name, fd); }
+    close(fd);
+    return false;
+  }
+  if (head->hash_1 != hash_1 || head->hash_2 != hash_2 ||
+      get_layout(head->row_length, head->num_nodes,
+                 head->has_group != 0, head->num_task).size != size) {
+    munmap(ptr, size);
+    close(fd);
+    return false;
+  }
+  name_ = name;
+  fd_ = fd;
+  ptr_ = (char*)ptr;
+  size_ = size;
+  make_view(matrix);
+  return true;
+}
+
+bool SharedDataset::Create(const std::string& name, DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  Close();
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1) { return false; }
+  if (flock(fd, LOCK_EX) != 0) {
+    shm_unlink(name.c_str());
+    close(fd);
+    return false;
+  }
+  uint64 row_length = matrix->row_length;
+  uint64 num_nodes = 0;
+  for (uint64 i = 0; i < row_length; ++i) {
+    if (matrix->row[i] != nullptr) { num_nodes += matrix->row[i]->size(); }
+  }
+  DatasetLayout layout = get_layout(row_length, num_nodes,
+                                    matrix->HasGroup(), matrix->num_task);
+  // The memory of /dev/shm is reserved here, so the
+  // training does not crash when it is exhausted
+  bool ok = ftruncate(fd, layout.size) == 0;
+#ifdef __linux__
+  ok = ok && posix_fallocate(fd, 0, layout.size) == 0;
+#endif
+  void* ptr = ok ? mmap(NULL, layout.size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (ptr == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    close(fd);
+    return false;
+  }
+  char* base = (char*)ptr;
+  uint64* offset = (uint64*)(base + layout.offset);
+  Node* node = (Node*)(base + layout.node);
+  offset[0] = 0;
+  for (uint64 i = 0; i < row_length; ++i) {
+    const SparseRow* row = matrix->row[i];
+    uint64 n = row == nullptr ? 0 : row->size();
+    if (n > 0) { memcpy(node + offset[i], row->begin(), n * sizeof(Node)); }
+    offset[i+1] = offset[i] + n;
+  }
+  if (row_length > 0) {
+    memcpy(base + layout.Y, matrix->Y.data(), row_length * sizeof(real_t));
+    memcpy(base + layout.norm, matrix->norm.data(),
+           row_length * sizeof(real_t));
+  }
+  if (matrix->HasGroup() && row_length > 0) {
+    memcpy(base + layout.group, matrix->group.data(),
+           row_length * sizeof(uint64));
+  }
+  if (!matrix->task_Y.empty()) {
+    memcpy(base + layout.task_Y, matrix->task_Y.data(),
+           matrix->task_Y.size() * sizeof(real_t));
+  }
+  DatasetHead* head = (DatasetHead*)base;
+  head->hash_1 = matrix->hash_value_1;
+  head->hash_2 = matrix->hash_value_2;
+  head->row_length = row_length;
+  head->num_nodes = num_nodes;
+  head->has_label = matrix->has_label;
+  head->has_group = matrix->HasGroup();
+  head->num_task = matrix->num_task;
+  head->magic.store(kDatasetMagic, std::memory_order_release);
+  // Nobody writes the region any more
+  mprotect(ptr, layout.size, PROT_READ);
+  flock(fd, LOCK_SH);
+  name_ = name;
+  fd_ = fd;
+  ptr_ = base;
+  size_ = layout.size;
+  make_view(matrix);
+  return true;
+}
+
+void SharedDataset::Close() {
+  if (ptr_ != nullptr) {
+    munmap(ptr_, size_);
+    ptr_ = nullptr;
+    size_ = 0;
+  }
+  if (fd_ != -1) {
+    // The lock can be exclusive only for the last process
+    if (flock(fd_, LOCK_EX | LOCK_NB) == 0) { unlink_same(name_, fd_); }
+    close(fd_);
+    fd_ = -1;
+  }
+  name_.clear();
+}
+
+#else  // _MSC_VER
+
+// The shared memory is not supported on Windows yet.
+bool SharedDataset::Attach(const std::string& name,
+                           uint64 hash_1,
+                           uint64 hash_2,
+                           DMatrix* matrix) {
+  return false;
+}
+
+bool SharedDataset::Create(const std::string& name, DMatrix* matrix) {
+  return false;
+}
+
+void SharedDataset::Close() { }
+
+#endif  // _MSC_VER
+
+void SharedDataset::make_view(DMatrix* matrix) {
+  const DatasetHead* head = (const DatasetHead*)ptr_;
+  uint64 row_length = head->row_length;
+  DatasetLayout layout = get_layout(row_length, head->num_nodes,
+                                    head->has_group != 0, head->num_task);
+  const uint64* offset = (const uint64*)(ptr_ + layout.offset);
+  const Node* node = (const Node*)(ptr_ + layout.node);
+  const real_t* Y = (const real_t*)(ptr_ + layout.Y);
+  const real_t* norm = (const real_t*)(ptr_ + layout.norm);
+  matrix->Reset();
+  matrix->hash_value_1 = head->hash_1;
+  matrix->hash_value_2 = head->hash_2;
+  matrix->has_label = head->has_label != 0;
+  matrix->row_length = row_length;
+  matrix->row.resize(row_length, nullptr);
+  for (uint64 i = 0; i < row_length; ++i) {
+    matrix->row[i] = matrix->arena.NewView(node + offset[i],
+                                           offset[i+1] - offset[i]);
+  }
+  matrix->Y.assign(Y, Y + row_length);
+  matrix->norm.assign(norm, norm + row_length);
+  if (head->has_group != 0) {
+    const uint64* group = (const uint64*)(ptr_ + layout.group);
+    matrix->group.assign(group, group + row_length);
+  }
+  matrix->num_task = head->num_task;
+  if (head->num_task > 1) {
+    const real_t* task_Y = (const real_t*)(ptr_ + layout.task_Y);
+    matrix->task_Y.assign(task_Y,
+                          task_Y + row_length * (head->num_task - 1));
+  }
+}
+
+}  // namespace xLearn
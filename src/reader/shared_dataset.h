@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the SharedDataset class, which keeps one parsed
+dataset in the shared memory for the training processes of a host.
+*/
+
+#ifndef XLEARN_READER_SHARED_DATASET_H_
+#define XLEARN_READER_SHARED_DATASET_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// SharedDataset lets the training processes of one host (e.g., the jobs
+// of a sweep) use one copy of a parsed dataset. The first process copies
+// its DMatrix to the POSIX shared memory (shm_open() + mmap()) in the CSR
+// layout, i.e., the offsets of the rows and then their nodes, and the
+// labels and the norms after them. The later processes map it read-only,
+// and the rows of their DMatrix are the views of the shared nodes (see
+// RowArena::NewView), so only the labels are copied:
+//
+//   SharedDataset shared;
+//   if (!shared.Attach(name, hash_1, hash_2, &matrix)) {
+//     ... parse the data to matrix ...
+//     shared.Create(name, &matrix);   /* matrix is the view now */
+//   }
+//   ... train on matrix, whose nodes must not be changed ...
+//   shared.Close();
+//
+// Each process holds a shared flock() of the region while it is mapped,
+// and the process that creates it holds an exclusive one until it is
+// filled. So the others wait for the creator, and the lock of a process
+// is released by the system even if it crashes, which is the reference
+// count of the region. Close() removes the name when no other process
+// holds it, and a region left by a crashed creator is removed by the
+// next Attach(). The shared memory is not supported on Windows.
+//------------------------------------------------------------------------------
+class SharedDataset {
+ public:
+  // Constructor and Destructor
+  SharedDataset() { }
+  ~SharedDataset() { Close(); }
+
+  // Map the region of the name, which waits while it is being
+  // created, and make the matrix a view of it. Return false if the
+  // region does not exist, or its hash values are not the given ones.
+  bool Attach(const std::string& name,
+              uint64 hash_1,
+              uint64 hash_2,
+              DMatrix* matrix);
+
+  // Copy the matrix to a new region of the name, and then the matrix
+  // is a view of it. Return false if the region exists (e.g., it is
+  // created by another process first) or it cannot be allocated,
+  // and then the matrix is not changed.
+  bool Create(const std::string& name, DMatrix* matrix);
+
+  // Unmap the region, and remove its name if this is the last
+  // process. The views of the matrix are invalid after it.
+  void Close();
+
+  // If a region is mapped.
+  bool IsOpen() const { return ptr_ != nullptr; }
+
+  // Bytes of the mapped region.
+  uint64 Size() const { return size_; }
+
+ protected:
+  /* The name of the region, which starts with '/' */
+  std::string name_;
+  /* The file of the region, which holds the lock */
+  int fd_ = -1;
+  /* The mapped region */
+  char* ptr_ = nullptr;
+  uint64 size_ = 0;
+
+  // Make the matrix a view of the mapped region.
+  void make_view(DMatrix* matrix);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SharedDataset);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_SHARED_DATASET_H_
@@ -0,0 +1,125 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the SharedDataset class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/base/stringprintf.h"
+#include "src/reader/shared_dataset.h"
+
+namespace xLearn {
+
+const index_t kNumRows = 100;
+
+std::string ShmName() {
+  return StringPrintf("/xlearn_dataset_test_%d", (int)getpid());
+}
+
+bool ShmExists(const std::string& name) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0600);
+  if (fd == -1) { return false; }
+  close(fd);
+  return true;
+}
+
+void MakeMatrix(DMatrix* matrix) {
+  matrix->ReAlloc(kNumRows);
+  matrix->SetNumTask(2);
+  for (index_t i = 0; i < kNumRows; ++i) {
+    matrix->Y[i] = i % 2;
+    matrix->norm[i] = 1.0 / (i + 1);
+    matrix->Label(i, 1) = i;
+    matrix->SetGroup(i, i / 10);
+    // Row 0 is empty
+    for (index_t j = 0; j < i % 7; ++j) {
+      matrix->AddNode(i, i + j, j * 0.5, j);
+    }
+  }
+  matrix->SetHash(1234, 5678);
+}
+
+void CheckMatrix(const DMatrix& matrix) {
+  ASSERT_EQ(matrix.row_length, kNumRows);
+  EXPECT_EQ(matrix.hash_value_1, 1234);
+  EXPECT_EQ(matrix.hash_value_2, 5678);
+  EXPECT_EQ(matrix.num_task, 2);
+  EXPECT_TRUE(matrix.HasGroup());
+  for (index_t i = 0; i < kNumRows; ++i) {
+    EXPECT_FLOAT_EQ(matrix.Y[i], i % 2);
+    EXPECT_FLOAT_EQ(matrix.norm[i], 1.0 / (i + 1));
+    EXPECT_FLOAT_EQ(matrix.Label(i, 1), i);
+    EXPECT_EQ(matrix.group[i], i / 10);
+    const SparseRow* row = matrix.row[i];
+    ASSERT_EQ(row->size(), i % 7);
+    for (index_t j = 0; j < i % 7; ++j) {
+      EXPECT_EQ((*row)[j].feat_id, i + j);
+      EXPECT_EQ((*row)[j].field_id, j);
+      EXPECT_FLOAT_EQ((*row)[j].feat_val, j * 0.5);
+    }
+  }
+}
+
+TEST(SharedDatasetTest, Create_and_attach) {
+  std::string name = ShmName();
+  DMatrix matrix;
+  MakeMatrix(&matrix);
+  SharedDataset shared;
+  DMatrix attached;
+  EXPECT_FALSE(shared.Attach(name, 1234, 5678, &attached));
+  ASSERT_TRUE(shared.Create(name, &matrix));
+  CheckMatrix(matrix);
+  SharedDataset shared_2;
+  EXPECT_FALSE(shared_2.Create(name, &attached));
+  EXPECT_FALSE(shared_2.Attach(name, 1234, 0, &attached));
+  ASSERT_TRUE(shared_2.Attach(name, 1234, 5678, &attached));
+  CheckMatrix(attached);
+  // The name is removed by the last one
+  shared.Close();
+  EXPECT_TRUE(ShmExists(name));
+  CheckMatrix(attached);
+  shared_2.Close();
+  EXPECT_FALSE(ShmExists(name));
+}
+
+TEST(SharedDatasetTest, Remove_crashed_region) {
+  std::string name = ShmName();
+  // A region that is never filled
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(ftruncate(fd, 4096), 0);
+  close(fd);
+  SharedDataset shared;
+  DMatrix matrix;
+  EXPECT_FALSE(shared.Attach(name, 1234, 5678, &matrix));
+  EXPECT_FALSE(ShmExists(name));
+  MakeMatrix(&matrix);
+  ASSERT_TRUE(shared.Create(name, &matrix));
+  CheckMatrix(matrix);
+  shared.Close();
+  EXPECT_FALSE(ShmExists(name));
+}
+
+}  // namespace xLearn
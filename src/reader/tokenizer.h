@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the Token and Tokenizer used by the parsers,
+which split the lines and items of a memory buffer in place.
+*/
+
+#ifndef XLEARN_READER_TOKENIZER_H_
+#define XLEARN_READER_TOKENIZER_H_
+
+#include <string.h>
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Token is a span [begin, end) of the buffer, which is not
+// terminated by '\0', so nothing is copied for a line or an item.
+//------------------------------------------------------------------------------
+struct Token {
+  Token() : begin(nullptr), end(nullptr) { }
+  Token(const char* b, const char* e) : begin(b), end(e) { }
+
+  size_t size() const { return end - begin; }
+  bool empty() const { return begin == end; }
+
+  // If the token is the same as str.
+  bool Equals(const char* str) const {
+    size_t len = strlen(str);
+    return size() == len && memcmp(begin, str, len) == 0;
+  }
+
+  // Return the token as a string.
+  std::string ToString() const { return std::string(begin, end); }
+
+  const char* begin;
+  const char* end;
+};
+
+//------------------------------------------------------------------------------
+// Tokenizer splits a buffer into lines, and a line into items, where
+// any character of the delimiter string separates two items, and the
+// empty items are skipped (the same as strtok()). For example:
+//
+//   Tokenizer tokenizer(" ");
+//   uint64 pos = 0;
+//   Token line, item;
+//   while (Tokenizer::NextLine(buf, size, &pos, &line)) {
+//     while (tokenizer.NextItem(&line, &item)) {
+//       Token field;
+//       if (Tokenizer::Split(&item, ':', &field)) { ... }
+//     }
+//   }
+//
+// The lines are found by memchr(), which is vectorized by the C
+// library, and the items are short, which are found by a table.
+//------------------------------------------------------------------------------
+class Tokenizer {
+ public:
+  explicit Tokenizer(const std::string& delim = " ") {
+    SetDelimiter(delim);
+  }
+
+  // Set the delimiter characters.
+  void SetDelimiter(const std::string& delim) {
+    memset(is_delim_, 0, sizeof(is_delim_));
+    for (size_t i = 0; i < delim.size(); ++i) {
+      is_delim_[(unsigned char)delim[i]] = true;
+    }
+  }
+
+  // Get the line that starts at *pos, and move *pos to the next
+  // line. The '\n' (and the '\r' before it) is not in the line.
+  // Return false at the end of the buffer.
+  static bool NextLine(const char* buf,
+                       uint64 size,
+                       uint64* pos,
+                       Token* line) {
+    if (*pos >= size) { return false; }
+    const char* begin = buf + *pos;
+    const char* end = (const char*)memchr(begin, '\n', size - *pos);
+    if (end == nullptr) {
+      end = buf + size;
+      *pos = size;
+    } else {
+      *pos = end - buf + 1;
+    }
+    // Handle some txt format in windows or DOS.
+    if (end > begin && *(end - 1) == '\r') { end--; }
+    line->begin = begin;
+    line->end = end;
+    return true;
+  }
+
+  // Get the next item of the line, which is removed from the
+  // front of the line. Return false if there is no more item.
+  bool NextItem(Token* line, Token* item) const {
+    const char* p = line->begin;
+    const char* end = line->end;
+    while (p < end && is_delim_[(unsigned char)*p]) { p++; }
+    if (p == end) {
+      line->begin = end;
+      return false;
+    }
+    item->begin = p;
+    while (p < end && !is_delim_[(unsigned char)*p]) { p++; }
+    item->end = p;
+    line->begin = p;
+    return true;
+  }
+
+  // Split the item at the first c, where the part before c is
+  // given by head, and the item keeps the part after c.
+  // Return false (and keep the item) if there is no c.
+  static bool Split(Token* item, char c, Token* head) {
+    const char* p = (const char*)memchr(item->begin, c, item->size());
+    if (p == nullptr) { return false; }
+    head->begin = item->begin;
+    head->end = p;
+    item->begin = p + 1;
+    return true;
+  }
+
+ protected:
+  bool is_delim_[256];
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_TOKENIZER_H_
@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests tokenizer.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/reader/tokenizer.h"
+
+namespace xLearn {
+
+TEST(TokenizerTest, NextLine) {
+  std::string buf = "1 2\r\n\n3 4";
+  uint64 pos = 0;
+  Token line;
+  std::vector<std::string> lines;
+  while (Tokenizer::NextLine(buf.data(), buf.size(), &pos, &line)) {
+    lines.push_back(line.ToString());
+  }
+  ASSERT_EQ(lines.size(), 3);
+  EXPECT_EQ(lines[0], "1 2");
+  EXPECT_EQ(lines[1], "");
+  EXPECT_EQ(lines[2], "3 4");
+  EXPECT_EQ(pos, buf.size());
+}
+
+TEST(TokenizerTest, NextItem) {
+  std::string buf = "  1  0:0.5\t2:3  ";
+  Token line(buf.data(), buf.data() + buf.size());
+  Tokenizer tokenizer(" \t");
+  Token item;
+  std::vector<std::string> items;
+  while (tokenizer.NextItem(&line, &item)) {
+    items.push_back(item.ToString());
+  }
+  ASSERT_EQ(items.size(), 3);
+  EXPECT_EQ(items[0], "1");
+  EXPECT_EQ(items[1], "0:0.5");
+  EXPECT_EQ(items[2], "2:3");
+  EXPECT_TRUE(line.empty());
+  // The comma
+  tokenizer.SetDelimiter(",");
+  buf = "1,,2 3";
+  line = Token(buf.data(), buf.data() + buf.size());
+  items.clear();
+  while (tokenizer.NextItem(&line, &item)) {
+    items.push_back(item.ToString());
+  }
+  ASSERT_EQ(items.size(), 2);
+  EXPECT_EQ(items[1], "2 3");
+}
+
+TEST(TokenizerTest, Split) {
+  std::string buf = "3:10:0.5";
+  Token item(buf.data(), buf.data() + buf.size());
+  Token field, idx;
+  ASSERT_TRUE(Tokenizer::Split(&item, ':', &field));
+  ASSERT_TRUE(Tokenizer::Split(&item, ':', &idx));
+  EXPECT_TRUE(field.Equals("3"));
+  EXPECT_TRUE(idx.Equals("10"));
+  EXPECT_TRUE(item.Equals("0.5"));
+  EXPECT_FALSE(item.Equals("0.55"));
+  EXPECT_FALSE(Tokenizer::Split(&item, ':', &idx));
+  EXPECT_TRUE(item.Equals("0.5"));
+}
+
+}  // namespace xLearn
@@ -18,416 +18,1021 @@
 This file is the implementation of FFMScore class.
 */
 
-#include <pmmintrin.h>  // for SSE
-
 #include "src/score/ffm_score.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "src/base/half.h"
 #include "src/base/math.h"
+#include "src/base/scratch_buffer.h"
 
 namespace xLearn {
 
-// y = sum( (V_i_fj*V_j_fi)(x_i * x_j) )
-// Using SSE to accelerate vector operation.
-real_t FFMScore::CalcScore(const SparseRow* row,
+// The latent vector converted to fp32 for the ranking requests
+static thread_local ScratchBuffer<real_t> latent_buffer;
+
+// The slots of the nodes of a row in the pair tables
+static thread_local ScratchBuffer<index_t> slot_buffer;
+
+// The pairs of the row found by the forward pass, which
+// are owned by each training thread.
+static thread_local ScratchBuffer<FFMPair> pair_buffer;
+
+// The units of a row with the bag fields (see FFMScore), which are
+// kept by bag_score() for the gradient of the same row.
+struct BagUnits {
+  /* The distinct fields of the row */
+  std::vector<index_t> fields;
+  /* The nodes [first, last) of each unit, the slot of its
+  field in fields, and the scale s of its nodes */
+  std::vector<const Node*> first;
+  std::vector<const Node*> last;
+  std::vector<index_t> slot;
+  std::vector<real_t> scale;
+  /* P_f of each unit u for the t-th field f of the row,
+  at (u * fields + t) * aligned_k */
+  std::vector<real_t> pool;
+  /* The sum of P_f of the units of the s-th field for
+  the t-th field f, at (s * fields + t) * aligned_k */
+  std::vector<real_t> sum;
+};
+static thread_local BagUnits bag_units;
+
+// The blocks of the pair of V_j1_f2 and V_j2_f1 of the sparse model,
+// which is the smaller width of the two vectors, so the pair never
+// reads the next vector (the rest of the wider one is its own zeros
+// of the same field).
+static inline index_t pair_blocks(const FieldIndex& index,
+                                  index_t j1, index_t f1,
+                                  index_t j2, index_t f2,
+                                  index_t num_block) {
+  if (!index.HasWidths()) { return num_block; }
+  return std::min(index.Width(j1, f2), index.Width(j2, f1));
+}
+
+// Store the pairs of [begin, end) of the sparse model, whose offsets
+// are looked up by the field index, and return the number of them.
+// The pairs out of the index are skipped, since one of their latent
+// vectors is zero, and so are their score and gradient.
+static size_t sparse_pairs(const Node* begin,
+                           const Node* end,
                            Model& model,
-                           real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/
-  real_t sum_w = 0;
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
+                           real_t norm,
+                           FFMPair* pairs) {
+  const FieldIndex& index = model.GetFieldIndex();
   index_t num_feat = model.GetNumFeature();
   index_t num_field = model.GetNumField();
-  index_t aux_size = model.GetAuxiliarySize();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    sum_w += (iter->feat_val * w[feat_id*aux_size] * sqrt_norm);
-  }
-  // bias
-  w = model.GetParameter_b();
-  sum_w += w[0];
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
-  index_t align0 = aux_size * model.get_aligned_k();
-  index_t align1 = num_field * align0;
-  int align = kAlign * aux_size;
-  w = model.GetParameter_v();
-  __m128 XMMt = _mm_setzero_ps();
-  for (SparseRow::const_iterator iter_i = row->begin();
-       iter_i != row->end(); ++iter_i) {
+  index_t num_block = model.get_aligned_k() / kAlign;
+  offset_t align0 = (offset_t)model.get_row_k() *
+                    model.GetAuxiliarySize();
+  size_t n = 0;
+  for (const Node* iter_i = begin; iter_i != end; ++iter_i) {
     index_t j1 = iter_i->feat_id;
     index_t f1 = iter_i->field_id;
-    // To avoid unseen feature in Prediction
     if (j1 >= num_feat || f1 >= num_field) continue;
     real_t v1 = iter_i->feat_val;
-    for (SparseRow::const_iterator iter_j = iter_i+1;
-         iter_j != row->end(); ++iter_j) {
+    for (const Node* iter_j = iter_i+1; iter_j != end; ++iter_j) {
       index_t j2 = iter_j->feat_id;
       index_t f2 = iter_j->field_id;
-      // To avoid unseen feature in Prediction
       if (j2 >= num_feat || f2 >= num_field) continue;
-      real_t v2 = iter_j->feat_val;
-      real_t* w1_base = w + j1*align1 + f2*align0;
-      real_t* w2_base = w + j2*align1 + f1*align0;
-      __m128 XMMv = _mm_set1_ps(v1*v2*norm);
-      for (index_t d = 0; d < align0; d += align) {
-        __m128 XMMw1 = _mm_load_ps(w1_base + d);
-        __m128 XMMw2 = _mm_load_ps(w2_base + d);
-        XMMt = _mm_add_ps(XMMt,
-               _mm_mul_ps(
-               _mm_mul_ps(XMMw1, XMMw2), XMMv));
+      offset_t b1 = index.Block(j1, f2);
+      if (b1 == FieldIndex::kNoBlock) continue;
+      offset_t b2 = index.Block(j2, f1);
+      if (b2 == FieldIndex::kNoBlock) continue;
+      pairs[n].w1 = b1 * align0;
+      pairs[n].w2 = b2 * align0;
+      pairs[n].v = v1 * iter_j->feat_val * norm;
+      pairs[n].blocks = pair_blocks(index, j1, f1, j2, f2, num_block);
+      ++n;
+    }
+  }
+  return n;
+}
+
+// The offsets of the latent vectors of a pair in any layout of the
+// model, i.e., V_j1_f2 and V_j2_f1 of the nodes (j1, f1) and (j2, f2).
+// The pairs of the sparse model are found by the field index, and the
+// ones out of the model or the index are skipped as sparse_pairs().
+struct PairLayout {
+  PairLayout(Model& model, const KernelShape& shape)
+    : index(model.GetFieldIndex()), shape(shape) {
+    align0 = (offset_t)shape.aligned_k * (shape.split ? 1 : shape.aux_size);
+    align1 = (offset_t)shape.num_field * shape.aux_size * shape.aligned_k;
+    if (shape.field_major) {
+      align1 = align0;
+      align0 = (offset_t)shape.num_feat * align1;
+    }
+    sparse_align = (offset_t)model.get_row_k() * shape.aux_size;
+    num_block = shape.aligned_k / kAlign;
+  }
+
+  // Whether the node is in the model, whose pairs are all skipped if not.
+  inline bool Has(const Node* node) const {
+    return node->feat_id < shape.num_feat && node->field_id < shape.num_field;
+  }
+
+  // Store the pair of the two nodes in the model, and return false
+  // if it is out of the field index.
+  inline bool Set(const Node* node_i, const Node* node_j,
+                  real_t norm, FFMPair* pair) const {
+    index_t j1 = node_i->feat_id, f1 = node_i->field_id;
+    index_t j2 = node_j->feat_id, f2 = node_j->field_id;
+    if (index.Empty()) {
+      pair->w1 = (offset_t)j1 * align1 + f2 * align0;
+      pair->w2 = (offset_t)j2 * align1 + f1 * align0;
+      pair->blocks = num_block;
+    } else {
+      offset_t b1 = index.Block(j1, f2);
+      if (b1 == FieldIndex::kNoBlock) return false;
+      offset_t b2 = index.Block(j2, f1);
+      if (b2 == FieldIndex::kNoBlock) return false;
+      pair->w1 = b1 * sparse_align;
+      pair->w2 = b2 * sparse_align;
+      pair->blocks = pair_blocks(index, j1, f1, j2, f2, num_block);
+    }
+    pair->v = node_i->feat_val * node_j->feat_val * norm;
+    return true;
+  }
+
+  const FieldIndex& index;
+  const KernelShape& shape;
+  offset_t align0, align1, sparse_align;
+  index_t num_block;
+};
+
+// Store the pairs of the nodes [i_begin, i_end) with the nodes after
+// them up to end in the order of FFM_PAIR_LOOP_BEGIN, and return the
+// number of them.
+static size_t block_pairs(const Node* i_begin,
+                          const Node* i_end,
+                          const Node* end,
+                          Model& model,
+                          const KernelShape& shape,
+                          real_t norm,
+                          FFMPair* pairs) {
+  PairLayout layout(model, shape);
+  size_t n = 0;
+  for (const Node* iter_i = i_begin; iter_i != i_end; ++iter_i) {
+    if (!layout.Has(iter_i)) continue;
+    for (const Node* iter_j = iter_i+1; iter_j != end; ++iter_j) {
+      if (!layout.Has(iter_j)) continue;
+      if (layout.Set(iter_i, iter_j, norm, pairs + n)) { ++n; }
+    }
+  }
+  return n;
+}
+
+// Store num_sample pairs of [begin, end) drawn uniformly with
+// replacement by the generator of current thread, and return the
+// number of them. Each one is weighted by num_pair / num_sample, so
+// that the sum over the sample is an unbiased estimate of the sum
+// over all the num_pair pairs. The partial gradient of the row is
+// taken at this estimate, so the update is biased for the nonlinear
+// losses; the exact score would keep the row quadratic. The draws
+// out of the model add nothing, as their pairs are zero.
+static thread_local std::mt19937 pair_generator;
+static size_t sample_pairs(const Node* begin,
+                           const Node* end,
+                           size_t num_sample,
+                           Model& model,
+                           const KernelShape& shape,
+                           real_t norm,
+                           FFMPair* pairs) {
+  size_t num_node = end - begin;
+  if (num_node < 2 || num_sample == 0) { return 0; }
+  PairLayout layout(model, shape);
+  double num_pair = (double)num_node * (num_node - 1) / 2;
+  real_t weight = norm * (real_t)(num_pair / num_sample);
+  std::uniform_int_distribution<size_t> first(0, num_node - 1);
+  std::uniform_int_distribution<size_t> second(0, num_node - 2);
+  size_t n = 0;
+  for (size_t s = 0; s < num_sample; ++s) {
+    size_t i = first(pair_generator);
+    size_t j = second(pair_generator);
+    if (j >= i) { ++j; } else { std::swap(i, j); }
+    if (!layout.Has(begin + i) || !layout.Has(begin + j)) continue;
+    if (layout.Set(begin + i, begin + j, weight, pairs + n)) { ++n; }
+  }
+  return n;
+}
+
+// At most these fields of a row are prefetched. The pairs
+// need nnz * num_field latent vectors, so prefetching all of
+// them for a long row only evicts the current one.
+static const index_t kMaxPrefetchField = 16;
+
+// Prefetch w_i and V_i_fj of the row, where fj is the field
+// of the other nodes in the row. Each V_i_fj is fetched once
+// even if several nodes own the field fj.
+void FFMScore::Prefetch(const SparseRow* row, Model& model) {
+  prefetch_linear(row, model);
+  KernelShape shape = kernel_shape(model);
+  size_t align1 = (size_t)shape.num_field * shape.aligned_k *
+                  shape.aux_size;
+  size_t align0 = shape.split ? shape.aligned_k :
+                  shape.aligned_k * shape.aux_size;
+  if (shape.field_major) {
+    align1 = align0;
+    align0 = (size_t)shape.num_feat * align1;
+  }
+  // Distinct fields of the row
+  index_t fields[kMaxPrefetchField];
+  index_t num_fields = 0;
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    index_t f = iter->field_id;
+    if (f >= shape.num_field) continue;
+    index_t n = 0;
+    while (n < num_fields && fields[n] != f) { ++n; }
+    if (n < num_fields) continue;
+    if (num_fields == kMaxPrefetchField) break;
+    fields[num_fields++] = f;
+  }
+  const FieldIndex& index = model.GetFieldIndex();
+  size_t sparse_align = (size_t)model.get_row_k() * shape.aux_size;
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    if (iter->feat_id >= shape.num_feat) continue;
+    size_t offset = iter->feat_id * align1;
+    for (index_t n = 0; n < num_fields; ++n) {
+      if (index.Empty()) {
+        prefetch_latent(model, offset + fields[n] * align0);
+        continue;
+      }
+      offset_t b = index.Block(iter->feat_id, fields[n]);
+      if (b != FieldIndex::kNoBlock) {
+        prefetch_latent(model, b * sparse_align);
       }
     }
   }
-  real_t sum_v = 0;
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  _mm_store_ss(&sum_v, XMMt);
+}
 
-  return sum_v + sum_w;
+// y = sum( (V_i_fj*V_j_fi)(x_i * x_j) )
+// Using SIMD kernels to accelerate vector operation, and the
+// compact latent factors are converted to fp32 in registers.
+real_t FFMScore::CalcScore(const SparseRow* row,
+                           Model& model,
+                           real_t norm) {
+  real_t sum_w = linear_score(row, model, norm, *kernels_);
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*row, model.GetNumField(), &end);
+  return sum_w + latent_score(begin, end, model, norm);
+}
+
+// The latent part of the nodes by the storage type of the model
+real_t FFMScore::latent_score(const Node* begin,
+                              const Node* end,
+                              Model& model,
+                              real_t norm) {
+  if (!bag_field_.empty()) {
+    return bag_score(begin, end, model, norm);
+  }
+  if (!model.GetPairTable().Empty() &&
+      model.GetLatentType() == kStoreFP32) {
+    return table_score(begin, end, model, norm);
+  }
+  // The sparse model is always in fp32
+  if (!model.GetFieldIndex().Empty()) {
+    size_t nnz = end - begin;
+    FFMPair* pairs = pair_buffer.Get(nnz * (nnz - 1) / 2);
+    size_t num_pairs = sparse_pairs(begin, end, model, norm, pairs);
+    return kernels_->ffm_pair_score(pairs, num_pairs,
+                                    model.GetParameter_v(),
+                                    kernel_shape(model));
+  }
+  switch (model.GetLatentType()) {
+    case kStoreFP16:
+      return kernels_->ffm_score_fp16(begin, end,
+                                      model.GetParameter_v_half(),
+                                      kernel_shape(model),
+                                      norm);
+    case kStoreBF16:
+      return kernels_->ffm_score_bf16(begin, end,
+                                      model.GetParameter_v_half(),
+                                      kernel_shape(model),
+                                      norm);
+    case kStoreInt8:
+      return kernels_->ffm_score_int8(begin, end,
+                                      model.GetParameter_v_int8(),
+                                      model.GetParameter_v_scale(),
+                                      kernel_shape(model),
+                                      norm);
+    default:
+      return kernels_->ffm_score(begin, end,
+                                 model.GetParameter_v(),
+                                 kernel_shape(model),
+                                 norm);
+  }
+}
+
+// Return V_j_f of the feature j and the field f in fp32. The fp32
+// model without the aux blocks is read in place, and the others are
+// copied or converted into the buffer of aligned_k values, where the
+// vector of its own width is followed by zeros.
+static const real_t* load_latent(Model& model,
+                                 index_t j,
+                                 index_t f,
+                                 real_t* buffer) {
+  index_t aligned_k = model.get_aligned_k();
+  offset_t num_field = model.GetNumField();
+  // The compact latent factors have no aux blocks
+  offset_t offset = ((offset_t)j * num_field + f) * aligned_k;
+  switch (model.GetLatentType()) {
+    case kStoreFP16:
+    case kStoreBF16: {
+      const uint16* v = model.GetParameter_v_half() + offset;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        buffer[d] = Float16ToFloat(v[d], model.GetLatentType());
+      }
+      return buffer;
+    }
+    case kStoreInt8: {
+      const int8* v = model.GetParameter_v_int8() + offset;
+      real_t scale = model.GetParameter_v_scale()[j*num_field+f];
+      for (index_t d = 0; d < aligned_k; ++d) {
+        buffer[d] = v[d] * scale;
+      }
+      return buffer;
+    }
+    default: {
+      // The pairs out of the field index of the sparse model are zero
+      const FieldIndex& index = model.GetFieldIndex();
+      index_t size = aligned_k;
+      if (!index.Empty()) {
+        offset = index.Block(j, f);
+        if (offset == FieldIndex::kNoBlock) {
+          memset(buffer, 0, aligned_k * sizeof(real_t));
+          return buffer;
+        }
+        offset *= model.get_row_k();
+      }
+      if (index.HasWidths()) {
+        size = index.Width(j, f) * kAlign;
+        memset(buffer + size, 0, (aligned_k - size) * sizeof(real_t));
+      }
+      // The blocks of w(kAlign) are interleaved with the aux blocks,
+      // or the w of all the fields of j are together
+      offset_t aux_size = model.GetAuxiliarySize();
+      if (model.IsSplitLayout()) {
+        return model.GetParameter_v() +
+               ((offset_t)j * num_field * aux_size + f) * aligned_k;
+      }
+      if (model.IsFieldMajor()) {
+        offset = ((offset_t)f * model.GetNumFeature() + j) * aligned_k;
+      }
+      const real_t* v = model.GetParameter_v() + offset * aux_size;
+      if (aux_size == 1 && size == aligned_k) { return v; }
+      for (index_t d = 0; d < size; d += kAlign) {
+        memcpy(buffer + d, v + d * aux_size, kAlign * sizeof(real_t));
+      }
+      return buffer;
+    }
+  }
+}
+
+// Return the offset of V_j_f in param_v_ of the fp32 model (see
+// FFMScore::latent_layout), or kNoBlock if the pair is not in the
+// field index of the sparse model.
+static offset_t latent_pos(Model& model, index_t j, index_t f) {
+  const FieldIndex& index = model.GetFieldIndex();
+  offset_t aux_size = model.GetAuxiliarySize();
+  if (!index.Empty()) {
+    offset_t b = index.Block(j, f);
+    if (b == FieldIndex::kNoBlock) { return b; }
+    return b * model.get_row_k() * aux_size;
+  }
+  offset_t aligned_k = model.get_aligned_k();
+  offset_t align0 = aligned_k * (model.IsSplitLayout() ? 1 : aux_size);
+  offset_t align1 = (offset_t)model.GetNumField() * aux_size * aligned_k;
+  if (model.IsFieldMajor()) {
+    align1 = align0;
+    align0 = (offset_t)model.GetNumFeature() * align1;
+  }
+  return j * align1 + f * align0;
+}
+
+// The pairs of the tables are looked up, and the others are stored
+// with their offsets (see FFM_PAIR_LOOP_BEGIN) for the pair kernel.
+real_t FFMScore::table_score(const Node* begin,
+                             const Node* end,
+                             Model& model,
+                             real_t norm) {
+  size_t nnz = end - begin;
+  if (nnz < 2) { return 0; }
+  const PairTable& table = model.GetPairTable();
+  const FieldIndex& index = model.GetFieldIndex();
+  KernelShape shape = kernel_shape(model);
+  offset_t align0 = (offset_t)shape.aligned_k *
+                    (shape.split ? 1 : shape.aux_size);
+  offset_t align1 = (offset_t)shape.num_field * shape.aux_size *
+                    shape.aligned_k;
+  if (shape.field_major) {
+    align1 = align0;
+    align0 = (offset_t)shape.num_feat * align1;
+  }
+  offset_t sparse_align = (offset_t)model.get_row_k() * shape.aux_size;
+  index_t num_block = shape.aligned_k / kAlign;
+  FFMPair* pairs = pair_buffer.Get(nnz * (nnz - 1) / 2);
+  index_t* slots = slot_buffer.Get(nnz);
+  for (size_t i = 0; i < nnz; ++i) {
+    slots[i] = table.Slot(begin[i].feat_id, begin[i].field_id);
+  }
+  real_t sum = 0;
+  size_t n = 0;
+  for (size_t i = 0; i < nnz; ++i) {
+    index_t j1 = begin[i].feat_id;
+    index_t f1 = begin[i].field_id;
+    if (j1 >= shape.num_feat || f1 >= shape.num_field) continue;
+    real_t v1 = begin[i].feat_val * norm;
+    for (size_t k = i + 1; k < nnz; ++k) {
+      index_t j2 = begin[k].feat_id;
+      index_t f2 = begin[k].field_id;
+      if (j2 >= shape.num_feat || f2 >= shape.num_field) continue;
+      real_t vv = v1 * begin[k].feat_val;
+      real_t value;
+      if (table.Lookup(f1, slots[i], f2, slots[k], &value)) {
+        sum += value * vv;
+        continue;
+      }
+      offset_t off1 = (offset_t)j1 * align1 + f2 * align0;
+      offset_t off2 = (offset_t)j2 * align1 + f1 * align0;
+      pairs[n].blocks = num_block;
+      // The pairs out of the index of the sparse model are zero
+      if (!index.Empty()) {
+        offset_t b1 = index.Block(j1, f2);
+        offset_t b2 = index.Block(j2, f1);
+        if (b1 == FieldIndex::kNoBlock || b2 == FieldIndex::kNoBlock) {
+          continue;
+        }
+        off1 = b1 * sparse_align;
+        off2 = b2 * sparse_align;
+        pairs[n].blocks = pair_blocks(index, j1, f1, j2, f2, num_block);
+      }
+      pairs[n].w1 = off1;
+      pairs[n].w2 = off2;
+      pairs[n].v = vv;
+      ++n;
+    }
+  }
+  return sum + kernels_->ffm_pair_score(pairs, n, model.GetParameter_v(),
+                                        shape);
+}
+
+void FFMScore::FillPairTable(Model& model) {
+  PairTable& table = model.GetPairTable();
+  index_t num_K = model.GetNumK();
+  real_t* buffer_1 = latent_buffer.Get(2 * (size_t)model.get_aligned_k());
+  real_t* buffer_2 = buffer_1 + model.get_aligned_k();
+  for (index_t f1 = 0; f1 < table.NumField(); ++f1) {
+    for (index_t f2 = f1; f2 < table.NumField(); ++f2) {
+      real_t* cells = table.Table(f1, f2);
+      if (cells == nullptr) continue;
+      index_t n1 = table.VocabSize(f1);
+      index_t n2 = table.VocabSize(f2);
+      for (index_t s1 = 0; s1 < n1; ++s1) {
+        const real_t* w1 = load_latent(model, table.Feature(f1, s1),
+                                       f2, buffer_1);
+        for (index_t s2 = 0; s2 < n2; ++s2) {
+          const real_t* w2 = load_latent(model, table.Feature(f2, s2),
+                                         f1, buffer_2);
+          real_t dot = 0;
+          for (index_t d = 0; d < num_K; ++d) {
+            dot += w1[d] * w2[d];
+          }
+          cells[(uint64)s1 * n2 + s2] = dot;
+        }
+      }
+    }
+  }
+}
+
+// Keep the linear sum and the pairs of the context with norm = 1,
+// since the latent part of a row is norm times the one with norm = 1,
+// and the sum of V_j_f * x_j of each field of the context.
+void FFMScore::CalcContext(const SparseRow* context,
+                           Model& model,
+                           ScoreContext* ctx) {
+  // A bag can have the nodes of both the context and the candidate
+  if (!bag_field_.empty()) {
+    Score::CalcContext(context, model, ctx);
+    return;
+  }
+  index_t num_feat = model.GetNumFeature();
+  index_t num_field = model.GetNumField();
+  index_t aligned_k = model.get_aligned_k();
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*context, num_field, &end);
+  ctx->linear = linear_sum(context, model, *kernels_);
+  ctx->latent = latent_score(begin, end, model, 1.0);
+  // The nodes of the same field are next to each other
+  ctx->fields.clear();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    if (iter->feat_id >= num_feat || iter->field_id >= num_field) {
+      continue;
+    }
+    if (ctx->fields.empty() || ctx->fields.back() != iter->field_id) {
+      ctx->fields.push_back(iter->field_id);
+    }
+  }
+  size_t block = (size_t)num_field * aligned_k;
+  ctx->sum.assign(ctx->fields.size() * block, 0);
+  real_t* buffer = latent_buffer.Get(aligned_k);
+  size_t n = 0;
+  for (const Node* iter = begin; iter != end; ++iter) {
+    if (iter->feat_id >= num_feat || iter->field_id >= num_field) {
+      continue;
+    }
+    while (ctx->fields[n] != iter->field_id) { ++n; }
+    real_t* agg = ctx->sum.data() + n * block;
+    real_t x = iter->feat_val;
+    for (index_t f = 0; f < num_field; ++f) {
+      const real_t* w = load_latent(model, iter->feat_id, f, buffer);
+      for (index_t d = 0; d < aligned_k; ++d) {
+        agg[d] += w[d] * x;
+      }
+      agg += aligned_k;
+    }
+  }
+}
+
+// The pairs of the whole row are the pairs of the context, the pairs
+// of the candidate, and the pairs between the candidate and the context.
+real_t FFMScore::CalcCandidate(const ScoreContext& ctx,
+                               const SparseRow* candidate,
+                               Model& model,
+                               real_t norm) {
+  if (!bag_field_.empty()) {
+    return Score::CalcCandidate(ctx, candidate, model, norm);
+  }
+  index_t num_feat = model.GetNumFeature();
+  index_t num_field = model.GetNumField();
+  index_t aligned_k = model.get_aligned_k();
+  size_t block = (size_t)num_field * aligned_k;
+  CHECK_EQ(ctx.sum.size(), ctx.fields.size() * block);
+  real_t* buffer = latent_buffer.Get(aligned_k);
+  real_t cross = 0;
+  for (SparseRow::const_iterator iter = candidate->begin();
+       iter != candidate->end(); ++iter) {
+    index_t j = iter->feat_id;
+    index_t fi = iter->field_id;
+    if (j >= num_feat || fi >= num_field) continue;
+    real_t dot = 0;
+    for (size_t n = 0; n < ctx.fields.size(); ++n) {
+      const real_t* w = load_latent(model, j, ctx.fields[n], buffer);
+      const real_t* agg = ctx.sum.data() + n * block + fi * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        dot += w[d] * agg[d];
+      }
+    }
+    cross += dot * iter->feat_val;
+  }
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*candidate, num_field, &end);
+  real_t latent = latent_score(begin, end, model, 1.0);
+  real_t linear = (ctx.linear + linear_sum(candidate, model, *kernels_)) *
+                  sqrt(norm);
+  return linear + model.GetParameter_b()[0] +
+         (ctx.latent + latent + cross) * norm;
+}
+
+void FFMScore::SetBagFields(const std::vector<index_t>& fields,
+                            bool mean) {
+  bag_field_.clear();
+  for (index_t f : fields) {
+    if (f >= bag_field_.size()) { bag_field_.resize(f + 1, false); }
+    bag_field_[f] = true;
+  }
+  bag_mean_ = mean;
+}
+
+// The nodes of a bag field next to each other are one unit, and the
+// sums of the units of each field give the pairs of each unit:
+//   score = 1/2 * sum_u sum_f <P_u_f, S_f_fu - [f = fu] * P_u_fu>
+// where S_f_fu is the sum of P_fu of the units of field f.
+real_t FFMScore::bag_score(const Node* begin,
+                           const Node* end,
+                           Model& model,
+                           real_t norm) {
+  index_t num_feat = model.GetNumFeature();
+  index_t num_field = model.GetNumField();
+  index_t aligned_k = model.get_aligned_k();
+  BagUnits& bag = bag_units;
+  bag.fields.clear();
+  bag.first.clear();
+  bag.last.clear();
+  bag.slot.clear();
+  bag.scale.clear();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    index_t f = iter->field_id;
+    if (iter->feat_id >= num_feat || f >= num_field) continue;
+    bool new_field = bag.fields.empty() || bag.fields.back() != f;
+    if (new_field) { bag.fields.push_back(f); }
+    bool is_bag = f < bag_field_.size() && bag_field_[f];
+    if (is_bag && !new_field) {
+      bag.last.back() = iter + 1;
+      bag.scale.back() += 1;
+      continue;
+    }
+    bag.first.push_back(iter);
+    bag.last.push_back(iter + 1);
+    bag.slot.push_back(bag.fields.size() - 1);
+    bag.scale.push_back(is_bag ? 1 : 0);
+  }
+  // The scale holds the number of nodes of the bags for now
+  size_t num_unit = bag.first.size();
+  size_t r = bag.fields.size();
+  for (size_t u = 0; u < num_unit; ++u) {
+    bag.scale[u] = (bag.scale[u] > 0 && bag_mean_) ? 1 / bag.scale[u] : 1;
+  }
+  bag.pool.assign(num_unit * r * aligned_k, 0);
+  bag.sum.assign(r * r * aligned_k, 0);
+  real_t* buffer = latent_buffer.Get(aligned_k);
+  for (size_t u = 0; u < num_unit; ++u) {
+    real_t* pool = bag.pool.data() + u * r * aligned_k;
+    for (const Node* iter = bag.first[u]; iter != bag.last[u]; ++iter) {
+      if (iter->feat_id >= num_feat) continue;
+      real_t x = iter->feat_val * bag.scale[u];
+      for (size_t t = 0; t < r; ++t) {
+        const real_t* w = load_latent(model, iter->feat_id,
+                                      bag.fields[t], buffer);
+        real_t* p = pool + t * aligned_k;
+        for (index_t d = 0; d < aligned_k; ++d) { p[d] += w[d] * x; }
+      }
+    }
+    real_t* sum = bag.sum.data() + bag.slot[u] * r * aligned_k;
+    for (size_t d = 0; d < r * aligned_k; ++d) { sum[d] += pool[d]; }
+  }
+  real_t score = 0;
+  for (size_t u = 0; u < num_unit; ++u) {
+    size_t fu = bag.slot[u];
+    const real_t* pool = bag.pool.data() + u * r * aligned_k;
+    for (size_t t = 0; t < r; ++t) {
+      const real_t* p = pool + t * aligned_k;
+      const real_t* q = bag.sum.data() + (t * r + fu) * aligned_k;
+      const real_t* self = pool + fu * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        score += p[d] * (t == fu ? q[d] - self[d] : q[d]);
+      }
+    }
+  }
+  return score * 0.5 * norm;
+}
+
+// The gradient of V_j_f of a node j of unit u is
+//   pg * norm * s * x_j * (S_f_fu - [f = fu] * P_u_fu)
+// which is the sum of the units of field f except u itself.
+template <typename Func>
+void FFMScore::bag_grad(Model& model, real_t pg, real_t norm, Func fn) {
+  // The vectors of their own width are not updated as a whole
+  CHECK(!model.GetFieldIndex().HasWidths());
+  index_t num_feat = model.GetNumFeature();
+  index_t aligned_k = model.get_aligned_k();
+  const BagUnits& bag = bag_units;
+  size_t r = bag.fields.size();
+  real_t* other = latent_buffer.Get(2 * aligned_k);
+  real_t* grad = other + aligned_k;
+  for (size_t u = 0; u < bag.first.size(); ++u) {
+    size_t fu = bag.slot[u];
+    const real_t* self = bag.pool.data() + (u * r + fu) * aligned_k;
+    for (size_t t = 0; t < r; ++t) {
+      const real_t* q = bag.sum.data() + (t * r + fu) * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        other[d] = t == fu ? q[d] - self[d] : q[d];
+      }
+      for (const Node* iter = bag.first[u]; iter != bag.last[u]; ++iter) {
+        if (iter->feat_id >= num_feat) continue;
+        offset_t pos = latent_pos(model, iter->feat_id, bag.fields[t]);
+        if (pos == FieldIndex::kNoBlock) continue;
+        real_t g = pg * norm * bag.scale[u] * iter->feat_val;
+        for (index_t d = 0; d < aligned_k; ++d) { grad[d] = g * other[d]; }
+        fn(pos, (const real_t*)grad);
+      }
+    }
+  }
+}
+
+// Update the latent vectors of the units of the last bag_score()
+// by the optimizer, which adds the L2 term once for each vector.
+template <class Optimizer>
+void FFMScore::update_bags(Model& model,
+                           const KernelParam& param,
+                           real_t pg,
+                           real_t norm) {
+  index_t aligned_k = model.get_aligned_k();
+  real_t lambda = Optimizer::Lambda(param);
+  offset_t stride = 0, gap = 0;
+  latent_layout(model, &stride, &gap);
+  real_t* v = model.GetParameter_v();
+  bag_grad(model, pg, norm, [&](offset_t pos, const real_t* grad) {
+    update_latent<Optimizer>(v + pos, grad, aligned_k,
+                             stride, gap, lambda, param);
+  });
 }
 
 // Calculate gradient and update current model.
-// Using the SSE to accelerate vector operation.
+// Using SIMD kernels to accelerate vector operation.
 void FFMScore::CalcGrad(const SparseRow* row,
                         Model& model,
                         real_t pg,
                         real_t norm) {
   // Using sgd
   if (opt_type_.compare("sgd") == 0) {
-    this->calc_grad_sgd(row, model, pg, norm);
+    this->calc_grad<SGDOptimizer>(row, model, pg, norm);
   }
   // Using adagrad
   else if (opt_type_.compare("adagrad") == 0) {
-    this->calc_grad_adagrad(row, model, pg, norm);
+    this->calc_grad<AdaGradOptimizer>(row, model, pg, norm);
   }
   // Using ftrl 
   else if (opt_type_.compare("ftrl") == 0) {
-    this->calc_grad_ftrl(row, model, pg, norm);
+    this->calc_grad<FTRLOptimizer>(row, model, pg, norm);
   } 
+  // Using ftrl of the bf16 state (see -opt_state)
+  else if (opt_type_.compare("ftrl_bf16") == 0) {
+    this->calc_grad<FTRLBF16Optimizer>(row, model, pg, norm);
+  }
+  // Using adam or adamw
+  else if (opt_type_.compare("adam") == 0 ||
+           opt_type_.compare("adamw") == 0) {
+    this->calc_grad<AdamOptimizer>(row, model, pg, norm);
+  }
   else {
     LOG(FATAL) << "Unknow optimization method: " << opt_type_;
   }
 }
 
-// Calculate gradient and update current model using sgd
-// TODO(aksnzhy): solve unseen feature
-void FFMScore::calc_grad_sgd(const SparseRow* row,
-                             Model& model,
-                             real_t pg,
-                             real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  index_t num_field = model.GetNumField();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id];
-    real_t g = regu_lambda_*wl+pg*iter->feat_val*sqrt_norm;
-    wl -= (learning_rate_ * g);
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t g = pg;
-  wb -= (learning_rate_ * g);
+// Calculate gradient and update current model using
+// the given optimizer policy (see optimizer.h)
+template <class Optimizer>
+void FFMScore::calc_grad(const SparseRow* row,
+                         Model& model,
+                         real_t pg,
+                         real_t norm) {
+  KernelParam param = kernel_param();
+  update_linear<Optimizer>(row, model, param, pg, norm);
   /*********************************************************
    *  latent factor                                        *
    *********************************************************/
-  index_t align0 = model.GetAuxiliarySize() * model.get_aligned_k();
-  index_t align1 = model.GetNumField() * align0;
-  index_t align = kAlign * model.GetAuxiliarySize();
-  w = model.GetParameter_v();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMlr = _mm_set1_ps(learning_rate_);
-  __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  for (SparseRow::const_iterator iter_i = row->begin();
-       iter_i != row->end(); ++iter_i) {
-    index_t j1 = iter_i->feat_id;
-    index_t f1 = iter_i->field_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat || f1 >= num_field) continue;
-    real_t v1 = iter_i->feat_val;
-    for (SparseRow::const_iterator iter_j = iter_i+1;
-         iter_j != row->end(); ++iter_j) {
-      index_t j2 = iter_j->feat_id;
-      index_t f2 = iter_j->field_id;
-      // To avoid unseen feature
-      if (j2 >= num_feat || f2 >= num_field) continue;
-      real_t v2 = iter_j->feat_val;
-      real_t* w1_base = w + j1*align1 + f2*align0;
-      real_t* w2_base = w + j2*align1 + f1*align0;
-      __m128 XMMv = _mm_set1_ps(v1*v2*norm);
-      __m128 XMMpgv = _mm_mul_ps(XMMv, XMMpg);
-      for (index_t d = 0; d < align0; d += align) {
-        real_t *w1 = w1_base + d;
-        real_t *w2 = w2_base + d;
-        __m128 XMMw1 = _mm_load_ps(w1);
-        __m128 XMMw2 = _mm_load_ps(w2);
-        __m128 XMMg1 = _mm_add_ps(
-                       _mm_mul_ps(XMMlamb, XMMw1),
-                       _mm_mul_ps(XMMpgv, XMMw2));
-        __m128 XMMg2 = _mm_add_ps(
-                       _mm_mul_ps(XMMlamb, XMMw2),
-                       _mm_mul_ps(XMMpgv, XMMw1));
-        XMMw1 = _mm_sub_ps(XMMw1, _mm_mul_ps(XMMlr, XMMg1));
-        XMMw2 = _mm_sub_ps(XMMw2, _mm_mul_ps(XMMlr, XMMg2));
-        _mm_store_ps(w1, XMMw1);
-        _mm_store_ps(w2, XMMw2);
-      }
-    }
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*row, model.GetNumField(), &end);
+  // The units of the row are found again, since the
+  // score of the row may not be the last one of the thread
+  if (!bag_field_.empty()) {
+    bag_score(begin, end, model, norm);
+    update_bags<Optimizer>(model, param, pg, norm);
+    return;
+  }
+  if (!model.GetFieldIndex().Empty()) {
+    size_t nnz = end - begin;
+    FFMPair* pairs = pair_buffer.Get(nnz * (nnz - 1) / 2);
+    size_t num_pairs = sparse_pairs(begin, end, model, norm, pairs);
+    Optimizer::FFMPairKernel(*kernels_)(pairs,
+                                        num_pairs,
+                                        model.GetParameter_v(),
+                                        kernel_shape(model),
+                                        param, pg);
+    return;
   }
+  Optimizer::FFMKernel(*kernels_)(begin,
+                                  end,
+                                  model.GetParameter_v(),
+                                  kernel_shape(model),
+                                  param,
+                                  pg,
+                                  norm);
+}
 
+// Calculate score and gradient in one walk of the row. Here the
+// forward pass records the offsets of the latent vectors for each
+// pair, and the update just goes through the pair list. The pairs of
+// the sparse model are found by the field index in the same way.
+template <class Optimizer>
+real_t FFMScore::calc_score_and_grad(const SparseRow* row,
+                                     Model& model,
+                                     real_t y,
+                                     PartialGradFunc partial_grad,
+                                     real_t norm) {
+  size_t nnz = row->size();
+  if (!bag_field_.empty()) {
+    real_t pred = CalcScore(row, model, norm);
+    real_t pg = partial_grad(pred, y);
+    KernelParam param = kernel_param();
+    update_linear<Optimizer>(row, model, param, pg, norm);
+    update_bags<Optimizer>(model, param, pg, norm);
+    return pred;
+  }
+  size_t num_sample = sample_size(nnz);
+  if (num_sample == 0 && long_pool_ != nullptr && nnz >= long_row_) {
+    return long_score_and_grad<Optimizer>(row, model, y,
+                                          partial_grad, norm);
+  }
+  FFMPair* pairs = pair_buffer.Get(num_sample > 0 ? num_sample :
+                                   nnz * (nnz - 1) / 2);
+  KernelShape shape = kernel_shape(model);
+  real_t* v = model.GetParameter_v();
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*row, model.GetNumField(), &end);
+  size_t num_pairs = 0;
+  real_t pred = linear_score(row, model, norm, *kernels_);
+  if (num_sample > 0) {
+    num_pairs = sample_pairs(begin, end, num_sample,
+                             model, shape, norm, pairs);
+    pred += kernels_->ffm_pair_score(pairs, num_pairs, v, shape);
+  } else if (!model.GetFieldIndex().Empty()) {
+    num_pairs = sparse_pairs(begin, end, model, norm, pairs);
+    pred += kernels_->ffm_pair_score(pairs, num_pairs, v, shape);
+  } else {
+    pred += kernels_->ffm_score_pairs(begin, end,
+                                      v, shape, norm,
+                                      pairs,
+                                      &num_pairs);
+  }
+  real_t pg = partial_grad(pred, y);
+  KernelParam param = kernel_param();
+  update_linear<Optimizer>(row, model, param, pg, norm);
+  Optimizer::FFMPairKernel(*kernels_)(pairs,
+                                      num_pairs,
+                                      v, shape, param, pg);
+  return pred;
 }
 
-// Calculate gradient and update current model using adagrad
-// TODO(aksnzhy): solve unseen feature
-void FFMScore::calc_grad_adagrad(const SparseRow* row,
-                                 Model& model,
-                                 real_t pg,
-                                 real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  index_t num_field = model.GetNumField();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id*2];
-    real_t &wlg = w[feat_id*2+1];
-    real_t g = regu_lambda_*wl+pg*iter->feat_val*sqrt_norm;
-    wlg += g*g;
-    wl -= learning_rate_ * g * InvSqrt(wlg);
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t g = pg;
-  wbg += g*g;
-  wb -= learning_rate_ * g * InvSqrt(wbg);
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
-  index_t align0 = 2 * model.get_aligned_k();
-  index_t align1 = model.GetNumField() * align0;
-  index_t align = kAlign * 2;
-  w = model.GetParameter_v();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMlr = _mm_set1_ps(learning_rate_);
-  __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  for (SparseRow::const_iterator iter_i = row->begin();
-       iter_i != row->end(); ++iter_i) {
-    index_t j1 = iter_i->feat_id;
-    index_t f1 = iter_i->field_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat || f1 >= num_field) continue;
-    real_t v1 = iter_i->feat_val;
-    for (SparseRow::const_iterator iter_j = iter_i+1;
-         iter_j != row->end(); ++iter_j) {
-      index_t j2 = iter_j->feat_id;
-      index_t f2 = iter_j->field_id;
-      // To avoid unseen feature
-      if (j2 >= num_feat || f2 >= num_field) continue;
-      real_t v2 = iter_j->feat_val;
-      real_t* w1_base = w + j1*align1 + f2*align0;
-      real_t* w2_base = w + j2*align1 + f1*align0;
-      __m128 XMMv = _mm_set1_ps(v1*v2*norm);
-      __m128 XMMpgv = _mm_mul_ps(XMMv, XMMpg);
-      for (index_t d = 0; d < align0; d += align) {
-        real_t *w1 = w1_base + d;
-        real_t *w2 = w2_base + d;
-        real_t *wg1 = w1 + kAlign;
-        real_t *wg2 = w2 + kAlign;
-        __m128 XMMw1 = _mm_load_ps(w1);
-        __m128 XMMw2 = _mm_load_ps(w2);
-        __m128 XMMwg1 = _mm_load_ps(wg1);
-        __m128 XMMwg2 = _mm_load_ps(wg2);
-        __m128 XMMg1 = _mm_add_ps(
-                       _mm_mul_ps(XMMlamb, XMMw1),
-                       _mm_mul_ps(XMMpgv, XMMw2));
-        __m128 XMMg2 = _mm_add_ps(
-                       _mm_mul_ps(XMMlamb, XMMw2),
-                       _mm_mul_ps(XMMpgv, XMMw1));
-        XMMwg1 = _mm_add_ps(XMMwg1, _mm_mul_ps(XMMg1, XMMg1));
-        XMMwg2 = _mm_add_ps(XMMwg2, _mm_mul_ps(XMMg2, XMMg2));
-        XMMw1 = _mm_sub_ps(XMMw1, _mm_mul_ps(XMMlr,
-                _mm_mul_ps(_mm_rsqrt_ps(XMMwg1), XMMg1)));
-        XMMw2 = _mm_sub_ps(XMMw2, _mm_mul_ps(XMMlr,
-                _mm_mul_ps(_mm_rsqrt_ps(XMMwg2), XMMg2)));
-        _mm_store_ps(w1, XMMw1);
-        _mm_store_ps(w2, XMMw2);
-        _mm_store_ps(wg1, XMMwg1);
-        _mm_store_ps(wg2, XMMwg2);
-      }
+// The node i has nnz-1-i pairs, so the blocks of the first node are
+// cut by the number of pairs, and the pairs of a block are stored at
+// the offset of its first node in the pair list of current thread,
+// i.e., i * (2*nnz - i - 1) / 2. The calling thread runs the blocks
+// too, and so it can be a worker of the same pool.
+template <class Optimizer>
+real_t FFMScore::long_score_and_grad(const SparseRow* row,
+                                     Model& model,
+                                     real_t y,
+                                     PartialGradFunc partial_grad,
+                                     real_t norm) {
+  KernelShape shape = kernel_shape(model);
+  real_t* v = model.GetParameter_v();
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*row, model.GetNumField(), &end);
+  size_t nnz = end - begin;
+  size_t total = nnz * (nnz - 1) / 2;
+  FFMPair* pairs = pair_buffer.Get(total);
+  size_t num_blocks = long_pool_->ThreadNumber() *
+                      ThreadPool::kChunksPerThread;
+  std::vector<size_t> bounds(1, 0);
+  size_t cut = 0;
+  for (size_t i = 0; i < nnz; ++i) {
+    cut += nnz - 1 - i;
+    if (cut * num_blocks >= total * bounds.size() || i + 1 == nnz) {
+      bounds.push_back(i + 1);
     }
   }
+  std::vector<real_t> partial(bounds.size() - 1, 0);
+  std::vector<size_t> count(bounds.size() - 1, 0);
+  auto block_of = [&bounds](size_t i) -> size_t {
+    return std::upper_bound(bounds.begin(), bounds.end(), i) -
+           bounds.begin() - 1;
+  };
+  long_pool_->ParallelFor(bounds, [&](size_t i_begin, size_t i_end) {
+    size_t b = block_of(i_begin);
+    FFMPair* block = pairs + i_begin * (2 * nnz - i_begin - 1) / 2;
+    count[b] = block_pairs(begin + i_begin, begin + i_end, end,
+                           model, shape, norm, block);
+    partial[b] = kernels_->ffm_pair_score(block, count[b], v, shape);
+  });
+  real_t pred = linear_score(row, model, norm, *kernels_);
+  for (size_t b = 0; b < partial.size(); ++b) {
+    pred += partial[b];
+  }
+  real_t pg = partial_grad(pred, y);
+  KernelParam param = kernel_param();
+  update_linear<Optimizer>(row, model, param, pg, norm);
+  long_pool_->ParallelFor(bounds, [&](size_t i_begin, size_t i_end) {
+    size_t b = block_of(i_begin);
+    FFMPair* block = pairs + i_begin * (2 * nnz - i_begin - 1) / 2;
+    Optimizer::FFMPairKernel(*kernels_)(block, count[b],
+                                        v, shape, param, pg);
+  });
+  return pred;
 }
 
-// Calculate gradient and update current model using ftrl
-void FFMScore::calc_grad_ftrl(const SparseRow* row,
-                              Model& model,
-                              real_t pg,
-                              real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/  
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  index_t num_field = model.GetNumField();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id*3];
-    real_t &wlg = w[feat_id*3+1];
-    real_t &wlz = w[feat_id*3+2];
-    real_t g = lambda_2_*wl+pg*iter->feat_val*sqrt_norm; 
-    real_t old_wlg = wlg;
-    wlg += g*g;
-    real_t sigma = (sqrt(wlg)-sqrt(old_wlg)) / alpha_;
-    wlz += (g-sigma*wl);
-    int sign = wlz > 0 ? 1:-1;
-    if (sign*wlz <= lambda_1_) {
-      wl = 0;
-    } else {
-      wl = (sign*lambda_1_-wlz) / 
-           ((beta_ + sqrt(wlg)) / 
-            alpha_ + lambda_2_);
-    }
+// The weights of a latent vector are in blocks of kAlign values with
+// their aux blocks in turn, or all together with --split-ffm, where
+// the aux of all the fields of the feature are after them.
+void FFMScore::latent_layout(Model& model,
+                             offset_t* stride,
+                             offset_t* gap) {
+  offset_t aligned_k = model.get_aligned_k();
+  if (model.IsSplitLayout()) {
+    *stride = kAlign;
+    *gap = model.GetNumField() * aligned_k;
+  } else {
+    *stride = kAlign * (offset_t)model.GetAuxiliarySize();
+    *gap = kAlign;
   }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t &wbz = w[2];
-  real_t g = pg;
-  real_t old_wbg = wbg;
-  wbg += g*g;
-  real_t sigma = (sqrt(wbg)-sqrt(old_wbg)) / alpha_;
-  wbz += (g-sigma*wb);
-  int sign = wbz > 0 ? 1:-1;
-  if (sign*wbz <= lambda_1_) {
-    wb = 0;
+}
+
+// The pair of V_i_fj and V_j_fi adds pg * v * V_j_fi to the gradient
+// of V_i_fj and pg * v * V_i_fj to the one of V_j_fi, where v is
+// x_i * x_j * norm, and the pairs are recorded by the score.
+real_t FFMScore::CalcScoreAndBatchGrad(const SparseRow* row,
+                                       Model& model,
+                                       real_t y,
+                                       PartialGradFunc partial_grad,
+                                       real_t norm,
+                                       GradBuffer* buf,
+                                       real_t weight) {
+  if (!bag_field_.empty()) {
+    real_t pred = CalcScore(row, model, norm);
+    real_t pg = weight * partial_grad(pred, y);
+    accumulate_linear(row, model, pg, sqrt(norm), buf);
+    index_t aligned_k = model.get_aligned_k();
+    bag_grad(model, pg, norm, [&](offset_t pos, const real_t* grad) {
+      real_t* g = buf->Latent(pos, aligned_k);
+      for (index_t d = 0; d < aligned_k; ++d) { g[d] += grad[d]; }
+    });
+    buf->rows++;
+    return pred;
+  }
+  size_t nnz = row->size();
+  // The weighted rows are exact (see SetPairSample)
+  size_t num_sample = weight == 1.0 ? sample_size(nnz) : 0;
+  FFMPair* pairs = pair_buffer.Get(num_sample > 0 ? num_sample :
+                                   nnz * (nnz - 1) / 2);
+  KernelShape shape = kernel_shape(model);
+  real_t* v = model.GetParameter_v();
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*row, model.GetNumField(), &end);
+  size_t num_pairs = 0;
+  real_t pred = linear_score(row, model, norm, *kernels_);
+  if (num_sample > 0) {
+    num_pairs = sample_pairs(begin, end, num_sample,
+                             model, shape, norm, pairs);
+    pred += kernels_->ffm_pair_score(pairs, num_pairs, v, shape);
+  } else if (!model.GetFieldIndex().Empty()) {
+    num_pairs = sparse_pairs(begin, end, model, norm, pairs);
+    pred += kernels_->ffm_pair_score(pairs, num_pairs, v, shape);
   } else {
-    wb = (sign*lambda_1_-wbz) / 
-         ((beta_ + sqrt(wbg)) / 
-          alpha_ + lambda_2_);
+    pred += kernels_->ffm_score_pairs(begin, end,
+                                      v, shape, norm,
+                                      pairs,
+                                      &num_pairs);
   }
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
-  index_t align0 = 3 * model.get_aligned_k();
-  index_t align1 = model.GetNumField() * align0;
-  index_t align = kAlign * 3;
-  w = model.GetParameter_v();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMalpha = _mm_set1_ps(alpha_);
-  __m128 XMML2 = _mm_set1_ps(lambda_2_);
-  for (SparseRow::const_iterator iter_i = row->begin();
-       iter_i != row->end(); ++iter_i) {
-    index_t j1 = iter_i->feat_id;
-    index_t f1 = iter_i->field_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat || f1 >= num_field) continue;
-    real_t v1 = iter_i->feat_val;
-    for (SparseRow::const_iterator iter_j = iter_i+1;
-         iter_j != row->end(); ++iter_j) {
-      index_t j2 = iter_j->feat_id;
-      index_t f2 = iter_j->field_id;
-      // To avoid unseen feature
-      if (j2 >= num_feat || f2 >= num_field) continue;
-      real_t v2 = iter_j->feat_val;
-      real_t* w1_base = w + j1*align1 + f2*align0;
-      real_t* w2_base = w + j2*align1 + f1*align0;
-      __m128 XMMv = _mm_set1_ps(v1*v2*norm);
-      __m128 XMMpgv = _mm_mul_ps(XMMv, XMMpg);
-      for (index_t d = 0; d < align0; d += align) {
-        real_t *w1 = w1_base + d;
-        real_t *w2 = w2_base + d;
-        real_t *wg1 = w1 + kAlign;
-        real_t *wg2 = w2 + kAlign;
-        real_t *z1 = w1 + kAlign * 2;
-        real_t *z2 = w2 + kAlign * 2;
-        __m128 XMMw1 = _mm_load_ps(w1);
-        __m128 XMMw2 = _mm_load_ps(w2);
-        __m128 XMMwg1 = _mm_load_ps(wg1);
-        __m128 XMMwg2 = _mm_load_ps(wg2);
-        __m128 XMMz1 = _mm_load_ps(z1);
-        __m128 XMMz2 = _mm_load_ps(z2);
-        __m128 XMMg1 = _mm_add_ps(
-                       _mm_mul_ps(XMML2, XMMw1),
-                       _mm_mul_ps(XMMpgv, XMMw2));
-        __m128 XMMg2 = _mm_add_ps(
-                       _mm_mul_ps(XMML2, XMMw2),
-                       _mm_mul_ps(XMMpgv, XMMw1));
-        __m128 XMMsigma1 = _mm_div_ps(
-                           _mm_sub_ps(
-                           _mm_sqrt_ps(
-                           _mm_add_ps(XMMwg1,
-                           _mm_mul_ps(XMMg1, XMMg1))),
-                           _mm_sqrt_ps(XMMwg1)), XMMalpha);
-        __m128 XMMsigma2 = _mm_div_ps(
-                           _mm_sub_ps(
-                           _mm_sqrt_ps(
-                           _mm_add_ps(XMMwg2,
-                           _mm_mul_ps(XMMg2, XMMg2))),
-                           _mm_sqrt_ps(XMMwg2)), XMMalpha);
-        XMMz1 = _mm_add_ps(XMMz1,
-                _mm_sub_ps(XMMg1,
-                _mm_mul_ps(XMMsigma1, XMMw1)));
-        XMMz2 = _mm_add_ps(XMMz2,
-                _mm_sub_ps(XMMg2,
-                _mm_mul_ps(XMMsigma2, XMMw2)));
-        _mm_store_ps(z1, XMMz1);
-        _mm_store_ps(z2, XMMz2);
-        XMMwg1 = _mm_add_ps(XMMwg1,
-                 _mm_mul_ps(XMMg1, XMMg1));
-        XMMwg2 = _mm_add_ps(XMMwg2,
-                 _mm_mul_ps(XMMg2, XMMg2));
-        _mm_store_ps(wg1, XMMwg1);
-        _mm_store_ps(wg2, XMMwg2);
-        // Update w. SSE may not faster
-        for (size_t i = 0; i < kAlign; ++i) {
-          // w1
-          real_t z1_value = *(z1+i);
-          int sign = z1_value > 0 ? 1 : -1;
-          if (sign * z1_value <= lambda_1_) {
-            *(w1+i) = 0;
-          } else {
-            *(w1+i) = (sign*lambda_1_-z1_value) / 
-              ((beta_ + sqrt(*(wg1+i))) / alpha_ + lambda_2_);
-          }
-          // w2
-          real_t z2_value = *(z2+i);
-          sign = z2_value > 0 ? 1 : -1;
-          if (sign * z2_value <= lambda_1_) {
-            *(w2+i) = 0;
-          } else {
-            *(w2+i) = (sign*lambda_1_-z2_value) / 
-              ((beta_ + sqrt(*(wg2+i))) / alpha_ + lambda_2_);
-          }
-        }
+  real_t pg = weight * partial_grad(pred, y);
+  accumulate_linear(row, model, pg, sqrt(norm), buf);
+  index_t aligned_k = shape.aligned_k;
+  offset_t stride = 0, gap = 0;
+  latent_layout(model, &stride, &gap);
+  for (size_t p = 0; p < num_pairs; ++p) {
+    real_t pgv = pg * pairs[p].v;
+    const real_t* w1 = v + pairs[p].w1;
+    const real_t* w2 = v + pairs[p].w2;
+    real_t* g1 = buf->Latent(pairs[p].w1, aligned_k);
+    for (index_t d = 0; d < aligned_k; d += kAlign) {
+      const real_t* w = w2 + (d / kAlign) * stride;
+      for (index_t e = 0; e < kAlign; ++e) {
+        g1[d+e] += pgv * w[e];
+      }
+    }
+    real_t* g2 = buf->Latent(pairs[p].w2, aligned_k);
+    for (index_t d = 0; d < aligned_k; d += kAlign) {
+      const real_t* w = w1 + (d / kAlign) * stride;
+      for (index_t e = 0; e < kAlign; ++e) {
+        g2[d+e] += pgv * w[e];
       }
     }
   }
+  buf->rows++;
+  return pred;
 }
 
+// Instantiate the optimizers used by OptScore
+template void FFMScore::calc_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FFMScore::calc_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FFMScore::calc_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FFMScore::calc_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FFMScore::calc_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+
+template real_t FFMScore::calc_score_and_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FFMScore::calc_score_and_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FFMScore::calc_score_and_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FFMScore::calc_score_and_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FFMScore::calc_score_and_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+
 } // namespace xLearn
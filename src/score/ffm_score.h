@@ -21,21 +21,58 @@ This file defines the FFMScore (field-aware factorization machine) class.
 #ifndef XLEARN_LOSS_FFM_SCORE_H_
 #define XLEARN_LOSS_FFM_SCORE_H_
 
+#include <string>
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/parse_number.h"
+#include "src/base/split_string.h"
 #include "src/score/score_function.h"
+#include "src/score/optimizer.h"
 
 namespace xLearn {
 
+// Parse the fields of -bag_field, e.g., "3,7", which are
+// distinct. Return false if the list is empty or invalid.
+inline bool ParseBagFields(const std::string& spec,
+                           std::vector<index_t>* fields) {
+  CHECK_NOTNULL(fields);
+  fields->clear();
+  std::vector<std::string> list;
+  SplitStringUsing(spec, ",", &list);
+  for (const std::string& item : list) {
+    index_t field = 0;
+    if (!ParseUint32(item.data(), item.data() + item.size(), &field)) {
+      return false;
+    }
+    for (index_t other : *fields) {
+      if (other == field) { return false; }
+    }
+    fields->push_back(field);
+  }
+  return !fields->empty();
+}
+
 //------------------------------------------------------------------------------
 // FFMScore is used to implement field-aware factorization machines,
 // in which the score function is:
 //   y = sum( (V_i_fj*V_j_fi)(x_i * x_j) )
 // Here leave out the bias and linear term.
+//
+// The nodes of a bag field (see SetBagFields), e.g., the tags of a
+// user, are one unit of the row, whose vector of each target field f
+// is P_f = s * sum(V_j_f * x_j) over its nodes j, where s is 1 for
+// the sum and 1/n for the mean of n nodes. Every other node is a unit
+// of its own (s = 1), and the score is the sum of <P_fv, Q_fu> of
+// each two units P of field fu and Q of field fv. So the nodes of a
+// bag have no pairs with each other, and a row costs
+// O(nnz * fields + fields^2) instead of O(nnz^2) (in K values), since
+// the pairs of a unit are the sums of the units of each field.
 //------------------------------------------------------------------------------
 class FFMScore : public Score {
 public:
  // Constructor and Destructor
- FFMScore() { }
+ FFMScore() : kernels_(&GetBestScoreKernels()) { }
  ~FFMScore() { }
 
  // Given one example and current model, this method
@@ -44,42 +81,146 @@ public:
                   Model& model,
                   real_t norm = 1.0);
 
- // Calculate gradient and update current
- // model parameters.
+ // Calculate gradient and update current model
+ // parameters. The optimizer is checked by opt_type_
+ // for each call, and OptScore does it at compile time.
  void CalcGrad(const SparseRow* row,
                Model& model,
                real_t pg,
                real_t norm = 1.0);
 
+ // Add the gradient of the row to the buffer, in which the pairs
+ // found by the score give the gradient of each latent vector.
+ real_t CalcScoreAndBatchGrad(const SparseRow* row,
+                              Model& model,
+                              real_t y,
+                              PartialGradFunc partial_grad,
+                              real_t norm,
+                              GradBuffer* buf,
+                              real_t weight = 1.0);
+
+ // Use the kernels of the given table (see Score::SetKernels).
+ void SetKernels(const ScoreKernels* kernels) {
+   CHECK_NOTNULL(kernels);
+   kernels_ = kernels;
+ }
+
+ // Pool the nodes of the bag fields (see Score::SetBagFields).
+ void SetBagFields(const std::vector<index_t>& fields, bool mean);
+
+ // Prefetch the linear term and the latent factors of the row.
+ void Prefetch(const SparseRow* row, Model& model);
+
+ // The context of a ranking request keeps its own pairs, and for
+ // each field fc of the context and each target field f, the sum of
+ // V_j_f * x_j over the context nodes j of field fc. Then the pairs
+ // between a candidate node i of field fi and the context are
+ // sum_fc <V_i_fc, sum_j(V_j_fi * x_j)> * x_i, so each candidate
+ // costs O(candidate_nnz * (context_fields + candidate_nnz) * K)
+ // instead of O((context_nnz + candidate_nnz)^2 * K).
+ void CalcContext(const SparseRow* context,
+                  Model& model,
+                  ScoreContext* ctx);
+ real_t CalcCandidate(const ScoreContext& ctx,
+                      const SparseRow* candidate,
+                      Model& model,
+                      real_t norm = 1.0);
+
+ // Compute the cells of the pair tables of the model (see PairTable),
+ // which are <V_i_f2, V_j_f1> of the feature i of f1 and j of f2.
+ static void FillPairTable(Model& model);
+
  protected:
-  // Calculate gradient and update model using sgd
-  void calc_grad_sgd(const SparseRow* row,
+  // Layout of the latent vectors of ffm (see Score::latent_layout).
+  void latent_layout(Model& model, offset_t* stride, offset_t* gap);
+
+  // Return the latent part of the nodes grouped by field
+  // with the given norm by the storage type of the model.
+  real_t latent_score(const Node* begin,
+                      const Node* end,
+                      Model& model,
+                      real_t norm);
+
+  // Same as latent_score(), but the pairs of the pair tables of
+  // the fp32 model are looked up instead of the dot products.
+  real_t table_score(const Node* begin,
+                     const Node* end,
                      Model& model,
-                     real_t pg,
-                     real_t norm = 1.0);
+                     real_t norm);
+
+  // Return the latent part of the nodes grouped by field with
+  // the units of the bag fields, which are kept for bag_grad().
+  real_t bag_score(const Node* begin,
+                   const Node* end,
+                   Model& model,
+                   real_t norm);
 
-  // Calculate gradient and update model using adagrad
-  void calc_grad_adagrad(const SparseRow* row,
-  	                     Model& model,
-  	                     real_t pg,
-  	                     real_t norm = 1.0);
+  // Call fn(offset, grad) for each latent vector of the units of
+  // the last bag_score() of current thread, where grad is its
+  // gradient of aligned_k values with the partial gradient pg.
+  template <typename Func>
+  void bag_grad(Model& model, real_t pg, real_t norm, Func fn);
 
-  // Calculate gradient and update model using ftrl
-  void calc_grad_ftrl(const SparseRow* row,
-  	                  Model& model,
-  	                  real_t pg,
-  	                  real_t norm = 1.0);
+  // Update the latent vectors of bag_grad() by the optimizer.
+  template <class Optimizer>
+  void update_bags(Model& model,
+                   const KernelParam& param,
+                   real_t pg,
+                   real_t norm);
+
+  // Calculate gradient and update model by the given
+  // optimizer policy, which is defined in optimizer.h
+  template <class Optimizer>
+  void calc_grad(const SparseRow* row,
+                 Model& model,
+                 real_t pg,
+                 real_t norm = 1.0);
+
+  // Calculate score and gradient in one walk of the row.
+  // The pairs found by the score are reused by the update.
+  template <class Optimizer>
+  real_t calc_score_and_grad(const SparseRow* row,
+                             Model& model,
+                             real_t y,
+                             PartialGradFunc partial_grad,
+                             real_t norm = 1.0);
+
+  // Same as calc_score_and_grad() for a long row (see SetLongRow),
+  // whose pair loop is split into the blocks of the first node. The
+  // threads of the pool sum the pairs of their blocks, which are added
+  // up for the score, and then each one updates the pairs of its block
+  // without any lock (Hogwild), while the linear term is updated here.
+  template <class Optimizer>
+  real_t long_score_and_grad(const SparseRow* row,
+                             Model& model,
+                             real_t y,
+                             PartialGradFunc partial_grad,
+                             real_t norm);
 
  private:
+  // SIMD kernels chosen by current CPU
+  const ScoreKernels* kernels_;
   real_t* comp_res1 = nullptr;
   real_t* comp_res2 = nullptr;
   real_t* comp_z_lt_zero = nullptr;
   real_t* comp_z_gt_zero = nullptr;
+  // Whether each field is a bag, and whether the bags are averaged
+  std::vector<bool> bag_field_;
+  bool bag_mean_ = false;
   
  private:
   DISALLOW_COPY_AND_ASSIGN(FFMScore);
 };
 
+// FFMScore with the optimizer known at compile time
+typedef OptScore<FFMScore, SGDOptimizer> FFMScoreSGD;
+typedef OptScore<FFMScore, AdaGradOptimizer> FFMScoreAdaGrad;
+typedef OptScore<FFMScore, FTRLOptimizer> FFMScoreFTRL;
+typedef OptScore<FFMScore, FTRLBF16Optimizer> FFMScoreFTRLBF16;
+typedef OptScore<FFMScore, AdamOptimizer> FFMScoreAdam;
+// adamw shares the policy of adam (see AdamOptimizer)
+typedef OptScore<FFMScore, AdamOptimizer> FFMScoreAdamW;
+
 }  // namespace xLearn
 
 #endif  // XLEARN_LOSS_FFM_SCORE_H_
@@ -20,8 +20,15 @@ This file tests the FFMScore class.
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
 #include "src/base/common.h"
 #include "src/data/data_structure.h"
+#include "src/data/field_index.h"
 #include "src/data/hyper_parameters.h"
 #include "src/score/score_function.h"
 #include "src/score/ffm_score.h"
@@ -133,4 +140,621 @@ TEST(FFMScore_Test, calc_score_overflow) {
   }
 }
 
+real_t partial_grad(real_t pred, real_t y) {
+  return pred - y;
+}
+
+// The fused pass should give the same model as
+// calling CalcScore() and CalcGrad() one by one.
+void CheckScoreAndGrad(Score* score_a, Score* score_b,
+                       const std::string& opt_type,
+                       index_t aux_size) {
+  SparseRow row(8);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i % 6;
+    row[i].field_id = i % 3;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b;
+  model_a.Initialize("ffm", "squared", 6, 3, 10, aux_size);
+  model_b.Initialize("ffm", "squared", 6, 3, 10, aux_size);
+  std::string opt = opt_type;
+  score_a->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  for (int n = 0; n < 3; ++n) {
+    real_t pred_a = score_a->CalcScore(&row, model_a, 0.5);
+    score_a->CalcGrad(&row, model_a, partial_grad(pred_a, 1.0), 0.5);
+    real_t pred_b = score_b->CalcScoreAndGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5);
+    EXPECT_FLOAT_EQ(pred_a, pred_b);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_w()[i],
+                    model_b.GetParameter_w()[i]);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_v()[i],
+                    model_b.GetParameter_v()[i]);
+  }
+}
+
+TEST(FFMScore_Test, calc_score_and_grad) {
+  FFMScore sgd_a, adagrad_a, ftrl_a, adam_a, adamw_a;
+  FFMScoreSGD sgd_b;
+  FFMScoreAdaGrad adagrad_b;
+  FFMScoreFTRL ftrl_b;
+  FFMScoreAdam adam_b;
+  FFMScoreAdamW adamw_b;
+  CheckScoreAndGrad(&sgd_a, &sgd_b, "sgd", 1);
+  CheckScoreAndGrad(&adagrad_a, &adagrad_b, "adagrad", 2);
+  CheckScoreAndGrad(&ftrl_a, &ftrl_b, "ftrl", 3);
+  CheckScoreAndGrad(&adam_a, &adam_b, "adam", 3);
+  CheckScoreAndGrad(&adamw_a, &adamw_b, "adamw", 3);
+}
+
+// One row in the buffer gives the same model as its own update,
+// where the features and the fields of the row are distinct. The
+// layout of the model is 0 for the default, 1 for the split layout,
+// and 2 for the field-major layout.
+void CheckBatchGrad(Score* score_a, Score* score_b,
+                    const std::string& opt_type,
+                    index_t aux_size,
+                    int layout = 0) {
+  SparseRow row(5);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = i;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b;
+  model_a.SetSplitLayout(layout == 1);
+  model_b.SetSplitLayout(layout == 1);
+  model_a.SetFieldMajor(layout == 2);
+  model_b.SetFieldMajor(layout == 2);
+  model_a.Initialize("ffm", "squared", 5, 5, 10, aux_size);
+  model_b.Initialize("ffm", "squared", 5, 5, 10, aux_size);
+  std::string opt = opt_type;
+  score_a->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  GradBuffer buf;
+  for (int n = 0; n < 3; ++n) {
+    real_t pred_a = score_a->CalcScoreAndGrad(&row, model_a, 1.0,
+                                              partial_grad, 0.5);
+    real_t pred_b = score_b->CalcScoreAndBatchGrad(&row, model_b, 1.0,
+                                                   partial_grad, 0.5,
+                                                   &buf);
+    EXPECT_EQ(buf.rows, 1);
+    score_b->ApplyGrad(model_b, &buf);
+    EXPECT_EQ(buf.rows, 0);
+    // adagrad of the SIMD kernels uses the approximate rsqrt
+    EXPECT_NEAR(pred_a, pred_b, 1e-4);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(model_a.GetParameter_w()[i],
+                model_b.GetParameter_w()[i], 1e-4);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(model_a.GetParameter_v()[i],
+                model_b.GetParameter_v()[i], 1e-4);
+  }
+}
+
+// The long row split across the threads gives the same score and
+// model as the one of current thread, where each latent vector is in
+// one pair, since the features and the fields of the row are distinct.
+void CheckLongRow(int layout) {
+  const index_t kNNZ = 40;
+  SparseRow row(kNNZ);
+  for (index_t i = 0; i < kNNZ; ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = i;
+    row[i].feat_val = 0.1 + i * 0.001;
+  }
+  Model model_a, model_b;
+  for (Model* model : {&model_a, &model_b}) {
+    model->SetSplitLayout(layout == 1);
+    model->SetFieldMajor(layout == 2);
+    model->Initialize("ffm", "squared", kNNZ, kNNZ, 10, 2);
+  }
+  FFMScoreAdaGrad score_a, score_b;
+  std::string opt = "adagrad";
+  score_a.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  ThreadPool pool(4);
+  score_b.SetLongRow(&pool, kNNZ);
+  for (int n = 0; n < 3; ++n) {
+    real_t pred_a = score_a.CalcScoreAndGrad(&row, model_a, 1.0,
+                                             partial_grad, 0.5);
+    real_t pred_b = score_b.CalcScoreAndGrad(&row, model_b, 1.0,
+                                             partial_grad, 0.5);
+    EXPECT_NEAR(pred_a, pred_b, 1e-4);
+  }
+  // The partial scores are summed in another order
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(model_a.GetParameter_w()[i],
+                model_b.GetParameter_w()[i], 1e-4);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(model_a.GetParameter_v()[i],
+                model_b.GetParameter_v()[i], 1e-4);
+  }
+}
+
+TEST(FFMScore_Test, calc_score_and_grad_long_row) {
+  CheckLongRow(0);
+  CheckLongRow(1);
+  CheckLongRow(2);
+}
+
+// The score of a sampled row is an unbiased estimate of the exact
+// one, and the rows shorter than -sample_row are not sampled. The
+// batch gradients are kept in the buffer, so the model is the same
+// for each draw.
+TEST(FFMScore_Test, calc_score_and_grad_sample) {
+  const index_t kNNZ = 40;
+  SparseRow row(kNNZ);
+  for (index_t i = 0; i < kNNZ; ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = i;
+    row[i].feat_val = 0.5 + i * 0.01;
+  }
+  Model model;
+  model.Initialize("ffm", "squared", kNNZ, kNNZ, 10, 1);
+  FFMScoreSGD score;
+  std::string opt = "sgd";
+  score.Initialize(0.1, 0, 0.3, 1.0, 0.001, 0.01, opt);
+  real_t exact = score.CalcScore(&row, model, 0.5);
+  score.SetPairSample(kNNZ + 1, 2);
+  GradBuffer buf;
+  EXPECT_FLOAT_EQ(score.CalcScoreAndBatchGrad(&row, model, 1.0,
+                                              partial_grad, 0.5, &buf),
+                  exact);
+  score.SetPairSample(kNNZ, 2);
+  const int kDraws = 2000;
+  double sum = 0, sum2 = 0;
+  for (int n = 0; n < kDraws; ++n) {
+    real_t pred = score.CalcScoreAndBatchGrad(&row, model, 1.0,
+                                              partial_grad, 0.5, &buf);
+    sum += pred;
+    sum2 += pred * pred;
+  }
+  double mean = sum / kDraws;
+  double stddev = sqrt(sum2 / kDraws - mean * mean);
+  EXPECT_GT(stddev, 0);
+  EXPECT_NEAR(mean, exact, 4 * stddev / sqrt(kDraws));
+  EXPECT_FLOAT_EQ(score.CalcScore(&row, model, 0.5), exact);
+}
+
+real_t logistic_grad(real_t pred, real_t y) {
+  return -y / (1.0 + exp(y * pred));
+}
+
+// Logistic loss of the rows under the exact score
+real_t logistic_loss(Score* score, const std::vector<SparseRow>& rows,
+                     const std::vector<real_t>& labels, Model& model) {
+  real_t loss = 0;
+  for (size_t r = 0; r < rows.size(); ++r) {
+    real_t pred = score->CalcScore(&rows[r], model, 1.0);
+    loss += log1p(exp(-labels[r] * pred));
+  }
+  return loss / rows.size();
+}
+
+// The gradient of a sampled row is taken at the sampled score, which
+// biases it under the logistic loss. Training on a small fixture with
+// a quarter of the pairs stays close to training on all of them.
+TEST(FFMScore_Test, calc_score_and_grad_sample_bias) {
+  const index_t kRows = 50;
+  const index_t kNNZ = 24;
+  const index_t kFeat = 200;
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<index_t> feat(0, kFeat - 1);
+  std::vector<SparseRow> rows(kRows, SparseRow(kNNZ));
+  std::vector<real_t> labels(kRows);
+  for (index_t r = 0; r < kRows; ++r) {
+    for (index_t i = 0; i < kNNZ; ++i) {
+      rows[r][i].feat_id = feat(gen);
+      rows[r][i].field_id = i;
+      rows[r][i].feat_val = 1.0 / sqrt(kNNZ);
+    }
+    labels[r] = (r % 3 == 0) ? 1.0 : -1.0;
+  }
+  Model model_a, model_b;
+  model_a.Initialize("ffm", "cross-entropy", kFeat, kNNZ, 4, 1);
+  model_b.Initialize("ffm", "cross-entropy", kFeat, kNNZ, 4, 1);
+  FFMScoreSGD score_a, score_b;
+  std::string opt = "sgd";
+  score_a.Initialize(0.2, 0, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b.Initialize(0.2, 0, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b.SetPairSample(kNNZ, 3);
+  real_t init = logistic_loss(&score_a, rows, labels, model_a);
+  for (int epoch = 0; epoch < 20; ++epoch) {
+    for (index_t r = 0; r < kRows; ++r) {
+      score_a.CalcScoreAndGrad(&rows[r], model_a, labels[r],
+                               logistic_grad, 1.0);
+      score_b.CalcScoreAndGrad(&rows[r], model_b, labels[r],
+                               logistic_grad, 1.0);
+    }
+  }
+  real_t loss_a = logistic_loss(&score_a, rows, labels, model_a);
+  real_t loss_b = logistic_loss(&score_b, rows, labels, model_b);
+  EXPECT_LT(loss_a, init);
+  EXPECT_LT(loss_b, init);
+  EXPECT_NEAR(loss_b, loss_a, 0.1 * (init - loss_a));
+}
+
+TEST(FFMScore_Test, calc_score_and_batch_grad) {
+  FFMScore sgd_a, adagrad_a, ftrl_a, adam_a;
+  FFMScoreSGD sgd_b;
+  FFMScoreAdaGrad adagrad_b;
+  FFMScoreFTRL ftrl_b;
+  // The plain score checks the optimizer by opt_type_
+  FFMScore adam_b;
+  CheckBatchGrad(&sgd_a, &sgd_b, "sgd", 1);
+  CheckBatchGrad(&adagrad_a, &adagrad_b, "adagrad", 2);
+  CheckBatchGrad(&ftrl_a, &ftrl_b, "ftrl", 3);
+  CheckBatchGrad(&adam_a, &adam_b, "adam", 3);
+  FFMScoreAdaGrad split_a, split_b, field_a, field_b;
+  CheckBatchGrad(&split_a, &split_b, "adagrad", 2, 1);
+  CheckBatchGrad(&field_a, &field_b, "adagrad", 2, 2);
+}
+
+// Two rows of one batch are scored on the same model, so without
+// L2 the sgd update of a row twice in the buffer is twice its own.
+TEST(FFMScore_Test, batch_grad_sums_rows) {
+  SparseRow row(5);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = i;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b, model_c;
+  model_a.Initialize("ffm", "squared", 5, 5, 10, 1);
+  model_b.Initialize("ffm", "squared", 5, 5, 10, 1);
+  model_c.Initialize("ffm", "squared", 5, 5, 10, 1);
+  std::string opt = "sgd";
+  FFMScoreSGD score;
+  score.Initialize(0.1, 0, 0.3, 1.0, 0.001, 0.01, opt);
+  GradBuffer buf;
+  real_t pred_a = score.CalcScoreAndBatchGrad(&row, model_a, 1.0,
+                                              partial_grad, 0.5, &buf);
+  score.ApplyGrad(model_a, &buf);
+  real_t pred_b = score.CalcScoreAndBatchGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5, &buf);
+  real_t pred_c = score.CalcScoreAndBatchGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5, &buf);
+  EXPECT_EQ(buf.rows, 2);
+  score.ApplyGrad(model_b, &buf);
+  EXPECT_FLOAT_EQ(pred_a, pred_b);
+  EXPECT_FLOAT_EQ(pred_a, pred_c);
+  real_t* w[3] = { model_a.GetParameter_w(), model_b.GetParameter_w(),
+                   model_c.GetParameter_w() };
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(w[1][i] - w[2][i], 2 * (w[0][i] - w[2][i]), 1e-5);
+  }
+  real_t* v[3] = { model_a.GetParameter_v(), model_b.GetParameter_v(),
+                   model_c.GetParameter_v() };
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(v[1][i] - v[2][i], 2 * (v[0][i] - v[2][i]), 1e-5);
+  }
+  EXPECT_NEAR(model_b.GetParameter_b()[0] - model_c.GetParameter_b()[0],
+              2 * (model_a.GetParameter_b()[0] -
+                   model_c.GetParameter_b()[0]), 1e-5);
+}
+
+// The compact latent factors give nearly the same score. The
+// relative error of bf16 is at most 2^-8, and int8 has the
+// error of scale/2 for each value.
+TEST(FFMScore_Test, calc_score_compact) {
+  StorageType types[3] = { kStoreFP16, kStoreBF16, kStoreInt8 };
+  real_t tolerance[3] = { 0.01, 0.02, 0.05 };
+  for (int t = 0; t < 3; ++t) {
+    for (index_t k = 1; k < 20; ++k) {
+      SparseRow row(5);
+      for (index_t i = 0; i < 5; ++i) {
+        row[i].feat_id = i;
+        row[i].feat_val = 1.0 + i * 0.2;
+        row[i].field_id = i % 3;
+      }
+      Model model;
+      model.Initialize("ffm", "squared", 5, 3, k, 2, 0.5);
+      FFMScore score;
+      real_t expect = score.CalcScore(&row, model, 0.5);
+      model.ConvertLatent(types[t]);
+      real_t val = score.CalcScore(&row, model, 0.5);
+      EXPECT_NEAR(val, expect, tolerance[t] * std::fabs(expect) + 1e-4);
+    }
+  }
+}
+
+// FFMScore groups the nodes by field before the kernel, which
+// gives the same score as the row sorted by field. Both of
+// the bucket sort and the std::sort (for many fields) are checked,
+// and the row also has unseen fields and features.
+TEST(FFMScore_Test, calc_score_group_by_field) {
+  index_t num_fields[2] = { 7, 2000 };
+  for (int t = 0; t < 2; ++t) {
+    index_t num_field = num_fields[t];
+    Model model;
+    model.Initialize("ffm", "squared", 50, num_field, 8, 2, 0.5);
+    SparseRow row(40);
+    for (index_t i = 0; i < row.size(); ++i) {
+      row[i].feat_id = (i * 7) % 53;
+      row[i].field_id = (i * 13 + 5) % (num_field + 2);
+      row[i].feat_val = 0.5 + i * 0.01;
+    }
+    // The reversed row of sorted nodes is scored as it is
+    SparseRow sorted_row(row);
+    std::stable_sort(sorted_row.begin(), sorted_row.end(),
+      [](const Node& a, const Node& b) {
+        return a.field_id < b.field_id;
+    });
+    SparseRow reversed_row(sorted_row.rbegin(), sorted_row.rend());
+    FFMScore score;
+    real_t expect = score.CalcScore(&sorted_row, model, 0.5);
+    EXPECT_NEAR(score.CalcScore(&row, model, 0.5), expect,
+                1e-4 * (1.0 + std::fabs(expect)));
+    EXPECT_NEAR(score.CalcScore(&reversed_row, model, 0.5), expect,
+                1e-4 * (1.0 + std::fabs(expect)));
+  }
+}
+
+// The context and candidate parts give the same score as the whole
+// row of the context features plus the candidate, in which the fields
+// of the context and the candidate overlap, and the rows have unseen
+// fields and features.
+TEST(FFMScore_Test, calc_candidate) {
+  StorageType types[3] = { kStoreFP32, kStoreBF16, kStoreInt8 };
+  real_t norms[2] = { 1.0, 0.3 };
+  for (int t = 0; t < 3; ++t) {
+    for (index_t k = 1; k < 20; k += 3) {
+      SparseRow context(6), candidate(5), row;
+      for (index_t i = 0; i < 6; ++i) {
+        context[i].feat_id = (i * 5) % 21;
+        context[i].field_id = (i * 3 + 1) % 6;
+        context[i].feat_val = 1.0 + i * 0.2;
+        row.push_back(context[i]);
+      }
+      for (index_t i = 0; i < 5; ++i) {
+        candidate[i].feat_id = i + 10;
+        candidate[i].field_id = i % 5;
+        candidate[i].feat_val = 0.5 + i * 0.3;
+        row.push_back(candidate[i]);
+      }
+      Model model;
+      model.Initialize("ffm", "squared", 20, 5, k, 2, 0.5);
+      model.ConvertLatent(types[t]);
+      FFMScore score;
+      ScoreContext ctx;
+      score.CalcContext(&context, model, &ctx);
+      for (int n = 0; n < 2; ++n) {
+        real_t expect = score.CalcScore(&row, model, norms[n]);
+        real_t val = score.CalcCandidate(ctx, &candidate,
+                                         model, norms[n]);
+        EXPECT_NEAR(val, expect, 1e-4 * (1.0 + std::fabs(expect)));
+      }
+    }
+  }
+}
+
+// The sparse model of the pairs of its training rows gives the same
+// score and update as the dense model, since the pairs out of the
+// field index are never used by the rows.
+TEST(FFMScore_Test, calc_score_sparse) {
+  DMatrix matrix;
+  matrix.ReAlloc(2);
+  for (index_t i = 0; i < 2; ++i) {
+    matrix.row[i] = new SparseRow;
+    for (index_t n = 0; n < 5; ++n) {
+      matrix.AddNode(i, (i * 5 + n * 3) % 9, 0.5 + n * 0.1,
+                     (i + n * 2) % 4);
+    }
+  }
+  FieldIndex index;
+  index.Add(&matrix);
+  index.Build(10, 4);
+  EXPECT_LT(index.NumBlocks(), 10 * 4);
+  Model dense, sparse;
+  dense.Initialize("ffm", "squared", 10, 4, 11, 2, 0.5);
+  sparse.SetFieldIndex(index);
+  sparse.Initialize("ffm", "squared", 10, 4, 11, 2, 0.5);
+  EXPECT_LT(sparse.GetNumParameter_v(), dense.GetNumParameter_v());
+  FFMScoreAdaGrad score_dense, score_sparse;
+  std::string opt = "adagrad";
+  score_dense.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_sparse.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  for (int n = 0; n < 3; ++n) {
+    for (index_t i = 0; i < 2; ++i) {
+      SparseRow* row = matrix.row[i];
+      EXPECT_FLOAT_EQ(score_sparse.CalcScore(row, sparse, 0.5),
+                      score_dense.CalcScore(row, dense, 0.5));
+      EXPECT_FLOAT_EQ(
+          score_sparse.CalcScoreAndGrad(row, sparse, 1.0, partial_grad, 0.5),
+          score_dense.CalcScoreAndGrad(row, dense, 1.0, partial_grad, 0.5));
+    }
+  }
+  offset_t size = dense.get_aligned_k() * dense.GetAuxiliarySize();
+  for (index_t j = 0; j < 10; ++j) {
+    for (index_t f = 0; f < 4; ++f) {
+      offset_t b = index.Block(j, f);
+      if (b == FieldIndex::kNoBlock) continue;
+      const real_t* v_dense = dense.GetParameter_v() + (j * 4 + f) * size;
+      const real_t* v_sparse = sparse.GetParameter_v() + b * size;
+      for (offset_t d = 0; d < size; ++d) {
+        EXPECT_FLOAT_EQ(v_sparse[d], v_dense[d]);
+      }
+    }
+  }
+}
+
+// The vectors of their own K give the same score and update as the
+// dense model whose vectors are zero after the K, where feature j is
+// of field j % 4, so the two vectors of each pair have the same K.
+TEST(FFMScore_Test, calc_score_field_k) {
+  DMatrix matrix;
+  matrix.ReAlloc(3);
+  for (index_t i = 0; i < 3; ++i) {
+    matrix.row[i] = new SparseRow;
+    for (index_t n = 0; n < 6; ++n) {
+      index_t j = (i * 5 + n * 7) % 12;
+      matrix.AddNode(i, j, 0.5 + n * 0.1, j % 4);
+    }
+  }
+  std::vector<FieldK> items;
+  ASSERT_TRUE(ParseFieldK("0=2,1=5,2:3=4", &items));
+  FieldIndex index;
+  index.Add(&matrix);
+  index.SetFieldK(FieldKTable(items, 4, 11));
+  index.Build(12, 4);
+  Model dense, sparse;
+  dense.Initialize("ffm", "squared", 12, 4, 11, 2, 0.5);
+  sparse.SetFieldIndex(index);
+  sparse.Initialize("ffm", "squared", 12, 4, 11, 2, 0.5);
+  EXPECT_LT(sparse.GetNumParameter_v() * 2, dense.GetNumParameter_v());
+  // The vectors of the index are copied, and the dense ones
+  // are zero after their widths
+  offset_t size = dense.get_aligned_k() * dense.GetAuxiliarySize();
+  offset_t block = kAlign * sparse.GetAuxiliarySize();
+  for (index_t j = 0; j < 12; ++j) {
+    for (index_t f = 0; f < 4; ++f) {
+      offset_t b = index.Block(j, f);
+      if (b == FieldIndex::kNoBlock) continue;
+      real_t* v_dense = dense.GetParameter_v() + (j * 4 + f) * size;
+      const real_t* v_sparse = sparse.GetParameter_v() + b * block;
+      offset_t width = index.Width(j, f) * block;
+      std::copy(v_sparse, v_sparse + width, v_dense);
+      for (offset_t d = width; d < size; d += block) {
+        std::fill(v_dense + d, v_dense + d + kAlign, 0);
+      }
+    }
+  }
+  FFMScoreAdaGrad score_dense, score_sparse;
+  std::string opt = "adagrad";
+  score_dense.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_sparse.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  for (int n = 0; n < 3; ++n) {
+    for (index_t i = 0; i < 3; ++i) {
+      SparseRow* row = matrix.row[i];
+      EXPECT_FLOAT_EQ(score_sparse.CalcScore(row, sparse, 0.5),
+                      score_dense.CalcScore(row, dense, 0.5));
+      EXPECT_FLOAT_EQ(
+          score_sparse.CalcScoreAndGrad(row, sparse, 1.0, partial_grad, 0.5),
+          score_dense.CalcScoreAndGrad(row, dense, 1.0, partial_grad, 0.5));
+      score_sparse.CalcGrad(row, sparse, 0.2, 0.5);
+      score_dense.CalcGrad(row, dense, 0.2, 0.5);
+    }
+  }
+  for (index_t j = 0; j < 12; ++j) {
+    for (index_t f = 0; f < 4; ++f) {
+      offset_t b = index.Block(j, f);
+      if (b == FieldIndex::kNoBlock) continue;
+      const real_t* v_dense = dense.GetParameter_v() + (j * 4 + f) * size;
+      const real_t* v_sparse = sparse.GetParameter_v() + b * block;
+      offset_t width = index.Width(j, f) * block;
+      for (offset_t d = 0; d < size; ++d) {
+        if (d < width) {
+          EXPECT_FLOAT_EQ(v_sparse[d], v_dense[d]);
+        } else if (d % block < kAlign) {
+          EXPECT_EQ(v_dense[d], 0);
+        }
+      }
+    }
+  }
+}
+
+// The row of 8 nodes of -bag_field, whose field 2 has four nodes.
+static SparseRow BagRow() {
+  static const index_t kField[8] = { 0, 1, 2, 2, 2, 2, 3, 3 };
+  SparseRow row(8);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = kField[i];
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  return row;
+}
+
+// The bag of the sum is the row without the pairs of the bag, and the
+// mean is the same with the bag values divided by the size of the bag.
+TEST(FFMScore_Test, calc_score_bag) {
+  Model model;
+  model.Initialize("ffm", "squared", 8, 4, 10, 1);
+  std::fill(model.GetParameter_w(),
+            model.GetParameter_w() + model.GetNumParameter_w(), 0);
+  SparseRow row = BagRow();
+  FFMScore plain, sum, mean, none;
+  sum.SetBagFields({2}, false);
+  mean.SetBagFields({2}, true);
+  none.SetBagFields({9}, false);
+  for (bool is_mean : {false, true}) {
+    SparseRow full = row, bag;
+    for (index_t i = 0; i < full.size(); ++i) {
+      if (full[i].field_id != 2) continue;
+      if (is_mean) { full[i].feat_val /= 4; }
+      bag.push_back(full[i]);
+    }
+    real_t expected = plain.CalcScore(&full, model, 0.5) -
+                      plain.CalcScore(&bag, model, 0.5);
+    FFMScore& score = is_mean ? mean : sum;
+    EXPECT_NEAR(score.CalcScore(&row, model, 0.5), expected, 1e-5);
+  }
+  // The fields without any bag are the plain ffm
+  EXPECT_NEAR(none.CalcScore(&row, model, 0.5),
+              plain.CalcScore(&row, model, 0.5), 1e-5);
+}
+
+// The sgd update without L2 is the gradient of the score, which is
+// checked by the finite difference, and the fused pass and the batch
+// give the same model as CalcScore() and CalcGrad().
+TEST(FFMScore_Test, calc_grad_bag) {
+  SparseRow row = BagRow();
+  std::string opt = "sgd";
+  for (bool is_mean : {false, true}) {
+    Model model_a, model_b, model_c;
+    model_a.Initialize("ffm", "squared", 8, 4, 10, 1);
+    model_b.Initialize("ffm", "squared", 8, 4, 10, 1);
+    model_c.Initialize("ffm", "squared", 8, 4, 10, 1);
+    FFMScore score_a, score_c;
+    FFMScoreSGD score_b;
+    for (Score* score : {(Score*)&score_a, (Score*)&score_b,
+                         (Score*)&score_c}) {
+      score->Initialize(0.1, 0, 0.3, 1.0, 0.001, 0.01, opt);
+      score->SetBagFields({2}, is_mean);
+    }
+    index_t size = model_a.get_aligned_k();
+    std::vector<real_t> before(model_a.GetParameter_v(),
+                               model_a.GetParameter_v() +
+                               model_a.GetNumParameter_v());
+    real_t pred = score_a.CalcScore(&row, model_a, 0.5);
+    score_a.CalcGrad(&row, model_a, partial_grad(pred, 1.0), 0.5);
+    EXPECT_FLOAT_EQ(score_b.CalcScoreAndGrad(&row, model_b, 1.0,
+                                             partial_grad, 0.5), pred);
+    GradBuffer buf;
+    EXPECT_FLOAT_EQ(score_c.CalcScoreAndBatchGrad(&row, model_c, 1.0,
+                                                  partial_grad, 0.5,
+                                                  &buf), pred);
+    score_c.ApplyGrad(model_c, &buf);
+    for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(model_a.GetParameter_v()[i],
+                      model_b.GetParameter_v()[i]);
+      EXPECT_NEAR(model_a.GetParameter_v()[i],
+                  model_c.GetParameter_v()[i], 1e-6);
+    }
+    // V_2_3 of a bag node, V_3_2 of the same bag, and V_6_2 of a
+    // plain node (the first weight of each vector)
+    real_t pg = partial_grad(pred, 1.0);
+    for (index_t r : {2 * 4 + 3, 3 * 4 + 2, 6 * 4 + 2}) {
+      real_t* v = model_c.GetParameter_v() + r * size;
+      std::copy(before.begin(), before.end(), model_c.GetParameter_v());
+      v[0] += 1e-2;
+      real_t up = score_c.CalcScore(&row, model_c, 0.5);
+      v[0] -= 2e-2;
+      real_t down = score_c.CalcScore(&row, model_c, 0.5);
+      real_t grad = (up - down) / 2e-2;
+      real_t step = before[r * size] - model_a.GetParameter_v()[r * size];
+      EXPECT_NEAR(step, 0.1 * pg * grad, 1e-4);
+    }
+  }
+}
+
 } // namespace xLearn
@@ -18,385 +18,248 @@
 This file is the implementation of FMScore class.
 */
 
-#include <pmmintrin.h>  // for SSE
-
 #include "src/score/fm_score.h"
 #include "src/base/math.h"
+#include "src/base/scratch_buffer.h"
 
 namespace xLearn {
 
+// The sum vector sum(V_i * x_i) of current row, which is owned
+// by each thread, so we don't allocate it for every row.
+static thread_local ScratchBuffer<real_t> sum_buffer;
+
 // y = sum( (V_i*V_j)(x_i * x_j) )
-// Using SSE to accelerate vector operation.
+// Using SIMD kernels to accelerate vector operation, and the
+// compact latent factors are converted to fp32 in registers.
 real_t FMScore::CalcScore(const SparseRow* row,
                           Model& model,
                           real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  real_t t = 0;
-  index_t aux_size = model.GetAuxiliarySize();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature in Prediction
-    if (feat_id >= num_feat) continue;
-    t += (iter->feat_val * w[feat_id*aux_size] * sqrt_norm);
+  real_t t = linear_score(row, model, norm, *kernels_);
+  real_t* sum = sum_buffer.GetZero(model.get_aligned_k());
+  return t + latent_score(row, model, sum, norm);
+}
+
+// The latent part of the row by the storage type of the model
+real_t FMScore::latent_score(const SparseRow* row,
+                             Model& model,
+                             real_t* sum,
+                             real_t norm) {
+  const SparseRow& r = *row;
+  switch (model.GetLatentType()) {
+    case kStoreFP16:
+      return kernels_->fm_score_fp16(r.data(),
+                                     r.data() + r.size(),
+                                     model.GetParameter_v_half(),
+                                     kernel_shape(model),
+                                     sum,
+                                     norm);
+    case kStoreBF16:
+      return kernels_->fm_score_bf16(r.data(),
+                                     r.data() + r.size(),
+                                     model.GetParameter_v_half(),
+                                     kernel_shape(model),
+                                     sum,
+                                     norm);
+    case kStoreInt8:
+      return kernels_->fm_score_int8(r.data(),
+                                     r.data() + r.size(),
+                                     model.GetParameter_v_int8(),
+                                     model.GetParameter_v_scale(),
+                                     kernel_shape(model),
+                                     sum,
+                                     norm);
+    default:
+      return kernels_->fm_score(r.data(),
+                                r.data() + r.size(),
+                                model.GetParameter_v(),
+                                kernel_shape(model),
+                                sum,
+                                norm);
   }
-  // bias
-  w = model.GetParameter_b();
-  t += w[0];
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
+}
+
+// Keep the linear sum, the sum vector and the pairs of the context,
+// which are computed with norm = 1, since the latent part of a row
+// is norm^2 times the one with norm = 1.
+void FMScore::CalcContext(const SparseRow* context,
+                          Model& model,
+                          ScoreContext* ctx) {
   index_t aligned_k = model.get_aligned_k();
-  index_t align0 = model.get_aligned_k() * aux_size;
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature in Prediction
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 const XMMw = _mm_load_ps(w+d);
-      XMMs = _mm_add_ps(XMMs, _mm_mul_ps(XMMw, XMMv));
-      _mm_store_ps(s+d, XMMs);
-    }
+  real_t* sum = sum_buffer.GetZero(aligned_k);
+  ctx->linear = linear_sum(context, model, *kernels_);
+  ctx->latent = latent_score(context, model, sum, 1.0);
+  ctx->sum.assign(sum, sum + aligned_k);
+}
+
+// The pairs of the whole row are the pairs of the context, the pairs
+// of the candidate, and <s_context, s_candidate>.
+real_t FMScore::CalcCandidate(const ScoreContext& ctx,
+                              const SparseRow* candidate,
+                              Model& model,
+                              real_t norm) {
+  index_t aligned_k = model.get_aligned_k();
+  CHECK_EQ(ctx.sum.size(), aligned_k);
+  real_t* sum = sum_buffer.GetZero(aligned_k);
+  real_t latent = latent_score(candidate, model, sum, 1.0);
+  const real_t* s = ctx.sum.data();
+  real_t dot = 0;
+  for (index_t d = 0; d < aligned_k; ++d) {
+    dot += s[d] * sum[d];
   }
-  __m128 XMMt = _mm_set1_ps(0.0f);
+  real_t linear = (ctx.linear + linear_sum(candidate, model, *kernels_)) *
+                  sqrt(norm);
+  return linear + model.GetParameter_b()[0] +
+         (ctx.latent + latent + dot) * norm * norm;
+}
+
+// Prefetch w_i and V_i of each feature in the row.
+void FMScore::Prefetch(const SparseRow* row, Model& model) {
+  prefetch_linear(row, model);
+  KernelShape shape = kernel_shape(model);
+  size_t align = shape.aligned_k * shape.aux_size;
   for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature in Prediction
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 XMMw = _mm_load_ps(w+d);
-      __m128 XMMwv = _mm_mul_ps(XMMw, XMMv);
-      XMMt = _mm_add_ps(XMMt,
-         _mm_mul_ps(XMMwv, _mm_sub_ps(XMMs, XMMwv)));
-    }
+    if (iter->feat_id >= shape.num_feat) continue;
+    prefetch_latent(model, iter->feat_id * align);
   }
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  real_t t_all;
-  _mm_store_ss(&t_all, XMMt);
-  t_all *= 0.5;
-  t_all += t;
-  return t_all;
 }
 
 // Calculate gradient and update current model parameters.
-// Using SSE to accelerate vector operation.
+// Using SIMD kernels to accelerate vector operation.
 void FMScore::CalcGrad(const SparseRow* row,
                        Model& model,
                        real_t pg,
                        real_t norm) {
   // Using sgd
   if (opt_type_.compare("sgd") == 0) {
-    this->calc_grad_sgd(row, model, pg, norm);
+    this->calc_grad<SGDOptimizer>(row, model, pg, norm);
   }
   // Using adagrad
   else if (opt_type_.compare("adagrad") == 0) {
-    this->calc_grad_adagrad(row, model, pg, norm);
+    this->calc_grad<AdaGradOptimizer>(row, model, pg, norm);
   }
   // Using ftrl 
   else if (opt_type_.compare("ftrl") == 0) {
-    this->calc_grad_ftrl(row, model, pg, norm);
+    this->calc_grad<FTRLOptimizer>(row, model, pg, norm);
+  }
+  // Using ftrl of the bf16 state (see -opt_state)
+  else if (opt_type_.compare("ftrl_bf16") == 0) {
+    this->calc_grad<FTRLBF16Optimizer>(row, model, pg, norm);
+  }
+  // Using adam or adamw
+  else if (opt_type_.compare("adam") == 0 ||
+           opt_type_.compare("adamw") == 0) {
+    this->calc_grad<AdamOptimizer>(row, model, pg, norm);
   }
   else {
     LOG(FATAL) << "Unknow optimization method: " << opt_type_;
   }
 }
 
-// Calculate gradient and update current model using sgd
-void FMScore::calc_grad_sgd(const SparseRow* row,
-                            Model& model,
-                            real_t pg,
-                            real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/  
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id];
-    real_t g = regu_lambda_*wl+pg*iter->feat_val*sqrt_norm;
-    wl -= learning_rate_ * g;
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t g = pg;
-  wb -= learning_rate_ * g;
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
-  index_t aligned_k = model.get_aligned_k();
-  index_t align0 = model.get_aligned_k() * 
-                   model.GetAuxiliarySize();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMlr = _mm_set1_ps(learning_rate_);
-  __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 const XMMw = _mm_load_ps(w+d);
-      XMMs = _mm_add_ps(XMMs, _mm_mul_ps(XMMw, XMMv));
-      _mm_store_ps(s+d, XMMs);
-    }
-  }
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-  // To avoid unseen feature
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    __m128 XMMpgv = _mm_mul_ps(XMMpg, XMMv);
-    for(index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 XMMw = _mm_load_ps(w+d);
-      __m128 XMMg = _mm_add_ps(_mm_mul_ps(XMMlamb, XMMw),
-        _mm_mul_ps(XMMpgv, _mm_sub_ps(XMMs,
-        _mm_mul_ps(XMMw, XMMv))));
-      XMMw = _mm_sub_ps(XMMw, _mm_mul_ps(XMMlr, XMMg));
-      _mm_store_ps(w+d, XMMw);
-    }
-  }
+// Calculate gradient and update current model using
+// the given optimizer policy (see optimizer.h)
+template <class Optimizer>
+void FMScore::calc_grad(const SparseRow* row,
+                        Model& model,
+                        real_t pg,
+                        real_t norm) {
+  KernelParam param = kernel_param();
+  KernelShape shape = kernel_shape(model);
+  update_linear<Optimizer>(row, model, param, pg, norm);
+  real_t* v = model.GetParameter_v();
+  real_t* sum = sum_buffer.GetZero(shape.aligned_k);
+  const SparseRow& r = *row;
+  kernels_->fm_sum(r.data(), r.data() + r.size(),
+                   v, shape, sum, norm);
+  Optimizer::FMKernel(*kernels_)(r.data(), r.data() + r.size(),
+                                 v, shape, param, sum, pg, norm);
 }
 
-// Calculate gradient and update current model using adagrad
-void FMScore::calc_grad_adagrad(const SparseRow* row,
-                                Model& model,
-                                real_t pg,
-                                real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  for (SparseRow::const_iterator iter = row->begin();
-      iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id*2];
-    real_t &wlg = w[feat_id*2+1];
-    real_t g = regu_lambda_*wl+pg*iter->feat_val*sqrt_norm;
-    wlg += g*g;
-    wl -= learning_rate_ * g * InvSqrt(wlg);
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t g = pg;
-  wbg += g*g;
-  wb -= learning_rate_ * g * InvSqrt(wbg);
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
-  index_t aligned_k = model.get_aligned_k();
-  index_t align0 = model.get_aligned_k() * 
-                   model.GetAuxiliarySize();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMlr = _mm_set1_ps(learning_rate_);
-  __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 const XMMw = _mm_load_ps(w+d);
-      XMMs = _mm_add_ps(XMMs, _mm_mul_ps(XMMw, XMMv));
-      _mm_store_ps(s+d, XMMs);
-    }
-  }
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    __m128 XMMpgv = _mm_mul_ps(XMMpg, XMMv);
-    for(index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 XMMw = _mm_load_ps(w+d);
-      __m128 XMMwg = _mm_load_ps(w+aligned_k+d);
-      __m128 XMMg = _mm_add_ps(_mm_mul_ps(XMMlamb, XMMw),
-      _mm_mul_ps(XMMpgv, _mm_sub_ps(XMMs,
-        _mm_mul_ps(XMMw, XMMv))));
-      XMMwg = _mm_add_ps(XMMwg, _mm_mul_ps(XMMg, XMMg));
-      XMMw = _mm_sub_ps(XMMw,
-             _mm_mul_ps(XMMlr,
-             _mm_mul_ps(_mm_rsqrt_ps(XMMwg), XMMg)));
-      _mm_store_ps(w+d, XMMw);
-      _mm_store_ps(w+aligned_k+d, XMMwg);
-    }
-  }
+// Calculate score and gradient, in which the sum
+// vector of the score is reused by the update.
+template <class Optimizer>
+real_t FMScore::calc_score_and_grad(const SparseRow* row,
+                                    Model& model,
+                                    real_t y,
+                                    PartialGradFunc partial_grad,
+                                    real_t norm) {
+  KernelShape shape = kernel_shape(model);
+  real_t* v = model.GetParameter_v();
+  real_t* sum = sum_buffer.GetZero(shape.aligned_k);
+  const SparseRow& r = *row;
+  real_t pred = linear_score(row, model, norm, *kernels_) +
+                kernels_->fm_score(r.data(), r.data() + r.size(),
+                                   v, shape, sum, norm);
+  real_t pg = partial_grad(pred, y);
+  KernelParam param = kernel_param();
+  update_linear<Optimizer>(row, model, param, pg, norm);
+  Optimizer::FMKernel(*kernels_)(r.data(), r.data() + r.size(),
+                                 v, shape, param, sum, pg, norm);
+  return pred;
 }
 
-// Calculate gradient and update current model using ftrl
-void FMScore::calc_grad_ftrl(const SparseRow* row,
-                             Model& model,
-                             real_t pg,
-                             real_t norm) {
-  /*********************************************************
-   *  linear term and bias term                            *
-   *********************************************************/
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id*3];
-    real_t &wlg = w[feat_id*3+1];
-    real_t &wlz = w[feat_id*3+2];
-    real_t g = lambda_2_*wl+pg*iter->feat_val*sqrt_norm; 
-    real_t old_wlg = wlg;
-    wlg += g*g;
-    real_t sigma = (sqrt(wlg)-sqrt(old_wlg)) / alpha_;
-    wlz += (g-sigma*wl);
-    int sign = wlz > 0 ? 1:-1;
-    if (sign*wlz <= lambda_1_) {
-      wl = 0;
-    } else {
-      wl = (sign*lambda_1_-wlz) / 
-           ((beta_ + sqrt(wlg)) / 
-            alpha_ + lambda_2_);
-    }
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t &wbz = w[2];
-  real_t g = pg;
-  real_t old_wbg = wbg;
-  wbg += g*g;
-  real_t sigma = (sqrt(wbg)-sqrt(old_wbg)) / alpha_;
-  wbz += (g-sigma*wb);
-  int sign = wbz > 0 ? 1:-1;
-  if (sign*wbz <= lambda_1_) {
-    wb = 0;
-  } else {
-    wb = (sign*lambda_1_-wbz) / 
-         ((beta_ + sqrt(wbg)) / 
-          alpha_ + lambda_2_);
-  }  
-  /*********************************************************
-   *  latent factor                                        *
-   *********************************************************/
-  index_t aligned_k = model.get_aligned_k();
-  index_t align0 = model.get_aligned_k() * 
-                   model.GetAuxiliarySize();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMalpha = _mm_set1_ps(alpha_);
-  __m128 XMML2 = _mm_set1_ps(lambda_2_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
- for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 const XMMw = _mm_load_ps(w+d);
-      XMMs = _mm_add_ps(XMMs, _mm_mul_ps(XMMw, XMMv));
-      _mm_store_ps(s+d, XMMs);
-    }
-  }
+// The gradient of V_i is pg * v1 * (s - V_i * v1) without the L2
+// term, where v1 = x_i * norm, and s is the sum vector of the score.
+real_t FMScore::CalcScoreAndBatchGrad(const SparseRow* row,
+                                      Model& model,
+                                      real_t y,
+                                      PartialGradFunc partial_grad,
+                                      real_t norm,
+                                      GradBuffer* buf,
+                                      real_t weight) {
+  KernelShape shape = kernel_shape(model);
+  real_t* v = model.GetParameter_v();
+  real_t* sum = sum_buffer.GetZero(shape.aligned_k);
+  const SparseRow& r = *row;
+  real_t pred = linear_score(row, model, norm, *kernels_) +
+                kernels_->fm_score(r.data(), r.data() + r.size(),
+                                   v, shape, sum, norm);
+  real_t pg = weight * partial_grad(pred, y);
+  accumulate_linear(row, model, pg, sqrt(norm), buf);
+  index_t aligned_k = shape.aligned_k;
+  offset_t align0 = (offset_t)aligned_k * shape.aux_size;
   for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    // To avoid unseen feature
-    if (j1 >= num_feat) continue;
-    real_t v1 = iter->feat_val;
-    real_t *w_base = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    __m128 XMMpgv = _mm_mul_ps(XMMpg, XMMv);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      real_t* w = w_base + d;
-      real_t* wg = w_base + aligned_k + d;
-      real_t* z = w_base + aligned_k*2 + d;
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 XMMw = _mm_load_ps(w);
-      __m128 XMMwg = _mm_load_ps(wg);
-      __m128 XMMz = _mm_load_ps(z);
-      __m128 XMMg = _mm_add_ps(
-                    _mm_mul_ps(XMML2, XMMw),
-                    _mm_mul_ps(XMMpgv,
-                    _mm_sub_ps(XMMs,
-                      _mm_mul_ps(XMMw, XMMv))));
-      __m128 XMMsigma = _mm_div_ps(
-                        _mm_sub_ps(
-                        _mm_sqrt_ps(
-                        _mm_add_ps(XMMwg,
-                        _mm_mul_ps(XMMg, XMMg))),
-                        _mm_sqrt_ps(XMMwg)), XMMalpha);
-      XMMz = _mm_add_ps(XMMz,
-             _mm_sub_ps(XMMg,
-             _mm_mul_ps(XMMsigma, XMMw)));
-      _mm_store_ps(z, XMMz);
-      XMMwg = _mm_add_ps(XMMwg,
-              _mm_mul_ps(XMMg, XMMg));
-      _mm_store_ps(wg, XMMwg);
-      // Update w. SSE mat not faster.
-      for (size_t i = 0; i < kAlign; ++i) {
-        real_t z_value = *(z+i);
-        int sign = z_value > 0 ? 1:-1;
-        if (sign * z_value <= lambda_1_) {
-          *(w+i) = 0;
-        } else {
-          *(w+i) = (sign*lambda_1_-z_value) / 
-              ((beta_ + sqrt(*(wg+i))) / alpha_ + lambda_2_);
-        }
-      }
+    if (iter->feat_id >= shape.num_feat) continue;
+    offset_t offset = iter->feat_id * align0;
+    const real_t* w = v + offset;
+    real_t v1 = iter->feat_val * norm;
+    real_t pgv = pg * v1;
+    real_t* g = buf->Latent(offset, aligned_k);
+    for (index_t d = 0; d < aligned_k; ++d) {
+      g[d] += pgv * (sum[d] - w[d] * v1);
     }
   }
+  buf->rows++;
+  return pred;
 }
 
+// Instantiate the optimizers used by OptScore
+template void FMScore::calc_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FMScore::calc_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FMScore::calc_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FMScore::calc_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FMScore::calc_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+
+template real_t FMScore::calc_score_and_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FMScore::calc_score_and_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FMScore::calc_score_and_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FMScore::calc_score_and_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FMScore::calc_score_and_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+
 } // namespace xLearn
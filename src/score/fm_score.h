@@ -24,6 +24,7 @@ This file defines the FMrScore (factorization machine) class.
 #include "src/base/common.h"
 #include "src/data/model_parameters.h"
 #include "src/score/score_function.h"
+#include "src/score/optimizer.h"
 
 namespace xLearn {
 
@@ -35,7 +36,7 @@ namespace xLearn {
 class FMScore : public Score {
  public:
   // Constructor and Destructor
-  FMScore() { }
+  FMScore() : kernels_(&GetBestScoreKernels()) { }
   ~FMScore() { }
 
   // Given one example and current model, this method
@@ -44,32 +45,73 @@ class FMScore : public Score {
                    Model& model,
                    real_t norm = 1.0);
 
-  // Calculate gradient and update current
-  // model parameters.
+  // Calculate gradient and update current model
+  // parameters. The optimizer is checked by opt_type_
+  // for each call, and OptScore does it at compile time.
   void CalcGrad(const SparseRow* row,
                 Model& model,
                 real_t pg,
                 real_t norm = 1.0);
 
+  // Add the gradient of the row to the buffer, in which the
+  // sum vector of the score gives the gradient of each V_i.
+  real_t CalcScoreAndBatchGrad(const SparseRow* row,
+                               Model& model,
+                               real_t y,
+                               PartialGradFunc partial_grad,
+                               real_t norm,
+                               GradBuffer* buf,
+                               real_t weight = 1.0);
+
+  // Use the kernels of the given table (see Score::SetKernels).
+  void SetKernels(const ScoreKernels* kernels) {
+    CHECK_NOTNULL(kernels);
+    kernels_ = kernels;
+  }
+
+  // Prefetch the linear term and the latent factors of the row.
+  void Prefetch(const SparseRow* row, Model& model);
+
+  // The context of a ranking request keeps its linear sum, its sum
+  // vector s = sum(V_j * x_j) and its own pairs, and the pairs
+  // between the context and a candidate are <s, sum(V_i * x_i)>
+  // of the candidate, so each candidate costs O(candidate_nnz * K).
+  void CalcContext(const SparseRow* context,
+                   Model& model,
+                   ScoreContext* ctx);
+  real_t CalcCandidate(const ScoreContext& ctx,
+                       const SparseRow* candidate,
+                       Model& model,
+                       real_t norm = 1.0);
+
  protected:
-  // Calculate gradient and update model using sgd
-  void calc_grad_sgd(const SparseRow* row,
-                     Model& model,
-                     real_t pg,
-                     real_t norm = 1.0);
-
-  // Calculate gradient and update model using adagrad
-  void calc_grad_adagrad(const SparseRow* row,
-                         Model& model,
-                         real_t pg,
-                         real_t norm = 1.0);
-
-  // Calculate gradient and update model using ftrl
-  void calc_grad_ftrl(const SparseRow* row,
+  // Return the latent part of the row with the given norm,
+  // and the sum vector (zero on entry) keeps sum(V_i * x_i).
+  real_t latent_score(const SparseRow* row,
                       Model& model,
-                      real_t pg,
-                      real_t norm = 1.0);
+                      real_t* sum,
+                      real_t norm);
+
+  // Calculate gradient and update model by the given
+  // optimizer policy, which is defined in optimizer.h
+  template <class Optimizer>
+  void calc_grad(const SparseRow* row,
+                 Model& model,
+                 real_t pg,
+                 real_t norm = 1.0);
+
+  // Calculate score and gradient, and the sum vector
+  // of the score is reused by the update.
+  template <class Optimizer>
+  real_t calc_score_and_grad(const SparseRow* row,
+                             Model& model,
+                             real_t y,
+                             PartialGradFunc partial_grad,
+                             real_t norm = 1.0);
+
  private:
+  // SIMD kernels chosen by current CPU
+  const ScoreKernels* kernels_;
   real_t* comp_res = nullptr;
   real_t* comp_z_lt_zero = nullptr;
   real_t* comp_z_gt_zero = nullptr;
@@ -78,6 +120,15 @@ class FMScore : public Score {
   DISALLOW_COPY_AND_ASSIGN(FMScore);
 };
 
+// FMScore with the optimizer known at compile time
+typedef OptScore<FMScore, SGDOptimizer> FMScoreSGD;
+typedef OptScore<FMScore, AdaGradOptimizer> FMScoreAdaGrad;
+typedef OptScore<FMScore, FTRLOptimizer> FMScoreFTRL;
+typedef OptScore<FMScore, FTRLBF16Optimizer> FMScoreFTRLBF16;
+typedef OptScore<FMScore, AdamOptimizer> FMScoreAdam;
+// adamw shares the policy of adam (see AdamOptimizer)
+typedef OptScore<FMScore, AdamOptimizer> FMScoreAdamW;
+
 } // namespace xLearn
 
 #endif // XLEARN_LOSS_FM_SCORE_H_
@@ -20,6 +20,9 @@ This file tests the FMScore class.
 
 #include "gtest/gtest.h"
 
+#include <cmath>
+#include <string>
+
 #include "src/base/common.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
@@ -124,4 +127,208 @@ TEST(FMScoreTest, calc_score_overflow) {
   }
 }
 
+real_t partial_grad(real_t pred, real_t y) {
+  return pred - y;
+}
+
+// The fused pass should give the same model as
+// calling CalcScore() and CalcGrad() one by one.
+void CheckScoreAndGrad(Score* score_a, Score* score_b,
+                       const std::string& opt_type,
+                       index_t aux_size) {
+  SparseRow row(8);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i % 6;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b;
+  model_a.Initialize("fm", "squared", 6, 0, 10, aux_size);
+  model_b.Initialize("fm", "squared", 6, 0, 10, aux_size);
+  std::string opt = opt_type;
+  score_a->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  for (int n = 0; n < 3; ++n) {
+    real_t pred_a = score_a->CalcScore(&row, model_a, 0.5);
+    score_a->CalcGrad(&row, model_a, partial_grad(pred_a, 1.0), 0.5);
+    real_t pred_b = score_b->CalcScoreAndGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5);
+    EXPECT_FLOAT_EQ(pred_a, pred_b);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_w()[i],
+                    model_b.GetParameter_w()[i]);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_v()[i],
+                    model_b.GetParameter_v()[i]);
+  }
+}
+
+TEST(FMScoreTest, calc_score_and_grad) {
+  FMScore sgd_a, adagrad_a, ftrl_a, adam_a, adamw_a;
+  FMScoreSGD sgd_b;
+  FMScoreAdaGrad adagrad_b;
+  FMScoreFTRL ftrl_b;
+  FMScoreAdam adam_b;
+  FMScoreAdamW adamw_b;
+  CheckScoreAndGrad(&sgd_a, &sgd_b, "sgd", 1);
+  CheckScoreAndGrad(&adagrad_a, &adagrad_b, "adagrad", 2);
+  CheckScoreAndGrad(&ftrl_a, &ftrl_b, "ftrl", 3);
+  CheckScoreAndGrad(&adam_a, &adam_b, "adam", 3);
+  CheckScoreAndGrad(&adamw_a, &adamw_b, "adamw", 3);
+}
+
+// One row in the buffer gives the same model as its own update,
+// where the features (and the fields of ffm) of the row are distinct.
+void CheckBatchGrad(Score* score_a, Score* score_b,
+                    const std::string& opt_type,
+                    index_t aux_size) {
+  SparseRow row(5);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b;
+  model_a.Initialize("fm", "squared", 5, 0, 10, aux_size);
+  model_b.Initialize("fm", "squared", 5, 0, 10, aux_size);
+  std::string opt = opt_type;
+  score_a->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  GradBuffer buf;
+  for (int n = 0; n < 3; ++n) {
+    real_t pred_a = score_a->CalcScoreAndGrad(&row, model_a, 1.0,
+                                              partial_grad, 0.5);
+    real_t pred_b = score_b->CalcScoreAndBatchGrad(&row, model_b, 1.0,
+                                                   partial_grad, 0.5,
+                                                   &buf);
+    EXPECT_EQ(buf.rows, 1);
+    score_b->ApplyGrad(model_b, &buf);
+    EXPECT_EQ(buf.rows, 0);
+    // adagrad of the SIMD kernels uses the approximate rsqrt
+    EXPECT_NEAR(pred_a, pred_b, 1e-4);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(model_a.GetParameter_w()[i],
+                model_b.GetParameter_w()[i], 1e-4);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(model_a.GetParameter_v()[i],
+                model_b.GetParameter_v()[i], 1e-4);
+  }
+}
+
+TEST(FMScoreTest, calc_score_and_batch_grad) {
+  FMScore sgd_a, adagrad_a, ftrl_a, adam_a;
+  FMScoreSGD sgd_b;
+  FMScoreAdaGrad adagrad_b;
+  FMScoreFTRL ftrl_b;
+  // The plain score checks the optimizer by opt_type_
+  FMScore adam_b;
+  CheckBatchGrad(&sgd_a, &sgd_b, "sgd", 1);
+  CheckBatchGrad(&adagrad_a, &adagrad_b, "adagrad", 2);
+  CheckBatchGrad(&ftrl_a, &ftrl_b, "ftrl", 3);
+  CheckBatchGrad(&adam_a, &adam_b, "adam", 3);
+}
+
+// Two rows of one batch are scored on the same model, so without
+// L2 the sgd update of a row twice in the buffer is twice its own.
+TEST(FMScoreTest, batch_grad_sums_rows) {
+  SparseRow row(5);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b, model_c;
+  model_a.Initialize("fm", "squared", 5, 0, 10, 1);
+  model_b.Initialize("fm", "squared", 5, 0, 10, 1);
+  model_c.Initialize("fm", "squared", 5, 0, 10, 1);
+  std::string opt = "sgd";
+  FMScoreSGD score;
+  score.Initialize(0.1, 0, 0.3, 1.0, 0.001, 0.01, opt);
+  GradBuffer buf;
+  real_t pred_a = score.CalcScoreAndBatchGrad(&row, model_a, 1.0,
+                                              partial_grad, 0.5, &buf);
+  score.ApplyGrad(model_a, &buf);
+  real_t pred_b = score.CalcScoreAndBatchGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5, &buf);
+  real_t pred_c = score.CalcScoreAndBatchGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5, &buf);
+  EXPECT_EQ(buf.rows, 2);
+  score.ApplyGrad(model_b, &buf);
+  EXPECT_FLOAT_EQ(pred_a, pred_b);
+  EXPECT_FLOAT_EQ(pred_a, pred_c);
+  real_t* w[3] = { model_a.GetParameter_w(), model_b.GetParameter_w(),
+                   model_c.GetParameter_w() };
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(w[1][i] - w[2][i], 2 * (w[0][i] - w[2][i]), 1e-5);
+  }
+  real_t* v[3] = { model_a.GetParameter_v(), model_b.GetParameter_v(),
+                   model_c.GetParameter_v() };
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(v[1][i] - v[2][i], 2 * (v[0][i] - v[2][i]), 1e-5);
+  }
+  EXPECT_NEAR(model_b.GetParameter_b()[0] - model_c.GetParameter_b()[0],
+              2 * (model_a.GetParameter_b()[0] -
+                   model_c.GetParameter_b()[0]), 1e-5);
+}
+
+// The compact latent factors give nearly the same score. The
+// relative error of bf16 is at most 2^-8, and int8 has the
+// error of scale/2 for each value.
+TEST(FMScoreTest, calc_score_compact) {
+  StorageType types[3] = { kStoreFP16, kStoreBF16, kStoreInt8 };
+  real_t tolerance[3] = { 0.01, 0.02, 0.05 };
+  for (int t = 0; t < 3; ++t) {
+    for (index_t k = 1; k < 20; ++k) {
+      SparseRow row(5);
+      for (index_t i = 0; i < 5; ++i) {
+        row[i].feat_id = i;
+        row[i].feat_val = 1.0 + i * 0.2;
+        row[i].field_id = i % 3;
+      }
+      Model model;
+      model.Initialize("fm", "squared", 5, 3, k, 2, 0.5);
+      FMScore score;
+      real_t expect = score.CalcScore(&row, model, 0.5);
+      model.ConvertLatent(types[t]);
+      real_t val = score.CalcScore(&row, model, 0.5);
+      EXPECT_NEAR(val, expect, tolerance[t] * std::fabs(expect) + 1e-4);
+    }
+  }
+}
+
+// The context and candidate parts give the same score as
+// the whole row of the context features plus the candidate.
+TEST(FMScoreTest, calc_candidate) {
+  StorageType types[2] = { kStoreFP32, kStoreFP16 };
+  real_t norms[2] = { 1.0, 0.3 };
+  for (int t = 0; t < 2; ++t) {
+    for (index_t k = 1; k < 20; ++k) {
+      SparseRow context(3), candidate(4), row;
+      for (index_t i = 0; i < 3; ++i) {
+        context[i].feat_id = i;
+        context[i].feat_val = 1.0 + i * 0.2;
+        row.push_back(context[i]);
+      }
+      for (index_t i = 0; i < 4; ++i) {
+        candidate[i].feat_id = i + 3;
+        candidate[i].feat_val = 0.5 + i * 0.3;
+        row.push_back(candidate[i]);
+      }
+      Model model;
+      model.Initialize("fm", "squared", 7, 1, k, 2, 0.5);
+      model.ConvertLatent(types[t]);
+      FMScore score;
+      ScoreContext ctx;
+      score.CalcContext(&context, model, &ctx);
+      for (int n = 0; n < 2; ++n) {
+        real_t expect = score.CalcScore(&row, model, norms[n]);
+        real_t val = score.CalcCandidate(ctx, &candidate,
+                                         model, norms[n]);
+        EXPECT_NEAR(val, expect, 1e-4 * std::fabs(expect) + 1e-5);
+      }
+    }
+  }
+}
+
 } // namespace xLearn
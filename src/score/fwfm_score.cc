@@ -0,0 +1,275 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of FwFMScore class.
+*/
+
+#include "src/score/fwfm_score.h"
+#include "src/base/math.h"
+#include "src/base/scratch_buffer.h"
+
+namespace xLearn {
+
+// The field groups of current row, the sum vector of each group,
+// and the vectors t_f = sum(r_f_g * s_g) of the update, which are
+// owned by each thread, so we don't allocate them for every row.
+static thread_local ScratchBuffer<FwFMScore::FieldGroup> group_buffer;
+static thread_local ScratchBuffer<real_t> sum_buffer;
+static thread_local ScratchBuffer<real_t> ctx_buffer;
+
+// Return <a, b> of two vectors.
+static inline real_t dot_vector(const real_t* a,
+                                const real_t* b,
+                                index_t len) {
+  real_t sum = 0;
+  for (index_t d = 0; d < len; ++d) {
+    sum += a[d] * b[d];
+  }
+  return sum;
+}
+
+// y = sum( r_fi_fj * (V_i*V_j)(x_i * x_j) )
+// Using SIMD kernels to accelerate vector operation, and the
+// compact latent factors are converted to fp32 in registers.
+real_t FwFMScore::CalcScore(const SparseRow* row,
+                            Model& model,
+                            real_t norm) {
+  real_t t = linear_score(row, model, norm, *kernels_);
+  size_t num_group = sum_fields(row, model, norm);
+  return t + latent_score(num_group, model);
+}
+
+// The sum vector and the pairs of each group are given by the fm
+// kernel of the storage type, which is run on the nodes of the group.
+size_t FwFMScore::sum_fields(const SparseRow* row,
+                             Model& model,
+                             real_t norm) {
+  index_t num_field = model.GetNumField();
+  index_t aligned_k = model.get_aligned_k();
+  const Node* end = nullptr;
+  const Node* begin = group_by_field(*row, num_field, &end);
+  // The unseen fields are at the end, which are left out
+  FieldGroup* groups = group_buffer.Get(row->size());
+  size_t num_group = 0;
+  for (const Node* iter = begin;
+       iter != end && iter->field_id < num_field; ) {
+    const Node* next = iter + 1;
+    while (next != end && next->field_id == iter->field_id) { ++next; }
+    groups[num_group].begin = iter;
+    groups[num_group].end = next;
+    groups[num_group].field = iter->field_id;
+    num_group++;
+    iter = next;
+  }
+  real_t* sum = sum_buffer.GetZero(num_group * aligned_k);
+  KernelShape shape = kernel_shape(model);
+  for (size_t g = 0; g < num_group; ++g) {
+    const Node* b = groups[g].begin;
+    const Node* e = groups[g].end;
+    real_t* s = sum + g * aligned_k;
+    switch (model.GetLatentType()) {
+      case kStoreFP16:
+        groups[g].pairs = kernels_->fm_score_fp16(b, e,
+            model.GetParameter_v_half(), shape, s, norm);
+        break;
+      case kStoreBF16:
+        groups[g].pairs = kernels_->fm_score_bf16(b, e,
+            model.GetParameter_v_half(), shape, s, norm);
+        break;
+      case kStoreInt8:
+        groups[g].pairs = kernels_->fm_score_int8(b, e,
+            model.GetParameter_v_int8(), model.GetParameter_v_scale(),
+            shape, s, norm);
+        break;
+      default:
+        groups[g].pairs = kernels_->fm_score(b, e,
+            model.GetParameter_v(), shape, s, norm);
+        break;
+    }
+  }
+  return num_group;
+}
+
+// The pairs in each field, and <s_f, s_g> of each pair of fields.
+real_t FwFMScore::latent_score(size_t num_group, Model& model) {
+  index_t aligned_k = model.get_aligned_k();
+  const FieldGroup* groups = group_buffer.Get(num_group);
+  const real_t* sum = sum_buffer.Get(num_group * aligned_k);
+  real_t t = 0;
+  for (size_t g = 0; g < num_group; ++g) {
+    index_t f = groups[g].field;
+    t += model.GetFieldWeight(f, f)[0] * groups[g].pairs;
+    for (size_t h = g + 1; h < num_group; ++h) {
+      t += model.GetFieldWeight(f, groups[h].field)[0] *
+           dot_vector(sum + g * aligned_k, sum + h * aligned_k,
+                      aligned_k);
+    }
+  }
+  return t;
+}
+
+// Prefetch w_i and V_i of each feature in the row.
+void FwFMScore::Prefetch(const SparseRow* row, Model& model) {
+  prefetch_linear(row, model);
+  KernelShape shape = kernel_shape(model);
+  size_t align = shape.aligned_k * shape.aux_size;
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    if (iter->feat_id >= shape.num_feat) continue;
+    prefetch_latent(model, iter->feat_id * align);
+  }
+}
+
+// Calculate gradient and update current model parameters.
+// Using SIMD kernels to accelerate vector operation.
+void FwFMScore::CalcGrad(const SparseRow* row,
+                         Model& model,
+                         real_t pg,
+                         real_t norm) {
+  // Using sgd
+  if (opt_type_.compare("sgd") == 0) {
+    this->calc_grad<SGDOptimizer>(row, model, pg, norm);
+  }
+  // Using adagrad
+  else if (opt_type_.compare("adagrad") == 0) {
+    this->calc_grad<AdaGradOptimizer>(row, model, pg, norm);
+  }
+  // Using ftrl
+  else if (opt_type_.compare("ftrl") == 0) {
+    this->calc_grad<FTRLOptimizer>(row, model, pg, norm);
+  }
+  // Using ftrl of the bf16 state (see -opt_state)
+  else if (opt_type_.compare("ftrl_bf16") == 0) {
+    this->calc_grad<FTRLBF16Optimizer>(row, model, pg, norm);
+  }
+  // Using adam or adamw
+  else if (opt_type_.compare("adam") == 0 ||
+           opt_type_.compare("adamw") == 0) {
+    this->calc_grad<AdamOptimizer>(row, model, pg, norm);
+  }
+  else {
+    LOG(FATAL) << "Unknow optimization method: " << opt_type_;
+  }
+}
+
+// The gradient of V_i of field f is x_i * (t_f - r_f_f * V_i * x_i),
+// that of r_f_g is <s_f, s_g>, and that of r_f_f is the pairs in f.
+// All of them are given by the model before the update.
+template <class Optimizer>
+void FwFMScore::update_latent(size_t num_group,
+                              Model& model,
+                              const KernelParam& param,
+                              real_t pg,
+                              real_t norm) {
+  index_t aligned_k = model.get_aligned_k();
+  const FieldGroup* groups = group_buffer.Get(num_group);
+  const real_t* sum = sum_buffer.Get(num_group * aligned_k);
+  real_t* ctx = ctx_buffer.GetZero(num_group * aligned_k);
+  for (size_t g = 0; g < num_group; ++g) {
+    real_t* t = ctx + g * aligned_k;
+    for (size_t h = 0; h < num_group; ++h) {
+      real_t r = model.GetFieldWeight(groups[g].field,
+                                      groups[h].field)[0];
+      const real_t* s = sum + h * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        t[d] += r * s[d];
+      }
+    }
+  }
+  KernelShape shape = kernel_shape(model);
+  real_t* v = model.GetParameter_v();
+  FwFMGradKernel kernel = Optimizer::FwFMKernel(*kernels_);
+  for (size_t g = 0; g < num_group; ++g) {
+    index_t f = groups[g].field;
+    kernel(groups[g].begin, groups[g].end, v, shape, param,
+           ctx + g * aligned_k, model.GetFieldWeight(f, f)[0],
+           pg, norm);
+  }
+  // The field weights are scalars as the linear term
+  real_t lambda = Optimizer::Lambda(param);
+  for (size_t g = 0; g < num_group; ++g) {
+    index_t f = groups[g].field;
+    for (size_t h = g; h < num_group; ++h) {
+      real_t grad = h == g ? groups[g].pairs :
+                    dot_vector(sum + g * aligned_k,
+                               sum + h * aligned_k, aligned_k);
+      real_t* r = model.GetFieldWeight(f, groups[h].field);
+      Optimizer::Update(r, lambda * r[0] + pg * grad, param);
+    }
+  }
+}
+
+// Calculate gradient and update current model using
+// the given optimizer policy (see optimizer.h)
+template <class Optimizer>
+void FwFMScore::calc_grad(const SparseRow* row,
+                          Model& model,
+                          real_t pg,
+                          real_t norm) {
+  KernelParam param = kernel_param();
+  update_linear<Optimizer>(row, model, param, pg, norm);
+  size_t num_group = sum_fields(row, model, norm);
+  update_latent<Optimizer>(num_group, model, param, pg, norm);
+}
+
+// Calculate score and gradient, in which the sum
+// vectors of the score are reused by the update.
+template <class Optimizer>
+real_t FwFMScore::calc_score_and_grad(const SparseRow* row,
+                                      Model& model,
+                                      real_t y,
+                                      PartialGradFunc partial_grad,
+                                      real_t norm) {
+  size_t num_group = sum_fields(row, model, norm);
+  real_t pred = linear_score(row, model, norm, *kernels_) +
+                latent_score(num_group, model);
+  real_t pg = partial_grad(pred, y);
+  KernelParam param = kernel_param();
+  update_linear<Optimizer>(row, model, param, pg, norm);
+  update_latent<Optimizer>(num_group, model, param, pg, norm);
+  return pred;
+}
+
+// Instantiate the optimizers used by OptScore
+template void FwFMScore::calc_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FwFMScore::calc_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FwFMScore::calc_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FwFMScore::calc_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void FwFMScore::calc_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+
+template real_t FwFMScore::calc_score_and_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FwFMScore::calc_score_and_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FwFMScore::calc_score_and_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FwFMScore::calc_score_and_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+template real_t FwFMScore::calc_score_and_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t y,
+    PartialGradFunc partial_grad, real_t norm);
+
+} // namespace xLearn
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the FwFMScore (field-weighted factorization machine) class.
+*/
+
+#ifndef XLEARN_LOSS_FWFM_SCORE_H_
+#define XLEARN_LOSS_FWFM_SCORE_H_
+
+#include "src/base/common.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+#include "src/score/optimizer.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// FwFMScore is used to implement field-weighted factorization machines,
+// in which the score function is:
+//   y = sum( r_fi_fj * (V_i*V_j)(x_i * x_j) )
+// Each feature has one latent vector as fm, and each pair of fields
+// has a learned weight r (see Model::GetFieldWeight), so the model
+// takes num_feature * K + num_field^2 values instead of the
+// num_feature * num_field * K of ffm. The nodes are summed by field,
+// s_f = sum(V_i * x_i) for the nodes i of field f, and the score is:
+//   y = sum_f( r_f_f * pairs in f ) + sum_f<g( r_f_g * <s_f, s_g> )
+// which costs O(nnz * K + row_fields^2 * K) for a row.
+// Here we leave out the linear term and bias term.
+//------------------------------------------------------------------------------
+class FwFMScore : public Score {
+ public:
+  // Constructor and Destructor
+  FwFMScore() : kernels_(&GetBestScoreKernels()) { }
+  ~FwFMScore() { }
+
+  // Given one example and current model, this method
+  // returns the fwfm score.
+  real_t CalcScore(const SparseRow* row,
+                   Model& model,
+                   real_t norm = 1.0);
+
+  // Calculate gradient and update current model
+  // parameters. The optimizer is checked by opt_type_
+  // for each call, and OptScore does it at compile time.
+  void CalcGrad(const SparseRow* row,
+                Model& model,
+                real_t pg,
+                real_t norm = 1.0);
+
+  // Use the kernels of the given table (see Score::SetKernels).
+  void SetKernels(const ScoreKernels* kernels) {
+    CHECK_NOTNULL(kernels);
+    kernels_ = kernels;
+  }
+
+  // Prefetch the linear term and the latent factors of the row.
+  void Prefetch(const SparseRow* row, Model& model);
+
+  // The nodes of one field in the grouped row, and the pairs
+  // between them, which are sum( (V_i*V_j)(x_i * x_j) ).
+  struct FieldGroup {
+    const Node* begin;
+    const Node* end;
+    index_t field;
+    real_t pairs;
+  };
+
+ protected:
+  // Group the row by field, and fill the sum vector of each
+  // group (aligned_k values each). Return the number of groups.
+  size_t sum_fields(const SparseRow* row,
+                    Model& model,
+                    real_t norm);
+
+  // Return the latent part of the groups of sum_fields().
+  real_t latent_score(size_t num_group, Model& model);
+
+  // Calculate gradient and update model by the given
+  // optimizer policy, which is defined in optimizer.h
+  template <class Optimizer>
+  void calc_grad(const SparseRow* row,
+                 Model& model,
+                 real_t pg,
+                 real_t norm = 1.0);
+
+  // Calculate score and gradient, and the sum vectors
+  // of the score are reused by the update.
+  template <class Optimizer>
+  real_t calc_score_and_grad(const SparseRow* row,
+                             Model& model,
+                             real_t y,
+                             PartialGradFunc partial_grad,
+                             real_t norm = 1.0);
+
+  // Update the latent factors and the field weights of
+  // the groups of sum_fields() by the optimizer.
+  template <class Optimizer>
+  void update_latent(size_t num_group,
+                     Model& model,
+                     const KernelParam& param,
+                     real_t pg,
+                     real_t norm);
+
+ private:
+  // SIMD kernels chosen by current CPU
+  const ScoreKernels* kernels_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FwFMScore);
+};
+
+// FwFMScore with the optimizer known at compile time
+typedef OptScore<FwFMScore, SGDOptimizer> FwFMScoreSGD;
+typedef OptScore<FwFMScore, AdaGradOptimizer> FwFMScoreAdaGrad;
+typedef OptScore<FwFMScore, FTRLOptimizer> FwFMScoreFTRL;
+typedef OptScore<FwFMScore, FTRLBF16Optimizer> FwFMScoreFTRLBF16;
+typedef OptScore<FwFMScore, AdamOptimizer> FwFMScoreAdam;
+// adamw shares the policy of adam (see AdamOptimizer)
+typedef OptScore<FwFMScore, AdamOptimizer> FwFMScoreAdamW;
+
+} // namespace xLearn
+
+#endif // XLEARN_LOSS_FWFM_SCORE_H_
@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the FwFMScore class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <string>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+#include "src/score/fm_score.h"
+#include "src/score/fwfm_score.h"
+
+namespace xLearn {
+
+const index_t kNumFeat = 8;
+const index_t kNumField = 3;
+
+// The row of 8 nodes, whose fields are not sorted.
+void InitRow(SparseRow& row) {
+  row.resize(kNumFeat);
+  for (index_t i = 0; i < kNumFeat; ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = (i * 2) % kNumField;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+}
+
+// Give each pair of fields its own weight.
+void InitFieldWeight(Model& model) {
+  for (index_t f1 = 0; f1 < model.GetNumField(); ++f1) {
+    for (index_t f2 = f1; f2 < model.GetNumField(); ++f2) {
+      model.GetFieldWeight(f1, f2)[0] = 0.5 + f1 * 0.3 - f2 * 0.2;
+    }
+  }
+}
+
+// Copy the latent factors of fm, which have the same layout.
+void CopyLatent(Model& fm, Model& fwfm) {
+  ASSERT_EQ(fm.GetNumParameter_v(), fwfm.GetNumParameter_v());
+  for (index_t i = 0; i < fm.GetNumParameter_v(); ++i) {
+    fwfm.GetParameter_v()[i] = fm.GetParameter_v()[i];
+  }
+}
+
+// y = sum( r_fi_fj * (V_i*V_j)(x_i * x_j) ) of all the pairs.
+real_t BruteForceScore(const SparseRow& row, Model& model) {
+  index_t k_aligned = model.get_aligned_k();
+  index_t aux = model.GetAuxiliarySize();
+  real_t* v = model.GetParameter_v();
+  real_t sum = 0;
+  for (size_t i = 0; i < row.size(); ++i) {
+    for (size_t j = i + 1; j < row.size(); ++j) {
+      real_t* vi = v + row[i].feat_id * k_aligned * aux;
+      real_t* vj = v + row[j].feat_id * k_aligned * aux;
+      real_t dot = 0;
+      for (index_t d = 0; d < model.GetNumK(); ++d) {
+        dot += vi[d] * vj[d];
+      }
+      sum += model.GetFieldWeight(row[i].field_id,
+                                  row[j].field_id)[0] *
+             dot * row[i].feat_val * row[j].feat_val;
+    }
+  }
+  return sum;
+}
+
+TEST(FwFMScoreTest, calc_score) {
+  SparseRow row;
+  InitRow(row);
+  for (index_t k = 1; k < 20; ++k) {
+    Model model;
+    model.Initialize("fwfm", "squared", kNumFeat, kNumField, k, 2, 0.5);
+    InitFieldWeight(model);
+    FwFMScore score;
+    real_t expect = BruteForceScore(row, model);
+    real_t val = score.CalcScore(&row, model);
+    EXPECT_NEAR(val, expect, 1e-4 * (1.0 + std::fabs(expect)));
+  }
+}
+
+// The new model has all the weights of 1, which is the fm model,
+// and it gives the same score and the same update of the latent
+// factors as fm.
+TEST(FwFMScoreTest, same_as_fm) {
+  std::string opts[5] = { "sgd", "adagrad", "ftrl", "adam", "adamw" };
+  index_t aux[5] = { 1, 2, 3, 3, 3 };
+  SparseRow row;
+  InitRow(row);
+  for (int o = 0; o < 5; ++o) {
+    for (index_t k = 1; k < 20; k += 3) {
+      Model fm, fwfm;
+      fm.Initialize("fm", "squared", kNumFeat, kNumField, k, aux[o], 0.5);
+      fwfm.Initialize("fwfm", "squared", kNumFeat, kNumField, k, aux[o],
+                      0.5);
+      CopyLatent(fm, fwfm);
+      FMScore fm_score;
+      FwFMScore fwfm_score;
+      fm_score.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opts[o]);
+      fwfm_score.Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opts[o]);
+      real_t expect = fm_score.CalcScore(&row, fm, 0.5);
+      real_t val = fwfm_score.CalcScore(&row, fwfm, 0.5);
+      EXPECT_NEAR(val, expect, 1e-4 * (1.0 + std::fabs(expect)));
+      fm_score.CalcGrad(&row, fm, 0.2, 0.5);
+      fwfm_score.CalcGrad(&row, fwfm, 0.2, 0.5);
+      for (index_t i = 0; i < fm.GetNumParameter_v(); ++i) {
+        EXPECT_NEAR(fm.GetParameter_v()[i], fwfm.GetParameter_v()[i],
+                    1e-4 * (1.0 + std::fabs(fm.GetParameter_v()[i])));
+      }
+    }
+  }
+}
+
+// The fields not less than the fields of the model are left out.
+TEST(FwFMScoreTest, calc_score_unseen_field) {
+  SparseRow row;
+  InitRow(row);
+  Model model;
+  model.Initialize("fwfm", "squared", kNumFeat, kNumField, 4, 2, 0.5);
+  InitFieldWeight(model);
+  index_t aux = model.GetAuxiliarySize();
+  model.GetParameter_w()[0] = 0.3;
+  model.GetParameter_w()[aux] = 0.7;
+  FwFMScore score;
+  real_t expect = score.CalcScore(&row, model);
+  SparseRow extra = row;
+  extra.push_back(Node(kNumField, 0, 1.0));
+  extra.push_back(Node(kNumField + 5, 1, 2.0));
+  // The linear term of the extra nodes is still used
+  real_t linear = 0.3 * 1.0 + 0.7 * 2.0;
+  EXPECT_NEAR(score.CalcScore(&extra, model), expect + linear, 1e-4);
+}
+
+real_t partial_grad(real_t pred, real_t y) {
+  return pred - y;
+}
+
+// The fused pass should give the same model as
+// calling CalcScore() and CalcGrad() one by one.
+void CheckScoreAndGrad(Score* score_a, Score* score_b,
+                       const std::string& opt_type,
+                       index_t aux_size) {
+  SparseRow row;
+  InitRow(row);
+  Model model_a, model_b;
+  model_a.Initialize("fwfm", "squared", kNumFeat, kNumField, 10, aux_size);
+  model_b.Initialize("fwfm", "squared", kNumFeat, kNumField, 10, aux_size);
+  std::string opt = opt_type;
+  score_a->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  score_b->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt);
+  for (int n = 0; n < 3; ++n) {
+    real_t pred_a = score_a->CalcScore(&row, model_a, 0.5);
+    score_a->CalcGrad(&row, model_a, partial_grad(pred_a, 1.0), 0.5);
+    real_t pred_b = score_b->CalcScoreAndGrad(&row, model_b, 1.0,
+                                              partial_grad, 0.5);
+    EXPECT_FLOAT_EQ(pred_a, pred_b);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_v()[i],
+                    model_b.GetParameter_v()[i]);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_r(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetFieldWeight(0, 0)[i],
+                    model_b.GetFieldWeight(0, 0)[i]);
+  }
+}
+
+TEST(FwFMScoreTest, calc_score_and_grad) {
+  FwFMScore sgd_a, adagrad_a, ftrl_a, adam_a, adamw_a;
+  FwFMScoreSGD sgd_b;
+  FwFMScoreAdaGrad adagrad_b;
+  FwFMScoreFTRL ftrl_b;
+  FwFMScoreAdam adam_b;
+  FwFMScoreAdamW adamw_b;
+  CheckScoreAndGrad(&sgd_a, &sgd_b, "sgd", 1);
+  CheckScoreAndGrad(&adagrad_a, &adagrad_b, "adagrad", 2);
+  CheckScoreAndGrad(&ftrl_a, &ftrl_b, "ftrl", 3);
+  CheckScoreAndGrad(&adam_a, &adam_b, "adam", 3);
+  CheckScoreAndGrad(&adamw_a, &adamw_b, "adamw", 3);
+}
+
+// The gradient of the field weights fits the row, and
+// the weights move away from the fm model.
+TEST(FwFMScoreTest, calc_grad) {
+  SparseRow row;
+  InitRow(row);
+  Model model;
+  model.Initialize("fwfm", "squared", kNumFeat, kNumField, 4, 1, 0.5);
+  FwFMScore score;
+  std::string opt = "sgd";
+  score.Initialize(0.05, 0, 0.3, 1.0, 0.001, 0.01, opt);
+  real_t y = 3.0;
+  real_t loss = 0;
+  for (int n = 0; n < 20; ++n) {
+    real_t pred = score.CalcScore(&row, model);
+    real_t new_loss = (pred - y) * (pred - y);
+    if (n > 0) { EXPECT_LT(new_loss, loss); }
+    loss = new_loss;
+    score.CalcGrad(&row, model, pred - y);
+  }
+  EXPECT_NE(model.GetFieldWeight(0, 1)[0], 1.0);
+  EXPECT_NE(model.GetFieldWeight(2, 2)[0], 1.0);
+}
+
+} // namespace xLearn
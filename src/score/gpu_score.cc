@@ -0,0 +1,193 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the host part of the GpuScore class, and the
+device part is in gpu_score_kernel.cu.
+*/
+
+#include "src/score/gpu_score.h"
+
+namespace xLearn {
+
+#ifdef XLEARN_USE_CUDA
+// The device part (see gpu_score_kernel.cu), which only takes the
+// plain arrays, so the .cu file does not need the headers of xLearn.
+// The nodes are the 12-byte Node of the host.
+int gpu_device_count();
+void* gpu_upload(int device,
+                 const real_t* w, size_t num_w,
+                 const real_t* v, size_t num_v);
+void gpu_score(void* state,
+               int score_type,
+               uint32 num_feat,
+               uint32 num_field,
+               uint32 num_k,
+               const uint64* offset,
+               const void* node,
+               const real_t* norm,
+               size_t num_rows,
+               real_t* pred);
+void gpu_free(void* state);
+#endif
+
+// The row is nullptr if no node is added (see DMatrix::AddRow)
+static inline size_t row_size(const SparseRow* row) {
+  return row == nullptr ? 0 : row->size();
+}
+
+void PackRows(const DMatrix* matrix,
+              size_t begin,
+              size_t end,
+              bool is_norm,
+              CSRBatch* batch) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(batch);
+  CHECK_LE(begin, end);
+  CHECK_LE(end, matrix->row_length);
+  batch->offset.resize(end - begin + 1);
+  batch->norm.resize(end - begin);
+  size_t nnz = 0;
+  for (size_t i = begin; i < end; ++i) {
+    batch->offset[i-begin] = nnz;
+    nnz += row_size(matrix->row[i]);
+    batch->norm[i-begin] = is_norm ? matrix->norm[i] : 1.0;
+  }
+  batch->offset[end-begin] = nnz;
+  batch->node.resize(nnz);
+  for (size_t i = begin; i < end; ++i) {
+    const SparseRow* row = matrix->row[i];
+    if (row_size(row) > 0) {
+      memcpy(batch->node.data() + batch->offset[i-begin],
+             row->data(), row->size() * sizeof(Node));
+    }
+  }
+}
+
+GpuScore::~GpuScore() {
+  release();
+}
+
+bool GpuScore::Available() {
+#ifdef XLEARN_USE_CUDA
+  return gpu_device_count() > 0;
+#else
+  return false;
+#endif
+}
+
+// The weights are copied without the gradient cache and the padding
+// of aligned_k, so the latent vector r of fm (r = j) and ffm
+// (r = j * num_field + f) is [r * num_k, (r+1) * num_k) on the device.
+bool GpuScore::Initialize(const std::string& score_func,
+                          Model& model,
+                          int device) {
+  release();
+  if (!Available()) { return false; }
+  if (score_func.compare("linear") == 0) {
+    score_type_ = 0;
+  } else if (score_func.compare("fm") == 0) {
+    score_type_ = 1;
+  } else if (score_func.compare("ffm") == 0) {
+    score_type_ = 2;
+  } else {
+    return false;
+  }
+  if (model.IsLazy() || model.GetLatentType() != kStoreFP32 ||
+      !model.GetFieldIndex().Empty() || model.IsSplitLayout() ||
+      model.IsFieldMajor()) {
+    return false;
+  }
+  num_feat_ = model.GetNumFeature();
+  num_field_ = score_type_ == 2 ? model.GetNumField() : 0;
+  num_k_ = score_type_ == 0 ? 0 : model.GetNumK();
+  bias_ = model.GetParameter_b()[0];
+  offset_ = model.GetScoreOffset();
+  index_t aux_size = model.GetAuxiliarySize();
+  std::vector<real_t> w(num_feat_);
+  for (index_t j = 0; j < num_feat_; ++j) {
+    w[j] = model.GetParameter_w()[(offset_t)j * aux_size];
+  }
+  std::vector<real_t> v;
+  if (score_type_ > 0) {
+    offset_t num_vec = score_type_ == 1 ? num_feat_ :
+                       (offset_t)num_feat_ * num_field_;
+    offset_t align0 = (offset_t)model.get_aligned_k() * aux_size;
+    const real_t* param_v = model.GetParameter_v();
+    v.resize(num_vec * num_k_);
+    for (offset_t r = 0; r < num_vec; ++r) {
+      const real_t* src = param_v + r * align0;
+      real_t* dst = v.data() + r * num_k_;
+      for (index_t d = 0; d < num_k_; ++d) {
+        // The weights of ffm are in blocks of kAlign with their aux
+        // blocks in turn, and the ones of fm are before the aux.
+        dst[d] = score_type_ == 1 ? src[d] :
+                 src[(d - d % kAlign) * aux_size + d % kAlign];
+      }
+    }
+  }
+#ifdef XLEARN_USE_CUDA
+  device_ = gpu_upload(device, w.data(), w.size(),
+                       v.data(), v.size());
+#endif
+  return device_ != nullptr;
+}
+
+void GpuScore::Predict(const DMatrix* matrix,
+                       bool is_norm,
+                       real_t* pred) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(pred);
+  CHECK_NOTNULL(device_);
+  size_t begin = 0;
+  while (begin < matrix->row_length) {
+    // A batch has kBatchNodes nodes at most, or only one row
+    size_t end = begin;
+    size_t nnz = 0;
+    while (end < matrix->row_length &&
+           (end == begin ||
+            nnz + row_size(matrix->row[end]) <= kBatchNodes)) {
+      nnz += row_size(matrix->row[end]);
+      ++end;
+    }
+    PackRows(matrix, begin, end, is_norm, &batch_);
+    score_batch(pred + begin);
+    begin = end;
+  }
+}
+
+void GpuScore::score_batch(real_t* pred) {
+  size_t num_rows = batch_.norm.size();
+#ifdef XLEARN_USE_CUDA
+  gpu_score(device_, score_type_, num_feat_, num_field_, num_k_,
+            batch_.offset.data(), batch_.node.data(),
+            batch_.norm.data(), num_rows, pred);
+#else
+  LOG(FATAL) << "xLearn is built without CUDA.";
+#endif
+  for (size_t i = 0; i < num_rows; ++i) {
+    pred[i] += bias_ + offset_;
+  }
+}
+
+void GpuScore::release() {
+#ifdef XLEARN_USE_CUDA
+  if (device_ != nullptr) { gpu_free(device_); }
+#endif
+  device_ = nullptr;
+}
+
+}  // namespace xLearn
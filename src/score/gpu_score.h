@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the GpuScore class, which scores the batches
+of rows on a CUDA device.
+*/
+
+#ifndef XLEARN_SCORE_GPU_SCORE_H_
+#define XLEARN_SCORE_GPU_SCORE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// CSRBatch is a batch of rows in the CSR format, which is copied to the
+// device in one piece: the nodes of row i are node[offset[i], offset[i+1]),
+// and norm[i] is the norm of row i (1 without the normalization).
+//------------------------------------------------------------------------------
+struct CSRBatch {
+  std::vector<uint64> offset;
+  std::vector<Node> node;
+  std::vector<real_t> norm;
+};
+
+// Pack the rows [begin, end) of the matrix into the batch. The
+// norm of the matrix is used if is_norm is true.
+void PackRows(const DMatrix* matrix,
+              size_t begin,
+              size_t end,
+              bool is_norm,
+              CSRBatch* batch);
+
+//------------------------------------------------------------------------------
+// GpuScore keeps the weights of a linear, fm or ffm model in the memory
+// of a CUDA device without the gradient cache, and scores the rows of a
+// DMatrix in batches, in which the rows are packed in the CSR format,
+// copied to the device, and each row is scored by one thread block. The
+// predictions are the same as Loss::Predict() up to the rounding of the
+// sums, which are added in another order. It is only for prediction,
+// and the model is copied once by Initialize(), so it cannot change
+// after that. We can use it like this:
+//
+//   GpuScore gpu;
+//   if (GpuScore::Available() && gpu.Initialize("ffm", model, 0)) {
+//     gpu.Predict(matrix, true, pred.data());
+//   }
+//
+// Without XLEARN_USE_CUDA (see CMakeLists.txt), Available() is false
+// and Initialize() always fails, so the caller predicts on the CPU.
+//------------------------------------------------------------------------------
+class GpuScore {
+ public:
+  // Constructor and Destructor
+  GpuScore() { }
+  ~GpuScore();
+
+  // Return true if xLearn is built with CUDA and there is a device.
+  static bool Available();
+
+  // Copy the weights of the model to the given device. It returns
+  // false for the model that is not supported, which is fwfm, the
+  // sparse ffm, the lazy model, the compact latent factors (see
+  // Model::ConvertLatent), and the split and field-major layouts.
+  bool Initialize(const std::string& score_func, Model& model, int device);
+
+  // Return the predictions of all the rows of the matrix, where the
+  // score offset of the model is added as Loss::Predict().
+  void Predict(const DMatrix* matrix, bool is_norm, real_t* pred);
+
+  // Maximal number of nodes of a batch that is copied at once.
+  static const size_t kBatchNodes = 1 << 22;
+
+ protected:
+  /* 0 for linear, 1 for fm and 2 for ffm */
+  int score_type_ = 0;
+  index_t num_feat_ = 0;
+  index_t num_field_ = 0;
+  index_t num_k_ = 0;
+  real_t bias_ = 0;
+  real_t offset_ = 0;
+  /* The device state, which is nullptr without CUDA */
+  void* device_ = nullptr;
+  /* The batch of the host */
+  CSRBatch batch_;
+
+  // Score the packed batch on the device into pred.
+  void score_batch(real_t* pred);
+
+  // Free the device memory.
+  void release();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(GpuScore);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_GPU_SCORE_H_
@@ -0,0 +1,226 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the device part of the GpuScore class, which is only
+built with XLEARN_USE_CUDA (see gpu_score.cc for the interface).
+*/
+
+#include <cuda_runtime.h>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+#define CUDA_CHECK(call)                                     \
+  do {                                                       \
+    cudaError_t err = (call);                                \
+    CHECK(err == cudaSuccess) << cudaGetErrorString(err);    \
+  } while (0)
+
+// Same as the Node of data_structure.h
+struct GpuNode {
+  uint32 field_id;
+  uint32 feat_id;
+  float feat_val;
+};
+
+static const int kThreads = 128;
+
+struct GpuState {
+  int device = 0;
+  float* w = nullptr;
+  float* v = nullptr;
+  /* The batch buffers of the device, which grow as needed */
+  uint64* offset = nullptr;
+  GpuNode* node = nullptr;
+  float* norm = nullptr;
+  float* pred = nullptr;
+  size_t cap_rows = 0;
+  size_t cap_nodes = 0;
+};
+
+// Sum the value of each thread of the block into thread 0.
+__device__ float block_sum(float val, float* shared) {
+  shared[threadIdx.x] = val;
+  __syncthreads();
+  for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+    if (threadIdx.x < s) {
+      shared[threadIdx.x] += shared[threadIdx.x + s];
+    }
+    __syncthreads();
+  }
+  float sum = shared[0];
+  __syncthreads();
+  return sum;
+}
+
+// One block for each row. The linear term is scaled by sqrt(norm)
+// for fm and ffm as the CPU scores, and the latent term of fm is
+// 0.5 * sum_d ((sum_j v_jd x_j)^2 - sum_j (v_jd x_j)^2) with x_j
+// scaled by norm, and the one of ffm is the pairs of fields.
+__global__ void score_kernel(int score_type,
+                             uint32 num_feat,
+                             uint32 num_field,
+                             uint32 num_k,
+                             const float* w,
+                             const float* v,
+                             const uint64* offset,
+                             const GpuNode* node,
+                             const float* norm,
+                             float* pred) {
+  __shared__ float shared[kThreads];
+  uint64 row = blockIdx.x;
+  uint64 begin = offset[row];
+  uint64 end = offset[row + 1];
+  float n = norm[row];
+  float linear = 0;
+  for (uint64 i = begin + threadIdx.x; i < end; i += blockDim.x) {
+    if (node[i].feat_id < num_feat) {
+      linear += w[node[i].feat_id] * node[i].feat_val;
+    }
+  }
+  float score = block_sum(linear, shared);
+  if (score_type > 0) { score *= sqrtf(n); }
+  float latent = 0;
+  if (score_type == 1) {
+    // Thread d sums the factor d over the nodes
+    for (uint32 d = threadIdx.x; d < num_k; d += blockDim.x) {
+      float sum = 0, sq = 0;
+      for (uint64 i = begin; i < end; ++i) {
+        if (node[i].feat_id >= num_feat) { continue; }
+        float x = v[(uint64)node[i].feat_id * num_k + d] *
+                  node[i].feat_val * n;
+        sum += x;
+        sq += x * x;
+      }
+      latent += 0.5f * (sum * sum - sq);
+    }
+  } else if (score_type == 2) {
+    // The pairs (i, j) with i < j are split over the threads
+    uint64 len = end - begin;
+    for (uint64 p = threadIdx.x; p < len * len; p += blockDim.x) {
+      uint64 i = begin + p / len;
+      uint64 j = begin + p % len;
+      if (i >= j) { continue; }
+      uint32 j1 = node[i].feat_id, f1 = node[i].field_id;
+      uint32 j2 = node[j].feat_id, f2 = node[j].field_id;
+      if (j1 >= num_feat || j2 >= num_feat ||
+          f1 >= num_field || f2 >= num_field) {
+        continue;
+      }
+      const float* w1 = v + ((uint64)j1 * num_field + f2) * num_k;
+      const float* w2 = v + ((uint64)j2 * num_field + f1) * num_k;
+      float dot = 0;
+      for (uint32 d = 0; d < num_k; ++d) {
+        dot += w1[d] * w2[d];
+      }
+      latent += dot * node[i].feat_val * node[j].feat_val * n;
+    }
+  }
+  if (score_type > 0) {
+    score += block_sum(latent, shared);
+  }
+  if (threadIdx.x == 0) { pred[row] = score; }
+}
+
+int gpu_device_count() {
+  int count = 0;
+  if (cudaGetDeviceCount(&count) != cudaSuccess) {
+    cudaGetLastError();
+    return 0;
+  }
+  return count;
+}
+
+void* gpu_upload(int device,
+                 const float* w, size_t num_w,
+                 const float* v, size_t num_v) {
+  if (device < 0 || device >= gpu_device_count()) { return nullptr; }
+  CUDA_CHECK(cudaSetDevice(device));
+  GpuState* state = new GpuState;
+  state->device = device;
+  CUDA_CHECK(cudaMalloc(&state->w, (num_w + 1) * sizeof(float)));
+  CUDA_CHECK(cudaMemcpy(state->w, w, num_w * sizeof(float),
+                        cudaMemcpyHostToDevice));
+  CUDA_CHECK(cudaMalloc(&state->v, (num_v + 1) * sizeof(float)));
+  if (num_v > 0) {
+    CUDA_CHECK(cudaMemcpy(state->v, v, num_v * sizeof(float),
+                          cudaMemcpyHostToDevice));
+  }
+  return state;
+}
+
+void gpu_score(void* handle,
+               int score_type,
+               uint32 num_feat,
+               uint32 num_field,
+               uint32 num_k,
+               const uint64* offset,
+               const void* node,
+               const float* norm,
+               size_t num_rows,
+               float* pred) {
+  static_assert(sizeof(GpuNode) == 12, "GpuNode must match Node");
+  if (num_rows == 0) { return; }
+  GpuState* state = reinterpret_cast<GpuState*>(handle);
+  CUDA_CHECK(cudaSetDevice(state->device));
+  size_t num_nodes = offset[num_rows];
+  if (num_rows > state->cap_rows) {
+    cudaFree(state->offset);
+    cudaFree(state->norm);
+    cudaFree(state->pred);
+    CUDA_CHECK(cudaMalloc(&state->offset, (num_rows + 1) * sizeof(uint64)));
+    CUDA_CHECK(cudaMalloc(&state->norm, num_rows * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&state->pred, num_rows * sizeof(float)));
+    state->cap_rows = num_rows;
+  }
+  if (num_nodes > state->cap_nodes) {
+    cudaFree(state->node);
+    CUDA_CHECK(cudaMalloc(&state->node, num_nodes * sizeof(GpuNode)));
+    state->cap_nodes = num_nodes;
+  }
+  CUDA_CHECK(cudaMemcpy(state->offset, offset,
+                        (num_rows + 1) * sizeof(uint64),
+                        cudaMemcpyHostToDevice));
+  if (num_nodes > 0) {
+    CUDA_CHECK(cudaMemcpy(state->node, node, num_nodes * sizeof(GpuNode),
+                          cudaMemcpyHostToDevice));
+  }
+  CUDA_CHECK(cudaMemcpy(state->norm, norm, num_rows * sizeof(float),
+                        cudaMemcpyHostToDevice));
+  score_kernel<<<num_rows, kThreads>>>(score_type, num_feat, num_field,
+                                       num_k, state->w, state->v,
+                                       state->offset, state->node,
+                                       state->norm, state->pred);
+  CUDA_CHECK(cudaGetLastError());
+  CUDA_CHECK(cudaMemcpy(pred, state->pred, num_rows * sizeof(float),
+                        cudaMemcpyDeviceToHost));
+}
+
+void gpu_free(void* handle) {
+  GpuState* state = reinterpret_cast<GpuState*>(handle);
+  cudaSetDevice(state->device);
+  cudaFree(state->w);
+  cudaFree(state->v);
+  cudaFree(state->offset);
+  cudaFree(state->node);
+  cudaFree(state->norm);
+  cudaFree(state->pred);
+  delete state;
+}
+
+}  // namespace xLearn
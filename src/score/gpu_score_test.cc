@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the GpuScore class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/gpu_score.h"
+#include "src/score/linear_score.h"
+#include "src/score/fm_score.h"
+#include "src/score/ffm_score.h"
+
+namespace xLearn {
+
+static const index_t kNumFeat = 50;
+static const index_t kNumField = 5;
+static const index_t kNumRows = 100;
+
+// Rows of 0 to 19 nodes, where row 0 is empty
+void InitMatrix(DMatrix* matrix) {
+  for (index_t i = 0; i < kNumRows; ++i) {
+    matrix->AddRow();
+    matrix->norm[i] = 0.5;
+    for (index_t j = 0; j < i % 20; ++j) {
+      matrix->AddNode(i, (i * 7 + j * 3) % kNumFeat,
+                      0.1 + (i + j) % 7 * 0.2, j % kNumField);
+    }
+  }
+}
+
+TEST(GpuScore_Test, pack_rows) {
+  DMatrix matrix;
+  InitMatrix(&matrix);
+  CSRBatch batch;
+  PackRows(&matrix, 10, 30, true, &batch);
+  ASSERT_EQ(batch.offset.size(), 21);
+  ASSERT_EQ(batch.norm.size(), 20);
+  EXPECT_EQ(batch.offset[0], 0);
+  for (index_t i = 10; i < 30; ++i) {
+    const SparseRow* row = matrix.row[i];
+    size_t size = row == nullptr ? 0 : row->size();
+    uint64 begin = batch.offset[i-10];
+    ASSERT_EQ(batch.offset[i-9] - begin, size);
+    EXPECT_FLOAT_EQ(batch.norm[i-10], 0.5);
+    for (size_t j = 0; j < size; ++j) {
+      EXPECT_EQ(batch.node[begin+j].feat_id, (*row)[j].feat_id);
+      EXPECT_EQ(batch.node[begin+j].field_id, (*row)[j].field_id);
+      EXPECT_FLOAT_EQ(batch.node[begin+j].feat_val, (*row)[j].feat_val);
+    }
+  }
+  PackRows(&matrix, 0, 2, false, &batch);
+  EXPECT_EQ(batch.offset[1], 0);
+  EXPECT_EQ(batch.offset[2], 1);
+  EXPECT_FLOAT_EQ(batch.norm[0], 1.0);
+}
+
+void CheckPredict(const std::string& score_func, Score* score) {
+  Model model;
+  model.Initialize(score_func, "cross-entropy",
+                   kNumFeat, kNumField, 6, 2);
+  model.GetParameter_b()[0] = 0.25;
+  model.SetNegativeRate(0.5);
+  DMatrix matrix;
+  InitMatrix(&matrix);
+  GpuScore gpu;
+  if (!GpuScore::Available()) {
+    // Without CUDA the caller predicts on the CPU
+    EXPECT_FALSE(gpu.Initialize(score_func, model, 0));
+    return;
+  }
+  ASSERT_TRUE(gpu.Initialize(score_func, model, 0));
+  std::vector<real_t> pred(kNumRows);
+  gpu.Predict(&matrix, true, pred.data());
+  for (index_t i = 0; i < kNumRows; ++i) {
+    SparseRow empty(0);
+    const SparseRow* row = matrix.row[i] ? matrix.row[i] : &empty;
+    real_t expect = score->CalcScore(row, model, matrix.norm[i]) +
+                    model.GetScoreOffset();
+    EXPECT_NEAR(pred[i], expect, 1e-4);
+  }
+}
+
+TEST(GpuScore_Test, predict) {
+  LinearScore linear;
+  CheckPredict("linear", &linear);
+  FMScore fm;
+  CheckPredict("fm", &fm);
+  FFMScore ffm;
+  CheckPredict("ffm", &ffm);
+}
+
+}  // namespace xLearn
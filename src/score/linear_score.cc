@@ -27,22 +27,69 @@ namespace xLearn {
 real_t LinearScore::CalcScore(const SparseRow* row,
                               Model& model,
                               real_t norm) {
-  real_t* w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  real_t score = 0.0;
-  index_t auxiliary_size = model.GetAuxiliarySize();
-  // linear term
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature in Prediction
-    if (feat_id >= num_feat) continue;
-    index_t idx = feat_id * auxiliary_size;
-    score += w[idx] * iter->feat_val;
+  // linear term and bias
+  return linear_sum(row, model, *kernels_) + model.GetParameter_b()[0];
+}
+
+// The arrays of each thread keep their memory for the next batch
+void LinearScore::CalcScoreBatch(const SparseRow* const* rows,
+                                 size_t n,
+                                 Model& model,
+                                 const real_t* norms,
+                                 real_t* out) {
+  if (model.HasLocalLinear()) {
+    Score::CalcScoreBatch(rows, n, model, norms, out);
+    return;
   }
-  // bias
-  score += model.GetParameter_b()[0];
-  return score;
+  static thread_local std::vector<index_t> id;
+  static thread_local std::vector<real_t> x;
+  static thread_local std::vector<size_t> end;
+  id.clear();
+  x.clear();
+  end.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    for (SparseRow::const_iterator iter = rows[i]->begin();
+         iter != rows[i]->end(); ++iter) {
+      id.push_back(iter->feat_id);
+      x.push_back(iter->feat_val);
+    }
+    end[i] = id.size();
+  }
+  kernels_->linear_rows(id.data(), x.data(), end.data(), n,
+                        model.GetParameter_w(), model.GetNumFeature(),
+                        (index_t)model.GetAuxiliarySize(), out);
+  real_t bias = model.GetParameter_b()[0];
+  for (size_t i = 0; i < n; ++i) { out[i] += bias; }
+}
+
+// Keep wTx of the context
+void LinearScore::CalcContext(const SparseRow* context,
+                              Model& model,
+                              ScoreContext* ctx) {
+  ctx->linear = linear_sum(context, model, *kernels_);
+}
+
+// y = wTx of the context + wTx of the candidate
+real_t LinearScore::CalcCandidate(const ScoreContext& ctx,
+                                  const SparseRow* candidate,
+                                  Model& model,
+                                  real_t norm) {
+  return ctx.linear + linear_sum(candidate, model, *kernels_) +
+         model.GetParameter_b()[0];
+}
+
+// The gradient of w_i is pg * x_i
+real_t LinearScore::CalcScoreAndBatchGrad(const SparseRow* row,
+                                          Model& model,
+                                          real_t y,
+                                          PartialGradFunc partial_grad,
+                                          real_t norm,
+                                          GradBuffer* buf,
+                                          real_t weight) {
+  real_t pred = CalcScore(row, model, norm);
+  accumulate_linear(row, model, weight * partial_grad(pred, y), 1.0, buf);
+  buf->rows++;
+  return pred;
 }
 
 // Calculate gradient and update current model
@@ -52,124 +99,64 @@ void LinearScore::CalcGrad(const SparseRow* row,
                            real_t norm) {
   // Using sgd
   if (opt_type_.compare("sgd") == 0) {
-    this->calc_grad_sgd(row, model, pg, norm);
+    this->calc_grad<SGDOptimizer>(row, model, pg, norm);
   }
   // Using adagrad
   else if (opt_type_.compare("adagrad") == 0) {
-    this->calc_grad_adagrad(row, model, pg, norm);
+    this->calc_grad<AdaGradOptimizer>(row, model, pg, norm);
   }
   // Using ftrl
   else if (opt_type_.compare("ftrl") == 0) {
-    this->calc_grad_ftrl(row, model, pg, norm);
+    this->calc_grad<FTRLOptimizer>(row, model, pg, norm);
+  }
+  // Using ftrl of the bf16 state (see -opt_state)
+  else if (opt_type_.compare("ftrl_bf16") == 0) {
+    this->calc_grad<FTRLBF16Optimizer>(row, model, pg, norm);
+  }
+  // Using adam or adamw
+  else if (opt_type_.compare("adam") == 0 ||
+           opt_type_.compare("adamw") == 0) {
+    this->calc_grad<AdamOptimizer>(row, model, pg, norm);
   }
   else {
     LOG(FATAL) << "Unknow optimization method: " << opt_type_;
   }
 }
 
-// Calculate gradient and update current model using sgd
-void LinearScore::calc_grad_sgd(const SparseRow* row,
-                                Model& model,
-                                real_t pg,
-                                real_t norm) {
+// Calculate gradient and update current model using
+// the given optimizer policy (see optimizer.h)
+template <class Optimizer>
+void LinearScore::calc_grad(const SparseRow* row,
+                            Model& model,
+                            real_t pg,
+                            real_t norm) {
+  KernelParam param = kernel_param();
+  real_t lambda = Optimizer::Lambda(param);
   // linear term
-  real_t* w = model.GetParameter_w();
   index_t num_feat = model.GetNumFeature();
   for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
-    real_t gradient = pg * iter->feat_val;
     index_t feat_id = iter->feat_id;
     // To avoid unseen feature
     if (feat_id >= num_feat) continue;
-    gradient += regu_lambda_ * w[feat_id];
-    w[feat_id] -= (learning_rate_ * gradient);
+    real_t* wl = model.GetLinear(feat_id);
+    real_t g = lambda*wl[0]+pg*iter->feat_val;
+    Optimizer::Update(wl, g, param);
   }
   // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t g = pg;
-  wb -= learning_rate_ * g;
+  Optimizer::Update(model.GetParameter_b(), pg, param);
 }
 
-// Calculate gradient and update current model using adagrad
-void LinearScore::calc_grad_adagrad(const SparseRow* row,
-                                    Model& model,
-                                    real_t pg,
-                                    real_t norm) {
-  // linear term
-  real_t* w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t gradient = pg * iter->feat_val;
-    index_t idx_g = feat_id * 2;
-    index_t idx_c = idx_g + 1;
-    gradient += regu_lambda_ * w[idx_g];
-    w[idx_c] += (gradient * gradient);
-    w[idx_g] -= (learning_rate_ * gradient *
-                 InvSqrt(w[idx_c]));
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t g = pg;
-  wbg += g*g;
-  wb -= learning_rate_ * g * InvSqrt(wbg);
-}
-
-// Calculate gradient and update current model using ftrl
-void LinearScore::calc_grad_ftrl(const SparseRow* row,
-                                 Model& model,
-                                 real_t pg,
-                                 real_t norm) {
-  // linear term
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  index_t num_feat = model.GetNumFeature();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t feat_id = iter->feat_id;
-    // To avoid unseen feature
-    if (feat_id >= num_feat) continue;
-    real_t &wl = w[feat_id*3];
-    real_t &wlg = w[feat_id*3+1];
-    real_t &wlz = w[feat_id*3+2];
-    real_t g = lambda_2_*wl+pg*iter->feat_val*sqrt_norm; 
-    real_t old_wlg = wlg;
-    wlg += g*g;
-    real_t sigma = (sqrt(wlg)-sqrt(old_wlg)) / alpha_;
-    wlz += (g-sigma*wl);
-    int sign = wlz > 0 ? 1:-1;
-    if (sign*wlz <= lambda_1_) {
-      wl = 0;
-    } else {
-      wl = (sign*lambda_1_-wlz) / 
-           ((beta_ + sqrt(wlg)) / 
-            alpha_ + lambda_2_);
-    }
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t &wbz = w[2];
-  real_t g = pg;
-  real_t old_wbg = wbg;
-  wbg += g*g;
-  real_t sigma = (sqrt(wbg)-sqrt(old_wbg)) / alpha_;
-  wbz += (g-sigma*wb);
-  int sign = wbz > 0 ? 1:-1;
-  if (sign*wbz <= lambda_1_) {
-    wb = 0;
-  } else {
-    wb = (sign*lambda_1_-wbz) / 
-         ((beta_ + sqrt(wbg)) / 
-          alpha_ + lambda_2_);
-  }
-}
+// Instantiate the optimizers used by OptScore
+template void LinearScore::calc_grad<SGDOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void LinearScore::calc_grad<AdaGradOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void LinearScore::calc_grad<FTRLOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void LinearScore::calc_grad<FTRLBF16Optimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
+template void LinearScore::calc_grad<AdamOptimizer>(
+    const SparseRow* row, Model& model, real_t pg, real_t norm);
 
 } // namespace xLearn
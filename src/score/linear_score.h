@@ -24,6 +24,7 @@ This file defines the LinearScore class.
 #include "src/base/common.h"
 #include "src/data/model_parameters.h"
 #include "src/score/score_function.h"
+#include "src/score/optimizer.h"
 
 namespace xLearn {
 
@@ -34,7 +35,7 @@ namespace xLearn {
 class LinearScore : public Score {
  public:
   // Constructor and Destructor
-  LinearScore() { }
+  LinearScore() : kernels_(&GetBestScoreKernels()) { }
   ~LinearScore() { }
 
   // Given one example and current model, this method
@@ -43,36 +44,73 @@ class LinearScore : public Score {
                    Model& model,
                    real_t norm = 1.0);
 
-  // Calculate gradient and update current
-  // model parameters.
+  // The nodes of the rows are copied to the arrays of the ids and
+  // the values, and w of all of them is gathered by the full lanes
+  // (see LinearRowsKernel), even if the rows are short.
+  void CalcScoreBatch(const SparseRow* const* rows,
+                      size_t n,
+                      Model& model,
+                      const real_t* norms,
+                      real_t* out);
+
+  // Calculate gradient and update current model
+  // parameters. The optimizer is checked by opt_type_
+  // for each call, and OptScore does it at compile time.
   void CalcGrad(const SparseRow* row,
                 Model& model,
                 real_t pg,
                 real_t norm = 1.0);
 
+  // Add the gradient of the row to the buffer.
+  real_t CalcScoreAndBatchGrad(const SparseRow* row,
+                               Model& model,
+                               real_t y,
+                               PartialGradFunc partial_grad,
+                               real_t norm,
+                               GradBuffer* buf,
+                               real_t weight = 1.0);
+
+  // The context of a ranking request only keeps its wTx,
+  // so each candidate costs O(candidate_nnz).
+  void CalcContext(const SparseRow* context,
+                   Model& model,
+                   ScoreContext* ctx);
+  real_t CalcCandidate(const ScoreContext& ctx,
+                       const SparseRow* candidate,
+                       Model& model,
+                       real_t norm = 1.0);
+
+  // Use the linear kernel of the given table (see Score::SetKernels).
+  void SetKernels(const ScoreKernels* kernels) {
+    CHECK_NOTNULL(kernels);
+    kernels_ = kernels;
+  }
+
  protected:
-  // Calculate gradient and update model using sgd
-  void calc_grad_sgd(const SparseRow* row,
-                     Model& model,
-                     real_t pg,
-                     real_t norm = 1.0);
-
-  // Calculate gradient and update model using adagrad
-  void calc_grad_adagrad(const SparseRow* row,
-                         Model& model,
-                         real_t pg,
-                         real_t norm = 1.0);
-
-  // Calculate gradient and update model using ftrl
-  void calc_grad_ftrl(const SparseRow* row,
-                      Model& model,
-                      real_t pg,
-                      real_t norm = 1.0);
+  // SIMD kernels chosen by current CPU
+  const ScoreKernels* kernels_;
+
+  // Calculate gradient and update model by the given
+  // optimizer policy, which is defined in optimizer.h
+  template <class Optimizer>
+  void calc_grad(const SparseRow* row,
+                 Model& model,
+                 real_t pg,
+                 real_t norm = 1.0);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(LinearScore);
 };
 
+// LinearScore with the optimizer known at compile time
+typedef OptScore<LinearScore, SGDOptimizer> LinearScoreSGD;
+typedef OptScore<LinearScore, AdaGradOptimizer> LinearScoreAdaGrad;
+typedef OptScore<LinearScore, FTRLOptimizer> LinearScoreFTRL;
+typedef OptScore<LinearScore, FTRLBF16Optimizer> LinearScoreFTRLBF16;
+typedef OptScore<LinearScore, AdamOptimizer> LinearScoreAdam;
+// adamw shares the policy of adam (see AdamOptimizer)
+typedef OptScore<LinearScore, AdamOptimizer> LinearScoreAdamW;
+
 }  // namespace xLearn
 
 #endif  // XLEARN_LINEAR_SCORE_H_
@@ -90,4 +90,43 @@ TEST_F(LinearScoreTest, calc_score_overflow) {
   EXPECT_FLOAT_EQ(val, 600.0);
 }
 
+// Rows of every length from 0 to 20, whose unseen features are
+// skipped, score the same by the batch on every SIMD level.
+TEST_F(LinearScoreTest, calc_score_batch) {
+  Model model;
+  model.Initialize(param.score_func,
+                param.loss_func,
+                param.num_feature,
+                0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  index_t num_w = model.GetNumParameter_w();
+  for (index_t i = 0; i < num_w; ++i) {
+    w[i] = 0.01 * i;
+  }
+  model.GetParameter_b()[0] = 0.5;
+  std::vector<SparseRow*> rows;
+  for (index_t n = 0; n <= 20; ++n) {
+    SparseRow* row = new SparseRow(n);
+    for (index_t i = 0; i < n; ++i) {
+      (*row)[i].feat_id = (n * 7 + i * 13) % (kLength + 10);
+      (*row)[i].feat_val = 1.0 + i * 0.1;
+    }
+    rows.push_back(row);
+  }
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* kernels = GetScoreKernels(levels[l]);
+    if (kernels == nullptr) { continue; }
+    LinearScore score;
+    score.SetKernels(kernels);
+    std::vector<real_t> out(rows.size());
+    score.CalcScoreBatch(rows.data(), rows.size(), model,
+                         nullptr, out.data());
+    for (size_t i = 0; i < rows.size(); ++i) {
+      EXPECT_NEAR(out[i], score.CalcScore(rows[i], model), 1e-4);
+    }
+  }
+  for (size_t i = 0; i < rows.size(); ++i) { delete rows[i]; }
+}
+
 } // namespace xLearn
@@ -0,0 +1,215 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the optimizer policies used by the Score classes.
+*/
+
+#ifndef XLEARN_SCORE_OPTIMIZER_H_
+#define XLEARN_SCORE_OPTIMIZER_H_
+
+#include <cmath>
+#include <limits>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// An optimizer policy tells the Score class the state layout of one
+// parameter (kAuxSize), how to update a scalar parameter (the linear
+// and bias term), and which SIMD kernel updates the latent factors.
+// The policy is a template parameter, so the update is resolved at
+// compile time and can be inlined into the score loops:
+//
+//   real_t g = Optimizer::Lambda(param) * w[0] + grad;
+//   Optimizer::Update(w, g, param);
+//
+// Here w points to the parameter, followed by its aux state.
+//------------------------------------------------------------------------------
+struct SGDOptimizer {
+  static const index_t kAuxSize = 1;
+  static const char* Name() { return "sgd"; }
+  static inline real_t Lambda(const KernelParam& param) {
+    return param.regu_lambda;
+  }
+  static inline void Update(real_t* w, real_t g,
+                            const KernelParam& param) {
+    w[0] -= param.learning_rate * g;
+  }
+  static FFMGradKernel FFMKernel(const ScoreKernels& k) {
+    return k.ffm_sgd;
+  }
+  static FFMPairGradKernel FFMPairKernel(const ScoreKernels& k) {
+    return k.ffm_sgd_pairs;
+  }
+  static FMGradKernel FMKernel(const ScoreKernels& k) {
+    return k.fm_sgd;
+  }
+  static FwFMGradKernel FwFMKernel(const ScoreKernels& k) {
+    return k.fwfm_sgd;
+  }
+};
+
+// w = [w, sum of squared gradient]
+struct AdaGradOptimizer {
+  static const index_t kAuxSize = 2;
+  static const char* Name() { return "adagrad"; }
+  static inline real_t Lambda(const KernelParam& param) {
+    return param.regu_lambda;
+  }
+  static inline void Update(real_t* w, real_t g,
+                            const KernelParam& param) {
+    w[1] += g*g;
+    w[0] -= param.learning_rate * g * InvSqrt(w[1]);
+  }
+  static FFMGradKernel FFMKernel(const ScoreKernels& k) {
+    return k.ffm_adagrad;
+  }
+  static FFMPairGradKernel FFMPairKernel(const ScoreKernels& k) {
+    return k.ffm_adagrad_pairs;
+  }
+  static FMGradKernel FMKernel(const ScoreKernels& k) {
+    return k.fm_adagrad;
+  }
+  static FwFMGradKernel FwFMKernel(const ScoreKernels& k) {
+    return k.fwfm_adagrad;
+  }
+};
+
+// w = [w, sum of squared gradient, z]
+struct FTRLOptimizer {
+  static const index_t kAuxSize = 3;
+  static const char* Name() { return "ftrl"; }
+  static inline real_t Lambda(const KernelParam& param) {
+    return param.lambda_2;
+  }
+  static inline void Update(real_t* w, real_t g,
+                            const KernelParam& param) {
+    real_t &wl = w[0];
+    real_t &wlg = w[1];
+    real_t &wlz = w[2];
+    real_t old_wlg = wlg;
+    wlg += g*g;
+    real_t sigma = (sqrt(wlg)-sqrt(old_wlg)) / param.alpha;
+    wlz += (g-sigma*wl);
+    int sign = wlz > 0 ? 1:-1;
+    if (sign*wlz <= param.lambda_1) {
+      wl = 0;
+    } else {
+      wl = (sign*param.lambda_1-wlz) /
+           ((param.beta + sqrt(wlg)) /
+            param.alpha + param.lambda_2);
+    }
+  }
+  static FFMGradKernel FFMKernel(const ScoreKernels& k) {
+    return k.ffm_ftrl;
+  }
+  static FFMPairGradKernel FFMPairKernel(const ScoreKernels& k) {
+    return k.ffm_ftrl_pairs;
+  }
+  static FMGradKernel FMKernel(const ScoreKernels& k) {
+    return k.fm_ftrl;
+  }
+  static FwFMGradKernel FwFMKernel(const ScoreKernels& k) {
+    return k.fwfm_ftrl;
+  }
+};
+
+// w = [w, (sum of squared gradient, z) in two bf16], which is the
+// ftrl of -opt_state bf16: the aux values are a third of the model
+// less than FTRLOptimizer. z of a nonzero w is given by w itself,
+// so only z of zero w is kept (see ftrl_bf16_update).
+struct FTRLBF16Optimizer {
+  static const index_t kAuxSize = 2;
+  static const char* Name() { return "ftrl_bf16"; }
+  static inline real_t Lambda(const KernelParam& param) {
+    return param.lambda_2;
+  }
+  static inline void Update(real_t* w, real_t g,
+                            const KernelParam& param) {
+    real_t &wl = w[0];
+    real_t wlg = LowBF16(w[1]);
+    real_t wlz = HighBF16(w[1]);
+    real_t sqrt_old = sqrt(wlg);
+    if (std::fabs(wlz) < std::numeric_limits<real_t>::min() && wl != 0) {
+      real_t den = (param.beta + sqrt_old) / param.alpha + param.lambda_2;
+      wlz = -((wl > 0 ? param.lambda_1 : -param.lambda_1) + wl * den);
+    }
+    uint32 seed = float_bits(g);
+    wlg = RoundBF16(wlg + g*g, seed);
+    real_t sigma = (sqrt(wlg)-sqrt_old) / param.alpha;
+    wlz += (g-sigma*wl);
+    int sign = wlz > 0 ? 1:-1;
+    if (sign*wlz <= param.lambda_1) {
+      wl = 0;
+      w[1] = PackBF16(wlg, RoundBF16(wlz, seed));
+    } else {
+      wl = (sign*param.lambda_1-wlz) /
+           ((param.beta + sqrt(wlg)) /
+            param.alpha + param.lambda_2);
+      w[1] = PackBF16(wlg, 0);
+    }
+  }
+  static FFMGradKernel FFMKernel(const ScoreKernels& k) {
+    return k.ffm_ftrl_bf16;
+  }
+  static FFMPairGradKernel FFMPairKernel(const ScoreKernels& k) {
+    return k.ffm_ftrl_bf16_pairs;
+  }
+  static FMGradKernel FMKernel(const ScoreKernels& k) {
+    return k.fm_ftrl_bf16;
+  }
+  static FwFMGradKernel FwFMKernel(const ScoreKernels& k) {
+    return k.fwfm_ftrl_bf16;
+  }
+};
+
+// w = [w, first moment, second moment]. Both adam and adamw use
+// this policy: for adamw, Score::kernel_param() moves the L2 term
+// (regu_lambda) into the decoupled weight_decay.
+struct AdamOptimizer {
+  static const index_t kAuxSize = 3;
+  static const char* Name() { return "adam"; }
+  static inline real_t Lambda(const KernelParam& param) {
+    return param.regu_lambda;
+  }
+  static inline void Update(real_t* w, real_t g,
+                            const KernelParam& param) {
+    w[1] = param.beta_1 * w[1] + (1 - param.beta_1) * g;
+    w[2] = param.beta_2 * w[2] + (1 - param.beta_2) * g * g;
+    w[0] -= param.step_size * w[1] / (sqrt(w[2]) + param.epsilon) +
+            param.weight_decay * w[0];
+  }
+  static FFMGradKernel FFMKernel(const ScoreKernels& k) {
+    return k.ffm_adam;
+  }
+  static FFMPairGradKernel FFMPairKernel(const ScoreKernels& k) {
+    return k.ffm_adam_pairs;
+  }
+  static FMGradKernel FMKernel(const ScoreKernels& k) {
+    return k.fm_adam;
+  }
+  static FwFMGradKernel FwFMKernel(const ScoreKernels& k) {
+    return k.fwfm_adam;
+  }
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_OPTIMIZER_H_
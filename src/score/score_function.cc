@@ -19,12 +19,106 @@ This file is the implementation of the base Score class.
 */
 
 #include "src/score/score_function.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "src/base/scratch_buffer.h"
 #include "src/score/linear_score.h"
 #include "src/score/fm_score.h"
 #include "src/score/ffm_score.h"
+#include "src/score/fwfm_score.h"
+#include "src/score/optimizer.h"
 
 namespace xLearn {
 
+// The nodes of current row grouped by field, and the
+// counters of the bucket sort, which are owned by each thread.
+static thread_local ScratchBuffer<Node> field_buffer;
+static thread_local ScratchBuffer<index_t> count_buffer;
+
+// Beyond this number of field, the counters cost more
+// than the sort itself, so we use std::sort instead.
+static const index_t kMaxBucketField = 1024;
+
+// The row is returned as it is if it has already been sorted.
+const Node* Score::group_by_field(const SparseRow& row,
+                                  index_t num_field,
+                                  const Node** end) {
+  const Node* begin = row.data();
+  size_t nnz = row.size();
+  *end = begin + nnz;
+  bool sorted = true;
+  for (size_t i = 1; i < nnz; ++i) {
+    if (begin[i].field_id < begin[i-1].field_id) {
+      sorted = false;
+      break;
+    }
+  }
+  if (sorted) { return begin; }
+  Node* nodes = field_buffer.Get(nnz);
+  if (num_field > kMaxBucketField) {
+    memcpy(nodes, begin, nnz * sizeof(Node));
+    std::stable_sort(nodes, nodes + nnz,
+      [](const Node& a, const Node& b) {
+        return a.field_id < b.field_id;
+    });
+  } else {
+    // Bucket sort, and the unseen fields go to the last bucket
+    index_t* count = count_buffer.GetZero(num_field + 2);
+    for (size_t i = 0; i < nnz; ++i) {
+      index_t f = std::min(begin[i].field_id, num_field);
+      count[f+1]++;
+    }
+    // Now count[f] is the start of the bucket f
+    for (index_t f = 1; f < num_field + 2; ++f) {
+      count[f] += count[f-1];
+    }
+    for (size_t i = 0; i < nnz; ++i) {
+      index_t f = std::min(begin[i].field_id, num_field);
+      nodes[count[f]++] = begin[i];
+    }
+  }
+  *end = nodes + nnz;
+  return nodes;
+}
+
+// The row of the context plus the candidate
+static thread_local SparseRow candidate_row;
+
+// Score the whole row of the context plus the candidate
+real_t Score::CalcCandidate(const ScoreContext& ctx,
+                            const SparseRow* candidate,
+                            Model& model,
+                            real_t norm) {
+  candidate_row = ctx.row;
+  for (SparseRow::const_iterator iter = candidate->begin();
+       iter != candidate->end(); ++iter) {
+    candidate_row.push_back(*iter);
+  }
+  return CalcScore(&candidate_row, model, norm);
+}
+
+// Update the model by the buffer with the optimizer of opt_type_
+void Score::ApplyGrad(Model& model, GradBuffer* buf) {
+  CHECK_NOTNULL(buf);
+  if (opt_type_.compare("sgd") == 0) {
+    update_batch<SGDOptimizer>(model, buf);
+  } else if (opt_type_.compare("adagrad") == 0) {
+    update_batch<AdaGradOptimizer>(model, buf);
+  } else if (opt_type_.compare("ftrl") == 0) {
+    update_batch<FTRLOptimizer>(model, buf);
+  } else if (opt_type_.compare("ftrl_bf16") == 0) {
+    update_batch<FTRLBF16Optimizer>(model, buf);
+  } else if (opt_type_.compare("adam") == 0 ||
+             opt_type_.compare("adamw") == 0) {
+    update_batch<AdamOptimizer>(model, buf);
+  } else {
+    LOG(FATAL) << "Unknow optimization method: " << opt_type_;
+  }
+}
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -32,5 +126,30 @@ CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_score_registry, Score);
 REGISTER_SCORE("linear", LinearScore);
 REGISTER_SCORE("fm", FMScore);
 REGISTER_SCORE("ffm", FFMScore);
+REGISTER_SCORE("fwfm", FwFMScore);
+REGISTER_SCORE("linear_sgd", LinearScoreSGD);
+REGISTER_SCORE("linear_adagrad", LinearScoreAdaGrad);
+REGISTER_SCORE("linear_ftrl", LinearScoreFTRL);
+REGISTER_SCORE("linear_ftrl_bf16", LinearScoreFTRLBF16);
+REGISTER_SCORE("linear_adam", LinearScoreAdam);
+REGISTER_SCORE("linear_adamw", LinearScoreAdamW);
+REGISTER_SCORE("fm_sgd", FMScoreSGD);
+REGISTER_SCORE("fm_adagrad", FMScoreAdaGrad);
+REGISTER_SCORE("fm_ftrl", FMScoreFTRL);
+REGISTER_SCORE("fm_ftrl_bf16", FMScoreFTRLBF16);
+REGISTER_SCORE("fm_adam", FMScoreAdam);
+REGISTER_SCORE("fm_adamw", FMScoreAdamW);
+REGISTER_SCORE("ffm_sgd", FFMScoreSGD);
+REGISTER_SCORE("ffm_adagrad", FFMScoreAdaGrad);
+REGISTER_SCORE("ffm_ftrl", FFMScoreFTRL);
+REGISTER_SCORE("ffm_ftrl_bf16", FFMScoreFTRLBF16);
+REGISTER_SCORE("ffm_adam", FFMScoreAdam);
+REGISTER_SCORE("ffm_adamw", FFMScoreAdamW);
+REGISTER_SCORE("fwfm_sgd", FwFMScoreSGD);
+REGISTER_SCORE("fwfm_adagrad", FwFMScoreAdaGrad);
+REGISTER_SCORE("fwfm_ftrl", FwFMScoreFTRL);
+REGISTER_SCORE("fwfm_ftrl_bf16", FwFMScoreFTRLBF16);
+REGISTER_SCORE("fwfm_adam", FwFMScoreAdam);
+REGISTER_SCORE("fwfm_adamw", FwFMScoreAdamW);
 
 }  // namespace xLearn
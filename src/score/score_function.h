@@ -22,16 +22,119 @@ FM score, FFM score, and etc.
 #ifndef XLEARN_LOSS_SCORE_FUNCTION_H_
 #define XLEARN_LOSS_SCORE_FUNCTION_H_
 
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
 #include <vector>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
+#include "src/base/thread_pool.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 #include "src/data/model_parameters.h"
+#include "src/score/score_kernel.h"
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// Given the score and the label, return the partial gradient
+// of the loss function. See CalcScoreAndGrad() for details.
+//------------------------------------------------------------------------------
+typedef real_t (*PartialGradFunc)(real_t pred, real_t y);
+
+// Added to the square root of the second moment of adam.
+const real_t kAdamEpsilon = 1e-8;
+
+//------------------------------------------------------------------------------
+// ScoreContext keeps the part of the score that only depends on the
+// context features of a ranking request (e.g., the user and the page),
+// which are the same for all of its candidates (e.g., the items). The
+// score function fills it once by CalcContext(), and then each candidate
+// is scored by CalcCandidate() as one row of the context features plus
+// the candidate features, without walking the context again.
+//------------------------------------------------------------------------------
+struct ScoreContext {
+  ScoreContext() : linear(0), latent(0) { }
+  /* The context features */
+  SparseRow row;
+  /* sum(w_i * x_i) of the context */
+  real_t linear;
+  /* The latent part of the context pairs with norm = 1 */
+  real_t latent;
+  /* fm: sum(V_i * x_i) of the context (aligned_k values)
+     ffm: sum(V_j_f * x_j) of the context nodes j in each of the
+     fields, for each target field f (fields * num_field * aligned_k) */
+  std::vector<real_t> sum;
+  /* ffm: the distinct fields of the context */
+  std::vector<index_t> fields;
+};
+
+//------------------------------------------------------------------------------
+// GradBuffer keeps the gradients of a mini-batch of rows of one thread
+// (see Score::CalcScoreAndBatchGrad), in which the gradients of the same
+// parameter are summed, and then Score::ApplyGrad() updates each of them
+// once. The linear term is keyed by its feature, and a latent vector by
+// its offset in param_v_, so fm and the layouts of ffm share it. The L2
+// term is not in the buffer, which is added by ApplyGrad().
+//------------------------------------------------------------------------------
+struct GradBuffer {
+  /* Number of rows in the buffer */
+  index_t rows = 0;
+  /* Gradient of the bias */
+  real_t bias = 0;
+  /* Features of the linear term, and their gradients */
+  std::vector<index_t> feat;
+  std::vector<real_t> grad_w;
+  /* Offsets of the latent vectors, and their gradients,
+  which are aligned_k values for each offset */
+  std::vector<offset_t> pos;
+  std::vector<real_t> grad_v;
+  /* Index of each feature in feat, and of each offset in pos */
+  std::unordered_map<index_t, index_t> feat_index;
+  std::unordered_map<offset_t, index_t> pos_index;
+  /* If the bias is updated by the buffer, which is false for
+  the owners of the features but the first (see OwnerRoute) */
+  bool has_bias = true;
+  /* The adam step of the update, which the owners of a round share
+  (see Score::NextStep), or 0 for a new step */
+  uint64 step = 0;
+
+  // Return the gradient of the linear term of feature j.
+  real_t& Linear(index_t j) {
+    auto it = feat_index.emplace(j, (index_t)feat.size());
+    if (it.second) {
+      feat.push_back(j);
+      grad_w.push_back(0);
+    }
+    return grad_w[it.first->second];
+  }
+
+  // Return the gradient of the latent vector at the offset, which
+  // is valid until the next call, since grad_v may be moved.
+  real_t* Latent(offset_t offset, index_t aligned_k) {
+    auto it = pos_index.emplace(offset, (index_t)pos.size());
+    if (it.second) {
+      pos.push_back(offset);
+      grad_v.resize(grad_v.size() + aligned_k, 0);
+    }
+    return grad_v.data() + (size_t)it.first->second * aligned_k;
+  }
+
+  // Remove all the gradients.
+  void Clear() {
+    rows = 0;
+    bias = 0;
+    step = 0;
+    feat.clear();
+    grad_w.clear();
+    pos.clear();
+    grad_v.clear();
+    feat_index.clear();
+    pos_index.clear();
+  }
+};
+
 //------------------------------------------------------------------------------
 // Score is an abstract class, which can be implemented by different
 // score functions such as LinearScore (liner_score.h), FMScore (fm_score.h)
@@ -51,13 +154,16 @@ class Score {
   virtual ~Score() { }
 
   // Invoke this function before we use this class.
+  // The beta_1 and beta_2 are only used by adam and adamw.
   virtual void Initialize(real_t learning_rate,
                           real_t regu_lambda,
                           real_t alpha,
                           real_t beta,
                           real_t lambda_1,
                           real_t lambda_2,
-                          std::string& opt_type) {
+                          std::string& opt_type,
+                          real_t beta_1 = 0.9,
+                          real_t beta_2 = 0.999) {
     learning_rate_ = learning_rate;
     regu_lambda_ = regu_lambda;
     alpha_ = alpha;
@@ -65,6 +171,11 @@ class Score {
     lambda_1_ = lambda_1;
     lambda_2_ = lambda_2;
     opt_type_ = opt_type;
+    beta_1_ = beta_1;
+    beta_2_ = beta_2;
+    is_adamw_ = opt_type == "adamw";
+    is_adam_ = opt_type == "adam" || is_adamw_;
+    num_step_ = 0;
   }
 
   // Given one example and current model, this method
@@ -73,6 +184,22 @@ class Score {
                            Model& model,
                            real_t norm = 1.0) = 0;
 
+  // Score the n rows into out, where the norm of the i-th row is
+  // norms[i] (or 1.0 if norms is nullptr). The scores are the ones of
+  // CalcScore(), up to the order of the sums, and the score function
+  // can override it to work across the rows of the batch. By default,
+  // each row is scored by CalcScore().
+  virtual void CalcScoreBatch(const SparseRow* const* rows,
+                              size_t n,
+                              Model& model,
+                              const real_t* norms,
+                              real_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = CalcScore(rows[i], model,
+                         norms == nullptr ? 1.0 : norms[i]);
+    }
+  }
+
   // Calculate gradient and update current
   // model parameters
   virtual void CalcGrad(const SparseRow* row,
@@ -80,7 +207,365 @@ class Score {
                         real_t pg,
                         real_t norm = 1.0) = 0;
 
+  // Calculate the score, then calculate gradient and update
+  // current model parameters, in which the partial gradient is
+  // given by partial_grad(score, y). Return the score.
+  // Score function can override it to fuse the two passes.
+  virtual real_t CalcScoreAndGrad(const SparseRow* row,
+                                  Model& model,
+                                  real_t y,
+                                  PartialGradFunc partial_grad,
+                                  real_t norm = 1.0) {
+    real_t pred = CalcScore(row, model, norm);
+    CalcGrad(row, model, partial_grad(pred, y), norm);
+    return pred;
+  }
+
+  // Calculate the score as CalcScoreAndGrad(), but the gradient of
+  // the row is added to the buffer of current thread instead of the
+  // model, which is updated by ApplyGrad() once for the mini-batch.
+  // The score is computed on the model before the update of the batch,
+  // and the partial gradient is scaled by the weight of the row (see
+  // RowLoss). The score function without it updates the model right
+  // away, and the buffer is left unchanged.
+  virtual real_t CalcScoreAndBatchGrad(const SparseRow* row,
+                                       Model& model,
+                                       real_t y,
+                                       PartialGradFunc partial_grad,
+                                       real_t norm,
+                                       GradBuffer* buf,
+                                       real_t weight = 1.0) {
+    if (weight != 1.0) {
+      real_t pred = CalcScore(row, model, norm);
+      CalcGrad(row, model, weight * partial_grad(pred, y), norm);
+      return pred;
+    }
+    return CalcScoreAndGrad(row, model, y, partial_grad, norm);
+  }
+
+  // Update each parameter of the buffer once by its summed gradient
+  // and the L2 term, and then clear the buffer. The optimizer is
+  // checked by opt_type_, and OptScore does it at compile time.
+  virtual void ApplyGrad(Model& model, GradBuffer* buf);
+
+  // Take a new adam step of the bias correction and return it, which
+  // the buffers of one update share (see GradBuffer::step). It is 0
+  // for the other optimizers.
+  uint64 NextStep() {
+    if (!is_adam_) { return 0; }
+    return num_step_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // Use the SIMD kernels of the given table instead of the best one
+  // of current CPU, e.g., to compare the instruction sets. It is
+  // ignored by the score function without the kernels.
+  virtual void SetKernels(const ScoreKernels* kernels) { }
+
+  // Pool the nodes of each of the given fields of a row into one bag,
+  // whose latent vectors are summed (or averaged if mean is true)
+  // before the pairs, and the nodes of a bag have no pairs with each
+  // other (see FFMScore). It is ignored by the score function without
+  // the fields, and the same bags are given to the prediction.
+  virtual void SetBagFields(const std::vector<index_t>& fields,
+                            bool mean) { }
+
+  // The rows of at least min_nnz nodes are scored and updated by the
+  // threads of the pool instead of current thread, in which each thread
+  // takes a block of the pair loop (see FFMScore). It is ignored by the
+  // score function without the pair loop. 0 disables it.
+  void SetLongRow(ThreadPool* pool, size_t min_nnz) {
+    long_pool_ = min_nnz > 0 ? pool : nullptr;
+    long_row_ = min_nnz;
+  }
+
+  // The rows of at least min_nnz nodes are trained on a sample of
+  // num_pair * nnz of their pairs instead of all nnz * (nnz - 1) / 2,
+  // each weighted by the ratio of the two, at O(nnz) cost (see
+  // FFMScore). The sampled score is an unbiased estimate of the exact
+  // one, but its partial gradient is not, as the loss is nonlinear in
+  // the score. The prediction and the weighted rows are exact. It is
+  // ignored by the score function without the pair loop, and takes the
+  // rows from SetLongRow(). 0 disables it.
+  void SetPairSample(size_t min_nnz, size_t num_pair) {
+    sample_row_ = min_nnz;
+    sample_pair_ = num_pair;
+  }
+
+  // Issue the software prefetch for the model parameters that
+  // will be used by the row. The loss function calls it some rows
+  // ahead (see Loss::Initialize), so that the random lookups of
+  // param_w_ and param_v_ hit the cache. It never changes the model.
+  virtual void Prefetch(const SparseRow* row, Model& model) {
+    prefetch_linear(row, model);
+  }
+
+  // Compute the part of the score of the context features, which
+  // is shared by all the candidates (see ScoreContext). By default,
+  // only the context row is kept, and CalcCandidate() scores the
+  // whole row. The score function can override both of them.
+  virtual void CalcContext(const SparseRow* context,
+                           Model& model,
+                           ScoreContext* ctx) {
+    ctx->row = *context;
+  }
+
+  // Return the same score as CalcScore() of the row of the context
+  // features plus the candidate features, and the norm is the one
+  // of that row. It is thread-safe like CalcScore().
+  virtual real_t CalcCandidate(const ScoreContext& ctx,
+                               const SparseRow* candidate,
+                               Model& model,
+                               real_t norm = 1.0);
+
  protected:
+  // The default CalcScoreAndGrad() used by OptScore, which can be
+  // hidden by the score function that is able to fuse the passes.
+  template <class Optimizer>
+  real_t calc_score_and_grad(const SparseRow* row,
+                             Model& model,
+                             real_t y,
+                             PartialGradFunc partial_grad,
+                             real_t norm) {
+    return Score::CalcScoreAndGrad(row, model, y, partial_grad, norm);
+  }
+
+  // Hyper-parameters passed to the SIMD kernels, which is called
+  // once for each update. For adam, each call is a new step of the
+  // bias correction, which is counted over all the threads, unless
+  // the step of a shared update is given (see NextStep).
+  KernelParam kernel_param(uint64 step = 0) {
+    KernelParam param;
+    param.learning_rate = learning_rate_;
+    param.regu_lambda = regu_lambda_;
+    param.alpha = alpha_;
+    param.beta = beta_;
+    param.lambda_1 = lambda_1_;
+    param.lambda_2 = lambda_2_;
+    param.beta_1 = beta_1_;
+    param.beta_2 = beta_2_;
+    param.epsilon = kAdamEpsilon;
+    param.step_size = learning_rate_;
+    param.weight_decay = 0;
+    if (is_adam_) {
+      uint64 t = step > 0 ? step : NextStep();
+      param.step_size = learning_rate_ *
+                        sqrt(1 - pow(beta_2_, (double)t)) /
+                        (1 - pow(beta_1_, (double)t));
+      // adamw decays w directly instead of adding it to the gradient
+      if (is_adamw_) {
+        param.weight_decay = learning_rate_ * regu_lambda_;
+        param.regu_lambda = 0;
+      }
+    }
+    return param;
+  }
+
+  // Return sum(w_i * x_i) of the row without the bias by the linear
+  // kernel, unless the hot features of current thread have their own
+  // copies of w (see Model::GetLinear).
+  static real_t linear_sum(const SparseRow* row,
+                           Model& model,
+                           const ScoreKernels& kernels) {
+    index_t num_feat = model.GetNumFeature();
+    if (!model.HasLocalLinear()) {
+      return kernels.linear(row->begin(), row->end(),
+                            model.GetParameter_w(), num_feat,
+                            (index_t)model.GetAuxiliarySize());
+    }
+    real_t sum_w = 0;
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      if (iter->feat_id >= num_feat) continue;
+      sum_w += iter->feat_val * model.GetLinear(iter->feat_id)[0];
+    }
+    return sum_w;
+  }
+
+  // Linear term and bias term of fm and ffm, in which
+  // the feature value is scaled by sqrt(norm).
+  static real_t linear_score(const SparseRow* row,
+                             Model& model,
+                             real_t norm,
+                             const ScoreKernels& kernels) {
+    return linear_sum(row, model, kernels) * sqrt(norm) +
+           model.GetParameter_b()[0];
+  }
+
+  // Update the linear term and bias term of fm
+  // and ffm using the optimizer (optimizer.h).
+  template <class Optimizer>
+  static void update_linear(const SparseRow* row,
+                            Model& model,
+                            const KernelParam& param,
+                            real_t pg,
+                            real_t norm) {
+    real_t lambda = Optimizer::Lambda(param);
+    real_t sqrt_norm = sqrt(norm);
+    index_t num_feat = model.GetNumFeature();
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      index_t feat_id = iter->feat_id;
+      // To avoid unseen feature
+      if (feat_id >= num_feat) continue;
+      real_t* wl = model.GetLinear(feat_id);
+      real_t g = lambda*wl[0]+pg*iter->feat_val*sqrt_norm;
+      Optimizer::Update(wl, g, param);
+    }
+    // bias
+    Optimizer::Update(model.GetParameter_b(), pg, param);
+  }
+
+  // Add the gradient of the linear term and bias term to the buffer,
+  // in which the feature value is scaled by scale, e.g., sqrt(norm)
+  // for fm and ffm as update_linear().
+  static void accumulate_linear(const SparseRow* row,
+                                Model& model,
+                                real_t pg,
+                                real_t scale,
+                                GradBuffer* buf) {
+    index_t num_feat = model.GetNumFeature();
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      if (iter->feat_id >= num_feat) continue;
+      buf->Linear(iter->feat_id) += pg * iter->feat_val * scale;
+    }
+    buf->bias += pg;
+  }
+
+  // Layout of the latent vectors of training: the weights of a vector
+  // are in blocks of kAlign values, which are stride values apart, and
+  // the a-th aux of a weight is at a * gap after it. By default, it is
+  // the layout of fm, where the aux vectors are aligned_k values after
+  // the weights.
+  virtual void latent_layout(Model& model,
+                             offset_t* stride,
+                             offset_t* gap) {
+    *stride = kAlign;
+    *gap = model.get_aligned_k();
+  }
+
+  // Update the model by the buffer using the optimizer (optimizer.h),
+  // in which the L2 term of a parameter is added once for the batch.
+  template <class Optimizer>
+  void update_batch(Model& model, GradBuffer* buf) {
+    if (buf->rows == 0) { return; }
+    KernelParam param = kernel_param(buf->step);
+    real_t lambda = Optimizer::Lambda(param);
+    for (size_t i = 0; i < buf->feat.size(); ++i) {
+      real_t* wl = model.GetLinear(buf->feat[i]);
+      Optimizer::Update(wl, lambda*wl[0]+buf->grad_w[i], param);
+    }
+    if (buf->has_bias) {
+      Optimizer::Update(model.GetParameter_b(), buf->bias, param);
+    }
+    if (!buf->pos.empty()) {
+      index_t aligned_k = model.get_aligned_k();
+      offset_t stride = 0, gap = 0;
+      latent_layout(model, &stride, &gap);
+      real_t* v = model.GetParameter_v();
+      for (size_t i = 0; i < buf->pos.size(); ++i) {
+        update_latent<Optimizer>(v + buf->pos[i],
+                                 buf->grad_v.data() + i * aligned_k,
+                                 aligned_k, stride, gap, lambda, param);
+      }
+    }
+    buf->Clear();
+  }
+
+  // Update the latent vector at w (see latent_layout) by the gradient
+  // of its aligned_k values and the L2 term of lambda.
+  template <class Optimizer>
+  static void update_latent(real_t* w,
+                            const real_t* g,
+                            index_t aligned_k,
+                            offset_t stride,
+                            offset_t gap,
+                            real_t lambda,
+                            const KernelParam& param) {
+    // The weight and its aux are gathered for Optimizer::Update()
+    real_t aux[Optimizer::kAuxSize];
+    for (index_t d = 0; d < aligned_k; ++d) {
+      real_t* p = w + (d / kAlign) * stride + d % kAlign;
+      for (index_t a = 0; a < Optimizer::kAuxSize; ++a) {
+        aux[a] = p[a * gap];
+      }
+      Optimizer::Update(aux, lambda*aux[0]+g[d], param);
+      for (index_t a = 0; a < Optimizer::kAuxSize; ++a) {
+        p[a * gap] = aux[a];
+      }
+    }
+  }
+
+  // Prefetch the linear term of each feature in the row.
+  static void prefetch_linear(const SparseRow* row, Model& model) {
+    const real_t* w = model.GetParameter_w();
+    index_t num_feat = model.GetNumFeature();
+    index_t aux_size = model.GetAuxiliarySize();
+    for (SparseRow::const_iterator iter = row->begin();
+         iter != row->end(); ++iter) {
+      if (iter->feat_id >= num_feat) continue;
+      XLEARN_PREFETCH(w + (offset_t)iter->feat_id * aux_size);
+    }
+  }
+
+  // Prefetch the latent vector at the given offset (in number
+  // of values) of param_v_, or of the compact latent factors
+  // after Model::ConvertLatent(). Only the weights are fetched,
+  // which are the first aligned_k values of the vector.
+  static void prefetch_latent(Model& model, size_t offset) {
+    const char* p = nullptr;
+    size_t value_size = sizeof(real_t);
+    switch (model.GetLatentType()) {
+      case kStoreFP16:
+      case kStoreBF16:
+        p = (const char*)model.GetParameter_v_half();
+        value_size = sizeof(uint16);
+        break;
+      case kStoreInt8:
+        p = (const char*)model.GetParameter_v_int8();
+        value_size = sizeof(int8);
+        XLEARN_PREFETCH(model.GetParameter_v_scale() +
+                        offset / model.get_aligned_k());
+        break;
+      default:
+        p = (const char*)model.GetParameter_v();
+        break;
+    }
+    p += offset * value_size;
+    size_t bytes = model.get_aligned_k() * value_size;
+    for (size_t b = 0; b < bytes; b += kAlignByte) {
+      XLEARN_PREFETCH(p + b);
+    }
+  }
+
+  // Group the nodes of the row by field_id, and return the range of
+  // the grouped nodes, where the fields not less than num_field are
+  // at the end. Then for each i the pair loop of ffm walks V_i_fj in
+  // the order of field, which is contiguous in param_v_, and the
+  // hardware prefetcher and TLB get along with it much better, and
+  // fwfm sums each field in one run. Note that the score does not
+  // depend on the order of nodes. The grouped nodes are in a buffer
+  // of current thread, which is reused by the next call.
+  static const Node* group_by_field(const SparseRow& row,
+                                    index_t num_field,
+                                    const Node** end);
+
+  // Layout of the latent factors passed to the SIMD kernels.
+  static KernelShape kernel_shape(Model& model) {
+    KernelShape shape;
+    shape.num_feat = model.GetNumFeature();
+    shape.num_field = model.GetNumField();
+    shape.aligned_k = model.get_aligned_k();
+    // The compact latent factors have no gradient cache
+    shape.aux_size = model.GetLatentType() == kStoreFP32 ?
+                     model.GetAuxiliarySize() : 1;
+    shape.split = model.IsSplitLayout() && shape.aux_size > 1;
+    shape.field_major = model.IsFieldMajor() &&
+                        model.GetLatentType() == kStoreFP32;
+    shape.var_k = model.GetFieldIndex().HasWidths();
+    return shape;
+  }
+
   real_t learning_rate_;
   real_t regu_lambda_;
   real_t alpha_;
@@ -88,11 +573,76 @@ class Score {
   real_t lambda_1_;
   real_t lambda_2_;
   std::string opt_type_;
+  real_t beta_1_ = 0.9;
+  real_t beta_2_ = 0.999;
+  bool is_adam_ = false;
+  bool is_adamw_ = false;
+  /* Number of adam steps for the bias correction */
+  std::atomic<uint64> num_step_{0};
+  /* The pool and the nnz of the long rows (see SetLongRow) */
+  ThreadPool* long_pool_ = nullptr;
+  size_t long_row_ = 0;
+  /* The nnz of the sampled rows and the pairs per node (see
+     SetPairSample) */
+  size_t sample_row_ = 0;
+  size_t sample_pair_ = 0;
+
+  // The number of pairs sampled for a row of nnz nodes, which is 0
+  // if the row is not sampled, or if the sample has all its pairs.
+  size_t sample_size(size_t nnz) const {
+    if (sample_row_ == 0 || nnz < sample_row_) { return 0; }
+    size_t num_sample = sample_pair_ * nnz;
+    return num_sample < nnz * (nnz - 1) / 2 ? num_sample : 0;
+  }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Score);
 };
 
+//------------------------------------------------------------------------------
+// OptScore binds a score function with an optimizer policy (optimizer.h)
+// at compile time, so that CalcGrad() does not check the optimizer for
+// each row, and the update can be inlined into the score loops. The
+// ScoreFunc needs to implement the calc_grad<Optimizer>() method.
+// We register them by the name "score_optimizer", for example:
+//
+//  Score* score = CREATE_SCORE("ffm_adagrad");
+//------------------------------------------------------------------------------
+template <class ScoreFunc, class Optimizer>
+class OptScore : public ScoreFunc {
+ public:
+  // Constructor and Destructor
+  OptScore() { }
+  ~OptScore() { }
+
+  // Calculate gradient and update current
+  // model parameters by Optimizer.
+  void CalcGrad(const SparseRow* row,
+                Model& model,
+                real_t pg,
+                real_t norm = 1.0) {
+    this->template calc_grad<Optimizer>(row, model, pg, norm);
+  }
+
+  // Calculate score and gradient by Optimizer.
+  real_t CalcScoreAndGrad(const SparseRow* row,
+                          Model& model,
+                          real_t y,
+                          PartialGradFunc partial_grad,
+                          real_t norm = 1.0) {
+    return this->template calc_score_and_grad<Optimizer>(
+        row, model, y, partial_grad, norm);
+  }
+
+  // Update the model by the buffer with Optimizer.
+  void ApplyGrad(Model& model, GradBuffer* buf) {
+    this->template update_batch<Optimizer>(model, buf);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(OptScore);
+};
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -20,6 +20,9 @@ This file tests the Score class.
 
 #include "gtest/gtest.h"
 
+#include <string>
+
+#include "src/base/half.h"
 #include "src/score/score_function.h"
 
 namespace xLearn {
@@ -32,8 +35,83 @@ TEST(SCORE_TEST, Create_Score) {
   EXPECT_TRUE(CreateScore("linear") != NULL);
   EXPECT_TRUE(CreateScore("fm") != NULL);
   EXPECT_TRUE(CreateScore("ffm") != NULL);
+  EXPECT_TRUE(CreateScore("fwfm") != NULL);
+  EXPECT_TRUE(CreateScore("linear_sgd") != NULL);
+  EXPECT_TRUE(CreateScore("fm_adagrad") != NULL);
+  EXPECT_TRUE(CreateScore("ffm_ftrl") != NULL);
+  EXPECT_TRUE(CreateScore("fm_adam") != NULL);
+  EXPECT_TRUE(CreateScore("linear_adamw") != NULL);
+  EXPECT_TRUE(CreateScore("fwfm_sgd") != NULL);
+  EXPECT_TRUE(CreateScore("ffm_unknow") == NULL);
   EXPECT_TRUE(CreateScore("") == NULL);
   EXPECT_TRUE(CreateScore("unknow_name") == NULL);
 }
 
+real_t partial_grad(real_t pred, real_t y) {
+  return pred - y;
+}
+
+// OptScore should update the model in the same way
+// as the score which checks opt_type for each row,
+// and for the rows of a batch (see ApplyGrad).
+void CheckOptScore(const std::string& score_func,
+                   std::string opt_type,
+                   index_t aux_size,
+                   real_t aux_value = 1.0) {
+  SparseRow row(6);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = i % 3;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  Model model_a, model_b;
+  model_a.Initialize(score_func, "cross-entropy", 6, 3, 8, aux_size,
+                     1.0, false, aux_value);
+  model_b.Initialize(score_func, "cross-entropy", 6, 3, 8, aux_size,
+                     1.0, false, aux_value);
+  Score* score_a = CreateScore(score_func.c_str());
+  Score* score_b = CreateScore((score_func+"_"+opt_type).c_str());
+  ASSERT_TRUE(score_b != NULL);
+  score_a->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt_type);
+  score_b->Initialize(0.1, 0.01, 0.3, 1.0, 0.001, 0.01, opt_type);
+  for (int n = 0; n < 3; ++n) {
+    score_a->CalcGrad(&row, model_a, 0.2, 0.5);
+    score_b->CalcGrad(&row, model_b, 0.2, 0.5);
+  }
+  GradBuffer buf_a, buf_b;
+  for (int n = 0; n < 3; ++n) {
+    score_a->CalcScoreAndBatchGrad(&row, model_a, 1.0, partial_grad,
+                                   0.5, &buf_a);
+    score_b->CalcScoreAndBatchGrad(&row, model_b, 1.0, partial_grad,
+                                   0.5, &buf_b);
+    score_a->ApplyGrad(model_a, &buf_a);
+    score_b->ApplyGrad(model_b, &buf_b);
+  }
+  EXPECT_FLOAT_EQ(score_a->CalcScore(&row, model_a, 0.5),
+                  score_b->CalcScore(&row, model_b, 0.5));
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_w()[i],
+                    model_b.GetParameter_w()[i]);
+  }
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(model_a.GetParameter_v()[i],
+                    model_b.GetParameter_v()[i]);
+  }
+  delete score_a;
+  delete score_b;
+}
+
+TEST(SCORE_TEST, Opt_Score) {
+  const char* score_func[4] = { "linear", "fm", "ffm", "fwfm" };
+  for (int i = 0; i < 4; ++i) {
+    CheckOptScore(score_func[i], "sgd", 1);
+    CheckOptScore(score_func[i], "adagrad", 2);
+    CheckOptScore(score_func[i], "ftrl", 3);
+    // Both n and z of the bf16 state start at 1
+    CheckOptScore(score_func[i], "ftrl_bf16", 2, PackBF16(1.0, 1.0));
+    CheckOptScore(score_func[i], "adam", 3);
+    CheckOptScore(score_func[i], "adamw", 3);
+  }
+}
+
 }  // namespace xLearn
@@ -0,0 +1,43 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the kernel dispatch.
+*/
+
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+const ScoreKernels* GetScoreKernels(SimdLevel level,
+                                    index_t aligned_k) {
+  static const SimdLevel cpu_level = DetectSimdLevel();
+  if (level > cpu_level) {
+    return nullptr;
+  }
+  switch (level) {
+    case kSimdAVX512: return GetAVX512Kernels(aligned_k);
+    case kSimdAVX2: return GetAVX2Kernels(aligned_k);
+    default: return GetSSEKernels(aligned_k);
+  }
+}
+
+const ScoreKernels& GetBestScoreKernels(index_t aligned_k) {
+  static const SimdLevel level = DetectSimdLevel();
+  return *GetScoreKernels(level, aligned_k);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,303 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the SIMD kernels used by FMScore, FFMScore
+and FwFMScore.
+*/
+
+#ifndef XLEARN_SCORE_SCORE_KERNEL_H_
+#define XLEARN_SCORE_SCORE_KERNEL_H_
+
+#include "src/base/common.h"
+#include "src/base/cpu_info.h"
+#include "src/base/half.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// KernelShape describes the layout of the latent factors.
+//------------------------------------------------------------------------------
+struct KernelShape {
+  index_t num_feat;   /* Number of feature */
+  index_t num_field;  /* Number of field (only used by ffm) */
+  index_t aligned_k;  /* Latent factor size aligned to kAlign */
+  index_t aux_size;   /* Auxiliary size of the optimizer */
+  bool split;         /* Split layout of ffm (see Model::SetSplitLayout) */
+  bool field_major;   /* Field-major layout of ffm (see Model::SetFieldMajor) */
+  bool var_k;         /* The pairs have their own blocks (see FFMPair) */
+};
+
+//------------------------------------------------------------------------------
+// KernelParam stores the hyper-parameters of the optimizer.
+//------------------------------------------------------------------------------
+struct KernelParam {
+  real_t learning_rate;
+  real_t regu_lambda;
+  real_t alpha;
+  real_t beta;
+  real_t lambda_1;
+  real_t lambda_2;
+  real_t beta_1;        /* Decay of the first moment of adam */
+  real_t beta_2;        /* Decay of the second moment of adam */
+  real_t epsilon;       /* Used by adam */
+  real_t step_size;     /* Learning rate of adam with bias correction */
+  real_t weight_decay;  /* Decoupled weight decay of adamw */
+};
+
+// Return sum(w[feat_id * aux_size] * feat_val) of [begin, end),
+// which skips the unseen features (feat_id >= num_feat). It is
+// the linear term of every score function.
+typedef real_t (*LinearKernel)(const Node* begin,
+                               const Node* end,
+                               const real_t* w,
+                               index_t num_feat,
+                               index_t aux_size);
+
+// Same as LinearKernel for a batch of n rows, whose nodes are given
+// as the arrays of the ids and the values of all the rows (end[i] is
+// the end of the i-th row), and the sums are written to out. The
+// lanes of a gather can take the nodes of several short rows.
+typedef void (*LinearRowsKernel)(const index_t* id,
+                                 const real_t* x,
+                                 const size_t* end,
+                                 size_t n,
+                                 const real_t* w,
+                                 index_t num_feat,
+                                 index_t aux_size,
+                                 real_t* out);
+
+// Return the latent part of the ffm score for [begin, end).
+typedef real_t (*FFMScoreKernel)(const Node* begin,
+                                 const Node* end,
+                                 const real_t* v,
+                                 const KernelShape& shape,
+                                 real_t norm);
+
+// Update the ffm latent factors for [begin, end).
+typedef void (*FFMGradKernel)(const Node* begin,
+                              const Node* end,
+                              real_t* v,
+                              const KernelShape& shape,
+                              const KernelParam& param,
+                              real_t pg,
+                              real_t norm);
+
+//------------------------------------------------------------------------------
+// FFMPair records one feature pair of a row: the offsets of the two
+// latent vectors (V_i_fj and V_j_fi) in param_v_, and x_i*x_j*norm.
+// The forward pass of training stores the pairs, and then the update
+// uses them directly instead of walking the row again. The pair
+// kernels read the blocks of kAlign values of each pair if the
+// shape has var_k (see FieldIndex::SetFieldK), and otherwise all
+// the pairs have aligned_k / kAlign blocks.
+//------------------------------------------------------------------------------
+struct FFMPair {
+  offset_t w1;
+  offset_t w2;
+  real_t v;
+  index_t blocks;
+};
+
+// Same as FFMScoreKernel, and also stores the pairs of the row,
+// which needs (nnz * (nnz-1) / 2) FFMPair at most.
+typedef real_t (*FFMScorePairKernel)(const Node* begin,
+                                     const Node* end,
+                                     const real_t* v,
+                                     const KernelShape& shape,
+                                     real_t norm,
+                                     FFMPair* pairs,
+                                     size_t* num_pairs);
+
+// Return the latent part of the ffm score for the given pairs, whose
+// offsets are looked up by the field index of the sparse ffm model.
+typedef real_t (*FFMPairScoreKernel)(const FFMPair* pairs,
+                                     size_t num_pairs,
+                                     const real_t* v,
+                                     const KernelShape& shape);
+
+// Update the ffm latent factors for the recorded pairs.
+typedef void (*FFMPairGradKernel)(const FFMPair* pairs,
+                                  size_t num_pairs,
+                                  real_t* v,
+                                  const KernelShape& shape,
+                                  const KernelParam& param,
+                                  real_t pg);
+
+// Accumulate sum(V_i * x_i) of [begin, end) into the sum
+// vector (aligned_k size), which must be 16-byte aligned.
+typedef void (*FMSumKernel)(const Node* begin,
+                            const Node* end,
+                            const real_t* v,
+                            const KernelShape& shape,
+                            real_t* sum,
+                            real_t norm);
+
+// Return the latent part of the fm score for [begin, end).
+// The sum vector must be zero, and it keeps sum(V_i * x_i)
+// after the call, which can be reused by FMGradKernel.
+typedef real_t (*FMScoreKernel)(const Node* begin,
+                                const Node* end,
+                                const real_t* v,
+                                const KernelShape& shape,
+                                real_t* sum,
+                                real_t norm);
+
+// Update the fm latent factors for [begin, end), where
+// the sum vector is given by FMSumKernel or FMScoreKernel.
+typedef void (*FMGradKernel)(const Node* begin,
+                             const Node* end,
+                             real_t* v,
+                             const KernelShape& shape,
+                             const KernelParam& param,
+                             const real_t* sum,
+                             real_t pg,
+                             real_t norm);
+
+// Update the fwfm latent factors of the nodes [begin, end), which are
+// all in one field f of the row. The vector t (aligned_k size) is
+// sum(r_fg * s_g) over the fields g of the row, where s_g is the sum
+// vector of the field g, and r is r_ff. Then the gradient of V_i is
+// x_i * (t - r * V_i * x_i), which is the one of fm with t as its sum.
+typedef void (*FwFMGradKernel)(const Node* begin,
+                               const Node* end,
+                               real_t* v,
+                               const KernelShape& shape,
+                               const KernelParam& param,
+                               const real_t* t,
+                               real_t r,
+                               real_t pg,
+                               real_t norm);
+
+// Same as FFMScoreKernel and FMScoreKernel, but the latent factors
+// are stored in 16-bit floats (fp16 or bf16) without the aux blocks,
+// and they are converted to fp32 in registers (see Model::ConvertLatent).
+// So here the shape.aux_size is always 1.
+typedef real_t (*FFMHalfScoreKernel)(const Node* begin,
+                                     const Node* end,
+                                     const uint16* v,
+                                     const KernelShape& shape,
+                                     real_t norm);
+
+typedef real_t (*FMHalfScoreKernel)(const Node* begin,
+                                    const Node* end,
+                                    const uint16* v,
+                                    const KernelShape& shape,
+                                    real_t* sum,
+                                    real_t norm);
+
+// Same as above, but the latent factors are stored in int8, and
+// each latent vector (a row of aligned_k values) has its own scale.
+typedef real_t (*FFMInt8ScoreKernel)(const Node* begin,
+                                     const Node* end,
+                                     const int8* v,
+                                     const real_t* scale,
+                                     const KernelShape& shape,
+                                     real_t norm);
+
+typedef real_t (*FMInt8ScoreKernel)(const Node* begin,
+                                    const Node* end,
+                                    const int8* v,
+                                    const real_t* scale,
+                                    const KernelShape& shape,
+                                    real_t* sum,
+                                    real_t norm);
+
+//------------------------------------------------------------------------------
+// ScoreKernels is the function table of one instruction set.
+// Every table is compiled in its own translation unit with the
+// matching compiler flags, and the best one for current CPU is
+// chosen at runtime. For example:
+//
+//   const ScoreKernels& kernels = GetBestScoreKernels();
+//   real_t score = kernels.ffm_score(begin, end, v, shape, norm);
+//------------------------------------------------------------------------------
+struct ScoreKernels {
+  const char* name;
+  index_t aligned_k;  /* K of the fp32 ffm and fm kernels, 0 for any K */
+  LinearKernel linear;
+  LinearRowsKernel linear_rows;
+  FFMScoreKernel ffm_score;
+  FFMGradKernel ffm_sgd;
+  FFMGradKernel ffm_adagrad;
+  FFMGradKernel ffm_ftrl;
+  FFMGradKernel ffm_adam;
+  FFMScorePairKernel ffm_score_pairs;
+  FFMPairGradKernel ffm_sgd_pairs;
+  FFMPairGradKernel ffm_adagrad_pairs;
+  FFMPairGradKernel ffm_ftrl_pairs;
+  FFMPairGradKernel ffm_adam_pairs;
+  FFMPairScoreKernel ffm_pair_score;
+  FMSumKernel fm_sum;
+  FMScoreKernel fm_score;
+  FMGradKernel fm_sgd;
+  FMGradKernel fm_adagrad;
+  FMGradKernel fm_ftrl;
+  FMGradKernel fm_adam;
+  FFMHalfScoreKernel ffm_score_fp16;
+  FFMHalfScoreKernel ffm_score_bf16;
+  FFMInt8ScoreKernel ffm_score_int8;
+  FMHalfScoreKernel fm_score_fp16;
+  FMHalfScoreKernel fm_score_bf16;
+  FMInt8ScoreKernel fm_score_int8;
+  FwFMGradKernel fwfm_sgd;
+  FwFMGradKernel fwfm_adagrad;
+  FwFMGradKernel fwfm_ftrl;
+  FwFMGradKernel fwfm_adam;
+  // ftrl with the compact state of -opt_state bf16 (aux_size = 2)
+  FFMGradKernel ffm_ftrl_bf16;
+  FFMPairGradKernel ffm_ftrl_bf16_pairs;
+  FMGradKernel fm_ftrl_bf16;
+  FwFMGradKernel fwfm_ftrl_bf16;
+};
+
+// Each instruction set has a generic table and the tables whose
+// fp32 ffm and fm kernels are unrolled for kNumKernelK common K
+// (4, 8, 16 and 32). The specialized kernels call the generic
+// ones for any other K, so every table works for every model.
+const int kNumKernelK = 4;
+
+// Return the table of aligned_k in tables[0, kNumKernelK],
+// or the generic tables[0] if there is no such table.
+inline const ScoreKernels* SelectKernelTable(const ScoreKernels* tables,
+                                             index_t aligned_k) {
+  for (int i = 1; i <= kNumKernelK; ++i) {
+    if (tables[i].aligned_k == aligned_k) {
+      return &tables[i];
+    }
+  }
+  return &tables[0];
+}
+
+// Kernel tables of each instruction set.
+const ScoreKernels* GetSSEKernels(index_t aligned_k = 0);
+const ScoreKernels* GetAVX2Kernels(index_t aligned_k = 0);
+const ScoreKernels* GetAVX512Kernels(index_t aligned_k = 0);
+
+// Return the kernel table of the given SIMD level, or
+// nullptr if current CPU does not support it. The table
+// is specialized for aligned_k if there is one.
+const ScoreKernels* GetScoreKernels(SimdLevel level,
+                                    index_t aligned_k = 0);
+
+// Return the kernel table of the best SIMD level of
+// current CPU. The CPU is checked only once.
+const ScoreKernels& GetBestScoreKernels(index_t aligned_k = 0);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_SCORE_KERNEL_H_
@@ -0,0 +1,159 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file instantiates the score kernels with AVX2. It must
+be compiled with -mavx2 -mfma -mf16c, and it can only be called
+when the CPU supports AVX2 (see GetScoreKernels()).
+*/
+
+#include "src/base/cpu_info.h"
+
+#ifdef XLEARN_X86
+
+#include <immintrin.h>  // for AVX2
+
+#include "src/score/score_kernel_impl.h"
+
+namespace xLearn {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// 256-bit Ops, and each register holds two blocks.
+//------------------------------------------------------------------------------
+struct AVX2Ops {
+  typedef __m256 reg;
+  static const index_t kBlocks = 2;
+  static inline reg zero() { return _mm256_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm256_set1_ps(x); }
+  static inline reg load(const real_t* p, index_t stride) {
+    if (stride == kAlign) {
+      return _mm256_loadu_ps(p);
+    }
+    return _mm256_insertf128_ps(
+           _mm256_castps128_ps256(_mm_load_ps(p)),
+           _mm_load_ps(p + stride), 1);
+  }
+  static inline void store(real_t* p, index_t stride, reg x) {
+    if (stride == kAlign) {
+      _mm256_storeu_ps(p, x);
+      return;
+    }
+    _mm_store_ps(p, _mm256_castps256_ps128(x));
+    _mm_store_ps(p + stride, _mm256_extractf128_ps(x, 1));
+  }
+  static inline reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static inline reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+  static inline reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+  static inline reg rsqrt(reg a) { return _mm256_rsqrt_ps(a); }
+  static inline reg abs(reg a) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+  }
+  static inline reg copy_sign(reg a, reg s) {
+    return _mm256_or_ps(a, _mm256_and_ps(_mm256_set1_ps(-0.0f), s));
+  }
+  static inline reg keep_gt(reg a, reg b, reg x) {
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), x);
+  }
+  static inline reg load_fp16(const uint16* p) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+  }
+  static inline reg load_bf16(const uint16* p) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(
+           _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)), 16));
+  }
+  static inline reg load_int8(const int8* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+           _mm_loadl_epi64((const __m128i*)p)));
+  }
+  // The two bf16 of each lane (see PackBF16)
+  static inline reg bf16_lo(reg a) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_castps_si256(a), 16));
+  }
+  static inline reg bf16_hi(reg a) {
+    return _mm256_castsi256_ps(_mm256_and_si256(_mm256_castps_si256(a),
+                               _mm256_set1_epi32((int)0xffff0000)));
+  }
+  static inline reg bf16_pack(reg lo, reg hi) {
+    return _mm256_castsi256_ps(_mm256_or_si256(
+           _mm256_castps_si256(bf16_hi(hi)),
+           _mm256_srli_epi32(_mm256_castps_si256(lo), 16)));
+  }
+  // Same as RoundBF16 of each lane
+  static inline __m256i hash_bits(__m256i x) {
+    x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 10));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 6));
+    x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 3));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 11));
+    return _mm256_add_epi32(x, _mm256_slli_epi32(x, 15));
+  }
+  static inline reg round_bf16(reg a, reg seed) {
+    __m256i x = _mm256_castps_si256(a);
+    __m256i r = hash_bits(_mm256_xor_si256(x, _mm256_castps_si256(seed)));
+    x = _mm256_add_epi32(x, _mm256_srli_epi32(r, 16));
+    return _mm256_castsi256_ps(_mm256_and_si256(x,
+                               _mm256_set1_epi32((int)0xffff0000)));
+  }
+  // The ids and the values are gathered from the 8 nodes (3 ints
+  // each), and w of the unseen features is masked out of the gather.
+  // The unsigned id < num_feat is min(id, num_feat - 1) == id.
+  static inline reg gather_linear(const Node* p, const real_t* w,
+                                  index_t num_feat, index_t aux_size) {
+    const __m256i node = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    __m256i id = _mm256_i32gather_epi32((const int*)&p->feat_id, node, 4);
+    reg x = _mm256_i32gather_ps(&p->feat_val, node, 4);
+    __m256i mask = _mm256_cmpeq_epi32(
+        _mm256_min_epu32(id, _mm256_set1_epi32(num_feat - 1)), id);
+    __m256i pos = _mm256_mullo_epi32(id, _mm256_set1_epi32(aux_size));
+    reg v = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), w, pos,
+                                     _mm256_castsi256_ps(mask), 4);
+    return _mm256_mul_ps(_mm256_and_ps(x, _mm256_castsi256_ps(mask)), v);
+  }
+  // Same as gather_linear(), but the ids and the values are
+  // contiguous, so only w is gathered.
+  static inline reg gather_rows(const index_t* id_p, const real_t* x_p,
+                                const real_t* w, index_t num_feat,
+                                index_t aux_size) {
+    __m256i id = _mm256_loadu_si256((const __m256i*)id_p);
+    __m256i mask = _mm256_cmpeq_epi32(
+        _mm256_min_epu32(id, _mm256_set1_epi32(num_feat - 1)), id);
+    __m256i pos = _mm256_mullo_epi32(id, _mm256_set1_epi32(aux_size));
+    reg v = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), w, pos,
+                                     _mm256_castsi256_ps(mask), 4);
+    reg x = _mm256_and_ps(_mm256_loadu_ps(x_p), _mm256_castsi256_ps(mask));
+    return _mm256_mul_ps(x, v);
+  }
+  static inline real_t hsum(reg a) {
+    return SSEOps::hsum(_mm_add_ps(_mm256_castps256_ps128(a),
+                                   _mm256_extractf128_ps(a, 1)));
+  }
+};
+
+const ScoreKernels kAVX2Kernels[kNumKernelK + 1] =
+    XLEARN_SCORE_KERNEL_TABLES("avx2", AVX2Ops);
+
+}  // namespace
+
+const ScoreKernels* GetAVX2Kernels(index_t aligned_k) {
+  return SelectKernelTable(kAVX2Kernels, aligned_k);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_X86
@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file instantiates the score kernels with AVX-512. It must
+be compiled with -mavx512f, and it can only be called when the
+CPU supports AVX-512F (see GetScoreKernels()).
+*/
+
+#include "src/base/cpu_info.h"
+
+#ifdef XLEARN_X86
+
+#include <immintrin.h>  // for AVX-512
+
+#include "src/score/score_kernel_impl.h"
+
+namespace xLearn {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// 512-bit Ops, and each register holds four blocks.
+//
+// The unmasked forms of many intrinsics of GCC (e.g., the casts, the
+// extracts, the shifts, the conversions and sqrt) pass
+// _mm512_undefined_*() as the source of the masked-off lanes, which
+// -Wall reports as used uninitialized at every inlined call. So the
+// Ops use the zero-masked forms with all the lanes set instead, which
+// give the same code.
+//------------------------------------------------------------------------------
+struct AVX512Ops {
+  typedef __m512 reg;
+  static const index_t kBlocks = 4;
+  // All the lanes of a 128-bit and of a 512-bit register
+  static const __mmask8 kAll4 = 0xf;
+  static const __mmask16 kAll16 = 0xffff;
+  static inline reg zero() { return _mm512_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm512_set1_ps(x); }
+  static inline reg load(const real_t* p, index_t stride) {
+    if (stride == kAlign) {
+      return _mm512_loadu_ps(p);
+    }
+    reg x = _mm512_insertf32x4(_mm512_setzero_ps(), _mm_load_ps(p), 0);
+    x = _mm512_insertf32x4(x, _mm_load_ps(p + stride), 1);
+    x = _mm512_insertf32x4(x, _mm_load_ps(p + stride * 2), 2);
+    return _mm512_insertf32x4(x, _mm_load_ps(p + stride * 3), 3);
+  }
+  static inline void store(real_t* p, index_t stride, reg x) {
+    if (stride == kAlign) {
+      _mm512_storeu_ps(p, x);
+      return;
+    }
+    _mm_store_ps(p, _mm512_maskz_extractf32x4_ps(kAll4, x, 0));
+    _mm_store_ps(p + stride, _mm512_maskz_extractf32x4_ps(kAll4, x, 1));
+    _mm_store_ps(p + stride * 2, _mm512_maskz_extractf32x4_ps(kAll4, x, 2));
+    _mm_store_ps(p + stride * 3, _mm512_maskz_extractf32x4_ps(kAll4, x, 3));
+  }
+  static inline reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static inline reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+  static inline reg sqrt(reg a) { return _mm512_maskz_sqrt_ps(kAll16, a); }
+  static inline reg rsqrt(reg a) {
+    return _mm512_maskz_rsqrt14_ps(kAll16, a);
+  }
+  static inline reg abs(reg a) { return _mm512_abs_ps(a); }
+  // The float and/or need AVX-512DQ, so use the integer ones
+  static inline reg copy_sign(reg a, reg s) {
+    return _mm512_castsi512_ps(_mm512_or_si512(
+           _mm512_castps_si512(a),
+           _mm512_and_si512(_mm512_castps_si512(s),
+                            _mm512_set1_epi32(0x80000000))));
+  }
+  static inline reg keep_gt(reg a, reg b, reg x) {
+    return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ), x);
+  }
+  static inline reg load_fp16(const uint16* p) {
+    return _mm512_maskz_cvtph_ps(kAll16,
+                                 _mm256_loadu_si256((const __m256i*)p));
+  }
+  static inline reg load_bf16(const uint16* p) {
+    return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(kAll16,
+           _mm512_maskz_cvtepu16_epi32(
+               kAll16, _mm256_loadu_si256((const __m256i*)p)),
+           16));
+  }
+  static inline reg load_int8(const int8* p) {
+    return _mm512_maskz_cvtepi32_ps(kAll16, _mm512_maskz_cvtepi8_epi32(
+           kAll16, _mm_loadu_si128((const __m128i*)p)));
+  }
+  // The two bf16 of each lane (see PackBF16)
+  static inline reg bf16_lo(reg a) {
+    return _mm512_castsi512_ps(
+           _mm512_maskz_slli_epi32(kAll16, _mm512_castps_si512(a), 16));
+  }
+  static inline reg bf16_hi(reg a) {
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a),
+                               _mm512_set1_epi32((int)0xffff0000)));
+  }
+  static inline reg bf16_pack(reg lo, reg hi) {
+    return _mm512_castsi512_ps(_mm512_or_si512(
+           _mm512_castps_si512(bf16_hi(hi)),
+           _mm512_maskz_srli_epi32(kAll16, _mm512_castps_si512(lo), 16)));
+  }
+  // Same as RoundBF16 of each lane
+  static inline __m512i hash_bits(__m512i x) {
+    x = _mm512_add_epi32(x, _mm512_maskz_slli_epi32(kAll16, x, 10));
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi32(kAll16, x, 6));
+    x = _mm512_add_epi32(x, _mm512_maskz_slli_epi32(kAll16, x, 3));
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi32(kAll16, x, 11));
+    return _mm512_add_epi32(x, _mm512_maskz_slli_epi32(kAll16, x, 15));
+  }
+  static inline reg round_bf16(reg a, reg seed) {
+    __m512i x = _mm512_castps_si512(a);
+    __m512i r = hash_bits(_mm512_xor_si512(x, _mm512_castps_si512(seed)));
+    x = _mm512_add_epi32(x, _mm512_maskz_srli_epi32(kAll16, r, 16));
+    return _mm512_castsi512_ps(_mm512_and_si512(x,
+                               _mm512_set1_epi32((int)0xffff0000)));
+  }
+  // Same as AVX2Ops::gather_linear() for 16 nodes, and the mask of
+  // the unseen features also zeros their values.
+  static inline reg gather_linear(const Node* p, const real_t* w,
+                                  index_t num_feat, index_t aux_size) {
+    const __m512i node = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21,
+                                           24, 27, 30, 33, 36, 39, 42, 45);
+    __m512i id = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), kAll16,
+                                             node, &p->feat_id, 4);
+    __mmask16 mask = _mm512_cmplt_epu32_mask(id,
+                                             _mm512_set1_epi32(num_feat));
+    reg x = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, node,
+                                     &p->feat_val, 4);
+    __m512i pos = _mm512_mullo_epi32(id, _mm512_set1_epi32(aux_size));
+    reg v = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, pos, w, 4);
+    return _mm512_mul_ps(x, v);
+  }
+  static inline reg gather_rows(const index_t* id_p, const real_t* x_p,
+                                const real_t* w, index_t num_feat,
+                                index_t aux_size) {
+    __m512i id = _mm512_loadu_si512(id_p);
+    __mmask16 mask = _mm512_cmplt_epu32_mask(id,
+                                             _mm512_set1_epi32(num_feat));
+    __m512i pos = _mm512_mullo_epi32(id, _mm512_set1_epi32(aux_size));
+    reg v = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, pos, w, 4);
+    return _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, x_p), v);
+  }
+  // Same as _mm512_reduce_add_ps, whose halves are extracted
+  // from undefined sources (see above)
+  static inline real_t hsum(reg a) {
+    __m128 x = _mm_add_ps(_mm512_maskz_extractf32x4_ps(kAll4, a, 0),
+                          _mm512_maskz_extractf32x4_ps(kAll4, a, 1));
+    __m128 y = _mm_add_ps(_mm512_maskz_extractf32x4_ps(kAll4, a, 2),
+                          _mm512_maskz_extractf32x4_ps(kAll4, a, 3));
+    x = _mm_add_ps(x, y);
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+  }
+};
+
+const ScoreKernels kAVX512Kernels[kNumKernelK + 1] =
+    XLEARN_SCORE_KERNEL_TABLES("avx512", AVX512Ops);
+
+}  // namespace
+
+const ScoreKernels* GetAVX512Kernels(index_t aligned_k) {
+  return SelectKernelTable(kAVX512Kernels, aligned_k);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_X86
@@ -0,0 +1,1291 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file contains the generic implementation of the score kernels.
+It can ONLY be included by the score_kernel_*.cc files, and each of
+them instantiates the kernels with its own vector Ops, for example:
+
+  struct AVX2Ops {
+    typedef __m256 reg;
+    static const index_t kBlocks = 2;
+    static inline reg load(const real_t* p, index_t stride);
+    ...
+  };
+
+  const ScoreKernels kAVX2Kernels[kNumKernelK + 1] =
+      XLEARN_SCORE_KERNEL_TABLES("avx2", AVX2Ops);
+
+The fp32 ffm and fm kernels also take the aligned K as a template
+argument kK, which is 0 for any K. The specialized kernels of the
+common K (see kNumKernelK) have loops of a constant count, so they are
+fully unrolled and keep both latent vectors in registers. They
+accumulate in the same order as the generic ones, and give the same
+result, and any other K is passed on to the generic kernel.
+
+Ops::load() and Ops::store() access kBlocks blocks of kAlign floats,
+where the i-th block starts at (p + i * stride). The blocks left over
+at the end of the latent vector are handled by TailOps, which is the
+128-bit SSEOps. Ops::load_fp16(), Ops::load_bf16() and Ops::load_int8()
+read (kBlocks * kAlign) contiguous compact values and convert them to
+fp32. Ops::bf16_lo(), bf16_hi(),
+bf16_pack() and round_bf16() work on the compact optimizer state,
+which keeps two bf16 in each lane (see ftrl_bf16_update).
+
+Everything here lives in an anonymous namespace on purpose: the
+translation units are compiled with different instruction sets, and
+the inline functions must never be shared between them.
+*/
+
+#ifndef XLEARN_SCORE_SCORE_KERNEL_IMPL_H_
+#define XLEARN_SCORE_SCORE_KERNEL_IMPL_H_
+
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+
+#include "src/score/score_kernel.h"
+
+#include <pmmintrin.h>  // for SSE
+#ifdef __F16C__
+#include <immintrin.h>  // for F16C
+#endif
+
+namespace xLearn {
+namespace {
+
+// w * x of the feature, or 0 for an unseen one, which is one lane
+// of Ops::gather_linear() and Ops::gather_rows() for the Ops without
+// a gather instruction.
+inline real_t linear_lane(index_t id,
+                          real_t x,
+                          const real_t* w,
+                          index_t num_feat,
+                          index_t aux_size) {
+  return id < num_feat ? w[(offset_t)id * aux_size] * x : 0;
+}
+
+//------------------------------------------------------------------------------
+// 128-bit Ops, which is the baseline of x86-64.
+//------------------------------------------------------------------------------
+struct SSEOps {
+  typedef __m128 reg;
+  static const index_t kBlocks = 1;
+  static inline reg zero() { return _mm_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm_set1_ps(x); }
+  static inline reg load(const real_t* p, index_t) {
+    return _mm_load_ps(p);
+  }
+  static inline void store(real_t* p, index_t, reg x) {
+    _mm_store_ps(p, x);
+  }
+  static inline reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static inline reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+  static inline reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+  static inline reg rsqrt(reg a) { return _mm_rsqrt_ps(a); }
+  static inline reg abs(reg a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+  }
+  // a (a >= 0) with the sign of s
+  static inline reg copy_sign(reg a, reg s) {
+    return _mm_or_ps(a, _mm_and_ps(_mm_set1_ps(-0.0f), s));
+  }
+  // x where a > b, and zero elsewhere
+  static inline reg keep_gt(reg a, reg b, reg x) {
+    return _mm_and_ps(_mm_cmpgt_ps(a, b), x);
+  }
+  static inline reg load_fp16(const uint16* p) {
+#ifdef __F16C__
+    return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)p));
+#else
+    return _mm_setr_ps(HalfToFloat(p[0]), HalfToFloat(p[1]),
+                       HalfToFloat(p[2]), HalfToFloat(p[3]));
+#endif
+  }
+  // bf16 is the high half of fp32
+  static inline reg load_bf16(const uint16* p) {
+    return _mm_castsi128_ps(
+           _mm_unpacklo_epi16(_mm_setzero_si128(),
+           _mm_loadl_epi64((const __m128i*)p)));
+  }
+  // Sign-extend each byte by moving it to the top of the lane
+  static inline reg load_int8(const int8* p) {
+    int32 x;
+    memcpy(&x, p, sizeof(x));
+    __m128i XMMx = _mm_cvtsi32_si128(x);
+    XMMx = _mm_unpacklo_epi8(XMMx, XMMx);
+    XMMx = _mm_unpacklo_epi16(XMMx, XMMx);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(XMMx, 24));
+  }
+  // The two bf16 of each lane (see PackBF16)
+  static inline reg bf16_lo(reg a) {
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_castps_si128(a), 16));
+  }
+  static inline reg bf16_hi(reg a) {
+    return _mm_castsi128_ps(_mm_and_si128(_mm_castps_si128(a),
+                            _mm_set1_epi32((int)0xffff0000)));
+  }
+  static inline reg bf16_pack(reg lo, reg hi) {
+    return _mm_castsi128_ps(_mm_or_si128(_mm_castps_si128(bf16_hi(hi)),
+           _mm_srli_epi32(_mm_castps_si128(lo), 16)));
+  }
+  // Same as RoundBF16 of each lane
+  static inline __m128i hash_bits(__m128i x) {
+    x = _mm_add_epi32(x, _mm_slli_epi32(x, 10));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 6));
+    x = _mm_add_epi32(x, _mm_slli_epi32(x, 3));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 11));
+    return _mm_add_epi32(x, _mm_slli_epi32(x, 15));
+  }
+  static inline reg round_bf16(reg a, reg seed) {
+    __m128i x = _mm_castps_si128(a);
+    __m128i r = hash_bits(_mm_xor_si128(x, _mm_castps_si128(seed)));
+    x = _mm_add_epi32(x, _mm_srli_epi32(r, 16));
+    return _mm_castsi128_ps(_mm_and_si128(x,
+                            _mm_set1_epi32((int)0xffff0000)));
+  }
+  static inline reg gather_linear(const Node* p, const real_t* w,
+                                 index_t num_feat, index_t aux_size) {
+    return _mm_setr_ps(
+        linear_lane(p[0].feat_id, p[0].feat_val, w, num_feat, aux_size),
+        linear_lane(p[1].feat_id, p[1].feat_val, w, num_feat, aux_size),
+        linear_lane(p[2].feat_id, p[2].feat_val, w, num_feat, aux_size),
+        linear_lane(p[3].feat_id, p[3].feat_val, w, num_feat, aux_size));
+  }
+  static inline reg gather_rows(const index_t* id, const real_t* x,
+                                const real_t* w, index_t num_feat,
+                                index_t aux_size) {
+    return _mm_setr_ps(linear_lane(id[0], x[0], w, num_feat, aux_size),
+                       linear_lane(id[1], x[1], w, num_feat, aux_size),
+                       linear_lane(id[2], x[2], w, num_feat, aux_size),
+                       linear_lane(id[3], x[3], w, num_feat, aux_size));
+  }
+  static inline real_t hsum(reg a) {
+    a = _mm_hadd_ps(a, a);
+    a = _mm_hadd_ps(a, a);
+    real_t res;
+    _mm_store_ss(&res, a);
+    return res;
+  }
+};
+
+typedef SSEOps TailOps;
+
+// Update w by adam with the gradient g, where m and n are the
+// first and second moment:
+//   m = beta_1 * m + (1 - beta_1) * g
+//   n = beta_2 * n + (1 - beta_2) * g * g
+//   w = w - step_size * m / (sqrt(n) + epsilon) - weight_decay * w
+// Only the parameters in current row are updated (lazy moments).
+template <class V>
+inline void adam_update(real_t* w, real_t* m, real_t* n, index_t stride,
+                        typename V::reg XMMw, typename V::reg XMMg,
+                        const KernelParam& param) {
+  typename V::reg XMMb1 = V::set1(param.beta_1);
+  typename V::reg XMMb2 = V::set1(param.beta_2);
+  typename V::reg XMMm = V::add(V::mul(XMMb1, V::load(m, stride)),
+                         V::mul(V::set1(1 - param.beta_1), XMMg));
+  typename V::reg XMMn = V::add(V::mul(XMMb2, V::load(n, stride)),
+                         V::mul(V::set1(1 - param.beta_2),
+                                V::mul(XMMg, XMMg)));
+  typename V::reg XMMstep = V::div(
+                            V::mul(V::set1(param.step_size), XMMm),
+                            V::add(V::sqrt(XMMn),
+                                   V::set1(param.epsilon)));
+  XMMw = V::sub(XMMw, V::add(XMMstep,
+                      V::mul(V::set1(param.weight_decay), XMMw)));
+  V::store(m, stride, XMMm);
+  V::store(n, stride, XMMn);
+  V::store(w, stride, XMMw);
+}
+
+// The FTRL-proximal weight given by z and the square root of the
+// sum of squared gradient, which is the same as FTRLOptimizer:
+//   w = (sign(z) * lambda_1 - z) / ((beta + sqrt(n)) / alpha + lambda_2)
+// if |z| > lambda_1, and w = 0 otherwise. The branch is replaced by
+// a mask, so the whole register is updated at once.
+template <class V>
+inline typename V::reg ftrl_weight(typename V::reg XMMz,
+                                   typename V::reg XMMsqrt_wg,
+                                   const KernelParam& param) {
+  typename V::reg XMML1 = V::set1(param.lambda_1);
+  typename V::reg XMMnum = V::sub(V::copy_sign(XMML1, XMMz), XMMz);
+  typename V::reg XMMden = V::add(
+                           V::div(V::add(V::set1(param.beta), XMMsqrt_wg),
+                                  V::set1(param.alpha)),
+                           V::set1(param.lambda_2));
+  return V::keep_gt(V::abs(XMMz), XMML1, V::div(XMMnum, XMMden));
+}
+
+// FTRL with the compact state of -opt_state bf16, where the aux value
+// s of w keeps n (the sum of squared gradient) in its low half and z in
+// its high half, both in bf16 (see FTRLBF16Optimizer). n is rounded
+// stochastically, and the weight is given by the rounded n, so it is the
+// FTRL of slightly different gradients. z of a nonzero w is not kept
+// (zero), since it is given by w and n:
+//   z = -(sign(w) * lambda_1 + w * ((beta + sqrt(n)) / alpha + lambda_2))
+// and only z of zero w (|z| <= lambda_1) is rounded to bf16. The z set
+// by the initial value (aux_value) is used once, as the fp32 ftrl does.
+// The lanes of g seed the rounding, and w is updated in place.
+template <class V>
+inline void ftrl_bf16_update(real_t* w, real_t* s, index_t stride,
+                             typename V::reg XMMw, typename V::reg XMMg,
+                             const KernelParam& param) {
+  typename V::reg XMMalpha = V::set1(param.alpha);
+  typename V::reg XMML1 = V::set1(param.lambda_1);
+  typename V::reg XMMs = V::load(s, stride);
+  typename V::reg XMMwg = V::bf16_lo(XMMs);
+  typename V::reg XMMz = V::bf16_hi(XMMs);
+  typename V::reg XMMsqrt_old = V::sqrt(XMMwg);
+  typename V::reg XMMden = V::add(
+                           V::div(V::add(V::set1(param.beta), XMMsqrt_old),
+                                  XMMalpha),
+                           V::set1(param.lambda_2));
+  typename V::reg XMMz_w = V::sub(V::zero(),
+                           V::add(V::copy_sign(XMML1, XMMw),
+                                  V::mul(XMMw, XMMden)));
+  XMMz_w = V::keep_gt(V::abs(XMMw), V::zero(), XMMz_w);
+  XMMz = V::add(XMMz, V::keep_gt(V::set1(std::numeric_limits<real_t>::min()), V::abs(XMMz), XMMz_w));
+  typename V::reg XMMnew_wg = V::round_bf16(
+                              V::add(XMMwg, V::mul(XMMg, XMMg)), XMMg);
+  typename V::reg XMMsqrt_wg = V::sqrt(XMMnew_wg);
+  typename V::reg XMMsigma = V::div(V::sub(XMMsqrt_wg, XMMsqrt_old),
+                                    XMMalpha);
+  XMMz = V::add(XMMz, V::sub(XMMg, V::mul(XMMsigma, XMMw)));
+  typename V::reg XMMzero_z = V::sub(XMMz,
+                              V::keep_gt(V::abs(XMMz), XMML1, XMMz));
+  V::store(s, stride, V::bf16_pack(XMMnew_wg,
+                                   V::round_bf16(XMMzero_z, XMMg)));
+  V::store(w, stride, ftrl_weight<V>(XMMz, XMMsqrt_wg, param));
+}
+
+//------------------------------------------------------------------------------
+// Formats of the compact latent factors (see Model::ConvertLatent).
+// Format::load() reads the values of V::kBlocks blocks and converts
+// them to fp32, and the int8 values also need the scale of the row.
+//------------------------------------------------------------------------------
+struct FP16Format {
+  typedef uint16 type;
+  static const bool kScaled = false;
+  template <class V>
+  static inline typename V::reg load(const type* p) {
+    return V::load_fp16(p);
+  }
+};
+
+struct BF16Format {
+  typedef uint16 type;
+  static const bool kScaled = false;
+  template <class V>
+  static inline typename V::reg load(const type* p) {
+    return V::load_bf16(p);
+  }
+};
+
+struct Int8Format {
+  typedef int8 type;
+  static const bool kScaled = true;
+  template <class V>
+  static inline typename V::reg load(const type* p) {
+    return V::load_int8(p);
+  }
+};
+
+/*********************************************************
+ *  FFM kernels                                          *
+ *********************************************************/
+
+// The latent factors of ffm are stored as:
+//   feature -> field -> [w(kAlign), aux-1 blocks]...
+// so the stride between two blocks of w is kAlign * aux_size, and
+// the a-th aux block of w is at w + kAlign * a. The split layout
+// keeps the aux of each feature after all of its w:
+//   feature -> [field -> w(aligned_k)], aux-1 copies of the w part
+// so the blocks of w are contiguous, and the a-th aux block of w is
+// at w + num_field * aligned_k * a (see FFM_AUX_GAP). The field-major
+// layout swaps the order of feature and field:
+//   field -> feature -> [w(kAlign), aux-1 blocks]...
+// so only the strides of feature (align1) and field (align0) change.
+// The aligned K is the constant kK of the specialized kernels.
+#define FFM_BLOCK_SIZE_K(kK)                                       \
+  const index_t num_block =                                        \
+      ((kK) > 0 ? (kK) : shape.aligned_k) / kAlign;                \
+  const index_t main_block = num_block - num_block % Ops::kBlocks; \
+  index_t stride = shape.split ? kAlign : kAlign * shape.aux_size;
+
+#define FFM_AUX_GAP                                                \
+  (shape.split ? shape.num_field * num_block * kAlign : kAlign)
+
+#define FFM_BLOCK_SIZE FFM_BLOCK_SIZE_K(0)
+
+// The specialized kernel of kK passes the shape of any
+// other K (or of the pairs of their own K) to the generic
+// kernel, which is the given call.
+#define KERNEL_K_FALLBACK(call)                                    \
+  if (kK > 0 && (shape.aligned_k != kK || shape.var_k)) {          \
+    return call;                                                   \
+  }
+
+// The blocks of the p-th pair of the pair kernels, and
+// the ones of the main loop.
+#define FFM_PAIR_BLOCKS                                            \
+    const index_t pair_block =                                     \
+        shape.var_k ? pairs[p].blocks : num_block;                 \
+    const index_t pair_main = shape.var_k ?                        \
+        pair_block - pair_block % Ops::kBlocks : main_block;
+
+// V_j_fi of the next pair is at a random feature, so we prefetch
+// it while computing the current pair. V_i_fj is contiguous when
+// the row is grouped by field (see FFMScore), and it does not
+// need it. Prefetch never faults, but we still skip the unseen
+// features to keep the address inside param_v_.
+#define FFM_PREFETCH_NEXT                                          \
+      if (iter_j + 1 != end && (iter_j + 1)->feat_id < num_feat) { \
+        XLEARN_PREFETCH(v + (iter_j + 1)->feat_id *                \
+                        align1 + f1 * align0);                     \
+      }
+
+#define FFM_PAIR_LOOP_BEGIN_K(kK)                                  \
+  index_t num_feat = shape.num_feat;                               \
+  index_t num_field = shape.num_field;                             \
+  FFM_BLOCK_SIZE_K(kK)                                             \
+  offset_t align0 = (offset_t)num_block * kAlign *                 \
+                    (shape.split ? 1 : shape.aux_size);            \
+  offset_t align1 = (offset_t)num_field * shape.aux_size *         \
+                    num_block * kAlign;                            \
+  if (shape.field_major) {                                         \
+    align1 = align0;                                               \
+    align0 = (offset_t)num_feat * align1;                          \
+  }                                                                \
+  for (const Node* iter_i = begin; iter_i != end; ++iter_i) {      \
+    index_t j1 = iter_i->feat_id;                                  \
+    index_t f1 = iter_i->field_id;                                 \
+    if (j1 >= num_feat || f1 >= num_field) continue;               \
+    real_t v1 = iter_i->feat_val;                                  \
+    for (const Node* iter_j = iter_i+1; iter_j != end; ++iter_j) { \
+      FFM_PREFETCH_NEXT                                            \
+      index_t j2 = iter_j->feat_id;                                \
+      index_t f2 = iter_j->field_id;                               \
+      if (j2 >= num_feat || f2 >= num_field) continue;             \
+      real_t v2 = iter_j->feat_val;                                \
+      offset_t off1 = j1*align1 + f2*align0;                       \
+      offset_t off2 = j2*align1 + f1*align0;                       \
+      real_t vv = v1*v2*norm;
+
+#define FFM_PAIR_LOOP_BEGIN FFM_PAIR_LOOP_BEGIN_K(0)
+
+#define FFM_PAIR_LOOP_END } }
+
+// If kRecord is true, the pairs are also recorded for
+// the update of the same row (see FFMPair).
+template <class Ops, bool kRecord, index_t kK>
+real_t ffm_score_impl(const Node* begin,
+                      const Node* end,
+                      const real_t* v,
+                      const KernelShape& shape,
+                      real_t norm,
+                      FFMPair* pairs,
+                      size_t* num_pairs) {
+  KERNEL_K_FALLBACK((ffm_score_impl<Ops, kRecord, 0>(
+      begin, end, v, shape, norm, pairs, num_pairs)))
+  size_t n = 0;
+  typename Ops::reg XMMt = Ops::zero();
+  TailOps::reg XMMt_tail = TailOps::zero();
+  FFM_PAIR_LOOP_BEGIN_K(kK)
+    const real_t* w1_base = v + off1;
+    const real_t* w2_base = v + off2;
+    if (kRecord) {
+      pairs[n].w1 = off1;
+      pairs[n].w2 = off2;
+      pairs[n].v = vv;
+      pairs[n].blocks = num_block;
+      ++n;
+    }
+    typename Ops::reg XMMv = Ops::set1(vv);
+    index_t b = 0;
+    for (; b < main_block; b += Ops::kBlocks) {
+      index_t d = b * stride;
+      XMMt = Ops::add(XMMt,
+             Ops::mul(
+             Ops::mul(Ops::load(w1_base + d, stride),
+                      Ops::load(w2_base + d, stride)), XMMv));
+    }
+    for (; b < num_block; ++b) {
+      index_t d = b * stride;
+      XMMt_tail = TailOps::add(XMMt_tail,
+                  TailOps::mul(
+                  TailOps::mul(TailOps::load(w1_base + d, kAlign),
+                               TailOps::load(w2_base + d, kAlign)),
+                  TailOps::set1(vv)));
+    }
+  FFM_PAIR_LOOP_END
+  if (kRecord) {
+    *num_pairs = n;
+  }
+  return Ops::hsum(XMMt) + TailOps::hsum(XMMt_tail);
+}
+
+template <class Ops, index_t kK>
+real_t ffm_score(const Node* begin,
+                 const Node* end,
+                 const real_t* v,
+                 const KernelShape& shape,
+                 real_t norm) {
+  return ffm_score_impl<Ops, false, kK>(begin, end, v, shape,
+                                        norm, nullptr, nullptr);
+}
+
+template <class Ops, index_t kK>
+real_t ffm_score_pairs(const Node* begin,
+                       const Node* end,
+                       const real_t* v,
+                       const KernelShape& shape,
+                       real_t norm,
+                       FFMPair* pairs,
+                       size_t* num_pairs) {
+  return ffm_score_impl<Ops, true, kK>(begin, end, v, shape,
+                                       norm, pairs, num_pairs);
+}
+
+template <class Ops, index_t kK>
+real_t ffm_pair_score(const FFMPair* pairs,
+                      size_t num_pairs,
+                      const real_t* v,
+                      const KernelShape& shape) {
+  KERNEL_K_FALLBACK((ffm_pair_score<Ops, 0>(pairs, num_pairs, v, shape)))
+  FFM_BLOCK_SIZE_K(kK)
+  typename Ops::reg XMMt = Ops::zero();
+  TailOps::reg XMMt_tail = TailOps::zero();
+  for (size_t p = 0; p < num_pairs; ++p) {
+    if (p + 1 < num_pairs) {
+      XLEARN_PREFETCH(v + pairs[p+1].w1);
+      XLEARN_PREFETCH(v + pairs[p+1].w2);
+    }
+    const real_t* w1_base = v + pairs[p].w1;
+    const real_t* w2_base = v + pairs[p].w2;
+    real_t vv = pairs[p].v;
+    FFM_PAIR_BLOCKS
+    typename Ops::reg XMMv = Ops::set1(vv);
+    index_t b = 0;
+    for (; b < pair_main; b += Ops::kBlocks) {
+      index_t d = b * stride;
+      XMMt = Ops::add(XMMt,
+             Ops::mul(
+             Ops::mul(Ops::load(w1_base + d, stride),
+                      Ops::load(w2_base + d, stride)), XMMv));
+    }
+    for (; b < pair_block; ++b) {
+      index_t d = b * stride;
+      XMMt_tail = TailOps::add(XMMt_tail,
+                  TailOps::mul(
+                  TailOps::mul(TailOps::load(w1_base + d, kAlign),
+                               TailOps::load(w2_base + d, kAlign)),
+                  TailOps::set1(vv)));
+    }
+  }
+  return Ops::hsum(XMMt) + TailOps::hsum(XMMt_tail);
+}
+
+// The compact latent factors of ffm are stored as:
+//   feature -> field -> w(aligned_k)
+// so the FFM_PAIR_LOOP works with aux_size = 1.
+template <class Ops, class Format>
+real_t ffm_score_compact(const Node* begin,
+                         const Node* end,
+                         const typename Format::type* v,
+                         const real_t* scale,
+                         const KernelShape& shape,
+                         real_t norm) {
+  typename Ops::reg XMMt = Ops::zero();
+  TailOps::reg XMMt_tail = TailOps::zero();
+  FFM_PAIR_LOOP_BEGIN
+    const typename Format::type* w1_base = v + off1;
+    const typename Format::type* w2_base = v + off2;
+    if (Format::kScaled) {
+      vv *= scale[(offset_t)j1*num_field+f2] *
+            scale[(offset_t)j2*num_field+f1];
+    }
+    typename Ops::reg XMMv = Ops::set1(vv);
+    index_t b = 0;
+    for (; b < main_block; b += Ops::kBlocks) {
+      index_t d = b * stride;
+      XMMt = Ops::add(XMMt,
+             Ops::mul(
+             Ops::mul(Format::template load<Ops>(w1_base + d),
+                      Format::template load<Ops>(w2_base + d)), XMMv));
+    }
+    for (; b < num_block; ++b) {
+      index_t d = b * stride;
+      XMMt_tail = TailOps::add(XMMt_tail,
+                  TailOps::mul(
+                  TailOps::mul(
+                  Format::template load<TailOps>(w1_base + d),
+                  Format::template load<TailOps>(w2_base + d)),
+                  TailOps::set1(vv)));
+    }
+  FFM_PAIR_LOOP_END
+  return Ops::hsum(XMMt) + TailOps::hsum(XMMt_tail);
+}
+
+template <class Ops, class Format>
+real_t ffm_score_half(const Node* begin,
+                      const Node* end,
+                      const uint16* v,
+                      const KernelShape& shape,
+                      real_t norm) {
+  return ffm_score_compact<Ops, Format>(begin, end, v, nullptr,
+                                        shape, norm);
+}
+
+template <class Ops>
+real_t ffm_score_int8(const Node* begin,
+                      const Node* end,
+                      const int8* v,
+                      const real_t* scale,
+                      const KernelShape& shape,
+                      real_t norm) {
+  return ffm_score_compact<Ops, Int8Format>(begin, end, v, scale,
+                                            shape, norm);
+}
+
+template <class V>
+inline void ffm_sgd_block(real_t* w1, real_t* w2,
+                          index_t stride, index_t gap,
+                          real_t pgv, const KernelParam& param) {
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMlr = V::set1(param.learning_rate);
+  typename V::reg XMMlamb = V::set1(param.regu_lambda);
+  typename V::reg XMMw1 = V::load(w1, stride);
+  typename V::reg XMMw2 = V::load(w2, stride);
+  typename V::reg XMMg1 = V::add(V::mul(XMMlamb, XMMw1),
+                                 V::mul(XMMpgv, XMMw2));
+  typename V::reg XMMg2 = V::add(V::mul(XMMlamb, XMMw2),
+                                 V::mul(XMMpgv, XMMw1));
+  V::store(w1, stride, V::sub(XMMw1, V::mul(XMMlr, XMMg1)));
+  V::store(w2, stride, V::sub(XMMw2, V::mul(XMMlr, XMMg2)));
+}
+
+template <class V>
+inline void ffm_adagrad_block(real_t* w1, real_t* w2,
+                              index_t stride, index_t gap,
+                              real_t pgv, const KernelParam& param) {
+  real_t* wg1 = w1 + gap;
+  real_t* wg2 = w2 + gap;
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMlr = V::set1(param.learning_rate);
+  typename V::reg XMMlamb = V::set1(param.regu_lambda);
+  typename V::reg XMMw1 = V::load(w1, stride);
+  typename V::reg XMMw2 = V::load(w2, stride);
+  typename V::reg XMMwg1 = V::load(wg1, stride);
+  typename V::reg XMMwg2 = V::load(wg2, stride);
+  typename V::reg XMMg1 = V::add(V::mul(XMMlamb, XMMw1),
+                                 V::mul(XMMpgv, XMMw2));
+  typename V::reg XMMg2 = V::add(V::mul(XMMlamb, XMMw2),
+                                 V::mul(XMMpgv, XMMw1));
+  XMMwg1 = V::add(XMMwg1, V::mul(XMMg1, XMMg1));
+  XMMwg2 = V::add(XMMwg2, V::mul(XMMg2, XMMg2));
+  XMMw1 = V::sub(XMMw1, V::mul(XMMlr,
+          V::mul(V::rsqrt(XMMwg1), XMMg1)));
+  XMMw2 = V::sub(XMMw2, V::mul(XMMlr,
+          V::mul(V::rsqrt(XMMwg2), XMMg2)));
+  V::store(w1, stride, XMMw1);
+  V::store(w2, stride, XMMw2);
+  V::store(wg1, stride, XMMwg1);
+  V::store(wg2, stride, XMMwg2);
+}
+
+template <class V>
+inline void ffm_ftrl_block(real_t* w1, real_t* w2,
+                           index_t stride, index_t gap,
+                           real_t pgv, const KernelParam& param) {
+  real_t* wg1 = w1 + gap;
+  real_t* wg2 = w2 + gap;
+  real_t* z1 = w1 + gap * 2;
+  real_t* z2 = w2 + gap * 2;
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMalpha = V::set1(param.alpha);
+  typename V::reg XMML2 = V::set1(param.lambda_2);
+  typename V::reg XMMw1 = V::load(w1, stride);
+  typename V::reg XMMw2 = V::load(w2, stride);
+  typename V::reg XMMwg1 = V::load(wg1, stride);
+  typename V::reg XMMwg2 = V::load(wg2, stride);
+  typename V::reg XMMz1 = V::load(z1, stride);
+  typename V::reg XMMz2 = V::load(z2, stride);
+  typename V::reg XMMg1 = V::add(V::mul(XMML2, XMMw1),
+                                 V::mul(XMMpgv, XMMw2));
+  typename V::reg XMMg2 = V::add(V::mul(XMML2, XMMw2),
+                                 V::mul(XMMpgv, XMMw1));
+  typename V::reg XMMnew_wg1 = V::add(XMMwg1, V::mul(XMMg1, XMMg1));
+  typename V::reg XMMnew_wg2 = V::add(XMMwg2, V::mul(XMMg2, XMMg2));
+  typename V::reg XMMsqrt_wg1 = V::sqrt(XMMnew_wg1);
+  typename V::reg XMMsqrt_wg2 = V::sqrt(XMMnew_wg2);
+  typename V::reg XMMsigma1 = V::div(
+                              V::sub(XMMsqrt_wg1,
+                                     V::sqrt(XMMwg1)), XMMalpha);
+  typename V::reg XMMsigma2 = V::div(
+                              V::sub(XMMsqrt_wg2,
+                                     V::sqrt(XMMwg2)), XMMalpha);
+  XMMz1 = V::add(XMMz1, V::sub(XMMg1, V::mul(XMMsigma1, XMMw1)));
+  XMMz2 = V::add(XMMz2, V::sub(XMMg2, V::mul(XMMsigma2, XMMw2)));
+  V::store(z1, stride, XMMz1);
+  V::store(z2, stride, XMMz2);
+  V::store(wg1, stride, XMMnew_wg1);
+  V::store(wg2, stride, XMMnew_wg2);
+  V::store(w1, stride, ftrl_weight<V>(XMMz1, XMMsqrt_wg1, param));
+  V::store(w2, stride, ftrl_weight<V>(XMMz2, XMMsqrt_wg2, param));
+}
+
+template <class V>
+inline void ffm_ftrl_bf16_block(real_t* w1, real_t* w2,
+                                index_t stride, index_t gap,
+                                real_t pgv, const KernelParam& param) {
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMML2 = V::set1(param.lambda_2);
+  typename V::reg XMMw1 = V::load(w1, stride);
+  typename V::reg XMMw2 = V::load(w2, stride);
+  typename V::reg XMMg1 = V::add(V::mul(XMML2, XMMw1),
+                                 V::mul(XMMpgv, XMMw2));
+  typename V::reg XMMg2 = V::add(V::mul(XMML2, XMMw2),
+                                 V::mul(XMMpgv, XMMw1));
+  ftrl_bf16_update<V>(w1, w1 + gap, stride, XMMw1, XMMg1, param);
+  ftrl_bf16_update<V>(w2, w2 + gap, stride, XMMw2, XMMg2, param);
+}
+
+template <class V>
+inline void ffm_adam_block(real_t* w1, real_t* w2,
+                           index_t stride, index_t gap,
+                           real_t pgv, const KernelParam& param) {
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMlamb = V::set1(param.regu_lambda);
+  typename V::reg XMMw1 = V::load(w1, stride);
+  typename V::reg XMMw2 = V::load(w2, stride);
+  typename V::reg XMMg1 = V::add(V::mul(XMMlamb, XMMw1),
+                                 V::mul(XMMpgv, XMMw2));
+  typename V::reg XMMg2 = V::add(V::mul(XMMlamb, XMMw2),
+                                 V::mul(XMMpgv, XMMw1));
+  adam_update<V>(w1, w1 + gap, w1 + gap * 2, stride,
+                 XMMw1, XMMg1, param);
+  adam_update<V>(w2, w2 + gap, w2 + gap * 2, stride,
+                 XMMw2, XMMg2, param);
+}
+
+#define FFM_UPDATE_PAIR(name, num_block, main_block)               \
+    real_t* w1_base = v + off1;                                    \
+    real_t* w2_base = v + off2;                                    \
+    real_t pgv = pg * vv;                                          \
+    index_t gap = FFM_AUX_GAP;                                     \
+    index_t b = 0;                                                 \
+    for (; b < main_block; b += Ops::kBlocks) {                    \
+      index_t d = b * stride;                                      \
+      ffm_##name##_block<Ops>(w1_base + d, w2_base + d,            \
+                              stride, gap, pgv, param);            \
+    }                                                              \
+    for (; b < num_block; ++b) {                                   \
+      index_t d = b * stride;                                      \
+      ffm_##name##_block<TailOps>(w1_base + d, w2_base + d,        \
+                                  stride, gap, pgv, param);        \
+    }
+
+#define DEFINE_FFM_GRAD_KERNEL(name)                               \
+template <class Ops, index_t kK>                                   \
+void ffm_##name(const Node* begin,                                 \
+                const Node* end,                                   \
+                real_t* v,                                         \
+                const KernelShape& shape,                          \
+                const KernelParam& param,                          \
+                real_t pg,                                         \
+                real_t norm) {                                     \
+  KERNEL_K_FALLBACK((ffm_##name<Ops, 0>(begin, end, v, shape,      \
+                                        param, pg, norm)))         \
+  FFM_PAIR_LOOP_BEGIN_K(kK)                                        \
+    FFM_UPDATE_PAIR(name, num_block, main_block)                   \
+  FFM_PAIR_LOOP_END                                                \
+}                                                                  \
+                                                                   \
+template <class Ops, index_t kK>                                   \
+void ffm_##name##_pairs(const FFMPair* pairs,                      \
+                        size_t num_pairs,                          \
+                        real_t* v,                                 \
+                        const KernelShape& shape,                  \
+                        const KernelParam& param,                  \
+                        real_t pg) {                               \
+  KERNEL_K_FALLBACK((ffm_##name##_pairs<Ops, 0>(pairs, num_pairs,  \
+                                                v, shape, param,   \
+                                                pg)))              \
+  FFM_BLOCK_SIZE_K(kK)                                             \
+  for (size_t p = 0; p < num_pairs; ++p) {                         \
+    if (p + 1 < num_pairs) {                                       \
+      XLEARN_PREFETCH(v + pairs[p+1].w1);                          \
+      XLEARN_PREFETCH(v + pairs[p+1].w2);                          \
+    }                                                              \
+    offset_t off1 = pairs[p].w1;                                   \
+    offset_t off2 = pairs[p].w2;                                   \
+    real_t vv = pairs[p].v;                                        \
+    FFM_PAIR_BLOCKS                                                \
+    FFM_UPDATE_PAIR(name, pair_block, pair_main)                   \
+  }                                                                \
+}
+
+DEFINE_FFM_GRAD_KERNEL(sgd)
+DEFINE_FFM_GRAD_KERNEL(adagrad)
+DEFINE_FFM_GRAD_KERNEL(ftrl)
+DEFINE_FFM_GRAD_KERNEL(adam)
+DEFINE_FFM_GRAD_KERNEL(ftrl_bf16)
+
+/*********************************************************
+ *  FM kernels                                           *
+ *********************************************************/
+
+// The latent factors of fm are stored as:
+//   feature -> [w(aligned_k), aux-1 vectors of aligned_k]
+// so every vector is contiguous.
+
+// The dense columns of a row (e.g., the columns of a CSV file) are
+// the nodes of consecutive ids, so their vectors are kDenseRows rows
+// of v apart by align0, and fm_sum takes them as a GEMV: each block
+// of s is loaded and stored once for all of them instead of once for
+// each node. The products are added in the same order, so the sum
+// is the same as that of the nodes one by one.
+static const index_t kDenseRows = 4;
+
+// If the kDenseRows nodes from iter are of consecutive ids.
+inline bool is_dense_run(const Node* iter, const Node* end,
+                         index_t num_feat) {
+  if (end - iter < (ptrdiff_t)kDenseRows) { return false; }
+  index_t j = iter->feat_id;
+  if (j >= num_feat || num_feat - j < kDenseRows) { return false; }
+  for (index_t n = 1; n < kDenseRows; ++n) {
+    if (iter[n].feat_id != j + n) { return false; }
+  }
+  return true;
+}
+
+// s += sum(V_j * x_j) of the kDenseRows nodes from iter, whose
+// vectors start at w and are align0 apart.
+template <class Ops>
+inline void fm_dense_sum(const Node* iter,
+                         const real_t* w,
+                         offset_t align0,
+                         index_t aligned_k,
+                         real_t* s,
+                         real_t norm) {
+  index_t step = Ops::kBlocks * kAlign;
+  index_t main_k = aligned_k - aligned_k % step;
+  real_t x[kDenseRows];
+  for (index_t n = 0; n < kDenseRows; ++n) {
+    x[n] = iter[n].feat_val * norm;
+  }
+  index_t d = 0;
+  for (; d < main_k; d += step) {
+    typename Ops::reg XMMs = Ops::load(s+d, kAlign);
+    for (index_t n = 0; n < kDenseRows; ++n) {
+      XMMs = Ops::add(XMMs, Ops::mul(Ops::load(w+n*align0+d, kAlign),
+                                     Ops::set1(x[n])));
+    }
+    Ops::store(s+d, kAlign, XMMs);
+  }
+  for (; d < aligned_k; d += kAlign) {
+    TailOps::reg XMMs = TailOps::load(s+d, kAlign);
+    for (index_t n = 0; n < kDenseRows; ++n) {
+      XMMs = TailOps::add(XMMs,
+             TailOps::mul(TailOps::load(w+n*align0+d, kAlign),
+                          TailOps::set1(x[n])));
+    }
+    TailOps::store(s+d, kAlign, XMMs);
+  }
+}
+
+template <class Ops, index_t kK>
+void fm_sum(const Node* begin,
+            const Node* end,
+            const real_t* v,
+            const KernelShape& shape,
+            real_t* s,
+            real_t norm) {
+  KERNEL_K_FALLBACK((fm_sum<Ops, 0>(begin, end, v, shape, s, norm)))
+  const index_t aligned_k = kK > 0 ? kK : shape.aligned_k;
+  offset_t align0 = aligned_k * shape.aux_size;
+  index_t step = Ops::kBlocks * kAlign;
+  index_t main_k = aligned_k - aligned_k % step;
+  for (const Node* iter = begin; iter != end; ++iter) {
+    index_t j1 = iter->feat_id;
+    if (j1 >= shape.num_feat) continue;
+    const real_t* w = v + j1 * align0;
+    if (is_dense_run(iter, end, shape.num_feat)) {
+      fm_dense_sum<Ops>(iter, w, align0, aligned_k, s, norm);
+      iter += kDenseRows - 1;
+      continue;
+    }
+    real_t v1 = iter->feat_val * norm;
+    typename Ops::reg XMMv = Ops::set1(v1);
+    index_t d = 0;
+    for (; d < main_k; d += step) {
+      Ops::store(s+d, kAlign,
+                 Ops::add(Ops::load(s+d, kAlign),
+                 Ops::mul(Ops::load(w+d, kAlign), XMMv)));
+    }
+    for (; d < aligned_k; d += kAlign) {
+      TailOps::store(s+d, kAlign,
+                     TailOps::add(TailOps::load(s+d, kAlign),
+                     TailOps::mul(TailOps::load(w+d, kAlign),
+                                  TailOps::set1(v1))));
+    }
+  }
+}
+
+template <class Ops, index_t kK>
+real_t fm_score(const Node* begin,
+                const Node* end,
+                const real_t* v,
+                const KernelShape& shape,
+                real_t* s,
+                real_t norm) {
+  KERNEL_K_FALLBACK((fm_score<Ops, 0>(begin, end, v, shape, s, norm)))
+  fm_sum<Ops, kK>(begin, end, v, shape, s, norm);
+  const index_t aligned_k = kK > 0 ? kK : shape.aligned_k;
+  offset_t align0 = aligned_k * shape.aux_size;
+  index_t step = Ops::kBlocks * kAlign;
+  index_t main_k = aligned_k - aligned_k % step;
+  typename Ops::reg XMMt = Ops::zero();
+  TailOps::reg XMMt_tail = TailOps::zero();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    index_t j1 = iter->feat_id;
+    if (j1 >= shape.num_feat) continue;
+    const real_t* w = v + j1 * align0;
+    real_t v1 = iter->feat_val * norm;
+    typename Ops::reg XMMv = Ops::set1(v1);
+    index_t d = 0;
+    for (; d < main_k; d += step) {
+      typename Ops::reg XMMwv = Ops::mul(Ops::load(w+d, kAlign), XMMv);
+      XMMt = Ops::add(XMMt, Ops::mul(XMMwv,
+             Ops::sub(Ops::load(s+d, kAlign), XMMwv)));
+    }
+    for (; d < aligned_k; d += kAlign) {
+      TailOps::reg XMMwv = TailOps::mul(TailOps::load(w+d, kAlign),
+                                        TailOps::set1(v1));
+      XMMt_tail = TailOps::add(XMMt_tail, TailOps::mul(XMMwv,
+                  TailOps::sub(TailOps::load(s+d, kAlign), XMMwv)));
+    }
+  }
+  return (Ops::hsum(XMMt) + TailOps::hsum(XMMt_tail)) * 0.5;
+}
+
+// The compact latent factors of fm are stored as:
+//   feature -> w(aligned_k)
+// and the sum vector is still fp32.
+template <class Ops, class Format>
+real_t fm_score_compact(const Node* begin,
+                        const Node* end,
+                        const typename Format::type* v,
+                        const real_t* scale,
+                        const KernelShape& shape,
+                        real_t* s,
+                        real_t norm) {
+  index_t aligned_k = shape.aligned_k;
+  index_t step = Ops::kBlocks * kAlign;
+  index_t main_k = aligned_k - aligned_k % step;
+  for (const Node* iter = begin; iter != end; ++iter) {
+    index_t j1 = iter->feat_id;
+    if (j1 >= shape.num_feat) continue;
+    const typename Format::type* w = v + (offset_t)j1 * aligned_k;
+    real_t v1 = iter->feat_val * norm;
+    if (Format::kScaled) { v1 *= scale[j1]; }
+    typename Ops::reg XMMv = Ops::set1(v1);
+    index_t d = 0;
+    for (; d < main_k; d += step) {
+      Ops::store(s+d, kAlign,
+                 Ops::add(Ops::load(s+d, kAlign),
+                 Ops::mul(Format::template load<Ops>(w+d), XMMv)));
+    }
+    for (; d < aligned_k; d += kAlign) {
+      TailOps::store(s+d, kAlign,
+                     TailOps::add(TailOps::load(s+d, kAlign),
+                     TailOps::mul(Format::template load<TailOps>(w+d),
+                                  TailOps::set1(v1))));
+    }
+  }
+  typename Ops::reg XMMt = Ops::zero();
+  TailOps::reg XMMt_tail = TailOps::zero();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    index_t j1 = iter->feat_id;
+    if (j1 >= shape.num_feat) continue;
+    const typename Format::type* w = v + (offset_t)j1 * aligned_k;
+    real_t v1 = iter->feat_val * norm;
+    if (Format::kScaled) { v1 *= scale[j1]; }
+    typename Ops::reg XMMv = Ops::set1(v1);
+    index_t d = 0;
+    for (; d < main_k; d += step) {
+      typename Ops::reg XMMwv = Ops::mul(
+                                Format::template load<Ops>(w+d), XMMv);
+      XMMt = Ops::add(XMMt, Ops::mul(XMMwv,
+             Ops::sub(Ops::load(s+d, kAlign), XMMwv)));
+    }
+    for (; d < aligned_k; d += kAlign) {
+      TailOps::reg XMMwv = TailOps::mul(
+                           Format::template load<TailOps>(w+d),
+                           TailOps::set1(v1));
+      XMMt_tail = TailOps::add(XMMt_tail, TailOps::mul(XMMwv,
+                  TailOps::sub(TailOps::load(s+d, kAlign), XMMwv)));
+    }
+  }
+  return (Ops::hsum(XMMt) + TailOps::hsum(XMMt_tail)) * 0.5;
+}
+
+template <class Ops, class Format>
+real_t fm_score_half(const Node* begin,
+                     const Node* end,
+                     const uint16* v,
+                     const KernelShape& shape,
+                     real_t* s,
+                     real_t norm) {
+  return fm_score_compact<Ops, Format>(begin, end, v, nullptr,
+                                       shape, s, norm);
+}
+
+template <class Ops>
+real_t fm_score_int8(const Node* begin,
+                     const Node* end,
+                     const int8* v,
+                     const real_t* scale,
+                     const KernelShape& shape,
+                     real_t* s,
+                     real_t norm) {
+  return fm_score_compact<Ops, Int8Format>(begin, end, v, scale,
+                                           shape, s, norm);
+}
+
+// Here the stride is always kAlign, and the aux vectors
+// are aligned_k floats after w.
+template <class V>
+inline void fm_sgd_block(real_t* w, const real_t* s, index_t,
+                         real_t v1, real_t pgv,
+                         const KernelParam& param) {
+  typename V::reg XMMv = V::set1(v1);
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMlr = V::set1(param.learning_rate);
+  typename V::reg XMMlamb = V::set1(param.regu_lambda);
+  typename V::reg XMMs = V::load(s, kAlign);
+  typename V::reg XMMw = V::load(w, kAlign);
+  typename V::reg XMMg = V::add(V::mul(XMMlamb, XMMw),
+                         V::mul(XMMpgv, V::sub(XMMs,
+                         V::mul(XMMw, XMMv))));
+  V::store(w, kAlign, V::sub(XMMw, V::mul(XMMlr, XMMg)));
+}
+
+template <class V>
+inline void fm_adagrad_block(real_t* w, const real_t* s,
+                             index_t aligned_k,
+                             real_t v1, real_t pgv,
+                             const KernelParam& param) {
+  real_t* wg = w + aligned_k;
+  typename V::reg XMMv = V::set1(v1);
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMlr = V::set1(param.learning_rate);
+  typename V::reg XMMlamb = V::set1(param.regu_lambda);
+  typename V::reg XMMs = V::load(s, kAlign);
+  typename V::reg XMMw = V::load(w, kAlign);
+  typename V::reg XMMwg = V::load(wg, kAlign);
+  typename V::reg XMMg = V::add(V::mul(XMMlamb, XMMw),
+                         V::mul(XMMpgv, V::sub(XMMs,
+                         V::mul(XMMw, XMMv))));
+  XMMwg = V::add(XMMwg, V::mul(XMMg, XMMg));
+  XMMw = V::sub(XMMw, V::mul(XMMlr, V::mul(V::rsqrt(XMMwg), XMMg)));
+  V::store(w, kAlign, XMMw);
+  V::store(wg, kAlign, XMMwg);
+}
+
+template <class V>
+inline void fm_ftrl_block(real_t* w, const real_t* s,
+                          index_t aligned_k,
+                          real_t v1, real_t pgv,
+                          const KernelParam& param) {
+  real_t* wg = w + aligned_k;
+  real_t* z = w + aligned_k * 2;
+  typename V::reg XMMv = V::set1(v1);
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMalpha = V::set1(param.alpha);
+  typename V::reg XMML2 = V::set1(param.lambda_2);
+  typename V::reg XMMs = V::load(s, kAlign);
+  typename V::reg XMMw = V::load(w, kAlign);
+  typename V::reg XMMwg = V::load(wg, kAlign);
+  typename V::reg XMMz = V::load(z, kAlign);
+  typename V::reg XMMg = V::add(V::mul(XMML2, XMMw),
+                         V::mul(XMMpgv, V::sub(XMMs,
+                         V::mul(XMMw, XMMv))));
+  typename V::reg XMMnew_wg = V::add(XMMwg, V::mul(XMMg, XMMg));
+  typename V::reg XMMsqrt_wg = V::sqrt(XMMnew_wg);
+  typename V::reg XMMsigma = V::div(
+                             V::sub(XMMsqrt_wg,
+                                    V::sqrt(XMMwg)), XMMalpha);
+  XMMz = V::add(XMMz, V::sub(XMMg, V::mul(XMMsigma, XMMw)));
+  V::store(z, kAlign, XMMz);
+  V::store(wg, kAlign, XMMnew_wg);
+  V::store(w, kAlign, ftrl_weight<V>(XMMz, XMMsqrt_wg, param));
+}
+
+template <class V>
+inline void fm_ftrl_bf16_block(real_t* w, const real_t* s,
+                               index_t aligned_k,
+                               real_t v1, real_t pgv,
+                               const KernelParam& param) {
+  typename V::reg XMMv = V::set1(v1);
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMML2 = V::set1(param.lambda_2);
+  typename V::reg XMMs = V::load(s, kAlign);
+  typename V::reg XMMw = V::load(w, kAlign);
+  typename V::reg XMMg = V::add(V::mul(XMML2, XMMw),
+                         V::mul(XMMpgv, V::sub(XMMs,
+                         V::mul(XMMw, XMMv))));
+  ftrl_bf16_update<V>(w, w + aligned_k, kAlign, XMMw, XMMg, param);
+}
+
+template <class V>
+inline void fm_adam_block(real_t* w, const real_t* s,
+                          index_t aligned_k,
+                          real_t v1, real_t pgv,
+                          const KernelParam& param) {
+  typename V::reg XMMv = V::set1(v1);
+  typename V::reg XMMpgv = V::set1(pgv);
+  typename V::reg XMMlamb = V::set1(param.regu_lambda);
+  typename V::reg XMMs = V::load(s, kAlign);
+  typename V::reg XMMw = V::load(w, kAlign);
+  typename V::reg XMMg = V::add(V::mul(XMMlamb, XMMw),
+                         V::mul(XMMpgv, V::sub(XMMs,
+                         V::mul(XMMw, XMMv))));
+  adam_update<V>(w, w + aligned_k, w + aligned_k * 2, kAlign,
+                 XMMw, XMMg, param);
+}
+
+#define DEFINE_FM_GRAD_KERNEL(name)                                \
+template <class Ops, index_t kK>                                   \
+void fm_##name(const Node* begin,                                  \
+               const Node* end,                                    \
+               real_t* v,                                          \
+               const KernelShape& shape,                           \
+               const KernelParam& param,                           \
+               const real_t* s,                                    \
+               real_t pg,                                          \
+               real_t norm) {                                      \
+  KERNEL_K_FALLBACK((fm_##name<Ops, 0>(begin, end, v, shape,       \
+                                       param, s, pg, norm)))       \
+  const index_t aligned_k = kK > 0 ? kK : shape.aligned_k;         \
+  offset_t align0 = aligned_k * shape.aux_size;                    \
+  index_t step = Ops::kBlocks * kAlign;                            \
+  index_t main_k = aligned_k - aligned_k % step;                   \
+  for (const Node* iter = begin; iter != end; ++iter) {            \
+    index_t j1 = iter->feat_id;                                    \
+    if (j1 >= shape.num_feat) continue;                            \
+    real_t* w = v + j1 * align0;                                   \
+    real_t v1 = iter->feat_val * norm;                             \
+    real_t pgv = pg * v1;                                          \
+    index_t d = 0;                                                 \
+    for (; d < main_k; d += step) {                                \
+      fm_##name##_block<Ops>(w+d, s+d, aligned_k,                  \
+                             v1, pgv, param);                      \
+    }                                                              \
+    for (; d < aligned_k; d += kAlign) {                           \
+      fm_##name##_block<TailOps>(w+d, s+d, aligned_k,              \
+                                 v1, pgv, param);                  \
+    }                                                              \
+  }                                                                \
+}
+
+DEFINE_FM_GRAD_KERNEL(sgd)
+DEFINE_FM_GRAD_KERNEL(adagrad)
+DEFINE_FM_GRAD_KERNEL(ftrl)
+DEFINE_FM_GRAD_KERNEL(adam)
+DEFINE_FM_GRAD_KERNEL(ftrl_bf16)
+
+/*********************************************************
+ *  Linear kernel                                        *
+ *********************************************************/
+
+// Each Ops::gather_linear() gives w * x of the next (kBlocks * kAlign)
+// nodes, whose unseen features are masked to 0 instead of a branch of
+// each node. The gather takes the 32-bit offsets of w, so the model of
+// more than 2^31 linear values, and the nodes left over at the end,
+// are summed one by one.
+static_assert(sizeof(Node) == 3 * sizeof(int32),
+              "gather_linear() takes 3 ints of each node");
+
+template <class Ops>
+real_t linear_sum(const Node* begin,
+                  const Node* end,
+                  const real_t* w,
+                  index_t num_feat,
+                  index_t aux_size) {
+  const index_t lanes = Ops::kBlocks * kAlign;
+  const Node* iter = begin;
+  real_t sum = 0;
+  if (num_feat > 0 &&
+      (uint64)num_feat * aux_size <=
+      (uint64)std::numeric_limits<int32>::max()) {
+    typename Ops::reg XMMs = Ops::zero();
+    for (; end - iter >= lanes; iter += lanes) {
+      XMMs = Ops::add(XMMs,
+                      Ops::gather_linear(iter, w, num_feat, aux_size));
+    }
+    sum = Ops::hsum(XMMs);
+  }
+  for (; iter != end; ++iter) {
+    if (iter->feat_id >= num_feat) continue;
+    sum += w[(offset_t)iter->feat_id * aux_size] * iter->feat_val;
+  }
+  return sum;
+}
+
+// The products of each lane are added to their rows one by one,
+// which is cheap next to the gather of w.
+template <class Ops>
+void linear_rows(const index_t* id,
+                 const real_t* x,
+                 const size_t* end,
+                 size_t n,
+                 const real_t* w,
+                 index_t num_feat,
+                 index_t aux_size,
+                 real_t* out) {
+  const index_t lanes = Ops::kBlocks * kAlign;
+  size_t total = n == 0 ? 0 : end[n-1];
+  size_t i = 0, r = 0;
+  for (size_t k = 0; k < n; ++k) { out[k] = 0; }
+  if (num_feat > 0 &&
+      (uint64)num_feat * aux_size <=
+      (uint64)std::numeric_limits<int32>::max()) {
+    alignas(64) real_t product[lanes];
+    for (; i + lanes <= total; i += lanes) {
+      Ops::store(product, kAlign,
+                 Ops::gather_rows(id + i, x + i, w, num_feat, aux_size));
+      for (index_t l = 0; l < lanes; ++l) {
+        while (end[r] <= i + l) { ++r; }
+        out[r] += product[l];
+      }
+    }
+  }
+  for (; i < total; ++i) {
+    while (end[r] <= i) { ++r; }
+    if (id[i] >= num_feat) continue;
+    out[r] += w[(offset_t)id[i] * aux_size] * x[i];
+  }
+}
+
+/*********************************************************
+ *  FwFM kernels                                         *
+ *********************************************************/
+
+// The latent factors of fwfm have the layout of fm, and the
+// blocks of fm are reused: the gradient pg * v1 * (t - r * w * v1)
+// is the one of fm with the sum vector t and x_i * r in place of x_i.
+#define DEFINE_FWFM_GRAD_KERNEL(name)                              \
+template <class Ops>                                               \
+void fwfm_##name(const Node* begin,                                \
+                 const Node* end,                                  \
+                 real_t* v,                                        \
+                 const KernelShape& shape,                         \
+                 const KernelParam& param,                         \
+                 const real_t* t,                                  \
+                 real_t r,                                         \
+                 real_t pg,                                        \
+                 real_t norm) {                                    \
+  index_t aligned_k = shape.aligned_k;                             \
+  offset_t align0 = aligned_k * shape.aux_size;                    \
+  index_t step = Ops::kBlocks * kAlign;                            \
+  index_t main_k = aligned_k - aligned_k % step;                   \
+  for (const Node* iter = begin; iter != end; ++iter) {            \
+    index_t j1 = iter->feat_id;                                    \
+    if (j1 >= shape.num_feat) continue;                            \
+    real_t* w = v + j1 * align0;                                   \
+    real_t v1 = iter->feat_val * norm;                             \
+    real_t pgv = pg * v1;                                          \
+    index_t d = 0;                                                 \
+    for (; d < main_k; d += step) {                                \
+      fm_##name##_block<Ops>(w+d, t+d, aligned_k,                  \
+                             v1 * r, pgv, param);                  \
+    }                                                              \
+    for (; d < aligned_k; d += kAlign) {                           \
+      fm_##name##_block<TailOps>(w+d, t+d, aligned_k,              \
+                                 v1 * r, pgv, param);              \
+    }                                                              \
+  }                                                                \
+}
+
+DEFINE_FWFM_GRAD_KERNEL(sgd)
+DEFINE_FWFM_GRAD_KERNEL(adagrad)
+DEFINE_FWFM_GRAD_KERNEL(ftrl)
+DEFINE_FWFM_GRAD_KERNEL(adam)
+DEFINE_FWFM_GRAD_KERNEL(ftrl_bf16)
+
+#undef FFM_BLOCK_SIZE
+#undef FFM_BLOCK_SIZE_K
+#undef FFM_AUX_GAP
+#undef KERNEL_K_FALLBACK
+#undef FFM_PREFETCH_NEXT
+#undef FFM_PAIR_LOOP_BEGIN
+#undef FFM_PAIR_LOOP_BEGIN_K
+#undef FFM_PAIR_LOOP_END
+#undef FFM_UPDATE_PAIR
+#undef FFM_PAIR_BLOCKS
+#undef DEFINE_FFM_GRAD_KERNEL
+#undef DEFINE_FM_GRAD_KERNEL
+#undef DEFINE_FWFM_GRAD_KERNEL
+
+}  // namespace
+
+// Build the kernel table for the given Ops, whose fp32 ffm and fm
+// kernels are specialized for the aligned K (0 for any K).
+#define XLEARN_SCORE_KERNELS_K(name, Ops, K)     \
+  { name, K, linear_sum<Ops>, linear_rows<Ops>,  \
+    ffm_score<Ops, K>, ffm_sgd<Ops, K>,          \
+    ffm_adagrad<Ops, K>, ffm_ftrl<Ops, K>,       \
+    ffm_adam<Ops, K>,                            \
+    ffm_score_pairs<Ops, K>,                     \
+    ffm_sgd_pairs<Ops, K>,                       \
+    ffm_adagrad_pairs<Ops, K>,                   \
+    ffm_ftrl_pairs<Ops, K>,                      \
+    ffm_adam_pairs<Ops, K>,                      \
+    ffm_pair_score<Ops, K>,                      \
+    fm_sum<Ops, K>, fm_score<Ops, K>,            \
+    fm_sgd<Ops, K>, fm_adagrad<Ops, K>,          \
+    fm_ftrl<Ops, K>, fm_adam<Ops, K>,            \
+    ffm_score_half<Ops, FP16Format>,             \
+    ffm_score_half<Ops, BF16Format>,             \
+    ffm_score_int8<Ops>,                         \
+    fm_score_half<Ops, FP16Format>,              \
+    fm_score_half<Ops, BF16Format>,              \
+    fm_score_int8<Ops>,                          \
+    fwfm_sgd<Ops>, fwfm_adagrad<Ops>,            \
+    fwfm_ftrl<Ops>, fwfm_adam<Ops>,              \
+    ffm_ftrl_bf16<Ops, K>,                       \
+    ffm_ftrl_bf16_pairs<Ops, K>,                 \
+    fm_ftrl_bf16<Ops, K>, fwfm_ftrl_bf16<Ops> }
+
+#define XLEARN_SCORE_KERNELS(name, Ops) XLEARN_SCORE_KERNELS_K(name, Ops, 0)
+
+// Build the generic table and the kNumKernelK specialized
+// tables, in the order that SelectKernelTable() expects.
+#define XLEARN_SCORE_KERNEL_TABLES(name, Ops)    \
+  { XLEARN_SCORE_KERNELS_K(name, Ops, 0),        \
+    XLEARN_SCORE_KERNELS_K(name, Ops, 4),        \
+    XLEARN_SCORE_KERNELS_K(name, Ops, 8),        \
+    XLEARN_SCORE_KERNELS_K(name, Ops, 16),       \
+    XLEARN_SCORE_KERNELS_K(name, Ops, 32) }
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_SCORE_KERNEL_IMPL_H_
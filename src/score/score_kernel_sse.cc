@@ -0,0 +1,42 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file instantiates the score kernels with SSE.
+*/
+
+#include "src/base/cpu_info.h"
+
+#ifdef XLEARN_X86
+
+#include "src/score/score_kernel_impl.h"
+
+namespace xLearn {
+
+namespace {
+
+const ScoreKernels kSSEKernels[kNumKernelK + 1] =
+    XLEARN_SCORE_KERNEL_TABLES("sse", SSEOps);
+
+}  // namespace
+
+const ScoreKernels* GetSSEKernels(index_t aligned_k) {
+  return SelectKernelTable(kSSEKernels, aligned_k);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_X86
@@ -0,0 +1,723 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the SIMD kernels in score_kernel.h.
+*/
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/optimizer.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+const index_t kNumFeat = 10;
+const index_t kNumField = 4;
+
+// Relative error, since rsqrt of different instruction
+// set has different precision.
+bool NearlyEqual(real_t a, real_t b) {
+  return std::fabs(a - b) <= 1e-3 * (1.0 + std::fabs(a));
+}
+
+void InitRow(SparseRow& row) {
+  for (index_t i = 0; i < kNumFeat; ++i) {
+    row[i].feat_id = i;
+    row[i].field_id = i % kNumField;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+}
+
+void InitModel(Model& model, const std::string& score,
+               index_t k, index_t aux) {
+  // The random engine uses the default seed, and
+  // hence the models have the same value.
+  model.Initialize(score, "cross-entropy",
+                   kNumFeat, kNumField, k, aux, 0.5);
+}
+
+void CheckModel(Model& a, Model& b) {
+  real_t* va = a.GetParameter_v();
+  real_t* vb = b.GetParameter_v();
+  for (index_t i = 0; i < a.GetNumParameter_v(); ++i) {
+    EXPECT_TRUE(NearlyEqual(va[i], vb[i]));
+  }
+}
+
+KernelShape GetShape(Model& model) {
+  KernelShape shape;
+  shape.num_feat = model.GetNumFeature();
+  shape.num_field = model.GetNumField();
+  shape.aligned_k = model.get_aligned_k();
+  shape.aux_size = model.GetAuxiliarySize();
+  shape.split = model.IsSplitLayout();
+  shape.field_major = model.IsFieldMajor();
+  shape.var_k = model.GetFieldIndex().HasWidths();
+  return shape;
+}
+
+KernelParam GetParam() {
+  KernelParam param;
+  param.learning_rate = 0.1;
+  param.regu_lambda = 0.01;
+  param.alpha = 0.3;
+  param.beta = 1.0;
+  param.lambda_1 = 0.001;
+  param.lambda_2 = 0.01;
+  param.beta_1 = 0.9;
+  param.beta_2 = 0.999;
+  param.epsilon = 1e-8;
+  param.step_size = 0.05;
+  param.weight_decay = 0.001;
+  return param;
+}
+
+TEST(ScoreKernelTest, baseline_is_always_supported) {
+  EXPECT_TRUE(GetScoreKernels(kSimdBaseline) != nullptr);
+  EXPECT_TRUE(GetScoreKernels(DetectSimdLevel()) != nullptr);
+  EXPECT_STREQ(GetBestScoreKernels().name,
+               SimdLevelName(DetectSimdLevel()));
+}
+
+// Compare all the kernels supported by current CPU with the baseline
+// (SSE) kernels. Different K covers the tail blocks of the
+// wide kernels.
+TEST(ScoreKernelTest, same_as_baseline) {
+  const ScoreKernels* sse = GetScoreKernels(kSimdBaseline);
+  SimdLevel levels[2] = { kSimdAVX2, kSimdAVX512 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  KernelParam param = GetParam();
+  for (int l = 0; l < 2; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) {
+      printf("Skip %s\n", SimdLevelName(levels[l]));
+      continue;
+    }
+    for (index_t k = 1; k <= 20; ++k) {
+      // sgd, adagrad, ftrl, and adam
+      for (index_t opt = 0; opt < 4; ++opt) {
+        index_t aux = opt < 3 ? opt + 1 : 3;
+        FFMGradKernel ffm_sse[4] = { sse->ffm_sgd,
+                                     sse->ffm_adagrad,
+                                     sse->ffm_ftrl,
+                                     sse->ffm_adam };
+        FFMGradKernel ffm_simd[4] = { simd->ffm_sgd,
+                                      simd->ffm_adagrad,
+                                      simd->ffm_ftrl,
+                                      simd->ffm_adam };
+        FMGradKernel fm_sse[4] = { sse->fm_sgd,
+                                   sse->fm_adagrad,
+                                   sse->fm_ftrl,
+                                   sse->fm_adam };
+        FMGradKernel fm_simd[4] = { simd->fm_sgd,
+                                    simd->fm_adagrad,
+                                    simd->fm_ftrl,
+                                    simd->fm_adam };
+        // ffm
+        Model ffm_a, ffm_b;
+        InitModel(ffm_a, "ffm", k, aux);
+        InitModel(ffm_b, "ffm", k, aux);
+        KernelShape shape = GetShape(ffm_a);
+        real_t score_a = sse->ffm_score(begin, end,
+            ffm_a.GetParameter_v(), shape, 0.5);
+        real_t score_b = simd->ffm_score(begin, end,
+            ffm_b.GetParameter_v(), shape, 0.5);
+        EXPECT_TRUE(NearlyEqual(score_a, score_b));
+        ffm_sse[opt](begin, end, ffm_a.GetParameter_v(),
+                     shape, param, 0.2, 0.5);
+        ffm_simd[opt](begin, end, ffm_b.GetParameter_v(),
+                      shape, param, 0.2, 0.5);
+        CheckModel(ffm_a, ffm_b);
+        // fm
+        Model fm_a, fm_b;
+        InitModel(fm_a, "fm", k, aux);
+        InitModel(fm_b, "fm", k, aux);
+        shape = GetShape(fm_a);
+        std::vector<real_t> sum_a(shape.aligned_k, 0);
+        std::vector<real_t> sum_b(shape.aligned_k, 0);
+        score_a = sse->fm_score(begin, end, fm_a.GetParameter_v(),
+                                shape, sum_a.data(), 0.5);
+        score_b = simd->fm_score(begin, end, fm_b.GetParameter_v(),
+                                 shape, sum_b.data(), 0.5);
+        EXPECT_TRUE(NearlyEqual(score_a, score_b));
+        sum_a.assign(shape.aligned_k, 0);
+        sum_b.assign(shape.aligned_k, 0);
+        sse->fm_sum(begin, end, fm_a.GetParameter_v(),
+                    shape, sum_a.data(), 0.5);
+        simd->fm_sum(begin, end, fm_b.GetParameter_v(),
+                     shape, sum_b.data(), 0.5);
+        fm_sse[opt](begin, end, fm_a.GetParameter_v(),
+                    shape, param, sum_a.data(), 0.2, 0.5);
+        fm_simd[opt](begin, end, fm_b.GetParameter_v(),
+                     shape, param, sum_b.data(), 0.2, 0.5);
+        CheckModel(fm_a, fm_b);
+        // fwfm, whose t vector is any vector of aligned_k
+        FwFMGradKernel fwfm_sse[4] = { sse->fwfm_sgd,
+                                       sse->fwfm_adagrad,
+                                       sse->fwfm_ftrl,
+                                       sse->fwfm_adam };
+        FwFMGradKernel fwfm_simd[4] = { simd->fwfm_sgd,
+                                        simd->fwfm_adagrad,
+                                        simd->fwfm_ftrl,
+                                        simd->fwfm_adam };
+        Model fwfm_a, fwfm_b;
+        InitModel(fwfm_a, "fwfm", k, aux);
+        InitModel(fwfm_b, "fwfm", k, aux);
+        std::vector<real_t> t(shape.aligned_k);
+        for (index_t d = 0; d < shape.aligned_k; ++d) {
+          t[d] = 0.3 - d * 0.05;
+        }
+        fwfm_sse[opt](begin, end, fwfm_a.GetParameter_v(),
+                      shape, param, t.data(), 0.7, 0.2, 0.5);
+        fwfm_simd[opt](begin, end, fwfm_b.GetParameter_v(),
+                       shape, param, t.data(), 0.7, 0.2, 0.5);
+        CheckModel(fwfm_a, fwfm_b);
+      }
+    }
+  }
+}
+
+// With r_f_f = 1 and t = s, the fwfm kernels are the fm kernels
+// of the row, for every instruction set of current CPU.
+TEST(ScoreKernelTest, fwfm_same_as_fm) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  KernelParam param = GetParam();
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) { continue; }
+    FMGradKernel fm[4] = { simd->fm_sgd, simd->fm_adagrad,
+                           simd->fm_ftrl, simd->fm_adam };
+    FwFMGradKernel fwfm[4] = { simd->fwfm_sgd, simd->fwfm_adagrad,
+                               simd->fwfm_ftrl, simd->fwfm_adam };
+    for (index_t k = 1; k <= 20; ++k) {
+      for (index_t opt = 0; opt < 4; ++opt) {
+        index_t aux = opt < 3 ? opt + 1 : 3;
+        Model fm_model, fwfm_model;
+        InitModel(fm_model, "fm", k, aux);
+        InitModel(fwfm_model, "fwfm", k, aux);
+        KernelShape shape = GetShape(fm_model);
+        std::vector<real_t> sum(shape.aligned_k, 0);
+        simd->fm_sum(begin, end, fm_model.GetParameter_v(),
+                     shape, sum.data(), 0.5);
+        fm[opt](begin, end, fm_model.GetParameter_v(),
+                shape, param, sum.data(), 0.2, 0.5);
+        fwfm[opt](begin, end, fwfm_model.GetParameter_v(),
+                  shape, param, sum.data(), 1.0, 0.2, 0.5);
+        CheckModel(fm_model, fwfm_model);
+      }
+    }
+  }
+}
+
+// The gather of each level skips the unseen features as the scalar
+// loop does, for every length of the row around the lanes.
+TEST(ScoreKernelTest, linear_same_as_scalar) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  const index_t num_feat = 50;
+  const index_t aux = 3;
+  std::vector<real_t> w(num_feat * aux);
+  for (size_t i = 0; i < w.size(); ++i) { w[i] = 0.01 * i - 0.3; }
+  SparseRow row(40);
+  for (index_t i = 0; i < 40; ++i) {
+    // Every fifth feature is unseen, and one is out of the int32
+    row[i].feat_id = i % 5 == 4 ? num_feat + i : (i * 7) % num_feat;
+    row[i].field_id = 0;
+    row[i].feat_val = 0.5 + i * 0.1;
+  }
+  row[9].feat_id = 0x80000001;
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) { continue; }
+    for (index_t n = 0; n <= 40; ++n) {
+      real_t expected = 0;
+      for (index_t i = 0; i < n; ++i) {
+        if (row[i].feat_id >= num_feat) continue;
+        expected += w[row[i].feat_id * aux] * row[i].feat_val;
+      }
+      real_t sum = simd->linear(row.data(), row.data() + n,
+                                w.data(), num_feat, aux);
+      EXPECT_TRUE(NearlyEqual(sum, expected));
+    }
+  }
+}
+
+// The kernels unrolled for K give exactly the results of the generic
+// kernels, and the other K is passed on to the generic kernels.
+TEST(ScoreKernelTest, unrolled_same_as_generic) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  index_t unrolled_k[kNumKernelK] = { 4, 8, 16, 32 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  KernelParam param = GetParam();
+  std::vector<FFMPair> pairs_a(kNumFeat * kNumFeat);
+  std::vector<FFMPair> pairs_b(kNumFeat * kNumFeat);
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* generic = GetScoreKernels(levels[l]);
+    if (generic == nullptr) { continue; }
+    EXPECT_EQ(generic->aligned_k, 0);
+    EXPECT_EQ(GetScoreKernels(levels[l], 12), generic);
+    for (int u = 0; u < kNumKernelK; ++u) {
+      const ScoreKernels* unrolled =
+          GetScoreKernels(levels[l], unrolled_k[u]);
+      EXPECT_EQ(unrolled->aligned_k, unrolled_k[u]);
+      EXPECT_STREQ(unrolled->name, generic->name);
+      FFMGradKernel ffm_a[4] = { generic->ffm_sgd, generic->ffm_adagrad,
+                                 generic->ffm_ftrl, generic->ffm_adam };
+      FFMGradKernel ffm_b[4] = { unrolled->ffm_sgd, unrolled->ffm_adagrad,
+                                 unrolled->ffm_ftrl, unrolled->ffm_adam };
+      FFMPairGradKernel pair_a[4] = { generic->ffm_sgd_pairs,
+                                      generic->ffm_adagrad_pairs,
+                                      generic->ffm_ftrl_pairs,
+                                      generic->ffm_adam_pairs };
+      FFMPairGradKernel pair_b[4] = { unrolled->ffm_sgd_pairs,
+                                      unrolled->ffm_adagrad_pairs,
+                                      unrolled->ffm_ftrl_pairs,
+                                      unrolled->ffm_adam_pairs };
+      FMGradKernel fm_a[4] = { generic->fm_sgd, generic->fm_adagrad,
+                               generic->fm_ftrl, generic->fm_adam };
+      FMGradKernel fm_b[4] = { unrolled->fm_sgd, unrolled->fm_adagrad,
+                               unrolled->fm_ftrl, unrolled->fm_adam };
+      // The K of the table, its neighbours, and the fallback
+      for (index_t k = 1; k <= 36; ++k) {
+        for (index_t opt = 0; opt < 4; ++opt) {
+          index_t aux = opt < 3 ? opt + 1 : 3;
+          // ffm by row
+          Model a, b;
+          InitModel(a, "ffm", k, aux);
+          InitModel(b, "ffm", k, aux);
+          KernelShape shape = GetShape(a);
+          EXPECT_EQ(generic->ffm_score(begin, end, a.GetParameter_v(),
+                                       shape, 0.5),
+                    unrolled->ffm_score(begin, end, b.GetParameter_v(),
+                                        shape, 0.5));
+          ffm_a[opt](begin, end, a.GetParameter_v(),
+                     shape, param, 0.2, 0.5);
+          ffm_b[opt](begin, end, b.GetParameter_v(),
+                     shape, param, 0.2, 0.5);
+          EXPECT_EQ(0, memcmp(a.GetParameter_v(), b.GetParameter_v(),
+                    a.GetNumParameter_v() * sizeof(real_t)));
+          // ffm by the recorded pairs
+          size_t num_a = 0, num_b = 0;
+          EXPECT_EQ(generic->ffm_score_pairs(begin, end,
+                        a.GetParameter_v(), shape, 0.5,
+                        pairs_a.data(), &num_a),
+                    unrolled->ffm_score_pairs(begin, end,
+                        b.GetParameter_v(), shape, 0.5,
+                        pairs_b.data(), &num_b));
+          EXPECT_EQ(num_a, num_b);
+          EXPECT_EQ(generic->ffm_pair_score(pairs_a.data(), num_a,
+                        a.GetParameter_v(), shape),
+                    unrolled->ffm_pair_score(pairs_b.data(), num_b,
+                        b.GetParameter_v(), shape));
+          pair_a[opt](pairs_a.data(), num_a, a.GetParameter_v(),
+                      shape, param, 0.2);
+          pair_b[opt](pairs_b.data(), num_b, b.GetParameter_v(),
+                      shape, param, 0.2);
+          EXPECT_EQ(0, memcmp(a.GetParameter_v(), b.GetParameter_v(),
+                    a.GetNumParameter_v() * sizeof(real_t)));
+          // fm
+          Model fm_ma, fm_mb;
+          InitModel(fm_ma, "fm", k, aux);
+          InitModel(fm_mb, "fm", k, aux);
+          shape = GetShape(fm_ma);
+          std::vector<real_t> sum_a(shape.aligned_k, 0);
+          std::vector<real_t> sum_b(shape.aligned_k, 0);
+          EXPECT_EQ(generic->fm_score(begin, end, fm_ma.GetParameter_v(),
+                                      shape, sum_a.data(), 0.5),
+                    unrolled->fm_score(begin, end, fm_mb.GetParameter_v(),
+                                       shape, sum_b.data(), 0.5));
+          EXPECT_TRUE(sum_a == sum_b);
+          fm_a[opt](begin, end, fm_ma.GetParameter_v(),
+                    shape, param, sum_a.data(), 0.2, 0.5);
+          fm_b[opt](begin, end, fm_mb.GetParameter_v(),
+                    shape, param, sum_b.data(), 0.2, 0.5);
+          EXPECT_EQ(0, memcmp(fm_ma.GetParameter_v(),
+                              fm_mb.GetParameter_v(),
+                              fm_ma.GetNumParameter_v() * sizeof(real_t)));
+        }
+      }
+    }
+  }
+}
+
+// The ffm kernels of the split layout give exactly the
+// results of the interleaved layout.
+TEST(ScoreKernelTest, split_same_as_interleaved) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  KernelParam param = GetParam();
+  std::vector<index_t> ids;
+  for (index_t j = 0; j < kNumFeat; ++j) { ids.push_back(j); }
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) { continue; }
+    FFMGradKernel ffm[4] = { simd->ffm_sgd, simd->ffm_adagrad,
+                             simd->ffm_ftrl, simd->ffm_adam };
+    for (index_t k = 1; k <= 20; ++k) {
+      for (index_t opt = 1; opt < 4; ++opt) {
+        index_t aux = opt < 3 ? opt + 1 : 3;
+        Model a, b;
+        InitModel(a, "ffm", k, aux);
+        b.SetSplitLayout(true);
+        InitModel(b, "ffm", k, aux);
+        ASSERT_TRUE(b.IsSplitLayout());
+        KernelShape shape_a = GetShape(a);
+        KernelShape shape_b = GetShape(b);
+        EXPECT_EQ(simd->ffm_score(begin, end, a.GetParameter_v(),
+                                  shape_a, 0.5),
+                  simd->ffm_score(begin, end, b.GetParameter_v(),
+                                  shape_b, 0.5));
+        ffm[opt](begin, end, a.GetParameter_v(),
+                 shape_a, param, 0.2, 0.5);
+        ffm[opt](begin, end, b.GetParameter_v(),
+                 shape_b, param, 0.2, 0.5);
+        // Both in the interleaved layout
+        std::vector<real_t> value_a(ids.size() * a.GetFeatureSize());
+        std::vector<real_t> value_b(value_a.size());
+        a.GetFeatures(ids, value_a.data());
+        b.GetFeatures(ids, value_b.data());
+        EXPECT_TRUE(value_a == value_b);
+      }
+    }
+  }
+}
+
+// The ffm kernels of the field-major layout, both the generic
+// and the unrolled ones, give exactly the results of the
+// feature-major layout.
+TEST(ScoreKernelTest, field_major_same_as_feature_major) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  KernelParam param = GetParam();
+  std::vector<index_t> ids;
+  for (index_t j = 0; j < kNumFeat; ++j) { ids.push_back(j); }
+  for (int l = 0; l < 3; ++l) {
+    if (GetScoreKernels(levels[l]) == nullptr) { continue; }
+    for (index_t k = 1; k <= 20; ++k) {
+      for (index_t opt = 0; opt < 4; ++opt) {
+        index_t aux = opt < 3 ? opt + 1 : 3;
+        Model a, b;
+        InitModel(a, "ffm", k, aux);
+        b.SetFieldMajor(true);
+        InitModel(b, "ffm", k, aux);
+        ASSERT_TRUE(b.IsFieldMajor());
+        const ScoreKernels* simd = GetScoreKernels(levels[l],
+                                                   a.get_aligned_k());
+        FFMGradKernel ffm[4] = { simd->ffm_sgd, simd->ffm_adagrad,
+                                 simd->ffm_ftrl, simd->ffm_adam };
+        KernelShape shape_a = GetShape(a);
+        KernelShape shape_b = GetShape(b);
+        EXPECT_EQ(simd->ffm_score(begin, end, a.GetParameter_v(),
+                                  shape_a, 0.5),
+                  simd->ffm_score(begin, end, b.GetParameter_v(),
+                                  shape_b, 0.5));
+        ffm[opt](begin, end, a.GetParameter_v(),
+                 shape_a, param, 0.2, 0.5);
+        ffm[opt](begin, end, b.GetParameter_v(),
+                 shape_b, param, 0.2, 0.5);
+        // Both in the feature-major layout
+        std::vector<real_t> value_a(ids.size() * a.GetFeatureSize());
+        std::vector<real_t> value_b(value_a.size());
+        a.GetFeatures(ids, value_a.data());
+        b.GetFeatures(ids, value_b.data());
+        EXPECT_TRUE(value_a == value_b);
+      }
+    }
+  }
+}
+
+// The nodes of consecutive ids of fm are summed as a dense run,
+// which gives exactly the sum of the nodes one by one.
+TEST(ScoreKernelTest, dense_run_same_as_nodes) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  for (int l = 0; l < 3; ++l) {
+    if (GetScoreKernels(levels[l]) == nullptr) { continue; }
+    for (index_t k = 1; k <= 20; ++k) {
+      for (index_t aux = 1; aux <= 3; ++aux) {
+        Model model;
+        InitModel(model, "fm", k, aux);
+        index_t aligned_k = model.get_aligned_k();
+        const ScoreKernels* simd = GetScoreKernels(levels[l], aligned_k);
+        KernelShape shape = GetShape(model);
+        std::vector<real_t> sum(aligned_k, 0), sum_nodes(aligned_k, 0);
+        simd->fm_sum(begin, end, model.GetParameter_v(),
+                     shape, sum.data(), 0.5);
+        for (const Node* iter = begin; iter != end; ++iter) {
+          simd->fm_sum(iter, iter + 1, model.GetParameter_v(),
+                       shape, sum_nodes.data(), 0.5);
+        }
+        EXPECT_TRUE(sum == sum_nodes);
+      }
+    }
+  }
+}
+
+// Round the latent factors of the model to the 16-bit type,
+// so the fp32 kernels see the same values as the 16-bit ones.
+void RoundModel(Model& model, StorageType type) {
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = Float16ToFloat(FloatTo16(v[i], type), type);
+  }
+}
+
+// The 16-bit kernels of every instruction set give the
+// same score as the fp32 kernels on the rounded model.
+TEST(ScoreKernelTest, half_same_as_fp32) {
+  const ScoreKernels* sse = GetScoreKernels(kSimdBaseline);
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  StorageType types[2] = { kStoreFP16, kStoreBF16 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) {
+      printf("Skip %s\n", SimdLevelName(levels[l]));
+      continue;
+    }
+    for (int t = 0; t < 2; ++t) {
+      FFMHalfScoreKernel ffm_half = types[t] == kStoreBF16 ?
+          simd->ffm_score_bf16 : simd->ffm_score_fp16;
+      FMHalfScoreKernel fm_half = types[t] == kStoreBF16 ?
+          simd->fm_score_bf16 : simd->fm_score_fp16;
+      for (index_t k = 1; k <= 20; ++k) {
+        // ffm
+        Model ffm_a, ffm_b;
+        InitModel(ffm_a, "ffm", k, 2);
+        InitModel(ffm_b, "ffm", k, 2);
+        RoundModel(ffm_a, types[t]);
+        ffm_b.ConvertLatent(types[t]);
+        real_t score_a = sse->ffm_score(begin, end,
+            ffm_a.GetParameter_v(), GetShape(ffm_a), 0.5);
+        KernelShape shape = GetShape(ffm_b);
+        shape.aux_size = 1;
+        real_t score_b = ffm_half(begin, end,
+            ffm_b.GetParameter_v_half(), shape, 0.5);
+        EXPECT_TRUE(NearlyEqual(score_a, score_b));
+        // fm
+        Model fm_a, fm_b;
+        InitModel(fm_a, "fm", k, 3);
+        InitModel(fm_b, "fm", k, 3);
+        RoundModel(fm_a, types[t]);
+        fm_b.ConvertLatent(types[t]);
+        shape = GetShape(fm_a);
+        std::vector<real_t> sum_a(shape.aligned_k, 0);
+        std::vector<real_t> sum_b(shape.aligned_k, 0);
+        score_a = sse->fm_score(begin, end, fm_a.GetParameter_v(),
+                                shape, sum_a.data(), 0.5);
+        shape.aux_size = 1;
+        score_b = fm_half(begin, end, fm_b.GetParameter_v_half(),
+                          shape, sum_b.data(), 0.5);
+        EXPECT_TRUE(NearlyEqual(score_a, score_b));
+      }
+    }
+  }
+}
+
+// Copy the dequantized int8 latent factors of b to a, so the
+// fp32 kernels see the same values as the int8 ones.
+void DequantizeModel(Model& a, Model& b) {
+  real_t* v = a.GetParameter_v();
+  int8* q = b.GetParameter_v_int8();
+  real_t* scale = b.GetParameter_v_scale();
+  bool is_ffm = a.GetScoreFunction() == "ffm";
+  index_t k_aligned = a.get_aligned_k();
+  index_t aux = a.GetAuxiliarySize();
+  index_t num_row = a.GetNumParameter_v() / (k_aligned*aux);
+  for (index_t r = 0; r < num_row; ++r) {
+    real_t* w = v + r*k_aligned*aux;
+    for (index_t d = 0; d < k_aligned; ++d) {
+      index_t idx = is_ffm ? (d/kAlign)*kAlign*aux + d%kAlign : d;
+      w[idx] = q[r*k_aligned+d] * scale[r];
+    }
+  }
+}
+
+TEST(ScoreKernelTest, int8_same_as_fp32) {
+  const ScoreKernels* sse = GetScoreKernels(kSimdBaseline);
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  SparseRow row(kNumFeat);
+  InitRow(row);
+  const Node* begin = row.data();
+  const Node* end = row.data() + row.size();
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) {
+      printf("Skip %s\n", SimdLevelName(levels[l]));
+      continue;
+    }
+    for (index_t k = 1; k <= 20; ++k) {
+      // ffm
+      Model ffm_a, ffm_b;
+      InitModel(ffm_a, "ffm", k, 2);
+      InitModel(ffm_b, "ffm", k, 2);
+      ffm_b.ConvertLatent(kStoreInt8);
+      DequantizeModel(ffm_a, ffm_b);
+      real_t score_a = sse->ffm_score(begin, end,
+          ffm_a.GetParameter_v(), GetShape(ffm_a), 0.5);
+      KernelShape shape = GetShape(ffm_b);
+      shape.aux_size = 1;
+      real_t score_b = simd->ffm_score_int8(begin, end,
+          ffm_b.GetParameter_v_int8(),
+          ffm_b.GetParameter_v_scale(), shape, 0.5);
+      EXPECT_TRUE(NearlyEqual(score_a, score_b));
+      // fm
+      Model fm_a, fm_b;
+      InitModel(fm_a, "fm", k, 3);
+      InitModel(fm_b, "fm", k, 3);
+      fm_b.ConvertLatent(kStoreInt8);
+      DequantizeModel(fm_a, fm_b);
+      shape = GetShape(fm_a);
+      std::vector<real_t> sum_a(shape.aligned_k, 0);
+      std::vector<real_t> sum_b(shape.aligned_k, 0);
+      score_a = sse->fm_score(begin, end, fm_a.GetParameter_v(),
+                              shape, sum_a.data(), 0.5);
+      shape.aux_size = 1;
+      score_b = simd->fm_score_int8(begin, end,
+          fm_b.GetParameter_v_int8(),
+          fm_b.GetParameter_v_scale(), shape, sum_b.data(), 0.5);
+      EXPECT_TRUE(NearlyEqual(score_a, score_b));
+    }
+  }
+}
+
+// The SIMD kernels of the given optimizer are the same as its
+// scalar Update() for each latent value of fm. The z of ftrl is
+// set on both sides of lambda_1, so part of the weights fall into
+// the zero branch of the masked update. For the bf16 state of
+// ftrl, z is kept in the high half of the 2nd aux value, and the
+// values are compared after they are unpacked.
+template <class Optimizer>
+void CheckSameAsScalar(const KernelParam& param, real_t* z_value,
+                       bool bf16 = false) {
+  SimdLevel levels[3] = { kSimdBaseline, kSimdAVX2, kSimdAVX512 };
+  SparseRow row(1);
+  row[0].feat_id = 3;
+  row[0].field_id = 0;
+  row[0].feat_val = 0.8;
+  real_t pg = 0.2, norm = 0.5;
+  for (int l = 0; l < 3; ++l) {
+    const ScoreKernels* simd = GetScoreKernels(levels[l]);
+    if (simd == nullptr) {
+      printf("Skip %s\n", SimdLevelName(levels[l]));
+      continue;
+    }
+    for (index_t k = 1; k <= 20; ++k) {
+      Model fm_a, fm_b;
+      real_t aux_value = bf16 ? PackBF16(1.0, 1.0) : 1.0;
+      fm_a.Initialize("fm", "cross-entropy", kNumFeat, kNumField, k,
+                      Optimizer::kAuxSize, 0.5, false, aux_value);
+      fm_b.Initialize("fm", "cross-entropy", kNumFeat, kNumField, k,
+                      Optimizer::kAuxSize, 0.5, false, aux_value);
+      KernelShape shape = GetShape(fm_a);
+      index_t aligned_k = shape.aligned_k;
+      index_t aux = Optimizer::kAuxSize;
+      std::vector<real_t> sum(aligned_k);
+      // The 3rd feature
+      real_t* w_a = fm_a.GetParameter_v() + 3 * aligned_k * aux;
+      real_t* w = fm_b.GetParameter_v() + 3 * aligned_k * aux;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        sum[d] = (d % 3 == 0 ? -0.1 : 0.05) * (d + 1);
+        if (z_value != nullptr && bf16) {
+          w_a[d+aligned_k] = w[d+aligned_k] = PackBF16(1.0, z_value[d % 2]);
+        } else if (z_value != nullptr) {
+          w_a[d+aligned_k*2] = w[d+aligned_k*2] = z_value[d % 2];
+        }
+      }
+      Optimizer::FMKernel(*simd)(row.data(), row.data() + 1,
+                                 fm_a.GetParameter_v(), shape,
+                                 param, sum.data(), pg, norm);
+      // The scalar update of [w, aux...] for each d
+      real_t v1 = row[0].feat_val * norm;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        real_t state[3];
+        for (index_t a = 0; a < aux; ++a) {
+          state[a] = w[d+aligned_k*a];
+        }
+        real_t g = Optimizer::Lambda(param) * state[0] +
+                   pg * v1 * (sum[d] - state[0] * v1);
+        Optimizer::Update(state, g, param);
+        for (index_t a = 0; a < aux; ++a) {
+          w[d+aligned_k*a] = state[a];
+        }
+      }
+      if (!bf16) {
+        CheckModel(fm_a, fm_b);
+        continue;
+      }
+      // The rounding of the two sides can differ by one bit of bf16
+      for (index_t d = 0; d < aligned_k; ++d) {
+        real_t a[3] = { w_a[d], LowBF16(w_a[d+aligned_k]),
+                        HighBF16(w_a[d+aligned_k]) };
+        real_t b[3] = { w[d], LowBF16(w[d+aligned_k]),
+                        HighBF16(w[d+aligned_k]) };
+        for (int i = 0; i < 3; ++i) {
+          EXPECT_NEAR(a[i], b[i], 1e-2 * (1.0 + std::fabs(a[i])));
+        }
+      }
+    }
+  }
+}
+
+TEST(ScoreKernelTest, ftrl_same_as_scalar) {
+  KernelParam param = GetParam();
+  param.lambda_1 = 0.5;
+  real_t z_value[2] = { 0.1, -1.0 };
+  CheckSameAsScalar<FTRLOptimizer>(param, z_value);
+}
+
+TEST(ScoreKernelTest, ftrl_bf16_same_as_scalar) {
+  KernelParam param = GetParam();
+  param.lambda_1 = 0.5;
+  real_t z_value[2] = { 0.1, -1.0 };
+  CheckSameAsScalar<FTRLBF16Optimizer>(param, z_value, true);
+}
+
+TEST(ScoreKernelTest, adam_same_as_scalar) {
+  CheckSameAsScalar<AdamOptimizer>(GetParam(), nullptr);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the configurations of the --autotune option, which
+are timed on a sample of the training data (see Solver::autotune).
+*/
+
+#ifndef XLEARN_SOLVER_AUTOTUNE_H_
+#define XLEARN_SOLVER_AUTOTUNE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+// A configuration of --autotune, which is the options that change
+// the speed of the training, but not the model it learns (except
+// the order of the lock-free updates).
+struct TuneConfig {
+  size_t num_thread;
+  int prefetch;
+  std::string partition;
+  bool lock_free;
+  /* The layout of the latent vectors of the dense ffm */
+  bool split_ffm;
+  bool field_major;
+};
+
+// The options are tuned one after another, and each one is tried
+// with the best values of the options before it, so the number of
+// the trials is the sum (not the product) of the number of values.
+enum TuneOption {
+  kTuneThread = 0,
+  kTunePrefetch = 1,
+  kTunePartition = 2,
+  kTuneLockFree = 3,
+  kTuneLayout = 4,
+  kNumTuneOption = 5
+};
+
+// Return the configurations of the option, which are the best
+// configuration with each value of the option. The threads are the
+// powers of two up to max_thread and max_thread itself, and the
+// layouts are only tried for the dense ffm.
+inline std::vector<TuneConfig> TuneCandidates(TuneOption option,
+                                              const TuneConfig& best,
+                                              size_t max_thread,
+                                              bool dense_ffm) {
+  static const int kPrefetch[] = { 0, 2, 4, 8, 16 };
+  static const char* kPartition[] = { "row", "nnz", "dynamic" };
+  std::vector<TuneConfig> configs;
+  TuneConfig config = best;
+  switch (option) {
+    case kTuneThread:
+      for (size_t n = 1; n < max_thread; n *= 2) {
+        config.num_thread = n;
+        configs.push_back(config);
+      }
+      config.num_thread = max_thread;
+      configs.push_back(config);
+      break;
+    case kTunePrefetch:
+      for (int pf : kPrefetch) {
+        config.prefetch = pf;
+        configs.push_back(config);
+      }
+      break;
+    case kTunePartition:
+      for (const char* part : kPartition) {
+        config.partition = part;
+        configs.push_back(config);
+      }
+      break;
+    case kTuneLockFree:
+      config.lock_free = true;
+      configs.push_back(config);
+      config.lock_free = false;
+      configs.push_back(config);
+      break;
+    case kTuneLayout:
+      if (!dense_ffm) { break; }
+      config.split_ffm = false;
+      config.field_major = false;
+      configs.push_back(config);
+      config.split_ffm = true;
+      configs.push_back(config);
+      config.split_ffm = false;
+      config.field_major = true;
+      configs.push_back(config);
+      break;
+    default:
+      break;
+  }
+  return configs;
+}
+
+// The options of a configuration on the command line,
+// e.g., "-nthread 8 -pf 4 -part nnz --split-ffm".
+inline std::string TuneName(const TuneConfig& config) {
+  std::string name = StringPrintf("-nthread %lu -pf %d -part %s",
+                                  config.num_thread, config.prefetch,
+                                  config.partition.c_str());
+  if (!config.lock_free) { name += " --dis-lock-free"; }
+  if (config.split_ffm) { name += " --split-ffm"; }
+  if (config.field_major) { name += " --field-major"; }
+  return name;
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_AUTOTUNE_H_
@@ -0,0 +1,153 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the BatchScorer class.
+*/
+
+#include "src/solver/batch_scorer.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "src/base/phase_timer.h"
+
+namespace xLearn {
+
+// Start the background thread of the batches
+void BatchScorer::Initialize(Loss* loss, Model* model,
+                             int window_us, index_t max_rows) {
+  CHECK_NOTNULL(loss);
+  CHECK_NOTNULL(model);
+  CHECK_GE(window_us, 0);
+  CHECK_GT(max_rows, 0);
+  Stop();
+  loss_ = loss;
+  model_ = model;
+  window_us_ = window_us;
+  max_rows_ = max_rows;
+  stop_ = false;
+  thread_ = std::thread(&BatchScorer::run, this);
+}
+
+// Predict the rows of the matrix in the next batch
+void BatchScorer::Predict(const DMatrix* matrix, real_t* out,
+                          PredictTiming* timing) {
+  CHECK_NOTNULL(matrix);
+  CHECK(thread_.joinable());
+  if (matrix->row_length == 0) { return; }
+  Request request = { matrix, out, false, WallSeconds(), 0, 0 };
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.push_back(&request);
+    waiting_rows_ += matrix->row_length;
+    request_cv_.notify_one();
+    done_cv_.wait(lock, [&request]() { return request.done; });
+  }
+  if (timing != nullptr) {
+    timing->queue = request.started - request.queued;
+    timing->score = request.scored - request.started;
+    timing->copy = WallSeconds() - request.scored;
+  }
+}
+
+// Finish the waiting requests and stop the background thread
+void BatchScorer::Stop() {
+  if (!thread_.joinable()) { return; }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  request_cv_.notify_one();
+  thread_.join();
+}
+
+// The loop of the background thread
+void BatchScorer::run() {
+  std::vector<Request*> batch;
+  for (;;) {
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      request_cv_.wait(lock, [this]() {
+        return stop_ || !queue_.empty();
+      });
+      if (queue_.empty()) { return; }
+      // Wait for more requests of the batch within the window
+      auto deadline = std::chrono::steady_clock::now() +
+                      std::chrono::microseconds(window_us_);
+      request_cv_.wait_until(lock, deadline, [this]() {
+        return stop_ || waiting_rows_ >= max_rows_;
+      });
+      index_t rows = 0;
+      while (!queue_.empty()) {
+        index_t len = queue_.front()->matrix->row_length;
+        if (!batch.empty() && rows + len > max_rows_) { break; }
+        batch.push_back(queue_.front());
+        queue_.pop_front();
+        rows += len;
+      }
+      waiting_rows_ -= rows;
+    }
+    double started = WallSeconds();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      batch[i]->started = started;
+    }
+    predict_batch(batch);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->done = true;
+      }
+    }
+    done_cv_.notify_all();
+  }
+}
+
+// Predict the requests of one batch
+void BatchScorer::predict_batch(const std::vector<Request*>& batch) {
+  if (batch.size() == 1) {
+    loss_->Predict(batch[0]->matrix, *model_, batch[0]->out);
+    batch[0]->scored = WallSeconds();
+    return;
+  }
+  // The rows are borrowed, and the vectors are kept for the
+  // next batch, so the matrix is not allocated by ReAlloc()
+  matrix_.row.clear();
+  matrix_.norm.clear();
+  for (size_t i = 0; i < batch.size(); ++i) {
+    const DMatrix* m = batch[i]->matrix;
+    matrix_.row.insert(matrix_.row.end(), m->row.begin(),
+                       m->row.begin() + m->row_length);
+    matrix_.norm.insert(matrix_.norm.end(), m->norm.begin(),
+                        m->norm.begin() + m->row_length);
+  }
+  matrix_.row_length = matrix_.row.size();
+  pred_.resize(matrix_.row_length);
+  loss_->Predict(&matrix_, *model_, pred_.data());
+  double scored = WallSeconds();
+  size_t pos = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    size_t len = batch[i]->matrix->row_length;
+    memcpy(batch[i]->out, pred_.data() + pos, len * sizeof(real_t));
+    batch[i]->scored = scored;
+    pos += len;
+  }
+  // The rows belong to the callers
+  std::fill(matrix_.row.begin(), matrix_.row.end(), nullptr);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,133 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the BatchScorer class.
+*/
+
+#ifndef XLEARN_SOLVER_BATCH_SCORER_H_
+#define XLEARN_SOLVER_BATCH_SCORER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/loss.h"
+
+namespace xLearn {
+
+// The seconds of the phases of one BatchScorer::Predict() call: the
+// wait in the queue until its batch is started, the scoring of the
+// batch, and the copy of its results until the caller wakes up.
+struct PredictTiming {
+  double queue = 0;
+  double score = 0;
+  double copy = 0;
+};
+
+//------------------------------------------------------------------------------
+// BatchScorer serves the predictions of many caller threads by one
+// shared read-only model. The requests arriving within a short window
+// are coalesced into one batch, which is predicted over the thread pool
+// of the loss by a background thread, so the small requests of an RPC
+// server use all the threads with one round trip to the pool.
+// Predict() blocks until the predictions of its rows are written.
+//
+//   BatchScorer scorer;
+//   scorer.Initialize(loss, model, 200, 4096);
+//   /* in each caller thread */
+//   scorer.Predict(matrix, out);
+//
+// A batch is started after window_us microseconds since its first
+// request, or as soon as max_rows rows are waiting, and a request is
+// never split. The rows are borrowed from the matrices of the callers.
+//------------------------------------------------------------------------------
+class BatchScorer {
+ public:
+  // Constructor and Destructor
+  BatchScorer()
+    : loss_(nullptr),
+      model_(nullptr),
+      window_us_(0),
+      max_rows_(0),
+      waiting_rows_(0),
+      stop_(false) { }
+  ~BatchScorer() { Stop(); }
+
+  // Start the background thread of the batches
+  void Initialize(Loss* loss, Model* model,
+                  int window_us, index_t max_rows);
+
+  // Predict the rows of the matrix in the next batch, and write
+  // the matrix->row_length raw scores to out. It can be called by
+  // many threads at the same time. If timing is not nullptr, it is
+  // set to the seconds of the phases of this call.
+  void Predict(const DMatrix* matrix, real_t* out,
+               PredictTiming* timing = nullptr);
+
+  // Finish the waiting requests and stop the background thread.
+  void Stop();
+
+ protected:
+  /* One call of Predict() */
+  struct Request {
+    const DMatrix* matrix;
+    real_t* out;
+    bool done;
+    /* The times (WallSeconds) that the request is queued,
+    that its batch is started, and that its batch is scored */
+    double queued;
+    double started;
+    double scored;
+  };
+
+  Loss* loss_;
+  Model* model_;
+  int window_us_;
+  index_t max_rows_;
+  /* The requests that are not batched yet */
+  std::deque<Request*> queue_;
+  index_t waiting_rows_;
+  bool stop_;
+  /* Guard the queue and the done flags */
+  std::mutex mutex_;
+  /* Wake up the background thread */
+  std::condition_variable request_cv_;
+  /* Wake up the callers of a finished batch */
+  std::condition_variable done_cv_;
+  std::thread thread_;
+  /* The batch borrows the rows of the requests */
+  DMatrix matrix_;
+  std::vector<real_t> pred_;
+
+  // The loop of the background thread
+  void run();
+
+  // Predict the requests of one batch
+  void predict_batch(const std::vector<Request*>& batch);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BatchScorer);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_BATCH_SCORER_H_
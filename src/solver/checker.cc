@@ -22,12 +22,24 @@ This file is the implementation of the Checker class.
 #include <cstdlib>
 #include <algorithm>
 #include <cstdio>
+#include <cctype>
 
 #include "src/base/common.h"
 #include "src/base/format_print.h"
 #include "src/solver/checker.h"
 #include "src/base/levenshtein_distance.h"
 #include "src/base/file_util.h"
+#include "src/base/split_string.h"
+#include "src/base/half.h"
+#include "src/reader/columnar.h"
+#include "src/reader/parser.h"
+#include "src/data/field_index.h"
+#include "src/score/ffm_score.h"
+#include "src/base/mem_alloc.h"
+#include "src/loss/loss.h"
+#include "src/distributed/transport.h"
+#include "src/solver/line_source.h"
+#include "src/solver/sweep.h"
 
 namespace xLearn {
 
@@ -40,6 +52,10 @@ USAGE:
      xlearn_train <train_file_path> [OPTIONS] 
                                                     
  e.g.,  xlearn_train train_data.txt -s 0 -v validate_data.txt -r 0.1
+
+ The <train_file_path> can also be a comma-separated list of files, a glob such as 
+ './day-*.txt' (quoted), a directory of the files, or '@manifest.txt' (a file of their 
+ paths, one per line), which are trained as one dataset without putting them together. 
                                                                     
 OPTIONS: 
   -s <type> : Type of machine learning model (default 0) 
@@ -47,17 +63,27 @@ OPTIONS:
          0 -- linear model (GLM) 
          1 -- factorization machines (FM) 
          2 -- field-aware factorization machines (FFM) 
+         6 -- field-weighted factorization machines (FwFM) 
      for regression task: 
          3 -- linear model (GLM) 
          4 -- factorization machines (FM) 
          5 -- field-aware factorization machines (FFM) 
+         7 -- field-weighted factorization machines (FwFM) 
                                                                             
   -x <metric>          :  The metric can be 'acc', 'prec', 'recall', 'f1', 'auc' (classification), and 
                           'mae', 'mape', 'rmsd (rmse)' (regression). On defaurt, xLearn will not print 
                           any evaluation metric information.                                            
+                          'gauc' is the AUC of each group averaged by the group sizes, where the group 
+                          of a row is given by 'qid:<id>' after the label (libsvm and libffm only). 
+                          A list of them (e.g., 'auc,acc,f1') is evaluated by one pass over the 
+                          validation data, and the first one is used by early-stopping. 
                                                                                                       
-  -p <opt_method>      :  Choose the optimization method, including 'sgd', adagrad', and 'ftrl'. On default, 
-                          we use the adagrad optimization. 
+  -p <opt_method>      :  Choose the optimization method, including 'sgd', adagrad', 'ftrl', 'adam', 
+                          and 'adamw'. On default, we use the adagrad optimization. 
+                                                                                                 
+  -opt_state <type>    :  Storage type of the optimizer state, which can be 'fp32' (by default) or 
+                          'bf16'. The bf16 state keeps both aux values of ftrl in one float, which 
+                          cuts the memory of the model by a third. It only works with -p ftrl. 
                                                                                                  
   -v <validate_file>   :  Path of the validation data file. This option will be empty by default, 
                           and in this way, the xLearn will not perform validation. 
@@ -70,6 +96,22 @@ OPTIONS:
 
   -t <txt_model_file>  :  Path of the txt model checkpoint file. On default, this option is empty 
                           and xLearn will not dump the txt model. 
+
+  -im <inference_file> :  Path of the inference model file, which only keeps the model without 
+                          the gradient cache of the optimizer. xlearn_predict can load it just 
+                          like the model checkpoint file, and it maps the file instead of reading 
+                          it, so the model is ready at once. On default, this option is empty and 
+                          xLearn will not dump the inference model. 
+
+  -latent <type>       :  Storage type of the latent factors in the inference model file, which 
+                          can be 'fp32', 'fp16', 'bf16', or 'int8'. Using 'fp32' by default. 
+                                                                             
+  -prune <threshold>   :  Drop the latent vectors whose L2 norm is below <threshold> from the model 
+                          before it is saved (-m, -t and -im), e.g., the vectors of a strong L1 of ftrl 
+                          (-lambda_1). The ffm model keeps the rest in the sparse layout of --sparse-ffm, 
+                          which is smaller and faster to score, and the vectors of fm and fwfm are set 
+                          to zero. Using 0 (off) by default. It does not work with -shm, and not with 
+                          --sparse-model for ffm. 
                                                                              
   -l <log_file>        :  Path of the log file. Using '/tmp/xlearn_log/' by default. 
                                                                                        
@@ -93,6 +135,10 @@ OPTIONS:
                                                                        
   -lambda_2            :  Used by ftrl.                                
                                                                       
+  -beta_1              :  Decay of the first moment, used by adam and adamw. Using 0.9 by default. 
+                                                                      
+  -beta_2              :  Decay of the second moment, used by adam and adamw. Using 0.999 by default. 
+                                                                      
   -u <model_scale>     :  Hyper parameter used for initialize model parameters. 
                           Using 0.66 by default. 
                                                                                   
@@ -100,15 +146,292 @@ OPTIONS:
                           perform early-stopping by default, so this value is just a upper bound. 
                                                                                        
   -f <fold_number>     :  Number of folds for cross-validation. Using 5 by default.      
+
+  -read_jobs <number>  :  Number of the files of a training list parsed at the same time. The on-disk 
+                          training (--disk) reads the next files ahead of current one, and the order 
+                          of the files is shuffled in each epoch. Using 2 by default. 
+
+  -cv_jobs <number>    :  Number of folds of cross-validation trained at the same time. The threads 
+                          of -nthread are split evenly across the folds, and each of them needs its 
+                          own model in memory. Using 1 by default. 
+
+  -sweep <grid>        :  Train a model for each configuration of the grid over the same data, which is 
+                          read only once, e.g., 'k=4,8:r=0.1,0.2' gives the four configurations of -k 
+                          and -r, and the options that are not in the grid (k, r and b for -b) keep their 
+                          values. The result of each configuration on the validation data (-v) is shown, 
+                          and the model of the best one is saved. It only works with the in-memory 
+                          training, and not with --cv, -ps_hosts, -shm, -pre, -ckpt and -stop_file. 
+
+  -sweep_jobs <number> :  Number of configurations of -sweep trained at the same time. The threads of 
+                          -nthread are split evenly across them, and each of them needs its own model 
+                          in memory. Using 1 by default. 
+
+  -ps_hosts <list>     :  Train on several machines, where <list> is the host:port of each node, 
+                          e.g., 'node0:9000,node1:9000'. Each node runs xlearn_train with the same 
+                          options and its own part of the training data, and keeps a shard of the 
+                          model, which the others pull and push over TCP. Only the node of -ps_rank 0 
+                          saves the model. The validation loss and metrics are the ones of the validation 
+                          data (-v) of all the nodes. Cross-validation and early-stopping are not supported. 
+
+  -ps_rank <rank>      :  Rank of this node in -ps_hosts, from 0. Using 0 by default. 
+
+  -ps_batch <rows>     :  Number of rows of each pull and push of the distributed training. Using 
+                          10000 by default. 
+
+  -ps_timeout <seconds> : Seconds to wait for the other nodes to start. Using 300 by default. 
+
+  -ps_staleness <n>    :  Train the nodes asynchronously, where a node can be at most <n> mini-batches 
+                          of -ps_batch ahead of the slowest node, and the nodes only wait for each 
+                          other at the end of the training. The training loss of each epoch is the 
+                          loss of the node itself. By default, all the nodes wait for each other 
+                          after each epoch. 
+
+  -ps_push <type>      :  Encoding of the pushes of the distributed training, which can be fp32, fp16, 
+                          bf16 or int8 (with a scale for each feature). The error of the encoding 
+                          is added to the next push of the feature. Using fp32 by default. 
+
+  -ps_topk <ratio>     :  Push the <ratio> of the values of each feature with the largest change, 
+                          and the others are pushed later with the error of -ps_push. Using 1.0 
+                          (all the values) by default. 
+
+  -ps_partition <type> :  How the features are split into the servers of -ps_hosts, which can be mod 
+                          (by the remainder of the feature id), range (contiguous ranges of ids) or 
+                          balanced (contiguous ranges with the same number of features in the 
+                          training data). The consecutive ids of a pull or a push are sent as ranges. 
+                          Using mod by default. 
+
+  -ps_cache <n>        :  Cache the pulled parameters of the distributed training, where a feature 
+                          is pulled again after <n> mini-batches of -ps_batch, and its change is 
+                          pushed before that. It saves most of the pulls of the frequent features. 
+                          Using 0 (no cache) by default. 
+
+  --allreduce          :  Each node of -ps_hosts keeps the whole model, and the change of the model 
+                          in each mini-batch of -ps_batch is averaged by the nodes with a ring 
+                          allreduce, which runs while the next mini-batch is computed. It is 
+                          faster than the parameter server for the linear and the small FM models. 
+
+  --ps-sync            :  Wait for the pull and the push of each mini-batch of the distributed 
+                          training. By default, the next mini-batch is pulled and the last one is 
+                          pushed while a mini-batch is computed, so its gradient is computed on 
+                          the parameters without the push of the last mini-batch. 
+
+  --ps-shard           :  All the nodes of -ps_hosts read the same training file (e.g., on a shared 
+                          file system), and each node only reads its own part of the bytes, which 
+                          is split at the lines. By default, each node reads its own file. 
+
+  -shm <name>          :  Train one model by the -shm_procs processes of one host, which run 
+                          xlearn_train with the same options and the same training file. The model 
+                          is in the shared memory of <name> (/dev/shm), which all the processes 
+                          update without lock, and each process reads its own part of the file as 
+                          --ps-shard. The process of -shm_rank 0 validates the model, stops early 
+                          and saves the model. Cross-validation is not supported. 
+
+  -shm_rank <rank>     :  Rank of this process of -shm, from 0. Using 0 by default. 
+
+  -shm_procs <number>  :  Number of the processes of -shm, at most 64. Using 1 by default. 
+
+  -data_shm <name>     :  Share the parsed data with the other in-memory training processes of 
+                          this host by the shared memory of <name> (/dev/shm). The first process 
+                          parses each file and copies its rows to the shared memory, and the 
+                          later processes with the same <name>, file and parser options read 
+                          them from it, so the data is in memory only once (e.g., for the jobs 
+                          of a hyper-parameter search). It is removed when the last process 
+                          exits, or by the next process if the last one was killed. It does not 
+                          work with --disk and the remote files. 
                                                                                          
-  -nthread <thread_number> :  Number of thread for multi-thread training.                
+  -nthread <thread_number> :  Number of thread for multi-thread training. By default, it is the number 
+                              of cpus that xLearn can run on, which is limited by the cpu quota of the 
+                              cgroup (e.g., a container) and the cpus of -affinity. 
                                                                                        
+  -affinity <policy>   :  CPU affinity of the threads used with -nthread, which can be 'none', 
+                          'compact' (fill the cpus of one NUMA node first), 'scatter' (spread the 
+                          threads over the nodes), or a cpu list such as '0-7,16-23'. Each thread is 
+                          pinned to one cpu, so they are not moved by the OS. Using 'none' by default. 
+
   -block <block_size>  :  Block size fot on-disk training.     
 
+  -io <mode>           :  How the data files are read, which can be 'cache' (the page cache of the OS), 
+                          'nocache' (drop the pages of the text after they are read), or 'direct' 
+                          (read the text by O_DIRECT, or 'nocache' if it is not supported). So a 
+                          large scan does not evict the pages of the other jobs on the host. 'uring' 
+                          reads the text by io_uring with several reads in flight on Linux, which 
+                          keeps a fast NVMe disk busy. Using 'cache' by default. 
+
+  -mem <MB>            :  Memory budget of the training. The memory of the model and of the data is 
+                          estimated by the first block of the training file, and the training is on disk 
+                          (--disk) with a smaller block size (-block) if it does not fit in memory. 
+                          Using 0 (no budget) by default. 
+
+  -block_cache <MB>    :  Memory of the parsed blocks that on-disk training keeps for the next epochs, 
+                          so these blocks are not read and parsed again. The blocks are chosen by the 
+                          shuffled order of the next epoch. Using 0 by default, where the memory left by 
+                          -mem is used if it is set. 
+
+  -param_file <file>   :  Keep the model parameters in this file instead of memory, which is mapped, so the 
+                          model can be larger than the memory. The pages of the model are loaded on their use 
+                          and written back to the file by the OS, and the file is removed at the end. It 
+                          works best with --disk and --remap. The best model of early-stopping is still kept 
+                          in memory unless -stop_file is given. It does not work with --cv, -sweep, -ps_hosts, 
+                          -shm, --async-valid, -ckpt and -numa replicate. 
+
+  -param_mem <MB>      :  Memory of the head of -param_file that is locked in memory, which keeps the most 
+                          frequent features with --remap or -min_count. It is a part of -mem. Using 0 by 
+                          default, which leaves all the pages to the OS. 
+
+  --auto-block         :  Adjust the block size of on-disk training in the first epoch by the parse time 
+                          and the train time of the blocks, within the block size of -block (the largest) 
+                          and the memory of -mem. 
+
+  --pack-rows          :  Keep the rows of the in-memory training and validation compressed (the varints 
+                          of the bin file, about 2 ~ 4 times smaller), which are decoded by all the threads 
+                          for each batch of 16384 rows just before it is trained. So 2 ~ 4 times more data 
+                          fits in memory (and in -mem) before the on-disk training is needed. It does not 
+                          work with --cv, -sweep, --autotune, -data_shm and -shuffle_window. 
+
+  --autotune           :  Time short trials of -nthread (up to its value), -pf, -part, --dis-lock-free 
+                          and the layouts of the dense ffm (--split-ffm and --field-major) on a sample of 
+                          the training data, and train with the fastest configuration whose estimated 
+                          memory is within -mem. Only for the in-memory training. 
+
+  -pf <distance>       :  Number of rows to prefetch the model parameters ahead, which hides the 
+                          memory latency of the random lookups. Using 4 by default, and 0 disables it. 
+
+  -merge <rows>        :  Each thread updates its own copy of the bias (and the hot features of -hot), 
+                          which is merged into the shared model every <rows> rows, so the threads do not 
+                          write the same cache line for every row. 0 (by default) disables it. 
+
+  -hot <number>        :  Number of the most frequent features (counted on the first batch) that are 
+                          also copied for each thread by -merge. Using 0 by default. 
+
+  -grad_batch <rows>   :  Each thread sums the gradients of <rows> rows in its own buffer, where the 
+                          gradients of the same feature are merged, and then updates each feature once, 
+                          so the hot features are not written by every row of every thread. 0 (by 
+                          default) updates the model for each row. It does not work with fwfm and 
+                          --dis-lock-free. 
+
+  -owner <rows>        :  Train by the owners of the features instead of Hogwild. The features are split 
+                          into the ranges of the threads, and in each round every thread scores <rows> 
+                          rows and routes their gradients to the owners of the features, which apply 
+                          them, so each parameter is only written by one thread. With -numa local, the 
+                          range of each thread is placed on its NUMA node. 0 (by default) disables it. 
+                          It does not work with fwfm, -merge, -long_row, --lazy-init, --lazy-l2, 
+                          -field_k, -ps_hosts, -shm, multi-task, -numa replicate and the online 
+                          training, and -grad_batch is not used. 
+
+  -long_row <nnz>      :  The ffm rows of at least <nnz> nodes are scored and updated by all the threads, 
+                          each of which takes a block of the pairs of the row, so a few very long rows 
+                          do not hold up the epoch. 0 (by default) disables it. It does not work with 
+                          -grad_batch. 
+
+  -sample_row <nnz>    :  The ffm rows of at least <nnz> nodes are trained on a random sample of their 
+                          pairs instead of all nnz * (nnz - 1) / 2 of them, whose score is scaled to 
+                          the estimate of the whole row, so each one costs O(nnz). The gradient is 
+                          taken at the sampled score, which biases it with the nonlinear losses. The 
+                          prediction is still exact. 0 (by default) disables it. It takes these rows 
+                          from -long_row, and does not work with -bag_field. 
+
+  -sample_pair <number>:  Number of the pairs sampled for each node of a row of -sample_row. 16 by default. 
+
+  -num_label <number>  :  Number of the labels at the head of each training row (1 ~ 16), which are 
+                          the tasks of the multi-task training in one pass over the data. The first 
+                          label is the task of -s, and each other one trains its own model with the 
+                          same options, which is saved to <model_file>.task<t> (t from 2). Using 1 by 
+                          default. It does not work with --cv, -sweep, -ps_hosts, -shm, -pre and 
+                          -param_file. 
+
+  -task_loss <l2,...>  :  Loss of each other task of -num_label, which can be 'cross-entropy' or 
+                          'squared'. The other tasks use the loss of -s by default. 
+
+  -hash <bits>         :  Map the feature ids into 2^bits buckets by the hashing trick, which can be 
+                          1 ~ 31. Then the ids can be any 64-bit integer or string (e.g., the libffm 
+                          item 3:user_country=DE:1), and the model size does not depend on the max 
+                          feature id. The same -hash is needed by prediction. 
+                          On default, xLearn does not hash the feature ids. 
+
+  -cross <pairs>       :  Cross the features of the pairs of fields when parsing the data, e.g., 
+                          '0:1,2:5' adds a feature for each two features of field 0 and 1 (and of 2 
+                          and 5) in a row, which is in the first field of the pair. The fields are the 
+                          fields of libffm and the columns of csv, and the libsvm data has no cross. 
+                          The crosses need -hash, and the same -cross is needed by prediction. 
+
+  -numa <policy>       :  NUMA placement of the model parameters, which can be 'none', 'interleave' 
+                          (spread the pages over all the nodes), 'local' (the pages are first 
+                          touched by the worker threads), or 'replicate' (each NUMA node trains its 
+                          own copy of the model by its threads, and the copies are averaged after 
+                          each -numa_sync rows, so the threads do not write the memory of the other 
+                          nodes). The model is always initialized by the worker threads, so 'none' 
+                          and 'local' are the same for training. 'replicate' costs one more model 
+                          size per node, and it does not work with --cv, -sweep, -ps_hosts, -shm, 
+                          -stop_file, -param_file, --lazy-init, --lazy-l2, -merge, -valid_rows and 
+                          the online training. Using 'none' by default. 
+
+  -numa_sync <rows>    :  Number of the rows trained by the copies of -numa replicate between two 
+                          averages of the copies, which are also averaged at the end of each epoch. 
+                          Using 65536 by default. 
+
+  -part <partition>    :  How the rows are split over the threads, which can be 'row' (the same 
+                          number of rows), 'nnz' (the same number of features, or feature pairs 
+                          for ffm), or 'dynamic' (small chunks taken by the idle threads). 'nnz' 
+                          and 'dynamic' help when the row lengths are skewed. Using 'row' by default. 
+
+  -auc_bucket <number> :  Number of the buckets of sigmoid(score) used by the approximate AUC (-x auc), 
+                          which is its resolution. Using 1000000 by default. 
+
   -sw <stop_window>    :  Size of stop window for early-stopping. Using 2 by default.                       
+
+  -stop_file <file>    :  Keep the best model of early-stopping in this file instead of memory, which 
+                          saves the memory of a copy of the model. The file is removed at the end. 
+
+  -ckpt <file>         :  Write a checkpoint of the model, its optimizer state and the number of trained 
+                          epochs to this file during the training. The file is written in the background 
+                          by the end of the epochs, and the training resumes from it with -pre <file>. 
+
+  -ckpt_e <number>     :  Epochs between two checkpoints of -ckpt. Using 1 by default. 
+
+  -ckpt_m <minutes>    :  Minutes between two checkpoints of -ckpt, which are checked by the end of the 
+                          epochs. If it is set, -ckpt_e is not used unless it is also set. 
+
+  -publish <seconds>   :  Only for the online training of 'xlearn_online <source> [OPTIONS]', whose 
+                          source is '-' (stdin), a named pipe, or 'tcp:<port>' (the producers connect 
+                          to the port one after another), and it trains each piece of the lines as 
+                          they arrive. The model is published to the files of -m and -im every 
+                          <seconds> seconds (60 by default) by a rename, so the serving processes can 
+                          reload it. It stops at the end of the stream or by Ctrl-C. 
+
+  -delta <prefix>      :  Only for xlearn_online. Also write the delta from the last publication to 
+                          <prefix>.<n> after the n-th publication, which only keeps the changed 
+                          features, so the serving processes apply it to the loaded model in place 
+                          (XLearnApplyDelta) instead of loading the whole model. 
+
+  -metrics <port>      :  Only for xlearn_online. Serve the metrics of the training (the rows and the nnz, 
+                          the time of the phases, the busy time of the threads, the memory of the model 
+                          and the bytes waiting for the training) in the Prometheus text format at 
+                          http://<host>:<port>/metrics. 0 (by default) disables it. 
                                                                                       
   -seed <random_seed>  :  Random Seed to shuffle data set.
 
+  -shuffle_window <n>  :  Order the examples of each window of <n> shuffled examples by a min-hash of 
+                          their features, so the examples that share the features are trained one after 
+                          another and their parameters are still in the cache. Each window is a random 
+                          set of the examples, so the order of the epoch is still random across the 
+                          windows. Only for the in-memory training. Using 0 (the shuffled order) by default. 
+
+  -neg_rate <rate>     :  Keep each negative example (y <= 0) of the training data with the probability 
+                          <rate> in (0, 1], which is chosen by the hash of the example and -seed. The 
+                          model records the rate, and its predictions are calibrated by log(rate), so 
+                          they are not biased by the sampling. Only for the classification tasks. 
+                          Using 1 (no sampling) by default. 
+
+  -loss_sample <rate>  :  Sample the training examples of the epochs from -loss_sample_epoch by their 
+                          loss in the last epoch that trained them, so about <rate> of them are trained 
+                          and the confident ones are mostly skipped. The gradient of each sampled 
+                          example is weighted by 1/p (p is its probability), so the epoch is unbiased. 
+                          Only for the in-memory training of cross-entropy, and it does not work with 
+                          --cv, -ps_hosts, -shm, multi-task and the online training. 
+                          Using 1 (no sampling) by default. 
+
+  -loss_sample_epoch <n> : The first epoch of -loss_sample, which is at least 2. Using 3 by default. 
+
   --disk               :  Open on-disk training for large-scale machine learning problems. 
                                                                     
   --cv                 :  Open cross-validation in training tasks. If we use this option, xLearn 
@@ -116,7 +439,10 @@ OPTIONS:
                                                                    
   --dis-lock-free      :  Disable lock-free training. Lock-free training can accelerate training but 
                           the result is non-deterministic. Our suggestion is that you can open this flag 
-                          if the training data is big and sparse. 
+                          if the training data is big and sparse. Without lock-free training, all the 
+                          threads are still used, and each sample locks its features before the update. 
+                          The order of the samples among threads is still non-deterministic, so please 
+                          use -nthread 1 if you need the same result in every run. 
                                                                         
   --dis-es             :  Disable early-stopping in training. By default, xLearn will use early-stopping 
                           in training tasks, except for training in cross-validation. 
@@ -125,9 +451,151 @@ OPTIONS:
                           instance-wise normalization for both training and prediction. 
 
   --no-bin             :  Do not generate bin file for training and test data file.
+
+  --skip-zeros         :  Drop the features of value 0 when parsing the data, e.g., the zero columns 
+                          of a sparse CSV file, which saves the memory and the time of training. 
+                          The same --skip-zeros is needed by prediction. 
+
+  --merge-dup          :  Merge the features of the same id (and field for libffm) in a row of the libsvm 
+                          and libffm data by summing their values, e.g., after the hashing collisions or 
+                          the multi-valued fields. The rows are also sorted by feature id. The same 
+                          --merge-dup is needed by prediction. 
                                                                   
   --quiet              :  Don't print any evaluation information during the training and 
                           just train the model quietly. 
+
+  --lazy-init          :  Initialize the model parameters of each feature on its first use, which 
+                          saves the memory of the features that never show up in the data, e.g., 
+                          a large hashing space (-hash). 
+
+  --lazy-l2            :  Apply the L2 regularization (-r) of the steps that a feature misses on its 
+                          next use, so every step decays all the features instead of only the features 
+                          of current row, without a dense pass. Only for sgd and adagrad. 
+
+  --sparse-model       :  Write the model file (-m) in the sparse format, which only keeps the features 
+                          that have been used with the list of their ids. It is loaded as a lazy model 
+                          (see --lazy-init), and the model of -pre is dense unless --lazy-init is set. 
+
+  --checksum           :  Write a checksum of each 16 MB section of the model file (-m), which is verified 
+                          when the model is loaded (e.g., by -pre or xlearn_predict). The sections are 
+                          written and read by the threads (-nthread) either way. 
+
+  --huge-page          :  Use transparent huge pages for the model parameters, which reduces the 
+                          TLB misses of a big model. Only supported on Linux. 
+
+  --train-metric       :  Also show the (first) metric (-x) of the training data in each epoch, which is 
+                          accumulated in the gradient pass without another pass, so each row is 
+                          scored by the model before its own update. 
+
+  --async-valid        :  Validate the model of each epoch on a snapshot of it while the next epoch is 
+                          trained, so the threads do not wait for the validation. The result of an epoch 
+                          is shown after the next epoch, and early-stopping stops one epoch late and rolls 
+                          back to the best epoch, which keeps two copies of the model in memory. It does 
+                          not work with --cv, -ps_hosts, -shm and -stop_file. 
+
+  -valid_every <n>     :  Validate the model every <n> epochs (and after the last epoch), so the 
+                          early-stopping window (-sw) counts the validations. Using 1 by default. 
+
+  -valid_rows <rows>   :  Validate the model every <rows> training rows instead of the epochs, which 
+                          can stop the training in the middle of an epoch. The training loss of such a 
+                          validation is the loss of the epoch so far. Using 0 (off) by default. It does 
+                          not work with --async-valid. 
+
+  -valid_sample <rate> :  Validate the model by a sample of the validation data during the training, 
+                          which keeps each example with the probability <rate> in (0, 1] by the hash 
+                          of the example and -seed, so the labels keep their ratio and the sample is 
+                          the same in every validation. The final model is then validated once by all 
+                          the validation data. Using 1 (all the data) by default. 
+
+  --exact-auc          :  Compute the exact AUC (-x auc) by sorting the scores of all the examples, 
+                          instead of the buckets (-auc_bucket). It needs 8 bytes for each example. 
+
+  --profile            :  Print the time of the phases of each epoch after its line, which are the reading 
+                          of the data (I/O and parsing), the gradient pass, the prediction and the metric 
+                          of the validation, and the waiting for the other workers, with the rows/sec and 
+                          the nnz/sec of the gradient pass. 
+
+  -profile_file <file> :  Write the time of the phases of each epoch (see --profile) to this file, which 
+                          has one JSON object per epoch and per line. 
+
+  --perf               :  Count the hardware events (cycles, instructions, LLC misses and dTLB misses) 
+                          of the gradient pass and of the prediction by perf_event_open (Linux only), 
+                          which are printed with the phases of --profile as the instructions per cycle 
+                          and the misses per thousand instructions. 
+
+  -trace <file>        :  Record the spans of the threads (the tasks of the thread pool and their waits, 
+                          the reading and the parsing of the blocks, and the epochs) and write them to 
+                          this file in the Chrome trace-event format at the end, which is opened by 
+                          chrome://tracing or https://ui.perfetto.dev. 
+
+  -feat_stats <file>   :  Count how often each feature and each field is used by the training data when 
+                          it is read, print the summary with the most frequent features, and write the 
+                          counts to this file. With -merge, the hot features (-hot) are then the most 
+                          frequent features of the whole data instead of the first batch. 
+
+  --remap              :  Renumber the features by their frequency in the training data during the training, 
+                          so the parameters of the frequent features are together at the head of the model, 
+                          which uses the cache and the TLB better for the data of skewed features. The model 
+                          is moved back to the original ids before it is saved. It does not work with --cv, 
+                          -ps_hosts, -shm and -stop_file. 
+
+  --remap-fields       :  Renumber the fields that are used by the training data to 0, 1, 2 ..., so the 
+                          ffm and fwfm models only have the latent vectors (and the weights) of the used 
+                          fields when the field ids of the data are sparse, e.g., 0, 7 and 1000. The map of 
+                          the ids is kept in the model file, and the data of prediction is renumbered by it. 
+                          It does not work with --sparse-ffm, -ps_hosts, -shm, -pre and the online training. 
+
+  -min_count <number>  :  The features that are used less than this number of times in the training data 
+                          (and the unseen ids) share one id, and the others are renumbered by their 
+                          frequency, so the model only has the latent factors of the frequent features. 
+                          The map of the ids is kept in the model file, and the data of prediction is 
+                          renumbered by it. The TXT model (-t) is written with the new ids. Using 0 (off) 
+                          by default. It does not work with --cv, -ps_hosts, -shm and -pre. 
+
+  --sparse-ffm         :  Only keep the latent vectors of ffm for the pairs of (feature, target field) that 
+                          are in the training data, which are found when the data is read. The others are 
+                          zero, and the kernels look up the vectors by the field index of the model. It 
+                          does not work with -ps_hosts, -shm, -pre, --remap, -min_count and --sparse-model, 
+                          and the latent factors of the model are always fp32 (see -latent). 
+
+  -field_pairs <pairs> :  Only keep the interactions of ffm between the pairs of fields, e.g., '0:1,2:5' 
+                          (or the file of the pairs, which are separated by commas, spaces or lines, and 
+                          '#' starts a comment). The features of a field only have the latent vectors of 
+                          its paired fields, and the other pairs are skipped by the kernels. It turns on 
+                          --sparse-ffm, and has the same limits. 
+
+  -share_count <number>:  The features of ffm that are used less than this number of times in the training 
+                          data have one latent vector for all their target fields, like the vector of fm, 
+                          and the others keep a vector of each field. The rare features cannot learn a 
+                          vector of each field, so it saves most of the memory of a long-tailed data. It 
+                          turns on --sparse-ffm, and has the same limits. Using 0 (off) by default. 
+
+  -field_k <spec>      :  The K of the latent vectors of ffm by their fields, e.g., '0=2,1=2,3:4=16' (or the 
+                          file of the items), where field=K is the K of a field, and field:field=K is the K 
+                          of a pair of fields. A pair has the smaller K of its two fields by default, and 
+                          the fields without an item have -k, which is also the largest K. Each vector is 
+                          padded to the SIMD width of 4 values, so the small fields take less memory and 
+                          time. It turns on --sparse-ffm, and has the same limits, and it does not work 
+                          with -prune and -grad_batch. 
+
+  -bag_field <fields>  :  The multi-valued fields of ffm, e.g., '3,7', whose nodes of a row (e.g., the tags 
+                          of a user) are pooled into one bag. The latent vectors of a bag are summed for 
+                          each target field before the pairs, and its nodes have no pairs with each other, 
+                          so a row costs O(nnz * fields) instead of O(nnz^2). The same -bag_field and 
+                          -bag_pool are given to xlearn_predict. It does not work with -field_k. 
+
+  -bag_pool <pool>     :  How the vectors of a bag are pooled, which can be 'sum' or 'mean'. Using 'sum' 
+                          by default. 
+
+  --split-ffm          :  Keep the latent weights of all the fields of a feature of ffm together, followed 
+                          by their gradient cache, instead of the blocks of weights and cache in turn. The 
+                          forward pass and the validation read 2-3x less memory. The model files keep the 
+                          same layout. It has no effect with sgd, and does not work with --sparse-ffm. 
+
+  --field-major        :  Keep the latent vectors of ffm in the order of target field and then feature, 
+                          instead of feature and then field, so the vectors of one field are together. 
+                          The model files keep the same layout. The model cannot grow for new features, 
+                          and it does not work with --sparse-ffm and --split-ffm. 
 ----------------------------------------------------------------------------------------------)"
     );
   } else {
@@ -137,25 +605,111 @@ USAGE:
      xlearn_predict <test_file> <model_file> [OPTIONS] 
                                                          
  e.g.,  xlearn_predict ./test_data.txt ./model_file -o ./out.txt  
+
+ The <test_file> can also be a comma-separated list of files or a glob such as 
+ './day-*.txt' (quoted, or the shell expands it), which are predicted by the model 
+ loaded once.
+
+ The <model_file> can also be a comma-separated list of models (e.g., ffm, fm and linear 
+ models of the same features), which score each row in one pass over the test file, and 
+ each line of the output file has the predictions of all the models in the same order, 
+ separated by tabs. The models must have the same feature and field maps (e.g., of 
+ -min_count or --remap). 
                                                                            
 OPTIONS: 
   -o <output_file>         :  Path of the output file. On default, this value will be set 
-                              to 'test_file' + '.out'                    
+                              to 'test_file' + '.out'. For several test files, it can be a 
+                              directory that keeps 'test_file' + '.out' of each of them, or 
+                              a comma-separated list of the same number of files. 
+
+  -test_jobs <number>      :  Number of test files parsed and predicted at the same time, 
+                              which share the threads of -nthread. Using 2 by default. 
                                                                          
-  -nthread <thread number> :  Number of thread for multi-thread learning. 
+  -nthread <thread number> :  Number of thread for multi-thread learning. By default, it is the 
+                              number of cpus that xLearn can run on (see xlearn_train). 
                                                                              
+  -affinity <policy>       :  CPU affinity of the threads, which can be 'none', 'compact', 
+                              'scatter', or a cpu list such as '0-7,16-23' (see xlearn_train). 
+                              Using 'none' by default. 
+
   -l <log_file_path>       :  Path of the log file. Using '/tmp/xlearn_log' by default. 
 
-  -block <block_size>      :  Block size fot on-disk prediction. 
+  -block <block_size>      :  Block size for the streaming prediction. 
+
+  -io <mode>               :  How the test file is read, which can be 'cache', 'nocache' (drop 
+                              the pages of the text after they are read), 'direct' (O_DIRECT), or 
+                              'uring' (io_uring on Linux). Using 'cache' by default. 
+
+  -pf <distance>           :  Number of rows to prefetch the model parameters ahead. Using 4 
+                              by default, and 0 disables it. 
+
+  -hash <bits>             :  Map the feature ids into 2^bits buckets by the hashing trick, which 
+                              must be the same as the -hash used by training. 
+
+  -cross <pairs>           :  Cross the features of the pairs of fields when parsing the data, which 
+                              must be the same as the -cross used by training. 
+
+  -bag_field <fields>      :  The bag fields of ffm, which must be the same as the -bag_field used 
+                              by training. 
+
+  -bag_pool <pool>         :  How the vectors of a bag are pooled, 'sum' or 'mean', which must be 
+                              the same as the -bag_pool used by training. 
+
+  -numa <policy>           :  NUMA placement of the model parameters, which can be 'none', 
+                              'interleave', or 'replicate'. With 'replicate', each NUMA node keeps 
+                              its own copy of the model, and the threads pinned to the node read 
+                              the local copy, which costs one more model size per node. Using 
+                              'none' by default. 
+
+  -part <partition>        :  How the rows are split over the threads, which can be 'row', 'nnz', 
+                              or 'dynamic' (see xlearn_train). Using 'row' by default. 
                                                             
+  -latent <storage_type>   :  Storage type of the latent factors for fm and ffm, which can be 
+                              'fp32', 'fp16', 'bf16', or 'int8'. Using 'fp32' by default. The 
+                              16-bit types halve the memory of the model and int8 quarters it, 
+                              with a little precision loss. 
+
   --sign                   :  Converting output to 0 and 1. 
                                                                
   --sigmoid                :  Converting output to 0~1 (problebility). 
 
-  --disk                   :  On-disk prediction.
+  --raw-out                :  Write the output file as raw float32 values (4 bytes each, in the 
+                              byte order of the machine) instead of text, which is smaller and 
+                              much faster to write and read for a large test set. 
+
+  --gpu                    :  Score the test set on a CUDA device for linear, fm and ffm models. It needs 
+                              xLearn built with the CUDA toolkit, and falls back to the CPU without it, or 
+                              for fwfm, --sparse-ffm, --split-ffm, --field-major and -latent other than fp32. 
+                              It does not work with several test files. 
+
+  -gpu_device <id>         :  Id of the CUDA device of --gpu. Using 0 by default. 
+
+  -pair_table <cells>      :  Precompute the latent products of the pairs of fields of a ffm model 
+                              of fp32, whose features in the test set are at most <cells> in product, 
+                              and look them up when scoring. It costs one more pass over the test 
+                              set and 4 bytes each cell. Using 0 (no tables) by default. 
+
+  -blend <w1,w2,...>       :  Weights of the models of a list of model files, whose weighted sum of 
+                              the scores is added as the last column of the output file, and it is 
+                              converted by --sign and --sigmoid like the others. 
+
+  --disk                   :  Write the binary cache of the test file (filename.disk.bin) for the 
+                              later predictions. By default, the test file is streamed in blocks 
+                              without the cache, since it is read only once. 
   
   --no-norm                :  Disable instance-wise normalization. By default, xLearn will use 
                               instance-wise normalization for both training and prediction. 
+
+  --skip-zeros             :  Drop the features of value 0 when parsing the data, which must be 
+                              the same as the --skip-zeros used by training. 
+
+  --merge-dup              :  Merge the features of the same id (and field) in a row, which must be 
+                              the same as the --merge-dup used by training. 
+
+  --huge-page              :  Use transparent huge pages for the model parameters. 
+
+  -trace <file>            :  Record the spans of the threads and write them to this file in the Chrome 
+                              trace-event format at the end (see xlearn_train). 
 ----------------------------------------------------------------------------------------------)"
     );
   }
@@ -169,8 +723,12 @@ void Checker::Initialize(bool is_train, int argc, char* argv[]) {
     menu_.push_back(std::string("-x"));
     menu_.push_back(std::string("-v"));
     menu_.push_back(std::string("-p"));
+    menu_.push_back(std::string("-opt_state"));
     menu_.push_back(std::string("-m"));
     menu_.push_back(std::string("-t"));
+    menu_.push_back(std::string("-im"));
+    menu_.push_back(std::string("-prune"));
+    menu_.push_back(std::string("-latent"));
     menu_.push_back(std::string("-l"));
     menu_.push_back(std::string("-k"));
     menu_.push_back(std::string("-r"));
@@ -178,30 +736,137 @@ void Checker::Initialize(bool is_train, int argc, char* argv[]) {
     menu_.push_back(std::string("-u"));
     menu_.push_back(std::string("-e"));
     menu_.push_back(std::string("-f"));
+    menu_.push_back(std::string("-cv_jobs"));
+    menu_.push_back(std::string("-read_jobs"));
+    menu_.push_back(std::string("-sweep"));
+    menu_.push_back(std::string("-sweep_jobs"));
+    menu_.push_back(std::string("-ps_hosts"));
+    menu_.push_back(std::string("-ps_rank"));
+    menu_.push_back(std::string("-ps_batch"));
+    menu_.push_back(std::string("-ps_timeout"));
+    menu_.push_back(std::string("-ps_staleness"));
+    menu_.push_back(std::string("-ps_push"));
+    menu_.push_back(std::string("-ps_topk"));
+    menu_.push_back(std::string("-ps_cache"));
+    menu_.push_back(std::string("-ps_partition"));
+    menu_.push_back(std::string("--ps-sync"));
+    menu_.push_back(std::string("--ps-shard"));
+    menu_.push_back(std::string("--allreduce"));
+    menu_.push_back(std::string("-shm"));
+    menu_.push_back(std::string("-shm_rank"));
+    menu_.push_back(std::string("-shm_procs"));
+    menu_.push_back(std::string("-data_shm"));
     menu_.push_back(std::string("-pre"));
     menu_.push_back(std::string("-nthread"));
+    menu_.push_back(std::string("-affinity"));
     menu_.push_back(std::string("-block"));
+    menu_.push_back(std::string("-io"));
+    menu_.push_back(std::string("-mem"));
+    menu_.push_back(std::string("-block_cache"));
+    menu_.push_back(std::string("-param_file"));
+    menu_.push_back(std::string("-param_mem"));
+    menu_.push_back(std::string("-pf"));
+    menu_.push_back(std::string("-merge"));
+    menu_.push_back(std::string("-hot"));
+    menu_.push_back(std::string("-grad_batch"));
+    menu_.push_back(std::string("-owner"));
+    menu_.push_back(std::string("-long_row"));
+    menu_.push_back(std::string("-sample_row"));
+    menu_.push_back(std::string("-sample_pair"));
+    menu_.push_back(std::string("-num_label"));
+    menu_.push_back(std::string("-task_loss"));
+    menu_.push_back(std::string("-hash"));
+    menu_.push_back(std::string("-cross"));
+    menu_.push_back(std::string("-numa"));
+    menu_.push_back(std::string("-numa_sync"));
+    menu_.push_back(std::string("-part"));
+    menu_.push_back(std::string("-auc_bucket"));
     menu_.push_back(std::string("-sw"));
+    menu_.push_back(std::string("-stop_file"));
+    menu_.push_back(std::string("-ckpt"));
+    menu_.push_back(std::string("-ckpt_e"));
+    menu_.push_back(std::string("-ckpt_m"));
+    menu_.push_back(std::string("-publish"));
+    menu_.push_back(std::string("-metrics"));
+    menu_.push_back(std::string("-delta"));
     menu_.push_back(std::string("-seed"));
+    menu_.push_back(std::string("-shuffle_window"));
+    menu_.push_back(std::string("-neg_rate"));
+    menu_.push_back(std::string("-loss_sample"));
+    menu_.push_back(std::string("-loss_sample_epoch"));
     menu_.push_back(std::string("--disk"));
     menu_.push_back(std::string("--cv"));
     menu_.push_back(std::string("--dis-es"));
     menu_.push_back(std::string("--no-norm"));
+    menu_.push_back(std::string("--skip-zeros"));
+    menu_.push_back(std::string("--merge-dup"));
     menu_.push_back(std::string("--no-bin"));
+    menu_.push_back(std::string("--auto-block"));
+    menu_.push_back(std::string("--pack-rows"));
+    menu_.push_back(std::string("--autotune"));
     menu_.push_back(std::string("--quiet"));
+    menu_.push_back(std::string("--lazy-init"));
+    menu_.push_back(std::string("--lazy-l2"));
+    menu_.push_back(std::string("--sparse-model"));
+    menu_.push_back(std::string("--checksum"));
+    menu_.push_back(std::string("--huge-page"));
+    menu_.push_back(std::string("--train-metric"));
+    menu_.push_back(std::string("--async-valid"));
+    menu_.push_back(std::string("-valid_every"));
+    menu_.push_back(std::string("-valid_rows"));
+    menu_.push_back(std::string("-valid_sample"));
+    menu_.push_back(std::string("--exact-auc"));
+    menu_.push_back(std::string("--profile"));
+    menu_.push_back(std::string("--perf"));
+    menu_.push_back(std::string("-profile_file"));
+    menu_.push_back(std::string("-trace"));
+    menu_.push_back(std::string("-feat_stats"));
+    menu_.push_back(std::string("--remap"));
+    menu_.push_back(std::string("--remap-fields"));
+    menu_.push_back(std::string("-min_count"));
+    menu_.push_back(std::string("--sparse-ffm"));
+    menu_.push_back(std::string("-field_pairs"));
+    menu_.push_back(std::string("-share_count"));
+    menu_.push_back(std::string("-field_k"));
+    menu_.push_back(std::string("-bag_field"));
+    menu_.push_back(std::string("-bag_pool"));
+    menu_.push_back(std::string("--split-ffm"));
+    menu_.push_back(std::string("--field-major"));
     menu_.push_back(std::string("-alpha"));
     menu_.push_back(std::string("-beta"));
     menu_.push_back(std::string("-lambda_1"));
     menu_.push_back(std::string("-lambda_2"));
+    menu_.push_back(std::string("-beta_1"));
+    menu_.push_back(std::string("-beta_2"));
   } else {  // for Prediction
     menu_.push_back(std::string("-o"));
+    menu_.push_back(std::string("-test_jobs"));
     menu_.push_back(std::string("-l"));
     menu_.push_back(std::string("-nthread"));
+    menu_.push_back(std::string("-affinity"));
     menu_.push_back(std::string("-block"));
+    menu_.push_back(std::string("-io"));
+    menu_.push_back(std::string("-pf"));
+    menu_.push_back(std::string("-hash"));
+    menu_.push_back(std::string("-cross"));
+    menu_.push_back(std::string("-bag_field"));
+    menu_.push_back(std::string("-bag_pool"));
+    menu_.push_back(std::string("-numa"));
+    menu_.push_back(std::string("-part"));
     menu_.push_back(std::string("--sign"));
     menu_.push_back(std::string("--sigmoid"));
+    menu_.push_back(std::string("--raw-out"));
+    menu_.push_back(std::string("--gpu"));
+    menu_.push_back(std::string("-gpu_device"));
+    menu_.push_back(std::string("-pair_table"));
+    menu_.push_back(std::string("-blend"));
+    menu_.push_back(std::string("-latent"));
     menu_.push_back(std::string("--disk"));
     menu_.push_back(std::string("--no-norm"));
+    menu_.push_back(std::string("--skip-zeros"));
+    menu_.push_back(std::string("--merge-dup"));
+    menu_.push_back(std::string("--huge-page"));
+    menu_.push_back(std::string("-trace"));
   }
   // Get the user's input
   for (int i = 0; i < argc; ++i) {
@@ -233,14 +898,131 @@ bool Checker::check_param(HyperParam& hyper_param) {
   }
 }
 
+// The metrics of -x, which can be a list (e.g., auc,acc,f1)
+static std::vector<std::string> metric_list(const std::string& metric) {
+  std::vector<std::string> names;
+  SplitStringUsing(metric, ",", &names);
+  return names;
+}
+
+static std::string join_metrics(const std::vector<std::string>& names) {
+  std::string metric;
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (i > 0) { metric += ","; }
+    metric += names[i];
+  }
+  return names.empty() ? "none" : metric;
+}
+
+// Each metric of the list is known, and 'none' is not in a list
+static bool is_metric_list(const std::string& metric) {
+  std::vector<std::string> names = metric_list(metric);
+  if (names.empty()) { return false; }
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (names[i].compare("acc") != 0 &&
+        names[i].compare("prec") != 0 &&
+        names[i].compare("recall") != 0 &&
+        names[i].compare("f1") != 0 &&
+        names[i].compare("auc") != 0 &&
+        names[i].compare("gauc") != 0 &&
+        names[i].compare("mae") != 0 &&
+        names[i].compare("mape") != 0 &&
+        names[i].compare("rmsd") != 0 &&
+        names[i].compare("rmse") != 0 &&
+        (names[i].compare("none") != 0 || names.size() > 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The pairs of -field_pairs, which is the list of the pairs (e.g.,
+// 0:1,2:5) or the file of them, where the pairs are separated by
+// commas, spaces or lines, and '#' starts a comment.
+static std::string read_field_pairs(const std::string& value) {
+  if (!FileExist(value.c_str())) { return value; }
+  char* buf = nullptr;
+  uint64 len = ReadFileToMemory(value, &buf);
+  std::string spec, item;
+  bool comment = false;
+  for (uint64 i = 0; i <= len; ++i) {
+    char c = i < len ? buf[i] : '\n';
+    if (c == '\n') { comment = false; }
+    if (c == '#') { comment = true; }
+    if (!comment && !isspace(c) && c != ',') {
+      item += c;
+    } else if (!item.empty()) {
+      if (!spec.empty()) { spec += ","; }
+      spec += item;
+      item.clear();
+    }
+  }
+  delete [] buf;
+  return spec;
+}
+
+// rmse is the same as rmsd
+static std::string normalize_metric(const std::string& metric) {
+  std::vector<std::string> names = metric_list(metric);
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (names[i].compare("rmse") == 0) { names[i] = "rmsd"; }
+  }
+  return join_metrics(names);
+}
+
+// Expand the list of training files (see ExpandDataList), where
+// the list of several files sets train_set_files, and its first
+// file is train_set_file. The single file is checked by the caller.
+bool Checker::check_train_files(const std::string& list,
+                                HyperParam& hyper_param) {
+  StringList files = ExpandDataList(list);
+  hyper_param.train_set_files.clear();
+  if (files.size() == 1) {
+    hyper_param.train_set_file = files[0];
+    return true;
+  }
+  if (files.empty()) {
+    Color::print_error(
+      StringPrintf("Training data: %s has no files.", list.c_str())
+    );
+    return false;
+  }
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (IsStreamFile(files[i])) {
+      Color::print_error("The stdin or a pipe cannot be in the list "
+                         "of training files.");
+      return false;
+    }
+    if (!IsRemoteFile(files[i]) && !FileExist(files[i].c_str())) {
+      Color::print_error(
+        StringPrintf("Training data file: %s does not exist.",
+                     files[i].c_str())
+      );
+      return false;
+    }
+  }
+  hyper_param.train_set_files = files;
+  hyper_param.train_set_file = files[0];
+  return true;
+}
+
 // Check options for training tasks
 bool Checker::check_train_options(HyperParam& hyper_param) {
   bool bo = true;
   /*********************************************************
    *  Check the file path of the training data             *
    *********************************************************/
-  if (FileExist(args_[1].c_str())) {
+  if (hyper_param.online) {
     hyper_param.train_set_file = std::string(args_[1]);
+  } else if (!check_train_files(args_[1], hyper_param)) {
+    return false;
+  }
+  const std::string& train_file = hyper_param.train_set_file;
+  if (!hyper_param.train_set_files.empty() ||
+      IsStreamFile(train_file) || IsRemoteFile(train_file) ||
+      FileExist(train_file.c_str()) ||
+      (hyper_param.online && IsSocketSource(train_file))) {
+    // The files of a list are checked
   } else {
     Color::print_error(
       StringPrintf("Training data file: %s does not exist.", 
@@ -256,17 +1038,19 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
   for (int i = 0; i < list.size(); ) {
     if (list[i].compare("-s") == 0) {  // task type
       int value = atoi(list[i+1].c_str());
-      if (value < 0 || value > 5) {
+      if (value < 0 || value > 7) {
         Color::print_error(
-            "-s can only be [0 - 5] : \n"
+            "-s can only be [0 - 7] : \n"
             "  for classification task: \n"
             "    0 -- linear model (GLM) \n"
             "    1 -- factorization machines (FM) \n"
             "    2 -- field-aware factorization machines (FFM) \n"
+            "    6 -- field-weighted factorization machines (FwFM) \n"
             "  for regression task: \n"
             "    3 -- linear model (GLM) \n"
             "    4 -- factorization machines (FM) \n"
-            "    5 -- field-aware factorization machines (FFM)");
+            "    5 -- field-aware factorization machines (FFM) \n"
+            "    7 -- field-weighted factorization machines (FwFM)");
         bo = false;
       } else {
         switch (value) {
@@ -294,29 +1078,29 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
             hyper_param.loss_func = "squared";
             hyper_param.score_func = "ffm";
             break;
+          case 6:
+            hyper_param.loss_func = "cross-entropy";
+            hyper_param.score_func = "fwfm";
+            break;
+          case 7:
+            hyper_param.loss_func = "squared";
+            hyper_param.score_func = "fwfm";
+            break;
           default: break;
         }
       }
       i += 2;
     } else if (list[i].compare("-x") == 0) {  // metrics
-      if (list[i+1].compare("acc") != 0 &&
-          list[i+1].compare("prec") != 0 &&
-          list[i+1].compare("recall") != 0 &&
-          list[i+1].compare("f1") != 0 &&
-          list[i+1].compare("auc") != 0 &&
-          list[i+1].compare("mae") != 0 &&
-          list[i+1].compare("mape") != 0 &&
-          list[i+1].compare("rmsd") != 0 &&
-          list[i+1].compare("rmse") != 0 &&
-          list[i+1].compare("none") != 0) {
+      if (!is_metric_list(list[i+1])) {
         Color::print_error(
           StringPrintf("Unknow metric: %s \n"
-               " -x can only be: \n"
+               " -x can only be a list (e.g., auc,acc,f1) of: \n"
                "   acc \n"
                "   prec \n" 
                "   recall \n"
                "   f1 \n"
                "   auc\n"
+               "   gauc \n"
                "   mae \n"
                "   mape \n"
                "   rmsd \n"
@@ -332,10 +1116,12 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
     } else if (list[i].compare("-p") == 0) {  // optimization method
       if (list[i+1].compare("adagrad") != 0 &&
           list[i+1].compare("ftrl") != 0 &&
-          list[i+1].compare("sgd") != 0) {
+          list[i+1].compare("sgd") != 0 &&
+          list[i+1].compare("adam") != 0 &&
+          list[i+1].compare("adamw") != 0) {
         Color::print_error(
           StringPrintf("Unknow optimization method: %s \n"
-               " -o can only be: adagrad and ftrl. \n",
+               " -p can only be: sgd, adagrad, ftrl, adam, and adamw. \n",
                list[i+1].c_str())
         );
         bo = false;
@@ -343,8 +1129,22 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.opt_type = list[i+1];
       }
       i += 2;
+    } else if (list[i].compare("-opt_state") == 0) {  // optimizer state
+      if (list[i+1].compare("fp32") != 0 &&
+          list[i+1].compare("bf16") != 0) {
+        Color::print_error(
+          StringPrintf("Unknow type of optimizer state: %s \n"
+               " -opt_state can only be: fp32 and bf16. \n",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.opt_state = list[i+1];
+      }
+      i += 2;
     } else if (list[i].compare("-v") == 0) {  // validation file
-      if (FileExist(list[i+1].c_str())) {
+      if (IsStreamFile(list[i+1]) || IsRemoteFile(list[i+1]) ||
+          FileExist(list[i+1].c_str())) {
         hyper_param.validate_set_file = list[i+1];
       } else {
         Color::print_error(
@@ -360,6 +1160,34 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
     } else if (list[i].compare("-t") == 0) { // txt model file
       hyper_param.txt_model_file = list[i+1];
       i += 2;
+    } else if (list[i].compare("-im") == 0) { // inference model file
+      hyper_param.inference_model_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-prune") == 0) {  // threshold of pruning
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -prune : '%f'. -prune must be greater "
+                       "than or equal to 0.", value)
+        );
+        bo = false;
+      } else {
+        hyper_param.prune = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-latent") == 0) {  // storage type of latent factor
+      StorageType type;
+      if (!ParseStorageType(list[i+1], &type)) {
+        Color::print_error(
+          StringPrintf("Unknow storage type '%s'. -latent can only be: "
+                       "fp32, fp16, bf16, or int8.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.latent_type = list[i+1];
+      }
+      i += 2;
     } else if (list[i].compare("-l") == 0) {  // log file
       hyper_param.log_file = list[i+1];
       i += 2;
@@ -400,6 +1228,42 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.regu_lambda = value;
       }
       i += 2;
+    } else if (list[i].compare("-neg_rate") == 0) {  // negative sampling
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        Color::print_error(
+          StringPrintf("Illegal -neg_rate : '%f'. -neg_rate must be in (0, 1].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.neg_rate = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-loss_sample") == 0) {  // loss sampling
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        Color::print_error(
+          StringPrintf("Illegal -loss_sample : '%f'. -loss_sample must be in (0, 1].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.loss_sample = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-loss_sample_epoch") == 0) {  // first sampled epoch
+      int value = atoi(list[i+1].c_str());
+      if (value < 2) {
+        Color::print_error(
+          StringPrintf("Illegal -loss_sample_epoch : '%i'. -loss_sample_epoch must be at least 2.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.loss_sample_epoch = value;
+      }
+      i += 2;
     } else if (list[i].compare("-u") == 0) {  // model scale
       real_t value = atof(list[i+1].c_str());
       if (value <= 0) {
@@ -436,92 +1300,831 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.num_folds = value;
       }
       i += 2;
-    } else if (list[i].compare("-pre") == 0) {  // pre-trained model
-      hyper_param.pre_model_file = list[i+1];
-      i += 2;
-    } else if (list[i].compare("-nthread") == 0) {  // number of thread
+    } else if (list[i].compare("-read_jobs") == 0) {  // files at the same time
       int value = atoi(list[i+1].c_str());
       if (value <= 0) {
         Color::print_error(
-          StringPrintf("Illegal -nthread : '%i'. -nthread must be greater than zero.",
+          StringPrintf("Illegal -read_jobs : '%i'. -read_jobs must be greater than zero.",
                value)
         );
         bo = false;
       } else {
-        hyper_param.thread_number = value;
+        hyper_param.read_jobs = value;
       }
       i += 2;
-    } else if (list[i].compare("-block") == 0) {  // block size for on-disk training
+    } else if (list[i].compare("-cv_jobs") == 0) {  // folds at the same time
       int value = atoi(list[i+1].c_str());
       if (value <= 0) {
         Color::print_error(
-          StringPrintf("Illegal -block : '%i'. -block must be greater than zero.",
+          StringPrintf("Illegal -cv_jobs : '%i'. -cv_jobs must be greater than zero.",
                value)
         );
         bo = false;
       } else {
-        hyper_param.block_size = value;
+        hyper_param.cv_jobs = value;
       }
       i += 2;
-    } else if (list[i].compare("-sw") == 0) {  // window size for early stopping
+    } else if (list[i].compare("-sweep") == 0) {  // grid of configurations
+      SweepConfig base = { 1, 1, 0 };
+      std::vector<SweepConfig> configs;
+      if (!ParseSweep(list[i+1], base, &configs)) {
+        Color::print_error(
+          StringPrintf("Illegal -sweep : '%s'. -sweep must be the lists of "
+                       "k, r and b, e.g., 'k=4,8:r=0.1,0.2'.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.sweep = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-sweep_jobs") == 0) {  // configurations at the same time
       int value = atoi(list[i+1].c_str());
-      if (value < 1) {
+      if (value <= 0) {
         Color::print_error(
-          StringPrintf("Illegal -sw : '%i'. -sw must be greater than or equal to 1.",
+          StringPrintf("Illegal -sweep_jobs : '%i'. -sweep_jobs must be greater than zero.",
                value)
         );
         bo = false;
       } else {
-        hyper_param.stop_window = value;
+        hyper_param.sweep_jobs = value;
       }
       i += 2;
-    } else if (list[i].compare("-seed") == 0) {  // random seed
+    } else if (list[i].compare("-ps_hosts") == 0) {  // nodes of distributed training
+      StringList hosts;
+      SplitStringUsing(list[i+1], ",", &hosts);
+      std::string host;
+      int port = 0;
+      for (size_t j = 0; j < hosts.size(); ++j) {
+        if (!ParseAddress(hosts[j], &host, &port)) {
+          Color::print_error(
+            StringPrintf("Illegal -ps_hosts : '%s'. Each node must be host:port.",
+                 hosts[j].c_str())
+          );
+          bo = false;
+        }
+      }
+      if (hosts.empty()) {
+        Color::print_error("The -ps_hosts cannot be empty.");
+        bo = false;
+      }
+      hyper_param.ps_hosts = hosts;
+      i += 2;
+    } else if (list[i].compare("-ps_rank") == 0) {  // rank of the node
       int value = atoi(list[i+1].c_str());
-      if (value < 1) {
+      if (value < 0) {
         Color::print_error(
-          StringPrintf("Illegal -seed : '%i'. -seed must be greater than or equal to 1.",
+          StringPrintf("Illegal -ps_rank : '%i'. -ps_rank must be greater than or equal to zero.",
                value)
         );
         bo = false;
       } else {
-        hyper_param.seed = value;
+        hyper_param.ps_rank = value;
       }
       i += 2;
-    } else if (list[i].compare("--disk") == 0) {  // on-disk training
-      hyper_param.on_disk = true;
-      i += 1;
-    } else if (list[i].compare("--cv") == 0) {  // cross-validation
-      hyper_param.cross_validation = true;
-      i += 1;
-    } else if (list[i].compare("--dis-lock-free") == 0) {  // lock-free training
-      hyper_param.lock_free = false;
-      i += 1;
-    } else if (list[i].compare("--dis-es") == 0) {  // disable early-stop
-      hyper_param.early_stop = false;
-      i += 1;
-    } else if (list[i].compare("--no-norm") == 0) {  // normalization
-      hyper_param.norm = false;
-      i += 1;
-    } else if (list[i].compare("--no-bin") == 0) {  // do not generate bin file
-      hyper_param.bin_out = false;
-      i += 1;
-    } else if (list[i].compare("--quiet") == 0) {  // quiet
-      hyper_param.quiet = true;
-      i += 1;
-    } else if (list[i].compare("-alpha") == 0) {  // alpha
-      real_t value = atof(list[i+1].c_str());
+    } else if (list[i].compare("-ps_batch") == 0) {  // rows of each push
+      int value = atoi(list[i+1].c_str());
       if (value <= 0) {
         Color::print_error(
-          StringPrintf("Illegal -alpha : '%f'. "
-                       "-alpha must be greater than zero.",
+          StringPrintf("Illegal -ps_batch : '%i'. -ps_batch must be greater than zero.",
                value)
         );
         bo = false;
       } else {
-        hyper_param.alpha = value;
+        hyper_param.batch_size = value;
       }
       i += 2;
-    } else if (list[i].compare("-beta") == 0) {  // beta
+    } else if (list[i].compare("-ps_timeout") == 0) {  // wait for the nodes
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ps_timeout : '%i'. -ps_timeout must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.ps_timeout = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ps_push") == 0) {  // encoding of pushes
+      StorageType type;
+      if (!ParseStorageType(list[i+1], &type)) {
+        Color::print_error(
+          StringPrintf("Illegal -ps_push : '%s'. -ps_push can be fp32, "
+                       "fp16, bf16 or int8.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.ps_push = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-ps_topk") == 0) {  // sparse pushes
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        Color::print_error(
+          StringPrintf("Illegal -ps_topk : '%f'. -ps_topk must be in (0, 1].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.ps_topk = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ps_partition") == 0) {  // sharding of keys
+      if (list[i+1] != "mod" && list[i+1] != "range" &&
+          list[i+1] != "balanced") {
+        Color::print_error(
+          StringPrintf("Illegal -ps_partition : '%s'. -ps_partition can be "
+                       "mod, range or balanced.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.ps_partition = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-shm") == 0) {  // shared memory
+      if (list[i+1].empty() ||
+          list[i+1].find('/', 1) != std::string::npos) {
+        Color::print_error(
+          StringPrintf("Illegal -shm : '%s'. -shm must be a name without '/'.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.shm_name = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-data_shm") == 0) {  // shared data
+      if (list[i+1].empty() ||
+          list[i+1].find('/') != std::string::npos) {
+        Color::print_error(
+          StringPrintf("Illegal -data_shm : '%s'. -data_shm must be a name "
+                       "without '/'.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.data_shm = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-shm_rank") == 0) {  // rank of the process
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -shm_rank : '%i'. -shm_rank must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.shm_rank = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-shm_procs") == 0) {  // number of processes
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0 || value > 64) {
+        Color::print_error(
+          StringPrintf("Illegal -shm_procs : '%i'. -shm_procs must be in [1, 64].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.shm_procs = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ps_cache") == 0) {  // parameter cache
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ps_cache : '%i'. -ps_cache must be "
+                       "greater than or equal to zero.", value)
+        );
+        bo = false;
+      } else {
+        hyper_param.ps_cache = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ps_staleness") == 0) {  // bounded staleness
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ps_staleness : '%i'. -ps_staleness must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.ps_staleness = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-pre") == 0) {  // pre-trained model
+      hyper_param.pre_model_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-stop_file") == 0) {  // best model file
+      hyper_param.stop_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-ckpt") == 0) {  // checkpoint file
+      hyper_param.checkpoint_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-ckpt_e") == 0) {  // epochs of checkpoint
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ckpt_e : '%i'. -ckpt_e must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.checkpoint_epoch = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ckpt_m") == 0) {  // minutes of checkpoint
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ckpt_m : '%f'. -ckpt_m must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.checkpoint_minute = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-publish") == 0) {  // seconds of publication
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -publish : '%f'. -publish must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.publish_seconds = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-metrics") == 0) {  // port of the metrics
+      int value = atoi(list[i+1].c_str());
+      if (value < 0 || value > 65535) {
+        Color::print_error(
+          StringPrintf("Illegal -metrics : '%i'. -metrics must be a port (0 ~ 65535).",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.metrics_port = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-delta") == 0) {  // prefix of delta files
+      hyper_param.delta_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-nthread") == 0) {  // number of thread
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -nthread : '%i'. -nthread must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.thread_number = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-affinity") == 0) {  // cpu affinity
+      AffinityPolicy policy;
+      std::vector<int> cpus;
+      if (!ParseAffinity(list[i+1], &policy, &cpus)) {
+        Color::print_error(
+          StringPrintf("Unknow affinity '%s'. -affinity can only be: "
+                       "none, compact, scatter, or a cpu list (e.g., 0-7,16-23).",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.affinity = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-block") == 0) {  // block size for on-disk training
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -block : '%i'. -block must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.block_size = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-mem") == 0) {  // memory budget
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -mem : '%i'. -mem must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.mem_budget = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-block_cache") == 0) {  // cache of blocks
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -block_cache : '%i'. -block_cache must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.block_cache = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-param_file") == 0) {  // model in file
+      hyper_param.param_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-param_mem") == 0) {  // locked model
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -param_mem : '%i'. -param_mem must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.param_mem = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-auc_bucket") == 0) {  // buckets of AUC
+      int value = atoi(list[i+1].c_str());
+      if (value <= 1) {
+        Color::print_error(
+          StringPrintf("Illegal -auc_bucket : '%i'. -auc_bucket must be greater than one.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.auc_bucket = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-pf") == 0) {  // prefetch distance
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -pf : '%i'. -pf must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.prefetch_distance = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-merge") == 0) {  // rows between merges
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -merge : '%i'. -merge must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.merge_rows = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-hot") == 0) {  // number of hot features
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -hot : '%i'. -hot must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.num_hot_feature = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-grad_batch") == 0) {  // rows of each update
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -grad_batch : '%i'. -grad_batch must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.grad_batch = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-owner") == 0) {  // rows of a round of the owners
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -owner : '%i'. -owner must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.owner_rows = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-long_row") == 0) {  // nnz of a long row
+      int value = atoi(list[i+1].c_str());
+      if (value < 0 || value == 1) {
+        Color::print_error(
+          StringPrintf("Illegal -long_row : '%i'. -long_row must be 0 or greater than one.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.long_row = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-sample_row") == 0) {  // nnz of a sampled row
+      int value = atoi(list[i+1].c_str());
+      if (value < 0 || value == 1) {
+        Color::print_error(
+          StringPrintf("Illegal -sample_row : '%i'. -sample_row must be 0 or greater than one.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.sample_row = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-sample_pair") == 0) {  // pairs of each node
+      int value = atoi(list[i+1].c_str());
+      if (value < 1) {
+        Color::print_error(
+          StringPrintf("Illegal -sample_pair : '%i'. -sample_pair must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.sample_pair = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-num_label") == 0) {  // tasks of each row
+      int value = atoi(list[i+1].c_str());
+      if (value < 1 || value > 16) {
+        Color::print_error(
+          StringPrintf("Illegal -num_label : '%i'. -num_label must be in the range of 1 ~ 16.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.num_label = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-task_loss") == 0) {  // losses of the tasks
+      StringList loss;
+      SplitStringUsing(list[i+1], ",", &loss);
+      for (size_t j = 0; j < loss.size(); ++j) {
+        if (loss[j].compare("cross-entropy") != 0 &&
+            loss[j].compare("squared") != 0) {
+          Color::print_error(
+            StringPrintf("Illegal -task_loss : '%s'. The loss must be "
+                         "'cross-entropy' or 'squared'.",
+                         loss[j].c_str())
+          );
+          bo = false;
+        }
+      }
+      hyper_param.task_loss = loss;
+      i += 2;
+    } else if (list[i].compare("-hash") == 0) {  // bits of hashing trick
+      int value = atoi(list[i+1].c_str());
+      if (value < 1 || value > 31) {
+        Color::print_error(
+          StringPrintf("Illegal -hash : '%i'. -hash must be in range [1, 31].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.hash_bits = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-cross") == 0) {  // crosses of the fields
+      std::vector<FieldCross> crosses;
+      if (!ParseCrosses(list[i+1], &crosses)) {
+        Color::print_error(
+          StringPrintf("Illegal -cross : '%s'. -cross must be the pairs "
+                       "of fields, e.g., '0:1,2:5'.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.cross = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-numa") == 0) {  // NUMA policy
+      NumaPolicy policy;
+      if (!ParseNumaPolicy(list[i+1], &policy)) {
+        Color::print_error(
+          StringPrintf("Unknow NUMA policy '%s'. -numa can only be: "
+                       "none, interleave, local, or replicate.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.numa_policy = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-numa_sync") == 0) {  // rows of NUMA copies
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -numa_sync '%s'. It must be greater "
+                       "than zero.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.numa_sync = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-io") == 0) {  // page cache of the files
+      FileIO io;
+      if (!ParseFileIO(list[i+1], &io)) {
+        Color::print_error(
+          StringPrintf("Unknow file io '%s'. -io can only be: "
+                       "cache, nocache, direct, or uring.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.file_io = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-part") == 0) {  // row partition
+      RowPartition partition;
+      if (!ParseRowPartition(list[i+1], &partition)) {
+        Color::print_error(
+          StringPrintf("Unknow row partition '%s'. -part can only be: "
+                       "row, nnz, or dynamic.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.partition = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-sw") == 0) {  // window size for early stopping
+      int value = atoi(list[i+1].c_str());
+      if (value < 1) {
+        Color::print_error(
+          StringPrintf("Illegal -sw : '%i'. -sw must be greater than or equal to 1.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.stop_window = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-seed") == 0) {  // random seed
+      int value = atoi(list[i+1].c_str());
+      if (value < 1) {
+        Color::print_error(
+          StringPrintf("Illegal -seed : '%i'. -seed must be greater than or equal to 1.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.seed = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-shuffle_window") == 0) {  // window of rows
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -shuffle_window : '%i'. -shuffle_window must "
+                       "be greater than or equal to 0.", value)
+        );
+        bo = false;
+      } else {
+        hyper_param.shuffle_window = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--disk") == 0) {  // on-disk training
+      hyper_param.on_disk = true;
+      i += 1;
+    } else if (list[i].compare("--cv") == 0) {  // cross-validation
+      hyper_param.cross_validation = true;
+      i += 1;
+    } else if (list[i].compare("--dis-lock-free") == 0) {  // lock-free training
+      hyper_param.lock_free = false;
+      i += 1;
+    } else if (list[i].compare("--dis-es") == 0) {  // disable early-stop
+      hyper_param.early_stop = false;
+      i += 1;
+    } else if (list[i].compare("--no-norm") == 0) {  // normalization
+      hyper_param.norm = false;
+      i += 1;
+    } else if (list[i].compare("--skip-zeros") == 0) {  // drop zero features
+      hyper_param.skip_zeros = true;
+      i += 1;
+    } else if (list[i].compare("--merge-dup") == 0) {  // merge duplicates
+      hyper_param.merge_dup = true;
+      i += 1;
+    } else if (list[i].compare("--no-bin") == 0) {  // do not generate bin file
+      hyper_param.bin_out = false;
+      i += 1;
+    } else if (list[i].compare("--auto-block") == 0) {  // adaptive block
+      hyper_param.auto_block = true;
+      i += 1;
+    } else if (list[i].compare("--pack-rows") == 0) {  // compressed rows
+      hyper_param.pack_rows = true;
+      i += 1;
+    } else if (list[i].compare("--autotune") == 0) {  // timed trials
+      hyper_param.autotune = true;
+      i += 1;
+    } else if (list[i].compare("--ps-sync") == 0) {  // no pipeline
+      hyper_param.ps_pipeline = false;
+      i += 1;
+    } else if (list[i].compare("--ps-shard") == 0) {  // shard of the file
+      hyper_param.ps_shard = true;
+      i += 1;
+    } else if (list[i].compare("--allreduce") == 0) {  // ring allreduce
+      hyper_param.ps_allreduce = true;
+      i += 1;
+    } else if (list[i].compare("--quiet") == 0) {  // quiet
+      hyper_param.quiet = true;
+      i += 1;
+    } else if (list[i].compare("--lazy-init") == 0) {  // lazy initialization
+      hyper_param.lazy_init = true;
+      i += 1;
+    } else if (list[i].compare("--lazy-l2") == 0) {  // lazy L2 regularization
+      hyper_param.lazy_l2 = true;
+      i += 1;
+    } else if (list[i].compare("--train-metric") == 0) {  // metric of training data
+      hyper_param.train_metric = true;
+      i += 1;
+    } else if (list[i].compare("--async-valid") == 0) {  // pipelined validation
+      hyper_param.async_validate = true;
+      i += 1;
+    } else if (list[i].compare("-valid_every") == 0) {  // validation schedule
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -valid_every : '%i'. -valid_every must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.valid_every = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-valid_rows") == 0) {  // sub-epoch validation
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -valid_rows : '%i'. -valid_rows must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.valid_rows = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-valid_sample") == 0) {  // validation sample
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        Color::print_error(
+          StringPrintf("Illegal -valid_sample : '%f'. -valid_sample must be in (0, 1].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.valid_sample = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--exact-auc") == 0) {  // exact AUC
+      hyper_param.exact_auc = true;
+      i += 1;
+    } else if (list[i].compare("--profile") == 0) {  // time of the phases
+      hyper_param.profile = true;
+      i += 1;
+    } else if (list[i].compare("--perf") == 0) {  // hardware events
+      hyper_param.perf_counter = true;
+      i += 1;
+    } else if (list[i].compare("-profile_file") == 0) {  // JSON of the phases
+      hyper_param.profile_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-trace") == 0) {  // trace of the spans
+      hyper_param.trace_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-feat_stats") == 0) {  // counts of features
+      hyper_param.feature_stats_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("--remap") == 0) {  // renumber the features
+      hyper_param.remap_features = true;
+      i += 1;
+    } else if (list[i].compare("--remap-fields") == 0) {  // dense fields
+      hyper_param.remap_fields = true;
+      i += 1;
+    } else if (list[i].compare("-min_count") == 0) {  // rare features
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -min_count : '%i'. -min_count must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.min_count = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--sparse-model") == 0) {  // sparse model file
+      hyper_param.sparse_model = true;
+      i += 1;
+    } else if (list[i].compare("--checksum") == 0) {  // model checksum
+      hyper_param.model_checksum = true;
+      i += 1;
+    } else if (list[i].compare("--sparse-ffm") == 0) {  // sparse latent blocks
+      hyper_param.sparse_ffm = true;
+      i += 1;
+    } else if (list[i].compare("-field_pairs") == 0) {  // pairs of ffm
+      std::string spec = read_field_pairs(list[i+1]);
+      std::vector<FieldCross> pairs;
+      if (spec.empty() || !ParseCrosses(spec, &pairs)) {
+        Color::print_error(
+          StringPrintf("Illegal -field_pairs : '%s'. -field_pairs must be "
+                       "the pairs of fields, e.g., '0:1,2:5', or the file "
+                       "of them.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.field_pairs = spec;
+      }
+      i += 2;
+    } else if (list[i].compare("-share_count") == 0) {  // shared vectors
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -share_count : '%i'. -share_count must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.share_count = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-field_k") == 0) {  // K of the fields
+      std::string spec = read_field_pairs(list[i+1]);
+      std::vector<FieldK> items;
+      if (spec.empty() || !ParseFieldK(spec, &items)) {
+        Color::print_error(
+          StringPrintf("Illegal -field_k : '%s'. -field_k must be the K "
+                       "of the fields and the pairs of fields, e.g., "
+                       "'0=2,3:4=16', or the file of them.",
+                       list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.field_k = spec;
+      }
+      i += 2;
+    } else if (list[i].compare("-bag_field") == 0) {  // bags of ffm
+      std::vector<index_t> fields;
+      if (!ParseBagFields(list[i+1], &fields)) {
+        Color::print_error(
+          StringPrintf("Illegal -bag_field : '%s'. -bag_field must be "
+                       "the distinct fields, e.g., '3,7'.",
+                       list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.bag_field = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-bag_pool") == 0) {  // pooling of bags
+      if (list[i+1].compare("sum") != 0 &&
+          list[i+1].compare("mean") != 0) {
+        Color::print_error(
+          StringPrintf("Unknow pooling '%s'. -bag_pool can only be: "
+                       "sum and mean.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.bag_pool = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("--split-ffm") == 0) {  // split latent layout
+      hyper_param.split_ffm = true;
+      i += 1;
+    } else if (list[i].compare("--field-major") == 0) {  // field-major layout
+      hyper_param.field_major = true;
+      i += 1;
+    } else if (list[i].compare("--huge-page") == 0) {  // huge pages
+      hyper_param.huge_page = true;
+      i += 1;
+    } else if (list[i].compare("-alpha") == 0) {  // alpha
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -alpha : '%f'. "
+                       "-alpha must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.alpha = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-beta") == 0) {  // beta
       real_t value = atof(list[i+1].c_str());
       if (value < 0) {
         Color::print_error(
@@ -560,6 +2163,22 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.lambda_2 = value;
       }
       i += 2;
+    } else if (list[i].compare("-beta_1") == 0 ||
+               list[i].compare("-beta_2") == 0) {  // beta_1 and beta_2
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0 || value >= 1) {
+        Color::print_error(
+          StringPrintf("Illegal %s : '%f'. "
+                       "%s must be in [0, 1).",
+               list[i].c_str(), value, list[i].c_str())
+        );
+        bo = false;
+      } else if (list[i].compare("-beta_1") == 0) {
+        hyper_param.beta_1 = value;
+      } else {
+        hyper_param.beta_2 = value;
+      }
+      i += 2;
     } else {  // no match
       std::string similar_str;
       ss.FindSimilar(list[i], menu_, similar_str);
@@ -577,15 +2196,26 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
    *  Check warning and fix conflict                       *
    *********************************************************/
   check_conflict_train(hyper_param);
+  if (hyper_param.online && hyper_param.model_file.compare("none") == 0) {
+    Color::print_error("xlearn_online publishes the model to the "
+                       "file of -m, which cannot be 'none'.");
+    return false;
+  }
+  if (!hyper_param.cross.empty() && hyper_param.hash_bits == 0) {
+    Color::print_error("The crosses of the fields (-cross) "
+                       "need the hashing trick (-hash).");
+    return false;
+  }
   /*********************************************************
    *  Set default value                                    *
    *********************************************************/
   if (hyper_param.model_file.empty() && !hyper_param.cross_validation) {
-    hyper_param.model_file = hyper_param.train_set_file + ".model";
-  }
-  if (hyper_param.metric.compare("rmse") == 0) {
-    hyper_param.metric = "rmsd";
+    hyper_param.model_file =
+        (IsSocketSource(hyper_param.train_set_file) ?
+         std::string("online") :
+         OutputPrefix(hyper_param.train_set_file)) + ".model";
   }
+  hyper_param.metric = normalize_metric(hyper_param.metric);
 
   return true;
 }
@@ -597,7 +2227,10 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
    *  Check file path                                      *
    *********************************************************/
   if (hyper_param.from_file) {
-    if (!FileExist(hyper_param.train_set_file.c_str())) {
+    if (!check_train_files(hyper_param.train_set_file, hyper_param)) {
+      bo = false;
+    } else if (!IsRemoteFile(hyper_param.train_set_file) &&
+        !FileExist(hyper_param.train_set_file.c_str())) {
       Color::print_error(
         StringPrintf("Training data file: %s does not exist.", 
                       hyper_param.train_set_file.c_str())
@@ -605,6 +2238,7 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
       bo = false;
     }
     if (!hyper_param.validate_set_file.empty() &&
+        !IsRemoteFile(hyper_param.validate_set_file) &&
         !FileExist(hyper_param.validate_set_file.c_str())) {
       Color::print_error(
         StringPrintf("Validation data file: %s does not exist.", 
@@ -613,7 +2247,8 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
       bo = false;
     }  
   } else {
-    if (hyper_param.train_dataset == nullptr) {
+    if (hyper_param.train_dataset == nullptr &&
+        hyper_param.train_iter.Empty()) {
       Color::print_error(
         StringPrintf("Training dataset is None, please check!")
       );
@@ -636,31 +2271,90 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
     );
     bo = false;
   }
-  if (hyper_param.metric.compare("acc") != 0 &&
-      hyper_param.metric.compare("prec") != 0 &&
-      hyper_param.metric.compare("recall") != 0 &&
-      hyper_param.metric.compare("f1") != 0 &&
-      hyper_param.metric.compare("auc") != 0 &&
-      hyper_param.metric.compare("mae") != 0 &&
-      hyper_param.metric.compare("mape") != 0 &&
-      hyper_param.metric.compare("rmsd") != 0 &&
-      hyper_param.metric.compare("rmse") != 0 &&
-      hyper_param.metric.compare("none") != 0) {
+  if (!is_metric_list(hyper_param.metric)) {
     Color::print_error(
       StringPrintf("Unknow evaluation metric: %s.",
         hyper_param.metric.c_str())
     );
     bo = false;
   }
+  if (!hyper_param.cross.empty() && hyper_param.hash_bits == 0) {
+    Color::print_error("The crosses of the fields (-cross) "
+                       "need the hashing trick (-hash).");
+    bo = false;
+  }
   if (hyper_param.opt_type.compare("sgd") != 0 &&
       hyper_param.opt_type.compare("ftrl") != 0 &&
-      hyper_param.opt_type.compare("adagrad") != 0) {
+      hyper_param.opt_type.compare("adagrad") != 0 &&
+      hyper_param.opt_type.compare("adam") != 0 &&
+      hyper_param.opt_type.compare("adamw") != 0) {
     Color::print_error(
       StringPrintf("Unknow optimization method: %s.",
         hyper_param.opt_type.c_str())
     );
     bo = false;
   }
+  StorageType type;
+  if (!ParseStorageType(hyper_param.latent_type, &type)) {
+    Color::print_error(
+      StringPrintf("Unknow storage type: %s. It can only be: "
+                   "fp32, fp16, bf16, or int8.",
+        hyper_param.latent_type.c_str())
+    );
+    bo = false;
+  }
+  NumaPolicy policy;
+  if (!ParseNumaPolicy(hyper_param.numa_policy, &policy)) {
+    Color::print_error(
+      StringPrintf("Unknow NUMA policy: %s. It can only be: "
+                   "none, interleave, local, or replicate.",
+        hyper_param.numa_policy.c_str())
+    );
+    bo = false;
+  }
+  if (hyper_param.numa_sync <= 0) {
+    Color::print_error(
+      StringPrintf("Illegal numa_sync: %d. It must be greater than zero.",
+        hyper_param.numa_sync)
+    );
+    bo = false;
+  }
+  FileIO io;
+  if (!ParseFileIO(hyper_param.file_io, &io)) {
+    Color::print_error(
+      StringPrintf("Unknow file io: %s. It can only be: "
+                   "cache, nocache, direct, or uring.",
+        hyper_param.file_io.c_str())
+    );
+    bo = false;
+  }
+  RowPartition partition;
+  if (!ParseRowPartition(hyper_param.partition, &partition)) {
+    Color::print_error(
+      StringPrintf("Unknow row partition: %s. It can only be: "
+                   "row, nnz, or dynamic.",
+        hyper_param.partition.c_str())
+    );
+    bo = false;
+  }
+  AffinityPolicy affinity;
+  std::vector<int> cpus;
+  if (!ParseAffinity(hyper_param.affinity, &affinity, &cpus)) {
+    Color::print_error(
+      StringPrintf("Unknow affinity: %s. It can only be: "
+                   "none, compact, scatter, or a cpu list.",
+        hyper_param.affinity.c_str())
+    );
+    bo = false;
+  }
+  if (hyper_param.auc_bucket <= 1) {
+    Color::print_error(
+      StringPrintf("Invalid number of AUC buckets: %d. "
+                   "It must be greater than one.",
+        hyper_param.auc_bucket)
+    );
+    bo = false;
+  }
   if (hyper_param.num_K > 999999) {
     Color::print_error(
       StringPrintf("Invalid size of K: %d. "
@@ -677,6 +2371,69 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
     );
     bo = false;
   }
+  if (hyper_param.neg_rate <= 0 || hyper_param.neg_rate > 1) {
+    Color::print_error(
+      StringPrintf("Invalid rate of negative sampling: %f. "
+                   "It must be in (0, 1].", 
+        hyper_param.neg_rate)
+    );
+    bo = false;
+  }
+  if (hyper_param.loss_sample <= 0 || hyper_param.loss_sample > 1 ||
+      hyper_param.loss_sample_epoch < 2) {
+    Color::print_error(
+      StringPrintf("Invalid loss sampling: %f from epoch %d. The rate "
+                   "must be in (0, 1], and the epoch at least 2.",
+        hyper_param.loss_sample, hyper_param.loss_sample_epoch)
+    );
+    bo = false;
+  }
+  if (hyper_param.valid_every <= 0 || hyper_param.valid_rows < 0 ||
+      hyper_param.valid_sample <= 0 || hyper_param.valid_sample > 1) {
+    Color::print_error(
+      StringPrintf("Invalid schedule of validation: every %d epochs, "
+                   "%d rows and sample rate %f.",
+        hyper_param.valid_every, hyper_param.valid_rows,
+        hyper_param.valid_sample)
+    );
+    bo = false;
+  }
+  if (hyper_param.checkpoint_epoch < 0 || hyper_param.checkpoint_minute < 0) {
+    Color::print_error(
+      StringPrintf("Invalid interval of checkpoint: %d epochs or %f minutes. "
+                   "It cannot be negative.", 
+        hyper_param.checkpoint_epoch,
+        hyper_param.checkpoint_minute)
+    );
+    bo = false;
+  }
+  if (hyper_param.cv_jobs <= 0) {
+    Color::print_error(
+      StringPrintf("Invalid number of cv jobs: %d. "
+                   "It must be greater than zero.", 
+        hyper_param.cv_jobs)
+    );
+    bo = false;
+  }
+  SweepConfig base = { 1, 1, 0 };
+  std::vector<SweepConfig> configs;
+  if (!hyper_param.sweep.empty() &&
+      !ParseSweep(hyper_param.sweep, base, &configs)) {
+    Color::print_error(
+      StringPrintf("Invalid grid of sweep: %s. It must be the lists "
+                   "of k, r and b, e.g., 'k=4,8:r=0.1,0.2'.", 
+        hyper_param.sweep.c_str())
+    );
+    bo = false;
+  }
+  if (hyper_param.sweep_jobs <= 0) {
+    Color::print_error(
+      StringPrintf("Invalid number of sweep jobs: %d. "
+                   "It must be greater than zero.", 
+        hyper_param.sweep_jobs)
+    );
+    bo = false;
+  }
   if (hyper_param.num_epoch <= 0) {
     Color::print_error(
       StringPrintf("Invalid number of epoch: %d. "
@@ -694,17 +2451,190 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
    *  Set default value                                    *
    *********************************************************/
   if (hyper_param.model_file.empty() && !hyper_param.cross_validation) {
-    hyper_param.model_file = hyper_param.train_set_file + ".model";
-  }
-  if (hyper_param.metric.compare("rmse") == 0) {
-    hyper_param.metric = "rmsd";
+    hyper_param.model_file =
+        OutputPrefix(hyper_param.train_set_file) + ".model";
   }
+  hyper_param.metric = normalize_metric(hyper_param.metric);
 
   return true;
 }
 
 // Check warning and fix conflict
 void Checker::check_conflict_train(HyperParam& hyper_param) {
+  // The online training reads each line once, and has no epoch
+  if (hyper_param.online &&
+      (!hyper_param.validate_set_file.empty() ||
+       hyper_param.cross_validation || !hyper_param.sweep.empty() ||
+       !hyper_param.checkpoint_file.empty() ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       hyper_param.num_label > 1 || hyper_param.on_disk)) {
+    Color::print_warning("The -v, --cv, -sweep, -ckpt, -ps_hosts, -shm, "
+                         "-num_label and --disk options do not work with "
+                         "xlearn_online, and xLearn will ignore them.");
+    hyper_param.validate_set_file.clear();
+    hyper_param.cross_validation = false;
+    hyper_param.sweep.clear();
+    hyper_param.checkpoint_file.clear();
+    hyper_param.ps_hosts.clear();
+    hyper_param.shm_name.clear();
+    hyper_param.num_label = 1;
+    hyper_param.on_disk = false;
+  }
+  if (!hyper_param.online && !hyper_param.delta_file.empty()) {
+    Color::print_warning("The -delta option only works with "
+                         "xlearn_online, and xLearn will ignore it.");
+    hyper_param.delta_file.clear();
+  }
+  if (!hyper_param.online && hyper_param.metrics_port > 0) {
+    Color::print_warning("The -metrics option only works with "
+                         "xlearn_online, and xLearn will ignore it.");
+    hyper_param.metrics_port = 0;
+  }
+  // The folds split the rows of one file
+  if (!hyper_param.train_set_files.empty() &&
+      hyper_param.cross_validation) {
+    Color::print_warning("The list of training files does not work with "
+                         "--cv, and xLearn only uses the first file.");
+    hyper_param.train_set_files.clear();
+  }
+  if (!hyper_param.train_set_files.empty() &&
+      !hyper_param.data_shm.empty()) {
+    Color::print_warning("The -data_shm option does not work with the list "
+                         "of training files, and xLearn will ignore it.");
+    hyper_param.data_shm.clear();
+  }
+  if (hyper_param.from_file && !hyper_param.online &&
+      (IsStreamFile(hyper_param.train_set_file) ||
+       IsStreamFile(hyper_param.validate_set_file))) {
+    if (hyper_param.train_set_file == hyper_param.validate_set_file) {
+      Color::print_error("The training and validation data cannot "
+                         "be read from the same stream.");
+      exit(0);
+    }
+    if (!hyper_param.on_disk) {
+      Color::print_warning("The stream input can only be read by on-disk "
+                           "training. xLearn has already set the --disk option.");
+      hyper_param.on_disk = true;
+    }
+    // The first pass over the data finds the size of model,
+    // and hence the training passes read the cache
+    if (!hyper_param.bin_out) {
+      Color::print_warning("The stream input is read once, so it needs "
+                           "the binary cache. xLearn has already disable "
+                           "the --no-bin option.");
+      hyper_param.bin_out = true;
+    }
+  }
+  if (hyper_param.from_file && hyper_param.on_disk &&
+      (IsParquetFile(hyper_param.train_set_file) ||
+       IsParquetFile(hyper_param.validate_set_file))) {
+    Color::print_warning("The Parquet file can only be read by in-memory "
+                         "training. xLearn has already disable the --disk option.");
+    hyper_param.on_disk = false;
+  }
+  // The field weights of fwfm are not in the shards of the model
+  if (hyper_param.score_func.compare("fwfm") == 0 &&
+      (!hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty())) {
+    Color::print_error("The fwfm model cannot be trained by -ps_hosts "
+                       "and -shm.");
+    exit(0);
+  }
+  // All the workers train the same epochs at the same time
+  if (!hyper_param.ps_hosts.empty()) {
+    if (hyper_param.ps_rank >= (int)hyper_param.ps_hosts.size()) {
+      Color::print_error(
+        StringPrintf("The -ps_rank %d must be less than the number of "
+                     "nodes of -ps_hosts (%lu).", hyper_param.ps_rank,
+                     hyper_param.ps_hosts.size())
+      );
+      exit(0);
+    }
+    if (hyper_param.cross_validation) {
+      Color::print_warning("Distributed training doesn't support cross-validation. "
+                           "xLearn has already disable the -cv option.");
+      hyper_param.cross_validation = false;
+    }
+    if (hyper_param.early_stop) {
+      Color::print_warning("Distributed training doesn't support early-stopping. "
+                           "xLearn has already close early-stopping.");
+      hyper_param.early_stop = false;
+    }
+    if (hyper_param.lazy_init || hyper_param.lazy_l2) {
+      Color::print_warning("Distributed training keeps the whole model on the "
+                           "servers. xLearn has already disable the --lazy-init "
+                           "and --lazy-l2 options.");
+      hyper_param.lazy_init = false;
+      hyper_param.lazy_l2 = false;
+    }
+    if (hyper_param.ps_allreduce && hyper_param.ps_staleness >= 0) {
+      Color::print_warning("The nodes of --allreduce have the same rounds. "
+                           "xLearn has already disable the -ps_staleness option.");
+      hyper_param.ps_staleness = -1;
+    }
+    if (hyper_param.ps_allreduce &&
+        (hyper_param.ps_push != "fp32" || hyper_param.ps_topk < 1)) {
+      Color::print_warning("The change of the model of --allreduce is not compressed. "
+                           "xLearn has already disable the -ps_push and -ps_topk options.");
+      hyper_param.ps_push = "fp32";
+      hyper_param.ps_topk = 1.0;
+    }
+    if (hyper_param.ps_allreduce && hyper_param.ps_cache > 0) {
+      Color::print_warning("The nodes of --allreduce have the whole model. "
+                           "xLearn has already disable the -ps_cache option.");
+      hyper_param.ps_cache = 0;
+    }
+    if (hyper_param.ps_allreduce && hyper_param.ps_partition != "mod") {
+      Color::print_warning("The nodes of --allreduce have no servers. "
+                           "xLearn has already disable the -ps_partition option.");
+      hyper_param.ps_partition = "mod";
+    }
+    hyper_param.num_worker = hyper_param.ps_hosts.size();
+    hyper_param.num_server = hyper_param.ps_allreduce ?
+                             0 : hyper_param.ps_hosts.size();
+  }
+  // The processes of one host train the same epochs at the same time
+  if (!hyper_param.shm_name.empty()) {
+#ifdef _MSC_VER
+    Color::print_error("The -shm option is not supported on Windows.");
+    exit(0);
+#endif
+    if (hyper_param.shm_rank >= hyper_param.shm_procs) {
+      Color::print_error(
+        StringPrintf("The -shm_rank %d must be less than -shm_procs %d.",
+                     hyper_param.shm_rank, hyper_param.shm_procs)
+      );
+      exit(0);
+    }
+    if (!hyper_param.ps_hosts.empty()) {
+      Color::print_error("The -shm and -ps_hosts cannot be used together.");
+      exit(0);
+    }
+    if (hyper_param.cross_validation) {
+      Color::print_warning("Shared-memory training doesn't support cross-validation. "
+                           "xLearn has already disable the -cv option.");
+      hyper_param.cross_validation = false;
+    }
+    if (hyper_param.lazy_init || hyper_param.lazy_l2) {
+      Color::print_warning("The processes of -shm have the whole model. "
+                           "xLearn has already disable the --lazy-init "
+                           "and --lazy-l2 options.");
+      hyper_param.lazy_init = false;
+      hyper_param.lazy_l2 = false;
+    }
+  }
+  // Only the in-memory reader of a file keeps all the rows
+  if (!hyper_param.data_shm.empty()) {
+#ifdef _MSC_VER
+    Color::print_warning("The -data_shm option is not supported on Windows, "
+                         "and xLearn will ignore it.");
+    hyper_param.data_shm.clear();
+#endif
+    if (hyper_param.on_disk || !hyper_param.from_file) {
+      Color::print_warning("The -data_shm option only works with the in-memory "
+                           "training of the data files, and xLearn will ignore it.");
+      hyper_param.data_shm.clear();
+    }
+  }
   if (!hyper_param.from_file && hyper_param.cross_validation) {
     Color::print_warning("Transform DMatrix not from file doesn't support cross-validation. "
                          "xLearn has already disable the -cv option.");
@@ -738,16 +2668,375 @@ void Checker::check_conflict_train(HyperParam& hyper_param) {
                          "xLearn will not dump model checkpoint to disk.");
     hyper_param.model_file.clear();
   }
-  if ((hyper_param.validate_set_file.empty() && hyper_param.valid_dataset == nullptr) 
-      && hyper_param.early_stop) {
+  if (hyper_param.cross_validation && !hyper_param.checkpoint_file.empty()) {
+    Color::print_warning("The --cv (cross-validation) has been set, and "
+                         "xLearn will ignore the -ckpt option.");
+    hyper_param.checkpoint_file.clear();
+  }
+  if (hyper_param.lazy_l2 &&
+      hyper_param.opt_type.compare("sgd") != 0 &&
+      hyper_param.opt_type.compare("adagrad") != 0) {
+    Color::print_warning(
+      StringPrintf("The --lazy-l2 option only supports sgd and adagrad, and "
+                   "xLearn has already disable it for %s.",
+                   hyper_param.opt_type.c_str())
+    );
+    hyper_param.lazy_l2 = false;
+  }
+  if (hyper_param.opt_state.compare("fp32") != 0 &&
+      (hyper_param.opt_type.compare("ftrl") != 0 ||
+       hyper_param.merge_rows > 0 || !hyper_param.ps_hosts.empty() ||
+       !hyper_param.shm_name.empty())) {
+    Color::print_warning("The -opt_state option only works with ftrl "
+                         "without -merge, -ps_hosts and -shm, and xLearn "
+                         "will ignore it.");
+    hyper_param.opt_state = "fp32";
+  }
+  if (hyper_param.num_hot_feature > 0 && hyper_param.merge_rows == 0) {
+    Color::print_warning("The -hot option only works with -merge, and "
+                         "xLearn will ignore it.");
+    hyper_param.num_hot_feature = 0;
+  }
+  if (hyper_param.remap_features &&
+      (hyper_param.cross_validation || !hyper_param.ps_hosts.empty() ||
+       !hyper_param.shm_name.empty() || !hyper_param.stop_file.empty())) {
+    Color::print_warning("The --remap option does not work with --cv, "
+                         "-ps_hosts, -shm and -stop_file, and xLearn "
+                         "will ignore it.");
+    hyper_param.remap_features = false;
+  }
+  if (hyper_param.min_count > 0 &&
+      (hyper_param.cross_validation || !hyper_param.ps_hosts.empty() ||
+       !hyper_param.shm_name.empty() ||
+       !hyper_param.pre_model_file.empty())) {
+    Color::print_warning("The -min_count option does not work with --cv, "
+                         "-ps_hosts, -shm and -pre, and xLearn will "
+                         "ignore it.");
+    hyper_param.min_count = 0;
+  }
+  // The kept features of -min_count are renumbered by their frequency
+  if (hyper_param.min_count > 0 && hyper_param.remap_features) {
+    hyper_param.remap_features = false;
+  }
+  // The allowed pairs are kept by the field index of sparse ffm
+  if (!hyper_param.field_pairs.empty()) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      Color::print_warning("The -field_pairs option only works with ffm, "
+                           "and xLearn will ignore it.");
+      hyper_param.field_pairs.clear();
+    } else {
+      hyper_param.sparse_ffm = true;
+    }
+  }
+  // The shared features are kept by the field index of sparse ffm
+  if (hyper_param.share_count > 0) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      Color::print_warning("The -share_count option only works with ffm, "
+                           "and xLearn will ignore it.");
+      hyper_param.share_count = 0;
+    } else {
+      hyper_param.sparse_ffm = true;
+    }
+  }
+  // The vectors of their own K are kept by the field index
+  if (!hyper_param.field_k.empty()) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      Color::print_warning("The -field_k option only works with ffm, "
+                           "and xLearn will ignore it.");
+      hyper_param.field_k.clear();
+    } else if (hyper_param.prune > 0 || hyper_param.grad_batch > 0) {
+      Color::print_warning("The -field_k option does not work with "
+                           "-prune and -grad_batch, and xLearn will "
+                           "ignore it.");
+      hyper_param.field_k.clear();
+    } else {
+      hyper_param.sparse_ffm = true;
+    }
+  }
+  // The bags pool the vectors of all their blocks
+  if (!hyper_param.bag_field.empty()) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      Color::print_warning("The -bag_field option only works with ffm, "
+                           "and xLearn will ignore it.");
+      hyper_param.bag_field.clear();
+    } else if (!hyper_param.field_k.empty()) {
+      Color::print_warning("The -bag_field option does not work with "
+                           "-field_k, and xLearn will ignore it.");
+      hyper_param.bag_field.clear();
+    }
+  }
+  if (hyper_param.sparse_ffm &&
+      hyper_param.score_func.compare("ffm") != 0) {
+    Color::print_warning("The --sparse-ffm option only works with ffm, "
+                         "and xLearn will ignore it.");
+    hyper_param.sparse_ffm = false;
+  }
+  // The field index is found on the ids of the data, and the
+  // pre-trained model keeps its own layout
+  if (hyper_param.sparse_ffm &&
+      (!hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       !hyper_param.pre_model_file.empty() ||
+       hyper_param.remap_features || hyper_param.min_count > 0 ||
+       hyper_param.sparse_model)) {
+    Color::print_warning("The --sparse-ffm (-field_pairs, -share_count and "
+                         "-field_k) option does not work with -ps_hosts, "
+                         "-shm, -pre, --remap, -min_count and "
+                         "--sparse-model, and xLearn will ignore it.");
+    hyper_param.sparse_ffm = false;
+    hyper_param.field_pairs.clear();
+    hyper_param.share_count = 0;
+    hyper_param.field_k.clear();
+  }
+  // The field map is found by the scan of the training data
+  if (hyper_param.remap_fields &&
+      (hyper_param.score_func.compare("ffm") != 0 &&
+       hyper_param.score_func.compare("fwfm") != 0)) {
+    Color::print_warning("The --remap-fields option only works with ffm "
+                         "and fwfm, and xLearn will ignore it.");
+    hyper_param.remap_fields = false;
+  }
+  if (hyper_param.remap_fields &&
+      (hyper_param.sparse_ffm || !hyper_param.ps_hosts.empty() ||
+       !hyper_param.shm_name.empty() ||
+       !hyper_param.pre_model_file.empty() || hyper_param.online)) {
+    Color::print_warning("The --remap-fields option does not work with "
+                         "--sparse-ffm, -ps_hosts, -shm, -pre and the "
+                         "online training, and xLearn will ignore it.");
+    hyper_param.remap_fields = false;
+  }
+  // The pruned ffm is a sparse ffm model
+  if (hyper_param.prune > 0 &&
+      (hyper_param.score_func.compare("linear") == 0 ||
+       !hyper_param.shm_name.empty() ||
+       (hyper_param.score_func.compare("ffm") == 0 &&
+        hyper_param.sparse_model))) {
+    Color::print_warning("The -prune option does not work with linear, "
+                         "-shm, and --sparse-model of ffm, and xLearn "
+                         "will ignore it.");
+    hyper_param.prune = 0;
+  }
+  if (hyper_param.split_ffm &&
+      (hyper_param.score_func.compare("ffm") != 0 ||
+       hyper_param.sparse_ffm)) {
+    Color::print_warning("The --split-ffm option only works with the "
+                         "dense ffm, and xLearn will ignore it.");
+    hyper_param.split_ffm = false;
+  }
+  if (hyper_param.grad_batch > 0 &&
+      (hyper_param.score_func.compare("fwfm") == 0 ||
+       !hyper_param.lock_free)) {
+    Color::print_warning("The -grad_batch option does not work with fwfm "
+                         "and --dis-lock-free, and xLearn will ignore it.");
+    hyper_param.grad_batch = 0;
+  }
+  if (hyper_param.long_row > 0 &&
+      (hyper_param.score_func.compare("ffm") != 0 ||
+       hyper_param.grad_batch > 0)) {
+    Color::print_warning("The -long_row option only works with ffm "
+                         "without -grad_batch, and xLearn will ignore it.");
+    hyper_param.long_row = 0;
+  }
+  if (hyper_param.sample_row > 0 &&
+      (hyper_param.score_func.compare("ffm") != 0 ||
+       !hyper_param.bag_field.empty())) {
+    Color::print_warning("The -sample_row option only works with ffm "
+                         "without -bag_field, and xLearn will ignore it.");
+    hyper_param.sample_row = 0;
+  }
+  // The owners apply the batch gradients of the rows of one model
+  if (hyper_param.owner_rows > 0 &&
+      (hyper_param.score_func.compare("fwfm") == 0 ||
+       hyper_param.merge_rows > 0 || hyper_param.long_row > 0 ||
+       hyper_param.lazy_init || hyper_param.lazy_l2 ||
+       !hyper_param.field_k.empty() ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       hyper_param.num_label > 1 || hyper_param.online ||
+       hyper_param.numa_policy.compare("replicate") == 0)) {
+    Color::print_warning("The -owner option does not work with fwfm, "
+                         "-merge, -long_row, --lazy-init, --lazy-l2, "
+                         "-field_k, -ps_hosts, -shm, "
+                         "multi-task, -numa replicate and the online "
+                         "training, and xLearn will ignore it.");
+    hyper_param.owner_rows = 0;
+  }
+  if (hyper_param.owner_rows > 0 &&
+      (hyper_param.grad_batch > 0 || !hyper_param.lock_free)) {
+    Color::print_warning("Each parameter is written by its owner, so the "
+                         "-grad_batch and --dis-lock-free options are not "
+                         "used by -owner.");
+    hyper_param.grad_batch = 0;
+    hyper_param.lock_free = true;
+  }
+  if (hyper_param.num_label > 1 &&
+      (hyper_param.cross_validation || !hyper_param.sweep.empty() ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       !hyper_param.pre_model_file.empty() ||
+       !hyper_param.param_file.empty() || !hyper_param.from_file ||
+       IsParquetFile(hyper_param.train_set_file))) {
+    Color::print_warning("The -num_label option does not work with --cv, "
+                         "-sweep, -ps_hosts, -shm, -pre, -param_file, the "
+                         "DMatrix of python and Parquet, and xLearn will "
+                         "ignore it.");
+    hyper_param.num_label = 1;
+  }
+  if (!hyper_param.task_loss.empty() &&
+      hyper_param.task_loss.size() != hyper_param.num_label - 1) {
+    Color::print_warning(
+      StringPrintf("The -task_loss option needs %d losses for -num_label "
+                   "%d, and xLearn will ignore it.",
+                   hyper_param.num_label - 1, hyper_param.num_label)
+    );
+    hyper_param.task_loss.clear();
+  }
+  // The models of the other tasks cannot roll back to the best epoch
+  if (hyper_param.num_label > 1 && hyper_param.early_stop &&
+      !hyper_param.validate_set_file.empty()) {
+    Color::print_warning("The early-stopping does not work with "
+                         "-num_label, and xLearn has already disable it.");
+    hyper_param.early_stop = false;
+  }
+  if (hyper_param.field_major &&
+      (hyper_param.score_func.compare("ffm") != 0 ||
+       hyper_param.sparse_ffm || hyper_param.split_ffm)) {
+    Color::print_warning("The --field-major option only works with the "
+                         "dense ffm without --split-ffm, and xLearn "
+                         "will ignore it.");
+    hyper_param.field_major = false;
+  }
+  if (hyper_param.async_validate &&
+      (hyper_param.cross_validation || !hyper_param.ps_hosts.empty() ||
+       !hyper_param.shm_name.empty() || !hyper_param.stop_file.empty())) {
+    Color::print_warning("The --async-valid option does not work with --cv, "
+                         "-ps_hosts, -shm and -stop_file, and xLearn "
+                         "will ignore it.");
+    hyper_param.async_validate = false;
+  }
+  if ((hyper_param.valid_every > 1 || hyper_param.valid_rows > 0 ||
+       hyper_param.valid_sample < 1) &&
+      (hyper_param.cross_validation || !hyper_param.ps_hosts.empty() ||
+       !hyper_param.shm_name.empty())) {
+    Color::print_warning("The -valid_every, -valid_rows and -valid_sample "
+                         "options do not work with --cv, -ps_hosts and "
+                         "-shm, and xLearn will ignore them.");
+    hyper_param.valid_every = 1;
+    hyper_param.valid_rows = 0;
+    hyper_param.valid_sample = 1.0;
+  }
+  if (!hyper_param.sweep.empty() &&
+      (!hyper_param.from_file || hyper_param.on_disk ||
+       hyper_param.cross_validation ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       !hyper_param.pre_model_file.empty() ||
+       !hyper_param.checkpoint_file.empty() ||
+       !hyper_param.stop_file.empty())) {
+    Color::print_warning("The -sweep option only works with the in-memory "
+                         "training of the data files, and not with --cv, "
+                         "-ps_hosts, -shm, -pre, -ckpt and -stop_file, so "
+                         "xLearn will ignore it.");
+    hyper_param.sweep.clear();
+  }
+  if (!hyper_param.sweep.empty() &&
+      hyper_param.validate_set_file.empty() &&
+      hyper_param.valid_dataset == nullptr &&
+      hyper_param.valid_iter.Empty()) {
+    Color::print_warning("The -sweep option needs the validation data (-v) "
+                         "to compare the configurations, and xLearn will "
+                         "ignore it.");
+    hyper_param.sweep.clear();
+  }
+  // The jobs of the sweep validate each epoch by their own loss
+  if (!hyper_param.sweep.empty() &&
+      (hyper_param.async_validate || hyper_param.valid_rows > 0 ||
+       hyper_param.valid_sample < 1)) {
+    Color::print_warning("The --async-valid, -valid_rows and -valid_sample "
+                         "options do not work with -sweep, and xLearn will "
+                         "ignore them.");
+    hyper_param.async_validate = false;
+    hyper_param.valid_rows = 0;
+    hyper_param.valid_sample = 1.0;
+  }
+  if (hyper_param.valid_rows > 0 && hyper_param.async_validate) {
+    Color::print_warning("The -valid_rows option does not work with "
+                         "--async-valid, and xLearn will ignore it.");
+    hyper_param.valid_rows = 0;
+  }
+  // These options keep more models or a copy of the model in memory
+  if (!hyper_param.param_file.empty() &&
+      (hyper_param.cross_validation || !hyper_param.sweep.empty() ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       hyper_param.async_validate || !hyper_param.checkpoint_file.empty() ||
+       hyper_param.numa_policy.compare("replicate") == 0)) {
+    Color::print_warning("The -param_file option does not work with --cv, "
+                         "-sweep, -ps_hosts, -shm, --async-valid, -ckpt and "
+                         "-numa replicate, and xLearn will ignore it.");
+    hyper_param.param_file.clear();
+  }
+  // The copies of the NUMA nodes are only trained by the gradient
+  // pass of one model, which has no per-row state of its own
+  if (hyper_param.numa_policy.compare("replicate") == 0 &&
+      (hyper_param.cross_validation || !hyper_param.sweep.empty() ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       !hyper_param.stop_file.empty() || hyper_param.lazy_init ||
+       hyper_param.lazy_l2 || hyper_param.merge_rows > 0 ||
+       hyper_param.valid_rows > 0 || hyper_param.online)) {
+    Color::print_warning("The -numa replicate option does not work with "
+                         "--cv, -sweep, -ps_hosts, -shm, -stop_file, "
+                         "--lazy-init, --lazy-l2, -merge, -valid_rows and "
+                         "the online training, and xLearn will use "
+                         "-numa none.");
+    hyper_param.numa_policy = "none";
+  }
+  if (hyper_param.param_mem > 0 && hyper_param.param_file.empty()) {
+    Color::print_warning("The -param_mem option only works with "
+                         "-param_file, and xLearn will ignore it.");
+    hyper_param.param_mem = 0;
+  }
+  if (hyper_param.model_checksum && hyper_param.sparse_model) {
+    Color::print_warning("The --checksum option only works with the "
+                         "dense model file, and xLearn will ignore it.");
+    hyper_param.model_checksum = false;
+  }
+  // The trials train their own models on the rows in memory
+  if (hyper_param.autotune &&
+      (hyper_param.on_disk || hyper_param.online ||
+       hyper_param.cross_validation || !hyper_param.sweep.empty() ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       !hyper_param.param_file.empty() ||
+       !hyper_param.train_set_files.empty() ||
+       !hyper_param.train_iter.Empty() || hyper_param.num_label > 1)) {
+    Color::print_warning("The --autotune option only works with the "
+                         "in-memory training of one file or DMatrix, and "
+                         "not with --cv, -sweep, -ps_hosts, -shm, "
+                         "-param_file and -num_label, so xLearn will "
+                         "ignore it.");
+    hyper_param.autotune = false;
+  }
+  if ((hyper_param.validate_set_file.empty() &&
+       hyper_param.valid_dataset == nullptr &&
+       hyper_param.valid_iter.Empty()) && hyper_param.early_stop) {
     Color::print_warning("Validation file(dataset) not found, xLearn has already "
                          "disable early-stopping.");
     hyper_param.early_stop = false;
   }
+  std::vector<std::string> metrics = metric_list(hyper_param.metric);
+  if (hyper_param.exact_auc &&
+      std::find(metrics.begin(), metrics.end(), "auc") == metrics.end()) {
+    Color::print_warning("The --exact-auc option only works with -x auc, "
+                         "and xLearn will ignore it.");
+    hyper_param.exact_auc = false;
+  }
+  if (hyper_param.train_metric && hyper_param.metric.compare("none") == 0) {
+    Color::print_warning("The --train-metric option needs a metric (-x), "
+                         "and xLearn will ignore it.");
+    hyper_param.train_metric = false;
+  }
+  // The metric is still used by --train-metric
   if (hyper_param.metric.compare("none") != 0 &&
       hyper_param.validate_set_file.empty() && 
       hyper_param.valid_dataset == nullptr &&
-      !hyper_param.cross_validation) {
+      hyper_param.valid_iter.Empty() &&
+      !hyper_param.cross_validation &&
+      !hyper_param.train_metric) {
     Color::print_warning(
       StringPrintf("Validation file not found, xLearn has already "
                    "disable (-x %s) option.", 
@@ -755,33 +3044,74 @@ void Checker::check_conflict_train(HyperParam& hyper_param) {
     );
     hyper_param.metric = "none";
   }
-  if (hyper_param.loss_func.compare("squared") == 0) {
-    if (hyper_param.metric.compare("acc") == 0 ||
-        hyper_param.metric.compare("prec") == 0 ||
-        hyper_param.metric.compare("recall") == 0 ||
-        hyper_param.metric.compare("f1") == 0) {
+  if (hyper_param.shuffle_window > 0 && hyper_param.on_disk) {
+    Color::print_warning("The -shuffle_window can only be used in the "
+                         "in-memory training. xLearn will ignore this "
+                         "option.");
+    hyper_param.shuffle_window = 0;
+  }
+  // The packed rows are not kept in the matrix of the reader
+  if (hyper_param.pack_rows &&
+      (hyper_param.cross_validation || !hyper_param.sweep.empty() ||
+       hyper_param.autotune || !hyper_param.data_shm.empty() ||
+       hyper_param.shuffle_window > 0)) {
+    Color::print_warning("The --pack-rows option does not work with --cv, "
+                         "-sweep, --autotune, -data_shm and -shuffle_window, "
+                         "and xLearn will ignore it.");
+    hyper_param.pack_rows = false;
+  }
+  if (hyper_param.neg_rate < 1 &&
+      hyper_param.loss_func.compare("cross-entropy") != 0) {
+    Color::print_warning("The -neg_rate can only be used in classification "
+                         "tasks. xLearn will ignore this option.");
+    hyper_param.neg_rate = 1.0;
+  }
+  // The loss of each row is kept by the in-memory reader, and
+  // only the gradient pass of one cross-entropy model weights it
+  if (hyper_param.loss_sample < 1 &&
+      (hyper_param.loss_func.compare("cross-entropy") != 0 ||
+       hyper_param.on_disk || hyper_param.cross_validation ||
+       !hyper_param.ps_hosts.empty() || !hyper_param.shm_name.empty() ||
+       hyper_param.num_label > 1 || hyper_param.online)) {
+    Color::print_warning("The -loss_sample option only works with the "
+                         "in-memory training of cross-entropy, and it "
+                         "does not work with --cv, -ps_hosts, -shm, "
+                         "multi-task and the online training. xLearn "
+                         "will ignore it.");
+    hyper_param.loss_sample = 1.0;
+  }
+  // The metrics of the other task are removed from the list
+  metrics = metric_list(hyper_param.metric);
+  std::vector<std::string> kept;
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    const std::string& name = metrics[i];
+    if (hyper_param.loss_func.compare("squared") == 0 &&
+        (name.compare("acc") == 0 ||
+         name.compare("prec") == 0 ||
+         name.compare("recall") == 0 ||
+         name.compare("f1") == 0)) {
       Color::print_warning(
         StringPrintf("The -x: %s metric can only be used "
                      "in classification tasks. xLearn will "
                      "ignore this option.",
-                     hyper_param.metric.c_str())
+                     name.c_str())
       );
-      hyper_param.metric = "none";
-    }
-  } else if (hyper_param.loss_func.compare("cross-entropy") == 0) {
-    if (hyper_param.metric.compare("mae") == 0 ||
-        hyper_param.metric.compare("mape") == 0 ||
-        hyper_param.metric.compare("rmsd") == 0 ||
-        hyper_param.metric.compare("rmse") == 0) {
+    } else if (hyper_param.loss_func.compare("cross-entropy") == 0 &&
+               (name.compare("mae") == 0 ||
+                name.compare("mape") == 0 ||
+                name.compare("rmsd") == 0 ||
+                name.compare("rmse") == 0)) {
       Color::print_warning(
         StringPrintf("The -x: %s metric can only be used "
                      "in regression tasks. xLearn will ignore "
                      "this option.",
-                     hyper_param.metric.c_str())
+                     name.c_str())
       );
-      hyper_param.metric = "none";
+    } else {
+      kept.push_back(name);
     }
   }
+  hyper_param.metric = join_metrics(kept);
 }
 
 // Check options for prediction tasks
@@ -797,8 +3127,27 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
   /*********************************************************
    *  Check the path of test set file                      *
    *********************************************************/
-  if (FileExist(args_[1].c_str())) {
-    hyper_param.test_set_file = std::string(args_[1]);
+  StringList test_files = ExpandFileList(args_[1]);
+  if (test_files.size() > 1) {
+    for (size_t i = 0; i < test_files.size(); ++i) {
+      if (IsStreamFile(test_files[i])) {
+        Color::print_error("The stdin or a pipe cannot be in the list of test files.");
+        return false;
+      }
+      if (!FileExist(test_files[i].c_str())) {
+        Color::print_error(
+          StringPrintf("Test set file: %s does not exist.",
+               test_files[i].c_str())
+        );
+        return false;
+      }
+    }
+    hyper_param.test_set_files = test_files;
+    hyper_param.test_set_file = test_files[0];
+  } else if (test_files.size() == 1 &&
+            (IsStreamFile(test_files[0]) || IsRemoteFile(test_files[0]) ||
+             FileExist(test_files[0].c_str()))) {
+    hyper_param.test_set_file = test_files[0];
   } else {
     Color::print_error(
       StringPrintf("Test set file: %s does not exist.",
@@ -809,7 +3158,21 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
   /*********************************************************
    *  Check the path of model file                         *
    *********************************************************/
-  if (FileExist(args_[2].c_str())) {
+  StringList model_files = ExpandFileList(args_[2]);
+  if (model_files.size() > 1) {
+    for (size_t i = 0; i < model_files.size(); ++i) {
+      if (!FileExist(model_files[i].c_str())) {
+        Color::print_error(
+          StringPrintf("Model file: %s does not exist.",
+               model_files[i].c_str())
+        );
+        return false;
+      }
+    }
+    hyper_param.model_file = model_files[0];
+    hyper_param.ensemble_files.assign(model_files.begin() + 1,
+                                      model_files.end());
+  } else if (FileExist(args_[2].c_str())) {
     hyper_param.model_file = std::string(args_[2]);
   } else {
     Color::print_error(
@@ -827,6 +3190,18 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
     if (list[i].compare("-o") == 0) {  // path of the output
       hyper_param.output_file = list[i+1];
       i += 2;
+    } else if (list[i].compare("-test_jobs") == 0) {  // files at the same time
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -test_jobs : '%i'. -test_jobs must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.test_jobs = value;
+      }
+      i += 2;
     } else if (list[i].compare("-l") == 0) {  // path of the log file
       hyper_param.log_file = list[i+1];
       i += 2;
@@ -842,6 +3217,20 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
         hyper_param.thread_number = value;
       }
       i += 2;
+    } else if (list[i].compare("-affinity") == 0) {  // cpu affinity
+      AffinityPolicy policy;
+      std::vector<int> cpus;
+      if (!ParseAffinity(list[i+1], &policy, &cpus)) {
+        Color::print_error(
+          StringPrintf("Unknow affinity '%s'. -affinity can only be: "
+                       "none, compact, scatter, or a cpu list (e.g., 0-7,16-23).",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.affinity = list[i+1];
+      }
+      i += 2;
     } else if (list[i].compare("-block") == 0) {  // block size for on-disk training
       int value = atoi(list[i+1].c_str());
       if (value <= 0) {
@@ -854,18 +3243,183 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
         hyper_param.block_size = value;
       }
       i += 2;
+    } else if (list[i].compare("-pf") == 0) {  // prefetch distance
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -pf : '%i'. -pf must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.prefetch_distance = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-hash") == 0) {  // bits of hashing trick
+      int value = atoi(list[i+1].c_str());
+      if (value < 1 || value > 31) {
+        Color::print_error(
+          StringPrintf("Illegal -hash : '%i'. -hash must be in range [1, 31].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.hash_bits = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-cross") == 0) {  // crosses of the fields
+      std::vector<FieldCross> crosses;
+      if (!ParseCrosses(list[i+1], &crosses)) {
+        Color::print_error(
+          StringPrintf("Illegal -cross : '%s'. -cross must be the pairs "
+                       "of fields, e.g., '0:1,2:5'.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.cross = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-bag_field") == 0) {  // bags of ffm
+      std::vector<index_t> fields;
+      if (!ParseBagFields(list[i+1], &fields)) {
+        Color::print_error(
+          StringPrintf("Illegal -bag_field : '%s'. -bag_field must be "
+                       "the distinct fields, e.g., '3,7'.",
+                       list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.bag_field = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-bag_pool") == 0) {  // pooling of bags
+      if (list[i+1].compare("sum") != 0 &&
+          list[i+1].compare("mean") != 0) {
+        Color::print_error(
+          StringPrintf("Unknow pooling '%s'. -bag_pool can only be: "
+                       "sum and mean.", list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.bag_pool = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-numa") == 0) {  // NUMA policy
+      NumaPolicy policy;
+      if (!ParseNumaPolicy(list[i+1], &policy) || policy == kNumaLocal) {
+        Color::print_error(
+          StringPrintf("Unknow NUMA policy '%s'. -numa can only be: "
+                       "none, interleave, or replicate for prediction.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.numa_policy = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-io") == 0) {  // page cache of the files
+      FileIO io;
+      if (!ParseFileIO(list[i+1], &io)) {
+        Color::print_error(
+          StringPrintf("Unknow file io '%s'. -io can only be: "
+                       "cache, nocache, direct, or uring.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.file_io = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-part") == 0) {  // row partition
+      RowPartition partition;
+      if (!ParseRowPartition(list[i+1], &partition)) {
+        Color::print_error(
+          StringPrintf("Unknow row partition '%s'. -part can only be: "
+                       "row, nnz, or dynamic.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.partition = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-latent") == 0) {  // storage type of latent factor
+      StorageType type;
+      if (!ParseStorageType(list[i+1], &type)) {
+        Color::print_error(
+          StringPrintf("Unknow storage type '%s'. -latent can only be: "
+                       "fp32, fp16, bf16, or int8.",
+               list[i+1].c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.latent_type = list[i+1];
+      }
+      i += 2;
     } else if (list[i].compare("--sign") == 0) {  // convert output to 0 and 1
       hyper_param.sign = true;
       i += 1;
     } else if (list[i].compare("--sigmoid") == 0) {  // using sigmoid
       hyper_param.sigmoid = true;
       i += 1;
+    } else if (list[i].compare("--raw-out") == 0) {  // raw float32 output
+      hyper_param.raw_out = true;
+      i += 1;
+    } else if (list[i].compare("--gpu") == 0) {  // score on the gpu
+      hyper_param.use_gpu = true;
+      i += 1;
+    } else if (list[i].compare("-gpu_device") == 0) {  // id of the gpu
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -gpu_device : '%i'. -gpu_device must be "
+                       "greater than or equal to zero.",
+                       value)
+        );
+        bo = false;
+      } else {
+        hyper_param.gpu_device = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-pair_table") == 0) {  // cells of the pair tables
+      long long value = atoll(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -pair_table : '%lld'. -pair_table must be "
+                       "greater than or equal to zero.",
+                       value)
+        );
+        bo = false;
+      } else {
+        hyper_param.pair_cells = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-blend") == 0) {  // weights of the models
+      StringList weights;
+      SplitStringUsing(list[i+1], ",", &weights);
+      hyper_param.blend_weights.clear();
+      for (size_t j = 0; j < weights.size(); ++j) {
+        hyper_param.blend_weights.push_back(atof(weights[j].c_str()));
+      }
+      i += 2;
     } else if (list[i].compare("--disk") == 0) {  // on-disk prediction
       hyper_param.on_disk = true;
       i += 1;
+    } else if (list[i].compare("--huge-page") == 0) {  // huge pages
+      hyper_param.huge_page = true;
+      i += 1;
     } else if (list[i].compare("--no-norm") == 0) {  // normalization
       hyper_param.norm = false;
       i += 1;
+    } else if (list[i].compare("--skip-zeros") == 0) {  // drop zero features
+      hyper_param.skip_zeros = true;
+      i += 1;
+    } else if (list[i].compare("--merge-dup") == 0) {  // merge duplicates
+      hyper_param.merge_dup = true;
+      i += 1;
+    } else if (list[i].compare("-trace") == 0) {  // trace of the spans
+      hyper_param.trace_file = list[i+1];
+      i += 2;
     } else {  // no match
       std::string similar_str;
       ss.FindSimilar(list[i], menu_, similar_str);
@@ -878,6 +3432,11 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
       break;
     }
   }
+  if (!hyper_param.cross.empty() && hyper_param.hash_bits == 0) {
+    Color::print_error("The crosses of the fields (-cross) "
+                       "need the hashing trick (-hash).");
+    bo = false;
+  }
   if (!bo) { return false; }
   /*********************************************************
    *  Check warning and fix conflict                       *
@@ -886,13 +3445,58 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
   /*********************************************************
    *  Set default value                                    *
    *********************************************************/
+  if (!hyper_param.test_set_files.empty()) {
+    return set_output_files(hyper_param);
+  }
   if (hyper_param.output_file.empty()) {
-    hyper_param.output_file = hyper_param.test_set_file + ".out";
+    hyper_param.output_file =
+        OutputPrefix(hyper_param.test_set_file) + ".out";
   }
 
   return true;
 }
 
+// Set the output file of each test file, where -o can be
+// empty, a directory, or a list of the same number of files
+bool Checker::set_output_files(HyperParam& hyper_param) {
+  const StringList& test_files = hyper_param.test_set_files;
+  const std::string& out = hyper_param.output_file;
+  StringList& out_files = hyper_param.output_files;
+  out_files.clear();
+  if (out.empty()) {
+    for (size_t i = 0; i < test_files.size(); ++i) {
+      out_files.push_back(test_files[i] + ".out");
+    }
+  } else if (out[out.size()-1] == '/' || IsDirectory(out)) {
+    if (!IsDirectory(out)) {
+      Color::print_error(
+        StringPrintf("Output directory: %s does not exist.",
+             out.c_str())
+      );
+      return false;
+    }
+    std::string dir = out[out.size()-1] == '/' ? out : out + "/";
+    for (size_t i = 0; i < test_files.size(); ++i) {
+      size_t pos = test_files[i].find_last_of("/\\");
+      std::string name = pos == std::string::npos ?
+          test_files[i] : test_files[i].substr(pos + 1);
+      out_files.push_back(dir + name + ".out");
+    }
+  } else {
+    out_files = ExpandFileList(out);
+    if (out_files.size() != test_files.size()) {
+      Color::print_error(
+        StringPrintf("-o must be a directory or %lu output files "
+                     "for %lu test files, but it has %lu files.",
+             test_files.size(), test_files.size(), out_files.size())
+      );
+      return false;
+    }
+  }
+  hyper_param.output_file = out_files[0];
+  return true;
+}
+
 // Check the given param. Used by c_api
 bool Checker::check_prediction_param(HyperParam& hyper_param) {
  bool bo = true;
@@ -900,7 +3504,8 @@ bool Checker::check_prediction_param(HyperParam& hyper_param) {
   *  Check the path of test set file                      *
   *********************************************************/
  if (hyper_param.from_file) {
-  if (!FileExist(hyper_param.test_set_file.c_str())) {
+  if (!IsRemoteFile(hyper_param.test_set_file) &&
+      !FileExist(hyper_param.test_set_file.c_str())) {
       Color::print_error(
         StringPrintf("Test set file: %s does not exist.",
             hyper_param.test_set_file.c_str())
@@ -915,6 +3520,29 @@ bool Checker::check_prediction_param(HyperParam& hyper_param) {
       bo =  false;
    }
  }
+ if (!check_model_param(hyper_param)) { bo = false; }
+ if (!bo) return false;
+ /*********************************************************
+  *  Check warning and fix conflict                       *
+  *********************************************************/
+ check_conflict_predict(hyper_param);
+ /*********************************************************
+  *  Set default value                                    *
+  *********************************************************/
+ if (hyper_param.res_out) {
+  if (hyper_param.output_file.empty()) {
+    hyper_param.output_file =
+        OutputPrefix(hyper_param.test_set_file) + ".out";
+  }
+ }
+
+ return true;
+}
+
+// Check the model and the options of prediction,
+// which do not depend on the test data
+bool Checker::check_model_param(HyperParam& hyper_param) {
+ bool bo = true;
  /*********************************************************
   *  Check the path of model file                         *
   *********************************************************/
@@ -935,25 +3563,129 @@ bool Checker::check_prediction_param(HyperParam& hyper_param) {
     );
     bo = false;
   }
- if (!bo) return false;
- /*********************************************************
-  *  Check warning and fix conflict                       *
-  *********************************************************/
- check_conflict_predict(hyper_param);
- /*********************************************************
-  *  Set default value                                    *
-  *********************************************************/
- if (hyper_param.res_out) {
-  if (hyper_param.output_file.empty()) {
-    hyper_param.output_file = hyper_param.test_set_file + ".out";
-  }
+ StorageType type;
+ if (!ParseStorageType(hyper_param.latent_type, &type)) {
+    Color::print_error(
+      StringPrintf("Unknow storage type: %s. It can only be: "
+                   "fp32, fp16, bf16, or int8.",
+        hyper_param.latent_type.c_str())
+    );
+    bo = false;
+ }
+ NumaPolicy policy;
+ if (!ParseNumaPolicy(hyper_param.numa_policy, &policy) ||
+     policy == kNumaLocal) {
+    Color::print_error(
+      StringPrintf("Unknow NUMA policy: %s. It can only be: "
+                   "none, interleave, or replicate for prediction.",
+        hyper_param.numa_policy.c_str())
+    );
+    bo = false;
+ }
+ FileIO io;
+ if (!ParseFileIO(hyper_param.file_io, &io)) {
+    Color::print_error(
+      StringPrintf("Unknow file io: %s. It can only be: "
+                   "cache, nocache, direct, or uring.",
+        hyper_param.file_io.c_str())
+    );
+    bo = false;
  }
+ RowPartition partition;
+ if (!ParseRowPartition(hyper_param.partition, &partition)) {
+    Color::print_error(
+      StringPrintf("Unknow row partition: %s. It can only be: "
+                   "row, nnz, or dynamic.",
+        hyper_param.partition.c_str())
+    );
+    bo = false;
+ }
+ AffinityPolicy affinity;
+ std::vector<int> cpus;
+ if (!ParseAffinity(hyper_param.affinity, &affinity, &cpus)) {
+    Color::print_error(
+      StringPrintf("Unknow affinity: %s. It can only be: "
+                   "none, compact, scatter, or a cpu list.",
+        hyper_param.affinity.c_str())
+    );
+    bo = false;
+ }
+ if (hyper_param.batch_window < 0 || hyper_param.batch_rows <= 0) {
+    Color::print_error(
+      StringPrintf("The batch window must be greater than or equal "
+                   "to zero: %d, and the batch rows must be greater "
+                   "than zero: %d.",
+        hyper_param.batch_window, hyper_param.batch_rows)
+    );
+    bo = false;
+ }
+ if (hyper_param.result_cache < 0) {
+    Color::print_error(
+      StringPrintf("The result cache must be greater than or equal "
+                   "to zero: %d.", hyper_param.result_cache)
+    );
+    bo = false;
+ }
+ if (hyper_param.metrics_port < 0 || hyper_param.metrics_port > 65535) {
+    Color::print_error(
+      StringPrintf("The metrics port must be 0 ~ 65535: %d.",
+        hyper_param.metrics_port)
+    );
+    bo = false;
+ }
+ if (!hyper_param.cross.empty() && hyper_param.hash_bits == 0) {
+    Color::print_error("The crosses of the fields (-cross) "
+                       "need the hashing trick (-hash).");
+    bo = false;
+ }
+ if (!bo) return false;
+ check_conflict_output(hyper_param);
 
  return true;
 }
 
 // Check warning and fix conflict
 void Checker::check_conflict_predict(HyperParam& hyper_param) {
+  if (hyper_param.from_file &&
+      IsStreamFile(hyper_param.test_set_file)) {
+    // The stream is predicted in one pass without the cache
+    hyper_param.on_disk = true;
+    hyper_param.bin_out = false;
+  }
+  if (hyper_param.from_file && hyper_param.on_disk &&
+      IsParquetFile(hyper_param.test_set_file)) {
+    Color::print_warning("The Parquet file can only be read by in-memory "
+                         "prediction. xLearn has already disable the --disk option.");
+    hyper_param.on_disk = false;
+  }
+  if (!hyper_param.ensemble_files.empty() &&
+      hyper_param.test_set_files.size() > 1) {
+    Color::print_warning("The list of model files does not work with several "
+                         "test files, and xLearn only uses the first model.");
+    hyper_param.ensemble_files.clear();
+  }
+  if (hyper_param.pair_cells > 0 &&
+      (hyper_param.test_set_files.size() > 1 ||
+       (hyper_param.from_file &&
+        IsStreamFile(hyper_param.test_set_file)))) {
+    Color::print_warning("The -pair_table option needs one test file that can "
+                         "be read twice. xLearn will ignore it.");
+    hyper_param.pair_cells = 0;
+  }
+  size_t num_models = hyper_param.ensemble_files.size() + 1;
+  if (!hyper_param.blend_weights.empty() &&
+      hyper_param.blend_weights.size() != num_models) {
+    Color::print_warning(
+      StringPrintf("The -blend option needs %lu weights for %lu models, "
+                   "and xLearn will ignore it.", num_models, num_models)
+    );
+    hyper_param.blend_weights.clear();
+  }
+  check_conflict_output(hyper_param);
+}
+
+// Only one of --sign and --sigmoid can be used
+void Checker::check_conflict_output(HyperParam& hyper_param) {
   if (hyper_param.sign && hyper_param.sigmoid) {
     Color::print_warning("Both of --sign and --sigmoid have been set. "
                          "xLearn has already disable --sign and --sigmoid.");
@@ -50,6 +50,11 @@ class Checker {
   // Check hyper-param. Used by c_api
   bool check_param(HyperParam& hyper_param);
 
+  // Check the model file and the prediction options which
+  // do not depend on the test data. Used by the loaded model
+  // of c_api, which predicts the data given by each call.
+  bool check_model_param(HyperParam& hyper_param);
+
  protected:
   /* Store all the possible options */
   StringList menu_;
@@ -63,11 +68,14 @@ class Checker {
 
   // Check options for training and prediction
   bool check_train_options(HyperParam& hyper_param);
+  bool check_train_files(const std::string& list, HyperParam& hyper_param);
   bool check_train_param(HyperParam& hyper_param);
   bool check_prediction_options(HyperParam& hyper_param);
   bool check_prediction_param(HyperParam& hyper_param);
+  bool set_output_files(HyperParam& hyper_param);
   void check_conflict_train(HyperParam& hyper_param);
   void check_conflict_predict(HyperParam& hyper_param);
+  void check_conflict_output(HyperParam& hyper_param);
   
  private:
   DISALLOW_COPY_AND_ASSIGN(Checker);
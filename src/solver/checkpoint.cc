@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the Checkpoint class.
+*/
+
+#include "src/solver/checkpoint.h"
+
+#include <cstdio>
+#include <random>
+
+#include "src/base/file_util.h"
+#include "src/base/logging.h"
+
+namespace xLearn {
+
+// Initialize the interval of the checkpoints
+void Checkpoint::Initialize(const std::string& filename,
+                            int num_epoch,
+                            real_t num_minute,
+                            int start_epoch) {
+  CHECK(!filename.empty());
+  CHECK_GE(num_epoch, 0);
+  CHECK_GE(num_minute, 0);
+  filename_ = filename;
+  num_epoch_ = num_epoch;
+  num_minute_ = num_minute;
+  if (num_epoch_ == 0 && num_minute_ == 0) {
+    num_epoch_ = 1;
+  }
+  last_epoch_ = start_epoch;
+  last_time_ = std::chrono::steady_clock::now();
+}
+
+void Checkpoint::SetDeltaFile(const std::string& prefix) {
+  delta_prefix_ = prefix;
+  std::random_device rd;
+  run_id_ = rd();
+}
+
+bool Checkpoint::is_due(int epoch) {
+  if (num_epoch_ > 0 && epoch - last_epoch_ >= num_epoch_) {
+    return true;
+  }
+  if (num_minute_ > 0) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - last_time_;
+    return elapsed.count() >= num_minute_ * 60;
+  }
+  return false;
+}
+
+// The snapshot is copied by the training thread between two
+// epochs, when the gradient threads are idle, so it is consistent,
+// and only the copy is spent by the training.
+bool Checkpoint::Step(Model* model, int epoch) {
+  CHECK_NOTNULL(model);
+  CHECK(!filename_.empty());
+  if (!is_due(epoch)) { return false; }
+  if (!done_.load()) {
+    LOG(WARNING) << "Skip the checkpoint of epoch " << epoch
+                 << ", since the last one is still being written.";
+    return false;
+  }
+  if (writer_.joinable()) { writer_.join(); }
+  // The last snapshot is the base of the delta
+  base_id_ = snapshot_.GetVersionId();
+  has_delta_ = !delta_prefix_.empty() && feature_map_ == nullptr &&
+               base_id_ != 0 && model->ChangedFeatures(&snapshot_,
+                                                       &changed_);
+  model->Snapshot(&snapshot_);
+  snapshot_.SetEpoch(epoch);
+  if (!delta_prefix_.empty()) {
+    snapshot_.SetVersionId(((uint64)run_id_ << 32) | (uint32)epoch);
+  }
+  last_epoch_ = epoch;
+  last_time_ = std::chrono::steady_clock::now();
+  done_.store(false);
+  writer_ = std::thread(&Checkpoint::write, this);
+  return true;
+}
+
+void Checkpoint::Wait() {
+  if (writer_.joinable()) { writer_.join(); }
+}
+
+// Write the new checkpoint aside and then replace the old one
+void Checkpoint::write() {
+  std::string tmp = filename_ + ".tmp";
+  // The snapshot is moved by the writer, not by the training
+  if (feature_map_ != nullptr) {
+    snapshot_.RemapFeatures(*feature_map_);
+  }
+  snapshot_.Serialize(tmp);
+  if (replace(tmp, filename_)) {
+    written_epoch_ = snapshot_.GetEpoch();
+    LOG(INFO) << "Checkpoint of epoch " << written_epoch_
+              << ": " << filename_;
+  }
+  if (!inference_file_.empty()) {
+    tmp = inference_file_ + ".tmp";
+    snapshot_.SerializeInference(tmp, inference_type_);
+    replace(tmp, inference_file_);
+  }
+  if (has_delta_) {
+    std::string delta = delta_prefix_ + "." + std::to_string(
+        snapshot_.GetEpoch());
+    tmp = delta + ".tmp";
+    snapshot_.SerializeDelta(tmp, changed_, base_id_);
+    if (replace(tmp, delta)) {
+      LOG(INFO) << "Delta of epoch " << snapshot_.GetEpoch() << ": "
+                << delta << " (" << changed_.size() << " features)";
+    }
+  }
+  done_.store(true);
+}
+
+bool Checkpoint::replace(const std::string& tmp,
+                         const std::string& filename) {
+#ifdef _MSC_VER
+  // rename() does not replace the file on Windows
+  if (FileExist(filename.c_str())) {
+    RemoveFile(filename.c_str());
+  }
+#endif
+  if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+    LOG(ERR) << "Cannot rename " << tmp << " to " << filename;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace xLearn
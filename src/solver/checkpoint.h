@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the Checkpoint class.
+*/
+
+#ifndef XLEARN_SOLVER_CHECKPOINT_H_
+#define XLEARN_SOLVER_CHECKPOINT_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Checkpoint writes the model to a checkpoint file during the
+// training, every num_epoch epochs or every num_minute minutes.
+// At the end of an epoch the gradient threads are idle, so Step()
+// copies the model to a snapshot, and a background thread writes
+// the snapshot while the next epoch is trained. The file has the
+// format of the model file with the number of the trained epochs,
+// so the training resumes from it by using -pre.
+//
+//    Checkpoint checkpoint;
+//    checkpoint.Initialize("/tmp/model.ckpt", 1, 0);
+//    for (int n = 1; n <= epoch; ++n) {
+//      /* train one epoch ... */
+//      checkpoint.Step(model, n);
+//    }
+//    checkpoint.Wait();
+//
+// The snapshot is written to filename.tmp first and then renamed,
+// so a failure in the middle of a write keeps the last checkpoint.
+// If the last write is still running when the next checkpoint is
+// due, this checkpoint is skipped instead of waiting for it.
+//------------------------------------------------------------------------------
+class Checkpoint {
+ public:
+  // Constructor and Destructor
+  Checkpoint() { }
+  ~Checkpoint() { Wait(); }
+
+  // Invoke this function before we use this class. A checkpoint
+  // is due after num_epoch epochs (0 for no limit) or num_minute
+  // minutes (0 for no limit), and it is written at the end of
+  // each epoch if both of them are 0. The epochs are counted
+  // from start_epoch, which is the epoch of the resumed model.
+  void Initialize(const std::string& filename,
+                  int num_epoch,
+                  real_t num_minute,
+                  int start_epoch = 0);
+
+  // Start to write a checkpoint of the model after the given
+  // epoch if it is due. Return true if it is started.
+  bool Step(Model* model, int epoch);
+
+  // Wait for the write in the background.
+  void Wait();
+
+  // Move the features of the snapshot by the map in the background
+  // before it is written (see Model::RemapFeatures), e.g., back to
+  // the ids of the data when the model is trained on the renumbered
+  // features.
+  // The map is kept by the caller, and nullptr (by default) keeps
+  // the features.
+  inline void SetFeatureMap(const std::vector<index_t>* map) {
+    feature_map_ = map;
+  }
+
+  // Also write the snapshot to the inference model file after each
+  // checkpoint (see Model::SerializeInference), in the same way by a
+  // rename, so the serving processes can map the new file and swap it
+  // in (see Solver::ReloadModel). The filename is empty by default,
+  // which writes no inference file.
+  inline void SetInferenceFile(const std::string& filename,
+                               StorageType type) {
+    inference_file_ = filename;
+    inference_type_ = type;
+  }
+
+  // Also write the delta from the last checkpoint to prefix.<epoch>
+  // after each checkpoint (see Model::SerializeDelta), which only has
+  // the changed features, so the serving processes apply it to their
+  // model in place (see Solver::ApplyDelta) instead of loading the
+  // whole file. Each snapshot gets the version id of (a random id of
+  // this run << 32 | epoch). The first checkpoint has no delta, and
+  // neither does the snapshot that is moved by a feature map.
+  void SetDeltaFile(const std::string& prefix);
+
+  // Get the last epoch that has been written (or 0), which
+  // is read after Wait().
+  inline int LastEpoch() { return written_epoch_; }
+
+ protected:
+  /* Filename of the checkpoint */
+  std::string filename_;
+  /* Epochs between two checkpoints */
+  int num_epoch_ = 0;
+  /* Minutes between two checkpoints */
+  real_t num_minute_ = 0;
+  /* The epoch of the last checkpoint */
+  int last_epoch_ = 0;
+  /* The epoch of the last finished write */
+  int written_epoch_ = 0;
+  /* Start time of the last checkpoint */
+  std::chrono::steady_clock::time_point last_time_;
+  /* The copy of the model being written */
+  Model snapshot_;
+  /* The inference model file and its type of the latent factors */
+  std::string inference_file_;
+  StorageType inference_type_ = kStoreFP32;
+  /* The prefix of the delta files, the random id of this run, and
+  the delta of the snapshot: its base version and changed features */
+  std::string delta_prefix_;
+  uint32 run_id_ = 0;
+  uint64 base_id_ = 0;
+  std::vector<index_t> changed_;
+  bool has_delta_ = false;
+  /* The map of the features of the snapshot, or nullptr */
+  const std::vector<index_t>* feature_map_ = nullptr;
+  /* The background writer */
+  std::thread writer_;
+  /* If the write of writer_ is finished */
+  std::atomic<bool> done_{true};
+
+  // Check if a checkpoint is due after the given epoch.
+  bool is_due(int epoch);
+
+  // Write the snapshot to the checkpoint file.
+  void write();
+
+  // Write the file aside and then replace the old one.
+  static bool replace(const std::string& tmp, const std::string& filename);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Checkpoint);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_CHECKPOINT_H_
@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of convert.h.
+*/
+
+#include "src/solver/convert.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "src/reader/parser.h"
+#include "src/reader/reader.h"
+
+namespace xLearn {
+
+// The in-memory reader writes the cache in background until it is
+// deleted, and the on-disk reader writes it during the pass.
+void ConvertFile(const std::string& filename,
+                 size_t shard,
+                 const ConvertOption& option,
+                 ThreadPool* pool,
+                 ConvertStats* stats) {
+  FileIO io;
+  CHECK(ParseFileIO(option.file_io, &io));
+  std::unique_ptr<Reader> reader(
+      CREATE_READER(option.on_disk ? "disk" : "memory"));
+  CHECK(reader != nullptr);
+  reader->SetBlockSize(option.block_size);
+  reader->SetHashBits(option.hash_bits);
+  reader->SetSkipZeros(option.skip_zeros);
+  reader->SetMergeDuplicates(option.merge_dup);
+  reader->SetCrosses(option.cross);
+  reader->SetNumLabels(option.num_label);
+  reader->SetFileIO(io);
+  reader->SetThreadPool(pool);
+  if (option.num_shard > 1) {
+    reader->SetShard(shard, option.num_shard);
+  }
+  reader->Initialize(filename);
+  stats->has_label = reader->has_label();
+  DMatrix* matrix = nullptr;
+  while (reader->Samples(matrix) > 0) {
+    for (index_t i = 0; i < matrix->row_length; ++i) {
+      const SparseRow* row = matrix->row[i];
+      for (SparseRow::const_iterator iter = row->begin();
+           iter != row->end(); ++iter) {
+        stats->data.AddNode(iter->feat_id, iter->field_id);
+      }
+      if (row->empty()) { stats->empty++; }
+      stats->max_nnz = std::max(stats->max_nnz, (uint64)row->size());
+      if (stats->has_label && matrix->Y[i] > 0) { stats->positive++; }
+    }
+    stats->data.rows += matrix->row_length;
+  }
+}
+
+}  // namespace xLearn
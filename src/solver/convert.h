@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the conversion of the text files into the binary
+caches of xlearn_convert (see convert_main.cc).
+*/
+
+#ifndef XLEARN_SOLVER_CONVERT_H_
+#define XLEARN_SOLVER_CONVERT_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// The options of xlearn_convert, which are the options of the parser
+// and the reader of xlearn_train of the same names.
+struct ConvertOption {
+  std::vector<std::string> files;
+  size_t num_thread = 0;
+  size_t num_shard = 1;
+  int hash_bits = 0;
+  std::string cross;
+  int num_label = 1;
+  int block_size = 500;  // MB
+  std::string file_io = "cache";
+  bool on_disk = false;
+  bool skip_zeros = false;
+  bool merge_dup = false;
+};
+
+// The rows of a file (or a shard), which are counted as they are read.
+struct ConvertStats {
+  DataStats data;
+  uint64 positive = 0;
+  uint64 empty = 0;
+  uint64 max_nnz = 0;
+  bool has_label = false;
+};
+
+// Read all the rows of the shard of the file by the threads of pool,
+// which writes its cache as the training would write it: filename.bin,
+// or filename.disk.bin if option.on_disk, and filename.2-of-4.bin for
+// the shard 2 of option.num_shard = 4. The cache carries the hash of
+// the parser options, so only the readers of the same options take it.
+// The rows are counted in stats.
+void ConvertFile(const std::string& filename,
+                 size_t shard,
+                 const ConvertOption& option,
+                 ThreadPool* pool,
+                 ConvertStats* stats);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_CONVERT_H_
@@ -0,0 +1,213 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the entry of xlearn_convert, which converts the text
+files (libsvm, libffm or csv, compressed or not) into the binary
+caches that xlearn_train and xlearn_predict read, e.g., in the ETL
+of the data before the training jobs:
+
+  ./xlearn_convert train.txt.gz test.txt -nthread 16 -shards 4 -hash 24
+
+Each file is parsed by all the threads, and its cache is written as
+the training would write it, with the same name and the same hash of
+the parser options, so the jobs with the same -hash, -cross,
+--skip-zeros, --merge-dup and -num_label find it and skip the parsing.
+The cache is filename.bin for the training in memory, or
+filename.disk.bin with --disk for the on-disk training (of the same
+-block). With -shards n, the n shards of the file (see -ps_shard and
+-shm) get their own caches, e.g., filename.2-of-4.bin. A cache that
+is still valid is kept. The rows are checked on the way, and the
+stats of each file are printed: the rows, the nodes, the largest ids
+and the labels.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/format_print.h"
+#include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
+#include "src/base/timer.h"
+#include "src/reader/parser.h"
+#include "src/solver/convert.h"
+
+namespace xLearn {
+
+static void usage() {
+  printf("Usage: xlearn_convert <file> [<file> ...] [-nthread n]\n"
+         "  [-shards 1] [-hash bits] [-cross pairs] [-num_label 1]\n"
+         "  [-block 500] [-io cache|nocache|direct|uring] [--disk]\n"
+         "  [--skip-zeros] [--merge-dup]\n");
+  exit(0);
+}
+
+static int parse_int(const std::string& name,
+                     const std::string& value,
+                     int min) {
+  int n = atoi(value.c_str());
+  if (n < min) {
+    Color::print_error(
+      StringPrintf("Illegal %s : '%s'. %s must be greater than or "
+                   "equal to %d.", name.c_str(), value.c_str(),
+                   name.c_str(), min)
+    );
+    exit(1);
+  }
+  return n;
+}
+
+static void parse_option(int argc, char* argv[], ConvertOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string name = argv[i];
+    if (name == "-h" || name == "--help") { usage(); }
+    if (name == "--disk") {
+      option->on_disk = true;
+      continue;
+    } else if (name == "--skip-zeros") {
+      option->skip_zeros = true;
+      continue;
+    } else if (name == "--merge-dup") {
+      option->merge_dup = true;
+      continue;
+    } else if (name.empty() || name[0] != '-') {
+      option->files.push_back(name);
+      continue;
+    }
+    if (i + 1 >= argc) { usage(); }
+    std::string value = argv[++i];
+    if (name == "-nthread") {
+      option->num_thread = parse_int(name, value, 1);
+    } else if (name == "-shards") {
+      option->num_shard = parse_int(name, value, 1);
+    } else if (name == "-hash") {
+      option->hash_bits = parse_int(name, value, 0);
+      if (option->hash_bits > 31) {
+        Color::print_error("Illegal -hash. -hash must be at most 31.");
+        exit(1);
+      }
+    } else if (name == "-cross") {
+      std::vector<FieldCross> crosses;
+      if (!ParseCrosses(value, &crosses)) {
+        Color::print_error(
+          StringPrintf("Illegal -cross : '%s'. -cross must be the pairs "
+                       "of fields, e.g., '0:1,2:5'.", value.c_str())
+        );
+        exit(1);
+      }
+      option->cross = value;
+    } else if (name == "-num_label") {
+      option->num_label = parse_int(name, value, 1);
+    } else if (name == "-block") {
+      option->block_size = parse_int(name, value, 1);
+    } else if (name == "-io") {
+      FileIO io;
+      if (!ParseFileIO(value, &io)) {
+        Color::print_error(
+          StringPrintf("Unknow -io : '%s'. -io can only be: cache, "
+                       "nocache, direct and uring.", value.c_str())
+        );
+        exit(1);
+      }
+      option->file_io = value;
+    } else {
+      Color::print_error(
+        StringPrintf("Unknow option: %s", name.c_str())
+      );
+      usage();
+    }
+  }
+  if (option->files.empty()) { usage(); }
+}
+
+static void print_stats(const std::string& name,
+                        const ConvertStats& stats,
+                        double seconds) {
+  const DataStats& data = stats.data;
+  Color::print_info(
+    StringPrintf("%s: %llu rows, %llu nodes (%.2f per row, at most "
+                 "%llu), largest feature %u and field %u, in %.2f sec",
+                 name.c_str(), (unsigned long long)data.rows,
+                 (unsigned long long)data.nnz,
+                 data.rows > 0 ? (double)data.nnz / data.rows : 0.0,
+                 (unsigned long long)stats.max_nnz,
+                 data.max_feat, data.max_field, seconds)
+  );
+  if (stats.has_label && data.rows > 0) {
+    Color::print_info(
+      StringPrintf("%s: %.4f%% positive labels", name.c_str(),
+                   100.0 * stats.positive / data.rows)
+    );
+  }
+  if (stats.empty > 0) {
+    Color::print_warning(
+      StringPrintf("%s: %llu rows have no feature.", name.c_str(),
+                   (unsigned long long)stats.empty)
+    );
+  }
+}
+
+}  // namespace xLearn
+
+//------------------------------------------------------------------------------
+// The pre-defined main function
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  using namespace xLearn;
+  Timer timer;
+  timer.tic();
+  ConvertOption option;
+  parse_option(argc, argv, &option);
+  size_t num_thread = option.num_thread > 0 ?
+                      option.num_thread : DefaultThreadNumber();
+  ThreadPool pool(num_thread);
+  Color::print_info(
+    StringPrintf("Convert %lu files by %lu threads into the %s caches.",
+                 option.files.size(), num_thread,
+                 option.on_disk ? "on-disk" : "in-memory")
+  );
+  for (const std::string& filename : option.files) {
+    if (!FileExist(filename.c_str())) {
+      Color::print_error(
+        StringPrintf("Cannot open the file %s", filename.c_str())
+      );
+      return 1;
+    }
+    for (size_t shard = 0; shard < option.num_shard; ++shard) {
+      Timer shard_timer;
+      shard_timer.tic();
+      ConvertStats stats;
+      ConvertFile(filename, shard, option, &pool, &stats);
+      std::string name = filename;
+      if (option.num_shard > 1) {
+        name += StringPrintf(" (shard %lu of %lu)", shard,
+                             option.num_shard);
+      }
+      print_stats(name, stats, shard_timer.toc());
+    }
+  }
+  Color::print_info(
+    StringPrintf("Total time cost: %.2f (sec)", timer.toc()),
+    NOT_IMPORTANT_MSG
+  );
+  return 0;
+}
@@ -0,0 +1,201 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the conversion of xlearn_convert.
+*/
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
+#include "src/reader/reader.h"
+#include "src/solver/convert.h"
+#include "src/solver/solver.h"
+
+namespace xLearn {
+
+const std::string kSvmFile = "./convert_test.libsvm";
+const std::string kFfmFile = "./convert_test.libffm";
+const index_t kRows = 6;
+
+void write_test_files() {
+  std::ofstream svm(kSvmFile);
+  std::ofstream ffm(kFfmFile);
+  for (index_t i = 0; i < kRows; ++i) {
+    svm << i % 2 << " " << i << ":1 " << i + 3 << ":0.5\n";
+    ffm << i % 2 << " 0:" << i << ":1 1:" << i + 3 << ":0.5\n";
+  }
+}
+
+// Each row of the reader, e.g., "1 0:2:1 1:5:0.5"
+std::vector<std::string> read_rows(Reader* reader) {
+  std::vector<std::string> rows;
+  DMatrix* matrix = nullptr;
+  while (reader->Samples(matrix) > 0) {
+    for (index_t i = 0; i < matrix->row_length; ++i) {
+      std::string row = StringPrintf("%g", matrix->Y[i]);
+      const SparseRow* nodes = matrix->row[i];
+      for (SparseRow::const_iterator iter = nodes->begin();
+           iter != nodes->end(); ++iter) {
+        row += StringPrintf(" %u:%u:%g", iter->field_id,
+                            iter->feat_id, iter->feat_val);
+      }
+      rows.push_back(row);
+    }
+  }
+  return rows;
+}
+
+// The reader of the options, as xlearn_train creates it
+Reader* create_reader(const ConvertOption& option, ThreadPool* pool) {
+  Reader* reader = CREATE_READER(option.on_disk ? "disk" : "memory");
+  reader->SetBlockSize(option.block_size);
+  reader->SetHashBits(option.hash_bits);
+  reader->SetThreadPool(pool);
+  return reader;
+}
+
+// The rows of the shard parsed from the text without any cache
+std::vector<std::string> read_text(const std::string& filename,
+                                   size_t shard,
+                                   const ConvertOption& option,
+                                   ThreadPool* pool) {
+  std::unique_ptr<Reader> reader(create_reader(option, pool));
+  reader->SetNoBin();
+  if (option.num_shard > 1) {
+    reader->SetShard(shard, option.num_shard);
+  }
+  reader->SetShowInfo(false);
+  reader->Initialize(filename);
+  return read_rows(reader.get());
+}
+
+std::string cache_name(const std::string& filename,
+                       size_t shard,
+                       const ConvertOption& option) {
+  std::string name = filename;
+  if (option.num_shard > 1) {
+    name += StringPrintf(".%lu-of-%lu", shard, option.num_shard);
+  }
+  return name + (option.on_disk ? ".disk.bin" : ".bin");
+}
+
+// Convert the shards of the file, and then the reader of the same
+// options finds each cache and reads the rows of the text from it,
+// while the reader of another -hash does not take it.
+void check_convert(const std::string& filename,
+                   const ConvertOption& option) {
+  ThreadPool pool(2);
+  for (size_t shard = 0; shard < option.num_shard; ++shard) {
+    std::string cache = cache_name(filename, shard, option);
+    if (FileExist(cache.c_str())) { RemoveFile(cache.c_str()); }
+    ConvertStats stats;
+    ConvertFile(filename, shard, option, &pool, &stats);
+    std::vector<std::string> expect =
+      read_text(filename, shard, option, &pool);
+    EXPECT_EQ(stats.data.rows, expect.size());
+    EXPECT_TRUE(stats.has_label);
+    ASSERT_TRUE(FileExist(cache.c_str()));
+    std::unique_ptr<Reader> reader(create_reader(option, &pool));
+    if (option.num_shard > 1) {
+      reader->SetShard(shard, option.num_shard);
+    }
+    testing::internal::CaptureStdout();
+    reader->Initialize(filename);
+    std::string log = testing::internal::GetCapturedStdout();
+    EXPECT_NE(log.find(cache + ") found"), std::string::npos) << log;
+    EXPECT_EQ(read_rows(reader.get()), expect);
+    reader.reset();
+    ConvertOption other = option;
+    other.hash_bits = option.hash_bits + 1;
+    reader.reset(create_reader(other, &pool));
+    reader->SetNoBin();
+    if (option.num_shard > 1) {
+      reader->SetShard(shard, option.num_shard);
+    }
+    testing::internal::CaptureStdout();
+    reader->Initialize(filename);
+    log = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(log.find(cache + ") found"), std::string::npos) << log;
+    reader.reset();
+    RemoveFile(cache.c_str());
+  }
+}
+
+TEST(ConvertTest, ConvertFile) {
+  write_test_files();
+  for (const std::string& filename : { kSvmFile, kFfmFile }) {
+    for (bool on_disk : { false, true }) {
+      for (size_t num_shard : { 1, 2 }) {
+        ConvertOption option;
+        option.block_size = 1;
+        option.hash_bits = 20;
+        option.on_disk = on_disk;
+        option.num_shard = num_shard;
+        check_convert(filename, option);
+      }
+    }
+  }
+  RemoveFile(kSvmFile.c_str());
+  RemoveFile(kFfmFile.c_str());
+}
+
+// xlearn_train of the default options skips the parsing of the
+// converted file.
+TEST(ConvertTest, Train_from_cache) {
+  write_test_files();
+  const std::string model_file = "./convert_test.model";
+  for (bool on_disk : { false, true }) {
+    ConvertOption option;
+    option.on_disk = on_disk;
+    std::string cache = cache_name(kFfmFile, 0, option);
+    ThreadPool pool(2);
+    ConvertStats stats;
+    ConvertFile(kFfmFile, 0, option, &pool, &stats);
+    ASSERT_TRUE(FileExist(cache.c_str()));
+    std::vector<std::string> cmd = { "xlearn_train", kFfmFile, "-s", "2",
+                                     "-e", "1", "-nthread", "2",
+                                     "-m", model_file };
+    if (on_disk) { cmd.push_back("--disk"); }
+    std::vector<char*> argv;
+    for (size_t i = 0; i < cmd.size(); ++i) {
+      argv.push_back(&cmd[i][0]);
+    }
+    testing::internal::CaptureStdout();
+    Solver solver;
+    solver.SetTrain();
+    solver.Initialize(argv.size(), argv.data());
+    solver.StartWork();
+    solver.Clear();
+    std::string log = testing::internal::GetCapturedStdout();
+    EXPECT_NE(log.find(cache + ") found"), std::string::npos) << log;
+    EXPECT_TRUE(FileExist(model_file.c_str()));
+    RemoveFile(model_file.c_str());
+    RemoveFile(cache.c_str());
+  }
+  RemoveFile(kFfmFile.c_str());
+  RemoveFile(kSvmFile.c_str());
+}
+
+}  // namespace xLearn
@@ -21,47 +21,167 @@ This file is the implementation of the Predictor class.
 #include "src/solver/inference.h"
 #include "src/base/timer.h"
 #include "src/base/format_print.h"
+#include "src/base/math.h"
+#include "src/base/file_util.h"
 
+#include <algorithm>
 #include <vector>
-#include <sstream>
+#include <cstring>
 
 namespace xLearn {
 
 // Given a pre-trained model and test data, the predictor
 // will return the prediction output
 void Predictor::Predict() {
-  if (res_out_)
-    std::ofstream o_file(out_file_);
-  static std::vector<real_t> out;
+  FILE* file = nullptr;
+  if (res_out_) {
+    file = OpenFileOrDie(out_file_.c_str(), raw_out_ ? "wb" : "w");
+  }
+  std::vector<real_t> out;
   DMatrix* matrix = nullptr;
   reader_->Reset();
   loss_->Reset();
+  for (size_t m = 0; m < ensemble_loss_.size(); ++m) {
+    ensemble_loss_[m]->Reset();
+  }
+  // The predictions of the other models, and then the blend
+  std::vector<std::vector<real_t>> cols(ensemble_model_.size() +
+                                        (blend_.empty() ? 0 : 1));
+  out_.clear();
+  num_result_ = 0;
   for (;;) {
     index_t tmp = reader_->Samples(matrix);
     if (tmp == 0) { break; }
     if (tmp != out.size()) { out.resize(tmp); }
-    loss_->Predict(matrix, *model_, out);
-    if (reader_->has_label()) {
-      loss_->Evaluate(out, matrix->Y);
+    if (gpu_ != nullptr) {
+      gpu_->Predict(matrix, gpu_norm_, out.data());
+      if (reader_->has_label()) { loss_->Evaluate(out, matrix->Y); }
+    } else if (reader_->has_label()) {
+      loss_->PredictAndEvaluate(matrix, *model_, out, nullptr);
+    } else {
+      loss_->Predict(matrix, *model_, out);
+    }
+    for (size_t m = 0; m < ensemble_model_.size(); ++m) {
+      cols[m].resize(tmp);
+      if (reader_->has_label()) {
+        ensemble_loss_[m]->PredictAndEvaluate(matrix, *ensemble_model_[m],
+                                              cols[m], nullptr);
+      } else {
+        ensemble_loss_[m]->Predict(matrix, *ensemble_model_[m], cols[m]);
+      }
+    }
+    if (!blend_.empty()) {
+      std::vector<real_t>& blend = cols.back();
+      blend.resize(tmp);
+      for (size_t i = 0; i < tmp; ++i) {
+        blend[i] = blend_[0] * out[i];
+      }
+      for (size_t m = 0; m < ensemble_model_.size(); ++m) {
+        for (size_t i = 0; i < tmp; ++i) {
+          blend[i] += blend_[m+1] * cols[m][i];
+        }
+      }
     }
-    if (sigmoid_) {
-      this->sigmoid(out, out);
-    } else if (sign_) {
-      this->sign(out, out);
+    convert(out);
+    for (size_t m = 0; m < cols.size(); ++m) {
+      convert(cols[m]);
     }
-    this->out_.insert(this->out_.end(), out.begin(), out.end());
-    if (res_out_) {
-      std::ofstream o_file(out_file_, std::ofstream::app);
-      for (index_t i = 0; i < out.size(); ++i) {
-        o_file << out[i] << "\n";
+    if (res_out_ && !cols.empty()) {
+      write_columns(file, out, cols);
+    } else if (res_out_) {
+      write(file, out);
+    } else if (out_buffer_ != nullptr) {
+      if (num_result_ < out_length_) {
+        size_t len = std::min(out.size(), out_length_ - num_result_);
+        memcpy(out_buffer_ + num_result_, out.data(),
+               len * sizeof(real_t));
       }
+    } else {
+      this->out_.insert(this->out_.end(), out.begin(), out.end());
     }
+    num_result_ += out.size();
   }
-  if (reader_->has_label()) {
+  if (res_out_) {
+    flush(file);
+    Close(file);
+  }
+  if (reader_->has_label() && show_info_) {
     Color::print_info(
       StringPrintf("The test loss is: %.6f", 
         loss_->GetLoss())
     );
+    for (size_t m = 0; m < ensemble_loss_.size(); ++m) {
+      Color::print_info(
+        StringPrintf("The test loss of model %lu is: %.6f",
+          m + 2, ensemble_loss_[m]->GetLoss())
+      );
+    }
+  }
+}
+
+// The output buffer is written to the file every 4 MB
+static const size_t kOutputBufferSize = 4 * 1024 * 1024;
+
+// Append the predictions to the output buffer
+void Predictor::write(FILE* file, const std::vector<real_t>& out) {
+  if (raw_out_) {
+    size_t len = buffer_.size();
+    buffer_.resize(len + out.size() * sizeof(real_t));
+    memcpy(buffer_.data() + len, out.data(), out.size() * sizeof(real_t));
+  } else {
+    // "%g" is the same as the default format of std::ostream
+    char str[32];
+    for (size_t i = 0; i < out.size(); ++i) {
+      int n = snprintf(str, sizeof(str), "%g\n", out[i]);
+      buffer_.insert(buffer_.end(), str, str + n);
+    }
+  }
+  if (buffer_.size() >= kOutputBufferSize) { flush(file); }
+}
+
+// Append the rows of the columns to the output buffer
+void Predictor::write_columns(FILE* file,
+                              const std::vector<real_t>& out,
+                              const std::vector<std::vector<real_t>>& cols) {
+  if (raw_out_) {
+    std::vector<real_t> row(cols.size() + 1);
+    for (size_t i = 0; i < out.size(); ++i) {
+      row[0] = out[i];
+      for (size_t m = 0; m < cols.size(); ++m) {
+        row[m+1] = cols[m][i];
+      }
+      size_t len = buffer_.size();
+      buffer_.resize(len + row.size() * sizeof(real_t));
+      memcpy(buffer_.data() + len, row.data(), row.size() * sizeof(real_t));
+    }
+  } else {
+    char str[32];
+    for (size_t i = 0; i < out.size(); ++i) {
+      int n = snprintf(str, sizeof(str), "%g", out[i]);
+      buffer_.insert(buffer_.end(), str, str + n);
+      for (size_t m = 0; m < cols.size(); ++m) {
+        n = snprintf(str, sizeof(str), "\t%g", cols[m][i]);
+        buffer_.insert(buffer_.end(), str, str + n);
+      }
+      buffer_.push_back('\n');
+    }
+  }
+  if (buffer_.size() >= kOutputBufferSize) { flush(file); }
+}
+
+// Write the rest of the buffer to the file
+void Predictor::flush(FILE* file) {
+  if (buffer_.empty()) { return; }
+  WriteDataToDisk(file, buffer_.data(), buffer_.size());
+  buffer_.clear();
+}
+
+// Convert the output by --sign or --sigmoid.
+void Predictor::convert(std::vector<real_t>& out) {
+  if (sigmoid_) {
+    this->sigmoid(out, out);
+  } else if (sign_) {
+    this->sign(out, out);
   }
 }
 
@@ -69,9 +189,7 @@ void Predictor::Predict() {
 void Predictor::sigmoid(std::vector<real_t>& in, 
                         std::vector<real_t>& out) {
   CHECK_EQ(in.size(), out.size());
-  for (size_t i = 0; i < in.size(); ++i) {
-    out[i] = 1.0 / (1.0 + exp(-in[i]));
-  }
+  VecSigmoid(in.data(), out.data(), in.size());
 }
 
 // Convert output to 0 and 1.
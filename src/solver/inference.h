@@ -22,18 +22,34 @@ This file defines the Predictor class.
 #define XLEARN_SOLVER_INFERENCE_H_
 
 #include <string>
+#include <vector>
+#include <cstdio>
 
 #include "src/base/common.h"
 #include "src/data/data_structure.h"
 #include "src/data/model_parameters.h"
 #include "src/reader/reader.h"
 #include "src/loss/loss.h"
+#include "src/score/gpu_score.h"
 
 namespace xLearn {
 
 //------------------------------------------------------------------------------
 // Given a pre-trained model and test data, the predictor
-// will return the prediction output
+// will return the prediction output.
+//
+// The predictions are streamed to the output file by one writer with
+// a large buffer, which is text (one value per line) by default, or raw
+// float32 values if raw_out is set. If res_out is false, which is used
+// by the C API, they are written to the buffer of the caller given by
+// SetOutputBuffer(), or kept in memory for GetResult() without it.
+//
+// The other models of an ensemble (AddModel) score each matrix of the
+// reader after the first model, so the test file is read and parsed
+// once for all of them. Each line of the output file then has the
+// predictions of all the models, separated by tabs, and the weighted
+// sum of their scores (SetBlend) as the last column. The buffer of the
+// caller and GetResult() only get the predictions of the first model.
 //------------------------------------------------------------------------------
 class Predictor {
  public:
@@ -48,7 +64,8 @@ class Predictor {
                   const std::string& out,
                   bool sign = false,
                   bool sigmoid = false,
-                  bool res_out = true) {
+                  bool res_out = true,
+                  bool raw_out = false) {
     CHECK_NOTNULL(reader);
     CHECK_NOTNULL(model);
     CHECK_NOTNULL(loss);
@@ -61,16 +78,54 @@ class Predictor {
     sign_ = sign;
     sigmoid_ = sigmoid;
     res_out_ = res_out;
+    raw_out_ = raw_out;
+  }
+
+  // Write the predictions to the buffer of length values instead
+  // of GetResult(). The rows beyond the length are only counted.
+  void SetOutputBuffer(real_t* buffer, size_t length) {
+    out_buffer_ = buffer;
+    out_length_ = length;
+  }
+
+  // Add another model of the ensemble, which is scored by its
+  // own loss, so it can have another score function.
+  void AddModel(Model* model, Loss* loss) {
+    CHECK_NOTNULL(model);
+    CHECK_NOTNULL(loss);
+    ensemble_model_.push_back(model);
+    ensemble_loss_.push_back(loss);
+  }
+
+  // Weights of the blend of the scores, with the one of the
+  // first model first. The blend is not written if it is empty.
+  void SetBlend(const std::vector<real_t>& weights) {
+    CHECK_EQ(weights.size(), ensemble_model_.size() + 1);
+    blend_ = weights;
+  }
+
+  // Do not print the test loss, which is printed by the
+  // caller when several files are predicted at the same time.
+  void SetShowInfo(bool show) { show_info_ = show; }
+
+  // Score the rows on the device of the initialized gpu instead of
+  // the loss, which still evaluates the predictions of the labels.
+  void SetGpuScore(GpuScore* gpu, bool is_norm) {
+    gpu_ = gpu;
+    gpu_norm_ = is_norm;
   }
 
   // The core function
   void Predict();
 
   // Get the results
-  inline std::vector<real_t> GetResult() {
+  inline std::vector<real_t>& GetResult() {
     return this->out_;
   }
 
+  // Number of the predictions of the last Predict()
+  inline size_t GetNumResult() { return num_result_; }
+
  protected:
   Reader* reader_;
   Model* model_;
@@ -80,6 +135,38 @@ class Predictor {
   bool sign_;
   bool sigmoid_;
   bool res_out_;
+  bool raw_out_;
+  /* The buffer of the caller for the predictions */
+  real_t* out_buffer_ = nullptr;
+  size_t out_length_ = 0;
+  size_t num_result_ = 0;
+  bool show_info_ = true;
+  /* Scores the rows if it is not nullptr */
+  GpuScore* gpu_ = nullptr;
+  bool gpu_norm_ = true;
+  /* The other models of the ensemble and their losses */
+  std::vector<Model*> ensemble_model_;
+  std::vector<Loss*> ensemble_loss_;
+  std::vector<real_t> blend_;
+  /* Buffer of the output, which is written to
+  the file when it is full */
+  std::vector<char> buffer_;
+
+  // Append the predictions to the output buffer,
+  // and write the buffer to the file if it is full.
+  void write(FILE* file, const std::vector<real_t>& out);
+
+  // Same as write(), but each line has the predictions of out
+  // and then the ones of the columns.
+  void write_columns(FILE* file,
+                     const std::vector<real_t>& out,
+                     const std::vector<std::vector<real_t>>& cols);
+
+  // Convert the output by --sign or --sigmoid.
+  void convert(std::vector<real_t>& out);
+
+  // Write the rest of the buffer to the file.
+  void flush(FILE* file);
 
   // Convert output by using the sigmoid function.
   void sigmoid(std::vector<real_t>& in, 
@@ -0,0 +1,138 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the sources of lines.
+*/
+
+#include "src/solver/line_source.h"
+
+#include <fcntl.h>
+#ifndef _MSC_VER
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#include "src/base/file_util.h"
+#include "src/base/format_print.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+// The last line of a stream is ended by a newline
+static void end_line(std::string* buf) {
+  if (!buf->empty() && buf->back() != '\n') {
+    buf->push_back('\n');
+  }
+}
+
+FileLineSource::~FileLineSource() {
+  if (fd_ > 0) {
+#ifndef _MSC_VER
+    close(fd_);
+#else
+    _close(fd_);
+#endif
+  }
+}
+
+bool FileLineSource::Open() {
+  if (filename_ == kStdinFile) {
+    fd_ = 0;
+  } else {
+#ifndef _MSC_VER
+    fd_ = open(filename_.c_str(), O_RDONLY);
+#else
+    fd_ = _open(filename_.c_str(), _O_RDONLY | _O_BINARY);
+#endif
+  }
+  return fd_ >= 0;
+}
+
+bool FileLineSource::Read(std::string* buf,
+                          size_t max_bytes,
+                          int timeout_ms) {
+  CHECK_NOTNULL(buf);
+  CHECK_GE(fd_, 0);
+  size_t size = buf->size();
+#ifndef _MSC_VER
+  struct pollfd fds;
+  fds.fd = fd_;
+  fds.events = POLLIN;
+  if (poll(&fds, 1, timeout_ms) == 0) { return true; }
+  buf->resize(size + max_bytes);
+  ssize_t n = read(fd_, &(*buf)[size], max_bytes);
+#else
+  buf->resize(size + max_bytes);
+  int n = _read(fd_, &(*buf)[size], (unsigned)max_bytes);
+#endif
+  buf->resize(size + (n > 0 ? n : 0));
+  if (n <= 0) {
+    end_line(buf);
+    return false;
+  }
+  return true;
+}
+
+bool SocketLineSource::Open() {
+  int port = listener_.Listen(port_);
+  if (port < 0) { return false; }
+  port_ = port;
+  return true;
+}
+
+bool SocketLineSource::Read(std::string* buf,
+                            size_t max_bytes,
+                            int timeout_ms) {
+  CHECK_NOTNULL(buf);
+  CHECK(listener_.IsOpen());
+  if (!conn_.IsOpen()) {
+    if (!listener_.Wait(timeout_ms)) { return true; }
+    if (listener_.Accept(&conn_)) {
+      LOG(INFO) << "Accept a producer of the lines on port " << port_;
+    }
+    return true;
+  }
+  if (!conn_.Wait(timeout_ms)) { return true; }
+  size_t size = buf->size();
+  buf->resize(size + max_bytes);
+  int64 n = conn_.RecvSome(&(*buf)[size], max_bytes);
+  buf->resize(size + (n > 0 ? n : 0));
+  if (n <= 0) {
+    // The producer is gone, and the next one is accepted
+    conn_.Close();
+    end_line(buf);
+  }
+  return true;
+}
+
+bool IsSocketSource(const std::string& name) {
+  return name.compare(0, 4, "tcp:") == 0;
+}
+
+LineSource* CreateLineSource(const std::string& name) {
+  if (IsSocketSource(name)) {
+    std::string host;
+    int port = 0;
+    if (!ParseAddress(name, &host, &port)) { return nullptr; }
+    return new SocketLineSource(port);
+  }
+  return new FileLineSource(name);
+}
+
+}  // namespace xLearn
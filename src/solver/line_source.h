@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the LineSource class and its sources of the
+lines of the online training.
+*/
+
+#ifndef XLEARN_SOLVER_LINE_SOURCE_H_
+#define XLEARN_SOLVER_LINE_SOURCE_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/distributed/transport.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// LineSource is a stream of text lines that never seeks back, which is
+// read by the online training (see Solver::SetOnline) in pieces of the
+// bytes that have arrived. The reader waits for each piece only for a
+// short time, so it can publish the model while the stream is idle:
+//
+//   LineSource* source = CreateLineSource("tcp:9000");
+//   CHECK(source->Open());
+//   std::string buf;
+//   while (source->Read(&buf, 1 << 20, 100)) {
+//     /* parse and train the whole lines of buf ... */
+//   }
+//
+// A new source of lines is a subclass of LineSource, which is created
+// by CreateLineSource() for its name.
+//------------------------------------------------------------------------------
+class LineSource {
+ public:
+  // Constructor and Destructor
+  LineSource() { }
+  virtual ~LineSource() { }
+
+  // Open the source, and return false if it cannot be opened.
+  virtual bool Open() = 0;
+
+  // Append at most max_bytes bytes of the stream to buf, which waits
+  // for at most timeout_ms milliseconds if no byte has arrived. Return
+  // false at the end of the stream, and then buf ends with a newline
+  // if it is not empty.
+  virtual bool Read(std::string* buf, size_t max_bytes, int timeout_ms) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LineSource);
+};
+
+//------------------------------------------------------------------------------
+// FileLineSource reads the standard input ("-"), a named pipe, or a
+// file, and the stream ends at its end of file, e.g., when the writers
+// of the pipe are closed. On Windows the read blocks until some bytes
+// arrive, so the timeout is not used.
+//------------------------------------------------------------------------------
+class FileLineSource : public LineSource {
+ public:
+  explicit FileLineSource(const std::string& filename)
+    : filename_(filename) { }
+  ~FileLineSource();
+
+  bool Open();
+  bool Read(std::string* buf, size_t max_bytes, int timeout_ms);
+
+ protected:
+  std::string filename_;
+  /* The file descriptor, which is 0 for the standard input */
+  int fd_ = -1;
+};
+
+//------------------------------------------------------------------------------
+// SocketLineSource listens on the TCP port of "tcp:<port>", and reads
+// the lines of the producers that connect to it, one after another.
+// When a producer closes its connection, the next one is accepted, so
+// the stream never ends. The last line of a connection is ended by a
+// newline, so the lines of two producers are not mixed.
+//------------------------------------------------------------------------------
+class SocketLineSource : public LineSource {
+ public:
+  explicit SocketLineSource(int port) : port_(port) { }
+
+  bool Open();
+  bool Read(std::string* buf, size_t max_bytes, int timeout_ms);
+
+  // Return the port, which is picked by Open() if it is 0.
+  inline int Port() const { return port_; }
+
+ protected:
+  int port_;
+  Socket listener_;
+  Socket conn_;
+};
+
+// Create the source of the name, which is "tcp:<port>" for a
+// SocketLineSource, and a file name for a FileLineSource.
+// Return nullptr if the port is not valid.
+LineSource* CreateLineSource(const std::string& name);
+
+// Return true if the name is a source of CreateLineSource()
+// that is not a file, i.e., "tcp:<port>".
+bool IsSocketSource(const std::string& name);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_LINE_SOURCE_H_
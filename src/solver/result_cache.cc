@@ -0,0 +1,142 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the ResultCache class.
+*/
+
+#include "src/solver/result_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace xLearn {
+
+// The finalizer of MurmurHash3, which mixes all the bits
+static inline uint64 mix(uint64 h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static inline uint64 float_bits(real_t value) {
+  uint32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Keep at most capacity entries
+void ResultCache::Initialize(size_t capacity) {
+  CHECK_GT(capacity, 0);
+  for (int i = 0; i < kNumShard; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    shards_[i].entries.clear();
+    shards_[i].slot.clear();
+    shards_[i].hand = 0;
+    shards_[i].capacity = std::max((size_t)1,
+        (capacity + kNumShard - 1) / kNumShard);
+  }
+  hits_ = 0;
+  misses_ = 0;
+}
+
+// The nodes are sorted, so the key is the same for any order
+// of the same nodes, and the hash mixes them one by one
+void ResultCache::RowKey(const SparseRow* row, real_t norm, Key* key) {
+  CHECK_NOTNULL(key);
+  key->nodes.clear();
+  if (row != nullptr) {
+    key->nodes.reserve(row->size());
+    for (SparseRow::const_iterator it = row->begin();
+         it != row->end(); ++it) {
+      uint64 id = ((uint64)it->field_id << 32) | it->feat_id;
+      key->nodes.push_back(std::make_pair(id, float_bits(it->feat_val)));
+    }
+    std::sort(key->nodes.begin(), key->nodes.end());
+  }
+  key->norm = (uint32)float_bits(norm);
+  uint64 size = key->nodes.size();
+  uint64 h = mix((size << 32) | key->norm);
+  for (size_t i = 0; i < key->nodes.size(); ++i) {
+    h = mix(h ^ mix(key->nodes[i].first) ^ key->nodes[i].second);
+  }
+  key->hash = h;
+}
+
+// Get the score of the key
+bool ResultCache::Get(const Key& key, real_t* score) {
+  CHECK_NOTNULL(score);
+  Shard& s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto it = s.slot.find(key.hash);
+  // The entry may be of another row of the same hash
+  if (it == s.slot.end() || s.entries[it->second].key != key) {
+    misses_++;
+    return false;
+  }
+  Entry& entry = s.entries[it->second];
+  entry.used = true;
+  *score = entry.score;
+  hits_++;
+  return true;
+}
+
+// The hand of CLOCK skips the entries used since it passed
+// them last time, and the first unused one is replaced
+void ResultCache::Put(const Key& key, real_t score) {
+  Shard& s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (s.capacity == 0) { return; }
+  auto it = s.slot.find(key.hash);
+  if (it != s.slot.end()) {
+    Entry& entry = s.entries[it->second];
+    if (entry.key != key) { entry.key = key; }
+    entry.score = score;
+    return;
+  }
+  if (s.entries.size() < s.capacity) {
+    s.slot[key.hash] = s.entries.size();
+    s.entries.push_back(Entry{key, score, false});
+    return;
+  }
+  while (s.entries[s.hand].used) {
+    s.entries[s.hand].used = false;
+    s.hand = (s.hand + 1) % s.entries.size();
+  }
+  Entry& entry = s.entries[s.hand];
+  s.slot.erase(entry.key.hash);
+  s.slot[key.hash] = s.hand;
+  entry.key = key;
+  entry.score = score;
+  entry.used = false;
+  s.hand = (s.hand + 1) % s.entries.size();
+}
+
+// Remove all the entries
+void ResultCache::Clear() {
+  for (int i = 0; i < kNumShard; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    shards_[i].entries.clear();
+    shards_[i].slot.clear();
+    shards_[i].hand = 0;
+  }
+}
+
+}  // namespace xLearn
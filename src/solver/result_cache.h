@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the ResultCache class.
+*/
+
+#ifndef XLEARN_SOLVER_RESULT_CACHE_H_
+#define XLEARN_SOLVER_RESULT_CACHE_H_
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// ResultCache keeps the raw scores of the recent rows of one version
+// of the served model, so a repeated request (e.g., a retry or a
+// duplicate impression) skips the score function. The key of a row is
+// its sorted (field, id, value) nodes and its norm, together with a
+// 64-bit hash of them. The entries are found by the hash, and a hit is
+// checked against the full key, so two rows of the same hash never
+// share a score.
+//
+//   ResultCache cache;
+//   cache.Initialize(100000);
+//   ResultCache::Key key;
+//   ResultCache::RowKey(row, norm, &key);
+//   real_t score;
+//   if (!cache.Get(key, &score)) {
+//     score = ... compute the score of the row ...
+//     cache.Put(key, score);
+//   }
+//
+// Each version of the model has its own cache, so the entries go away
+// with the old version when a new one is swapped in. The entries are
+// kept in kNumShard shards of their own locks, and each shard evicts
+// its entries by the CLOCK policy (an approximate LRU) when it is full.
+// Get() and Put() can be called by many threads at the same time.
+//------------------------------------------------------------------------------
+class ResultCache {
+ public:
+  // Constructor and Destructor
+  ResultCache() : hits_(0), misses_(0) { }
+  ~ResultCache() { }
+
+  /* The full key of a row */
+  struct Key {
+    uint64 hash = 0;
+    /* The (field and id, bits of value) of the nodes, in order */
+    std::vector<std::pair<uint64, uint64>> nodes;
+    /* The bits of the norm */
+    uint32 norm = 0;
+    bool operator==(const Key& other) const {
+      return hash == other.hash && norm == other.norm &&
+             nodes == other.nodes;
+    }
+    bool operator!=(const Key& other) const { return !(*this == other); }
+  };
+
+  // Keep at most capacity entries
+  void Initialize(size_t capacity);
+
+  // Set the key of the row and its norm
+  static void RowKey(const SparseRow* row, real_t norm, Key* key);
+
+  // Get the score of the key, and return false if it is not cached.
+  bool Get(const Key& key, real_t* score);
+
+  // Cache the score of the key. It replaces the entry of another
+  // key of the same hash.
+  void Put(const Key& key, real_t score);
+
+  // Remove all the entries, e.g., after the model is trained.
+  void Clear();
+
+  // The numbers of the hits and the misses of Get().
+  uint64 NumHits() const { return hits_.load(); }
+  uint64 NumMisses() const { return misses_.load(); }
+
+ protected:
+  static const int kNumShard = 16;
+  /* One cached score */
+  struct Entry {
+    Key key;
+    real_t score;
+    /* Set by Get(), and cleared by the hand of CLOCK */
+    bool used;
+  };
+  /* The entries of one shard and the slot of each hash */
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Entry> entries;
+    std::unordered_map<uint64, size_t> slot;
+    size_t capacity = 0;
+    size_t hand = 0;
+  };
+  Shard shards_[kNumShard];
+  std::atomic<uint64> hits_;
+  std::atomic<uint64> misses_;
+
+  // The shard of the key
+  Shard& shard(const Key& key) { return shards_[key.hash % kNumShard]; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ResultCache);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_RESULT_CACHE_H_
@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the ResultCache class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "src/solver/result_cache.h"
+
+namespace xLearn {
+
+// The rows of the same nodes in another order have the same key
+TEST(ResultCacheTest, RowKey) {
+  SparseRow row, shuffled, other;
+  row.push_back(Node(1, 2, 0.5));
+  row.push_back(Node(0, 7, 1.0));
+  row.push_back(Node(3, 4, 2.0));
+  shuffled.push_back(Node(3, 4, 2.0));
+  shuffled.push_back(Node(1, 2, 0.5));
+  shuffled.push_back(Node(0, 7, 1.0));
+  other.push_back(Node(1, 2, 0.5));
+  other.push_back(Node(0, 7, 1.0));
+  other.push_back(Node(3, 4, 2.5));
+  ResultCache::Key a, b, c, d;
+  ResultCache::RowKey(&row, 1.0, &a);
+  ResultCache::RowKey(&shuffled, 1.0, &b);
+  ResultCache::RowKey(&other, 1.0, &c);
+  ResultCache::RowKey(&row, 0.5, &d);
+  EXPECT_TRUE(a == b);
+  EXPECT_EQ(a.hash, b.hash);
+  EXPECT_TRUE(a != c);
+  EXPECT_TRUE(a != d);
+}
+
+// Two rows of the same hash never share a score
+TEST(ResultCacheTest, HashCollision) {
+  ResultCache cache;
+  cache.Initialize(64);
+  SparseRow row, other;
+  row.push_back(Node(0, 1, 1.0));
+  other.push_back(Node(0, 2, 1.0));
+  ResultCache::Key a, b;
+  ResultCache::RowKey(&row, 1.0, &a);
+  ResultCache::RowKey(&other, 1.0, &b);
+  b.hash = a.hash;
+  real_t score = 0;
+  cache.Put(a, 0.25);
+  EXPECT_TRUE(cache.Get(a, &score));
+  EXPECT_FLOAT_EQ(score, 0.25);
+  EXPECT_FALSE(cache.Get(b, &score));
+  // The later row replaces the entry of the hash
+  cache.Put(b, 0.75);
+  EXPECT_TRUE(cache.Get(b, &score));
+  EXPECT_FLOAT_EQ(score, 0.75);
+  EXPECT_FALSE(cache.Get(a, &score));
+  EXPECT_EQ(cache.NumHits(), 2);
+  EXPECT_EQ(cache.NumMisses(), 2);
+}
+
+// The unused entries are evicted first when the cache is full
+TEST(ResultCacheTest, Eviction) {
+  ResultCache cache;
+  cache.Initialize(1);
+  std::vector<ResultCache::Key> keys(100);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    SparseRow row;
+    row.push_back(Node(0, i, 1.0));
+    ResultCache::RowKey(&row, 1.0, &keys[i]);
+    cache.Put(keys[i], i);
+  }
+  // Each shard keeps one entry, which is the last of its keys
+  real_t score = 0;
+  size_t num_cached = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (cache.Get(keys[i], &score)) {
+      EXPECT_FLOAT_EQ(score, i);
+      num_cached++;
+    }
+  }
+  EXPECT_GT(num_cached, 0);
+  EXPECT_LE(num_cached, 16);
+  cache.Clear();
+  EXPECT_FALSE(cache.Get(keys.back(), &score));
+}
+
+}  // namespace xLearn
@@ -26,11 +26,23 @@ This file is the implementation of the Solver class.
 #include <stdexcept>
 #include <cstdio>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <cmath>
+#include <csignal>
 
 #include "src/base/stringprintf.h"
 #include "src/base/split_string.h"
 #include "src/base/timer.h"
+#include "src/base/trace.h"
+#include "src/base/math.h"
+#include "src/base/memory_info.h"
+#include "src/base/phase_timer.h"
 #include "src/base/system.h"
+#include "src/reader/columnar.h"
+#include "src/score/ffm_score.h"
 
 namespace xLearn {
 
@@ -79,12 +91,30 @@ Reader* Solver::create_reader() {
 }
 
 // Create Score by a given string
+// For training, the optimizer is chosen here at compile time,
+// e.g., "ffm_adagrad", and hence we don't check it for each row.
 Score* Solver::create_score() {
   Score* score;
-  score = CREATE_SCORE(hyper_param_.score_func.c_str());
+  std::string name = hyper_param_.score_func;
+  if (hyper_param_.is_train) {
+    name += "_" + hyper_param_.opt_type;
+    // The optimizer of the compact state (see FTRLBF16Optimizer)
+    if (hyper_param_.opt_state.compare("bf16") == 0) {
+      name += "_bf16";
+    }
+  }
+  score = CREATE_SCORE(name.c_str());
   if (score == nullptr) {
-    LOG(FATAL) << "Cannot create score: "
-               << hyper_param_.score_func;
+    LOG(FATAL) << "Cannot create score: " << name;
+  }
+  // Use the kernels unrolled for the K of the model, if any.
+  index_t aligned_k = (hyper_param_.num_K + kAlign - 1) / kAlign * kAlign;
+  score->SetKernels(&GetBestScoreKernels(aligned_k));
+  // The bags of the training and the prediction (see -bag_field)
+  if (!hyper_param_.bag_field.empty()) {
+    std::vector<index_t> fields;
+    CHECK(ParseBagFields(hyper_param_.bag_field, &fields));
+    score->SetBagFields(fields, hyper_param_.bag_pool == "mean");
   }
   return score;
 }
@@ -100,16 +130,74 @@ Loss* Solver::create_loss() {
   return loss;
 }
 
-// Create Metric by a given string
+// Create Metric by a given string, which is a MetricList
+// if several metrics are given (e.g., -x auc,acc,f1)
 Metric* Solver::create_metric() {
+  std::vector<std::string> names;
+  SplitStringUsing(hyper_param_.metric, ",", &names);
+  if (names.size() > 1) {
+    MetricList* list = new MetricList;
+    for (size_t i = 0; i < names.size(); ++i) {
+      list->Add(create_metric(names[i]));
+    }
+    return list;
+  }
+  return create_metric(hyper_param_.metric);
+}
+
+Metric* Solver::create_metric(const std::string& name) {
   Metric* metric;
-  metric = CREATE_METRIC(hyper_param_.metric.c_str());
+  metric = CREATE_METRIC(name.c_str());
   // Note that here we do not cheack metric == nullptr
   // this is because we can set metric to "none", which 
   // means that we don't print any metric info.
+  // Set the mode of AUC (-auc_bucket and --exact-auc)
+  AUCMetric* auc = dynamic_cast<AUCMetric*>(metric);
+  if (auc != nullptr) {
+    if (hyper_param_.exact_auc) {
+      auc->SetExact(true);
+    } else {
+      auc->SetBucketSize(hyper_param_.auc_bucket);
+    }
+  }
   return metric;
 }
 
+// The page cache of the data files (-io), which is checked by Checker
+static FileIO get_file_io(const std::string& name) {
+  FileIO io;
+  CHECK(ParseFileIO(name, &io));
+  return io;
+}
+
+// Create Model with the memory policy (--huge-page and -numa)
+Model* Solver::create_model(const std::string& filename,
+                            ThreadPool* pool) {
+  NumaPolicy numa;
+  CHECK(ParseNumaPolicy(hyper_param_.numa_policy, &numa));
+  Model* model = new Model();
+  model->SetMemoryPolicy(hyper_param_.huge_page, numa,
+                         pool == nullptr ? pool_ : pool);
+  model->SetChecksum(hyper_param_.model_checksum);
+  // The model of the training can be kept in -param_file
+  if (hyper_param_.is_train && !hyper_param_.param_file.empty()) {
+    model->SetParamFile(hyper_param_.param_file);
+  }
+  // The files of both layouts are the same
+  if (hyper_param_.is_train) {
+    model->SetSplitLayout(hyper_param_.split_ffm);
+    model->SetFieldMajor(hyper_param_.field_major);
+  }
+  if (!filename.empty() && !model->Deserialize(filename)) {
+    Color::print_error(
+      StringPrintf("Cannot Load model from the file: %s",
+           filename.c_str())
+    );
+    exit(0);
+  }
+  return model;
+}
+
 /******************************************************************************
  * Functions for xlearn initialize                                            *
  ******************************************************************************/
@@ -122,8 +210,15 @@ void Solver::Initialize(int argc, char* argv[]) {
   checker(argc, argv);
   // Initialize log file
   init_log();
-  // Init train or predict
-  if (hyper_param_.is_train) {
+  if (!hyper_param_.trace_file.empty()) {
+    StartTrace(hyper_param_.trace_file);
+    SetTraceThreadName("main");
+  }
+  // Init train or predict, and the online training
+  // creates the model by its first piece of the lines
+  if (hyper_param_.online) {
+    return;
+  } else if (hyper_param_.is_train) {
     init_train();
   } else {
     init_predict();
@@ -141,6 +236,10 @@ void Solver::Initialize(HyperParam& hyper_param) {
   this->hyper_param_ = hyper_param;
   // Initialize log file
   init_log();
+  if (!hyper_param_.trace_file.empty()) {
+    StartTrace(hyper_param_.trace_file);
+    SetTraceThreadName("main");
+  }
   // Init train or predict
   if (hyper_param_.is_train) {
     init_train();
@@ -184,16 +283,97 @@ void Solver::init_log() {
               StringPrintf("%s.ERROR", prefix.c_str()));
 }
 
+// The default number of threads is limited by the cpu quota of the
+// container and the cpus of the process, which are no more than the
+// cpus of the -affinity list, so the threads are never more than the
+// cpus they can run on.
+size_t Solver::thread_number() {
+  if (hyper_param_.thread_number != 0) {
+    return hyper_param_.thread_number;
+  }
+  size_t num = DefaultThreadNumber();
+  AffinityPolicy policy;
+  std::vector<int> list;
+  CHECK(ParseAffinity(hyper_param_.affinity, &policy, &list));
+  if (policy == kAffinityList) {
+    num = std::min(num, list.size());
+  }
+  return num;
+}
+
+// Return the cpus of the threads given by -affinity,
+// which is empty if the threads are not pinned.
+std::vector<int> Solver::thread_cpus(size_t threadNumber) {
+  AffinityPolicy policy;
+  std::vector<int> list;
+  CHECK(ParseAffinity(hyper_param_.affinity, &policy, &list));
+  std::vector<int> cpus;
+  GetThreadCpus(policy, list, threadNumber, &cpus);
+  if (!cpus.empty()) {
+    std::string str;
+    for (size_t i = 0; i < cpus.size() && i < 16; ++i) {
+      str += (i == 0 ? "" : ",") + std::to_string(cpus[i]);
+    }
+    if (cpus.size() > 16) { str += ",..."; }
+    Color::print_info(
+      StringPrintf("Pin the threads to cpus (%s): %s",
+                   AffinityPolicyName(policy), str.c_str())
+    );
+    // The threads on the other cpus are left to the OS
+    std::vector<int> allowed;
+    GetAllowedCpus(&allowed);
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (std::find(allowed.begin(), allowed.end(), list[i]) ==
+          allowed.end()) {
+        Color::print_warning(
+          StringPrintf("The cpu %d of -affinity cannot be used by "
+                       "xLearn, and its threads are not pinned.", list[i])
+        );
+      }
+    }
+  }
+  return cpus;
+}
+
+// The used fields of the training data, which are not many,
+// so the flags are indexed by the field ids.
+static void mark_fields(const DMatrix* matrix, std::vector<uint8>* used) {
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    if (matrix->row[i] == nullptr) { continue; }
+    for (const Node& node : *matrix->row[i]) {
+      if (node.field_id >= used->size()) {
+        used->resize(node.field_id + 1, 0);
+      }
+      (*used)[node.field_id] = 1;
+    }
+  }
+}
+
 // Initialize training task
 void Solver::init_train() {
   /*********************************************************
    *  Initialize thread pool                               *
    *********************************************************/
-  size_t threadNumber = std::thread::hardware_concurrency();
-  if (hyper_param_.thread_number != 0) {
-    threadNumber = hyper_param_.thread_number;
+  size_t threadNumber = thread_number();
+  cpus_ = thread_cpus(threadNumber);
+  if (hyper_param_.perf_counter) {
+    perf_.reset(new PerfCounters);
+    std::string error;
+    if (perf_->Open(&error) == 0) {
+      Color::print_warning(
+        StringPrintf("Cannot count the hardware events (%s).",
+                     error.c_str())
+      );
+      perf_.reset();
+    }
   }
-  pool_ = new ThreadPool(threadNumber);
+  // The threads are pinned to the NUMA nodes when each node trains
+  // its own copy of the model, or its own ranges of -owner.
+  NumaPolicy numa;
+  CHECK(ParseNumaPolicy(hyper_param_.numa_policy, &numa));
+  pool_ = new ThreadPool(threadNumber, numa == kNumaReplicate ||
+                         (numa == kNumaLocal && hyper_param_.owner_rows > 0),
+                         cpus_);
   Color::print_info(
     StringPrintf("xLearn uses %i threads for training task.",
              threadNumber)
@@ -205,51 +385,116 @@ void Solver::init_train() {
   timer.tic();
   Color::print_action("Read Problem ...");
   LOG(INFO) << "Start to init Reader";
-  // Split file
-  if (hyper_param_.from_file) {
-    if (hyper_param_.cross_validation) {
-      CHECK_GT(hyper_param_.num_folds, 0);
-      splitor_.split(hyper_param_.train_set_file,
-                    hyper_param_.num_folds);
-      LOG(INFO) << "Split file into "
-                << hyper_param_.num_folds
-                << " parts.";
-    }
-  }
+  memory_ = MemoryUsage();
   // Get the Reader list
   int num_reader = 0;
-  if (hyper_param_.from_file) {
+  if (hyper_param_.from_file && hyper_param_.cross_validation) {
+    // The training file is parsed once, and each fold is
+    // a range of its rows, so no file is written for the folds
+    CHECK_GT(hyper_param_.num_folds, 0);
+    estimate_data({ hyper_param_.train_set_file });
+    cv_data_ = new InmemReader;
+    cv_data_->SetBlockSize(hyper_param_.block_size);
+    cv_data_->SetHashBits(hyper_param_.hash_bits);
+    cv_data_->SetSkipZeros(hyper_param_.skip_zeros);
+    cv_data_->SetMergeDuplicates(hyper_param_.merge_dup);
+    cv_data_->SetCrosses(hyper_param_.cross);
+    cv_data_->SetFileIO(get_file_io(hyper_param_.file_io));
+    cv_data_->SetThreadPool(pool_);
+    if (hyper_param_.bin_out == false) {
+      cv_data_->SetNoBin();
+    }
+    if (!hyper_param_.data_shm.empty()) {
+      cv_data_->SetSharedData(hyper_param_.data_shm);
+    }
+    cv_data_->Initialize(hyper_param_.train_set_file);
+    num_reader = hyper_param_.num_folds;
+    LOG(INFO) << "Number of Reader: " << num_reader;
+    reader_ = create_folds();
+    LOG(INFO) << "Split " << cv_data_->GetMatrix()->row_length
+              << " rows into " << num_reader << " folds.";
+  } else if (hyper_param_.from_file) {
     std::vector<std::string> file_list;
-    if (hyper_param_.cross_validation) {
-      num_reader += hyper_param_.num_folds;
-      for (int i = 0; i < hyper_param_.num_folds; ++i) {
-        std::string filename = StringPrintf("%s_%d",
-            hyper_param_.train_set_file.c_str(), i);
-        file_list.push_back(filename);
-      }
-    } else {  // do not use cross-validation
-      num_reader += 1;  // training file
-      CHECK_NE(hyper_param_.train_set_file.empty(), true);
-      file_list.push_back(hyper_param_.train_set_file);
-      if (!hyper_param_.validate_set_file.empty()) {
-        num_reader += 1;  // validation file
-        file_list.push_back(hyper_param_.validate_set_file);
-      }
+    num_reader += 1;  // training file
+    CHECK_NE(hyper_param_.train_set_file.empty(), true);
+    file_list.push_back(hyper_param_.train_set_file);
+    if (!hyper_param_.validate_set_file.empty()) {
+      num_reader += 1;  // validation file
+      file_list.push_back(hyper_param_.validate_set_file);
     }
+    // The reader and its block size can be chosen by -mem
+    estimate_data(file_list);
     LOG(INFO) << "Number of Reader: " << num_reader;
     reader_.resize(num_reader, nullptr);
     // Create Reader
+    // The files of a training list are read as one dataset
+    bool train_list = !hyper_param_.train_set_files.empty();
     for (int i = 0; i < num_reader; ++i) {
-      reader_[i] = create_reader();
+      if (i == 0 && train_list) {
+        ShardReader* shards = new ShardReader;
+        shards->SetShardType(hyper_param_.on_disk ? "disk" : "memory");
+        shards->SetNumJobs(hyper_param_.read_jobs);
+        reader_[i] = shards;
+      } else {
+        reader_[i] = create_reader();
+      }
       reader_[i]->SetBlockSize(hyper_param_.block_size);
       reader_[i]->SetSeed(hyper_param_.seed);
+      reader_[i]->SetHashBits(hyper_param_.hash_bits);
+      reader_[i]->SetSkipZeros(hyper_param_.skip_zeros);
+      reader_[i]->SetMergeDuplicates(hyper_param_.merge_dup);
+      reader_[i]->SetCrosses(hyper_param_.cross);
+      reader_[i]->SetNumLabels(hyper_param_.num_label);
+      reader_[i]->SetFileIO(get_file_io(hyper_param_.file_io));
+      reader_[i]->SetThreadPool(pool_);
+      // Only the training data is sampled
+      if (i == 0) {
+        reader_[i]->SetNegativeRate(hyper_param_.neg_rate);
+      }
+      // Each node of distributed training reads its own shard
+      if (i == 0 && hyper_param_.ps_shard &&
+          !hyper_param_.ps_hosts.empty()) {
+        reader_[i]->SetShard(hyper_param_.ps_rank,
+                             hyper_param_.ps_hosts.size());
+      }
+      // And so does each process of -shm
+      if (i == 0 && !hyper_param_.shm_name.empty()) {
+        reader_[i]->SetShard(hyper_param_.shm_rank,
+                             hyper_param_.shm_procs);
+      }
       if (hyper_param_.bin_out == false) {
         reader_[i]->SetNoBin();
       }
-      reader_[i]->Initialize(file_list[i]);
-      if (!hyper_param_.on_disk) {
-        reader_[i]->SetShuffle(true);
+      if (!hyper_param_.data_shm.empty()) {
+        reader_[i]->SetSharedData(hyper_param_.data_shm);
+      }
+      reader_[i]->SetPackRows(hyper_param_.pack_rows);
+      // The parsed blocks kept by the on-disk reader, where the
+      // training file has all of -block_cache without the estimate
+      if (i < (int)memory_.block_cache.size()) {
+        reader_[i]->SetBlockCache(memory_.block_cache[i]);
+      } else if (i == 0) {
+        reader_[i]->SetBlockCache((uint64)hyper_param_.block_cache * MB);
+      }
+      // The block size of the first epoch, within -block and -mem
+      if (hyper_param_.auto_block) {
+        reader_[i]->SetAutoBlock(i < (int)memory_.block_memory.size() ?
+                                 memory_.block_memory[i] : 0);
+      }
+      if (i == 0 && train_list) {
+        static_cast<ShardReader*>(reader_[i])->Initialize(
+            hyper_param_.train_set_files);
+        Color::print_info(
+          StringPrintf("Read %lu training files as one dataset.",
+                       static_cast<ShardReader*>(reader_[i])->NumShards())
+        );
+      } else {
+        reader_[i]->Initialize(file_list[i]);
+      }
+      if (i == 0) {
+        reader_[i]->SetShuffleWindow(hyper_param_.shuffle_window);
       }
+      reader_[i]->SetShuffle(true);
       if (reader_[i] == nullptr) {
         Color::print_error(
           StringPrintf("Cannot open the file %s",
@@ -261,24 +506,53 @@ void Solver::init_train() {
     } 
   } else {
     num_reader += 1;  // training dataset
+    // Each dataset is a DMatrix or the DataIter of its batches
     std::vector<xLearn::DMatrix*> data_list;
-    CHECK_NOTNULL(hyper_param_.train_dataset);
+    std::vector<DataIter> iter_list;
+    CHECK(hyper_param_.train_dataset != nullptr ||
+          !hyper_param_.train_iter.Empty());
     data_list.push_back(hyper_param_.train_dataset);
-    if (hyper_param_.valid_dataset != nullptr) {
+    iter_list.push_back(hyper_param_.train_iter);
+    if (hyper_param_.valid_dataset != nullptr ||
+        !hyper_param_.valid_iter.Empty()) {
       num_reader += 1;  // validation dataset
       data_list.push_back(hyper_param_.valid_dataset);
+      iter_list.push_back(hyper_param_.valid_iter);
+    }
+    // The matrices are given by the caller
+    for (size_t i = 0; i < data_list.size(); ++i) {
+      if (iter_list[i].Empty()) {
+        memory_.data += data_list[i]->MemoryBytes();
+      }
     }
     // Create Reader
     LOG(INFO) << "Number of Reader: " << num_reader;
     reader_.resize(num_reader, nullptr);
     for (int i = 0; i < num_reader; ++i) {
+      // The batches are streamed from the caller
+      if (!iter_list[i].Empty()) {
+        FromIterReader* reader = new FromIterReader;
+        reader->SetSeed(hyper_param_.seed);
+        if (i == 0) {
+          reader->SetNegativeRate(hyper_param_.neg_rate);
+        }
+        reader->Initialize(iter_list[i]);
+        reader_[i] = reader;
+        continue;
+      }
       reader_[i] = create_reader();
       reader_[i]->SetBlockSize(hyper_param_.block_size);
       reader_[i]->SetSeed(hyper_param_.seed);
+      if (i == 0) {
+        reader_[i]->SetNegativeRate(hyper_param_.neg_rate);
+      }
       if (hyper_param_.bin_out == false) {
         reader_[i]->SetNoBin();
       }
       reader_[i]->Initialize(data_list[i]);
+      if (i == 0) {
+        reader_[i]->SetShuffleWindow(hyper_param_.shuffle_window);
+      }
       if (!hyper_param_.on_disk) {
         reader_[i]->SetShuffle(true);
       }
@@ -293,38 +567,132 @@ void Solver::init_train() {
    *********************************************************/
   DMatrix* matrix = nullptr;
   index_t max_feat = 0, max_field = 0;
+  bool count_feature = !hyper_param_.ps_hosts.empty() &&
+                       hyper_param_.ps_partition == "balanced";
+  bool feature_stats = !hyper_param_.feature_stats_file.empty() ||
+                       hyper_param_.remap_features ||
+                       hyper_param_.min_count > 0 ||
+                       hyper_param_.share_count > 0;
+  bool field_index = hyper_param_.sparse_ffm;
+  bool field_map = hyper_param_.remap_fields;
+  std::vector<uint8> used_fields;
+  feature_stats_.Clear();
+  field_index_.Clear();
+  if (field_index && !hyper_param_.field_pairs.empty()) {
+    std::vector<FieldCross> pairs;
+    CHECK(ParseCrosses(hyper_param_.field_pairs, &pairs));
+    for (const FieldCross& pair : pairs) {
+      field_index_.AllowPair(pair.field_1, pair.field_2);
+    }
+  }
   for (int i = 0; i < num_reader; ++i) {
-    while(reader_[i]->Samples(matrix)) {
-      int tmp = matrix->MaxFeat();
-      if (tmp > max_feat) { max_feat = tmp; }
-      if (hyper_param_.score_func.compare("ffm") == 0) {
-        tmp = matrix->MaxField();
-        if (tmp > max_field) { max_field = tmp; }
+    // The readers of cross-validation are all training data,
+    // and otherwise the second reader is the validation data
+    bool is_train = i == 0 || hyper_param_.cross_validation;
+    // The stats of the parser need no scan of the data
+    DataStats stats;
+    if (!count_feature &&
+        !((feature_stats || field_index || field_map) && is_train) &&
+        reader_[i]->GetStats(&stats)) {
+      reader_[i]->EndPass();
+    } else {
+      while(reader_[i]->Samples(matrix)) {
+        if (count_feature) { count_features(matrix); }
+        if (feature_stats && is_train) { feature_stats_.Add(matrix); }
+        if (field_index && is_train) { field_index_.Add(matrix); }
+        if (field_map && is_train) { mark_fields(matrix, &used_fields); }
+        stats.Merge(matrix->Stats());
       }
     }
+    if (stats.max_feat > max_feat) { max_feat = stats.max_feat; }
+    if ((hyper_param_.score_func.compare("ffm") == 0 ||
+         hyper_param_.score_func.compare("fwfm") == 0) &&
+        stats.max_field > max_field) {
+      max_field = stats.max_field;
+    }
     // Return to the beginning of target file.
     reader_[i]->Reset();
   }
   hyper_param_.num_feature = max_feat + 1;
+  // The model is sized by the buckets of the hashing trick
+  if (hyper_param_.hash_bits > 0) {
+    hyper_param_.num_feature = 1U << hyper_param_.hash_bits;
+    // Only the txt parsers hash the feature ids
+    if (max_feat >= hyper_param_.num_feature) {
+      Color::print_warning(
+        StringPrintf("The feature ids larger than 2^%d are ignored, "
+                     "since the DMatrix input is not hashed.",
+                     hyper_param_.hash_bits)
+      );
+    }
+    Color::print_info(
+      StringPrintf("Hash feature ids into 2^%d buckets.",
+                   hyper_param_.hash_bits)
+    );
+  }
+  // The nodes of distributed training read their own data
+  if (!hyper_param_.ps_hosts.empty()) {
+    init_dist(&max_field);
+  }
+  if (!hyper_param_.shm_name.empty()) {
+    init_shared(&max_field);
+  }
   // Check overflow:
   // INT_MAX +  = 0
   if (hyper_param_.num_feature == 0) {
     Color::print_error("Feature index is too large (overflow).");
     LOG(FATAL) << "Feature index is too large (overflow).";
   }
+  // The model is sized by the frequent features
+  if (hyper_param_.min_count > 0) {
+    compact_features();
+  }
   LOG(INFO) << "Number of feature: " << hyper_param_.num_feature;
   Color::print_info(
     StringPrintf("Number of Feature: %d", 
                  hyper_param_.num_feature)
   );
-  if (hyper_param_.score_func.compare("ffm") == 0) {
+  if (hyper_param_.score_func.compare("ffm") == 0 ||
+      hyper_param_.score_func.compare("fwfm") == 0) {
     hyper_param_.num_field = max_field + 1;
+    if (field_map) {
+      used_fields.resize(hyper_param_.num_field, 0);
+      remap_fields(used_fields);
+    }
     LOG(INFO) << "Number of field: " << hyper_param_.num_field;
     Color::print_info(
       StringPrintf("Number of Field: %d", 
         hyper_param_.num_field)
     );
   }
+  if (field_index) {
+    if (hyper_param_.share_count > 0) {
+      share_features();
+    }
+    if (!hyper_param_.field_k.empty()) {
+      std::vector<FieldK> items;
+      CHECK(ParseFieldK(hyper_param_.field_k, &items));
+      field_index_.SetFieldK(FieldKTable(items, hyper_param_.num_field,
+                                         hyper_param_.num_K));
+    }
+    field_index_.Build(hyper_param_.num_feature, hyper_param_.num_field);
+    // The blocks of the widths are kAlign values
+    uint64 dense = (uint64)hyper_param_.num_feature *
+                   hyper_param_.num_field;
+    uint64 blocks = field_index_.NumBlocks();
+    if (field_index_.HasWidths()) {
+      dense *= (hyper_param_.num_K + kAlign - 1) / kAlign;
+    }
+    Color::print_info(
+      StringPrintf("Latent blocks of sparse ffm: %llu of %llu (%.1f%%)",
+                   (unsigned long long)blocks,
+                   (unsigned long long)dense,
+                   100.0 * blocks / dense)
+    );
+  }
+  if (!hyper_param_.feature_stats_file.empty()) {
+    show_feature_stats();
+  }
   Color::print_info(
     StringPrintf("Time cost for reading problem: %.2f (sec)",
          timer.toc())
@@ -332,31 +700,45 @@ void Solver::init_train() {
   /*********************************************************
    *  Initialize Model                                     *
    *********************************************************/
+  estimate_model(hyper_param_.num_feature, hyper_param_.num_field);
+  show_memory(false);
+  if (hyper_param_.autotune) {
+    autotune();
+  }
   timer.reset();
   timer.tic();
   Color::print_action("Initialize model ...");
-  // Initialize parameters from reader
-  if (hyper_param_.pre_model_file.empty()) {
-    model_ = new Model();
-    if (hyper_param_.opt_type.compare("sgd") == 0) {
-      hyper_param_.auxiliary_size = 1;
-    } else if (hyper_param_.opt_type.compare("adagrad") == 0) {
-      hyper_param_.auxiliary_size = 2;
-    } else if (hyper_param_.opt_type.compare("ftrl") == 0) {
-      hyper_param_.auxiliary_size = 3;
-    }
-    model_->Initialize(hyper_param_.score_func,
-                     hyper_param_.loss_func,
-                     hyper_param_.num_feature,
-                     hyper_param_.num_field,
-                     hyper_param_.num_K,
-                     hyper_param_.auxiliary_size,
-                     hyper_param_.model_scale);
-  } else { // Initialize parameter from pre-trained model
-    model_ = new Model(hyper_param_.pre_model_file);
+  model_ = init_model(pool_);
+  if (server_ != nullptr) {
+    init_shard();
+  }
+  if (shared_ != nullptr) {
+    share_model();
+  }
+  // The model of -pre, e.g., a checkpoint of -min_count, keeps its maps
+  if (field_map_.empty() && !model_->GetFieldMap().empty()) {
+    field_map_ = model_->GetFieldMap();
+    for (size_t i = 0; i < reader_.size(); ++i) {
+      reader_[i]->SetFieldMap(&field_map_);
+    }
+  }
+  if (feature_map_.empty() && !model_->GetFeatureMap().empty()) {
+    feature_map_ = model_->GetFeatureMap();
+    for (size_t i = 0; i < reader_.size(); ++i) {
+      reader_[i]->SetFeatureMap(&feature_map_);
+    }
+  } else if (hyper_param_.remap_features) {
+    remap_features();
   }
-  index_t num_param = model_->GetNumParameter();
+  lock_model();
+  offset_t num_param = model_->GetNumParameter();
   hyper_param_.num_param = num_param;
+  memory_.model = num_param * sizeof(real_t);
+  // Only the locked head of -param_file is counted
+  if (model_->IsFileBacked()) {
+    memory_.model = std::min(memory_.model,
+                             (uint64)hyper_param_.param_mem * MB);
+  }
   LOG(INFO) << "Number parameters: " << num_param;
   Color::print_info(
     StringPrintf("Model size: %s", 
@@ -369,112 +751,662 @@ void Solver::init_train() {
   /*********************************************************
    *  Initialize score function                            *
    *********************************************************/
-  score_ = create_score();
-  score_->Initialize(hyper_param_.learning_rate,
-                     hyper_param_.regu_lambda,
-                     hyper_param_.alpha,
-                     hyper_param_.beta,
-                     hyper_param_.lambda_1,
-                     hyper_param_.lambda_2,
-                     hyper_param_.opt_type);
+  score_ = init_score();
   LOG(INFO) << "Initialize score function.";
   /*********************************************************
    *  Initialize loss function                             *
    *********************************************************/
-  loss_ = create_loss();
-  loss_->Initialize(score_, pool_, 
-         hyper_param_.norm, 
-         hyper_param_.lock_free);
+  loss_ = init_loss(score_, pool_);
   LOG(INFO) << "Initialize loss function.";
+  if (hyper_param_.num_label > 1) {
+    init_tasks();
+  }
   /*********************************************************
    *  Init metric                                          *
    *********************************************************/
   metric_ = create_metric();
   if (metric_ != nullptr) {
     metric_->Initialize(pool_);
+    if (hyper_param_.train_metric) {
+      train_metric_ = create_metric();
+      train_metric_->Initialize(pool_);
+    }
   }
   LOG(INFO) << "Initialize evaluation metric.";
 }
 
-// Initialize predict task
-void Solver::init_predict() {
-  /*********************************************************
-   *  Initialize thread pool                               *
-   *********************************************************/
-  size_t threadNumber = std::thread::hardware_concurrency();
-  if (hyper_param_.thread_number != 0) {
-    threadNumber = hyper_param_.thread_number;
+// The options of each configuration are tried one after another (see
+// TuneCandidates), where a trial trains its own model on the first
+// rows of the training data, and the best of its passes after the
+// first one is its time. A new value of an option must be faster than
+// the current one by kTuneGain, so the noise of the timer does not
+// change it. The memory of a configuration is the estimate of
+// show_memory() and the buffers of its threads.
+void Solver::autotune() {
+  // Rows of the sample, the least passes and seconds of each
+  // trial, and the gain of a new value of an option
+  static const index_t kTuneRows = 20000;
+  static const int kTunePasses = 2;
+  static const double kTuneSeconds = 0.1;
+  static const double kTuneGain = 0.05;
+  InmemReader* inmem = dynamic_cast<InmemReader*>(reader_[0]);
+  if (inmem == nullptr || inmem->GetMatrix()->row_length == 0) {
+    Color::print_warning("The --autotune option only works with the "
+                         "in-memory training, and xLearn will ignore it.");
+    return;
   }
-  pool_ = new ThreadPool(threadNumber);
-  Color::print_info(
-    StringPrintf("xLearn uses %i threads for prediction task.",
-             threadNumber)
-  );
-  /*********************************************************
-   *  Read model file                                      *
-   *********************************************************/
-  Color::print_action("Load model ...");
-  CHECK_NE(hyper_param_.model_file.empty(), true);
-  Color::print_info(
-    StringPrintf("Load model from %s",
-          hyper_param_.model_file.c_str())
-  );
+  DMatrix* data = inmem->GetMatrix();
+  index_t num_row = std::min(data->row_length, kTuneRows);
+  FromDMReader sample;
+  sample.SetSeed(hyper_param_.seed);
+  sample.Initialize(data, 0, num_row);
+  // Each thread has its copy of the hot features of -merge,
+  // and the gradients of the features of -grad_batch rows
+  uint64 nnz = 0;
+  for (index_t i = 0; i < num_row; ++i) {
+    if (data->row[i] != nullptr) { nnz += data->row[i]->size(); }
+  }
+  uint64 feature_bytes = memory_.model / hyper_param_.num_feature;
+  uint64 thread_bytes = feature_bytes * (
+      (hyper_param_.merge_rows > 0 ? hyper_param_.num_hot_feature + 1 : 0) +
+      (uint64)hyper_param_.grad_batch * nnz / num_row);
+  uint64 fixed_bytes = memory_.model + memory_.best_model + memory_.data;
+  uint64 budget = (uint64)hyper_param_.mem_budget * MB;
+  bool dense_ffm = hyper_param_.score_func.compare("ffm") == 0 &&
+                   !hyper_param_.sparse_ffm &&
+                   hyper_param_.pre_model_file.empty();
+  auto apply = [&](const TuneConfig& config) {
+    hyper_param_.prefetch_distance = config.prefetch;
+    hyper_param_.partition = config.partition;
+    hyper_param_.lock_free = config.lock_free;
+    hyper_param_.split_ffm = config.split_ffm;
+    hyper_param_.field_major = config.field_major;
+  };
+  // Return the rows per second of the configuration
+  auto trial = [&](const TuneConfig& config) {
+    apply(config);
+    std::unique_ptr<ThreadPool> pool(
+      new ThreadPool(config.num_thread, false,
+                     thread_cpus(config.num_thread)));
+    std::unique_ptr<Model> model(init_model(pool.get()));
+    std::unique_ptr<Score> score(init_score());
+    std::unique_ptr<Loss> loss(init_loss(score.get(), pool.get()));
+    double best_seconds = 0;
+    double total_seconds = 0;
+    // The first pass touches the model and warms up the caches
+    for (int p = 0; p <= kTunePasses || total_seconds < kTuneSeconds; ++p) {
+      double begin = WallSeconds();
+      DMatrix* matrix = nullptr;
+      while (sample.Samples(matrix)) {
+        loss->CalcGrad(matrix, *model);
+      }
+      sample.Reset();
+      double seconds = WallSeconds() - begin;
+      if (p == 0) { continue; }
+      total_seconds += seconds;
+      if (best_seconds == 0 || seconds < best_seconds) {
+        best_seconds = seconds;
+      }
+    }
+    return num_row / std::max(best_seconds, 1e-9);
+  };
   Timer timer;
   timer.tic();
-  model_ = new Model(hyper_param_.model_file);
-  hyper_param_.score_func = model_->GetScoreFunction();
-  hyper_param_.loss_func = model_->GetLossFunction();
-  hyper_param_.num_feature = model_->GetNumFeature();
-  if (hyper_param_.score_func.compare("fm") == 0 ||
-       hyper_param_.score_func.compare("ffm") == 0) {
-    hyper_param_.num_K = model_->GetNumK();
+  Color::print_action(
+    StringPrintf("Autotune on %u rows of the training data ...", num_row)
+  );
+  TuneConfig best = { pool_->ThreadNumber(),
+                      hyper_param_.prefetch_distance,
+                      hyper_param_.partition,
+                      hyper_param_.lock_free,
+                      hyper_param_.split_ffm,
+                      hyper_param_.field_major };
+  size_t max_thread = best.num_thread;
+  double best_speed = 0;
+  for (int o = 0; o < kNumTuneOption; ++o) {
+    // -grad_batch and -owner only work with the lock-free training
+    if (o == kTuneLockFree && (hyper_param_.grad_batch > 0 ||
+                               hyper_param_.owner_rows > 0)) { continue; }
+    std::vector<TuneConfig> configs =
+        TuneCandidates((TuneOption)o, best, max_thread, dense_ffm);
+    // The speed of the current value, and of the fastest one
+    std::string current = TuneName(best);
+    double current_speed = 0;
+    double option_speed = 0;
+    TuneConfig option_best = best;
+    for (const TuneConfig& config : configs) {
+      uint64 memory = fixed_bytes + thread_bytes * config.num_thread;
+      if (budget > 0 && memory > budget && config.num_thread > 1) {
+        Color::print_info(
+          StringPrintf("Autotune: %s: skipped, the estimated memory (%s) "
+                       "is more than -mem %d MB.", TuneName(config).c_str(),
+                       PrintSize(memory).c_str(), hyper_param_.mem_budget)
+        );
+        continue;
+      }
+      double speed = trial(config);
+      Color::print_info(
+        StringPrintf("Autotune: %s: %.0f rows/sec",
+                     TuneName(config).c_str(), speed)
+      );
+      if (TuneName(config) == current) { current_speed = speed; }
+      if (speed > option_speed) {
+        option_speed = speed;
+        option_best = config;
+      }
+    }
+    if (current_speed > 0 &&
+        option_speed < current_speed * (1 + kTuneGain)) {
+      best_speed = current_speed;
+    } else if (option_speed > 0) {
+      best = option_best;
+      best_speed = option_speed;
+    }
   }
-  if (hyper_param_.score_func.compare("ffm") == 0) {
-    hyper_param_.num_field = model_->GetNumField();
+  apply(best);
+  hyper_param_.thread_number = best.num_thread;
+  // The readers and the training use the threads of the best one
+  if (best.num_thread != pool_->ThreadNumber()) {
+    ThreadPool* pool = pool_;
+    cpus_ = thread_cpus(best.num_thread);
+    pool_ = new ThreadPool(best.num_thread, false, cpus_);
+    for (size_t i = 0; i < reader_.size(); ++i) {
+      reader_[i]->SetThreadPool(pool_);
+    }
+    delete pool;
   }
+  std::string str = StringPrintf("The fastest configuration of --autotune: "
+                                 "%s (%.0f rows/sec)",
+                                 TuneName(best).c_str(), best_speed);
+  LOG(INFO) << str;
+  Color::print_action(str);
   Color::print_info(
-    StringPrintf("Loss function: %s", 
-      hyper_param_.loss_func.c_str())
-  );
-  Color::print_info(
-    StringPrintf("Score function: %s", 
-      hyper_param_.score_func.c_str())
-  );
-  Color::print_info(
-    StringPrintf("Number of Feature: %d", 
-                 hyper_param_.num_feature)
+    StringPrintf("Time cost for autotune: %.2f (sec)", timer.toc())
   );
-  if (hyper_param_.score_func.compare("fm") == 0 ||
-      hyper_param_.score_func.compare("ffm") == 0) {
+}
+
+// Create the readers of the folds over the matrix of cv_data_,
+// where the i-th fold is the i-th range of its rows.
+std::vector<Reader*> Solver::create_folds() {
+  CHECK_NOTNULL(cv_data_);
+  DMatrix* data = cv_data_->GetMatrix();
+  int num_folds = hyper_param_.num_folds;
+  std::vector<Reader*> folds(num_folds, nullptr);
+  for (int i = 0; i < num_folds; ++i) {
+    FromDMReader* fold = new FromDMReader;
+    fold->SetSeed(hyper_param_.seed);
+    fold->Initialize(data,
+        (uint64)data->row_length * i / num_folds,
+        (uint64)data->row_length * (i + 1) / num_folds);
+    fold->SetShuffleWindow(hyper_param_.shuffle_window);
+    fold->SetShuffle(true);
+    folds[i] = fold;
+  }
+  return folds;
+}
+
+// The size of the parameter and its optimizer state, where the
+// bf16 state of ftrl packs its two aux values into one
+index_t Solver::AuxiliarySize(const std::string& opt_type,
+                              const std::string& opt_state) {
+  if (opt_type.compare("sgd") == 0) {
+    return 1;
+  } else if (opt_type.compare("adagrad") == 0) {
+    return 2;
+  } else if (opt_type.compare("ftrl") == 0 &&
+             opt_state.compare("bf16") == 0) {
+    return 2;
+  } else if (opt_type.compare("ftrl") == 0 ||
+             opt_type.compare("adam") == 0 ||
+             opt_type.compare("adamw") == 0) {
+    return 3;
+  }
+  return 0;
+}
+
+// The features of the first blocks are a lower bound of the model,
+// which is estimated again by the features of all the data before
+// it is created (see show_memory).
+// Bytes of all the files of the list, where the
+// size of a remote file is not known.
+static uint64 list_bytes(const std::vector<std::string>& files) {
+  uint64 bytes = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    struct stat st;
+    if (stat(files[i].c_str(), &st) == 0) { bytes += st.st_size; }
+  }
+  return bytes;
+}
+
+void Solver::estimate_data(const std::vector<std::string>& files) {
+  InmemReader sampler;
+  sampler.SetHashBits(hyper_param_.hash_bits);
+  sampler.SetSkipZeros(hyper_param_.skip_zeros);
+  sampler.SetMergeDuplicates(hyper_param_.merge_dup);
+  sampler.SetCrosses(hyper_param_.cross);
+  sampler.SetNumLabels(hyper_param_.num_label);
+  sampler.SetThreadPool(pool_);
+  // Each node or process of the sharded training reads its share
+  size_t num_shard = 1;
+  if (hyper_param_.ps_shard && !hyper_param_.ps_hosts.empty()) {
+    num_shard = hyper_param_.ps_hosts.size();
+  } else if (!hyper_param_.shm_name.empty()) {
+    num_shard = hyper_param_.shm_procs;
+  }
+  memory_.block_cache.clear();
+  memory_.block_memory.clear();
+  std::vector<MatrixEstimate> estimates(files.size());
+  index_t max_feat = 0, max_field = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!sampler.EstimateMatrix(files[i], kSampleMB, &estimates[i])) {
+      LOG(INFO) << "Cannot estimate the memory of " << files[i];
+      return;
+    }
+    // The first file of a training list stands for all of them
+    if (i == 0 && !hyper_param_.train_set_files.empty()) {
+      estimates[i].text_bytes = list_bytes(hyper_param_.train_set_files);
+    }
+    if (i == 0) { estimates[i].text_bytes /= num_shard; }
+    max_feat = std::max(max_feat, estimates[i].max_feat);
+    max_field = std::max(max_field, estimates[i].max_field);
+  }
+  estimate_model(hyper_param_.hash_bits > 0 ?
+                   1U << hyper_param_.hash_bits : max_feat + 1,
+                 max_field + 1);
+  // The in-memory reader keeps the matrix of the file, and the
+  // row pointers, the labels, the norms and the order of its samples.
+  // With --pack-rows, it keeps the packed rows and a decoded batch.
+  auto in_memory = [&]() {
+    uint64 bytes = 0;
+    for (const MatrixEstimate& e : estimates) {
+      uint64 rows = e.Rows();
+      if (hyper_param_.pack_rows && rows > 0) {
+        uint64 batch = std::min(rows, (uint64)InmemReader::kPackedBatch);
+        bytes += e.PackedBytes(e.text_bytes) +
+                 e.MatrixBytes(e.text_bytes) / rows * batch +
+                 rows * sizeof(index_t);
+      } else {
+        bytes += e.MatrixBytes(e.text_bytes) + rows *
+                 (sizeof(SparseRow*) + 2 * sizeof(real_t) + sizeof(index_t));
+      }
+    }
+    return bytes;
+  };
+  // The on-disk reader keeps its text block and the parsed blocks,
+  // and the list of training files has read_jobs of them open
+  const uint64 kPrefetch = OndiskReader::kDefaultPrefetch + 1;
+  std::vector<uint64> num_open(files.size(), 1);
+  if (!hyper_param_.train_set_files.empty()) {
+    num_open[0] = std::min((size_t)hyper_param_.read_jobs,
+                           hyper_param_.train_set_files.size());
+  }
+  auto on_disk = [&](int block_mb) {
+    uint64 bytes = 0;
+    for (size_t i = 0; i < estimates.size(); ++i) {
+      const MatrixEstimate& e = estimates[i];
+      uint64 text = std::min((uint64)block_mb * MB, e.text_bytes);
+      bytes += num_open[i] * (text + kPrefetch * e.MatrixBytes(text));
+    }
+    return bytes;
+  };
+  bool disk = hyper_param_.on_disk && !hyper_param_.cross_validation;
+  uint64 model = memory_.model + memory_.best_model;
+  uint64 budget = (uint64)hyper_param_.mem_budget * MB;
+  if (budget > 0 && !disk && !hyper_param_.cross_validation &&
+      model + in_memory() > budget) {
     Color::print_info(
-      StringPrintf("Number of K: %d", 
-                   hyper_param_.num_K)
+      StringPrintf("The in-memory training (%s) does not fit in -mem %d MB, "
+                   "so the data is read from disk (--disk).",
+                   PrintSize(model + in_memory()).c_str(),
+                   hyper_param_.mem_budget)
     );
-    if (hyper_param_.score_func.compare("ffm") == 0) {
+    hyper_param_.on_disk = true;
+    disk = true;
+  }
+  if (budget > 0 && disk) {
+    // The largest block that fits, and 1 MB at least
+    double per_mb = 0;
+    for (size_t i = 0; i < estimates.size(); ++i) {
+      per_mb += num_open[i] *
+                (1.0 + kPrefetch * (double)estimates[i].MatrixBytes(MB) / MB);
+    }
+    double fit = budget > model ? (budget - model) / (per_mb * MB) : 0;
+    if (fit < 1) {
+      Color::print_warning(
+        StringPrintf("The model (%s) does not fit in -mem %d MB.",
+                     PrintSize(model).c_str(), hyper_param_.mem_budget)
+      );
+      fit = 1;
+    }
+    if (fit < hyper_param_.block_size) {
+      hyper_param_.block_size = (int)fit;
       Color::print_info(
-        StringPrintf("Number of field: %d", 
-                    hyper_param_.num_field)
+        StringPrintf("Set the block size (-block) to %d MB for -mem %d MB.",
+                     hyper_param_.block_size, hyper_param_.mem_budget)
+      );
+    }
+  }
+  memory_.data = disk ? on_disk(hyper_param_.block_size) : in_memory();
+  if (disk) {
+    // The memory left by -mem keeps the parsed blocks
+    uint64 cache = (uint64)hyper_param_.block_cache * MB;
+    bool by_budget = cache == 0 && budget > model + memory_.data + MB;
+    if (by_budget) {
+      cache = budget - model - memory_.data;
+    }
+    // The training file first, and then the rest
+    uint64 kept = 0;
+    for (const MatrixEstimate& e : estimates) {
+      uint64 bytes = std::min(cache, e.MatrixBytes(e.text_bytes));
+      memory_.block_cache.push_back(bytes);
+      kept += bytes;
+      cache -= bytes;
+    }
+    memory_.data += kept;
+    // The rest of -mem bounds the blocks of --auto-block
+    if (budget > 0) {
+      uint64 left = budget > model + kept ? budget - model - kept : 0;
+      memory_.block_memory.assign(estimates.size(),
+          std::max(left / estimates.size(), (uint64)MB));
+    }
+    if (by_budget) {
+      Color::print_info(
+        StringPrintf("Keep %s of the parsed blocks in memory for "
+                     "-mem %d MB.", PrintSize(kept).c_str(),
+                     hyper_param_.mem_budget)
+      );
+    }
+  }
+  memory_.sampled = true;
+}
+
+// The model has (aux_size) values for each parameter, and the
+// latent vectors are padded to the aligned K (see Model).
+void Solver::estimate_model(index_t num_feature, index_t num_field) {
+  uint64 aux = AuxiliarySize(hyper_param_.opt_type,
+                             hyper_param_.opt_state);
+  if (aux == 0) { aux = hyper_param_.auxiliary_size; }
+  uint64 k = (hyper_param_.num_K + kAlign - 1) / kAlign * kAlign;
+  uint64 num_param = (uint64)num_feature * aux;
+  if (hyper_param_.score_func.compare("fm") == 0) {
+    num_param += (uint64)num_feature * k * aux;
+  } else if (hyper_param_.score_func.compare("fwfm") == 0) {
+    num_param += ((uint64)num_feature * k + (uint64)num_field * num_field)
+                 * aux;
+  } else if (hyper_param_.score_func.compare("ffm") == 0 &&
+             !field_index_.Empty()) {
+    num_param += field_index_.NumBlocks() *
+                 (field_index_.HasWidths() ? kAlign : k) * aux;
+  } else if (hyper_param_.score_func.compare("ffm") == 0) {
+    num_param += (uint64)num_feature * k * num_field * aux;
+  }
+  memory_.model = (num_param + aux) * sizeof(real_t);
+  // The best model is copied in memory, unless it is in -stop_file
+  bool has_valid = !hyper_param_.validate_set_file.empty() ||
+                   hyper_param_.valid_dataset != nullptr ||
+                   !hyper_param_.valid_iter.Empty();
+  memory_.best_model = hyper_param_.early_stop &&
+                       !hyper_param_.cross_validation && has_valid &&
+                       hyper_param_.stop_file.empty() ? memory_.model : 0;
+  // The snapshot of --async-valid, besides the best one
+  if (hyper_param_.async_validate && has_valid && !hyper_param_.quiet) {
+    memory_.best_model += memory_.model;
+  }
+  // The model of -param_file is paged by the OS, and
+  // only its locked head is kept in memory
+  if (!hyper_param_.param_file.empty()) {
+    memory_.model = std::min(memory_.model,
+                             (uint64)hyper_param_.param_mem * MB);
+  }
+}
+
+void Solver::show_memory(bool peak) {
+  std::string str;
+  if (!peak) {
+    uint64 total = memory_.model + memory_.best_model + memory_.data;
+    str = StringPrintf("Estimated memory: model %s, best model %s, "
+                       "data %s (%s), total %s",
+                       PrintSize(memory_.model).c_str(),
+                       PrintSize(memory_.best_model).c_str(),
+                       PrintSize(memory_.data).c_str(),
+                       !hyper_param_.from_file ? "DMatrix" :
+                       memory_.sampled ? (hyper_param_.on_disk &&
+                       !hyper_param_.cross_validation ? "on-disk" :
+                       "in-memory") : "unknown",
+                       PrintSize(total).c_str());
+    uint64 budget = (uint64)hyper_param_.mem_budget * MB;
+    if (budget > 0 && total > budget) {
+      Color::print_warning(
+        StringPrintf("The estimated memory (%s) is more than -mem %d MB.",
+                     PrintSize(total).c_str(), hyper_param_.mem_budget)
+      );
+    }
+  } else {
+    uint64 rss = GetPeakRSS();
+    if (rss == 0) { return; }
+    uint64 known = memory_.model + memory_.best_model + memory_.data;
+    str = StringPrintf("Peak memory: %s (model %s, best model %s, "
+                       "data %s, others %s)",
+                       PrintSize(rss).c_str(),
+                       PrintSize(memory_.model).c_str(),
+                       PrintSize(memory_.best_model).c_str(),
+                       PrintSize(memory_.data).c_str(),
+                       PrintSize(rss > known ? rss - known : 0).c_str());
+  }
+  LOG(INFO) << str;
+  Color::print_info(str);
+}
+
+// Create and initialize the model for training, whose
+// memory is first touched by the threads of the pool.
+Model* Solver::init_model(ThreadPool* pool) {
+  Model* model = nullptr;
+  // The ids of the training data are renumbered by -min_count
+  bool compact = hyper_param_.min_count > 0 && !feature_map_.empty();
+  // Initialize parameters from reader
+  if (hyper_param_.pre_model_file.empty()) {
+    model = create_model("", pool);
+    index_t aux_size = AuxiliarySize(hyper_param_.opt_type,
+                                     hyper_param_.opt_state);
+    if (aux_size > 0) {
+      hyper_param_.auxiliary_size = aux_size;
+    }
+    // The moments of adam start at zero
+    real_t aux_value =
+        hyper_param_.opt_type.compare(0, 4, "adam") == 0 ? 0 : 1.0;
+    // Both n and z of ftrl start at 1 in the compact state
+    if (hyper_param_.opt_state.compare("bf16") == 0) {
+      aux_value = PackBF16(1.0, 1.0);
+      model->SetOptState(kStoreBF16);
+    }
+    if (!field_index_.Empty()) {
+      model->SetFieldIndex(field_index_);
+    }
+    model->Initialize(hyper_param_.score_func,
+                      hyper_param_.loss_func,
+                      hyper_param_.num_feature,
+                      hyper_param_.num_field,
+                      hyper_param_.num_K,
+                      hyper_param_.auxiliary_size,
+                      hyper_param_.model_scale,
+                      hyper_param_.lazy_init,
+                      aux_value);
+  } else { // Initialize parameter from pre-trained model
+    model = create_model(hyper_param_.pre_model_file, pool);
+    // The aux values are the state of the optimizer
+    StorageType state = kStoreFP32;
+    ParseStorageType(hyper_param_.opt_state, &state);
+    if (model->GetOptState() != state ||
+        (index_t)model->GetAuxiliarySize() !=
+        AuxiliarySize(hyper_param_.opt_type, hyper_param_.opt_state)) {
+      Color::print_error(
+        StringPrintf("The pre-trained model is not trained by -p %s "
+                     "with -opt_state %s.",
+                     hyper_param_.opt_type.c_str(),
+                     hyper_param_.opt_state.c_str())
+      );
+      exit(0);
+    }
+    // The sparse model is loaded as a lazy model
+    if (model->IsLazy() && !hyper_param_.lazy_init) {
+      model->Densify();
+    }
+    grow_model(model);
+  }
+  if (hyper_param_.lazy_l2) {
+    model->SetLazyRegu(hyper_param_.learning_rate,
+                       hyper_param_.regu_lambda);
+  }
+  if (hyper_param_.merge_rows > 0) {
+    model->SetLocalParams(hyper_param_.merge_rows,
+                          hyper_param_.num_hot_feature);
+    // The hot features of the whole data, instead of the first batch
+    if (compact) {
+      // whose new ids of -min_count are in the order of the frequency
+      std::vector<index_t> ids(hyper_param_.num_feature);
+      std::iota(ids.begin(), ids.end(), 0);
+      model->SetHotFeatures(ids);
+    } else if (feature_stats_.NumNodes() > 0) {
+      model->SetHotFeatures(feature_stats_.FrequencyOrder());
+    }
+  }
+  if (compact) {
+    model->SetFeatureMap(feature_map_);
+  }
+  if (!field_map_.empty()) {
+    model->SetFieldMap(field_map_);
+  }
+  // The rate of current training data, which
+  // replaces the rate of the pre-trained model
+  model->SetNegativeRate(hyper_param_.neg_rate);
+  return model;
+}
+
+// Grow the pre-trained model for the new feature ids of current
+// training data, where the old features keep their parameters and
+// the state of the optimizer. The hashed ids, the ids of a feature
+// map, the latent factors of an inference file and the field-major
+// latent factors cannot grow.
+void Solver::grow_model(Model* model) {
+  index_t old_feat = model->GetNumFeature();
+  if (hyper_param_.num_feature > old_feat) {
+    if (hyper_param_.hash_bits > 0 ||
+        !model->GetFeatureMap().empty() || model->IsMapped() ||
+        model->GetLatentType() != kStoreFP32 || model->IsFieldMajor()) {
+      Color::print_warning(
+        StringPrintf("The feature ids not less than %d are ignored, "
+                     "since the pre-trained model cannot grow.",
+                     old_feat)
+      );
+    } else {
+      model->Grow(hyper_param_.num_feature);
+      Color::print_info(
+        StringPrintf("Grow the pre-trained model from %d to %d "
+                     "features.", old_feat, model->GetNumFeature())
       );
     }
   }
+  // The fields of a field map are renumbered to the model
+  if ((hyper_param_.score_func.compare("ffm") == 0 ||
+       hyper_param_.score_func.compare("fwfm") == 0) &&
+      hyper_param_.num_field > model->GetNumField() &&
+      model->GetFieldMap().empty()) {
+    Color::print_warning(
+      StringPrintf("The field ids not less than %d are ignored, "
+                   "since the fields of the pre-trained model "
+                   "cannot grow.", model->GetNumField())
+    );
+  }
+}
+
+// Create the score function of the optimizer for training.
+Score* Solver::init_score() {
+  Score* score = create_score();
+  // The score checks the optimizer by its name, e.g., "ftrl_bf16"
+  std::string opt_type = hyper_param_.opt_type;
+  if (hyper_param_.opt_state.compare("bf16") == 0) {
+    opt_type += "_bf16";
+  }
+  score->Initialize(hyper_param_.learning_rate,
+                    hyper_param_.regu_lambda,
+                    hyper_param_.alpha,
+                    hyper_param_.beta,
+                    hyper_param_.lambda_1,
+                    hyper_param_.lambda_2,
+                    opt_type,
+                    hyper_param_.beta_1,
+                    hyper_param_.beta_2);
+  return score;
+}
+
+// Create the loss function for training on the pool.
+Loss* Solver::init_loss(Score* score, ThreadPool* pool) {
+  Loss* loss = create_loss();
+  // The mini-batch is only used by distributed training
+  loss->Initialize(score, pool, 
+         hyper_param_.norm, 
+         hyper_param_.lock_free,
+         hyper_param_.ps_hosts.empty() ? 0 : hyper_param_.batch_size,
+         hyper_param_.prefetch_distance);
+  RowPartition partition;
+  CHECK(ParseRowPartition(hyper_param_.partition, &partition));
+  loss->SetPartition(partition);
+  loss->SetPipeline(hyper_param_.ps_pipeline);
+  loss->SetParamCache(hyper_param_.ps_cache);
+  loss->SetGradBatch(hyper_param_.grad_batch);
+  // The ranges of the owners are placed on the nodes of -numa local
+  NumaPolicy numa;
+  CHECK(ParseNumaPolicy(hyper_param_.numa_policy, &numa));
+  loss->SetOwnerUpdate(hyper_param_.owner_rows,
+                       numa == kNumaLocal ? GetNumNodes() : 1);
+  score->SetLongRow(pool, hyper_param_.long_row);
+  score->SetPairSample(hyper_param_.sample_row, hyper_param_.sample_pair);
+  return loss;
+}
+
+// Create the model, the score and the loss of each other task of
+// -num_label, which have the options of model_ but the loss of
+// -task_loss, so they are created with that loss for a while.
+void Solver::init_tasks() {
+  std::string loss_func = hyper_param_.loss_func;
+  for (int t = 1; t < hyper_param_.num_label; ++t) {
+    if (!hyper_param_.task_loss.empty()) {
+      hyper_param_.loss_func = hyper_param_.task_loss[t-1];
+    }
+    task_model_.emplace_back(init_model(pool_));
+    task_score_.emplace_back(init_score());
+    task_loss_.emplace_back(init_loss(task_score_.back().get(), pool_));
+  }
+  hyper_param_.loss_func = loss_func;
   Color::print_info(
-    StringPrintf("Time cost for loading model: %.2f (sec)",
-        timer.toc())
+    StringPrintf("Train %d tasks of the labels of each row.",
+                 hyper_param_.num_label)
   );
-  LOG(INFO) << "Initialize model.";
+}
+
+// Initialize predict task
+void Solver::init_predict() {
+  init_predict_pool();
+  load_model();
+  load_ensemble();
   /*********************************************************
    *  Initialize Reader and read problem                   *
    *********************************************************/
   Color::print_action("Read Problem ...");
-  timer.reset();
+  Timer timer;
   timer.tic();
+  // The test files of a list are read by start_prediction_work()
+  if (hyper_param_.test_set_files.size() > 1) {
+    Color::print_info(
+      StringPrintf("Predict %lu test files with one model.",
+                   hyper_param_.test_set_files.size())
+    );
+    return;
+  }
   // Create Reader
-  reader_.resize(1, create_reader());
   if (hyper_param_.from_file) {
     CHECK_NE(hyper_param_.test_set_file.empty(), true);
-    reader_[0]->SetBlockSize(hyper_param_.block_size);
-    reader_[0]->Initialize(hyper_param_.test_set_file);
-    reader_[0]->SetShuffle(false);
+    reader_.resize(1, create_test_reader(hyper_param_.test_set_file));
     if (reader_[0] == nullptr) {
     Color::print_info(
       StringPrintf("Cannot open the file %s",
@@ -484,9 +1416,16 @@ void Solver::init_predict() {
     }
   } else {
     CHECK_NOTNULL(hyper_param_.test_dataset)
+    reader_.resize(1, create_reader());
     reader_[0]->SetBlockSize(hyper_param_.block_size);
     reader_[0]->Initialize(hyper_param_.test_dataset);
     reader_[0]->SetShuffle(false);
+    if (!model_->GetFeatureMap().empty()) {
+      reader_[0]->SetFeatureMap(&model_->GetFeatureMap());
+    }
+    if (!model_->GetFieldMap().empty()) {
+      reader_[0]->SetFieldMap(&model_->GetFieldMap());
+    }
     if (reader_[0] == nullptr) {
     Color::print_info(
       StringPrintf("Cannot open the file %s",
@@ -500,26 +1439,296 @@ void Solver::init_predict() {
                   timer.toc())
   );
   LOG(INFO) << "Initialize Reader: " << hyper_param_.test_set_file;
-  /*********************************************************
-   *  Init score function                                  *
-   *********************************************************/
-  score_ = create_score();
-  LOG(INFO) << "Initialize score function.";
-  /*********************************************************
-   *  Init loss function                                   *
+}
+
+// Create the reader of a test file for prediction. The test file is
+// read only once, so it is streamed by the on-disk reader, which keeps
+// a few parsed blocks ahead of the scoring instead of the whole file,
+// and writes no binary cache (but it reads a valid filename.disk.bin,
+// e.g., of xlearn_convert --disk). With --disk the cache is written
+// for the later runs. The Parquet file is read by the in-memory reader.
+Reader* Solver::create_test_reader(const std::string& filename) {
+  Reader* reader = CREATE_READER(IsParquetFile(filename) ?
+                                 "memory" : "disk");
+  CHECK_NOTNULL(reader);
+  reader->SetBlockSize(hyper_param_.block_size);
+  reader->SetHashBits(hyper_param_.hash_bits);
+  reader->SetSkipZeros(hyper_param_.skip_zeros);
+  reader->SetMergeDuplicates(hyper_param_.merge_dup);
+  reader->SetCrosses(hyper_param_.cross);
+  reader->SetFileIO(get_file_io(hyper_param_.file_io));
+  reader->SetThreadPool(pool_);
+  if (!hyper_param_.on_disk || hyper_param_.bin_out == false) {
+    reader->SetNoBin();
+  }
+  reader->Initialize(filename);
+  reader->SetShuffle(false);
+  reader->Prefetch();
+  // The model is trained on the renumbered features
+  if (!model_->GetFeatureMap().empty()) {
+    reader->SetFeatureMap(&model_->GetFeatureMap());
+  }
+  if (!model_->GetFieldMap().empty()) {
+    reader->SetFieldMap(&model_->GetFieldMap());
+  }
+  return reader;
+}
+
+// The same streaming reader as create_test_reader(), but it has no
+// feature map, since the rows are renumbered by Predict()
+Reader* Solver::CreatePredictReader(const std::string& filename) {
+  CHECK(IsLoaded());
+  Reader* reader = CREATE_READER("disk");
+  CHECK_NOTNULL(reader);
+  reader->SetBlockSize(hyper_param_.block_size);
+  reader->SetHashBits(hyper_param_.hash_bits);
+  reader->SetSkipZeros(hyper_param_.skip_zeros);
+  reader->SetMergeDuplicates(hyper_param_.merge_dup);
+  reader->SetCrosses(hyper_param_.cross);
+  reader->SetFileIO(get_file_io(hyper_param_.file_io));
+  reader->SetThreadPool(pool_);
+  if (!hyper_param_.on_disk || hyper_param_.bin_out == false) {
+    reader->SetNoBin();
+  }
+  reader->Initialize(filename);
+  reader->SetShuffle(false);
+  reader->Prefetch();
+  return reader;
+}
+
+// Create the thread pool of prediction
+void Solver::init_predict_pool() {
+  /*********************************************************
+   *  Initialize thread pool                               *
+   *********************************************************/
+  size_t threadNumber = thread_number();
+  // The threads are pinned to the NUMA nodes
+  // when each node has its own copy of the model.
+  NumaPolicy numa;
+  CHECK(ParseNumaPolicy(hyper_param_.numa_policy, &numa));
+  pool_ = new ThreadPool(threadNumber, numa == kNumaReplicate,
+                         thread_cpus(threadNumber));
+  Color::print_info(
+    StringPrintf("xLearn uses %i threads for prediction task.",
+             threadNumber)
+  );
+}
+
+// Create the model, the score and the loss of
+// prediction by the hyper-parameters. The model is read
+// from hyper_param_.model_file if it is nullptr.
+void Solver::load_model(Model* model) {
+  NumaPolicy numa;
+  CHECK(ParseNumaPolicy(hyper_param_.numa_policy, &numa));
+  /*********************************************************
+   *  Read model file                                      *
+   *********************************************************/
+  Color::print_action("Load model ...");
+  Timer timer;
+  timer.tic();
+  if (model != nullptr) {
+    Color::print_info("Load the trained model in memory");
+    model_ = model;
+  } else {
+    CHECK_NE(hyper_param_.model_file.empty(), true);
+    Color::print_info(
+      StringPrintf("Load model from %s",
+            hyper_param_.model_file.c_str())
+    );
+    model_ = create_model(hyper_param_.model_file);
+  }
+  hyper_param_.score_func = model_->GetScoreFunction();
+  hyper_param_.loss_func = model_->GetLossFunction();
+  hyper_param_.num_feature = model_->GetNumFeature();
+  if (model_->GetNegativeRate() < 1.0) {
+    Color::print_info(
+      StringPrintf("The model is trained with negative sampling "
+                   "(rate %g), and the scores are calibrated by %f.",
+                   model_->GetNegativeRate(), model_->GetScoreOffset())
+    );
+  }
+  if (hyper_param_.hash_bits > 0 &&
+      hyper_param_.num_feature != (1U << hyper_param_.hash_bits)) {
+    Color::print_error(
+      StringPrintf("The model has %d features, which is not "
+                   "trained by -hash %d.",
+                   hyper_param_.num_feature,
+                   hyper_param_.hash_bits)
+    );
+    exit(0);
+  }
+  if (hyper_param_.score_func.compare("linear") != 0) {
+    hyper_param_.num_K = model_->GetNumK();
+  }
+  if (hyper_param_.score_func.compare("ffm") == 0 ||
+      hyper_param_.score_func.compare("fwfm") == 0) {
+    hyper_param_.num_field = model_->GetNumField();
+  }
+  Color::print_info(
+    StringPrintf("Loss function: %s", 
+      hyper_param_.loss_func.c_str())
+  );
+  Color::print_info(
+    StringPrintf("Score function: %s", 
+      hyper_param_.score_func.c_str())
+  );
+  Color::print_info(
+    StringPrintf("Number of Feature: %d", 
+                 hyper_param_.num_feature)
+  );
+  if (hyper_param_.score_func.compare("linear") != 0) {
+    Color::print_info(
+      StringPrintf("Number of K: %d", 
+                   hyper_param_.num_K)
+    );
+    if (hyper_param_.score_func.compare("fm") != 0) {
+      Color::print_info(
+        StringPrintf("Number of field: %d", 
+                    hyper_param_.num_field)
+      );
+    }
+  }
+  if (hyper_param_.score_func.compare("linear") != 0) {
+    StorageType type;
+    CHECK(ParseStorageType(hyper_param_.latent_type, &type));
+    // The compact kernels only read the dense layout of ffm
+    if (type != kStoreFP32 && !model_->GetFieldIndex().Empty()) {
+      Color::print_warning(
+        StringPrintf("The sparse ffm model is kept in fp32, and "
+                     "-latent %s is ignored.", StorageTypeName(type))
+      );
+      type = kStoreFP32;
+    }
+    // The inference model may have its own storage type
+    if (model_->GetLatentType() != kStoreFP32) {
+      if (type != kStoreFP32 && type != model_->GetLatentType()) {
+        Color::print_warning(
+          StringPrintf("The latent factors of the model are stored "
+                       "in %s, and -latent %s is ignored.",
+                       StorageTypeName(model_->GetLatentType()),
+                       StorageTypeName(type))
+        );
+      }
+    } else {
+      model_->ConvertLatent(type);
+    }
+    if (model_->GetLatentType() != kStoreFP32) {
+      Color::print_info(
+        StringPrintf("Storage type of latent factor: %s",
+                     StorageTypeName(model_->GetLatentType()))
+      );
+    }
+  }
+  if (model_->IsMapped()) {
+    Color::print_info("The model is mapped from the inference file.");
+  }
+  if (numa == kNumaReplicate) {
+    int num_nodes = GetNumNodes();
+    if (num_nodes > 1) {
+      model_->Replicate(num_nodes);
+      Color::print_info(
+        StringPrintf("Copy the model to %d NUMA nodes.", num_nodes)
+      );
+    } else {
+      Color::print_warning(
+        "Only one NUMA node is found, and -numa replicate is ignored."
+      );
+    }
+  }
+  Color::print_info(
+    StringPrintf("Time cost for loading model: %.2f (sec)",
+        timer.toc())
+  );
+  LOG(INFO) << "Initialize model.";
+  /*********************************************************
+   *  Init score function                                  *
    *********************************************************/
-  loss_ = create_loss();
-  loss_->Initialize(score_, pool_, hyper_param_.norm);
+  score_ = create_score();
+  LOG(INFO) << "Initialize score function.";
+  /*********************************************************
+   *  Init loss function                                   *
+   *********************************************************/
+  loss_ = init_predict_loss();
   LOG(INFO) << "Initialize score function.";
 }
 
+// Load the other models of the ensemble, which have their own
+// score and loss, since they can be of another score function.
+// The reader renumbers the rows by the feature and field maps of
+// the first model, so a model with other maps is rejected.
+void Solver::load_ensemble() {
+  const StringList& files = hyper_param_.ensemble_files;
+  StorageType type;
+  CHECK(ParseStorageType(hyper_param_.latent_type, &type));
+  for (size_t i = 0; i < files.size(); ++i) {
+    Color::print_info(
+      StringPrintf("Load model %lu of the ensemble from %s",
+                   i + 2, files[i].c_str())
+    );
+    Model* model = create_model(files[i]);
+    if (model->GetFeatureMap() != model_->GetFeatureMap() ||
+        model->GetFieldMap() != model_->GetFieldMap()) {
+      Color::print_error(
+        StringPrintf("The model %s of the ensemble does not have the "
+                     "feature and field maps of the first model %s, "
+                     "e.g., of another -min_count or --remap.",
+                     files[i].c_str(), hyper_param_.model_file.c_str())
+      );
+      exit(0);
+    }
+    std::string score_func = model->GetScoreFunction();
+    if (score_func.compare("linear") != 0 &&
+        model->GetLatentType() == kStoreFP32 &&
+        model->GetFieldIndex().Empty()) {
+      model->ConvertLatent(type);
+    }
+    Score* score = CREATE_SCORE(score_func.c_str());
+    if (score == nullptr) {
+      LOG(FATAL) << "Cannot create score: " << score_func;
+    }
+    score->SetKernels(&GetBestScoreKernels(model->get_aligned_k()));
+    Loss* loss = CREATE_LOSS(model->GetLossFunction().c_str());
+    if (loss == nullptr) {
+      LOG(FATAL) << "Cannot create loss: " << model->GetLossFunction();
+    }
+    loss->Initialize(score, pool_,
+           hyper_param_.norm,
+           false,
+           0,
+           hyper_param_.prefetch_distance);
+    RowPartition partition;
+    CHECK(ParseRowPartition(hyper_param_.partition, &partition));
+    loss->SetPartition(partition);
+    ensemble_model_.emplace_back(model);
+    ensemble_score_.emplace_back(score);
+    ensemble_loss_.emplace_back(loss);
+  }
+}
+
+// Create the loss function of prediction on score_ and pool_.
+Loss* Solver::init_predict_loss() {
+  Loss* loss = create_loss();
+  loss->Initialize(score_, pool_, 
+         hyper_param_.norm,
+         false,
+         0,
+         hyper_param_.prefetch_distance);
+  RowPartition partition;
+  CHECK(ParseRowPartition(hyper_param_.partition, &partition));
+  loss->SetPartition(partition);
+  return loss;
+}
+
 /******************************************************************************
  * Functions for xlearn start work                                            *
  ******************************************************************************/
 
 // Start training or inference
 void Solver::StartWork() {
-  if (hyper_param_.is_train) {
+  if (hyper_param_.online) {
+    LOG(INFO) << "Start online training work.";
+    start_online_work();
+  } else if (hyper_param_.is_train) {
     LOG(INFO) << "Start training work.";
     start_train_work();
   } else {
@@ -546,6 +1755,42 @@ void Solver::start_train_work() {
       hyper_param_.cross_validation) {
     save_txt_model = false;
   }
+  bool save_inference_model = true;
+  if (hyper_param_.inference_model_file.compare("none") == 0 ||
+      hyper_param_.cross_validation) {
+    save_inference_model = false;
+  }
+  // Only the first node of distributed training saves the
+  // model, which is the same on all the nodes
+  bool is_master = hyper_param_.ps_rank == 0 &&
+                   hyper_param_.shm_rank == 0;
+  if (!is_master) {
+    save_model = false;
+    save_txt_model = false;
+    save_inference_model = false;
+  }
+  // The first process of -shm validates the shared model for all
+  // the processes, and the others only train it
+  if (shared_ != nullptr && !is_master) {
+    early_stop = false;
+    quiet = true;
+  }
+  // The best model of early-stop is kept in the file
+  if (early_stop && !hyper_param_.stop_file.empty()) {
+    model_->SetBestModelFile(hyper_param_.stop_file);
+  }
+  // The checkpoint given by -pre resumes after its epochs, and
+  // the model saved by this training does not keep the number
+  int start_epoch = hyper_param_.cross_validation ? 0 : model_->GetEpoch();
+  model_->SetEpoch(0);
+  if (start_epoch >= epoch) {
+    Color::print_error(
+      StringPrintf("The checkpoint %s has been trained for %d epochs, "
+                   "which is not less than the number of epoch (-e %d).",
+                   hyper_param_.pre_model_file.c_str(), start_epoch, epoch)
+    );
+    exit(0);
+  }
   Trainer trainer;
   trainer.Initialize(reader_,  /* Reader list */
                      epoch,
@@ -554,54 +1799,985 @@ void Solver::start_train_work() {
                      metric_,
                      early_stop,
                      stop_window,
-                     quiet);
+                     quiet,
+                     train_metric_);
+  if (store_ != nullptr) {
+    trainer.SetKVStore(store_.get(), hyper_param_.ps_staleness >= 0);
+  }
+  if (ring_ != nullptr) {
+    trainer.SetRingAllReduce(ring_.get(), hyper_param_.batch_size);
+  }
+  if (shared_ != nullptr) {
+    trainer.SetSharedModel(shared_.get());
+  }
+  if (!task_model_.empty()) {
+    std::vector<Loss::Task> tasks;
+    for (size_t t = 0; t < task_model_.size(); ++t) {
+      tasks.push_back({ task_model_[t].get(), task_loss_[t].get() });
+    }
+    trainer.SetTasks(tasks);
+  }
+  // The hardware events are shown with the phases
+  bool show_profile = hyper_param_.profile || hyper_param_.perf_counter;
+  if (show_profile || !hyper_param_.profile_file.empty()) {
+    trainer.SetProfile(show_profile,
+                       hyper_param_.profile_file,
+                       pool_);
+    trainer.SetPerfCounters(perf_.get());
+  }
+  pool_->ResetStats();
   Color::print_action("Start to train ...");
 /******************************************************************************
  * Training under cross-validation                                            *
  ******************************************************************************/
   if (hyper_param_.cross_validation) {
-    trainer.CVTrain();
+    if (hyper_param_.cv_jobs > 1) {
+      parallel_cv(trainer);
+    } else {
+      trainer.CVTrain();
+    }
+    show_thread_stats();
+    show_memory(true);
     Color::print_action("Finish Cross-Validation");
   } 
+/******************************************************************************
+ * Training of the configurations of -sweep                                   *
+ ******************************************************************************/
+  else if (!hyper_param_.sweep.empty()) {
+    std::unique_ptr<Model> best(train_sweep(epoch, early_stop, stop_window));
+    show_thread_stats();
+    show_memory(true);
+    // The model goes back to the ids of the data
+    if (!feature_order_.empty()) {
+      best->RemapFeatures(feature_order_);
+    }
+    save_models(best.get(), save_model, save_txt_model, save_inference_model);
+    Color::print_action("Finish training");
+  }
 /******************************************************************************
  * Original training without cross-validation                                 *
  ******************************************************************************/
   else {
+    Checkpoint checkpoint;
+    if (!hyper_param_.checkpoint_file.empty() && is_master) {
+      checkpoint.Initialize(hyper_param_.checkpoint_file,
+                            hyper_param_.checkpoint_epoch,
+                            hyper_param_.checkpoint_minute,
+                            start_epoch);
+      trainer.SetCheckpoint(&checkpoint);
+      if (!feature_order_.empty()) {
+        checkpoint.SetFeatureMap(&feature_order_);
+      }
+    }
+    if (start_epoch > 0) {
+      Color::print_info(
+        StringPrintf("Resume the training after epoch %d of the checkpoint.",
+          start_epoch)
+      );
+      trainer.SetStartEpoch(start_epoch);
+    }
+    // The validation of each epoch runs with the next epoch, and
+    // the one in the middle of an epoch keeps the training loss
+    bool has_valid = !quiet && reader_.size() > 1;
+    std::unique_ptr<Loss> valid_loss;
+    if ((hyper_param_.async_validate || hyper_param_.valid_rows > 0) &&
+        has_valid) {
+      valid_loss.reset(init_predict_loss());
+      trainer.SetValidationLoss(valid_loss.get());
+      trainer.SetAsyncValidation(hyper_param_.async_validate);
+    }
+    trainer.SetValidationSchedule(hyper_param_.valid_every,
+                                  hyper_param_.valid_rows);
+    DMatrix valid_sample;
+    std::unique_ptr<Reader> sample_reader;
+    if (hyper_param_.valid_sample < 1 && has_valid) {
+      sample_reader.reset(sample_validation(&valid_sample));
+      trainer.SetValidationSample(sample_reader.get());
+    }
+    // Each NUMA node trains its own copy of the model
+    if (hyper_param_.numa_policy.compare("replicate") == 0) {
+      int num_nodes = GetNumNodes();
+      if (num_nodes > 1) {
+        model_->Replicate(num_nodes);
+        trainer.SetReplicaSync(hyper_param_.numa_sync);
+        Color::print_info(
+          StringPrintf("Train a copy of the model on each of the %d "
+                       "NUMA nodes.", num_nodes)
+        );
+      } else {
+        Color::print_warning(
+          "Only one NUMA node is found, and -numa replicate is ignored."
+        );
+      }
+    }
+    // The later epochs only train the sample of the rows by their loss
+    if (hyper_param_.loss_sample < 1) {
+      trainer.SetLossSampling(hyper_param_.loss_sample_epoch,
+                              hyper_param_.loss_sample);
+      Color::print_info(
+        StringPrintf("Sample about %.0f%% of the training rows by their "
+                     "loss from epoch %d.", hyper_param_.loss_sample * 100,
+                     hyper_param_.loss_sample_epoch)
+      );
+    }
     // The training process
     trainer.Train();
-    // Save binary model
+    model_->ClearReplicas();
+    show_thread_stats();
+    show_memory(true);
+    if (store_ != nullptr) {
+      finish_dist();
+    }
+    // The model goes back to the ids of the data
+    if (!feature_order_.empty()) {
+      model_->RemapFeatures(feature_order_);
+    }
+    if (!hyper_param_.checkpoint_file.empty() && is_master) {
+      checkpoint.Wait();
+      if (checkpoint.LastEpoch() > 0) {
+        Color::print_info(
+          StringPrintf("Checkpoint file: %s (epoch %d)",
+            hyper_param_.checkpoint_file.c_str(), checkpoint.LastEpoch())
+        );
+      }
+    }
+    save_models(model_, save_model, save_txt_model, save_inference_model);
     if (save_model) {
+      save_tasks();
+    }
+    Color::print_action("Finish training");
+  }
+}
+
+// The vectors are dropped before all the files are written,
+// so the files of -m, -t and -im have the same model.
+void Solver::prune_model(Model* model) {
+  if (hyper_param_.prune <= 0 ||
+      model->GetScoreFunction().compare("linear") == 0) {
+    return;
+  }
+  offset_t total = model->GetScoreFunction().compare("ffm") != 0 ?
+      model->GetNumFeature() : model->GetFieldIndex().Empty() ?
+      (offset_t)model->GetNumFeature() * model->GetNumField() :
+      model->GetFieldIndex().NumBlocks();
+  offset_t pruned = model->Prune(hyper_param_.prune);
+  Color::print_info(
+    StringPrintf("Prune %llu of %llu latent vectors (%.1f%%) by -prune %g.",
+                 (unsigned long long)pruned, (unsigned long long)total,
+                 total > 0 ? 100.0 * pruned / total : 0.0,
+                 hyper_param_.prune)
+  );
+}
+
+// Save the model of each other task to <model_file>.task<t>,
+// where the tasks are numbered from 1 as the labels.
+void Solver::save_tasks() {
+  for (size_t t = 0; t < task_model_.size(); ++t) {
+    Model* model = task_model_[t].get();
+    if (!feature_order_.empty()) {
+      model->RemapFeatures(feature_order_);
+    }
+    prune_model(model);
+    std::string filename = StringPrintf("%s.task%lu",
+                                        hyper_param_.model_file.c_str(),
+                                        t + 2);
+    if (hyper_param_.sparse_model) {
+      model->SerializeSparse(filename);
+    } else {
+      model->Serialize(filename);
+    }
+    Color::print_info(StringPrintf("Model file: %s", filename.c_str()));
+  }
+}
+
+// Save the model of the training to the files
+void Solver::save_models(Model* model,
+                         bool save_model,
+                         bool save_txt_model,
+                         bool save_inference_model) {
+  CHECK_NOTNULL(model);
+  prune_model(model);
+  // Save binary model
+  if (save_model) {
+    Timer timer;
+    timer.tic();
+    Color::print_action("Start to save model ...");
+    TraceSpan span("serialize_model", "trainer");
+    if (hyper_param_.sparse_model) {
+      model->SerializeSparse(hyper_param_.model_file);
+    } else {
+      model->Serialize(hyper_param_.model_file);
+    }
+    Color::print_info(
+      StringPrintf("Model file: %s", hyper_param_.model_file.c_str())
+    );
+    Color::print_info(
+      StringPrintf("Time cost for saving model: %.2f (sec)", timer.toc())
+    );
+  }
+  // Save TXT model 
+  if (save_txt_model) {
+    Timer timer;
+    timer.tic();
+    Color::print_action("Start to save txt model ...");
+    model->SerializeToTXT(hyper_param_.txt_model_file);
+    Color::print_info(
+      StringPrintf("TXT Model file: %s", hyper_param_.txt_model_file.c_str())
+    );
+    Color::print_info(
+      StringPrintf("Time cost for saving txt model: %.2f (sec)", timer.toc())
+    );
+  }
+  // Save inference model
+  if (save_inference_model) {
+    Timer timer;
+    timer.tic();
+    Color::print_action("Start to save inference model ...");
+    StorageType type;
+    CHECK(ParseStorageType(hyper_param_.latent_type, &type));
+    if (type != kStoreFP32 && !model->GetFieldIndex().Empty()) {
+      Color::print_warning(
+        StringPrintf("The sparse ffm model is kept in fp32, and "
+                     "-latent %s is ignored.", StorageTypeName(type))
+      );
+      type = kStoreFP32;
+    }
+    model->SerializeInference(hyper_param_.inference_model_file, type);
+    Color::print_info(
+      StringPrintf("Inference model file: %s (%s)",
+        hyper_param_.inference_model_file.c_str(),
+        StorageTypeName(type))
+    );
+    Color::print_info(
+      StringPrintf("Time cost for saving inference model: %.2f (sec)",
+        timer.toc())
+    );
+  }
+}
+
+// A job of parallel_cv(), which trains its folds one by one.
+// Its trainer is initialized again with new fold readers for
+// each fold, so the folds do not share the state of shuffle.
+struct CVJob {
+  ThreadPool* pool = nullptr;
+  Model* model = nullptr;
+  Score* score = nullptr;
+  Loss* loss = nullptr;
+  Metric* metric = nullptr;
+  Metric* train_metric = nullptr;
+  std::vector<Reader*> folds;
+  Trainer trainer;
+
+  ~CVJob() {
+    clear_folds();
+    delete train_metric;
+    delete metric;
+    delete loss;
+    delete score;
+    delete model;
+    delete pool;
+  }
+
+  void clear_folds() {
+    for (size_t i = 0; i < folds.size(); ++i) {
+      delete folds[i];
+    }
+    folds.clear();
+  }
+};
+
+// The folds are independent, so -cv_jobs of them are trained at the
+// same time. The threads of pool_ are split evenly into the pools of
+// the jobs, and each job has its own model, score, loss, metric and
+// readers over the matrix of cv_data_, which is shared read-only. The
+// job resets its model and its readers before each fold, so the
+// metric of a fold does not depend on the job that trains it.
+void Solver::parallel_cv(Trainer& trainer) {
+  int num_folds = reader_.size();
+  size_t threadNumber = pool_->ThreadNumber();
+  size_t num_jobs = std::min((size_t)hyper_param_.cv_jobs,
+                     std::min((size_t)num_folds, threadNumber));
+  if (num_jobs <= 1) {
+    trainer.CVTrain();
+    return;
+  }
+  Color::print_info(
+    StringPrintf("Train %lu folds at the same time, and each of "
+                 "them uses %lu threads.", num_jobs,
+                 threadNumber / num_jobs)
+  );
+  std::vector<std::unique_ptr<CVJob>> jobs(num_jobs);
+  size_t cpu_begin = 0;
+  for (size_t j = 0; j < num_jobs; ++j) {
+    // The first (threadNumber % num_jobs) jobs have one more thread
+    size_t threads = threadNumber / num_jobs +
+                     (j < threadNumber % num_jobs ? 1 : 0);
+    std::vector<int> cpus;
+    if (!cpus_.empty()) {
+      for (size_t k = 0; k < threads; ++k) {
+        cpus.push_back(cpus_[(cpu_begin + k) % cpus_.size()]);
+      }
+    }
+    cpu_begin += threads;
+    CVJob* job = new CVJob;
+    jobs[j].reset(job);
+    job->pool = new ThreadPool(threads, false, cpus);
+    job->model = init_model(job->pool);
+    job->score = init_score();
+    job->loss = init_loss(job->score, job->pool);
+    job->metric = create_metric();
+    if (job->metric != nullptr) {
+      job->metric->Initialize(job->pool);
+      if (hyper_param_.train_metric) {
+        job->train_metric = create_metric();
+        job->train_metric->Initialize(job->pool);
+      }
+    }
+    job->trainer.SetShowInfo(false);
+  }
+  // Each job takes the next fold when it is done
+  std::atomic<int> next_fold(0);
+  std::vector<MetricInfo> info_list(num_folds);
+  std::mutex print_mutex;
+  auto run_job = [&](CVJob* job) {
+    bool first = true;
+    for (int i = next_fold++; i < num_folds; i = next_fold++) {
+      if (!first) { job->model->Reset(); }
+      first = false;
       Timer timer;
       timer.tic();
-      Color::print_action("Start to save model ...");
-      trainer.SaveModel(hyper_param_.model_file);
-      Color::print_info(
-        StringPrintf("Model file: %s", hyper_param_.model_file.c_str())
-      );
-      Color::print_info(
-        StringPrintf("Time cost for saving model: %.2f (sec)", timer.toc())
-      );
+      job->clear_folds();
+      job->folds = create_folds();
+      job->trainer.Initialize(job->folds,
+                              hyper_param_.num_epoch,
+                              job->model,
+                              job->loss,
+                              job->metric,
+                              false,  /* No early-stopping for cv */
+                              hyper_param_.stop_window,
+                              false,
+                              job->train_metric);
+      info_list[i] = job->trainer.TrainFold(i);
+      std::string str = StringPrintf("Cross-validation: %d/%d: Test %s: %.6f",
+          i+1, num_folds, loss_->loss_type().c_str(),
+          info_list[i].loss_val);
+      for (size_t m = 0; m < info_list[i].metric_list.size(); ++m) {
+        str += StringPrintf(", Test %s: %.6f",
+                            job->metric->MetricTypeAt(m).c_str(),
+                            info_list[i].metric_list[m]);
+      }
+      str += StringPrintf(", Time cost: %.2f (sec)", timer.toc());
+      std::lock_guard<std::mutex> lock(print_mutex);
+      Color::print_info(str);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads.emplace_back(run_job, jobs[j].get());
+  }
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads[j].join();
+  }
+  // Average metric for cross-validation
+  trainer.ShowAverageMetric(info_list);
+}
+
+// A job of train_sweep(), which trains its configurations one by
+// one. It has its own readers over the matrices of the in-memory
+// readers, which are shared read-only by all the jobs.
+struct SweepJob {
+  ThreadPool* pool = nullptr;
+  bool own_pool = false;
+  Metric* metric = nullptr;
+  Metric* train_metric = nullptr;
+  std::vector<Reader*> readers;
+
+  ~SweepJob() {
+    for (size_t i = 0; i < readers.size(); ++i) {
+      delete readers[i];
+    }
+    delete train_metric;
+    delete metric;
+    if (own_pool) { delete pool; }
+  }
+};
+
+// The data is read once, and each configuration of the grid is trained
+// over it by one of the -sweep_jobs jobs, which takes the next one when
+// it is done as the folds of parallel_cv(). The threads of pool_ are
+// split evenly into the pools of the jobs, and the model, score and
+// loss of a configuration are created by the job for it. The result of
+// a configuration is its validation after early-stopping, which is
+// shown when it is done, and only the model of the best one is kept.
+Model* Solver::train_sweep(int epoch, bool early_stop, int stop_window) {
+  SweepConfig base = { hyper_param_.num_K,
+                       hyper_param_.learning_rate,
+                       hyper_param_.regu_lambda };
+  std::vector<SweepConfig> configs;
+  CHECK(ParseSweep(hyper_param_.sweep, base, &configs));
+  // The rows are the matrices of the in-memory readers
+  std::vector<DMatrix*> data;
+  for (size_t i = 0; i < reader_.size(); ++i) {
+    InmemReader* inmem = dynamic_cast<InmemReader*>(reader_[i]);
+    if (inmem == nullptr) {
+      Color::print_error("The -sweep option only works with the "
+                         "in-memory training of the data files.");
+      exit(0);
+    }
+    data.push_back(inmem->GetMatrix());
+  }
+  if (data.size() < 2) {
+    Color::print_error("The -sweep option needs the validation "
+                       "data (-v) to compare the configurations.");
+    exit(0);
+  }
+  int num_configs = configs.size();
+  size_t threadNumber = pool_->ThreadNumber();
+  size_t num_jobs = std::min((size_t)hyper_param_.sweep_jobs,
+                     std::min((size_t)num_configs, threadNumber));
+  Color::print_info(
+    StringPrintf("Train %d configurations of -sweep, %lu of them at "
+                 "the same time.", num_configs, num_jobs)
+  );
+  std::vector<std::unique_ptr<SweepJob>> jobs(num_jobs);
+  size_t cpu_begin = 0;
+  for (size_t j = 0; j < num_jobs; ++j) {
+    SweepJob* job = new SweepJob;
+    jobs[j].reset(job);
+    if (num_jobs == 1) {
+      job->pool = pool_;
+    } else {
+      // The first (threadNumber % num_jobs) jobs have one more thread
+      size_t threads = threadNumber / num_jobs +
+                       (j < threadNumber % num_jobs ? 1 : 0);
+      std::vector<int> cpus;
+      if (!cpus_.empty()) {
+        for (size_t k = 0; k < threads; ++k) {
+          cpus.push_back(cpus_[(cpu_begin + k) % cpus_.size()]);
+        }
+      }
+      cpu_begin += threads;
+      job->pool = new ThreadPool(threads, false, cpus);
+      job->own_pool = true;
     }
-    // Save TXT model 
-    if (save_txt_model) {
+    job->metric = create_metric();
+    if (job->metric != nullptr) {
+      job->metric->Initialize(job->pool);
+      if (hyper_param_.train_metric) {
+        job->train_metric = create_metric();
+        job->train_metric->Initialize(job->pool);
+      }
+    }
+    for (size_t i = 0; i < data.size(); ++i) {
+      FromDMReader* reader = new FromDMReader;
+      reader->SetSeed(hyper_param_.seed);
+      reader->Initialize(data[i]);
+      // Only the training data is shuffled
+      if (i == 0) {
+        reader->SetShuffleWindow(hyper_param_.shuffle_window);
+      }
+      reader->SetShuffle(i == 0);
+      job->readers.push_back(reader);
+    }
+  }
+  // Each job takes the next configuration when it is done
+  std::atomic<int> next_config(0);
+  std::mutex mutex;
+  std::unique_ptr<Model> best_model;
+  int best_config = -1;
+  MetricInfo best_info = { 0, 0 };
+  std::string metric_type = metric_ == nullptr ?
+                            "" : metric_->metric_type();
+  auto run_job = [&](SweepJob* job) {
+    for (int i = next_config++; i < num_configs; i = next_config++) {
       Timer timer;
       timer.tic();
-      Color::print_action("Start to save txt model ...");
-      trainer.SaveTxtModel(hyper_param_.txt_model_file);
-      Color::print_info(
-        StringPrintf("TXT Model file: %s", hyper_param_.txt_model_file.c_str())
-      );
-      Color::print_info(
-        StringPrintf("Time cost for saving txt model: %.2f (sec)", timer.toc())
+      std::unique_ptr<Model> model;
+      std::unique_ptr<Score> score;
+      std::unique_ptr<Loss> loss;
+      {
+        // The model and the score are given by the options of the
+        // task, which are changed to the configuration for them
+        std::lock_guard<std::mutex> lock(mutex);
+        hyper_param_.num_K = configs[i].num_K;
+        hyper_param_.learning_rate = configs[i].learning_rate;
+        hyper_param_.regu_lambda = configs[i].regu_lambda;
+        model.reset(init_model(job->pool));
+        score.reset(init_score());
+        loss.reset(init_loss(score.get(), job->pool));
+        hyper_param_.num_K = base.num_K;
+        hyper_param_.learning_rate = base.learning_rate;
+        hyper_param_.regu_lambda = base.regu_lambda;
+      }
+      Trainer trainer;
+      trainer.Initialize(job->readers,
+                         epoch,
+                         model.get(),
+                         loss.get(),
+                         job->metric,
+                         early_stop,
+                         stop_window,
+                         false,
+                         job->train_metric);
+      trainer.SetShowInfo(false);
+      trainer.SetValidationSchedule(hyper_param_.valid_every, 0);
+      trainer.Train();
+      real_t best_epoch = 0;
+      MetricInfo info = trainer.GetResult(&best_epoch);
+      std::string str = StringPrintf("Sweep: %d/%d (%s): Test %s: %.6f",
+          i+1, num_configs, SweepName(configs[i]).c_str(),
+          loss_->loss_type().c_str(), info.loss_val);
+      if (metric_ != nullptr) {
+        str += StringPrintf(", Test %s: %.6f", metric_type.c_str(),
+                            info.metric_val);
+      }
+      str += StringPrintf(", Epoch: %g, Time cost: %.2f (sec)",
+                          best_epoch, timer.toc());
+      std::lock_guard<std::mutex> lock(mutex);
+      Color::print_info(str);
+      // The lower loss, or the better metric, and the first
+      // configuration of the grid for the same result, so the
+      // best one does not depend on the order of the jobs
+      real_t value = metric_ == nullptr ? info.loss_val : info.metric_val;
+      real_t best = metric_ == nullptr ? best_info.loss_val :
+                                         best_info.metric_val;
+      bool better = best_config < 0;
+      if (!better && value != best) {
+        better = metric_ == nullptr ? value < best :
+                                      metric_->cmp(value, best);
+      } else if (!better) {
+        better = i < best_config;
+      }
+      if (better) {
+        best_model = std::move(model);
+        best_config = i;
+        best_info = info;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads.emplace_back(run_job, jobs[j].get());
+  }
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads[j].join();
+  }
+  CHECK_GE(best_config, 0);
+  std::string str = StringPrintf("The best configuration of -sweep: "
+      "%s, Test %s: %.6f", SweepName(configs[best_config]).c_str(),
+      loss_->loss_type().c_str(), best_info.loss_val);
+  if (metric_ != nullptr) {
+    str += StringPrintf(", Test %s: %.6f", metric_type.c_str(),
+                        best_info.metric_val);
+  }
+  Color::print_action(str);
+  return best_model.release();
+}
+
+// Start the server of this node, and connect to the servers of all
+// the nodes (or connect the ring of --allreduce), which are waited for
+// -ps_timeout seconds. The size of the model is the max of all the
+// nodes, since each node reads its own part of the training data.
+void Solver::init_dist(index_t* max_field) {
+  const StringList& hosts = hyper_param_.ps_hosts;
+  size_t rank = hyper_param_.ps_rank;
+  CHECK_LT(rank, hosts.size());
+  Color::print_action("Connect the nodes of distributed training ...");
+  std::vector<double> value = { (double)hyper_param_.num_feature,
+                                (double)*max_field };
+  if (hyper_param_.ps_allreduce) {
+    ring_.reset(new RingAllReduce);
+    if (!ring_->Connect(hosts, rank, hyper_param_.ps_timeout)) {
+      Color::print_error(
+        StringPrintf("Cannot connect the ring of -ps_hosts in %d seconds.",
+                     hyper_param_.ps_timeout)
       );
+      exit(0);
     }
-    Color::print_action("Finish training");
+    ring_->AllReduce(value.data(), value.size(), kReduceMax);
+  } else {
+    init_server();
+    store_->AllReduce(&value, kReduceMax);
+  }
+  hyper_param_.num_feature = (index_t)value[0];
+  *max_field = (index_t)value[1];
+  Color::print_info(
+    StringPrintf("Node %lu of %lu nodes of distributed training.",
+                 rank, hosts.size())
+  );
+}
+
+void Solver::init_server() {
+  const StringList& hosts = hyper_param_.ps_hosts;
+  size_t rank = hyper_param_.ps_rank;
+  std::string host;
+  int port = 0;
+  CHECK(ParseAddress(hosts[rank], &host, &port));
+  server_.reset(new ParameterServer);
+  if (server_->Start(port, rank, hosts.size(), hosts.size(),
+                     hyper_param_.ps_staleness) < 0) {
+    Color::print_error(
+      StringPrintf("Cannot listen on the port %d of %s.",
+                   port, hosts[rank].c_str())
+    );
+    exit(0);
+  }
+  store_.reset(new KVStore);
+  store_->SetClock(hyper_param_.ps_staleness >= 0);
+  StorageType push_type;
+  CHECK(ParseStorageType(hyper_param_.ps_push, &push_type));
+  store_->SetCompression(push_type, hyper_param_.ps_topk);
+  if (!store_->Connect(hosts, hyper_param_.ps_timeout)) {
+    Color::print_error(
+      StringPrintf("Cannot connect to the nodes of -ps_hosts in %d seconds.",
+                   hyper_param_.ps_timeout)
+    );
+    exit(0);
   }
 }
 
+// The processes read their own shards of the training file, so they
+// agree on the size of the model as the nodes of init_dist() do.
+void Solver::init_shared(index_t* max_field) {
+  size_t rank = hyper_param_.shm_rank;
+  size_t num_proc = hyper_param_.shm_procs;
+  Color::print_action("Connect the processes of shared-memory training ...");
+  shared_.reset(new SharedModel);
+  if (!shared_->Connect(hyper_param_.shm_name, rank, num_proc,
+                        hyper_param_.ps_timeout)) {
+    Color::print_error(
+      StringPrintf("Cannot connect the processes of -shm %s in %d seconds.",
+                   hyper_param_.shm_name.c_str(), hyper_param_.ps_timeout)
+    );
+    exit(0);
+  }
+  double value[2] = { (double)hyper_param_.num_feature,
+                      (double)*max_field };
+  shared_->AllReduce(value, 2, kReduceMax);
+  hyper_param_.num_feature = (index_t)value[0];
+  *max_field = (index_t)value[1];
+  Color::print_info(
+    StringPrintf("Process %lu of %lu processes of shared-memory training.",
+                 rank, num_proc)
+  );
+}
+
+// All the processes initialize the model in the same way, and
+// the one of rank 0 gives it to the others (as -pre is the same).
+void Solver::share_model() {
+  uint64 size = model_->GetSharedSize();
+  char* buffer = shared_->Allocate(size);
+  if (buffer == nullptr) {
+    Color::print_error(
+      StringPrintf("Cannot allocate %s of shared memory for -shm %s.",
+                   PrintSize(size).c_str(), hyper_param_.shm_name.c_str())
+    );
+    exit(0);
+  }
+  model_->ShareParameters(buffer, shared_->Rank() == 0);
+  // No process trains before the model is copied
+  shared_->Barrier();
+}
+
+// Copy the features of the shard of this node from the model, which
+// is initialized in the same way on all the nodes, and then wait for
+// the other shards before the first pull.
+void Solver::init_shard() {
+  size_t rank = hyper_param_.ps_rank;
+  size_t num_server = hyper_param_.ps_hosts.size();
+  // The bias is the key after the features
+  index_t num_key = model_->GetNumFeature() + 1;
+  if (hyper_param_.ps_partition == "range") {
+    store_->SetRangePartition(KVStore::RangeBounds(num_key, num_server));
+  } else if (hyper_param_.ps_partition == "balanced") {
+    // The blocks are merged, so there are at most kMaxBlock of them
+    uint64 merge = ((uint64)num_key + kCountBlock * kMaxBlock - 1) /
+                   (kCountBlock * kMaxBlock);
+    index_t block_size = (index_t)(kCountBlock * merge);
+    std::vector<double> count(((uint64)num_key + block_size - 1) /
+                              block_size, 0);
+    for (size_t b = 0; b < feature_count_.size(); ++b) {
+      if (b / merge < count.size()) { count[b / merge] += feature_count_[b]; }
+    }
+    store_->AllReduce(&count, kReduceSum);
+    store_->SetRangePartition(
+      KVStore::BalancedBounds(count, block_size, num_key, num_server));
+    feature_count_.clear();
+  }
+  if (hyper_param_.ps_partition != "mod") {
+    std::string str = "Number of the features of the servers:";
+    for (size_t s = 0; s < num_server; ++s) {
+      str += StringPrintf(" %u", store_->NumLocalKey(num_key, s));
+    }
+    Color::print_info(str);
+  }
+  index_t num_local = store_->NumLocalKey(num_key, rank);
+  std::vector<index_t> key(num_local);
+  for (index_t i = 0; i < num_local; ++i) {
+    key[i] = store_->GlobalKey(rank, i);
+  }
+  size_t length = model_->GetFeatureSize();
+  std::vector<real_t> value((size_t)num_local * length);
+  model_->GetFeatures(key, value.data());
+  server_->SetValue(length, &value);
+  std::vector<double> barrier(1, 0);
+  store_->AllReduce(&barrier, kReduceSum);
+}
+
+// Print the summary of the counts of the features,
+// and write the counts to the file of -feat_stats.
+void Solver::show_feature_stats() {
+  std::vector<std::string> lines = feature_stats_.Report(kNumTopFeature);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    LOG(INFO) << lines[i];
+    Color::print_info(lines[i]);
+  }
+  if (!feature_stats_.Save(hyper_param_.feature_stats_file)) {
+    Color::print_warning(
+      StringPrintf("Cannot write the feature stats to %s",
+                   hyper_param_.feature_stats_file.c_str())
+    );
+  }
+}
+
+// The model is created by the original ids, so its
+// initial values move with the features.
+void Solver::remap_features() {
+  if (!model_->GetFeatureMap().empty()) {
+    Color::print_warning("The features of the model have been "
+                         "renumbered, and xLearn will ignore --remap.");
+    return;
+  }
+  for (size_t i = 0; i < reader_.size(); ++i) {
+    if (reader_[i]->Type() == "from-dmatrix") {
+      Color::print_warning("The --remap option does not work with the "
+                           "DMatrix input, and xLearn will ignore it.");
+      return;
+    }
+  }
+  index_t num_feature = model_->GetNumFeature();
+  feature_map_ = feature_stats_.FeatureMap(num_feature);
+  feature_order_.resize(num_feature);
+  for (index_t j = 0; j < num_feature; ++j) {
+    feature_order_[feature_map_[j]] = j;
+  }
+  model_->RemapFeatures(feature_map_);
+  for (size_t i = 0; i < reader_.size(); ++i) {
+    reader_[i]->SetFeatureMap(&feature_map_);
+  }
+  Color::print_info(
+    StringPrintf("Renumber the %u used features by their frequency.",
+                 feature_stats_.NumUsedFeatures())
+  );
+}
+
+// The head of the model has the most frequent features after
+// --remap or -min_count, so it is locked in memory, and the others
+// are paged in and out of the file by the OS.
+void Solver::lock_model() {
+  if (!model_->IsFileBacked()) { return; }
+  Color::print_info(
+    StringPrintf("The model parameters are kept in the file: %s",
+                 hyper_param_.param_file.c_str())
+  );
+  uint64 budget = (uint64)hyper_param_.param_mem * MB;
+  index_t num_feature = model_->GetNumFeature();
+  if (budget == 0 || num_feature == 0) { return; }
+  uint64 per_feature = std::max(
+      model_->GetNumParameter() * sizeof(real_t) / num_feature,
+      (uint64)1);
+  index_t num_lock = (index_t)std::min((uint64)num_feature,
+                                       budget / per_feature);
+  if (model_->LockFeatures(num_lock)) {
+    Color::print_info(
+      StringPrintf("Lock the first %u features of the model file "
+                   "in memory (%s).", num_lock,
+                   PrintSize((uint64)num_lock * per_feature).c_str())
+    );
+  } else {
+    Color::print_warning(
+      StringPrintf("Cannot lock the model file in memory (see ulimit -l), "
+                   "so the first %u features are only loaded ahead.",
+                   num_lock)
+    );
+  }
+}
+
+// The rows of each label (y > 0 or not) are ranked by their hash, and
+// the first ones of the rate are kept, so the sample has the ratio of
+// the labels of the validation data, and it does not depend on the
+// order of the rows. The rows are read by the validation reader, which
+// has renumbered them, and the on-disk reader only keeps the sample.
+Reader* Solver::sample_validation(DMatrix* sample) {
+  CHECK_GT(reader_.size(), 1);
+  Reader* reader = reader_[1];
+  DMatrix* matrix = nullptr;
+  std::vector<index_t> hash[2];
+  reader->Reset();
+  for (;;) {
+    index_t tmp = reader->Samples(matrix);
+    if (tmp == 0) { break; }
+    for (index_t i = 0; i < tmp; ++i) {
+      hash[matrix->Y[i] > 0].push_back(
+          Reader::HashRow(matrix->row[i], hyper_param_.seed, 32));
+    }
+  }
+  // The largest hash of each label in the sample
+  index_t max_hash[2] = { 0, 0 };
+  for (int y = 0; y < 2; ++y) {
+    if (hash[y].empty()) { continue; }
+    size_t num = std::max((size_t)1, (size_t)std::round(
+        hash[y].size() * hyper_param_.valid_sample));
+    std::nth_element(hash[y].begin(), hash[y].begin() + num - 1,
+                     hash[y].end());
+    max_hash[y] = hash[y][num - 1];
+  }
+  sample->ReAlloc(0);
+  reader->Reset();
+  for (;;) {
+    index_t tmp = reader->Samples(matrix);
+    if (tmp == 0) { break; }
+    for (index_t i = 0; i < tmp; ++i) {
+      int y = matrix->Y[i] > 0;
+      const SparseRow* row = matrix->row[i];
+      if (hash[y].empty() ||
+          Reader::HashRow(row, hyper_param_.seed, 32) > max_hash[y]) {
+        continue;
+      }
+      sample->AddRow();
+      index_t k = sample->row_length - 1;
+      if (row != nullptr) {
+        sample->row[k] = sample->arena.NewRow(row->begin(), row->end());
+      }
+      sample->Y[k] = matrix->Y[i];
+      sample->norm[k] = matrix->norm[i];
+    }
+  }
+  Color::print_info(
+    StringPrintf("Validate the model by a sample of %u of the %lu rows "
+                 "of the validation data during the training.",
+                 sample->row_length, hash[0].size() + hash[1].size())
+  );
+  Reader* sample_reader = CREATE_READER("dmatrix");
+  CHECK_NOTNULL(sample_reader);
+  sample_reader->Initialize(sample);
+  sample_reader->SetShuffle(false);
+  return sample_reader;
+}
+
+// The features of less nodes than -min_count share the last id
+// of the model, so the model only has the frequent features.
+void Solver::compact_features() {
+  index_t num_kept = 0;
+  feature_map_ = feature_stats_.CompactMap(hyper_param_.num_feature,
+                                           hyper_param_.min_count,
+                                           &num_kept);
+  for (size_t i = 0; i < reader_.size(); ++i) {
+    reader_[i]->SetFeatureMap(&feature_map_);
+  }
+  Color::print_info(
+    StringPrintf("Keep %u of the %u used features, which are used "
+                 "at least %d times, and the others share one id.",
+                 num_kept, feature_stats_.NumUsedFeatures(),
+                 hyper_param_.min_count)
+  );
+  hyper_param_.num_feature = num_kept + 1;
+}
+
+// The features of less nodes than -share_count have one block
+// of the field index for all their target fields.
+void Solver::share_features() {
+  index_t num_shared = 0;
+  for (index_t j = 0; j < hyper_param_.num_feature; ++j) {
+    uint64 count = feature_stats_.FeatureCount(j);
+    if (count > 0 && count < (uint64)hyper_param_.share_count) {
+      field_index_.Share(j);
+      num_shared++;
+    }
+  }
+  Color::print_info(
+    StringPrintf("Share one latent vector of ffm for each of the %u "
+                 "features, which are used less than %d times.",
+                 num_shared, hyper_param_.share_count)
+  );
+}
+
+// The unused ids (including the fields of the validation data that
+// are not in the training data) are mapped to num_field, which the
+// score functions skip, as the model would do without the map.
+void Solver::remap_fields(const std::vector<uint8>& used) {
+  index_t num_used = std::count(used.begin(), used.end(), 1);
+  if (num_used == 0 || num_used == used.size()) { return; }
+  field_map_.assign(used.size(), num_used);
+  index_t id = 0;
+  for (size_t f = 0; f < used.size(); ++f) {
+    if (used[f]) { field_map_[f] = id++; }
+  }
+  for (size_t i = 0; i < reader_.size(); ++i) {
+    reader_[i]->SetFieldMap(&field_map_);
+  }
+  Color::print_info(
+    StringPrintf("Renumber the %u used fields of the field ids "
+                 "0 to %u.", num_used, (index_t)used.size() - 1)
+  );
+  hyper_param_.num_field = num_used;
+}
+
+// Count the features of the matrix by the blocks of kCountBlock ids.
+void Solver::count_features(const DMatrix* matrix) {
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    for (const Node& node : *matrix->row[i]) {
+      size_t b = node.feat_id / kCountBlock;
+      if (b >= feature_count_.size()) { feature_count_.resize(b + 1, 0); }
+      feature_count_[b]++;
+    }
+  }
+}
+
+// Tell the servers that this worker is done, and serve the
+// shard of this node until all the workers are done.
+void Solver::finish_dist() {
+  if (hyper_param_.ps_staleness >= 0) {
+    const ClockStat& stat = store_->GetClockStat();
+    Color::print_info(
+      StringPrintf("Staleness of %llu mini-batches: average %.2f, max %llu. "
+                   "Time cost for waiting for the other nodes: %.2f (sec)",
+                   (unsigned long long)stat.num_clock,
+                   stat.num_clock == 0 ? 0 :
+                   (double)stat.sum_staleness / stat.num_clock,
+                   (unsigned long long)stat.max_staleness,
+                   stat.wait_time)
+    );
+  }
+  if (hyper_param_.ps_push != "fp32" || hyper_param_.ps_topk < 1) {
+    double bytes = store_->GetPushBytes();
+    double raw_bytes = store_->GetRawPushBytes();
+    Color::print_info(
+      StringPrintf("Push traffic: %.2f MB, which is %.2fx smaller than fp32.",
+                   bytes / (1024.0 * 1024.0),
+                   bytes > 0 ? raw_bytes / bytes : 1.0)
+    );
+  }
+  if (hyper_param_.ps_cache > 0) {
+    uint64 keys = loss_->GetCacheKeys();
+    Color::print_info(
+      StringPrintf("Parameter cache: %.2f%% of the keys of the mini-batches "
+                   "are not pulled.",
+                   keys == 0 ? 0 : 100.0 * loss_->GetCacheHits() / keys)
+    );
+  }
+  store_->Stop();
+  server_->Wait();
+  Color::print_info("All the nodes of distributed training are done.");
+}
+
 // Inference
 void Solver::start_prediction_work() {
   Color::print_action("Start to predict ...");
+  if (hyper_param_.test_set_files.size() > 1) {
+    predict_files();
+    return;
+  }
   Predictor pdc;
   pdc.Initialize(reader_[0],
                  model_,
@@ -609,10 +2785,159 @@ void Solver::start_prediction_work() {
                  hyper_param_.output_file,
                  hyper_param_.sign,
                  hyper_param_.sigmoid,
-                 hyper_param_.res_out);
+                 hyper_param_.res_out,
+                 hyper_param_.raw_out);
+  if (out_buffer_ != nullptr) {
+    pdc.SetOutputBuffer(out_buffer_, out_length_);
+  }
+  for (size_t i = 0; i < ensemble_model_.size(); ++i) {
+    pdc.AddModel(ensemble_model_[i].get(), ensemble_loss_[i].get());
+  }
+  if (!hyper_param_.blend_weights.empty()) {
+    pdc.SetBlend(hyper_param_.blend_weights);
+  }
+  build_pair_table();
+  GpuScore gpu;
+  if (hyper_param_.use_gpu) {
+    if (hyper_param_.bag_field.empty() &&
+        gpu.Initialize(hyper_param_.score_func, *model_,
+                       hyper_param_.gpu_device)) {
+      pdc.SetGpuScore(&gpu, hyper_param_.norm);
+      Color::print_info(
+        StringPrintf("Predict on the CUDA device %d.",
+                     hyper_param_.gpu_device)
+      );
+    } else {
+      Color::print_warning(
+        StringPrintf("Cannot predict on the CUDA device %d, which needs "
+                     "xLearn built with CUDA and a linear, fm or ffm "
+                     "model of fp32 without -bag_field. xLearn "
+                     "predicts on the CPU.",
+                     hyper_param_.gpu_device)
+      );
+    }
+  }
   // Predict and write output
   pdc.Predict();
-  this->out_ = pdc.GetResult();
+  this->out_.swap(pdc.GetResult());
+  num_result_ = pdc.GetNumResult();
+  // The buffer is only used by one prediction
+  out_buffer_ = nullptr;
+  out_length_ = 0;
+}
+
+// The features of each field of ffm are collected from the test set,
+// and the latent products of the pairs of the fields whose features are
+// few are precomputed, which the score looks up (see PairTable).
+void Solver::build_pair_table() {
+  if (hyper_param_.pair_cells == 0) { return; }
+  if (hyper_param_.score_func.compare("ffm") != 0 ||
+      model_->GetLatentType() != kStoreFP32 || hyper_param_.use_gpu) {
+    Color::print_warning("The -pair_table option only works for the ffm "
+                         "model of fp32 on the CPU. xLearn will ignore it.");
+    return;
+  }
+  PairTable& table = model_->GetPairTable();
+  table.Init(model_->GetNumFeature(),
+             model_->GetNumField(),
+             hyper_param_.pair_cells);
+  Reader* reader = reader_[0];
+  DMatrix* matrix = nullptr;
+  reader->Reset();
+  while (reader->Samples(matrix) > 0) {
+    table.Add(matrix);
+  }
+  reader->Reset();
+  table.Build();
+  FFMScore::FillPairTable(*model_);
+  Color::print_info(
+    StringPrintf("Precompute %u pair tables of %llu cells.",
+                 table.NumTables(),
+                 (unsigned long long)table.NumCells())
+  );
+}
+
+// The test files are predicted by -test_jobs threads at the same time,
+// and each of them takes the next file when it is done. The jobs share
+// the model, the score and the threads of pool_, so the parsing and the
+// scoring of a file overlap with the others. Each job has its own reader
+// and loss for the file, which keep the state of the file.
+void Solver::predict_files() {
+  const StringList& files = hyper_param_.test_set_files;
+  const StringList& out_files = hyper_param_.output_files;
+  CHECK_EQ(files.size(), out_files.size());
+  size_t num_jobs = std::min((size_t)hyper_param_.test_jobs, files.size());
+  Color::print_info(
+    StringPrintf("Predict %lu files at the same time.", num_jobs)
+  );
+  std::atomic<size_t> next_file(0);
+  std::mutex print_mutex;
+  auto run_job = [&]() {
+    for (size_t i = next_file++; i < files.size(); i = next_file++) {
+      Timer timer;
+      timer.tic();
+      std::unique_ptr<Reader> reader(create_test_reader(files[i]));
+      std::unique_ptr<Loss> loss(init_predict_loss());
+      Predictor pdc;
+      pdc.Initialize(reader.get(),
+                     model_,
+                     loss.get(),
+                     out_files[i],
+                     hyper_param_.sign,
+                     hyper_param_.sigmoid,
+                     true,
+                     hyper_param_.raw_out);
+      pdc.SetShowInfo(false);
+      pdc.Predict();
+      std::string str = StringPrintf("Predict %s to %s",
+          files[i].c_str(), out_files[i].c_str());
+      if (reader->has_label()) {
+        str += StringPrintf(", Test loss: %.6f", loss->GetLoss());
+      }
+      str += StringPrintf(", Time cost: %.2f (sec)", timer.toc());
+      std::lock_guard<std::mutex> lock(print_mutex);
+      Color::print_info(str);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads.emplace_back(run_job);
+  }
+  for (size_t j = 0; j < num_jobs; ++j) {
+    threads[j].join();
+  }
+}
+
+// The busy, idle and lock times of a worker are the shares of the
+// time of the training, which is the sum of them.
+void Solver::show_thread_stats() {
+  pool_->GetStats(&thread_stats_);
+  const ThreadPoolStats& s = thread_stats_;
+  uint64 tasks = 0;
+  double busy = 0, idle = 0, lock_wait = 0;
+  for (size_t i = 0; i < s.tasks.size(); ++i) {
+    tasks += s.tasks[i];
+    busy += s.busy[i];
+    idle += s.idle[i];
+    lock_wait += s.lock_wait[i];
+  }
+  double total = std::max(busy + idle + lock_wait, 1e-9);
+  std::string str = StringPrintf(
+    "Thread pool: %zu workers, %llu tasks, busy %.1f%%, idle %.1f%%, "
+    "lock wait %.1f%%, the callers waited %.2f (sec)",
+    s.tasks.size(), (unsigned long long)tasks, 100 * busy / total,
+    100 * idle / total, 100 * lock_wait / total, s.caller_wait);
+  LOG(INFO) << str;
+  if (!hyper_param_.profile) { return; }
+  Color::print_info(str);
+  for (size_t i = 0; i < s.tasks.size(); ++i) {
+    Color::print_info(
+      StringPrintf("  worker %zu: %llu tasks, busy %.2f, idle %.2f, "
+                   "lock wait %.3f (sec)", i,
+                   (unsigned long long)s.tasks[i], s.busy[i],
+                   s.idle[i], s.lock_wait[i])
+    );
+  }
 }
 
 /******************************************************************************
@@ -632,6 +2957,683 @@ void Solver::Clear() {
     }
   }
   reader_.clear();
+  delete cv_data_;
+  cv_data_ = nullptr;
+  store_.reset();
+  server_.reset();
+  ring_.reset();
+  shared_.reset();
+  perf_.reset();
+  // The series are kept for the threads that still update them
+  metrics_server_.Stop();
+  feature_stats_.Clear();
+  feature_map_.clear();
+  feature_order_.clear();
+  field_map_.clear();
+  ensemble_loss_.clear();
+  ensemble_score_.clear();
+  ensemble_model_.clear();
+  task_loss_.clear();
+  task_score_.clear();
+  task_model_.clear();
+  // The threads of the readers have stopped
+  if (!hyper_param_.trace_file.empty()) {
+    int64 count = StopTrace();
+    if (count >= 0) {
+      Color::print_info(
+        StringPrintf("Trace file: %s (%lld spans)",
+          hyper_param_.trace_file.c_str(), (long long)count)
+      );
+    }
+  }
+}
+
+/******************************************************************************
+ * Functions for the loaded model                                             *
+ ******************************************************************************/
+
+// Load the model once for the following Predict() calls
+void Solver::LoadModel(HyperParam& hyper_param) {
+  if (!checker_.check_model_param(hyper_param)) {
+    Color::print_error("Arguments error");
+    exit(0);
+  }
+  UnloadModel();
+  this->hyper_param_ = hyper_param;
+  hyper_param_.is_train = false;
+  init_predict_pool();
+  start_metrics();
+  reset_predict_latency();
+  std::atomic_store(&served_, load_served());
+}
+
+// Serve the model in memory for the following Predict() calls
+void Solver::LoadModel(HyperParam& hyper_param, Model* model) {
+  CHECK_NOTNULL(model);
+  UnloadModel();
+  this->hyper_param_ = hyper_param;
+  hyper_param_.is_train = false;
+  init_predict_pool();
+  start_metrics();
+  reset_predict_latency();
+  std::atomic_store(&served_, load_served(model));
+}
+
+// Remove the latency of the predictions of the last loaded model
+void Solver::reset_predict_latency() {
+  for (int i = 0; i < kNumPredictPhase; ++i) {
+    predict_latency_[i].Reset();
+  }
+}
+
+// Serve the metrics of the online training and the loaded model
+void Solver::start_metrics() {
+  if (hyper_param_.metrics_port == 0 || metrics_server_.IsRunning()) {
+    return;
+  }
+  if (!metrics_on_.load()) {
+    static const char* kPhase = "Seconds of the phases of the online training.";
+    static const char* kLatency = "Latency of the predictions (seconds).";
+    metrics_.train_rows = stats_.GetCounter(
+        "xlearn_train_rows_total", "Rows trained online.");
+    metrics_.train_nnz = stats_.GetCounter(
+        "xlearn_train_nnz_total", "Non-zero features of the rows trained online.");
+    metrics_.read_ns = stats_.GetCounter(
+        "xlearn_phase_seconds_total", kPhase, "phase=\"read\"", 1e-9);
+    metrics_.parse_ns = stats_.GetCounter(
+        "xlearn_phase_seconds_total", kPhase, "phase=\"parse\"", 1e-9);
+    metrics_.train_ns = stats_.GetCounter(
+        "xlearn_phase_seconds_total", kPhase, "phase=\"train\"", 1e-9);
+    metrics_.publish_ns = stats_.GetCounter(
+        "xlearn_phase_seconds_total", kPhase, "phase=\"publish\"", 1e-9);
+    metrics_.pending_bytes = stats_.GetGauge(
+        "xlearn_reader_pending_bytes",
+        "Bytes read from the source of the online training and not trained yet.");
+    metrics_.predict_rows = stats_.GetCounter(
+        "xlearn_predict_rows_total", "Rows predicted by the loaded model.");
+    metrics_.predict_latency = stats_.GetHistogram(
+        "xlearn_predict_latency_seconds", kLatency, "api=\"predict\"");
+    metrics_.score_row_latency = stats_.GetHistogram(
+        "xlearn_predict_latency_seconds", kLatency, "api=\"score_row\"");
+    metrics_.score_rows_latency = stats_.GetHistogram(
+        "xlearn_predict_latency_seconds", kLatency, "api=\"score_rows\"");
+    metrics_.rank_latency = stats_.GetHistogram(
+        "xlearn_predict_latency_seconds", kLatency, "api=\"rank\"");
+    metrics_.model_bytes = stats_.GetGauge(
+        "xlearn_model_bytes", "Bytes of the parameters of the model.");
+    metrics_.resident_bytes = stats_.GetGauge(
+        "xlearn_resident_bytes", "Resident memory of the process (bytes).");
+    metrics_.pool_threads = stats_.GetGauge(
+        "xlearn_pool_threads", "Threads of the thread pool.");
+    metrics_.pool_busy = stats_.GetGauge(
+        "xlearn_pool_busy_seconds",
+        "Seconds that the threads of the pool ran the tasks.");
+    metrics_.model_version = stats_.GetGauge(
+        "xlearn_model_version", "Version of the loaded model.");
+    metrics_on_.store(true);
+  }
+  int port = metrics_server_.Start(hyper_param_.metrics_port, &stats_);
+  if (port < 0) {
+    Color::print_warning(
+      StringPrintf("Cannot serve the metrics at port %d.",
+                   hyper_param_.metrics_port)
+    );
+    return;
+  }
+  Color::print_info(
+    StringPrintf("Serve the metrics at http://<host>:%d/metrics", port)
+  );
+}
+
+// The gauges are set by the threads that update the
+// counters, since the registry has no callback
+void Solver::refresh_metrics() {
+  double now = WallSeconds();
+  double last = metrics_time_.load(std::memory_order_relaxed);
+  if (now - last < 1.0 ||
+      !metrics_time_.compare_exchange_strong(last, now)) {
+    return;
+  }
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  if (served != nullptr) {
+    metrics_.model_bytes->Set(
+      (double)served->model->GetNumParameter() * sizeof(real_t));
+    metrics_.model_version->Set((double)served->version);
+  }
+  metrics_.resident_bytes->Set((double)GetCurrentRSS());
+  if (pool_ != nullptr) {
+    ThreadPoolStats stats;
+    pool_->GetStats(&stats);
+    double busy = 0;
+    for (size_t i = 0; i < stats.busy.size(); ++i) { busy += stats.busy[i]; }
+    metrics_.pool_threads->Set((double)pool_->ThreadNumber());
+    metrics_.pool_busy->Set(busy);
+  }
+}
+
+// Take the trained model
+Model* Solver::ReleaseModel() {
+  CHECK_NOTNULL(model_);
+  Model* model = model_;
+  model_ = nullptr;
+  model->Densify();
+  return model;
+}
+
+// Return the served model of the new predictions
+Model* Solver::GetLoadedModel() {
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  CHECK(served != nullptr);
+  return served->model;
+}
+
+// Set by Ctrl-C or kill to stop the online training
+static std::atomic<bool> online_stop(false);
+
+static void stop_online(int) {
+  online_stop.store(true);
+}
+
+// Create the parser of the online training by the first line,
+// which is libsvm or libffm with the label
+static Parser* create_online_parser(const std::string& line,
+                                    const HyperParam& hyper_param) {
+  size_t space_count = std::count(line.begin(), line.end(), ' ');
+  size_t table_count = std::count(line.begin(), line.end(), '\t');
+  std::string splitor = table_count > space_count ? "\t" : " ";
+  std::vector<std::string> str_list;
+  SplitStringUsing(line, splitor.c_str(), &str_list);
+  size_t count = 0;
+  if (str_list.size() > 1 &&
+      str_list[0].find(':') == std::string::npos) {
+    count = std::count(str_list[1].begin(), str_list[1].end(), ':');
+  }
+  if (count != 1 && count != 2) {
+    Color::print_error(
+      StringPrintf("The online training reads libsvm or libffm "
+                   "lines with the label, but the first line is: %s",
+                   line.c_str())
+    );
+    exit(0);
+  }
+  Parser* parser = CREATE_PARSER(count == 1 ? "libsvm" : "libffm");
+  CHECK_NOTNULL(parser);
+  parser->setLabel(true);
+  parser->setSplitor(splitor);
+  parser->setHashBits(hyper_param.hash_bits);
+  parser->setSkipZeros(hyper_param.skip_zeros);
+  parser->setMergeDuplicates(hyper_param.merge_dup);
+  std::vector<FieldCross> crosses;
+  CHECK(ParseCrosses(hyper_param.cross, &crosses));
+  parser->setCrosses(crosses);
+  return parser;
+}
+
+// Add the nanoseconds since the beginning to the counter,
+// and return the end as the beginning of the next phase
+static double add_seconds(StatCounter* counter, double begin) {
+  double end = WallSeconds();
+  counter->Add((uint64)((end - begin) * 1e9));
+  return end;
+}
+
+// Train on the lines of the source as they arrive
+void Solver::start_online_work() {
+  // Bytes read at most, and the time waited for them (ms)
+  static const size_t kReadBytes = 4 * 1024 * 1024;
+  static const int kWaitMs = 200;
+  std::unique_ptr<LineSource> source(
+    CreateLineSource(hyper_param_.train_set_file));
+  if (source == nullptr || !source->Open()) {
+    Color::print_error(
+      StringPrintf("Cannot open the source of the online training: %s",
+                   hyper_param_.train_set_file.c_str())
+    );
+    exit(0);
+  }
+  bool save_txt_model = hyper_param_.txt_model_file.compare("none") != 0;
+  bool save_inference_model =
+      hyper_param_.inference_model_file.compare("none") != 0;
+  // The model is published by the writer of the checkpoint
+  Checkpoint publisher;
+  publisher.Initialize(hyper_param_.model_file, 0,
+                       hyper_param_.publish_seconds / 60.0, 0);
+  if (save_inference_model) {
+    StorageType type;
+    CHECK(ParseStorageType(hyper_param_.latent_type, &type));
+    publisher.SetInferenceFile(hyper_param_.inference_model_file, type);
+  }
+  if (!hyper_param_.delta_file.empty()) {
+    publisher.SetDeltaFile(hyper_param_.delta_file);
+  }
+  start_metrics();
+  bool metrics = metrics_on_.load();
+  online_stop.store(false);
+  signal(SIGINT, stop_online);
+  signal(SIGTERM, stop_online);
+  Color::print_action(
+    StringPrintf("Start to train online from %s ...",
+                 hyper_param_.train_set_file.c_str())
+  );
+  HyperParam hyper_param = hyper_param_;
+  std::unique_ptr<Parser> parser;
+  DMatrix matrix;
+  std::string buf;
+  uint64 num_rows = 0;
+  uint64 new_rows = 0;
+  double loss_sum = 0;
+  int num_publish = 0;
+  bool more = true;
+  while (more && !online_stop.load()) {
+    double begin = metrics ? WallSeconds() : 0;
+    more = source->Read(&buf, kReadBytes, kWaitMs);
+    if (metrics) {
+      begin = add_seconds(metrics_.read_ns, begin);
+      metrics_.pending_bytes->Set((double)buf.size());
+    }
+    // Only the whole lines are parsed, and the rest is kept
+    size_t end = buf.rfind('\n');
+    if (end != std::string::npos) {
+      if (parser == nullptr) {
+        size_t begin = buf.find_first_not_of("\r\n");
+        if (begin != std::string::npos) {
+          size_t size = buf.find('\n', begin) - begin;
+          std::string line = buf.substr(begin, size);
+          if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+          parser.reset(create_online_parser(line, hyper_param));
+        }
+      }
+      if (parser != nullptr) {
+        parser->Parse(buf.data(), end + 1, matrix, true);
+        if (metrics) { begin = add_seconds(metrics_.parse_ns, begin); }
+        if (matrix.row_length > 0) {
+          real_t loss = PartialFit(hyper_param, &matrix);
+          loss_sum += (double)loss * matrix.row_length;
+          new_rows += matrix.row_length;
+          if (metrics) {
+            begin = add_seconds(metrics_.train_ns, begin);
+            metrics_.train_rows->Add(matrix.row_length);
+            uint64 nnz = 0;
+            for (index_t i = 0; i < matrix.row_length; ++i) {
+              if (matrix.row[i] != nullptr) { nnz += matrix.row[i]->size(); }
+            }
+            metrics_.train_nnz->Add(nnz);
+          }
+        }
+      }
+      buf.erase(0, end + 1);
+    }
+    // The model is also published while the source is idle
+    if (new_rows > 0 &&
+        publisher.Step(GetLoadedModel(), num_publish + 1)) {
+      num_rows += new_rows;
+      num_publish++;
+      Color::print_info(
+        StringPrintf("Publish %d: %llu rows, %s of the new rows: %.6f",
+                     num_publish, (unsigned long long)num_rows,
+                     hyper_param_.loss_func.c_str(),
+                     loss_sum / new_rows)
+      );
+      new_rows = 0;
+      loss_sum = 0;
+      if (metrics) { add_seconds(metrics_.publish_ns, begin); }
+    }
+    if (metrics) { refresh_metrics(); }
+  }
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  publisher.Wait();
+  if (!IsLoaded()) {
+    Color::print_warning("No line has been trained, and no model is saved.");
+    return;
+  }
+  num_rows += new_rows;
+  Color::print_info(
+    StringPrintf("Trained %llu rows online.", (unsigned long long)num_rows)
+  );
+  save_models(GetLoadedModel(), true, save_txt_model, save_inference_model);
+  Color::print_action("Finish training");
+}
+
+// Train the loaded model on the rows of the matrix
+real_t Solver::PartialFit(HyperParam& hyper_param, const DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  if (!IsLoaded()) {
+    // The first batch gives the size of the new model
+    UnloadModel();
+    this->hyper_param_ = hyper_param;
+    hyper_param_.is_train = true;
+    hyper_param_.num_feature = hyper_param_.hash_bits > 0 ?
+        1U << hyper_param_.hash_bits : matrix->MaxFeat() + 1;
+    if (hyper_param_.score_func.compare("ffm") == 0 ||
+        hyper_param_.score_func.compare("fwfm") == 0) {
+      hyper_param_.num_field = matrix->MaxField() + 1;
+    }
+    init_predict_pool();
+    Model* model = init_model(pool_);
+    std::atomic_store(&served_, load_served(model));
+  }
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  Model* model = served->model;
+  // The optimizer of the loaded model, which is kept for the next batch
+  if (loss_ == nullptr) {
+    score_ = init_score();
+    loss_ = init_loss(score_, pool_);
+  }
+  DMatrix mapped;
+  matrix = map_rows(*model, matrix, &mapped);
+  // Only the ids of the DMatrix without hashing can be new
+  if (hyper_param_.hash_bits == 0 && !model->IsFieldMajor()) {
+    model->Grow(matrix->MaxFeat() + 1);
+  }
+  loss_->Reset();
+  if (matrix->row_length > 0) {
+    loss_->CalcGrad(matrix, *model);
+  }
+  model->FlushLazyRegu();
+  // The cached scores are of the model before the training
+  if (served->cache != nullptr) { served->cache->Clear(); }
+  return matrix->row_length > 0 ? loss_->GetLoss() : 0;
+}
+
+// Load a new version of the model, and swap it in
+void Solver::ReloadModel(const std::string& filename,
+                         bool background) {
+  CHECK(IsLoaded());
+  if (!FileExist(filename.c_str())) {
+    Color::print_error(
+      StringPrintf("Model file: %s does not exist.",
+           filename.c_str())
+    );
+    exit(0);
+  }
+  // One reload at a time
+  WaitReload();
+  auto reload = [this, filename]() {
+    hyper_param_.model_file = filename;
+    std::shared_ptr<Served> served = load_served();
+    // The old version is deleted by its last running request
+    std::atomic_store(&served_, served);
+  };
+  if (background) {
+    reload_thread_ = std::thread(reload);
+  } else {
+    reload();
+  }
+}
+
+// Wait for the reload in the background
+void Solver::WaitReload() {
+  if (reload_thread_.joinable()) { reload_thread_.join(); }
+}
+
+// The predictions keep running during the apply
+bool Solver::ApplyDelta(const std::string& filename) {
+  CHECK(IsLoaded());
+  WaitReload();
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  if (!served->model->ApplyDelta(filename)) { return false; }
+  if (served->cache != nullptr) { served->cache->Clear(); }
+  return true;
+}
+
+// Return the version of the loaded model
+uint64 Solver::GetModelVersion() {
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  return served == nullptr ? 0 : served->version;
+}
+
+// Load the model of hyper_param_.model_file for serving,
+// or serve the given model if it is not nullptr
+std::shared_ptr<Solver::Served> Solver::load_served(Model* model) {
+  load_model(model);
+  std::shared_ptr<Served> served(new Served());
+  served->model = model_;
+  served->score = score_;
+  served->loss = loss_;
+  served->version = ++version_;
+  model_ = nullptr;
+  score_ = nullptr;
+  loss_ = nullptr;
+  if (hyper_param_.batch_window > 0) {
+    served->batcher = new BatchScorer();
+    served->batcher->Initialize(served->loss, served->model,
+                                hyper_param_.batch_window,
+                                hyper_param_.batch_rows);
+    Color::print_info(
+      StringPrintf("Predict the requests within %d us in one batch "
+                   "of at most %d rows.",
+                   hyper_param_.batch_window,
+                   hyper_param_.batch_rows)
+    );
+  }
+  if (hyper_param_.result_cache > 0) {
+    served->cache = new ResultCache();
+    served->cache->Initialize(hyper_param_.result_cache);
+  }
+  return served;
+}
+
+// Predict the rows of the matrix by the loaded model
+void Solver::Predict(const DMatrix* matrix, real_t* out) {
+  CHECK_NOTNULL(matrix);
+  double begin = WallSeconds();
+  PredictTiming timing;
+  predict(matrix, out, &timing);
+  double end = WallSeconds();
+  if (hyper_param_.batch_window > 0) {
+    predict_latency_[kPhaseQueue].RecordSeconds(timing.queue);
+  }
+  predict_latency_[kPhaseScore].RecordSeconds(timing.score);
+  predict_latency_[kPhaseCopy].RecordSeconds(timing.copy);
+  predict_latency_[kPhaseTotal].RecordSeconds(end - begin);
+  if (metrics_on_.load(std::memory_order_acquire)) {
+    observe_predict(metrics_.predict_latency, begin, matrix->row_length);
+  }
+}
+
+void Solver::predict(const DMatrix* matrix, real_t* out,
+                     PredictTiming* timing) {
+  double begin = WallSeconds();
+  // The version is kept until the prediction is done
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  CHECK(served != nullptr);
+  if (matrix->row_length == 0) { return; }
+  index_t num_row = matrix->row_length;
+  // Only the rows missed by the cache are predicted,
+  // which are the views of the rows of the caller
+  std::vector<ResultCache::Key> keys;
+  std::vector<index_t> missed;
+  DMatrix missed_rows;
+  std::vector<real_t> missed_out;
+  real_t* pred = out;
+  if (served->cache != nullptr) {
+    ResultCache::Key key;
+    for (index_t i = 0; i < num_row; ++i) {
+      ResultCache::RowKey(matrix->row[i], matrix->norm[i], &key);
+      if (!served->cache->Get(key, out + i)) {
+        keys.push_back(std::move(key));
+        missed.push_back(i);
+      }
+    }
+    missed_rows.ReAlloc(missed.size(), false);
+    for (size_t m = 0; m < missed.size(); ++m) {
+      const SparseRow* row = matrix->row[missed[m]];
+      missed_rows.row[m] = row == nullptr ? nullptr :
+          missed_rows.arena.NewView(row->begin(), row->size());
+      missed_rows.norm[m] = matrix->norm[missed[m]];
+    }
+    missed_out.resize(missed.size());
+    matrix = &missed_rows;
+    pred = missed_out.data();
+  }
+  if (matrix->row_length > 0) {
+    DMatrix mapped;
+    matrix = map_rows(*served->model, matrix, &mapped);
+    if (served->batcher != nullptr) {
+      served->batcher->Predict(matrix, pred, timing);
+    } else {
+      served->loss->Predict(matrix, *served->model, pred);
+    }
+  }
+  // The scoring is the time before the results are written,
+  // which is not spent in the queue and the copy of the batch
+  double scored = WallSeconds();
+  timing->score = scored - begin - timing->queue - timing->copy;
+  for (size_t m = 0; m < missed.size(); ++m) {
+    served->cache->Put(keys[m], pred[m]);
+    out[missed[m]] = pred[m];
+  }
+  if (hyper_param_.sigmoid) {
+    VecSigmoid(out, out, num_row);
+  } else if (hyper_param_.sign) {
+    for (index_t i = 0; i < num_row; ++i) {
+      out[i] = out[i] > 0 ? 1 : 0;
+    }
+  }
+  timing->copy += WallSeconds() - scored;
+}
+
+// Score one row in the thread of the caller
+real_t Solver::ScoreRow(const SparseRow* row, real_t norm) {
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  CHECK(served != nullptr);
+  if (metrics_on_.load(std::memory_order_acquire)) {
+    double begin = WallSeconds();
+    real_t pred = score_row(*served, row, norm);
+    observe_predict(metrics_.score_row_latency, begin, 1);
+    return pred;
+  }
+  return score_row(*served, row, norm);
+}
+
+// Add the latency since the beginning and the rows
+// of one call to the metrics of the predictions
+void Solver::observe_predict(StatHistogram* latency,
+                             double begin,
+                             index_t num_row) {
+  latency->Observe(WallSeconds() - begin);
+  metrics_.predict_rows->Add(num_row);
+  refresh_metrics();
+}
+
+// The rows of the caller are renumbered by the feature map of
+// the model in the copy, and they are returned if there is no map.
+const DMatrix* Solver::map_rows(const Model& model,
+                                const DMatrix* matrix,
+                                DMatrix* copy) {
+  if (model.GetFeatureMap().empty() && model.GetFieldMap().empty()) {
+    return matrix;
+  }
+  copy->CopyFrom(matrix);
+  model.MapFeatures(copy);
+  return copy;
+}
+
+const SparseRow* Solver::map_row(const Model& model,
+                                 const SparseRow* row,
+                                 SparseRow* copy) {
+  if (model.GetFeatureMap().empty() && model.GetFieldMap().empty()) {
+    return row;
+  }
+  copy->assign(row->begin(), row->end());
+  model.MapFeatures(copy);
+  return copy;
+}
+
+// Score the rows of the matrix in the thread of the caller
+void Solver::ScoreRows(const DMatrix* matrix, real_t* out) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(out);
+  // All of the rows are scored by the same version
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  CHECK(served != nullptr);
+  bool metrics = metrics_on_.load(std::memory_order_acquire);
+  double begin = metrics ? WallSeconds() : 0;
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    out[i] = score_row(*served, matrix->row[i], matrix->norm[i]);
+  }
+  if (metrics) {
+    observe_predict(metrics_.score_rows_latency, begin, matrix->row_length);
+  }
+}
+
+// Rank the candidates of one request in the thread of the caller
+void Solver::RankCandidates(const SparseRow* context,
+                            const DMatrix* candidates,
+                            real_t* out) {
+  CHECK_NOTNULL(context);
+  CHECK_NOTNULL(candidates);
+  CHECK_NOTNULL(out);
+  std::shared_ptr<Served> served = std::atomic_load(&served_);
+  CHECK(served != nullptr);
+  bool metrics = metrics_on_.load(std::memory_order_acquire);
+  double begin = metrics ? WallSeconds() : 0;
+  static thread_local SparseRow mapped_context;
+  DMatrix mapped;
+  context = map_row(*served->model, context, &mapped_context);
+  candidates = map_rows(*served->model, candidates, &mapped);
+  served->loss->PredictCandidates(context, candidates,
+                                  *served->model, out);
+  for (index_t i = 0; i < candidates->row_length; ++i) {
+    out[i] = convert_output(out[i]);
+  }
+  if (metrics) {
+    observe_predict(metrics_.rank_latency, begin, candidates->row_length);
+  }
+}
+
+// Score one row by the given version of the model
+real_t Solver::score_row(const Served& served,
+                         const SparseRow* row,
+                         real_t norm) {
+  // The key of each thread keeps its memory for the next call
+  static thread_local ResultCache::Key key;
+  real_t pred = 0;
+  if (served.cache != nullptr) {
+    ResultCache::RowKey(row, norm, &key);
+    if (served.cache->Get(key, &pred)) { return convert_output(pred); }
+  }
+  // The row of each thread keeps its memory for the next call
+  static thread_local SparseRow mapped;
+  row = map_row(*served.model, row, &mapped);
+  pred = served.loss->PredictRow(row, *served.model, norm);
+  if (served.cache != nullptr) { served.cache->Put(key, pred); }
+  return convert_output(pred);
+}
+
+// Convert the prediction by --sigmoid or --sign
+real_t Solver::convert_output(real_t pred) {
+  if (hyper_param_.sigmoid) {
+    return polysigmoid(pred);
+  } else if (hyper_param_.sign) {
+    return pred > 0 ? 1 : 0;
+  }
+  return pred;
+}
+
+// Release the loaded model
+void Solver::UnloadModel() {
+  WaitReload();
+  if (!IsLoaded()) { return; }
+  std::atomic_store(&served_, std::shared_ptr<Served>());
+  // The optimizer of PartialFit()
+  delete loss_;
+  delete score_;
+  loss_ = nullptr;
+  score_ = nullptr;
+  delete pool_;
+  pool_ = nullptr;
+}
+
+// The waiting requests of the batcher are finished
+// before the model is deleted
+Solver::Served::~Served() {
+  delete batcher;
+  delete cache;
+  delete loss;
+  delete score;
+  delete model;
 }
 
 } // namespace xLearn
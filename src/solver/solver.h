@@ -21,20 +21,34 @@ This file defines the Solver class, which is the entry of the xLearn.
 #ifndef XLEARN_SOLVER_SOLVER_H_
 #define XLEARN_SOLVER_SOLVER_H_
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
 #include "src/base/common.h"
+#include "src/base/perf_counter.h"
+#include "src/base/stats_registry.h"
 #include "src/base/thread_pool.h"
 #include "src/data/hyper_parameters.h"
 #include "src/data/data_structure.h"
+#include "src/data/feature_stats.h"
+#include "src/data/field_index.h"
+#include "src/distributed/metrics_server.h"
 #include "src/data/model_parameters.h"
 #include "src/reader/reader.h"
 #include "src/reader/parser.h"
-#include "src/reader/file_splitor.h"
 #include "src/score/score_function.h"
 #include "src/loss/loss.h"
 #include "src/loss/metric.h"
 #include "src/solver/checker.h"
 #include "src/solver/trainer.h"
 #include "src/solver/inference.h"
+#include "src/solver/batch_scorer.h"
+#include "src/solver/result_cache.h"
+#include "src/solver/sweep.h"
+#include "src/solver/autotune.h"
+#include "src/solver/line_source.h"
 
 namespace xLearn {
 //------------------------------------------------------------------------------
@@ -54,15 +68,31 @@ class Solver {
  public:
   // Constructor and Destructor
   Solver() 
-    : score_(nullptr),
+    : model_(nullptr),
+      cv_data_(nullptr),
+      score_(nullptr),
       loss_(nullptr),
-      metric_(nullptr) { }
-  ~Solver() { }
+      metric_(nullptr),
+      train_metric_(nullptr),
+      pool_(nullptr),
+      out_buffer_(nullptr),
+      out_length_(0),
+      num_result_(0),
+      version_(0) { }
+  ~Solver() { UnloadModel(); }
 
   // Ser train or predict
   void SetTrain() { hyper_param_.is_train = true; }
   void SetPredict() { hyper_param_.is_train = false; }
 
+  // Train online (see xlearn_online): StartWork() reads the lines of
+  // the source of train_set_file as they arrive, trains each piece of
+  // them by PartialFit(), and publishes the model every publish_seconds.
+  void SetOnline() {
+    hyper_param_.is_train = true;
+    hyper_param_.online = true;
+  }
+
   // Initialize the xLearn environment, including checking
   // and parsing the commad line arguments, reading problem
   // (training data or testing data), initialize model, loss, 
@@ -78,11 +108,157 @@ class Solver {
   void StartWork();
 
   // Get reaults, only for predict
-  inline std::vector<real_t> GetResult() { return this->out_; }
+  inline std::vector<real_t>& GetResult() { return this->out_; }
+
+  // Write the results of the next prediction to the buffer of
+  // the caller (e.g., a numpy array) instead of GetResult(), which
+  // has length values. GetNumResult() is the number of rows, and
+  // the rows beyond the length are not written.
+  void SetOutputBuffer(real_t* out, size_t length) {
+    out_buffer_ = out;
+    out_length_ = length;
+  }
+  inline size_t GetNumResult() { return num_result_; }
 
   // Clear the xLearn environment.
   void Clear();
 
+  // The statistics of the thread pool of the last training,
+  // which are kept after Clear().
+  const ThreadPoolStats& GetThreadStats() const { return thread_stats_; }
+
+  // Load the model once for the following Predict() calls.
+  // The model, the score, the loss and the thread pool stay
+  // resident until UnloadModel(), so each call only scores the
+  // given rows. This function is used by the loaded model of
+  // c_api, and it does not read any test data.
+  void LoadModel(HyperParam& hyper_param);
+
+  // Same as LoadModel(), but the given model (e.g., the one of
+  // ReleaseModel()) is served instead of model_file, which is
+  // deleted by UnloadModel().
+  void LoadModel(HyperParam& hyper_param, Model* model);
+
+  // Take the model of the last training, which is not deleted by
+  // Clear(), so it can be passed to LoadModel() without a model
+  // file. The lazy features are initialized before it returns.
+  Model* ReleaseModel();
+
+  // Train the loaded model with one pass over the rows of the matrix,
+  // and return the training loss of them. The model, its optimizer
+  // state (the gradient cache) and the thread pool stay resident for
+  // the next mini-batch, and the new feature ids of the matrix grow
+  // the model (see Model::Grow) unless the ids are hashed (-hash).
+  // If no model is loaded, the first call creates a new one by the
+  // hyper-parameters (or from pre_model_file), which is sized by the
+  // matrix. The optimizer follows the hyper-parameters of the first
+  // call or LoadModel(), so the loaded model must be a checkpoint of
+  // the same optimizer. It must not be called with the predictions.
+  real_t PartialFit(HyperParam& hyper_param, const DMatrix* matrix);
+
+  // Return the number of the parameter and its optimizer state of
+  // each weight, which is 0 for an unknown optimizer.
+  static index_t AuxiliarySize(const std::string& opt_type,
+                               const std::string& opt_state = "fp32");
+
+  // Return the loaded model, which is valid until the next
+  // ReloadModel() or UnloadModel().
+  Model* GetLoadedModel();
+
+  // Predict the rows of the matrix by the loaded model, and
+  // write the matrix->row_length outputs to out, which are
+  // converted by --sigmoid or --sign. Many threads can call it
+  // at the same time, and the calls within batch_window are
+  // predicted in one batch if the micro-batching is enabled.
+  void Predict(const DMatrix* matrix, real_t* out);
+
+  // The phases of the latency of each Predict() call: the wait in
+  // the queue of the micro-batching (only with batch_window), the
+  // scoring of the rows (with the cache and the feature map), the
+  // copy of the results to out (with --sigmoid), and the whole call.
+  enum PredictPhase {
+    kPhaseQueue = 0,
+    kPhaseScore = 1,
+    kPhaseCopy = 2,
+    kPhaseTotal = 3,
+    kNumPredictPhase = 4
+  };
+
+  // The latency histogram of the phase, which is kept since
+  // LoadModel() or its last reset by the caller, e.g., to
+  // read the p99 of each interval (see XLearnGetPredictLatency).
+  LatencyHistogram* GetPredictLatency(PredictPhase phase) {
+    return &predict_latency_[phase];
+  }
+
+  // Score one row by the loaded model in the thread of the
+  // caller, without the round trip to the thread pool, which
+  // is the low-latency path of online serving. The norm of the
+  // row is only used by -norm. Like Predict(), ScoreRow() and
+  // ScoreRows() can be called by many threads at the same time.
+  // If result_cache is set, the three of them take the scores of
+  // the repeated rows from the cache of the served version.
+  real_t ScoreRow(const SparseRow* row, real_t norm = 1.0);
+
+  // Same as ScoreRow(), but all of the rows of the matrix are
+  // scored in order, and the row_length outputs are written to out.
+  void ScoreRows(const DMatrix* matrix, real_t* out);
+
+  // Rank the candidates of one request by the loaded model in the
+  // thread of the caller. Each row of the candidates is scored as
+  // the context features plus its own features, but the part of the
+  // context is computed only once, so fm costs O(candidate_nnz * K)
+  // for each candidate, and ffm skips the pairs of the context and
+  // uses the sums of each context field (see FFMScore::CalcContext).
+  // The row_length outputs are written to out.
+  void RankCandidates(const SparseRow* context,
+                      const DMatrix* candidates,
+                      real_t* out);
+
+  // Create the on-disk reader of a test file for the loaded model,
+  // which returns the rows in blocks of -block MB, and its loader
+  // thread parses the next blocks while the caller predicts and
+  // writes the results of this one, so a file of any size is
+  // predicted by Predict() in the memory of a few blocks (see
+  // XLearnPredictOpen). The rows are renumbered by Predict(), and
+  // the caller deletes the reader.
+  Reader* CreatePredictReader(const std::string& filename);
+
+  // Load a new version of the model from the file, and swap it in
+  // atomically while the old version is still serving. The running
+  // predictions keep the version they started with, and the old
+  // version is deleted after the last of them is done (RCU-style).
+  // If background is true, the model is loaded in a background
+  // thread, and this function returns at once. The reloaded model
+  // uses the options of LoadModel().
+  void ReloadModel(const std::string& filename,
+                   bool background = false);
+
+  // Wait for the reload in the background.
+  void WaitReload();
+
+  // Apply the delta file of the online training (see -delta) to the
+  // loaded model in place, which only writes the changed features, and
+  // clear the cached scores of the served version. Return false if the
+  // loaded model is not the base version of the delta, or it cannot be
+  // written in place (see Model::ApplyDelta), and then the caller loads
+  // the whole model by ReloadModel(). It must not be called at the
+  // same time as ReloadModel().
+  bool ApplyDelta(const std::string& filename);
+
+  // Return the version of the loaded model, which is increased by
+  // each LoadModel() or ReloadModel(), and 0 if it is not loaded.
+  uint64 GetModelVersion();
+
+  // Release the loaded model, which must not be called
+  // with the running predictions.
+  void UnloadModel();
+
+  // Return true if the model is loaded by LoadModel().
+  inline bool IsLoaded() {
+    return std::atomic_load(&served_) != nullptr;
+  }
+
  protected:
   /* Global hyper-parameters */
   xLearn::HyperParam hyper_param_;
@@ -92,39 +268,315 @@ class Solver {
   xLearn::Model* model_;
   /* One Reader corresponds one data file */
   std::vector<xLearn::Reader*> reader_;
-  /* Split file in cross-validation */
-  xLearn::FileSpliter splitor_;
+  /* The training data of cross-validation, which
+  is parsed once and shared by the fold readers */
+  xLearn::InmemReader* cv_data_;
   /* linear, fm or ffm ? */
   xLearn::Score* score_;
   /* cross-entropy or squared ? */
   xLearn::Loss* loss_;
   /* acc, prec, recall, mae, etc */
   xLearn::Metric* metric_;
+  /* The same metric for the training data (--train-metric) */
+  xLearn::Metric* train_metric_;
+  /* The parameter server of distributed training (-ps_hosts),
+  where this node keeps a shard in server_ and trains by store_ */
+  std::unique_ptr<xLearn::ParameterServer> server_;
+  std::unique_ptr<xLearn::KVStore> store_;
+  /* The ring of the nodes of --allreduce, instead of the server */
+  std::unique_ptr<xLearn::RingAllReduce> ring_;
+  /* The shared memory of the processes of -shm, where model_ is */
+  std::unique_ptr<xLearn::SharedModel> shared_;
+  /* The count of the features of each block of kCountBlock ids in
+  the training data, for -ps_partition balanced */
+  std::vector<double> feature_count_;
+  /* The counts of the features of the training data, for
+  -feat_stats, which also give the hot features of the model */
+  FeatureStats feature_stats_;
+  /* The pairs of (feature, target field) of the training
+  data for --sparse-ffm, which is empty without it */
+  FieldIndex field_index_;
+  /* The new id of each feature of --remap or -min_count, and the
+  original id of each new id of --remap, which are empty without it */
+  std::vector<index_t> feature_map_;
+  std::vector<index_t> feature_order_;
+  /* The new id of each field of --remap-fields, which is empty
+  without it or if the fields of the training data are dense */
+  std::vector<index_t> field_map_;
+  /* The other models of an ensemble of prediction, which are
+  given by a list of model files, and their scores and losses */
+  std::vector<std::unique_ptr<xLearn::Model>> ensemble_model_;
+  std::vector<std::unique_ptr<xLearn::Score>> ensemble_score_;
+  std::vector<std::unique_ptr<xLearn::Loss>> ensemble_loss_;
+  /* The models of the other tasks of -num_label, and
+  their scores and losses */
+  std::vector<std::unique_ptr<xLearn::Model>> task_model_;
+  std::vector<std::unique_ptr<xLearn::Score>> task_score_;
+  std::vector<std::unique_ptr<xLearn::Loss>> task_loss_;
   /* ThreadPool for multi-thread training */
   ThreadPool* pool_;
+  /* The hardware counters of --perf, which are opened
+  before pool_, so its threads are counted too */
+  std::unique_ptr<PerfCounters> perf_;
+  /* The statistics of pool_ in the last training */
+  ThreadPoolStats thread_stats_;
+  /* The estimate of the memory of the training (bytes) */
+  struct MemoryUsage {
+    uint64 model = 0;
+    /* The copy of the best model of early-stopping */
+    uint64 best_model = 0;
+    /* The matrices of the readers, and the text
+    blocks of the on-disk readers */
+    uint64 data = 0;
+    /* The data is estimated by the first blocks of the files */
+    bool sampled = false;
+    /* Bytes of the parsed blocks that each on-disk reader keeps
+    (-block_cache), in the order of the files */
+    std::vector<uint64> block_cache;
+    /* Bytes of -mem that each on-disk reader has for its text
+    block and parsed blocks (--auto-block), in the order of the files */
+    std::vector<uint64> block_memory;
+  } memory_;
+  /* The cpus of the threads of pool_, which is
+  empty if the threads are not pinned */
+  std::vector<int> cpus_;
   /* predict results */
   std::vector<real_t> out_;
+  /* The buffer of the caller for the predict results */
+  real_t* out_buffer_;
+  size_t out_length_;
+  size_t num_result_;
+  /* One version of the model loaded by LoadModel() */
+  struct Served {
+    Served()
+      : model(nullptr), score(nullptr), loss(nullptr),
+        batcher(nullptr), cache(nullptr), version(0) { }
+    ~Served();
+    xLearn::Model* model;
+    xLearn::Score* score;
+    xLearn::Loss* loss;
+    /* Micro-batching of the Predict() calls, which
+    is nullptr if batch_window is 0 */
+    xLearn::BatchScorer* batcher;
+    /* The scores of the recent rows of this version, which
+    is nullptr if result_cache is 0 */
+    xLearn::ResultCache* cache;
+    uint64 version;
+  };
+  /* The version used by the new predictions, which is read
+  and swapped by std::atomic_load() and std::atomic_store() */
+  std::shared_ptr<Served> served_;
+  /* Number of the loaded versions */
+  uint64 version_;
+  /* The thread of ReloadModel() in the background */
+  std::thread reload_thread_;
+  /* The metrics of -metrics, which are served by metrics_server_.
+  The series are created once by start_metrics(), and the threads
+  of the training and the predictions only update them if
+  metrics_on_ is set */
+  StatsRegistry stats_;
+  MetricsServer metrics_server_;
+  std::atomic<bool> metrics_on_{false};
+  struct Metrics {
+    StatCounter* train_rows = nullptr;
+    StatCounter* train_nnz = nullptr;
+    /* Nanoseconds of the phases of the online training */
+    StatCounter* read_ns = nullptr;
+    StatCounter* parse_ns = nullptr;
+    StatCounter* train_ns = nullptr;
+    StatCounter* publish_ns = nullptr;
+    StatCounter* predict_rows = nullptr;
+    StatHistogram* predict_latency = nullptr;
+    StatHistogram* score_row_latency = nullptr;
+    StatHistogram* score_rows_latency = nullptr;
+    StatHistogram* rank_latency = nullptr;
+    StatGauge* pending_bytes = nullptr;
+    StatGauge* model_bytes = nullptr;
+    StatGauge* resident_bytes = nullptr;
+    StatGauge* pool_threads = nullptr;
+    StatGauge* pool_busy = nullptr;
+    StatGauge* model_version = nullptr;
+  } metrics_;
+  /* The latency of the phases of Predict(), which is always kept */
+  LatencyHistogram predict_latency_[kNumPredictPhase];
+  /* The last time (seconds) that refresh_metrics() set the gauges */
+  std::atomic<double> metrics_time_{0};
 
   // Create object by name
   xLearn::Reader* create_reader();
   xLearn::Score* create_score();
   xLearn::Loss* create_loss();
   xLearn::Metric* create_metric();
+  xLearn::Metric* create_metric(const std::string& name);
+
+  // Create the model with the memory policy, and load
+  // it from the checkpoint file if filename is not empty.
+  // The model uses the pool to touch its memory, which is
+  // pool_ if it is nullptr.
+  xLearn::Model* create_model(const std::string& filename = "",
+                              ThreadPool* pool = nullptr);
+
+  // Create the objects of training by the hyper-parameters
+  std::vector<xLearn::Reader*> create_folds();
+  xLearn::Model* init_model(ThreadPool* pool);
+  void grow_model(xLearn::Model* model);
+  xLearn::Score* init_score();
+  xLearn::Loss* init_loss(xLearn::Score* score, ThreadPool* pool);
 
   // xLearn command line logo
   void print_logo() const;
 
+  // Return the number of threads given by -nthread, or the default
+  // one of the cpus that xLearn can use (see DefaultThreadNumber)
+  size_t thread_number();
+
+  // Return the cpus of the threads given by -affinity
+  std::vector<int> thread_cpus(size_t threadNumber);
+
   // Initialize function
   void init_train();
+  void init_tasks();
   void init_predict();
+  void load_model(Model* model = nullptr);
+  void load_ensemble();
+  void init_predict_pool();
+  // Time the configurations of --autotune on a sample of the
+  // training data, and keep the fastest one for the training
+  void autotune();
+  // Serve the metrics at -metrics if it is not zero
+  void start_metrics();
+  // Reset the latency histograms of Predict()
+  void reset_predict_latency();
+  // Set the gauges of the model, the memory and the threads,
+  // at most once per second
+  void refresh_metrics();
+  void observe_predict(StatHistogram* latency,
+                       double begin,
+                       index_t num_row);
+  // Predict() without the metrics, which sets the
+  // seconds of the phases of the call to timing
+  void predict(const DMatrix* matrix, real_t* out,
+               PredictTiming* timing);
+  xLearn::Reader* create_test_reader(const std::string& filename);
+  xLearn::Loss* init_predict_loss();
+  std::shared_ptr<Served> load_served(Model* model = nullptr);
+  // Renumber the rows of the caller in the copy by the feature
+  // map of the model, or return the rows if it has no map.
+  static const DMatrix* map_rows(const Model& model,
+                                 const DMatrix* matrix,
+                                 DMatrix* copy);
+  static const SparseRow* map_row(const Model& model,
+                                  const SparseRow* row,
+                                  SparseRow* copy);
+
+  real_t score_row(const Served& served,
+                   const SparseRow* row,
+                   real_t norm);
+  real_t convert_output(real_t pred);
   void init_log();
   void checker(int argc, char* argv[]);
   void checker(HyperParam& hyper_param);
 
   // Start function
   void start_train_work();
+  void start_online_work();
   void start_prediction_work();
 
+  // Predict the test files of a list at the same time
+  void predict_files();
+
+  // Build the pair tables of the ffm model from the test set
+  void build_pair_table();
+
+  // Train the folds of cross-validation at the same time
+  void parallel_cv(Trainer& trainer);
+
+  // Train the configurations of -sweep over the same data,
+  // and return the model of the best one.
+  xLearn::Model* train_sweep(int epoch, bool early_stop, int stop_window);
+
+  // Drop the small latent vectors of the model by -prune.
+  void prune_model(Model* model);
+
+  // Save the model to the files of -m, -t and -im.
+  void save_models(Model* model,
+                   bool save_model,
+                   bool save_txt_model,
+                   bool save_inference_model);
+
+  // Save the models of the other tasks of -num_label.
+  void save_tasks();
+
+  // Keep the statistics of pool_ after the training, and print
+  // them with --profile.
+  void show_thread_stats();
+
+  // Estimate the memory of the data of the files by their first
+  // blocks, and choose the on-disk reader and its block size if
+  // the training does not fit in the memory budget (-mem).
+  void estimate_data(const std::vector<std::string>& files);
+
+  // Bytes of the model of the hyper-parameters, and of its copy
+  // of early-stopping, for the given features and fields.
+  void estimate_model(index_t num_feature, index_t num_field);
+
+  // Print the estimate of the memory before the model is created,
+  // or the peak RSS after the training (peak == true), which is
+  // split into the estimate and the rest.
+  void show_memory(bool peak);
+
+  // Start and stop the node of distributed training
+  void init_dist(index_t* max_field);
+  void init_server();
+  void init_shard();
+  void finish_dist();
+
+  // Connect the processes of -shm, and move the model to the
+  // shared memory, which is copied by the process of rank 0.
+  void init_shared(index_t* max_field);
+  void share_model();
+
+  // Count the features for -ps_partition balanced.
+  void count_features(const DMatrix* matrix);
+
+  // Print and save the counts of -feat_stats.
+  void show_feature_stats();
+
+  // Renumber the features of the readers and model_ by their
+  // frequency for --remap.
+  void remap_features();
+
+  // Renumber the fields of the readers in the order of their ids for
+  // --remap-fields, where used[f] is 1 if the field f is in the
+  // training data, and num_field becomes the number of them.
+  void remap_fields(const std::vector<uint8>& used);
+
+  // Lock the head of the model file of -param_file in the
+  // memory of -param_mem.
+  void lock_model();
+
+  // Share one id of the model by the rare features for -min_count.
+  void compact_features();
+
+  // Share one latent block of the field index by the target fields
+  // of each rare feature for -share_count.
+  void share_features();
+
+  // Copy the sample of -valid_sample of the validation reader to
+  // the matrix, and return the reader of it.
+  xLearn::Reader* sample_validation(DMatrix* sample);
+
+  // MB of the first block of a file that estimates its data
+  static const size_t kSampleMB = 8;
+
+  // The ids of a block of feature_count_, and the max number of
+  // the blocks of the balanced partition.
+  static const index_t kCountBlock = 1024;
+  static const index_t kMaxBlock = 65536;
+
+  // Number of the features in the summary of -feat_stats.
+  static const size_t kNumTopFeature = 10;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Solver);
 };
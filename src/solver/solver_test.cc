@@ -0,0 +1,215 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the prediction of the Solver class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/thread_pool.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/squared_loss.h"
+#include "src/reader/reader.h"
+#include "src/score/fm_score.h"
+#include "src/solver/solver.h"
+
+namespace xLearn {
+
+const std::string kTestFile = "./solver_test.txt";
+const std::string kOutFile = "./solver_test.out";
+
+// Four rows of the features 0 ~ 3
+void write_test_file() {
+  std::ofstream file(kTestFile);
+  file << "1 0:1 2:2\n"
+       << "0 1:1 3:0.5\n"
+       << "1 0:0.5 1:2 2:1\n"
+       << "0 3:3\n";
+}
+
+const real_t kTestRows[4][4] = { { 1, 0, 2, 0 },
+                                 { 0, 1, 0, 0.5 },
+                                 { 0.5, 2, 1, 0 },
+                                 { 0, 0, 0, 3 } };
+
+// Save a linear model of the weights and the bias, whose features
+// are renumbered by map if it is not empty.
+void write_linear(const std::string& filename,
+                  const std::vector<real_t>& weights,
+                  real_t bias,
+                  const std::vector<index_t>& map = {}) {
+  Model model;
+  model.Initialize("linear", "squared", weights.size(), 0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  for (size_t j = 0; j < weights.size(); ++j) { w[j*2] = weights[j]; }
+  model.GetParameter_b()[0] = bias;
+  if (!map.empty()) { model.SetFeatureMap(map); }
+  model.Serialize(filename);
+}
+
+// The score of row i of the test file by the linear model
+real_t linear_score(const std::vector<real_t>& weights,
+                    real_t bias, int i) {
+  real_t score = bias;
+  for (size_t j = 0; j < weights.size(); ++j) {
+    score += weights[j] * kTestRows[i][j];
+  }
+  return score;
+}
+
+// Run xlearn_predict with the arguments after the program
+void predict(const std::vector<std::string>& args) {
+  std::vector<std::string> cmd = { "xlearn_predict" };
+  cmd.insert(cmd.end(), args.begin(), args.end());
+  std::vector<char*> argv;
+  for (size_t i = 0; i < cmd.size(); ++i) {
+    argv.push_back(&cmd[i][0]);
+  }
+  Solver solver;
+  solver.SetPredict();
+  solver.Initialize(argv.size(), argv.data());
+  solver.StartWork();
+  solver.Clear();
+}
+
+// The tab-separated columns of each line of the output file
+std::vector<std::vector<real_t>> read_output() {
+  std::vector<std::vector<real_t>> lines;
+  std::ifstream file(kOutFile);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream cols(line);
+    std::vector<real_t> values;
+    real_t value;
+    while (cols >> value) { values.push_back(value); }
+    lines.push_back(values);
+  }
+  return lines;
+}
+
+TEST(SolverTest, Predict_ensemble_blend) {
+  write_test_file();
+  const std::vector<real_t> w_a = { 1, 2, 3, 4 };
+  const std::vector<real_t> w_b = { -0.5, 0.25, 1, 2 };
+  write_linear("./solver_test_a.model", w_a, 0.5);
+  write_linear("./solver_test_b.model", w_b, -1);
+  predict({ kTestFile, "./solver_test_a.model,./solver_test_b.model",
+            "-o", kOutFile, "-blend", "0.25,0.75", "-nthread", "2",
+            "--no-norm" });
+  std::vector<std::vector<real_t>> lines = read_output();
+  ASSERT_EQ(lines.size(), 4);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(lines[i].size(), 3);
+    real_t a = linear_score(w_a, 0.5, i);
+    real_t b = linear_score(w_b, -1, i);
+    EXPECT_NEAR(lines[i][0], a, 1e-4);
+    EXPECT_NEAR(lines[i][1], b, 1e-4);
+    EXPECT_NEAR(lines[i][2], 0.25 * a + 0.75 * b, 1e-4);
+  }
+  // The rows are renumbered by the maps of the first model,
+  // so the model of other maps is rejected
+  write_linear("./solver_test_b.model", w_b, -1, { 3, 2, 1, 0 });
+  EXPECT_EXIT(predict({ kTestFile,
+                        "./solver_test_a.model,./solver_test_b.model",
+                        "-o", kOutFile, "--no-norm" }),
+              ::testing::ExitedWithCode(0), "");
+  RemoveFile("./solver_test_a.model");
+  RemoveFile("./solver_test_b.model");
+  RemoveFile(kTestFile.c_str());
+  RemoveFile(kOutFile.c_str());
+}
+
+// The predictions of the model file for the test file by the
+// in-memory reader, which writes no cache
+std::vector<real_t> predict_in_memory(const std::string& model_file) {
+  Model model;
+  EXPECT_TRUE(model.Deserialize(model_file));
+  InmemReader reader;
+  reader.SetNoBin();
+  reader.Initialize(kTestFile);
+  reader.SetShuffle(false);
+  ThreadPool pool(2);
+  FMScore score;
+  SquaredLoss loss;
+  loss.Initialize(&score, &pool, false);
+  std::vector<real_t> pred, out;
+  DMatrix* matrix = nullptr;
+  for (;;) {
+    index_t num_rows = reader.Samples(matrix);
+    if (num_rows == 0) { break; }
+    out.resize(num_rows);
+    loss.Predict(matrix, model, out);
+    pred.insert(pred.end(), out.begin(), out.end());
+  }
+  return pred;
+}
+
+// The test file is streamed by the on-disk reader. It writes no cache
+// of the text by default, reads a valid cache, and writes the cache
+// with --disk. Each gives the predictions of the in-memory reader.
+TEST(SolverTest, Predict_test_reader) {
+  write_test_file();
+  const std::string model_file = "./solver_test_fm.model";
+  const std::string cache_file = kTestFile + ".disk.bin";
+  Model model;
+  model.Initialize("fm", "squared", 4, 0, 4, 1);
+  model.Serialize(model_file);
+  std::vector<real_t> expect = predict_in_memory(model_file);
+  ASSERT_EQ(expect.size(), 4);
+  std::vector<std::string> args = { kTestFile, model_file, "-o", kOutFile,
+                                    "--no-norm", "-nthread", "2" };
+  auto check_output = [&]() {
+    std::vector<std::vector<real_t>> lines = read_output();
+    ASSERT_EQ(lines.size(), expect.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+      ASSERT_EQ(lines[i].size(), 1);
+      EXPECT_NEAR(lines[i][0], expect[i], 1e-4);
+    }
+  };
+  // The text is streamed, and no cache is written
+  if (FileExist(cache_file.c_str())) { RemoveFile(cache_file.c_str()); }
+  predict(args);
+  check_output();
+  EXPECT_FALSE(FileExist(cache_file.c_str()));
+  EXPECT_FALSE(FileExist((kTestFile + ".bin").c_str()));
+  // --disk writes the cache
+  std::vector<std::string> disk_args = args;
+  disk_args.push_back("--disk");
+  predict(disk_args);
+  check_output();
+  EXPECT_TRUE(FileExist(cache_file.c_str()));
+  // The cache is read instead of the text
+  RemoveFile(kOutFile.c_str());
+  testing::internal::CaptureStdout();
+  predict(args);
+  std::string log = testing::internal::GetCapturedStdout();
+  EXPECT_NE(log.find("Binary cache (" + cache_file + ") found"),
+            std::string::npos);
+  check_output();
+  RemoveFile(model_file.c_str());
+  RemoveFile(cache_file.c_str());
+  RemoveFile(kTestFile.c_str());
+  RemoveFile(kOutFile.c_str());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the configurations of the -sweep option, which
+are trained over the same data (see Solver::train_sweep).
+*/
+
+#ifndef XLEARN_SOLVER_SWEEP_H_
+#define XLEARN_SOLVER_SWEEP_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/parse_number.h"
+#include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+// A configuration of the sweep, which is the -k, -r
+// and -b options of a model.
+struct SweepConfig {
+  index_t num_K;
+  real_t learning_rate;
+  real_t regu_lambda;
+};
+
+// Parse the grid of the sweep, e.g., "k=4,8:r=0.1,0.2:b=0.00002",
+// where each item is a list of the values of -k, -r or -b, and the
+// option that is not in the grid keeps the value of the task. The
+// configurations are all the combinations in the order of k, r
+// and b. Return false for an invalid grid.
+inline bool ParseSweep(const std::string& grid,
+                       const SweepConfig& base,
+                       std::vector<SweepConfig>* configs) {
+  CHECK_NOTNULL(configs);
+  configs->clear();
+  std::vector<index_t> k_list(1, base.num_K);
+  std::vector<real_t> r_list(1, base.learning_rate);
+  std::vector<real_t> b_list(1, base.regu_lambda);
+  bool has_k = false, has_r = false, has_b = false;
+  std::vector<std::string> items;
+  SplitStringUsing(grid, ":", &items);
+  if (items.empty()) { return false; }
+  for (size_t i = 0; i < items.size(); ++i) {
+    size_t pos = items[i].find('=');
+    if (pos == std::string::npos) { return false; }
+    std::string name = items[i].substr(0, pos);
+    std::vector<std::string> values;
+    SplitStringUsing(items[i].substr(pos + 1), ",", &values);
+    if (values.empty()) { return false; }
+    if (name == "k" && !has_k) {
+      has_k = true;
+      k_list.clear();
+      for (const std::string& str : values) {
+        index_t k = 0;
+        if (!ParseUint32(str.data(), str.data() + str.size(), &k) ||
+            k == 0) {
+          return false;
+        }
+        k_list.push_back(k);
+      }
+    } else if ((name == "r" && !has_r) || (name == "b" && !has_b)) {
+      bool rate = name == "r";
+      std::vector<real_t>* list = rate ? &r_list : &b_list;
+      (rate ? has_r : has_b) = true;
+      list->clear();
+      for (const std::string& str : values) {
+        real_t value = 0;
+        if (!ParseFloat(str.data(), str.data() + str.size(), &value) ||
+            value < 0 || (rate && value == 0)) {
+          return false;
+        }
+        list->push_back(value);
+      }
+    } else {  // unknown or repeated
+      return false;
+    }
+  }
+  for (index_t k : k_list) {
+    for (real_t r : r_list) {
+      for (real_t b : b_list) {
+        configs->push_back({ k, r, b });
+      }
+    }
+  }
+  return true;
+}
+
+// The name of a configuration, e.g., "k=4, r=0.1, b=2e-05".
+inline std::string SweepName(const SweepConfig& config) {
+  return StringPrintf("k=%u, r=%g, b=%g", config.num_K,
+                      config.learning_rate, config.regu_lambda);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_SWEEP_H_
@@ -19,15 +19,132 @@ This file is the implementation of the Trainer class.
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
 #include <vector>
 #include <string>
 
 #include "src/solver/trainer.h"
 #include "src/data/data_structure.h"
 #include "src/base/timer.h"
+#include "src/base/trace.h"
 
 namespace xLearn {
 
+static const char* kPhaseName[] = {
+  "read", "grad", "predict", "metric", "sync"
+};
+
+/*********************************************************
+ *  Time the phases of the epochs                        *
+ *********************************************************/
+void Trainer::SetProfile(bool show,
+                         const std::string& file,
+                         ThreadPool* pool) {
+  show_profile_ = show;
+  profile_file_ = file;
+  profile_pool_ = pool;
+  profile_ = show || !file.empty();
+  if (profile_out_ != nullptr) {
+    fclose(profile_out_);
+    profile_out_ = nullptr;
+  }
+  if (!file.empty()) {
+    profile_out_ = fopen(file.c_str(), "w");
+    if (profile_out_ == nullptr) {
+      Color::print_error(
+        StringPrintf("Cannot open the profile file: %s", file.c_str())
+      );
+      exit(0);
+    }
+  }
+}
+
+void Trainer::count_rows(const DMatrix* matrix) {
+  if (!profile_) { return; }
+  epoch_rows_ += matrix->row_length;
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    epoch_nnz_ += matrix->row[i]->size();
+  }
+}
+
+// The instructions per cycle, and the misses of LLC and dTLB per
+// thousand instructions (MPKI). A low IPC with many misses is the
+// phase that waits for the memory, and a high IPC is the compute.
+std::string Trainer::perf_info(const PhaseTime& time) {
+  if (time.perf == nullptr) { return ""; }
+  std::string str;
+  double cycles = time.events[kPerfCycles];
+  double instructions = time.events[kPerfInstructions];
+  if (time.perf->IsOpen(kPerfCycles) && cycles > 0 &&
+      time.perf->IsOpen(kPerfInstructions)) {
+    str += StringPrintf(", ipc %.2f", instructions / cycles);
+  }
+  if (time.perf->IsOpen(kPerfInstructions) && instructions > 0) {
+    if (time.perf->IsOpen(kPerfLLCMisses)) {
+      str += StringPrintf(", llc mpki %.2f",
+               time.events[kPerfLLCMisses] * 1000 / instructions);
+    }
+    if (time.perf->IsOpen(kPerfDTLBMisses)) {
+      str += StringPrintf(", dtlb mpki %.2f",
+               time.events[kPerfDTLBMisses] * 1000 / instructions);
+    }
+  }
+  return str;
+}
+
+// The time of the rest of the epoch (e.g., the checkpoint and the
+// early-stopping) is the wall time minus the phases.
+void Trainer::show_profile(int epoch, double wall, double train_wall) {
+  double pool_wait = profile_pool_ == nullptr ?
+                     0 : profile_pool_->WaitTime();
+  double rows_per_sec = train_wall > 0 ? epoch_rows_ / train_wall : 0;
+  double nnz_per_sec = train_wall > 0 ? epoch_nnz_ / train_wall : 0;
+  if (show_profile_ && show_info_) {
+    std::string str = StringPrintf(
+      "Epoch %d: %.0f rows/sec, %.0f nnz/sec |", 
+      epoch, rows_per_sec, nnz_per_sec);
+    for (int p = 0; p < kNumPhase; ++p) {
+      if (phase_[p].count == 0) { continue; }
+      str += StringPrintf(" %s %.3f (cpu %.3f%s) |", kPhaseName[p],
+                          phase_[p].wall, phase_[p].cpu,
+                          perf_info(phase_[p]).c_str());
+    }
+    str += StringPrintf(" pool wait %.3f | total %.3f (sec)",
+                        pool_wait, wall);
+    Color::print_info(str);
+  }
+  if (profile_out_ != nullptr) {
+    std::string str = StringPrintf(
+      "{\"epoch\": %d, \"wall\": %.6f, \"rows\": %llu, "
+      "\"nnz\": %llu, \"rows_per_sec\": %.1f, \"nnz_per_sec\": %.1f, "
+      "\"pool_wait\": %.6f, \"phases\": {",
+      epoch, wall, (unsigned long long)epoch_rows_,
+      (unsigned long long)epoch_nnz_, rows_per_sec, nnz_per_sec,
+      pool_wait);
+    for (int p = 0; p < kNumPhase; ++p) {
+      str += StringPrintf(
+        "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f, \"count\": %llu",
+        p == 0 ? "" : ", ", kPhaseName[p], phase_[p].wall,
+        phase_[p].cpu, (unsigned long long)phase_[p].count);
+      if (phase_[p].perf != nullptr) {
+        for (int e = 0; e < kNumPerfEvent; ++e) {
+          if (!phase_[p].perf->IsOpen(e)) { continue; }
+          str += StringPrintf(", \"%s\": %llu", PerfEventName(e),
+                   (unsigned long long)phase_[p].events[e]);
+        }
+      }
+      str += "}";
+    }
+    str += "}}\n";
+    fwrite(str.data(), 1, str.size(), profile_out_);
+    fflush(profile_out_);
+  }
+}
+
 /*********************************************************
  *  Show head info                                       *
  *********************************************************/
@@ -38,12 +155,18 @@ void Trainer::show_head_info(bool validate) {
   width_list.push_back(6);
   str_list.push_back("Train " + loss_->loss_type());
   width_list.push_back(20);
+  if (train_metric_ != nullptr) {
+    str_list.push_back("Train " + train_metric_->metric_type());
+    width_list.push_back(20);
+  }
   if (validate) {
     str_list.push_back("Test " + loss_->loss_type());
     width_list.push_back(20);
     if (metric_ != nullptr) {
-      str_list.push_back("Test " + metric_->metric_type());
-      width_list.push_back(20);
+      for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
+        str_list.push_back("Test " + metric_->MetricTypeAt(i));
+        width_list.push_back(20);
+      }
     }
   }
   str_list.push_back("Time cost (sec)");
@@ -54,27 +177,48 @@ void Trainer::show_head_info(bool validate) {
   Color::print_row(str_list, width_list);
 }
 
+// The value of NaN is not known, which is shown as "-".
+static std::string value_string(real_t value) {
+  return std::isnan(value) ? "-" : StringPrintf("%.6f", value);
+}
+
+// The epoch of the validation in the middle of an epoch is a fraction.
+static std::string epoch_string(real_t epoch) {
+  if (epoch == std::floor(epoch)) {
+    return StringPrintf("%d", (int)epoch);
+  }
+  return StringPrintf("%.2f", epoch);
+}
+
 /*********************************************************
  *  Show train info                                      *
  *********************************************************/
 void Trainer::show_train_info(real_t tr_loss, 
+                              real_t tr_metric,
                               real_t te_loss,
-                              real_t te_metric,
+                              const std::vector<real_t>& te_metric,
                               real_t time_cost, 
                               bool validate,
-                              index_t epoch) {
+                              real_t epoch) {
   std::vector<std::string> str_list;
   std::vector<int> width_list;
-  str_list.push_back(StringPrintf("%d", epoch));
+  str_list.push_back(epoch_string(epoch));
   width_list.push_back(6);
-  str_list.push_back(StringPrintf("%.6f", tr_loss));
+  str_list.push_back(value_string(tr_loss));
   width_list.push_back(20);
+  if (train_metric_ != nullptr) {
+    str_list.push_back(value_string(tr_metric));
+    width_list.push_back(20);
+  }
   if (validate) {
-    str_list.push_back(StringPrintf("%.6f", te_loss));
+    str_list.push_back(value_string(te_loss));
     width_list.push_back(20);
     if (metric_ != nullptr) {
-      str_list.push_back(StringPrintf("%.6f", te_metric));
-      width_list.push_back(20);
+      for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
+        str_list.push_back(value_string(i < te_metric.size() ?
+                                        te_metric[i] : NAN));
+        width_list.push_back(20);
+      }
     }
   }
   str_list.push_back(StringPrintf("%.2f", time_cost));
@@ -100,6 +244,45 @@ void Trainer::Train() {
     te_reader.push_back(reader_list_[1]);
   }
   this->train(tr_reader, te_reader);
+  if (!tasks_.empty() && !quiet_ && show_info_) {
+    show_task_info(te_reader);
+  }
+}
+
+/*********************************************************
+ *  Show the loss of the other tasks                     *
+ *********************************************************/
+void Trainer::show_task_info(std::vector<Reader*>& test_reader) {
+  std::vector<real_t> pred;
+  std::vector<real_t> label;
+  for (size_t t = 0; t < tasks_.size(); ++t) {
+    Loss* loss = tasks_[t].loss;
+    // The tasks are numbered from 1 as the labels of the rows
+    std::string info = StringPrintf("Task %lu: Train %s: %.6f",
+                                    t + 2, loss->loss_type().c_str(),
+                                    loss->GetLoss());
+    if (!test_reader.empty()) {
+      loss->Reset();
+      for (size_t i = 0; i < test_reader.size(); ++i) {
+        test_reader[i]->Reset();
+        DMatrix* matrix = nullptr;
+        for (;;) {
+          index_t tmp = test_reader[i]->Samples(matrix);
+          if (tmp == 0) { break; }
+          pred.resize(tmp);
+          loss->Predict(matrix, *tasks_[t].model, pred);
+          label.resize(tmp);
+          for (index_t j = 0; j < tmp; ++j) {
+            label[j] = matrix->Label(j, t + 1);
+          }
+          loss->Evaluate(pred, label);
+        }
+      }
+      info += StringPrintf(", Test %s: %.6f",
+                           loss->loss_type().c_str(), loss->GetLoss());
+    }
+    Color::print_info(info);
+  }
 }
 
 /*********************************************************
@@ -112,46 +295,63 @@ void Trainer::CVTrain() {
       StringPrintf("Cross-validation: %d/%lu:", 
         i+1, reader_list_.size())
     );
-    // Get the train Reader and test Reader
-    std::vector<Reader*> tr_reader;
-    for (int j = 0; j < reader_list_.size(); ++j) {
-      if (i == j) { continue; }
-      tr_reader.push_back(reader_list_[j]);
-    }
-    std::vector<Reader*> te_reader;
-    te_reader.push_back(reader_list_[i]);
     if (i != 0) {
       // Re-init current model parameters.
       model_->Reset();
     }
-    this->train(tr_reader, te_reader);
+    TrainFold(i);
   }
   // Average metric for cross-validation
-  show_average_metric();
+  ShowAverageMetric(metric_info_);
+}
+
+/*********************************************************
+ *  Train one fold of Cross-Validation                   *
+ *********************************************************/
+MetricInfo Trainer::TrainFold(int i) {
+  CHECK_GE(i, 0);
+  CHECK_LT(i, reader_list_.size());
+  // Get the train Reader and test Reader
+  std::vector<Reader*> tr_reader;
+  for (int j = 0; j < reader_list_.size(); ++j) {
+    if (i == j) { continue; }
+    tr_reader.push_back(reader_list_[j]);
+  }
+  std::vector<Reader*> te_reader;
+  te_reader.push_back(reader_list_[i]);
+  // The negative sampling of the model is only for the
+  // training folds, and the validation fold keeps all the rows
+  for (int j = 0; j < reader_list_.size(); ++j) {
+    reader_list_[j]->SetNegativeRate(
+        i == j ? 1.0 : model_->GetNegativeRate());
+  }
+  this->train(tr_reader, te_reader);
+  return metric_info_.back();
 }
 
 /*********************************************************
  *  Calc average evaluation metric for CV                *
  *********************************************************/
-void Trainer::show_average_metric() {
+void Trainer::ShowAverageMetric(const std::vector<MetricInfo>& info_list) {
   real_t loss = 0;
-  real_t metric = 0;
-  for (size_t i = 0; i < metric_info_.size(); ++i) {
-    loss += metric_info_[i].loss_val;
-    if (metric_ != nullptr) {
-      metric += metric_info_[i].metric_val;
+  size_t num_metrics = metric_ == nullptr ? 0 : metric_->NumMetrics();
+  std::vector<real_t> metric(num_metrics, 0);
+  for (size_t i = 0; i < info_list.size(); ++i) {
+    loss += info_list[i].loss_val;
+    for (size_t m = 0; m < num_metrics; ++m) {
+      metric[m] += info_list[i].metric_list[m];
     }
   }
   Color::print_info(
     StringPrintf("Average %s: %.6f", 
     loss_->loss_type().c_str(), 
-    loss / metric_info_.size())
+    loss / info_list.size())
   );
-  if (metric_ != nullptr) {
+  for (size_t m = 0; m < num_metrics; ++m) {
     Color::print_info(
       StringPrintf("Average %s: %.6f", 
-      metric_->metric_type().c_str(),
-       metric / metric_info_.size())
+      metric_->MetricTypeAt(m).c_str(),
+       metric[m] / info_list.size())
     );
   }
 }
@@ -161,7 +361,7 @@ void Trainer::show_average_metric() {
  *********************************************************/
 void Trainer::train(std::vector<Reader*>& train_reader,
                     std::vector<Reader*>& test_reader) {
-  int best_epoch = 0;
+  real_t best_epoch = 0;
   int stop_window = 0;
   real_t best_result = 0;
   real_t prev_result = 0;
@@ -185,112 +385,665 @@ void Trainer::train(std::vector<Reader*>& train_reader,
       prev_result = kFloatMin;
     }
   }
-  MetricInfo te_info;
+  MetricInfo te_info = { 0, 0 };
+  // The best validation of early-stopping, and the last one
+  MetricInfo best_info = { 0, 0 };
+  real_t last_valid = 0;
   // Show header info
-  if (!quiet_) { 
+  if (!quiet_ && show_info_) { 
     show_head_info(!test_reader.empty()); 
   }
-  for (int n = 1; n <= epoch_; ++n) {
-    Timer timer;
-    timer.tic();
-    // Calc grad and update model
-    real_t tr_loss = calc_gradient(train_reader);
-    // we don't do any evaluation in a quiet model
-    if (!quiet_) {
-      if (!test_reader.empty()) { 
-        te_info = calc_metric(test_reader); 
-      }
-      // show evaluation metric info
+  if (ring_ != nullptr) {
+    broadcast_model();
+  }
+  bool validate = !quiet_ && !test_reader.empty();
+  // Each epoch is validated on its snapshot while the next one is trained
+  bool pipelined = async_valid_ && valid_loss_ != nullptr && validate;
+  // The validation in the middle of the epochs, which does not
+  // reset the training loss that is accumulated by the epoch
+  bool in_epoch = valid_rows_ > 0 && valid_loss_ != nullptr &&
+                  validate && !pipelined;
+  // The validation during the training is by the sample (if any)
+  std::vector<Reader*> valid_reader = test_reader;
+  if (valid_sample_ != nullptr && validate) {
+    valid_reader.assign(1, valid_sample_);
+  }
+  // The model has not been trained since it was the best one ?
+  bool best_current = false;
+  // Show the result of epoch n, and if it has been validated, check
+  // it for early-stopping. Return true if the training should stop.
+  auto finish_epoch = [&](real_t n, real_t tr_loss, real_t tr_metric,
+                          real_t time_cost, bool validated) {
+    bool stop = false;
+    if (validated) { last_valid = n; }
+    if (show_info_) {
       show_train_info(tr_loss, 
-                      te_info.loss_val,
-                      te_info.metric_val,
-                      timer.toc(), 
+                      tr_metric,
+                      validated ? te_info.loss_val : NAN,
+                      validated ? te_info.metric_list :
+                                  std::vector<real_t>(),
+                      time_cost, 
                       !test_reader.empty(), 
                       n);
-      // Early-stopping
-      if (early_stop_) {
-        if ((metric_ == nullptr && te_info.loss_val <= best_result) ||
-            (metric_ != nullptr && metric_->cmp(te_info.metric_val, 
-                                                best_result))) {
-          best_result = metric_ == nullptr ? 
-            te_info.loss_val : te_info.metric_val;
-          best_epoch = n;
+    }
+    // Early-stopping
+    if (early_stop_ && validated) {
+      if ((metric_ == nullptr && te_info.loss_val <= best_result) ||
+          (metric_ != nullptr && metric_->cmp(te_info.metric_val, 
+                                              best_result))) {
+        best_result = metric_ == nullptr ? 
+          te_info.loss_val : te_info.metric_val;
+        best_epoch = n;
+        best_info = te_info;
+        // The snapshot of the pipeline is the model of epoch n
+        if (pipelined) {
+          std::swap(valid_model_, best_model_);
+        } else {
           model_->SetBestModel();
+          best_current = true;
         }
-        if ((metric_ == nullptr && te_info.loss_val > prev_result) ||
-            (metric_ != nullptr && !metric_->cmp(te_info.metric_val, 
-                                                 prev_result))) {
-          // If the validation loss goes up continuously
-          // in stop_window epoch, we stop training
-          if (stop_window == stop_window_) { break; }
-          stop_window++;
-        } else {
-          stop_window = 0;
+      }
+      if ((metric_ == nullptr && te_info.loss_val > prev_result) ||
+          (metric_ != nullptr && !metric_->cmp(te_info.metric_val, 
+                                               prev_result))) {
+        // If the validation loss goes up continuously
+        // in stop_window epoch, we stop training
+        if (stop_window == stop_window_) { stop = true; }
+        stop_window++;
+      } else {
+        stop_window = 0;
+      }
+      prev_result = metric_ == nullptr ? 
+        te_info.loss_val : te_info.metric_val;
+    }
+    return stop;
+  };
+  // The epoch in the validation of the pipeline (0 for none), and
+  // its training loss, training metric and time
+  int valid_epoch = 0;
+  real_t valid_tr_loss = 0, valid_tr_metric = 0, valid_time = 0;
+  int last_epoch = start_epoch_;
+  // The rows trained since the last validation before current
+  // epoch, and the rows of the last epoch
+  uint64 carry_rows = 0;
+  uint64 last_rows = 0;
+  // The loss of each row is kept by the reader from the first epoch
+  RowLoss* row_loss = nullptr;
+  if (sample_epoch_ > 0 && train_reader.size() == 1) {
+    row_loss = train_reader[0]->TrackLoss();
+    loss_->SetRowLoss(row_loss);
+    if (row_loss == nullptr && show_info_) {
+      Color::print_warning("The training data is not kept in memory by "
+                           "its reader, so the rows are not sampled by "
+                           "their loss.");
+    }
+  }
+  for (int n = start_epoch_ + 1; n <= epoch_; ++n) {
+    TraceSpan epoch_span("epoch", "trainer");
+    Timer timer;
+    timer.tic();
+    bool stop = false;
+    double epoch_start = 0;
+    if (profile_) {
+      for (int p = 0; p < kNumPhase; ++p) { phase_[p].Reset(); }
+      epoch_rows_ = 0;
+      epoch_nnz_ = 0;
+      if (profile_pool_ != nullptr) { profile_pool_->ResetWaitTime(); }
+      epoch_start = WallSeconds();
+    }
+    // The rows of this epoch at its last validation
+    uint64 valid_mark = 0;
+    std::function<bool(uint64)> after_batch;
+    if (in_epoch) {
+      after_batch = [&](uint64 rows) {
+        if (carry_rows + rows - valid_mark < valid_rows_) { return false; }
+        best_current = false;
+        {
+          ScopedPhase grad_phase(phase(kPhaseGrad));
+          model_->FlushLazyRegu();
         }
-        prev_result = metric_ == nullptr ? 
-          te_info.loss_val : te_info.metric_val;
+        te_info = evaluate(valid_reader, model_, valid_loss_, true);
+        // The fraction of the epoch is known by the rows of the last one
+        real_t pos = n;
+        if (last_rows > 0) {
+          pos = n - 1 + std::min((real_t)rows / last_rows, (real_t)1);
+        }
+        carry_rows = 0;
+        valid_mark = rows;
+        // The training metric is only merged at the end of the epoch
+        stop = finish_epoch(pos, loss_->GetLoss(), NAN, timer.toc(), true);
+        return stop;
+      };
+    }
+    if (row_loss != nullptr && n >= sample_epoch_) {
+      train_reader[0]->SetLossRate(sample_rate_);
+    }
+    // Calc grad and update model
+    real_t tr_loss = calc_gradient(train_reader, after_batch);
+    double train_wall = profile_ ? WallSeconds() - epoch_start : 0;
+    last_epoch = n;
+    if (!in_epoch || trained_rows_ > valid_mark) { best_current = false; }
+    // The model is up to date between two epochs
+    if (checkpoint_ != nullptr) {
+      checkpoint_->Step(model_, n);
+    }
+    // The epochs of the schedule, and the last one is always validated
+    bool scheduled = n == epoch_ ||
+                     (valid_rows_ == 0 &&
+                      (n - start_epoch_) % valid_epoch_ == 0);
+    if (in_epoch) {
+      carry_rows += trained_rows_ - valid_mark;
+      last_rows = trained_rows_;
+      scheduled = n == epoch_ && carry_rows > 0;
+    }
+    // we don't do any evaluation in a quiet model
+    if (pipelined) {
+      ScopedPhase metric_phase(phase(kPhaseMetric));
+      real_t tr_metric = train_metric_ == nullptr ?
+                         0 : train_metric_->GetMetric();
+      metric_phase.Stop();
+      // The last epoch has been validated during this epoch, so
+      // early-stopping is decided one epoch late
+      if (valid_epoch > 0) {
+        ScopedPhase wait_phase(phase(kPhaseSync));
+        te_info = wait_validation();
+        wait_phase.Stop();
+        stop = finish_epoch(valid_epoch, valid_tr_loss,
+                            valid_tr_metric, valid_time, true);
+        valid_epoch = 0;
       }
+      if (!stop && scheduled) {
+        start_validation(valid_reader);
+        valid_epoch = n;
+        valid_tr_loss = tr_loss;
+        valid_tr_metric = tr_metric;
+        valid_time = timer.toc();
+      } else if (!stop) {
+        finish_epoch(n, tr_loss, tr_metric, timer.toc(), false);
+      }
+    } else if (!quiet_ && !stop) {  // not stopped in the epoch
+      if (validate && scheduled) { 
+        te_info = calc_metric(valid_reader);
+        carry_rows = 0;
+      }
+      // show evaluation metric info
+      ScopedPhase metric_phase(phase(kPhaseMetric));
+      real_t tr_metric = train_metric_ == nullptr ?
+                         0 : train_metric_->GetMetric();
+      metric_phase.Stop();
+      // The line of the epoch has been shown by the validation at its end
+      bool shown = in_epoch && valid_mark > 0 &&
+                   valid_mark == trained_rows_ && train_metric_ == nullptr;
+      if (!shown) {
+        stop = finish_epoch(n, tr_loss, tr_metric, timer.toc(),
+                            validate && scheduled);
+      }
+    }
+    // All the processes of the shared model stop at the same epoch
+    if (shared_ != nullptr) {
+      ScopedPhase sync_phase(phase(kPhaseSync));
+      double value = stop ? 1 : 0;
+      shared_->AllReduce(&value, 1, kReduceMax);
+      stop = value > 0;
     }
+    if (profile_) {
+      show_profile(n, WallSeconds() - epoch_start, train_wall);
+    }
+    if (stop) { break; }
+  }
+  if (row_loss != nullptr) {
+    loss_->SetRowLoss(nullptr);
+    train_reader[0]->SetLossRate(1.0);
+  }
+  // The validation of the last epoch
+  if (valid_epoch > 0) {
+    te_info = wait_validation();
+    finish_epoch(valid_epoch, valid_tr_loss, valid_tr_metric,
+                 valid_time, true);
+  }
+  if (store_ != nullptr && async_) {
+    // Wait for the pushes of all the workers
+    std::vector<double> barrier(1, 0);
+    store_->AllReduce(&barrier, kReduceSum);
+    pull_model();
+  }
+  if (ring_ != nullptr && show_info_) {
+    Color::print_info(
+      StringPrintf("Time cost for waiting for the other nodes: %.2f (sec)",
+                   ring_wait_)
+    );
+  }
+  // The model has been trained after the best validation
+  bool trained = pipelined ? best_epoch != last_epoch : !best_current;
+  if (early_stop_ && best_epoch > 0) {
+    result_ = best_info;
+    result_epoch_ = best_epoch;
+  } else {
+    result_ = te_info;
+    result_epoch_ = last_valid;
   }
-  if (early_stop_ && best_epoch != epoch_) {  // not for cv
+  if (early_stop_ && trained) {  // not for cv
     std::string metric_name = metric_ == nullptr ? 
       "loss" : metric_->metric_type();
-    Color::print_action(
-      StringPrintf("Early-stopping at epoch %d, best %s: %f", 
-        best_epoch, metric_name.c_str(), best_result)
-    );
-    model_->Shrink();
+    if (show_info_) {
+      Color::print_action(
+        StringPrintf("Early-stopping at epoch %s, best %s: %f", 
+          epoch_string(best_epoch).c_str(), metric_name.c_str(),
+          best_result)
+      );
+    }
+    if (!pipelined) {
+      model_->Shrink();
+    } else if (best_model_ != nullptr) {
+      // Roll back to the snapshot of the best epoch
+      best_model_->Snapshot(model_);
+    }
   } else {  // for cv
     metric_info_.push_back(te_info);
   }
+  valid_model_.reset();
+  best_model_.reset();
+  // The final model is validated by all the data once
+  if (valid_sample_ != nullptr && validate && show_info_) {
+    MetricInfo info = calc_metric(test_reader);
+    std::string result = StringPrintf("The final model on all the "
+      "validation data: %s %.6f", loss_->loss_type().c_str(),
+      info.loss_val);
+    for (size_t m = 0; m < info.metric_list.size(); ++m) {
+      result += StringPrintf(", %s %.6f", metric_->MetricTypeAt(m).c_str(),
+                             info.metric_list[m]);
+    }
+    Color::print_info(result);
+  }
+}
+
+// The snapshot is copied by the training thread between two epochs,
+// and the validation thread evaluates it on the threads of the pool,
+// which it shares with the gradient pass of the next epoch.
+void Trainer::start_validation(std::vector<Reader*>& test_reader) {
+  CHECK(!valid_thread_.joinable());
+  if (valid_model_ == nullptr) { valid_model_.reset(new Model()); }
+  {
+    TraceSpan span("snapshot", "trainer");
+    model_->Snapshot(valid_model_.get());
+  }
+  valid_thread_ = std::thread([this, &test_reader]() {
+    valid_info_ = evaluate(test_reader, valid_model_.get(),
+                           valid_loss_, false);
+  });
+}
+
+MetricInfo Trainer::wait_validation() {
+  CHECK(valid_thread_.joinable());
+  valid_thread_.join();
+  return valid_info_;
 }
 
 /*********************************************************
  *  Calc gradient and update model                       *
  *********************************************************/
-real_t Trainer::calc_gradient(std::vector<Reader*>& reader) {
+real_t Trainer::calc_gradient(std::vector<Reader*>& reader,
+                              const std::function<bool(uint64)>& after_batch) {
   CHECK_NE(reader.empty(), true);
+  TraceSpan span("calc_gradient", "trainer");
   loss_->Reset();
-  for (int i = 0; i < reader.size(); ++i) {
+  for (size_t t = 0; t < tasks_.size(); ++t) {
+    tasks_[t].loss->Reset();
+  }
+  if (train_metric_ != nullptr) {
+    train_metric_->Reset();
+  }
+  if (ring_ != nullptr) {
+    return ring_gradient(reader);
+  }
+  uint64 num_rows = 0;
+  bool stop = false;
+  for (int i = 0; i < reader.size() && !stop; ++i) {
     reader[i]->Reset();
     DMatrix* matrix = nullptr;
     for (;;) {
+      ScopedPhase read_phase(phase(kPhaseRead));
       index_t tmp = reader[i]->Samples(matrix);
+      read_phase.Stop();
       if (tmp == 0) { break; }
-      loss_->CalcGrad(matrix, *model_);
+      count_rows(matrix);
+      ScopedPhase grad_phase(phase(kPhaseGrad));
+      if (store_ != nullptr) {
+        loss_->CalcGradDist(matrix, *model_, store_);
+      } else if (!tasks_.empty()) {
+        loss_->CalcGradTasks(matrix, *model_, tasks_);
+      } else {
+        loss_->CalcGrad(matrix, *model_);
+      }
+      grad_phase.Stop();
+      if (replica_rows_ > 0) {
+        unsynced_rows_ += tmp;
+        if (unsynced_rows_ >= replica_rows_) { sync_replicas(); }
+      }
+      num_rows += tmp;
+      if (after_batch != nullptr && after_batch(num_rows)) {
+        stop = true;
+        break;
+      }
+    }
+  }
+  trained_rows_ = num_rows;
+  if (store_ != nullptr && async_) {
+    {
+      ScopedPhase sync_phase(phase(kPhaseSync));
+      pull_model();
+    }
+    if (train_metric_ != nullptr) {
+      ScopedPhase metric_phase(phase(kPhaseMetric));
+      train_metric_->MergeLocals();
+    }
+    return loss_->GetLoss();
+  }
+  if (store_ != nullptr) {
+    // Wait for the pushes of all the workers
+    std::vector<double> value = { loss_->GetLoss() * num_rows,
+                                  (double)num_rows };
+    {
+      ScopedPhase sync_phase(phase(kPhaseSync));
+      store_->AllReduce(&value, kReduceSum);
+      pull_model();
+    }
+    if (train_metric_ != nullptr) {
+      ScopedPhase metric_phase(phase(kPhaseMetric));
+      train_metric_->MergeLocals();
+    }
+    return value[1] > 0 ? value[0] / value[1] : 0;
+  }
+  // Bring the model up to date before it is evaluated
+  if (unsynced_rows_ > 0) { sync_replicas(); }
+  {
+    ScopedPhase grad_phase(phase(kPhaseGrad));
+    model_->FlushLazyRegu();
+    for (size_t t = 0; t < tasks_.size(); ++t) {
+      tasks_[t].model->FlushLazyRegu();
     }
   }
+  if (train_metric_ != nullptr) {
+    ScopedPhase metric_phase(phase(kPhaseMetric));
+    train_metric_->MergeLocals();
+  }
+  if (shared_ != nullptr) {
+    // Wait for the other processes, whose updates are in the model
+    ScopedPhase sync_phase(phase(kPhaseSync));
+    double value[2] = { loss_->GetLoss() * num_rows, (double)num_rows };
+    shared_->AllReduce(value, 2, kReduceSum);
+    return value[1] > 0 ? value[0] / value[1] : 0;
+  }
   return loss_->GetLoss();
 }
 
+// The copies of the NUMA nodes are averaged by all the threads
+void Trainer::sync_replicas() {
+  ScopedPhase sync_phase(phase(kPhaseSync));
+  TraceSpan span("sync_replicas", "trainer");
+  model_->SyncReplicas();
+  unsynced_rows_ = 0;
+}
+
+/*********************************************************
+ *  Pull the model from the parameter server             *
+ *********************************************************/
+// Number of the keys of each pull
+static const index_t kPullBlock = 64 * 1024;
+
+void Trainer::pull_model() {
+  CHECK_NOTNULL(store_);
+  // The bias is the key after the features
+  index_t num_key = model_->GetNumFeature() + 1;
+  size_t length = model_->GetFeatureSize();
+  std::vector<index_t> key;
+  std::vector<real_t> value;
+  for (index_t begin = 0; begin < num_key; begin += kPullBlock) {
+    index_t end = std::min(num_key, begin + kPullBlock);
+    key.resize(end - begin);
+    for (index_t j = begin; j < end; ++j) {
+      key[j - begin] = j;
+    }
+    store_->Pull(key, &value, length);
+    model_->SetFeatures(key, value.data());
+  }
+}
+
+/*********************************************************
+ *  Average the model on the ring                        *
+ *********************************************************/
+// The parameters of the model that are averaged by the ring, which
+// are the linear terms, the latent factors and the bias, all with
+// their gradient caches.
+typedef std::vector<std::pair<real_t*, size_t>> ParamSegments;
+
+static void get_segments(Model* model, ParamSegments* segment) {
+  CHECK(model->GetLatentType() == kStoreFP32);
+  segment->clear();
+  segment->emplace_back(model->GetParameter_w(),
+                        model->GetNumParameter_w());
+  segment->emplace_back(model->GetParameter_v(),
+                        model->GetNumParameter_v());
+  segment->emplace_back(model->GetParameter_b(),
+                        (size_t)model->GetAuxiliarySize());
+}
+
+static size_t get_size(const ParamSegments& segment) {
+  size_t size = 0;
+  for (size_t i = 0; i < segment.size(); ++i) {
+    size += segment[i].second;
+  }
+  return size;
+}
+
+void Trainer::broadcast_model() {
+  ParamSegments segment;
+  get_segments(model_, &segment);
+  std::vector<real_t> value(get_size(segment), 0);
+  size_t k = 0;
+  for (size_t i = 0; i < segment.size(); ++i) {
+    if (ring_->Rank() == 0 && segment[i].second > 0) {
+      memcpy(value.data() + k, segment[i].first,
+             segment[i].second * sizeof(real_t));
+    }
+    k += segment[i].second;
+  }
+  // The others add 0
+  ring_->AllReduce(value.data(), value.size(), kReduceSum);
+  k = 0;
+  for (size_t i = 0; i < segment.size(); ++i) {
+    if (segment[i].second > 0) {
+      memcpy(segment[i].first, value.data() + k,
+             segment[i].second * sizeof(real_t));
+    }
+    k += segment[i].second;
+  }
+}
+
+// In round t, a node computes its mini-batch t, and then it gets the
+// sum of the changes of round t-1 and replaces its own change of t-1
+// by the average, while the changes of t are summed in the background.
+// The last value of a change is 1 if the node had a mini-batch, and
+// the nodes stop after a round that no node had a mini-batch, so all
+// of them run the same rounds even if their data is not the same size.
+real_t Trainer::ring_gradient(std::vector<Reader*>& reader) {
+  ThreadPool comm_pool(1);
+  std::future<void> reduce;
+  ParamSegments segment;
+  get_segments(model_, &segment);
+  size_t size = get_size(segment);
+  ring_base_.resize(size + 1);
+  ring_delta_.resize(size + 1);
+  ring_sum_.resize(size + 1);
+  // Apply fn(param, base, delta, sum) to each parameter
+  auto for_each = [&](std::function<void(real_t&, real_t&,
+                                         real_t&, real_t&)> fn) {
+    size_t k = 0;
+    for (size_t i = 0; i < segment.size(); ++i) {
+      real_t* param = segment[i].first;
+      for (size_t j = 0; j < segment[i].second; ++j, ++k) {
+        fn(param[j], ring_base_[k], ring_delta_[k], ring_sum_[k]);
+      }
+    }
+  };
+  for_each([](real_t& p, real_t& base, real_t&, real_t&) { base = p; });
+  // The mini-batches of all the readers
+  size_t r = 0;
+  DMatrix* matrix = nullptr;
+  auto next_batch = [&](DMatrix* batch) -> index_t {
+    for (;;) {
+      if (matrix != nullptr) {
+        index_t len = matrix->GetMiniBatch(ring_batch_size_, *batch);
+        if (len > 0) { return len; }
+        matrix->pos = 0;
+        matrix = nullptr;
+      }
+      if (r == reader.size()) { return 0; }
+      ScopedPhase read_phase(phase(kPhaseRead));
+      index_t len = reader[r]->Samples(matrix);
+      read_phase.Stop();
+      if (len == 0) {
+        matrix = nullptr;
+        if (++r < reader.size()) { reader[r]->Reset(); }
+      } else {
+        matrix->pos = 0;
+      }
+    }
+  };
+  reader[0]->Reset();
+  real_t num_node = ring_->NumNode();
+  uint64 num_rows = 0;
+  bool started = false;
+  for (;;) {
+    DMatrix mini_batch;
+    index_t len = next_batch(&mini_batch);
+    if (len > 0) {
+      count_rows(&mini_batch);
+      ScopedPhase grad_phase(phase(kPhaseGrad));
+      loss_->CalcGrad(&mini_batch, *model_);
+      num_rows += len;
+    }
+    real_t active = 1;
+    if (started) {
+      Timer timer;
+      timer.tic();
+      ScopedPhase sync_phase(phase(kPhaseSync));
+      reduce.get();
+      sync_phase.Stop();
+      ring_wait_ += timer.toc();
+      active = ring_sum_[size];
+      // The change of this node is (param - base), and the change
+      // of the last round is delta, which is replaced by the average
+      for_each([num_node](real_t& p, real_t& base,
+                          real_t& delta, real_t& sum) {
+        real_t change = p - base;
+        p += sum / num_node - delta;
+        base = p;
+        delta = change;
+      });
+    } else {
+      for_each([](real_t& p, real_t& base, real_t& delta, real_t&) {
+        delta = p - base;
+        base = p;
+      });
+    }
+    // No node has a mini-batch after the last round
+    if (active == 0) { break; }
+    ring_delta_[size] = len > 0 ? 1 : 0;
+    memcpy(ring_sum_.data(), ring_delta_.data(),
+           ring_sum_.size() * sizeof(real_t));
+    reduce = comm_pool.enqueue([this]() {
+      ring_->AllReduce(ring_sum_.data(), ring_sum_.size(), kReduceSum);
+    });
+    started = true;
+  }
+  std::vector<double> value = { loss_->GetLoss() * num_rows,
+                                (double)num_rows };
+  {
+    ScopedPhase sync_phase(phase(kPhaseSync));
+    ring_->AllReduce(value.data(), value.size(), kReduceSum);
+  }
+  if (train_metric_ != nullptr) {
+    ScopedPhase metric_phase(phase(kPhaseMetric));
+    train_metric_->MergeLocals();
+  }
+  return value[1] > 0 ? value[0] / value[1] : 0;
+}
+
 /*********************************************************
  *  Calc evaluation metric                               *
  *********************************************************/
+// The loss and the state of the metric are summed by one allreduce,
+// so all the nodes have the metric of all the validation data.
+real_t Trainer::reduce_metric(real_t loss_val, double num_rows) {
+  ScopedPhase sync_phase(phase(kPhaseSync));
+  size_t state_size = metric_ == nullptr ? 0 : metric_->StateSize();
+  std::vector<double> value(2 + state_size, 0);
+  if (num_rows > 0) {
+    value[0] = loss_val * num_rows;
+    value[1] = num_rows;
+  }
+  if (metric_ != nullptr) {
+    metric_->GetState(value.data() + 2);
+  }
+  if (ring_ != nullptr) {
+    ring_->AllReduce(value.data(), value.size(), kReduceSum);
+  } else {
+    store_->AllReduce(&value, kReduceSum);
+  }
+  if (metric_ != nullptr) {
+    metric_->SetState(value.data() + 2);
+  }
+  return value[1] > 0 ? value[0] / value[1] : 0;
+}
+
 MetricInfo Trainer::calc_metric(std::vector<Reader*>& reader_list) {
+  return evaluate(reader_list, model_, loss_, true);
+}
+
+// The phases are not timed by the validation of the pipeline,
+// since it runs at the same time as the gradient pass.
+MetricInfo Trainer::evaluate(std::vector<Reader*>& reader_list,
+                             Model* model, Loss* loss, bool timed) {
   CHECK_NE(reader_list.empty(), true);
+  TraceSpan span("calc_metric", "trainer");
   DMatrix* matrix = nullptr;
   std::vector<real_t> pred;
+  double num_rows = 0;
   if (metric_ != nullptr) {
     metric_->Reset();
   }
-  loss_->Reset();
+  loss->Reset();
   for (int i = 0; i < reader_list.size(); ++i) {
     reader_list[i]->Reset();
     for (;;) {
+      ScopedPhase read_phase(timed ? phase(kPhaseRead) : nullptr);
       index_t tmp = reader_list[i]->Samples(matrix);
+      read_phase.Stop();
       if (tmp == 0) { break; }
       if (tmp != pred.size()) { pred.resize(tmp); }
-      loss_->Predict(matrix, *model_, pred);
-      loss_->Evaluate(pred, matrix->Y);
-      if (metric_ != nullptr) {
-        metric_->Accumulate(matrix->Y, pred);
-      }
+      num_rows += tmp;
+      // The loss and the metric are evaluated in the same pass
+      ScopedPhase predict_phase(timed ? phase(kPhasePredict) : nullptr);
+      loss->PredictAndEvaluate(matrix, *model, pred, metric_);
     }
   }
+  ScopedPhase metric_phase(timed ? phase(kPhaseMetric) : nullptr);
+  if (metric_ != nullptr) {
+    metric_->MergeLocals();
+  }
   MetricInfo info;
-  info.loss_val = loss_->GetLoss();
+  info.loss_val = loss->GetLoss();
+  // The pipeline does not run with the distributed training
+  if (timed && (ring_ != nullptr || store_ != nullptr)) {
+    metric_phase.Stop();
+    info.loss_val = reduce_metric(info.loss_val, num_rows);
+  }
   if (metric_ != nullptr) {
     info.metric_val = metric_->GetMetric();
+    for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
+      info.metric_list.push_back(metric_->MetricAt(i));
+    }
   }
   return info;
 }
@@ -21,14 +21,27 @@ This file defines the Trainer class.
 #ifndef XLEARN_SOLVER_TRAINER_H_
 #define XLEARN_SOLVER_TRAINER_H_
 
+#include <stdio.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "src/base/common.h"
 #include "src/base/format_print.h"
+#include "src/base/phase_timer.h"
+#include "src/base/thread_pool.h"
+#include "src/base/trace.h"
 #include "src/reader/reader.h"
 #include "src/data/model_parameters.h"
+#include "src/distributed/parameter_server.h"
+#include "src/distributed/ring_allreduce.h"
+#include "src/distributed/shared_model.h"
 #include "src/loss/loss.h"
 #include "src/loss/metric.h"
+#include "src/solver/checkpoint.h"
 
 namespace xLearn {
 
@@ -41,7 +54,10 @@ class Trainer {
  public:
   // Constructor and Destructor
   Trainer() {}
-  ~Trainer() {}
+  ~Trainer() {
+    if (valid_thread_.joinable()) { valid_thread_.join(); }
+    if (profile_out_ != nullptr) { fclose(profile_out_); }
+  }
 
   // Invoke this function before we use this class
   void Initialize(std::vector<Reader*>& reader_list,
@@ -51,7 +67,8 @@ class Trainer {
                   Metric* metric,
                   bool early_stop,
                   int stop_window,
-                  bool quiet) {
+                  bool quiet,
+                  Metric* train_metric = nullptr) {
     CHECK_NE(reader_list.empty(), true);
     CHECK_GT(epoch, 0);
     CHECK_GT(stop_window, 0);
@@ -66,6 +83,8 @@ class Trainer {
     early_stop_ = early_stop;
     stop_window_ = stop_window;
     quiet_ = quiet;
+    train_metric_ = train_metric;
+    loss_->SetTrainMetric(train_metric);
   }
 
   // Training without cross-validation
@@ -74,11 +93,161 @@ class Trainer {
   // Training using cross-validation
   void CVTrain();
 
-  // Save model to disk file
-  void SaveModel(const std::string& filename) {
+  // Train the model with the i-th reader as validation reader and
+  // the others as training readers, which is one fold of CVTrain().
+  // Return the metric of the validation reader.
+  MetricInfo TrainFold(int i);
+
+  // Print the average metric of the folds.
+  void ShowAverageMetric(const std::vector<MetricInfo>& info_list);
+
+  // The validation of the model given by Train(), which is the best
+  // epoch of early-stopping, and the epoch of it (0 if the model has
+  // not been validated), e.g., to compare the models of a sweep.
+  MetricInfo GetResult(real_t* epoch = nullptr) const {
+    if (epoch != nullptr) { *epoch = result_epoch_; }
+    return result_;
+  }
+
+  // Print the header and the metric of each epoch (true by default).
+  // The folds trained at the same time do not print them, since
+  // their lines would be mixed.
+  void SetShowInfo(bool show) { show_info_ = show; }
+
+  // Write the checkpoints during the training (nullptr by default).
+  void SetCheckpoint(Checkpoint* checkpoint) { checkpoint_ = checkpoint; }
+
+  // Train the model on the parameter server (nullptr by default),
+  // where the model is the local copy of this worker. The training
+  // loss of each epoch is the loss of all the workers, and then the
+  // whole model is pulled, so it is up to date between two epochs.
+  // If async is true, the workers do not wait for each other between
+  // the epochs, where the training loss is the one of this worker and
+  // the pulled model may miss the pushes of the others, and they only
+  // wait at the end of the training.
+  void SetKVStore(KVStore* store, bool async = false) {
+    store_ = store;
+    async_ = async;
+  }
+
+  // Train the model on the nodes of the ring (nullptr by default),
+  // where each node has the whole model and trains its own data by
+  // the mini-batches of batch_size rows. After each mini-batch, the
+  // change of the model is averaged by the ring, which runs while the
+  // next mini-batch is computed, and then it replaces the change of
+  // this node. So the model of a mini-batch misses the change of the
+  // other nodes in the last mini-batch, and all the nodes have the
+  // same model between two epochs. The first node gives the initial
+  // model to the others.
+  void SetRingAllReduce(RingAllReduce* ring, index_t batch_size) {
+    CHECK_GT(batch_size, 0);
+    ring_ = ring;
+    ring_batch_size_ = batch_size;
+  }
+
+  // Train the copies of the model on the NUMA nodes (see
+  // Model::Replicate), where the threads of each node train its own
+  // copy lock-free, and the copies are averaged after each rows rows
+  // and at the end of each epoch, so the model is up to date between
+  // two epochs. 0 (by default) trains the model itself.
+  void SetReplicaSync(index_t rows) { replica_rows_ = rows; }
+
+  // Sample the training rows of the epochs from epoch by their loss
+  // in the last epoch that trained them (see Reader::SetLossRate), so
+  // about rate of the rows are trained, and their gradients are
+  // weighted by the importance weights. The loss of the rows is kept
+  // from the first epoch. It only works with one training reader in
+  // memory, and 0 (by default) trains all the rows of each epoch.
+  void SetLossSampling(int epoch, real_t rate) {
+    sample_epoch_ = epoch;
+    sample_rate_ = rate;
+  }
+
+  // Train the model in the shared memory with the other processes
+  // of the host (nullptr by default), which update it at the same
+  // time. The training loss of each epoch is the loss of all the
+  // processes (but the training metric is of this process), and the
+  // processes wait for each other after each epoch, so the first one
+  // validates the model and decides when all of them stop early.
+  void SetSharedModel(SharedModel* shared) { shared_ = shared; }
+
+  // Train the models of the other tasks of the rows with model_ in the
+  // same pass over the data (see Loss::CalcGradTasks), where task t
+  // (t > 0) is tasks[t-1]. Their losses are printed after the
+  // training, with the validation losses if there is validation data.
+  // It is not used by cross-validation and by the distributed training.
+  void SetTasks(const std::vector<Loss::Task>& tasks) { tasks_ = tasks; }
+
+  // Time the phases of each epoch, which are the reading of the data
+  // (I/O and parsing), the gradient pass, the prediction and the metric
+  // of the validation, and the waiting for the other workers. If show
+  // is true, the time of the phases, the rows/sec and the nnz/sec of
+  // the gradient pass are printed after each epoch. If file is not
+  // empty, each epoch is also written to it as one JSON object per
+  // line. The pool gives the time that the phases waited for its
+  // threads, which can be nullptr.
+  void SetProfile(bool show, const std::string& file, ThreadPool* pool);
+
+  // Count the hardware events of the gradient pass and of the
+  // prediction by perf, which are shown with the phases of
+  // SetProfile(). The perf must count the threads of the pool.
+  void SetPerfCounters(const PerfCounters* perf) {
+    phase_[kPhaseGrad].perf = perf;
+    phase_[kPhasePredict].perf = perf;
+  }
+
+  // The own loss of the validation (nullptr by default), which shares
+  // the score function and the threads with the loss of the training.
+  // It is needed by SetAsyncValidation() and by the validation in the
+  // middle of an epoch, which must not reset the training loss.
+  void SetValidationLoss(Loss* loss) { valid_loss_ = loss; }
+
+  // Validate the model of each epoch on its snapshot while the next
+  // epoch is trained (false by default) by the loss of
+  // SetValidationLoss(). The result of epoch n is shown after epoch
+  // n + 1, so early-stopping is decided one epoch late, and then the
+  // model rolls back to the snapshot of the best epoch. It keeps two
+  // snapshots (the validated one and the best one) in memory, and the
+  // time of waiting for the validation is the sync phase of
+  // SetProfile(). It is not used by cross-validation.
+  void SetAsyncValidation(bool async) { async_valid_ = async; }
+
+  // Validate the model every num_epoch epochs (1 by default), or every
+  // num_rows training rows if it is not 0, where the validation (and
+  // early-stopping) can be in the middle of an epoch and it is shown
+  // as a fraction of the epochs. The stop window counts the
+  // validations, and the last epoch is always validated. The rows
+  // need the loss of SetValidationLoss() and do not work with
+  // SetAsyncValidation().
+  void SetValidationSchedule(int num_epoch, uint64 num_rows) {
+    CHECK_GT(num_epoch, 0);
+    valid_epoch_ = num_epoch;
+    valid_rows_ = num_rows;
+  }
+
+  // Validate the model by the reader of a sample of the validation
+  // data during the training (nullptr by default), and the model that
+  // the training ends with is then validated once by all the data.
+  void SetValidationSample(Reader* sample) { valid_sample_ = sample; }
+
+  // Start the training after the given number of epochs, which
+  // are trained by the resumed checkpoint (0 by default).
+  void SetStartEpoch(int epoch) {
+    CHECK_GE(epoch, 0);
+    CHECK_LT(epoch, epoch_);
+    start_epoch_ = epoch;
+  }
+
+  // Save model to disk file, in the sparse format if sparse is true
+  void SaveModel(const std::string& filename, bool sparse = false) {
     CHECK_NE(filename.empty(), true);
     CHECK_NE(filename.compare("none"), 0);
-    model_->Serialize(filename);
+    TraceSpan span("serialize_model", "trainer");
+    if (sparse) {
+      model_->SerializeSparse(filename);
+    } else {
+      model_->Serialize(filename);
+    }
   }
 
   // Save txt model to disk file
@@ -88,6 +257,14 @@ class Trainer {
     model_->SerializeToTXT(filename);
   }
 
+  // Save inference model to disk file
+  void SaveInferenceModel(const std::string& filename,
+                          StorageType type) {
+    CHECK_NE(filename.empty(), true);
+    CHECK_NE(filename.compare("none"), 0);
+    model_->SerializeInference(filename, type);
+  }
+
  protected:
   /* The reader_list_ contains both of the 
   training data and the validation data. */
@@ -100,37 +277,162 @@ class Trainer {
   int stop_window_;
   /* quiet training ? */
   bool quiet_;
+  /* Print the info of each epoch ? */
+  bool show_info_ = true;
+  /* Writer of the checkpoints, or nullptr */
+  Checkpoint* checkpoint_ = nullptr;
+  /* Number of the epochs trained before */
+  int start_epoch_ = 0;
+  /* The parameter server of distributed training, or nullptr */
+  KVStore* store_ = nullptr;
+  /* Do not wait for the workers between the epochs */
+  bool async_ = false;
+  /* The ring of data-parallel training, or nullptr */
+  RingAllReduce* ring_ = nullptr;
+  index_t ring_batch_size_ = 0;
+  /* The rows between two averages of the NUMA copies, and
+  the rows trained after the last one */
+  index_t replica_rows_ = 0;
+  uint64 unsynced_rows_ = 0;
+  /* The first epoch sampled by the loss (0 for none), and the
+  rate of the rows of a sampled epoch */
+  int sample_epoch_ = 0;
+  real_t sample_rate_ = 1.0;
+  /* The model at the start of current mini-batch, the change
+  of the last mini-batch, and the sum of the changes of the nodes
+  plus the number of the nodes that have the mini-batch */
+  std::vector<real_t> ring_base_;
+  std::vector<real_t> ring_delta_;
+  std::vector<real_t> ring_sum_;
+  /* Seconds of waiting for the ring */
+  double ring_wait_ = 0;
+  /* The processes of the shared model, or nullptr */
+  SharedModel* shared_ = nullptr;
+  /* The other tasks of the multi-task training */
+  std::vector<Loss::Task> tasks_;
+  /* Print (or write) the time of the phases ? */
+  bool profile_ = false;
+  bool show_profile_ = false;
+  std::string profile_file_;
+  FILE* profile_out_ = nullptr;
+  ThreadPool* profile_pool_ = nullptr;
+  /* The phases of an epoch */
+  enum Phase {
+    kPhaseRead,
+    kPhaseGrad,
+    kPhasePredict,
+    kPhaseMetric,
+    kPhaseSync,
+    kNumPhase
+  };
+  PhaseTime phase_[kNumPhase];
+  /* Rows and nonzeros of the gradient pass of current epoch */
+  uint64 epoch_rows_ = 0;
+  uint64 epoch_nnz_ = 0;
   /* Model parameter */
   Model* model_;
   /* Loss function */
   Loss* loss_;
   /* Evaluation metric */
   Metric* metric_;
+  /* Metric of the training data, which is accumulated
+  by the gradient pass (nullptr if it is not used) */
+  Metric* train_metric_ = nullptr;
   /* Store each metric info of cross-validation */
   std::vector<MetricInfo> metric_info_;
+  /* The validation of the final model, and its epoch */
+  MetricInfo result_ = { 0, 0 };
+  real_t result_epoch_ = 0;
+  /* The own loss of the validation, or nullptr */
+  Loss* valid_loss_ = nullptr;
+  /* Validate in the background ? */
+  bool async_valid_ = false;
+  /* Validate every valid_epoch_ epochs, or every valid_rows_
+  training rows if it is not 0 */
+  int valid_epoch_ = 1;
+  uint64 valid_rows_ = 0;
+  /* The sample of the validation data, or nullptr */
+  Reader* valid_sample_ = nullptr;
+  /* Rows of the last gradient pass */
+  uint64 trained_rows_ = 0;
+  /* The thread of the validation, its snapshot of the model and
+  its result, and the snapshot of the best epoch */
+  std::thread valid_thread_;
+  std::unique_ptr<Model> valid_model_;
+  std::unique_ptr<Model> best_model_;
+  MetricInfo valid_info_;
 
   // Basic train function
   void train(std::vector<Reader*>& train_reader,
              std::vector<Reader*>& test_reader);
 
   // Calculate gradient and update model.
-  // Return training loss.
-  real_t calc_gradient(std::vector<Reader*>& reader_list);
+  // Return training loss. If after_batch is given, it is called
+  // after each mini-batch with the rows of the pass so far, and
+  // the pass stops if it returns true.
+  real_t calc_gradient(std::vector<Reader*>& reader_list,
+                       const std::function<bool(uint64)>& after_batch
+                         = nullptr);
+
+  // Pull the whole model from the parameter server.
+  void pull_model();
+
+  // Train the mini-batches of the ring, and return the training loss.
+  real_t ring_gradient(std::vector<Reader*>& reader_list);
+
+  // Average the NUMA copies of the model.
+  void sync_replicas();
+
+  // Give the model of the first node of the ring to the others.
+  void broadcast_model();
 
   // Calculate loss value and evaluation metric.
   MetricInfo calc_metric(std::vector<Reader*>& reader_list);
 
-  // Calculate average metric for cross-validation
-  void show_average_metric();
+  // Evaluate the model by the loss, and the phases are timed if
+  // timed is true. The loss and the metric of the distributed
+  // training are the ones of all the nodes.
+  MetricInfo evaluate(std::vector<Reader*>& reader_list,
+                      Model* model, Loss* loss, bool timed);
+
+  // Sum the loss and the metric of the validation data of all the
+  // nodes, and return the loss of all of them.
+  real_t reduce_metric(real_t loss_val, double num_rows);
+
+  // Start the validation of the snapshot of model_ in the
+  // background, and wait for its result.
+  void start_validation(std::vector<Reader*>& test_reader);
+  MetricInfo wait_validation();
+
+  // The timer of the phase, or nullptr if it is not timed.
+  PhaseTime* phase(Phase p) { return profile_ ? &phase_[p] : nullptr; }
+
+  // Count the rows and the nonzeros of the gradient pass.
+  void count_rows(const DMatrix* matrix);
+
+  // Print and write the time of the phases of the epoch.
+  void show_profile(int epoch, double wall, double train_wall);
+
+  // The ratios of the hardware events of the phase for show_profile,
+  // which is empty if they are not counted.
+  static std::string perf_info(const PhaseTime& time);
+
+  // Print the training loss of the last epoch of each other task,
+  // and its loss of the validation data if it is not empty.
+  void show_task_info(std::vector<Reader*>& test_reader);
 
-  // Print information during the training.
+  // Print information during the training, where the values
+  // of NaN are not known (e.g., the epoch is not validated).
+  // te_metric has the values of the metric list (-x), which is
+  // empty if they are not known.
   void show_head_info(bool validate);
   void show_train_info(real_t tr_loss, 
+                       real_t tr_metric,
                        real_t te_loss,
-                       real_t te_metric,
+                       const std::vector<real_t>& te_metric,
                        real_t time_cost, 
                        bool validate,
-                       index_t epoch);
+                       real_t epoch);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Trainer);